@@ -13,6 +13,7 @@
 #include <cutils/process_name.h>
 #include <cutils/memory.h>
 #include <cutils/trace.h>
+#include <utils/Timers.h>
 #include <android_runtime/AndroidRuntime.h>
 
 #include <stdlib.h>
@@ -21,6 +22,9 @@
 
 namespace android {
 
+// Time at which app_process started, used to report zygote startup timing
+static nsecs_t gStartTime;
+
 void app_usage()
 {
     fprintf(stderr,
@@ -55,7 +59,10 @@ public:
     virtual void onVmCreated(JNIEnv* env)
     {
         if (mClassName == NULL) {
-            return; // Zygote. Nothing to do here.
+            // Zygote. Nothing to do here but report how long VM startup took.
+            ALOGI("Zygote VM created in %lld ms",
+                    ns2ms(systemTime(SYSTEM_TIME_MONOTONIC) - gStartTime));
+            return;
         }
 
         /*
@@ -135,6 +142,8 @@ static void setArgv0(const char *argv0, const char *newArgv0)
 
 int main(int argc, char* const argv[])
 {
+    gStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
+
     // These are global variables in ProcessState.cpp
     mArgC = argc;
     mArgV = argv;
@@ -17,6 +17,7 @@ LOCAL_SHARED_LIBRARIES := \
 	libskia \
     libEGL \
     libGLESv1_CM \
+    libETC1 \
     libgui
 
 LOCAL_C_INCLUDES := \
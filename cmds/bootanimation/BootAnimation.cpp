@@ -29,6 +29,7 @@
 #include <binder/IPCThreadState.h>
 #include <utils/Atomic.h>
 #include <utils/Errors.h>
+#include <utils/KeyedVector.h>
 #include <utils/Log.h>
 #include <utils/threads.h>
 
@@ -50,6 +51,8 @@
 #include <GLES/glext.h>
 #include <EGL/eglext.h>
 
+#include <ETC1/etc1.h>
+
 #include "BootAnimation.h"
 
 #define SYSTEM_BOOTANIMATION_FILE "/system/media/bootanimation.zip"
@@ -156,23 +159,34 @@ status_t BootAnimation::initTexture(Texture* texture, AssetManager& assets,
     return NO_ERROR;
 }
 
-status_t BootAnimation::initTexture(void* buffer, size_t len)
+bool BootAnimation::decodeImage(const void* buffer, size_t len, SkBitmap* bitmap)
 {
     //StopWatch watch("blah");
 
-    SkBitmap bitmap;
     SkMemoryStream  stream(buffer, len);
     SkImageDecoder* codec = SkImageDecoder::Factory(&stream);
-    if (codec) {
-        codec->setDitherImage(false);
-        codec->decode(&stream, &bitmap,
-                SkBitmap::kARGB_8888_Config,
-                SkImageDecoder::kDecodePixels_Mode);
-        delete codec;
+    if (!codec) {
+        return false;
     }
+    codec->setDitherImage(false);
+    bool decoded = codec->decode(&stream, bitmap,
+            SkBitmap::kARGB_8888_Config,
+            SkImageDecoder::kDecodePixels_Mode);
+    delete codec;
+    return decoded;
+}
+
+status_t BootAnimation::initTexture(void* buffer, size_t len)
+{
+    SkBitmap bitmap;
+    decodeImage(buffer, len, &bitmap);
+    return initTexture(bitmap);
+}
 
+status_t BootAnimation::initTexture(const SkBitmap& bitmap)
+{
     // ensure we can call getPixels(). No need to call unlock, since the
-    // bitmap will go out of scope when we return from this method.
+    // bitmap will go out of scope when the caller is done with it.
     bitmap.lockPixels();
 
     const int w = bitmap.width();
@@ -218,6 +232,109 @@ status_t BootAnimation::initTexture(void* buffer, size_t len)
     return NO_ERROR;
 }
 
+// ETC1 frames come in the PKM container written by etc1tool
+static bool isValidPkm(const void* buffer, size_t len)
+{
+    const etc1_byte* pkm = (const etc1_byte*) buffer;
+    return len >= ETC_PKM_HEADER_SIZE && etc1_pkm_is_valid(pkm)
+            && len - ETC_PKM_HEADER_SIZE >= etc1_get_encoded_data_size(
+                    etc1_pkm_get_width(pkm), etc1_pkm_get_height(pkm));
+}
+
+static bool isPowerOfTwo(etc1_uint32 n)
+{
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+// Returns true if GL can take the ETC1 data of the frame as is: the GLES 1.x
+// context has no NPOT textures, and compressed data can't be padded
+bool BootAnimation::canUploadCompressed(const void* buffer, size_t len)
+{
+    if (!isValidPkm(buffer, len)) {
+        return false;
+    }
+    const etc1_byte* pkm = (const etc1_byte*) buffer;
+    // Data is padded to whole 4x4 blocks
+    return isPowerOfTwo((etc1_pkm_get_width(pkm) + 3) & ~3)
+            && isPowerOfTwo((etc1_pkm_get_height(pkm) + 3) & ~3);
+}
+
+status_t BootAnimation::initCompressedTexture(const void* buffer, size_t len)
+{
+    if (!canUploadCompressed(buffer, len)) {
+        ALOGE("Bad ETC1 frame");
+        return BAD_VALUE;
+    }
+    // The crop rect hides the padding
+    const etc1_byte* pkm = (const etc1_byte*) buffer;
+    const int w = etc1_pkm_get_width(pkm);
+    const int h = etc1_pkm_get_height(pkm);
+    const int tw = (w + 3) & ~3;
+    const int th = (h + 3) & ~3;
+
+    GLint crop[4] = { 0, h, w, -h };
+    glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_ETC1_RGB8_OES, tw, th, 0,
+            etc1_get_encoded_data_size(w, h), pkm + ETC_PKM_HEADER_SIZE);
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_CROP_RECT_OES, crop);
+    return NO_ERROR;
+}
+
+// Decodes ETC1 frames GL can't take as is, like any PNG frame
+static bool decodePkm(const void* buffer, size_t len, SkBitmap* bitmap)
+{
+    if (!isValidPkm(buffer, len)) {
+        ALOGE("Bad ETC1 frame");
+        return false;
+    }
+    const etc1_byte* pkm = (const etc1_byte*) buffer;
+    const etc1_uint32 w = etc1_pkm_get_width(pkm);
+    const etc1_uint32 h = etc1_pkm_get_height(pkm);
+    bitmap->setConfig(SkBitmap::kRGB_565_Config, w, h);
+    if (!bitmap->allocPixels()) {
+        return false;
+    }
+    return etc1_decode_image(pkm + ETC_PKM_HEADER_SIZE, (etc1_byte*) bitmap->getPixels(),
+            w, h, 2, bitmap->rowBytes()) == 0;
+}
+
+bool BootAnimation::decodeFrame(const Animation::Frame& frame, SkBitmap* bitmap)
+{
+    const void* data = frame.map->getDataPtr();
+    const size_t len = frame.map->getDataLength();
+    return frame.compressed ? decodePkm(data, len, bitmap) : decodeImage(data, len, bitmap);
+}
+
+void BootAnimation::initCanvas(int w, int h)
+{
+    GLint crop[4] = { 0, h, w, -h };
+    int tw = 1 << (31 - __builtin_clz(w));
+    int th = 1 << (31 - __builtin_clz(h));
+    if (tw < w) tw <<= 1;
+    if (th < h) th <<= 1;
+
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tw, th, 0, GL_RGBA,
+            GL_UNSIGNED_BYTE, 0);
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_CROP_RECT_OES, crop);
+}
+
+void BootAnimation::updateCanvas(const SkBitmap& bitmap, int x, int y)
+{
+    // The canvas is RGBA, so anything else is converted first
+    SkBitmap converted;
+    const SkBitmap* src = &bitmap;
+    if (bitmap.getConfig() != SkBitmap::kARGB_8888_Config) {
+        if (!bitmap.copyTo(&converted, SkBitmap::kARGB_8888_Config)) {
+            return;
+        }
+        src = &converted;
+    }
+
+    src->lockPixels();
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, src->width(), src->height(),
+            GL_RGBA, GL_UNSIGNED_BYTE, src->getPixels());
+    src->unlockPixels();
+}
+
 status_t BootAnimation::readyToRun() {
     mAssets.addDefaultAssets();
 
@@ -389,6 +506,109 @@ void BootAnimation::checkExit() {
     }
 }
 
+BootAnimation::FrameDecoder::FrameDecoder(const Animation& animation)
+    : Thread(false), mNext(0), mConsumed(0), mDecoding(-1)
+{
+    for (size_t i=0 ; i<animation.parts.size() ; i++) {
+        const Animation::Part& part(animation.parts[i]);
+        mPartStart.add(mSequence.size());
+        for (size_t j=0 ; j<part.frames.size() ; j++) {
+            mSequence.add(&part.frames[j]);
+        }
+    }
+}
+
+BootAnimation::FrameDecoder::~FrameDecoder()
+{
+    for (List<DecodedFrame>::iterator it = mFrames.begin(); it != mFrames.end(); ++it) {
+        delete it->bitmap;
+    }
+}
+
+void BootAnimation::FrameDecoder::stop()
+{
+    {
+        Mutex::Autolock _l(mLock);
+        requestExit();
+        mCondition.broadcast();
+    }
+    requestExitAndWait();
+}
+
+bool BootAnimation::FrameDecoder::threadLoop()
+{
+    size_t index;
+    {
+        Mutex::Autolock _l(mLock);
+        while (!exitPending() && mFrames.size() >= kMaxDecodedFrames) {
+            mCondition.wait(mLock);
+        }
+        if (exitPending() || mNext >= mSequence.size()) {
+            return false;
+        }
+        index = mNext++;
+        mDecoding = index;
+    }
+
+    const Animation::Frame* frame = mSequence[index];
+    SkBitmap* bitmap = new SkBitmap;
+    if (!frame->direct) {
+        decodeFrame(*frame, bitmap);
+    }
+
+    Mutex::Autolock _l(mLock);
+    mDecoding = -1;
+    if (index >= mConsumed) {
+        DecodedFrame decoded;
+        decoded.index = index;
+        decoded.bitmap = bitmap;
+        mFrames.push_back(decoded);
+    } else {
+        // The render loop skipped ahead while this was being decoded
+        delete bitmap;
+    }
+    mCondition.broadcast();
+    return true;
+}
+
+void BootAnimation::FrameDecoder::getFrame(size_t part, size_t frame, SkBitmap* bitmap)
+{
+    const size_t index = mPartStart[part] + frame;
+    {
+        Mutex::Autolock _l(mLock);
+        mConsumed = index;
+        for (;;) {
+            // Drop frames of parts or passes the render loop has skipped
+            while (!mFrames.empty() && mFrames.begin()->index < index) {
+                delete mFrames.begin()->bitmap;
+                mFrames.erase(mFrames.begin());
+            }
+            if (!mFrames.empty() && mFrames.begin()->index == index) {
+                SkBitmap* decoded = mFrames.begin()->bitmap;
+                mFrames.erase(mFrames.begin());
+                mCondition.broadcast();
+                bitmap->swap(*decoded);
+                delete decoded;
+                return;
+            }
+            if (mDecoding != (ssize_t) index) {
+                break;
+            }
+            mCondition.wait(mLock);
+        }
+        // Not decoded yet: take it over and let the thread carry on after it
+        if (mNext <= index) {
+            mNext = index + 1;
+        }
+        mCondition.broadcast();
+    }
+
+    const Animation::Frame* f = mSequence[index];
+    if (!f->direct) {
+        decodeFrame(*f, bitmap);
+    }
+}
+
 bool BootAnimation::movie()
 {
     ZipEntryRO desc = mZip->findEntryByName("desc.txt");
@@ -409,6 +629,8 @@ bool BootAnimation::movie()
     char const* s = desString.string();
 
     Animation animation;
+    // Entry name -> origin of the rect a delta frame covers
+    KeyedVector<String8, Point> deltas;
 
     // Parse the description file
     for (;;) {
@@ -419,12 +641,17 @@ bool BootAnimation::movie()
         int fps, width, height, count, pause;
         char path[ANIM_ENTRY_NAME_MAX];
         char pathType;
+        int x, y;
         if (sscanf(l, "%d %d %d", &width, &height, &fps) == 3) {
             //LOGD("> w=%d, h=%d, fps=%d", width, height, fps);
             animation.width = width;
             animation.height = height;
             animation.fps = fps;
         }
+        else if (sscanf(l, " o %d %d %s", &x, &y, path) == 3) {
+            // "o x y part/frame.png": frame only covers the rect at x, y
+            deltas.add(String8(path), Point(x, y));
+        }
         else if (sscanf(l, " %c %d %d %s", &pathType, &count, &pause, path) == 4) {
             //LOGD("> type=%c, count=%d, pause=%d, path=%s", pathType, count, pause, path);
             Animation::Part part;
@@ -432,6 +659,7 @@ bool BootAnimation::movie()
             part.count = count;
             part.pause = pause;
             part.path = path;
+            part.hasDeltas = false;
             animation.parts.add(part);
         }
 
@@ -440,6 +668,10 @@ bool BootAnimation::movie()
 
     // read all the data structures
     const size_t pcount = animation.parts.size();
+    // ETC1 frames are decoded like PNG frames where GL can't take them
+    const char* extensions = (const char*) glGetString(GL_EXTENSIONS);
+    const bool hasEtc1 = extensions != NULL
+            && strstr(extensions, "GL_OES_compressed_ETC1_RGB8_texture") != NULL;
     void *cookie = NULL;
     if (!mZip->startIteration(&cookie)) {
         return false;
@@ -461,7 +693,7 @@ bool BootAnimation::movie()
             for (size_t j=0 ; j<pcount ; j++) {
                 if (path == animation.parts[j].path) {
                     int method;
-                    // supports only stored png files
+                    // supports only stored png and pkm files
                     if (mZip->getEntryInfo(entry, &method, NULL, NULL, NULL, NULL, NULL)) {
                         if (method == ZipFileRO::kCompressStored) {
                             FileMap* map = mZip->createEntryFileMap(entry);
@@ -469,7 +701,21 @@ bool BootAnimation::movie()
                                 Animation::Frame frame;
                                 frame.name = leaf;
                                 frame.map = map;
+                                frame.tid = 0;
+                                frame.x = 0;
+                                frame.y = 0;
+                                frame.compressed = leaf.getPathExtension() == ".pkm";
+                                frame.direct = frame.compressed && hasEtc1
+                                        && canUploadCompressed(map->getDataPtr(),
+                                                map->getDataLength());
+                                frame.bitmap = NULL;
                                 Animation::Part& part(animation.parts.editItemAt(j));
+                                ssize_t index = deltas.indexOfKey(entryName);
+                                if (index >= 0) {
+                                    frame.x = deltas.valueAt(index).x;
+                                    frame.y = deltas.valueAt(index).y;
+                                    part.hasDeltas = true;
+                                }
                                 part.frames.add(frame);
                             }
                         }
@@ -481,6 +727,17 @@ bool BootAnimation::movie()
 
     mZip->endIteration(cookie);
 
+    // ETC1 textures can't be updated in part, so parts with delta frames
+    // decode their ETC1 frames into the canvas like PNG frames
+    for (size_t i=0 ; i<pcount ; i++) {
+        Animation::Part& part(animation.parts.editItemAt(i));
+        if (part.hasDeltas) {
+            for (size_t j=0 ; j<part.frames.size() ; j++) {
+                part.frames.editItemAt(j).direct = false;
+            }
+        }
+    }
+
     // clear screen
     glShadeModel(GL_FLAT);
     glDisable(GL_DITHER);
@@ -507,11 +764,25 @@ bool BootAnimation::movie()
     Region clearReg(Rect(mWidth, mHeight));
     clearReg.subtractSelf(Rect(xc, yc, xc+animation.width, yc+animation.height));
 
+    sp<FrameDecoder> decoder = new FrameDecoder(animation);
+    decoder->run("BootAnimationDecoder", PRIORITY_DISPLAY);
+
     for (size_t i=0 ; i<pcount ; i++) {
         const Animation::Part& part(animation.parts[i]);
         const size_t fcount = part.frames.size();
         glBindTexture(GL_TEXTURE_2D, 0);
 
+        // Parts with delta frames draw into one texture that each frame
+        // only partly updates; the first frame of such a part must be full
+        GLuint canvas = 0;
+        if (part.hasDeltas) {
+            glGenTextures(1, &canvas);
+            glBindTexture(GL_TEXTURE_2D, canvas);
+            glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            initCanvas(animation.width, animation.height);
+        }
+
         for (int r=0 ; !part.count || r<part.count ; r++) {
             // Exit any non playuntil complete parts immediately
             if(exitPending() && !part.playUntilComplete)
@@ -521,7 +792,14 @@ bool BootAnimation::movie()
                 const Animation::Frame& frame(part.frames[j]);
                 nsecs_t lastFrame = systemTime();
 
-                if (r > 0) {
+                if (part.hasDeltas) {
+                    // Only the changed rect is uploaded, on every pass
+                    if (r == 0) {
+                        frame.bitmap = new SkBitmap;
+                        decoder->getFrame(i, j, frame.bitmap);
+                    }
+                    updateCanvas(*frame.bitmap, frame.x, frame.y);
+                } else if (r > 0) {
                     glBindTexture(GL_TEXTURE_2D, frame.tid);
                 } else {
                     if (part.count != 1) {
@@ -530,9 +808,16 @@ bool BootAnimation::movie()
                         glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
                         glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
                     }
-                    initTexture(
-                            frame.map->getDataPtr(),
-                            frame.map->getDataLength());
+                    if (frame.direct) {
+                        // Uploaded straight from the mapped zip entry
+                        initCompressedTexture(
+                                frame.map->getDataPtr(),
+                                frame.map->getDataLength());
+                    } else {
+                        SkBitmap bitmap;
+                        decoder->getFrame(i, j, &bitmap);
+                        initTexture(bitmap);
+                    }
                 }
 
                 if (!clearReg.isEmpty()) {
@@ -576,7 +861,14 @@ bool BootAnimation::movie()
         }
 
         // free the textures for this part
-        if (part.count != 1) {
+        if (part.hasDeltas) {
+            glDeleteTextures(1, &canvas);
+            for (size_t j=0 ; j<fcount ; j++) {
+                const Animation::Frame& frame(part.frames[j]);
+                delete frame.bitmap;
+                frame.bitmap = NULL;
+            }
+        } else if (part.count != 1) {
             for (size_t j=0 ; j<fcount ; j++) {
                 const Animation::Frame& frame(part.frames[j]);
                 glDeleteTextures(1, &frame.tid);
@@ -584,6 +876,8 @@ bool BootAnimation::movie()
         }
     }
 
+    decoder->stop();
+
     return false;
 }
 
@@ -21,6 +21,7 @@
 #include <sys/types.h>
 
 #include <androidfw/AssetManager.h>
+#include <utils/List.h>
 #include <utils/threads.h>
 
 #include <EGL/egl.h>
@@ -61,6 +62,16 @@ private:
             String8 name;
             FileMap* map;
             mutable GLuint tid;
+            // Delta frames only cover the rect at (x, y) and are drawn over
+            // the previous frame; full frames are at 0, 0
+            int x;
+            int y;
+            // ETC1 data in a PKM container rather than a PNG
+            bool compressed;
+            // ETC1 data uploaded as is rather than decoded first
+            bool direct;
+            // Decoded once and kept, in parts that use delta frames
+            mutable SkBitmap* bitmap;
             bool operator < (const Frame& rhs) const {
                 return name < rhs.name;
             }
@@ -71,6 +82,7 @@ private:
             String8 path;
             SortedVector<Frame> frames;
             bool playUntilComplete;
+            bool hasDeltas;
         };
         int fps;
         int width;
@@ -78,8 +90,50 @@ private:
         Vector<Part> parts;
     };
 
+    // Decodes the frames of each part's first pass a few frames ahead of the
+    // render loop, so that PNG decoding doesn't eat into the frame budget.
+    // Texture upload stays on the render thread, which owns the GL context.
+    class FrameDecoder : public Thread {
+    public:
+        FrameDecoder(const Animation& animation);
+        virtual ~FrameDecoder();
+
+        // Hands back the decoded frame, decoding it on the caller's thread if
+        // the decoder fell behind. Frames before it are dropped.
+        void getFrame(size_t part, size_t frame, SkBitmap* bitmap);
+
+        void stop();
+
+    private:
+        struct DecodedFrame {
+            size_t index;
+            SkBitmap* bitmap;
+        };
+
+        static const size_t kMaxDecodedFrames = 4;
+
+        virtual bool threadLoop();
+
+        Mutex mLock;
+        Condition mCondition;
+        // Every frame of every part in play order, and where each part starts
+        Vector<const Animation::Frame*> mSequence;
+        Vector<size_t> mPartStart;
+        List<DecodedFrame> mFrames;
+        size_t mNext;       // next frame the thread will decode
+        size_t mConsumed;   // frame the render loop asked for last
+        ssize_t mDecoding;  // frame being decoded right now, or -1
+    };
+
+    static bool decodeImage(const void* buffer, size_t len, SkBitmap* bitmap);
+    static bool decodeFrame(const Animation::Frame& frame, SkBitmap* bitmap);
+    static bool canUploadCompressed(const void* buffer, size_t len);
     status_t initTexture(Texture* texture, AssetManager& asset, const char* name);
     status_t initTexture(void* buffer, size_t len);
+    status_t initTexture(const SkBitmap& bitmap);
+    status_t initCompressedTexture(const void* buffer, size_t len);
+    void initCanvas(int width, int height);
+    void updateCanvas(const SkBitmap& bitmap, int x, int y);
     bool android();
     bool movie();
 
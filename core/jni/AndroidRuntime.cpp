@@ -206,6 +206,12 @@ static void com_android_internal_os_RuntimeInit_nativeSetExitWithoutCleanup(JNIE
     gCurRuntime->setExitWithoutCleanup(exitWithoutCleanup);
 }
 
+static jboolean com_android_internal_os_RuntimeInit_nativeRegisterDeferredNatives(JNIEnv* env,
+        jobject clazz)
+{
+    return AndroidRuntime::registerDeferredNatives(env) == 0 ? JNI_TRUE : JNI_FALSE;
+}
+
 /*
  * JNI registration.
  */
@@ -216,6 +222,8 @@ static JNINativeMethod gMethods[] = {
         (void*) com_android_internal_os_RuntimeInit_nativeZygoteInit },
     { "nativeSetExitWithoutCleanup", "(Z)V",
         (void*) com_android_internal_os_RuntimeInit_nativeSetExitWithoutCleanup },
+    { "nativeRegisterDeferredNatives", "()Z",
+        (void*) com_android_internal_os_RuntimeInit_nativeRegisterDeferredNatives },
 };
 
 int register_com_android_internal_os_RuntimeInit(JNIEnv* env)
@@ -849,9 +857,12 @@ void AndroidRuntime::start(const char* className, const char* options)
     onVmCreated(env);
 
     /*
-     * Register android functions.
+     * Register android functions. Only the zygote, whose children inherit
+     * its registrations, pays for the optional subsystems up front.
      */
-    if (startReg(env) < 0) {
+    bool zygote = className != NULL &&
+            strcmp(className, "com.android.internal.os.ZygoteInit") == 0;
+    if (startReg(env, !zygote) < 0) {
         ALOGE("Unable to register all android natives\n");
         return;
     }
@@ -1110,7 +1121,6 @@ static const RegJNIRec gRegJNI[] = {
     REG_JNI(register_android_content_AssetManager),
     REG_JNI(register_android_content_StringBlock),
     REG_JNI(register_android_content_XmlBlock),
-    REG_JNI(register_android_emoji_EmojiFactory),
     REG_JNI(register_android_text_AndroidCharacter),
     REG_JNI(register_android_text_AndroidBidi),
     REG_JNI(register_android_view_InputDevice),
@@ -1130,21 +1140,9 @@ static const RegJNIRec gRegJNI[] = {
     REG_JNI(register_android_view_SurfaceControl),
     REG_JNI(register_android_view_SurfaceSession),
     REG_JNI(register_android_view_TextureView),
-    REG_JNI(register_com_google_android_gles_jni_EGLImpl),
-    REG_JNI(register_com_google_android_gles_jni_GLImpl),
-    REG_JNI(register_android_opengl_jni_EGL14),
-    REG_JNI(register_android_opengl_jni_EGLExt),
-    REG_JNI(register_android_opengl_jni_GLES10),
-    REG_JNI(register_android_opengl_jni_GLES10Ext),
-    REG_JNI(register_android_opengl_jni_GLES11),
-    REG_JNI(register_android_opengl_jni_GLES11Ext),
-    REG_JNI(register_android_opengl_jni_GLES20),
-    REG_JNI(register_android_opengl_jni_GLES30),
 
     REG_JNI(register_android_graphics_Bitmap),
     REG_JNI(register_android_graphics_BitmapFactory),
-    REG_JNI(register_android_graphics_BitmapRegionDecoder),
-    REG_JNI(register_android_graphics_Camera),
     REG_JNI(register_android_graphics_CreateJavaOutputStreamAdaptor),
     REG_JNI(register_android_graphics_Canvas),
     REG_JNI(register_android_graphics_ColorFilter),
@@ -1153,7 +1151,6 @@ static const RegJNIRec gRegJNI[] = {
     REG_JNI(register_android_graphics_LayerRasterizer),
     REG_JNI(register_android_graphics_MaskFilter),
     REG_JNI(register_android_graphics_Matrix),
-    REG_JNI(register_android_graphics_Movie),
     REG_JNI(register_android_graphics_NinePatch),
     REG_JNI(register_android_graphics_Paint),
     REG_JNI(register_android_graphics_Path),
@@ -1167,8 +1164,6 @@ static const RegJNIRec gRegJNI[] = {
     REG_JNI(register_android_graphics_SurfaceTexture),
     REG_JNI(register_android_graphics_Typeface),
     REG_JNI(register_android_graphics_Xfermode),
-    REG_JNI(register_android_graphics_YuvImage),
-    REG_JNI(register_android_graphics_pdf_PdfDocument),
 
     REG_JNI(register_android_database_CursorWindow),
     REG_JNI(register_android_database_SQLiteConnection),
@@ -1183,55 +1178,86 @@ static const RegJNIRec gRegJNI[] = {
     REG_JNI(register_android_net_LocalSocketImpl),
     REG_JNI(register_android_net_NetworkUtils),
     REG_JNI(register_android_net_TrafficStats),
-    REG_JNI(register_android_net_wifi_WifiNative),
     REG_JNI(register_android_os_MemoryFile),
     REG_JNI(register_com_android_internal_os_ZygoteInit),
+    REG_JNI(register_android_hardware_SensorManager),
+    REG_JNI(register_android_media_AudioSystem),
+
+    REG_JNI(register_android_server_NetworkManagementSocketTagger),
+    REG_JNI(register_android_server_Watchdog),
+    REG_JNI(register_android_app_ActivityThread),
+    REG_JNI(register_android_view_InputChannel),
+    REG_JNI(register_android_view_InputEventReceiver),
+    REG_JNI(register_android_view_InputEventSender),
+    REG_JNI(register_android_view_InputQueue),
+    REG_JNI(register_android_view_KeyEvent),
+    REG_JNI(register_android_view_MotionEvent),
+    REG_JNI(register_android_view_PointerIcon),
+    REG_JNI(register_android_view_VelocityTracker),
+
+    REG_JNI(register_android_content_res_Configuration),
+
+    REG_JNI(register_android_animation_PropertyValuesHolder),
+    REG_JNI(register_com_android_internal_content_NativeLibraryHelper),
+};
+
+/*
+ * Natives of subsystems that many processes never use. The zygote registers
+ * them eagerly so that every app inherits them; other processes (app_process
+ * tools, cmds) register them on first demand through registerDeferredNatives().
+ */
+static const RegJNIRec gDeferredRegJNI[] = {
+    REG_JNI(register_com_google_android_gles_jni_EGLImpl),
+    REG_JNI(register_com_google_android_gles_jni_GLImpl),
+    REG_JNI(register_android_opengl_jni_EGL14),
+    REG_JNI(register_android_opengl_jni_EGLExt),
+    REG_JNI(register_android_opengl_jni_GLES10),
+    REG_JNI(register_android_opengl_jni_GLES10Ext),
+    REG_JNI(register_android_opengl_jni_GLES11),
+    REG_JNI(register_android_opengl_jni_GLES11Ext),
+    REG_JNI(register_android_opengl_jni_GLES20),
+    REG_JNI(register_android_opengl_jni_GLES30),
+    REG_JNI(register_android_opengl_classes),
+
+    REG_JNI(register_android_emoji_EmojiFactory),
+    REG_JNI(register_android_graphics_BitmapRegionDecoder),
+    REG_JNI(register_android_graphics_Camera),
+    REG_JNI(register_android_graphics_Movie),
+    REG_JNI(register_android_graphics_YuvImage),
+    REG_JNI(register_android_graphics_pdf_PdfDocument),
+
+    REG_JNI(register_android_net_wifi_WifiNative),
     REG_JNI(register_android_hardware_Camera),
     REG_JNI(register_android_hardware_camera2_CameraMetadata),
-    REG_JNI(register_android_hardware_SensorManager),
     REG_JNI(register_android_hardware_SerialPort),
     REG_JNI(register_android_hardware_UsbDevice),
     REG_JNI(register_android_hardware_UsbDeviceConnection),
     REG_JNI(register_android_hardware_UsbRequest),
+
     REG_JNI(register_android_media_AudioRecord),
-    REG_JNI(register_android_media_AudioSystem),
     REG_JNI(register_android_media_AudioTrack),
     REG_JNI(register_android_media_JetPlayer),
     REG_JNI(register_android_media_RemoteDisplay),
     REG_JNI(register_android_media_ToneGenerator),
 
-    REG_JNI(register_android_opengl_classes),
-    REG_JNI(register_android_server_NetworkManagementSocketTagger),
-    REG_JNI(register_android_server_Watchdog),
     REG_JNI(register_android_ddm_DdmHandleNativeHeap),
     REG_JNI(register_android_backup_BackupDataInput),
     REG_JNI(register_android_backup_BackupDataOutput),
     REG_JNI(register_android_backup_FileBackupHelperBase),
     REG_JNI(register_android_backup_BackupHelperDispatcher),
     REG_JNI(register_android_app_backup_FullBackup),
-    REG_JNI(register_android_app_ActivityThread),
     REG_JNI(register_android_app_NativeActivity),
-    REG_JNI(register_android_view_InputChannel),
-    REG_JNI(register_android_view_InputEventReceiver),
-    REG_JNI(register_android_view_InputEventSender),
-    REG_JNI(register_android_view_InputQueue),
-    REG_JNI(register_android_view_KeyEvent),
-    REG_JNI(register_android_view_MotionEvent),
-    REG_JNI(register_android_view_PointerIcon),
-    REG_JNI(register_android_view_VelocityTracker),
-
     REG_JNI(register_android_content_res_ObbScanner),
-    REG_JNI(register_android_content_res_Configuration),
-
-    REG_JNI(register_android_animation_PropertyValuesHolder),
-    REG_JNI(register_com_android_internal_content_NativeLibraryHelper),
     REG_JNI(register_com_android_internal_net_NetworkStatsFactory),
 };
 
+static Mutex gDeferredRegLock;
+static bool gDeferredRegDone = false;
+
 /*
  * Register android native functions with the VM.
  */
-/*static*/ int AndroidRuntime::startReg(JNIEnv* env)
+/*static*/ int AndroidRuntime::startReg(JNIEnv* env, bool deferOptional)
 {
     /*
      * This hook causes all future threads created in this process to be
@@ -1256,11 +1282,36 @@ static const RegJNIRec gRegJNI[] = {
     }
     env->PopLocalFrame(NULL);
 
+    if (!deferOptional) {
+        return registerDeferredNatives(env);
+    }
+
     //createJavaThread("fubar", quickTest, (void*) "hello");
 
     return 0;
 }
 
+/*static*/ int AndroidRuntime::registerDeferredNatives(JNIEnv* env)
+{
+    AutoMutex _l(gDeferredRegLock);
+    if (gDeferredRegDone) {
+        return 0;
+    }
+
+    ALOGV("--- registering deferred native functions ---\n");
+
+    env->PushLocalFrame(200);
+    int result = register_jni_procs(gDeferredRegJNI, NELEM(gDeferredRegJNI), env);
+    env->PopLocalFrame(NULL);
+    if (result < 0) {
+        ALOGE("Unable to register deferred android natives\n");
+        return -1;
+    }
+
+    gDeferredRegDone = true;
+    return 0;
+}
+
 AndroidRuntime* AndroidRuntime::getRuntime()
 {
     return gCurRuntime;
@@ -1272,7 +1323,10 @@ AndroidRuntime* AndroidRuntime::getRuntime()
 extern "C"
 jint Java_com_android_internal_util_WithFramework_registerNatives(
         JNIEnv* env, jclass clazz) {
-    return register_jni_procs(gRegJNI, NELEM(gRegJNI), env);
+    if (register_jni_procs(gRegJNI, NELEM(gRegJNI), env) < 0) {
+        return -1;
+    }
+    return AndroidRuntime::registerDeferredNatives(env);
 }
 
 /**
@@ -1280,7 +1334,10 @@ jint Java_com_android_internal_util_WithFramework_registerNatives(
  */
 extern "C"
 jint Java_LoadClass_registerNatives(JNIEnv* env, jclass clazz) {
-    return register_jni_procs(gRegJNI, NELEM(gRegJNI), env);
+    if (register_jni_procs(gRegJNI, NELEM(gRegJNI), env) < 0) {
+        return -1;
+    }
+    return AndroidRuntime::registerDeferredNatives(env);
 }
 
 }   // namespace android
@@ -17,12 +17,240 @@
 
 #include <Caches.h>
 
+#if defined(__ARM_HAVE_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define BITMAP_USE_NEON 1
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+    #define BITMAP_USE_SSE2 1
+#endif
+
 #if 0
     #define TRACE_BITMAP(code)  code
 #else
     #define TRACE_BITMAP(code)
 #endif
 
+///////////////////////////////////////////////////////////////////////////////
+// Vectorized row kernels for the conversions below. Each one converts the
+// leading pixels of a row in whole vectors and returns how many it did; the
+// caller converts the rest one at a time. They give the same results as the
+// scalar code, so a row can be split anywhere between the two.
+
+#if BITMAP_USE_NEON
+
+// Byte planes of 8 SkColors loaded with vld4_u8 (little endian ARGB)
+#define COLOR_PLANE_B 0
+#define COLOR_PLANE_G 1
+#define COLOR_PLANE_R 2
+#define COLOR_PLANE_A 3
+
+// x * a / 255, rounded like SkMulDiv255Round
+static inline uint8x8_t MulDiv255Round_NEON(uint8x8_t x, uint8x8_t a) {
+    uint16x8_t prod = vaddq_u16(vmull_u8(x, a), vdupq_n_u16(128));
+    return vshrn_n_u16(vaddq_u16(prod, vshrq_n_u16(prod, 8)), 8);
+}
+
+static int Premultiply_Row(SkPMColor* dst, const SkColor* src, int width) {
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        uint8x8x4_t c = vld4_u8((const uint8_t*)(src + i));
+        uint8x8_t a = c.val[COLOR_PLANE_A];
+        uint8x8x4_t pm;
+        pm.val[SK_A32_SHIFT / 8] = a;
+        pm.val[SK_R32_SHIFT / 8] = MulDiv255Round_NEON(c.val[COLOR_PLANE_R], a);
+        pm.val[SK_G32_SHIFT / 8] = MulDiv255Round_NEON(c.val[COLOR_PLANE_G], a);
+        pm.val[SK_B32_SHIFT / 8] = MulDiv255Round_NEON(c.val[COLOR_PLANE_B], a);
+        vst4_u8((uint8_t*)(dst + i), pm);
+    }
+    return i;
+}
+
+static int ColorToPM_Row(SkPMColor* dst, const SkColor* src, int width) {
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        uint8x8x4_t c = vld4_u8((const uint8_t*)(src + i));
+        uint8x8x4_t pm;
+        pm.val[SK_A32_SHIFT / 8] = c.val[COLOR_PLANE_A];
+        pm.val[SK_R32_SHIFT / 8] = c.val[COLOR_PLANE_R];
+        pm.val[SK_G32_SHIFT / 8] = c.val[COLOR_PLANE_G];
+        pm.val[SK_B32_SHIFT / 8] = c.val[COLOR_PLANE_B];
+        vst4_u8((uint8_t*)(dst + i), pm);
+    }
+    return i;
+}
+
+static inline void PMToColor8_NEON(SkColor* dst, uint8x8x4_t pm, bool opaque) {
+    uint8x8x4_t c;
+    c.val[COLOR_PLANE_A] = opaque ? vdup_n_u8(0xFF) : pm.val[SK_A32_SHIFT / 8];
+    c.val[COLOR_PLANE_R] = pm.val[SK_R32_SHIFT / 8];
+    c.val[COLOR_PLANE_G] = pm.val[SK_G32_SHIFT / 8];
+    c.val[COLOR_PLANE_B] = pm.val[SK_B32_SHIFT / 8];
+    vst4_u8((uint8_t*)dst, c);
+}
+
+static int PMToColor_Row(SkColor* dst, const SkPMColor* src, int width, bool opaque) {
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        PMToColor8_NEON(dst + i, vld4_u8((const uint8_t*)(src + i)), opaque);
+    }
+    return i;
+}
+
+static int UnPremultiply_Row(SkColor* dst, const SkPMColor* src, int width) {
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        uint8x8x4_t pm = vld4_u8((const uint8_t*)(src + i));
+        uint64_t alphas = vget_lane_u64(vreinterpret_u64_u8(pm.val[SK_A32_SHIFT / 8]), 0);
+        if (alphas == ~0ULL) {
+            // all opaque, nothing to divide
+            PMToColor8_NEON(dst + i, pm, false);
+        } else if (alphas == 0) {
+            // all transparent, premultiplied channels are 0
+            vst1q_u32((uint32_t*)(dst + i), vdupq_n_u32(0));
+            vst1q_u32((uint32_t*)(dst + i + 4), vdupq_n_u32(0));
+        } else {
+            for (int j = i; j < i + 8; j++) {
+                dst[j] = SkUnPreMultiply::PMColorToColor(src[j]);
+            }
+        }
+    }
+    return i;
+}
+
+static int S565ToColor_Row(SkColor* dst, const uint16_t* src, int width) {
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        uint16x8_t c = vld1q_u16(src + i);
+        uint16x8_t r = vshrq_n_u16(c, 11);
+        uint16x8_t g = vandq_u16(vshrq_n_u16(c, 5), vdupq_n_u16(0x3F));
+        uint16x8_t b = vandq_u16(c, vdupq_n_u16(0x1F));
+        // widen to 8 bits by replicating the high bits, like SkPacked16ToR32
+        uint8x8x4_t out;
+        out.val[COLOR_PLANE_A] = vdup_n_u8(0xFF);
+        out.val[COLOR_PLANE_R] = vmovn_u16(vorrq_u16(vshlq_n_u16(r, 3), vshrq_n_u16(r, 2)));
+        out.val[COLOR_PLANE_G] = vmovn_u16(vorrq_u16(vshlq_n_u16(g, 2), vshrq_n_u16(g, 4)));
+        out.val[COLOR_PLANE_B] = vmovn_u16(vorrq_u16(vshlq_n_u16(b, 3), vshrq_n_u16(b, 2)));
+        vst4_u8((uint8_t*)(dst + i), out);
+    }
+    return i;
+}
+
+#elif BITMAP_USE_SSE2
+
+// Moves the byte at bit "from" of each 32-bit lane to bit "to"
+#define MOVE_BYTE_SSE2(v, from, to) \
+    _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(v, from), _mm_set1_epi32(0xFF)), to)
+
+static inline __m128i ColorToPM4_SSE2(__m128i c) {
+    return _mm_or_si128(
+            _mm_or_si128(MOVE_BYTE_SSE2(c, 24, SK_A32_SHIFT), MOVE_BYTE_SSE2(c, 16, SK_R32_SHIFT)),
+            _mm_or_si128(MOVE_BYTE_SSE2(c, 8, SK_G32_SHIFT), MOVE_BYTE_SSE2(c, 0, SK_B32_SHIFT)));
+}
+
+static inline __m128i PMToColor4_SSE2(__m128i pm) {
+    return _mm_or_si128(
+            _mm_or_si128(MOVE_BYTE_SSE2(pm, SK_A32_SHIFT, 24), MOVE_BYTE_SSE2(pm, SK_R32_SHIFT, 16)),
+            _mm_or_si128(MOVE_BYTE_SSE2(pm, SK_G32_SHIFT, 8), MOVE_BYTE_SSE2(pm, SK_B32_SHIFT, 0)));
+}
+
+// 2 pixels as 8 16-bit channels, each times its pixel's alpha / 255, rounded
+// like SkMulDiv255Round
+static inline __m128i MulDiv255Round2_SSE2(__m128i x) {
+    const int A = SK_A32_SHIFT / 8;
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(A, A, A, A)),
+            _MM_SHUFFLE(A, A, A, A));
+    __m128i prod = _mm_add_epi16(_mm_mullo_epi16(x, a), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(prod, _mm_srli_epi16(prod, 8)), 8);
+}
+
+static int Premultiply_Row(SkPMColor* dst, const SkColor* src, int width) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaMask = _mm_set1_epi32((int) (0xFFu << SK_A32_SHIFT));
+    int i = 0;
+    for (; i + 4 <= width; i += 4) {
+        __m128i pm = ColorToPM4_SSE2(_mm_loadu_si128((const __m128i*)(src + i)));
+        __m128i lo = MulDiv255Round2_SSE2(_mm_unpacklo_epi8(pm, zero));
+        __m128i hi = MulDiv255Round2_SSE2(_mm_unpackhi_epi8(pm, zero));
+        // the alpha channel was multiplied too; put the original back
+        __m128i out = _mm_or_si128(_mm_andnot_si128(alphaMask, _mm_packus_epi16(lo, hi)),
+                _mm_and_si128(alphaMask, pm));
+        _mm_storeu_si128((__m128i*)(dst + i), out);
+    }
+    return i;
+}
+
+static int ColorToPM_Row(SkPMColor* dst, const SkColor* src, int width) {
+    int i = 0;
+    for (; i + 4 <= width; i += 4) {
+        __m128i c = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), ColorToPM4_SSE2(c));
+    }
+    return i;
+}
+
+static int PMToColor_Row(SkColor* dst, const SkPMColor* src, int width, bool opaque) {
+    const __m128i alpha = _mm_set1_epi32(opaque ? 0xFF000000 : 0);
+    int i = 0;
+    for (; i + 4 <= width; i += 4) {
+        __m128i c = PMToColor4_SSE2(_mm_loadu_si128((const __m128i*)(src + i)));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(c, alpha));
+    }
+    return i;
+}
+
+static int UnPremultiply_Row(SkColor* dst, const SkPMColor* src, int width) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaMask = _mm_set1_epi32((int) (0xFFu << SK_A32_SHIFT));
+    int i = 0;
+    for (; i + 4 <= width; i += 4) {
+        __m128i pm = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i alphas = _mm_and_si128(pm, alphaMask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(alphas, alphaMask)) == 0xFFFF) {
+            // all opaque, nothing to divide
+            _mm_storeu_si128((__m128i*)(dst + i), PMToColor4_SSE2(pm));
+        } else if (_mm_movemask_epi8(_mm_cmpeq_epi32(alphas, zero)) == 0xFFFF) {
+            // all transparent, premultiplied channels are 0
+            _mm_storeu_si128((__m128i*)(dst + i), zero);
+        } else {
+            for (int j = i; j < i + 4; j++) {
+                dst[j] = SkUnPreMultiply::PMColorToColor(src[j]);
+            }
+        }
+    }
+    return i;
+}
+
+static int S565ToColor_Row(SkColor* dst, const uint16_t* src, int width) {
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        __m128i c = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i r = _mm_srli_epi16(c, 11);
+        __m128i g = _mm_and_si128(_mm_srli_epi16(c, 5), _mm_set1_epi16(0x3F));
+        __m128i b = _mm_and_si128(c, _mm_set1_epi16(0x1F));
+        // widen to 8 bits by replicating the high bits, like SkPacked16ToR32
+        r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+        b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+        // the low and high halves of the ARGB pixels, then interleaved
+        __m128i gb = _mm_or_si128(_mm_slli_epi16(g, 8), b);
+        __m128i ar = _mm_or_si128(_mm_set1_epi16((short) 0xFF00), r);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi16(gb, ar));
+        _mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi16(gb, ar));
+    }
+    return i;
+}
+
+#else
+
+static inline int Premultiply_Row(SkPMColor*, const SkColor*, int) { return 0; }
+static inline int ColorToPM_Row(SkPMColor*, const SkColor*, int) { return 0; }
+static inline int PMToColor_Row(SkColor*, const SkPMColor*, int, bool) { return 0; }
+static inline int UnPremultiply_Row(SkColor*, const SkPMColor*, int) { return 0; }
+static inline int S565ToColor_Row(SkColor*, const uint16_t*, int) { return 0; }
+
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 // Conversions to/from SkColor, for get/setPixels, and the create method, which
 // is basically like setPixels
@@ -34,8 +262,8 @@ static void FromColor_D32(void* dst, const SkColor src[], int width,
                           int, int) {
     SkPMColor* d = (SkPMColor*)dst;
 
-    for (int i = 0; i < width; i++) {
-        *d++ = SkPreMultiplyColor(*src++);
+    for (int i = Premultiply_Row(d, src, width); i < width; i++) {
+        d[i] = SkPreMultiplyColor(src[i]);
     }
 }
 
@@ -49,9 +277,9 @@ static void FromColor_D32_Raw(void* dst, const SkColor src[], int width,
 
     // order isn't same, repack each pixel manually
     SkPMColor* d = (SkPMColor*)dst;
-    for (int i = 0; i < width; i++) {
-        SkColor c = *src++;
-        *d++ = SkPackARGB32NoCheck(SkColorGetA(c), SkColorGetR(c),
+    for (int i = ColorToPM_Row(d, src, width); i < width; i++) {
+        SkColor c = src[i];
+        d[i] = SkPackARGB32NoCheck(SkColorGetA(c), SkColorGetR(c),
                                    SkColorGetG(c), SkColorGetB(c));
     }
 }
@@ -150,31 +378,31 @@ static void ToColor_S32_Alpha(SkColor dst[], const void* src, int width,
                               SkColorTable*) {
     SkASSERT(width > 0);
     const SkPMColor* s = (const SkPMColor*)src;
-    do {
-        *dst++ = SkUnPreMultiply::PMColorToColor(*s++);
-    } while (--width != 0);
+    for (int i = UnPremultiply_Row(dst, s, width); i < width; i++) {
+        dst[i] = SkUnPreMultiply::PMColorToColor(s[i]);
+    }
 }
 
 static void ToColor_S32_Raw(SkColor dst[], const void* src, int width,
                               SkColorTable*) {
     SkASSERT(width > 0);
     const SkPMColor* s = (const SkPMColor*)src;
-    do {
-        SkPMColor c = *s++;
-        *dst++ = SkColorSetARGB(SkGetPackedA32(c), SkGetPackedR32(c),
+    for (int i = PMToColor_Row(dst, s, width, false); i < width; i++) {
+        SkPMColor c = s[i];
+        dst[i] = SkColorSetARGB(SkGetPackedA32(c), SkGetPackedR32(c),
                                 SkGetPackedG32(c), SkGetPackedB32(c));
-    } while (--width != 0);
+    }
 }
 
 static void ToColor_S32_Opaque(SkColor dst[], const void* src, int width,
                                SkColorTable*) {
     SkASSERT(width > 0);
     const SkPMColor* s = (const SkPMColor*)src;
-    do {
-        SkPMColor c = *s++;
-        *dst++ = SkColorSetRGB(SkGetPackedR32(c), SkGetPackedG32(c),
+    for (int i = PMToColor_Row(dst, s, width, true); i < width; i++) {
+        SkPMColor c = s[i];
+        dst[i] = SkColorSetRGB(SkGetPackedR32(c), SkGetPackedG32(c),
                                SkGetPackedB32(c));
-    } while (--width != 0);
+    }
 }
 
 static void ToColor_S4444_Alpha(SkColor dst[], const void* src, int width,
@@ -212,11 +440,11 @@ static void ToColor_S565(SkColor dst[], const void* src, int width,
                          SkColorTable*) {
     SkASSERT(width > 0);
     const uint16_t* s = (const uint16_t*)src;
-    do {
-        uint16_t c = *s++;
-        *dst++ =  SkColorSetRGB(SkPacked16ToR32(c), SkPacked16ToG32(c),
-                                SkPacked16ToB32(c));
-    } while (--width != 0);
+    for (int i = S565ToColor_Row(dst, s, width); i < width; i++) {
+        uint16_t c = s[i];
+        dst[i] = SkColorSetRGB(SkPacked16ToR32(c), SkPacked16ToG32(c),
+                               SkPacked16ToB32(c));
+    }
 }
 
 static void ToColor_SI8_Alpha(SkColor dst[], const void* src, int width,
@@ -23,6 +23,8 @@
 #include <netinet/in.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
 
 jfieldID gOptions_justBoundsFieldID;
 jfieldID gOptions_sampleSizeFieldID;
@@ -148,7 +150,114 @@ static SkBitmap::Config configForScaledOutput(SkBitmap::Config config) {
     return config;
 }
 
-class ScaleCheckingAllocator : public SkBitmap::HeapAllocator {
+/*
+ * Native pixel buffers for the intermediate bitmaps of scaled decodes, kept
+ * in power-of-two size classes so that decoding a run of similar images,
+ * like thumbnails while scrolling, reuses the same few buffers.
+ */
+class DecodeBufferPool {
+public:
+    // Smallest and largest size class; others go straight to the heap.
+    static const size_t kMinBufferSize = 64 * 1024;
+    static const size_t kMaxBufferSize = 4 * 1024 * 1024;
+    // Bytes of idle buffers kept for reuse
+    static const size_t kMaxIdleBytes = 8 * 1024 * 1024;
+
+    DecodeBufferPool() : mIdleBytes(0) {}
+
+    /**
+     * Returns a buffer of at least "size" bytes, and its actual size in
+     * "capacity", or NULL if the size is out of the pooled range or memory
+     * is exhausted.
+     */
+    void* acquire(size_t size, size_t* capacity) {
+        if (size < kMinBufferSize || size > kMaxBufferSize) {
+            return NULL;
+        }
+        size_t sizeClass = 0;
+        while ((kMinBufferSize << sizeClass) < size) {
+            sizeClass++;
+        }
+        *capacity = kMinBufferSize << sizeClass;
+
+        {
+            Mutex::Autolock _l(mLock);
+            if (!mIdle[sizeClass].isEmpty()) {
+                void* buffer = mIdle[sizeClass].top();
+                mIdle[sizeClass].pop();
+                mIdleBytes -= *capacity;
+                return buffer;
+            }
+        }
+        return sk_malloc_flags(*capacity, 0);
+    }
+
+    void release(void* buffer, size_t capacity) {
+        size_t sizeClass = 0;
+        while ((kMinBufferSize << sizeClass) < capacity) {
+            sizeClass++;
+        }
+
+        Mutex::Autolock _l(mLock);
+        if (mIdleBytes + capacity > kMaxIdleBytes) {
+            sk_free(buffer);
+            return;
+        }
+        mIdle[sizeClass].push(buffer);
+        mIdleBytes += capacity;
+    }
+
+private:
+    static const size_t kSizeClasses = 7;   // 64KB to 4MB
+
+    Mutex mLock;
+    Vector<void*> mIdle[kSizeClasses];
+    size_t mIdleBytes;
+};
+
+static DecodeBufferPool gDecodeBufferPool;
+
+// Hands its pixels back to gDecodeBufferPool when the bitmap lets go of them.
+class PooledPixelRef : public SkMallocPixelRef {
+public:
+    PooledPixelRef(void* storage, size_t capacity, SkColorTable* ctable)
+            : SkMallocPixelRef(storage, capacity, ctable, false), mCapacity(capacity) {
+    }
+
+    virtual ~PooledPixelRef() {
+        gDecodeBufferPool.release(getAddr(), mCapacity);
+    }
+
+private:
+    const size_t mCapacity;
+};
+
+/*
+ * Allocates the pixels of the intermediate bitmap of a scaled decode from
+ * gDecodeBufferPool, or from the heap for sizes the pool doesn't keep.
+ */
+class PooledPixelAllocator : public SkBitmap::HeapAllocator {
+public:
+    virtual bool allocPixelRef(SkBitmap* bitmap, SkColorTable* ctable) {
+        if (!bitmap->getSize64().is32()) {
+            return false;
+        }
+        size_t capacity;
+        void* storage = gDecodeBufferPool.acquire(bitmap->getSize(), &capacity);
+        if (storage == NULL) {
+            return SkBitmap::HeapAllocator::allocPixelRef(bitmap, ctable);
+        }
+
+        SkPixelRef* pr = new PooledPixelRef(storage, capacity, ctable);
+        bitmap->setPixelRef(pr)->unref();
+        // since we're already allocated, we lockPixels right away
+        // HeapAllocator/JavaPixelAllocator behaves this way too
+        bitmap->lockPixels();
+        return true;
+    }
+};
+
+class ScaleCheckingAllocator : public PooledPixelAllocator {
 public:
     ScaleCheckingAllocator(float scale, int size)
             : mScale(scale), mSize(size) {
@@ -166,7 +275,7 @@ public:
                     mSize, requestedSize);
             return false;
         }
-        return SkBitmap::HeapAllocator::allocPixelRef(bitmap, ctable);
+        return PooledPixelAllocator::allocPixelRef(bitmap, ctable);
     }
 private:
     const float mScale;
@@ -206,11 +315,67 @@ private:
     const unsigned int mSize;
 };
 
+/*
+ * Lets another thread stop an asynchronous decode.  doDecode() attaches its
+ * decoder while it decodes, and cancel() then stops the decoder at its next
+ * scanline; a decode cancelled before it attaches doesn't start.
+ */
+class DecodeCanceler {
+public:
+    DecodeCanceler() : mDecoder(NULL), mCancelled(false) {}
+
+    bool attach(SkImageDecoder* decoder) {
+        Mutex::Autolock _l(mLock);
+        if (mCancelled) {
+            return false;
+        }
+        mDecoder = decoder;
+        return true;
+    }
+
+    void detach() {
+        Mutex::Autolock _l(mLock);
+        mDecoder = NULL;
+    }
+
+    void cancel() {
+        Mutex::Autolock _l(mLock);
+        mCancelled = true;
+        if (mDecoder != NULL) {
+            mDecoder->cancelDecode();
+        }
+    }
+
+    bool isCancelled() {
+        Mutex::Autolock _l(mLock);
+        return mCancelled;
+    }
+
+private:
+    Mutex mLock;
+    SkImageDecoder* mDecoder;
+    bool mCancelled;
+};
+
+class AutoDetachCanceler {
+public:
+    AutoDetachCanceler(DecodeCanceler* canceler) : mCanceler(canceler) {}
+    ~AutoDetachCanceler() {
+        if (mCanceler != NULL) {
+            mCanceler->detach();
+        }
+    }
+
+private:
+    DecodeCanceler* const mCanceler;
+};
+
 // since we "may" create a purgeable imageref, we require the stream be ref'able
 // i.e. dynamically allocated, since its lifetime may exceed the current stack
 // frame.
 static jobject doDecode(JNIEnv* env, SkStreamRewindable* stream, jobject padding,
-        jobject options, bool allowPurgeable, bool forcePurgeable = false) {
+        jobject options, bool allowPurgeable, bool forcePurgeable = false,
+        DecodeCanceler* canceler = NULL) {
 
     int sampleSize = 1;
 
@@ -293,6 +458,7 @@ static jobject doDecode(JNIEnv* env, SkStreamRewindable* stream, jobject padding
     JavaPixelAllocator javaAllocator(env);
     RecyclingPixelAllocator recyclingAllocator(outputBitmap->pixelRef(), existingBufferSize);
     ScaleCheckingAllocator scaleCheckingAllocator(scale, existingBufferSize);
+    PooledPixelAllocator pooledAllocator;
     SkBitmap::Allocator* outputAllocator = (javaBitmap != NULL) ?
             (SkBitmap::Allocator*)&recyclingAllocator : (SkBitmap::Allocator*)&javaAllocator;
     if (decodeMode != SkImageDecoder::kDecodeBounds_Mode) {
@@ -305,6 +471,9 @@ static jobject doDecode(JNIEnv* env, SkStreamRewindable* stream, jobject padding
             // check for eventual scaled bounds at allocation time, so we don't decode the bitmap
             // only to find the scaled result too large to fit in the allocation
             decoder->setAllocator(&scaleCheckingAllocator);
+        } else {
+            // the decoded bitmap only lives until it has been scaled
+            decoder->setAllocator(&pooledAllocator);
         }
     }
 
@@ -322,13 +491,45 @@ static jobject doDecode(JNIEnv* env, SkStreamRewindable* stream, jobject padding
         return nullObjectReturn("gOptions_mCancelID");
     }
 
+    // An asynchronous decode can also be cancelled through its request.
+    if (canceler != NULL && !canceler->attach(decoder)) {
+        return nullObjectReturn("async decode cancelled");
+    }
+    AutoDetachCanceler adtc(canceler);
+
+    // A JPEG scaled down to half or less is decoded at a smaller DCT scale,
+    // leaving less to decode and filter.  The output keeps the size of a
+    // decode at the requested sample size, read from the header first.
+    int unscaledWidth = -1;
+    int unscaledHeight = -1;
+    if (willScale && scale <= 0.5f && decodeMode == SkImageDecoder::kDecodePixels_Mode
+            && javaBitmap == NULL && decoder->getFormat() == SkImageDecoder::kJPEG_Format
+            && stream->getMemoryBase() != NULL) {
+        SkBitmap bounds;
+        if (!decoder->decode(stream, &bounds, prefConfig, SkImageDecoder::kDecodeBounds_Mode)
+                || !stream->rewind()) {
+            return nullObjectReturn("decoder->decode returned false");
+        }
+        int extraSampleSize = 1;
+        while (extraSampleSize * 2 * scale <= 1.0f) {
+            extraSampleSize *= 2;
+        }
+        unscaledWidth = bounds.width();
+        unscaledHeight = bounds.height();
+        decoder->setSampleSize(sampleSize * extraSampleSize);
+    }
+
     SkBitmap decodingBitmap;
     if (!decoder->decode(stream, &decodingBitmap, prefConfig, decodeMode)) {
         return nullObjectReturn("decoder->decode returned false");
     }
 
-    int scaledWidth = decodingBitmap.width();
-    int scaledHeight = decodingBitmap.height();
+    if (unscaledWidth < 0) {
+        unscaledWidth = decodingBitmap.width();
+        unscaledHeight = decodingBitmap.height();
+    }
+    int scaledWidth = unscaledWidth;
+    int scaledHeight = unscaledHeight;
 
     if (willScale && mode != SkImageDecoder::kDecodeBounds_Mode) {
         scaledWidth = int(scaledWidth * scale + 0.5f);
@@ -532,16 +733,25 @@ static jobject nativeDecodeAsset(JNIEnv* env, jobject clazz, jlong native_asset,
     Asset* asset = reinterpret_cast<Asset*>(native_asset);
     bool forcePurgeable = optionsPurgeable(env, options);
     if (forcePurgeable) {
-        // if we could "ref/reopen" the asset, we may not need to copy it here
-        // and we could assume optionsShareable, since assets are always RO
-        stream = CopyAssetToStream(asset);
+        // The stream outlives the asset, so it maps the file of an uncompressed
+        // asset or else copies the asset; assets are always RO, so either way
+        // we can assume optionsShareable
+        stream = MapAssetToStream(asset);
+        if (stream == NULL) {
+            stream = CopyAssetToStream(asset);
+        }
         if (stream == NULL) {
             return NULL;
         }
     } else {
         // since we know we'll be done with the asset when we return, we can
-        // just use a simple wrapper
-        stream = new AssetStreamAdaptor(asset);
+        // decode straight from its buffer, which an uncompressed asset maps
+        const void* buffer = asset->getBuffer(false);
+        if (buffer != NULL) {
+            stream = new SkMemoryStream(buffer, asset->getLength(), false);
+        } else {
+            stream = new AssetStreamAdaptor(asset);
+        }
     }
     SkAutoUnref aur(stream);
     return doDecode(env, stream, padding, options, forcePurgeable, forcePurgeable);
@@ -562,6 +772,243 @@ static jobject nativeDecodeByteArray(JNIEnv* env, jobject, jbyteArray byteArray,
     return doDecode(env, stream, NULL, options, purgeable);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Asynchronous decodes
+
+// Most worker threads decoding at once
+static const size_t kMaxAsyncDecodeThreads = 4;
+// Local references reserved for each decode and its callback
+static const jint kAsyncDecodeLocalFrameCapacity = 16;
+
+struct AsyncDecodeRequest : public RefBase {
+    jlong id;
+    jint priority;
+    SkStreamRewindable* stream;
+    jobject options;        // global ref, may be NULL
+    jobject callback;       // global ref
+    jmethodID onDecodeComplete;
+    DecodeCanceler canceler;
+
+    virtual ~AsyncDecodeRequest() {
+        SkSafeUnref(stream);
+    }
+
+    void deleteRefs(JNIEnv* env) {
+        if (options != NULL) {
+            env->DeleteGlobalRef(options);
+        }
+        env->DeleteGlobalRef(callback);
+    }
+};
+
+/*
+ * Decodes queued requests on a few worker threads, highest priority first
+ * and in order of submission within a priority, and passes each result to
+ * the callback of its request on the worker thread.
+ */
+class AsyncDecodeQueue {
+public:
+    AsyncDecodeQueue() : mIdleThreads(0), mNextId(1) {}
+
+    jlong enqueue(const sp<AsyncDecodeRequest>& request) {
+        Mutex::Autolock _l(mLock);
+        request->id = mNextId++;
+
+        size_t i = 0;
+        while (i < mPending.size() && mPending[i]->priority >= request->priority) {
+            i++;
+        }
+        mPending.insertAt(request, i);
+
+        // add a thread while there are more pending requests than idle threads
+        if (mIdleThreads < mPending.size() && mThreads.size() < maxThreads()) {
+            sp<Thread> thread = new WorkerThread(this);
+            if (thread->run("AsyncDecode") == NO_ERROR) {
+                mThreads.add(thread);
+            }
+        }
+        mCondition.signal();
+        return request->id;
+    }
+
+    /**
+     * Cancels the request: a pending one is dropped without a callback, and
+     * a running one stops decoding and reports a null bitmap.  Returns false
+     * if the request had already completed.
+     */
+    bool cancel(JNIEnv* env, jlong id) {
+        sp<AsyncDecodeRequest> dropped;
+        {
+            Mutex::Autolock _l(mLock);
+            for (size_t i = 0; i < mPending.size(); i++) {
+                if (mPending[i]->id == id) {
+                    dropped = mPending[i];
+                    mPending.removeAt(i);
+                    break;
+                }
+            }
+            if (dropped == NULL) {
+                for (size_t i = 0; i < mRunning.size(); i++) {
+                    if (mRunning[i]->id == id) {
+                        mRunning[i]->canceler.cancel();
+                        return true;
+                    }
+                }
+                return false;
+            }
+        }
+        dropped->deleteRefs(env);
+        return true;
+    }
+
+private:
+    class WorkerThread : public Thread {
+    public:
+        WorkerThread(AsyncDecodeQueue* queue) : Thread(true), mQueue(queue) {}
+
+    private:
+        virtual bool threadLoop() {
+            mQueue->runNext();
+            return true;
+        }
+
+        AsyncDecodeQueue* const mQueue;
+    };
+
+    static size_t maxThreads() {
+        long cpus = sysconf(_SC_NPROCESSORS_CONF);
+        return (cpus > 0 && (size_t) cpus < kMaxAsyncDecodeThreads) ?
+                (size_t) cpus : kMaxAsyncDecodeThreads;
+    }
+
+    void runNext() {
+        sp<AsyncDecodeRequest> request;
+        {
+            Mutex::Autolock _l(mLock);
+            mIdleThreads++;
+            while (mPending.isEmpty()) {
+                mCondition.wait(mLock);
+            }
+            mIdleThreads--;
+            request = mPending[0];
+            mPending.removeAt(0);
+            mRunning.add(request);
+        }
+
+        // The thread never returns to the VM, the local references created
+        // by the decode and the callback are released with this frame
+        JNIEnv* env = AndroidRuntime::getJNIEnv();
+        const bool framePushed = env->PushLocalFrame(kAsyncDecodeLocalFrameCapacity) == 0;
+
+        jobject bitmap = NULL;
+        if (framePushed) {
+            bitmap = doDecode(env, request->stream, NULL, request->options, false, false,
+                    &request->canceler);
+        }
+        if (env->ExceptionCheck()) {
+            // The decode failed, typically out of memory
+            env->ExceptionDescribe();
+            env->ExceptionClear();
+            bitmap = NULL;
+        }
+        if (request->canceler.isCancelled()) {
+            bitmap = NULL;
+        }
+
+        finish(request);
+
+        env->CallVoidMethod(request->callback, request->onDecodeComplete, bitmap);
+        if (env->ExceptionCheck()) {
+            ALOGE("Uncaught exception in async decode callback");
+            env->ExceptionDescribe();
+            env->ExceptionClear();
+        }
+        if (framePushed) {
+            env->PopLocalFrame(NULL);
+        }
+        request->deleteRefs(env);
+    }
+
+    void finish(const sp<AsyncDecodeRequest>& request) {
+        Mutex::Autolock _l(mLock);
+        for (size_t i = 0; i < mRunning.size(); i++) {
+            if (mRunning[i] == request) {
+                mRunning.removeAt(i);
+                break;
+            }
+        }
+    }
+
+    Mutex mLock;
+    Condition mCondition;
+    Vector<sp<AsyncDecodeRequest> > mPending;   // by decreasing priority
+    Vector<sp<AsyncDecodeRequest> > mRunning;
+    Vector<sp<Thread> > mThreads;
+    size_t mIdleThreads;
+    jlong mNextId;
+};
+
+// Created on first use, and like its threads never destroyed
+static Mutex gAsyncDecodeQueueLock;
+static AsyncDecodeQueue* gAsyncDecodeQueue;
+
+static AsyncDecodeQueue* asyncDecodeQueue() {
+    Mutex::Autolock _l(gAsyncDecodeQueueLock);
+    if (gAsyncDecodeQueue == NULL) {
+        gAsyncDecodeQueue = new AsyncDecodeQueue;
+    }
+    return gAsyncDecodeQueue;
+}
+
+static jlong enqueueAsyncDecode(JNIEnv* env, SkStreamRewindable* stream, jobject options,
+        jint priority, jobject callback) {
+    jclass callbackClass = env->GetObjectClass(callback);
+    jmethodID onDecodeComplete = env->GetMethodID(callbackClass, "onDecodeComplete",
+            "(Landroid/graphics/Bitmap;)V");
+    env->DeleteLocalRef(callbackClass);
+    if (onDecodeComplete == NULL) {
+        return 0;   // NoSuchMethodError pending
+    }
+
+    sp<AsyncDecodeRequest> request = new AsyncDecodeRequest;
+    request->priority = priority;
+    request->stream = stream;
+    SkSafeRef(stream);
+    request->options = (options != NULL) ? env->NewGlobalRef(options) : NULL;
+    request->callback = env->NewGlobalRef(callback);
+    request->onDecodeComplete = onDecodeComplete;
+    return asyncDecodeQueue()->enqueue(request);
+}
+
+static jlong nativeDecodeByteArrayAsync(JNIEnv* env, jobject, jbyteArray byteArray,
+        jint offset, jint length, jobject options, jint priority, jobject callback) {
+    NPE_CHECK_RETURN_ZERO(env, callback);
+
+    // The array is copied since the caller may change it before the decode runs.
+    AutoJavaByteArray ar(env, byteArray);
+    SkAutoTUnref<SkMemoryStream> stream(new SkMemoryStream(ar.ptr() + offset, length, true));
+    return enqueueAsyncDecode(env, stream, options, priority, callback);
+}
+
+static jlong nativeDecodeFileDescriptorAsync(JNIEnv* env, jobject, jobject fileDescriptor,
+        jobject options, jint priority, jobject callback) {
+    NPE_CHECK_RETURN_ZERO(env, fileDescriptor);
+    NPE_CHECK_RETURN_ZERO(env, callback);
+
+    jint descriptor = jniGetFDFromFileDescriptor(env, fileDescriptor);
+    SkAutoTUnref<SkData> data(SkData::NewFromFD(descriptor));
+    if (data.get() == NULL) {
+        doThrowIOE(env, "broken file descriptor");
+        return 0;
+    }
+    SkAutoTUnref<SkMemoryStream> stream(new SkMemoryStream(data));
+    return enqueueAsyncDecode(env, stream, options, priority, callback);
+}
+
+static jboolean nativeCancelDecodeAsync(JNIEnv* env, jobject, jlong id) {
+    return asyncDecodeQueue()->cancel(env, id) ? JNI_TRUE : JNI_FALSE;
+}
+
 static void nativeRequestCancel(JNIEnv*, jobject joptions) {
     (void)AutoDecoderCancel::RequestCancel(joptions);
 }
@@ -598,6 +1045,21 @@ static JNINativeMethod gMethods[] = {
         "(Ljava/io/FileDescriptor;)Z",
         (void*)nativeIsSeekable
     },
+
+    {   "nativeDecodeByteArrayAsync",
+        "([BIILandroid/graphics/BitmapFactory$Options;ILandroid/graphics/BitmapFactory$DecodeCallback;)J",
+        (void*)nativeDecodeByteArrayAsync
+    },
+
+    {   "nativeDecodeFileDescriptorAsync",
+        "(Ljava/io/FileDescriptor;Landroid/graphics/BitmapFactory$Options;ILandroid/graphics/BitmapFactory$DecodeCallback;)J",
+        (void*)nativeDecodeFileDescriptorAsync
+    },
+
+    {   "nativeCancelDecodeAsync",
+        "(J)Z",
+        (void*)nativeCancelDecodeAsync
+    },
 };
 
 static JNINativeMethod gOptionsMethods[] = {
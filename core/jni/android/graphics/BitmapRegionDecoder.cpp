@@ -40,6 +40,8 @@
 #include <jni.h>
 #include <androidfw/Asset.h>
 #include <sys/stat.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
 
 #if 0
     #define TRACE_BITMAP(code)  code
@@ -49,34 +51,233 @@
 
 using namespace android;
 
+// Bytes of decoded pixels each region decoder keeps for repeated requests
+static const size_t kRegionCacheBytes = 4 * 1024 * 1024;
+// Decoders a region decoder may have decoding at once, the first one included
+static const size_t kMaxDecoders = 4;
+
+/*
+ * A requested region and the options that change its decoded pixels.  Tiled
+ * viewers request their tiles on a fixed grid, so a tile panned back into
+ * view is requested again with the same key.
+ */
+struct RegionKey {
+    SkIRect rect;
+    int sampleSize;
+    SkBitmap::Config config;
+    bool dither;
+    bool preferQualityOverSpeed;
+    bool requireUnpremultiplied;
+
+    bool operator==(const RegionKey& other) const {
+        return rect == other.rect && sampleSize == other.sampleSize
+                && config == other.config && dither == other.dither
+                && preferQualityOverSpeed == other.preferQualityOverSpeed
+                && requireUnpremultiplied == other.requireUnpremultiplied;
+    }
+};
+
+struct CachedRegion {
+    RegionKey key;
+    SkBitmap bitmap;    // owns a native copy of the decoded pixels
+};
+
 class SkBitmapRegionDecoder {
 public:
-    SkBitmapRegionDecoder(SkImageDecoder* decoder, int width, int height) {
-        fDecoder = decoder;
+    SkBitmapRegionDecoder(SkImageDecoder* decoder, SkStreamRewindable* stream,
+                          int width, int height)
+            : fStream(stream), fFormat(decoder->getFormat()), fDecoderCount(1),
+              fCacheBytes(0) {
+        SkSafeRef(fStream);
+        fIdleDecoders.push(decoder);
         fWidth = width;
         fHeight = height;
     }
     ~SkBitmapRegionDecoder() {
-        SkDELETE(fDecoder);
+        // Java only cleans us up once no decode is running, so all are idle.
+        for (size_t i = 0; i < fIdleDecoders.size(); i++) {
+            SkDELETE(fIdleDecoders[i]);
+        }
+        for (size_t i = 0; i < fCache.size(); i++) {
+            delete fCache[i];
+        }
+        SkSafeUnref(fStream);
+    }
+
+    /**
+     * Returns a decoder no other thread is using.  When all are busy another
+     * one is built on a duplicate of the stream, up to kMaxDecoders; after
+     * that this waits for one to be released.  Returns NULL if building a
+     * decoder failed.
+     */
+    SkImageDecoder* acquireDecoder(JNIEnv* env) {
+        {
+            Mutex::Autolock _l(fLock);
+            while (fIdleDecoders.isEmpty() && fDecoderCount >= kMaxDecoders) {
+                fDecoderReleased.wait(fLock);
+            }
+            if (!fIdleDecoders.isEmpty()) {
+                SkImageDecoder* decoder = fIdleDecoders.top();
+                fIdleDecoders.pop();
+                return decoder;
+            }
+            fDecoderCount++;
+        }
+
+        SkImageDecoder* decoder = newDecoder(env);
+        if (decoder == NULL) {
+            Mutex::Autolock _l(fLock);
+            fDecoderCount--;
+            fDecoderReleased.signal();
+        }
+        return decoder;
     }
 
-    bool decodeRegion(SkBitmap* bitmap, const SkIRect& rect,
+    void releaseDecoder(SkImageDecoder* decoder) {
+        Mutex::Autolock _l(fLock);
+        fIdleDecoders.push(decoder);
+        fDecoderReleased.signal();
+    }
+
+    bool decodeRegion(SkImageDecoder* decoder, SkBitmap* bitmap, const SkIRect& rect,
                       SkBitmap::Config pref, int sampleSize) {
-        fDecoder->setSampleSize(sampleSize);
-        return fDecoder->decodeRegion(bitmap, rect, pref);
+        decoder->setSampleSize(sampleSize);
+        return decoder->decodeRegion(bitmap, rect, pref);
+    }
+
+    /**
+     * Looks up an earlier decode of the region into "bitmap", which then
+     * shares the cached pixels.  The region becomes the most recently used.
+     */
+    bool findCachedRegion(const RegionKey& key, SkBitmap* bitmap) {
+        Mutex::Autolock _l(fLock);
+        for (size_t i = 0; i < fCache.size(); i++) {
+            if (fCache[i]->key == key) {
+                CachedRegion* region = fCache[i];
+                fCache.removeAt(i);
+                fCache.insertAt(region, 0);
+                *bitmap = region->bitmap;
+                return true;
+            }
+        }
+        return false;
     }
 
-    SkImageDecoder* getDecoder() const { return fDecoder; }
+    /**
+     * Keeps a copy of the decoded region, dropping the least recently used
+     * regions to stay within kRegionCacheBytes.
+     */
+    void cacheRegion(const RegionKey& key, const SkBitmap& decoded) {
+        if (decoded.getSize() > kRegionCacheBytes / 4) {
+            return;     // too large to be a tile worth keeping
+        }
+        CachedRegion* region = new CachedRegion;
+        region->key = key;
+        if (!decoded.copyTo(&region->bitmap, decoded.config())) {
+            delete region;
+            return;
+        }
+
+        Mutex::Autolock _l(fLock);
+        for (size_t i = 0; i < fCache.size(); i++) {
+            if (fCache[i]->key == key) {
+                // another thread decoded it meanwhile
+                delete region;
+                return;
+            }
+        }
+        fCache.insertAt(region, 0);
+        fCacheBytes += region->bitmap.getSize();
+        while (fCacheBytes > kRegionCacheBytes) {
+            CachedRegion* oldest = fCache.top();
+            fCache.pop();
+            fCacheBytes -= oldest->bitmap.getSize();
+            delete oldest;
+        }
+    }
+
+    SkImageDecoder::Format getFormat() const { return fFormat; }
     int getWidth() const { return fWidth; }
     int getHeight() const { return fHeight; }
 
 private:
-    SkImageDecoder* fDecoder;
+    SkImageDecoder* newDecoder(JNIEnv* env) {
+        SkStreamRewindable* stream = fStream->duplicate();
+        if (stream == NULL) {
+            return NULL;
+        }
+        SkImageDecoder* decoder = SkImageDecoder::Factory(stream);
+        if (decoder != NULL) {
+            JavaPixelAllocator* javaAllocator = new JavaPixelAllocator(env);
+            decoder->setAllocator(javaAllocator);
+            javaAllocator->unref();
+
+            int width, height;
+            if (!decoder->buildTileIndex(stream, &width, &height)) {
+                SkDELETE(decoder);
+                decoder = NULL;
+            }
+        }
+        stream->unref(); // the decoder now holds a reference
+        return decoder;
+    }
+
+    SkStreamRewindable* fStream;
+    const SkImageDecoder::Format fFormat;
     int fWidth;
     int fHeight;
+
+    Mutex fLock;
+    Condition fDecoderReleased;
+    Vector<SkImageDecoder*> fIdleDecoders;
+    size_t fDecoderCount;
+    Vector<CachedRegion*> fCache;   // most recently used first
+    size_t fCacheBytes;
 };
 
-static jobject createBitmapRegionDecoder(JNIEnv* env, SkStream* stream) {
+/*
+ * Returns a decoder acquired from an SkBitmapRegionDecoder when going out
+ * of scope.
+ */
+class AutoReleaseDecoder {
+public:
+    AutoReleaseDecoder(SkBitmapRegionDecoder* brd, SkImageDecoder* decoder)
+            : fBrd(brd), fDecoder(decoder) {}
+    ~AutoReleaseDecoder() {
+        fBrd->releaseDecoder(fDecoder);
+    }
+
+private:
+    SkBitmapRegionDecoder* fBrd;
+    SkImageDecoder* fDecoder;
+};
+
+/*
+ * Copies a cached region into the bitmap to return.  A reused bitmap must
+ * have the same dimensions and config as the region; a new one gets Java
+ * heap pixels from the allocator.
+ */
+static bool copyCachedRegion(const SkBitmap& cached, SkBitmap* bitmap, bool reuse,
+                             JavaPixelAllocator* allocator) {
+    if (!reuse) {
+        return cached.copyTo(bitmap, cached.config(), allocator);
+    }
+    if (bitmap->config() != cached.config() || bitmap->width() != cached.width()
+            || bitmap->height() != cached.height()
+            || bitmap->rowBytes() != cached.rowBytes()) {
+        return false;
+    }
+    SkAutoLockPixels alpSrc(cached);
+    SkAutoLockPixels alpDst(*bitmap);
+    if (cached.getPixels() == NULL || bitmap->getPixels() == NULL) {
+        return false;
+    }
+    memcpy(bitmap->getPixels(), cached.getPixels(), cached.getSize());
+    bitmap->notifyPixelsChanged();
+    return true;
+}
+
+static jobject createBitmapRegionDecoder(JNIEnv* env, SkStreamRewindable* stream) {
     SkImageDecoder* decoder = SkImageDecoder::Factory(stream);
     int width, height;
     if (NULL == decoder) {
@@ -97,7 +298,7 @@ static jobject createBitmapRegionDecoder(JNIEnv* env, SkStream* stream) {
         return nullObjectReturn("decoder->buildTileIndex returned false");
     }
 
-    SkBitmapRegionDecoder *bm = new SkBitmapRegionDecoder(decoder, width, height);
+    SkBitmapRegionDecoder *bm = new SkBitmapRegionDecoder(decoder, stream, width, height);
     return GraphicsJNI::createBitmapRegionDecoder(env, bm);
 }
 
@@ -108,7 +309,7 @@ static jobject nativeNewInstanceFromByteArray(JNIEnv* env, jobject, jbyteArray b
         For now we just always copy the array's data if isShareable.
      */
     AutoJavaByteArray ar(env, byteArray);
-    SkStream* stream = new SkMemoryStream(ar.ptr() + offset, length, true);
+    SkMemoryStream* stream = new SkMemoryStream(ar.ptr() + offset, length, true);
 
     jobject brd = createBitmapRegionDecoder(env, stream);
     SkSafeUnref(stream); // the decoder now holds a reference
@@ -154,7 +355,8 @@ static jobject nativeNewInstanceFromAsset(JNIEnv* env, jobject clazz,
                                  jlong native_asset, // Asset
                                  jboolean isShareable) {
     Asset* asset = reinterpret_cast<Asset*>(native_asset);
-    SkAutoTUnref<SkMemoryStream> stream(CopyAssetToStream(asset));
+    SkMemoryStream* mapped = MapAssetToStream(asset);
+    SkAutoTUnref<SkMemoryStream> stream(mapped != NULL ? mapped : CopyAssetToStream(asset));
     if (NULL == stream.get()) {
         return NULL;
     }
@@ -174,7 +376,6 @@ static jobject nativeDecodeRegion(JNIEnv* env, jobject, jlong brdHandle,
                                 jint start_x, jint start_y, jint width, jint height, jobject options) {
     SkBitmapRegionDecoder *brd = reinterpret_cast<SkBitmapRegionDecoder*>(brdHandle);
     jobject tileBitmap = NULL;
-    SkImageDecoder *decoder = brd->getDecoder();
     int sampleSize = 1;
     SkBitmap::Config prefConfig = SkBitmap::kNo_Config;
     bool doDither = true;
@@ -198,18 +399,6 @@ static jobject nativeDecodeRegion(JNIEnv* env, jobject, jlong brdHandle,
         requireUnpremultiplied = !env->GetBooleanField(options, gOptions_premultipliedFieldID);
     }
 
-    decoder->setDitherImage(doDither);
-    decoder->setPreferQualityOverSpeed(preferQualityOverSpeed);
-    decoder->setRequireUnpremultipliedColors(requireUnpremultiplied);
-    AutoDecoderCancel adc(options, decoder);
-
-    // To fix the race condition in case "requestCancelDecode"
-    // happens earlier than AutoDecoderCancel object is added
-    // to the gAutoDecoderCancelMutex linked list.
-    if (NULL != options && env->GetBooleanField(options, gOptions_mCancelID)) {
-        return nullObjectReturn("gOptions_mCancelID");;
-    }
-
     SkIRect region;
     region.fLeft = start_x;
     region.fTop = start_y;
@@ -226,9 +415,50 @@ static jobject nativeDecodeRegion(JNIEnv* env, jobject, jlong brdHandle,
         bitmap = new SkBitmap;
         adb.reset(bitmap);
     }
-
-    if (!brd->decodeRegion(bitmap, region, prefConfig, sampleSize)) {
-        return nullObjectReturn("decoder->decodeRegion returned false");
+    const bool reuse = adb.get() == NULL;
+
+    RegionKey key;
+    key.rect = region;
+    key.sampleSize = sampleSize;
+    key.config = prefConfig;
+    key.dither = doDither;
+    key.preferQualityOverSpeed = preferQualityOverSpeed;
+    key.requireUnpremultiplied = requireUnpremultiplied;
+
+    // A region decoded before is copied out of the cache without a decoder.
+    JavaPixelAllocator cacheAllocator(env);
+    SkBitmap cached;
+    jbyteArray buff = NULL;
+    if (brd->findCachedRegion(key, &cached)
+            && copyCachedRegion(cached, bitmap, reuse, &cacheAllocator)) {
+        buff = cacheAllocator.getStorageObjAndReset();
+    } else {
+        SkImageDecoder *decoder = brd->acquireDecoder(env);
+        if (decoder == NULL) {
+            return nullObjectReturn("brd->acquireDecoder returned null");
+        }
+        AutoReleaseDecoder ard(brd, decoder);
+
+        decoder->setDitherImage(doDither);
+        decoder->setPreferQualityOverSpeed(preferQualityOverSpeed);
+        decoder->setRequireUnpremultipliedColors(requireUnpremultiplied);
+        AutoDecoderCancel adc(options, decoder);
+
+        // To fix the race condition in case "requestCancelDecode"
+        // happens earlier than AutoDecoderCancel object is added
+        // to the gAutoDecoderCancelMutex linked list.
+        if (NULL != options && env->GetBooleanField(options, gOptions_mCancelID)) {
+            return nullObjectReturn("gOptions_mCancelID");;
+        }
+
+        if (!brd->decodeRegion(decoder, bitmap, region, prefConfig, sampleSize)) {
+            return nullObjectReturn("decoder->decodeRegion returned false");
+        }
+        brd->cacheRegion(key, *bitmap);
+
+        // take the pixels before another thread can acquire the decoder
+        JavaPixelAllocator* allocator = (JavaPixelAllocator*) decoder->getAllocator();
+        buff = allocator->getStorageObjAndReset();
     }
 
     // update options (if any)
@@ -239,7 +469,7 @@ static jobject nativeDecodeRegion(JNIEnv* env, jobject, jlong brdHandle,
         // but how to reuse a set of strings, rather than allocating new one
         // each time?
         env->SetObjectField(options, gOptions_mimeFieldID,
-                            getMimeTypeString(env, decoder->getFormat()));
+                            getMimeTypeString(env, brd->getFormat()));
     }
 
     if (tileBitmap != NULL) {
@@ -249,9 +479,6 @@ static jobject nativeDecodeRegion(JNIEnv* env, jobject, jlong brdHandle,
     // detach bitmap from its autodeleter, since we want to own it now
     adb.release();
 
-    JavaPixelAllocator* allocator = (JavaPixelAllocator*) decoder->getAllocator();
-    jbyteArray buff = allocator->getStorageObjAndReset();
-
     int bitmapCreateFlags = 0;
     if (!requireUnpremultiplied) bitmapCreateFlags |= GraphicsJNI::kBitmapCreateFlag_Premultiplied;
     return GraphicsJNI::createBitmap(env, bitmap, buff, bitmapCreateFlags, NULL, NULL, -1);
@@ -38,6 +38,8 @@
 #include <SkPath.h>
 #include <SkPoint.h>
 #include <SkRect.h>
+#include <SkStream.h>
+#include <SkTypeface.h>
 #include <SkUtils.h>
 
 #include <hb.h>
@@ -156,6 +158,32 @@ hb_blob_t* harfbuzzSkiaReferenceTable(hb_face_t* face, hb_tag_t tag, void* userD
                           HB_MEMORY_MODE_WRITABLE, buffer, free);
 }
 
+static void unrefFontStream(void* data) {
+    reinterpret_cast<SkStream*>(data)->unref();
+}
+
+hb_face_t* createFace(SkTypeface* typeface) {
+    int ttcIndex = 0;
+    SkStream* stream = typeface->openStream(&ttcIndex);
+    if (stream) {
+        // System fonts are memory mapped: the tables are then read in place,
+        // from pages shared with every other process using the font, instead
+        // of being copied to the heap of each process
+        const void* base = stream->getMemoryBase();
+        if (base) {
+            hb_blob_t* blob = hb_blob_create(reinterpret_cast<const char*>(base),
+                    stream->getLength(), HB_MEMORY_MODE_READONLY, stream, unrefFontStream);
+            hb_face_t* face = hb_face_create(blob, ttcIndex);
+            hb_blob_destroy(blob);
+            return face;
+        }
+        stream->unref();
+    }
+
+    // TODO: destroy function
+    return hb_face_create_for_tables(harfbuzzSkiaReferenceTable, typeface, NULL);
+}
+
 static void destroyHarfBuzzFontData(void* data) {
     delete (HarfBuzzFontData*)data;
 }
@@ -52,6 +52,10 @@ static inline hb_position_t SkScalarToHBFixed(SkScalar value) {
 
 hb_blob_t* harfbuzzSkiaReferenceTable(hb_face_t* face, hb_tag_t tag, void* userData);
 
+// Creates a face whose tables point directly into the typeface's font data
+// when it is memory mapped, and are copied out of the typeface otherwise.
+hb_face_t* createFace(SkTypeface* typeface);
+
 hb_font_t* createFont(hb_face_t* face, SkPaint* paint, float sizeX, float sizeY);
 
 }  // namespace android
@@ -7,6 +7,7 @@
 #include "SkUtils.h"
 #include "Utils.h"
 #include "CreateJavaOutputStreamAdaptor.h"
+#include "MovieFrameCache.h"
 
 #include <androidfw/Asset.h>
 #include <androidfw/ResourceTypes.h>
@@ -63,7 +64,27 @@ static jint movie_duration(JNIEnv* env, jobject movie) {
 
 static jboolean movie_setTime(JNIEnv* env, jobject movie, jint ms) {
     NPE_CHECK_RETURN_ZERO(env, movie);
-    return J2Movie(env, movie)->setTime(ms) ? JNI_TRUE : JNI_FALSE;
+    SkMovie* m = J2Movie(env, movie);
+    android::MovieFrameCache* cache = android::MovieFrameCache::get(m);
+    if (cache) {
+        return cache->setTime(ms) ? JNI_TRUE : JNI_FALSE;
+    }
+    return m->setTime(ms) ? JNI_TRUE : JNI_FALSE;
+}
+
+// Decodes the frames ahead of time on a background thread, in up to
+// maxBytes of memory. 0 goes back to decoding each frame on setTime().
+static void movie_setFrameCacheSize(JNIEnv* env, jobject movie, jint maxBytes) {
+    NPE_CHECK_RETURN_VOID(env, movie);
+    android::MovieFrameCache::attach(J2Movie(env, movie), maxBytes > 0 ? maxBytes : 0);
+}
+
+// Returns when the frame selected by setTime() ends, so that the caller can
+// schedule the next draw, or -1 if unknown.
+static jint movie_frameEndTime(JNIEnv* env, jobject movie) {
+    NPE_CHECK_RETURN_ZERO(env, movie);
+    android::MovieFrameCache* cache = android::MovieFrameCache::get(J2Movie(env, movie));
+    return cache ? cache->frameEndTime() : -1;
 }
 
 static void movie_draw(JNIEnv* env, jobject movie, jobject canvas,
@@ -76,9 +97,15 @@ static void movie_draw(JNIEnv* env, jobject movie, jobject canvas,
     SkCanvas* c = GraphicsJNI::getNativeCanvas(env, canvas);
     SkScalar sx = SkFloatToScalar(fx);
     SkScalar sy = SkFloatToScalar(fy);
-    const SkBitmap& b = m->bitmap();
     const SkPaint* p = jpaint ? GraphicsJNI::getNativePaint(env, jpaint) : NULL;
 
+    android::MovieFrameCache* cache = android::MovieFrameCache::get(m);
+    if (cache) {
+        c->drawBitmap(cache->bitmap(), sx, sy, p);
+        return;
+    }
+
+    const SkBitmap& b = m->bitmap();
     c->drawBitmap(b, sx, sy, p);
 }
 
@@ -132,6 +159,7 @@ static jobject movie_decodeByteArray(JNIEnv* env, jobject clazz,
 
 static void movie_destructor(JNIEnv* env, jobject, jlong movieHandle) {
     SkMovie* movie = (SkMovie*) movieHandle;
+    android::MovieFrameCache::detach(movie);
     delete movie;
 }
 
@@ -145,6 +173,8 @@ static JNINativeMethod gMethods[] = {
     {   "isOpaque", "()Z",  (void*)movie_isOpaque  },
     {   "duration", "()I",  (void*)movie_duration  },
     {   "setTime",  "(I)Z", (void*)movie_setTime  },
+    {   "setFrameCacheSize", "(I)V", (void*)movie_setFrameCacheSize  },
+    {   "frameEndTime", "()I", (void*)movie_frameEndTime  },
     {   "draw",     "(Landroid/graphics/Canvas;FFLandroid/graphics/Paint;)V",
                             (void*)movie_draw  },
     { "nativeDecodeAsset", "(J)Landroid/graphics/Movie;",
@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "MovieFrameCache"
+
+#include <utils/KeyedVector.h>
+#include <utils/Log.h>
+#include <utils/Thread.h>
+
+#include "MovieFrameCache.h"
+
+namespace android {
+
+///////////////////////////////////////////////////////////////////////////////
+// Decode thread
+///////////////////////////////////////////////////////////////////////////////
+
+class MovieFrameCache::DecodeThread: public Thread {
+public:
+    DecodeThread(MovieFrameCache* cache): Thread(false), mCache(cache) {
+    }
+
+private:
+    virtual bool threadLoop() {
+        return mCache->decodeAhead();
+    }
+
+    MovieFrameCache* mCache;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Cache
+///////////////////////////////////////////////////////////////////////////////
+
+MovieFrameCache::MovieFrameCache(SkMovie* movie, size_t maxBytes):
+        mMovie(movie), mMaxBytes(maxBytes), mDuration(movie->duration()),
+        mDecodeTime(0), mDecodeGenerationId(0), mBytes(0), mCurrent(0),
+        mComplete(false), mExit(false), mBitmapEnd(0) {
+    // Decoding starts from the first frame, wherever the movie was before
+    mMovie->setTime(0);
+    mDecodeGenerationId = mMovie->bitmap().getGenerationID();
+
+    // A single frame is decoded on first use
+    if (mDuration > 0) {
+        mThread = new DecodeThread(this);
+        mThread->run("MovieDecoder", PRIORITY_BACKGROUND);
+    }
+}
+
+MovieFrameCache::~MovieFrameCache() {
+    if (mThread != NULL) {
+        {
+            Mutex::Autolock _l(mLock);
+            mExit = true;
+            mCondition.signal();
+        }
+        mThread->requestExitAndWait();
+    }
+}
+
+bool MovieFrameCache::decodeFrameLocked(Frame* frame) {
+    const SkBitmap& bitmap = mMovie->bitmap();
+    if (!bitmap.copyTo(&frame->bitmap, bitmap.config())) {
+        return false;
+    }
+    frame->start = mDecodeTime;
+
+    // Step until the movie composites the next frame, which becomes the
+    // decoder's current frame. Steps stay aligned on frame boundaries after
+    // a seek
+    SkMSec time = mDecodeTime;
+    uint32_t generationId = mDecodeGenerationId;
+    while (time < mDuration && generationId == mDecodeGenerationId) {
+        time = (time / kTimeStep + 1) * kTimeStep;
+        if (time > mDuration) time = mDuration;
+        mMovie->setTime(time);
+        generationId = mMovie->bitmap().getGenerationID();
+    }
+    frame->end = time;
+
+    if (generationId == mDecodeGenerationId) {
+        // Last frame, loop
+        mMovie->setTime(0);
+        generationId = mMovie->bitmap().getGenerationID();
+        time = 0;
+    }
+    mDecodeTime = time;
+    mDecodeGenerationId = generationId;
+    return true;
+}
+
+void MovieFrameCache::seekLocked(SkMSec time) {
+    // The start of the frame is not known, it is cached from this time on
+    mMovie->setTime(time);
+    mDecodeTime = time;
+    mDecodeGenerationId = mMovie->bitmap().getGenerationID();
+}
+
+bool MovieFrameCache::hasRoomLocked() const {
+    return mFrames.isEmpty() || mCurrent > 0 ||
+            mBytes + mFrames[0].bitmap.getSize() <= mMaxBytes;
+}
+
+void MovieFrameCache::addFrameLocked(const Frame& frame, SkMSec nextStart) {
+    const size_t size = frame.bitmap.getSize();
+    while (mCurrent > 0 && mBytes + size > mMaxBytes) {
+        mBytes -= mFrames[0].bitmap.getSize();
+        mFrames.removeAt(0);
+        mCurrent--;
+    }
+
+    mFrames.add(frame);
+    mBytes += size;
+
+    // The frames are contiguous, they cover the whole movie once the next
+    // frame is the first one
+    mComplete = nextStart == mFrames[0].start;
+}
+
+ssize_t MovieFrameCache::findFrameLocked(SkMSec time) const {
+    for (size_t i = 0; i < mFrames.size(); i++) {
+        const Frame& frame = mFrames[i];
+        if (frame.start <= time && (time < frame.end || frame.end == mDuration)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool MovieFrameCache::decodeAhead() {
+    {
+        Mutex::Autolock _l(mLock);
+        while (!mExit && (mComplete || !hasRoomLocked())) {
+            mCondition.wait(mLock);
+        }
+        if (mExit) return false;
+    }
+
+    // A seek may happen before the movie lock is taken, the next frame is
+    // then the one following the frame the seek decoded
+    Mutex::Autolock _m(mMovieLock);
+    Frame frame;
+    if (!decodeFrameLocked(&frame)) {
+        ALOGW("Unable to allocate a movie frame, decoding on demand");
+        return false;
+    }
+
+    Mutex::Autolock _l(mLock);
+    addFrameLocked(frame, mDecodeTime);
+    return true;
+}
+
+bool MovieFrameCache::setTime(SkMSec time) {
+    if (time > mDuration) time = mDuration;
+
+    ssize_t index;
+    {
+        Mutex::Autolock _l(mLock);
+        index = findFrameLocked(time);
+        if (index >= 0) {
+            mCurrent = index;
+            // The played frames may be dropped for the next ones
+            mCondition.signal();
+        }
+    }
+
+    if (index < 0) {
+        // Seeking, or the decode thread is late
+        Mutex::Autolock _m(mMovieLock);
+        Mutex::Autolock _l(mLock);
+        index = findFrameLocked(time);
+        if (index < 0) {
+            mFrames.clear();
+            mBytes = 0;
+            mCurrent = 0;
+            mComplete = false;
+
+            Frame frame;
+            seekLocked(time);
+            if (!decodeFrameLocked(&frame)) {
+                return false;
+            }
+            addFrameLocked(frame, mDecodeTime);
+            index = 0;
+        }
+        mCurrent = index;
+        mCondition.signal();
+    }
+
+    Mutex::Autolock _l(mLock);
+    const Frame& frame = mFrames[mCurrent];
+    bool changed = frame.bitmap.getPixelRef() != mBitmap.getPixelRef();
+    mBitmap = frame.bitmap;
+    mBitmapEnd = frame.end;
+    return changed;
+}
+
+SkBitmap MovieFrameCache::bitmap() {
+    if (mBitmap.isNull()) {
+        setTime(0);
+    }
+    return mBitmap;
+}
+
+int32_t MovieFrameCache::frameEndTime() {
+    if (mDuration == 0) return -1;
+    if (mBitmap.isNull()) {
+        setTime(0);
+    }
+    return mBitmapEnd;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Registry
+///////////////////////////////////////////////////////////////////////////////
+
+static Mutex gCachesLock;
+static KeyedVector<SkMovie*, MovieFrameCache*> gCaches;
+
+MovieFrameCache* MovieFrameCache::get(SkMovie* movie) {
+    Mutex::Autolock _l(gCachesLock);
+    ssize_t index = gCaches.indexOfKey(movie);
+    return index >= 0 ? gCaches.valueAt(index) : NULL;
+}
+
+void MovieFrameCache::attach(SkMovie* movie, size_t maxBytes) {
+    detach(movie);
+    if (maxBytes == 0) return;
+
+    MovieFrameCache* cache = new MovieFrameCache(movie, maxBytes);
+    Mutex::Autolock _l(gCachesLock);
+    gCaches.add(movie, cache);
+}
+
+void MovieFrameCache::detach(SkMovie* movie) {
+    MovieFrameCache* cache = NULL;
+    {
+        Mutex::Autolock _l(gCachesLock);
+        ssize_t index = gCaches.indexOfKey(movie);
+        if (index >= 0) {
+            cache = gCaches.valueAt(index);
+            gCaches.removeItemsAt(index);
+        }
+    }
+    delete cache;
+}
+
+}; // namespace android
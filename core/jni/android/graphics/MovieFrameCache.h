@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_MOVIE_FRAME_CACHE_H
+#define ANDROID_MOVIE_FRAME_CACHE_H
+
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+#include <utils/StrongPointer.h>
+#include <utils/Vector.h>
+
+#include "SkBitmap.h"
+#include "SkMovie.h"
+
+namespace android {
+
+/**
+ * Decodes the frames of a movie ahead of time on a background thread and
+ * keeps them composited, so that drawing the movie at a given time does not
+ * run the decoder from the previous frame on the caller's thread.
+ *
+ * Frames are kept in playback order, from the frame being displayed to the
+ * last frame decoded ahead, within a memory budget. Once every frame of the
+ * movie fits in the budget, the movie is never decoded again. Seeking to a
+ * time that is not cached decodes the frame synchronously and restarts the
+ * decode-ahead from there.
+ *
+ * SkMovie does not expose frame delays. GIF delays are multiples of 10ms,
+ * frame boundaries are found by stepping the movie 10ms at a time until the
+ * generation id of its bitmap changes, which SkGIFMovie only does when it
+ * composites a new frame.
+ *
+ * The movie must only be used through this class once it is attached.
+ */
+class MovieFrameCache {
+public:
+    MovieFrameCache(SkMovie* movie, size_t maxBytes);
+    ~MovieFrameCache();
+
+    /**
+     * Selects the frame displayed at the specified time, clamped to the
+     * duration of the movie. Returns true if it is a different frame.
+     */
+    bool setTime(SkMSec time);
+
+    /**
+     * Returns the frame selected by the last call to setTime().
+     */
+    SkBitmap bitmap();
+
+    /**
+     * Returns the time at which the selected frame ends, which is when
+     * setTime() will next return true, or -1 if the movie does not animate.
+     */
+    int32_t frameEndTime();
+
+    /**
+     * Returns the cache attached to the specified movie, or NULL.
+     */
+    static MovieFrameCache* get(SkMovie* movie);
+
+    /**
+     * Attaches a cache to the specified movie, replacing the previous one.
+     * A budget of 0 detaches the cache.
+     */
+    static void attach(SkMovie* movie, size_t maxBytes);
+
+    /**
+     * Destroys the cache attached to the specified movie, if any. Must be
+     * called before the movie is deleted.
+     */
+    static void detach(SkMovie* movie);
+
+private:
+    // Smallest frame delay of a GIF
+    static const SkMSec kTimeStep = 10;
+
+    struct Frame {
+        SkMSec start;
+        SkMSec end;
+        SkBitmap bitmap;
+    };
+
+    class DecodeThread;
+    friend class DecodeThread;
+
+    bool decodeAhead();
+
+    // Must be called with mMovieLock held
+    void seekLocked(SkMSec time);
+    bool decodeFrameLocked(Frame* frame);
+
+    // Must be called with mLock held
+    bool hasRoomLocked() const;
+    void addFrameLocked(const Frame& frame, SkMSec nextStart);
+    ssize_t findFrameLocked(SkMSec time) const;
+
+    SkMovie* const mMovie;
+    const size_t mMaxBytes;
+    const SkMSec mDuration;
+
+    // Protects the movie and the decoder state, taken before mLock
+    Mutex mMovieLock;
+    // Start of the frame held by the movie's bitmap
+    SkMSec mDecodeTime;
+    uint32_t mDecodeGenerationId;
+
+    // Protects the frames
+    Mutex mLock;
+    Condition mCondition;
+    Vector<Frame> mFrames;
+    size_t mBytes;
+    // Index of the displayed frame, the frames before it were played
+    size_t mCurrent;
+    // True once every frame of the movie is cached
+    bool mComplete;
+    bool mExit;
+
+    // Frame selected by setTime(), only used by the caller's thread
+    SkBitmap mBitmap;
+    SkMSec mBitmapEnd;
+
+    sp<DecodeThread> mThread;
+}; // class MovieFrameCache
+
+}; // namespace android
+
+#endif // ANDROID_MOVIE_FRAME_CACHE_H
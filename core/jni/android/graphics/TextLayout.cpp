@@ -73,7 +73,7 @@ void TextLayout::getTextRunAdvances(SkPaint* paint, const jchar* chars, jint sta
         return ;
     }
     if (resultAdvances) {
-        memcpy(resultAdvances, value->getAdvances(), value->getAdvancesCount() * sizeof(jfloat));
+        value->copyAdvances(resultAdvances);
     }
     if (resultTotalAdvance) {
         *resultTotalAdvance = value->getTotalAdvance();
@@ -34,25 +34,39 @@ ANDROID_SINGLETON_STATIC_INSTANCE(TextLayoutEngine);
 
 //--------------------------------------------------------------------------------------------------
 
+TextLayoutCache::Shard::Shard() :
+        mCache(LruCache<TextLayoutCacheKey, sp<TextLayoutValue> >::kUnlimitedCapacity),
+        mSize(0), mDebugEnabled(false) {
+    mCache.setOnEntryRemovedListener(this);
+}
+
 TextLayoutCache::TextLayoutCache(TextLayoutShaper* shaper) :
         mShaper(shaper),
-        mCache(LruCache<TextLayoutCacheKey, sp<TextLayoutValue> >::kUnlimitedCapacity),
-        mSize(0), mMaxSize(MB(DEFAULT_TEXT_LAYOUT_CACHE_SIZE_IN_MB)),
+        mMaxSize(MB(DEFAULT_TEXT_LAYOUT_CACHE_SIZE_IN_MB)),
+        mShardMaxSize(mMaxSize / kShardCount),
         mCacheHitCount(0), mNanosecondsSaved(0) {
     init();
 }
 
 TextLayoutCache::~TextLayoutCache() {
-    mCache.clear();
+    for (size_t i = 0; i < kShardCount; i++) {
+        mShards[i].mCache.clear();
+    }
 }
 
 void TextLayoutCache::init() {
-    mCache.setOnEntryRemovedListener(this);
-
     mDebugLevel = readRtlDebugLevel();
     mDebugEnabled = mDebugLevel & kRtlDebugCaches;
     ALOGD("Using debug level = %d - Debug Enabled = %d", mDebugLevel, mDebugEnabled);
 
+    for (size_t i = 0; i < kShardCount; i++) {
+        mShards[i].mDebugEnabled = mDebugEnabled;
+    }
+
+    char property[PROPERTY_VALUE_MAX];
+    property_get(PROPERTY_TEXT_LAYOUT_COMPACT_KEYS, property, "false");
+    mCompactKeys = !strcmp(property, "true");
+
     mCacheStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
 
     if (mDebugEnabled) {
@@ -65,7 +79,7 @@ void TextLayoutCache::init() {
 /**
  *  Callbacks
  */
-void TextLayoutCache::operator()(TextLayoutCacheKey& text, sp<TextLayoutValue>& desc) {
+void TextLayoutCache::Shard::operator()(TextLayoutCacheKey& text, sp<TextLayoutValue>& desc) {
     size_t totalSizeToDelete = text.getSize() + desc->getSize();
     mSize -= totalSizeToDelete;
     if (mDebugEnabled) {
@@ -77,8 +91,11 @@ void TextLayoutCache::operator()(TextLayoutCacheKey& text, sp<TextLayoutValue>&
  * Cache clearing
  */
 void TextLayoutCache::purgeCaches() {
-    AutoMutex _l(mLock);
-    mCache.clear();
+    for (size_t i = 0; i < kShardCount; i++) {
+        AutoMutex _l(mShards[i].mLock);
+        mShards[i].mCache.clear();
+    }
+    AutoMutex _l(mShaperLock);
     mShaper->purgeCaches();
 }
 
@@ -87,7 +104,6 @@ void TextLayoutCache::purgeCaches() {
  */
 sp<TextLayoutValue> TextLayoutCache::getValue(const SkPaint* paint,
             const jchar* text, jint start, jint count, jint contextCount, jint dirFlags) {
-    AutoMutex _l(mLock);
     nsecs_t startTime = 0;
     if (mDebugEnabled) {
         startTime = systemTime(SYSTEM_TIME_MONOTONIC);
@@ -95,83 +111,35 @@ sp<TextLayoutValue> TextLayoutCache::getValue(const SkPaint* paint,
 
     // Create the key
     TextLayoutCacheKey key(paint, text, start, count, contextCount, dirFlags);
+    Shard& shard = mShards[key.hash() % kShardCount];
 
-    // Get value from cache if possible
-    sp<TextLayoutValue> value = mCache.get(key);
-
-    // Value not found for the key, we need to add a new value in the cache
-    if (value == NULL) {
-        if (mDebugEnabled) {
-            startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    // Get value from cache if possible. If another thread is already computing the
+    // value for this key, wait for it rather than shaping the same text twice.
+    sp<TextLayoutValue> value;
+    {
+        AutoMutex _l(shard.mLock);
+        value = shard.mCache.get(key);
+        while (value == NULL && shard.mPendingKeys.indexOf(key) >= 0) {
+            shard.mPendingDone.wait(shard.mLock);
+            value = shard.mCache.get(key);
         }
-
-        value = new TextLayoutValue(contextCount);
-
-        // Compute advances and store them
-        mShaper->computeValues(value.get(), paint,
-                reinterpret_cast<const UChar*>(key.getText()), start, count,
-                size_t(contextCount), int(dirFlags));
-
-        if (mDebugEnabled) {
-            value->setElapsedTime(systemTime(SYSTEM_TIME_MONOTONIC) - startTime);
+        if (value == NULL) {
+            shard.mPendingKeys.add(key);
         }
+    }
 
-        // Don't bother to add in the cache if the entry is too big
-        size_t size = key.getSize() + value->getSize();
-        if (size <= mMaxSize) {
-            // Cleanup to make some room if needed
-            if (mSize + size > mMaxSize) {
-                if (mDebugEnabled) {
-                    ALOGD("Need to clean some entries for making some room for a new entry");
-                }
-                while (mSize + size > mMaxSize) {
-                    // This will call the callback
-                    bool removedOne = mCache.removeOldest();
-                    LOG_ALWAYS_FATAL_IF(!removedOne, "The cache is non-empty but we "
-                            "failed to remove the oldest entry.  "
-                            "mSize = %u, size = %u, mMaxSize = %u, mCache.size() = %u",
-                            mSize, size, mMaxSize, mCache.size());
-                }
-            }
-
-            // Update current cache size
-            mSize += size;
-
-            bool putOne = mCache.put(key, value);
-            LOG_ALWAYS_FATAL_IF(!putOne, "Failed to put an entry into the cache.  "
-                    "This indicates that the cache already has an entry with the "
-                    "same key but it should not since we checked earlier!"
-                    " - start = %d, count = %d, contextCount = %d - Text = '%s'",
-                    start, count, contextCount, String8(key.getText() + start, count).string());
-
-            if (mDebugEnabled) {
-                nsecs_t totalTime = systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
-                ALOGD("CACHE MISS: Added entry %p "
-                        "with start = %d, count = %d, contextCount = %d, "
-                        "entry size %d bytes, remaining space %d bytes"
-                        " - Compute time %0.6f ms - Put time %0.6f ms - Text = '%s'",
-                        value.get(), start, count, contextCount, size, mMaxSize - mSize,
-                        value->getElapsedTime() * 0.000001f,
-                        (totalTime - value->getElapsedTime()) * 0.000001f,
-                        String8(key.getText() + start, count).string());
-            }
-        } else {
-            if (mDebugEnabled) {
-                ALOGD("CACHE MISS: Calculated but not storing entry because it is too big "
-                        "with start = %d, count = %d, contextCount = %d, "
-                        "entry size %d bytes, remaining space %d bytes"
-                        " - Compute time %0.6f ms - Text = '%s'",
-                        start, count, contextCount, size, mMaxSize - mSize,
-                        value->getElapsedTime() * 0.000001f,
-                        String8(key.getText() + start, count).string());
-            }
-        }
-    } else {
+    if (value != NULL) {
         // This is a cache hit, just log timestamp and user infos
         if (mDebugEnabled) {
             nsecs_t elapsedTimeThruCacheGet = systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
-            mNanosecondsSaved += (value->getElapsedTime() - elapsedTimeThruCacheGet);
-            ++mCacheHitCount;
+            bool dumpStats;
+            uint32_t cacheHitCount;
+            {
+                AutoMutex _l(mStatsLock);
+                mNanosecondsSaved += (value->getElapsedTime() - elapsedTimeThruCacheGet);
+                cacheHitCount = ++mCacheHitCount;
+                dumpStats = mCacheHitCount % DEFAULT_DUMP_STATS_CACHE_HIT_INTERVAL == 0;
+            }
 
             if (value->getElapsedTime() > 0) {
                 float deltaPercent = 100 * ((value->getElapsedTime() - elapsedTimeThruCacheGet)
@@ -179,25 +147,123 @@ sp<TextLayoutValue> TextLayoutCache::getValue(const SkPaint* paint,
                 ALOGD("CACHE HIT #%d with start = %d, count = %d, contextCount = %d"
                         "- Compute time %0.6f ms - "
                         "Cache get time %0.6f ms - Gain in percent: %2.2f - Text = '%s'",
-                        mCacheHitCount, start, count, contextCount,
+                        cacheHitCount, start, count, contextCount,
                         value->getElapsedTime() * 0.000001f,
                         elapsedTimeThruCacheGet * 0.000001f,
                         deltaPercent,
                         String8(key.getText() + start, count).string());
             }
-            if (mCacheHitCount % DEFAULT_DUMP_STATS_CACHE_HIT_INTERVAL == 0) {
+            if (dumpStats) {
                 dumpCacheStats();
             }
         }
+        return value;
+    }
+
+    // Value not found for the key, we need to add a new value in the cache
+    if (mDebugEnabled) {
+        startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+
+    value = new TextLayoutValue(contextCount);
+
+    // Compute advances and store them, holding only the shaper lock
+    {
+        AutoMutex _l(mShaperLock);
+        mShaper->computeValues(value.get(), paint,
+                reinterpret_cast<const UChar*>(key.getText()), start, count,
+                size_t(contextCount), int(dirFlags));
+    }
+
+    if (mDebugEnabled) {
+        value->setElapsedTime(systemTime(SYSTEM_TIME_MONOTONIC) - startTime);
+    }
+
+    value->compact();
+
+    // The key is only compacted for storage, shaping and logging need its text
+    TextLayoutCacheKey storedKey(key);
+    if (mCompactKeys) {
+        storedKey.compact();
+    }
+
+    AutoMutex _l(shard.mLock);
+    shard.mPendingKeys.remove(key);
+    shard.mPendingDone.broadcast();
+
+    // Don't bother to add in the cache if the entry is too big
+    size_t size = storedKey.getSize() + value->getSize();
+    if (size <= mShardMaxSize) {
+        // Cleanup to make some room if needed
+        if (shard.mSize + size > mShardMaxSize) {
+            if (mDebugEnabled) {
+                ALOGD("Need to clean some entries for making some room for a new entry");
+            }
+            while (shard.mSize + size > mShardMaxSize) {
+                // This will call the callback
+                bool removedOne = shard.mCache.removeOldest();
+                LOG_ALWAYS_FATAL_IF(!removedOne, "The cache is non-empty but we "
+                        "failed to remove the oldest entry.  "
+                        "mSize = %u, size = %u, mShardMaxSize = %u, mCache.size() = %u",
+                        shard.mSize, size, mShardMaxSize, shard.mCache.size());
+            }
+        }
+
+        // Update current cache size
+        shard.mSize += size;
+
+        bool putOne = shard.mCache.put(storedKey, value);
+        LOG_ALWAYS_FATAL_IF(!putOne, "Failed to put an entry into the cache.  "
+                "This indicates that the cache already has an entry with the "
+                "same key but it should not since the key was marked pending!"
+                " - start = %d, count = %d, contextCount = %d - Text = '%s'",
+                start, count, contextCount, String8(key.getText() + start, count).string());
+
+        if (mDebugEnabled) {
+            nsecs_t totalTime = systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
+            ALOGD("CACHE MISS: Added entry %p "
+                    "with start = %d, count = %d, contextCount = %d, "
+                    "entry size %d bytes, remaining space %d bytes"
+                    " - Compute time %0.6f ms - Put time %0.6f ms - Text = '%s'",
+                    value.get(), start, count, contextCount, size,
+                    mShardMaxSize - shard.mSize,
+                    value->getElapsedTime() * 0.000001f,
+                    (totalTime - value->getElapsedTime()) * 0.000001f,
+                    String8(key.getText() + start, count).string());
+        }
+    } else {
+        if (mDebugEnabled) {
+            ALOGD("CACHE MISS: Calculated but not storing entry because it is too big "
+                    "with start = %d, count = %d, contextCount = %d, "
+                    "entry size %d bytes, remaining space %d bytes"
+                    " - Compute time %0.6f ms - Text = '%s'",
+                    start, count, contextCount, size, mShardMaxSize - shard.mSize,
+                    value->getElapsedTime() * 0.000001f,
+                    String8(key.getText() + start, count).string());
+        }
     }
     return value;
 }
 
 void TextLayoutCache::dumpCacheStats() {
-    float remainingPercent = 100 * ((mMaxSize - mSize) / ((float)mMaxSize));
-    float timeRunningInSec = (systemTime(SYSTEM_TIME_MONOTONIC) - mCacheStartTime) / 1000000000;
+    size_t cacheSize = 0;
+    uint32_t size = 0;
+    for (size_t i = 0; i < kShardCount; i++) {
+        AutoMutex _l(mShards[i].mLock);
+        cacheSize += mShards[i].mCache.size();
+        size += mShards[i].mSize;
+    }
+
+    uint32_t cacheHitCount;
+    uint64_t nanosecondsSaved;
+    {
+        AutoMutex _l(mStatsLock);
+        cacheHitCount = mCacheHitCount;
+        nanosecondsSaved = mNanosecondsSaved;
+    }
 
-    size_t cacheSize = mCache.size();
+    float remainingPercent = 100 * ((mMaxSize - size) / ((float)mMaxSize));
+    float timeRunningInSec = (systemTime(SYSTEM_TIME_MONOTONIC) - mCacheStartTime) / 1000000000;
 
     ALOGD("------------------------------------------------");
     ALOGD("Cache stats");
@@ -205,11 +271,12 @@ void TextLayoutCache::dumpCacheStats() {
     ALOGD("pid       : %d", getpid());
     ALOGD("running   : %.0f seconds", timeRunningInSec);
     ALOGD("entries   : %d", cacheSize);
+    ALOGD("shards    : %d", kShardCount);
     ALOGD("max size  : %d bytes", mMaxSize);
-    ALOGD("used      : %d bytes according to mSize", mSize);
-    ALOGD("remaining : %d bytes or %2.2f percent", mMaxSize - mSize, remainingPercent);
-    ALOGD("hits      : %d", mCacheHitCount);
-    ALOGD("saved     : %0.6f ms", mNanosecondsSaved * 0.000001f);
+    ALOGD("used      : %d bytes according to mSize", size);
+    ALOGD("remaining : %d bytes or %2.2f percent", mMaxSize - size, remainingPercent);
+    ALOGD("hits      : %d", cacheHitCount);
+    ALOGD("saved     : %0.6f ms", nanosecondsSaved * 0.000001f);
     ALOGD("------------------------------------------------");
 }
 
@@ -218,14 +285,14 @@ void TextLayoutCache::dumpCacheStats() {
  */
 TextLayoutCacheKey::TextLayoutCacheKey(): start(0), count(0), contextCount(0),
         dirFlags(0), typeface(NULL), textSize(0), textSkewX(0), textScaleX(0), flags(0),
-        hinting(SkPaint::kNo_Hinting) {
+        hinting(SkPaint::kNo_Hinting), isCompact(false), fullHash(0), textHash(0) {
     paintOpts.setUseFontFallbacks(true);
 }
 
 TextLayoutCacheKey::TextLayoutCacheKey(const SkPaint* paint, const UChar* text,
         size_t start, size_t count, size_t contextCount, int dirFlags) :
             start(start), count(count), contextCount(contextCount),
-            dirFlags(dirFlags) {
+            dirFlags(dirFlags), isCompact(false), fullHash(0), textHash(0) {
     textCopy.setTo(text, contextCount);
     typeface = paint->getTypeface();
     textSize = paint->getTextSize();
@@ -248,7 +315,52 @@ TextLayoutCacheKey::TextLayoutCacheKey(const TextLayoutCacheKey& other) :
         textScaleX(other.textScaleX),
         flags(other.flags),
         hinting(other.hinting),
-        paintOpts(other.paintOpts) {
+        paintOpts(other.paintOpts),
+        isCompact(other.isCompact),
+        fullHash(other.fullHash),
+        textHash(other.textHash) {
+}
+
+void TextLayoutCacheKey::compact() {
+    if (isCompact) {
+        return;
+    }
+    fullHash = hash();
+    textHash = computeTextHash();
+
+    UChar slice[COMPACT_KEY_SLICE_LENGTH * 2];
+    size_t sliceLength;
+    getTextSlice(slice, &sliceLength);
+    textCopy.setTo(slice, sliceLength);
+    isCompact = true;
+}
+
+uint32_t TextLayoutCacheKey::computeTextHash() const {
+    if (isCompact) {
+        return textHash;
+    }
+    // Seeded differently from hash() so that together they form a 64 bit check
+    uint32_t hash = JenkinsHashMix(0x9e3779b9, contextCount);
+    hash = JenkinsHashMixShorts(hash, getText(), contextCount);
+    return JenkinsHashWhiten(hash);
+}
+
+void TextLayoutCacheKey::getTextSlice(UChar* outSlice, size_t* outLength) const {
+    if (isCompact) {
+        memcpy(outSlice, getText(), textCopy.size() * sizeof(UChar));
+        *outLength = textCopy.size();
+        return;
+    }
+    if (contextCount <= COMPACT_KEY_SLICE_LENGTH * 2) {
+        memcpy(outSlice, getText(), contextCount * sizeof(UChar));
+        *outLength = contextCount;
+        return;
+    }
+    memcpy(outSlice, getText(), COMPACT_KEY_SLICE_LENGTH * sizeof(UChar));
+    memcpy(outSlice + COMPACT_KEY_SLICE_LENGTH,
+            getText() + contextCount - COMPACT_KEY_SLICE_LENGTH,
+            COMPACT_KEY_SLICE_LENGTH * sizeof(UChar));
+    *outLength = COMPACT_KEY_SLICE_LENGTH * 2;
 }
 
 int TextLayoutCacheKey::compare(const TextLayoutCacheKey& lhs, const TextLayoutCacheKey& rhs) {
@@ -285,14 +397,36 @@ int TextLayoutCacheKey::compare(const TextLayoutCacheKey& lhs, const TextLayoutC
     if (lhs.paintOpts != rhs.paintOpts)
         return memcmp(&lhs.paintOpts, &rhs.paintOpts, sizeof(SkPaintOptionsAndroid));
 
+    if (lhs.isCompact || rhs.isCompact) {
+        // The text of a compact key is only known through its hashes and slice
+        hash_t lhsHash = lhs.hash();
+        hash_t rhsHash = rhs.hash();
+        if (lhsHash != rhsHash) return lhsHash < rhsHash ? -1 : +1;
+
+        uint32_t lhsTextHash = lhs.computeTextHash();
+        uint32_t rhsTextHash = rhs.computeTextHash();
+        if (lhsTextHash != rhsTextHash) return lhsTextHash < rhsTextHash ? -1 : +1;
+
+        UChar lhsSlice[COMPACT_KEY_SLICE_LENGTH * 2];
+        UChar rhsSlice[COMPACT_KEY_SLICE_LENGTH * 2];
+        size_t sliceLength;
+        lhs.getTextSlice(lhsSlice, &sliceLength);
+        rhs.getTextSlice(rhsSlice, &sliceLength);
+        return memcmp(lhsSlice, rhsSlice, sliceLength * sizeof(UChar));
+    }
+
     return memcmp(lhs.getText(), rhs.getText(), lhs.contextCount * sizeof(UChar));
 }
 
 size_t TextLayoutCacheKey::getSize() const {
-    return sizeof(TextLayoutCacheKey) + sizeof(UChar) * contextCount;
+    return sizeof(TextLayoutCacheKey) + sizeof(UChar) * textCopy.size();
 }
 
 hash_t TextLayoutCacheKey::hash() const {
+    if (isCompact) {
+        return fullHash;
+    }
+
     uint32_t hash = JenkinsHashMix(0, start);
     hash = JenkinsHashMix(hash, count);
     /* contextCount not needed because it's included in text, below */
@@ -313,7 +447,7 @@ hash_t TextLayoutCacheKey::hash() const {
  * TextLayoutCacheValue
  */
 TextLayoutValue::TextLayoutValue(size_t contextCount) :
-        mTotalAdvance(0), mElapsedTime(0) {
+        mTotalAdvance(0), mElapsedTime(0), mFixedAdvances(false), mPosElided(false) {
     mBounds.setEmpty();
     // Give a hint for advances and glyphs vectors size
     mAdvances.setCapacity(contextCount);
@@ -323,9 +457,91 @@ TextLayoutValue::TextLayoutValue(size_t contextCount) :
 
 size_t TextLayoutValue::getSize() const {
     return sizeof(TextLayoutValue) + sizeof(jfloat) * mAdvances.capacity() +
+            sizeof(int16_t) * mCompactAdvances.capacity() +
             sizeof(jchar) * mGlyphs.capacity() + sizeof(jfloat) * mPos.capacity();
 }
 
+/**
+ * Drop the capacity hints given at construction, which are sized for the whole context
+ */
+template<typename T>
+static void trimToSize(Vector<T>* vector) {
+    if (vector->capacity() == vector->size()) {
+        return;
+    }
+    Vector<T> trimmed;
+    trimmed.setCapacity(vector->size());
+    trimmed.appendVector(*vector);
+    *vector = trimmed;
+}
+
+void TextLayoutValue::copyAdvances(jfloat* outAdvances) const {
+    if (!mFixedAdvances) {
+        memcpy(outAdvances, mAdvances.array(), mAdvances.size() * sizeof(jfloat));
+        return;
+    }
+    for (size_t i = 0; i < mCompactAdvances.size(); i++) {
+        outAdvances[i] = mCompactAdvances[i] / 256.0f;
+    }
+}
+
+const jfloat* TextLayoutValue::getPos(PosStorage* storage) const {
+    if (!mPosElided) {
+        return mPos.array();
+    }
+    size_t glyphsCount = mGlyphs.size();
+    storage->resize(glyphsCount * 2);
+    jfloat* pos = storage->editArray();
+    jfloat x = 0;
+    for (size_t i = 0; i < glyphsCount; i++) {
+        pos[2 * i] = x;
+        pos[2 * i + 1] = 0;
+        x += advanceAt(i);
+    }
+    return pos;
+}
+
+void TextLayoutValue::compact() {
+    if (mFixedAdvances || mPosElided) {
+        return;
+    }
+
+    // Positions can be recomputed if there is one glyph per char, each placed on the
+    // baseline at the sum of the preceding advances
+    size_t glyphsCount = mGlyphs.size();
+    bool elidePos = glyphsCount == mAdvances.size();
+    jfloat x = 0;
+    for (size_t i = 0; elidePos && i < glyphsCount; i++) {
+        elidePos = mPos[2 * i] == x && mPos[2 * i + 1] == 0;
+        x += mAdvances[i];
+    }
+
+    bool fixedAdvances = true;
+    for (size_t i = 0; fixedAdvances && i < mAdvances.size(); i++) {
+        jfloat scaled = mAdvances[i] * 256.0f;
+        fixedAdvances = scaled >= -32768.0f && scaled <= 32767.0f &&
+                scaled == jfloat(int32_t(scaled));
+    }
+
+    if (elidePos) {
+        mPos = Vector<jfloat>();
+        mPosElided = true;
+    } else {
+        trimToSize(&mPos);
+    }
+    trimToSize(&mGlyphs);
+    if (fixedAdvances) {
+        mCompactAdvances.setCapacity(mAdvances.size());
+        for (size_t i = 0; i < mAdvances.size(); i++) {
+            mCompactAdvances.add(int16_t(mAdvances[i] * 256.0f));
+        }
+        mAdvances = Vector<jfloat>();
+        mFixedAdvances = true;
+    } else {
+        trimToSize(&mAdvances);
+    }
+}
+
 void TextLayoutValue::setElapsedTime(uint32_t time) {
     mElapsedTime = time;
 }
@@ -334,7 +550,8 @@ uint32_t TextLayoutValue::getElapsedTime() {
     return mElapsedTime;
 }
 
-TextLayoutShaper::TextLayoutShaper() {
+TextLayoutShaper::TextLayoutShaper() : mWordCache(DEFAULT_WORD_CACHE_CAPACITY),
+        mWordCacheHits(0) {
     mBuffer = hb_buffer_create();
 }
 
@@ -716,61 +933,122 @@ void TextLayoutShaper::computeRunValues(const SkPaint* paint, const UChar* conte
         ALOGD("         -- string = '%s'", String8(chars, count).string());
 #endif
 
-        hb_buffer_reset(mBuffer);
-        // Note: if we want to set unicode functions, etc., this is the place.
-        
-        hb_buffer_set_direction(mBuffer, isRTL ? HB_DIRECTION_RTL : HB_DIRECTION_LTR);
-        hb_buffer_set_script(mBuffer, run.script);
-        SkString langString = paint->getPaintOptionsAndroid().getLanguage().getTag();
-        hb_buffer_set_language(mBuffer, hb_language_from_string(langString.c_str(), -1));
-        hb_buffer_add_utf16(mBuffer, contextChars, contextCount, start + run.pos, run.length);
-
-        // Initialize Harfbuzz Shaper and get the base glyph count for offsetting the glyphIDs
-        // and shape the Font run
-        size_t glyphBaseCount = shapeFontRun(paint);
-        unsigned int numGlyphs;
-        hb_glyph_info_t* info = hb_buffer_get_glyph_infos(mBuffer, &numGlyphs);
-        hb_glyph_position_t* positions = hb_buffer_get_glyph_positions(mBuffer, NULL);
+        if (!isRTL && isWordCacheableScript(run.script)
+                && run.length <= MAX_WORD_CACHE_RUN_LENGTH) {
+            // These scripts are not shaped across script runs, so the run can be
+            // assembled from the word cache
+            sp<TextLayoutValue> word = getShapedWord(paint, chars + run.pos, run.length,
+                    run.script);
+            const jfloat* wordAdvances = word->mAdvances.array();
+            for (size_t i = 0; i < run.length; i++) {
+                size_t index = run.pos + i;
+                outAdvances->replaceAt(outAdvances->itemAt(index) + wordAdvances[i], index);
+            }
+            outGlyphs->appendArray(word->getGlyphs(), word->getGlyphsCount());
+            const jfloat* wordPos = word->mPos.array();
+            for (size_t i = 0; i < word->mPos.size(); i += 2) {
+                outPos->add(totalAdvance + wordPos[i]);
+                outPos->add(wordPos[i + 1]);
+            }
+            SkRect wordBounds = word->getBounds();
+            wordBounds.offset(totalAdvance, 0);
+            outBounds->join(wordBounds);
+            totalAdvance += word->getTotalAdvance();
+            continue;
+        }
+
+        shapeScriptRun(paint, contextChars, contextCount, start, start + run.pos, run.length,
+                run.script, isRTL, outAdvances, &totalAdvance, outBounds, outGlyphs, outPos);
+    }
+
+    *outTotalAdvance = totalAdvance;
+
+#if DEBUG_GLYPHS
+    ALOGD("         -- final totalAdvance = %f", totalAdvance);
+    ALOGD("-------- End of Script Run --------");
+#endif
+}
+
+void TextLayoutShaper::shapeScriptRun(const SkPaint* paint, const UChar* contextChars,
+        size_t contextCount, size_t start, size_t runStart, size_t runLength,
+        hb_script_t script, bool isRTL,
+        Vector<jfloat>* const outAdvances, jfloat* outTotalAdvance, SkRect* outBounds,
+        Vector<jchar>* const outGlyphs, Vector<jfloat>* const outPos) {
+    float skewX = paint->getTextSkewX();
+    jfloat totalAdvance = *outTotalAdvance;
+
+    hb_buffer_reset(mBuffer);
+    // Note: if we want to set unicode functions, etc., this is the place.
+    
+    hb_buffer_set_direction(mBuffer, isRTL ? HB_DIRECTION_RTL : HB_DIRECTION_LTR);
+    hb_buffer_set_script(mBuffer, script);
+    SkString langString = paint->getPaintOptionsAndroid().getLanguage().getTag();
+    hb_buffer_set_language(mBuffer, hb_language_from_string(langString.c_str(), -1));
+    hb_buffer_add_utf16(mBuffer, contextChars, contextCount, runStart, runLength);
+
+    // Initialize Harfbuzz Shaper and get the base glyph count for offsetting the glyphIDs
+    // and shape the Font run
+    size_t glyphBaseCount = shapeFontRun(paint);
+    unsigned int numGlyphs;
+    hb_glyph_info_t* info = hb_buffer_get_glyph_infos(mBuffer, &numGlyphs);
+    hb_glyph_position_t* positions = hb_buffer_get_glyph_positions(mBuffer, NULL);
 
 #if DEBUG_GLYPHS
-        ALOGD("Got from Harfbuzz");
-        ALOGD("         -- glyphBaseCount = %d", glyphBaseCount);
-        ALOGD("         -- num_glyph = %d", numGlyphs);
-        ALOGD("         -- isDevKernText = %d", paint->isDevKernText());
-        ALOGD("         -- initial totalAdvance = %f", totalAdvance);
+    ALOGD("Got from Harfbuzz");
+    ALOGD("         -- glyphBaseCount = %d", glyphBaseCount);
+    ALOGD("         -- num_glyph = %d", numGlyphs);
+    ALOGD("         -- isDevKernText = %d", paint->isDevKernText());
+    ALOGD("         -- initial totalAdvance = %f", totalAdvance);
 
-        logGlyphs(mBuffer);
+    logGlyphs(mBuffer);
 #endif
 
-        for (size_t i = 0; i < numGlyphs; i++) {
-            size_t cluster = info[i].cluster - start;
-            float xAdvance = HBFixedToFloat(positions[i].x_advance);
-            outAdvances->replaceAt(outAdvances->itemAt(cluster) + xAdvance, cluster);
-            jchar glyphId = info[i].codepoint + glyphBaseCount;
-            outGlyphs->add(glyphId);
-            float xo = HBFixedToFloat(positions[i].x_offset);
-            float yo = -HBFixedToFloat(positions[i].y_offset);
-
-            float xpos = totalAdvance + xo + yo * skewX;
-            float ypos = yo;
-            outPos->add(xpos);
-            outPos->add(ypos);
-            totalAdvance += xAdvance;
-
-            // TODO: consider using glyph cache
-            const SkGlyph& metrics = mShapingPaint.getGlyphMetrics(glyphId, NULL);
-            outBounds->join(xpos + metrics.fLeft, ypos + metrics.fTop,
-                    xpos + metrics.fLeft + metrics.fWidth, ypos + metrics.fTop + metrics.fHeight);
+    for (size_t i = 0; i < numGlyphs; i++) {
+        size_t cluster = info[i].cluster - start;
+        float xAdvance = HBFixedToFloat(positions[i].x_advance);
+        outAdvances->replaceAt(outAdvances->itemAt(cluster) + xAdvance, cluster);
+        jchar glyphId = info[i].codepoint + glyphBaseCount;
+        outGlyphs->add(glyphId);
+        float xo = HBFixedToFloat(positions[i].x_offset);
+        float yo = -HBFixedToFloat(positions[i].y_offset);
+
+        float xpos = totalAdvance + xo + yo * skewX;
+        float ypos = yo;
+        outPos->add(xpos);
+        outPos->add(ypos);
+        totalAdvance += xAdvance;
+
+        // TODO: consider using glyph cache
+        const SkGlyph& metrics = mShapingPaint.getGlyphMetrics(glyphId, NULL);
+        outBounds->join(xpos + metrics.fLeft, ypos + metrics.fTop,
+                xpos + metrics.fLeft + metrics.fWidth, ypos + metrics.fTop + metrics.fHeight);
 
-        }
     }
 
     *outTotalAdvance = totalAdvance;
+}
 
-#if DEBUG_GLYPHS
-    ALOGD("         -- final totalAdvance = %f", totalAdvance);
-    ALOGD("-------- End of Script Run --------");
-#endif
+/**
+ * Return the shaped values of a simple script LTR run, shaping it without context on a
+ * word cache miss. mShapingPaint must already be set up for paint.
+ */
+sp<TextLayoutValue> TextLayoutShaper::getShapedWord(const SkPaint* paint, const UChar* chars,
+        size_t count, hb_script_t script) {
+    TextLayoutCacheKey key(paint, chars, 0, count, count, kBidi_Force_LTR);
+    sp<TextLayoutValue> word = mWordCache.get(key);
+    if (word != NULL) {
+        mWordCacheHits++;
+    } else {
+        word = new TextLayoutValue(count);
+        for (size_t i = 0; i < count; i++) {
+            word->mAdvances.add(0);
+        }
+        shapeScriptRun(paint, chars, count, 0, 0, count, script, false,
+                &word->mAdvances, &word->mTotalAdvance, &word->mBounds,
+                &word->mGlyphs, &word->mPos);
+        mWordCache.put(key, word);
+    }
+    return word;
 }
 
 /**
@@ -806,6 +1084,27 @@ bool TextLayoutShaper::isComplexScript(hb_script_t script) {
     }
 }
 
+bool TextLayoutShaper::isWordCacheableScript(hb_script_t script) {
+    // isComplexScript() is about fallback fonts and includes Latin; this is
+    // about whether the glyphs of a run depend on the text around it
+    switch (script) {
+    case HB_SCRIPT_COMMON:
+    case HB_SCRIPT_INHERITED:
+    case HB_SCRIPT_LATIN:
+    case HB_SCRIPT_GREEK:
+    case HB_SCRIPT_CYRILLIC:
+    case HB_SCRIPT_ARMENIAN:
+    case HB_SCRIPT_GEORGIAN:
+    case HB_SCRIPT_HANGUL:
+    case HB_SCRIPT_HAN:
+    case HB_SCRIPT_KATAKANA:
+    case HB_SCRIPT_HIRAGANA:
+        return true;
+    default:
+        return false;
+    }
+}
+
 size_t TextLayoutShaper::shapeFontRun(const SkPaint* paint) {
     // Update Harfbuzz Shaper
 
@@ -879,8 +1178,7 @@ hb_face_t* TextLayoutShaper::referenceCachedHBFace(SkTypeface* typeface) {
     if (index >= 0) {
         return hb_face_reference(mCachedHBFaces.valueAt(index));
     }
-    // TODO: destroy function
-    hb_face_t* face = hb_face_create_for_tables(harfbuzzSkiaReferenceTable, typeface, NULL);
+    hb_face_t* face = createFace(typeface);
 #if DEBUG_GLYPHS
     ALOGD("Created HB_NewFace %p from paint typeface = %p", face, typeface);
 #endif
@@ -894,6 +1192,7 @@ void TextLayoutShaper::purgeCaches() {
         hb_face_destroy(mCachedHBFaces.valueAt(i));
     }
     mCachedHBFaces.clear();
+    mWordCache.clear();
 }
 
 TextLayoutEngine::TextLayoutEngine() {
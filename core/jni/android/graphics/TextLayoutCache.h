@@ -24,6 +24,7 @@
 #include <utils/String16.h>
 #include <utils/LruCache.h>
 #include <utils/KeyedVector.h>
+#include <utils/SortedVector.h>
 #include <utils/RefBase.h>
 #include <utils/Singleton.h>
 
@@ -56,6 +57,18 @@
 // Define the default cache size in Mb
 #define DEFAULT_TEXT_LAYOUT_CACHE_SIZE_IN_MB 0.500f
 
+// Define the number of shaped script runs kept by the word cache
+#define DEFAULT_WORD_CACHE_CAPACITY 1024
+
+// Define the longest script run, in UTF-16 units, that goes through the word cache
+#define MAX_WORD_CACHE_RUN_LENGTH 32
+
+// Define the number of UTF-16 units kept from each end of the text by a compact key
+#define COMPACT_KEY_SLICE_LENGTH 8
+
+// System property enabling compact cache keys, which keep only hashes of the text
+#define PROPERTY_TEXT_LAYOUT_COMPACT_KEYS "ro.text_layout.compact_keys"
+
 // Define the interval in number of cache hits between two statistics dump
 #define DEFAULT_DUMP_STATS_CACHE_HIT_INTERVAL 100
 
@@ -80,8 +93,17 @@ public:
 
     static int compare(const TextLayoutCacheKey& lhs, const TextLayoutCacheKey& rhs);
 
+    /**
+     * Get the text of the key. Not available once the key has been compacted.
+     */
     inline const UChar* getText() const { return textCopy.string(); }
 
+    /**
+     * Replace the text copy with two hashes of it plus a few characters from each
+     * end for verification, so the key no longer grows with the text length.
+     */
+    void compact();
+
     bool operator==(const TextLayoutCacheKey& other) const {
         return compare(*this, other) == 0;
     }
@@ -105,6 +127,16 @@ private:
     SkPaint::Hinting hinting;
     SkPaintOptionsAndroid paintOpts;
 
+    /**
+     * Set by compact(): textCopy then only holds the verification slice
+     */
+    bool isCompact;
+    hash_t fullHash;
+    uint32_t textHash;
+
+    uint32_t computeTextHash() const;
+    void getTextSlice(UChar* outSlice, size_t* outLength) const;
+
 }; // TextLayoutCacheKey
 
 inline int strictly_order_type(const TextLayoutCacheKey& lhs, const TextLayoutCacheKey& rhs) {
@@ -129,14 +161,29 @@ public:
     void setElapsedTime(uint32_t time);
     uint32_t getElapsedTime();
 
-    inline const jfloat* getAdvances() const { return mAdvances.array(); }
-    inline size_t getAdvancesCount() const { return mAdvances.size(); }
+    /**
+     * Storage for positions decoded from a compact value
+     */
+    typedef Vector<jfloat> PosStorage;
+
+    void copyAdvances(jfloat* outAdvances) const;
+    inline size_t getAdvancesCount() const {
+        return mFixedAdvances ? mCompactAdvances.size() : mAdvances.size();
+    }
     inline jfloat getTotalAdvance() const { return mTotalAdvance; }
     inline const SkRect& getBounds() const { return mBounds; }
     inline const jchar* getGlyphs() const { return mGlyphs.array(); }
     inline size_t getGlyphsCount() const { return mGlyphs.size(); }
-    inline const jfloat* getPos() const { return mPos.array(); }
-    inline size_t getPosCount() const { return mPos.size(); }
+    const jfloat* getPos(PosStorage* storage) const;
+    inline size_t getPosCount() const { return mGlyphs.size() * 2; }
+
+    /**
+     * Re-encode the value once it is computed. Advances that are whole 24.8 fixed
+     * point values, as returned by Harfbuzz, are stored as 16 bit integers, and
+     * positions are dropped when they are the running sum of the advances on the
+     * baseline (one glyph per char, no offsets). Both encodings are lossless.
+     */
+    void compact();
 
     /**
      * Advances vector
@@ -174,6 +221,21 @@ private:
      */
     uint32_t mElapsedTime;
 
+    /**
+     * Advances in 1/256 pixels, replacing mAdvances when mFixedAdvances is set
+     */
+    Vector<int16_t> mCompactAdvances;
+    bool mFixedAdvances;
+
+    /**
+     * Set when mPos has been dropped and is recomputed from the advances
+     */
+    bool mPosElided;
+
+    inline jfloat advanceAt(size_t index) const {
+        return mFixedAdvances ? mCompactAdvances[index] / 256.0f : mAdvances[index];
+    }
+
 }; // TextLayoutCacheValue
 
 /**
@@ -189,6 +251,15 @@ public:
 
     void purgeCaches();
 
+    /**
+     * Whether runs of the script are shaped independently of the text around them,
+     * and can be assembled from the word cache
+     */
+    static bool isWordCacheableScript(hb_script_t script);
+
+    size_t getWordCacheSize() const { return mWordCache.size(); }
+    uint32_t getWordCacheHits() const { return mWordCacheHits; }
+
 private:
     /**
      * Harfbuzz buffer for shaping
@@ -205,6 +276,13 @@ private:
      */
     KeyedVector<SkFontID, hb_face_t*> mCachedHBFaces;
 
+    /**
+     * Cache of shaped LTR script runs of simple scripts, which are usually single
+     * words or spaces. Positions and bounds are relative to the start of the run.
+     */
+    LruCache<TextLayoutCacheKey, sp<TextLayoutValue> > mWordCache;
+    uint32_t mWordCacheHits;
+
     SkTypeface* typefaceForScript(const SkPaint* paint, SkTypeface* typeface,
         hb_script_t script);
 
@@ -220,6 +298,14 @@ private:
             Vector<jfloat>* const outAdvances, jfloat* outTotalAdvance, SkRect* outBounds,
             Vector<jchar>* const outGlyphs, Vector<jfloat>* const outPos);
 
+    void shapeScriptRun(const SkPaint* paint, const UChar* contextChars, size_t contextCount,
+            size_t start, size_t runStart, size_t runLength, hb_script_t script, bool isRTL,
+            Vector<jfloat>* const outAdvances, jfloat* outTotalAdvance, SkRect* outBounds,
+            Vector<jchar>* const outGlyphs, Vector<jfloat>* const outPos);
+
+    sp<TextLayoutValue> getShapedWord(const SkPaint* paint, const UChar* chars,
+            size_t count, hb_script_t script);
+
     SkTypeface* setCachedTypeface(SkTypeface** typeface, hb_script_t script, SkTypeface::Style style);
     hb_face_t* referenceCachedHBFace(SkTypeface* typeface);
 
@@ -228,9 +314,11 @@ private:
 
 /**
  * Cache of text layout information.
+ *
+ * The cache is split into shards selected by key hash, each with its own lock, and
+ * shaping runs outside of any shard lock so that cache hits never wait on HarfBuzz.
  */
-class TextLayoutCache : private OnEntryRemoved<TextLayoutCacheKey, sp<TextLayoutValue> >
-{
+class TextLayoutCache {
 public:
     TextLayoutCache(TextLayoutShaper* shaper);
 
@@ -240,12 +328,6 @@ public:
         return mInitialized;
     }
 
-    /**
-     * Used as a callback when an entry is removed from the cache
-     * Do not invoke directly
-     */
-    void operator()(TextLayoutCacheKey& text, sp<TextLayoutValue>& desc);
-
     sp<TextLayoutValue> getValue(const SkPaint* paint, const jchar* text, jint start,
             jint count, jint contextCount, jint dirFlags);
 
@@ -255,20 +337,67 @@ public:
     void purgeCaches();
 
 private:
+    /**
+     * One independently locked slice of the cache
+     */
+    class Shard : private OnEntryRemoved<TextLayoutCacheKey, sp<TextLayoutValue> > {
+    public:
+        Shard();
+
+        /**
+         * Used as a callback when an entry is removed from the cache
+         * Do not invoke directly
+         */
+        void operator()(TextLayoutCacheKey& text, sp<TextLayoutValue>& desc);
+
+        Mutex mLock;
+
+        /**
+         * Signaled whenever a key is removed from mPendingKeys
+         */
+        Condition mPendingDone;
+
+        /**
+         * Keys whose values are being computed by some thread
+         */
+        SortedVector<TextLayoutCacheKey> mPendingKeys;
+
+        LruCache<TextLayoutCacheKey, sp<TextLayoutValue> > mCache;
+
+        uint32_t mSize;
+        bool mDebugEnabled;
+    };
+
+    static const size_t kShardCount = 8;
+
     TextLayoutShaper* mShaper;
-    Mutex mLock;
+
+    /**
+     * Serializes use of mShaper, which is not thread safe
+     */
+    Mutex mShaperLock;
+
     bool mInitialized;
 
-    LruCache<TextLayoutCacheKey, sp<TextLayoutValue> > mCache;
+    Shard mShards[kShardCount];
 
-    uint32_t mSize;
     uint32_t mMaxSize;
+    uint32_t mShardMaxSize;
 
+    /**
+     * Protects the statistics below
+     */
+    Mutex mStatsLock;
     uint32_t mCacheHitCount;
     uint64_t mNanosecondsSaved;
 
     uint64_t mCacheStartTime;
 
+    /**
+     * Whether entries are stored under compact keys
+     */
+    bool mCompactKeys;
+
     RtlDebugLevel mDebugLevel;
     bool mDebugEnabled;
 
@@ -15,8 +15,12 @@
  */
 
 #include "Utils.h"
+#include "SkData.h"
 #include "SkUtils.h"
 
+#include <sys/mman.h>
+#include <unistd.h>
+
 using namespace android;
 
 bool AssetStreamAdaptor::rewind() {
@@ -106,6 +110,46 @@ SkMemoryStream* android::CopyAssetToStream(Asset* asset) {
     return stream;
 }
 
+// The context is the offset of the asset into its page-aligned mapping
+static void unmapAsset(const void* ptr, size_t length, void* context) {
+    size_t offset = (size_t) context;
+    munmap((char*) ptr - offset, length + offset);
+}
+
+SkMemoryStream* android::MapAssetToStream(Asset* asset) {
+    if (NULL == asset) {
+        return NULL;
+    }
+
+    off64_t start, length;
+    int fd = asset->openFileDescriptor(&start, &length);
+    if (fd < 0) {
+        return NULL;
+    }
+    // Within 2GB the page offset can be added to the length as a size_t
+    if (start < 0 || length <= 0 || length >= 0x7fffffff) {
+        close(fd);
+        SkDebugf("---- mapAsset: couldn't map %lld bytes at %lld\n", length, start);
+        return NULL;
+    }
+
+    // Only the pages of the asset are mapped, not the whole APK. The mapping
+    // stays valid once the descriptor is closed.
+    const off64_t pageSize = sysconf(_SC_PAGESIZE);
+    const off64_t mapStart = start & ~(pageSize - 1);
+    const size_t offset = start - mapStart;
+    void* base = mmap64(NULL, offset + length, PROT_READ, MAP_SHARED, fd, mapStart);
+    close(fd);
+    if (base == MAP_FAILED) {
+        SkDebugf("---- mapAsset: couldn't map %lld bytes at %lld\n", length, start);
+        return NULL;
+    }
+
+    SkAutoTUnref<SkData> data(SkData::NewWithProc((char*) base + offset, length,
+            unmapAsset, (void*) offset));
+    return new SkMemoryStream(data);
+}
+
 jobject android::nullObjectReturn(const char msg[]) {
     if (msg) {
         SkDebugf("--- %s\n", msg);
@@ -48,6 +48,13 @@ private:
 
 SkMemoryStream* CopyAssetToStream(Asset*);
 
+/**
+ *  Map the file holding an uncompressed asset and return the asset's part of
+ *  it as a stream that outlives the asset, without copying. Returns NULL if
+ *  the asset isn't a range of a file, as compressed assets aren't.
+ */
+SkMemoryStream* MapAssetToStream(Asset*);
+
 /** Restore the file descriptor's offset in our destructor
  */
 class AutoFDSeek {
@@ -4,8 +4,113 @@
 #include <ui/PixelFormat.h>
 #include <hardware/hardware.h>
 
+#include <utils/threads.h>
+#include <unistd.h>
+
 #include <jni.h>
 
+#if defined(__ARM_HAVE_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define YUV_USE_NEON 1
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+    #define YUV_USE_SSE2 1
+#endif
+
+using namespace android;
+
+// Frames with at least this many pixels are split into horizontal stripes
+// that are encoded in parallel.
+static const int kParallelMinPixels = 1024 * 1024;
+static const int kMaxStripes = 4;
+// Each stripe but the last spans a multiple of 8 MCU rows, so with one
+// restart interval per MCU row its restart markers end on RST6 and the
+// stripes can be joined by a single RST7 without renumbering.
+static const int kMcuRowsPerRestartCycle = 8;
+static const int kMcuHeight = 16;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Row kernels deinterleave as many leading elements as they can and return
+// the count processed; callers finish the remainder with scalar code.
+#if YUV_USE_NEON
+
+static int DeinterleaveVU_Row(uint8_t* u, uint8_t* v, const uint8_t* vu,
+        int count) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x2_t vu8 = vld2q_u8(vu + 2 * i);
+        vst1q_u8(v + i, vu8.val[0]);
+        vst1q_u8(u + i, vu8.val[1]);
+    }
+    return i;
+}
+
+static int DeinterleaveYUYV_Row(uint8_t* y, uint8_t* u, uint8_t* v,
+        const uint8_t* yuyv, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t yuyv8 = vld4_u8(yuyv + 4 * i);
+        uint8x8x2_t y8;
+        y8.val[0] = yuyv8.val[0];
+        y8.val[1] = yuyv8.val[2];
+        vst2_u8(y + 2 * i, y8);
+        vst1_u8(u + i, yuyv8.val[1]);
+        vst1_u8(v + i, yuyv8.val[3]);
+    }
+    return i;
+}
+
+#elif YUV_USE_SSE2
+
+static int DeinterleaveVU_Row(uint8_t* u, uint8_t* v, const uint8_t* vu,
+        int count) {
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (vu + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i*) (vu + 2 * i + 16));
+        _mm_storeu_si128((__m128i*) (v + i), _mm_packus_epi16(
+                _mm_and_si128(a, lowBytes), _mm_and_si128(b, lowBytes)));
+        _mm_storeu_si128((__m128i*) (u + i), _mm_packus_epi16(
+                _mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+    return i;
+}
+
+static int DeinterleaveYUYV_Row(uint8_t* y, uint8_t* u, uint8_t* v,
+        const uint8_t* yuyv, int count) {
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (yuyv + 4 * i));
+        __m128i b = _mm_loadu_si128((const __m128i*) (yuyv + 4 * i + 16));
+        _mm_storeu_si128((__m128i*) (y + 2 * i), _mm_packus_epi16(
+                _mm_and_si128(a, lowBytes), _mm_and_si128(b, lowBytes)));
+        __m128i uv = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        _mm_storel_epi64((__m128i*) (u + i),
+                _mm_packus_epi16(_mm_and_si128(uv, lowBytes), zero));
+        _mm_storel_epi64((__m128i*) (v + i),
+                _mm_packus_epi16(_mm_srli_epi16(uv, 8), zero));
+    }
+    return i;
+}
+
+#else
+
+static int DeinterleaveVU_Row(uint8_t*, uint8_t*, const uint8_t*, int) {
+    return 0;
+}
+
+static int DeinterleaveYUYV_Row(uint8_t*, uint8_t*, uint8_t*, const uint8_t*, int) {
+    return 0;
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+
 YuvToJpegEncoder* YuvToJpegEncoder::create(int format, int* strides) {
     // Only ImageFormat.NV21 and ImageFormat.YUY2 are supported
     // for now.
@@ -23,6 +128,25 @@ YuvToJpegEncoder::YuvToJpegEncoder(int* strides) : fStrides(strides) {
 
 bool YuvToJpegEncoder::encode(SkWStream* stream, void* inYuv, int width,
         int height, int* offsets, int jpegQuality) {
+    if (width * height >= kParallelMinPixels) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        int numStripes = cpus < kMaxStripes ? (int) cpus : kMaxStripes;
+        int mcuRows = (height + kMcuHeight - 1) / kMcuHeight;
+        if (numStripes > mcuRows / kMcuRowsPerRestartCycle) {
+            numStripes = mcuRows / kMcuRowsPerRestartCycle;
+        }
+        if (numStripes > 1) {
+            return encodeStriped(stream, (uint8_t*) inYuv, width, height,
+                    offsets, jpegQuality, numStripes);
+        }
+    }
+    return encodeStripe(stream, (uint8_t*) inYuv, width, height, offsets,
+            jpegQuality, false);
+}
+
+bool YuvToJpegEncoder::encodeStripe(SkWStream* stream, uint8_t* yuv,
+        int width, int height, int* offsets, int jpegQuality,
+        bool restartRows) {
     jpeg_compress_struct    cinfo;
     skjpeg_error_mgr        sk_err;
     skjpeg_destination_mgr  sk_wstream(stream);
@@ -30,6 +154,7 @@ bool YuvToJpegEncoder::encode(SkWStream* stream, void* inYuv, int width,
     cinfo.err = jpeg_std_error(&sk_err);
     sk_err.error_exit = skjpeg_error_exit;
     if (setjmp(sk_err.fJmpBuf)) {
+        jpeg_destroy_compress(&cinfo);
         return false;
     }
     jpeg_create_compress(&cinfo);
@@ -37,16 +162,138 @@ bool YuvToJpegEncoder::encode(SkWStream* stream, void* inYuv, int width,
     cinfo.dest = &sk_wstream;
 
     setJpegCompressStruct(&cinfo, width, height, jpegQuality);
+    if (restartRows) {
+        cinfo.restart_in_rows = 1;
+    }
 
     jpeg_start_compress(&cinfo, TRUE);
 
-    compress(&cinfo, (uint8_t*) inYuv, offsets);
+    compress(&cinfo, yuv, offsets);
 
     jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
 
     return true;
 }
 
+/** Encodes one horizontal stripe of the frame into memory. */
+class StripeThread : public Thread {
+public:
+    StripeThread(YuvToJpegEncoder* encoder, uint8_t* yuv, int width,
+            int height, int* offsets, int jpegQuality) :
+            Thread(false), fEncoder(encoder), fYuv(yuv), fWidth(width),
+            fHeight(height), fQuality(jpegQuality), fSuccess(false) {
+        for (int i = 0; i < 3; i++) {
+            fOffsets[i] = offsets[i];
+        }
+    }
+
+    bool encodeNow() {
+        fSuccess = fEncoder->encodeStripe(&fOutput, fYuv, fWidth, fHeight,
+                fOffsets, fQuality, true);
+        return fSuccess;
+    }
+
+    bool success() const { return fSuccess; }
+    SkDynamicMemoryWStream& output() { return fOutput; }
+
+private:
+    virtual bool threadLoop() {
+        encodeNow();
+        return false;
+    }
+
+    YuvToJpegEncoder* const fEncoder;
+    uint8_t* const fYuv;
+    const int fWidth;
+    const int fHeight;
+    int fOffsets[3];
+    const int fQuality;
+    bool fSuccess;
+    SkDynamicMemoryWStream fOutput;
+};
+
+/** Returns the offset of the entropy-coded data following the SOS header,
+ *  or 0 if the stream is malformed. If height is positive, the frame height
+ *  recorded in the SOF header is replaced with it.
+ */
+static size_t findScanData(uint8_t* jpeg, size_t size, int height) {
+    size_t pos = 2;  // SOI
+    while (pos + 4 <= size && jpeg[pos] == 0xFF) {
+        uint8_t marker = jpeg[pos + 1];
+        size_t length = (jpeg[pos + 2] << 8) | jpeg[pos + 3];
+        if (pos + 2 + length > size) {
+            return 0;
+        }
+        if (height > 0 && marker >= 0xC0 && marker <= 0xC2) {
+            jpeg[pos + 5] = (uint8_t) (height >> 8);
+            jpeg[pos + 6] = (uint8_t) height;
+        }
+        pos += 2 + length;
+        if (marker == 0xDA) {
+            return pos;
+        }
+    }
+    return 0;
+}
+
+bool YuvToJpegEncoder::encodeStriped(SkWStream* stream, uint8_t* yuv,
+        int width, int height, int* offsets, int jpegQuality, int numStripes) {
+    int mcuRows = (height + kMcuHeight - 1) / kMcuHeight;
+    int stripeRows = (mcuRows / numStripes) / kMcuRowsPerRestartCycle *
+            kMcuRowsPerRestartCycle * kMcuHeight;
+
+    sp<StripeThread> stripes[kMaxStripes];
+    for (int i = 0; i < numStripes; i++) {
+        int startRow = i * stripeRows;
+        int rows = (i == numStripes - 1) ? height - startRow : stripeRows;
+        int rowOffsets[3];
+        offsetsForRow(offsets, startRow, rowOffsets);
+        stripes[i] = new StripeThread(this, yuv, width, rows, rowOffsets,
+                jpegQuality);
+    }
+
+    // The calling thread encodes the first stripe itself, and any stripe
+    // whose thread could not be started.
+    for (int i = 1; i < numStripes; i++) {
+        if (stripes[i]->run("YuvToJpegStripe", PRIORITY_DEFAULT) != NO_ERROR) {
+            stripes[i]->encodeNow();
+        }
+    }
+    bool success = stripes[0]->encodeNow();
+    for (int i = 1; i < numStripes; i++) {
+        stripes[i]->join();
+        success = success && stripes[i]->success();
+    }
+    if (!success) {
+        return false;
+    }
+
+    static const uint8_t kRst7[] = { 0xFF, 0xD7 };
+    static const uint8_t kEoi[] = { 0xFF, 0xD9 };
+    for (int i = 0; i < numStripes; i++) {
+        SkDynamicMemoryWStream& output = stripes[i]->output();
+        size_t size = output.bytesWritten();
+        SkAutoMalloc storage(size);
+        uint8_t* jpeg = (uint8_t*) storage.get();
+        output.copyTo(jpeg);
+
+        size_t scanStart = findScanData(jpeg, size, i == 0 ? height : 0);
+        // Every stripe ends with its EOI marker, which is dropped.
+        if (scanStart == 0 || scanStart + 2 > size) {
+            return false;
+        }
+        size_t start = (i == 0) ? 0 : scanStart;
+        if (i > 0 && !stream->write(kRst7, sizeof(kRst7))) {
+            return false;
+        }
+        if (!stream->write(jpeg + start, size - 2 - start)) {
+            return false;
+        }
+    }
+    return stream->write(kEoi, sizeof(kEoi));
+}
+
 void YuvToJpegEncoder::setJpegCompressStruct(jpeg_compress_struct* cinfo,
         int width, int height, int quality) {
     cinfo->image_width = width;
@@ -116,18 +363,27 @@ void Yuv420SpToJpegEncoder::deinterleave(uint8_t* vuPlanar, uint8_t* uRows,
         uint8_t* vRows, int rowIndex, int width, int height) {
     int numRows = (height - rowIndex) / 2;
     if (numRows > 8) numRows = 8;
+    int halfWidth = width >> 1;
     for (int row = 0; row < numRows; ++row) {
         int offset = ((rowIndex >> 1) + row) * fStrides[1];
         uint8_t* vu = vuPlanar + offset;
-        for (int i = 0; i < (width >> 1); ++i) {
-            int index = row * (width >> 1) + i;
-            uRows[index] = vu[1];
-            vRows[index] = vu[0];
-            vu += 2;
+        uint8_t* uRow = uRows + row * halfWidth;
+        uint8_t* vRow = vRows + row * halfWidth;
+        int i = DeinterleaveVU_Row(uRow, vRow, vu, halfWidth);
+        for (; i < halfWidth; ++i) {
+            uRow[i] = vu[(i << 1) + 1];
+            vRow[i] = vu[i << 1];
         }
     }
 }
 
+void Yuv420SpToJpegEncoder::offsetsForRow(int* offsets, int startRow,
+        int* rowOffsets) {
+    rowOffsets[0] = offsets[0] + startRow * fStrides[0];
+    rowOffsets[1] = offsets[1] + (startRow >> 1) * fStrides[1];
+    rowOffsets[2] = 0;
+}
+
 void Yuv420SpToJpegEncoder::configSamplingFactors(jpeg_compress_struct* cinfo) {
     // cb and cr are horizontally downsampled and vertically downsampled as well.
     cinfo->comp_info[0].h_samp_factor = 2;
@@ -191,20 +447,30 @@ void Yuv422IToJpegEncoder::deinterleave(uint8_t* yuv, uint8_t* yRows, uint8_t* u
         uint8_t* vRows, int rowIndex, int width, int height) {
     int numRows = height - rowIndex;
     if (numRows > 16) numRows = 16;
+    int halfWidth = width >> 1;
     for (int row = 0; row < numRows; ++row) {
         uint8_t* yuvSeg = yuv + (rowIndex + row) * fStrides[0];
-        for (int i = 0; i < (width >> 1); ++i) {
-            int indexY = row * width + (i << 1);
-            int indexU = row * (width >> 1) + i;
-            yRows[indexY] = yuvSeg[0];
-            yRows[indexY + 1] = yuvSeg[2];
-            uRows[indexU] = yuvSeg[1];
-            vRows[indexU] = yuvSeg[3];
-            yuvSeg += 4;
+        uint8_t* yRow = yRows + row * width;
+        uint8_t* uRow = uRows + row * halfWidth;
+        uint8_t* vRow = vRows + row * halfWidth;
+        int i = DeinterleaveYUYV_Row(yRow, uRow, vRow, yuvSeg, halfWidth);
+        for (; i < halfWidth; ++i) {
+            const uint8_t* pair = yuvSeg + (i << 2);
+            yRow[i << 1] = pair[0];
+            yRow[(i << 1) + 1] = pair[2];
+            uRow[i] = pair[1];
+            vRow[i] = pair[3];
         }
     }
 }
 
+void Yuv422IToJpegEncoder::offsetsForRow(int* offsets, int startRow,
+        int* rowOffsets) {
+    rowOffsets[0] = offsets[0] + startRow * fStrides[0];
+    rowOffsets[1] = 0;
+    rowOffsets[2] = 0;
+}
+
 void Yuv422IToJpegEncoder::configSamplingFactors(jpeg_compress_struct* cinfo) {
     // cb and cr are horizontally downsampled and vertically downsampled as well.
     cinfo->comp_info[0].h_samp_factor = 2;
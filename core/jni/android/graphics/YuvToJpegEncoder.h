@@ -43,6 +43,19 @@ protected:
     virtual void configSamplingFactors(jpeg_compress_struct* cinfo) = 0;
     virtual void compress(jpeg_compress_struct* cinfo,
             uint8_t* yuv, int* offsets) = 0;
+    /** Compute the plane offsets of the image row startRow, which must be
+     *  a multiple of the MCU height.
+     */
+    virtual void offsetsForRow(int* offsets, int startRow,
+            int* rowOffsets) = 0;
+
+private:
+    bool encodeStripe(SkWStream* stream, uint8_t* yuv, int width,
+            int height, int* offsets, int jpegQuality, bool restartRows);
+    bool encodeStriped(SkWStream* stream, uint8_t* yuv, int width,
+            int height, int* offsets, int jpegQuality, int numStripes);
+
+    friend class StripeThread;
 };
 
 class Yuv420SpToJpegEncoder : public YuvToJpegEncoder {
@@ -57,6 +70,7 @@ private:
      void deinterleave(uint8_t* vuPlanar, uint8_t* uRows, uint8_t* vRows,
              int rowIndex, int width, int height);
      void compress(jpeg_compress_struct* cinfo, uint8_t* yuv, int* offsets);
+     void offsetsForRow(int* offsets, int startRow, int* rowOffsets);
 };
 
 class Yuv422IToJpegEncoder : public YuvToJpegEncoder {
@@ -69,6 +83,7 @@ private:
     void compress(jpeg_compress_struct* cinfo, uint8_t* yuv, int* offsets);
     void deinterleave(uint8_t* yuv, uint8_t* yRows, uint8_t* uRows,
             uint8_t* vRows, int rowIndex, int width, int height);
+    void offsetsForRow(int* offsets, int startRow, int* rowOffsets);
 };
 
 #endif
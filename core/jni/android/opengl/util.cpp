@@ -23,6 +23,15 @@
 #include <string.h>
 #include <assert.h>
 #include <dlfcn.h>
+#include <limits.h>
+
+#if defined(__ARM_HAVE_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define UTIL_USE_NEON 1
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+    #define UTIL_USE_SSE2 1
+#endif
 
 #include <GLES/gl.h>
 #include <ETC1/etc1.h>
@@ -40,12 +49,29 @@
 
 namespace android {
 
+// The vector versions multiply and add in the same order as the scalar code,
+// one column of the matrix at a time, so they give the same results.
+
 static inline
 void mx4transform(float x, float y, float z, float w, const float* pM, float* pDest) {
+#if UTIL_USE_NEON
+    float32x4_t v = vmulq_n_f32(vld1q_f32(pM), x);
+    v = vmlaq_n_f32(v, vld1q_f32(pM + 4), y);
+    v = vmlaq_n_f32(v, vld1q_f32(pM + 8), z);
+    v = vmlaq_n_f32(v, vld1q_f32(pM + 12), w);
+    vst1q_f32(pDest, v);
+#elif UTIL_USE_SSE2
+    __m128 v = _mm_mul_ps(_mm_loadu_ps(pM), _mm_set1_ps(x));
+    v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(pM + 4), _mm_set1_ps(y)));
+    v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(pM + 8), _mm_set1_ps(z)));
+    v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(pM + 12), _mm_set1_ps(w)));
+    _mm_storeu_ps(pDest, v);
+#else
     pDest[0] = pM[0 + 4 * 0] * x + pM[0 + 4 * 1] * y + pM[0 + 4 * 2] * z + pM[0 + 4 * 3] * w;
     pDest[1] = pM[1 + 4 * 0] * x + pM[1 + 4 * 1] * y + pM[1 + 4 * 2] * z + pM[1 + 4 * 3] * w;
     pDest[2] = pM[2 + 4 * 0] * x + pM[2 + 4 * 1] * y + pM[2 + 4 * 2] * z + pM[2 + 4 * 3] * w;
     pDest[3] = pM[3 + 4 * 0] * x + pM[3 + 4 * 1] * y + pM[3 + 4 * 2] * z + pM[3 + 4 * 3] * w;
+#endif
 }
 
 class MallocHelper {
@@ -223,6 +249,26 @@ typedef ArrayHelper<jcharArray, unsigned short> UnsignedShortArrayHelper;
 typedef ArrayHelper<jintArray, int> IntArrayHelper;
 typedef ArrayHelper<jbyteArray, unsigned char> ByteArrayHelper;
 
+// Compute how many elements "count" items of "size" elements, "stride"
+// elements apart, span.  Throws and returns false if that can't be done.
+static bool batchSpan(JNIEnv* env, jint count, jint stride, jint size, jint* span) {
+    if (count < 0) {
+        doThrowIAE(env, "count < 0");
+        return false;
+    }
+    if (stride < 0) {
+        doThrowIAE(env, "stride < 0");
+        return false;
+    }
+    int64_t n = count == 0 ? 0 : (int64_t) (count - 1) * stride + size;
+    if (n > INT_MAX) {
+        doThrowIAE(env, "length - offset < n");
+        return false;
+    }
+    *span = (jint) n;
+    return true;
+}
+
 inline float distance2(float x, float y, float z) {
     return x * x + y * y + z * z;
 }
@@ -320,6 +366,60 @@ static inline float signedDistance(const float* pPlane, float x, float y, float
     return dot3(pPlane[0], pPlane[1], pPlane[2], x, y, z) + pPlane[3];
 }
 
+#if UTIL_USE_NEON || UTIL_USE_SSE2
+
+// The frustum planes with their coefficients in separate arrays, so that
+// a sphere can be tested against four planes at once. The last plane is
+// repeated to make eight.
+
+struct FrustumPlanes {
+    float a[8];
+    float b[8];
+    float c[8];
+    float d[8];
+};
+
+static void transposeFrustum(const float* pFrustum, FrustumPlanes* pPlanes) {
+    for (int i = 0; i < 8; i++) {
+        const float* p = pFrustum + 4 * (i < 6 ? i : 5);
+        pPlanes->a[i] = p[0];
+        pPlanes->b[i] = p[1];
+        pPlanes->c[i] = p[2];
+        pPlanes->d[i] = p[3];
+    }
+}
+
+// Return true if the sphere intersects or is inside the frustum
+
+static bool sphereHitsFrustum(const FrustumPlanes& planes, const float* pSphere) {
+#if UTIL_USE_NEON
+    uint32x4_t outside = vdupq_n_u32(0);
+    float32x4_t negRadius = vdupq_n_f32(-pSphere[3]);
+    for (int i = 0; i < 8; i += 4) {
+        float32x4_t dist = vmulq_n_f32(vld1q_f32(planes.a + i), pSphere[0]);
+        dist = vmlaq_n_f32(dist, vld1q_f32(planes.b + i), pSphere[1]);
+        dist = vmlaq_n_f32(dist, vld1q_f32(planes.c + i), pSphere[2]);
+        dist = vaddq_f32(dist, vld1q_f32(planes.d + i));
+        outside = vorrq_u32(outside, vcleq_f32(dist, negRadius));
+    }
+    uint32x2_t any = vorr_u32(vget_low_u32(outside), vget_high_u32(outside));
+    return vget_lane_u32(vpmax_u32(any, any), 0) == 0;
+#else
+    int outside = 0;
+    __m128 negRadius = _mm_set1_ps(-pSphere[3]);
+    for (int i = 0; i < 8; i += 4) {
+        __m128 dist = _mm_mul_ps(_mm_loadu_ps(planes.a + i), _mm_set1_ps(pSphere[0]));
+        dist = _mm_add_ps(dist, _mm_mul_ps(_mm_loadu_ps(planes.b + i), _mm_set1_ps(pSphere[1])));
+        dist = _mm_add_ps(dist, _mm_mul_ps(_mm_loadu_ps(planes.c + i), _mm_set1_ps(pSphere[2])));
+        dist = _mm_add_ps(dist, _mm_loadu_ps(planes.d + i));
+        outside |= _mm_movemask_ps(_mm_cmple_ps(dist, negRadius));
+    }
+    return outside == 0;
+#endif
+}
+
+#else
+
 // Return true if the sphere intersects or is inside the frustum
 
 static bool sphereHitsFrustum(const float* pFrustum, const float* pSphere) {
@@ -335,6 +435,8 @@ static bool sphereHitsFrustum(const float* pFrustum, const float* pSphere) {
     return true;
 }
 
+#endif
+
 static void computeFrustum(const float* m, float* f) {
     float m3 = m[3];
     float m7 = m[7];
@@ -411,6 +513,10 @@ jint util_frustumCullSpheres(JNIEnv *env, jclass clazz,
     results.bind();
 
     computeFrustum(mvp.mData, frustum);
+#if UTIL_USE_NEON || UTIL_USE_SSE2
+    FrustumPlanes planes;
+    transposeFrustum(frustum, &planes);
+#endif
 
     // Cull the spheres
 
@@ -418,7 +524,11 @@ jint util_frustumCullSpheres(JNIEnv *env, jclass clazz,
     pResults = results.mData;
     outputCount = 0;
     for(int i = 0; i < spheresCount; i++, pSphere += 4) {
+#if UTIL_USE_NEON || UTIL_USE_SSE2
+        if (sphereHitsFrustum(planes, pSphere)) {
+#else
         if (sphereHitsFrustum(frustum, pSphere)) {
+#endif
             if (outputCount < resultsCapacity) {
                 *pResults++ = i;
             }
@@ -470,6 +580,13 @@ jint util_visibilityTest(JNIEnv *env, jclass clazz,
 static
 void multiplyMM(float* r, const float* lhs, const float* rhs)
 {
+#if UTIL_USE_NEON || UTIL_USE_SSE2
+    // Column i of the result is lhs times column i of rhs
+    for (int i=0 ; i<4 ; i++) {
+        const float* rhs_i = rhs + 4*i;
+        mx4transform(rhs_i[0], rhs_i[1], rhs_i[2], rhs_i[3], lhs, r + 4*i);
+    }
+#else
     for (int i=0 ; i<4 ; i++) {
         register const float rhs_i0 = rhs[ I(i,0) ];
         register float ri0 = lhs[ I(0,0) ] * rhs_i0;
@@ -488,6 +605,7 @@ void multiplyMM(float* r, const float* lhs, const float* rhs)
         r[ I(i,2) ] = ri2;
         r[ I(i,3) ] = ri3;
     }
+#endif
 }
 
 static
@@ -546,6 +664,92 @@ void util_multiplyMV(JNIEnv *env, jclass clazz,
     resultV.commitChanges();
 }
 
+/*
+ public native void multiplyMMBatch(float[] result, int resultOffset,
+ float[] lhs, int lhsOffset, int lhsStride,
+ float[] rhs, int rhsOffset, int rhsStride, int count);
+
+ Multiplies count pairs of matrices. A stride of 0 reuses the same matrix
+ for every product, e.g. one view-projection matrix for many models.
+ */
+
+static
+void util_multiplyMMBatch(JNIEnv *env, jclass clazz,
+    jfloatArray result_ref, jint resultOffset,
+    jfloatArray lhs_ref, jint lhsOffset, jint lhsStride,
+    jfloatArray rhs_ref, jint rhsOffset, jint rhsStride,
+    jint count) {
+
+    jint resultSpan, lhsSpan, rhsSpan;
+    if (!batchSpan(env, count, 16, 16, &resultSpan)
+            || !batchSpan(env, count, lhsStride, 16, &lhsSpan)
+            || !batchSpan(env, count, rhsStride, 16, &rhsSpan)) {
+        return;
+    }
+
+    FloatArrayHelper resultMat(env, result_ref, resultOffset, resultSpan);
+    FloatArrayHelper lhs(env, lhs_ref, lhsOffset, lhsSpan);
+    FloatArrayHelper rhs(env, rhs_ref, rhsOffset, rhsSpan);
+
+    bool checkOK = resultMat.check() && lhs.check() && rhs.check();
+
+    if ( !checkOK ) {
+        return;
+    }
+
+    resultMat.bind();
+    lhs.bind();
+    rhs.bind();
+
+    for (int i = 0; i < count; i++) {
+        multiplyMM(resultMat.mData + 16 * i,
+                lhs.mData + lhsStride * i, rhs.mData + rhsStride * i);
+    }
+
+    resultMat.commitChanges();
+}
+
+/*
+ public native void multiplyMVBatch(float[] result, int resultOffset,
+ float[] lhs, int lhsOffset,
+ float[] rhs, int rhsOffset, int count);
+
+ Transforms count consecutive vectors by the same matrix.
+ */
+
+static
+void util_multiplyMVBatch(JNIEnv *env, jclass clazz,
+    jfloatArray result_ref, jint resultOffset,
+    jfloatArray lhs_ref, jint lhsOffset,
+    jfloatArray rhs_ref, jint rhsOffset,
+    jint count) {
+
+    jint vectorsSpan;
+    if (!batchSpan(env, count, 4, 4, &vectorsSpan)) {
+        return;
+    }
+
+    FloatArrayHelper resultV(env, result_ref, resultOffset, vectorsSpan);
+    FloatArrayHelper lhs(env, lhs_ref, lhsOffset, 16);
+    FloatArrayHelper rhs(env, rhs_ref, rhsOffset, vectorsSpan);
+
+    bool checkOK = resultV.check() && lhs.check() && rhs.check();
+
+    if ( !checkOK ) {
+        return;
+    }
+
+    resultV.bind();
+    lhs.bind();
+    rhs.bind();
+
+    for (int i = 0; i < count; i++) {
+        multiplyMV(resultV.mData + 4 * i, lhs.mData, rhs.mData + 4 * i);
+    }
+
+    resultV.commitChanges();
+}
+
 // ---------------------------------------------------------------------------
 
 static jfieldID nativeBitmapID = 0;
@@ -1018,6 +1222,8 @@ static jint etc1_getHeight(JNIEnv *env, jclass clazz,
 static JNINativeMethod gMatrixMethods[] = {
     { "multiplyMM", "([FI[FI[FI)V", (void*)util_multiplyMM },
     { "multiplyMV", "([FI[FI[FI)V", (void*)util_multiplyMV },
+    { "multiplyMMBatch", "([FI[FII[FIII)V", (void*)util_multiplyMMBatch },
+    { "multiplyMVBatch", "([FI[FI[FII)V", (void*)util_multiplyMVBatch },
 };
 
 static JNINativeMethod gVisibilityMethods[] = {
@@ -18,9 +18,14 @@
 #include <assert.h>
 
 #include "jni.h"
+#include <nativehelper/JNIHelp.h>
 #include <android_runtime/AndroidRuntime.h>
 #include <utils/misc.h>
 
+#ifdef USE_OPENGL_RENDERER
+#include <DisplayListAnimator.h>
+#endif
+
 // ----------------------------------------------------------------------------
 
 namespace android {
@@ -59,6 +64,119 @@ static void android_animation_PropertyValuesHolder_callFloatMethod(
     env->CallVoidMethod(target, reinterpret_cast<jmethodID>(methodID), arg);
 }
 
+#ifdef USE_OPENGL_RENDERER
+
+using namespace uirenderer;
+
+// ----------------------------------------------------------------------------
+// Display list animations
+// ----------------------------------------------------------------------------
+
+static jlong android_animation_PropertyValuesHolder_createDisplayListAnimator(
+        JNIEnv* env, jclass pvhClass)
+{
+    return reinterpret_cast<jlong>(new DisplayListAnimator());
+}
+
+static void android_animation_PropertyValuesHolder_destroyDisplayListAnimator(
+        JNIEnv* env, jclass pvhClass, jlong animatorHandle)
+{
+    delete reinterpret_cast<DisplayListAnimator*>(animatorHandle);
+}
+
+static jint android_animation_PropertyValuesHolder_startDisplayListAnimation(
+        JNIEnv* env, jclass pvhClass, jlong animatorHandle, jlong displayListHandle,
+        jint property, jfloatArray fractions, jfloatArray values,
+        jint interpolator, jfloat factor, jfloatArray interpolatorTable,
+        jlong startTime, jlong duration, jint repeatCount, jint repeatMode)
+{
+    DisplayListAnimator* animator = reinterpret_cast<DisplayListAnimator*>(animatorHandle);
+    DisplayList* displayList = reinterpret_cast<DisplayList*>(displayListHandle);
+
+    jsize count = env->GetArrayLength(values);
+    if (count < 2 || env->GetArrayLength(fractions) != count) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "at least two keyframes are required");
+        return 0;
+    }
+
+    PropertyAnimation* animation = new PropertyAnimation(displayList,
+            (PropertyAnimation::Property) property);
+
+    // A NULL array leaves an OutOfMemoryError pending
+    jfloat* fractionsArray = env->GetFloatArrayElements(fractions, NULL);
+    if (fractionsArray == NULL) {
+        delete animation;
+        return 0;
+    }
+    jfloat* valuesArray = env->GetFloatArrayElements(values, NULL);
+    if (valuesArray == NULL) {
+        env->ReleaseFloatArrayElements(fractions, fractionsArray, JNI_ABORT);
+        delete animation;
+        return 0;
+    }
+    animation->setKeyframes(fractionsArray, valuesArray, count);
+    env->ReleaseFloatArrayElements(values, valuesArray, JNI_ABORT);
+    env->ReleaseFloatArrayElements(fractions, fractionsArray, JNI_ABORT);
+
+    if (interpolator == PropertyAnimation::kInterpolatorTable && interpolatorTable) {
+        jfloat* table = env->GetFloatArrayElements(interpolatorTable, NULL);
+        if (table == NULL) {
+            delete animation;
+            return 0;
+        }
+        animation->setInterpolatorTable(table, env->GetArrayLength(interpolatorTable));
+        env->ReleaseFloatArrayElements(interpolatorTable, table, JNI_ABORT);
+    } else {
+        animation->setInterpolator((PropertyAnimation::Interpolator) interpolator, factor);
+    }
+
+    animation->setTiming(startTime, duration, repeatCount,
+            (PropertyAnimation::RepeatMode) repeatMode);
+
+    return animator->start(animation);
+}
+
+static void android_animation_PropertyValuesHolder_cancelDisplayListAnimation(
+        JNIEnv* env, jclass pvhClass, jlong animatorHandle, jint id)
+{
+    reinterpret_cast<DisplayListAnimator*>(animatorHandle)->cancel(id);
+}
+
+static void android_animation_PropertyValuesHolder_cancelDisplayListAnimations(
+        JNIEnv* env, jclass pvhClass, jlong animatorHandle, jlong displayListHandle)
+{
+    reinterpret_cast<DisplayListAnimator*>(animatorHandle)->cancel(
+            reinterpret_cast<DisplayList*>(displayListHandle));
+}
+
+/**
+ * Sets the values of every running animation for the specified frame. The ids
+ * of the animations that ended are written to endedIds, followed by 0 if there
+ * is room left; ids that do not fit are returned by the next call. Returns the
+ * number of animations still running.
+ */
+static jint android_animation_PropertyValuesHolder_animateDisplayLists(
+        JNIEnv* env, jclass pvhClass, jlong animatorHandle, jlong frameTimeNanos,
+        jintArray endedIds)
+{
+    DisplayListAnimator* animator = reinterpret_cast<DisplayListAnimator*>(animatorHandle);
+    size_t running = animator->animate(frameTimeNanos);
+
+    jsize length = env->GetArrayLength(endedIds);
+    if (length > 0) {
+        jint* ids = env->GetIntArrayElements(endedIds, NULL);
+        if (ids == NULL) return running;
+        size_t count = animator->getEndedAnimations(ids, length);
+        if (count < (size_t) length) ids[count] = 0;
+        env->ReleaseIntArrayElements(endedIds, ids, 0);
+    }
+
+    return running;
+}
+
+#endif // USE_OPENGL_RENDERER
+
 static JNINativeMethod gMethods[] = {
     {   "nGetIntMethod", "(Ljava/lang/Class;Ljava/lang/String;)J",
             (void*)android_animation_PropertyValuesHolder_getIntMethod },
@@ -67,7 +185,21 @@ static JNINativeMethod gMethods[] = {
     {   "nCallIntMethod", "(Ljava/lang/Object;JI)V",
             (void*)android_animation_PropertyValuesHolder_callIntMethod },
     {   "nCallFloatMethod", "(Ljava/lang/Object;JF)V",
-            (void*)android_animation_PropertyValuesHolder_callFloatMethod }
+            (void*)android_animation_PropertyValuesHolder_callFloatMethod },
+#ifdef USE_OPENGL_RENDERER
+    {   "nCreateDisplayListAnimator", "()J",
+            (void*)android_animation_PropertyValuesHolder_createDisplayListAnimator },
+    {   "nDestroyDisplayListAnimator", "(J)V",
+            (void*)android_animation_PropertyValuesHolder_destroyDisplayListAnimator },
+    {   "nStartDisplayListAnimation", "(JJI[F[FIF[FJJII)I",
+            (void*)android_animation_PropertyValuesHolder_startDisplayListAnimation },
+    {   "nCancelDisplayListAnimation", "(JI)V",
+            (void*)android_animation_PropertyValuesHolder_cancelDisplayListAnimation },
+    {   "nCancelDisplayListAnimations", "(JJ)V",
+            (void*)android_animation_PropertyValuesHolder_cancelDisplayListAnimations },
+    {   "nAnimateDisplayLists", "(JJ[I)I",
+            (void*)android_animation_PropertyValuesHolder_animateDisplayLists },
+#endif
 };
 
 int register_android_animation_PropertyValuesHolder(JNIEnv* env)
@@ -34,6 +34,8 @@ static struct {
     jfieldID version;
     jfieldID flags;
     jfieldID salt;
+    jfieldID kdfDigest;
+    jfieldID kdfRounds;
 } gObbInfoClassInfo;
 
 static void android_content_res_ObbScanner_getObbInfo(JNIEnv* env, jobject clazz, jstring file,
@@ -69,6 +71,11 @@ static void android_content_res_ObbScanner_getObbInfo(JNIEnv* env, jobject clazz
         env->SetByteArrayRegion(saltArray, 0, saltLen, (jbyte*)salt);
         env->SetObjectField(obbInfo, gObbInfoClassInfo.salt, saltArray);
     }
+
+    // The key must be derived the way it was when the file was made, files
+    // without a version 2 footer report SHA1 with OBB_KDF_DEFAULT_ROUNDS
+    env->SetIntField(obbInfo, gObbInfoClassInfo.kdfDigest, obb->getKdfDigest());
+    env->SetIntField(obbInfo, gObbInfoClassInfo.kdfRounds, obb->getKdfRounds());
 }
 
 /*
@@ -101,6 +108,10 @@ int register_android_content_res_ObbScanner(JNIEnv* env)
             "flags", "I");
     GET_FIELD_ID(gObbInfoClassInfo.salt, clazz,
             "salt", "[B");
+    GET_FIELD_ID(gObbInfoClassInfo.kdfDigest, clazz,
+            "kdfDigest", "I");
+    GET_FIELD_ID(gObbInfoClassInfo.kdfRounds, clazz,
+            "kdfRounds", "I");
 
     return AndroidRuntime::registerNativeMethods(env, "android/content/res/ObbScanner", gMethods,
             NELEM(gMethods));
@@ -37,6 +37,9 @@
 
 namespace android {
 
+// Number of values copied to Java arrays at once by the bulk getters
+#define COPY_BATCH_SIZE 256
+
 static struct {
     jfieldID data;
     jfieldID sizeCopied;
@@ -76,6 +79,25 @@ static jlong nativeCreate(JNIEnv* env, jclass clazz, jstring nameObj, jint curso
     return reinterpret_cast<jlong>(window);
 }
 
+static jlong nativeCreateGrowable(JNIEnv* env, jclass clazz, jstring nameObj,
+        jint cursorWindowSize, jint maxCursorWindowSize) {
+    String8 name;
+    const char* nameStr = env->GetStringUTFChars(nameObj, NULL);
+    name.setTo(nameStr);
+    env->ReleaseStringUTFChars(nameObj, nameStr);
+
+    CursorWindow* window;
+    status_t status = CursorWindow::create(name, cursorWindowSize, maxCursorWindowSize, &window);
+    if (status || !window) {
+        ALOGE("Could not allocate CursorWindow '%s' of size %d (max %d) due to error %d.",
+                name.string(), cursorWindowSize, maxCursorWindowSize, status);
+        return 0;
+    }
+
+    LOG_WINDOW("nativeCreateGrowable: window = %p", window);
+    return reinterpret_cast<jlong>(window);
+}
+
 static jlong nativeCreateFromParcel(JNIEnv* env, jclass clazz, jobject parcelObj) {
     Parcel* parcel = parcelForJavaObject(env, parcelObj);
 
@@ -131,6 +153,11 @@ static jint nativeGetNumRows(JNIEnv* env, jclass clazz, jlong windowPtr) {
     return window->getNumRows();
 }
 
+static jint nativeGetNumPublishedRows(JNIEnv* env, jclass clazz, jlong windowPtr) {
+    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+    return window->getNumPublishedRows();
+}
+
 static jboolean nativeSetNumColumns(JNIEnv* env, jclass clazz, jlong windowPtr,
         jint columnNum) {
     CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
@@ -138,6 +165,13 @@ static jboolean nativeSetNumColumns(JNIEnv* env, jclass clazz, jlong windowPtr,
     return status == OK;
 }
 
+static jboolean nativeSetColumnar(JNIEnv* env, jclass clazz, jlong windowPtr,
+        jboolean columnar) {
+    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+    status_t status = window->setColumnar(columnar);
+    return status == OK;
+}
+
 static jboolean nativeAllocRow(JNIEnv* env, jclass clazz, jlong windowPtr) {
     CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
     status_t status = window->allocRow();
@@ -154,6 +188,11 @@ static jint nativeGetType(JNIEnv* env, jclass clazz, jlong windowPtr,
     CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
     LOG_WINDOW("returning column type affinity for %d,%d from %p", row, column, window);
 
+    if (window->isColumnar()) {
+        int32_t type = window->getColumnarFieldType(row, column);
+        return type < 0 ? CursorWindow::FIELD_TYPE_NULL : type;
+    }
+
     CursorWindow::FieldSlot* fieldSlot = window->getFieldSlot(row, column);
     if (!fieldSlot) {
         // FIXME: This is really broken but we have CTS tests that depend
@@ -169,6 +208,18 @@ static jbyteArray nativeGetBlob(JNIEnv* env, jclass clazz, jlong windowPtr,
     CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
     LOG_WINDOW("Getting blob for %d,%d from %p", row, column, window);
 
+    if (window->isColumnar()) {
+        int32_t type = window->getColumnarFieldType(row, column);
+        if (type < 0) {
+            throwExceptionWithRowCol(env, row, column);
+        } else if (type == CursorWindow::FIELD_TYPE_INTEGER) {
+            throw_sqlite3_exception(env, "INTEGER data in nativeGetBlob ");
+        } else if (type == CursorWindow::FIELD_TYPE_FLOAT) {
+            throw_sqlite3_exception(env, "FLOAT data in nativeGetBlob ");
+        }
+        return NULL;
+    }
+
     CursorWindow::FieldSlot* fieldSlot = window->getFieldSlot(row, column);
     if (!fieldSlot) {
         throwExceptionWithRowCol(env, row, column);
@@ -199,10 +250,34 @@ static jbyteArray nativeGetBlob(JNIEnv* env, jclass clazz, jlong windowPtr,
     return NULL;
 }
 
-static jstring nativeGetString(JNIEnv* env, jclass clazz, jlong windowPtr,
-        jint row, jint column) {
-    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
-    LOG_WINDOW("Getting string for %d,%d from %p", row, column, window);
+/**
+ * Formats the field of a columnar window, which is never a string or a blob.
+ * Returns false, and throws if the field is not in the window, when there is
+ * no string to return.
+ */
+static bool formatColumnarField(JNIEnv* env, CursorWindow* window, jint row, jint column,
+        char* buf, size_t size) {
+    int32_t type = window->getColumnarFieldType(row, column);
+    if (type == CursorWindow::FIELD_TYPE_INTEGER) {
+        snprintf(buf, size, "%lld", window->getColumnarFieldLong(row, column));
+        return true;
+    } else if (type == CursorWindow::FIELD_TYPE_FLOAT) {
+        snprintf(buf, size, "%g", window->getColumnarFieldDouble(row, column));
+        return true;
+    } else if (type < 0) {
+        throwExceptionWithRowCol(env, row, column);
+    }
+    return false;
+}
+
+static jstring getString(JNIEnv* env, CursorWindow* window, jint row, jint column) {
+    if (window->isColumnar()) {
+        char buf[32];
+        if (!formatColumnarField(env, window, row, column, buf, sizeof(buf))) {
+            return NULL;
+        }
+        return env->NewStringUTF(buf);
+    }
 
     CursorWindow::FieldSlot* fieldSlot = window->getFieldSlot(row, column);
     if (!fieldSlot) {
@@ -243,6 +318,13 @@ static jstring nativeGetString(JNIEnv* env, jclass clazz, jlong windowPtr,
     }
 }
 
+static jstring nativeGetString(JNIEnv* env, jclass clazz, jlong windowPtr,
+        jint row, jint column) {
+    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+    LOG_WINDOW("Getting string for %d,%d from %p", row, column, window);
+    return getString(env, window, row, column);
+}
+
 static jcharArray allocCharArrayBuffer(JNIEnv* env, jobject bufferObj, size_t size) {
     jcharArray dataObj = jcharArray(env->GetObjectField(bufferObj,
             gCharArrayBufferClassInfo.data));
@@ -296,6 +378,16 @@ static void nativeCopyStringToBuffer(JNIEnv* env, jclass clazz, jlong windowPtr,
     CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
     LOG_WINDOW("Copying string for %d,%d from %p", row, column, window);
 
+    if (window->isColumnar()) {
+        char buf[32];
+        if (formatColumnarField(env, window, row, column, buf, sizeof(buf))) {
+            fillCharArrayBufferUTF(env, bufferObj, buf, strlen(buf));
+        } else if (!env->ExceptionCheck()) {
+            clearCharArrayBuffer(env, bufferObj);
+        }
+        return;
+    }
+
     CursorWindow::FieldSlot* fieldSlot = window->getFieldSlot(row, column);
     if (!fieldSlot) {
         throwExceptionWithRowCol(env, row, column);
@@ -330,10 +422,18 @@ static void nativeCopyStringToBuffer(JNIEnv* env, jclass clazz, jlong windowPtr,
     }
 }
 
-static jlong nativeGetLong(JNIEnv* env, jclass clazz, jlong windowPtr,
-        jint row, jint column) {
-    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
-    LOG_WINDOW("Getting long for %d,%d from %p", row, column, window);
+static jlong getLong(JNIEnv* env, CursorWindow* window, jint row, jint column) {
+    if (window->isColumnar()) {
+        int32_t type = window->getColumnarFieldType(row, column);
+        if (type == CursorWindow::FIELD_TYPE_INTEGER) {
+            return window->getColumnarFieldLong(row, column);
+        } else if (type == CursorWindow::FIELD_TYPE_FLOAT) {
+            return jlong(window->getColumnarFieldDouble(row, column));
+        } else if (type < 0) {
+            throwExceptionWithRowCol(env, row, column);
+        }
+        return 0;
+    }
 
     CursorWindow::FieldSlot* fieldSlot = window->getFieldSlot(row, column);
     if (!fieldSlot) {
@@ -361,10 +461,25 @@ static jlong nativeGetLong(JNIEnv* env, jclass clazz, jlong windowPtr,
     }
 }
 
-static jdouble nativeGetDouble(JNIEnv* env, jclass clazz, jlong windowPtr,
+static jlong nativeGetLong(JNIEnv* env, jclass clazz, jlong windowPtr,
         jint row, jint column) {
     CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
-    LOG_WINDOW("Getting double for %d,%d from %p", row, column, window);
+    LOG_WINDOW("Getting long for %d,%d from %p", row, column, window);
+    return getLong(env, window, row, column);
+}
+
+static jdouble getDouble(JNIEnv* env, CursorWindow* window, jint row, jint column) {
+    if (window->isColumnar()) {
+        int32_t type = window->getColumnarFieldType(row, column);
+        if (type == CursorWindow::FIELD_TYPE_FLOAT) {
+            return window->getColumnarFieldDouble(row, column);
+        } else if (type == CursorWindow::FIELD_TYPE_INTEGER) {
+            return jdouble(window->getColumnarFieldLong(row, column));
+        } else if (type < 0) {
+            throwExceptionWithRowCol(env, row, column);
+        }
+        return 0.0;
+    }
 
     CursorWindow::FieldSlot* fieldSlot = window->getFieldSlot(row, column);
     if (!fieldSlot) {
@@ -392,6 +507,89 @@ static jdouble nativeGetDouble(JNIEnv* env, jclass clazz, jlong windowPtr,
     }
 }
 
+static jdouble nativeGetDouble(JNIEnv* env, jclass clazz, jlong windowPtr,
+        jint row, jint column) {
+    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+    LOG_WINDOW("Getting double for %d,%d from %p", row, column, window);
+    return getDouble(env, window, row, column);
+}
+
+/**
+ * Checks the range of rows of a bulk copy and returns the number of rows to
+ * copy, or -1 after throwing if the first row is not in the window.
+ */
+static jint getCopyRowCount(JNIEnv* env, CursorWindow* window, jint startRow, jint column,
+        jsize capacity) {
+    jint numRows = window->getNumRows();
+    if (startRow < 0 || startRow > numRows || column < 0
+            || uint32_t(column) >= window->getNumColumns()) {
+        throwExceptionWithRowCol(env, startRow, column);
+        return -1;
+    }
+    return capacity < numRows - startRow ? capacity : numRows - startRow;
+}
+
+static jint nativeCopyLongs(JNIEnv* env, jclass clazz, jlong windowPtr,
+        jint startRow, jint column, jlongArray valuesObj) {
+    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+    LOG_WINDOW("Copying longs from %d,%d from %p", startRow, column, window);
+
+    jint count = getCopyRowCount(env, window, startRow, column, env->GetArrayLength(valuesObj));
+    jlong buf[COPY_BATCH_SIZE];
+    for (jint i = 0; i < count; ) {
+        jint batch = count - i < COPY_BATCH_SIZE ? count - i : COPY_BATCH_SIZE;
+        for (jint j = 0; j < batch; j++) {
+            buf[j] = getLong(env, window, startRow + i + j, column);
+            if (env->ExceptionCheck()) {
+                return -1;
+            }
+        }
+        env->SetLongArrayRegion(valuesObj, i, batch, buf);
+        i += batch;
+    }
+    return count;
+}
+
+static jint nativeCopyDoubles(JNIEnv* env, jclass clazz, jlong windowPtr,
+        jint startRow, jint column, jdoubleArray valuesObj) {
+    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+    LOG_WINDOW("Copying doubles from %d,%d from %p", startRow, column, window);
+
+    jint count = getCopyRowCount(env, window, startRow, column, env->GetArrayLength(valuesObj));
+    jdouble buf[COPY_BATCH_SIZE];
+    for (jint i = 0; i < count; ) {
+        jint batch = count - i < COPY_BATCH_SIZE ? count - i : COPY_BATCH_SIZE;
+        for (jint j = 0; j < batch; j++) {
+            buf[j] = getDouble(env, window, startRow + i + j, column);
+            if (env->ExceptionCheck()) {
+                return -1;
+            }
+        }
+        env->SetDoubleArrayRegion(valuesObj, i, batch, buf);
+        i += batch;
+    }
+    return count;
+}
+
+static jint nativeCopyStrings(JNIEnv* env, jclass clazz, jlong windowPtr,
+        jint startRow, jint column, jobjectArray valuesObj) {
+    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+    LOG_WINDOW("Copying strings from %d,%d from %p", startRow, column, window);
+
+    jint count = getCopyRowCount(env, window, startRow, column, env->GetArrayLength(valuesObj));
+    for (jint i = 0; i < count; i++) {
+        jstring value = getString(env, window, startRow + i, column);
+        if (env->ExceptionCheck()) {
+            return -1;
+        }
+        env->SetObjectArrayElement(valuesObj, i, value);
+        if (value && value != gEmptyString) {
+            env->DeleteLocalRef(value);
+        }
+    }
+    return count;
+}
+
 static jboolean nativePutBlob(JNIEnv* env, jclass clazz, jlong windowPtr,
         jbyteArray valueObj, jint row, jint column) {
     CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
@@ -479,6 +677,8 @@ static JNINativeMethod sMethods[] =
     /* name, signature, funcPtr */
     { "nativeCreate", "(Ljava/lang/String;I)J",
             (void*)nativeCreate },
+    { "nativeCreateGrowable", "(Ljava/lang/String;II)J",
+            (void*)nativeCreateGrowable },
     { "nativeCreateFromParcel", "(Landroid/os/Parcel;)J",
             (void*)nativeCreateFromParcel },
     { "nativeDispose", "(J)V",
@@ -491,8 +691,12 @@ static JNINativeMethod sMethods[] =
             (void*)nativeClear },
     { "nativeGetNumRows", "(J)I",
             (void*)nativeGetNumRows },
+    { "nativeGetNumPublishedRows", "(J)I",
+            (void*)nativeGetNumPublishedRows },
     { "nativeSetNumColumns", "(JI)Z",
             (void*)nativeSetNumColumns },
+    { "nativeSetColumnar", "(JZ)Z",
+            (void*)nativeSetColumnar },
     { "nativeAllocRow", "(J)Z",
             (void*)nativeAllocRow },
     { "nativeFreeLastRow", "(J)V",
@@ -509,6 +713,12 @@ static JNINativeMethod sMethods[] =
             (void*)nativeGetDouble },
     { "nativeCopyStringToBuffer", "(JIILandroid/database/CharArrayBuffer;)V",
             (void*)nativeCopyStringToBuffer },
+    { "nativeCopyLongs", "(JII[J)I",
+            (void*)nativeCopyLongs },
+    { "nativeCopyDoubles", "(JII[D)I",
+            (void*)nativeCopyDoubles },
+    { "nativeCopyStrings", "(JII[Ljava/lang/String;)I",
+            (void*)nativeCopyStrings },
     { "nativePutBlob", "(J[BII)Z",
             (void*)nativePutBlob },
     { "nativePutString", "(JLjava/lang/String;II)Z",
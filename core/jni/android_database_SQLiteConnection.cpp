@@ -24,6 +24,7 @@
 #include <utils/Log.h>
 #include <utils/String8.h>
 #include <utils/String16.h>
+#include <utils/Vector.h>
 #include <cutils/ashmem.h>
 #include <sys/mman.h>
 
@@ -60,12 +61,29 @@ static struct {
     jfieldID name;
     jfieldID numArgs;
     jmethodID dispatchCallback;
+    jmethodID dispatchCallbackBatch;
 } gSQLiteCustomFunctionClassInfo;
 
 static struct {
     jclass clazz;
 } gStringClassInfo;
 
+/* Maximum number of idle statements kept prepared by each connection.
+ * Statements in use are never evicted, the cache grows past this size
+ * when more of them are acquired at once.
+ */
+static const size_t MAX_CACHED_STATEMENTS = 16;
+
+struct CachedStatement {
+    String16 sql;
+    sqlite3_stmt* statement;
+    // Global reference to the names of the columns, created on demand.
+    jobjectArray columnNames;
+    bool inUse;
+};
+
+struct BatchedCustomFunction;
+
 struct SQLiteConnection {
     // Open flags.
     // Must be kept in sync with the constants defined in SQLiteDatabase.java.
@@ -84,6 +102,12 @@ struct SQLiteConnection {
 
     volatile bool canceled;
 
+    // Statements acquired through nativeAcquireStatement, least recently used first.
+    Vector<CachedStatement> statementCache;
+
+    // Custom functions registered with nativeRegisterCustomFunctionBatched.
+    Vector<BatchedCustomFunction*> batchedFunctions;
+
     SQLiteConnection(sqlite3* db, int openFlags, const String8& path, const String8& label) :
         db(db), openFlags(openFlags), path(path), label(label), canceled(false) { }
 };
@@ -173,11 +197,31 @@ static jlong nativeOpen(JNIEnv* env, jclass clazz, jstring pathStr, jint openFla
     return reinterpret_cast<jlong>(connection);
 }
 
+static void finalizeCachedStatement(JNIEnv* env, const CachedStatement& cached) {
+    if (cached.columnNames) {
+        env->DeleteGlobalRef(cached.columnNames);
+    }
+    sqlite3_finalize(cached.statement);
+}
+
+static void clearStatementCache(JNIEnv* env, SQLiteConnection* connection) {
+    Vector<CachedStatement>& cache = connection->statementCache;
+    for (size_t i = 0; i < cache.size(); i++) {
+        if (cache[i].inUse) {
+            ALOGW("Statement %p is still in use while closing connection %p",
+                    cache[i].statement, connection->db);
+        }
+        finalizeCachedStatement(env, cache[i]);
+    }
+    cache.clear();
+}
+
 static void nativeClose(JNIEnv* env, jclass clazz, jlong connectionPtr) {
     SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
 
     if (connection) {
         ALOGV("Closing connection %p", connection->db);
+        clearStatementCache(env, connection);
         int err = sqlite3_close(connection->db);
         if (err != SQLITE_OK) {
             // This can happen if sub-objects aren't closed first.  Make sure the caller knows.
@@ -267,6 +311,215 @@ static void nativeRegisterCustomFunction(JNIEnv* env, jclass clazz, jlong connec
     }
 }
 
+/* Custom function whose calls are buffered natively and dispatched to Java
+ * in batches. Custom functions have no result, so a call only has to reach
+ * Java before the statement that made it returns, instead of making a JNI
+ * round trip and allocating an array for each row.
+ *
+ * The arguments of the buffered calls are stored one after the other, with
+ * their SQLite type. Integers and floats are kept as is, text and blobs are
+ * kept as UTF-16 text like the arguments of non batched functions.
+ */
+struct BatchedCustomFunction {
+    SQLiteConnection* const connection;
+    const jobject functionObjGlobal;
+    const int numArgs;
+    const size_t batchSize;
+
+    size_t pendingCalls;
+    Vector<jint> types;
+    Vector<jlong> longs;
+    Vector<jdouble> doubles;
+    // Text of the text and blob arguments, and where each one ends.
+    Vector<jchar> text;
+    Vector<size_t> textEnds;
+
+    BatchedCustomFunction(SQLiteConnection* connection, jobject functionObjGlobal,
+            int numArgs, size_t batchSize) :
+        connection(connection), functionObjGlobal(functionObjGlobal), numArgs(numArgs),
+        batchSize(batchSize), pendingCalls(0) { }
+};
+
+static bool hasTextValue(jint type) {
+    return type == SQLITE_TEXT || type == SQLITE_BLOB;
+}
+
+// Calls the Java function once with the arguments of every buffered call.
+static void flushBatchedCustomFunction(JNIEnv* env, BatchedCustomFunction* function) {
+    if (!function->pendingCalls) {
+        return;
+    }
+
+    size_t numValues = function->types.size();
+    jintArray typesArray = env->NewIntArray(numValues);
+    jlongArray longsArray = typesArray ? env->NewLongArray(numValues) : NULL;
+    jdoubleArray doublesArray = longsArray ? env->NewDoubleArray(numValues) : NULL;
+    jobjectArray stringsArray = doublesArray ?
+            env->NewObjectArray(numValues, gStringClassInfo.clazz, NULL) : NULL;
+    if (stringsArray) {
+        env->SetIntArrayRegion(typesArray, 0, numValues, function->types.array());
+        env->SetLongArrayRegion(longsArray, 0, numValues, function->longs.array());
+        env->SetDoubleArrayRegion(doublesArray, 0, numValues, function->doubles.array());
+
+        size_t textIndex = 0;
+        size_t textStart = 0;
+        bool outOfMemory = false;
+        for (size_t i = 0; i < numValues && !outOfMemory; i++) {
+            if (hasTextValue(function->types[i])) {
+                size_t textEnd = function->textEnds[textIndex++];
+                jstring argStr = env->NewString(function->text.array() + textStart,
+                        textEnd - textStart);
+                textStart = textEnd;
+                if (!argStr) {
+                    outOfMemory = true;
+                } else {
+                    env->SetObjectArrayElement(stringsArray, i, argStr);
+                    env->DeleteLocalRef(argStr);
+                }
+            }
+        }
+
+        if (!outOfMemory) {
+            env->CallVoidMethod(function->functionObjGlobal,
+                    gSQLiteCustomFunctionClassInfo.dispatchCallbackBatch,
+                    jint(function->pendingCalls), typesArray, longsArray, doublesArray,
+                    stringsArray);
+        }
+    }
+
+    env->DeleteLocalRef(typesArray);
+    env->DeleteLocalRef(longsArray);
+    env->DeleteLocalRef(doublesArray);
+    env->DeleteLocalRef(stringsArray);
+
+    function->pendingCalls = 0;
+    function->types.clear();
+    function->longs.clear();
+    function->doubles.clear();
+    function->text.clear();
+    function->textEnds.clear();
+
+    if (env->ExceptionCheck()) {
+        ALOGE("An exception was thrown by custom SQLite function.");
+        LOGE_EX(env);
+        env->ExceptionClear();
+    }
+}
+
+// Called once a statement has been stepped, to deliver the calls it made.
+static void flushCustomFunctionBatches(JNIEnv* env, SQLiteConnection* connection) {
+    Vector<BatchedCustomFunction*>& functions = connection->batchedFunctions;
+    if (functions.isEmpty()) {
+        return;
+    }
+
+    // Java cannot be called while the exception of a failed statement is pending.
+    jthrowable pending = env->ExceptionOccurred();
+    if (pending) {
+        env->ExceptionClear();
+    }
+    for (size_t i = 0; i < functions.size(); i++) {
+        flushBatchedCustomFunction(env, functions[i]);
+    }
+    if (pending) {
+        env->Throw(pending);
+        env->DeleteLocalRef(pending);
+    }
+}
+
+// Called each time a batched custom function is evaluated.
+static void sqliteBatchedCustomFunctionCallback(sqlite3_context *context,
+        int argc, sqlite3_value **argv) {
+    BatchedCustomFunction* function =
+            static_cast<BatchedCustomFunction*>(sqlite3_user_data(context));
+
+    for (int i = 0; i < argc; i++) {
+        jint type = sqlite3_value_type(argv[i]);
+        jlong longValue = 0;
+        jdouble doubleValue = 0;
+        if (type == SQLITE_INTEGER) {
+            longValue = sqlite3_value_int64(argv[i]);
+        } else if (type == SQLITE_FLOAT) {
+            doubleValue = sqlite3_value_double(argv[i]);
+        } else if (hasTextValue(type)) {
+            const jchar* arg = static_cast<const jchar*>(sqlite3_value_text16(argv[i]));
+            if (!arg) {
+                ALOGW("NULL argument in custom_function_callback.  This should not happen.");
+                type = SQLITE_NULL;
+            } else {
+                size_t argLen = sqlite3_value_bytes16(argv[i]) / sizeof(jchar);
+                function->text.appendArray(arg, argLen);
+                function->textEnds.add(function->text.size());
+            }
+        }
+        function->types.add(type);
+        function->longs.add(longValue);
+        function->doubles.add(doubleValue);
+    }
+
+    if (++function->pendingCalls >= function->batchSize) {
+        flushBatchedCustomFunction(AndroidRuntime::getJNIEnv(), function);
+    }
+}
+
+// Called when a batched custom function is destroyed.
+static void sqliteBatchedCustomFunctionDestructor(void* data) {
+    BatchedCustomFunction* function = static_cast<BatchedCustomFunction*>(data);
+
+    JNIEnv* env = AndroidRuntime::getJNIEnv();
+    flushBatchedCustomFunction(env, function);
+
+    Vector<BatchedCustomFunction*>& functions = function->connection->batchedFunctions;
+    for (size_t i = 0; i < functions.size(); i++) {
+        if (functions[i] == function) {
+            functions.removeAt(i);
+            break;
+        }
+    }
+
+    env->DeleteGlobalRef(function->functionObjGlobal);
+    delete function;
+}
+
+/* Registers a custom function whose calls are dispatched to
+ * SQLiteCustomFunction.dispatchCallbackBatch() by groups of up to batchSize
+ * calls, and at the latest when the statement that made them returns.
+ * Functions with a variable number of arguments are dispatched one call at
+ * a time.
+ */
+static void nativeRegisterCustomFunctionBatched(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jobject functionObj, jint batchSize) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+
+    jint numArgs = env->GetIntField(functionObj, gSQLiteCustomFunctionClassInfo.numArgs);
+    if (numArgs < 0 || batchSize <= 1) {
+        nativeRegisterCustomFunction(env, clazz, connectionPtr, functionObj);
+        return;
+    }
+
+    jstring nameStr = jstring(env->GetObjectField(
+            functionObj, gSQLiteCustomFunctionClassInfo.name));
+
+    BatchedCustomFunction* function = new BatchedCustomFunction(connection,
+            env->NewGlobalRef(functionObj), numArgs, batchSize);
+
+    // A function registered under the same name is destroyed here, after
+    // delivering its pending calls.
+    const char* name = env->GetStringUTFChars(nameStr, NULL);
+    int err = sqlite3_create_function_v2(connection->db, name, numArgs, SQLITE_UTF16,
+            function, &sqliteBatchedCustomFunctionCallback, NULL, NULL,
+            &sqliteBatchedCustomFunctionDestructor);
+    env->ReleaseStringUTFChars(nameStr, name);
+
+    if (err != SQLITE_OK) {
+        // SQLite has already called the destructor.
+        ALOGE("sqlite3_create_function returned %d", err);
+        throw_sqlite3_exception(env, connection->db);
+        return;
+    }
+    connection->batchedFunctions.add(function);
+}
+
 static void nativeRegisterLocalizedCollators(JNIEnv* env, jclass clazz, jlong connectionPtr,
         jstring localeStr) {
     SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
@@ -280,6 +533,22 @@ static void nativeRegisterLocalizedCollators(JNIEnv* env, jclass clazz, jlong co
     }
 }
 
+static void throwCompileException(JNIEnv* env, SQLiteConnection* connection,
+        jstring sqlString) {
+    // Error messages like 'near ")": syntax error' are not
+    // always helpful enough, so construct an error string that
+    // includes the query itself.
+    const char *query = env->GetStringUTFChars(sqlString, NULL);
+    char *message = (char*) malloc(strlen(query) + 50);
+    if (message) {
+        strcpy(message, ", while compiling: "); // less than 50 chars
+        strcat(message, query);
+    }
+    env->ReleaseStringUTFChars(sqlString, query);
+    throw_sqlite3_exception(env, connection->db, message);
+    free(message);
+}
+
 static jlong nativePrepareStatement(JNIEnv* env, jclass clazz, jlong connectionPtr,
         jstring sqlString) {
     SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
@@ -292,18 +561,7 @@ static jlong nativePrepareStatement(JNIEnv* env, jclass clazz, jlong connectionP
     env->ReleaseStringCritical(sqlString, sql);
 
     if (err != SQLITE_OK) {
-        // Error messages like 'near ")": syntax error' are not
-        // always helpful enough, so construct an error string that
-        // includes the query itself.
-        const char *query = env->GetStringUTFChars(sqlString, NULL);
-        char *message = (char*) malloc(strlen(query) + 50);
-        if (message) {
-            strcpy(message, ", while compiling: "); // less than 50 chars
-            strcat(message, query);
-        }
-        env->ReleaseStringUTFChars(sqlString, query);
-        throw_sqlite3_exception(env, connection->db, message);
-        free(message);
+        throwCompileException(env, connection, sqlString);
         return 0;
     }
 
@@ -311,6 +569,142 @@ static jlong nativePrepareStatement(JNIEnv* env, jclass clazz, jlong connectionP
     return reinterpret_cast<jlong>(statement);
 }
 
+/**
+ * Returns a prepared statement for the query, from the cache of the
+ * connection when an idle statement was prepared for the same query, and
+ * stores the number of parameters, the number of columns and whether the
+ * statement is read only in info.  The statement must be given back with
+ * nativeReleaseStatement.
+ */
+static jlong nativeAcquireStatement(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jstring sqlString, jintArray infoObj) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    Vector<CachedStatement>& cache = connection->statementCache;
+
+    jsize sqlLength = env->GetStringLength(sqlString);
+    const jchar* sql = env->GetStringCritical(sqlString, NULL);
+    String16 key(reinterpret_cast<const char16_t*>(sql), sqlLength);
+    env->ReleaseStringCritical(sqlString, sql);
+
+    sqlite3_stmt* statement = NULL;
+    bool inCache = false;
+    for (size_t i = cache.size(); i > 0; i--) {
+        const CachedStatement& cached = cache[i - 1];
+        if (cached.inUse || cached.sql != key) {
+            continue;
+        }
+        // Move the statement to the most recently used end
+        CachedStatement entry(cached);
+        entry.inUse = true;
+        cache.removeAt(i - 1);
+        cache.push(entry);
+        statement = entry.statement;
+        inCache = true;
+        break;
+    }
+
+    if (!inCache) {
+        int err = sqlite3_prepare16_v2(connection->db,
+                key.string(), key.size() * sizeof(char16_t), &statement, NULL);
+        if (err != SQLITE_OK) {
+            throwCompileException(env, connection, sqlString);
+            return 0;
+        }
+        ALOGV("Prepared statement %p on connection %p", statement, connection->db);
+
+        CachedStatement entry;
+        entry.sql = key;
+        entry.statement = statement;
+        entry.columnNames = NULL;
+        entry.inUse = true;
+        cache.push(entry);
+
+        // Evict the least recently used idle statements
+        for (size_t i = 0; i < cache.size() && cache.size() > MAX_CACHED_STATEMENTS; ) {
+            if (cache[i].inUse) {
+                i++;
+                continue;
+            }
+            finalizeCachedStatement(env, cache[i]);
+            cache.removeAt(i);
+        }
+    }
+
+    jint info[3];
+    info[0] = sqlite3_bind_parameter_count(statement);
+    info[1] = sqlite3_column_count(statement);
+    info[2] = sqlite3_stmt_readonly(statement) != 0;
+    env->SetIntArrayRegion(infoObj, 0, 3, info);
+    return reinterpret_cast<jlong>(statement);
+}
+
+static void nativeReleaseStatement(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jlong statementPtr) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    sqlite3_stmt* statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
+    Vector<CachedStatement>& cache = connection->statementCache;
+
+    sqlite3_reset(statement);
+    sqlite3_clear_bindings(statement);
+    for (size_t i = 0; i < cache.size(); i++) {
+        if (cache[i].statement == statement) {
+            cache.editItemAt(i).inUse = false;
+            return;
+        }
+    }
+    ALOGW("Released statement %p is not in the cache of connection %p",
+            statement, connection->db);
+}
+
+/**
+ * Returns the names of the columns of a statement acquired with
+ * nativeAcquireStatement.  The array is shared by the users of the
+ * statement and must not be modified.
+ */
+static jobjectArray nativeGetColumnNames(JNIEnv* env, jclass clazz, jlong connectionPtr,
+        jlong statementPtr) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    sqlite3_stmt* statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
+    Vector<CachedStatement>& cache = connection->statementCache;
+
+    ssize_t index = -1;
+    for (size_t i = 0; i < cache.size(); i++) {
+        if (cache[i].statement == statement) {
+            index = i;
+            break;
+        }
+    }
+    if (index >= 0 && cache[index].columnNames) {
+        return jobjectArray(env->NewLocalRef(cache[index].columnNames));
+    }
+
+    int count = sqlite3_column_count(statement);
+    jobjectArray namesObj = env->NewObjectArray(count, gStringClassInfo.clazz, NULL);
+    if (!namesObj) {
+        return NULL;
+    }
+    for (int i = 0; i < count; i++) {
+        const jchar* name = static_cast<const jchar*>(sqlite3_column_name16(statement, i));
+        if (name) {
+            size_t length = 0;
+            while (name[length]) {
+                length += 1;
+            }
+            jstring nameObj = env->NewString(name, length);
+            if (!nameObj) {
+                return NULL;
+            }
+            env->SetObjectArrayElement(namesObj, i, nameObj);
+            env->DeleteLocalRef(nameObj);
+        }
+    }
+
+    if (index >= 0) {
+        cache.editItemAt(index).columnNames = jobjectArray(env->NewGlobalRef(namesObj));
+    }
+    return namesObj;
+}
+
 static void nativeFinalizeStatement(JNIEnv* env, jclass clazz, jlong connectionPtr,
         jlong statementPtr) {
     SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
@@ -441,6 +835,7 @@ static void nativeResetStatementAndClearBindings(JNIEnv* env, jclass clazz, jlon
 
 static int executeNonQuery(JNIEnv* env, SQLiteConnection* connection, sqlite3_stmt* statement) {
     int err = sqlite3_step(statement);
+    flushCustomFunctionBatches(env, connection);
     if (err == SQLITE_ROW) {
         throw_sqlite3_exception(env,
                 "Queries can be performed using SQLiteDatabase query or rawQuery methods only.");
@@ -479,6 +874,7 @@ static jlong nativeExecuteForLastInsertedRowId(JNIEnv* env, jclass clazz,
 
 static int executeOneRowQuery(JNIEnv* env, SQLiteConnection* connection, sqlite3_stmt* statement) {
     int err = sqlite3_step(statement);
+    flushCustomFunctionBatches(env, connection);
     if (err != SQLITE_ROW) {
         throw_sqlite3_exception(env, connection->db);
     }
@@ -594,7 +990,11 @@ static CopyRowResult copyRow(JNIEnv* env, CursorWindow* window,
             // one to make sure we store the terminator.
             size_t sizeIncludingNull = sqlite3_column_bytes(statement, i) + 1;
             status = window->putString(addedRows, i, text, sizeIncludingNull);
-            if (status) {
+            if (status == INVALID_OPERATION && window->isColumnar()) {
+                throw_sqlite3_exception(env, "TEXT data in a columnar window");
+                result = CPR_ERROR;
+                break;
+            } else if (status) {
                 LOG_WINDOW("Failed allocating %u bytes for text at %d,%d, error=%d",
                         sizeIncludingNull, startPos + addedRows, i, status);
                 result = CPR_FULL;
@@ -629,7 +1029,11 @@ static CopyRowResult copyRow(JNIEnv* env, CursorWindow* window,
             const void* blob = sqlite3_column_blob(statement, i);
             size_t size = sqlite3_column_bytes(statement, i);
             status = window->putBlob(addedRows, i, blob, size);
-            if (status) {
+            if (status == INVALID_OPERATION && window->isColumnar()) {
+                throw_sqlite3_exception(env, "BLOB data in a columnar window");
+                result = CPR_ERROR;
+                break;
+            } else if (status) {
                 LOG_WINDOW("Failed allocating %u bytes for blob at %d,%d, error=%d",
                         size, startPos + addedRows, i, status);
                 result = CPR_FULL;
@@ -664,12 +1068,16 @@ static CopyRowResult copyRow(JNIEnv* env, CursorWindow* window,
     return result;
 }
 
-static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
-        jlong connectionPtr, jlong statementPtr, jlong windowPtr,
-        jint startPos, jint requiredPos, jboolean countAllRows) {
-    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
-    sqlite3_stmt* statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
-    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+/**
+ * Fills the window with the rows of the statement.  When publishInterval is
+ * positive, the rows are published every publishInterval rows so that they
+ * can be read while the statement is being stepped.  Rows are only published
+ * once the required row is in the window, since the window is cleared until
+ * then.
+ */
+static jlong executeForCursorWindow(JNIEnv* env, SQLiteConnection* connection,
+        sqlite3_stmt* statement, CursorWindow* window,
+        jint startPos, jint requiredPos, jboolean countAllRows, jint publishInterval) {
 
     status_t status = window->clear();
     if (status) {
@@ -720,6 +1128,10 @@ static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
 
             if (cpr == CPR_OK) {
                 addedRows += 1;
+                if (publishInterval > 0 && addedRows % publishInterval == 0
+                        && startPos + addedRows > requiredPos) {
+                    window->publishRows();
+                }
             } else if (cpr == CPR_FULL) {
                 windowFull = true;
             } else {
@@ -751,6 +1163,8 @@ static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
             "to the window in %d bytes",
             statement, totalRows, addedRows, window->size() - window->freeSpace());
     sqlite3_reset(statement);
+    window->publishRows();
+    flushCustomFunctionBatches(env, connection);
 
     // Report the total number of rows on request.
     if (startPos > totalRows) {
@@ -760,6 +1174,26 @@ static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
     return result;
 }
 
+static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
+        jlong connectionPtr, jlong statementPtr, jlong windowPtr,
+        jint startPos, jint requiredPos, jboolean countAllRows) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    sqlite3_stmt* statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
+    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+    return executeForCursorWindow(env, connection, statement, window,
+            startPos, requiredPos, countAllRows, 0);
+}
+
+static jlong nativeExecuteForCursorWindowStreaming(JNIEnv* env, jclass clazz,
+        jlong connectionPtr, jlong statementPtr, jlong windowPtr,
+        jint startPos, jint requiredPos, jboolean countAllRows, jint publishInterval) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    sqlite3_stmt* statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
+    CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
+    return executeForCursorWindow(env, connection, statement, window,
+            startPos, requiredPos, countAllRows, publishInterval);
+}
+
 static jint nativeGetDbLookaside(JNIEnv* env, jobject clazz, jlong connectionPtr) {
     SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
 
@@ -797,12 +1231,21 @@ static JNINativeMethod sMethods[] =
             (void*)nativeClose },
     { "nativeRegisterCustomFunction", "(JLandroid/database/sqlite/SQLiteCustomFunction;)V",
             (void*)nativeRegisterCustomFunction },
+    { "nativeRegisterCustomFunctionBatched",
+            "(JLandroid/database/sqlite/SQLiteCustomFunction;I)V",
+            (void*)nativeRegisterCustomFunctionBatched },
     { "nativeRegisterLocalizedCollators", "(JLjava/lang/String;)V",
             (void*)nativeRegisterLocalizedCollators },
     { "nativePrepareStatement", "(JLjava/lang/String;)J",
             (void*)nativePrepareStatement },
     { "nativeFinalizeStatement", "(JJ)V",
             (void*)nativeFinalizeStatement },
+    { "nativeAcquireStatement", "(JLjava/lang/String;[I)J",
+            (void*)nativeAcquireStatement },
+    { "nativeReleaseStatement", "(JJ)V",
+            (void*)nativeReleaseStatement },
+    { "nativeGetColumnNames", "(JJ)[Ljava/lang/String;",
+            (void*)nativeGetColumnNames },
     { "nativeGetParameterCount", "(JJ)I",
             (void*)nativeGetParameterCount },
     { "nativeIsReadOnly", "(JJ)Z",
@@ -837,6 +1280,8 @@ static JNINativeMethod sMethods[] =
             (void*)nativeExecuteForLastInsertedRowId },
     { "nativeExecuteForCursorWindow", "(JJJIIZ)J",
             (void*)nativeExecuteForCursorWindow },
+    { "nativeExecuteForCursorWindowStreaming", "(JJJIIZI)J",
+            (void*)nativeExecuteForCursorWindowStreaming },
     { "nativeGetDbLookaside", "(J)I",
             (void*)nativeGetDbLookaside },
     { "nativeCancel", "(J)V",
@@ -868,6 +1313,8 @@ int register_android_database_SQLiteConnection(JNIEnv *env)
             "numArgs", "I");
     GET_METHOD_ID(gSQLiteCustomFunctionClassInfo.dispatchCallback,
             clazz, "dispatchCallback", "([Ljava/lang/String;)V");
+    GET_METHOD_ID(gSQLiteCustomFunctionClassInfo.dispatchCallbackBatch,
+            clazz, "dispatchCallbackBatch", "(I[I[J[D[Ljava/lang/String;)V");
 
     FIND_CLASS(clazz, "java/lang/String");
     gStringClassInfo.clazz = jclass(env->NewGlobalRef(clazz));
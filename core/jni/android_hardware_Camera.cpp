@@ -67,12 +67,17 @@ public:
     void postMetadata(JNIEnv *env, int32_t msgType, camera_frame_metadata_t *metadata);
     void addCallbackBuffer(JNIEnv *env, jbyteArray cbb, int msgType);
     void setCallbackMode(JNIEnv *env, bool installed, bool manualMode);
+    void setDirectFrameMode(JNIEnv *env, bool enabled, int maxFrames);
+    void releaseDirectFrame(int32_t frameId);
     sp<Camera> getCamera() { Mutex::Autolock _l(mLock); return mCamera; }
     bool isRawImageCallbackBufferAvailable() const;
     void release();
 
 private:
     void copyAndPost(JNIEnv* env, const sp<IMemory>& dataPtr, int msgType);
+    void postDirectFrame(JNIEnv* env, const sp<IMemory>& dataPtr);
+    void updateDirectFrameCallback_l();
+    void clearDirectFrames_l(JNIEnv *env);
     void clearCallbackBuffers_l(JNIEnv *env, Vector<jbyteArray> *buffers);
     void clearCallbackBuffers_l(JNIEnv *env);
     jbyteArray getCallbackBuffer(JNIEnv *env, Vector<jbyteArray> *buffers, size_t bufferSize);
@@ -102,6 +107,29 @@ private:
     bool mManualBufferMode;              // Whether to use application managed buffers.
     bool mManualCameraCallbackSet;       // Whether the callback has been set, used to
                                          // reduce unnecessary calls to set the callback.
+    bool mPreviewCallbackInstalled;      // Whether Java has a preview callback at all.
+
+    /*
+     * Direct preview frame mode. Each frame is copied into one of a pool of
+     * native buffers, handed to Java as a direct ByteBuffer instead of a new
+     * byte[], and not reused until Java releases it by id. The camera's own
+     * memory is recycled by the next frame, it is never handed out. At most
+     * mMaxDirectFrames are outstanding; beyond that the preview callback is
+     * suspended, the same way manual mode throttles on an empty queue.
+     *
+     * The buffers are freed when direct mode is left or the camera released,
+     * Java must drop every ByteBuffer of the pool before either.
+     */
+    struct DirectFrame {
+        uint8_t* data;
+        size_t size;
+        jobject buffer;     // global reference to the ByteBuffer over data
+        bool outstanding;
+    };
+    bool mDirectFrameMode;
+    size_t mMaxDirectFrames;
+    size_t mOutstandingDirectFrames;
+    Vector<DirectFrame> mDirectFrames;  // indexed by frame id
 };
 
 bool JNICameraContext::isRawImageCallbackBufferAvailable() const
@@ -140,6 +168,10 @@ JNICameraContext::JNICameraContext(JNIEnv* env, jobject weak_this, jclass clazz,
 
     mManualBufferMode = false;
     mManualCameraCallbackSet = false;
+    mPreviewCallbackInstalled = false;
+    mDirectFrameMode = false;
+    mMaxDirectFrames = 0;
+    mOutstandingDirectFrames = 0;
 }
 
 void JNICameraContext::release()
@@ -165,6 +197,7 @@ void JNICameraContext::release()
         mRectClass = NULL;
     }
     clearCallbackBuffers_l(env);
+    clearDirectFrames_l(env);
     mCamera.clear();
 }
 
@@ -221,10 +254,84 @@ jbyteArray JNICameraContext::getCallbackBuffer(
     return obj;
 }
 
+void JNICameraContext::postDirectFrame(JNIEnv* env, const sp<IMemory>& dataPtr)
+{
+    void* data = dataPtr != NULL ? dataPtr->pointer() : NULL;
+    if (data == NULL) {
+        ALOGE("image heap is NULL");
+        return;
+    }
+    if (mOutstandingDirectFrames >= mMaxDirectFrames) {
+        ALOGV("All %d direct frames outstanding, dropping frame", mOutstandingDirectFrames);
+        updateDirectFrameCallback_l();
+        return;
+    }
+
+    size_t frameId = 0;
+    while (frameId < mDirectFrames.size() && mDirectFrames[frameId].outstanding) {
+        frameId++;
+    }
+    if (frameId == mDirectFrames.size()) {
+        DirectFrame frame = { NULL, 0, NULL, false };
+        mDirectFrames.push(frame);
+    }
+
+    // The buffer of a released frame is reused as long as the preview size
+    // does not change
+    DirectFrame& frame = mDirectFrames.editItemAt(frameId);
+    const size_t size = dataPtr->size();
+    if (frame.buffer == NULL || frame.size != size) {
+        if (frame.buffer != NULL) {
+            env->DeleteGlobalRef(frame.buffer);
+            frame.buffer = NULL;
+        }
+        free(frame.data);
+        frame.data = (uint8_t*) malloc(size);
+        frame.size = size;
+
+        jobject obj = frame.data != NULL ? env->NewDirectByteBuffer(frame.data, size) : NULL;
+        if (obj == NULL) {
+            ALOGE("Couldn't allocate a direct buffer for a preview frame");
+            env->ExceptionClear();
+            free(frame.data);
+            frame.data = NULL;
+            return;
+        }
+        frame.buffer = env->NewGlobalRef(obj);
+        env->DeleteLocalRef(obj);
+    }
+
+    memcpy(frame.data, data, size);
+    frame.outstanding = true;
+    mOutstandingDirectFrames++;
+    updateDirectFrameCallback_l();
+
+    env->CallStaticVoidMethod(mCameraJClass, fields.post_event,
+            mCameraJObjectWeak, CAMERA_MSG_PREVIEW_FRAME, (jint) frameId, 0, frame.buffer);
+}
+
+void JNICameraContext::clearDirectFrames_l(JNIEnv *env)
+{
+    for (size_t i = 0; i < mDirectFrames.size(); i++) {
+        const DirectFrame& frame = mDirectFrames[i];
+        if (frame.buffer != NULL) {
+            env->DeleteGlobalRef(frame.buffer);
+        }
+        free(frame.data);
+    }
+    mDirectFrames.clear();
+    mOutstandingDirectFrames = 0;
+}
+
 void JNICameraContext::copyAndPost(JNIEnv* env, const sp<IMemory>& dataPtr, int msgType)
 {
     jbyteArray obj = NULL;
 
+    if (msgType == CAMERA_MSG_PREVIEW_FRAME && mDirectFrameMode) {
+        postDirectFrame(env, dataPtr);
+        return;
+    }
+
     // allocate Java byte array and copy data
     if (dataPtr != NULL) {
         ssize_t offset;
@@ -363,6 +470,7 @@ void JNICameraContext::setCallbackMode(JNIEnv *env, bool installed, bool manualM
     Mutex::Autolock _l(mLock);
     mManualBufferMode = manualMode;
     mManualCameraCallbackSet = false;
+    mPreviewCallbackInstalled = installed;
 
     // In order to limit the over usage of binder threads, all non-manual buffer
     // callbacks use CAMERA_FRAME_CALLBACK_FLAG_BARCODE_SCANNER mode now.
@@ -374,6 +482,9 @@ void JNICameraContext::setCallbackMode(JNIEnv *env, bool installed, bool manualM
     if (!installed) {
         mCamera->setPreviewCallbackFlags(CAMERA_FRAME_CALLBACK_FLAG_NOOP);
         clearCallbackBuffers_l(env, &mCallbackBuffers);
+    } else if (mDirectFrameMode) {
+        clearCallbackBuffers_l(env, &mCallbackBuffers);
+        updateDirectFrameCallback_l();
     } else if (mManualBufferMode) {
         if (!mCallbackBuffers.isEmpty()) {
             mCamera->setPreviewCallbackFlags(CAMERA_FRAME_CALLBACK_FLAG_CAMERA);
@@ -385,6 +496,46 @@ void JNICameraContext::setCallbackMode(JNIEnv *env, bool installed, bool manualM
     }
 }
 
+void JNICameraContext::setDirectFrameMode(JNIEnv *env, bool enabled, int maxFrames)
+{
+    Mutex::Autolock _l(mLock);
+    mDirectFrameMode = enabled;
+    mMaxDirectFrames = enabled && maxFrames > 0 ? maxFrames : 0;
+    mManualCameraCallbackSet = false;
+    if (!enabled) {
+        // Java drops every outstanding buffer before leaving direct mode
+        clearDirectFrames_l(env);
+    }
+}
+
+void JNICameraContext::releaseDirectFrame(int32_t frameId)
+{
+    Mutex::Autolock _l(mLock);
+    if (frameId < 0 || (size_t) frameId >= mDirectFrames.size()
+            || !mDirectFrames[frameId].outstanding) {
+        ALOGW("Releasing unknown preview frame %d", frameId);
+        return;
+    }
+    mDirectFrames.editItemAt(frameId).outstanding = false;
+    mOutstandingDirectFrames--;
+    if (mDirectFrameMode && mPreviewCallbackInstalled) {
+        updateDirectFrameCallback_l();
+    }
+}
+
+// Keeps the camera's callback flag in step with the number of frames Java
+// still holds, only talking to the camera when the state actually changes.
+void JNICameraContext::updateDirectFrameCallback_l()
+{
+    bool wanted = mOutstandingDirectFrames < mMaxDirectFrames;
+    if (mCamera == NULL || wanted == mManualCameraCallbackSet) {
+        return;
+    }
+    mCamera->setPreviewCallbackFlags(wanted ? CAMERA_FRAME_CALLBACK_FLAG_CAMERA
+            : CAMERA_FRAME_CALLBACK_FLAG_NOOP);
+    mManualCameraCallbackSet = wanted;
+}
+
 void JNICameraContext::addCallbackBuffer(
         JNIEnv *env, jbyteArray cbb, int msgType)
 {
@@ -661,6 +812,32 @@ static void android_hardware_Camera_addCallbackBuffer(JNIEnv *env, jobject thiz,
     }
 }
 
+static void android_hardware_Camera_setDirectPreviewFrames(JNIEnv *env, jobject thiz,
+        jboolean enabled, jint maxFrames)
+{
+    ALOGV("setDirectPreviewFrames: enabled:%d, maxFrames:%d", (int)enabled, maxFrames);
+    if (enabled && maxFrames <= 0) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "maxFrames must be positive");
+        return;
+    }
+    JNICameraContext* context;
+    sp<Camera> camera = get_native_camera(env, thiz, &context);
+    if (camera == 0) return;
+
+    context->setDirectFrameMode(env, enabled, maxFrames);
+}
+
+static void android_hardware_Camera_releasePreviewFrame(JNIEnv *env, jobject thiz, jint frameId)
+{
+    ALOGV("releasePreviewFrame: %d", frameId);
+    JNICameraContext* context = reinterpret_cast<JNICameraContext*>(env->GetLongField(thiz, fields.context));
+
+    if (context != NULL) {
+        context->releaseDirectFrame(frameId);
+    }
+}
+
 static void android_hardware_Camera_autoFocus(JNIEnv *env, jobject thiz)
 {
     ALOGV("autoFocus");
@@ -919,6 +1096,12 @@ static JNINativeMethod camMethods[] = {
   { "_addCallbackBuffer",
     "([BI)V",
     (void *)android_hardware_Camera_addCallbackBuffer },
+  { "_setDirectPreviewFrames",
+    "(ZI)V",
+    (void *)android_hardware_Camera_setDirectPreviewFrames },
+  { "_releasePreviewFrame",
+    "(I)V",
+    (void *)android_hardware_Camera_releasePreviewFrame },
   { "native_autoFocus",
     "()V",
     (void *)android_hardware_Camera_autoFocus },
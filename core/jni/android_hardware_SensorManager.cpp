@@ -18,6 +18,7 @@
 
 #include <utils/Log.h>
 #include <utils/Looper.h>
+#include <utils/threads.h>
 
 #include <gui/Sensor.h>
 #include <gui/SensorManager.h>
@@ -32,10 +33,29 @@ static struct {
     jclass clazz;
     jmethodID dispatchSensorEvent;
     jmethodID dispatchFlushCompleteEvent;
+    jmethodID dispatchSensorEventBatch;
 } gBaseEventQueueClassInfo;
 
 namespace android {
 
+/*
+ * Layout of one event in a batch buffer, in native byte order. Keep in sync
+ * with SystemSensorManager.BaseEventQueue.
+ */
+struct BatchedSensorEvent {
+    int32_t sensor;     // sensor handle
+    int32_t flags;      // BATCHED_EVENT_FLAG_*
+    int32_t status;
+    int32_t reserved;
+    int64_t timestamp;
+    float values[16];
+};
+
+enum {
+    // A flush complete event for |sensor|; the other fields are unused
+    BATCHED_EVENT_FLAG_FLUSH_COMPLETE = 1,
+};
+
 struct SensorOffsets
 {
     jfieldID    name;
@@ -112,6 +132,17 @@ class Receiver : public LooperCallback {
     sp<MessageQueue> mMessageQueue;
     jobject mReceiverObject;
     jfloatArray mScratch;
+    // Direct buffer events are packed into when batching; NULL otherwise.
+    // Only used on the looper thread.
+    jobject mBatchBuffer;
+    BatchedSensorEvent* mBatch;
+    size_t mBatchCapacity;
+    // Buffer set by setBatchBuffer(), swapped in by the looper thread
+    Mutex mPendingLock;
+    bool mPendingSwap;
+    jobject mPendingBuffer;
+    BatchedSensorEvent* mPendingBatch;
+    size_t mPendingCapacity;
 public:
     Receiver(const sp<SensorEventQueue>& sensorQueue,
             const sp<MessageQueue>& messageQueue,
@@ -121,11 +152,52 @@ public:
         mMessageQueue = messageQueue;
         mReceiverObject = env->NewGlobalRef(receiverObject);
         mScratch = (jfloatArray)env->NewGlobalRef(scratch);
+        mBatchBuffer = NULL;
+        mBatch = NULL;
+        mBatchCapacity = 0;
+        mPendingSwap = false;
+        mPendingBuffer = NULL;
+        mPendingBatch = NULL;
+        mPendingCapacity = 0;
     }
     ~Receiver() {
         JNIEnv* env = AndroidRuntime::getJNIEnv();
         env->DeleteGlobalRef(mReceiverObject);
         env->DeleteGlobalRef(mScratch);
+        if (mBatchBuffer != NULL) {
+            env->DeleteGlobalRef(mBatchBuffer);
+        }
+        if (mPendingBuffer != NULL) {
+            env->DeleteGlobalRef(mPendingBuffer);
+        }
+    }
+
+    // Switches between per-event dispatch (buffer NULL) and batched dispatch
+    // into a direct ByteBuffer. Returns false if the buffer can't be used.
+    // The looper thread may be writing into the current buffer, so the new
+    // one only takes over on that thread, before it reads the next events.
+    bool setBatchBuffer(JNIEnv* env, jobject buffer) {
+        BatchedSensorEvent* batch = NULL;
+        size_t capacity = 0;
+        if (buffer != NULL) {
+            batch = reinterpret_cast<BatchedSensorEvent*>(env->GetDirectBufferAddress(buffer));
+            jlong bytes = env->GetDirectBufferCapacity(buffer);
+            if (batch == NULL || bytes < jlong(sizeof(BatchedSensorEvent))
+                    || (uintptr_t(batch) & (sizeof(int64_t) - 1))) {
+                return false;
+            }
+            capacity = size_t(bytes) / sizeof(BatchedSensorEvent);
+        }
+        AutoMutex _l(mPendingLock);
+        // A pending buffer that was never swapped in isn't in use
+        if (mPendingBuffer != NULL) {
+            env->DeleteGlobalRef(mPendingBuffer);
+        }
+        mPendingBuffer = buffer != NULL ? env->NewGlobalRef(buffer) : NULL;
+        mPendingBatch = batch;
+        mPendingCapacity = capacity;
+        mPendingSwap = true;
+        return true;
     }
     sp<SensorEventQueue> getSensorEventQueue() const {
         return mSensorQueue;
@@ -142,39 +214,127 @@ private:
                 ALOOPER_EVENT_INPUT, this, mSensorQueue.get());
     }
 
-    virtual int handleEvent(int fd, int events, void* data) {
-        JNIEnv* env = AndroidRuntime::getJNIEnv();
-        sp<SensorEventQueue> q = reinterpret_cast<SensorEventQueue *>(data);
+    // Takes over the buffer last passed to setBatchBuffer(), on the looper
+    // thread and between batches, when the old buffer is no longer written.
+    void swapBatchBuffer(JNIEnv* env) {
+        AutoMutex _l(mPendingLock);
+        if (!mPendingSwap) {
+            return;
+        }
+        if (mBatchBuffer != NULL) {
+            env->DeleteGlobalRef(mBatchBuffer);
+        }
+        mBatchBuffer = mPendingBuffer;
+        mBatch = mPendingBatch;
+        mBatchCapacity = mPendingCapacity;
+        mPendingBuffer = NULL;
+        mPendingBatch = NULL;
+        mPendingCapacity = 0;
+        mPendingSwap = false;
+    }
+
+    // Drains the queue into the batch buffer, calling Java once per full
+    // buffer and once for the remainder, rather than once per event.
+    int handleEventBatched(JNIEnv* env, const sp<SensorEventQueue>& q) {
         ssize_t n;
         ASensorEvent buffer[16];
+        size_t count = 0;
         while ((n = q->read(buffer, 16)) > 0) {
             for (int i=0 ; i<n ; i++) {
-
-                if (buffer[i].type == SENSOR_TYPE_STEP_COUNTER) {
-                    // step-counter returns a uint64, but the java API only deals with floats
-                    float value = float(buffer[i].u64.step_counter);
-                    env->SetFloatArrayRegion(mScratch, 0, 1, &value);
-                } else {
-                    env->SetFloatArrayRegion(mScratch, 0, 16, buffer[i].data);
+                if (count == 0) {
+                    // Java may have changed the buffer during the last dispatch
+                    swapBatchBuffer(env);
+                    if (mBatch == NULL) {
+                        for (; i < n; i++) {
+                            if (!dispatchEvent(env, buffer[i])) {
+                                return 1;
+                            }
+                        }
+                        return handleEventUnbatched(env, q);
+                    }
                 }
-
+                BatchedSensorEvent& out(mBatch[count++]);
                 if (buffer[i].type == SENSOR_TYPE_META_DATA) {
-                    // This is a flush complete sensor event. Call dispatchFlushCompleteEvent
-                    // method.
-                    env->CallVoidMethod(mReceiverObject,
-                                        gBaseEventQueueClassInfo.dispatchFlushCompleteEvent,
-                                        buffer[i].meta_data.sensor);
+                    out.sensor = buffer[i].meta_data.sensor;
+                    out.flags = BATCHED_EVENT_FLAG_FLUSH_COMPLETE;
+                    out.status = 0;
+                    out.timestamp = 0;
                 } else {
+                    out.sensor = buffer[i].sensor;
+                    out.flags = 0;
+                    out.status = buffer[i].vector.status;
+                    out.timestamp = buffer[i].timestamp;
+                    if (buffer[i].type == SENSOR_TYPE_STEP_COUNTER) {
+                        // step-counter returns a uint64, but the java API only deals with floats
+                        out.values[0] = float(buffer[i].u64.step_counter);
+                    } else {
+                        memcpy(out.values, buffer[i].data, sizeof(out.values));
+                    }
+                }
+                out.reserved = 0;
+
+                if (count == mBatchCapacity) {
                     env->CallVoidMethod(mReceiverObject,
-                                        gBaseEventQueueClassInfo.dispatchSensorEvent,
-                                        buffer[i].sensor,
-                                        mScratch,
-                                        buffer[i].vector.status,
-                                        buffer[i].timestamp);
+                                        gBaseEventQueueClassInfo.dispatchSensorEventBatch,
+                                        jint(count));
+                    count = 0;
+                    if (env->ExceptionCheck()) {
+                        ALOGE("Exception dispatching input event.");
+                        return 1;
+                    }
                 }
+            }
+        }
+
+        if (count > 0) {
+            env->CallVoidMethod(mReceiverObject,
+                                gBaseEventQueueClassInfo.dispatchSensorEventBatch,
+                                jint(count));
+            if (env->ExceptionCheck()) {
+                ALOGE("Exception dispatching input event.");
+            }
+        }
+        return 1;
+    }
+
+    // Calls Java for a single event, returns false if it threw.
+    bool dispatchEvent(JNIEnv* env, const ASensorEvent& event) {
+        if (event.type == SENSOR_TYPE_STEP_COUNTER) {
+            // step-counter returns a uint64, but the java API only deals with floats
+            float value = float(event.u64.step_counter);
+            env->SetFloatArrayRegion(mScratch, 0, 1, &value);
+        } else {
+            env->SetFloatArrayRegion(mScratch, 0, 16, event.data);
+        }
+
+        if (event.type == SENSOR_TYPE_META_DATA) {
+            // This is a flush complete sensor event. Call dispatchFlushCompleteEvent
+            // method.
+            env->CallVoidMethod(mReceiverObject,
+                                gBaseEventQueueClassInfo.dispatchFlushCompleteEvent,
+                                event.meta_data.sensor);
+        } else {
+            env->CallVoidMethod(mReceiverObject,
+                                gBaseEventQueueClassInfo.dispatchSensorEvent,
+                                event.sensor,
+                                mScratch,
+                                event.vector.status,
+                                event.timestamp);
+        }
 
-                if (env->ExceptionCheck()) {
-                    ALOGE("Exception dispatching input event.");
+        if (env->ExceptionCheck()) {
+            ALOGE("Exception dispatching input event.");
+            return false;
+        }
+        return true;
+    }
+
+    int handleEventUnbatched(JNIEnv* env, const sp<SensorEventQueue>& q) {
+        ssize_t n;
+        ASensorEvent buffer[16];
+        while ((n = q->read(buffer, 16)) > 0) {
+            for (int i=0 ; i<n ; i++) {
+                if (!dispatchEvent(env, buffer[i])) {
                     return 1;
                 }
             }
@@ -182,9 +342,18 @@ private:
         if (n<0 && n != -EAGAIN) {
             // FIXME: error receiving events, what to do in this case?
         }
-
         return 1;
     }
+
+    virtual int handleEvent(int fd, int events, void* data) {
+        JNIEnv* env = AndroidRuntime::getJNIEnv();
+        sp<SensorEventQueue> q = reinterpret_cast<SensorEventQueue *>(data);
+        swapBatchBuffer(env);
+        if (mBatch != NULL) {
+            return handleEventBatched(env, q);
+        }
+        return handleEventUnbatched(env, q);
+    }
 };
 
 static jlong nativeInitSensorEventQueue(JNIEnv *env, jclass clazz, jobject eventQ, jobject msgQ, jfloatArray scratch) {
@@ -225,6 +394,14 @@ static jint nativeFlushSensor(JNIEnv *env, jclass clazz, jlong eventQ) {
     return receiver->getSensorEventQueue()->flush();
 }
 
+static void nativeSetBatchBuffer(JNIEnv *env, jclass clazz, jlong eventQ, jobject buffer) {
+    sp<Receiver> receiver(reinterpret_cast<Receiver *>(eventQ));
+    if (!receiver->setBatchBuffer(env, buffer)) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "Batch buffer must be an 8-byte aligned direct buffer of at least one event");
+    }
+}
+
 //----------------------------------------------------------------------------
 
 static JNINativeMethod gSystemSensorManagerMethods[] = {
@@ -257,6 +434,10 @@ static JNINativeMethod gBaseEventQueueMethods[] = {
     {"nativeFlushSensor",
             "(J)I",
             (void*)nativeFlushSensor },
+
+    {"nativeSetBatchBuffer",
+            "(JLjava/nio/ByteBuffer;)V",
+            (void*)nativeSetBatchBuffer },
 };
 
 }; // namespace android
@@ -290,5 +471,9 @@ int register_android_hardware_SensorManager(JNIEnv *env)
                   gBaseEventQueueClassInfo.clazz,
                   "dispatchFlushCompleteEvent", "(I)V");
 
+    GET_METHOD_ID(gBaseEventQueueClassInfo.dispatchSensorEventBatch,
+                  gBaseEventQueueClassInfo.clazz,
+                  "dispatchSensorEventBatch", "(I)V");
+
     return 0;
 }
@@ -25,9 +25,11 @@
 #include <usbhost/usbhost.h>
 
 #include <stdio.h>
+#include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <linux/usbdevice_fs.h>
 
 using namespace android;
 
@@ -189,6 +191,76 @@ android_hardware_UsbDeviceConnection_bulk_request(JNIEnv *env, jobject thiz,
     return result;
 }
 
+// Same as native_bulk_request, but on a direct buffer, so nothing is pinned
+// or copied while the transfer blocks.
+static jint
+android_hardware_UsbDeviceConnection_bulk_request_direct(JNIEnv *env, jobject thiz,
+        jint endpoint, jobject buffer, jint start, jint length, jint timeout)
+{
+    struct usb_device* device = get_device_from_object(env, thiz);
+    if (!device) {
+        ALOGE("device is closed in native_bulk_request_direct");
+        return -1;
+    }
+
+    jbyte* bufferBytes = NULL;
+    if (buffer) {
+        bufferBytes = (jbyte*)env->GetDirectBufferAddress(buffer);
+        if (!bufferBytes || start < 0 || length < 0 ||
+                (jlong)start + length > env->GetDirectBufferCapacity(buffer)) {
+            jniThrowException(env, "java/lang/IllegalArgumentException",
+                    "buffer must be direct and hold start + length bytes");
+            return -1;
+        }
+    }
+
+    return usb_device_bulk_transfer(device, endpoint, bufferBytes + start, length, timeout);
+}
+
+// Reaps a completed request without blocking, mirroring usb_request_wait()
+static struct usb_request* request_reap_nodelay(struct usb_device* device)
+{
+    struct usbdevfs_urb *urb = NULL;
+    if (ioctl(usb_device_get_fd(device), USBDEVFS_REAPURBNDELAY, &urb) < 0) {
+        return NULL;
+    }
+    struct usb_request* request = (struct usb_request*)urb->usercontext;
+    request->actual_length = urb->actual_length;
+    return request;
+}
+
+/*
+ * Blocks for the first completed request, then collects any others that
+ * have already completed, up to the size of the array. Returns the number
+ * of requests stored.
+ */
+static jint
+android_hardware_UsbDeviceConnection_request_wait_batch(JNIEnv *env, jobject thiz,
+        jobjectArray completed)
+{
+    struct usb_device* device = get_device_from_object(env, thiz);
+    if (!device) {
+        ALOGE("device is closed in native_request_wait_batch");
+        return -1;
+    }
+
+    jsize max = env->GetArrayLength(completed);
+    if (max == 0) {
+        return 0;
+    }
+
+    struct usb_request* request = usb_request_wait(device);
+    jint count = 0;
+    while (request) {
+        env->SetObjectArrayElement(completed, count++, (jobject)request->client_data);
+        if (count == max) {
+            break;
+        }
+        request = request_reap_nodelay(device);
+    }
+    return count;
+}
+
 static jobject
 android_hardware_UsbDeviceConnection_request_wait(JNIEnv *env, jobject thiz)
 {
@@ -233,8 +305,12 @@ static JNINativeMethod method_table[] = {
                                         (void *)android_hardware_UsbDeviceConnection_control_request},
     {"native_bulk_request",     "(I[BIII)I",
                                         (void *)android_hardware_UsbDeviceConnection_bulk_request},
+    {"native_bulk_request_direct", "(ILjava/nio/ByteBuffer;III)I",
+                                        (void *)android_hardware_UsbDeviceConnection_bulk_request_direct},
     {"native_request_wait",             "()Landroid/hardware/usb/UsbRequest;",
                                         (void *)android_hardware_UsbDeviceConnection_request_wait},
+    {"native_request_wait_batch", "([Landroid/hardware/usb/UsbRequest;)I",
+                                        (void *)android_hardware_UsbDeviceConnection_request_wait_batch},
     { "native_get_serial",      "()Ljava/lang/String;",
                                         (void*)android_hardware_UsbDeviceConnection_get_serial },
 };
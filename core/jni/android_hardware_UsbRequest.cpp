@@ -134,8 +134,7 @@ android_hardware_UsbRequest_dequeue_array(JNIEnv *env, jobject thiz,
 }
 
 static jboolean
-android_hardware_UsbRequest_queue_direct(JNIEnv *env, jobject thiz,
-        jobject buffer, jint length, jboolean out)
+queue_direct(JNIEnv *env, jobject thiz, jobject buffer, jint length)
 {
     struct usb_request* request = get_request_from_object(env, thiz);
     if (!request) {
@@ -164,6 +163,49 @@ android_hardware_UsbRequest_queue_direct(JNIEnv *env, jobject thiz,
     }
 }
 
+static jboolean
+android_hardware_UsbRequest_queue_direct(JNIEnv *env, jobject thiz,
+        jobject buffer, jint length, jboolean out)
+{
+    return queue_direct(env, thiz, buffer, length);
+}
+
+/*
+ * Queues requests[i] on buffers[i] for lengths[i] bytes, all in one
+ * crossing, so a stream can keep many URBs in flight. Stops at the first
+ * request that can't be queued and returns how many were.
+ */
+static jint
+android_hardware_UsbRequest_queue_direct_batch(JNIEnv *env, jclass clazz,
+        jobjectArray requests, jobjectArray buffers, jintArray lengths, jboolean out)
+{
+    jsize count = env->GetArrayLength(requests);
+    if (env->GetArrayLength(buffers) < count || env->GetArrayLength(lengths) < count) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "buffers and lengths must cover every request");
+        return -1;
+    }
+
+    jint* lengthValues = env->GetIntArrayElements(lengths, NULL);
+    if (lengthValues == NULL) {
+        // OutOfMemoryError is pending
+        return 0;
+    }
+    jint queued = 0;
+    for (; queued < count; queued++) {
+        jobject request = env->GetObjectArrayElement(requests, queued);
+        jobject buffer = env->GetObjectArrayElement(buffers, queued);
+        jboolean ok = request && queue_direct(env, request, buffer, lengthValues[queued]);
+        env->DeleteLocalRef(buffer);
+        env->DeleteLocalRef(request);
+        if (!ok) {
+            break;
+        }
+    }
+    env->ReleaseIntArrayElements(lengths, lengthValues, JNI_ABORT);
+    return queued;
+}
+
 static jint
 android_hardware_UsbRequest_dequeue_direct(JNIEnv *env, jobject thiz)
 {
@@ -196,6 +238,8 @@ static JNINativeMethod method_table[] = {
     {"native_dequeue_array",    "([BIZ)I",  (void *)android_hardware_UsbRequest_dequeue_array},
     {"native_queue_direct",     "(Ljava/nio/ByteBuffer;IZ)Z",
                                             (void *)android_hardware_UsbRequest_queue_direct},
+    {"native_queue_direct_batch", "([Landroid/hardware/usb/UsbRequest;[Ljava/nio/ByteBuffer;[IZ)I",
+                                            (void *)android_hardware_UsbRequest_queue_direct_batch},
     {"native_dequeue_direct",   "()I",      (void *)android_hardware_UsbRequest_dequeue_direct},
     {"native_cancel",           "()Z",      (void *)android_hardware_UsbRequest_cancel},
 };
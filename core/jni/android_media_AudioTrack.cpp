@@ -316,7 +316,8 @@ android_media_AudioTrack_native_setup(JNIEnv *env, jobject thiz, jobject weak_th
             0,// notificationFrames == 0 since not using EVENT_MORE_DATA to feed the AudioTrack
             0,// shared mem
             true,// thread can call Java
-            sessionId);// audio session ID
+            sessionId,// audio session ID
+            AudioTrack::TRANSFER_OBTAIN);// data written by writeToTrack()
         break;
 
     case MODE_STATIC:
@@ -507,13 +508,50 @@ static void android_media_AudioTrack_native_finalize(JNIEnv *env,  jobject thiz)
 }
 
 // ----------------------------------------------------------------------------
-jint writeToTrack(const sp<AudioTrack>& track, jint audioFormat, jbyte* data,
-                  jint offsetInBytes, jint sizeInBytes) {
+// Copies whole frames of data into a streaming track, which is created with
+// TRANSFER_OBTAIN, expanding 8 bit data to the 16 bit samples of the track.
+// Unless blocking, stops as soon as the track has no room left. Returns the
+// number of bytes of data copied, which may be 0, or an error if nothing could
+// be copied.
+static ssize_t writeObtained(const sp<AudioTrack>& track, jint audioFormat, const jbyte* data,
+        size_t size, bool blocking) {
+    const bool expand = audioFormat == ENCODING_PCM_8BIT;
+    const size_t frameSize = track->frameSize();
+    size_t written = 0;
+    while (size - written >= frameSize) {
+        AudioTrack::Buffer buffer;
+        buffer.frameCount = (size - written) / frameSize;
+        status_t err = track->obtainBuffer(&buffer, blocking ? -1 : 0 /*waitCount*/);
+        if (err != NO_ERROR) {
+            if (written == 0 && err != WOULD_BLOCK) {
+                return err;
+            }
+            break;
+        }
+        if (expand) {
+            const size_t count = buffer.size / sizeof(int16_t);
+            const int8_t* src = (const int8_t*) data + written;
+            for (size_t i = 0; i < count; i++) {
+                buffer.i16[i] = (int16_t)(src[i] ^ 0x80) << 8;
+            }
+            written += count;
+        } else {
+            memcpy(buffer.raw, data + written, buffer.size);
+            written += buffer.size;
+        }
+        track->releaseBuffer(&buffer);
+    }
+    return written;
+}
+
+jint writeToTrack(const sp<AudioTrack>& track, jint audioFormat, const jbyte* data,
+                  jint offsetInBytes, jint sizeInBytes, bool blocking = true) {
     // give the data to the native AudioTrack object (the data starts at the offset)
     ssize_t written = 0;
-    // regular write() or copy the data to the AudioTrack's shared memory?
+    // stream the data or copy it to the AudioTrack's shared memory?
     if (track->sharedBuffer() == 0) {
-        written = track->write(data + offsetInBytes, sizeInBytes);
+        written = writeObtained(track, audioFormat, data + offsetInBytes, sizeInBytes,
+                blocking);
         // for compatibility with earlier behavior of write(), return 0 in this case
         if (written == (ssize_t) WOULD_BLOCK) {
             written = 0;
@@ -579,6 +617,12 @@ static jint android_media_AudioTrack_native_write_byte(JNIEnv *env,  jobject thi
         ALOGE("NULL java array of audio data to play, can't play");
         return 0;
     }
+    if (offsetInBytes < 0 || sizeInBytes < 0
+            || offsetInBytes > env->GetArrayLength(javaAudioData) - sizeInBytes) {
+        ALOGE("Invalid range of audio data to play, can't play");
+        env->ReleaseByteArrayElements(javaAudioData, cAudioData, JNI_ABORT);
+        return (jint) AUDIOTRACK_ERROR_BAD_VALUE;
+    }
 
     jint written = writeToTrack(lpTrack, javaAudioFormat, cAudioData, offsetInBytes, sizeInBytes);
 
@@ -606,6 +650,96 @@ static jint android_media_AudioTrack_native_write_short(JNIEnv *env,  jobject th
 }
 
 
+// ----------------------------------------------------------------------------
+// Writes from a direct ByteBuffer straight into the track, without copying the
+// audio data through a Java array.
+static jint android_media_AudioTrack_native_write_native_bytes(JNIEnv *env,  jobject thiz,
+                                                  jobject javaByteBuffer,
+                                                  jint byteOffset, jint sizeInBytes,
+                                                  jint javaAudioFormat, jboolean isWriteBlocking) {
+    sp<AudioTrack> lpTrack = getAudioTrack(env, thiz);
+    if (lpTrack == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException",
+            "Unable to retrieve AudioTrack pointer for write()");
+        return 0;
+    }
+
+    const jbyte* data = (const jbyte*) env->GetDirectBufferAddress(javaByteBuffer);
+    const jlong capacity = env->GetDirectBufferCapacity(javaByteBuffer);
+    if (data == NULL || capacity < 0) {
+        ALOGE("Buffer for AudioTrack.write() is not a direct buffer");
+        return (jint) AUDIOTRACK_ERROR_BAD_VALUE;
+    }
+    if (byteOffset < 0 || sizeInBytes < 0 || (jlong) byteOffset + sizeInBytes > capacity) {
+        return (jint) AUDIOTRACK_ERROR_BAD_VALUE;
+    }
+
+    return writeToTrack(lpTrack, javaAudioFormat, data, byteOffset, sizeInBytes,
+            isWriteBlocking == JNI_TRUE);
+}
+
+// ----------------------------------------------------------------------------
+// Writes float samples in [-1, 1] to a 16 bit track, converting them directly
+// into the track buffer. Returns the number of floats written.
+static jint android_media_AudioTrack_native_write_float(JNIEnv *env,  jobject thiz,
+                                                  jfloatArray javaAudioData,
+                                                  jint offsetInFloats, jint sizeInFloats,
+                                                  jint javaAudioFormat, jboolean isWriteBlocking) {
+    sp<AudioTrack> lpTrack = getAudioTrack(env, thiz);
+    if (lpTrack == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException",
+            "Unable to retrieve AudioTrack pointer for write()");
+        return 0;
+    }
+    if (lpTrack->sharedBuffer() != 0 || lpTrack->format() != AUDIO_FORMAT_PCM_16_BIT) {
+        ALOGE("AudioTrack.write(float[]) needs a streaming 16 bit track");
+        return (jint) AUDIOTRACK_ERROR_BAD_VALUE;
+    }
+    if (javaAudioData == NULL) {
+        ALOGE("NULL java array of audio data to play, can't play");
+        return 0;
+    }
+    if (offsetInFloats < 0 || sizeInFloats < 0
+            || offsetInFloats > env->GetArrayLength(javaAudioData) - sizeInFloats) {
+        ALOGE("Invalid range of audio data to play, can't play");
+        return (jint) AUDIOTRACK_ERROR_BAD_VALUE;
+    }
+
+    jfloat* cAudioData = env->GetFloatArrayElements(javaAudioData, NULL);
+    if (cAudioData == NULL) {
+        ALOGE("Error retrieving source of audio data to play, can't play");
+        return 0; // out of memory or no data to load
+    }
+
+    const jfloat* src = cAudioData + offsetInFloats;
+    const size_t channelCount = lpTrack->channelCount();
+    size_t remaining = sizeInFloats - sizeInFloats % channelCount;
+    jint written = 0;
+    while (remaining > 0) {
+        AudioTrack::Buffer buffer;
+        buffer.frameCount = remaining / channelCount;
+        status_t err = lpTrack->obtainBuffer(&buffer, isWriteBlocking ? -1 : 0);
+        if (err != NO_ERROR) {
+            if (written == 0 && err != WOULD_BLOCK) {
+                written = (jint) AUDIOTRACK_ERROR;
+            }
+            break;
+        }
+        const size_t count = buffer.frameCount * channelCount;
+        for (size_t i = 0; i < count; i++) {
+            float f = src[i] * 32768.0f;
+            buffer.i16[i] = f >= 32767.0f ? 32767 : f <= -32768.0f ? -32768 : (int16_t) f;
+        }
+        lpTrack->releaseBuffer(&buffer);
+        src += count;
+        remaining -= count;
+        written += count;
+    }
+
+    env->ReleaseFloatArrayElements(javaAudioData, cAudioData, JNI_ABORT);
+    return written;
+}
+
 // ----------------------------------------------------------------------------
 static jint android_media_AudioTrack_get_native_frame_count(JNIEnv *env,  jobject thiz) {
     sp<AudioTrack> lpTrack = getAudioTrack(env, thiz);
@@ -877,6 +1011,11 @@ static JNINativeMethod gMethods[] = {
     {"native_release",       "()V",      (void *)android_media_AudioTrack_native_release},
     {"native_write_byte",    "([BIII)I", (void *)android_media_AudioTrack_native_write_byte},
     {"native_write_short",   "([SIII)I", (void *)android_media_AudioTrack_native_write_short},
+    {"native_write_native_bytes",
+                             "(Ljava/lang/Object;IIIZ)I",
+                                         (void *)android_media_AudioTrack_native_write_native_bytes},
+    {"native_write_float",   "([FIIIZ)I",
+                                         (void *)android_media_AudioTrack_native_write_float},
     {"native_setVolume",     "(FF)V",    (void *)android_media_AudioTrack_set_volume},
     {"native_get_native_frame_count",
                              "()I",      (void *)android_media_AudioTrack_get_native_frame_count},
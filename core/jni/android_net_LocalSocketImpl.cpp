@@ -32,6 +32,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 
 #include <cutils/sockets.h>
 #include <netinet/tcp.h>
@@ -43,8 +44,15 @@ static jfieldID field_inboundFileDescriptors;
 static jfieldID field_outboundFileDescriptors;
 static jclass class_Credentials;
 static jclass class_FileDescriptor;
+static jclass class_byteArray;
 static jmethodID method_CredentialsInit;
 
+// Most buffers passed to a single scatter or gather call, UIO_MAXIOV
+#define MAX_IOVECS 1024
+
+// Writes of at most this many bytes are copied instead of pinning the array
+#define MAX_COPIED_WRITE 512
+
 /* private native void connectLocal(FileDescriptor fd,
  * String name, int namespace) throws IOException
  */
@@ -482,32 +490,25 @@ static int socket_process_cmsg(JNIEnv *env, jobject thisJ, struct msghdr * pMsg)
 }
 
 /**
- * Reads data from a socket into buf, processing any ancillary data
- * and adding it to thisJ.
+ * Reads data from a socket into the specified buffers, in order,
+ * processing any ancillary data and adding it to thisJ.
  *
  * Returns the length of normal data read, or -1 if an exception has
  * been thrown in this function.
  */
-static ssize_t socket_read_all(JNIEnv *env, jobject thisJ, int fd,
-        void *buffer, size_t len)
+static ssize_t socket_readv_all(JNIEnv *env, jobject thisJ, int fd,
+        struct iovec *iov, int iovcnt)
 {
     ssize_t ret;
-    ssize_t bytesread = 0;
     struct msghdr msg;
-    struct iovec iv;
-    unsigned char *buf = (unsigned char *)buffer;
     // Enough buffer for a pile of fd's. We throw an exception if
     // this buffer is too small.
     struct cmsghdr cmsgbuf[2*sizeof(cmsghdr) + 0x100];
 
     memset(&msg, 0, sizeof(msg));
-    memset(&iv, 0, sizeof(iv));
-
-    iv.iov_base = buf;
-    iv.iov_len = len;
 
-    msg.msg_iov = &iv;
-    msg.msg_iovlen = 1;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
     msg.msg_control = cmsgbuf;
     msg.msg_controllen = sizeof(cmsgbuf);
 
@@ -542,18 +543,41 @@ static ssize_t socket_read_all(JNIEnv *env, jobject thisJ, int fd,
 }
 
 /**
- * Writes all the data in the specified buffer to the specified socket.
+ * Reads data from a socket into buf, processing any ancillary data
+ * and adding it to thisJ.
+ *
+ * Returns the length of normal data read, or -1 if an exception has
+ * been thrown in this function.
+ */
+static ssize_t socket_read_all(JNIEnv *env, jobject thisJ, int fd,
+        void *buffer, size_t len)
+{
+    struct iovec iv;
+
+    iv.iov_base = buffer;
+    iv.iov_len = len;
+
+    return socket_readv_all(env, thisJ, fd, &iv, 1);
+}
+
+/**
+ * Writes all the data in the specified buffers, in order, to the
+ * specified socket. The buffers are updated to skip what was written.
  *
  * Returns 0 on success or -1 if an exception was thrown.
  */
-static int socket_write_all(JNIEnv *env, jobject object, int fd,
-        void *buf, size_t len)
+static int socket_writev_all(JNIEnv *env, jobject object, int fd,
+        struct iovec *iov, int iovcnt)
 {
     ssize_t ret;
     struct msghdr msg;
-    unsigned char *buffer = (unsigned char *)buf;
+    size_t len = 0;
     memset(&msg, 0, sizeof(msg));
 
+    for (int i = 0; i < iovcnt; i++) {
+        len += iov[i].iov_len;
+    }
+
     jobjectArray outboundFds
             = (jobjectArray)env->GetObjectField(
                 object, field_outboundFileDescriptors);
@@ -598,14 +622,8 @@ static int socket_write_all(JNIEnv *env, jobject object, int fd,
 
     // We only write our msg_control during the first write
     while (len > 0) {
-        struct iovec iv;
-        memset(&iv, 0, sizeof(iv));
-
-        iv.iov_base = buffer;
-        iv.iov_len = len;
-
-        msg.msg_iov = &iv;
-        msg.msg_iovlen = 1;
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
 
         do {
             ret = sendmsg(fd, &msg, MSG_NOSIGNAL);
@@ -616,9 +634,19 @@ static int socket_write_all(JNIEnv *env, jobject object, int fd,
             return -1;
         }
 
-        buffer += ret;
         len -= ret;
 
+        // Skip the buffers that were written entirely
+        while (iovcnt > 0 && (size_t)ret >= iov->iov_len) {
+            ret -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (unsigned char *)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+
         // Wipes out any msg_control too
         memset(&msg, 0, sizeof(msg));
     }
@@ -626,6 +654,22 @@ static int socket_write_all(JNIEnv *env, jobject object, int fd,
     return 0;
 }
 
+/**
+ * Writes all the data in the specified buffer to the specified socket.
+ *
+ * Returns 0 on success or -1 if an exception was thrown.
+ */
+static int socket_write_all(JNIEnv *env, jobject object, int fd,
+        void *buf, size_t len)
+{
+    struct iovec iv;
+
+    iv.iov_base = buf;
+    iv.iov_len = len;
+
+    return socket_writev_all(env, object, fd, &iv, 1);
+}
+
 static jint socket_read (JNIEnv *env, jobject object, jobject fileDescriptor)
 {
     int fd;
@@ -749,6 +793,14 @@ static void socket_writeba (JNIEnv *env, jobject object,
         return;
     }
 
+    // Most writes are small commands, copying them is cheaper
+    if (len <= MAX_COPIED_WRITE) {
+        jbyte copy[MAX_COPIED_WRITE];
+        env->GetByteArrayRegion(buffer, off, len, copy);
+        socket_write_all(env, object, fd, copy, len);
+        return;
+    }
+
     byteBuffer = env->GetByteArrayElements(buffer,NULL);
 
     if (NULL == byteBuffer) {
@@ -764,6 +816,428 @@ static void socket_writeba (JNIEnv *env, jobject object,
     env->ReleaseByteArrayElements(buffer, byteBuffer, JNI_ABORT);
 }
 
+/**
+ * Returns the address of the specified range of a direct buffer, or NULL
+ * if an exception was thrown.
+ */
+static unsigned char *socket_direct_buffer_range(JNIEnv *env,
+        jobject buffer, jint off, jint len)
+{
+    unsigned char *address = (unsigned char *)env->GetDirectBufferAddress(buffer);
+
+    if (address == NULL) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "not a direct buffer");
+        return NULL;
+    }
+
+    if (off < 0 || len < 0 || (off + len) > env->GetDirectBufferCapacity(buffer)) {
+        jniThrowException(env, "java/lang/IndexOutOfBoundsException", NULL);
+        return NULL;
+    }
+
+    return address + off;
+}
+
+static jint socket_read_direct (JNIEnv *env, jobject object,
+        jobject buffer, jint off, jint len, jobject fileDescriptor)
+{
+    int fd;
+    ssize_t ret;
+    unsigned char *address;
+
+    if (fileDescriptor == NULL || buffer == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return (jint)-1;
+    }
+
+    address = socket_direct_buffer_range(env, buffer, off, len);
+
+    if (address == NULL) {
+        return (jint)-1;
+    }
+
+    if (len == 0) {
+        // because socket_read_all returns 0 on EOF
+        return 0;
+    }
+
+    fd = jniGetFDFromFileDescriptor(env, fileDescriptor);
+
+    if (env->ExceptionOccurred() != NULL) {
+        return (jint)-1;
+    }
+
+    ret = socket_read_all(env, object, fd, address, len);
+
+    // A return of -1 above means an exception is pending
+
+    return (jint) ((ret == 0) ? -1 : ret);
+}
+
+static void socket_write_direct (JNIEnv *env, jobject object,
+        jobject buffer, jint off, jint len, jobject fileDescriptor)
+{
+    int fd;
+    unsigned char *address;
+
+    if (fileDescriptor == NULL || buffer == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return;
+    }
+
+    address = socket_direct_buffer_range(env, buffer, off, len);
+
+    if (address == NULL) {
+        return;
+    }
+
+    fd = jniGetFDFromFileDescriptor(env, fileDescriptor);
+
+    if (env->ExceptionOccurred() != NULL) {
+        return;
+    }
+
+    socket_write_all(env, object, fd, address, len);
+
+    // A return of -1 above means an exception is pending
+}
+
+/**
+ * Fills iov with the specified ranges of buffers, each either a byte[] or
+ * a direct java.nio.ByteBuffer. Byte arrays are pinned, the elements are
+ * stored in pinned, which must be cleared by the caller, and must be
+ * released with socket_release_buffers() even if an exception was thrown.
+ *
+ * Returns the number of buffers, or -1 if an exception was thrown.
+ */
+static int socket_get_buffers(JNIEnv *env, jobjectArray buffers,
+        jintArray offsets, jintArray lengths, struct iovec *iov, jbyte **pinned)
+{
+    if (buffers == NULL || offsets == NULL || lengths == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return -1;
+    }
+
+    int count = env->GetArrayLength(buffers);
+
+    if (count > MAX_IOVECS) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "too many buffers");
+        return -1;
+    }
+
+    if (env->GetArrayLength(offsets) < count || env->GetArrayLength(lengths) < count) {
+        jniThrowException(env, "java/lang/ArrayIndexOutOfBoundsException", NULL);
+        return -1;
+    }
+
+    jint off[count];
+    jint len[count];
+    env->GetIntArrayRegion(offsets, 0, count, off);
+    env->GetIntArrayRegion(lengths, 0, count, len);
+
+    for (int i = 0; i < count; i++) {
+        jobject buffer = env->GetObjectArrayElement(buffers, i);
+
+        if (buffer == NULL) {
+            jniThrowNullPointerException(env, NULL);
+            return -1;
+        }
+
+        if (env->IsInstanceOf(buffer, class_byteArray)) {
+            jbyteArray array = (jbyteArray)buffer;
+
+            if (off[i] < 0 || len[i] < 0 || (off[i] + len[i]) > env->GetArrayLength(array)) {
+                jniThrowException(env, "java/lang/ArrayIndexOutOfBoundsException", NULL);
+                return -1;
+            }
+
+            pinned[i] = env->GetByteArrayElements(array, NULL);
+
+            if (pinned[i] == NULL) {
+                // an exception will have been thrown
+                return -1;
+            }
+
+            iov[i].iov_base = pinned[i] + off[i];
+        } else {
+            iov[i].iov_base = socket_direct_buffer_range(env, buffer, off[i], len[i]);
+
+            if (iov[i].iov_base == NULL) {
+                return -1;
+            }
+        }
+        iov[i].iov_len = len[i];
+
+        env->DeleteLocalRef(buffer);
+    }
+
+    return count;
+}
+
+static void socket_release_buffers(JNIEnv *env, jobjectArray buffers,
+        jbyte **pinned, int count, jint mode)
+{
+    for (int i = 0; i < count; i++) {
+        if (pinned[i] != NULL) {
+            jbyteArray array = (jbyteArray)env->GetObjectArrayElement(buffers, i);
+            env->ReleaseByteArrayElements(array, pinned[i], mode);
+            env->DeleteLocalRef(array);
+        }
+    }
+}
+
+/**
+ * Reads into several buffers with a single recvmsg() call. Returns the
+ * total number of bytes read, or -1 at the end of the stream.
+ */
+static jint socket_readv (JNIEnv *env, jobject object,
+        jobjectArray buffers, jintArray offsets, jintArray lengths,
+        jobject fileDescriptor)
+{
+    int fd;
+    ssize_t ret;
+
+    if (fileDescriptor == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return (jint)-1;
+    }
+
+    fd = jniGetFDFromFileDescriptor(env, fileDescriptor);
+
+    if (env->ExceptionOccurred() != NULL) {
+        return (jint)-1;
+    }
+
+    int count = buffers != NULL ? env->GetArrayLength(buffers) : 0;
+    if (count > MAX_IOVECS) {
+        count = MAX_IOVECS;
+    }
+    struct iovec iov[count > 0 ? count : 1];
+    jbyte *pinned[count > 0 ? count : 1];
+    memset(pinned, 0, sizeof(pinned));
+
+    ret = socket_get_buffers(env, buffers, offsets, lengths, iov, pinned);
+
+    if (ret > 0) {
+        size_t len = 0;
+        for (int i = 0; i < count; i++) {
+            len += iov[i].iov_len;
+        }
+
+        // because socket_readv_all returns 0 on EOF
+        ret = len > 0 ? socket_readv_all(env, object, fd, iov, count) : 0;
+        ret = (len > 0 && ret == 0) ? -1 : ret;
+    }
+
+    // A return of -1 above means an exception is pending
+
+    socket_release_buffers(env, buffers, pinned, count, 0);
+
+    return (jint)ret;
+}
+
+/**
+ * Writes several buffers, in order, with as few sendmsg() calls as
+ * possible.
+ */
+static void socket_writev (JNIEnv *env, jobject object,
+        jobjectArray buffers, jintArray offsets, jintArray lengths,
+        jobject fileDescriptor)
+{
+    int fd;
+
+    if (fileDescriptor == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return;
+    }
+
+    fd = jniGetFDFromFileDescriptor(env, fileDescriptor);
+
+    if (env->ExceptionOccurred() != NULL) {
+        return;
+    }
+
+    int count = buffers != NULL ? env->GetArrayLength(buffers) : 0;
+    if (count > MAX_IOVECS) {
+        count = MAX_IOVECS;
+    }
+    struct iovec iov[count > 0 ? count : 1];
+    jbyte *pinned[count > 0 ? count : 1];
+    memset(pinned, 0, sizeof(pinned));
+
+    if (socket_get_buffers(env, buffers, offsets, lengths, iov, pinned) > 0) {
+        socket_writev_all(env, object, fd, iov, count);
+    }
+
+    // A return of -1 above means an exception is pending
+
+    socket_release_buffers(env, buffers, pinned, count, JNI_ABORT);
+}
+
+/*
+ * Write coalescing buffer. Writes are accumulated natively and sent
+ * with a single sendmsg() once the buffer is full or flushed, instead
+ * of one system call per write. Outbound file descriptors are attached
+ * to the data when it is sent.
+ */
+struct socket_write_buffer {
+    size_t capacity;
+    size_t length;
+    unsigned char data[0];
+};
+
+static jlong socket_create_write_buffer (JNIEnv *env, jobject object,
+        jint capacity)
+{
+    if (capacity <= 0) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return 0;
+    }
+
+    socket_write_buffer *buffer = (socket_write_buffer *)malloc(
+            sizeof(socket_write_buffer) + capacity);
+
+    if (buffer == NULL) {
+        jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
+        return 0;
+    }
+
+    buffer->capacity = capacity;
+    buffer->length = 0;
+
+    return reinterpret_cast<jlong>(buffer);
+}
+
+/**
+ * Frees a write buffer. Data that was not flushed is discarded.
+ */
+static void socket_destroy_write_buffer (JNIEnv *env, jobject object,
+        jlong bufferPtr)
+{
+    free(reinterpret_cast<socket_write_buffer *>(bufferPtr));
+}
+
+/**
+ * Sends the content of the write buffer, followed by the specified data.
+ *
+ * Returns 0 on success or -1 if an exception was thrown. The buffer is
+ * emptied in both cases.
+ */
+static int socket_flush_write_buffer(JNIEnv *env, jobject object, int fd,
+        socket_write_buffer *buffer, void *data, size_t len)
+{
+    struct iovec iov[2];
+    int iovcnt = 0;
+
+    if (buffer->length > 0) {
+        iov[iovcnt].iov_base = buffer->data;
+        iov[iovcnt].iov_len = buffer->length;
+        iovcnt++;
+    }
+    if (len > 0) {
+        iov[iovcnt].iov_base = data;
+        iov[iovcnt].iov_len = len;
+        iovcnt++;
+    }
+
+    buffer->length = 0;
+
+    return iovcnt > 0 ? socket_writev_all(env, object, fd, iov, iovcnt) : 0;
+}
+
+static void socket_flush (JNIEnv *env, jobject object,
+        jlong bufferPtr, jobject fileDescriptor)
+{
+    socket_write_buffer *buffer = reinterpret_cast<socket_write_buffer *>(bufferPtr);
+    int fd;
+
+    if (fileDescriptor == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return;
+    }
+
+    if (buffer->length == 0) {
+        return;
+    }
+
+    fd = jniGetFDFromFileDescriptor(env, fileDescriptor);
+
+    if (env->ExceptionOccurred() != NULL) {
+        return;
+    }
+
+    socket_flush_write_buffer(env, object, fd, buffer, NULL, 0);
+
+    // A return of -1 above means an exception is pending
+}
+
+static void socket_write_buffered (JNIEnv *env, jobject object,
+        jlong bufferPtr, jint b, jobject fileDescriptor)
+{
+    socket_write_buffer *buffer = reinterpret_cast<socket_write_buffer *>(bufferPtr);
+
+    buffer->data[buffer->length++] = (unsigned char)b;
+
+    if (buffer->length == buffer->capacity) {
+        socket_flush(env, object, bufferPtr, fileDescriptor);
+    }
+}
+
+static void socket_writeba_buffered (JNIEnv *env, jobject object,
+        jlong bufferPtr, jbyteArray array, jint off, jint len, jobject fileDescriptor)
+{
+    socket_write_buffer *buffer = reinterpret_cast<socket_write_buffer *>(bufferPtr);
+    int fd;
+    jbyte* byteBuffer;
+
+    if (fileDescriptor == NULL || array == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return;
+    }
+
+    if (off < 0 || len < 0 || (off + len) > env->GetArrayLength(array)) {
+        jniThrowException(env, "java/lang/ArrayIndexOutOfBoundsException", NULL);
+        return;
+    }
+
+    // Copy what fits, flushing when the buffer fills up
+    if ((size_t)len < buffer->capacity) {
+        if (buffer->length + len > buffer->capacity) {
+            socket_flush(env, object, bufferPtr, fileDescriptor);
+
+            if (env->ExceptionOccurred() != NULL) {
+                return;
+            }
+        }
+
+        env->GetByteArrayRegion(array, off, len, (jbyte *)buffer->data + buffer->length);
+        buffer->length += len;
+        return;
+    }
+
+    // Large writes are sent right away, along with the buffered data
+    fd = jniGetFDFromFileDescriptor(env, fileDescriptor);
+
+    if (env->ExceptionOccurred() != NULL) {
+        return;
+    }
+
+    byteBuffer = env->GetByteArrayElements(array, NULL);
+
+    if (NULL == byteBuffer) {
+        // an exception will have been thrown
+        return;
+    }
+
+    socket_flush_write_buffer(env, object, fd, buffer, byteBuffer + off, len);
+
+    // A return of -1 above means an exception is pending
+
+    env->ReleaseByteArrayElements(array, byteBuffer, JNI_ABORT);
+}
+
 static jobject socket_get_peer_credentials(JNIEnv *env,
         jobject object, jobject fileDescriptor)
 {
@@ -871,6 +1345,21 @@ static JNINativeMethod gMethods[] = {
     {"readba_native", "([BIILjava/io/FileDescriptor;)I", (void*) socket_readba},
     {"writeba_native", "([BIILjava/io/FileDescriptor;)V", (void*) socket_writeba},
     {"write_native", "(ILjava/io/FileDescriptor;)V", (void*) socket_write},
+    {"readDirect_native", "(Ljava/nio/ByteBuffer;IILjava/io/FileDescriptor;)I",
+            (void*) socket_read_direct},
+    {"writeDirect_native", "(Ljava/nio/ByteBuffer;IILjava/io/FileDescriptor;)V",
+            (void*) socket_write_direct},
+    {"readv_native", "([Ljava/lang/Object;[I[ILjava/io/FileDescriptor;)I",
+            (void*) socket_readv},
+    {"writev_native", "([Ljava/lang/Object;[I[ILjava/io/FileDescriptor;)V",
+            (void*) socket_writev},
+    {"createWriteBuffer_native", "(I)J", (void*) socket_create_write_buffer},
+    {"destroyWriteBuffer_native", "(J)V", (void*) socket_destroy_write_buffer},
+    {"writeBuffered_native", "(JILjava/io/FileDescriptor;)V",
+            (void*) socket_write_buffered},
+    {"writebaBuffered_native", "(J[BIILjava/io/FileDescriptor;)V",
+            (void*) socket_writeba_buffered},
+    {"flush_native", "(JLjava/io/FileDescriptor;)V", (void*) socket_flush},
     {"getPeerCredentials_native",
             "(Ljava/io/FileDescriptor;)Landroid/net/Credentials;",
             (void*) socket_get_peer_credentials}
@@ -919,6 +1408,14 @@ int register_android_net_LocalSocketImpl(JNIEnv *env)
 
     class_FileDescriptor = (jclass)env->NewGlobalRef(class_FileDescriptor);
 
+    class_byteArray = env->FindClass("[B");
+
+    if (class_byteArray == NULL) {
+        goto error;
+    }
+
+    class_byteArray = (jclass)env->NewGlobalRef(class_byteArray);
+
     method_CredentialsInit
             = env->GetMethodID(class_Credentials, "<init>", "(III)V");
 
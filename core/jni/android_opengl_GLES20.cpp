@@ -107,6 +107,15 @@ getPointer(JNIEnv *_env, jobject buffer, jarray *array, jint *remaining, jint *o
     limit = _env->GetIntField(buffer, limitID);
     elementSizeShift = _env->GetIntField(buffer, elementSizeShiftID);
     *remaining = (limit - position) << elementSizeShift;
+
+    /* Direct buffers resolve without calling back into NIOAccess; only
+     * array-backed buffers need the static Java helpers. */
+    char *address = (char *) _env->GetDirectBufferAddress(buffer);
+    if (address != NULL) {
+        *array = NULL;
+        return (void *) (address + (position << elementSizeShift));
+    }
+
     pointer = _env->CallStaticLongMethod(nioAccessClass,
             getBasePointerID, buffer);
     if (pointer != 0L) {
@@ -6027,6 +6036,197 @@ android_glViewport__IIII
     );
 }
 
+/* Opcodes for glExecuteCommands. Each command is an opcode word followed by
+ * its arguments, one 32-bit word each in native order; float arguments are
+ * passed as their raw bits. Buffer offsets refer to the currently bound
+ * GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER. Values must stay stable. */
+enum {
+    CMD_ACTIVE_TEXTURE = 1,                 // texture
+    CMD_BIND_BUFFER = 2,                    // target, buffer
+    CMD_BIND_FRAMEBUFFER = 3,               // target, framebuffer
+    CMD_BIND_TEXTURE = 4,                   // target, texture
+    CMD_BLEND_FUNC = 5,                     // sfactor, dfactor
+    CMD_CLEAR = 6,                          // mask
+    CMD_CLEAR_COLOR = 7,                    // red, green, blue, alpha
+    CMD_DEPTH_MASK = 8,                     // flag
+    CMD_DISABLE = 9,                        // cap
+    CMD_DISABLE_VERTEX_ATTRIB_ARRAY = 10,   // index
+    CMD_DRAW_ARRAYS = 11,                   // mode, first, count
+    CMD_DRAW_ELEMENTS = 12,                 // mode, count, type, offset
+    CMD_ENABLE = 13,                        // cap
+    CMD_ENABLE_VERTEX_ATTRIB_ARRAY = 14,    // index
+    CMD_SCISSOR = 15,                       // x, y, width, height
+    CMD_UNIFORM_1F = 16,                    // location, x
+    CMD_UNIFORM_1I = 17,                    // location, x
+    CMD_UNIFORM_2F = 18,                    // location, x, y
+    CMD_UNIFORM_3F = 19,                    // location, x, y, z
+    CMD_UNIFORM_4F = 20,                    // location, x, y, z, w
+    CMD_UNIFORM_4FV = 21,                   // location, count, 4 * count floats
+    CMD_UNIFORM_MATRIX_4FV = 22,            // location, count, transpose, 16 * count floats
+    CMD_USE_PROGRAM = 23,                   // program
+    CMD_VERTEX_ATTRIB_POINTER = 24,         // indx, size, type, normalized, stride, offset
+    CMD_VIEWPORT = 25,                      // x, y, width, height
+};
+
+/* Fixed argument counts indexed by opcode; the vector uniforms also carry a
+ * variable payload sized by their count argument. */
+static const jint commandArgs[] = {
+    -1, 1, 2, 2, 2, 2, 1, 4, 1, 1, 1, 3, 4, 1, 1, 4, 2, 2, 3, 4, 5, 2, 3, 1, 6, 4,
+};
+
+static inline GLfloat
+commandFloat(const GLint *p) {
+    union { GLint i; GLfloat f; } u;
+    u.i = *p;
+    return u.f;
+}
+
+/* int glExecuteCommands ( java.nio.Buffer commands ) */
+static jint
+android_glExecuteCommands__Ljava_nio_Buffer_2
+  (JNIEnv *_env, jobject _this, jobject commands_buf) {
+    const char * _exceptionType = NULL;
+    const char * _exceptionMessage = NULL;
+    jint _executed = 0;
+    jint _remaining;
+    const GLint *p = (const GLint *) 0;
+    const GLint *end;
+
+    if (!commands_buf) {
+        jniThrowException(_env, "java/lang/IllegalArgumentException",
+                "commands == null");
+        return 0;
+    }
+    p = (const GLint *) getDirectBufferPointer(_env, commands_buf);
+    if (!p) {
+        return 0;
+    }
+    _remaining = (_env->GetIntField(commands_buf, limitID) -
+            _env->GetIntField(commands_buf, positionID)) <<
+            _env->GetIntField(commands_buf, elementSizeShiftID);
+    end = p + (_remaining >> 2);
+
+    while (p < end) {
+        jint op = p[0];
+        if (op <= 0 || op >= (jint) NELEM(commandArgs)) {
+            _exceptionType = "java/lang/IllegalArgumentException";
+            _exceptionMessage = "unknown command";
+            break;
+        }
+        if (end - p - 1 < commandArgs[op]) {
+            _exceptionType = "java/lang/IllegalArgumentException";
+            _exceptionMessage = "truncated command";
+            break;
+        }
+        const GLint *a = p + 1;
+        p = a + commandArgs[op];
+        switch (op) {
+        case CMD_ACTIVE_TEXTURE:
+            glActiveTexture((GLenum)a[0]);
+            break;
+        case CMD_BIND_BUFFER:
+            glBindBuffer((GLenum)a[0], (GLuint)a[1]);
+            break;
+        case CMD_BIND_FRAMEBUFFER:
+            glBindFramebuffer((GLenum)a[0], (GLuint)a[1]);
+            break;
+        case CMD_BIND_TEXTURE:
+            glBindTexture((GLenum)a[0], (GLuint)a[1]);
+            break;
+        case CMD_BLEND_FUNC:
+            glBlendFunc((GLenum)a[0], (GLenum)a[1]);
+            break;
+        case CMD_CLEAR:
+            glClear((GLbitfield)a[0]);
+            break;
+        case CMD_CLEAR_COLOR:
+            glClearColor(commandFloat(a), commandFloat(a + 1),
+                    commandFloat(a + 2), commandFloat(a + 3));
+            break;
+        case CMD_DEPTH_MASK:
+            glDepthMask((GLboolean)(a[0] != 0));
+            break;
+        case CMD_DISABLE:
+            glDisable((GLenum)a[0]);
+            break;
+        case CMD_DISABLE_VERTEX_ATTRIB_ARRAY:
+            glDisableVertexAttribArray((GLuint)a[0]);
+            break;
+        case CMD_DRAW_ARRAYS:
+            glDrawArrays((GLenum)a[0], (GLint)a[1], (GLsizei)a[2]);
+            break;
+        case CMD_DRAW_ELEMENTS:
+            glDrawElements((GLenum)a[0], (GLsizei)a[1], (GLenum)a[2],
+                    (const GLvoid *)(uintptr_t)(GLuint)a[3]);
+            break;
+        case CMD_ENABLE:
+            glEnable((GLenum)a[0]);
+            break;
+        case CMD_ENABLE_VERTEX_ATTRIB_ARRAY:
+            glEnableVertexAttribArray((GLuint)a[0]);
+            break;
+        case CMD_SCISSOR:
+            glScissor((GLint)a[0], (GLint)a[1], (GLsizei)a[2], (GLsizei)a[3]);
+            break;
+        case CMD_UNIFORM_1F:
+            glUniform1f((GLint)a[0], commandFloat(a + 1));
+            break;
+        case CMD_UNIFORM_1I:
+            glUniform1i((GLint)a[0], (GLint)a[1]);
+            break;
+        case CMD_UNIFORM_2F:
+            glUniform2f((GLint)a[0], commandFloat(a + 1), commandFloat(a + 2));
+            break;
+        case CMD_UNIFORM_3F:
+            glUniform3f((GLint)a[0], commandFloat(a + 1), commandFloat(a + 2),
+                    commandFloat(a + 3));
+            break;
+        case CMD_UNIFORM_4F:
+            glUniform4f((GLint)a[0], commandFloat(a + 1), commandFloat(a + 2),
+                    commandFloat(a + 3), commandFloat(a + 4));
+            break;
+        case CMD_UNIFORM_4FV:
+        case CMD_UNIFORM_MATRIX_4FV: {
+            jint stride = (op == CMD_UNIFORM_4FV) ? 4 : 16;
+            jint count = a[1];
+            if (count < 0 || (end - p) / stride < count) {
+                _exceptionType = "java/lang/IllegalArgumentException";
+                _exceptionMessage = "truncated command";
+                break;
+            }
+            if (op == CMD_UNIFORM_4FV) {
+                glUniform4fv((GLint)a[0], (GLsizei)count, (const GLfloat *)p);
+            } else {
+                glUniformMatrix4fv((GLint)a[0], (GLsizei)count,
+                        (GLboolean)(a[2] != 0), (const GLfloat *)p);
+            }
+            p += count * stride;
+            break;
+        }
+        case CMD_USE_PROGRAM:
+            glUseProgram((GLuint)a[0]);
+            break;
+        case CMD_VERTEX_ATTRIB_POINTER:
+            glVertexAttribPointer((GLuint)a[0], (GLint)a[1], (GLenum)a[2],
+                    (GLboolean)(a[3] != 0), (GLsizei)a[4],
+                    (const GLvoid *)(uintptr_t)(GLuint)a[5]);
+            break;
+        case CMD_VIEWPORT:
+            glViewport((GLint)a[0], (GLint)a[1], (GLsizei)a[2], (GLsizei)a[3]);
+            break;
+        }
+        if (_exceptionType) {
+            break;
+        }
+        _executed++;
+    }
+
+    if (_exceptionType) {
+        jniThrowException(_env, _exceptionType, _exceptionMessage);
+    }
+    return _executed;
+}
+
 static const char *classPathName = "android/opengl/GLES20";
 
 static JNINativeMethod methods[] = {
@@ -6080,6 +6280,7 @@ static JNINativeMethod methods[] = {
 {"glDrawElements", "(IIILjava/nio/Buffer;)V", (void *) android_glDrawElements__IIILjava_nio_Buffer_2 },
 {"glEnable", "(I)V", (void *) android_glEnable__I },
 {"glEnableVertexAttribArray", "(I)V", (void *) android_glEnableVertexAttribArray__I },
+{"glExecuteCommands", "(Ljava/nio/Buffer;)I", (void *) android_glExecuteCommands__Ljava_nio_Buffer_2 },
 {"glFinish", "()V", (void *) android_glFinish__ },
 {"glFlush", "()V", (void *) android_glFlush__ },
 {"glFramebufferRenderbuffer", "(IIII)V", (void *) android_glFramebufferRenderbuffer__IIII },
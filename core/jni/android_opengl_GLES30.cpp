@@ -107,6 +107,15 @@ getPointer(JNIEnv *_env, jobject buffer, jarray *array, jint *remaining, jint *o
     limit = _env->GetIntField(buffer, limitID);
     elementSizeShift = _env->GetIntField(buffer, elementSizeShiftID);
     *remaining = (limit - position) << elementSizeShift;
+
+    /* Direct buffers resolve without calling back into NIOAccess; only
+     * array-backed buffers need the static Java helpers. */
+    char *address = (char *) _env->GetDirectBufferAddress(buffer);
+    if (address != NULL) {
+        *array = NULL;
+        return (void *) (address + (position << elementSizeShift));
+    }
+
     pointer = _env->CallStaticLongMethod(nioAccessClass,
             getBasePointerID, buffer);
     if (pointer != 0L) {
@@ -486,49 +486,105 @@ static void android_os_Debug_getDirtyPages(JNIEnv *env, jobject clazz, jobject o
     android_os_Debug_getDirtyPagesPid(env, clazz, getpid(), object);
 }
 
+// Returns the value in kB of the smaps field whose name ends at name[len], or
+// -1 if line does not start with that field.
+static inline jlong parse_smaps_field(const char* line, const char* lineEnd,
+        const char* name, size_t len)
+{
+    if ((size_t) (lineEnd - line) <= len || memcmp(line, name, len) != 0) {
+        return -1;
+    }
+    const char* c = line + len;
+    while (c < lineEnd && *c == ' ') {
+        c++;
+    }
+    jlong value = 0;
+    while (c < lineEnd && *c >= '0' && *c <= '9') {
+        value = value * 10 + (*c - '0');
+        c++;
+    }
+    return value;
+}
+
+/*
+ * Sums the Pss and Private_* fields of an smaps style file without allocating
+ * or going through stdio. Only those lines are looked at; the mapping header
+ * lines and every other field are skipped after a first character check.
+ */
+static void sum_smaps_pss(int fd, jlong* outPss, jlong* outUss)
+{
+    char buffer[16 * 1024];
+    size_t filled = 0;
+    bool skipping = false;  // inside a line longer than the buffer
+    jlong pss = 0;
+    jlong uss = 0;
+
+    while (true) {
+        ssize_t count = TEMP_FAILURE_RETRY(read(fd, buffer + filled, sizeof(buffer) - filled));
+        if (count <= 0) {
+            break;
+        }
+        filled += count;
+
+        const char* line = buffer;
+        const char* end = buffer + filled;
+        while (true) {
+            const char* lineEnd = (const char*) memchr(line, '\n', end - line);
+            if (lineEnd == NULL) {
+                break;
+            }
+            if (skipping) {
+                skipping = false;
+            } else if (line[0] == 'P') {
+                jlong value;
+                if ((value = parse_smaps_field(line, lineEnd, "Pss:", 4)) >= 0) {
+                    pss += value;
+                } else if ((value = parse_smaps_field(line, lineEnd, "Private_Clean:", 14)) >= 0
+                        || (value = parse_smaps_field(line, lineEnd, "Private_Dirty:", 14)) >= 0) {
+                    uss += value;
+                }
+            }
+            line = lineEnd + 1;
+        }
+
+        if (line == buffer && filled == sizeof(buffer)) {
+            // No line end in a full buffer: drop it and skip to the next line
+            skipping = true;
+            filled = 0;
+        } else {
+            filled = end - line;
+            memmove(buffer, line, filled);
+        }
+    }
+
+    *outPss += pss;
+    *outUss += uss;
+}
+
 static jlong android_os_Debug_getPssPid(JNIEnv *env, jobject clazz, jint pid, jlongArray outUss)
 {
-    char line[1024];
     jlong pss = 0;
     jlong uss = 0;
-    unsigned temp;
 
     char tmp[128];
-    FILE *fp;
 
     struct graphics_memory_pss graphics_mem;
     if (read_memtrack_memory(pid, &graphics_mem) == 0) {
         pss = uss = graphics_mem.graphics + graphics_mem.gl + graphics_mem.other;
     }
 
-    sprintf(tmp, "/proc/%d/smaps", pid);
-    fp = fopen(tmp, "r");
-
-    if (fp != 0) {
-        while (true) {
-            if (fgets(line, 1024, fp) == NULL) {
-                break;
-            }
-
-            if (line[0] == 'P') {
-                if (strncmp(line, "Pss:", 4) == 0) {
-                    char* c = line + 4;
-                    while (*c != 0 && (*c < '0' || *c > '9')) {
-                        c++;
-                    }
-                    pss += atoi(c);
-                } else if (strncmp(line, "Private_Clean:", 14)
-                        || strncmp(line, "Private_Dirty:", 14)) {
-                    char* c = line + 14;
-                    while (*c != 0 && (*c < '0' || *c > '9')) {
-                        c++;
-                    }
-                    uss += atoi(c);
-                }
-            }
-        }
+    // Kernels with smaps_rollup sum the mappings themselves; it has the
+    // same fields as smaps, for a single pseudo mapping.
+    sprintf(tmp, "/proc/%d/smaps_rollup", pid);
+    int fd = open(tmp, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        sprintf(tmp, "/proc/%d/smaps", pid);
+        fd = open(tmp, O_RDONLY | O_CLOEXEC);
+    }
 
-        fclose(fp);
+    if (fd >= 0) {
+        sum_smaps_pss(fd, &pss, &uss);
+        close(fd);
     }
 
     if (outUss != NULL) {
@@ -38,6 +38,7 @@ public:
     virtual void raiseException(JNIEnv* env, const char* msg, jthrowable exceptionObj);
 
     void pollOnce(JNIEnv* env, int timeoutMillis);
+    int pollBatched(JNIEnv* env, int timeoutMillis);
 
     void wake();
 
@@ -103,6 +104,40 @@ void NativeMessageQueue::pollOnce(JNIEnv* env, int timeoutMillis) {
     }
 }
 
+// Upper bound on the extra non-blocking polls of one pollBatched() call, so that
+// a stream of fd events cannot starve the Java message loop.
+static const int MAX_BATCHED_POLLS = 8;
+
+/*
+ * Like pollOnce(), but after a poll that dispatched native callbacks it keeps
+ * polling without blocking while more callbacks are ready, so that fds which
+ * become ready together (input, vsync, sensors) are handled before returning
+ * to Java. Stops at the first wake, since that means Java has work queued.
+ *
+ * Returns the number of polls that dispatched callbacks. Zero means the poll
+ * was woken or timed out, so the Java side must look at its queue; otherwise
+ * it may skip its own redundant re-poll when nothing else is due.
+ */
+int NativeMessageQueue::pollBatched(JNIEnv* env, int timeoutMillis) {
+    int callbackPolls = 0;
+    mInCallback = true;
+    int result = mLooper->pollOnce(timeoutMillis);
+    while (result == ALOOPER_POLL_CALLBACK && !mExceptionObj) {
+        callbackPolls++;
+        if (callbackPolls > MAX_BATCHED_POLLS) {
+            break;
+        }
+        result = mLooper->pollOnce(0);
+    }
+    mInCallback = false;
+    if (mExceptionObj) {
+        env->Throw(mExceptionObj);
+        env->DeleteLocalRef(mExceptionObj);
+        mExceptionObj = NULL;
+    }
+    return callbackPolls;
+}
+
 void NativeMessageQueue::wake() {
     mLooper->wake();
 }
@@ -136,6 +171,12 @@ static void android_os_MessageQueue_nativePollOnce(JNIEnv* env, jclass clazz,
     nativeMessageQueue->pollOnce(env, timeoutMillis);
 }
 
+static jint android_os_MessageQueue_nativePollBatched(JNIEnv* env, jclass clazz,
+        jlong ptr, jint timeoutMillis) {
+    NativeMessageQueue* nativeMessageQueue = reinterpret_cast<NativeMessageQueue*>(ptr);
+    return nativeMessageQueue->pollBatched(env, timeoutMillis);
+}
+
 static void android_os_MessageQueue_nativeWake(JNIEnv* env, jclass clazz, jlong ptr) {
     NativeMessageQueue* nativeMessageQueue = reinterpret_cast<NativeMessageQueue*>(ptr);
     return nativeMessageQueue->wake();
@@ -153,6 +194,7 @@ static JNINativeMethod gMessageQueueMethods[] = {
     { "nativeInit", "()J", (void*)android_os_MessageQueue_nativeInit },
     { "nativeDestroy", "(J)V", (void*)android_os_MessageQueue_nativeDestroy },
     { "nativePollOnce", "(JI)V", (void*)android_os_MessageQueue_nativePollOnce },
+    { "nativePollBatched", "(JI)I", (void*)android_os_MessageQueue_nativePollBatched },
     { "nativeWake", "(J)V", (void*)android_os_MessageQueue_nativeWake },
     { "nativeIsIdling", "(J)Z", (void*)android_os_MessageQueue_nativeIsIdling }
 };
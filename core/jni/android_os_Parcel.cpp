@@ -64,6 +64,7 @@ static struct parcel_offsets_t
     jfieldID mNativePtr;
     jmethodID obtain;
     jmethodID recycle;
+    jclass stringClass;
 } gParcelOffsets;
 
 Parcel* parcelForJavaObject(JNIEnv* env, jobject obj)
@@ -248,6 +249,109 @@ static void android_os_Parcel_writeString(JNIEnv* env, jclass clazz, jlong nativ
     }
 }
 
+/*
+ * Writes a primitive array in the same layout as the per-element Java loop: the
+ * element count (-1 for null) followed by the elements back to back. Parcel
+ * stores every primitive in host byte order and int32/int64/float/double all
+ * keep 4 byte alignment, so the whole array can be copied with one memcpy.
+ */
+static void writePrimitiveArray(JNIEnv* env, jclass clazz, jlong nativePtr, jarray data,
+        size_t elemSize)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel == NULL) {
+        return;
+    }
+
+    if (data == NULL) {
+        const status_t err = parcel->writeInt32(-1);
+        if (err != NO_ERROR) {
+            signalExceptionForError(env, clazz, err);
+        }
+        return;
+    }
+
+    const jsize length = env->GetArrayLength(data);
+    if ((size_t) length > INT32_MAX / elemSize) {
+        signalExceptionForError(env, clazz, NO_MEMORY);
+        return;
+    }
+
+    const status_t err = parcel->writeInt32(length);
+    if (err != NO_ERROR) {
+        signalExceptionForError(env, clazz, err);
+        return;
+    }
+    if (length == 0) {
+        return;
+    }
+
+    const size_t size = length * elemSize;
+    void* dest = parcel->writeInplace(size);
+    if (dest == NULL) {
+        signalExceptionForError(env, clazz, NO_MEMORY);
+        return;
+    }
+
+    void* ar = env->GetPrimitiveArrayCritical(data, 0);
+    if (ar) {
+        memcpy(dest, ar, size);
+        env->ReleasePrimitiveArrayCritical(data, ar, JNI_ABORT);
+    }
+}
+
+static void android_os_Parcel_writeIntArray(JNIEnv* env, jclass clazz, jlong nativePtr,
+        jintArray data)
+{
+    writePrimitiveArray(env, clazz, nativePtr, data, sizeof(jint));
+}
+
+static void android_os_Parcel_writeLongArray(JNIEnv* env, jclass clazz, jlong nativePtr,
+        jlongArray data)
+{
+    writePrimitiveArray(env, clazz, nativePtr, data, sizeof(jlong));
+}
+
+static void android_os_Parcel_writeFloatArray(JNIEnv* env, jclass clazz, jlong nativePtr,
+        jfloatArray data)
+{
+    writePrimitiveArray(env, clazz, nativePtr, data, sizeof(jfloat));
+}
+
+static void android_os_Parcel_writeDoubleArray(JNIEnv* env, jclass clazz, jlong nativePtr,
+        jdoubleArray data)
+{
+    writePrimitiveArray(env, clazz, nativePtr, data, sizeof(jdouble));
+}
+
+static void android_os_Parcel_writeStringArray(JNIEnv* env, jclass clazz, jlong nativePtr,
+        jobjectArray data)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel == NULL) {
+        return;
+    }
+
+    const jsize length = data != NULL ? env->GetArrayLength(data) : -1;
+    status_t err = parcel->writeInt32(length);
+    for (jsize i = 0; i < length && err == NO_ERROR; i++) {
+        ScopedLocalRef<jstring> val(env, (jstring) env->GetObjectArrayElement(data, i));
+        if (val.get() != NULL) {
+            err = NO_MEMORY;
+            const jchar* str = env->GetStringCritical(val.get(), 0);
+            if (str) {
+                err = parcel->writeString16(str, env->GetStringLength(val.get()));
+                env->ReleaseStringCritical(val.get(), str);
+            }
+        } else {
+            err = parcel->writeString16(NULL, 0);
+        }
+    }
+    if (err != NO_ERROR) {
+        signalExceptionForError(env, clazz, err);
+    }
+}
+
 static void android_os_Parcel_writeStrongBinder(JNIEnv* env, jclass clazz, jlong nativePtr, jobject object)
 {
     Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
@@ -297,6 +401,134 @@ static jbyteArray android_os_Parcel_createByteArray(JNIEnv* env, jclass clazz, j
     return ret;
 }
 
+/*
+ * Reads the element count of an array written by writePrimitiveArray() and
+ * returns its elements in place, or NULL for a null array or a count that does
+ * not fit in the remaining data.
+ */
+static const void* readPrimitiveArrayInplace(Parcel* parcel, size_t elemSize, jsize* outLength)
+{
+    const int32_t len = parcel->readInt32();
+
+    // sanity check the stored length against the true data size
+    if (len < 0 || (size_t) len > parcel->dataAvail() / elemSize) {
+        return NULL;
+    }
+    *outLength = len;
+    return parcel->readInplace(len * elemSize);
+}
+
+static bool copyToPrimitiveArray(JNIEnv* env, jarray array, const void* data, size_t size)
+{
+    if (array == NULL) {
+        return false;
+    }
+    if (size > 0) {
+        void* ar = env->GetPrimitiveArrayCritical(array, 0);
+        if (ar == NULL) {
+            return false;
+        }
+        memcpy(ar, data, size);
+        env->ReleasePrimitiveArrayCritical(array, ar, 0);
+    }
+    return true;
+}
+
+static jintArray android_os_Parcel_createIntArray(JNIEnv* env, jclass clazz, jlong nativePtr)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel != NULL) {
+        jsize len;
+        const void* data = readPrimitiveArrayInplace(parcel, sizeof(jint), &len);
+        if (data != NULL) {
+            jintArray ret = env->NewIntArray(len);
+            if (copyToPrimitiveArray(env, ret, data, len * sizeof(jint))) {
+                return ret;
+            }
+        }
+    }
+    return NULL;
+}
+
+static jlongArray android_os_Parcel_createLongArray(JNIEnv* env, jclass clazz, jlong nativePtr)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel != NULL) {
+        jsize len;
+        const void* data = readPrimitiveArrayInplace(parcel, sizeof(jlong), &len);
+        if (data != NULL) {
+            jlongArray ret = env->NewLongArray(len);
+            if (copyToPrimitiveArray(env, ret, data, len * sizeof(jlong))) {
+                return ret;
+            }
+        }
+    }
+    return NULL;
+}
+
+static jfloatArray android_os_Parcel_createFloatArray(JNIEnv* env, jclass clazz, jlong nativePtr)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel != NULL) {
+        jsize len;
+        const void* data = readPrimitiveArrayInplace(parcel, sizeof(jfloat), &len);
+        if (data != NULL) {
+            jfloatArray ret = env->NewFloatArray(len);
+            if (copyToPrimitiveArray(env, ret, data, len * sizeof(jfloat))) {
+                return ret;
+            }
+        }
+    }
+    return NULL;
+}
+
+static jdoubleArray android_os_Parcel_createDoubleArray(JNIEnv* env, jclass clazz, jlong nativePtr)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel != NULL) {
+        jsize len;
+        const void* data = readPrimitiveArrayInplace(parcel, sizeof(jdouble), &len);
+        if (data != NULL) {
+            jdoubleArray ret = env->NewDoubleArray(len);
+            if (copyToPrimitiveArray(env, ret, data, len * sizeof(jdouble))) {
+                return ret;
+            }
+        }
+    }
+    return NULL;
+}
+
+static jobjectArray android_os_Parcel_createStringArray(JNIEnv* env, jclass clazz, jlong nativePtr)
+{
+    Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
+    if (parcel == NULL) {
+        return NULL;
+    }
+
+    // Every string takes at least 4 bytes for its length
+    const int32_t len = parcel->readInt32();
+    if (len < 0 || (size_t) len > parcel->dataAvail() / sizeof(int32_t)) {
+        return NULL;
+    }
+
+    jobjectArray ret = env->NewObjectArray(len, gParcelOffsets.stringClass, NULL);
+    if (ret == NULL) {
+        return NULL;
+    }
+    for (int32_t i = 0; i < len; i++) {
+        size_t strLen;
+        const char16_t* str = parcel->readString16Inplace(&strLen);
+        if (str != NULL) {
+            ScopedLocalRef<jstring> val(env, env->NewString(str, strLen));
+            if (val.get() == NULL) {
+                return NULL;
+            }
+            env->SetObjectArrayElement(ret, i, val.get());
+        }
+    }
+    return ret;
+}
+
 static jint android_os_Parcel_readInt(JNIEnv* env, jclass clazz, jlong nativePtr)
 {
     Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
@@ -641,6 +873,11 @@ static const JNINativeMethod gParcelMethods[] = {
     {"nativeWriteString",         "(JLjava/lang/String;)V", (void*)android_os_Parcel_writeString},
     {"nativeWriteStrongBinder",   "(JLandroid/os/IBinder;)V", (void*)android_os_Parcel_writeStrongBinder},
     {"nativeWriteFileDescriptor", "(JLjava/io/FileDescriptor;)V", (void*)android_os_Parcel_writeFileDescriptor},
+    {"nativeWriteIntArray",       "(J[I)V", (void*)android_os_Parcel_writeIntArray},
+    {"nativeWriteLongArray",      "(J[J)V", (void*)android_os_Parcel_writeLongArray},
+    {"nativeWriteFloatArray",     "(J[F)V", (void*)android_os_Parcel_writeFloatArray},
+    {"nativeWriteDoubleArray",    "(J[D)V", (void*)android_os_Parcel_writeDoubleArray},
+    {"nativeWriteStringArray",    "(J[Ljava/lang/String;)V", (void*)android_os_Parcel_writeStringArray},
 
     {"nativeCreateByteArray",     "(J)[B", (void*)android_os_Parcel_createByteArray},
     {"nativeReadInt",             "(J)I", (void*)android_os_Parcel_readInt},
@@ -650,6 +887,11 @@ static const JNINativeMethod gParcelMethods[] = {
     {"nativeReadString",          "(J)Ljava/lang/String;", (void*)android_os_Parcel_readString},
     {"nativeReadStrongBinder",    "(J)Landroid/os/IBinder;", (void*)android_os_Parcel_readStrongBinder},
     {"nativeReadFileDescriptor",  "(J)Ljava/io/FileDescriptor;", (void*)android_os_Parcel_readFileDescriptor},
+    {"nativeCreateIntArray",      "(J)[I", (void*)android_os_Parcel_createIntArray},
+    {"nativeCreateLongArray",     "(J)[J", (void*)android_os_Parcel_createLongArray},
+    {"nativeCreateFloatArray",    "(J)[F", (void*)android_os_Parcel_createFloatArray},
+    {"nativeCreateDoubleArray",   "(J)[D", (void*)android_os_Parcel_createDoubleArray},
+    {"nativeCreateStringArray",   "(J)[Ljava/lang/String;", (void*)android_os_Parcel_createStringArray},
 
     {"openFileDescriptor",        "(Ljava/lang/String;I)Ljava/io/FileDescriptor;", (void*)android_os_Parcel_openFileDescriptor},
     {"dupFileDescriptor",         "(Ljava/io/FileDescriptor;)Ljava/io/FileDescriptor;", (void*)android_os_Parcel_dupFileDescriptor},
@@ -683,6 +925,10 @@ int register_android_os_Parcel(JNIEnv* env)
                                                    "()Landroid/os/Parcel;");
     gParcelOffsets.recycle = env->GetMethodID(clazz, "recycle", "()V");
 
+    clazz = env->FindClass("java/lang/String");
+    LOG_FATAL_IF(clazz == NULL, "Unable to find class java.lang.String");
+    gParcelOffsets.stringClass = (jclass) env->NewGlobalRef(clazz);
+
     return AndroidRuntime::registerNativeMethods(
         env, kParcelPathName,
         gParcelMethods, NELEM(gParcelMethods));
@@ -19,25 +19,87 @@
 
 #include <JNIHelp.h>
 #include <ScopedUtfChars.h>
-#include <ScopedStringChars.h>
 
-#include <utils/String8.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include <utils/threads.h>
+#include <utils/Unicode.h>
+
+#include <cutils/atomic.h>
 #include <cutils/trace.h>
 #include <cutils/log.h>
 
 namespace android {
 
-static void sanitizeString(String8& utf8Chars) {
-    size_t size = utf8Chars.size();
-    char* str = utf8Chars.lockBuffer(size);
-    for (size_t i = 0; i < size; i++) {
-        char c = str[i];
+static const size_t MAX_SECTION_NAME_LEN = 127;
+static const size_t MAX_SECTION_NAME_UTF8_SIZE = MAX_SECTION_NAME_LEN * 3 + 1;
+
+/*
+ * Converts nameStr to a sanitized UTF-8 section name in out, which must hold
+ * MAX_SECTION_NAME_UTF8_SIZE bytes. Names are cut at MAX_SECTION_NAME_LEN UTF-16
+ * units, so unlike String8 this never touches the heap. Returns false with a
+ * pending exception if nameStr is null.
+ */
+static bool getSectionName(JNIEnv* env, jstring nameStr, char* out) {
+    if (nameStr == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return false;
+    }
+
+    jchar chars[MAX_SECTION_NAME_LEN];
+    size_t len = env->GetStringLength(nameStr);
+    if (len > MAX_SECTION_NAME_LEN) {
+        len = MAX_SECTION_NAME_LEN;
+        // Do not split a surrogate pair
+        env->GetStringRegion(nameStr, len - 1, 1, chars);
+        if ((chars[0] & 0xfc00) == 0xd800) {
+            len--;
+        }
+    }
+    env->GetStringRegion(nameStr, 0, len, chars);
+
+    for (size_t i = 0; i < len; i++) {
+        jchar c = chars[i];
         if (c == '\0' || c == '\n' || c == '|') {
-            str[i] = ' ';
+            chars[i] = ' ';
         }
     }
-    utf8Chars.unlockBuffer();
+    utf16_to_utf8(reinterpret_cast<const char16_t*>(chars), len, out);
+    return true;
+}
+
+/*
+ * Section names registered up front so that hot paths can begin a section by
+ * id, without converting and sanitizing a string on every call. Names are
+ * never unregistered; the count is published after the name is stored, so
+ * lookups do not need the lock.
+ */
+static const int32_t MAX_REGISTERED_SECTION_NAMES = 1024;
+static Mutex gSectionNamesLock;
+static const char* gSectionNames[MAX_REGISTERED_SECTION_NAMES];
+static volatile int32_t gSectionNameCount = 0;
+
+static jint android_os_Trace_nativeRegisterSectionName(JNIEnv* env, jclass clazz,
+        jstring nameStr) {
+    char name[MAX_SECTION_NAME_UTF8_SIZE];
+    if (!getSectionName(env, nameStr, name)) {
+        return -1;
+    }
+
+    AutoMutex _l(gSectionNamesLock);
+    const int32_t count = gSectionNameCount;
+    for (int32_t i = 0; i < count; i++) {
+        if (strcmp(gSectionNames[i], name) == 0) {
+            return i;
+        }
+    }
+    if (count == MAX_REGISTERED_SECTION_NAMES) {
+        return -1;
+    }
+    gSectionNames[count] = strdup(name);
+    android_atomic_release_store(count + 1, &gSectionNameCount);
+    return count;
 }
 
 static jlong android_os_Trace_nativeGetEnabledTags(JNIEnv* env, jclass clazz) {
@@ -54,13 +116,24 @@ static void android_os_Trace_nativeTraceCounter(JNIEnv* env, jclass clazz,
 
 static void android_os_Trace_nativeTraceBegin(JNIEnv* env, jclass clazz,
         jlong tag, jstring nameStr) {
-    const size_t MAX_SECTION_NAME_LEN = 127;
-    ScopedStringChars jchars(env, nameStr);
-    String8 utf8Chars(reinterpret_cast<const char16_t*>(jchars.get()), jchars.size());
-    sanitizeString(utf8Chars);
+    char name[MAX_SECTION_NAME_UTF8_SIZE];
+    if (!getSectionName(env, nameStr, name)) {
+        return;
+    }
 
-    ALOGV("%s: %lld %s", __FUNCTION__, tag, utf8Chars.string());
-    atrace_begin(tag, utf8Chars.string());
+    ALOGV("%s: %lld %s", __FUNCTION__, tag, name);
+    atrace_begin(tag, name);
+}
+
+static void android_os_Trace_nativeTraceBeginId(JNIEnv* env, jclass clazz,
+        jlong tag, jint nameId) {
+    if (nameId < 0 || nameId >= android_atomic_acquire_load(&gSectionNameCount)) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", "unknown section name id");
+        return;
+    }
+
+    ALOGV("%s: %lld %s", __FUNCTION__, tag, gSectionNames[nameId]);
+    atrace_begin(tag, gSectionNames[nameId]);
 }
 
 static void android_os_Trace_nativeTraceEnd(JNIEnv* env, jclass clazz,
@@ -72,24 +145,24 @@ static void android_os_Trace_nativeTraceEnd(JNIEnv* env, jclass clazz,
 
 static void android_os_Trace_nativeAsyncTraceBegin(JNIEnv* env, jclass clazz,
         jlong tag, jstring nameStr, jint cookie) {
-    const size_t MAX_SECTION_NAME_LEN = 127;
-    ScopedStringChars jchars(env, nameStr);
-    String8 utf8Chars(reinterpret_cast<const char16_t*>(jchars.get()), jchars.size());
-    sanitizeString(utf8Chars);
+    char name[MAX_SECTION_NAME_UTF8_SIZE];
+    if (!getSectionName(env, nameStr, name)) {
+        return;
+    }
 
-    ALOGV("%s: %lld %s %d", __FUNCTION__, tag, utf8Chars.string(), cookie);
-    atrace_async_begin(tag, utf8Chars.string(), cookie);
+    ALOGV("%s: %lld %s %d", __FUNCTION__, tag, name, cookie);
+    atrace_async_begin(tag, name, cookie);
 }
 
 static void android_os_Trace_nativeAsyncTraceEnd(JNIEnv* env, jclass clazz,
         jlong tag, jstring nameStr, jint cookie) {
-    const size_t MAX_SECTION_NAME_LEN = 127;
-    ScopedStringChars jchars(env, nameStr);
-    String8 utf8Chars(reinterpret_cast<const char16_t*>(jchars.get()), jchars.size());
-    sanitizeString(utf8Chars);
+    char name[MAX_SECTION_NAME_UTF8_SIZE];
+    if (!getSectionName(env, nameStr, name)) {
+        return;
+    }
 
-    ALOGV("%s: %lld %s %d", __FUNCTION__, tag, utf8Chars.string(), cookie);
-    atrace_async_end(tag, utf8Chars.string(), cookie);
+    ALOGV("%s: %lld %s %d", __FUNCTION__, tag, name, cookie);
+    atrace_async_end(tag, name, cookie);
 }
 
 static void android_os_Trace_nativeSetAppTracingAllowed(JNIEnv* env,
@@ -117,6 +190,12 @@ static JNINativeMethod gTraceMethods[] = {
     { "nativeTraceBegin",
             "(JLjava/lang/String;)V",
             (void*)android_os_Trace_nativeTraceBegin },
+    { "nativeRegisterSectionName",
+            "(Ljava/lang/String;)I",
+            (void*)android_os_Trace_nativeRegisterSectionName },
+    { "nativeTraceBeginId",
+            "(JI)V",
+            (void*)android_os_Trace_nativeTraceBeginId },
     { "nativeTraceEnd",
             "(J)V",
             (void*)android_os_Trace_nativeTraceEnd },
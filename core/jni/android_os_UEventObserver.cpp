@@ -29,34 +29,259 @@
 #include <utils/String8.h>
 #include <ScopedUtfChars.h>
 
+#include <errno.h>
+#include <string.h>
+#include <linux/filter.h>
+#include <sys/socket.h>
+
 namespace android {
 
+/**
+ * Aho-Corasick automaton over the match strings, compiled to a DFA so that
+ * a uevent is matched against every string in a single pass over its bytes.
+ * Bytes that appear in no match string share one input class; this class
+ * includes the NUL separating the fields, which sends the automaton back to
+ * its initial state, so that like strstr() no match spans two fields.
+ */
+class MatchAutomaton {
+public:
+    MatchAutomaton(): mClassCount(1), mMatchesAll(false) {
+        memset(mClasses, 0, sizeof(mClasses));
+    }
+
+    void build(const Vector<String8>& matches);
+    bool matches(const char* buffer, size_t length) const;
+
+private:
+    // States are stored as 16 bit indices
+    static const size_t kMaxStates = 65536;
+
+    uint8_t mClasses[256];
+    size_t mClassCount;
+    // mNext[state * mClassCount + class]
+    Vector<uint16_t> mNext;
+    Vector<bool> mOutput;
+    bool mMatchesAll;
+};
+
+void MatchAutomaton::build(const Vector<String8>& matches) {
+    memset(mClasses, 0, sizeof(mClasses));
+    mClassCount = 1;
+    mNext.clear();
+    mOutput.clear();
+    mMatchesAll = false;
+
+    size_t stateCount = 1;
+    for (size_t i = 0; i < matches.size(); i++) {
+        const String8& match = matches.itemAt(i);
+        stateCount += match.length();
+        for (size_t j = 0; j < match.length(); j++) {
+            uint8_t c = match.string()[j];
+            if (!mClasses[c]) mClasses[c] = mClassCount++;
+        }
+    }
+    if (stateCount > kMaxStates) {
+        // Every uevent goes to UEventObserver, which filters them again
+        ALOGW("Too many uevent matches, disabling native filtering");
+        mMatchesAll = true;
+        return;
+    }
+
+    // Trie of the match strings, 0 marks a missing edge as the root is
+    // never the target of one
+    mNext.insertAt(0, 0, mClassCount);
+    mOutput.add(false);
+    for (size_t i = 0; i < matches.size(); i++) {
+        const String8& match = matches.itemAt(i);
+        size_t state = 0;
+        for (size_t j = 0; j < match.length(); j++) {
+            size_t edge = state * mClassCount + mClasses[(uint8_t) match.string()[j]];
+            if (!mNext[edge]) {
+                mNext.editItemAt(edge) = mOutput.size();
+                mNext.insertAt(0, mNext.size(), mClassCount);
+                mOutput.add(false);
+            }
+            state = mNext[edge];
+        }
+        mOutput.editItemAt(state) = true;
+    }
+
+    // Breadth first, replace the missing edges with the edges of the
+    // failure state, which is complete since it is shallower
+    Vector<uint16_t> failure;
+    failure.insertAt(0, 0, mOutput.size());
+    Vector<uint16_t> queue;
+    for (size_t c = 0; c < mClassCount; c++) {
+        if (mNext[c]) queue.add(mNext[c]);
+    }
+    for (size_t head = 0; head < queue.size(); head++) {
+        size_t state = queue[head];
+        if (mOutput[failure[state]]) mOutput.editItemAt(state) = true;
+
+        for (size_t c = 0; c < mClassCount; c++) {
+            size_t edge = state * mClassCount + c;
+            size_t fallback = mNext[failure[state] * mClassCount + c];
+            if (mNext[edge]) {
+                failure.editItemAt(mNext[edge]) = fallback;
+                queue.add(mNext[edge]);
+            } else {
+                mNext.editItemAt(edge) = fallback;
+            }
+        }
+    }
+
+    // An empty match string matches every uevent
+    mMatchesAll = mOutput[0];
+}
+
+bool MatchAutomaton::matches(const char* buffer, size_t length) const {
+    if (mMatchesAll) return true;
+    if (mOutput.isEmpty()) return false;
+
+    const uint16_t* next = mNext.array();
+    const bool* output = mOutput.array();
+    size_t state = 0;
+    for (size_t i = 0; i < length; i++) {
+        state = next[state * mClassCount + mClasses[(uint8_t) buffer[i]]];
+        if (output[state]) return true;
+    }
+    return false;
+}
+
 static Mutex gMatchesMutex;
 static Vector<String8> gMatches;
+static MatchAutomaton gAutomaton;
+
+static const char kDevPathPrefix[] = "DEVPATH=";
+static const uint32_t kFilterAccept = 0xffffffff;
+static const uint32_t kFilterReject = 0;
+
+static int compareLength(const String8* lhs, const String8* rhs) {
+    return lhs->length() - rhs->length();
+}
+
+/**
+ * Builds a socket filter that drops the uevents which cannot match, so that
+ * they do not wake up the observer thread. The kernel sends messages made of
+ * an "action@devpath" header followed by the fields, and the filter can only
+ * compare bytes at known offsets: it handles matches on the DEVPATH field,
+ * which is what most observers use, by comparing the devpath of the header.
+ * Returns false if some match cannot be expressed, the socket must then
+ * receive every uevent.
+ */
+static bool buildSocketFilter(Vector<sock_filter>& program) {
+    Vector<String8> paths;
+    for (size_t i = 0; i < gMatches.size(); i++) {
+        const String8& match = gMatches.itemAt(i);
+        if (strncmp(match.string(), kDevPathPrefix, sizeof(kDevPathPrefix) - 1)) {
+            return false;
+        }
+        paths.add(String8(match.string() + sizeof(kDevPathPrefix) - 1));
+    }
+    // A load past the end of the message rejects it right away, test the
+    // shorter paths, which may still fit, first
+    paths.sort(compareLength);
+
+    // Find the '@' ending the action (add, remove, change, move, online,
+    // offline...) and keep the offset of the devpath in X. Anything else
+    // is not a kernel uevent and goes through
+    for (uint32_t offset = 3; offset <= 7; offset++) {
+        sock_filter find[] = {
+            BPF_STMT(BPF_LD | BPF_B | BPF_ABS, offset),
+            BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, '@', 0, 2),
+            BPF_STMT(BPF_LDX | BPF_IMM, offset + 1),
+            BPF_JUMP(BPF_JMP | BPF_JA, (7 - offset) * 4 + 1, 0, 0)
+        };
+        program.appendArray(find, NELEM(find));
+    }
+    sock_filter accept = BPF_STMT(BPF_RET | BPF_K, kFilterAccept);
+    program.add(accept);
+
+    // One block per path, any mismatch skips to the next block
+    for (size_t i = 0; i < paths.size(); i++) {
+        const uint8_t* path = (const uint8_t*) paths[i].string();
+        const size_t length = paths[i].length();
+
+        size_t loads = length / 4 + (length & 2) / 2 + (length & 1);
+        if (loads * 2 + 1 > 255) return false;
+
+        size_t offset = 0;
+        while (offset < length) {
+            uint16_t size;
+            uint32_t value;
+            size_t step;
+            if (length - offset >= 4) {
+                size = BPF_W;
+                value = path[offset] << 24 | path[offset + 1] << 16 |
+                        path[offset + 2] << 8 | path[offset + 3];
+                step = 4;
+            } else if (length - offset >= 2) {
+                size = BPF_H;
+                value = path[offset] << 8 | path[offset + 1];
+                step = 2;
+            } else {
+                size = BPF_B;
+                value = path[offset];
+                step = 1;
+            }
+            loads--;
+            sock_filter compare[] = {
+                BPF_STMT(BPF_LD | size | BPF_IND, (uint32_t) offset),
+                BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, value, 0, (uint8_t) (loads * 2 + 1))
+            };
+            program.appendArray(compare, NELEM(compare));
+            offset += step;
+        }
+        program.add(accept);
+    }
+
+    sock_filter reject = BPF_STMT(BPF_RET | BPF_K, kFilterReject);
+    program.add(reject);
+    return program.size() <= BPF_MAXINSNS;
+}
+
+/**
+ * Recompiles the matches. Must be called with gMatchesMutex held.
+ */
+static void updateMatches() {
+    gAutomaton.build(gMatches);
+
+    int fd = uevent_get_fd();
+    if (fd < 0) return;
+
+    Vector<sock_filter> program;
+    if (buildSocketFilter(program)) {
+        sock_fprog filter;
+        filter.len = program.size();
+        filter.filter = program.editArray();
+        if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &filter, sizeof(filter))) {
+            ALOGW("Unable to attach uevent socket filter: %s", strerror(errno));
+        }
+    } else {
+        // The value is ignored but must be an int. Fails with ENOENT when
+        // no filter is attached
+        int unused = 0;
+        setsockopt(fd, SOL_SOCKET, SO_DETACH_FILTER, &unused, sizeof(unused));
+    }
+}
 
 static void nativeSetup(JNIEnv *env, jclass clazz) {
     if (!uevent_init()) {
         jniThrowException(env, "java/lang/RuntimeException",
                 "Unable to open socket for UEventObserver");
+        return;
     }
+
+    AutoMutex _l(gMatchesMutex);
+    updateMatches();
 }
 
 static bool isMatch(const char* buffer, size_t length) {
     AutoMutex _l(gMatchesMutex);
 
-    for (size_t i = 0; i < gMatches.size(); i++) {
-        const String8& match = gMatches.itemAt(i);
-
-        // Consider all zero-delimited fields of the buffer.
-        const char* field = buffer;
-        const char* end = buffer + length + 1;
-        do {
-            if (strstr(field, match.string())) {
-                ALOGV("Matched uevent message with pattern: %s", match.string());
-                return true;
-            }
-            field += strlen(field) + 1;
-        } while (field != end);
+    if (gAutomaton.matches(buffer, length)) {
+        ALOGV("Matched uevent message");
+        return true;
     }
     return false;
 }
@@ -89,6 +314,7 @@ static void nativeAddMatch(JNIEnv* env, jclass clazz, jstring matchStr) {
 
     AutoMutex _l(gMatchesMutex);
     gMatches.add(String8(match.c_str()));
+    updateMatches();
 }
 
 static void nativeRemoveMatch(JNIEnv* env, jclass clazz, jstring matchStr) {
@@ -98,6 +324,7 @@ static void nativeRemoveMatch(JNIEnv* env, jclass clazz, jstring matchStr) {
     for (size_t i = 0; i < gMatches.size(); i++) {
         if (gMatches.itemAt(i) == match.c_str()) {
             gMatches.removeAt(i);
+            updateMatches();
             break; // only remove first occurrence
         }
     }
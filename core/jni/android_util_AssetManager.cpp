@@ -342,6 +342,40 @@ static jobject android_content_AssetManager_openNonAssetFdNative(JNIEnv* env, jo
     return returnParcelFileDescriptor(env, a, outOffsets);
 }
 
+static void android_content_AssetManager_prefetch(JNIEnv* env, jobject clazz,
+                                                 jobjectArray fileNames, jboolean nonAsset)
+{
+    if (fileNames == NULL) {
+        jniThrowNullPointerException(env, "fileNames");
+        return;
+    }
+
+    AssetManager* am = assetManagerForJavaObject(env, clazz);
+    if (am == NULL) {
+        return;
+    }
+
+    const jsize N = env->GetArrayLength(fileNames);
+    Vector<String8> names;
+    for (jsize i = 0; i < N; i++) {
+        jstring fileName = (jstring) env->GetObjectArrayElement(fileNames, i);
+        if (fileName == NULL) {
+            jniThrowNullPointerException(env, "fileName");
+            return;
+        }
+        {
+            ScopedUtfChars fileName8(env, fileName);
+            if (fileName8.c_str() == NULL) {
+                return;
+            }
+            names.add(String8(fileName8.c_str()));
+        }
+        env->DeleteLocalRef(fileName);
+    }
+
+    am->prefetch(names, nonAsset);
+}
+
 static jobjectArray android_content_AssetManager_list(JNIEnv* env, jobject clazz,
                                                    jstring fileName)
 {
@@ -972,63 +1006,18 @@ static void android_content_AssetManager_dumpTheme(JNIEnv* env, jobject clazz,
     theme->dumpToLog();
 }
 
-static jboolean android_content_AssetManager_applyStyle(JNIEnv* env, jobject clazz,
-                                                        jlong themeToken,
-                                                        jint defStyleAttr,
-                                                        jint defStyleRes,
-                                                        jlong xmlParserToken,
-                                                        jintArray attrs,
-                                                        jintArray outValues,
-                                                        jintArray outIndices)
+// Resolves the attributes of one style request into 'dest', which holds
+// STYLE_NUM_ENTRIES values per attribute, and the indices of the attributes
+// that have a value into 'indices', if not NULL.  The table of the theme
+// must be locked.
+static bool applyStyleLocked(JNIEnv* env, ResTable::Theme* theme, uint32_t defStyleAttr,
+        uint32_t defStyleRes, ResXMLParser* xmlParser, const jint* src, jsize NI,
+        jint* dest, jint* indices)
 {
-    if (themeToken == 0) {
-        jniThrowNullPointerException(env, "theme token");
-        return JNI_FALSE;
-    }
-    if (attrs == NULL) {
-        jniThrowNullPointerException(env, "attrs");
-        return JNI_FALSE;
-    }
-    if (outValues == NULL) {
-        jniThrowNullPointerException(env, "out values");
-        return JNI_FALSE;
-    }
-
-    DEBUG_STYLES(LOGI("APPLY STYLE: theme=0x%x defStyleAttr=0x%x defStyleRes=0x%x xml=0x%x",
-        themeToken, defStyleAttr, defStyleRes, xmlParserToken));
-
-    ResTable::Theme* theme = reinterpret_cast<ResTable::Theme*>(themeToken);
     const ResTable& res = theme->getResTable();
-    ResXMLParser* xmlParser = reinterpret_cast<ResXMLParser*>(xmlParserToken);
     ResTable_config config;
     Res_value value;
-
-    const jsize NI = env->GetArrayLength(attrs);
-    const jsize NV = env->GetArrayLength(outValues);
-    if (NV < (NI*STYLE_NUM_ENTRIES)) {
-        jniThrowException(env, "java/lang/IndexOutOfBoundsException", "out values too small");
-        return JNI_FALSE;
-    }
-
-    jint* src = (jint*)env->GetPrimitiveArrayCritical(attrs, 0);
-    if (src == NULL) {
-        return JNI_FALSE;
-    }
-
-    jint* baseDest = (jint*)env->GetPrimitiveArrayCritical(outValues, 0);
-    jint* dest = baseDest;
-    if (dest == NULL) {
-        env->ReleasePrimitiveArrayCritical(attrs, src, 0);
-        return JNI_FALSE;
-    }
-
-    jint* indices = NULL;
     int indicesIdx = 0;
-    if (outIndices != NULL) {
-        if (env->GetArrayLength(outIndices) > NI) {
-            indices = (jint*)env->GetPrimitiveArrayCritical(outIndices, 0);
-        }
-    }
 
     // Load default style from attribute, if specified...
     uint32_t defStyleBagTypeSetFlags = 0;
@@ -1058,9 +1047,6 @@ static jboolean android_content_AssetManager_applyStyle(JNIEnv* env, jobject cla
         }
     }
 
-    // Now lock down the resource object and start pulling stuff from it.
-    res.lock();
-
     // Retrieve the default style bag, if requested.
     const ResTable::bag_entry* defStyleEnt = NULL;
     uint32_t defStyleTypeSetFlags = 0;
@@ -1169,7 +1155,7 @@ static jboolean android_content_AssetManager_applyStyle(JNIEnv* env, jobject cla
 #if THROW_ON_BAD_ID
                 if (newBlock == BAD_INDEX) {
                     jniThrowException(env, "java/lang/IllegalStateException", "Bad resource!");
-                    return JNI_FALSE;
+                    return false;
                 }
 #endif
                 if (newBlock >= 0) block = newBlock;
@@ -1205,16 +1191,188 @@ static jboolean android_content_AssetManager_applyStyle(JNIEnv* env, jobject cla
         dest += STYLE_NUM_ENTRIES;
     }
 
+    if (indices != NULL) {
+        indices[0] = indicesIdx;
+    }
+    return true;
+}
+
+static jboolean android_content_AssetManager_applyStyle(JNIEnv* env, jobject clazz,
+                                                        jlong themeToken,
+                                                        jint defStyleAttr,
+                                                        jint defStyleRes,
+                                                        jlong xmlParserToken,
+                                                        jintArray attrs,
+                                                        jintArray outValues,
+                                                        jintArray outIndices)
+{
+    if (themeToken == 0) {
+        jniThrowNullPointerException(env, "theme token");
+        return JNI_FALSE;
+    }
+    if (attrs == NULL) {
+        jniThrowNullPointerException(env, "attrs");
+        return JNI_FALSE;
+    }
+    if (outValues == NULL) {
+        jniThrowNullPointerException(env, "out values");
+        return JNI_FALSE;
+    }
+
+    DEBUG_STYLES(LOGI("APPLY STYLE: theme=0x%x defStyleAttr=0x%x defStyleRes=0x%x xml=0x%x",
+        themeToken, defStyleAttr, defStyleRes, xmlParserToken));
+
+    ResTable::Theme* theme = reinterpret_cast<ResTable::Theme*>(themeToken);
+    const ResTable& res = theme->getResTable();
+    ResXMLParser* xmlParser = reinterpret_cast<ResXMLParser*>(xmlParserToken);
+
+    const jsize NI = env->GetArrayLength(attrs);
+    const jsize NV = env->GetArrayLength(outValues);
+    if (NV < (NI*STYLE_NUM_ENTRIES)) {
+        jniThrowException(env, "java/lang/IndexOutOfBoundsException", "out values too small");
+        return JNI_FALSE;
+    }
+
+    jint* src = (jint*)env->GetPrimitiveArrayCritical(attrs, 0);
+    if (src == NULL) {
+        return JNI_FALSE;
+    }
+
+    jint* baseDest = (jint*)env->GetPrimitiveArrayCritical(outValues, 0);
+    if (baseDest == NULL) {
+        env->ReleasePrimitiveArrayCritical(attrs, src, 0);
+        return JNI_FALSE;
+    }
+
+    jint* indices = NULL;
+    if (outIndices != NULL) {
+        if (env->GetArrayLength(outIndices) > NI) {
+            indices = (jint*)env->GetPrimitiveArrayCritical(outIndices, 0);
+        }
+    }
+
+    // Now lock down the resource object and start pulling stuff from it.
+    res.lock();
+    const bool applied = applyStyleLocked(env, theme, defStyleAttr, defStyleRes, xmlParser,
+            src, NI, baseDest, indices);
     res.unlock();
 
     if (indices != NULL) {
-        indices[0] = indicesIdx;
         env->ReleasePrimitiveArrayCritical(outIndices, indices, 0);
     }
     env->ReleasePrimitiveArrayCritical(outValues, baseDest, 0);
     env->ReleasePrimitiveArrayCritical(attrs, src, 0);
 
-    return JNI_TRUE;
+    return applied ? JNI_TRUE : JNI_FALSE;
+}
+
+static jboolean android_content_AssetManager_applyStyles(JNIEnv* env, jobject clazz,
+                                                         jlong themeToken,
+                                                         jlong xmlParserToken,
+                                                         jintArray requests,
+                                                         jintArray attrs,
+                                                         jintArray outValues,
+                                                         jintArray outIndices)
+{
+    if (themeToken == 0) {
+        jniThrowNullPointerException(env, "theme token");
+        return JNI_FALSE;
+    }
+    if (requests == NULL) {
+        jniThrowNullPointerException(env, "requests");
+        return JNI_FALSE;
+    }
+    if (attrs == NULL) {
+        jniThrowNullPointerException(env, "attrs");
+        return JNI_FALSE;
+    }
+    if (outValues == NULL) {
+        jniThrowNullPointerException(env, "out values");
+        return JNI_FALSE;
+    }
+
+    ResTable::Theme* theme = reinterpret_cast<ResTable::Theme*>(themeToken);
+    const ResTable& res = theme->getResTable();
+    ResXMLParser* xmlParser = reinterpret_cast<ResXMLParser*>(xmlParserToken);
+
+    // Each request is a (defStyleAttr, defStyleRes, attribute count) triple,
+    // the attributes of the requests are concatenated in 'attrs' and their
+    // results in 'outValues' and 'outIndices', in the layout of applyStyle().
+    const jsize NR = env->GetArrayLength(requests);
+    if (NR % 3 != 0) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", "bad requests length");
+        return JNI_FALSE;
+    }
+    const jsize NI = env->GetArrayLength(attrs);
+    jint* reqs = env->GetIntArrayElements(requests, NULL);
+    if (reqs == NULL) {
+        return JNI_FALSE;
+    }
+    jsize totalAttrs = 0;
+    for (jsize i=0; i<NR; i+=3) {
+        if (reqs[i+2] < 0) {
+            totalAttrs = -1;
+            break;
+        }
+        totalAttrs += reqs[i+2];
+    }
+    if (totalAttrs != NI) {
+        env->ReleaseIntArrayElements(requests, reqs, JNI_ABORT);
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "attribute counts do not match attrs");
+        return JNI_FALSE;
+    }
+    if (env->GetArrayLength(outValues) < (NI*STYLE_NUM_ENTRIES)) {
+        env->ReleaseIntArrayElements(requests, reqs, JNI_ABORT);
+        jniThrowException(env, "java/lang/IndexOutOfBoundsException", "out values too small");
+        return JNI_FALSE;
+    }
+    // Every request has its own count followed by the indices.
+    const bool hasIndices = outIndices != NULL
+            && env->GetArrayLength(outIndices) >= NI + NR / 3;
+
+    jint* src = (jint*)env->GetPrimitiveArrayCritical(attrs, 0);
+    if (src == NULL) {
+        env->ReleaseIntArrayElements(requests, reqs, JNI_ABORT);
+        return JNI_FALSE;
+    }
+
+    jint* baseDest = (jint*)env->GetPrimitiveArrayCritical(outValues, 0);
+    if (baseDest == NULL) {
+        env->ReleasePrimitiveArrayCritical(attrs, src, 0);
+        env->ReleaseIntArrayElements(requests, reqs, JNI_ABORT);
+        return JNI_FALSE;
+    }
+
+    jint* baseIndices = hasIndices
+            ? (jint*)env->GetPrimitiveArrayCritical(outIndices, 0) : NULL;
+
+    // A single lock acquisition for all the requests.
+    res.lock();
+    bool applied = true;
+    const jint* curSrc = src;
+    jint* dest = baseDest;
+    jint* indices = baseIndices;
+    for (jsize i=0; applied && i<NR; i+=3) {
+        const jsize count = reqs[i+2];
+        applied = applyStyleLocked(env, theme, reqs[i], reqs[i+1], xmlParser,
+                curSrc, count, dest, indices);
+        curSrc += count;
+        dest += count*STYLE_NUM_ENTRIES;
+        if (indices != NULL) {
+            indices += count + 1;
+        }
+    }
+    res.unlock();
+
+    if (baseIndices != NULL) {
+        env->ReleasePrimitiveArrayCritical(outIndices, baseIndices, 0);
+    }
+    env->ReleasePrimitiveArrayCritical(outValues, baseDest, 0);
+    env->ReleasePrimitiveArrayCritical(attrs, src, 0);
+    env->ReleaseIntArrayElements(requests, reqs, JNI_ABORT);
+
+    return applied ? JNI_TRUE : JNI_FALSE;
 }
 
 static jboolean android_content_AssetManager_retrieveAttributes(JNIEnv* env, jobject clazz,
@@ -1620,6 +1778,29 @@ static jobjectArray android_content_AssetManager_getArrayStringResource(JNIEnv*
     return array;
 }
 
+static jboolean android_content_AssetManager_precomputeSharedBags(JNIEnv* env, jobject clazz,
+                                                                  jintArray styleResIds)
+{
+    if (styleResIds == NULL) {
+        jniThrowNullPointerException(env, "styleResIds");
+        return JNI_FALSE;
+    }
+
+    AssetManager* am = assetManagerForJavaObject(env, clazz);
+    if (am == NULL) {
+        return JNI_FALSE;
+    }
+
+    const jsize N = env->GetArrayLength(styleResIds);
+    jint* ids = env->GetIntArrayElements(styleResIds, NULL);
+    if (ids == NULL) {
+        return JNI_FALSE;
+    }
+    const bool precomputed = am->precomputeSharedBags((const uint32_t*)ids, N);
+    env->ReleaseIntArrayElements(styleResIds, ids, JNI_ABORT);
+    return precomputed ? JNI_TRUE : JNI_FALSE;
+}
+
 static jintArray android_content_AssetManager_getArrayIntResource(JNIEnv* env, jobject clazz,
                                                                         jint arrayResId)
 {
@@ -1730,6 +1911,8 @@ static JNINativeMethod gAssetManagerMethods[] = {
         (void*) android_content_AssetManager_openNonAssetNative },
     { "openNonAssetFdNative", "(ILjava/lang/String;[J)Landroid/os/ParcelFileDescriptor;",
         (void*) android_content_AssetManager_openNonAssetFdNative },
+    { "prefetch",       "([Ljava/lang/String;Z)V",
+        (void*) android_content_AssetManager_prefetch },
     { "list",           "(Ljava/lang/String;)[Ljava/lang/String;",
         (void*) android_content_AssetManager_list },
     { "destroyAsset",   "(J)V",
@@ -1794,12 +1977,16 @@ static JNINativeMethod gAssetManagerMethods[] = {
         (void*) android_content_AssetManager_dumpTheme },
     { "applyStyle","(JIIJ[I[I[I)Z",
         (void*) android_content_AssetManager_applyStyle },
+    { "applyStyles","(JJ[I[I[I[I)Z",
+        (void*) android_content_AssetManager_applyStyles },
     { "retrieveAttributes","(J[I[I[I)Z",
         (void*) android_content_AssetManager_retrieveAttributes },
     { "getArraySize","(I)I",
         (void*) android_content_AssetManager_getArraySize },
     { "retrieveArray","(I[I)I",
         (void*) android_content_AssetManager_retrieveArray },
+    { "precomputeSharedBags","([I)Z",
+        (void*) android_content_AssetManager_precomputeSharedBags },
 
     // XML files.
     { "openXmlAssetNative", "(ILjava/lang/String;)J",
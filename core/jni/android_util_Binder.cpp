@@ -23,7 +23,9 @@
 #include "JNIHelp.h"
 
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -33,12 +35,14 @@
 #include <binder/IPCThreadState.h>
 #include <utils/Log.h>
 #include <utils/SystemClock.h>
+#include <utils/Timers.h>
 #include <utils/List.h>
 #include <utils/KeyedVector.h>
 #include <log/logger.h>
 #include <binder/Parcel.h>
 #include <binder/ProcessState.h>
 #include <binder/IServiceManager.h>
+#include <cutils/ashmem.h>
 #include <utils/threads.h>
 #include <utils/String8.h>
 
@@ -220,13 +224,99 @@ bail:
     env->DeleteLocalRef(msgstr);
 }
 
+// ----------------------------------------------------------------------------
+// Large payloads
+// ----------------------------------------------------------------------------
+
+/*
+ * Transactions whose data exceeds LARGE_PAYLOAD_THRESHOLD are sent through an
+ * ashmem region instead of the binder buffer, which is only 1MB and shared by
+ * every transaction in flight to the process. Only the region's fd crosses
+ * binder, with the dedicated LARGE_PAYLOAD_TRANSACTION code; the receiving
+ * JavaBBinder copies the region into the data parcel of the original code.
+ *
+ * Both sides opt in: the receiving Binder with setAcceptsLargePayloads(), any
+ * other binder rejects the code as unknown, and the caller by setting
+ * FLAG_LARGE_PAYLOAD on a transaction to such a Binder. The flag is never
+ * passed on to the driver.
+ */
+#define FLAG_LARGE_PAYLOAD          0x00010000
+#define LARGE_PAYLOAD_THRESHOLD     (256 * 1024)
+#define LARGE_PAYLOAD_MAGIC         0x4c504159 // 'LPAY'
+#define LARGE_PAYLOAD_TRANSACTION   B_PACK_CHARS('_', 'L', 'P', 'Y')
+
+// Writes the wrapped form of data into wrapped: the magic, the original code,
+// the payload size and a read-only ashmem region holding the payload.
+static status_t wrapLargePayload(uint32_t code, const Parcel& data, Parcel* wrapped)
+{
+    const size_t size = data.dataSize();
+    int fd = ashmem_create_region("binder payload", size);
+    if (fd < 0) {
+        return NO_MEMORY;
+    }
+
+    status_t err = NO_ERROR;
+    void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        err = -errno;
+    } else {
+        memcpy(ptr, data.data(), size);
+        munmap(ptr, size);
+        if (ashmem_set_prot_region(fd, PROT_READ) < 0) {
+            err = -errno;
+        }
+    }
+
+    if (err == NO_ERROR) {
+        err = wrapped->writeInt32(LARGE_PAYLOAD_MAGIC);
+    }
+    if (err == NO_ERROR) {
+        err = wrapped->writeInt32(code);
+    }
+    if (err == NO_ERROR) {
+        err = wrapped->writeInt32(size);
+    }
+    if (err == NO_ERROR) {
+        // The parcel owns the fd from here on
+        return wrapped->writeFileDescriptor(fd, true /*takeOwnership*/);
+    }
+    close(fd);
+    return err;
+}
+
+// Copies the payload of a parcel made by wrapLargePayload() into unwrapped and
+// returns its original code in outCode. The sender may still have the region
+// mapped writable, the payload is copied before anything parses it.
+static status_t unwrapLargePayload(const Parcel& data, uint32_t* outCode, Parcel* unwrapped)
+{
+    if (data.objectsCount() != 1 || data.readInt32() != LARGE_PAYLOAD_MAGIC) {
+        return BAD_VALUE;
+    }
+    const uint32_t code = data.readInt32();
+    const int32_t size = data.readInt32();
+    const int fd = data.readFileDescriptor();
+    if (size <= 0 || fd < 0 || ashmem_get_size_region(fd) < size) {
+        return BAD_VALUE;
+    }
+
+    void* ptr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        return -errno;
+    }
+    status_t err = unwrapped->setData(reinterpret_cast<const uint8_t*>(ptr), size);
+    munmap(ptr, size);
+    *outCode = code;
+    return err;
+}
+
 class JavaBBinderHolder;
 
 class JavaBBinder : public BBinder
 {
 public:
-    JavaBBinder(JNIEnv* env, jobject object)
-        : mVM(jnienv_to_javavm(env)), mObject(env->NewGlobalRef(object))
+    JavaBBinder(JNIEnv* env, jobject object, bool acceptsLargePayloads)
+        : mVM(jnienv_to_javavm(env)), mObject(env->NewGlobalRef(object)),
+          mAcceptsLargePayloads(acceptsLargePayloads)
     {
         ALOGV("Creating JavaBBinder %p\n", this);
         android_atomic_inc(&gNumLocalRefs);
@@ -243,6 +333,11 @@ public:
         return mObject;
     }
 
+    void setAcceptsLargePayloads(bool accepts)
+    {
+        android_atomic_release_store(accepts ? 1 : 0, &mAcceptsLargePayloads);
+    }
+
 protected:
     virtual ~JavaBBinder()
     {
@@ -266,8 +361,22 @@ protected:
         //printf("Transact from %p to Java code sending: ", this);
         //data.print();
         //printf("\n");
+        const Parcel* javaData = &data;
+        Parcel unwrapped;
+        if (code == LARGE_PAYLOAD_TRANSACTION) {
+            if (!android_atomic_acquire_load(&mAcceptsLargePayloads)) {
+                return UNKNOWN_TRANSACTION;
+            }
+            status_t err = unwrapLargePayload(data, &code, &unwrapped);
+            if (err != NO_ERROR) {
+                ALOGE("Unable to read large transaction payload: %d", err);
+                return err;
+            }
+            javaData = &unwrapped;
+        }
+
         jboolean res = env->CallBooleanMethod(mObject, gBinderOffsets.mExecTransact,
-            code, reinterpret_cast<jlong>(&data), reinterpret_cast<jlong>(reply), flags);
+            code, reinterpret_cast<jlong>(javaData), reinterpret_cast<jlong>(reply), flags);
         jthrowable excep = env->ExceptionOccurred();
 
         if (excep) {
@@ -320,6 +429,7 @@ protected:
 private:
     JavaVM* const   mVM;
     jobject const   mObject;
+    volatile int32_t mAcceptsLargePayloads;
 };
 
 // ----------------------------------------------------------------------------
@@ -327,12 +437,14 @@ private:
 class JavaBBinderHolder : public RefBase
 {
 public:
+    JavaBBinderHolder() : mAcceptsLargePayloads(false) {}
+
     sp<JavaBBinder> get(JNIEnv* env, jobject obj)
     {
         AutoMutex _l(mLock);
         sp<JavaBBinder> b = mBinder.promote();
         if (b == NULL) {
-            b = new JavaBBinder(env, obj);
+            b = new JavaBBinder(env, obj, mAcceptsLargePayloads);
             mBinder = b;
             ALOGV("Creating JavaBinder %p (refs %p) for Object %p, weakCount=%d\n",
                  b.get(), b->getWeakRefs(), obj, b->getWeakRefs()->getWeakCount());
@@ -347,9 +459,20 @@ public:
         return mBinder.promote();
     }
 
+    void setAcceptsLargePayloads(bool accepts)
+    {
+        AutoMutex _l(mLock);
+        mAcceptsLargePayloads = accepts;
+        sp<JavaBBinder> b = mBinder.promote();
+        if (b != NULL) {
+            b->setAcceptsLargePayloads(accepts);
+        }
+    }
+
 private:
     Mutex           mLock;
     wp<JavaBBinder> mBinder;
+    bool            mAcceptsLargePayloads;
 };
 
 // ----------------------------------------------------------------------------
@@ -786,6 +909,16 @@ static void android_os_Binder_destroy(JNIEnv* env, jobject obj)
     }
 }
 
+static void android_os_Binder_setAcceptsLargePayloads(JNIEnv* env, jobject obj,
+        jboolean accepts)
+{
+    JavaBBinderHolder* jbh = (JavaBBinderHolder*)
+        env->GetLongField(obj, gBinderOffsets.mObject);
+    if (jbh != NULL) {
+        jbh->setAcceptsLargePayloads(accepts);
+    }
+}
+
 // ----------------------------------------------------------------------------
 
 static const JNINativeMethod gBinderMethods[] = {
@@ -798,7 +931,8 @@ static const JNINativeMethod gBinderMethods[] = {
     { "getThreadStrictModePolicy", "()I", (void*)android_os_Binder_getThreadStrictModePolicy },
     { "flushPendingCommands", "()V", (void*)android_os_Binder_flushPendingCommands },
     { "init", "()V", (void*)android_os_Binder_init },
-    { "destroy", "()V", (void*)android_os_Binder_destroy }
+    { "destroy", "()V", (void*)android_os_Binder_destroy },
+    { "setAcceptsLargePayloads", "(Z)V", (void*)android_os_Binder_setAcceptsLargePayloads }
 };
 
 const char* const kBinderPathName = "android/os/Binder";
@@ -869,6 +1003,17 @@ static void android_os_BinderInternal_disableBackgroundScheduling(JNIEnv* env,
     IPCThreadState::disableBackgroundScheduling(disable ? true : false);
 }
 
+static void android_os_BinderInternal_dumpCallStats(JNIEnv* env, jobject clazz,
+        jobject fileDescriptor)
+{
+    int fd = jniGetFDFromFileDescriptor(env, fileDescriptor);
+    if (fd < 0) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", "bad file descriptor");
+        return;
+    }
+    dumpBinderCallStats(fd);
+}
+
 static void android_os_BinderInternal_handleGc(JNIEnv* env, jobject clazz)
 {
     ALOGV("Gc has executed, clearing binder ops");
@@ -882,7 +1027,8 @@ static const JNINativeMethod gBinderInternalMethods[] = {
     { "getContextObject", "()Landroid/os/IBinder;", (void*)android_os_BinderInternal_getContextObject },
     { "joinThreadPool", "()V", (void*)android_os_BinderInternal_joinThreadPool },
     { "disableBackgroundScheduling", "(Z)V", (void*)android_os_BinderInternal_disableBackgroundScheduling },
-    { "handleGc", "()V", (void*)android_os_BinderInternal_handleGc }
+    { "handleGc", "()V", (void*)android_os_BinderInternal_handleGc },
+    { "nativeDumpCallStats", "(Ljava/io/FileDescriptor;)V", (void*)android_os_BinderInternal_dumpCallStats }
 };
 
 const char* const kBinderInternalPathName = "com/android/internal/os/BinderInternal";
@@ -1044,6 +1190,196 @@ static bool should_time_binder_calls() {
 #endif
 }
 
+// ----------------------------------------------------------------------------
+// Call latency statistics
+// ----------------------------------------------------------------------------
+
+/*
+ * Every BinderProxy.transact() is counted in a latency histogram keyed by the
+ * target and the transaction code. Each thread records into its own table
+ * without locking; dumpBinderCallStats() merges the tables by interface
+ * descriptor, which it only resolves then as it may need a transaction of its
+ * own. A table is only ever written by its owning thread: an entry's
+ * key is filled in before it is published by bumping the table's entry count,
+ * and the buckets are 32 bit counters that the dump may read slightly stale.
+ *
+ * Tables are never freed. When a thread exits its table goes back to a pool
+ * and is adopted by the next new thread, so counts survive thread churn and
+ * the number of tables is bounded by the peak number of calling threads.
+ */
+#define CALL_STATS_BUCKETS          20  // bucket i counts calls of [2^i, 2^(i+1)) us
+#define CALL_STATS_TABLE_ENTRIES    64
+
+struct CallStatsEntry {
+    // The target is held weakly: proxies extend their lifetime to weak
+    // references, so the pointer cannot be reused while the entry exists.
+    wp<IBinder> target;
+    uint32_t code;
+    volatile uint32_t buckets[CALL_STATS_BUCKETS];
+};
+
+struct CallStatsTable {
+    CallStatsTable* next;
+    volatile int32_t count;
+    volatile uint32_t dropped;
+    CallStatsEntry entries[CALL_STATS_TABLE_ENTRIES];
+};
+
+static pthread_once_t gCallStatsOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t gCallStatsKey;
+static Mutex gCallStatsLock;
+static CallStatsTable* gCallStatsTables = NULL; // all tables, guarded by gCallStatsLock
+static Vector<CallStatsTable*> gCallStatsPool;  // tables of exited threads, guarded by gCallStatsLock
+
+static void releaseCallStatsTable(void* table)
+{
+    AutoMutex _l(gCallStatsLock);
+    gCallStatsPool.push(reinterpret_cast<CallStatsTable*>(table));
+}
+
+static void initCallStatsKey()
+{
+    pthread_key_create(&gCallStatsKey, releaseCallStatsTable);
+}
+
+static CallStatsTable* getCallStatsTable()
+{
+    pthread_once(&gCallStatsOnce, initCallStatsKey);
+    CallStatsTable* table = reinterpret_cast<CallStatsTable*>(pthread_getspecific(gCallStatsKey));
+    if (table == NULL) {
+        AutoMutex _l(gCallStatsLock);
+        if (!gCallStatsPool.isEmpty()) {
+            table = gCallStatsPool.top();
+            gCallStatsPool.pop();
+        } else {
+            table = new CallStatsTable();
+            table->next = gCallStatsTables;
+            table->count = 0;
+            table->dropped = 0;
+            gCallStatsTables = table;
+        }
+        pthread_setspecific(gCallStatsKey, table);
+    }
+    return table;
+}
+
+static void recordBinderCall(IBinder* target, uint32_t code, nsecs_t duration)
+{
+    CallStatsTable* table = getCallStatsTable();
+
+    CallStatsEntry* entry = NULL;
+    const int32_t count = table->count;
+    for (int32_t i = 0; i < count; i++) {
+        if (table->entries[i].code == code && table->entries[i].target == target) {
+            entry = &table->entries[i];
+            break;
+        }
+    }
+    if (entry == NULL) {
+        if (count == CALL_STATS_TABLE_ENTRIES) {
+            table->dropped++;
+            return;
+        }
+        entry = &table->entries[count];
+        entry->target = target;
+        entry->code = code;
+        memset((void*) entry->buckets, 0, sizeof(entry->buckets));
+        android_atomic_release_store(count + 1, &table->count);
+    }
+
+    const uint64_t us = ns2us(duration);
+    int bucket = 0;
+    while (bucket < CALL_STATS_BUCKETS - 1 && (us >> (bucket + 1)) != 0) {
+        bucket++;
+    }
+    entry->buckets[bucket]++;
+}
+
+namespace android {
+
+void dumpBinderCallStats(int fd)
+{
+    struct Merged {
+        String16 descriptor;
+        uint32_t code;
+        uint32_t buckets[CALL_STATS_BUCKETS];
+    };
+    struct Target {
+        wp<IBinder> target;
+        uint32_t code;
+        uint32_t buckets[CALL_STATS_BUCKETS];
+    };
+    Vector<Target> targets;
+    uint32_t dropped = 0;
+
+    {
+        AutoMutex _l(gCallStatsLock);
+        for (CallStatsTable* table = gCallStatsTables; table != NULL; table = table->next) {
+            const int32_t count = android_atomic_acquire_load(&table->count);
+            for (int32_t i = 0; i < count; i++) {
+                const CallStatsEntry& entry = table->entries[i];
+                Target t;
+                t.target = entry.target;
+                t.code = entry.code;
+                for (int b = 0; b < CALL_STATS_BUCKETS; b++) {
+                    t.buckets[b] = entry.buckets[b];
+                }
+                targets.push(t);
+            }
+            dropped += table->dropped;
+        }
+    }
+
+    // Descriptors are resolved without the lock, asking a remote binder for
+    // its descriptor is a transaction
+    Vector<Merged> merged;
+    for (size_t i = 0; i < targets.size(); i++) {
+        const Target& t = targets[i];
+        sp<IBinder> target = t.target.promote();
+        const String16 descriptor = target != NULL
+                ? target->getInterfaceDescriptor() : String16("<released binder>");
+
+        size_t index = 0;
+        while (index < merged.size() && (merged[index].code != t.code
+                || merged[index].descriptor != descriptor)) {
+            index++;
+        }
+        if (index == merged.size()) {
+            Merged m;
+            m.descriptor = descriptor;
+            m.code = t.code;
+            memset(m.buckets, 0, sizeof(m.buckets));
+            merged.push(m);
+        }
+        Merged& m = merged.editItemAt(index);
+        for (int b = 0; b < CALL_STATS_BUCKETS; b++) {
+            m.buckets[b] += t.buckets[b];
+        }
+    }
+
+    String8 result;
+    result.appendFormat("Binder call latency (bucket i counts calls of [2^i, 2^(i+1)) us):\n");
+    for (size_t i = 0; i < merged.size(); i++) {
+        const Merged& m = merged[i];
+        uint64_t calls = 0;
+        for (int b = 0; b < CALL_STATS_BUCKETS; b++) {
+            calls += m.buckets[b];
+        }
+        result.appendFormat("  %s code=%u calls=%llu:",
+                String8(m.descriptor).string(), m.code, calls);
+        for (int b = 0; b < CALL_STATS_BUCKETS; b++) {
+            result.appendFormat(" %u", m.buckets[b]);
+        }
+        result.append("\n");
+    }
+    if (dropped != 0) {
+        result.appendFormat("  %u calls not recorded, thread tables full\n", dropped);
+    }
+    write(fd, result.string(), result.size());
+}
+
+}
+
 static jboolean android_os_BinderProxy_transact(JNIEnv* env, jobject obj,
         jint code, jobject dataObj, jobject replyObj, jint flags) // throws RemoteException
 {
@@ -1081,8 +1417,25 @@ static jboolean android_os_BinderProxy_transact(JNIEnv* env, jobject obj,
         start_millis = uptimeMillis();
     }
 #endif
+    Parcel wrapped;
+    uint32_t transactCode = code;
+    if ((flags & FLAG_LARGE_PAYLOAD) != 0) {
+        flags &= ~FLAG_LARGE_PAYLOAD;
+        if (data->dataSize() > LARGE_PAYLOAD_THRESHOLD && data->objectsCount() == 0) {
+            status_t err = wrapLargePayload(code, *data, &wrapped);
+            if (err != NO_ERROR) {
+                signalExceptionForError(env, obj, err, true /*canThrowRemoteException*/);
+                return JNI_FALSE;
+            }
+            data = &wrapped;
+            transactCode = LARGE_PAYLOAD_TRANSACTION;
+        }
+    }
+
     //printf("Transact from Java code to %p sending: ", target); data->print();
-    status_t err = target->transact(code, *data, reply, flags);
+    const nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    status_t err = target->transact(transactCode, *data, reply, flags);
+    recordBinderCall(target, code, systemTime(SYSTEM_TIME_MONOTONIC) - startTime);
     //if (reply) printf("Transact from Java code to %p received: ", target); reply->print();
 #if ENABLE_BINDER_SAMPLE
     if (time_binder_calls) {
@@ -35,6 +35,10 @@ extern void set_dalvik_blockguard_policy(JNIEnv* env, jint strict_policy);
 extern void signalExceptionForError(JNIEnv* env, jobject obj, status_t err,
         bool canThrowRemoteException = false);
 
+// Writes the per-interface, per-code latency histograms of the outgoing binder
+// calls made through BinderProxy.transact() to fd.
+extern void dumpBinderCallStats(int fd);
+
 }
 
 #endif
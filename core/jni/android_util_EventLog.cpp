@@ -20,6 +20,7 @@
 #include "android_runtime/AndroidRuntime.h"
 #include "jni.h"
 #include "log/logger.h"
+#include "android_util_Log.h"
 
 #define UNUSED  __attribute__((__unused__))
 
@@ -50,7 +51,10 @@ static jint android_util_EventLog_writeEvent_Integer(JNIEnv* env UNUSED,
                                                      jobject clazz UNUSED,
                                                      jint tag, jint value)
 {
-    return android_btWriteLog(tag, EVENT_TYPE_INT, &value, sizeof(value));
+    uint8_t buf[1 + sizeof(value)];
+    buf[0] = EVENT_TYPE_INT;
+    memcpy(&buf[1], &value, sizeof(value));
+    return android_util_Log_writeEvent(tag, buf, sizeof(buf));
 }
 
 /*
@@ -61,7 +65,10 @@ static jint android_util_EventLog_writeEvent_Long(JNIEnv* env UNUSED,
                                                   jobject clazz UNUSED,
                                                   jint tag, jlong value)
 {
-    return android_btWriteLog(tag, EVENT_TYPE_LONG, &value, sizeof(value));
+    uint8_t buf[1 + sizeof(value)];
+    buf[0] = EVENT_TYPE_LONG;
+    memcpy(&buf[1], &value, sizeof(value));
+    return android_util_Log_writeEvent(tag, buf, sizeof(buf));
 }
 
 /*
@@ -86,7 +93,7 @@ static jint android_util_EventLog_writeEvent_String(JNIEnv* env,
     buf[1 + sizeof(len) + len] = '\n';
 
     if (value != NULL) env->ReleaseStringUTFChars(value, str);
-    return android_bWriteLog(tag, buf, 2 + sizeof(len) + len);
+    return android_util_Log_writeEvent(tag, buf, 2 + sizeof(len) + len);
 }
 
 /*
@@ -140,7 +147,7 @@ static jint android_util_EventLog_writeEvent_Array(JNIEnv* env, jobject clazz,
     buf[0] = EVENT_TYPE_LIST;
     buf[1] = copied;
     buf[pos++] = '\n';
-    return android_bWriteLog(tag, buf, pos);
+    return android_util_Log_writeEvent(tag, buf, pos);
 }
 
 /*
@@ -19,6 +19,8 @@
 #include "jni.h"
 #include "utils/Log.h"
 #include "utils/misc.h"
+#include "utils/JenkinsHash.h"
+#include "utils/Timers.h"
 #include "android_runtime/AndroidRuntime.h"
 
 #include <stdio.h>
@@ -28,6 +30,8 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <errno.h>
+#include <limits.h>
+#include <poll.h>
 
 #ifdef HAVE_INOTIFY
 #include <sys/inotify.h>
@@ -36,6 +40,34 @@
 namespace android {
 
 static jmethodID method_onEvent;
+static jmethodID method_onEvents;
+
+#ifdef HAVE_INOTIFY
+
+// A batch is whatever fits in this buffer, at most one event per 16 bytes
+static const size_t kBatchBufferSize = 16384;
+static const size_t kMaxBatchEvents = kBatchBufferSize / sizeof(struct inotify_event);
+// Power of two, at most half full
+static const size_t kBatchHashSize = kMaxBatchEvents * 2;
+
+// Each event of a batch is packed as 4 ints: wd, mask, and the offset and
+// length of its name in the names array (length 0 when there is no name)
+enum {
+    kBatchWd = 0,
+    kBatchMask,
+    kBatchNameOffset,
+    kBatchNameLength,
+    kBatchStride
+};
+
+static inline uint32_t hashEvent(int wd, const char* name, size_t length)
+{
+    uint32_t hash = JenkinsHashMix(0, wd);
+    hash = JenkinsHashMixBytes(hash, (const uint8_t*) name, length);
+    return JenkinsHashWhiten(hash);
+}
+
+#endif // HAVE_INOTIFY
 
 static jint android_os_fileobserver_init(JNIEnv* env, jobject object)
 {
@@ -102,6 +134,136 @@ static void android_os_fileobserver_observe(JNIEnv* env, jobject object, jint fd
 #endif // HAVE_INOTIFY
 }
 
+/**
+ * Same as observe(), but reads events for up to windowMs after the first
+ * one of a burst, drops the events repeating the previous one for the same
+ * (wd, name) with the same mask, and delivers
+ * the whole batch with a single call to onEvents(int count, int[] events,
+ * byte[] names). Names are raw UTF-8 bytes, no string is created natively.
+ * The arrays are allocated once and reused for every batch.
+ */
+static void android_os_fileobserver_observeBatched(JNIEnv* env, jobject object, jint fd,
+        jint windowMs)
+{
+#ifdef HAVE_INOTIFY
+
+    jintArray eventsArray = env->NewIntArray(kMaxBatchEvents * kBatchStride);
+    jbyteArray namesArray = eventsArray != NULL ? env->NewByteArray(kBatchBufferSize) : NULL;
+    if (namesArray == NULL)
+    {
+        // OutOfMemoryError is pending
+        return;
+    }
+
+    char* event_buf = (char*) malloc(kBatchBufferSize);
+    jint* events = (jint*) malloc(kMaxBatchEvents * kBatchStride * sizeof(jint));
+    jbyte* names = (jbyte*) malloc(kBatchBufferSize);
+    int16_t* table = (int16_t*) malloc(kBatchHashSize * sizeof(int16_t));
+
+    while (event_buf != NULL && events != NULL && names != NULL && table != NULL)
+    {
+        int num_bytes = read(fd, event_buf, kBatchBufferSize);
+
+        if (num_bytes < (int)sizeof(struct inotify_event))
+        {
+            if (errno == EINTR)
+                continue;
+
+            ALOGE("***** ERROR! android_os_fileobserver_observeBatched() got a short event!");
+            break;
+        }
+
+        // Keep reading the rest of the burst until the window expires or
+        // the buffer may not hold another event
+        nsecs_t deadline = systemTime(SYSTEM_TIME_MONOTONIC) + milliseconds_to_nanoseconds(windowMs);
+        while (kBatchBufferSize - num_bytes >= sizeof(struct inotify_event) + NAME_MAX + 1)
+        {
+            nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+            if (now >= deadline)
+                break;
+
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            int res = poll(&pfd, 1, toMillisecondTimeoutDelay(now, deadline));
+            if (res < 0 && errno == EINTR)
+                continue;
+            if (res <= 0)
+                break;
+
+            int count = read(fd, event_buf + num_bytes, kBatchBufferSize - num_bytes);
+            if (count < (int)sizeof(struct inotify_event))
+            {
+                if (count < 0 && errno == EINTR)
+                    continue;
+                break;
+            }
+            num_bytes += count;
+        }
+
+        // The kernel only merges an event with the one right before it,
+        // duplicates further apart are dropped here. The table maps each
+        // (wd, name) to its last event, so a duplicate is only dropped when
+        // no other event for that file came in between.
+        memset(table, -1, kBatchHashSize * sizeof(int16_t));
+        int event_count = 0;
+        int names_length = 0;
+        int event_pos = 0;
+
+        while (num_bytes - event_pos >= (int)sizeof(struct inotify_event))
+        {
+            struct inotify_event* event = (struct inotify_event *)(event_buf + event_pos);
+            event_pos += sizeof(*event) + event->len;
+
+            // The name is padded with NULs up to len
+            const char* name = event->len > 0 ? event->name : "";
+            size_t name_length = strnlen(name, event->len);
+
+            size_t index = hashEvent(event->wd, name, name_length) & (kBatchHashSize - 1);
+            bool duplicate = false;
+            while (table[index] >= 0)
+            {
+                const jint* other = events + table[index] * kBatchStride;
+                if (other[kBatchWd] == event->wd &&
+                        other[kBatchNameLength] == (jint) name_length &&
+                        !memcmp(names + other[kBatchNameOffset], name, name_length))
+                {
+                    duplicate = other[kBatchMask] == (jint) event->mask;
+                    break;
+                }
+                index = (index + 1) & (kBatchHashSize - 1);
+            }
+            if (duplicate)
+                continue;
+
+            table[index] = event_count;
+            jint* packed = events + event_count * kBatchStride;
+            packed[kBatchWd] = event->wd;
+            packed[kBatchMask] = event->mask;
+            packed[kBatchNameOffset] = names_length;
+            packed[kBatchNameLength] = name_length;
+            memcpy(names + names_length, name, name_length);
+            names_length += name_length;
+            event_count++;
+        }
+
+        env->SetIntArrayRegion(eventsArray, 0, event_count * kBatchStride, events);
+        env->SetByteArrayRegion(namesArray, 0, names_length, names);
+        env->CallVoidMethod(object, method_onEvents, event_count, eventsArray, namesArray);
+        if (env->ExceptionCheck()) {
+            env->ExceptionDescribe();
+            env->ExceptionClear();
+        }
+    }
+
+    free(event_buf);
+    free(events);
+    free(names);
+    free(table);
+    env->DeleteLocalRef(eventsArray);
+    env->DeleteLocalRef(namesArray);
+
+#endif // HAVE_INOTIFY
+}
+
 static jint android_os_fileobserver_startWatching(JNIEnv* env, jobject object, jint fd, jstring pathString, jint mask)
 {
     int res = -1;
@@ -135,6 +297,7 @@ static JNINativeMethod sMethods[] = {
      /* name, signature, funcPtr */
     { "init", "()I", (void*)android_os_fileobserver_init },
     { "observe", "(I)V", (void*)android_os_fileobserver_observe },
+    { "observeBatched", "(II)V", (void*)android_os_fileobserver_observeBatched },
     { "startWatching", "(ILjava/lang/String;I)I", (void*)android_os_fileobserver_startWatching },
     { "stopWatching", "(II)V", (void*)android_os_fileobserver_stopWatching }
     
@@ -159,6 +322,13 @@ int register_android_os_FileObserver(JNIEnv* env)
         return -1;
     }
 
+    method_onEvents = env->GetMethodID(clazz, "onEvents", "(I[I[B)V");
+    if (method_onEvents == NULL)
+    {
+        ALOGE("Can't find FileObserver.onEvents(int, int[], byte[])");
+        return -1;
+    }
+
     return AndroidRuntime::registerNativeMethods(env, "android/os/FileObserver$ObserverThread", sMethods, NELEM(sMethods));
 }
 
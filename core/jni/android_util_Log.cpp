@@ -19,9 +19,17 @@
 #define LOG_TAG "Log_println"
 
 #include <assert.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <cutils/atomic.h>
 #include <cutils/properties.h>
+#include <log/logger.h>
 #include <utils/Log.h>
+#include <utils/Mutex.h>
 #include <utils/String8.h>
+#include <utils/Thread.h>
 
 #include "jni.h"
 #include "JNIHelp.h"
@@ -101,6 +109,281 @@ bool android_util_Log_isVerboseLogEnabled(const char* tag) {
     return isLoggable(tag, levels.verbose);
 }
 
+// ----------------------------------------------------------------------------
+
+/*
+ * Asynchronous log.
+ *
+ * Every write to the logger is a system call that can block the calling
+ * thread behind the other writers of the system. When the asynchronous log
+ * is enabled for the process, the writing threads copy their messages into
+ * a ring of fixed size records without taking a lock, and a background
+ * thread writes them to the logger in the order they were queued.
+ *
+ * Messages that do not fit in a record, or that find the ring full, are
+ * written synchronously once the queued messages are, so that the messages
+ * of a thread stay in order. The logger timestamps the messages when they
+ * are written, which may be a little after they were queued.
+ *
+ * The queued messages are written synchronously when the process exits or
+ * crashes with a signal, and when flushAsync() is called, for instance by
+ * the handler of uncaught exceptions.
+ */
+
+#define ASYNC_LOG_RECORD_COUNT 256 // power of two
+#define ASYNC_LOG_RECORD_PAYLOAD 1008
+
+enum {
+    ASYNC_LOG_TEXT,
+    ASYNC_LOG_EVENT
+};
+
+struct AsyncLogRecord {
+    // Position of the record in the ring when it can be written to, the
+    // position + 1 once it can be read from
+    volatile int32_t sequence;
+    uint8_t type;
+    uint8_t bufID;
+    uint8_t priority;
+    // Text: the tag, then the message, both null terminated
+    uint16_t tagLength;
+    uint16_t length;
+    int32_t eventTag;
+    char payload[ASYNC_LOG_RECORD_PAYLOAD];
+};
+
+static struct {
+    AsyncLogRecord records[ASYNC_LOG_RECORD_COUNT];
+    volatile int32_t enqueuePos;
+    // Only changed with the lock held
+    volatile int32_t dequeuePos;
+
+    volatile int32_t enabled;
+    volatile int32_t wakePending;
+    sem_t wake;
+} gAsyncLog;
+
+// Held while writing queued records, and while starting the writer
+static Mutex gAsyncLogLock;
+static sp<Thread> gAsyncLogThread;
+
+static const int kCrashSignals[] = { SIGABRT, SIGBUS, SIGFPE, SIGILL, SIGSEGV, SIGSTKFLT };
+static struct sigaction gOldCrashActions[NELEM(kCrashSignals)];
+
+static int writeAsyncLogRecord(const AsyncLogRecord& record) {
+    if (record.type == ASYNC_LOG_EVENT) {
+        return android_bWriteLog(record.eventTag, record.payload, record.length);
+    }
+    return __android_log_buf_write(record.bufID, (android_LogPriority) record.priority,
+            record.payload, record.payload + record.tagLength);
+}
+
+/*
+ * Writes the queued records. A record may be reserved by a thread that has not
+ * finished copying its message yet, the records after it are then only
+ * written once it is queued, when its writer wakes the thread up. Unless all
+ * is true, in which case every record reserved so far is waited for.
+ */
+static void drainAsyncLogLocked(bool all) {
+    const int32_t end = android_atomic_acquire_load(&gAsyncLog.enqueuePos);
+    for (;;) {
+        const int32_t pos = gAsyncLog.dequeuePos;
+        AsyncLogRecord& record = gAsyncLog.records[pos & (ASYNC_LOG_RECORD_COUNT - 1)];
+        if (android_atomic_acquire_load(&record.sequence) != pos + 1) {
+            if (all && pos - end < 0) {
+                sched_yield();
+                continue;
+            }
+            break;
+        }
+
+        writeAsyncLogRecord(record);
+        android_atomic_release_store(pos + ASYNC_LOG_RECORD_COUNT, &record.sequence);
+        android_atomic_release_store(pos + 1, &gAsyncLog.dequeuePos);
+    }
+}
+
+static void wakeAsyncLogThread() {
+    if (android_atomic_release_cas(0, 1, &gAsyncLog.wakePending) == 0) {
+        sem_post(&gAsyncLog.wake);
+    }
+}
+
+/*
+ * Waits for the writer thread to write every record reserved so far, for a
+ * caller that found the ring full and writes its message itself. Unlike
+ * flushAsyncLog() it doesn't take the lock, which the writer holds for the
+ * whole drain.
+ */
+static void waitForAsyncLog() {
+    const int32_t end = android_atomic_acquire_load(&gAsyncLog.enqueuePos);
+    wakeAsyncLogThread();
+    while (android_atomic_acquire_load(&gAsyncLog.dequeuePos) - end < 0) {
+        sched_yield();
+    }
+}
+
+static void flushAsyncLog() {
+    Mutex::Autolock _l(gAsyncLogLock);
+    drainAsyncLogLocked(true);
+}
+
+static bool queueAsyncLogRecord(uint8_t type, int bufID, int priority, int32_t eventTag,
+        const char* tag, size_t tagLength, const void* data, size_t length) {
+    if (tagLength + length > ASYNC_LOG_RECORD_PAYLOAD) {
+        return false;
+    }
+
+    int32_t pos = android_atomic_acquire_load(&gAsyncLog.enqueuePos);
+    AsyncLogRecord* record;
+    for (;;) {
+        record = &gAsyncLog.records[pos & (ASYNC_LOG_RECORD_COUNT - 1)];
+        const int32_t diff = android_atomic_acquire_load(&record->sequence) - pos;
+        if (diff == 0) {
+            if (android_atomic_release_cas(pos, pos + 1, &gAsyncLog.enqueuePos) == 0) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The ring is full
+            return false;
+        }
+        pos = android_atomic_acquire_load(&gAsyncLog.enqueuePos);
+    }
+
+    record->type = type;
+    record->bufID = bufID;
+    record->priority = priority;
+    record->eventTag = eventTag;
+    record->tagLength = tagLength;
+    record->length = tagLength + length;
+    memcpy(record->payload, tag, tagLength);
+    memcpy(record->payload + tagLength, data, length);
+    android_atomic_release_store(pos + 1, &record->sequence);
+
+    wakeAsyncLogThread();
+    return true;
+}
+
+class AsyncLogThread : public Thread {
+public:
+    AsyncLogThread() : Thread(false) {
+    }
+
+private:
+    virtual bool threadLoop() {
+        while (sem_wait(&gAsyncLog.wake) < 0) {
+        }
+        // Records queued from now on wake the thread up again
+        android_atomic_and(0, &gAsyncLog.wakePending);
+
+        Mutex::Autolock _l(gAsyncLogLock);
+        drainAsyncLogLocked(false);
+        return true;
+    }
+};
+
+static void crashSignalHandler(int signal, siginfo_t* info, void* context) {
+    // The crashing thread may be the one writing the records
+    if (gAsyncLogLock.tryLock() == NO_ERROR) {
+        drainAsyncLogLocked(false);
+        gAsyncLogLock.unlock();
+    }
+
+    // Restore the previous handler. A fault is delivered to it again when
+    // the faulting instruction runs again, a signal sent with kill(), tgkill()
+    // or raise() has to be raised again.
+    for (size_t i = 0; i < NELEM(kCrashSignals); i++) {
+        if (kCrashSignals[i] == signal) {
+            sigaction(signal, &gOldCrashActions[i], NULL);
+        }
+    }
+    if (info->si_code <= 0) {
+        raise(signal);
+    }
+}
+
+static void startAsyncLogLocked() {
+    for (int32_t i = 0; i < ASYNC_LOG_RECORD_COUNT; i++) {
+        gAsyncLog.records[i].sequence = i;
+    }
+    gAsyncLog.enqueuePos = 0;
+    gAsyncLog.dequeuePos = 0;
+    gAsyncLog.wakePending = 0;
+    sem_init(&gAsyncLog.wake, 0, 0);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_sigaction = crashSignalHandler;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    for (size_t i = 0; i < NELEM(kCrashSignals); i++) {
+        sigaction(kCrashSignals[i], &action, &gOldCrashActions[i]);
+    }
+    atexit(flushAsyncLog);
+
+    gAsyncLogThread = new AsyncLogThread();
+    gAsyncLogThread->run("AsyncLog", PRIORITY_BACKGROUND);
+}
+
+int android_util_Log_write(int bufID, int priority, const char* tag, const char* msg) {
+    if (android_atomic_acquire_load(&gAsyncLog.enabled)) {
+        if (tag == NULL) tag = "";
+        const size_t tagLength = strlen(tag) + 1;
+        const size_t length = strlen(msg) + 1;
+        if (queueAsyncLogRecord(ASYNC_LOG_TEXT, bufID, priority, 0, tag, tagLength,
+                msg, length)) {
+            return 1 + tagLength + length;
+        }
+
+        waitForAsyncLog();
+        return __android_log_buf_write(bufID, (android_LogPriority) priority, tag, msg);
+    }
+    return __android_log_buf_write(bufID, (android_LogPriority) priority, tag, msg);
+}
+
+int android_util_Log_writeEvent(int32_t tag, const void* payload, size_t length) {
+    if (android_atomic_acquire_load(&gAsyncLog.enabled)) {
+        if (queueAsyncLogRecord(ASYNC_LOG_EVENT, LOG_ID_EVENTS, 0, tag, NULL, 0,
+                payload, length)) {
+            return sizeof(tag) + length;
+        }
+
+        waitForAsyncLog();
+        return android_bWriteLog(tag, payload, length);
+    }
+    return android_bWriteLog(tag, payload, length);
+}
+
+/*
+ * In class android.util.Log:
+ *  public static native void setAsyncEnabled(boolean enabled)
+ *
+ * Must not be enabled in the zygote, the writer thread would not survive
+ * the fork.
+ */
+static void android_util_Log_setAsyncEnabled(JNIEnv* env, jobject clazz, jboolean enabled)
+{
+    Mutex::Autolock _l(gAsyncLogLock);
+    if (enabled && gAsyncLogThread == NULL) {
+        startAsyncLogLocked();
+    }
+    android_atomic_release_store(enabled ? 1 : 0, &gAsyncLog.enabled);
+
+    // The messages queued so far are written before the next synchronous one
+    if (!enabled && gAsyncLogThread != NULL) {
+        drainAsyncLogLocked(true);
+    }
+}
+
+/*
+ * In class android.util.Log:
+ *  public static native void flushAsync()
+ */
+static void android_util_Log_flushAsync(JNIEnv* env, jobject clazz)
+{
+    flushAsyncLog();
+}
+
 /*
  * In class android.util.Log:
  *  public static native int println_native(int buffer, int priority, String tag, String msg)
@@ -125,7 +408,7 @@ static jint android_util_Log_println_native(JNIEnv* env, jobject clazz,
         tag = env->GetStringUTFChars(tagObj, NULL);
     msg = env->GetStringUTFChars(msgObj, NULL);
 
-    int res = __android_log_buf_write(bufID, (android_LogPriority)priority, tag, msg);
+    int res = android_util_Log_write(bufID, priority, tag, msg);
 
     if (tag != NULL)
         env->ReleaseStringUTFChars(tagObj, tag);
@@ -141,6 +424,8 @@ static JNINativeMethod gMethods[] = {
     /* name, signature, funcPtr */
     { "isLoggable",      "(Ljava/lang/String;I)Z", (void*) android_util_Log_isLoggable },
     { "println_native",  "(IILjava/lang/String;Ljava/lang/String;)I", (void*) android_util_Log_println_native },
+    { "setAsyncEnabled", "(Z)V", (void*) android_util_Log_setAsyncEnabled },
+    { "flushAsync",      "()V", (void*) android_util_Log_flushAsync },
 };
 
 int register_android_util_Log(JNIEnv* env)
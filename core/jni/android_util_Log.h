@@ -25,6 +25,13 @@ namespace android {
 
 bool android_util_Log_isVerboseLogEnabled(const char* tag);
 
+/*
+ * Write a message or an event to the logger, through the asynchronous log
+ * when it is enabled for the process.
+ */
+int android_util_Log_write(int bufID, int priority, const char* tag, const char* msg);
+int android_util_Log_writeEvent(int32_t tag, const void* payload, size_t length);
+
 }
 
 #endif // _ANDROID_UTIL_LOG_H
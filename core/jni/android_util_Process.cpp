@@ -37,8 +37,10 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <grp.h>
+#include <limits.h>
 #include <pwd.h>
 #include <signal.h>
+#include <stdio.h>
 #include <unistd.h>
 
 #define POLICY_DEBUG 0
@@ -690,36 +692,13 @@ enum {
     PROC_OUT_FLOAT = 0x4000,
 };
 
-jboolean android_os_Process_parseProcLineArray(JNIEnv* env, jobject clazz,
-        char* buffer, jint startIndex, jint endIndex, jintArray format,
-        jobjectArray outStrings, jlongArray outLongs, jfloatArray outFloats)
+// Parses buffer[startIndex, endIndex) according to the NF entries of formatData.
+// Output field di goes to outStrings[di], longsData[di] and floatsData[di] as the
+// format requests, when di is within NS, NL and NR respectively.
+static jboolean parseProcLine(JNIEnv* env, char* buffer, jsize startIndex, jsize endIndex,
+        const jint* formatData, jsize NF, jobjectArray outStrings, jsize NS,
+        jlong* longsData, jsize NL, jfloat* floatsData, jsize NR)
 {
-
-    const jsize NF = env->GetArrayLength(format);
-    const jsize NS = outStrings ? env->GetArrayLength(outStrings) : 0;
-    const jsize NL = outLongs ? env->GetArrayLength(outLongs) : 0;
-    const jsize NR = outFloats ? env->GetArrayLength(outFloats) : 0;
-
-    jint* formatData = env->GetIntArrayElements(format, 0);
-    jlong* longsData = outLongs ?
-        env->GetLongArrayElements(outLongs, 0) : NULL;
-    jfloat* floatsData = outFloats ?
-        env->GetFloatArrayElements(outFloats, 0) : NULL;
-    if (formatData == NULL || (NL > 0 && longsData == NULL)
-            || (NR > 0 && floatsData == NULL)) {
-        if (formatData != NULL) {
-            env->ReleaseIntArrayElements(format, formatData, 0);
-        }
-        if (longsData != NULL) {
-            env->ReleaseLongArrayElements(outLongs, longsData, 0);
-        }
-        if (floatsData != NULL) {
-            env->ReleaseFloatArrayElements(outFloats, floatsData, 0);
-        }
-        jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
-        return JNI_FALSE;
-    }
-
     jsize i = startIndex;
     jsize di = 0;
 
@@ -795,6 +774,42 @@ jboolean android_os_Process_parseProcLineArray(JNIEnv* env, jobject clazz,
         }
     }
 
+    return res;
+}
+
+jboolean android_os_Process_parseProcLineArray(JNIEnv* env, jobject clazz,
+        char* buffer, jint startIndex, jint endIndex, jintArray format,
+        jobjectArray outStrings, jlongArray outLongs, jfloatArray outFloats)
+{
+
+    const jsize NF = env->GetArrayLength(format);
+    const jsize NS = outStrings ? env->GetArrayLength(outStrings) : 0;
+    const jsize NL = outLongs ? env->GetArrayLength(outLongs) : 0;
+    const jsize NR = outFloats ? env->GetArrayLength(outFloats) : 0;
+
+    jint* formatData = env->GetIntArrayElements(format, 0);
+    jlong* longsData = outLongs ?
+        env->GetLongArrayElements(outLongs, 0) : NULL;
+    jfloat* floatsData = outFloats ?
+        env->GetFloatArrayElements(outFloats, 0) : NULL;
+    if (formatData == NULL || (NL > 0 && longsData == NULL)
+            || (NR > 0 && floatsData == NULL)) {
+        if (formatData != NULL) {
+            env->ReleaseIntArrayElements(format, formatData, 0);
+        }
+        if (longsData != NULL) {
+            env->ReleaseLongArrayElements(outLongs, longsData, 0);
+        }
+        if (floatsData != NULL) {
+            env->ReleaseFloatArrayElements(outFloats, floatsData, 0);
+        }
+        jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
+        return JNI_FALSE;
+    }
+
+    jboolean res = parseProcLine(env, buffer, startIndex, endIndex, formatData, NF,
+            outStrings, NS, longsData, NL, floatsData, NR);
+
     env->ReleaseIntArrayElements(format, formatData, 0);
     if (longsData != NULL) {
         env->ReleaseLongArrayElements(outLongs, longsData, 0);
@@ -858,6 +873,147 @@ jboolean android_os_Process_readProcFile(JNIEnv* env, jobject clazz,
 
 }
 
+/*
+ * Handle based variant of readProcFile() for files that are polled repeatedly.
+ * The fd stays open between reads and every read starts again from offset 0,
+ * which proc files regenerate on each read.
+ */
+jint android_os_Process_openProcFile(JNIEnv* env, jobject clazz, jstring file)
+{
+    if (file == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return -1;
+    }
+
+    const char* file8 = env->GetStringUTFChars(file, NULL);
+    if (file8 == NULL) {
+        jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
+        return -1;
+    }
+    int fd = open(file8, O_RDONLY | O_CLOEXEC);
+    env->ReleaseStringUTFChars(file, file8);
+    return fd;
+}
+
+void android_os_Process_closeProcFile(JNIEnv* env, jobject clazz, jint fd)
+{
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+jboolean android_os_Process_readProcFileHandle(JNIEnv* env, jobject clazz,
+        jint fd, jintArray format, jobjectArray outStrings,
+        jlongArray outLongs, jfloatArray outFloats)
+{
+    if (format == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return JNI_FALSE;
+    }
+    if (fd < 0) {
+        return JNI_FALSE;
+    }
+
+    char buffer[256];
+    const int len = TEMP_FAILURE_RETRY(pread(fd, buffer, sizeof(buffer)-1, 0));
+    if (len < 0) {
+        return JNI_FALSE;
+    }
+    buffer[len] = 0;
+
+    return android_os_Process_parseProcLineArray(env, clazz, buffer, 0, len,
+            format, outStrings, outLongs, outFloats);
+}
+
+/*
+ * Reads /proc/<pid>/<file> for every pid and parses it with format, all in one
+ * call. Each pid gets one row of outLongs, as wide as the number of output
+ * fields in format, in the order of pids. Rows of processes that could not be
+ * read are filled with -1. Returns the number of processes read.
+ */
+jint android_os_Process_readProcStats(JNIEnv* env, jobject clazz,
+        jstring file, jintArray pids, jintArray format, jlongArray outLongs)
+{
+    if (file == NULL || pids == NULL || format == NULL || outLongs == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return 0;
+    }
+
+    const jsize NP = env->GetArrayLength(pids);
+    const jsize NF = env->GetArrayLength(format);
+    const jsize NL = env->GetArrayLength(outLongs);
+
+    jint* formatData = env->GetIntArrayElements(format, 0);
+    if (formatData == NULL) {
+        jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
+        return 0;
+    }
+    jsize stride = 0;
+    for (jsize fi = 0; fi < NF; fi++) {
+        if ((formatData[fi]&(PROC_OUT_FLOAT|PROC_OUT_LONG|PROC_OUT_STRING)) != 0) {
+            stride++;
+        }
+    }
+    if (stride == 0 || NL / stride < NP) {
+        env->ReleaseIntArrayElements(format, formatData, JNI_ABORT);
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "outLongs too small for pids and format");
+        return 0;
+    }
+
+    const char* file8 = env->GetStringUTFChars(file, NULL);
+    jint* pidsData = env->GetIntArrayElements(pids, 0);
+    jlong* longsData = env->GetLongArrayElements(outLongs, 0);
+    if (file8 == NULL || pidsData == NULL || longsData == NULL) {
+        if (file8 != NULL) {
+            env->ReleaseStringUTFChars(file, file8);
+        }
+        if (pidsData != NULL) {
+            env->ReleaseIntArrayElements(pids, pidsData, JNI_ABORT);
+        }
+        if (longsData != NULL) {
+            env->ReleaseLongArrayElements(outLongs, longsData, JNI_ABORT);
+        }
+        env->ReleaseIntArrayElements(format, formatData, JNI_ABORT);
+        jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
+        return 0;
+    }
+
+    jint count = 0;
+    char path[PATH_MAX];
+    char buffer[512];
+    for (jsize pi = 0; pi < NP; pi++) {
+        jlong* row = longsData + pi * stride;
+        bool ok = false;
+
+        snprintf(path, sizeof(path), "/proc/%d/%s", pidsData[pi], file8);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            const int len = TEMP_FAILURE_RETRY(read(fd, buffer, sizeof(buffer)-1));
+            close(fd);
+            if (len >= 0) {
+                buffer[len] = 0;
+                ok = parseProcLine(env, buffer, 0, len, formatData, NF,
+                        NULL, 0, row, stride, NULL, 0);
+            }
+        }
+
+        if (ok) {
+            count++;
+        } else {
+            for (jsize di = 0; di < stride; di++) {
+                row[di] = -1;
+            }
+        }
+    }
+
+    env->ReleaseLongArrayElements(outLongs, longsData, 0);
+    env->ReleaseIntArrayElements(pids, pidsData, JNI_ABORT);
+    env->ReleaseStringUTFChars(file, file8);
+    env->ReleaseIntArrayElements(format, formatData, JNI_ABORT);
+    return count;
+}
+
 void android_os_Process_setApplicationObject(JNIEnv* env, jobject clazz,
                                              jobject binderObject)
 {
@@ -1036,6 +1192,10 @@ static const JNINativeMethod methods[] = {
     {"getPids", "(Ljava/lang/String;[I)[I", (void*)android_os_Process_getPids},
     {"readProcFile", "(Ljava/lang/String;[I[Ljava/lang/String;[J[F)Z", (void*)android_os_Process_readProcFile},
     {"parseProcLine", "([BII[I[Ljava/lang/String;[J[F)Z", (void*)android_os_Process_parseProcLine},
+    {"openProcFile", "(Ljava/lang/String;)I", (void*)android_os_Process_openProcFile},
+    {"closeProcFile", "(I)V", (void*)android_os_Process_closeProcFile},
+    {"readProcFile", "(I[I[Ljava/lang/String;[J[F)Z", (void*)android_os_Process_readProcFileHandle},
+    {"readProcStats", "(Ljava/lang/String;[I[I[J)I", (void*)android_os_Process_readProcStats},
     {"getElapsedCpuTime", "()J", (void*)android_os_Process_getElapsedCpuTime},
     {"getPss", "(I)J", (void*)android_os_Process_getPss},
     {"getPidsForCommands", "([Ljava/lang/String;)[I", (void*)android_os_Process_getPidsForCommands},
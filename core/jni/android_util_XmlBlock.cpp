@@ -307,6 +307,23 @@ static jint android_content_XmlBlock_nativeGetClassAttribute(JNIEnv* env, jobjec
     return idx >= 0 ? static_cast<jint>(st->getAttributeValueStringID(idx)) : -1;
 }
 
+static jint getStyleAttribute(const ResXMLParser* st)
+{
+    ssize_t idx = st->indexOfStyle();
+    if (idx < 0) {
+        return 0;
+    }
+
+    Res_value value;
+    if (st->getAttributeValue(idx, &value) < 0) {
+        return 0;
+    }
+
+    return value.dataType == value.TYPE_REFERENCE
+        || value.dataType == value.TYPE_ATTRIBUTE
+        ? value.data : 0;
+}
+
 static jint android_content_XmlBlock_nativeGetStyleAttribute(JNIEnv* env, jobject clazz,
                                                              jlong token)
 {
@@ -316,19 +333,88 @@ static jint android_content_XmlBlock_nativeGetStyleAttribute(JNIEnv* env, jobjec
         return 0;
     }
 
-    ssize_t idx = st->indexOfStyle();
-    if (idx < 0) {
+    return getStyleAttribute(st);
+}
+
+/*
+ * Layout of the element returned by nativeReadElement(), mirrored by
+ * XmlBlock.Parser. The header is followed by one record per attribute.
+ */
+enum {
+    ELEMENT_NAMESPACE = 0,
+    ELEMENT_NAME,
+    ELEMENT_LINE_NUMBER,
+    ELEMENT_ID_ATTRIBUTE,
+    ELEMENT_CLASS_ATTRIBUTE,
+    ELEMENT_STYLE_ATTRIBUTE,
+    ELEMENT_ATTRIBUTE_COUNT,
+    ELEMENT_HEADER_SIZE
+};
+
+enum {
+    ATTRIBUTE_NAMESPACE = 0,
+    ATTRIBUTE_NAME,
+    ATTRIBUTE_RESOURCE,
+    ATTRIBUTE_DATA_TYPE,
+    ATTRIBUTE_DATA,
+    ATTRIBUTE_STRING_VALUE,
+    ATTRIBUTE_RECORD_SIZE
+};
+
+/*
+ * Reads the whole start tag the parser is on in a single call, instead of
+ * one call per attribute and per field during inflation. Returns the size of
+ * the element, which is only written if it fits in the array, or 0 if the
+ * parser is not on a start tag.
+ */
+static jint android_content_XmlBlock_nativeReadElement(JNIEnv* env, jobject clazz,
+                                                       jlong token, jintArray outElement)
+{
+    ResXMLParser* st = reinterpret_cast<ResXMLParser*>(token);
+    if (st == NULL || outElement == NULL) {
+        jniThrowNullPointerException(env, NULL);
         return 0;
     }
 
-    Res_value value;
-    if (st->getAttributeValue(idx, &value) < 0) {
+    if (st->getEventType() != ResXMLParser::START_TAG) {
         return 0;
     }
 
-    return value.dataType == value.TYPE_REFERENCE
-        || value.dataType == value.TYPE_ATTRIBUTE
-        ? value.data : 0;
+    const size_t count = st->getAttributeCount();
+    const jsize size = ELEMENT_HEADER_SIZE + count * ATTRIBUTE_RECORD_SIZE;
+    if (env->GetArrayLength(outElement) < size) {
+        return size;
+    }
+
+    jint* element = (jint*) env->GetPrimitiveArrayCritical(outElement, 0);
+    if (element == NULL) {
+        jniThrowException(env, "java/lang/OutOfMemoryError", "");
+        return 0;
+    }
+
+    ssize_t idIdx = st->indexOfID();
+    ssize_t classIdx = st->indexOfClass();
+    element[ELEMENT_NAMESPACE] = st->getElementNamespaceID();
+    element[ELEMENT_NAME] = st->getElementNameID();
+    element[ELEMENT_LINE_NUMBER] = st->getLineNumber();
+    element[ELEMENT_ID_ATTRIBUTE] = idIdx >= 0 ? st->getAttributeValueStringID(idIdx) : -1;
+    element[ELEMENT_CLASS_ATTRIBUTE] = classIdx >= 0 ?
+            st->getAttributeValueStringID(classIdx) : -1;
+    element[ELEMENT_STYLE_ATTRIBUTE] = getStyleAttribute(st);
+    element[ELEMENT_ATTRIBUTE_COUNT] = count;
+
+    jint* attribute = element + ELEMENT_HEADER_SIZE;
+    for (size_t i = 0; i < count; i++, attribute += ATTRIBUTE_RECORD_SIZE) {
+        attribute[ATTRIBUTE_NAMESPACE] = st->getAttributeNamespaceID(i);
+        attribute[ATTRIBUTE_NAME] = st->getAttributeNameID(i);
+        attribute[ATTRIBUTE_RESOURCE] = st->getAttributeNameResID(i);
+        attribute[ATTRIBUTE_DATA_TYPE] = st->getAttributeDataType(i);
+        attribute[ATTRIBUTE_DATA] = st->getAttributeData(i);
+        attribute[ATTRIBUTE_STRING_VALUE] = st->getAttributeValueStringID(i);
+    }
+
+    env->ReleasePrimitiveArrayCritical(outElement, element, 0);
+    return size;
 }
 
 static void android_content_XmlBlock_nativeDestroyParseState(JNIEnv* env, jobject clazz,
@@ -400,6 +486,8 @@ static JNINativeMethod gXmlBlockMethods[] = {
             (void*) android_content_XmlBlock_nativeGetClassAttribute },
     { "nativeGetStyleAttribute",   "(J)I",
             (void*) android_content_XmlBlock_nativeGetStyleAttribute },
+    { "nativeReadElement",         "(J[I)I",
+            (void*) android_content_XmlBlock_nativeReadElement },
     { "nativeDestroyParseState",    "(J)V",
             (void*) android_content_XmlBlock_nativeDestroyParseState },
     { "nativeDestroy",              "(J)V",
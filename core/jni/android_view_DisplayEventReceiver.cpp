@@ -22,10 +22,16 @@
 #include "JNIHelp.h"
 
 #include <android_runtime/AndroidRuntime.h>
+#include <utils/KeyedVector.h>
 #include <utils/Log.h>
 #include <utils/Looper.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
 #include <utils/threads.h>
 #include <gui/DisplayEventReceiver.h>
+#include <gui/ISurfaceComposer.h>
+#include <gui/SurfaceComposerClient.h>
+#include <ui/DisplayInfo.h>
 #include "android_os_MessageQueue.h"
 
 namespace android {
@@ -43,7 +49,66 @@ static struct {
 } gDisplayEventReceiverClassInfo;
 
 
-class NativeDisplayEventReceiver : public LooperCallback {
+class NativeDisplayEventReceiver;
+
+/*
+ * Connection to the display event thread shared by the receivers of a looper.
+ *
+ * Each connection is a socket to SurfaceFlinger, which wakes every connection
+ * that requested a vsync. The receivers of a thread, such as the Choreographer
+ * and other display event receivers, share one connection: a single vsync is
+ * requested for all the receivers waiting on it and the event is fanned out to
+ * them natively.
+ *
+ * The receivers are added and removed from any thread, the events are read and
+ * dispatched on the thread of the looper.
+ */
+class VsyncConnection : public LooperCallback {
+public:
+    static sp<VsyncConnection> get(const sp<Looper>& looper);
+
+    status_t initCheck() const;
+    status_t addReceiver(NativeDisplayEventReceiver* receiver);
+    void removeReceiver(NativeDisplayEventReceiver* receiver);
+    status_t scheduleVsync(NativeDisplayEventReceiver* receiver);
+
+protected:
+    virtual ~VsyncConnection();
+
+private:
+    struct Hotplug {
+        nsecs_t timestamp;
+        int32_t id;
+        bool connected;
+    };
+
+    VsyncConnection(const sp<Looper>& looper);
+
+    virtual int handleEvent(int receiveFd, int events, void* data);
+
+    // Must be called with mLock held
+    bool processPendingEventsLocked(nsecs_t* outTimestamp, int32_t* outId,
+            uint32_t* outCount, Vector<Hotplug>* outHotplugs);
+    void updatePeriodLocked(nsecs_t timestamp, uint32_t count);
+
+    void dispatchHotplugs(const Vector<Hotplug>& hotplugs);
+
+    const sp<Looper> mLooper;
+    DisplayEventReceiver mReceiver;
+
+    // Protects the receivers and the vsync state
+    Mutex mLock;
+    Vector<NativeDisplayEventReceiver*> mReceivers;
+    bool mVsyncRequested;
+
+    // Last vsync read from the connection, used to measure the period
+    nsecs_t mLastVsyncTimestamp;
+    uint32_t mLastVsyncCount;
+    nsecs_t mVsyncPeriod;
+};
+
+
+class NativeDisplayEventReceiver : public RefBase {
 public:
     NativeDisplayEventReceiver(JNIEnv* env,
             jobject receiverObj, const sp<MessageQueue>& messageQueue);
@@ -56,75 +121,127 @@ protected:
     virtual ~NativeDisplayEventReceiver();
 
 private:
+    friend class VsyncConnection;
+
     jobject mReceiverObjGlobal;
     sp<MessageQueue> mMessageQueue;
-    DisplayEventReceiver mReceiver;
+    sp<VsyncConnection> mConnection;
+    // Protected by the lock of the connection
     bool mWaitingForVsync;
 
-    virtual int handleEvent(int receiveFd, int events, void* data);
-    bool processPendingEvents(nsecs_t* outTimestamp, int32_t* id, uint32_t* outCount);
-    void dispatchVsync(nsecs_t timestamp, int32_t id, uint32_t count);
+    void dispatchVsync(nsecs_t timestamp, int32_t id, uint32_t count, nsecs_t period);
     void dispatchHotplug(nsecs_t timestamp, int32_t id, bool connected);
 };
 
 
-NativeDisplayEventReceiver::NativeDisplayEventReceiver(JNIEnv* env,
-        jobject receiverObj, const sp<MessageQueue>& messageQueue) :
-        mReceiverObjGlobal(env->NewGlobalRef(receiverObj)),
-        mMessageQueue(messageQueue), mWaitingForVsync(false) {
-    ALOGV("receiver %p ~ Initializing input event receiver.", this);
+static Mutex gConnectionsLock;
+static KeyedVector<Looper*, wp<VsyncConnection> > gConnections;
+
+sp<VsyncConnection> VsyncConnection::get(const sp<Looper>& looper) {
+    AutoMutex _l(gConnectionsLock);
+    ssize_t index = gConnections.indexOfKey(looper.get());
+    if (index >= 0) {
+        // The connection may be in the middle of being destroyed
+        sp<VsyncConnection> connection = gConnections.valueAt(index).promote();
+        if (connection != NULL) {
+            return connection;
+        }
+    }
+
+    sp<VsyncConnection> connection = new VsyncConnection(looper);
+    gConnections.replaceValueFor(looper.get(), connection);
+    return connection;
 }
 
-NativeDisplayEventReceiver::~NativeDisplayEventReceiver() {
-    JNIEnv* env = AndroidRuntime::getJNIEnv();
-    env->DeleteGlobalRef(mReceiverObjGlobal);
+VsyncConnection::VsyncConnection(const sp<Looper>& looper) :
+        mLooper(looper), mVsyncRequested(false),
+        mLastVsyncTimestamp(0), mLastVsyncCount(0), mVsyncPeriod(0) {
+    ALOGV("connection %p ~ Initializing vsync connection.", this);
+
+    // The period is measured from the events, start from the refresh rate
+    DisplayInfo info;
+    sp<IBinder> display(SurfaceComposerClient::getBuiltInDisplay(
+            ISurfaceComposer::eDisplayIdMain));
+    if (display != NULL && !SurfaceComposerClient::getDisplayInfo(display, &info) &&
+            info.fps > 0.0f) {
+        mVsyncPeriod = nsecs_t(1000000000.0f / info.fps);
+    }
 }
 
-status_t NativeDisplayEventReceiver::initialize() {
-    status_t result = mReceiver.initCheck();
-    if (result) {
-        ALOGW("Failed to initialize display event receiver, status=%d", result);
-        return result;
+VsyncConnection::~VsyncConnection() {
+    AutoMutex _l(gConnectionsLock);
+    ssize_t index = gConnections.indexOfKey(mLooper.get());
+    if (index >= 0 && gConnections.valueAt(index).unsafe_get() == this) {
+        gConnections.removeItemsAt(index);
     }
+}
+
+status_t VsyncConnection::initCheck() const {
+    return mReceiver.initCheck();
+}
 
-    int rc = mMessageQueue->getLooper()->addFd(mReceiver.getFd(), 0, Looper::EVENT_INPUT,
-            this, NULL);
-    if (rc < 0) {
-        return UNKNOWN_ERROR;
+status_t VsyncConnection::addReceiver(NativeDisplayEventReceiver* receiver) {
+    AutoMutex _l(mLock);
+    if (mReceivers.isEmpty()) {
+        // The looper holds a reference to the connection while it is in use
+        int rc = mLooper->addFd(mReceiver.getFd(), 0, Looper::EVENT_INPUT, this, NULL);
+        if (rc < 0) {
+            return UNKNOWN_ERROR;
+        }
     }
+    mReceivers.add(receiver);
     return OK;
 }
 
-void NativeDisplayEventReceiver::dispose() {
-    ALOGV("receiver %p ~ Disposing display event receiver.", this);
-
-    if (!mReceiver.initCheck()) {
-        mMessageQueue->getLooper()->removeFd(mReceiver.getFd());
+void VsyncConnection::removeReceiver(NativeDisplayEventReceiver* receiver) {
+    AutoMutex _l(mLock);
+    for (size_t i = 0; i < mReceivers.size(); i++) {
+        if (mReceivers[i] == receiver) {
+            mReceivers.removeAt(i);
+            if (mReceivers.isEmpty()) {
+                mLooper->removeFd(mReceiver.getFd());
+            }
+            return;
+        }
     }
 }
 
-status_t NativeDisplayEventReceiver::scheduleVsync() {
-    if (!mWaitingForVsync) {
-        ALOGV("receiver %p ~ Scheduling vsync.", this);
-
-        // Drain all pending events.
-        nsecs_t vsyncTimestamp;
-        int32_t vsyncDisplayId;
-        uint32_t vsyncCount;
-        processPendingEvents(&vsyncTimestamp, &vsyncDisplayId, &vsyncCount);
-
-        status_t status = mReceiver.requestNextVsync();
-        if (status) {
-            ALOGW("Failed to request next vsync, status=%d", status);
-            return status;
+status_t VsyncConnection::scheduleVsync(NativeDisplayEventReceiver* receiver) {
+    Vector<Hotplug> hotplugs;
+    {
+        AutoMutex _l(mLock);
+        if (receiver->mWaitingForVsync) {
+            return OK;
         }
 
-        mWaitingForVsync = true;
+        ALOGV("connection %p ~ Scheduling vsync for receiver %p.", this, receiver);
+
+        // Another receiver already requested the next vsync, otherwise drain
+        // the stale events nobody is waiting for.
+        if (!mVsyncRequested) {
+            nsecs_t vsyncTimestamp;
+            int32_t vsyncDisplayId;
+            uint32_t vsyncCount;
+            if (processPendingEventsLocked(&vsyncTimestamp, &vsyncDisplayId, &vsyncCount,
+                    &hotplugs)) {
+                updatePeriodLocked(vsyncTimestamp, vsyncCount);
+            }
+
+            status_t status = mReceiver.requestNextVsync();
+            if (status) {
+                ALOGW("Failed to request next vsync, status=%d", status);
+                return status;
+            }
+            mVsyncRequested = true;
+        }
+        receiver->mWaitingForVsync = true;
     }
+
+    dispatchHotplugs(hotplugs);
     return OK;
 }
 
-int NativeDisplayEventReceiver::handleEvent(int receiveFd, int events, void* data) {
+int VsyncConnection::handleEvent(int receiveFd, int events, void* data) {
     if (events & (Looper::EVENT_ERROR | Looper::EVENT_HANGUP)) {
         ALOGE("Display event receiver pipe was closed or an error occurred.  "
                 "events=0x%x", events);
@@ -141,23 +258,45 @@ int NativeDisplayEventReceiver::handleEvent(int receiveFd, int events, void* dat
     nsecs_t vsyncTimestamp;
     int32_t vsyncDisplayId;
     uint32_t vsyncCount;
-    if (processPendingEvents(&vsyncTimestamp, &vsyncDisplayId, &vsyncCount)) {
-        ALOGV("receiver %p ~ Vsync pulse: timestamp=%lld, id=%d, count=%d",
-                this, vsyncTimestamp, vsyncDisplayId, vsyncCount);
-        mWaitingForVsync = false;
-        dispatchVsync(vsyncTimestamp, vsyncDisplayId, vsyncCount);
+    nsecs_t vsyncPeriod = 0;
+    Vector<Hotplug> hotplugs;
+    Vector<sp<NativeDisplayEventReceiver> > targets;
+    {
+        AutoMutex _l(mLock);
+        if (processPendingEventsLocked(&vsyncTimestamp, &vsyncDisplayId, &vsyncCount,
+                &hotplugs)) {
+            ALOGV("connection %p ~ Vsync pulse: timestamp=%lld, id=%d, count=%d",
+                    this, vsyncTimestamp, vsyncDisplayId, vsyncCount);
+            updatePeriodLocked(vsyncTimestamp, vsyncCount);
+            vsyncPeriod = mVsyncPeriod;
+
+            // Receivers scheduling from their handler wait for the next vsync
+            mVsyncRequested = false;
+            for (size_t i = 0; i < mReceivers.size(); i++) {
+                NativeDisplayEventReceiver* receiver = mReceivers[i];
+                if (receiver->mWaitingForVsync) {
+                    receiver->mWaitingForVsync = false;
+                    targets.add(receiver);
+                }
+            }
+        }
+    }
+
+    dispatchHotplugs(hotplugs);
+    for (size_t i = 0; i < targets.size(); i++) {
+        targets[i]->dispatchVsync(vsyncTimestamp, vsyncDisplayId, vsyncCount, vsyncPeriod);
     }
 
     return 1; // keep the callback
 }
 
-bool NativeDisplayEventReceiver::processPendingEvents(
-        nsecs_t* outTimestamp, int32_t* outId, uint32_t* outCount) {
+bool VsyncConnection::processPendingEventsLocked(nsecs_t* outTimestamp, int32_t* outId,
+        uint32_t* outCount, Vector<Hotplug>* outHotplugs) {
     bool gotVsync = false;
     DisplayEventReceiver::Event buf[EVENT_BUFFER_SIZE];
     ssize_t n;
     while ((n = mReceiver.getEvents(buf, EVENT_BUFFER_SIZE)) > 0) {
-        ALOGV("receiver %p ~ Read %d events.", this, int(n));
+        ALOGV("connection %p ~ Read %d events.", this, int(n));
         for (ssize_t i = 0; i < n; i++) {
             const DisplayEventReceiver::Event& ev = buf[i];
             switch (ev.header.type) {
@@ -169,11 +308,13 @@ bool NativeDisplayEventReceiver::processPendingEvents(
                 *outId = ev.header.id;
                 *outCount = ev.vsync.count;
                 break;
-            case DisplayEventReceiver::DISPLAY_EVENT_HOTPLUG:
-                dispatchHotplug(ev.header.timestamp, ev.header.id, ev.hotplug.connected);
+            case DisplayEventReceiver::DISPLAY_EVENT_HOTPLUG: {
+                Hotplug hotplug = { ev.header.timestamp, ev.header.id, ev.hotplug.connected };
+                outHotplugs->add(hotplug);
                 break;
+            }
             default:
-                ALOGW("receiver %p ~ ignoring unknown event type %#x", this, ev.header.type);
+                ALOGW("connection %p ~ ignoring unknown event type %#x", this, ev.header.type);
                 break;
             }
         }
@@ -184,12 +325,104 @@ bool NativeDisplayEventReceiver::processPendingEvents(
     return gotVsync;
 }
 
-void NativeDisplayEventReceiver::dispatchVsync(nsecs_t timestamp, int32_t id, uint32_t count) {
+void VsyncConnection::updatePeriodLocked(nsecs_t timestamp, uint32_t count) {
+    // The count of the display is incremented on every vsync, including the
+    // ones that were not requested
+    if (mLastVsyncTimestamp != 0 && count > mLastVsyncCount && timestamp > mLastVsyncTimestamp) {
+        nsecs_t period = (timestamp - mLastVsyncTimestamp) / (count - mLastVsyncCount);
+        // Smooth out the jitter of the timestamps
+        mVsyncPeriod = mVsyncPeriod > 0 ? (mVsyncPeriod * 7 + period) / 8 : period;
+    }
+    mLastVsyncTimestamp = timestamp;
+    mLastVsyncCount = count;
+}
+
+void VsyncConnection::dispatchHotplugs(const Vector<Hotplug>& hotplugs) {
+    if (hotplugs.isEmpty()) {
+        return;
+    }
+
+    Vector<sp<NativeDisplayEventReceiver> > targets;
+    {
+        AutoMutex _l(mLock);
+        for (size_t i = 0; i < mReceivers.size(); i++) {
+            targets.add(mReceivers[i]);
+        }
+    }
+
+    for (size_t i = 0; i < hotplugs.size(); i++) {
+        const Hotplug& hotplug = hotplugs[i];
+        for (size_t j = 0; j < targets.size(); j++) {
+            targets[j]->dispatchHotplug(hotplug.timestamp, hotplug.id, hotplug.connected);
+        }
+    }
+}
+
+
+NativeDisplayEventReceiver::NativeDisplayEventReceiver(JNIEnv* env,
+        jobject receiverObj, const sp<MessageQueue>& messageQueue) :
+        mReceiverObjGlobal(env->NewGlobalRef(receiverObj)),
+        mMessageQueue(messageQueue), mWaitingForVsync(false) {
+    ALOGV("receiver %p ~ Initializing input event receiver.", this);
+}
+
+NativeDisplayEventReceiver::~NativeDisplayEventReceiver() {
+    JNIEnv* env = AndroidRuntime::getJNIEnv();
+    env->DeleteGlobalRef(mReceiverObjGlobal);
+}
+
+status_t NativeDisplayEventReceiver::initialize() {
+    sp<VsyncConnection> connection = VsyncConnection::get(mMessageQueue->getLooper());
+    status_t result = connection->initCheck();
+    if (result) {
+        ALOGW("Failed to initialize display event receiver, status=%d", result);
+        return result;
+    }
+
+    result = connection->addReceiver(this);
+    if (result) {
+        return result;
+    }
+    mConnection = connection;
+    return OK;
+}
+
+void NativeDisplayEventReceiver::dispose() {
+    ALOGV("receiver %p ~ Disposing display event receiver.", this);
+
+    if (mConnection != NULL) {
+        mConnection->removeReceiver(this);
+        mConnection.clear();
+    }
+}
+
+status_t NativeDisplayEventReceiver::scheduleVsync() {
+    if (mConnection == NULL) {
+        return NO_INIT;
+    }
+    return mConnection->scheduleVsync(this);
+}
+
+void NativeDisplayEventReceiver::dispatchVsync(nsecs_t timestamp, int32_t id, uint32_t count,
+        nsecs_t period) {
     JNIEnv* env = AndroidRuntime::getJNIEnv();
 
+    // Vsyncs that went by since this one, the receiver is that many frames
+    // late. Unknown until the period is known.
+    nsecs_t nextVsync = 0;
+    int32_t skippedFrames = 0;
+    if (period > 0) {
+        nextVsync = timestamp + period;
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (now > timestamp) {
+            skippedFrames = int32_t((now - timestamp) / period);
+        }
+    }
+
     ALOGV("receiver %p ~ Invoking vsync handler.", this);
     env->CallVoidMethod(mReceiverObjGlobal,
-            gDisplayEventReceiverClassInfo.dispatchVsync, timestamp, id, count);
+            gDisplayEventReceiverClassInfo.dispatchVsync, timestamp, id, count,
+            period, nextVsync, skippedFrames);
     ALOGV("receiver %p ~ Returned from vsync handler.", this);
 
     mMessageQueue->raiseAndClearException(env, "dispatchVsync");
@@ -278,7 +511,7 @@ int register_android_view_DisplayEventReceiver(JNIEnv* env) {
 
     GET_METHOD_ID(gDisplayEventReceiverClassInfo.dispatchVsync,
             gDisplayEventReceiverClassInfo.clazz,
-            "dispatchVsync", "(JII)V");
+            "dispatchVsync", "(JIIJJI)V");
     GET_METHOD_ID(gDisplayEventReceiverClassInfo.dispatchHotplug,
             gDisplayEventReceiverClassInfo.clazz,
             "dispatchHotplug", "(JIZ)V");
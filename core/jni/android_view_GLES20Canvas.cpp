@@ -169,6 +169,12 @@ static jint android_view_GLES20Canvas_prepareDirty(JNIEnv* env, jobject clazz,
     return renderer->prepareDirty(left, top, right, bottom, opaque);
 }
 
+static void android_view_GLES20Canvas_setBufferAge(JNIEnv* env, jobject clazz,
+        jlong rendererHandle, jint age) {
+    OpenGLRenderer* renderer = reinterpret_cast<OpenGLRenderer*>(rendererHandle);
+    renderer->setBufferAge(age);
+}
+
 static void android_view_GLES20Canvas_finish(JNIEnv* env, jobject clazz,
         jlong rendererHandle) {
     OpenGLRenderer* renderer = reinterpret_cast<OpenGLRenderer*>(rendererHandle);
@@ -714,7 +720,8 @@ static void renderText(OpenGLRenderer* renderer, const jchar* text, int count,
     size_t glyphsCount = value->getGlyphsCount();
     jfloat totalAdvance = value->getTotalAdvance();
     x += xOffsetForTextAlign(paint, totalAdvance);
-    const float* positions = value->getPos();
+    TextLayoutValue::PosStorage posStorage;
+    const float* positions = value->getPos(&posStorage);
     int bytesCount = glyphsCount * sizeof(jchar);
     const SkRect& r = value->getBounds();
     android::uirenderer::Rect bounds(r.fLeft, r.fTop, r.fRight, r.fBottom);
@@ -750,7 +757,8 @@ static void renderTextRun(OpenGLRenderer* renderer, const jchar* text,
     size_t glyphsCount = value->getGlyphsCount();
     jfloat totalAdvance = value->getTotalAdvance();
     x += xOffsetForTextAlign(paint, totalAdvance);
-    const float* positions = value->getPos();
+    TextLayoutValue::PosStorage posStorage;
+    const float* positions = value->getPos(&posStorage);
     int bytesCount = glyphsCount * sizeof(jchar);
     const SkRect& r = value->getBounds();
     android::uirenderer::Rect bounds(r.fLeft, r.fTop, r.fRight, r.fBottom);
@@ -873,6 +881,203 @@ static void android_view_GLES20Canvas_drawPosText(JNIEnv* env, jobject clazz,
     env->ReleaseStringChars(text, textArray);
 }
 
+// ----------------------------------------------------------------------------
+// Batching
+// ----------------------------------------------------------------------------
+
+// Op codes of the packed command buffer given to nDrawBatch. Every op is a
+// 32 bit op code followed by its arguments, in native byte order; handles are
+// 64 bit and the buffer stays 4 byte aligned.
+enum BatchOp {
+    // int32 flags
+    kBatchOp_Save = 1,
+    // restores to the count before the matching save
+    kBatchOp_Restore = 2,
+    // float dx, dy
+    kBatchOp_Translate = 3,
+    // float left, top, right, bottom
+    kBatchOp_ClipRect = 4,
+    // float left, top, right, bottom, int64 paint
+    kBatchOp_DrawRect = 5,
+    // float left, top, right, bottom, rx, ry, int64 paint
+    kBatchOp_DrawRoundRect = 6,
+    // float x, y, radius, int64 paint
+    kBatchOp_DrawCircle = 7,
+    // float left, top, right, bottom, int64 paint
+    kBatchOp_DrawOval = 8,
+    // int64 path, int64 paint
+    kBatchOp_DrawPath = 9,
+    // int64 bitmap, int32 index of the pixel buffer in the objects array or -1,
+    // float left, top, int64 paint
+    kBatchOp_DrawBitmap = 10,
+    // int32 count, int32 bidi flags, float x, y, int64 paint, then count chars
+    // padded to a multiple of 4 bytes
+    kBatchOp_DrawText = 11,
+};
+
+#define MAX_BATCH_SAVE_DEPTH 32
+
+class BatchReader {
+public:
+    BatchReader(const uint8_t* data, size_t size): mPos(data), mEnd(data + size) {
+    }
+
+    bool done() const {
+        return mPos >= mEnd;
+    }
+
+    template<typename T>
+    bool read(T* out) {
+        if (size_t(mEnd - mPos) < sizeof(T)) return false;
+        memcpy(out, mPos, sizeof(T));
+        mPos += sizeof(T);
+        return true;
+    }
+
+    template<typename T>
+    bool readHandle(T** out) {
+        jlong handle;
+        if (!read(&handle)) return false;
+        *out = reinterpret_cast<T*>(handle);
+        return *out != NULL;
+    }
+
+    const jchar* readChars(size_t count) {
+        size_t size = (count * sizeof(jchar) + 3) & ~3;
+        if (size_t(mEnd - mPos) < size) return NULL;
+        const jchar* chars = reinterpret_cast<const jchar*>(mPos);
+        mPos += size;
+        return chars;
+    }
+
+private:
+    const uint8_t* mPos;
+    const uint8_t* mEnd;
+};
+
+static jint android_view_GLES20Canvas_drawBatch(JNIEnv* env, jobject clazz,
+        jlong rendererHandle, jobject commands, jint size, jobjectArray objects) {
+    OpenGLRenderer* renderer = reinterpret_cast<OpenGLRenderer*>(rendererHandle);
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(env->GetDirectBufferAddress(commands));
+    if (data == NULL || size < 0 || size > env->GetDirectBufferCapacity(commands)) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "Batch commands must be in a direct buffer of at least size bytes");
+        return 0;
+    }
+
+    BatchReader reader(data, size);
+    int saveCounts[MAX_BATCH_SAVE_DEPTH];
+    int saveDepth = 0;
+    jint opCount = 0;
+    bool valid = true;
+
+    while (valid && !reader.done()) {
+        int32_t op;
+        valid = reader.read(&op);
+        if (!valid) break;
+
+        float f[6];
+        SkPaint* paint;
+        switch (op) {
+            case kBatchOp_Save: {
+                int32_t flags;
+                valid = reader.read(&flags) && saveDepth < MAX_BATCH_SAVE_DEPTH;
+                if (valid) {
+                    saveCounts[saveDepth++] = renderer->getSaveCount();
+                    renderer->save(flags);
+                }
+                break;
+            }
+            case kBatchOp_Restore:
+                valid = saveDepth > 0;
+                if (valid) renderer->restoreToCount(saveCounts[--saveDepth]);
+                break;
+            case kBatchOp_Translate:
+                valid = reader.read(&f[0]) && reader.read(&f[1]);
+                if (valid) renderer->translate(f[0], f[1]);
+                break;
+            case kBatchOp_ClipRect:
+                valid = reader.read(&f[0]) && reader.read(&f[1]) &&
+                        reader.read(&f[2]) && reader.read(&f[3]);
+                if (valid) renderer->clipRect(f[0], f[1], f[2], f[3], SkRegion::kIntersect_Op);
+                break;
+            case kBatchOp_DrawRect:
+                valid = reader.read(&f[0]) && reader.read(&f[1]) &&
+                        reader.read(&f[2]) && reader.read(&f[3]) && reader.readHandle(&paint);
+                if (valid) renderer->drawRect(f[0], f[1], f[2], f[3], paint);
+                break;
+            case kBatchOp_DrawRoundRect:
+                valid = reader.read(&f[0]) && reader.read(&f[1]) &&
+                        reader.read(&f[2]) && reader.read(&f[3]) &&
+                        reader.read(&f[4]) && reader.read(&f[5]) && reader.readHandle(&paint);
+                if (valid) renderer->drawRoundRect(f[0], f[1], f[2], f[3], f[4], f[5], paint);
+                break;
+            case kBatchOp_DrawCircle:
+                valid = reader.read(&f[0]) && reader.read(&f[1]) &&
+                        reader.read(&f[2]) && reader.readHandle(&paint);
+                if (valid) renderer->drawCircle(f[0], f[1], f[2], paint);
+                break;
+            case kBatchOp_DrawOval:
+                valid = reader.read(&f[0]) && reader.read(&f[1]) &&
+                        reader.read(&f[2]) && reader.read(&f[3]) && reader.readHandle(&paint);
+                if (valid) renderer->drawOval(f[0], f[1], f[2], f[3], paint);
+                break;
+            case kBatchOp_DrawPath: {
+                SkPath* path;
+                valid = reader.readHandle(&path) && reader.readHandle(&paint);
+                if (valid) renderer->drawPath(path, paint);
+                break;
+            }
+            case kBatchOp_DrawBitmap: {
+                SkBitmap* bitmap;
+                int32_t bufferIndex;
+                jlong paintHandle;
+                valid = reader.readHandle(&bitmap) && reader.read(&bufferIndex) &&
+                        reader.read(&f[0]) && reader.read(&f[1]) && reader.read(&paintHandle);
+                if (!valid) break;
+                jbyteArray buffer = NULL;
+                if (bufferIndex >= 0) {
+                    valid = objects != NULL && bufferIndex < env->GetArrayLength(objects);
+                    if (!valid) break;
+                    buffer = (jbyteArray) env->GetObjectArrayElement(objects, bufferIndex);
+                }
+                {
+                    // This object allows the renderer to allocate a global JNI ref to the buffer object.
+                    JavaHeapBitmapRef bitmapRef(env, bitmap, buffer);
+                    renderer->drawBitmap(bitmap, f[0], f[1],
+                            reinterpret_cast<SkPaint*>(paintHandle));
+                }
+                if (buffer != NULL) env->DeleteLocalRef(buffer);
+                break;
+            }
+            case kBatchOp_DrawText: {
+                int32_t count;
+                int32_t flags;
+                const jchar* text = NULL;
+                valid = reader.read(&count) && count >= 0 && reader.read(&flags) &&
+                        reader.read(&f[0]) && reader.read(&f[1]) && reader.readHandle(&paint) &&
+                        (text = reader.readChars(count)) != NULL;
+                if (valid) renderText(renderer, text, count, f[0], f[1], flags, paint);
+                break;
+            }
+            default:
+                valid = false;
+                break;
+        }
+        if (valid) opCount++;
+    }
+
+    while (saveDepth > 0) {
+        renderer->restoreToCount(saveCounts[--saveDepth]);
+    }
+
+    if (!valid) {
+        jniThrowExceptionFmt(env, "java/lang/IllegalArgumentException",
+                "Malformed batch command after %d ops", opCount);
+    }
+    return opCount;
+}
+
 // ----------------------------------------------------------------------------
 // Display lists
 // ----------------------------------------------------------------------------
@@ -1064,6 +1269,23 @@ static void android_view_GLES20Canvas_setTextureLayerTransform(JNIEnv* env, jobj
     layer->getTransform().load(*matrix);
 }
 
+static void android_view_GLES20Canvas_setTextureLayerDirectComposition(JNIEnv* env,
+        jobject clazz, jlong layerHandle, jboolean enabled, jint width, jint height) {
+    Layer* layer = reinterpret_cast<Layer*>(layerHandle);
+    LayerRenderer::setDirectComposition(layer, enabled, width, height);
+}
+
+static jboolean android_view_GLES20Canvas_getTextureLayerOverlayGeometry(JNIEnv* env,
+        jobject clazz, jlong layerHandle, jfloatArray geometry) {
+    Layer* layer = reinterpret_cast<Layer*>(layerHandle);
+    if (!layer->isOverlayComposited()) return JNI_FALSE;
+
+    jfloat storage[10];
+    layer->getOverlayGeometry(storage);
+    env->SetFloatArrayRegion(geometry, 0, 10, storage);
+    return JNI_TRUE;
+}
+
 static void android_view_GLES20Canvas_destroyLayer(JNIEnv* env, jobject clazz, jlong layerHandle) {
     Layer* layer = reinterpret_cast<Layer*>(layerHandle);
     LayerRenderer::destroyLayer(layer);
@@ -1171,6 +1393,7 @@ static JNINativeMethod gMethods[] = {
     { "nSetViewport",       "(JII)V",          (void*) android_view_GLES20Canvas_setViewport },
     { "nPrepare",           "(JZ)I",           (void*) android_view_GLES20Canvas_prepare },
     { "nPrepareDirty",      "(JIIIIZ)I",       (void*) android_view_GLES20Canvas_prepareDirty },
+    { "nSetBufferAge",      "(JI)V",           (void*) android_view_GLES20Canvas_setBufferAge },
     { "nFinish",            "(J)V",            (void*) android_view_GLES20Canvas_finish },
     { "nSetName",           "(JLjava/lang/String;)V",
             (void*) android_view_GLES20Canvas_setName },
@@ -1257,6 +1480,9 @@ static JNINativeMethod gMethods[] = {
     { "nDrawPosText",       "(JLjava/lang/String;II[FJ)V",
             (void*) android_view_GLES20Canvas_drawPosText },
 
+    { "nDrawBatch",         "(JLjava/nio/ByteBuffer;I[Ljava/lang/Object;)I",
+            (void*) android_view_GLES20Canvas_drawBatch },
+
     { "nGetClipBounds",     "(JLandroid/graphics/Rect;)Z",
             (void*) android_view_GLES20Canvas_getClipBounds },
 
@@ -1292,6 +1518,10 @@ static JNINativeMethod gMethods[] = {
     { "nCancelLayerUpdate",      "(JJ)V",      (void*) android_view_GLES20Canvas_cancelLayerUpdate },
 
     { "nSetTextureLayerTransform", "(JJ)V",    (void*) android_view_GLES20Canvas_setTextureLayerTransform },
+    { "nSetTextureLayerDirectComposition", "(JZII)V",
+            (void*) android_view_GLES20Canvas_setTextureLayerDirectComposition },
+    { "nGetTextureLayerOverlayGeometry", "(J[F)Z",
+            (void*) android_view_GLES20Canvas_getTextureLayerOverlayGeometry },
 
     { "nGetMaximumTextureWidth",  "()I",       (void*) android_view_GLES20Canvas_getMaxTextureWidth },
     { "nGetMaximumTextureHeight", "()I",       (void*) android_view_GLES20Canvas_getMaxTextureHeight },
@@ -19,20 +19,28 @@
 #include "jni.h"
 #include <nativehelper/JNIHelp.h>
 #include <android_runtime/AndroidRuntime.h>
+#include <android_runtime/android_view_Surface.h>
 
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <EGL/egl_cache.h>
 
+#include <utils/String8.h>
 #include <utils/Timers.h>
 
 #include <Caches.h>
 #include <Extensions.h>
+#include <ProgramBinaryCache.h>
+#include <RenderThread.h>
 
 #ifdef USE_OPENGL_RENDERER
     EGLAPI void EGLAPIENTRY eglBeginFrame(EGLDisplay dpy, EGLSurface surface);
 #endif
 
+#ifndef EGL_BUFFER_AGE_EXT
+    #define EGL_BUFFER_AGE_EXT 0x313D
+#endif
+
 namespace android {
 
 /**
@@ -91,6 +99,27 @@ static jboolean android_view_HardwareRenderer_isBackBufferPreserved(JNIEnv* env,
     return error == EGL_SUCCESS && value == EGL_BUFFER_PRESERVED;
 }
 
+static jint android_view_HardwareRenderer_getBufferAge(JNIEnv* env, jobject clazz) {
+    if (!uirenderer::Extensions::getInstance().hasBufferAge()) {
+        return -1;
+    }
+
+    EGLDisplay display = eglGetCurrentDisplay();
+    EGLSurface surface = eglGetCurrentSurface(EGL_DRAW);
+    EGLint value;
+
+    eglGetError();
+    eglQuerySurface(display, surface, EGL_BUFFER_AGE_EXT, &value);
+
+    EGLint error = eglGetError();
+    if (error != EGL_SUCCESS) {
+        RENDERER_LOGD("Could not query buffer age (%x)", error);
+        return -1;
+    }
+
+    return value;
+}
+
 // ----------------------------------------------------------------------------
 // Tracing and debugging
 // ----------------------------------------------------------------------------
@@ -131,6 +160,47 @@ static jlong android_view_HardwareRenderer_getSystemTime(JNIEnv* env, jobject cl
     return systemTime(SYSTEM_TIME_MONOTONIC);
 }
 
+// ----------------------------------------------------------------------------
+// Render thread
+// ----------------------------------------------------------------------------
+
+static jlong android_view_HardwareRenderer_createRenderThread(JNIEnv* env, jobject clazz,
+        jobject surface) {
+    sp<ANativeWindow> window = android_view_Surface_getNativeWindow(env, surface);
+    if (window == NULL) return 0;
+
+    sp<uirenderer::RenderThread> thread = new uirenderer::RenderThread();
+    if (!thread->initialize(window)) {
+        return 0;
+    }
+    // Released in destroyRenderThread()
+    thread->incStrong(0);
+    return reinterpret_cast<jlong>(thread.get());
+}
+
+static jint android_view_HardwareRenderer_renderThreadDrawFrame(JNIEnv* env, jobject clazz,
+        jlong threadHandle, jlong displayListHandle,
+        jint left, jint top, jint right, jint bottom, jboolean opaque) {
+    uirenderer::RenderThread* thread = reinterpret_cast<uirenderer::RenderThread*>(threadHandle);
+    uirenderer::DisplayList* displayList =
+            reinterpret_cast<uirenderer::DisplayList*>(displayListHandle);
+    uirenderer::Rect dirty(left, top, right, bottom);
+    return thread->drawFrame(displayList, dirty, opaque);
+}
+
+static jint android_view_HardwareRenderer_renderThreadWaitForFlush(JNIEnv* env, jobject clazz,
+        jlong threadHandle) {
+    uirenderer::RenderThread* thread = reinterpret_cast<uirenderer::RenderThread*>(threadHandle);
+    return thread->waitForFlush();
+}
+
+static void android_view_HardwareRenderer_destroyRenderThread(JNIEnv* env, jobject clazz,
+        jlong threadHandle) {
+    uirenderer::RenderThread* thread = reinterpret_cast<uirenderer::RenderThread*>(threadHandle);
+    thread->terminate();
+    thread->decStrong(0);
+}
+
 #endif // USE_OPENGL_RENDERER
 
 // ----------------------------------------------------------------------------
@@ -142,6 +212,12 @@ static void android_view_HardwareRenderer_setupShadersDiskCache(JNIEnv* env, job
 
     const char* cacheArray = env->GetStringUTFChars(diskCachePath, NULL);
     egl_cache_t::get()->setCacheFilename(cacheArray);
+#ifdef USE_OPENGL_RENDERER
+    // Linked programs are stored next to the shaders cache
+    String8 programsPath(cacheArray);
+    programsPath.append(".programs");
+    uirenderer::ProgramBinaryCache::setFilename(programsPath.string());
+#endif
     env->ReleaseStringUTFChars(diskCachePath, cacheArray);
 }
 
@@ -155,11 +231,20 @@ static JNINativeMethod gMethods[] = {
 #ifdef USE_OPENGL_RENDERER
     { "nIsBackBufferPreserved", "()Z",   (void*) android_view_HardwareRenderer_isBackBufferPreserved },
     { "nPreserveBackBuffer",    "()Z",   (void*) android_view_HardwareRenderer_preserveBackBuffer },
+    { "nGetBufferAge",          "()I",   (void*) android_view_HardwareRenderer_getBufferAge },
     { "nLoadProperties",        "()Z",   (void*) android_view_HardwareRenderer_loadProperties },
 
     { "nBeginFrame",            "([I)V", (void*) android_view_HardwareRenderer_beginFrame },
 
     { "nGetSystemTime",         "()J",   (void*) android_view_HardwareRenderer_getSystemTime },
+
+    { "nCreateRenderThread",    "(Landroid/view/Surface;)J",
+            (void*) android_view_HardwareRenderer_createRenderThread },
+    { "nRenderThreadDrawFrame", "(JJIIIIZ)I",
+            (void*) android_view_HardwareRenderer_renderThreadDrawFrame },
+    { "nRenderThreadWaitForFlush", "(J)I",
+            (void*) android_view_HardwareRenderer_renderThreadWaitForFlush },
+    { "nDestroyRenderThread",   "(J)V",  (void*) android_view_HardwareRenderer_destroyRenderThread },
 #endif
 
     { "nSetupShadersDiskCache", "(Ljava/lang/String;)V",
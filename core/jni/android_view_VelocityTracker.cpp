@@ -50,6 +50,7 @@ public:
     void addMovement(const MotionEvent* event);
     void computeCurrentVelocity(int32_t units, float maxVelocity);
     void getVelocity(int32_t id, float* outVx, float* outVy);
+    BitSet32 getVelocities(float* outVelocities);
     bool getEstimator(int32_t id, VelocityTracker::Estimator* outEstimator);
 
 private:
@@ -61,23 +62,42 @@ private:
     int32_t mActivePointerId;
     BitSet32 mCalculatedIdBits;
     Velocity mCalculatedVelocity[MAX_POINTERS];
+
+    // True while the calculated velocities are those of the current movements,
+    // for the units and maximum velocity below
+    bool mCalculatedValid;
+    int32_t mCalculatedUnits;
+    float mCalculatedMaxVelocity;
 };
 
 VelocityTrackerState::VelocityTrackerState(const char* strategy) :
-        mVelocityTracker(strategy), mActivePointerId(-1) {
+        mVelocityTracker(strategy), mActivePointerId(-1), mCalculatedValid(false),
+        mCalculatedUnits(0), mCalculatedMaxVelocity(0) {
 }
 
 void VelocityTrackerState::clear() {
     mVelocityTracker.clear();
     mActivePointerId = -1;
     mCalculatedIdBits.clear();
+    mCalculatedValid = false;
 }
 
 void VelocityTrackerState::addMovement(const MotionEvent* event) {
     mVelocityTracker.addMovement(event);
+    mCalculatedValid = false;
 }
 
 void VelocityTrackerState::computeCurrentVelocity(int32_t units, float maxVelocity) {
+    // Views often compute the velocity several times for the same movements,
+    // the fit is only done again once a movement is added
+    if (mCalculatedValid && mCalculatedUnits == units
+            && mCalculatedMaxVelocity == maxVelocity) {
+        return;
+    }
+    mCalculatedValid = true;
+    mCalculatedUnits = units;
+    mCalculatedMaxVelocity = maxVelocity;
+
     BitSet32 idBits(mVelocityTracker.getCurrentPointerIdBits());
     mCalculatedIdBits = idBits;
 
@@ -131,6 +151,15 @@ void VelocityTrackerState::getVelocity(int32_t id, float* outVx, float* outVy) {
     }
 }
 
+BitSet32 VelocityTrackerState::getVelocities(float* outVelocities) {
+    for (uint32_t index = 0; index < mCalculatedIdBits.count(); index++) {
+        const Velocity& velocity = mCalculatedVelocity[index];
+        outVelocities[index * 2] = velocity.vx;
+        outVelocities[index * 2 + 1] = velocity.vy;
+    }
+    return mCalculatedIdBits;
+}
+
 bool VelocityTrackerState::getEstimator(int32_t id, VelocityTracker::Estimator* outEstimator) {
     return mVelocityTracker.getEstimator(id, outEstimator);
 }
@@ -191,6 +220,18 @@ static jfloat android_view_VelocityTracker_nativeGetYVelocity(JNIEnv* env, jclas
     return vy;
 }
 
+static jint android_view_VelocityTracker_nativeComputeCurrentVelocities(JNIEnv* env,
+        jclass clazz, jlong ptr, jint units, jfloat maxVelocity, jfloatArray outVelocitiesObj) {
+    VelocityTrackerState* state = reinterpret_cast<VelocityTrackerState*>(ptr);
+    state->computeCurrentVelocity(units, maxVelocity);
+
+    // The x and y velocities of each pointer, in the order of their ids
+    float velocities[MAX_POINTERS * 2];
+    BitSet32 idBits = state->getVelocities(velocities);
+    env->SetFloatArrayRegion(outVelocitiesObj, 0, idBits.count() * 2, velocities);
+    return idBits.value;
+}
+
 static jboolean android_view_VelocityTracker_nativeGetEstimator(JNIEnv* env, jclass clazz,
         jlong ptr, jint id, jobject outEstimatorObj) {
     VelocityTrackerState* state = reinterpret_cast<VelocityTrackerState*>(ptr);
@@ -237,6 +278,9 @@ static JNINativeMethod gVelocityTrackerMethods[] = {
     { "nativeGetYVelocity",
             "(JI)F",
             (void*)android_view_VelocityTracker_nativeGetYVelocity },
+    { "nativeComputeCurrentVelocities",
+            "(JIF[F)I",
+            (void*)android_view_VelocityTracker_nativeComputeCurrentVelocities },
     { "nativeGetEstimator",
             "(JILandroid/view/VelocityTracker$Estimator;)Z",
             (void*)android_view_VelocityTracker_nativeGetEstimator },
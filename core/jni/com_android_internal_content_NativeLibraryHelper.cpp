@@ -20,6 +20,9 @@
 #include <android_runtime/AndroidRuntime.h>
 
 #include <utils/Log.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
 #include <androidfw/ZipFileRO.h>
 #include <androidfw/ZipUtils.h>
 #include <ScopedUtfChars.h>
@@ -28,10 +31,12 @@
 #include <zlib.h>
 
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -51,6 +56,8 @@
 #define TMP_FILE_PATTERN "/tmp.XXXXXX"
 #define TMP_FILE_PATTERN_LEN (sizeof(TMP_FILE_PATTERN) - 1)
 
+#define MAX_COPY_THREADS 4
+
 namespace android {
 
 // These match PackageManager.java install codes
@@ -160,64 +167,170 @@ sumFiles(JNIEnv*, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntry, const char
 }
 
 /*
- * Copy the native library if needed.
- *
- * This function assumes the library and path names passed in are considered safe.
+ * A native library to copy out of the APK.  The entry info is read while
+ * iterating over the APK, the copies don't need the ZipFileRO.
  */
-static install_status_t
-copyFileIfChanged(JNIEnv *env, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntry, const char* fileName)
-{
-    jstring* javaNativeLibPath = (jstring*) arg;
-    ScopedUtfChars nativeLibPath(env, *javaNativeLibPath);
-
+struct NativeFile {
+    String8 fileName;
+    int method;
     size_t uncompLen;
+    size_t compLen;
+    off64_t offset;
     long when;
     long crc;
-    time_t modTime;
+};
+
+struct CopyState {
+    const char* nativeLibPath;
+    int apkFd;
+    Vector<NativeFile> files;
 
-    if (!zipFile->getEntryInfo(zipEntry, NULL, &uncompLen, NULL, NULL, &when, &crc)) {
+    Mutex lock;
+    // Index of the next file to copy, guarded by lock
+    size_t next;
+    // First failure, guarded by lock
+    install_status_t status;
+};
+
+static install_status_t
+queueFile(JNIEnv*, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntry, const char* fileName)
+{
+    CopyState* state = (CopyState*) arg;
+    NativeFile file;
+
+    if (!zipFile->getEntryInfo(zipEntry, &file.method, &file.uncompLen, &file.compLen,
+            &file.offset, &file.when, &file.crc)) {
         ALOGD("Couldn't read zip entry info\n");
         return INSTALL_FAILED_INVALID_APK;
-    } else {
-        struct tm t;
-        ZipUtils::zipTimeToTimespec(when, &t);
-        modTime = mktime(&t);
     }
 
+    if (file.method != ZipFileRO::kCompressStored
+            && file.method != ZipFileRO::kCompressDeflated) {
+        ALOGD("Unsupported compression method %d for %s\n", file.method, fileName);
+        return INSTALL_FAILED_INVALID_APK;
+    }
+
+    file.fileName.setTo(fileName);
+    state->files.add(file);
+
+    return INSTALL_SUCCEEDED;
+}
+
+/*
+ * Extract the library to "fd".  Stored libraries are copied by the
+ * kernel, compressed ones are inflated straight from a mapping of the APK.
+ */
+static bool
+extractFile(int apkFd, const NativeFile& file, int fd)
+{
+    if (file.method == ZipFileRO::kCompressStored) {
+        off_t offset = file.offset;
+        size_t remaining = file.uncompLen;
+        while (remaining > 0) {
+            ssize_t sent = TEMP_FAILURE_RETRY(sendfile(fd, apkFd, &offset, remaining));
+            if (sent <= 0) {
+                return false;
+            }
+            remaining -= sent;
+        }
+        return true;
+    }
+
+    FileMap* dataMap = new FileMap();
+    if (!dataMap->create(NULL, apkFd, file.offset, file.compLen, true)) {
+        dataMap->release();
+        return false;
+    }
+
+    z_stream zstream;
+    memset(&zstream, 0, sizeof(zstream));
+    zstream.next_in = (Bytef*) dataMap->getDataPtr();
+    zstream.avail_in = file.compLen;
+
+    // Raw deflate data, without the zlib header
+    if (inflateInit2(&zstream, -MAX_WBITS) != Z_OK) {
+        dataMap->release();
+        return false;
+    }
+
+    unsigned char buffer[32768];
+    size_t written = 0;
+    int zerr;
+    do {
+        zstream.next_out = buffer;
+        zstream.avail_out = sizeof(buffer);
+        zerr = inflate(&zstream, Z_NO_FLUSH);
+        if (zerr != Z_OK && zerr != Z_STREAM_END) {
+            break;
+        }
+
+        const unsigned char* pos = buffer;
+        size_t remaining = sizeof(buffer) - zstream.avail_out;
+        while (remaining > 0) {
+            ssize_t count = TEMP_FAILURE_RETRY(write(fd, pos, remaining));
+            if (count <= 0) {
+                zerr = Z_ERRNO;
+                break;
+            }
+            pos += count;
+            remaining -= count;
+            written += count;
+        }
+    } while (zerr == Z_OK);
+
+    inflateEnd(&zstream);
+    dataMap->release();
+
+    return zerr == Z_STREAM_END && written == file.uncompLen;
+}
+
+/*
+ * Copy the native library if needed.
+ *
+ * This function assumes the library and path names passed in are considered safe.
+ */
+static install_status_t
+copyFileIfChanged(const CopyState& state, const NativeFile& file)
+{
+    const char* fileName = file.fileName.string();
+    const size_t nativeLibPathLen = strlen(state.nativeLibPath);
+
+    struct tm t;
+    ZipUtils::zipTimeToTimespec(file.when, &t);
+    const time_t modTime = mktime(&t);
+
     // Build local file path
-    const size_t fileNameLen = strlen(fileName);
-    char localFileName[nativeLibPath.size() + fileNameLen + 2];
+    const size_t fileNameLen = file.fileName.length();
+    char localFileName[nativeLibPathLen + fileNameLen + 2];
 
-    if (strlcpy(localFileName, nativeLibPath.c_str(), sizeof(localFileName)) != nativeLibPath.size()) {
+    if (strlcpy(localFileName, state.nativeLibPath, sizeof(localFileName)) != nativeLibPathLen) {
         ALOGD("Couldn't allocate local file name for library");
         return INSTALL_FAILED_INTERNAL_ERROR;
     }
 
-    *(localFileName + nativeLibPath.size()) = '/';
+    *(localFileName + nativeLibPathLen) = '/';
 
-    if (strlcpy(localFileName + nativeLibPath.size() + 1, fileName, sizeof(localFileName)
-                    - nativeLibPath.size() - 1) != fileNameLen) {
+    if (strlcpy(localFileName + nativeLibPathLen + 1, fileName, sizeof(localFileName)
+                    - nativeLibPathLen - 1) != fileNameLen) {
         ALOGD("Couldn't allocate local file name for library");
         return INSTALL_FAILED_INTERNAL_ERROR;
     }
 
     // Only copy out the native file if it's different.
     struct stat64 st;
-    if (!isFileDifferent(localFileName, uncompLen, modTime, crc, &st)) {
+    if (!isFileDifferent(localFileName, file.uncompLen, modTime, file.crc, &st)) {
         return INSTALL_SUCCEEDED;
     }
 
-    char localTmpFileName[nativeLibPath.size() + TMP_FILE_PATTERN_LEN + 2];
-    if (strlcpy(localTmpFileName, nativeLibPath.c_str(), sizeof(localTmpFileName))
-            != nativeLibPath.size()) {
+    char localTmpFileName[nativeLibPathLen + TMP_FILE_PATTERN_LEN + 2];
+    if (strlcpy(localTmpFileName, state.nativeLibPath, sizeof(localTmpFileName))
+            != nativeLibPathLen) {
         ALOGD("Couldn't allocate local file name for library");
         return INSTALL_FAILED_INTERNAL_ERROR;
     }
 
-    *(localFileName + nativeLibPath.size()) = '/';
-
-    if (strlcpy(localTmpFileName + nativeLibPath.size(), TMP_FILE_PATTERN,
-                    TMP_FILE_PATTERN_LEN - nativeLibPath.size()) != TMP_FILE_PATTERN_LEN) {
+    if (strlcpy(localTmpFileName + nativeLibPathLen, TMP_FILE_PATTERN,
+                    sizeof(localTmpFileName) - nativeLibPathLen) != TMP_FILE_PATTERN_LEN) {
         ALOGI("Couldn't allocate temporary file name for library");
         return INSTALL_FAILED_INTERNAL_ERROR;
     }
@@ -228,7 +341,7 @@ copyFileIfChanged(JNIEnv *env, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntr
         return INSTALL_FAILED_CONTAINER_ERROR;
     }
 
-    if (!zipFile->uncompressEntry(zipEntry, fd)) {
+    if (!extractFile(state.apkFd, file, fd)) {
         ALOGI("Failed uncompressing %s to %s\n", fileName, localTmpFileName);
         close(fd);
         unlink(localTmpFileName);
@@ -268,6 +381,70 @@ copyFileIfChanged(JNIEnv *env, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntr
     return INSTALL_SUCCEEDED;
 }
 
+static void*
+copyFilesThread(void* arg)
+{
+    CopyState* state = (CopyState*) arg;
+
+    for (;;) {
+        size_t index;
+        {
+            AutoMutex _l(state->lock);
+            if (state->status != INSTALL_SUCCEEDED || state->next >= state->files.size()) {
+                break;
+            }
+            index = state->next++;
+        }
+
+        const NativeFile& file = state->files[index];
+        install_status_t ret = copyFileIfChanged(*state, file);
+        if (ret != INSTALL_SUCCEEDED) {
+            ALOGV("Failure for entry %s", file.fileName.string());
+            AutoMutex _l(state->lock);
+            if (state->status == INSTALL_SUCCEEDED) {
+                state->status = ret;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Copy the queued libraries, on as many threads as there are CPUs.  The
+ * time is mostly spent inflating and comparing CRCs, not waiting for I/O.
+ */
+static install_status_t
+copyFiles(CopyState* state)
+{
+    const long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threadCount = cpuCount > 0 ? cpuCount : 1;
+    if (threadCount > MAX_COPY_THREADS) {
+        threadCount = MAX_COPY_THREADS;
+    }
+    if (threadCount > state->files.size()) {
+        threadCount = state->files.size();
+    }
+
+    // The calling thread copies files as well
+    pthread_t threads[MAX_COPY_THREADS];
+    size_t started = 0;
+    for (size_t i = 1; i < threadCount; i++) {
+        if (pthread_create(&threads[started], NULL, copyFilesThread, state) != 0) {
+            break;
+        }
+        started++;
+    }
+
+    copyFilesThread(state);
+
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    return state->status;
+}
+
 static install_status_t
 iterateOverNativeFiles(JNIEnv *env, jstring javaFilePath, jstring javaCpuAbi, jstring javaCpuAbi2,
         iterFunc callFunc, void* callArg) {
@@ -366,8 +543,31 @@ static jint
 com_android_internal_content_NativeLibraryHelper_copyNativeBinaries(JNIEnv *env, jclass clazz,
         jstring javaFilePath, jstring javaNativeLibPath, jstring javaCpuAbi, jstring javaCpuAbi2)
 {
-    return (jint) iterateOverNativeFiles(env, javaFilePath, javaCpuAbi, javaCpuAbi2,
-            copyFileIfChanged, &javaNativeLibPath);
+    ScopedUtfChars filePath(env, javaFilePath);
+    ScopedUtfChars nativeLibPath(env, javaNativeLibPath);
+
+    CopyState state;
+    state.nativeLibPath = nativeLibPath.c_str();
+    state.apkFd = -1;
+    state.next = 0;
+    state.status = INSTALL_SUCCEEDED;
+
+    install_status_t ret = iterateOverNativeFiles(env, javaFilePath, javaCpuAbi, javaCpuAbi2,
+            queueFile, &state);
+    if (ret != INSTALL_SUCCEEDED || state.files.isEmpty()) {
+        return (jint) ret;
+    }
+
+    state.apkFd = TEMP_FAILURE_RETRY(open(filePath.c_str(), O_RDONLY));
+    if (state.apkFd < 0) {
+        ALOGI("Couldn't open APK %s\n", filePath.c_str());
+        return (jint) INSTALL_FAILED_INVALID_APK;
+    }
+
+    ret = copyFiles(&state);
+    close(state.apkFd);
+
+    return (jint) ret;
 }
 
 static jlong
@@ -17,8 +17,12 @@
 #define LOG_TAG "NetworkStats"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include <android_runtime/AndroidRuntime.h>
 #include <jni.h>
@@ -29,6 +33,7 @@
 
 #include <utils/Log.h>
 #include <utils/misc.h>
+#include <utils/threads.h>
 #include <utils/Vector.h>
 
 namespace android {
@@ -60,41 +65,217 @@ struct stats_line {
     int64_t txPackets;
 };
 
-static int readNetworkStatsDetail(JNIEnv* env, jclass clazz, jobject stats,
-        jstring path, jint limitUid) {
+// Orders lines by (iface, uid, set, tag), the key of a stats row
+static int compareStatsLineKeys(const stats_line* lhs, const stats_line* rhs) {
+    int diff = strcmp(lhs->iface, rhs->iface);
+    if (diff != 0) return diff;
+    if (lhs->uid != rhs->uid) return lhs->uid < rhs->uid ? -1 : 1;
+    if (lhs->set != rhs->set) return lhs->set < rhs->set ? -1 : 1;
+    if (lhs->tag != rhs->tag) return lhs->tag < rhs->tag ? -1 : 1;
+    return 0;
+}
+
+/*
+ * The rows returned by the previous delta read, sorted by key. A delta read
+ * only returns the rows whose counters differ from the snapshot.
+ */
+struct NetworkStatsSnapshot {
+    Mutex lock;
+    Vector<stats_line> lines;
+
+    const stats_line* find(const stats_line& key) const {
+        ssize_t lo = 0;
+        ssize_t hi = lines.size() - 1;
+        while (lo <= hi) {
+            ssize_t mid = (lo + hi) / 2;
+            int diff = compareStatsLineKeys(&lines[mid], &key);
+            if (diff == 0) {
+                return &lines[mid];
+            } else if (diff < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        return NULL;
+    }
+};
+
+static inline void skipSpaces(const char** pos, const char* end) {
+    while (*pos < end && (**pos == ' ' || **pos == '\t')) {
+        (*pos)++;
+    }
+}
+
+static inline bool parseUnsigned(const char** pos, const char* end, uint64_t* out) {
+    skipSpaces(pos, end);
+    const char* start = *pos;
+    uint64_t value = 0;
+    while (*pos < end && **pos >= '0' && **pos <= '9') {
+        value = value * 10 + (**pos - '0');
+        (*pos)++;
+    }
+    *out = value;
+    return *pos != start;
+}
+
+static inline bool parseHex(const char** pos, const char* end, uint64_t* out) {
+    skipSpaces(pos, end);
+    if (end - *pos < 2 || (*pos)[0] != '0' || (*pos)[1] != 'x') {
+        return false;
+    }
+    *pos += 2;
+    const char* start = *pos;
+    uint64_t value = 0;
+    while (*pos < end) {
+        const char c = **pos;
+        int digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            break;
+        }
+        value = (value << 4) | digit;
+        (*pos)++;
+    }
+    *out = value;
+    return *pos != start;
+}
+
+/*
+ * Parses one xt_qtaguid stats line of the form
+ *   idx iface acct_tag_hex uid_tag_int cnt_set rx_bytes rx_packets tx_bytes tx_packets ...
+ * between line and lineEnd. Returns false for lines that do not match, like the
+ * header.
+ */
+static bool parseStatsLine(const char* line, const char* lineEnd, stats_line* s) {
+    const char* pos = line;
+    uint64_t idx, rawTag, uid, set, rxBytes, rxPackets, txBytes, txPackets;
+
+    if (!parseUnsigned(&pos, lineEnd, &idx)) return false;
+
+    skipSpaces(&pos, lineEnd);
+    const char* iface = pos;
+    while (pos < lineEnd && *pos != ' ' && *pos != '\t') {
+        pos++;
+    }
+    const size_t ifaceLen = pos - iface;
+    if (ifaceLen == 0 || ifaceLen >= sizeof(s->iface)) return false;
+
+    if (!parseHex(&pos, lineEnd, &rawTag)
+            || !parseUnsigned(&pos, lineEnd, &uid)
+            || !parseUnsigned(&pos, lineEnd, &set)
+            || !parseUnsigned(&pos, lineEnd, &rxBytes)
+            || !parseUnsigned(&pos, lineEnd, &rxPackets)
+            || !parseUnsigned(&pos, lineEnd, &txBytes)
+            || !parseUnsigned(&pos, lineEnd, &txPackets)) {
+        return false;
+    }
+
+    s->idx = idx;
+    memcpy(s->iface, iface, ifaceLen);
+    s->iface[ifaceLen] = '\0';
+    s->uid = uid;
+    s->set = set;
+    s->tag = rawTag >> 32;
+    s->rxBytes = rxBytes;
+    s->rxPackets = rxPackets;
+    s->txBytes = txBytes;
+    s->txPackets = txPackets;
+    return true;
+}
+
+// Reads the whole file at path into buffer with as few read() calls as possible.
+static bool readFully(const char* path, Vector<char>* buffer) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    // proc files report no size, so grow by doubling from a size that holds
+    // a typical stats file
+    size_t filled = 0;
+    buffer->insertAt('\0', 0, 64 * 1024);
+    while (true) {
+        if (filled == buffer->size()) {
+            buffer->insertAt('\0', filled, filled);
+        }
+        ssize_t count = TEMP_FAILURE_RETRY(read(fd, buffer->editArray() + filled,
+                buffer->size() - filled));
+        if (count < 0) {
+            close(fd);
+            return false;
+        }
+        if (count == 0) {
+            break;
+        }
+        filled += count;
+    }
+    close(fd);
+
+    buffer->removeItemsAt(filled, buffer->size() - filled);
+    return true;
+}
+
+static int readNetworkStats(JNIEnv* env, jobject stats, jstring path, jint limitUid,
+        NetworkStatsSnapshot* snapshot) {
     ScopedUtfChars path8(env, path);
     if (path8.c_str() == NULL) {
         return -1;
     }
 
-    FILE *fp = fopen(path8.c_str(), "r");
-    if (fp == NULL) {
+    Vector<char> buffer;
+    if (!readFully(path8.c_str(), &buffer)) {
         return -1;
     }
 
     Vector<stats_line> lines;
+    lines.setCapacity(buffer.size() / 64);  // lines are longer than that
 
     int lastIdx = 1;
-    char buffer[384];
-    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+    const char* pos = buffer.array();
+    const char* end = pos + buffer.size();
+    while (pos < end) {
+        const char* lineEnd = (const char*) memchr(pos, '\n', end - pos);
+        if (lineEnd == NULL) {
+            lineEnd = end;
+        }
+
         stats_line s;
-        int64_t rawTag;
-        if (sscanf(buffer, "%d %31s 0x%llx %u %u %llu %llu %llu %llu", &s.idx,
-                s.iface, &rawTag, &s.uid, &s.set, &s.rxBytes, &s.rxPackets,
-                &s.txBytes, &s.txPackets) == 9) {
+        if (parseStatsLine(pos, lineEnd, &s)) {
             if (s.idx != lastIdx + 1) {
                 ALOGE("inconsistent idx=%d after lastIdx=%d", s.idx, lastIdx);
                 return -1;
             }
             lastIdx = s.idx;
 
-            s.tag = rawTag >> 32;
-            lines.push_back(s);
+            if (limitUid == -1 || limitUid == s.uid) {
+                lines.push_back(s);
+            }
         }
+        pos = lineEnd + 1;
     }
 
-    if (fclose(fp) != 0) {
-        return -1;
+    if (snapshot != NULL) {
+        AutoMutex _l(snapshot->lock);
+        lines.sort(compareStatsLineKeys);
+
+        Vector<stats_line> changed;
+        for (size_t i = 0; i < lines.size(); i++) {
+            const stats_line& line = lines[i];
+            const stats_line* last = snapshot->find(line);
+            if (last == NULL || last->rxBytes != line.rxBytes
+                    || last->rxPackets != line.rxPackets || last->txBytes != line.txBytes
+                    || last->txPackets != line.txPackets) {
+                changed.push_back(line);
+            }
+        }
+        snapshot->lines = lines;
+        lines = changed;
     }
 
     int size = lines.size();
@@ -118,9 +299,31 @@ static int readNetworkStatsDetail(JNIEnv* env, jclass clazz, jobject stats,
     ScopedLongArrayRW operations(env, env->NewLongArray(size));
     if (operations.get() == NULL) return -1;
 
+    // There are only a handful of interfaces, so share one string per
+    // interface instead of creating one per line
+    const size_t MAX_IFACE_STRINGS = 16;
+    const char* ifaceNames[MAX_IFACE_STRINGS];
+    jstring ifaceStrings[MAX_IFACE_STRINGS];
+    size_t ifaceCount = 0;
     for (int i = 0; i < size; i++) {
-        ScopedLocalRef<jstring> ifaceString(env, env->NewStringUTF(lines[i].iface));
-        env->SetObjectArrayElement(iface.get(), i, ifaceString.get());
+        size_t j = 0;
+        while (j < ifaceCount && strcmp(ifaceNames[j], lines[i].iface) != 0) {
+            j++;
+        }
+        if (j == ifaceCount) {
+            if (ifaceCount == MAX_IFACE_STRINGS) {
+                ScopedLocalRef<jstring> ifaceString(env, env->NewStringUTF(lines[i].iface));
+                env->SetObjectArrayElement(iface.get(), i, ifaceString.get());
+                j = MAX_IFACE_STRINGS;
+            } else {
+                ifaceNames[j] = lines[i].iface;
+                ifaceStrings[j] = env->NewStringUTF(lines[i].iface);
+                ifaceCount++;
+            }
+        }
+        if (j < ifaceCount) {
+            env->SetObjectArrayElement(iface.get(), i, ifaceStrings[j]);
+        }
 
         uid[i] = lines[i].uid;
         set[i] = lines[i].set;
@@ -130,6 +333,9 @@ static int readNetworkStatsDetail(JNIEnv* env, jclass clazz, jobject stats,
         txBytes[i] = lines[i].txBytes;
         txPackets[i] = lines[i].txPackets;
     }
+    for (size_t j = 0; j < ifaceCount; j++) {
+        env->DeleteLocalRef(ifaceStrings[j]);
+    }
 
     env->SetIntField(stats, gNetworkStatsClassInfo.size, size);
     env->SetObjectField(stats, gNetworkStatsClassInfo.iface, iface.get());
@@ -145,6 +351,25 @@ static int readNetworkStatsDetail(JNIEnv* env, jclass clazz, jobject stats,
     return 0;
 }
 
+static int readNetworkStatsDetail(JNIEnv* env, jclass clazz, jobject stats,
+        jstring path, jint limitUid) {
+    return readNetworkStats(env, stats, path, limitUid, NULL);
+}
+
+static int readNetworkStatsDetailDelta(JNIEnv* env, jclass clazz, jobject stats,
+        jstring path, jint limitUid, jlong snapshotPtr) {
+    NetworkStatsSnapshot* snapshot = reinterpret_cast<NetworkStatsSnapshot*>(snapshotPtr);
+    return readNetworkStats(env, stats, path, limitUid, snapshot);
+}
+
+static jlong createStatsSnapshot(JNIEnv* env, jclass clazz) {
+    return reinterpret_cast<jlong>(new NetworkStatsSnapshot());
+}
+
+static void destroyStatsSnapshot(JNIEnv* env, jclass clazz, jlong snapshotPtr) {
+    delete reinterpret_cast<NetworkStatsSnapshot*>(snapshotPtr);
+}
+
 static jclass findClass(JNIEnv* env, const char* name) {
     ScopedLocalRef<jclass> localClass(env, env->FindClass(name));
     jclass result = reinterpret_cast<jclass>(env->NewGlobalRef(localClass.get()));
@@ -158,7 +383,12 @@ static jclass findClass(JNIEnv* env, const char* name) {
 static JNINativeMethod gMethods[] = {
         { "nativeReadNetworkStatsDetail",
                 "(Landroid/net/NetworkStats;Ljava/lang/String;I)I",
-                (void*) readNetworkStatsDetail }
+                (void*) readNetworkStatsDetail },
+        { "nativeReadNetworkStatsDetailDelta",
+                "(Landroid/net/NetworkStats;Ljava/lang/String;IJ)I",
+                (void*) readNetworkStatsDetailDelta },
+        { "nativeCreateStatsSnapshot", "()J", (void*) createStatsSnapshot },
+        { "nativeDestroyStatsSnapshot", "(J)V", (void*) destroyStatsSnapshot }
 };
 
 int register_com_android_internal_net_NetworkStatsFactory(JNIEnv* env) {
@@ -29,6 +29,15 @@
 
 #include <sys/capability.h>
 #include <sys/prctl.h>
+#include <pthread.h>
+
+#include <utils/Timers.h>
+#include <SkPaint.h>
+#include <SkTypeface.h>
+#include <unicode/uclean.h>
+
+#include "TextLayout.h"
+#include "TextLayoutCache.h"
 
 namespace android {
 
@@ -232,6 +241,128 @@ static jobject com_android_internal_os_ZygoteInit_createFileDescriptor (
     return jniCreateFileDescriptor(env, fd);
 }
 
+// ----------------------------------------------------------------------------
+// Native preload
+// ----------------------------------------------------------------------------
+
+/*
+ * Native state that does not depend on the Java preload is warmed up on
+ * helper threads while ZygoteInit preloads classes and resources. The threads
+ * must be joined by nativeFinishPreload() before the zygote forks.
+ */
+struct PreloadTask {
+    const char* name;
+    void (*run)();
+    pthread_t thread;
+    bool started;
+    nsecs_t elapsed;
+};
+
+static void preloadIcu() {
+    UErrorCode status = U_ZERO_ERROR;
+    u_init(&status);
+    if (U_FAILURE(status)) {
+        ALOGW("ICU init failed during preload: %d", status);
+    }
+}
+
+static void preloadFonts() {
+    static const SkTypeface::Style kStyles[] = {
+        SkTypeface::kNormal, SkTypeface::kBold, SkTypeface::kItalic, SkTypeface::kBoldItalic
+    };
+    for (size_t i = 0; i < NELEM(kStyles); i++) {
+        SkSafeUnref(SkTypeface::CreateFromName(NULL, kStyles[i]));
+    }
+}
+
+static void preloadTextLayout() {
+    // Shaping a single char creates the engine, the shaper and the Harfbuzz
+    // face of the default typeface
+    SkPaint paint;
+    const jchar sample[] = { 'a' };
+    TextLayoutEngine::getInstance().getValue(&paint, sample, 0, 1, 1, kBidi_Force_LTR);
+}
+
+static PreloadTask gPreloadTasks[] = {
+    { "icu", preloadIcu },
+    { "fonts", preloadFonts },
+    { "text layout", preloadTextLayout },
+};
+
+static nsecs_t gPreloadStartTime = 0;
+static nsecs_t gPreloadPhaseTime = 0;
+
+static void* preloadTaskThread(void* arg) {
+    PreloadTask* task = reinterpret_cast<PreloadTask*>(arg);
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    task->run();
+    task->elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    return NULL;
+}
+
+/*
+ * private static native void nativeBeginPreload()
+ */
+static void com_android_internal_os_ZygoteInit_nativeBeginPreload(JNIEnv* env, jobject clazz)
+{
+    gPreloadStartTime = gPreloadPhaseTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t i = 0; i < NELEM(gPreloadTasks); i++) {
+        PreloadTask* task = &gPreloadTasks[i];
+        if (task->started) {
+            continue;
+        }
+        task->started = pthread_create(&task->thread, NULL, preloadTaskThread, task) == 0;
+        if (!task->started) {
+            // Fall back to running the task inline
+            preloadTaskThread(task);
+        }
+    }
+}
+
+/*
+ * private static native void nativeMarkPreloadPhase(String name)
+ *
+ * Logs the time spent since the previous mark, or since nativeBeginPreload().
+ */
+static void com_android_internal_os_ZygoteInit_nativeMarkPreloadPhase(JNIEnv* env,
+        jobject clazz, jstring name)
+{
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    const char* nameStr = name != NULL ? env->GetStringUTFChars(name, NULL) : NULL;
+    ALOGI("Preload phase %s took %lld ms", nameStr != NULL ? nameStr : "(unnamed)",
+            ns2ms(now - gPreloadPhaseTime));
+    if (nameStr != NULL) {
+        env->ReleaseStringUTFChars(name, nameStr);
+    }
+    gPreloadPhaseTime = now;
+}
+
+/*
+ * private static native void nativeFinishPreload()
+ *
+ * Joins the preload threads, so that the zygote is single threaded again
+ * before it forks, and logs the timing of every native preload task.
+ */
+static void com_android_internal_os_ZygoteInit_nativeFinishPreload(JNIEnv* env, jobject clazz)
+{
+    nsecs_t joinStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t i = 0; i < NELEM(gPreloadTasks); i++) {
+        PreloadTask* task = &gPreloadTasks[i];
+        if (task->started) {
+            pthread_join(task->thread, NULL);
+            task->started = false;
+        }
+    }
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    for (size_t i = 0; i < NELEM(gPreloadTasks); i++) {
+        ALOGI("Native preload %s took %lld ms", gPreloadTasks[i].name,
+                ns2ms(gPreloadTasks[i].elapsed));
+    }
+    ALOGI("Preload took %lld ms, %lld ms of which waiting for native preload threads",
+            ns2ms(now - gPreloadStartTime), ns2ms(now - joinStart));
+}
+
 /*
  * JNI registration.
  */
@@ -254,7 +385,13 @@ static JNINativeMethod gMethods[] = {
     { "selectReadable", "([Ljava/io/FileDescriptor;)I",
         (void *) com_android_internal_os_ZygoteInit_selectReadable },
     { "createFileDescriptor", "(I)Ljava/io/FileDescriptor;",
-        (void *) com_android_internal_os_ZygoteInit_createFileDescriptor }
+        (void *) com_android_internal_os_ZygoteInit_createFileDescriptor },
+    { "nativeBeginPreload", "()V",
+        (void *) com_android_internal_os_ZygoteInit_nativeBeginPreload },
+    { "nativeMarkPreloadPhase", "(Ljava/lang/String;)V",
+        (void *) com_android_internal_os_ZygoteInit_nativeMarkPreloadPhase },
+    { "nativeFinishPreload", "()V",
+        (void *) com_android_internal_os_ZygoteInit_nativeFinishPreload }
 };
 int register_com_android_internal_os_ZygoteInit(JNIEnv* env)
 {
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TextLayoutCache.h"
+#include "TextLayout.h"
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+class TextLayoutShaperTest : public testing::Test {
+protected:
+    TextLayoutShaper mShaper;
+    SkPaint mPaint;
+
+    virtual void SetUp() {
+        mPaint.setTextSize(16);
+    }
+
+    void shape(const UChar* chars, size_t count) {
+        sp<TextLayoutValue> value = new TextLayoutValue(count);
+        mShaper.computeValues(value.get(), &mPaint, chars, 0, count, count, kBidi_LTR);
+    }
+};
+
+TEST_F(TextLayoutShaperTest, WordCacheableScripts) {
+    EXPECT_TRUE(TextLayoutShaper::isWordCacheableScript(HB_SCRIPT_LATIN));
+    EXPECT_TRUE(TextLayoutShaper::isWordCacheableScript(HB_SCRIPT_COMMON));
+    EXPECT_TRUE(TextLayoutShaper::isWordCacheableScript(HB_SCRIPT_CYRILLIC));
+    EXPECT_TRUE(TextLayoutShaper::isWordCacheableScript(HB_SCRIPT_HAN));
+
+    EXPECT_FALSE(TextLayoutShaper::isWordCacheableScript(HB_SCRIPT_ARABIC));
+    EXPECT_FALSE(TextLayoutShaper::isWordCacheableScript(HB_SCRIPT_DEVANAGARI));
+    EXPECT_FALSE(TextLayoutShaper::isWordCacheableScript(HB_SCRIPT_THAI));
+}
+
+TEST_F(TextLayoutShaperTest, LatinRunsHitWordCache) {
+    const UChar hello[] = { 'h', 'e', 'l', 'l', 'o' };
+
+    shape(hello, sizeof(hello) / sizeof(hello[0]));
+    EXPECT_EQ(1U, mShaper.getWordCacheSize());
+    EXPECT_EQ(0U, mShaper.getWordCacheHits());
+
+    shape(hello, sizeof(hello) / sizeof(hello[0]));
+    EXPECT_EQ(1U, mShaper.getWordCacheSize());
+    EXPECT_EQ(1U, mShaper.getWordCacheHits());
+}
+
+TEST_F(TextLayoutShaperTest, ComplexRunsSkipWordCache) {
+    // Devanagari "namaste", shaped with its context
+    const UChar namaste[] = { 0x0928, 0x092E, 0x0938, 0x094D, 0x0924, 0x0947 };
+
+    shape(namaste, sizeof(namaste) / sizeof(namaste[0]));
+    shape(namaste, sizeof(namaste) / sizeof(namaste[0]));
+    EXPECT_EQ(0U, mShaper.getWordCacheSize());
+    EXPECT_EQ(0U, mShaper.getWordCacheHits());
+}
+
+} // namespace android
@@ -113,8 +113,15 @@ public:
     /** return a new string corresponding to 'className' with all '.'s replaced by '/'s. */
     static char* toSlashClassName(const char* className);
 
+    /**
+     * Register the natives of optional subsystems (GL bindings, camera, USB,
+     * media, backup...) that only the zygote registers at startup. Safe to call
+     * more than once; returns 0 on success.
+     */
+    static int registerDeferredNatives(JNIEnv* env);
+
 private:
-    static int startReg(JNIEnv* env);
+    static int startReg(JNIEnv* env, bool deferOptional);
     void parseExtraOpts(char* extraOptsBuf);
     int startVm(JavaVM** pJavaVM, JNIEnv** pEnv);
 
@@ -27,10 +27,53 @@
 #include <utils/Compat.h>
 #include <utils/Errors.h>
 #include <utils/FileMap.h>
+#include <utils/RefBase.h>
 #include <utils/String8.h>
+#include <utils/threads.h>
 
 namespace android {
 
+/*
+ * A chunk of shared memory holding the uncompressed data of an asset,
+ * shared by all the assets opened from it.  The chunk is pinned while it
+ * is in use and can be purged by the kernel under memory pressure
+ * otherwise, its data is then lost.
+ */
+class AssetBuffer : public RefBase {
+public:
+    /*
+     * Allocate a chunk of "length" bytes.  The chunk is returned pinned,
+     * the caller must unpin() it once it has written the data.
+     */
+    static sp<AssetBuffer> create(const char* name, size_t length);
+
+    /*
+     * Pin the chunk.  Returns false if the chunk was purged, in which case
+     * it is not pinned.
+     */
+    bool pin();
+    void unpin();
+
+    bool isPurged() const;
+
+    void* getData() const { return mData; }
+    size_t getLength() const { return mLength; }
+
+protected:
+    virtual ~AssetBuffer();
+
+private:
+    AssetBuffer(int fd, void* data, size_t length);
+
+    const int mFd;              // -1 when not backed by ashmem
+    void* const mData;
+    const size_t mLength;
+
+    mutable Mutex mLock;
+    int mPinCount;
+    bool mPurged;
+};
+
 /*
  * Instances of this class provide read-only operations on a byte stream.
  *
@@ -109,6 +152,19 @@ public:
      */
     virtual bool isAllocated(void) const { return false; }
 
+    /*
+     * Get a pointer to "length" bytes starting at "offset" without copying
+     * or inflating the rest of the asset.  Returns NULL if the range is not
+     * directly addressable, in which case it has to be read.  The pointer
+     * stays valid until the asset is closed.
+     */
+    virtual const void* getRange(off64_t offset, size_t length) { return NULL; }
+
+    /*
+     * Hint that "length" bytes starting at "offset" will be needed soon.
+     */
+    virtual void prefetch(off64_t offset, size_t length) const { }
+
     /*
      * Get a string identifying the asset's source.  This might be a full
      * path, it might be a colon-separated list of identifiers.
@@ -191,9 +247,12 @@ private:
 
 
     /*
-     * Create from a reference-counted chunk of shared memory.
+     * Create from a reference-counted chunk of shared memory.  The asset
+     * keeps the chunk pinned while it is open.  Returns NULL if the chunk
+     * was purged.
      */
-    // TODO
+    static Asset* createFromSharedBuffer(const sp<AssetBuffer>& buffer,
+        AccessMode mode);
 
     AccessMode  mAccessMode;        // how the asset was opened
     String8    mAssetSource;       // debug string
@@ -243,6 +302,8 @@ public:
     virtual off64_t getRemainingLength(void) const { return mLength-mOffset; }
     virtual int openFileDescriptor(off64_t* outStart, off64_t* outLength) const;
     virtual bool isAllocated(void) const { return mBuf != NULL; }
+    virtual const void* getRange(off64_t offset, size_t length);
+    virtual void prefetch(off64_t offset, size_t length) const;
 
 private:
     off64_t     mStart;         // absolute file offset of start of chunk
@@ -300,6 +361,8 @@ public:
     virtual off64_t getRemainingLength(void) const { return mUncompressedLen-mOffset; }
     virtual int openFileDescriptor(off64_t* outStart, off64_t* outLength) const { return -1; }
     virtual bool isAllocated(void) const { return mBuf != NULL; }
+    virtual const void* getRange(off64_t offset, size_t length);
+    virtual void prefetch(off64_t offset, size_t length) const;
 
 private:
     off64_t     mStart;         // offset to start of compressed data
@@ -315,7 +378,37 @@ private:
     unsigned char*  mBuf;       // for getBuffer()
 };
 
-// need: shared mmap version?
+/*
+ * An asset based on a shared chunk of uncompressed data.
+ */
+class _SharedBufferAsset : public Asset {
+public:
+    _SharedBufferAsset(void);
+    virtual ~_SharedBufferAsset(void);
+
+    /*
+     * Use a chunk of shared memory, pinned until the asset is closed.
+     */
+    status_t openChunk(const sp<AssetBuffer>& buffer);
+
+    /*
+     * Standard Asset interfaces.
+     */
+    virtual ssize_t read(void* buf, size_t count);
+    virtual off64_t seek(off64_t offset, int whence);
+    virtual void close(void);
+    virtual const void* getBuffer(bool wordAligned);
+    virtual off64_t getLength(void) const { return mLength; }
+    virtual off64_t getRemainingLength(void) const { return mLength-mOffset; }
+    virtual int openFileDescriptor(off64_t* outStart, off64_t* outLength) const { return -1; }
+    virtual bool isAllocated(void) const { return mBuffer != NULL; }
+    virtual const void* getRange(off64_t offset, size_t length);
+
+private:
+    sp<AssetBuffer> mBuffer;
+    off64_t     mLength;        // length of the data
+    off64_t     mOffset;        // current offset
+};
 
 }; // namespace android
 
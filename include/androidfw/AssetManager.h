@@ -169,6 +169,15 @@ public:
      */
     Asset* openNonAsset(const int32_t cookie, const char* fileName, AccessMode mode);
 
+    /*
+     * Open the named files on a background thread, so that opening them
+     * later is cheaper: compressed entries are inflated into the cache
+     * shared by all AssetManagers, the data of the others is paged in.
+     * The files are opened like open() does, or like openNonAsset() when
+     * "nonAsset" is true.
+     */
+    void prefetch(const Vector<String8>& fileNames, bool nonAsset);
+
     /*
      * Open a directory within the asset hierarchy.
      *
@@ -226,6 +235,15 @@ public:
      */
     void getLocales(Vector<String8>* locales) const;
 
+    /**
+     * Precompute the bags of the given styles in the resource table shared
+     * by all the AssetManagers using the same first asset path, typically
+     * framework-res, for the current configuration.  Resource tables
+     * created afterwards use them as long as they have the same
+     * configuration.  See ResTable::precomputeBags().
+     */
+    bool precomputeSharedBags(const uint32_t* resIDs, size_t count);
+
     /**
      * Generate idmap data to translate resources IDs between a package and a
      * corresponding overlay package.
@@ -256,7 +274,10 @@ private:
     ZipFileRO* getZipFileLocked(const asset_path& path);
     Asset* openAssetFromFileLocked(const String8& fileName, AccessMode mode);
     Asset* openAssetFromZipLocked(const ZipFileRO* pZipFile,
-        const ZipEntryRO entry, AccessMode mode, const String8& entryName);
+        const ZipEntryRO entry, AccessMode mode, const String8& entryName,
+        const String8& zipPath);
+    Asset* openSharedBufferLocked(FileMap* dataMap, size_t uncompressedLen,
+        AccessMode mode, const String8& entryName, const String8& zipPath);
 
     bool scanAndMergeDirLocked(SortedVector<AssetDir::FileInfo>* pMergedInfo,
         const asset_path& path, const char* rootDir, const char* dirName);
@@ -280,6 +301,10 @@ private:
     void updateResourceParamsLocked() const;
 
     Asset* openIdmapLocked(const struct asset_path& ap) const;
+    FileMap* openTableIndexLocked(const struct asset_path& ap, uint32_t tableCrc) const;
+    void writeTableIndexLocked(const struct asset_path& ap, const ResTable& table,
+            uint32_t tableCrc) const;
+    bool getResourceTableCrcLocked(const struct asset_path& ap, uint32_t* outCrc) const;
 
     void addSystemOverlays(const char* pathOverlaysList, const String8& targetPackagePath,
             ResTable* sharedRes, size_t offset) const;
@@ -295,6 +320,17 @@ private:
 
         ResTable* getResourceTable();
         ResTable* setResourceTable(ResTable* res);
+
+        // Inflated entries, shared by every AssetManager of the process
+        sp<AssetBuffer> getAssetBuffer(const String8& entryName);
+        sp<AssetBuffer> setAssetBuffer(const String8& entryName, const sp<AssetBuffer>& buffer);
+
+        // Files and subdirectories of a directory of the zip, without their
+        // source names.  The index of the directories is built on first use.
+        // Returns false if the zip could not be read.  *outDir is NULL when
+        // the directory does not exist.
+        bool getDirectory(const String8& dirName,
+                const SortedVector<AssetDir::FileInfo>** outDir);
         
         bool isUpToDate();
 
@@ -317,6 +353,22 @@ private:
 
         Vector<asset_path> mOverlays;
 
+        typedef KeyedVector<String8, SortedVector<AssetDir::FileInfo> > directory_index;
+
+        directory_index* buildDirectoryIndex() const;
+        static ssize_t addDirectory(directory_index* index, const String8& dirName);
+
+        struct asset_buffer {
+            String8 entryName;
+            sp<AssetBuffer> buffer;
+        };
+        // Least recently used first
+        Vector<asset_buffer> mAssetBuffers;
+        size_t mAssetBuffersLength;
+
+        Mutex mDirectoriesLock;
+        directory_index* mDirectories;
+
         static Mutex gLock;
         static DefaultKeyedVector<String8, wp<SharedZip> > gOpen;
     };
@@ -345,6 +397,13 @@ private:
         ResTable* getZipResourceTable(const String8& path);
         ResTable* setZipResourceTable(const String8& path, ResTable* res);
 
+        bool getZipDirectory(const String8& path, const String8& dirName,
+                const SortedVector<AssetDir::FileInfo>** outDir);
+
+        sp<AssetBuffer> getZipAssetBuffer(const String8& path, const String8& entryName);
+        sp<AssetBuffer> setZipAssetBuffer(const String8& path, const String8& entryName,
+                const sp<AssetBuffer>& buffer);
+
         // generate path, e.g. "common/en-US-noogle.zip"
         static String8 getPathName(const char* path);
 
@@ -361,9 +420,14 @@ private:
         mutable Vector<sp<SharedZip> > mZipFile;
     };
 
+    class PrefetchThread;
+
     // Protect all internal state.
     mutable Mutex   mLock;
 
+    // Started by the first call to prefetch()
+    sp<PrefetchThread> mPrefetchThread;
+
     ZipSet          mZipSet;
 
     Vector<asset_path> mAssetPaths;
@@ -21,12 +21,25 @@
 #include <utils/String8.h>
 #include <utils/KeyedVector.h>
 
+#include <sys/types.h>
+#include <sys/uio.h>
+
 namespace android {
 
 enum {
     BACKUP_HEADER_ENTITY_V1 = 0x61746144, // Data (little endian)
 };
 
+/* Extensions of the tar stream written by write_tarfile(), off by default. */
+enum {
+    // Send later names of a multiply-linked file as tar hard links.
+    TAR_STREAM_HARD_LINKS = 0x01,
+    // Send the holes of sparse files as a GNU sparse 1.0 map instead of zeros.
+    TAR_STREAM_SPARSE = 0x02,
+    // Add the SHA-256 of each file's contents as an ANDROID.sha256 pax record.
+    TAR_STREAM_CONTENT_HASH = 0x04,
+};
+
 typedef struct {
     int type; // BACKUP_HEADER_ENTITY_V1
     int keyLen; // length of the key name, not including the null terminator
@@ -80,17 +93,33 @@ public:
      */
     status_t WriteEntityData(const void* data, size_t size);
 
+    /* Writes the buffers one after the other, like as many WriteEntityData
+     * calls, in as few system calls as the fd allows.  The vector is
+     * modified as it is written.
+     */
+    status_t WriteEntityDataVector(struct iovec* iov, int iovcnt);
+
     void SetKeyPrefix(const String8& keyPrefix);
 
+    /* TAR_STREAM_* flags for the files write_tarfile() sends to this writer. */
+    void SetTarStreamFlags(int flags);
+    int GetTarStreamFlags() const;
+
+    /* Looks up the tar name first sent for the file (dev, ino) into *earlierName
+     * and returns true, or remembers "name" for it and returns false.
+     */
+    bool FindOrAddHardLink(dev_t dev, ino_t ino, const String8& name, String8* earlierName);
+
 private:
     explicit BackupDataWriter();
-    status_t write_padding_for(int n);
     
     int m_fd;
     status_t m_status;
     ssize_t m_pos;
     int m_entityCount;
     String8 m_keyPrefix;
+    int m_tarFlags;
+    KeyedVector<String8, String8> m_hardLinks;  // "dev:ino" -> first tar name
 };
 
 /**
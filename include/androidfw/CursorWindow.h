@@ -17,6 +17,7 @@
 #ifndef _ANDROID__DATABASE_WINDOW_H
 #define _ANDROID__DATABASE_WINDOW_H
 
+#include <cutils/atomic.h>
 #include <cutils/log.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -46,6 +47,16 @@ namespace android {
  * FieldSlot per column, which has the size, offset, and type of the data for that field.
  * Note that the data types come from sqlite3.h.
  *
+ * A growable window is made of up to MAX_SEGMENTS segments, each backed by its own
+ * ashmem region.  Offsets are contiguous across the segments, whose sizes are recorded
+ * in the header, and no allocation straddles two segments.
+ *
+ * A columnar window holds only INTEGER, FLOAT and NULL values.  Instead of row slots
+ * and field directories, each column is a contiguous array of 8 byte values followed,
+ * after the last column, by an array of one byte types per column, so that a field is
+ * found without walking the row slot chunks.  The number of rows is bounded by the
+ * space left in the first segment when the number of columns is set.
+ *
  * Strings are stored in UTF-8.
  */
 class CursorWindow {
@@ -81,6 +92,13 @@ public:
     ~CursorWindow();
 
     static status_t create(const String8& name, size_t size, CursorWindow** outCursorWindow);
+
+    /**
+     * Creates a window that starts with a segment of the specified size and
+     * grows by adding segments of the same size, up to maxSize bytes.
+     */
+    static status_t create(const String8& name, size_t size, size_t maxSize,
+            CursorWindow** outCursorWindow);
     static status_t createFromParcel(Parcel* parcel, CursorWindow** outCursorWindow);
 
     status_t writeToParcel(Parcel* parcel);
@@ -91,9 +109,29 @@ public:
     inline uint32_t getNumRows() { return mHeader->numRows; }
     inline uint32_t getNumColumns() { return mHeader->numColumns; }
 
+    /**
+     * Publishes the rows added so far.  The rows below the published count
+     * can be read from another thread, or another process, while the window
+     * is being filled, as long as the window is not cleared.
+     */
+    inline void publishRows() {
+        android_atomic_release_store(mHeader->numRows, &mHeader->numPublishedRows);
+    }
+
+    inline uint32_t getNumPublishedRows() {
+        return android_atomic_acquire_load(&mHeader->numPublishedRows);
+    }
+
     status_t clear();
     status_t setNumColumns(uint32_t numColumns);
 
+    /**
+     * Switches an empty window to or from the columnar layout.  The layout
+     * is kept when the window is cleared.
+     */
+    status_t setColumnar(bool columnar);
+    inline bool isColumnar() { return mHeader->columnar; }
+
     /**
      * Allocate a row slot and its directory.
      * The row is initialized will null entries for each field.
@@ -109,7 +147,8 @@ public:
 
     /**
      * Gets the field slot at the specified row and column.
-     * Returns null if the requested row or column is not in the window.
+     * Returns null if the requested row or column is not in the window,
+     * or if the window is columnar.
      */
     FieldSlot* getFieldSlot(uint32_t row, uint32_t column);
 
@@ -136,8 +175,23 @@ public:
         return offsetToPtr(fieldSlot->data.buffer.offset);
     }
 
+    /**
+     * Gets the type of the field at the specified row and column of a columnar window.
+     * Returns -1 if the requested row or column is not in the window.
+     */
+    int32_t getColumnarFieldType(uint32_t row, uint32_t column);
+
+    inline int64_t getColumnarFieldLong(uint32_t row, uint32_t column) {
+        return *static_cast<int64_t*>(getColumnarValue(row, column));
+    }
+
+    inline double getColumnarFieldDouble(uint32_t row, uint32_t column) {
+        return *static_cast<double*>(getColumnarValue(row, column));
+    }
+
 private:
     static const size_t ROW_SLOT_CHUNK_NUM_ROWS = 100;
+    static const size_t MAX_SEGMENTS = 16;
 
     struct Header {
         // Offset of the lowest unused byte in the window.
@@ -148,6 +202,32 @@ private:
 
         uint32_t numRows;
         uint32_t numColumns;
+
+        // Rows that are safe to read while the window is being filled.
+        volatile int32_t numPublishedRows;
+
+        // Segments of the window, the first one holds this header.
+        uint32_t numSegments;
+        uint32_t segmentSizes[MAX_SEGMENTS];
+
+        // Offsets of the row slot chunks after the first one, so that a row
+        // slot is found without walking the chunks.  The index is reallocated
+        // with twice its capacity when it is full.
+        uint32_t numChunks;
+        uint32_t chunkIndexOffset;
+        uint32_t chunkIndexCapacity;
+
+        // Columnar layout, the column arrays start at firstColumnOffset.
+        uint32_t columnar;
+        uint32_t rowCapacity;
+        uint32_t firstColumnOffset;
+    };
+
+    struct Segment {
+        int ashmemFd;
+        void* data;
+        uint32_t base;      // offset of the first byte of the segment
+        uint32_t size;
     };
 
     struct RowSlot {
@@ -160,20 +240,48 @@ private:
     };
 
     String8 mName;
+    // First segment
     int mAshmemFd;
     void* mData;
+    size_t mDataSize;
+    // End offset of the last segment
     size_t mSize;
+    size_t mMaxSize;
     bool mReadOnly;
     Header* mHeader;
 
+    // Segments after the first one
+    Segment mSegments[MAX_SEGMENTS - 1];
+    size_t mNumExtraSegments;
+
     inline void* offsetToPtr(uint32_t offset) {
-        return static_cast<uint8_t*>(mData) + offset;
+        if (offset < mDataSize) {
+            return static_cast<uint8_t*>(mData) + offset;
+        }
+        return extraSegmentOffsetToPtr(offset);
+    }
+
+    void* extraSegmentOffsetToPtr(uint32_t offset);
+    uint32_t offsetFromPtr(void* ptr);
+
+    static status_t createRegion(const String8& name, size_t size,
+            int* outAshmemFd, void** outData);
+    void appendSegment(int ashmemFd, void* data, size_t size);
+    bool addSegment(size_t minSize);
+
+    inline void* getColumnarValue(uint32_t row, uint32_t column) {
+        return offsetToPtr(mHeader->firstColumnOffset
+                + (column * mHeader->rowCapacity + row) * sizeof(int64_t));
     }
 
-    inline uint32_t offsetFromPtr(void* ptr) {
-        return static_cast<uint8_t*>(ptr) - static_cast<uint8_t*>(mData);
+    inline uint8_t* getColumnarType(uint32_t row, uint32_t column) {
+        return static_cast<uint8_t*>(offsetToPtr(mHeader->firstColumnOffset
+                + mHeader->numColumns * mHeader->rowCapacity * sizeof(int64_t)
+                + column * mHeader->rowCapacity + row));
     }
 
+    status_t putColumnar(uint32_t row, uint32_t column, int32_t type, const void* value);
+
     /**
      * Allocate a portion of the window. Returns the offset
      * of the allocation, or 0 if there isn't enough space.
@@ -183,6 +291,8 @@ private:
 
     RowSlot* getRowSlot(uint32_t row);
     RowSlot* allocRowSlot();
+    RowSlotChunk* getRowSlotChunk(uint32_t chunkIndex);
+    bool addRowSlotChunk();
 
     status_t putBlobOrString(uint32_t row, uint32_t column,
             const void* value, size_t size, int32_t type);
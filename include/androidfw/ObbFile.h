@@ -29,6 +29,13 @@ namespace android {
 #define OBB_OVERLAY         (1 << 0)
 #define OBB_SALTED          (1 << 1)
 
+// Digests for the PBKDF2 that derives the key from the password and salt
+#define OBB_KDF_SHA1        0
+#define OBB_KDF_SHA256      1
+
+// PBKDF2 rounds of files that don't record their own
+#define OBB_KDF_DEFAULT_ROUNDS 1024
+
 class ObbFile : public RefBase {
 protected:
     virtual ~ObbFile();
@@ -91,6 +98,24 @@ public:
         return true;
     }
 
+    int32_t getKdfDigest() const {
+        return mKdfDigest;
+    }
+
+    int32_t getKdfRounds() const {
+        return mKdfRounds;
+    }
+
+    bool setKdf(int32_t digest, int32_t rounds) {
+        if ((digest != OBB_KDF_SHA1 && digest != OBB_KDF_SHA256) || rounds <= 0) {
+            return false;
+        }
+
+        mKdfDigest = digest;
+        mKdfRounds = rounds;
+        return true;
+    }
+
     bool isOverlay() {
         return (mFlags & OBB_OVERLAY) == OBB_OVERLAY;
     }
@@ -130,6 +155,10 @@ private:
     /* The encryption salt. */
     unsigned char mSalt[8];
 
+    /* The PBKDF2 digest and rounds for the key. */
+    int32_t mKdfDigest;
+    int32_t mKdfRounds;
+
     const char* mFileName;
 
     size_t mFileSize;
@@ -139,6 +168,7 @@ private:
     unsigned char* mReadBuf;
 
     bool parseObbFile(int fd);
+    bool parseFooter(const unsigned char* scanBuf, size_t footerSize);
 };
 
 }
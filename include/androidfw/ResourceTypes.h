@@ -197,7 +197,10 @@ enum {
     // Chunk types in RES_TABLE_TYPE
     RES_TABLE_PACKAGE_TYPE      = 0x0200,
     RES_TABLE_TYPE_TYPE         = 0x0201,
-    RES_TABLE_TYPE_SPEC_TYPE    = 0x0202
+    RES_TABLE_TYPE_SPEC_TYPE    = 0x0202,
+    // An optional index of the configs of a type, see ResTable_configIndex.
+    // Readers that don't know it skip it.
+    RES_TABLE_CONFIG_INDEX_TYPE = 0x0203
 };
 
 /**
@@ -454,6 +457,11 @@ public:
     // Note: returns null if the string pool is not UTF8.
     const char* string8At(size_t idx, size_t* outLen) const;
 
+    // Decode the given strings of a UTF8 pool ahead of their first use by
+    // stringAt(), e.g. the strings a startup profile marked as hot.  Indices
+    // out of range are ignored; does nothing for UTF16 pools.
+    void decodeStrings(const uint32_t* indices, size_t count) const;
+
     // Return string whether the pool is UTF8 or UTF16.  Does not allow you
     // to distinguish null.
     const String8 string8ObjectAt(size_t idx) const;
@@ -471,15 +479,23 @@ public:
     bool isUTF8() const;
 
 private:
+    struct HashIndex;
+
+    // Returns the hash index of an unsorted pool, building it on demand, or
+    // NULL if the pool is not worth indexing (yet).
+    const HashIndex* getHashIndex() const;
+    uint32_t hashStringAt(size_t idx, bool* outValid) const;
+
     status_t                    mError;
     void*                       mOwnedData;
     const ResStringPool_header* mHeader;
     size_t                      mSize;
-    mutable Mutex               mDecodeLock;
     const uint32_t*             mEntries;
     const uint32_t*             mEntryStyles;
     const void*                 mStrings;
     char16_t mutable**          mCache;
+    HashIndex mutable*          mHashIndex;
+    mutable volatile int32_t    mLinearLookups;
     uint32_t                    mStringPoolSize;    // number of uint16_t
     const uint32_t*             mStyles;
     uint32_t                    mStylePoolSize;    // number of uint32_t
@@ -1144,6 +1160,43 @@ struct ResTable_type
     ResTable_config config;
 };
 
+/**
+ * An optional index of the ResTable_type chunks of a resource type, which
+ * follows the last of them in the package.  It is followed by an array of
+ * configCount ResTable_configIndexEntry, one for each ResTable_type chunk of
+ * the type, sorted by language and then by position of the chunk.
+ *
+ * A config for a language only matches settings of that language, so the
+ * configs that can match are the ones without a language and the ones of the
+ * requested language: two ranges of the array, found by binary search.
+ */
+struct ResTable_configIndex
+{
+    struct ResChunk_header header;
+
+    // The type identifier of the indexed ResTable_type chunks.
+    uint8_t id;
+
+    // Must be 0.
+    uint8_t res0;
+    // Must be 0.
+    uint16_t res1;
+
+    // Number of ResTable_configIndexEntry that follow, which is the number of
+    // ResTable_type chunks of the type.
+    uint32_t configCount;
+};
+
+struct ResTable_configIndexEntry
+{
+    // The language of the config, or 0 if it has none.
+    char language[2];
+
+    // Position of the ResTable_type chunk among those of its type, in the
+    // order of the package.
+    uint16_t config;
+};
+
 /**
  * This is the beginning of information about an entry in the resource
  * table.  It holds the reference to the name of this entry, and is
@@ -1285,6 +1338,12 @@ public:
 
     status_t add(Asset* asset, const int32_t cookie, bool copyData,
                  const void* idmap = NULL);
+    // Like add(), but the types and configs of the packages are read from
+    // the given table index (see createTableIndex()) instead of being
+    // collected by walking the table.  The table takes ownership of the
+    // index, which is ignored if it does not match the table.
+    status_t add(Asset* asset, const int32_t cookie, bool copyData,
+                 const void* idmap, FileMap* tableIndex);
     status_t add(const void *data, size_t size);
     status_t add(ResTable* src);
 
@@ -1365,6 +1424,12 @@ public:
 
     void unlockBag(const bag_entry* bag) const;
 
+    /**
+     * Guarantees that the bags returned by getBagLocked() stay valid until
+     * unlock() is called.  Several threads can hold the lock at the same
+     * time, it only excludes setParameters(), which clears the bag cache.
+     * The lock is not recursive.
+     */
     void lock() const;
 
     ssize_t getBagLocked(uint32_t resID, const bag_entry** outBag,
@@ -1372,6 +1437,19 @@ public:
 
     void unlock() const;
 
+    /**
+     * Computes the bags of the given resources, typically the styles of
+     * the default themes, for the current parameters.  Unlike the bags
+     * computed on demand, they are kept when the parameters change and are
+     * shared with the tables later copied from this one with add(), which
+     * use them while their parameters are the same.  Computing them before
+     * forking lets the child processes share them copy-on-write.
+     *
+     * The bags can only be precomputed once, and the table must outlive the
+     * tables copied from it.
+     */
+    status_t precomputeBags(const uint32_t* resIDs, size_t count);
+
     class Theme {
     public:
         Theme(const ResTable& table);
@@ -1415,6 +1493,8 @@ public:
         void dumpToLog() const;
         
     private:
+        friend class ResTable;
+
         Theme(const Theme&);
         Theme& operator=(const Theme&);
 
@@ -1431,12 +1511,24 @@ public:
             size_t numTypes;
             type_info types[];
         };
+        struct resolved_entry;
+        struct theme_data;
 
         void free_package(package_info* pi);
         package_info* copy_package(package_info* pi);
 
+        theme_data* edit_data();
+        void publish_data(theme_data* data);
+        void release_data(theme_data* data);
+        const theme_entry* find_entry(const theme_data* data, uint32_t resID,
+                uint32_t* outKey = NULL) const;
+        ssize_t walk_attribute(const theme_data* data, uint32_t resID, int cnt,
+                Res_value* outValue, uint32_t* outTypeSpecFlags) const;
+
         const ResTable& mTable;
-        package_info*   mPackages[Res_MAXPACKAGE];
+        // Shared by the themes of the table that had the same styles applied,
+        // NULL if no style was applied.
+        theme_data*     mData;
     };
 
     void setParameters(const ResTable_config* params);
@@ -1561,6 +1653,23 @@ public:
             uint32_t* pTargetCrc, uint32_t* pOverlayCrc,
             String8* pTargetPath, String8* pOverlayPath);
 
+    // Generate an index of the packages, types and configs of the resource
+    // table at the given index, which can be mapped read-only by other
+    // processes loading the same table.
+    //
+    // Return value: on success: NO_ERROR; caller is responsible for free-ing
+    // outData (using free(3)). On failure, any status_t value other than
+    // NO_ERROR; the caller should not free outData.
+    status_t createTableIndex(size_t index, uint32_t tableCrc,
+            void** outData, size_t* outSize) const;
+
+    // Retrieve the CRC of the resource table a table index was created for.
+    static bool getTableIndexInfo(const void* tableIndex, size_t size, uint32_t* pTableCrc);
+
+    // Return whether the resource table at the given index was loaded
+    // from a table index.
+    bool isTableIndexed(size_t index) const;
+
     void print(bool inclValues) const;
     static String8 normalizeForOutput(const char* input);
 
@@ -1572,24 +1681,34 @@ private:
     struct bag_set;
 
     status_t addInternal(const void* data, size_t size, const int32_t cookie,
-                 Asset* asset, bool copyData, const Asset* idmap);
+                 Asset* asset, bool copyData, const Asset* idmap,
+                 FileMap* tableIndex = NULL);
 
     ssize_t getResourcePackageIndex(uint32_t resID) const;
+    ssize_t getBagLocked(uint32_t resID, const bag_entry** outBag,
+            uint32_t* outTypeSpecFlags, bool bagLockHeld) const;
     ssize_t getEntry(
         const Package* package, int typeIndex, int entryIndex,
         const ResTable_config* config,
         const ResTable_type** outType, const ResTable_entry** outEntry,
         const Type** outTypeClass) const;
     status_t parsePackage(
-        const ResTable_package* const pkg, const Header* const header, uint32_t idmap_id);
+        const ResTable_package* const pkg, const Header* const header, uint32_t idmap_id,
+        const uint32_t* indexRecord);
 
     void print_value(const Package* pkg, const Res_value& value) const;
     
-    mutable Mutex               mLock;
+    // Read-locked while bags are in use, write-locked to clear the bag cache
+    mutable RWLock              mLock;
+    // Serializes the computation of bags, bags that were already computed
+    // are looked up without taking it
+    mutable Mutex               mBagLock;
 
     status_t                    mError;
 
     ResTable_config             mParams;
+    // Incremented every time mParams changes, see getEntry()
+    uint32_t                    mParamsGeneration;
 
     // Array of all resource tables.
     Vector<Header*>             mHeaders;
@@ -1600,6 +1719,11 @@ private:
     // Mapping from resource package IDs to indices into the internal
     // package array.
     uint8_t                     mPackageMap[256];
+
+    // Theme contents that can be shared, looked up by the styles applied
+    // to them.  Entries remove themselves when no theme uses them anymore.
+    mutable Mutex               mThemeLock;
+    mutable Vector<Theme::theme_data*> mThemes;
 };
 
 }   // namespace android
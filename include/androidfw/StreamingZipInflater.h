@@ -22,12 +22,14 @@
 #include <zlib.h>
 
 #include <utils/Compat.h>
+#include <utils/Vector.h>
 
 namespace android {
 
 class StreamingZipInflater {
 public:
     static const size_t INPUT_CHUNK_SIZE = 64 * 1024;
+    static const size_t MAX_INPUT_CHUNK_SIZE = 256 * 1024;
     static const size_t OUTPUT_CHUNK_SIZE = 64 * 1024;
 
     // Flavor that pages in the compressed data from a fd
@@ -42,14 +44,27 @@ public:
     // be NULL, in which case the data is consumed and discarded.
     ssize_t read(void* outBuf, size_t count);
 
-    // seeking backwards requires uncompressing fom the beginning, so is very
-    // expensive.  seeking forwards only requires uncompressing from the current
-    // position to the destination.
+    // seeking backwards within the last decoded chunk is free.  Further
+    // backwards seeks resume uncompressing from the closest saved inflate
+    // state, saved periodically once the stream has been seeked backwards, or
+    // from the beginning.  seeking forwards only requires uncompressing from
+    // the current position to the destination.
     off64_t seekAbsolute(off64_t absoluteInputPosition);
 
 private:
+    // Copy of the inflate state at some point of the stream
+    struct Checkpoint {
+        off64_t outPosition;    // uncompressed bytes produced before this point
+        size_t inOffset;        // compressed bytes consumed before this point
+        z_stream* state;
+    };
+
     void initInflateState();
     int readNextChunk();
+    size_t inputConsumed() const;
+    void saveCheckpoint();
+    bool restoreCheckpoint(off64_t absoluteInputPosition);
+    void clearCheckpoints();
 
     // where to find the uncompressed data
     int mFd;
@@ -77,6 +92,10 @@ private:
     // input state bookkeeping
     size_t mInNextChunkOffset;  // offset from start of blob at which the next input chunk lies
     // the z_stream contains state about input block consumption
+
+    // saved inflate states, by increasing position
+    Vector<Checkpoint> mCheckpoints;
+    size_t mCheckpointInterval; // 0 until the first backward seek
 };
 
 }
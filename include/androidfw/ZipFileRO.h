@@ -41,6 +41,7 @@
 #include <time.h>
 
 typedef void* ZipArchiveHandle;
+struct ZipEntry;
 
 namespace android {
 
@@ -78,6 +79,15 @@ public:
      */
     static ZipFileRO* open(const char* zipFileName);
 
+    /*
+     * Open an archive, looking entries up in the index stored in
+     * "indexFileName" instead of reading the central directory.  The
+     * archive itself is only opened when an entry has to be uncompressed
+     * or when iterating.  A missing or stale index is rebuilt, if the
+     * caller is allowed to write it.
+     */
+    static ZipFileRO* open(const char* zipFileName, const char* indexFileName);
+
     /*
      * Find an entry, by name.  Returns the entry identifier, or NULL if
      * not found.
@@ -157,12 +167,24 @@ private:
     ZipFileRO& operator=(const ZipFileRO& src);
 
     ZipFileRO(ZipArchiveHandle handle, char* fileName) : mHandle(handle),
-        mFileName(fileName)
+        mFileName(fileName), mFd(-1), mIndexMap(NULL)
     {
     }
 
-    const ZipArchiveHandle mHandle;
+    ZipArchiveHandle getHandle() const;
+    bool findIndexedEntry(const char* entryName, ZipEntry* outEntry) const;
+
+    static FileMap* openIndex(const char* indexFileName, int zipFd);
+    static void writeIndex(ZipArchiveHandle handle, const char* indexFileName, int zipFd);
+
+    // Opened on first use when the entries are read from an index.
+    mutable ZipArchiveHandle mHandle;
+    mutable Mutex mHandleLock;
     char* mFileName;
+
+    // Descriptor and index of an archive opened from an index.
+    int mFd;
+    FileMap* mIndexMap;
 };
 
 }; // namespace android
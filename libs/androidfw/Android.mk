@@ -68,6 +68,7 @@ LOCAL_SRC_FILES:= $(deviceSources)
 LOCAL_SHARED_LIBRARIES := \
 	libbinder \
 	liblog \
+	libcrypto \
 	libcutils \
 	libutils \
 	libz
@@ -76,6 +77,7 @@ LOCAL_STATIC_LIBRARIES := libziparchive
 
 LOCAL_C_INCLUDES := \
     external/icu4c/common \
+    external/openssl/include \
     external/zlib \
     system/core/include
 
@@ -30,10 +30,16 @@
 #include <utils/Log.h>
 #include <utils/threads.h>
 
+#ifdef HAVE_ANDROID_OS
+#include <cutils/ashmem.h>
+#include <sys/mman.h>
+#endif
+
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <memory.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -45,6 +51,31 @@ using namespace android;
 # define O_BINARY 0
 #endif
 
+/*
+ * Check that "length" bytes starting at "offset" lie within the asset.
+ */
+static bool isValidRange(off64_t offset, size_t length, off64_t assetLength)
+{
+    return offset >= 0 && offset <= assetLength
+            && (off64_t) length <= assetLength - offset;
+}
+
+/*
+ * Ask the kernel to start paging in a mapped range.
+ */
+static void adviseWillNeed(const void* data, size_t length)
+{
+#ifdef HAVE_ANDROID_OS
+    const uintptr_t pageMask = sysconf(_SC_PAGESIZE) - 1;
+    uintptr_t start = (uintptr_t) data & ~pageMask;
+    uintptr_t end = (uintptr_t) data + length;
+    if (end > start && madvise((void*) start, end - start, MADV_WILLNEED) != 0) {
+        ALOGV("madvise(%p, %u) failed: %s", (void*) start, (unsigned) (end - start),
+                strerror(errno));
+    }
+#endif
+}
+
 static Mutex gAssetLock;
 static int32_t gCount = 0;
 static Asset* gHead = NULL;
@@ -304,6 +335,26 @@ Asset::~Asset(void)
     return pAsset;
 }
 
+/*
+ * Create a new Asset from a chunk of shared memory.
+ */
+/*static*/ Asset* Asset::createFromSharedBuffer(const sp<AssetBuffer>& buffer,
+    AccessMode mode)
+{
+    _SharedBufferAsset* pAsset;
+    status_t result;
+
+    pAsset = new _SharedBufferAsset;
+    result = pAsset->openChunk(buffer);
+    if (result != NO_ERROR) {
+        delete pAsset;
+        return NULL;
+    }
+
+    pAsset->mAccessMode = mode;
+    return pAsset;
+}
+
 
 /*
  * Do generic seek() housekeeping.  Pass in the offset/whence values from
@@ -642,6 +693,33 @@ int _FileAsset::openFileDescriptor(off64_t* outStart, off64_t* outLength) const
     return open(mFileName, O_RDONLY | O_BINARY);
 }
 
+/*
+ * Return a pointer into the existing mapping of the chunk, or into the
+ * buffer it was already read into.  A range needs no word alignment, so
+ * unlike getBuffer() nothing is copied or read; without either, the caller
+ * reads the range itself.
+ */
+const void* _FileAsset::getRange(off64_t offset, size_t length)
+{
+    if (!isValidRange(offset, length, mLength))
+        return NULL;
+
+    if (mMap != NULL) {
+        const unsigned char* data = (const unsigned char*) mMap->getDataPtr() + offset;
+        adviseWillNeed(data, length);
+        return data;
+    }
+    if (mBuf != NULL)
+        return mBuf + offset;
+    return NULL;
+}
+
+void _FileAsset::prefetch(off64_t offset, size_t length) const
+{
+    if (mMap != NULL && isValidRange(offset, length, mLength))
+        adviseWillNeed((const unsigned char*) mMap->getDataPtr() + offset, length);
+}
+
 const void* _FileAsset::ensureAlignment(FileMap* map)
 {
     void* data = map->getDataPtr();
@@ -895,3 +973,193 @@ bail:
     return mBuf;
 }
 
+
+
+/*
+ * The range is only addressable once the whole asset has been inflated;
+ * callers are expected to stream it otherwise.
+ */
+const void* _CompressedAsset::getRange(off64_t offset, size_t length)
+{
+    if (mBuf == NULL || !isValidRange(offset, length, mUncompressedLen))
+        return NULL;
+    return mBuf + offset;
+}
+
+/*
+ * Deflate streams can't be entered in the middle, so everything up to the
+ * end of the range is needed.  Assume the data compressed evenly.
+ */
+void _CompressedAsset::prefetch(off64_t offset, size_t length) const
+{
+    if (mMap == NULL || mBuf != NULL || !isValidRange(offset, length, mUncompressedLen))
+        return;
+
+    off64_t end = mUncompressedLen > 0
+            ? (offset + length) * mCompressedLen / mUncompressedLen + 1 : 0;
+    if (end > mCompressedLen)
+        end = mCompressedLen;
+    adviseWillNeed(mMap->getDataPtr(), end);
+}
+
+/*
+ * ===========================================================================
+ *      AssetBuffer
+ * ===========================================================================
+ */
+
+/*static*/ sp<AssetBuffer> AssetBuffer::create(const char* name, size_t length)
+{
+#ifdef HAVE_ANDROID_OS
+    String8 ashmemName("Asset: ");
+    ashmemName.append(name);
+
+    int fd = ashmem_create_region(ashmemName.string(), length);
+    if (fd < 0) {
+        ALOGW("Could not create ashmem region for %s: %s\n", name, strerror(errno));
+        return NULL;
+    }
+    void* data = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        ALOGW("Could not map ashmem region for %s: %s\n", name, strerror(errno));
+        ::close(fd);
+        return NULL;
+    }
+    return new AssetBuffer(fd, data, length);
+#else
+    // Without ashmem the chunk is never purged
+    void* data = malloc(length);
+    if (data == NULL) {
+        return NULL;
+    }
+    return new AssetBuffer(-1, data, length);
+#endif
+}
+
+AssetBuffer::AssetBuffer(int fd, void* data, size_t length)
+    : mFd(fd), mData(data), mLength(length), mPinCount(1), mPurged(false)
+{
+}
+
+AssetBuffer::~AssetBuffer()
+{
+    if (mFd >= 0) {
+        munmap(mData, mLength);
+        ::close(mFd);
+    } else {
+        free(mData);
+    }
+}
+
+bool AssetBuffer::pin()
+{
+    AutoMutex _l(mLock);
+    if (mPurged) {
+        return false;
+    }
+#ifdef HAVE_ANDROID_OS
+    if (mPinCount == 0 && ashmem_pin_region(mFd, 0, 0) == ASHMEM_WAS_PURGED) {
+        ALOGV("Asset buffer %p was purged\n", this);
+        ashmem_unpin_region(mFd, 0, 0);
+        mPurged = true;
+        return false;
+    }
+#endif
+    mPinCount++;
+    return true;
+}
+
+void AssetBuffer::unpin()
+{
+    AutoMutex _l(mLock);
+    assert(mPinCount > 0);
+#ifdef HAVE_ANDROID_OS
+    if (mPinCount == 1) {
+        ashmem_unpin_region(mFd, 0, 0);
+    }
+#endif
+    mPinCount--;
+}
+
+bool AssetBuffer::isPurged() const
+{
+    AutoMutex _l(mLock);
+    return mPurged;
+}
+
+
+/*
+ * ===========================================================================
+ *      _SharedBufferAsset
+ * ===========================================================================
+ */
+
+_SharedBufferAsset::_SharedBufferAsset(void)
+    : mLength(0), mOffset(0)
+{
+}
+
+_SharedBufferAsset::~_SharedBufferAsset(void)
+{
+    close();
+}
+
+status_t _SharedBufferAsset::openChunk(const sp<AssetBuffer>& buffer)
+{
+    assert(mBuffer == NULL);    // no re-open
+
+    if (!buffer->pin()) {
+        return UNKNOWN_ERROR;
+    }
+
+    mBuffer = buffer;
+    mLength = buffer->getLength();
+    return NO_ERROR;
+}
+
+ssize_t _SharedBufferAsset::read(void* buf, size_t count)
+{
+    assert(mOffset >= 0 && mOffset <= mLength);
+
+    /* adjust count if we're near EOF */
+    size_t maxLen = mLength - mOffset;
+    if (count > maxLen)
+        count = maxLen;
+
+    if (!count)
+        return 0;
+
+    memcpy(buf, (const char*) mBuffer->getData() + mOffset, count);
+    mOffset += count;
+    return count;
+}
+
+off64_t _SharedBufferAsset::seek(off64_t offset, int whence)
+{
+    off64_t newPosn = handleSeek(offset, whence, mOffset, mLength);
+    if (newPosn == (off64_t) -1)
+        return newPosn;
+
+    mOffset = newPosn;
+    return mOffset;
+}
+
+void _SharedBufferAsset::close(void)
+{
+    if (mBuffer != NULL) {
+        mBuffer->unpin();
+        mBuffer.clear();
+    }
+}
+
+const void* _SharedBufferAsset::getBuffer(bool)
+{
+    return mBuffer != NULL ? mBuffer->getData() : NULL;
+}
+
+const void* _SharedBufferAsset::getRange(off64_t offset, size_t length)
+{
+    if (mBuffer == NULL || !isValidRange(offset, length, mLength))
+        return NULL;
+    return (const char*) mBuffer->getData() + offset;
+}
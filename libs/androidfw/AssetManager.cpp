@@ -27,7 +27,9 @@
 #include <androidfw/AssetManager.h>
 #include <androidfw/misc.h>
 #include <androidfw/ResourceTypes.h>
+#include <androidfw/StreamingZipInflater.h>
 #include <androidfw/ZipFileRO.h>
+#include <androidfw/ZipUtils.h>
 #include <utils/Atomic.h>
 #include <utils/Log.h>
 #include <utils/String8.h>
@@ -41,8 +43,12 @@
 #include <assert.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <string.h> // strerror
 #include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #ifndef TEMP_FAILURE_RETRY
 /* Used to retry syscalls that can return EINTR. */
@@ -79,6 +85,14 @@ static const char* kExcludeExtension = ".EXCLUDE";
 
 static Asset* const kExcludedAsset = (Asset*) 0xd000000d;
 
+/*
+ * Limits of the cache of inflated entries kept by each SharedZip.  Entries
+ * larger than kMaxAssetBufferLength are not cached.
+ */
+static const size_t kMaxAssetBuffers = 16;
+static const size_t kMaxAssetBuffersLength = 1024 * 1024;
+static const size_t kMaxAssetBufferLength = 256 * 1024;
+
 static volatile int32_t gCount = 0;
 
 const char* AssetManager::RESOURCES_FILENAME = "resources.arsc";
@@ -89,7 +103,7 @@ const char* AssetManager::TARGET_APK_PATH = "/system/framework/framework-res.apk
 const char* AssetManager::IDMAP_DIR = "/data/resource-cache";
 
 namespace {
-    String8 idmapPathForPackagePath(const String8& pkgPath)
+    String8 cachePathForPackagePath(const String8& pkgPath, const char* suffix)
     {
         const char* root = getenv("ANDROID_DATA");
         LOG_ALWAYS_FATAL_IF(root == NULL, "ANDROID_DATA not set");
@@ -111,11 +125,26 @@ namespace {
             ++p;
         }
         path.appendPath(filename);
-        path.append("@idmap");
+        path.append(suffix);
 
         return path;
     }
 
+    String8 idmapPathForPackagePath(const String8& pkgPath)
+    {
+        return cachePathForPackagePath(pkgPath, "@idmap");
+    }
+
+    String8 tableIndexPathForPackagePath(const String8& pkgPath)
+    {
+        return cachePathForPackagePath(pkgPath, "@index");
+    }
+
+    String8 zipIndexPathForPackagePath(const String8& pkgPath)
+    {
+        return cachePathForPackagePath(pkgPath, "@zipindex");
+    }
+
     /*
      * Like strdup(), but uses C++ "new" operator instead of malloc.
      */
@@ -161,6 +190,11 @@ AssetManager::~AssetManager(void)
     int count = android_atomic_dec(&gCount);
     //ALOGI("Destroying AssetManager in %p #%d\n", this, count);
 
+    if (mPrefetchThread != NULL) {
+        mPrefetchThread->requestExit();
+        mPrefetchThread->join();
+    }
+
     delete mConfig;
     delete mResources;
 
@@ -609,7 +643,22 @@ const ResTable* AssetManager::getResTable(bool required) const
                     // can quickly copy it out for others.
                     ALOGV("Creating shared resources for %s", ap.path.string());
                     sharedRes = new ResTable();
+#ifdef HAVE_ANDROID_OS
+                    // Processes loading the same table share a read-only
+                    // index of its types instead of each building its own.
+                    uint32_t tableCrc;
+                    if (getResourceTableCrcLocked(ap, &tableCrc)) {
+                        sharedRes->add(ass, i + 1, false, idmap,
+                                openTableIndexLocked(ap, tableCrc));
+                        if (!sharedRes->isTableIndexed(0)) {
+                            writeTableIndexLocked(ap, *sharedRes, tableCrc);
+                        }
+                    } else {
+                        sharedRes->add(ass, i + 1, false, idmap);
+                    }
+#else
                     sharedRes->add(ass, i + 1, false, idmap);
+#endif
 #ifdef HAVE_ANDROID_OS
                     const char* data = getenv("ANDROID_DATA");
                     LOG_ALWAYS_FATAL_IF(data == NULL, "ANDROID_DATA not set");
@@ -701,6 +750,98 @@ Asset* AssetManager::openIdmapLocked(const struct asset_path& ap) const
     return ass;
 }
 
+bool AssetManager::getResourceTableCrcLocked(const struct asset_path& ap,
+        uint32_t* outCrc) const
+{
+    ZipFileRO* zip = const_cast<AssetManager*>(this)->getZipFileLocked(ap);
+    if (zip == NULL) {
+        return false;
+    }
+    ZipEntryRO entry = zip->findEntryByName("resources.arsc");
+    if (entry == NULL) {
+        return false;
+    }
+    long crc;
+    const bool found = zip->getEntryInfo(entry, NULL, NULL, NULL, NULL, NULL, &crc);
+    zip->releaseEntry(entry);
+    if (found) {
+        *outCrc = (uint32_t)crc;
+    }
+    return found;
+}
+
+FileMap* AssetManager::openTableIndexLocked(const struct asset_path& ap,
+        uint32_t tableCrc) const
+{
+    const String8 path = tableIndexPathForPackagePath(ap.path);
+    int fd = TEMP_FAILURE_RETRY(open(path.string(), O_RDONLY));
+    if (fd < 0) {
+        ALOGV("no table index %s\n", path.string());
+        return NULL;
+    }
+
+    FileMap* map = NULL;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        map = new FileMap();
+        if (!map->create(path.string(), fd, 0, st.st_size, true)) {
+            map->release();
+            map = NULL;
+        }
+    }
+    close(fd);
+
+    uint32_t indexCrc;
+    if (map != NULL && (!ResTable::getTableIndexInfo(map->getDataPtr(),
+            map->getDataLength(), &indexCrc) || indexCrc != tableCrc)) {
+        ALOGV("table index %s is stale\n", path.string());
+        map->release();
+        map = NULL;
+    }
+    return map;
+}
+
+void AssetManager::writeTableIndexLocked(const struct asset_path& ap, const ResTable& table,
+        uint32_t tableCrc) const
+{
+    void* data;
+    size_t size;
+    if (table.createTableIndex(0, tableCrc, &data, &size) != NO_ERROR) {
+        return;
+    }
+
+    // Write to a temporary file first so that other processes never map
+    // a partially written index.
+    const String8 path = tableIndexPathForPackagePath(ap.path);
+    String8 tmpPath(path);
+    tmpPath.appendFormat(".%d", getpid());
+    int fd = TEMP_FAILURE_RETRY(open(tmpPath.string(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    if (fd < 0) {
+        // Only processes allowed to write to the resource cache create the index.
+        ALOGV("failed to create table index %s: %s\n", tmpPath.string(), strerror(errno));
+        free(data);
+        return;
+    }
+
+    const uint8_t* pos = (const uint8_t*)data;
+    size_t remaining = size;
+    while (remaining > 0) {
+        ssize_t written = TEMP_FAILURE_RETRY(write(fd, pos, remaining));
+        if (written <= 0) {
+            break;
+        }
+        pos += written;
+        remaining -= written;
+    }
+    close(fd);
+    free(data);
+
+    if (remaining != 0 || rename(tmpPath.string(), path.string()) != 0) {
+        ALOGW("failed to write table index %s: %s\n", path.string(), strerror(errno));
+        unlink(tmpPath.string());
+    }
+}
+
 void AssetManager::addSystemOverlays(const char* pathOverlaysList,
         const String8& targetPackagePath, ResTable* sharedRes, size_t offset) const
 {
@@ -753,6 +894,27 @@ bool AssetManager::isUpToDate()
     return mZipSet.isUpToDate();
 }
 
+bool AssetManager::precomputeSharedBags(const uint32_t* resIDs, size_t count)
+{
+    AutoMutex _l(mLock);
+    if (mAssetPaths.size() == 0) {
+        return false;
+    }
+
+    // Creates the shared table if needed.
+    getResTable(false);
+    ResTable* sharedRes = mZipSet.getZipResourceTable(mAssetPaths.itemAt(0).path);
+    if (sharedRes == NULL) {
+        ALOGW("No shared resource table to precompute bags in");
+        return false;
+    }
+
+    // The shared table is only used as a source for the other tables, its
+    // parameters are only those of its precomputed bags.
+    sharedRes->setParameters(mConfig);
+    return sharedRes->precomputeBags(resIDs, count) == NO_ERROR;
+}
+
 void AssetManager::getLocales(Vector<String8>* locales) const
 {
     ResTable* res = mResources;
@@ -802,7 +964,7 @@ Asset* AssetManager::openNonAssetInPathLocked(const char* fileName, AccessMode m
             ZipEntryRO entry = pZip->findEntryByName(path.string());
             if (entry != NULL) {
                 //printf("FOUND NA in Zip file for %s\n", appName ? appName : kAppCommon);
-                pAsset = openAssetFromZipLocked(pZip, entry, mode, path);
+                pAsset = openAssetFromZipLocked(pZip, entry, mode, path, ap.path);
                 pZip->releaseEntry(entry);
             }
         }
@@ -955,7 +1117,7 @@ Asset* AssetManager::openInLocaleVendorLocked(const char* fileName, AccessMode m
             if (entry != NULL) {
                 //printf("FOUND in Zip file for %s/%s-%s\n",
                 //    appName, locale, vendor);
-                pAsset = openAssetFromZipLocked(pZip, entry, mode, path);
+                pAsset = openAssetFromZipLocked(pZip, entry, mode, path, ap.path);
                 pZip->releaseEntry(entry);
             }
         }
@@ -1063,11 +1225,11 @@ Asset* AssetManager::openAssetFromFileLocked(const String8& pathName,
  * slice of shared memory.
  */
 Asset* AssetManager::openAssetFromZipLocked(const ZipFileRO* pZipFile,
-    const ZipEntryRO entry, AccessMode mode, const String8& entryName)
+    const ZipEntryRO entry, AccessMode mode, const String8& entryName,
+    const String8& zipPath)
 {
     Asset* pAsset = NULL;
 
-    // TODO: look for previously-created shared memory slice?
     int method;
     size_t uncompressedLen;
 
@@ -1082,6 +1244,24 @@ Asset* AssetManager::openAssetFromZipLocked(const ZipFileRO* pZipFile,
         return NULL;
     }
 
+    // Compressed entries that would be inflated in full anyway are shared,
+    // once inflated, by every AssetManager of the process.
+    const bool shareBuffer = method != ZipFileRO::kCompressStored
+            && uncompressedLen <= kMaxAssetBufferLength
+            && (mode == Asset::ACCESS_BUFFER
+                    || uncompressedLen <= StreamingZipInflater::OUTPUT_CHUNK_SIZE);
+    if (shareBuffer) {
+        sp<AssetBuffer> buffer = mZipSet.getZipAssetBuffer(zipPath, entryName);
+        if (buffer != NULL) {
+            pAsset = Asset::createFromSharedBuffer(buffer, mode);
+            if (pAsset != NULL) {
+                ALOGV("Opened shared entry %s in zip %s mode %d: %p", entryName.string(),
+                        zipPath.string(), mode, pAsset);
+                return pAsset;
+            }
+        }
+    }
+
     FileMap* dataMap = pZipFile->createEntryFileMap(entry);
     if (dataMap == NULL) {
         ALOGW("create map from entry failed\n");
@@ -1092,7 +1272,19 @@ Asset* AssetManager::openAssetFromZipLocked(const ZipFileRO* pZipFile,
         pAsset = Asset::createFromUncompressedMap(dataMap, mode);
         ALOGV("Opened uncompressed entry %s in zip %s mode %d: %p", entryName.string(),
                 dataMap->getFileName(), mode, pAsset);
-    } else {
+    } else if (shareBuffer) {
+        pAsset = openSharedBufferLocked(dataMap, uncompressedLen, mode, entryName, zipPath);
+    }
+
+    // Inflate privately when the entry cannot be shared
+    if (pAsset == NULL && method != ZipFileRO::kCompressStored) {
+        if (shareBuffer) {
+            dataMap = pZipFile->createEntryFileMap(entry);
+            if (dataMap == NULL) {
+                ALOGW("create map from entry failed\n");
+                return NULL;
+            }
+        }
         pAsset = Asset::createFromCompressedMap(dataMap, method,
             uncompressedLen, mode);
         ALOGV("Opened compressed entry %s in zip %s mode %d: %p", entryName.string(),
@@ -1106,8 +1298,154 @@ Asset* AssetManager::openAssetFromZipLocked(const ZipFileRO* pZipFile,
     return pAsset;
 }
 
+/*
+ * Inflate a compressed entry into a shared buffer and add it to the cache
+ * of the zip.  The map is always released.
+ */
+Asset* AssetManager::openSharedBufferLocked(FileMap* dataMap, size_t uncompressedLen,
+    AccessMode mode, const String8& entryName, const String8& zipPath)
+{
+    sp<AssetBuffer> buffer = AssetBuffer::create(entryName.string(), uncompressedLen);
+    if (buffer == NULL) {
+        dataMap->release();
+        return NULL;
+    }
+
+    const bool inflated = ZipUtils::inflateToBuffer(dataMap->getDataPtr(), buffer->getData(),
+            uncompressedLen, dataMap->getDataLength());
+    dataMap->release();
+    if (!inflated) {
+        ALOGW("failed to inflate %s in zip %s\n", entryName.string(), zipPath.string());
+        buffer->unpin();
+        return NULL;
+    }
+
+    // Another AssetManager may have inflated the same entry meanwhile
+    sp<AssetBuffer> shared = mZipSet.setZipAssetBuffer(zipPath, entryName, buffer);
+    Asset* pAsset = Asset::createFromSharedBuffer(shared, mode);
+    buffer->unpin();
+
+    ALOGV("Opened shared entry %s in zip %s mode %d: %p", entryName.string(),
+            zipPath.string(), mode, pAsset);
+    return pAsset;
+}
+
 
 
+/*
+ * Opens the files queued by prefetch(), one at a time, so that mLock is
+ * only held for the time it takes to open each file.
+ */
+class AssetManager::PrefetchThread : public Thread {
+public:
+    PrefetchThread(AssetManager* assets)
+        : Thread(false), mAssets(assets)
+    {
+    }
+
+    void add(const String8& fileName, bool nonAsset)
+    {
+        AutoMutex _l(mLock);
+        request r;
+        r.fileName = fileName;
+        r.nonAsset = nonAsset;
+        mRequests.add(r);
+        mCondition.signal();
+    }
+
+    virtual void requestExit()
+    {
+        Thread::requestExit();
+        AutoMutex _l(mLock);
+        mCondition.signal();
+    }
+
+private:
+    struct request {
+        String8 fileName;
+        bool nonAsset;
+    };
+
+    virtual bool threadLoop()
+    {
+        request r;
+        {
+            AutoMutex _l(mLock);
+            while (mRequests.isEmpty() && !exitPending()) {
+                mCondition.wait(mLock);
+            }
+            if (exitPending()) {
+                return false;
+            }
+            r = mRequests[0];
+            mRequests.removeAt(0);
+        }
+
+        Asset* asset = r.nonAsset
+                ? mAssets->openNonAsset(r.fileName.string(), Asset::ACCESS_BUFFER)
+                : mAssets->open(r.fileName.string(), Asset::ACCESS_BUFFER);
+        if (asset != NULL) {
+            touchAsset(asset);
+            delete asset;
+        }
+        return true;
+    }
+
+    /*
+     * Shared buffers are ready once opened.  The data of uncompressed assets
+     * is paged in; other compressed assets would be inflated for nothing.
+     */
+    static void touchAsset(Asset* asset)
+    {
+        if (asset->isAllocated()) {
+            return;
+        }
+
+        off64_t start, length;
+        int fd = asset->openFileDescriptor(&start, &length);
+        if (fd < 0) {
+            return;
+        }
+        close(fd);
+
+        const volatile uint8_t* data = (const uint8_t*) asset->getBuffer(false);
+        if (data == NULL) {
+            return;
+        }
+        for (off64_t i = 0; i < length; i += 4096) {
+            (void) data[i];
+        }
+    }
+
+    AssetManager* const mAssets;
+
+    Mutex mLock;
+    Condition mCondition;
+    Vector<request> mRequests;
+};
+
+void AssetManager::prefetch(const Vector<String8>& fileNames, bool nonAsset)
+{
+    sp<PrefetchThread> thread;
+    {
+        AutoMutex _l(mLock);
+        if (mPrefetchThread == NULL) {
+            sp<PrefetchThread> newThread = new PrefetchThread(this);
+            if (newThread->run("AssetPrefetch", PRIORITY_BACKGROUND) != NO_ERROR) {
+                ALOGW("failed to start the asset prefetch thread\n");
+                return;
+            }
+            mPrefetchThread = newThread;
+        }
+        thread = mPrefetchThread;
+    }
+
+    const size_t N = fileNames.size();
+    for (size_t i = 0; i < N; i++) {
+        thread->add(fileNames[i], nonAsset);
+    }
+}
+
 /*
  * Open a directory in the asset namespace.
  *
@@ -1423,17 +1761,7 @@ SortedVector<AssetDir::FileInfo>* AssetManager::scanDirLocked(const String8& pat
 bool AssetManager::scanAndMergeZipLocked(SortedVector<AssetDir::FileInfo>* pMergedInfo,
     const asset_path& ap, const char* rootDir, const char* baseDirName)
 {
-    ZipFileRO* pZip;
-    Vector<String8> dirs;
-    AssetDir::FileInfo info;
-    SortedVector<AssetDir::FileInfo> contents;
-    String8 sourceName, zipName, dirName;
-
-    pZip = mZipSet.getZip(ap.path);
-    if (pZip == NULL) {
-        ALOGW("Failure opening zip %s\n", ap.path.string());
-        return false;
-    }
+    String8 zipName, dirName;
 
     zipName = ZipSet::getPathName(ap.path.string());
 
@@ -1442,91 +1770,28 @@ bool AssetManager::scanAndMergeZipLocked(SortedVector<AssetDir::FileInfo>* pMerg
     dirName.appendPath(baseDirName);
 
     /*
-     * Scan through the list of files, looking for a match.  The files in
-     * the Zip table of contents are not in sorted order, so we have to
-     * process the entire list.  We're looking for a string that begins
-     * with the characters in "dirName", is followed by a '/', and has no
-     * subsequent '/' in the stuff that follows.
-     *
-     * What makes this especially fun is that directories are not stored
-     * explicitly in Zip archives, so we have to infer them from context.
-     * When we see "sounds/foo.wav" we have to leave a note to ourselves
-     * to insert a directory called "sounds" into the list.  We store
-     * these in temporary vector so that we only return each one once.
+     * The files in the Zip table of contents are not in sorted order, and
+     * directories are not stored explicitly in Zip archives.  The SharedZip
+     * indexes the files and the inferred directories of the whole archive
+     * the first time a directory is listed, so that listing a directory
+     * is proportional to its number of children.
      *
      * Name comparisons are case-sensitive to match UNIX filesystem
      * semantics.
      */
-    int dirNameLen = dirName.length();
-    void *iterationCookie;
-    if (!pZip->startIteration(&iterationCookie)) {
-        ALOGW("ZipFileRO::startIteration returned false");
+    const SortedVector<AssetDir::FileInfo>* pDir;
+    if (!mZipSet.getZipDirectory(ap.path, dirName, &pDir)) {
+        ALOGW("Failure indexing zip %s\n", ap.path.string());
         return false;
     }
-
-    ZipEntryRO entry;
-    while ((entry = pZip->nextEntry(iterationCookie)) != NULL) {
-        char nameBuf[256];
-
-        if (pZip->getEntryFileName(entry, nameBuf, sizeof(nameBuf)) != 0) {
-            // TODO: fix this if we expect to have long names
-            ALOGE("ARGH: name too long?\n");
-            continue;
-        }
-        //printf("Comparing %s in %s?\n", nameBuf, dirName.string());
-        if (dirNameLen == 0 ||
-            (strncmp(nameBuf, dirName.string(), dirNameLen) == 0 &&
-             nameBuf[dirNameLen] == '/'))
-        {
-            const char* cp;
-            const char* nextSlash;
-
-            cp = nameBuf + dirNameLen;
-            if (dirNameLen != 0)
-                cp++;       // advance past the '/'
-
-            nextSlash = strchr(cp, '/');
-//xxx this may break if there are bare directory entries
-            if (nextSlash == NULL) {
-                /* this is a file in the requested directory */
-
-                info.set(String8(nameBuf).getPathLeaf(), kFileTypeRegular);
-
-                info.setSourceName(
-                    createZipSourceNameLocked(zipName, dirName, info.getFileName()));
-
-                contents.add(info);
-                //printf("FOUND: file '%s'\n", info.getFileName().string());
-            } else {
-                /* this is a subdir; add it if we don't already have it*/
-                String8 subdirName(cp, nextSlash - cp);
-                size_t j;
-                size_t N = dirs.size();
-
-                for (j = 0; j < N; j++) {
-                    if (subdirName == dirs[j]) {
-                        break;
-                    }
-                }
-                if (j == N) {
-                    dirs.add(subdirName);
-                }
-
-                //printf("FOUND: dir '%s'\n", subdirName.string());
-            }
-        }
+    if (pDir == NULL) {
+        return true;
     }
 
-    pZip->endIteration(iterationCookie);
-
-    /*
-     * Add the set of unique directories.
-     */
-    for (int i = 0; i < (int) dirs.size(); i++) {
-        info.set(dirs[i], kFileTypeDirectory);
-        info.setSourceName(
-            createZipSourceNameLocked(zipName, dirName, info.getFileName()));
-        contents.add(info);
+    SortedVector<AssetDir::FileInfo> contents(*pDir);
+    for (size_t i = 0; i < contents.size(); i++) {
+        AssetDir::FileInfo& info = contents.editItemAt(i);
+        info.setSourceName(createZipSourceNameLocked(zipName, dirName, info.getFileName()));
     }
 
     mergeInfoLocked(pMergedInfo, &contents);
@@ -1789,11 +2054,16 @@ DefaultKeyedVector<String8, wp<AssetManager::SharedZip> > AssetManager::SharedZi
 
 AssetManager::SharedZip::SharedZip(const String8& path, time_t modWhen)
     : mPath(path), mZipFile(NULL), mModWhen(modWhen),
-      mResourceTableAsset(NULL), mResourceTable(NULL)
+      mResourceTableAsset(NULL), mResourceTable(NULL), mAssetBuffersLength(0),
+      mDirectories(NULL)
 {
     //ALOGI("Creating SharedZip %p %s\n", this, (const char*)mPath);
     ALOGV("+++ opening zip '%s'\n", mPath.string());
+#ifdef HAVE_ANDROID_OS
+    mZipFile = ZipFileRO::open(mPath.string(), zipIndexPathForPackagePath(mPath).string());
+#else
     mZipFile = ZipFileRO::open(mPath.string());
+#endif
     if (mZipFile == NULL) {
         ALOGD("failed to open Zip archive '%s'\n", mPath.string());
     }
@@ -1863,6 +2133,143 @@ ResTable* AssetManager::SharedZip::setResourceTable(ResTable* res)
     return mResourceTable;
 }
 
+sp<AssetBuffer> AssetManager::SharedZip::getAssetBuffer(const String8& entryName)
+{
+    AutoMutex _l(gLock);
+    const size_t N = mAssetBuffers.size();
+    for (size_t i = 0; i < N; i++) {
+        if (mAssetBuffers[i].entryName != entryName) {
+            continue;
+        }
+        asset_buffer cached = mAssetBuffers[i];
+        mAssetBuffers.removeAt(i);
+        if (cached.buffer->isPurged()) {
+            mAssetBuffersLength -= cached.buffer->getLength();
+            return NULL;
+        }
+        // Most recently used last
+        mAssetBuffers.add(cached);
+        return cached.buffer;
+    }
+    return NULL;
+}
+
+sp<AssetBuffer> AssetManager::SharedZip::setAssetBuffer(const String8& entryName,
+        const sp<AssetBuffer>& buffer)
+{
+    AutoMutex _l(gLock);
+    const size_t N = mAssetBuffers.size();
+    for (size_t i = 0; i < N; i++) {
+        if (mAssetBuffers[i].entryName != entryName) {
+            continue;
+        }
+        if (!mAssetBuffers[i].buffer->isPurged()) {
+            return mAssetBuffers[i].buffer;
+        }
+        mAssetBuffersLength -= mAssetBuffers[i].buffer->getLength();
+        mAssetBuffers.removeAt(i);
+        break;
+    }
+
+    asset_buffer cached;
+    cached.entryName = entryName;
+    cached.buffer = buffer;
+    mAssetBuffers.add(cached);
+    mAssetBuffersLength += buffer->getLength();
+
+    // Evict the least recently used buffers, whether they are in use or not
+    while (mAssetBuffers.size() > 1 && (mAssetBuffers.size() > kMaxAssetBuffers
+            || mAssetBuffersLength > kMaxAssetBuffersLength)) {
+        mAssetBuffersLength -= mAssetBuffers[0].buffer->getLength();
+        mAssetBuffers.removeAt(0);
+    }
+    return buffer;
+}
+
+bool AssetManager::SharedZip::getDirectory(const String8& dirName,
+        const SortedVector<AssetDir::FileInfo>** outDir)
+{
+    AutoMutex _l(mDirectoriesLock);
+    if (mDirectories == NULL) {
+        mDirectories = buildDirectoryIndex();
+        if (mDirectories == NULL) {
+            return false;
+        }
+    }
+
+    // The index is not modified once built
+    ssize_t idx = mDirectories->indexOfKey(dirName);
+    *outDir = idx >= 0 ? &mDirectories->valueAt(idx) : NULL;
+    return true;
+}
+
+/*
+ * Index the files of the zip by directory.  When we see "sounds/foo.wav"
+ * we also add a directory called "sounds" to the root directory.
+ */
+AssetManager::SharedZip::directory_index* AssetManager::SharedZip::buildDirectoryIndex() const
+{
+    void* iterationCookie;
+    if (mZipFile == NULL || !mZipFile->startIteration(&iterationCookie)) {
+        ALOGW("ZipFileRO::startIteration returned false");
+        return NULL;
+    }
+
+    directory_index* index = new directory_index();
+    index->add(String8(), SortedVector<AssetDir::FileInfo>());
+
+    ZipEntryRO entry;
+    while ((entry = mZipFile->nextEntry(iterationCookie)) != NULL) {
+        char nameBuf[PATH_MAX];
+
+        if (mZipFile->getEntryFileName(entry, nameBuf, sizeof(nameBuf)) != 0) {
+            ALOGE("ARGH: name too long?\n");
+            continue;
+        }
+
+        const char* lastSlash = strrchr(nameBuf, '/');
+        const String8 dirName = lastSlash != NULL
+                ? String8(nameBuf, lastSlash - nameBuf) : String8();
+        const char* leaf = lastSlash != NULL ? lastSlash + 1 : nameBuf;
+
+        ssize_t idx = addDirectory(index, dirName);
+        // Bare directory entries only add their directory
+        if (*leaf != '\0') {
+            AssetDir::FileInfo info;
+            info.set(String8(leaf), kFileTypeRegular);
+            index->editValueAt(idx).add(info);
+        }
+    }
+
+    mZipFile->endIteration(iterationCookie);
+
+    ALOGV("Indexed %d directories of zip %s\n", (int) index->size(), mPath.string());
+    return index;
+}
+
+/*
+ * Add a directory, and its parents, to the index if not present yet.
+ * Returns the index of the directory.
+ */
+ssize_t AssetManager::SharedZip::addDirectory(directory_index* index, const String8& dirName)
+{
+    ssize_t idx = index->indexOfKey(dirName);
+    if (idx >= 0) {
+        return idx;
+    }
+
+    // The root is always present, so dirName is not empty
+    const char* path = dirName.string();
+    const char* lastSlash = strrchr(path, '/');
+    const String8 parentName = lastSlash != NULL ? String8(path, lastSlash - path) : String8();
+
+    AssetDir::FileInfo info;
+    info.set(String8(lastSlash != NULL ? lastSlash + 1 : path), kFileTypeDirectory);
+    index->editValueAt(addDirectory(index, parentName)).add(info);
+
+    return index->add(dirName, SortedVector<AssetDir::FileInfo>());
+}
+
 bool AssetManager::SharedZip::isUpToDate()
 {
     time_t modWhen = getFileModDate(mPath.string());
@@ -1886,6 +2293,7 @@ bool AssetManager::SharedZip::getOverlay(size_t idx, asset_path* out) const
 AssetManager::SharedZip::~SharedZip()
 {
     //ALOGI("Destroying SharedZip %p %s\n", this, (const char*)mPath);
+    delete mDirectories;
     if (mResourceTable != NULL) {
         delete mResourceTable;
     }
@@ -1975,6 +2383,40 @@ ResTable* AssetManager::ZipSet::getZipResourceTable(const String8& path)
     return zip->getResourceTable();
 }
 
+bool AssetManager::ZipSet::getZipDirectory(const String8& path, const String8& dirName,
+                                           const SortedVector<AssetDir::FileInfo>** outDir)
+{
+    int idx = getIndex(path);
+    sp<SharedZip> zip = mZipFile[idx];
+    if (zip == NULL) {
+        zip = SharedZip::get(path);
+        mZipFile.editItemAt(idx) = zip;
+    }
+    return zip->getDirectory(dirName, outDir);
+}
+
+sp<AssetBuffer> AssetManager::ZipSet::getZipAssetBuffer(const String8& path,
+                                                        const String8& entryName)
+{
+    int idx = getIndex(path);
+    sp<SharedZip> zip = mZipFile[idx];
+    if (zip == NULL) {
+        zip = SharedZip::get(path);
+        mZipFile.editItemAt(idx) = zip;
+    }
+    return zip->getAssetBuffer(entryName);
+}
+
+sp<AssetBuffer> AssetManager::ZipSet::setZipAssetBuffer(const String8& path,
+                                                        const String8& entryName,
+                                                        const sp<AssetBuffer>& buffer)
+{
+    int idx = getIndex(path);
+    sp<SharedZip> zip = mZipFile[idx];
+    // doesn't make sense to call before previously accessing.
+    return zip->setAssetBuffer(entryName, buffer);
+}
+
 ResTable* AssetManager::ZipSet::setZipResourceTable(const String8& path,
                                                     ResTable* res)
 {
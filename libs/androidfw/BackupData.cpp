@@ -19,8 +19,10 @@
 #include <androidfw/BackupHelpers.h>
 #include <utils/ByteOrder.h>
 
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <cutils/log.h>
@@ -56,11 +58,46 @@ padding_extra(size_t n)
     return ROUND_UP[n % 4];
 }
 
+static const uint32_t PADDING = 0xbcbcbcbc;
+
+// Writes every byte of the vector with as few writev() calls as the fd
+// allows.  Returns the number of bytes written, or -1 with errno set.
+static ssize_t
+writev_fully(int fd, struct iovec* iov, int iovcnt)
+{
+    ssize_t total = 0;
+    while (iovcnt > 0) {
+        ssize_t amt = writev(fd, iov, iovcnt);
+        if (amt < 0 && errno == EINTR) {
+            continue;
+        }
+        if (amt <= 0) {
+            if (amt == 0) {
+                errno = EIO;
+            }
+            return -1;
+        }
+        total += amt;
+        // Skip what was written, which may end in the middle of a vector.
+        while (iovcnt > 0 && (size_t)amt >= iov->iov_len) {
+            amt -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + amt;
+            iov->iov_len -= amt;
+        }
+    }
+    return total;
+}
+
 BackupDataWriter::BackupDataWriter(int fd)
     :m_fd(fd),
      m_status(NO_ERROR),
      m_pos(0),
-     m_entityCount(0)
+     m_entityCount(0),
+     m_tarFlags(0)
 {
 }
 
@@ -68,27 +105,6 @@ BackupDataWriter::~BackupDataWriter()
 {
 }
 
-// Pad out anything they've previously written to the next 4 byte boundary.
-status_t
-BackupDataWriter::write_padding_for(int n)
-{
-    ssize_t amt;
-    ssize_t paddingSize;
-
-    paddingSize = padding_extra(n);
-    if (paddingSize > 0) {
-        uint32_t padding = 0xbcbcbcbc;
-        if (DEBUG) ALOGI("writing %d padding bytes for %d", paddingSize, n);
-        amt = write(m_fd, &padding, paddingSize);
-        if (amt != paddingSize) {
-            m_status = errno;
-            return m_status;
-        }
-        m_pos += amt;
-    }
-    return NO_ERROR;
-}
-
 status_t
 BackupDataWriter::WriteEntityHeader(const String8& key, size_t dataSize)
 {
@@ -96,13 +112,6 @@ BackupDataWriter::WriteEntityHeader(const String8& key, size_t dataSize)
         return m_status;
     }
 
-    ssize_t amt;
-
-    amt = write_padding_for(m_pos);
-    if (amt != 0) {
-        return amt;
-    }
-
     String8 k;
     if (m_keyPrefix.length() > 0) {
         k = m_keyPrefix;
@@ -125,27 +134,31 @@ BackupDataWriter::WriteEntityHeader(const String8& key, size_t dataSize)
     header.keyLen = tolel(keyLen);
     header.dataSize = tolel(dataSize);
 
-    if (DEBUG) ALOGI("writing entity header, %d bytes", sizeof(entity_header_v1));
-    amt = write(m_fd, &header, sizeof(entity_header_v1));
-    if (amt != sizeof(entity_header_v1)) {
+    // The padding of the previous entity's data, the header, the key and
+    // its padding go out in one system call.
+    uint32_t padding = PADDING;
+    struct iovec iov[4];
+    iov[0].iov_base = &padding;
+    iov[0].iov_len = padding_extra(m_pos);
+    iov[1].iov_base = &header;
+    iov[1].iov_len = sizeof(entity_header_v1);
+    iov[2].iov_base = (void*)k.string();
+    iov[2].iov_len = keyLen+1;
+    iov[3].iov_base = &padding;
+    iov[3].iov_len = padding_extra(keyLen+1);
+    ssize_t size = iov[0].iov_len + iov[1].iov_len + iov[2].iov_len + iov[3].iov_len;
+
+    if (DEBUG) ALOGI("writing entity header and key, %d bytes", size);
+    ssize_t amt = writev_fully(m_fd, iov, 4);
+    if (amt != size) {
         m_status = errno;
         return m_status;
     }
     m_pos += amt;
 
-    if (DEBUG) ALOGI("writing entity header key, %d bytes", keyLen+1);
-    amt = write(m_fd, k.string(), keyLen+1);
-    if (amt != keyLen+1) {
-        m_status = errno;
-        return m_status;
-    }
-    m_pos += amt;
-
-    amt = write_padding_for(keyLen+1);
-
     m_entityCount++;
 
-    return amt;
+    return NO_ERROR;
 }
 
 status_t
@@ -173,12 +186,62 @@ BackupDataWriter::WriteEntityData(const void* data, size_t size)
     return NO_ERROR;
 }
 
+status_t
+BackupDataWriter::WriteEntityDataVector(struct iovec* iov, int iovcnt)
+{
+    if (m_status != NO_ERROR) {
+        return m_status;
+    }
+
+    ssize_t size = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        size += iov[i].iov_len;
+    }
+    if (DEBUG) ALOGD("Writing data: %d buffers, size=%ld", iovcnt, (long) size);
+
+    ssize_t amt = writev_fully(m_fd, iov, iovcnt);
+    if (amt != size) {
+        m_status = errno;
+        if (DEBUG) ALOGD("writev returned error %d (%s)", m_status, strerror(m_status));
+        return m_status;
+    }
+    m_pos += amt;
+    return NO_ERROR;
+}
+
 void
 BackupDataWriter::SetKeyPrefix(const String8& keyPrefix)
 {
     m_keyPrefix = keyPrefix;
 }
 
+void
+BackupDataWriter::SetTarStreamFlags(int flags)
+{
+    m_tarFlags = flags;
+}
+
+int
+BackupDataWriter::GetTarStreamFlags() const
+{
+    return m_tarFlags;
+}
+
+bool
+BackupDataWriter::FindOrAddHardLink(dev_t dev, ino_t ino, const String8& name,
+        String8* earlierName)
+{
+    String8 key = String8::format("%llu:%llu", (unsigned long long) dev,
+            (unsigned long long) ino);
+    ssize_t index = m_hardLinks.indexOfKey(key);
+    if (index >= 0) {
+        *earlierName = m_hardLinks.valueAt(index);
+        return true;
+    }
+    m_hardLinks.add(key, name);
+    return false;
+}
+
 
 BackupDataReader::BackupDataReader(int fd)
     :m_fd(fd),
@@ -21,8 +21,11 @@
 #include <utils/KeyedVector.h>
 #include <utils/ByteOrder.h>
 #include <utils/String8.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
 
 #include <errno.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <sys/stat.h>
@@ -34,8 +37,11 @@
 #include <fcntl.h>
 #include <zlib.h>
 
+#include <cutils/atomic.h>
 #include <cutils/log.h>
 
+#include <openssl/sha.h>
+
 namespace android {
 
 #define MAGIC0 0x70616e53 // Snap
@@ -211,9 +217,11 @@ write_delete_file(BackupDataWriter* dataStream, const String8& key)
     return dataStream->WriteEntityHeader(key, -1);
 }
 
+// Writes the file as the entity "key".  The checksum of the data written is
+// returned in "outCrc".
 static int
 write_update_file(BackupDataWriter* dataStream, int fd, int mode, const String8& key,
-        char const* realFilename)
+        char const* realFilename, int* outCrc)
 {
     LOGP("write_update_file %s (%s) : mode 0%o\n", realFilename, key.string(), mode);
 
@@ -226,7 +234,7 @@ write_update_file(BackupDataWriter* dataStream, int fd, int mode, const String8&
 
     char* buf = (char*)malloc(bufsize);
     int crc = crc32(0L, Z_NULL, 0);
-
+    *outCrc = crc;
 
     fileSize = lseek(fd, 0, SEEK_END);
     lseek(fd, 0, SEEK_SET);
@@ -259,6 +267,8 @@ write_update_file(BackupDataWriter* dataStream, int fd, int mode, const String8&
         if (bytesLeft < 0) {
             amt += bytesLeft; // Plus a negative is minus.  Don't write more than we promised.
         }
+        crc = crc32(crc, (Bytef*)buf, amt);
+        *outCrc = crc;
         err = dataStream->WriteEntityData(buf, amt);
         if (err != 0) {
             free(buf);
@@ -289,7 +299,8 @@ write_update_file(BackupDataWriter* dataStream, int fd, int mode, const String8&
 }
 
 static int
-write_update_file(BackupDataWriter* dataStream, const String8& key, char const* realFilename)
+write_update_file(BackupDataWriter* dataStream, const String8& key, char const* realFilename,
+        int* outCrc)
 {
     int err;
     struct stat st;
@@ -304,7 +315,7 @@ write_update_file(BackupDataWriter* dataStream, const String8& key, char const*
         return errno;
     }
 
-    err = write_update_file(dataStream, fd, st.st_mode, key, realFilename);
+    err = write_update_file(dataStream, fd, st.st_mode, key, realFilename, outCrc);
     close(fd);
     return err;
 }
@@ -312,15 +323,28 @@ write_update_file(BackupDataWriter* dataStream, const String8& key, char const*
 static int
 compute_crc32(int fd)
 {
-    const int bufsize = 4*1024;
+    const int bufsize = 64*1024;
     int amt;
 
-    char* buf = (char*)malloc(bufsize);
     int crc = crc32(0L, Z_NULL, 0);
 
+    // Map the file when possible, sparing the copies into a buffer.
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && st.st_size <= 0x7fffffff) {
+        void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, st.st_size, MADV_SEQUENTIAL);
+            crc = crc32(crc, (const Bytef*)data, st.st_size);
+            munmap(data, st.st_size);
+            return crc;
+        }
+    }
+
+    char* buf = (char*)malloc(bufsize);
+
     lseek(fd, 0, SEEK_SET);
 
-    while ((amt = read(fd, buf, bufsize)) != 0) {
+    while ((amt = read(fd, buf, bufsize)) > 0) {
         crc = crc32(crc, (Bytef*)buf, amt);
     }
 
@@ -328,6 +352,83 @@ compute_crc32(int fd)
     return crc;
 }
 
+// Number of threads that compute the checksums of files, the calling thread included.
+static const int CRC_THREADS = 4;
+
+struct crc_job {
+    const char* file;
+    bool readable;
+    int crc;
+};
+
+static void
+run_crc_jobs(crc_job* jobs, int32_t count, volatile int32_t* next)
+{
+    int32_t i;
+    while ((i = android_atomic_inc(next)) < count) {
+        crc_job& job = jobs[i];
+        int fd = open(job.file, O_RDONLY);
+        job.readable = fd >= 0;
+        if (job.readable) {
+            job.crc = compute_crc32(fd);
+            close(fd);
+        }
+    }
+}
+
+// Takes the jobs of a crc_job list until there are none left.
+class CrcThread : public Thread {
+public:
+    CrcThread(crc_job* jobs, int32_t count, volatile int32_t* next)
+        : Thread(false), mJobs(jobs), mCount(count), mNext(next)
+    {
+    }
+
+private:
+    virtual bool threadLoop() {
+        run_crc_jobs(mJobs, mCount, mNext);
+        return false;
+    }
+
+    crc_job* const mJobs;
+    const int32_t mCount;
+    volatile int32_t* const mNext;
+};
+
+// Computes the checksums of the files of the jobs on up to CRC_THREADS threads.
+static void
+compute_crc32s(Vector<crc_job>* jobs)
+{
+    const int32_t count = jobs->size();
+    crc_job* array = jobs->editArray();
+    volatile int32_t next = 0;
+
+    Vector<sp<CrcThread> > threads;
+    for (int32_t i = 1; i < CRC_THREADS && i < count; i++) {
+        sp<CrcThread> thread = new CrcThread(array, count, &next);
+        if (thread->run("BackupCrc") != NO_ERROR) {
+            break;
+        }
+        threads.add(thread);
+    }
+    run_crc_jobs(array, count, &next);
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i]->join();
+    }
+}
+
+/*
+ * Whether a file whose size, mode and modification time match its state in
+ * the old snapshot might still have changed since.  As in git's racy-clean
+ * check, a file modified in the second the snapshot was written, or later,
+ * could have been modified again within that second after it was stat()'d.
+ */
+static inline bool
+is_racy(const FileState& state, time_t snapshotTime)
+{
+    return state.modTime_sec >= snapshotTime;
+}
+
 int
 back_up_files(int oldSnapshotFD, BackupDataWriter* dataStream, int newSnapshotFD,
         char const* const* files, char const* const* keys, int fileCount)
@@ -336,11 +437,18 @@ back_up_files(int oldSnapshotFD, BackupDataWriter* dataStream, int newSnapshotFD
     KeyedVector<String8,FileState> oldSnapshot;
     KeyedVector<String8,FileRec> newSnapshot;
 
+    // When the old snapshot was written; 0 trusts no file whose metadata matches.
+    time_t snapshotTime = 0;
     if (oldSnapshotFD != -1) {
         err = read_snapshot_file(oldSnapshotFD, &oldSnapshot);
         if (err != 0) {
             // On an error, treat this as a full backup.
             oldSnapshot.clear();
+        } else {
+            struct stat st;
+            if (fstat(oldSnapshotFD, &st) == 0) {
+                snapshotTime = st.st_mtime;
+            }
         }
     }
 
@@ -361,7 +469,9 @@ back_up_files(int oldSnapshotFD, BackupDataWriter* dataStream, int newSnapshotFD
             //r.s.modTime_nsec = st.st_mtime_nsec;
             r.s.mode = st.st_mode;
             r.s.size = st.st_size;
-            // we compute the crc32 later down below, when we already have the file open.
+            // the crc32 is kept from the old snapshot, computed below, or computed
+            // while the file is written.
+            r.s.crc32 = 0;
 
             if (newSnapshot.indexOfKey(key) >= 0) {
                 LOGP("back_up_files key already in use '%s'", key.string());
@@ -371,6 +481,30 @@ back_up_files(int oldSnapshotFD, BackupDataWriter* dataStream, int newSnapshotFD
         newSnapshot.add(key, r);
     }
 
+    // Files whose metadata matches the old snapshot are unchanged, unless they are
+    // racy; only those files are read to compare their checksums, on several threads.
+    // The others are either written in full, or not read at all.
+    Vector<crc_job> crcJobs;
+    KeyedVector<String8,size_t> crcJobIndex;
+    for (size_t i=0; i<newSnapshot.size(); i++) {
+        const FileRec& g = newSnapshot.valueAt(i);
+        ssize_t index = oldSnapshot.indexOfKey(newSnapshot.keyAt(i));
+        if (g.deleted || index < 0) {
+            continue;
+        }
+        const FileState& f = oldSnapshot.valueAt(index);
+        if (f.modTime_sec == g.s.modTime_sec && f.modTime_nsec == g.s.modTime_nsec
+                && f.mode == g.s.mode && f.size == g.s.size && is_racy(f, snapshotTime)) {
+            crc_job job;
+            job.file = g.file.string();
+            job.readable = false;
+            job.crc = 0;
+            crcJobIndex.add(newSnapshot.keyAt(i), crcJobs.size());
+            crcJobs.add(job);
+        }
+    }
+    compute_crc32s(&crcJobs);
+
     int n = 0;
     int N = oldSnapshot.size();
     int m = 0;
@@ -390,33 +524,47 @@ back_up_files(int oldSnapshotFD, BackupDataWriter* dataStream, int newSnapshotFD
         else if (cmp > 0) {
             // file added
             LOGP("file added: %s", g.file.string());
-            write_update_file(dataStream, q, g.file.string());
+            write_update_file(dataStream, q, g.file.string(), &g.s.crc32);
             m++;
         }
         else {
             // both files exist, check them
             const FileState& f = oldSnapshot.valueAt(n);
-
-            int fd = open(g.file.string(), O_RDONLY);
-            if (fd < 0) {
-                // We can't open the file.  Don't report it as a delete either.  Let the
-                // server keep the old version.  Maybe they'll be able to deal with it
-                // on restore.
-                LOGP("Unable to open file %s - skipping", g.file.string());
-            } else {
-                g.s.crc32 = compute_crc32(fd);
-
-                LOGP("%s", q.string());
-                LOGP("  new: modTime=%d,%d mode=%04o size=%-3d crc32=0x%08x",
-                        f.modTime_sec, f.modTime_nsec, f.mode, f.size, f.crc32);
-                LOGP("  old: modTime=%d,%d mode=%04o size=%-3d crc32=0x%08x",
-                        g.s.modTime_sec, g.s.modTime_nsec, g.s.mode, g.s.size, g.s.crc32);
-                if (f.modTime_sec != g.s.modTime_sec || f.modTime_nsec != g.s.modTime_nsec
-                        || f.mode != g.s.mode || f.size != g.s.size || f.crc32 != g.s.crc32) {
-                    write_update_file(dataStream, fd, g.s.mode, p, g.file.string());
+            bool changed = f.modTime_sec != g.s.modTime_sec || f.modTime_nsec != g.s.modTime_nsec
+                    || f.mode != g.s.mode || f.size != g.s.size;
+
+            LOGP("%s", q.string());
+            LOGP("  old: modTime=%d,%d mode=%04o size=%-3d crc32=0x%08x",
+                    f.modTime_sec, f.modTime_nsec, f.mode, f.size, f.crc32);
+            LOGP("  new: modTime=%d,%d mode=%04o size=%-3d",
+                    g.s.modTime_sec, g.s.modTime_nsec, g.s.mode, g.s.size);
+
+            // We can't read the file.  Don't report it as a delete either.  Let the
+            // server keep the old version.  Maybe they'll be able to deal with it
+            // on restore.
+            bool readable = true;
+            g.s.crc32 = f.crc32;
+            if (!changed) {
+                ssize_t index = crcJobIndex.indexOfKey(q);
+                if (index >= 0) {
+                    const crc_job& job = crcJobs[crcJobIndex.valueAt(index)];
+                    readable = job.readable;
+                    changed = readable && job.crc != f.crc32;
                 }
+            }
 
-                close(fd);
+            if (changed) {
+                int fd = open(g.file.string(), O_RDONLY);
+                readable = fd >= 0;
+                if (readable) {
+                    write_update_file(dataStream, fd, g.s.mode, p, g.file.string(), &g.s.crc32);
+                    close(fd);
+                }
+            }
+            if (!readable) {
+                // Keep the old state, so the file is compared again next time.
+                LOGP("Unable to open file %s - skipping", g.file.string());
+                g.s = f;
             }
             n++;
             m++;
@@ -433,7 +581,7 @@ back_up_files(int oldSnapshotFD, BackupDataWriter* dataStream, int newSnapshotFD
     while (m<fileCount) {
         const String8& q = newSnapshot.keyAt(m);
         FileRec& g = newSnapshot.editValueAt(m);
-        write_update_file(dataStream, q, g.file.string());
+        write_update_file(dataStream, q, g.file.string(), &g.s.crc32);
         m++;
     }
 
@@ -485,8 +633,312 @@ static int write_pax_header_entry(char* buf, const char* key, const char* value)
 // a 4-byte count of its size.  A chunk size of zero (four zero bytes) indicates EOD.
 void send_tarfile_chunk(BackupDataWriter* writer, const char* buffer, size_t size) {
     uint32_t chunk_size_no = htonl(size);
-    writer->WriteEntityData(&chunk_size_no, 4);
-    if (size != 0) writer->WriteEntityData(buffer, size);
+    struct iovec iov[2];
+    iov[0].iov_base = &chunk_size_no;
+    iov[0].iov_len = 4;
+    iov[1].iov_base = (void*) buffer;
+    iov[1].iov_len = size;
+    writer->WriteEntityDataVector(iov, 2);
+}
+
+// The data of a file is sent in chunks of up to this size.
+static const size_t TAR_BLOCK_SIZE = 32 * 1024;
+// Number of chunks read ahead of the ones being written.
+static const size_t TAR_READ_AHEAD = 4;
+
+// A range of a file that holds data, as opposed to a hole of a sparse file.
+struct tar_region {
+    off64_t offset;
+    off64_t length;
+};
+
+/*
+ * Reads the data regions of a file for write_tarfile() into a ring of chunks,
+ * the regions following each other, and the last chunk NUL-padded to a
+ * multiple of 512 bytes.  Once started, a thread of its own reads the next
+ * chunks while the caller writes the previous ones to the backup stream;
+ * files that fit in a single chunk are read by the caller.
+ */
+class TarFileReader : public Thread {
+public:
+    TarFileReader(int fd, const Vector<tar_region>& regions, off64_t size, const String8& path)
+        : Thread(false), mFd(fd), mPath(path), mRegions(regions), mRegion(0), mRegionPos(0),
+          mRemaining(size), mCount(TAR_READ_AHEAD), mBuffers(NULL), mFirst(0), mReady(0),
+          mDone(size <= 0), mError(0), mThreaded(false)
+    {
+        // Don't allocate more chunks than the file needs.
+        off64_t chunks = (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE;
+        if (chunks < (off64_t) mCount) {
+            mCount = chunks > 0 ? chunks : 1;
+        }
+    }
+
+    virtual ~TarFileReader() {
+        free(mBuffers);
+    }
+
+    status_t init() {
+        mBuffers = (char*) malloc(mCount * TAR_BLOCK_SIZE);
+        if (mBuffers == NULL) {
+            return NO_MEMORY;
+        }
+        if (mCount > 1 && run("TarFileReader") == NO_ERROR) {
+            mThreaded = true;
+        }
+        return NO_ERROR;
+    }
+
+    // Waits for the next chunks and returns how many are ready, or 0 once
+    // the whole file was returned or on error.
+    size_t waitForChunks() {
+        if (!mThreaded) {
+            if (mReady == 0 && !mDone) {
+                readChunk();
+            }
+            return mReady;
+        }
+        AutoMutex _l(mLock);
+        while (mReady == 0 && !mDone) {
+            mCondition.wait(mLock);
+        }
+        return mReady;
+    }
+
+    // The i-th ready chunk.
+    const char* chunkData(size_t i) const {
+        return mBuffers + ((mFirst + i) % mCount) * TAR_BLOCK_SIZE;
+    }
+    size_t chunkSize(size_t i) const {
+        return mSizes[(mFirst + i) % mCount];
+    }
+
+    // Hands the first ready chunks back to be filled again.
+    void releaseChunks(size_t count) {
+        AutoMutex _l(mLock);
+        mFirst = (mFirst + count) % mCount;
+        mReady -= count;
+        mCondition.broadcast();
+    }
+
+    // Stops reading, and waits for the thread to exit.
+    void finish() {
+        if (mThreaded) {
+            requestExit();
+            join();
+            mThreaded = false;
+        }
+    }
+
+    // The errno value of a failed read, or 0.
+    int getError() {
+        AutoMutex _l(mLock);
+        return mError;
+    }
+
+    virtual void requestExit() {
+        Thread::requestExit();
+        AutoMutex _l(mLock);
+        mCondition.broadcast();
+    }
+
+private:
+    virtual bool threadLoop() {
+        {
+            AutoMutex _l(mLock);
+            while (mReady == mCount && !exitPending()) {
+                mCondition.wait(mLock);
+            }
+            if (exitPending()) {
+                return false;
+            }
+        }
+        return readChunk();
+    }
+
+    // Reads the next chunk into a free buffer.  Returns false once the file
+    // is read, or on error.  Only the chunks that aren't ready are touched
+    // without the lock.
+    bool readChunk() {
+        size_t slot;
+        {
+            AutoMutex _l(mLock);
+            slot = (mFirst + mReady) % mCount;
+        }
+        char* buf = mBuffers + slot * TAR_BLOCK_SIZE;
+        size_t filled = 0;
+        int err = 0;
+        while (filled < TAR_BLOCK_SIZE && mRemaining > 0 && mRegion < mRegions.size()) {
+            const tar_region& region = mRegions[mRegion];
+            off64_t left = region.length - mRegionPos;
+            if (left <= 0) {
+                mRegion++;
+                mRegionPos = 0;
+                continue;
+            }
+            size_t toRead = TAR_BLOCK_SIZE - filled;
+            if ((off64_t) toRead > left) {
+                toRead = left;
+            }
+            ssize_t nRead = pread64(mFd, buf + filled, toRead, region.offset + mRegionPos);
+            if (nRead < 0 && errno == EINTR) {
+                continue;
+            }
+            if (nRead < 0) {
+                err = errno;
+                ALOGE("Unable to read file [%s], err=%d (%s)", mPath.string(),
+                        err, strerror(err));
+                break;
+            } else if (nRead == 0) {
+                ALOGE("EOF but expect %lld more bytes in [%s]", (long long) mRemaining,
+                        mPath.string());
+                err = EIO;
+                break;
+            }
+            filled += nRead;
+            mRegionPos += nRead;
+            mRemaining -= nRead;
+        }
+
+        // At EOF we might have a short block; NUL-pad that to a 512-byte multiple.
+        ssize_t partial = filled % 512;
+        if (partial > 0) {
+            ssize_t remainder = 512 - partial;
+            memset(buf + filled, 0, remainder);
+            filled += remainder;
+        }
+
+        AutoMutex _l(mLock);
+        if (err != 0) {
+            mError = err;
+            mDone = true;
+        } else {
+            mSizes[slot] = filled;
+            mReady++;
+            mDone = mRemaining <= 0;
+        }
+        mCondition.broadcast();
+        return !mDone;
+    }
+
+    const int mFd;
+    const String8 mPath;
+    const Vector<tar_region> mRegions;
+    // Only used by the reading thread.
+    size_t mRegion;
+    off64_t mRegionPos;
+    off64_t mRemaining;
+
+    size_t mCount;
+    char* mBuffers;
+    size_t mSizes[TAR_READ_AHEAD];
+
+    Mutex mLock;
+    Condition mCondition;
+    size_t mFirst;      // first ready chunk
+    size_t mReady;      // number of ready chunks
+    bool mDone;
+    int mError;
+
+    bool mThreaded;
+};
+
+/*
+ * Lists the regions of the file that hold data, skipping its holes.  A hole
+ * at the end of the file is marked by an empty region at its size, as the
+ * GNU sparse format expects.  Returns false if the filesystem can't tell
+ * where the holes are.
+ */
+static bool find_data_regions(int fd, off64_t size, Vector<tar_region>* regions)
+{
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    off64_t pos = 0;
+    while (pos < size) {
+        off64_t data = lseek64(fd, pos, SEEK_DATA);
+        if (data < 0 && errno == ENXIO) {
+            break;      // only a hole is left
+        }
+        off64_t hole = (data < 0) ? -1 : lseek64(fd, data, SEEK_HOLE);
+        if (hole < 0) {
+            regions->clear();
+            return false;
+        }
+        if (hole > size) {
+            hole = size;
+        }
+        tar_region region = { data, hole - data };
+        regions->add(region);
+        pos = hole;
+    }
+    if (pos < size) {
+        tar_region region = { size, 0 };
+        regions->add(region);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*
+ * Computes the SHA-256 of the contents of the file, its holes reading as
+ * zeros, into "outHex" as lowercase hex.  "regions" lists the data of the
+ * file, or is empty when the whole file is data.
+ */
+static bool hash_file_data(int fd, off64_t size, const Vector<tar_region>& regions,
+        char* outHex)
+{
+    const size_t bufsize = 64 * 1024;
+    char* buf = (char*) malloc(bufsize);
+    if (buf == NULL) {
+        return false;
+    }
+
+    SHA256_CTX ctx;
+    SHA256_Init(&ctx);
+    bool ok = true;
+    off64_t pos = 0;
+    for (size_t i = 0; ok && pos < size; i++) {
+        off64_t start = size, end = size;
+        if (regions.isEmpty()) {
+            start = 0;
+        } else if (i < regions.size()) {
+            start = regions[i].offset;
+            end = start + regions[i].length;
+        }
+
+        // the hole before the region
+        if (pos < start) {
+            memset(buf, 0, bufsize);
+            while (pos < start) {
+                size_t amt = (start - pos < (off64_t) bufsize) ? start - pos : bufsize;
+                SHA256_Update(&ctx, buf, amt);
+                pos += amt;
+            }
+        }
+        while (ok && pos < end) {
+            size_t toRead = (end - pos < (off64_t) bufsize) ? end - pos : bufsize;
+            ssize_t amt = pread64(fd, buf, toRead, pos);
+            if (amt < 0 && errno == EINTR) {
+                continue;
+            }
+            ok = amt > 0;
+            if (ok) {
+                SHA256_Update(&ctx, buf, amt);
+                pos += amt;
+            }
+        }
+    }
+    free(buf);
+
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    SHA256_Final(digest, &ctx);
+    if (!ok) {
+        return false;
+    }
+    for (size_t i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+        sprintf(outHex + 2 * i, "%02x", digest[i]);
+    }
+    return true;
 }
 
 int write_tarfile(const String8& packageName, const String8& domain,
@@ -535,6 +987,14 @@ int write_tarfile(const String8& packageName, const String8& domain,
     const int isdir = S_ISDIR(s.st_mode);
     if (isdir) s.st_size = 0;   // directories get no actual data in the tar stream
 
+    // Extensions of the stream that the writer may enable
+    const int tarFlags = writer->GetTarStreamFlags();
+    String8 linkTarget;         // earlier name of a file sent again as a hard link
+    Vector<tar_region> regions; // data of a sparse file, without its holes
+    String8 sparseMap;          // GNU sparse 1.0 map of those regions
+    off64_t dataSize = s.st_size;   // bytes of data following the header
+    char contentHash[2 * SHA256_DIGEST_LENGTH + 1] = "";
+
     // !!! TODO: use mmap when possible to avoid churning the buffer cache
     // !!! TODO: this will break with symlinks; need to use readlink(2)
     int fd = open(filepath.string(), O_RDONLY);
@@ -544,7 +1004,7 @@ int write_tarfile(const String8& packageName, const String8& domain,
         return err;
     }
 
-    // read/write up to this much at a time.
+    // scratch space for the headers; the file data is read by a TarFileReader.
     const size_t BUFSIZE = 32 * 1024;
     char* buf = (char *)calloc(1,BUFSIZE);
     char* paxHeader = buf + 512;    // use a different chunk of it as separate scratch
@@ -571,13 +1031,6 @@ int write_tarfile(const String8& packageName, const String8& domain,
     snprintf(buf + 108, 8, "0%lo", s.st_uid);
     snprintf(buf + 116, 8, "0%lo", s.st_gid);
 
-    // [ 124 :  12 ] file size in bytes
-    if (s.st_size > 077777777777LL) {
-        // very large files need a pax extended size header
-        needExtended = true;
-    }
-    snprintf(buf + 124, 12, "%011llo", (isdir) ? 0LL : s.st_size);
-
     // [ 136 :  12 ] last mod time as a UTC time_t
     snprintf(buf + 136, 12, "%0lo", s.st_mtime);
 
@@ -593,8 +1046,6 @@ int write_tarfile(const String8& packageName, const String8& domain,
     }
     buf[156] = type;
 
-    // [ 157 : 100 ] name of linked file [not implemented]
-
     {
         // Prefix and main relative path.  Path lengths have been preflighted.
         if (packageName.length() > 0) {
@@ -623,6 +1074,64 @@ int write_tarfile(const String8& packageName, const String8& domain,
         }
     }
 
+    // Hard links, sparse files and content hashes, for the streams that have them
+    if (type == '0' && tarFlags != 0) {
+        if ((tarFlags & TAR_STREAM_HARD_LINKS) && s.st_nlink > 1
+                && writer->FindOrAddHardLink(s.st_dev, s.st_ino, fullname, &linkTarget)) {
+            type = '1';     // tar magic: '1' == hard link to an earlier entry
+            buf[156] = type;
+            dataSize = 0;
+
+            // [ 157 : 100 ] name of linked file, or a pax linkpath if it won't fit
+            bool clean = linkTarget.length() < 100;
+            for (size_t i = 0; clean && i < linkTarget.length(); i++) {
+                clean = (linkTarget[i] & 0x80) == 0;
+            }
+            if (clean) {
+                strncpy(buf + 157, linkTarget.string(), 100);
+            } else {
+                needExtended = true;
+            }
+        } else {
+            if ((tarFlags & TAR_STREAM_SPARSE) && s.st_blocks * 512 < s.st_size
+                    && find_data_regions(fd, s.st_size, &regions)) {
+                off64_t stored = 0;
+                sparseMap = String8::format("%d\n", (int) regions.size());
+                for (size_t i = 0; i < regions.size(); i++) {
+                    sparseMap.appendFormat("%lld\n%lld\n", (long long) regions[i].offset,
+                            (long long) regions[i].length);
+                    stored += regions[i].length;
+                }
+                if (stored < s.st_size) {
+                    // The map fills whole blocks ahead of the data.
+                    dataSize = ((sparseMap.length() + 511) / 512) * 512 + stored;
+                    needExtended = true;
+
+                    // The ustar name is a placeholder, the real name is in the pax header.
+                    String8 leaf = fullname.getPathLeaf();
+                    memset(buf, 0, 100);
+                    snprintf(buf, 100, "GNUSparseFile.0/%s", leaf.string());
+                    memset(buf + 345, 0, 155);
+                    strncpy(buf + 345, prefix.string(), 155);
+                } else {
+                    regions.clear();
+                    sparseMap = "";
+                }
+            }
+            if ((tarFlags & TAR_STREAM_CONTENT_HASH)
+                    && hash_file_data(fd, s.st_size, regions, contentHash)) {
+                needExtended = true;
+            }
+        }
+    }
+
+    // [ 124 :  12 ] file size in bytes
+    if (dataSize > 077777777777LL) {
+        // very large files need a pax extended size header
+        needExtended = true;
+    }
+    snprintf(buf + 124, 12, "%011llo", (long long) dataSize);
+
     // [ 329 : 8 ] and [ 337 : 8 ] devmajor/devminor, not used
 
     ALOGI("   Name: %s", fullname.string());
@@ -639,11 +1148,27 @@ int write_tarfile(const String8& packageName, const String8& domain,
 
         // size header -- calc len in digits by actually rendering the number
         // to a string - brute force but simple
-        snprintf(sizeStr, sizeof(sizeStr), "%lld", s.st_size);
+        snprintf(sizeStr, sizeof(sizeStr), "%lld", (long long) dataSize);
         p += write_pax_header_entry(p, "size", sizeStr);
 
         // fullname was generated above with the ustar paths
-        p += write_pax_header_entry(p, "path", fullname.string());
+        if (sparseMap.length() > 0) {
+            // GNU sparse 1.0: the name is only given here, so that readers that
+            // don't know the format don't restore the map as the file's contents.
+            snprintf(sizeStr, sizeof(sizeStr), "%lld", (long long) s.st_size);
+            p += write_pax_header_entry(p, "GNU.sparse.major", "1");
+            p += write_pax_header_entry(p, "GNU.sparse.minor", "0");
+            p += write_pax_header_entry(p, "GNU.sparse.name", fullname.string());
+            p += write_pax_header_entry(p, "GNU.sparse.realsize", sizeStr);
+        } else {
+            p += write_pax_header_entry(p, "path", fullname.string());
+        }
+        if (linkTarget.length() > 0) {
+            p += write_pax_header_entry(p, "linkpath", linkTarget.string());
+        }
+        if (contentHash[0] != '\0') {
+            p += write_pax_header_entry(p, "ANDROID.sha256", contentHash);
+        }
 
         // Now we know how big the pax data is
         int paxLen = p - paxData;
@@ -677,36 +1202,53 @@ int write_tarfile(const String8& packageName, const String8& domain,
     send_tarfile_chunk(writer, buf, 512);
 
     // Now write the file data itself, for real files.  We honor tar's convention that
-    // only full 512-byte blocks are sent to write().
-    if (!isdir) {
-        off64_t toWrite = s.st_size;
-        while (toWrite > 0) {
-            size_t toRead = (toWrite < BUFSIZE) ? toWrite : BUFSIZE;
-            ssize_t nRead = read(fd, buf, toRead);
-            if (nRead < 0) {
-                err = errno;
-                ALOGE("Unable to read file [%s], err=%d (%s)", filepath.string(),
-                        err, strerror(err));
-                break;
-            } else if (nRead == 0) {
-                ALOGE("EOF but expect %lld more bytes in [%s]", (long long) toWrite,
-                        filepath.string());
-                err = EIO;
-                break;
+    // only full 512-byte blocks are sent to write().  The chunks that are ready are
+    // written together, while the next ones are being read.
+    if (type == '0') {
+        // The sparse map is a block of its own ahead of the data.
+        if (sparseMap.length() > 0) {
+            // A very fragmented file may have a map larger than the scratch buffer.
+            for (size_t pos = 0; pos < sparseMap.length(); pos += BUFSIZE) {
+                size_t len = sparseMap.length() - pos;
+                if (len > BUFSIZE) len = BUFSIZE;
+                size_t blockLen = ((len + 511) / 512) * 512;
+                memset(buf, 0, blockLen);
+                memcpy(buf, sparseMap.string() + pos, len);
+                send_tarfile_chunk(writer, buf, blockLen);
+                dataSize -= blockLen;
             }
+        } else {
+            tar_region region = { 0, s.st_size };
+            regions.add(region);
+        }
+
+        sp<TarFileReader> reader = new TarFileReader(fd, regions, dataSize, filepath);
+        if (reader->init() != NO_ERROR) {
+            ALOGE("Out of mem allocating transfer buffer");
+            err = ENOMEM;
+            goto cleanup;
+        }
 
-            // At EOF we might have a short block; NUL-pad that to a 512-byte multiple.  This
-            // depends on the OS guarantee that for ordinary files, read() will never return
-            // less than the number of bytes requested.
-            ssize_t partial = (nRead+512) % 512;
-            if (partial > 0) {
-                ssize_t remainder = 512 - partial;
-                memset(buf + nRead, 0, remainder);
-                nRead += remainder;
+        size_t ready;
+        while ((ready = reader->waitForChunks()) > 0) {
+            uint32_t chunkSizes[TAR_READ_AHEAD];
+            struct iovec iov[2 * TAR_READ_AHEAD];
+            for (size_t i = 0; i < ready; i++) {
+                chunkSizes[i] = htonl(reader->chunkSize(i));
+                iov[2*i].iov_base = &chunkSizes[i];
+                iov[2*i].iov_len = 4;
+                iov[2*i+1].iov_base = (void*) reader->chunkData(i);
+                iov[2*i+1].iov_len = reader->chunkSize(i);
+            }
+            status_t status = writer->WriteEntityDataVector(iov, 2 * ready);
+            reader->releaseChunks(ready);
+            if (status != NO_ERROR) {
+                // The stream is broken; reading the rest of the file would be wasted.
+                break;
             }
-            send_tarfile_chunk(writer, buf, nRead);
-            toWrite -= nRead;
         }
+        reader->finish();
+        err = reader->getError();
     }
 
 cleanup:
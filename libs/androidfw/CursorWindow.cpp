@@ -32,16 +32,22 @@ namespace android {
 
 CursorWindow::CursorWindow(const String8& name, int ashmemFd,
         void* data, size_t size, bool readOnly) :
-        mName(name), mAshmemFd(ashmemFd), mData(data), mSize(size), mReadOnly(readOnly) {
+        mName(name), mAshmemFd(ashmemFd), mData(data), mDataSize(size), mSize(size),
+        mMaxSize(size), mReadOnly(readOnly), mNumExtraSegments(0) {
     mHeader = static_cast<Header*>(mData);
 }
 
 CursorWindow::~CursorWindow() {
-    ::munmap(mData, mSize);
+    for (size_t i = 0; i < mNumExtraSegments; i++) {
+        ::munmap(mSegments[i].data, mSegments[i].size);
+        ::close(mSegments[i].ashmemFd);
+    }
+    ::munmap(mData, mDataSize);
     ::close(mAshmemFd);
 }
 
-status_t CursorWindow::create(const String8& name, size_t size, CursorWindow** outCursorWindow) {
+status_t CursorWindow::createRegion(const String8& name, size_t size,
+        int* outAshmemFd, void** outData) {
     String8 ashmemName("CursorWindow: ");
     ashmemName.append(name);
 
@@ -58,26 +64,47 @@ status_t CursorWindow::create(const String8& name, size_t size, CursorWindow** o
             } else {
                 result = ashmem_set_prot_region(ashmemFd, PROT_READ);
                 if (result >= 0) {
-                    CursorWindow* window = new CursorWindow(name, ashmemFd,
-                            data, size, false /*readOnly*/);
-                    result = window->clear();
-                    if (!result) {
-                        LOG_WINDOW("Created new CursorWindow: freeOffset=%d, "
-                                "numRows=%d, numColumns=%d, mSize=%d, mData=%p",
-                                window->mHeader->freeOffset,
-                                window->mHeader->numRows,
-                                window->mHeader->numColumns,
-                                window->mSize, window->mData);
-                        *outCursorWindow = window;
-                        return OK;
-                    }
-                    delete window;
+                    *outAshmemFd = ashmemFd;
+                    *outData = data;
+                    return OK;
                 }
+                ::munmap(data, size);
             }
-            ::munmap(data, size);
         }
         ::close(ashmemFd);
     }
+    return result;
+}
+
+status_t CursorWindow::create(const String8& name, size_t size, CursorWindow** outCursorWindow) {
+    return create(name, size, size, outCursorWindow);
+}
+
+status_t CursorWindow::create(const String8& name, size_t size, size_t maxSize,
+        CursorWindow** outCursorWindow) {
+    int ashmemFd;
+    void* data;
+    status_t result = createRegion(name, size, &ashmemFd, &data);
+    if (!result) {
+        CursorWindow* window = new CursorWindow(name, ashmemFd,
+                data, size, false /*readOnly*/);
+        window->mMaxSize = maxSize > size ? maxSize : size;
+        window->mHeader->numSegments = 1;
+        window->mHeader->segmentSizes[0] = size;
+        window->mHeader->columnar = 0;
+        result = window->clear();
+        if (!result) {
+            LOG_WINDOW("Created new CursorWindow: freeOffset=%d, "
+                    "numRows=%d, numColumns=%d, mSize=%d, mMaxSize=%d, mData=%p",
+                    window->mHeader->freeOffset,
+                    window->mHeader->numRows,
+                    window->mHeader->numColumns,
+                    window->mSize, window->mMaxSize, window->mData);
+            *outCursorWindow = window;
+            return OK;
+        }
+        delete window;
+    }
     *outCursorWindow = NULL;
     return result;
 }
@@ -101,19 +128,66 @@ status_t CursorWindow::createFromParcel(Parcel* parcel, CursorWindow** outCursor
                 void* data = ::mmap(NULL, size, PROT_READ, MAP_SHARED, dupAshmemFd, 0);
                 if (data == MAP_FAILED) {
                     result = -errno;
+                    ::close(dupAshmemFd);
                 } else {
                     CursorWindow* window = new CursorWindow(name, dupAshmemFd,
                             data, size, true /*readOnly*/);
-                    LOG_WINDOW("Created CursorWindow from parcel: freeOffset=%d, "
-                            "numRows=%d, numColumns=%d, mSize=%d, mData=%p",
-                            window->mHeader->freeOffset,
-                            window->mHeader->numRows,
-                            window->mHeader->numColumns,
-                            window->mSize, window->mData);
-                    *outCursorWindow = window;
-                    return OK;
+
+                    // The other segments follow the first one in the parcel
+                    if (size_t(size) < sizeof(Header)
+                            || window->mHeader->numSegments == 0
+                            || window->mHeader->numSegments > MAX_SEGMENTS
+                            || window->mHeader->segmentSizes[0] != size_t(size)
+                            || (window->mHeader->columnar
+                                    && window->mHeader->numRows > window->mHeader->rowCapacity)
+                            || (window->mHeader->columnar && window->mHeader->firstColumnOffset
+                                    + uint64_t(window->mHeader->numColumns)
+                                    * window->mHeader->rowCapacity
+                                    * (sizeof(int64_t) + 1) > size_t(size))) {
+                        result = BAD_VALUE;
+                    } else {
+                        result = OK;
+                        const uint32_t numSegments = window->mHeader->numSegments;
+                        for (uint32_t i = 1; i < numSegments && !result; i++) {
+                            const size_t segmentSize = window->mHeader->segmentSizes[i];
+                            int segmentFd = parcel->readFileDescriptor();
+                            if (segmentFd == int(BAD_TYPE)) {
+                                result = BAD_TYPE;
+                            } else if (segmentSize == 0
+                                    || window->mSize + segmentSize + 7 > UINT32_MAX
+                                    || ashmem_get_size_region(segmentFd) != ssize_t(segmentSize)) {
+                                result = BAD_VALUE;
+                            } else {
+                                int dupSegmentFd = ::dup(segmentFd);
+                                if (dupSegmentFd < 0) {
+                                    result = -errno;
+                                } else {
+                                    void* segmentData = ::mmap(NULL, segmentSize, PROT_READ,
+                                            MAP_SHARED, dupSegmentFd, 0);
+                                    if (segmentData == MAP_FAILED) {
+                                        result = -errno;
+                                        ::close(dupSegmentFd);
+                                    } else {
+                                        window->appendSegment(dupSegmentFd,
+                                                segmentData, segmentSize);
+                                    }
+                                }
+                            }
+                        }
+                    }
+
+                    if (!result) {
+                        LOG_WINDOW("Created CursorWindow from parcel: freeOffset=%d, "
+                                "numRows=%d, numColumns=%d, mSize=%d, mData=%p",
+                                window->mHeader->freeOffset,
+                                window->mHeader->numRows,
+                                window->mHeader->numColumns,
+                                window->mSize, window->mData);
+                        *outCursorWindow = window;
+                        return OK;
+                    }
+                    delete window;
                 }
-                ::close(dupAshmemFd);
             }
         }
     }
@@ -126,9 +200,83 @@ status_t CursorWindow::writeToParcel(Parcel* parcel) {
     if (!status) {
         status = parcel->writeDupFileDescriptor(mAshmemFd);
     }
+    for (size_t i = 0; i < mNumExtraSegments && !status; i++) {
+        status = parcel->writeDupFileDescriptor(mSegments[i].ashmemFd);
+    }
     return status;
 }
 
+/**
+ * Appends a mapped segment after the last one.  The window takes ownership
+ * of the mapping and of the file descriptor.
+ */
+void CursorWindow::appendSegment(int ashmemFd, void* data, size_t size) {
+    Segment& segment = mSegments[mNumExtraSegments];
+    segment.ashmemFd = ashmemFd;
+    segment.data = data;
+    // Segments start on 8 byte boundaries
+    segment.base = (mSize + 7) & ~size_t(7);
+    segment.size = size;
+    mSize = segment.base + size;
+    // Count the segment once it is filled in, for the readers of published rows
+    mNumExtraSegments++;
+}
+
+/**
+ * Grows the window by a segment of at least minSize bytes.
+ */
+bool CursorWindow::addSegment(size_t minSize) {
+    const size_t base = (mSize + 7) & ~size_t(7);
+    if (mNumExtraSegments >= MAX_SEGMENTS - 1 || base >= mMaxSize) {
+        return false;
+    }
+
+    size_t size = mDataSize > minSize ? mDataSize : minSize;
+    if (size > mMaxSize - base) {
+        size = mMaxSize - base;
+        if (size < minSize) {
+            return false;
+        }
+    }
+
+    int ashmemFd;
+    void* data;
+    if (createRegion(mName, size, &ashmemFd, &data)) {
+        return false;
+    }
+
+    appendSegment(ashmemFd, data, size);
+    mHeader->segmentSizes[mHeader->numSegments++] = size;
+
+    LOG_WINDOW("Added a segment of %d bytes to CursorWindow, mSize=%d", size, mSize);
+    return true;
+}
+
+void* CursorWindow::extraSegmentOffsetToPtr(uint32_t offset) {
+    for (size_t i = 0; i < mNumExtraSegments; i++) {
+        const Segment& segment = mSegments[i];
+        if (offset >= segment.base && offset - segment.base < segment.size) {
+            return static_cast<uint8_t*>(segment.data) + (offset - segment.base);
+        }
+    }
+    ALOGE("Offset %u is outside of the CursorWindow", offset);
+    return NULL;
+}
+
+uint32_t CursorWindow::offsetFromPtr(void* ptr) {
+    uint8_t* p = static_cast<uint8_t*>(ptr);
+    if (p >= static_cast<uint8_t*>(mData) && p < static_cast<uint8_t*>(mData) + mDataSize) {
+        return p - static_cast<uint8_t*>(mData);
+    }
+    for (size_t i = 0; i < mNumExtraSegments; i++) {
+        uint8_t* data = static_cast<uint8_t*>(mSegments[i].data);
+        if (p >= data && p < data + mSegments[i].size) {
+            return mSegments[i].base + (p - data);
+        }
+    }
+    return 0;
+}
+
 status_t CursorWindow::clear() {
     if (mReadOnly) {
         return INVALID_OPERATION;
@@ -138,6 +286,12 @@ status_t CursorWindow::clear() {
     mHeader->firstChunkOffset = sizeof(Header);
     mHeader->numRows = 0;
     mHeader->numColumns = 0;
+    mHeader->numPublishedRows = 0;
+    mHeader->numChunks = 1;
+    mHeader->chunkIndexOffset = 0;
+    mHeader->chunkIndexCapacity = 0;
+    mHeader->rowCapacity = 0;
+    mHeader->firstColumnOffset = 0;
 
     RowSlotChunk* firstChunk = static_cast<RowSlotChunk*>(offsetToPtr(mHeader->firstChunkOffset));
     firstChunk->nextChunkOffset = 0;
@@ -154,15 +308,57 @@ status_t CursorWindow::setNumColumns(uint32_t numColumns) {
         ALOGE("Trying to go from %d columns to %d", cur, numColumns);
         return INVALID_OPERATION;
     }
+
+    if (mHeader->columnar && !mHeader->firstColumnOffset && numColumns > 0) {
+        // The column arrays fill the rest of the first segment, starting on
+        // an 8 byte boundary
+        uint32_t offset = (mHeader->freeOffset + 7) & ~uint32_t(7);
+        size_t rowSize = numColumns * (sizeof(int64_t) + 1);
+        size_t rowCapacity = offset < mDataSize ? (mDataSize - offset) / rowSize : 0;
+        if (!rowCapacity) {
+            ALOGE("No room for a row of %d columns in a columnar CursorWindow", numColumns);
+            return NO_MEMORY;
+        }
+        mHeader->rowCapacity = rowCapacity;
+        mHeader->firstColumnOffset = offset;
+        mHeader->freeOffset = offset + rowCapacity * rowSize;
+        LOG_WINDOW("Columnar CursorWindow holds %d rows of %d columns at offset %u",
+                rowCapacity, numColumns, offset);
+    }
     mHeader->numColumns = numColumns;
     return OK;
 }
 
+status_t CursorWindow::setColumnar(bool columnar) {
+    if (mReadOnly) {
+        return INVALID_OPERATION;
+    }
+
+    if (mHeader->numRows > 0 || mHeader->numColumns > 0) {
+        ALOGE("Trying to change the layout of a CursorWindow which is not empty");
+        return INVALID_OPERATION;
+    }
+    mHeader->columnar = columnar;
+    return OK;
+}
+
 status_t CursorWindow::allocRow() {
     if (mReadOnly) {
         return INVALID_OPERATION;
     }
 
+    if (mHeader->columnar) {
+        uint32_t row = mHeader->numRows;
+        if (row >= mHeader->rowCapacity) {
+            return NO_MEMORY;
+        }
+        for (uint32_t column = 0; column < mHeader->numColumns; column++) {
+            *getColumnarType(row, column) = FIELD_TYPE_NULL;
+        }
+        mHeader->numRows += 1;
+        return OK;
+    }
+
     // Fill in the row slot
     RowSlot* rowSlot = allocRowSlot();
     if (rowSlot == NULL) {
@@ -208,50 +404,90 @@ uint32_t CursorWindow::alloc(size_t size, bool aligned) {
     }
 
     uint32_t offset = mHeader->freeOffset + padding;
-    uint32_t nextFreeOffset = offset + size;
-    if (nextFreeOffset > mSize) {
-        ALOGW("Window is full: requested allocation %d bytes, "
-                "free space %d bytes, window size %d bytes",
-                size, freeSpace(), mSize);
-        return 0;
+
+    // Find the end of the segment holding the offset.  Allocations don't
+    // straddle segments: move on to the next one, adding it if needed.
+    size_t segmentEnd = mDataSize;
+    size_t i = 0;
+    while (i < mNumExtraSegments && offset >= segmentEnd) {
+        segmentEnd = mSegments[i].base + mSegments[i].size;
+        if (offset < mSegments[i].base) {
+            offset = mSegments[i].base;
+        }
+        i++;
+    }
+    while (offset + size > segmentEnd) {
+        if (i == mNumExtraSegments && !addSegment(size)) {
+            ALOGW("Window is full: requested allocation %d bytes, "
+                    "free space %d bytes, window size %d bytes",
+                    size, freeSpace(), mSize);
+            return 0;
+        }
+        offset = mSegments[i].base;
+        segmentEnd = mSegments[i].base + mSegments[i].size;
+        i++;
     }
 
-    mHeader->freeOffset = nextFreeOffset;
+    mHeader->freeOffset = offset + size;
     return offset;
 }
 
+CursorWindow::RowSlotChunk* CursorWindow::getRowSlotChunk(uint32_t chunkIndex) {
+    uint32_t offset;
+    if (chunkIndex == 0) {
+        offset = mHeader->firstChunkOffset;
+    } else {
+        offset = static_cast<uint32_t*>(offsetToPtr(mHeader->chunkIndexOffset))[chunkIndex - 1];
+    }
+    return static_cast<RowSlotChunk*>(offsetToPtr(offset));
+}
+
 CursorWindow::RowSlot* CursorWindow::getRowSlot(uint32_t row) {
-    uint32_t chunkPos = row;
-    RowSlotChunk* chunk = static_cast<RowSlotChunk*>(
-            offsetToPtr(mHeader->firstChunkOffset));
-    while (chunkPos >= ROW_SLOT_CHUNK_NUM_ROWS) {
-        chunk = static_cast<RowSlotChunk*>(offsetToPtr(chunk->nextChunkOffset));
-        chunkPos -= ROW_SLOT_CHUNK_NUM_ROWS;
-    }
-    return &chunk->slots[chunkPos];
+    uint32_t chunkIndex = row / ROW_SLOT_CHUNK_NUM_ROWS;
+    if (chunkIndex >= mHeader->numChunks) {
+        return NULL;
+    }
+    RowSlotChunk* chunk = getRowSlotChunk(chunkIndex);
+    return &chunk->slots[row % ROW_SLOT_CHUNK_NUM_ROWS];
 }
 
-CursorWindow::RowSlot* CursorWindow::allocRowSlot() {
-    uint32_t chunkPos = mHeader->numRows;
-    RowSlotChunk* chunk = static_cast<RowSlotChunk*>(
-            offsetToPtr(mHeader->firstChunkOffset));
-    while (chunkPos > ROW_SLOT_CHUNK_NUM_ROWS) {
-        chunk = static_cast<RowSlotChunk*>(offsetToPtr(chunk->nextChunkOffset));
-        chunkPos -= ROW_SLOT_CHUNK_NUM_ROWS;
-    }
-    if (chunkPos == ROW_SLOT_CHUNK_NUM_ROWS) {
-        if (!chunk->nextChunkOffset) {
-            chunk->nextChunkOffset = alloc(sizeof(RowSlotChunk), true /*aligned*/);
-            if (!chunk->nextChunkOffset) {
-                return NULL;
-            }
+bool CursorWindow::addRowSlotChunk() {
+    uint32_t numIndexed = mHeader->numChunks - 1;
+    if (numIndexed == mHeader->chunkIndexCapacity) {
+        uint32_t capacity = numIndexed ? numIndexed * 2 : 16;
+        uint32_t indexOffset = alloc(capacity * sizeof(uint32_t), true /*aligned*/);
+        if (!indexOffset) {
+            return false;
         }
-        chunk = static_cast<RowSlotChunk*>(offsetToPtr(chunk->nextChunkOffset));
-        chunk->nextChunkOffset = 0;
-        chunkPos = 0;
+        if (numIndexed) {
+            memcpy(offsetToPtr(indexOffset), offsetToPtr(mHeader->chunkIndexOffset),
+                    numIndexed * sizeof(uint32_t));
+        }
+        mHeader->chunkIndexOffset = indexOffset;
+        mHeader->chunkIndexCapacity = capacity;
+    }
+
+    uint32_t chunkOffset = alloc(sizeof(RowSlotChunk), true /*aligned*/);
+    if (!chunkOffset) {
+        return false;
     }
+    RowSlotChunk* chunk = static_cast<RowSlotChunk*>(offsetToPtr(chunkOffset));
+    chunk->nextChunkOffset = 0;
+    getRowSlotChunk(numIndexed)->nextChunkOffset = chunkOffset;
+
+    static_cast<uint32_t*>(offsetToPtr(mHeader->chunkIndexOffset))[numIndexed] = chunkOffset;
+    mHeader->numChunks += 1;
+    return true;
+}
+
+CursorWindow::RowSlot* CursorWindow::allocRowSlot() {
+    uint32_t chunkIndex = mHeader->numRows / ROW_SLOT_CHUNK_NUM_ROWS;
+    if (chunkIndex >= mHeader->numChunks && !addRowSlotChunk()) {
+        return NULL;
+    }
+    RowSlotChunk* chunk = getRowSlotChunk(chunkIndex);
     mHeader->numRows += 1;
-    return &chunk->slots[chunkPos];
+    return &chunk->slots[(mHeader->numRows - 1) % ROW_SLOT_CHUNK_NUM_ROWS];
 }
 
 CursorWindow::FieldSlot* CursorWindow::getFieldSlot(uint32_t row, uint32_t column) {
@@ -261,6 +497,11 @@ CursorWindow::FieldSlot* CursorWindow::getFieldSlot(uint32_t row, uint32_t colum
                 row, column, mHeader->numRows, mHeader->numColumns);
         return NULL;
     }
+    if (mHeader->columnar) {
+        ALOGE("Failed to read the field slot of row %d, column %d from a columnar "
+                "CursorWindow.", row, column);
+        return NULL;
+    }
     RowSlot* rowSlot = getRowSlot(row);
     if (!rowSlot) {
         ALOGE("Failed to find rowSlot for row %d.", row);
@@ -281,7 +522,7 @@ status_t CursorWindow::putString(uint32_t row, uint32_t column, const char* valu
 
 status_t CursorWindow::putBlobOrString(uint32_t row, uint32_t column,
         const void* value, size_t size, int32_t type) {
-    if (mReadOnly) {
+    if (mReadOnly || mHeader->columnar) {
         return INVALID_OPERATION;
     }
 
@@ -308,6 +549,10 @@ status_t CursorWindow::putLong(uint32_t row, uint32_t column, int64_t value) {
         return INVALID_OPERATION;
     }
 
+    if (mHeader->columnar) {
+        return putColumnar(row, column, FIELD_TYPE_INTEGER, &value);
+    }
+
     FieldSlot* fieldSlot = getFieldSlot(row, column);
     if (!fieldSlot) {
         return BAD_VALUE;
@@ -323,6 +568,10 @@ status_t CursorWindow::putDouble(uint32_t row, uint32_t column, double value) {
         return INVALID_OPERATION;
     }
 
+    if (mHeader->columnar) {
+        return putColumnar(row, column, FIELD_TYPE_FLOAT, &value);
+    }
+
     FieldSlot* fieldSlot = getFieldSlot(row, column);
     if (!fieldSlot) {
         return BAD_VALUE;
@@ -338,6 +587,10 @@ status_t CursorWindow::putNull(uint32_t row, uint32_t column) {
         return INVALID_OPERATION;
     }
 
+    if (mHeader->columnar) {
+        return putColumnar(row, column, FIELD_TYPE_NULL, NULL);
+    }
+
     FieldSlot* fieldSlot = getFieldSlot(row, column);
     if (!fieldSlot) {
         return BAD_VALUE;
@@ -349,4 +602,27 @@ status_t CursorWindow::putNull(uint32_t row, uint32_t column) {
     return OK;
 }
 
+int32_t CursorWindow::getColumnarFieldType(uint32_t row, uint32_t column) {
+    if (row >= mHeader->numRows || column >= mHeader->numColumns) {
+        ALOGE("Failed to read row %d, column %d from a CursorWindow which "
+                "has %d rows, %d columns.",
+                row, column, mHeader->numRows, mHeader->numColumns);
+        return -1;
+    }
+    return *getColumnarType(row, column);
+}
+
+status_t CursorWindow::putColumnar(uint32_t row, uint32_t column, int32_t type,
+        const void* value) {
+    if (row >= mHeader->numRows || column >= mHeader->numColumns) {
+        return BAD_VALUE;
+    }
+
+    *getColumnarType(row, column) = type;
+    if (value) {
+        memcpy(getColumnarValue(row, column), value, sizeof(int64_t));
+    }
+    return OK;
+}
+
 }; // namespace android
@@ -43,9 +43,12 @@
 
 #define kMaxBufSize    32768 /* Maximum file read buffer */
 
+#define kTailReadSize  512   /* Bytes read at once from the end of the file */
+
 #define kSignature     0x01059983U /* ObbFile signature */
 
-#define kSigVersion    1 /* We only know about signature version 1 */
+#define kSigVersion    1 /* Signature version of files using the default KDF */
+#define kSigVersionKdf 2 /* Version 1 followed by the KDF digest and rounds */
 
 /* offsets in version 1 of the header */
 #define kPackageVersionOffset 4
@@ -54,6 +57,9 @@
 #define kPackageNameLenOffset 20
 #define kPackageNameOffset    24
 
+/* version 2 adds, after the package name: */
+#define kKdfSize              8 /* 32-bit KDF digest, 32-bit KDF rounds */
+
 /*
  * TEMP_FAILURE_RETRY is defined by some, but not all, versions of
  * <unistd.h>. (Alas, it is not as standard as we'd hoped!) So, if it's
@@ -76,6 +82,8 @@ ObbFile::ObbFile()
         : mPackageName("")
         , mVersion(-1)
         , mFlags(0)
+        , mKdfDigest(OBB_KDF_SHA1)
+        , mKdfRounds(OBB_KDF_DEFAULT_ROUNDS)
 {
     memset(mSalt, 0, sizeof(mSalt));
 }
@@ -127,27 +135,31 @@ bool ObbFile::parseObbFile(int fd)
         return false;
     }
 
-    ssize_t actual;
+    /*
+     * A single read of the tail of the file gets the footer tag and, for
+     * all but the longest package names, the whole footer.
+     */
+    unsigned char tail[kTailReadSize];
+    size_t tailSize = (fileLength < kTailReadSize) ? (size_t) fileLength : kTailReadSize;
+    ssize_t actual = TEMP_FAILURE_RETRY(pread64(fd, tail, tailSize, fileLength - tailSize));
+    if (actual != (ssize_t) tailSize) {
+        ALOGW("couldn't read footer signature: %s\n", strerror(errno));
+        return false;
+    }
+
     size_t footerSize;
 
     {
-        lseek64(fd, fileLength - kFooterTagSize, SEEK_SET);
+        const unsigned char* footer = tail + tailSize - kFooterTagSize;
 
-        char footer[kFooterTagSize];
-        actual = TEMP_FAILURE_RETRY(read(fd, footer, kFooterTagSize));
-        if (actual != kFooterTagSize) {
-            ALOGW("couldn't read footer signature: %s\n", strerror(errno));
-            return false;
-        }
-
-        unsigned int fileSig = get4LE((unsigned char*)footer + sizeof(int32_t));
+        unsigned int fileSig = get4LE(footer + sizeof(int32_t));
         if (fileSig != kSignature) {
             ALOGW("footer didn't match magic string (expected 0x%08x; got 0x%08x)\n",
                     kSignature, fileSig);
             return false;
         }
 
-        footerSize = get4LE((unsigned char*)footer);
+        footerSize = get4LE(footer);
         if (footerSize > (size_t)fileLength - kFooterTagSize
                 || footerSize > kMaxBufSize) {
             ALOGW("claimed footer size is too large (0x%08zx; file size is 0x%08llx)\n",
@@ -163,20 +175,19 @@ bool ObbFile::parseObbFile(int fd)
     }
 
     off64_t fileOffset = fileLength - footerSize - kFooterTagSize;
-    if (lseek64(fd, fileOffset, SEEK_SET) != fileOffset) {
-        ALOGW("seek %lld failed: %s\n", fileOffset, strerror(errno));
-        return false;
-    }
-
     mFooterStart = fileOffset;
 
-    char* scanBuf = (char*)malloc(footerSize);
+    if (footerSize + kFooterTagSize <= tailSize) {
+        return parseFooter(tail + tailSize - kFooterTagSize - footerSize, footerSize);
+    }
+
+    unsigned char* scanBuf = (unsigned char*)malloc(footerSize);
     if (scanBuf == NULL) {
         ALOGW("couldn't allocate scanBuf: %s\n", strerror(errno));
         return false;
     }
 
-    actual = TEMP_FAILURE_RETRY(read(fd, scanBuf, footerSize));
+    actual = TEMP_FAILURE_RETRY(pread64(fd, scanBuf, footerSize, fileOffset));
     // readAmount is guaranteed to be less than kMaxBufSize
     if (actual != (ssize_t)footerSize) {
         ALOGI("couldn't read ObbFile footer: %s\n", strerror(errno));
@@ -184,37 +195,56 @@ bool ObbFile::parseObbFile(int fd)
         return false;
     }
 
+    bool success = parseFooter(scanBuf, footerSize);
+    free(scanBuf);
+    return success;
+}
+
+bool ObbFile::parseFooter(const unsigned char* scanBuf, size_t footerSize)
+{
 #ifdef DEBUG
-    for (int i = 0; i < footerSize; ++i) {
+    for (size_t i = 0; i < footerSize; ++i) {
         ALOGI("char: 0x%02x\n", scanBuf[i]);
     }
 #endif
 
-    uint32_t sigVersion = get4LE((unsigned char*)scanBuf);
-    if (sigVersion != kSigVersion) {
+    uint32_t sigVersion = get4LE(scanBuf);
+    if (sigVersion != kSigVersion && sigVersion != kSigVersionKdf) {
         ALOGW("Unsupported ObbFile version %d\n", sigVersion);
-        free(scanBuf);
         return false;
     }
 
-    mVersion = (int32_t) get4LE((unsigned char*)scanBuf + kPackageVersionOffset);
-    mFlags = (int32_t) get4LE((unsigned char*)scanBuf + kFlagsOffset);
+    mVersion = (int32_t) get4LE(scanBuf + kPackageVersionOffset);
+    mFlags = (int32_t) get4LE(scanBuf + kFlagsOffset);
 
-    memcpy(&mSalt, (unsigned char*)scanBuf + kSaltOffset, sizeof(mSalt));
+    memcpy(&mSalt, scanBuf + kSaltOffset, sizeof(mSalt));
 
-    size_t packageNameLen = get4LE((unsigned char*)scanBuf + kPackageNameLenOffset);
+    size_t packageNameLen = get4LE(scanBuf + kPackageNameLenOffset);
     if (packageNameLen == 0
             || packageNameLen > (footerSize - kPackageNameOffset)) {
         ALOGW("bad ObbFile package name length (0x%04zx; 0x%04zx possible)\n",
                 packageNameLen, footerSize - kPackageNameOffset);
-        free(scanBuf);
         return false;
     }
 
-    char* packageName = reinterpret_cast<char*>(scanBuf + kPackageNameOffset);
-    mPackageName = String8(const_cast<char*>(packageName), packageNameLen);
+    const char* packageName = reinterpret_cast<const char*>(scanBuf + kPackageNameOffset);
+    mPackageName = String8(packageName, packageNameLen);
 
-    free(scanBuf);
+    mKdfDigest = OBB_KDF_SHA1;
+    mKdfRounds = OBB_KDF_DEFAULT_ROUNDS;
+    if (sigVersion == kSigVersionKdf) {
+        size_t kdfOffset = kPackageNameOffset + packageNameLen;
+        if (kdfOffset + kKdfSize > footerSize) {
+            ALOGW("ObbFile footer too small for its KDF parameters\n");
+            return false;
+        }
+        int32_t digest = (int32_t) get4LE(scanBuf + kdfOffset);
+        int32_t rounds = (int32_t) get4LE(scanBuf + kdfOffset + sizeof(uint32_t));
+        if (!setKdf(digest, rounds)) {
+            ALOGW("bad ObbFile KDF (digest %d, %d rounds)\n", digest, rounds);
+            return false;
+        }
+    }
 
 #ifdef DEBUG
     ALOGI("Obb scan succeeded: packageName=%s, version=%d\n", mPackageName.string(), mVersion);
@@ -255,53 +285,41 @@ bool ObbFile::writeTo(int fd)
         return false;
     }
 
-    unsigned char intBuf[sizeof(uint32_t)+1];
-    memset(&intBuf, 0, sizeof(intBuf));
-
-    put4LE(intBuf, kSigVersion);
-    if (write(fd, &intBuf, sizeof(uint32_t)) != (ssize_t)sizeof(uint32_t)) {
-        ALOGW("couldn't write signature version: %s\n", strerror(errno));
-        return false;
-    }
-
-    put4LE(intBuf, mVersion);
-    if (write(fd, &intBuf, sizeof(uint32_t)) != (ssize_t)sizeof(uint32_t)) {
-        ALOGW("couldn't write package version\n");
-        return false;
-    }
-
-    put4LE(intBuf, mFlags);
-    if (write(fd, &intBuf, sizeof(uint32_t)) != (ssize_t)sizeof(uint32_t)) {
-        ALOGW("couldn't write package version\n");
-        return false;
-    }
-
-    if (write(fd, mSalt, sizeof(mSalt)) != (ssize_t)sizeof(mSalt)) {
-        ALOGW("couldn't write salt: %s\n", strerror(errno));
-        return false;
-    }
+    // Files with the default KDF stay readable by version 1 parsers.
+    const bool writeKdf = mKdfDigest != OBB_KDF_SHA1 || mKdfRounds != OBB_KDF_DEFAULT_ROUNDS;
 
     size_t packageNameLen = mPackageName.size();
-    put4LE(intBuf, packageNameLen);
-    if (write(fd, &intBuf, sizeof(uint32_t)) != (ssize_t)sizeof(uint32_t)) {
-        ALOGW("couldn't write package name length: %s\n", strerror(errno));
+    size_t footerSize = kPackageNameOffset + packageNameLen + (writeKdf ? kKdfSize : 0);
+    if (footerSize > kMaxBufSize) {
+        ALOGW("package name too long for an ObbFile footer\n");
         return false;
     }
 
-    if (write(fd, mPackageName.string(), packageNameLen) != (ssize_t)packageNameLen) {
-        ALOGW("couldn't write package name: %s\n", strerror(errno));
+    // The footer and its tag are built up and written at once.
+    size_t totalSize = footerSize + kFooterTagSize;
+    unsigned char* footer = (unsigned char*)malloc(totalSize);
+    if (footer == NULL) {
+        ALOGW("couldn't allocate footer: %s\n", strerror(errno));
         return false;
     }
 
-    put4LE(intBuf, kPackageNameOffset + packageNameLen);
-    if (write(fd, &intBuf, sizeof(uint32_t)) != (ssize_t)sizeof(uint32_t)) {
-        ALOGW("couldn't write footer size: %s\n", strerror(errno));
-        return false;
+    put4LE(footer, writeKdf ? kSigVersionKdf : kSigVersion);
+    put4LE(footer + kPackageVersionOffset, mVersion);
+    put4LE(footer + kFlagsOffset, mFlags);
+    memcpy(footer + kSaltOffset, mSalt, sizeof(mSalt));
+    put4LE(footer + kPackageNameLenOffset, packageNameLen);
+    memcpy(footer + kPackageNameOffset, mPackageName.string(), packageNameLen);
+    if (writeKdf) {
+        put4LE(footer + kPackageNameOffset + packageNameLen, mKdfDigest);
+        put4LE(footer + kPackageNameOffset + packageNameLen + sizeof(uint32_t), mKdfRounds);
     }
+    put4LE(footer + footerSize, footerSize);
+    put4LE(footer + footerSize + sizeof(uint32_t), kSignature);
 
-    put4LE(intBuf, kSignature);
-    if (write(fd, &intBuf, sizeof(uint32_t)) != (ssize_t)sizeof(uint32_t)) {
-        ALOGW("couldn't write footer magic signature: %s\n", strerror(errno));
+    ssize_t actual = TEMP_FAILURE_RETRY(write(fd, footer, totalSize));
+    free(footer);
+    if (actual != (ssize_t)totalSize) {
+        ALOGW("couldn't write ObbFile footer: %s\n", strerror(errno));
         return false;
     }
 
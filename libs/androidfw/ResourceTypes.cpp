@@ -24,12 +24,14 @@
 #include <utils/Log.h>
 #include <utils/String16.h>
 #include <utils/String8.h>
+#include <utils/Thread.h>
 
 #include <stdlib.h>
 #include <string.h>
 #include <memory.h>
 #include <ctype.h>
 #include <stdint.h>
+#include <unistd.h>
 
 #ifndef INT32_MAX
 #define INT32_MAX ((int32_t)(2147483647))
@@ -66,6 +68,41 @@ namespace android {
 // size measured in sizeof(uint32_t)
 #define IDMAP_HEADER_SIZE (ResTable::IDMAP_HEADER_SIZE_BYTES / sizeof(uint32_t))
 
+#define TABLE_INDEX_MAGIC   0x78646e69
+#define TABLE_INDEX_VERSION 2
+// size measured in sizeof(uint32_t): magic, version, table crc, table size
+// and package count
+#define TABLE_INDEX_HEADER_SIZE 5
+
+// Caches that are filled without holding a lock, such as the bag cache and
+// the string pool decode cache, publish their pointers with release semantics
+// and read them with acquire semantics.
+template<typename T>
+static inline T* acquireLoad(T* const* address)
+{
+    return __atomic_load_n(address, __ATOMIC_ACQUIRE);
+}
+
+template<typename T>
+static inline void releaseStore(T** address, T* value)
+{
+    __atomic_store_n(address, value, __ATOMIC_RELEASE);
+}
+
+// Publishes value at address if address is still NULL.  Returns the value
+// stored at address: value if it was published, or the value another thread
+// published first.
+template<typename T>
+static inline T* publishIfNull(T** address, T* value)
+{
+    T* expected = NULL;
+    if (__atomic_compare_exchange_n(address, &expected, value, false,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return value;
+    }
+    return expected;
+}
+
 static void printToLogFunc(int32_t cookie, const char* txt)
 {
     ALOGV("[cookie=%d] %s", cookie, txt);
@@ -124,6 +161,200 @@ static status_t validate_chunk(const ResChunk_header* chunk,
     return BAD_TYPE;
 }
 
+// Checks the entry index of a type spec chunk that passed validate_chunk().
+static status_t validate_type_spec(const ResTable_typeSpec* typeSpec)
+{
+    const size_t typeSpecSize = dtohl(typeSpec->header.size);
+
+    // look for block overrun or int overflow when multiplying by 4
+    if ((dtohl(typeSpec->entryCount) > (INT32_MAX/sizeof(uint32_t))
+            || dtohs(typeSpec->header.headerSize)+(sizeof(uint32_t)*dtohl(typeSpec->entryCount))
+            > typeSpecSize)) {
+        ALOGW("ResTable_typeSpec entry index to %p extends beyond chunk end %p.",
+             (void*)(dtohs(typeSpec->header.headerSize)
+                     +(sizeof(uint32_t)*dtohl(typeSpec->entryCount))),
+             (void*)typeSpecSize);
+        return BAD_TYPE;
+    }
+
+    if (typeSpec->id == 0) {
+        ALOGW("ResTable_type has an id of 0.");
+        return BAD_TYPE;
+    }
+    return NO_ERROR;
+}
+
+// Checks the entry index of a type chunk that passed validate_chunk().
+static status_t validate_type(const ResTable_type* type)
+{
+    const size_t typeSize = dtohl(type->header.size);
+
+    if (dtohs(type->header.headerSize)+(sizeof(uint32_t)*dtohl(type->entryCount))
+        > typeSize) {
+        ALOGW("ResTable_type entry index to %p extends beyond chunk end %p.",
+             (void*)(dtohs(type->header.headerSize)
+                     +(sizeof(uint32_t)*dtohl(type->entryCount))),
+             (void*)typeSize);
+        return BAD_TYPE;
+    }
+    if (dtohl(type->entryCount) != 0
+        && dtohl(type->entriesStart) > (typeSize-sizeof(ResTable_entry))) {
+        ALOGW("ResTable_type entriesStart at %p extends beyond chunk end %p.",
+             (void*)dtohl(type->entriesStart), (void*)typeSize);
+        return BAD_TYPE;
+    }
+    if (type->id == 0) {
+        ALOGW("ResTable_type has an id of 0.");
+        return BAD_TYPE;
+    }
+    return NO_ERROR;
+}
+
+// Returns the language of a config the way ResTable_config::match() compares
+// it, 0 for configs that match any language.
+static inline uint16_t configLanguageKey(const char* language)
+{
+    return language[0] != 0 ? ((uint8_t)language[0] << 8) | (uint8_t)language[1] : 0;
+}
+
+// Returns the first entry of a config index that is not ordered before the
+// given language.
+static const ResTable_configIndexEntry* lowerBoundConfigIndex(
+        const ResTable_configIndexEntry* begin, const ResTable_configIndexEntry* end,
+        uint32_t languageKey)
+{
+    while (begin < end) {
+        const ResTable_configIndexEntry* mid = begin + (end - begin) / 2;
+        if (configLanguageKey(mid->language) < languageKey) {
+            begin = mid + 1;
+        } else {
+            end = mid;
+        }
+    }
+    return begin;
+}
+
+// The table index lists, for each package of a resource table and in the
+// order of the table, the offset of the package chunk and its type count,
+// followed for each type by the offset of its type spec chunk (0 if none),
+// its entry count, its config count, the offset of its config index chunk
+// (0 if none) and the offsets of its type chunks.  Offsets are relative to
+// the start of the table.
+
+static const uint32_t* nextTableIndexRecord(const uint32_t* record)
+{
+    const uint32_t typeCount = record[1];
+    record += 2;
+    for (uint32_t i = 0; i < typeCount; i++) {
+        record += 4 + record[2];
+    }
+    return record;
+}
+
+// Returns the chunk at the given offset of the table if it is a valid chunk
+// of the given type lying within [start, end), NULL otherwise.
+static const ResChunk_header* getIndexedChunk(const uint8_t* table, uint32_t offset,
+        const uint8_t* start, const uint8_t* end, uint16_t type, size_t minSize)
+{
+    const uint8_t* pos = table + offset;
+    if ((offset&0x3) != 0 || pos < start || pos > end - sizeof(ResChunk_header)) {
+        return NULL;
+    }
+    const ResChunk_header* chunk = (const ResChunk_header*)pos;
+    if (dtohs(chunk->type) != type
+            || validate_chunk(chunk, minSize, end, "ResTable index") != NO_ERROR) {
+        return NULL;
+    }
+    return chunk;
+}
+
+// Checks every offset of a table index against the table, so that the
+// types can be read from the index without walking the packages.
+static bool validateTableIndex(const ResTable_header* table, size_t tableSize,
+        const uint32_t* index, size_t indexSize)
+{
+    if (indexSize < TABLE_INDEX_HEADER_SIZE * sizeof(uint32_t) || (indexSize&0x3) != 0) {
+        return false;
+    }
+    if (index[0] != TABLE_INDEX_MAGIC || index[1] != TABLE_INDEX_VERSION
+            || index[3] != tableSize || index[4] != dtohl(table->packageCount)) {
+        return false;
+    }
+
+    const uint8_t* const base = (const uint8_t*)table;
+    const uint8_t* const dataEnd = base + tableSize;
+    const uint32_t* const end = index + indexSize / sizeof(uint32_t);
+    const uint32_t* pos = index + TABLE_INDEX_HEADER_SIZE;
+    uint32_t lastPackageOffset = 0;
+    for (uint32_t p = 0; p < index[4]; p++) {
+        if (end - pos < 2) {
+            return false;
+        }
+        const uint32_t packageOffset = pos[0];
+        const uint32_t typeCount = pos[1];
+        pos += 2;
+        const ResChunk_header* pkg = getIndexedChunk(base, packageOffset,
+                base + dtohs(table->header.headerSize), dataEnd,
+                RES_TABLE_PACKAGE_TYPE, sizeof(ResChunk_header));
+        if (pkg == NULL || packageOffset <= lastPackageOffset || typeCount > 255) {
+            return false;
+        }
+        lastPackageOffset = packageOffset;
+        const uint8_t* const pkgStart = (const uint8_t*)pkg + dtohs(pkg->headerSize);
+        const uint8_t* const pkgEnd = (const uint8_t*)pkg + dtohl(pkg->size);
+
+        for (uint32_t t = 0; t < typeCount; t++) {
+            if (end - pos < 4) {
+                return false;
+            }
+            const uint32_t typeSpecOffset = pos[0];
+            const uint32_t entryCount = pos[1];
+            const uint32_t configCount = pos[2];
+            const uint32_t configIndexOffset = pos[3];
+            pos += 4;
+            if (configCount > (size_t)(end - pos)) {
+                return false;
+            }
+
+            if (typeSpecOffset != 0) {
+                const ResTable_typeSpec* typeSpec = (const ResTable_typeSpec*)
+                    getIndexedChunk(base, typeSpecOffset, pkgStart, pkgEnd,
+                            RES_TABLE_TYPE_SPEC_TYPE, sizeof(ResTable_typeSpec));
+                if (typeSpec == NULL || validate_type_spec(typeSpec) != NO_ERROR
+                        || typeSpec->id != t + 1
+                        || dtohl(typeSpec->entryCount) != entryCount) {
+                    return false;
+                }
+            } else if (configCount == 0 && entryCount != 0) {
+                return false;
+            }
+
+            // Its contents are checked against the configs when it is used.
+            if (configIndexOffset != 0) {
+                const ResTable_configIndex* configIndex = (const ResTable_configIndex*)
+                    getIndexedChunk(base, configIndexOffset, pkgStart, pkgEnd,
+                            RES_TABLE_CONFIG_INDEX_TYPE, sizeof(ResTable_configIndex));
+                if (configIndex == NULL || configIndex->id != t + 1) {
+                    return false;
+                }
+            }
+
+            for (uint32_t c = 0; c < configCount; c++) {
+                const ResTable_type* type = (const ResTable_type*)
+                    getIndexedChunk(base, pos[c], pkgStart, pkgEnd, RES_TABLE_TYPE_TYPE,
+                            sizeof(ResTable_type)-sizeof(ResTable_config)+4);
+                if (type == NULL || validate_type(type) != NO_ERROR
+                        || type->id != t + 1
+                        || dtohl(type->entryCount) != entryCount) {
+                    return false;
+                }
+            }
+            pos += configCount;
+        }
+    }
+    return pos == end;
+}
+
 inline void Res_value::copyFrom_dtoh(const Res_value& src)
 {
     size = dtohs(src.size);
@@ -333,12 +564,14 @@ Res_png_9patch* Res_png_9patch::deserialize(const void* inData)
 // --------------------------------------------------------------------
 
 ResStringPool::ResStringPool()
-    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL)
+    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL),
+      mHashIndex(NULL), mLinearLookups(0)
 {
 }
 
 ResStringPool::ResStringPool(const void* data, size_t size, bool copyData)
-    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL)
+    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL),
+      mHashIndex(NULL), mLinearLookups(0)
 {
     setTo(data, size, copyData);
 }
@@ -540,6 +773,9 @@ void ResStringPool::uninit()
         free(mCache);
         mCache = NULL;
     }
+    free(mHashIndex);
+    mHashIndex = NULL;
+    mLinearLookups = 0;
     if (mOwnedData) {
         free(mOwnedData);
         mOwnedData = NULL;
@@ -616,9 +852,11 @@ const uint16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
 
                 // encLen must be less than 0x7FFF due to encoding.
                 if ((uint32_t)(u8str+u8len-strings) < mStringPoolSize) {
-                    AutoMutex lock(mDecodeLock);
-
-                    if (mCache == NULL) {
+                    // The cache is filled without a lock: threads decoding the
+                    // same string at the same time each decode it, the first
+                    // one to publish its copy wins and the others discard theirs
+                    char16_t** cache = acquireLoad(&mCache);
+                    if (cache == NULL) {
 #ifndef HAVE_ANDROID_OS
                         STRING_POOL_NOISY(ALOGI("CREATING STRING CACHE OF %d bytes",
                                 mHeader->stringCount*sizeof(char16_t**)));
@@ -627,16 +865,22 @@ const uint16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
                         ALOGW("CREATING STRING CACHE OF %d bytes",
                                 mHeader->stringCount*sizeof(char16_t**));
 #endif
-                        mCache = (char16_t**)calloc(mHeader->stringCount, sizeof(char16_t**));
-                        if (mCache == NULL) {
+                        char16_t** newCache = (char16_t**)calloc(mHeader->stringCount,
+                                sizeof(char16_t**));
+                        if (newCache == NULL) {
                             ALOGW("No memory trying to allocate decode cache table of %d bytes\n",
                                     (int)(mHeader->stringCount*sizeof(char16_t**)));
                             return NULL;
                         }
+                        cache = publishIfNull(&mCache, newCache);
+                        if (cache != newCache) {
+                            free(newCache);
+                        }
                     }
 
-                    if (mCache[idx] != NULL) {
-                        return mCache[idx];
+                    char16_t* cached = acquireLoad(&cache[idx]);
+                    if (cached != NULL) {
+                        return cached;
                     }
 
                     ssize_t actualLen = utf8_to_utf16_length(u8str, u8len);
@@ -656,8 +900,11 @@ const uint16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
 
                     STRING_POOL_NOISY(ALOGI("Caching UTF8 string: %s", u8str));
                     utf8_to_utf16(u8str, u8len, u16str);
-                    mCache[idx] = u16str;
-                    return u16str;
+                    cached = publishIfNull(&cache[idx], u16str);
+                    if (cached != u16str) {
+                        free(u16str);
+                    }
+                    return cached;
                 } else {
                     ALOGW("Bad string block: string #%lld extends to %lld, past end at %lld\n",
                             (long long)idx, (long long)(u8str+u8len-strings),
@@ -673,6 +920,20 @@ const uint16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
     return NULL;
 }
 
+void ResStringPool::decodeStrings(const uint32_t* indices, size_t count) const
+{
+    if (mError != NO_ERROR || (mHeader->flags&ResStringPool_header::UTF8_FLAG) == 0) {
+        return;
+    }
+
+    size_t len;
+    for (size_t i = 0; i < count; i++) {
+        if (indices[i] < mHeader->stringCount) {
+            stringAt(indices[i], &len);
+        }
+    }
+}
+
 const char* ResStringPool::string8At(size_t idx, size_t* outLen) const
 {
     if (mError == NO_ERROR && idx < mHeader->stringCount) {
@@ -730,6 +991,87 @@ const ResStringPool_span* ResStringPool::styleAt(size_t idx) const
     return NULL;
 }
 
+// Unsorted pools of at least this many strings get a hash index once they
+// were searched linearly HASH_INDEX_MIN_LOOKUPS times, most pools are only
+// searched for a few style span tags and are not worth indexing.
+#define HASH_INDEX_MIN_STRINGS 32
+#define HASH_INDEX_MIN_LOOKUPS 4
+
+struct ResStringPool::HashIndex
+{
+    uint32_t mask;
+    // Index of the string + 1, 0 for empty slots
+    uint32_t slots[1];
+};
+
+// FNV-1a, over the bytes of UTF-8 strings or the code units of UTF-16 strings.
+// The hash of a previous string may be passed to hash several strings.
+template<typename T>
+static inline uint32_t hashString(const T* str, size_t len, uint32_t hash = 2166136261u)
+{
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint32_t)str[i]) * 16777619u;
+    }
+    return hash;
+}
+
+uint32_t ResStringPool::hashStringAt(size_t idx, bool* outValid) const
+{
+    size_t len;
+    if ((mHeader->flags&ResStringPool_header::UTF8_FLAG) != 0) {
+        const char* s = string8At(idx, &len);
+        *outValid = s != NULL;
+        return s ? hashString((const uint8_t*)s, len) : 0;
+    }
+    const char16_t* s = stringAt(idx, &len);
+    *outValid = s != NULL;
+    return s ? hashString(s, len) : 0;
+}
+
+const ResStringPool::HashIndex* ResStringPool::getHashIndex() const
+{
+    const HashIndex* index = acquireLoad(&mHashIndex);
+    if (index != NULL) {
+        return index;
+    }
+
+    const size_t N = mHeader->stringCount;
+    if (N < HASH_INDEX_MIN_STRINGS ||
+            android_atomic_inc(&mLinearLookups) + 1 < HASH_INDEX_MIN_LOOKUPS) {
+        return NULL;
+    }
+
+    // At most half full, so that probe sequences stay short
+    size_t capacity = 1;
+    while (capacity < N*2) {
+        capacity <<= 1;
+    }
+    HashIndex* newIndex = (HashIndex*)calloc(1,
+            sizeof(HashIndex) + (capacity-1)*sizeof(uint32_t));
+    if (newIndex == NULL) {
+        return NULL;
+    }
+    newIndex->mask = capacity-1;
+
+    for (size_t i = 0; i < N; i++) {
+        bool valid;
+        const uint32_t hash = hashStringAt(i, &valid);
+        if (!valid) continue;
+
+        uint32_t slot = hash & newIndex->mask;
+        while (newIndex->slots[slot] != 0) {
+            slot = (slot + 1) & newIndex->mask;
+        }
+        newIndex->slots[slot] = i+1;
+    }
+
+    index = publishIfNull(&mHashIndex, newIndex);
+    if (index != newIndex) {
+        free(newIndex);
+    }
+    return index;
+}
+
 ssize_t ResStringPool::indexOfString(const char16_t* str, size_t strLen) const
 {
     if (mError != NO_ERROR) {
@@ -738,6 +1080,11 @@ ssize_t ResStringPool::indexOfString(const char16_t* str, size_t strLen) const
 
     size_t len;
 
+    // Pools are searched from the back below, the hash index returns the
+    // last matching string as well
+    const HashIndex* index = (mHeader->flags&ResStringPool_header::SORTED_FLAG) == 0
+            ? getHashIndex() : NULL;
+
     if ((mHeader->flags&ResStringPool_header::UTF8_FLAG) != 0) {
         STRING_POOL_NOISY(ALOGI("indexOfString UTF-8: %s", String8(str, strLen).string()));
 
@@ -785,6 +1132,19 @@ ssize_t ResStringPool::indexOfString(const char16_t* str, size_t strLen) const
             // block, start searching at the back.
             String8 str8(str, strLen);
             const size_t str8Len = str8.size();
+            if (index != NULL) {
+                ssize_t found = NAME_NOT_FOUND;
+                uint32_t slot = hashString((const uint8_t*)str8.string(), str8Len) & index->mask;
+                for (; index->slots[slot] != 0; slot = (slot + 1) & index->mask) {
+                    const ssize_t i = index->slots[slot]-1;
+                    const char* s = string8At(i, &len);
+                    if (i > found && s && str8Len == len
+                            && memcmp(s, str8.string(), str8Len) == 0) {
+                        found = i;
+                    }
+                }
+                return found;
+            }
             for (int i=mHeader->stringCount-1; i>=0; i--) {
                 const char* s = string8At(i, &len);
                 STRING_POOL_NOISY(ALOGI("Looking at %s, i=%d\n",
@@ -827,6 +1187,19 @@ ssize_t ResStringPool::indexOfString(const char16_t* str, size_t strLen) const
             // most often this happens because we want to get IDs for style
             // span tags; since those always appear at the end of the string
             // block, start searching at the back.
+            if (index != NULL) {
+                ssize_t found = NAME_NOT_FOUND;
+                uint32_t slot = hashString(str, strLen) & index->mask;
+                for (; index->slots[slot] != 0; slot = (slot + 1) & index->mask) {
+                    const ssize_t i = index->slots[slot]-1;
+                    const char16_t* s = stringAt(i, &len);
+                    if (i > found && s && strLen == len
+                            && strzcmp16(s, len, str, strLen) == 0) {
+                        found = i;
+                    }
+                }
+                return found;
+            }
             for (int i=mHeader->stringCount-1; i>=0; i--) {
                 const char16_t* s = stringAt(i, &len);
                 STRING_POOL_NOISY(ALOGI("Looking at %s, i=%d\n",
@@ -2474,11 +2847,14 @@ String8 ResTable_config::toString() const {
 struct ResTable::Header
 {
     Header(ResTable* _owner) : owner(_owner), ownedData(NULL), header(NULL),
-        resourceIDMap(NULL), resourceIDMapSize(0) { }
+        resourceIDMap(NULL), resourceIDMapSize(0), tableIndex(NULL) { }
 
     ~Header()
     {
         free(resourceIDMap);
+        if (tableIndex != NULL) {
+            tableIndex->release();
+        }
     }
 
     ResTable* const                 owner;
@@ -2492,19 +2868,113 @@ struct ResTable::Header
     ResStringPool                   values;
     uint32_t*                       resourceIDMap;
     size_t                          resourceIDMapSize;
+
+    // Read-only mapping the configs of the types point into, or NULL if
+    // the types were collected by walking the table.
+    FileMap*                        tableIndex;
+};
+
+// The configs of a type.  They are either collected while walking the
+// package, or read from the offsets stored in a table index, which are
+// shared by all the processes mapping the index.
+class TypeConfigList
+{
+public:
+    TypeConfigList() : mBase(NULL), mOffsets(NULL), mCount(0) { }
+
+    void setIndex(const uint8_t* base, const uint32_t* offsets, size_t count)
+    {
+        mBase = base;
+        mOffsets = offsets;
+        mCount = count;
+    }
+
+    ssize_t add(const ResTable_type* type)
+    {
+        return mConfigs.add(type);
+    }
+
+    size_t size() const
+    {
+        return mOffsets != NULL ? mCount : mConfigs.size();
+    }
+
+    const ResTable_type* operator[](size_t index) const
+    {
+        return mOffsets != NULL
+                ? (const ResTable_type*)(mBase + mOffsets[index]) : mConfigs[index];
+    }
+
+private:
+    Vector<const ResTable_type*>    mConfigs;
+
+    const uint8_t*                  mBase;
+    const uint32_t*                 mOffsets;
+    size_t                          mCount;
 };
 
 struct ResTable::Type
 {
     Type(const Header* _header, const Package* _package, size_t count)
         : header(_header), package(_package), entryCount(count),
-          typeSpec(NULL), typeSpecFlags(NULL) { }
+          typeSpec(NULL), typeSpecFlags(NULL), configIndex(NULL),
+          bestConfigs((uint32_t*)calloc(count, sizeof(uint32_t))) { }
+    ~Type()
+    {
+        free(bestConfigs);
+    }
+
+    // Uses the given config index for the configs of the type, unless it
+    // doesn't list each of them once, sorted by language.
+    bool setConfigIndex(const ResTable_configIndex* index)
+    {
+        configIndex = NULL;
+        const size_t count = configs.size();
+        const size_t headerSize = dtohs(index->header.headerSize);
+        if (headerSize < sizeof(*index) || dtohl(index->configCount) != count
+                || (dtohl(index->header.size) - headerSize)
+                        / sizeof(ResTable_configIndexEntry) < count) {
+            return false;
+        }
+        // The pairs of language and config are strictly increasing and the
+        // language is the one of the config, so no config is listed twice.
+        const ResTable_configIndexEntry* const entries = (const ResTable_configIndexEntry*)
+            (((const uint8_t*)index) + headerSize);
+        uint32_t last = 0;
+        for (size_t i = 0; i < count; i++) {
+            const uint16_t languageKey = configLanguageKey(entries[i].language);
+            const uint16_t config = dtohs(entries[i].config);
+            const uint32_t key = ((uint32_t)languageKey << 16) | config;
+            if (config >= count || (i > 0 && key <= last)
+                    || languageKey != configLanguageKey(configs[config]->config.language)) {
+                return false;
+            }
+            last = key;
+        }
+        configIndex = index;
+        return true;
+    }
+
+    const ResTable_configIndexEntry* getConfigIndexEntries() const
+    {
+        return (const ResTable_configIndexEntry*)
+            (((const uint8_t*)configIndex) + dtohs(configIndex->header.headerSize));
+    }
+
     const Header* const             header;
     const Package* const            package;
     const size_t                    entryCount;
     const ResTable_typeSpec*        typeSpec;
     const uint32_t*                 typeSpecFlags;
-    Vector<const ResTable_type*>    configs;
+    TypeConfigList                  configs;
+    // Index of the configs by language, see ResTable_configIndex, or NULL.
+    const ResTable_configIndex*     configIndex;
+
+    // For each entry, the index in configs of the best config for the
+    // table parameters, see getEntry().  The generation of the parameters
+    // is stored in the upper 16 bits, the lower 16 bits are the index + 1,
+    // or 0 if no config matches.  Entries of other generations are stale.
+    uint32_t* const                 bestConfigs;
 };
 
 struct ResTable::Package
@@ -2539,9 +3009,13 @@ struct ResTable::Package
 struct ResTable::PackageGroup
 {
     PackageGroup(ResTable* _owner, const String16& _name, uint32_t _id)
-        : owner(_owner), name(_name), id(_id), typeCount(0), bags(NULL) { }
+        : owner(_owner), name(_name), id(_id), typeCount(0), bags(NULL),
+          sharedBags(NULL), ownsSharedBags(false), sharedBagsUsable(false) { }
     ~PackageGroup() {
         clearBagCache();
+        if (sharedBags && ownsSharedBags) {
+            freeBags(sharedBags);
+        }
         const size_t N = packages.size();
         for (size_t i=0; i<N; i++) {
             Package* pkg = packages[i];
@@ -2553,29 +3027,33 @@ struct ResTable::PackageGroup
 
     void clearBagCache() {
         if (bags) {
-            TABLE_NOISY(printf("bags=%p\n", bags));
-            Package* pkg = packages[0];
-            TABLE_NOISY(printf("typeCount=%x\n", typeCount));
-            for (size_t i=0; i<typeCount; i++) {
-                TABLE_NOISY(printf("type=%d\n", i));
-                const Type* type = pkg->getType(i);
-                if (type != NULL) {
-                    bag_set** typeBags = bags[i];
-                    TABLE_NOISY(printf("typeBags=%p\n", typeBags));
-                    if (typeBags) {
-                        TABLE_NOISY(printf("type->entryCount=%x\n", type->entryCount));
-                        const size_t N = type->entryCount;
-                        for (size_t j=0; j<N; j++) {
-                            if (typeBags[j] && typeBags[j] != (bag_set*)0xFFFFFFFF)
-                                free(typeBags[j]);
-                        }
-                        free(typeBags);
+            freeBags(bags);
+            bags = NULL;
+        }
+    }
+
+    void freeBags(bag_set*** cache) {
+        TABLE_NOISY(printf("bags=%p\n", cache));
+        Package* pkg = packages[0];
+        TABLE_NOISY(printf("typeCount=%x\n", typeCount));
+        for (size_t i=0; i<typeCount; i++) {
+            TABLE_NOISY(printf("type=%d\n", i));
+            const Type* type = pkg->getType(i);
+            if (type != NULL) {
+                bag_set** typeBags = cache[i];
+                TABLE_NOISY(printf("typeBags=%p\n", typeBags));
+                if (typeBags) {
+                    TABLE_NOISY(printf("type->entryCount=%x\n", type->entryCount));
+                    const size_t N = type->entryCount;
+                    for (size_t j=0; j<N; j++) {
+                        if (typeBags[j] && typeBags[j] != (bag_set*)0xFFFFFFFF)
+                            free(typeBags[j]);
                     }
+                    free(typeBags);
                 }
             }
-            free(bags);
-            bags = NULL;
         }
+        free(cache);
     }
     
     ResTable* const                 owner;
@@ -2592,6 +3070,15 @@ struct ResTable::PackageGroup
     // Computed attribute bags, first indexed by the type and second
     // by the entry in that type.
     bag_set***                      bags;
+
+    // Bags computed by ResTable::precomputeBags() for sharedBagsParams,
+    // laid out like 'bags'.  They are never modified once computed, and
+    // tables copied from the table that owns them share them with it.
+    bag_set***                      sharedBags;
+    ResTable_config                 sharedBagsParams;
+    bool                            ownsSharedBags;
+    // Whether the table parameters are the ones of the shared bags.
+    bool                            sharedBagsUsable;
 };
 
 struct ResTable::bag_set
@@ -2602,19 +3089,75 @@ struct ResTable::bag_set
     // Followed by 'numAttr' bag_entry structures.
 };
 
+// An entry of a theme whose value references another attribute of the
+// theme, along with the value the chain of references leads to.
+struct ResTable::Theme::resolved_entry
+{
+    // Package index, type and entry of the attribute, see find_entry().
+    uint32_t key;
+    // The table index of the value, or the error the chain led to.
+    ssize_t stringBlock;
+    // Flags of the entries after the first one in the chain.
+    uint32_t typeSpecFlags;
+    Res_value value;
+};
+
+// The contents of a theme.  Once published, the contents are never
+// modified and are shared by all the themes of the table that had the
+// same styles applied with the same table parameters.
+struct ResTable::Theme::theme_data
+{
+    theme_data() : refCount(1), paramsGeneration(0), shareable(false), hash(0)
+    {
+        memset(packages, 0, sizeof(packages));
+    }
+
+    // Guarded by the table's mThemeLock.
+    int32_t                         refCount;
+
+    // The key of the theme: the styles applied, as pairs of resource id and
+    // force flag, and the generation of the table parameters they were
+    // applied with.  Contents that cannot be described by their styles
+    // are not shareable.
+    uint32_t                        paramsGeneration;
+    bool                            shareable;
+    uint32_t                        hash;
+    Vector<uint32_t>                styles;
+
+    package_info*                   packages[Res_MAXPACKAGE];
+
+    // The entries referencing other attributes, sorted by key.
+    Vector<resolved_entry>          resolved;
+
+    bool sameKey(const theme_data* other) const
+    {
+        return hash == other->hash
+                && paramsGeneration == other->paramsGeneration
+                && styles.size() == other->styles.size()
+                && memcmp(styles.array(), other->styles.array(),
+                          styles.size()*sizeof(uint32_t)) == 0;
+    }
+
+    void computeHash()
+    {
+        // FNV-1a
+        uint32_t h = 2166136261u ^ paramsGeneration;
+        for (size_t i=0; i<styles.size(); i++) {
+            h = (h ^ styles[i]) * 16777619u;
+        }
+        hash = h;
+    }
+};
+
 ResTable::Theme::Theme(const ResTable& table)
-    : mTable(table)
+    : mTable(table), mData(NULL)
 {
-    memset(mPackages, 0, sizeof(mPackages));
 }
 
 ResTable::Theme::~Theme()
 {
-    for (size_t i=0; i<Res_MAXPACKAGE; i++) {
-        package_info* pi = mPackages[i];
-        if (pi != NULL) {
-            free_package(pi);
-        }
+    if (mData != NULL) {
+        release_data(mData);
     }
 }
 
@@ -2649,8 +3192,161 @@ ResTable::Theme::package_info* ResTable::Theme::copy_package(package_info* pi)
     return newpi;
 }
 
+// Returns contents of the theme that can be modified, without copying
+// them if no other theme uses them.
+ResTable::Theme::theme_data* ResTable::Theme::edit_data()
+{
+    AutoMutex _l(mTable.mThemeLock);
+    if (mData != NULL && mData->refCount == 1) {
+        if (mData->shareable) {
+            for (size_t i=0; i<mTable.mThemes.size(); i++) {
+                if (mTable.mThemes[i] == mData) {
+                    mTable.mThemes.removeAt(i);
+                    break;
+                }
+            }
+        }
+        mData->resolved.clear();
+        return mData;
+    }
+
+    theme_data* data = new theme_data();
+    if (mData != NULL) {
+        data->paramsGeneration = mData->paramsGeneration;
+        data->shareable = mData->shareable;
+        data->styles = mData->styles;
+        for (size_t i=0; i<Res_MAXPACKAGE; i++) {
+            if (mData->packages[i] != NULL) {
+                data->packages[i] = copy_package(mData->packages[i]);
+            }
+        }
+        // Still used by other themes.
+        mData->refCount--;
+    }
+    mData = data;
+    return data;
+}
+
+// Makes contents built by edit_data() visible to the other themes of the
+// table, or switches to identical contents another theme published first.
+void ResTable::Theme::publish_data(theme_data* data)
+{
+    data->computeHash();
+
+    // Resolve the references to other attributes now, the contents no
+    // longer change.
+    for (size_t i=0; i<Res_MAXPACKAGE; i++) {
+        const package_info* pi = data->packages[i];
+        if (pi == NULL) continue;
+        for (size_t j=0; j<pi->numTypes; j++) {
+            const type_info& ti = pi->types[j];
+            for (size_t k=0; k<ti.numEntries; k++) {
+                const theme_entry& te = ti.entries[k];
+                if (te.value.dataType != Res_value::TYPE_ATTRIBUTE) continue;
+                resolved_entry re;
+                re.key = (i<<24) | (j<<16) | k;
+                re.typeSpecFlags = 0;
+                re.stringBlock = walk_attribute(data, te.value.data, 19, &re.value,
+                        &re.typeSpecFlags);
+                data->resolved.add(re);
+            }
+        }
+    }
+
+    if (!data->shareable) {
+        return;
+    }
+
+    AutoMutex _l(mTable.mThemeLock);
+    for (size_t i=0; i<mTable.mThemes.size(); i++) {
+        theme_data* other = mTable.mThemes[i];
+        if (other->sameKey(data)) {
+            other->refCount++;
+            mData = other;
+            // Only used by this theme.
+            for (size_t j=0; j<Res_MAXPACKAGE; j++) {
+                if (data->packages[j] != NULL) {
+                    free_package(data->packages[j]);
+                }
+            }
+            delete data;
+            return;
+        }
+    }
+    mTable.mThemes.add(data);
+}
+
+void ResTable::Theme::release_data(theme_data* data)
+{
+    {
+        AutoMutex _l(mTable.mThemeLock);
+        if (--data->refCount > 0) {
+            return;
+        }
+        if (data->shareable) {
+            for (size_t i=0; i<mTable.mThemes.size(); i++) {
+                if (mTable.mThemes[i] == data) {
+                    mTable.mThemes.removeAt(i);
+                    break;
+                }
+            }
+        }
+    }
+
+    for (size_t i=0; i<Res_MAXPACKAGE; i++) {
+        if (data->packages[i] != NULL) {
+            free_package(data->packages[i]);
+        }
+    }
+    delete data;
+}
+
 status_t ResTable::Theme::applyStyle(uint32_t resID, bool force)
 {
+    // Themes built with other parameters may hold other values for the
+    // same styles, and themes that were partly built with other parameters
+    // cannot be described by their styles at all.
+    const uint32_t generation = __atomic_load_n(&mTable.mParamsGeneration, __ATOMIC_ACQUIRE);
+    const bool shareable = mData == NULL
+            || (mData->shareable && mData->paramsGeneration == generation);
+
+    Vector<uint32_t> styles;
+    if (mData != NULL) {
+        styles = mData->styles;
+    }
+    styles.add(resID);
+    styles.add(force ? 1 : 0);
+
+    // Another theme may have been built from the same styles already.
+    if (shareable) {
+        theme_data key;
+        key.paramsGeneration = generation;
+        key.styles = styles;
+        key.computeHash();
+
+        theme_data* found = NULL;
+        {
+            AutoMutex _l(mTable.mThemeLock);
+            for (size_t i=0; i<mTable.mThemes.size(); i++) {
+                theme_data* other = mTable.mThemes[i];
+                if (other->sameKey(&key)) {
+                    other->refCount++;
+                    found = other;
+                    break;
+                }
+            }
+        }
+        if (found != NULL) {
+            TABLE_NOISY(ALOGV("Applying style 0x%08x to theme %p, shared contents %p",
+                              resID, this, found));
+            if (mData != NULL) {
+                release_data(mData);
+            }
+            mData = found;
+            return NO_ERROR;
+        }
+    }
+
     const bag_entry* bag;
     uint32_t bagTypeSpecFlags = 0;
     mTable.lock();
@@ -2661,6 +3357,8 @@ status_t ResTable::Theme::applyStyle(uint32_t resID, bool force)
         return N;
     }
 
+    theme_data* const data = edit_data();
+
     uint32_t curPackage = 0xffffffff;
     ssize_t curPackageIndex = 0;
     package_info* curPI = NULL;
@@ -2684,7 +3382,7 @@ status_t ResTable::Theme::applyStyle(uint32_t resID, bool force)
             }
             curPackage = p;
             curPackageIndex = pidx;
-            curPI = mPackages[pidx];
+            curPI = data->packages[pidx];
             if (curPI == NULL) {
                 PackageGroup* const grp = mTable.mPackageGroups[pidx];
                 int cnt = grp->typeCount;
@@ -2692,7 +3390,7 @@ status_t ResTable::Theme::applyStyle(uint32_t resID, bool force)
                     sizeof(package_info) + (cnt*sizeof(type_info)));
                 curPI->numTypes = cnt;
                 memset(curPI->types, 0, cnt*sizeof(type_info));
-                mPackages[pidx] = curPI;
+                data->packages[pidx] = curPI;
             }
             curType = 0xffffffff;
         }
@@ -2735,6 +3433,11 @@ status_t ResTable::Theme::applyStyle(uint32_t resID, bool force)
 
     mTable.unlock();
 
+    data->paramsGeneration = generation;
+    data->shareable = shareable;
+    data->styles = styles;
+    publish_data(data);
+
     //ALOGI("Applying style 0x%08x (force=%d)  theme %p...\n", resID, force, this);
     //dumpToLog();
     
@@ -2747,32 +3450,28 @@ status_t ResTable::Theme::setTo(const Theme& other)
     //dumpToLog();
     //other.dumpToLog();
     
+    theme_data* data = NULL;
     if (&mTable == &other.mTable) {
-        for (size_t i=0; i<Res_MAXPACKAGE; i++) {
-            if (mPackages[i] != NULL) {
-                free_package(mPackages[i]);
-            }
-            if (other.mPackages[i] != NULL) {
-                mPackages[i] = copy_package(other.mPackages[i]);
-            } else {
-                mPackages[i] = NULL;
-            }
+        // The contents are never modified once published, share them.
+        data = other.mData;
+        if (data != NULL) {
+            AutoMutex _l(mTable.mThemeLock);
+            data->refCount++;
         }
     } else {
         // @todo: need to really implement this, not just copy
         // the system package (which is still wrong because it isn't
         // fixing up resource references).
-        for (size_t i=0; i<Res_MAXPACKAGE; i++) {
-            if (mPackages[i] != NULL) {
-                free_package(mPackages[i]);
-            }
-            if (i == 0 && other.mPackages[i] != NULL) {
-                mPackages[i] = copy_package(other.mPackages[i]);
-            } else {
-                mPackages[i] = NULL;
-            }
+        if (other.mData != NULL && other.mData->packages[0] != NULL) {
+            data = new theme_data();
+            data->packages[0] = copy_package(other.mData->packages[0]);
+            publish_data(data);
         }
     }
+    if (mData != NULL) {
+        release_data(mData);
+    }
+    mData = data;
 
     //ALOGI("Final theme:");
     //dumpToLog();
@@ -2780,60 +3479,117 @@ status_t ResTable::Theme::setTo(const Theme& other)
     return NO_ERROR;
 }
 
-ssize_t ResTable::Theme::getAttribute(uint32_t resID, Res_value* outValue,
-        uint32_t* outTypeSpecFlags) const
+const ResTable::Theme::theme_entry* ResTable::Theme::find_entry(const theme_data* data,
+        uint32_t resID, uint32_t* outKey) const
 {
-    int cnt = 20;
+    if (data == NULL) {
+        return NULL;
+    }
 
-    if (outTypeSpecFlags != NULL) *outTypeSpecFlags = 0;
-    
+    const ssize_t p = mTable.getResourcePackageIndex(resID);
+    const uint32_t t = Res_GETTYPE(resID);
+    const uint32_t e = Res_GETENTRY(resID);
+
+    TABLE_THEME(ALOGI("Looking up attr 0x%08x in theme %p", resID, this));
+
+    if (p < 0) {
+        return NULL;
+    }
+    const package_info* const pi = data->packages[p];
+    TABLE_THEME(ALOGI("Found package: %p", pi));
+    if (pi == NULL) {
+        return NULL;
+    }
+    TABLE_THEME(ALOGI("Desired type index is %ld in avail %d", t, pi->numTypes));
+    if (t >= pi->numTypes) {
+        return NULL;
+    }
+    const type_info& ti = pi->types[t];
+    TABLE_THEME(ALOGI("Desired entry index is %ld in avail %d", e, ti.numEntries));
+    if (e >= ti.numEntries) {
+        return NULL;
+    }
+    if (outKey != NULL) {
+        *outKey = (p<<24) | (t<<16) | e;
+    }
+    return &ti.entries[e];
+}
+
+ssize_t ResTable::Theme::walk_attribute(const theme_data* data, uint32_t resID, int cnt,
+        Res_value* outValue, uint32_t* outTypeSpecFlags) const
+{
     do {
-        const ssize_t p = mTable.getResourcePackageIndex(resID);
-        const uint32_t t = Res_GETTYPE(resID);
-        const uint32_t e = Res_GETENTRY(resID);
-
-        TABLE_THEME(ALOGI("Looking up attr 0x%08x in theme %p", resID, this));
-
-        if (p >= 0) {
-            const package_info* const pi = mPackages[p];
-            TABLE_THEME(ALOGI("Found package: %p", pi));
-            if (pi != NULL) {
-                TABLE_THEME(ALOGI("Desired type index is %ld in avail %d", t, pi->numTypes));
-                if (t < pi->numTypes) {
-                    const type_info& ti = pi->types[t];
-                    TABLE_THEME(ALOGI("Desired entry index is %ld in avail %d", e, ti.numEntries));
-                    if (e < ti.numEntries) {
-                        const theme_entry& te = ti.entries[e];
-                        if (outTypeSpecFlags != NULL) {
-                            *outTypeSpecFlags |= te.typeSpecFlags;
-                        }
-                        TABLE_THEME(ALOGI("Theme value: type=0x%x, data=0x%08x",
-                                te.value.dataType, te.value.data));
-                        const uint8_t type = te.value.dataType;
-                        if (type == Res_value::TYPE_ATTRIBUTE) {
-                            if (cnt > 0) {
-                                cnt--;
-                                resID = te.value.data;
-                                continue;
-                            }
-                            ALOGW("Too many attribute references, stopped at: 0x%08x\n", resID);
-                            return BAD_INDEX;
-                        } else if (type != Res_value::TYPE_NULL) {
-                            *outValue = te.value;
-                            return te.stringBlock;
-                        }
-                        return BAD_INDEX;
-                    }
-                }
+        const theme_entry* te = find_entry(data, resID);
+        if (te == NULL) {
+            break;
+        }
+        *outTypeSpecFlags |= te->typeSpecFlags;
+        TABLE_THEME(ALOGI("Theme value: type=0x%x, data=0x%08x",
+                te->value.dataType, te->value.data));
+        const uint8_t type = te->value.dataType;
+        if (type == Res_value::TYPE_ATTRIBUTE) {
+            if (cnt > 0) {
+                cnt--;
+                resID = te->value.data;
+                continue;
             }
+            ALOGW("Too many attribute references, stopped at: 0x%08x\n", resID);
+            return BAD_INDEX;
+        } else if (type != Res_value::TYPE_NULL) {
+            *outValue = te->value;
+            return te->stringBlock;
         }
-        break;
+        return BAD_INDEX;
 
     } while (true);
 
     return BAD_INDEX;
 }
 
+ssize_t ResTable::Theme::getAttribute(uint32_t resID, Res_value* outValue,
+        uint32_t* outTypeSpecFlags) const
+{
+    uint32_t typeSpecFlags = 0;
+    ssize_t block = BAD_INDEX;
+
+    uint32_t key;
+    const theme_entry* te = find_entry(mData, resID, &key);
+    if (te != NULL && te->value.dataType == Res_value::TYPE_ATTRIBUTE) {
+        // References to other attributes were resolved when the contents
+        // were published.
+        const Vector<resolved_entry>& resolved = mData->resolved;
+        ssize_t lo = 0;
+        ssize_t hi = resolved.size() - 1;
+        const resolved_entry* re = NULL;
+        while (lo <= hi) {
+            const ssize_t mid = (lo + hi) / 2;
+            const uint32_t midKey = resolved[mid].key;
+            if (midKey < key) {
+                lo = mid + 1;
+            } else if (midKey > key) {
+                hi = mid - 1;
+            } else {
+                re = &resolved[mid];
+                break;
+            }
+        }
+        if (re != NULL) {
+            typeSpecFlags = te->typeSpecFlags | re->typeSpecFlags;
+            if (re->stringBlock >= 0) {
+                *outValue = re->value;
+            }
+            block = re->stringBlock;
+        } else {
+            block = walk_attribute(mData, resID, 20, outValue, &typeSpecFlags);
+        }
+    } else if (te != NULL) {
+        block = walk_attribute(mData, resID, 20, outValue, &typeSpecFlags);
+    }
+
+    if (outTypeSpecFlags != NULL) *outTypeSpecFlags = typeSpecFlags;
+    return block;
+}
+
 ssize_t ResTable::Theme::resolveAttributeReference(Res_value* inOutValue,
         ssize_t blockIndex, uint32_t* outLastRef,
         uint32_t* inoutTypeSpecFlags, ResTable_config* inoutConfig) const
@@ -2857,8 +3613,9 @@ ssize_t ResTable::Theme::resolveAttributeReference(Res_value* inOutValue,
 void ResTable::Theme::dumpToLog() const
 {
     ALOGI("Theme %p:\n", this);
+    if (mData == NULL) return;
     for (size_t i=0; i<Res_MAXPACKAGE; i++) {
-        package_info* pi = mPackages[i];
+        package_info* pi = mData->packages[i];
         if (pi == NULL) continue;
         
         ALOGI("  Package #0x%02x:\n", (int)(i+1));
@@ -2879,7 +3636,7 @@ void ResTable::Theme::dumpToLog() const
 }
 
 ResTable::ResTable()
-    : mError(NO_INIT)
+    : mError(NO_INIT), mParamsGeneration(1)
 {
     memset(&mParams, 0, sizeof(mParams));
     memset(mPackageMap, 0, sizeof(mPackageMap));
@@ -2887,7 +3644,7 @@ ResTable::ResTable()
 }
 
 ResTable::ResTable(const void* data, size_t size, const int32_t cookie, bool copyData)
-    : mError(NO_INIT)
+    : mError(NO_INIT), mParamsGeneration(1)
 {
     memset(&mParams, 0, sizeof(mParams));
     memset(mPackageMap, 0, sizeof(mPackageMap));
@@ -2924,6 +3681,22 @@ status_t ResTable::add(Asset* asset, const int32_t cookie, bool copyData, const
             reinterpret_cast<const Asset*>(idmap));
 }
 
+status_t ResTable::add(Asset* asset, const int32_t cookie, bool copyData, const void* idmap,
+        FileMap* tableIndex)
+{
+    const void* data = asset->getBuffer(true);
+    if (data == NULL) {
+        ALOGW("Unable to get buffer of resource asset file");
+        if (tableIndex != NULL) {
+            tableIndex->release();
+        }
+        return UNKNOWN_ERROR;
+    }
+    size_t size = (size_t)asset->getLength();
+    return addInternal(data, size, cookie, asset, copyData,
+            reinterpret_cast<const Asset*>(idmap), tableIndex);
+}
+
 status_t ResTable::add(ResTable* src)
 {
     mError = src->mError;
@@ -2940,6 +3713,10 @@ status_t ResTable::add(ResTable* src)
         }
         pg->basePackage = srcPg->basePackage;
         pg->typeCount = srcPg->typeCount;
+        pg->sharedBags = srcPg->sharedBags;
+        pg->sharedBagsParams = srcPg->sharedBagsParams;
+        pg->sharedBagsUsable = pg->sharedBags != NULL
+                && pg->sharedBagsParams.compare(mParams) == 0;
         mPackageGroups.add(pg);
     }
     
@@ -2949,12 +3726,18 @@ status_t ResTable::add(ResTable* src)
 }
 
 status_t ResTable::addInternal(const void* data, size_t size, const int32_t cookie,
-                       Asset* asset, bool copyData, const Asset* idmap)
+                       Asset* asset, bool copyData, const Asset* idmap, FileMap* tableIndex)
 {
-    if (!data) return NO_ERROR;
+    if (!data) {
+        if (tableIndex != NULL) {
+            tableIndex->release();
+        }
+        return NO_ERROR;
+    }
     Header* header = new Header(this);
     header->index = mHeaders.size();
     header->cookie = cookie;
+    header->tableIndex = tableIndex;
     if (idmap != NULL) {
         const size_t idmap_size = idmap->getLength();
         const void* idmap_data = const_cast<Asset*>(idmap)->getBuffer(true);
@@ -3005,6 +3788,20 @@ status_t ResTable::addInternal(const void* data, size_t size, const int32_t cook
     }
     header->dataEnd = ((const uint8_t*)header->header) + header->size;
 
+    // The record of the next package in the table index, if any.
+    const uint32_t* indexRecord = NULL;
+    if (header->tableIndex != NULL) {
+        const uint32_t* index = (const uint32_t*)header->tableIndex->getDataPtr();
+        if (validateTableIndex(header->header, header->size, index,
+                               header->tableIndex->getDataLength())) {
+            indexRecord = index + TABLE_INDEX_HEADER_SIZE;
+        } else {
+            ALOGW("Table index does not match the resource table, ignoring it.");
+            header->tableIndex->release();
+            header->tableIndex = NULL;
+        }
+    }
+
     // Iterate through all chunks.
     size_t curPackage = 0;
 
@@ -3048,7 +3845,21 @@ status_t ResTable::addInternal(const void* data, size_t size, const int32_t cook
                     idmap_id = tmp;
                 }
             }
-            if (parsePackage((ResTable_package*)chunk, header, idmap_id) != NO_ERROR) {
+            const uint32_t* record = NULL;
+            if (indexRecord != NULL) {
+                const uint32_t offset = ((const uint8_t*)chunk)
+                        - ((const uint8_t*)header->header);
+                if (indexRecord[0] == offset) {
+                    record = indexRecord;
+                    indexRecord = nextTableIndexRecord(indexRecord);
+                } else {
+                    // The packages already read keep pointing into the index.
+                    ALOGW("Table index does not match package at %p, ignoring it.",
+                         (void*)offset);
+                    indexRecord = NULL;
+                }
+            }
+            if (parsePackage((ResTable_package*)chunk, header, idmap_id, record) != NO_ERROR) {
                 return mError;
             }
             curPackage++;
@@ -3389,7 +4200,7 @@ const char16_t* ResTable::valueToString(
 
 ssize_t ResTable::lockBag(uint32_t resID, const bag_entry** outBag) const
 {
-    mLock.lock();
+    mLock.readLock();
     ssize_t err = getBagLocked(resID, outBag);
     if (err < NO_ERROR) {
         //printf("*** get failed!  unlocking\n");
@@ -3406,7 +4217,7 @@ void ResTable::unlockBag(const bag_entry* bag) const
 
 void ResTable::lock() const
 {
-    mLock.lock();
+    mLock.readLock();
 }
 
 void ResTable::unlock() const
@@ -3416,6 +4227,12 @@ void ResTable::unlock() const
 
 ssize_t ResTable::getBagLocked(uint32_t resID, const bag_entry** outBag,
         uint32_t* outTypeSpecFlags) const
+{
+    return getBagLocked(resID, outBag, outTypeSpecFlags, false);
+}
+
+ssize_t ResTable::getBagLocked(uint32_t resID, const bag_entry** outBag,
+        uint32_t* outTypeSpecFlags, bool bagLockHeld) const
 {
     if (mError != NO_ERROR) {
         return mError;
@@ -3458,11 +4275,27 @@ ssize_t ResTable::getBagLocked(uint32_t resID, const bag_entry** outBag,
         return BAD_INDEX;
     }
 
-    // First see if we've already computed this bag...
-    if (grp->bags) {
-        bag_set** typeSet = grp->bags[t];
+    // Bags precomputed for the current parameters never change.
+    if (grp->sharedBagsUsable) {
+        bag_set** typeSet = grp->sharedBags[t];
+        bag_set* set = typeSet ? typeSet[e] : NULL;
+        if (set && set != (bag_set*)0xFFFFFFFF) {
+            if (outTypeSpecFlags != NULL) {
+                *outTypeSpecFlags = set->typeSpecFlags;
+            }
+            *outBag = (bag_entry*)(set+1);
+            return set->numAttrs;
+        }
+    }
+
+    // First see if we've already computed this bag...  The cache is only
+    // filled while holding mBagLock and its entries are published with
+    // release stores, computed bags can be looked up without any lock.
+    bag_set*** bags = acquireLoad(&grp->bags);
+    if (bags) {
+        bag_set** typeSet = acquireLoad(&bags[t]);
         if (typeSet) {
-            bag_set* set = typeSet[e];
+            bag_set* set = acquireLoad(&typeSet[e]);
             if (set) {
                 if (set != (bag_set*)0xFFFFFFFF) {
                     if (outTypeSpecFlags != NULL) {
@@ -3472,28 +4305,39 @@ ssize_t ResTable::getBagLocked(uint32_t resID, const bag_entry** outBag,
                     //ALOGI("Found existing bag for: %p\n", (void*)resID);
                     return set->numAttrs;
                 }
-                ALOGW("Attempt to retrieve bag 0x%08x which is invalid or in a cycle.",
-                     resID);
-                return BAD_INDEX;
+                // Another thread may be computing this bag, it is only
+                // a cycle if this thread is the one computing it
+                if (bagLockHeld) {
+                    ALOGW("Attempt to retrieve bag 0x%08x which is invalid or in a cycle.",
+                         resID);
+                    return BAD_INDEX;
+                }
             }
         }
     }
 
-    // Bag not found, we need to compute it!
-    if (!grp->bags) {
-        grp->bags = (bag_set***)calloc(grp->typeCount, sizeof(bag_set*));
-        if (!grp->bags) return NO_MEMORY;
+    // Bag not found, we need to compute it!  Look it up again once we own
+    // the cache, another thread may have computed it in the meantime.
+    if (!bagLockHeld) {
+        AutoMutex _l(mBagLock);
+        return getBagLocked(resID, outBag, outTypeSpecFlags, true);
     }
 
-    bag_set** typeSet = grp->bags[t];
+    if (!bags) {
+        bags = (bag_set***)calloc(grp->typeCount, sizeof(bag_set*));
+        if (!bags) return NO_MEMORY;
+        releaseStore(&grp->bags, bags);
+    }
+
+    bag_set** typeSet = bags[t];
     if (!typeSet) {
         typeSet = (bag_set**)calloc(NENTRY, sizeof(bag_set*));
         if (!typeSet) return NO_MEMORY;
-        grp->bags[t] = typeSet;
+        releaseStore(&bags[t], typeSet);
     }
 
     // Mark that we are currently working on this one.
-    typeSet[e] = (bag_set*)0xFFFFFFFF;
+    releaseStore(&typeSet[e], (bag_set*)0xFFFFFFFF);
 
     // This is what we are building.
     bag_set* set = NULL;
@@ -3578,7 +4422,7 @@ ssize_t ResTable::getBagLocked(uint32_t resID, const bag_entry** outBag,
         if (parent) {
             const bag_entry* parentBag;
             uint32_t parentTypeSpecFlags = 0;
-            const ssize_t NP = getBagLocked(parent, &parentBag, &parentTypeSpecFlags);
+            const ssize_t NP = getBagLocked(parent, &parentBag, &parentTypeSpecFlags, true);
             const size_t NT = ((NP >= 0) ? NP : 0) + N;
             set = (bag_set*)malloc(sizeof(bag_set)+sizeof(bag_entry)*NT);
             if (set == NULL) {
@@ -3689,7 +4533,7 @@ ssize_t ResTable::getBagLocked(uint32_t resID, const bag_entry** outBag,
     }
 
     // And this is it...
-    typeSet[e] = set;
+    releaseStore(&typeSet[e], set);
     if (set) {
         if (outTypeSpecFlags != NULL) {
             *outTypeSpecFlags = set->typeSpecFlags;
@@ -3701,21 +4545,80 @@ ssize_t ResTable::getBagLocked(uint32_t resID, const bag_entry** outBag,
     return BAD_INDEX;
 }
 
+status_t ResTable::precomputeBags(const uint32_t* resIDs, size_t count)
+{
+    mLock.writeLock();
+    for (size_t i=0; i<mPackageGroups.size(); i++) {
+        if (mPackageGroups[i]->sharedBags != NULL) {
+            // Other tables may already be using them.
+            mLock.unlock();
+            return INVALID_OPERATION;
+        }
+    }
+
+    {
+        AutoMutex _l(mBagLock);
+        for (size_t i=0; i<count; i++) {
+            const bag_entry* bag;
+            if (getBagLocked(resIDs[i], &bag, NULL, true) < 0) {
+                ALOGW("Unable to precompute bag of resource 0x%08x", resIDs[i]);
+            }
+        }
+    }
+
+    // Every bag of the cache, the requested ones and their parents, was
+    // computed for the current parameters.
+    for (size_t i=0; i<mPackageGroups.size(); i++) {
+        PackageGroup* grp = mPackageGroups[i];
+        grp->sharedBags = grp->bags;
+        grp->sharedBagsParams = mParams;
+        grp->ownsSharedBags = true;
+        grp->sharedBagsUsable = grp->sharedBags != NULL;
+        grp->bags = NULL;
+    }
+    mLock.unlock();
+    return NO_ERROR;
+}
+
 void ResTable::setParameters(const ResTable_config* params)
 {
-    mLock.lock();
+    mLock.writeLock();
     TABLE_GETENTRY(ALOGI("Setting parameters: %s\n", params->toString().string()));
     mParams = *params;
     for (size_t i=0; i<mPackageGroups.size(); i++) {
         TABLE_NOISY(ALOGI("CLEARING BAGS FOR GROUP %d!", i));
-        mPackageGroups[i]->clearBagCache();
+        PackageGroup* grp = mPackageGroups[i];
+        grp->clearBagCache();
+        grp->sharedBagsUsable = grp->sharedBags != NULL
+                && grp->sharedBagsParams.compare(mParams) == 0;
+    }
+
+    // Makes the best configs computed for the previous parameters stale.
+    // The generation is stored on 16 bits, when it wraps around the old
+    // entries could look current again and are cleared instead.
+    uint32_t generation = mParamsGeneration + 1;
+    if (generation > 0xffff) {
+        generation = 1;
+        for (size_t i=0; i<mPackageGroups.size(); i++) {
+            const PackageGroup* grp = mPackageGroups[i];
+            for (size_t j=0; j<grp->packages.size(); j++) {
+                const Package* package = grp->packages[j];
+                for (size_t k=0; k<package->types.size(); k++) {
+                    const Type* type = package->types[k];
+                    if (type != NULL && type->bestConfigs != NULL) {
+                        memset(type->bestConfigs, 0, type->entryCount*sizeof(uint32_t));
+                    }
+                }
+            }
+        }
     }
+    __atomic_store_n(&mParamsGeneration, generation, __ATOMIC_RELEASE);
     mLock.unlock();
 }
 
 void ResTable::getParameters(ResTable_config* params) const
 {
-    mLock.lock();
+    mLock.readLock();
     *params = mParams;
     mLock.unlock();
 }
@@ -5046,7 +5949,66 @@ ssize_t ResTable::getEntry(
     memset(&bestConfig, 0, sizeof(bestConfig)); // make the compiler shut up
     
     const size_t NT = allTypes->configs.size();
-    for (size_t i=0; i<NT; i++) {
+
+    // The best config of an entry for the table parameters only changes
+    // with setParameters(), it is cached to avoid matching every config of
+    // the type against the parameters on each lookup.
+    uint32_t* const cachedConfig = config == &mParams && NT < 0xffff
+            ? allTypes->bestConfigs : NULL;
+    const uint32_t generation = cachedConfig ?
+            __atomic_load_n(&mParamsGeneration, __ATOMIC_ACQUIRE) : 0;
+    bool cacheHit = false;
+    if (cachedConfig) {
+        const uint32_t cached = __atomic_load_n(&cachedConfig[entryIndex], __ATOMIC_RELAXED);
+        if ((cached >> 16) == generation) {
+            if ((cached & 0xffff) == 0) {
+                TABLE_GETENTRY(ALOGI("No value found for requested entry (cached)!\n"));
+                return BAD_INDEX;
+            }
+            type = allTypes->configs[(cached & 0xffff) - 1];
+            const uint32_t* const eindex = (const uint32_t*)
+                (((const uint8_t*)type) + dtohs(type->header.headerSize));
+            offset = dtohl(eindex[entryIndex]);
+            cacheHit = true;
+        }
+    }
+
+    // With a config index, only the configs without a language and those of
+    // the requested language are matched.  The two ranges of the index are
+    // merged so that the configs are still visited in order.
+    const ResTable_configIndexEntry* anyLanguage = NULL;
+    const ResTable_configIndexEntry* anyLanguageEnd = NULL;
+    const ResTable_configIndexEntry* language = NULL;
+    const ResTable_configIndexEntry* languageEnd = NULL;
+    const bool indexed = config != NULL && allTypes->configIndex != NULL && !cacheHit;
+    if (indexed) {
+        const ResTable_configIndexEntry* const begin = allTypes->getConfigIndexEntries();
+        const ResTable_configIndexEntry* const end = begin + NT;
+        anyLanguage = begin;
+        anyLanguageEnd = lowerBoundConfigIndex(begin, end, 1);
+        const uint16_t languageKey = configLanguageKey(config->language);
+        if (languageKey != 0) {
+            language = lowerBoundConfigIndex(anyLanguageEnd, end, languageKey);
+            languageEnd = lowerBoundConfigIndex(language, end, languageKey + 1);
+        }
+    }
+
+    size_t bestIndex = NT;
+    for (size_t n=0; !cacheHit; n++) {
+        size_t i = n;
+        if (indexed) {
+            if (anyLanguage < anyLanguageEnd && (language == languageEnd
+                    || dtohs(anyLanguage->config) < dtohs(language->config))) {
+                i = dtohs((anyLanguage++)->config);
+            } else if (language < languageEnd) {
+                i = dtohs((language++)->config);
+            } else {
+                break;
+            }
+        } else if (n >= NT) {
+            break;
+        }
+
         const ResTable_type* const thisType = allTypes->configs[i];
         if (thisType == NULL) continue;
         
@@ -5089,9 +6051,17 @@ ssize_t ResTable::getEntry(
         type = thisType;
         offset = thisOffset;
         bestConfig = thisConfig;
+        bestIndex = i;
         TABLE_GETENTRY(ALOGI("Best entry so far -- using it!\n"));
         if (!config) break;
     }
+
+    if (cachedConfig && !cacheHit) {
+        // A lookup racing with setParameters() stores the generation it
+        // started with, its result is ignored
+        const uint32_t cached = (generation << 16) | (bestIndex < NT ? bestIndex + 1 : 0);
+        __atomic_store_n(&cachedConfig[entryIndex], cached, __ATOMIC_RELAXED);
+    }
     
     if (type == NULL) {
         TABLE_GETENTRY(ALOGI("No value found for requested entry!\n"));
@@ -5131,7 +6101,8 @@ ssize_t ResTable::getEntry(
 }
 
 status_t ResTable::parsePackage(const ResTable_package* const pkg,
-                                const Header* const header, uint32_t idmap_id)
+                                const Header* const header, uint32_t idmap_id,
+                                const uint32_t* indexRecord)
 {
     const uint8_t* base = (const uint8_t*)pkg;
     status_t err = validate_chunk(&pkg->header, sizeof(*pkg),
@@ -5227,6 +6198,45 @@ status_t ResTable::parsePackage(const ResTable_package* const pkg,
         return NO_ERROR;
     }
 
+    if (indexRecord != NULL) {
+        // The index was checked against the table by validateTableIndex():
+        // point the types at the chunks it lists instead of walking them.
+        const uint8_t* const tableBase = (const uint8_t*)header->header;
+        const uint32_t typeCount = indexRecord[1];
+        const uint32_t* pos = indexRecord + 2;
+        for (uint32_t i = 0; i < typeCount; i++) {
+            const uint32_t typeSpecOffset = pos[0];
+            const uint32_t entryCount = pos[1];
+            const uint32_t configCount = pos[2];
+            const uint32_t configIndexOffset = pos[3];
+            pos += 4;
+
+            Type* t = NULL;
+            if (typeSpecOffset != 0 || configCount != 0) {
+                t = new Type(header, package, entryCount);
+                if (typeSpecOffset != 0) {
+                    const ResTable_typeSpec* typeSpec =
+                        (const ResTable_typeSpec*)(tableBase + typeSpecOffset);
+                    t->typeSpecFlags = (const uint32_t*)(
+                            ((const uint8_t*)typeSpec) + dtohs(typeSpec->header.headerSize));
+                    t->typeSpec = typeSpec;
+                }
+                t->configs.setIndex(tableBase, pos, configCount);
+                if (configIndexOffset != 0 && !t->setConfigIndex(
+                        (const ResTable_configIndex*)(tableBase + configIndexOffset))) {
+                    ALOGW("ResTable_configIndex of type %d does not match its configs, "
+                          "ignoring it.", (int)(i + 1));
+                }
+            }
+            package->types.add(t);
+            pos += configCount;
+        }
+
+        if (group->typeCount == 0) {
+            group->typeCount = package->types.size();
+        }
+        return NO_ERROR;
+    }
     
     // Iterate through all chunks.
     size_t curPackage = 0;
@@ -5250,27 +6260,14 @@ status_t ResTable::parsePackage(const ResTable_package* const pkg,
                 return (mError=err);
             }
             
-            const size_t typeSpecSize = dtohl(typeSpec->header.size);
-            
             LOAD_TABLE_NOISY(printf("TypeSpec off %p: type=0x%x, headerSize=0x%x, size=%p\n",
                                     (void*)(base-(const uint8_t*)chunk),
                                     dtohs(typeSpec->header.type),
                                     dtohs(typeSpec->header.headerSize),
                                     (void*)typeSize));
-            // look for block overrun or int overflow when multiplying by 4
-            if ((dtohl(typeSpec->entryCount) > (INT32_MAX/sizeof(uint32_t))
-                    || dtohs(typeSpec->header.headerSize)+(sizeof(uint32_t)*dtohl(typeSpec->entryCount))
-                    > typeSpecSize)) {
-                ALOGW("ResTable_typeSpec entry index to %p extends beyond chunk end %p.",
-                     (void*)(dtohs(typeSpec->header.headerSize)
-                             +(sizeof(uint32_t)*dtohl(typeSpec->entryCount))),
-                     (void*)typeSpecSize);
-                return (mError=BAD_TYPE);
-            }
-            
-            if (typeSpec->id == 0) {
-                ALOGW("ResTable_type has an id of 0.");
-                return (mError=BAD_TYPE);
+            err = validate_type_spec(typeSpec);
+            if (err != NO_ERROR) {
+                return (mError=err);
             }
             
             while (package->types.size() < typeSpec->id) {
@@ -5297,30 +6294,14 @@ status_t ResTable::parsePackage(const ResTable_package* const pkg,
                 return (mError=err);
             }
             
-            const size_t typeSize = dtohl(type->header.size);
-            
             LOAD_TABLE_NOISY(printf("Type off %p: type=0x%x, headerSize=0x%x, size=%p\n",
                                     (void*)(base-(const uint8_t*)chunk),
                                     dtohs(type->header.type),
                                     dtohs(type->header.headerSize),
                                     (void*)typeSize));
-            if (dtohs(type->header.headerSize)+(sizeof(uint32_t)*dtohl(type->entryCount))
-                > typeSize) {
-                ALOGW("ResTable_type entry index to %p extends beyond chunk end %p.",
-                     (void*)(dtohs(type->header.headerSize)
-                             +(sizeof(uint32_t)*dtohl(type->entryCount))),
-                     (void*)typeSize);
-                return (mError=BAD_TYPE);
-            }
-            if (dtohl(type->entryCount) != 0
-                && dtohl(type->entriesStart) > (typeSize-sizeof(ResTable_entry))) {
-                ALOGW("ResTable_type entriesStart at %p extends beyond chunk end %p.",
-                     (void*)dtohl(type->entriesStart), (void*)typeSize);
-                return (mError=BAD_TYPE);
-            }
-            if (type->id == 0) {
-                ALOGW("ResTable_type has an id of 0.");
-                return (mError=BAD_TYPE);
+            err = validate_type(type);
+            if (err != NO_ERROR) {
+                return (mError=err);
             }
             
             while (package->types.size() < type->id) {
@@ -5342,6 +6323,24 @@ status_t ResTable::parsePackage(const ResTable_package* const pkg,
                 ALOGI("Adding config to type %d: %s\n",
                       type->id, thisConfig.toString().string()));
             t->configs.add(type);
+            // An index that precedes some configs doesn't cover them.
+            t->configIndex = NULL;
+        } else if (ctype == RES_TABLE_CONFIG_INDEX_TYPE) {
+            const ResTable_configIndex* configIndex = (const ResTable_configIndex*)(chunk);
+            err = validate_chunk(&configIndex->header, sizeof(*configIndex),
+                                 endPos, "ResTable_configIndex");
+            if (err != NO_ERROR) {
+                return (mError=err);
+            }
+
+            // The index is optional, it is ignored unless it matches the
+            // configs read so far.
+            Type* t = configIndex->id > 0 && configIndex->id <= package->types.size()
+                    ? package->types[configIndex->id-1] : NULL;
+            if (t == NULL || !t->setConfigIndex(configIndex)) {
+                ALOGW("ResTable_configIndex of type %d does not match its configs, "
+                      "ignoring it.", (int)configIndex->id);
+            }
         } else {
             status_t err = validate_chunk(chunk, sizeof(ResChunk_header),
                                           endPos, "ResTable_package:unknown");
@@ -5360,6 +6359,176 @@ status_t ResTable::parsePackage(const ResTable_package* const pkg,
     return NO_ERROR;
 }
 
+/*
+ * Resources of an overlay package hashed by type and name, so that each
+ * resource of the target package is matched in constant time.
+ */
+class IdmapOverlayIndex
+{
+public:
+    IdmapOverlayIndex() : mMask(0) { }
+
+    void add(const ResTable::resource_name& name, uint32_t resID)
+    {
+        Entry entry;
+        entry.type = name.type;
+        entry.typeLen = name.typeLen;
+        entry.name = name.name;
+        entry.nameLen = name.nameLen;
+        entry.hash = hashName(name.type, name.typeLen, name.name, name.nameLen);
+        entry.resID = resID;
+        mEntries.add(entry);
+    }
+
+    // Must be called once every resource is added
+    void build()
+    {
+        size_t size = 16;
+        while (size < mEntries.size() * 2) {
+            size <<= 1;
+        }
+        mMask = size - 1;
+        mSlots.insertAt((uint32_t)0, 0, size);
+        uint32_t* slots = mSlots.editArray();
+        for (size_t i = 0; i < mEntries.size(); i++) {
+            size_t slot = mEntries[i].hash & mMask;
+            while (slots[slot] != 0) {
+                slot = (slot + 1) & mMask;
+            }
+            slots[slot] = i + 1;
+        }
+    }
+
+    // Returns the ID of the overlay resource, or 0
+    uint32_t find(const ResTable::resource_name& name) const
+    {
+        if (mSlots.isEmpty()) {
+            return 0;
+        }
+        const uint32_t hash = hashName(name.type, name.typeLen, name.name, name.nameLen);
+        for (size_t slot = hash & mMask; mSlots[slot] != 0; slot = (slot + 1) & mMask) {
+            const Entry& entry = mEntries[mSlots[slot] - 1];
+            if (entry.hash == hash
+                    && strzcmp16(entry.type, entry.typeLen, name.type, name.typeLen) == 0
+                    && strzcmp16(entry.name, entry.nameLen, name.name, name.nameLen) == 0) {
+                return entry.resID;
+            }
+        }
+        return 0;
+    }
+
+private:
+    struct Entry
+    {
+        // Owned by the string pools of the overlay
+        const char16_t* type;
+        size_t typeLen;
+        const char16_t* name;
+        size_t nameLen;
+        uint32_t hash;
+        uint32_t resID;
+    };
+
+    static uint32_t hashName(const char16_t* type, size_t typeLen,
+            const char16_t* name, size_t nameLen)
+    {
+        return hashString(name, nameLen, hashString(type, typeLen));
+    }
+
+    Vector<Entry> mEntries;
+    // Index of the entry + 1, 0 for empty slots
+    Vector<uint32_t> mSlots;
+    size_t mMask;
+};
+
+/*
+ * Maps the resources of the types of the target package to the overlay. Any
+ * number of threads may call mapTypes(), each type is mapped by one of them.
+ */
+class IdmapTypeMapper
+{
+public:
+    IdmapTypeMapper(const ResTable& target, const IdmapOverlayIndex& index,
+            uint32_t pkgId, const size_t* entryCounts, size_t typeCount,
+            Vector<uint32_t>* outMaps)
+        : mTarget(target), mIndex(index), mPkgId(pkgId), mEntryCounts(entryCounts),
+          mTypeCount(typeCount), mMaps(outMaps), mNextType(0)
+    {
+    }
+
+    void mapTypes()
+    {
+        size_t typeIndex;
+        while ((typeIndex = android_atomic_inc(&mNextType)) < mTypeCount) {
+            mapType(typeIndex);
+        }
+    }
+
+private:
+    void mapType(size_t typeIndex)
+    {
+        Vector<uint32_t>& map = mMaps[typeIndex];
+        const size_t entryCount = mEntryCounts[typeIndex];
+        map.setCapacity(entryCount);
+        for (size_t entryIndex = 0; entryIndex < entryCount; ++entryIndex) {
+            uint32_t resID = mPkgId
+                | (0x00ff0000 & ((typeIndex+1)<<16))
+                | (0x0000ffff & (entryIndex));
+            ResTable::resource_name resName;
+            if (!mTarget.getResourceName(resID, false, &resName)) {
+                ALOGW("idmap: resource 0x%08x has spec but lacks values, skipping\n", resID);
+                // add dummy value, or trimming leading/trailing zeroes later will fail
+                map.push(0);
+                continue;
+            }
+
+            uint32_t overlayResID = mIndex.find(resName);
+            if (overlayResID != 0) {
+                overlayResID = mPkgId | (0x00ffffff & overlayResID);
+            }
+            map.push(overlayResID);
+        }
+    }
+
+    const ResTable& mTarget;
+    const IdmapOverlayIndex& mIndex;
+    const uint32_t mPkgId;
+    const size_t* const mEntryCounts;
+    const size_t mTypeCount;
+    Vector<uint32_t>* const mMaps;
+    volatile int32_t mNextType;
+};
+
+class IdmapTypeThread : public Thread
+{
+public:
+    IdmapTypeThread(IdmapTypeMapper* mapper) : Thread(false), mMapper(mapper)
+    {
+    }
+
+private:
+    virtual bool threadLoop()
+    {
+        mMapper->mapTypes();
+        return false;
+    }
+
+    IdmapTypeMapper* const mMapper;
+};
+
+// Types are mapped on one thread per CPU, up to 4
+static size_t idmapThreadCount(size_t typeCount)
+{
+    size_t count = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus > 1) {
+        count = cpus > 4 ? 4 : cpus;
+    }
+#endif
+    return typeCount < count ? typeCount : count;
+}
+
 status_t ResTable::createIdmap(const ResTable& overlay,
         uint32_t targetCrc, uint32_t overlayCrc,
         const char* targetPath, const char* overlayPath,
@@ -5384,54 +6553,66 @@ status_t ResTable::createIdmap(const ResTable& overlay,
     // starting size is header + first item (number of types in map)
     *outSize = (IDMAP_HEADER_SIZE + 1) * sizeof(uint32_t);
     // overlay packages are assumed to contain only one package group
-    const String16 overlayPackage(overlay.mPackageGroups[0]->packages[0]->package->name);
+    const PackageGroup* overlayGroup = overlay.mPackageGroups[0];
+    const Package* overlayPkg = overlayGroup->packages[0];
     const uint32_t pkg_id = pkg->package->id << 24;
 
-    for (size_t typeIndex = 0; typeIndex < typeCount; ++typeIndex) {
-        ssize_t first = -1;
-        ssize_t last = -1;
-        const Type* typeConfigs = pkg->getType(typeIndex);
-        ssize_t mapIndex = map.add();
-        if (mapIndex < 0) {
-            return NO_MEMORY;
+    // Index the names of the overlay resources once, instead of searching
+    // the overlay for the name of every target resource
+    IdmapOverlayIndex index;
+    for (size_t typeIndex = 0; typeIndex < overlayPkg->types.size(); ++typeIndex) {
+        const Type* typeConfigs = overlayPkg->getType(typeIndex);
+        if (typeConfigs == NULL) {
+            continue;
         }
-        Vector<uint32_t>& vector = map.editItemAt(mapIndex);
         for (size_t entryIndex = 0; entryIndex < typeConfigs->entryCount; ++entryIndex) {
-            uint32_t resID = pkg_id
-                | (0x00ff0000 & ((typeIndex+1)<<16))
-                | (0x0000ffff & (entryIndex));
+            const uint32_t resID = Res_MAKEID(overlayGroup->id - 1, typeIndex, entryIndex);
             resource_name resName;
-            if (!this->getResourceName(resID, false, &resName)) {
-                ALOGW("idmap: resource 0x%08x has spec but lacks values, skipping\n", resID);
-                // add dummy value, or trimming leading/trailing zeroes later will fail
-                vector.push(0);
-                continue;
+            if (overlay.getResourceName(resID, false, &resName)) {
+                index.add(resName, resID);
             }
+        }
+    }
+    index.build();
 
-            const String16 overlayType(resName.type, resName.typeLen);
-            const String16 overlayName(resName.name, resName.nameLen);
-            uint32_t overlayResID = overlay.identifierForName(overlayName.string(),
-                                                              overlayName.size(),
-                                                              overlayType.string(),
-                                                              overlayType.size(),
-                                                              overlayPackage.string(),
-                                                              overlayPackage.size());
-            if (overlayResID != 0) {
-                overlayResID = pkg_id | (0x00ffffff & overlayResID);
-                last = Res_GETENTRY(resID);
+    // Types are mapped independently
+    if (map.insertAt(0, typeCount) < 0) {
+        return NO_MEMORY;
+    }
+    Vector<uint32_t>* vectors = map.editArray();
+    Vector<size_t> entryCounts;
+    entryCounts.setCapacity(typeCount);
+    for (size_t typeIndex = 0; typeIndex < typeCount; ++typeIndex) {
+        entryCounts.push(pkg->getType(typeIndex)->entryCount);
+    }
+
+    // The calling thread maps types too, along with the extra threads that
+    // could be started
+    IdmapTypeMapper mapper(*this, index, pkg_id, entryCounts.array(), typeCount, vectors);
+    Vector<sp<Thread> > threads;
+    const size_t threadCount = idmapThreadCount(typeCount);
+    for (size_t i = 1; i < threadCount; ++i) {
+        sp<Thread> thread = new IdmapTypeThread(&mapper);
+        if (thread->run("idmap", PRIORITY_DEFAULT) == NO_ERROR) {
+            threads.push(thread);
+        }
+    }
+    mapper.mapTypes();
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i]->join();
+    }
+
+    for (size_t typeIndex = 0; typeIndex < typeCount; ++typeIndex) {
+        Vector<uint32_t>& vector = vectors[typeIndex];
+        ssize_t first = -1;
+        ssize_t last = -1;
+        for (size_t entryIndex = 0; entryIndex < vector.size(); ++entryIndex) {
+            if (vector[entryIndex] != 0) {
+                last = entryIndex;
                 if (first == -1) {
-                    first = Res_GETENTRY(resID);
+                    first = entryIndex;
                 }
             }
-            vector.push(overlayResID);
-#if 0
-            if (overlayResID != 0) {
-                ALOGD("%s/%s 0x%08x -> 0x%08x\n",
-                     String8(String16(resName.type)).string(),
-                     String8(String16(resName.name)).string(),
-                     resID, overlayResID);
-            }
-#endif
         }
 
         if (first != -1) {
@@ -5536,6 +6717,103 @@ bool ResTable::getIdmapInfo(const void* idmap, size_t sizeBytes,
     return true;
 }
 
+status_t ResTable::createTableIndex(size_t index, uint32_t tableCrc,
+        void** outData, size_t* outSize) const
+{
+    if (index >= mHeaders.size()) {
+        return BAD_INDEX;
+    }
+    const Header* header = mHeaders[index];
+    const uint8_t* const base = (const uint8_t*)header->header;
+
+    // Collect the packages of the table in the order of their chunks.
+    Vector<const Package*> packages;
+    for (size_t i = 0; i < mPackageGroups.size(); i++) {
+        const PackageGroup* group = mPackageGroups[i];
+        for (size_t j = 0; j < group->packages.size(); j++) {
+            const Package* package = group->packages[j];
+            if (package->header != header) {
+                continue;
+            }
+            size_t pos = packages.size();
+            while (pos > 0 && packages[pos-1]->package > package->package) {
+                pos--;
+            }
+            packages.insertAt(package, pos);
+        }
+    }
+    if (packages.size() != dtohl(header->header->packageCount)) {
+        ALOGW("table index: resource table %d was not fully loaded\n", (int)index);
+        return UNKNOWN_ERROR;
+    }
+
+    size_t size = TABLE_INDEX_HEADER_SIZE;
+    for (size_t i = 0; i < packages.size(); i++) {
+        const Package* package = packages[i];
+        size += 2;
+        for (size_t t = 0; t < package->types.size(); t++) {
+            const Type* type = package->types[t];
+            size += 4 + (type != NULL ? type->configs.size() : 0);
+        }
+    }
+
+    uint32_t* data = (uint32_t*)malloc(size * sizeof(uint32_t));
+    if (data == NULL) {
+        return NO_MEMORY;
+    }
+    *outData = data;
+    *outSize = size * sizeof(uint32_t);
+
+    *data++ = TABLE_INDEX_MAGIC;
+    *data++ = TABLE_INDEX_VERSION;
+    *data++ = tableCrc;
+    *data++ = header->size;
+    *data++ = packages.size();
+    for (size_t i = 0; i < packages.size(); i++) {
+        const Package* package = packages[i];
+        *data++ = ((const uint8_t*)package->package) - base;
+        *data++ = package->types.size();
+        for (size_t t = 0; t < package->types.size(); t++) {
+            const Type* type = package->types[t];
+            if (type == NULL) {
+                *data++ = 0;
+                *data++ = 0;
+                *data++ = 0;
+                *data++ = 0;
+                continue;
+            }
+            *data++ = type->typeSpec != NULL ? ((const uint8_t*)type->typeSpec) - base : 0;
+            *data++ = type->entryCount;
+            *data++ = type->configs.size();
+            *data++ = type->configIndex != NULL
+                    ? ((const uint8_t*)type->configIndex) - base : 0;
+            for (size_t c = 0; c < type->configs.size(); c++) {
+                *data++ = ((const uint8_t*)type->configs[c]) - base;
+            }
+        }
+    }
+
+    return NO_ERROR;
+}
+
+bool ResTable::getTableIndexInfo(const void* tableIndex, size_t size, uint32_t* pTableCrc)
+{
+    const uint32_t* index = (const uint32_t*)tableIndex;
+    if (size < TABLE_INDEX_HEADER_SIZE * sizeof(uint32_t)
+            || index[0] != TABLE_INDEX_MAGIC || index[1] != TABLE_INDEX_VERSION) {
+        return false;
+    }
+    if (pTableCrc) {
+        *pTableCrc = index[2];
+    }
+    return true;
+}
+
+bool ResTable::isTableIndexed(size_t index) const
+{
+    return index < mHeaders.size() && mHeaders[index]->tableIndex != NULL;
+}
+
 
 #define CHAR16_TO_CSTR(c16, len) (String8(String16(c16,len)).string())
 
@@ -25,6 +25,7 @@
 #include <assert.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 
 /*
  * TEMP_FAILURE_RETRY is defined by some, but not all, versions of
@@ -43,6 +44,11 @@
 
 static inline size_t min_of(size_t a, size_t b) { return (a < b) ? a : b; }
 
+// Saved inflate states are about 40KB each, at most MAX_CHECKPOINTS are kept
+// per stream and they are at least MIN_CHECKPOINT_INTERVAL bytes of output apart
+#define MAX_CHECKPOINTS 16
+#define MIN_CHECKPOINT_INTERVAL (512 * 1024)
+
 using namespace android;
 
 /*
@@ -56,12 +62,15 @@ StreamingZipInflater::StreamingZipInflater(int fd, off64_t compDataStart,
     mOutTotalSize = uncompSize;
     mInTotalSize = compSize;
 
-    mInBufSize = StreamingZipInflater::INPUT_CHUNK_SIZE;
+    // the input buffer grows as the stream is read, see readNextChunk()
+    mInBufSize = min_of(StreamingZipInflater::INPUT_CHUNK_SIZE, compSize);
     mInBuf = new uint8_t[mInBufSize];
 
     mOutBufSize = StreamingZipInflater::OUTPUT_CHUNK_SIZE;
     mOutBuf = new uint8_t[mOutBufSize];
 
+    mCheckpointInterval = 0;
+
     initInflateState();
 }
 
@@ -80,12 +89,18 @@ StreamingZipInflater::StreamingZipInflater(FileMap* dataMap, size_t uncompSize)
     mOutBufSize = StreamingZipInflater::OUTPUT_CHUNK_SIZE;
     mOutBuf = new uint8_t[mOutBufSize];
 
+    mCheckpointInterval = 0;
+
+    // the data is mostly read in order, let the kernel read ahead
+    dataMap->advise(FileMap::SEQUENTIAL);
+
     initInflateState();
 }
 
 StreamingZipInflater::~StreamingZipInflater() {
     // tear down the in-flight zip state just in case
     ::inflateEnd(&mInflateState);
+    clearCheckpoints();
 
     if (mDataMap == NULL) {
         delete [] mInBuf;
@@ -179,6 +194,7 @@ ssize_t StreamingZipInflater::read(void* outBuf, size_t count) {
                 result = inflateInit2(&mInflateState, -MAX_WBITS);
                 mStreamNeedsInit = false;
             }
+            if (result == Z_OK && mCheckpointInterval > 0) saveCheckpoint();
             if (result == Z_OK) result = ::inflate(&mInflateState, Z_SYNC_FLUSH);
             if (result < 0) {
                 // Whoops, inflation failed
@@ -206,6 +222,14 @@ int StreamingZipInflater::readNextChunk() {
     assert(mDataMap == NULL);
 
     if (mInNextChunkOffset < mInTotalSize) {
+        // the input buffer is drained at this point: grow it when the stream
+        // is read further than a couple of chunks, to issue fewer reads
+        if (mInBufSize < MAX_INPUT_CHUNK_SIZE && mInNextChunkOffset >= 2 * mInBufSize) {
+            delete [] mInBuf;
+            mInBufSize = min_of(2 * mInBufSize, MAX_INPUT_CHUNK_SIZE);
+            mInBuf = new uint8_t[mInBufSize];
+        }
+
         size_t toRead = min_of(mInBufSize, mInTotalSize - mInNextChunkOffset);
         if (toRead > 0) {
             ssize_t didRead = TEMP_FAILURE_RETRY(::read(mFd, mInBuf, toRead));
@@ -217,23 +241,130 @@ int StreamingZipInflater::readNextChunk() {
                 mInNextChunkOffset += didRead;
                 mInflateState.next_in = (Bytef*) mInBuf;
                 mInflateState.avail_in = didRead;
+
+#if defined(POSIX_FADV_WILLNEED)
+                // start reading the next chunk while this one is inflated
+                if (mInNextChunkOffset < mInTotalSize) {
+                    posix_fadvise(mFd, mInFileStart + mInNextChunkOffset,
+                            min_of(mInBufSize, mInTotalSize - mInNextChunkOffset),
+                            POSIX_FADV_WILLNEED);
+                }
+#endif
             }
         }
     }
     return 0;
 }
 
-// seeking backwards requires uncompressing fom the beginning, so is very
-// expensive.  seeking forwards only requires uncompressing from the current
-// position to the destination.
+// Number of compressed bytes consumed by the z_stream so far
+size_t StreamingZipInflater::inputConsumed() const {
+    if (mDataMap == NULL) {
+        return mInNextChunkOffset - mInflateState.avail_in;
+    }
+    return mInBufSize - mInflateState.avail_in;
+}
+
+/*
+ * Save the inflate state when the stream is far enough from the last saved
+ * state.  Only called before inflating, when the output buffer is drained:
+ * exactly mOutCurPosition bytes have been produced at this point.
+ */
+void StreamingZipInflater::saveCheckpoint() {
+    const off64_t lastPosition = mCheckpoints.isEmpty() ? 0 : mCheckpoints.top().outPosition;
+    if (mOutCurPosition < lastPosition + (off64_t) mCheckpointInterval) {
+        return;
+    }
+
+    Checkpoint checkpoint;
+    checkpoint.state = new z_stream;
+    if (inflateCopy(checkpoint.state, &mInflateState) != Z_OK) {
+        delete checkpoint.state;
+        return;
+    }
+    checkpoint.outPosition = mOutCurPosition;
+    checkpoint.inOffset = inputConsumed();
+    mCheckpoints.add(checkpoint);
+
+    ALOGV("Saved inflate state at %lld", (long long) mOutCurPosition);
+}
+
+/*
+ * Resume inflating from the last saved state before the given position.
+ * Returns false if there is no such state.
+ */
+bool StreamingZipInflater::restoreCheckpoint(off64_t absoluteInputPosition) {
+    ssize_t found = -1;
+    for (size_t i = 0; i < mCheckpoints.size(); i++) {
+        if (mCheckpoints[i].outPosition > absoluteInputPosition) break;
+        found = i;
+    }
+    if (found < 0) {
+        return false;
+    }
+
+    const Checkpoint& checkpoint = mCheckpoints[found];
+    if (!mStreamNeedsInit) {
+        ::inflateEnd(&mInflateState);
+    }
+    if (inflateCopy(&mInflateState, checkpoint.state) != Z_OK) {
+        initInflateState();
+        return false;
+    }
+    mStreamNeedsInit = false;
+
+    mInflateState.next_out = (Bytef*) mOutBuf;
+    mInflateState.avail_out = mOutBufSize;
+    mOutLastDecoded = mOutDeliverable = 0;
+    mOutCurPosition = checkpoint.outPosition;
+
+    if (mDataMap == NULL) {
+        ::lseek(mFd, mInFileStart + checkpoint.inOffset, SEEK_SET);
+        mInNextChunkOffset = checkpoint.inOffset;
+        mInflateState.next_in = (Bytef*) mInBuf;
+        mInflateState.avail_in = 0; // set when a chunk is read in
+    } else {
+        mInflateState.next_in = (Bytef*) mInBuf + checkpoint.inOffset;
+        mInflateState.avail_in = mInBufSize - checkpoint.inOffset;
+    }
+
+    ALOGV("Restored inflate state at %lld", (long long) mOutCurPosition);
+    return true;
+}
+
+void StreamingZipInflater::clearCheckpoints() {
+    for (size_t i = 0; i < mCheckpoints.size(); i++) {
+        ::inflateEnd(mCheckpoints[i].state);
+        delete mCheckpoints[i].state;
+    }
+    mCheckpoints.clear();
+}
+
 off64_t StreamingZipInflater::seekAbsolute(off64_t absoluteInputPosition) {
     if (absoluteInputPosition < mOutCurPosition) {
-        // rewind and reprocess the data from the beginning
-        if (!mStreamNeedsInit) {
-            ::inflateEnd(&mInflateState);
+        // the start of the output buffer lies mOutDeliverable bytes back
+        const off64_t outBufPosition = mOutCurPosition - mOutDeliverable;
+        if (absoluteInputPosition >= outBufPosition) {
+            mOutDeliverable = absoluteInputPosition - outBufPosition;
+            mOutCurPosition = absoluteInputPosition;
+            return absoluteInputPosition;
         }
-        initInflateState();
-        read(NULL, absoluteInputPosition);
+
+        // the stream is seeked around, save inflate states from now on
+        if (mCheckpointInterval == 0) {
+            mCheckpointInterval = mOutTotalSize / MAX_CHECKPOINTS;
+            if (mCheckpointInterval < MIN_CHECKPOINT_INTERVAL) {
+                mCheckpointInterval = MIN_CHECKPOINT_INTERVAL;
+            }
+        }
+
+        if (!restoreCheckpoint(absoluteInputPosition)) {
+            // rewind and reprocess the data from the beginning
+            if (!mStreamNeedsInit) {
+                ::inflateEnd(&mInflateState);
+            }
+            initInflateState();
+        }
+        read(NULL, absoluteInputPosition - mOutCurPosition);
     } else if (absoluteInputPosition > mOutCurPosition) {
         read(NULL, absoluteInputPosition - mOutCurPosition);
     }
@@ -24,15 +24,18 @@
 #include <utils/Compat.h>
 #include <utils/misc.h>
 #include <utils/threads.h>
+#include <utils/Vector.h>
 #include <ziparchive/zip_archive.h>
 
 #include <zlib.h>
 
 #include <string.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <errno.h>
 #include <assert.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 /*
  * We must open binary files using open(path, ... | O_BINARY) under Windows.
@@ -44,6 +47,73 @@
 
 using namespace android;
 
+/*
+ * Index of the entries of an archive, written next to the other cached
+ * files of a package by ZipFileRO::open(zipFileName, indexFileName).
+ *
+ * The header is followed by "hashSize" slots, each holding 1 + the index
+ * of a record or 0 when empty, then by "entryCount" records and finally by
+ * the entry names.  The index is only ever read on the device that wrote
+ * it, all the fields are in host byte order.
+ */
+#define ZIP_INDEX_MAGIC     0x78647a61      // 'azdx'
+#define ZIP_INDEX_VERSION   1
+
+struct ZipIndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    // Identify the archive the index was built from
+    uint64_t zipSize;
+    uint64_t zipModTime;
+    uint64_t zipInode;
+    uint32_t entryCount;
+    // Power of two, larger than entryCount
+    uint32_t hashSize;
+};
+
+struct ZipIndexRecord {
+    // Offset of the name from the start of the index
+    uint32_t nameOffset;
+    uint16_t nameLength;
+    uint16_t method;
+    uint32_t modTime;
+    uint32_t crc32;
+    uint32_t compressedLength;
+    uint32_t uncompressedLength;
+    uint64_t offset;
+};
+
+static uint32_t hashEntryName(const char* name, size_t length)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t) name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool isValidIndex(const FileMap* map, const struct stat& zipStat)
+{
+    const ZipIndexHeader* header = (const ZipIndexHeader*) map->getDataPtr();
+    if (header->magic != ZIP_INDEX_MAGIC || header->version != ZIP_INDEX_VERSION) {
+        return false;
+    }
+    if (header->zipSize != (uint64_t) zipStat.st_size
+            || header->zipModTime != (uint64_t) zipStat.st_mtime
+            || header->zipInode != (uint64_t) zipStat.st_ino) {
+        return false;
+    }
+
+    const uint32_t hashSize = header->hashSize;
+    if (hashSize < 2 || (hashSize & (hashSize - 1)) != 0 || header->entryCount >= hashSize) {
+        return false;
+    }
+    const uint64_t recordsEnd = sizeof(ZipIndexHeader) + (uint64_t) hashSize * sizeof(uint32_t)
+            + (uint64_t) header->entryCount * sizeof(ZipIndexRecord);
+    return recordsEnd <= map->getDataLength();
+}
+
 class _ZipEntryRO {
 public:
     ZipEntry entry;
@@ -59,7 +129,15 @@ private:
 };
 
 ZipFileRO::~ZipFileRO() {
-    CloseArchive(mHandle);
+    if (mHandle != NULL) {
+        CloseArchive(mHandle);
+    }
+    if (mFd >= 0) {
+        close(mFd);
+    }
+    if (mIndexMap != NULL) {
+        mIndexMap->release();
+    }
     free(mFileName);
 }
 
@@ -79,14 +157,258 @@ ZipFileRO::~ZipFileRO() {
     return new ZipFileRO(handle, strdup(zipFileName));
 }
 
+/*
+ * Open the specified file read-only, reading the entries from an index
+ * when it matches the file.  Otherwise the central directory is read as
+ * usual and the index is rewritten.
+ */
+/* static */ ZipFileRO* ZipFileRO::open(const char* zipFileName, const char* indexFileName)
+{
+    int fd = TEMP_FAILURE_RETRY(::open(zipFileName, O_RDONLY | O_BINARY));
+    if (fd < 0) {
+        return open(zipFileName);
+    }
+
+    FileMap* indexMap = openIndex(indexFileName, fd);
+    if (indexMap != NULL) {
+        ALOGV("Using index %s for %s", indexFileName, zipFileName);
+        ZipFileRO* zip = new ZipFileRO(NULL, strdup(zipFileName));
+        zip->mFd = fd;
+        zip->mIndexMap = indexMap;
+        return zip;
+    }
+
+    ZipFileRO* zip = open(zipFileName);
+    if (zip != NULL) {
+        writeIndex(zip->mHandle, indexFileName, fd);
+    }
+    close(fd);
+    return zip;
+}
+
+/* static */ FileMap* ZipFileRO::openIndex(const char* indexFileName, int zipFd)
+{
+    struct stat zipStat;
+    if (fstat(zipFd, &zipStat) != 0) {
+        return NULL;
+    }
+
+    int fd = TEMP_FAILURE_RETRY(::open(indexFileName, O_RDONLY | O_BINARY));
+    if (fd < 0) {
+        return NULL;
+    }
+
+    FileMap* map = NULL;
+    struct stat indexStat;
+    if (fstat(fd, &indexStat) == 0 && indexStat.st_size >= (off_t) sizeof(ZipIndexHeader)) {
+        map = new FileMap();
+        if (!map->create(indexFileName, fd, 0, indexStat.st_size, true)) {
+            map->release();
+            map = NULL;
+        }
+    }
+    close(fd);
+
+    if (map != NULL && !isValidIndex(map, zipStat)) {
+        ALOGV("Ignoring stale index %s", indexFileName);
+        map->release();
+        map = NULL;
+    }
+    return map;
+}
+
+/*
+ * Build the index of the archive and write it to "indexFileName".  Only
+ * the processes allowed to write to the directory of the index create it.
+ */
+/* static */ void ZipFileRO::writeIndex(ZipArchiveHandle handle, const char* indexFileName,
+    int zipFd)
+{
+    struct stat zipStat;
+    if (fstat(zipFd, &zipStat) != 0) {
+        return;
+    }
+
+    void* cookie;
+    if (StartIteration(handle, &cookie, NULL /* prefix */) != 0) {
+        return;
+    }
+
+    Vector<ZipIndexRecord> records;
+    Vector<char> names;
+    ZipEntry entry;
+    ZipEntryName name;
+    int32_t error;
+    while ((error = Next(cookie, &entry, &name)) == 0) {
+        ZipIndexRecord record;
+        // Relative to the start of the names until the layout is known
+        record.nameOffset = names.size();
+        record.nameLength = name.name_length;
+        record.method = entry.method;
+        record.modTime = entry.mod_time;
+        record.crc32 = entry.crc32;
+        record.compressedLength = entry.compressed_length;
+        record.uncompressedLength = entry.uncompressed_length;
+        record.offset = entry.offset;
+        records.add(record);
+        names.appendArray(name.name, name.name_length);
+    }
+    if (error != -1) {
+        return;
+    }
+
+    uint32_t hashSize = 16;
+    while (hashSize < records.size() * 2) {
+        hashSize <<= 1;
+    }
+    const size_t namesOffset = sizeof(ZipIndexHeader) + hashSize * sizeof(uint32_t)
+            + records.size() * sizeof(ZipIndexRecord);
+    const size_t size = namesOffset + names.size();
+    if (size != (uint32_t) size) {
+        return;
+    }
+
+    uint8_t* data = (uint8_t*) calloc(1, size);
+    if (data == NULL) {
+        return;
+    }
+
+    ZipIndexHeader* header = (ZipIndexHeader*) data;
+    header->magic = ZIP_INDEX_MAGIC;
+    header->version = ZIP_INDEX_VERSION;
+    header->zipSize = zipStat.st_size;
+    header->zipModTime = zipStat.st_mtime;
+    header->zipInode = zipStat.st_ino;
+    header->entryCount = records.size();
+    header->hashSize = hashSize;
+
+    memcpy(data + namesOffset, names.array(), names.size());
+
+    uint32_t* slots = (uint32_t*) (data + sizeof(ZipIndexHeader));
+    ZipIndexRecord* outRecords = (ZipIndexRecord*) (slots + hashSize);
+    const uint32_t mask = hashSize - 1;
+    for (size_t i = 0; i < records.size(); i++) {
+        ZipIndexRecord& record = outRecords[i];
+        record = records[i];
+        record.nameOffset += namesOffset;
+
+        const char* recordName = (const char*) data + record.nameOffset;
+        uint32_t slot = hashEntryName(recordName, record.nameLength) & mask;
+        while (slots[slot] != 0) {
+            // Keep the first of duplicate entries, like the central directory lookup
+            const ZipIndexRecord& other = outRecords[slots[slot] - 1];
+            if (other.nameLength == record.nameLength && memcmp(data + other.nameOffset,
+                    recordName, record.nameLength) == 0) {
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+        if (slots[slot] == 0) {
+            slots[slot] = i + 1;
+        }
+    }
+
+    // Write to a temporary file first so that other processes never map
+    // a partially written index.
+    char tmpFileName[PATH_MAX];
+    snprintf(tmpFileName, sizeof(tmpFileName), "%s.%d", indexFileName, getpid());
+    int fd = TEMP_FAILURE_RETRY(::open(tmpFileName, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY,
+            0644));
+    if (fd < 0) {
+        ALOGV("Could not create index %s: %s", tmpFileName, strerror(errno));
+        free(data);
+        return;
+    }
+
+    const uint8_t* pos = data;
+    size_t remaining = size;
+    while (remaining > 0) {
+        ssize_t written = TEMP_FAILURE_RETRY(write(fd, pos, remaining));
+        if (written <= 0) {
+            break;
+        }
+        pos += written;
+        remaining -= written;
+    }
+    close(fd);
+    free(data);
+
+    if (remaining != 0 || rename(tmpFileName, indexFileName) != 0) {
+        ALOGW("Could not write index %s: %s", indexFileName, strerror(errno));
+        unlink(tmpFileName);
+    }
+}
+
+/*
+ * Return the handle of the archive, opening it when the entries were read
+ * from an index.
+ */
+ZipArchiveHandle ZipFileRO::getHandle() const
+{
+    AutoMutex _l(mHandleLock);
+    if (mHandle == NULL) {
+        ZipArchiveHandle handle;
+        const int32_t error = OpenArchive(mFileName, &handle);
+        if (error) {
+            ALOGW("Error opening archive %s: %s", mFileName, ErrorCodeString(error));
+            CloseArchive(handle);
+            return NULL;
+        }
+        mHandle = handle;
+    }
+    return mHandle;
+}
+
+bool ZipFileRO::findIndexedEntry(const char* entryName, ZipEntry* outEntry) const
+{
+    const uint8_t* base = (const uint8_t*) mIndexMap->getDataPtr();
+    const size_t size = mIndexMap->getDataLength();
+    const ZipIndexHeader* header = (const ZipIndexHeader*) base;
+    const uint32_t* slots = (const uint32_t*) (base + sizeof(ZipIndexHeader));
+    const ZipIndexRecord* records = (const ZipIndexRecord*) (slots + header->hashSize);
+
+    const size_t nameLength = strlen(entryName);
+    const uint32_t mask = header->hashSize - 1;
+    uint32_t slot = hashEntryName(entryName, nameLength) & mask;
+    // There is always an empty slot since entryCount < hashSize
+    while (slots[slot] != 0) {
+        if (slots[slot] > header->entryCount) {
+            ALOGW("Corrupt index for %s", mFileName);
+            return false;
+        }
+
+        const ZipIndexRecord& record = records[slots[slot] - 1];
+        if (record.nameLength == nameLength && record.nameOffset <= size
+                && nameLength <= size - record.nameOffset
+                && memcmp(base + record.nameOffset, entryName, nameLength) == 0) {
+            outEntry->method = record.method;
+            outEntry->mod_time = record.modTime;
+            outEntry->crc32 = record.crc32;
+            outEntry->compressed_length = record.compressedLength;
+            outEntry->uncompressed_length = record.uncompressedLength;
+            outEntry->offset = record.offset;
+            return true;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return false;
+}
+
 
 ZipEntryRO ZipFileRO::findEntryByName(const char* entryName) const
 {
     _ZipEntryRO* data = new _ZipEntryRO;
-    const int32_t error = FindEntry(mHandle, entryName, &(data->entry));
-    if (error) {
-        delete data;
-        return NULL;
+    if (mIndexMap != NULL) {
+        if (!findIndexedEntry(entryName, &(data->entry))) {
+            delete data;
+            return NULL;
+        }
+    } else {
+        const int32_t error = FindEntry(mHandle, entryName, &(data->entry));
+        if (error) {
+            delete data;
+            return NULL;
+        }
     }
 
     data->name.name = entryName;
@@ -131,8 +453,13 @@ bool ZipFileRO::getEntryInfo(ZipEntryRO entry, int* pMethod, size_t* pUncompLen,
 
 bool ZipFileRO::startIteration(void** cookie)
 {
+    ZipArchiveHandle handle = getHandle();
+    if (handle == NULL) {
+        return false;
+    }
+
     _ZipEntryRO* ze = new _ZipEntryRO;
-    int32_t error = StartIteration(mHandle, &(ze->cookie), NULL /* prefix */);
+    int32_t error = StartIteration(handle, &(ze->cookie), NULL /* prefix */);
     if (error) {
         ALOGW("Could not start iteration over %s: %s", mFileName, ErrorCodeString(error));
         delete ze;
@@ -194,7 +521,7 @@ FileMap* ZipFileRO::createEntryFileMap(ZipEntryRO entry) const
 {
     const _ZipEntryRO *zipEntry = reinterpret_cast<_ZipEntryRO*>(entry);
     const ZipEntry& ze = zipEntry->entry;
-    int fd = GetFileDescriptor(mHandle);
+    int fd = mFd >= 0 ? mFd : GetFileDescriptor(mHandle);
     size_t actualLen = 0;
 
     if (ze.method == kCompressStored) {
@@ -220,8 +547,13 @@ FileMap* ZipFileRO::createEntryFileMap(ZipEntryRO entry) const
  */
 bool ZipFileRO::uncompressEntry(ZipEntryRO entry, void* buffer, size_t size) const
 {
+    ZipArchiveHandle handle = getHandle();
+    if (handle == NULL) {
+        return false;
+    }
+
     _ZipEntryRO *zipEntry = reinterpret_cast<_ZipEntryRO*>(entry);
-    const int32_t error = ExtractToMemory(mHandle, &(zipEntry->entry),
+    const int32_t error = ExtractToMemory(handle, &(zipEntry->entry),
         (uint8_t*) buffer, size);
     if (error) {
         ALOGW("ExtractToMemory failed with %s", ErrorCodeString(error));
@@ -238,8 +570,13 @@ bool ZipFileRO::uncompressEntry(ZipEntryRO entry, void* buffer, size_t size) con
  */
 bool ZipFileRO::uncompressEntry(ZipEntryRO entry, int fd) const
 {
+    ZipArchiveHandle handle = getHandle();
+    if (handle == NULL) {
+        return false;
+    }
+
     _ZipEntryRO *zipEntry = reinterpret_cast<_ZipEntryRO*>(entry);
-    const int32_t error = ExtractEntryToFile(mHandle, &(zipEntry->entry), fd);
+    const int32_t error = ExtractEntryToFile(handle, &(zipEntry->entry), fd);
     if (error) {
         ALOGW("ExtractToMemory failed with %s", ErrorCodeString(error));
         return false;
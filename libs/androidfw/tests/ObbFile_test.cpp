@@ -99,4 +99,31 @@ TEST_F(ObbFileTest, WriteThenRead) {
             << "salts should be the same";
 }
 
+TEST_F(ObbFileTest, WriteThenReadKdf) {
+    const char* packageName = "com.example.obbfile";
+    const int32_t rounds = 200000;
+
+    mObbFile->setPackageName(String8(packageName));
+    mObbFile->setVersion(1);
+    EXPECT_TRUE(mObbFile->setKdf(OBB_KDF_SHA256, rounds))
+            << "KDF should be successfully set";
+    EXPECT_FALSE(mObbFile->setKdf(OBB_KDF_SHA256, 0))
+            << "KDF with no rounds should be refused";
+
+    EXPECT_TRUE(mObbFile->writeTo(mFileName))
+            << "couldn't write to fake .obb file";
+
+    mObbFile = new ObbFile();
+
+    EXPECT_TRUE(mObbFile->readFrom(mFileName))
+            << "couldn't read from fake .obb file";
+
+    EXPECT_STREQ(packageName, mObbFile->getPackageName().string())
+            << "package name didn't come out the same as it went in";
+    EXPECT_EQ(OBB_KDF_SHA256, mObbFile->getKdfDigest())
+            << "KDF digest didn't come out the same as it went in";
+    EXPECT_EQ(rounds, mObbFile->getKdfRounds())
+            << "KDF rounds didn't come out the same as it went in";
+}
+
 }
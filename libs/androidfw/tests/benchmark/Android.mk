@@ -0,0 +1,16 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    ResourceBenchmark.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+    libandroidfw \
+    libcutils \
+    liblog \
+    libutils
+
+LOCAL_MODULE:= resbench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
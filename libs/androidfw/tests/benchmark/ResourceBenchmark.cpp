@@ -0,0 +1,420 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures the resource lookups made while an application inflates its UI,
+ * against the resources of a real package such as framework-res.apk:
+ *
+ *   resbench <apk> [thread count] [iteration count]
+ *
+ * Every benchmark runs on a single thread, then on the given number of
+ * threads at the same time (4 by default), sharing the same ResTable and
+ * ZipFileRO. The time per operation is the wall time of each thread divided
+ * by the operations it ran, the throughput is for all the threads together.
+ */
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <androidfw/Asset.h>
+#include <androidfw/AssetManager.h>
+#include <androidfw/ResourceTypes.h>
+#include <androidfw/ZipFileRO.h>
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+using namespace android;
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+#define DEFAULT_THREAD_COUNT 4
+#define DEFAULT_ITERATION_COUNT 20
+
+// Consecutive missing entries after which a type is considered complete, and
+// consecutive empty types after which a package is
+#define MAX_MISSING_ENTRIES 64
+#define MAX_MISSING_TYPES 8
+
+///////////////////////////////////////////////////////////////////////////////
+// Data set
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Everything the benchmarks look up, collected from the package beforehand.
+ */
+struct DataSet {
+    DataSet(): res(NULL), zip(NULL), iterations(0) {
+    }
+
+    ~DataSet() {
+        for (size_t i = 0; i < xmlFiles.size(); i++) {
+            delete xmlFiles[i];
+        }
+        delete zip;
+    }
+
+    AssetManager assets;
+    const ResTable* res;
+    ZipFileRO* zip;
+    size_t iterations;
+
+    Vector<uint32_t> resIds;
+    Vector<uint32_t> styleIds;
+    Vector<uint32_t> attrIds;
+    Vector<String8> entryNames;
+    Vector<ResXMLTree*> xmlFiles;
+};
+
+static String8 typeName(const ResTable::resource_name& name) {
+    return name.type8 ? String8(name.type8, name.typeLen) : String8(name.type, name.typeLen);
+}
+
+static void collectResources(DataSet* data) {
+    const ResTable& res = *data->res;
+    for (size_t p = 0; p < res.getBasePackageCount(); p++) {
+        const uint32_t packageId = res.getBasePackageId(p);
+        size_t missingTypes = 0;
+        for (uint32_t t = 0; t < 0xff && missingTypes < MAX_MISSING_TYPES; t++) {
+            size_t count = 0;
+            size_t missingEntries = 0;
+            for (uint32_t e = 0; e < 0x10000 && missingEntries < MAX_MISSING_ENTRIES; e++) {
+                const uint32_t resId = Res_MAKEID(packageId - 1, t, e);
+                ResTable::resource_name name;
+                if (!res.getResourceName(resId, true, &name)) {
+                    missingEntries++;
+                    continue;
+                }
+                missingEntries = 0;
+                count++;
+
+                data->resIds.add(resId);
+                const String8 type(typeName(name));
+                if (type == "style") {
+                    data->styleIds.add(resId);
+                } else if (type == "attr") {
+                    data->attrIds.add(resId);
+                }
+            }
+            missingTypes = count > 0 ? 0 : missingTypes + 1;
+        }
+    }
+}
+
+static bool collectEntries(DataSet* data, const char* path) {
+    data->zip = ZipFileRO::open(path);
+    if (data->zip == NULL) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return false;
+    }
+
+    void* cookie;
+    if (!data->zip->startIteration(&cookie)) {
+        return false;
+    }
+    ZipEntryRO entry;
+    char name[PATH_MAX];
+    while ((entry = data->zip->nextEntry(cookie)) != NULL) {
+        if (data->zip->getEntryFileName(entry, name, sizeof(name)) == 0) {
+            data->entryNames.add(String8(name));
+        }
+    }
+    data->zip->endIteration(cookie);
+
+    // Compiled XML files, such as layouts
+    for (size_t i = 0; i < data->entryNames.size(); i++) {
+        const String8& entryName = data->entryNames[i];
+        if (strncmp(entryName.string(), "res/", 4) || entryName.getPathExtension() != ".xml") {
+            continue;
+        }
+        Asset* asset = data->assets.openNonAsset(entryName.string(), Asset::ACCESS_BUFFER);
+        if (asset == NULL) {
+            continue;
+        }
+        ResXMLTree* tree = new ResXMLTree();
+        if (tree->setTo(asset->getBuffer(true), asset->getLength(), true) == NO_ERROR) {
+            data->xmlFiles.add(tree);
+        } else {
+            delete tree;
+        }
+        delete asset;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Benchmarks
+///////////////////////////////////////////////////////////////////////////////
+
+// Each benchmark returns the number of operations it ran
+typedef size_t (*BenchmarkFunction)(const DataSet& data);
+
+static size_t benchGetResource(const DataSet& data) {
+    Res_value value;
+    for (size_t r = 0; r < data.iterations; r++) {
+        for (size_t i = 0; i < data.resIds.size(); i++) {
+            data.res->getResource(data.resIds[i], &value, true);
+        }
+    }
+    return data.iterations * data.resIds.size();
+}
+
+static size_t benchGetBagLocked(const DataSet& data) {
+    const ResTable::bag_entry* bag;
+    for (size_t r = 0; r < data.iterations; r++) {
+        data.res->lock();
+        for (size_t i = 0; i < data.styleIds.size(); i++) {
+            data.res->getBagLocked(data.styleIds[i], &bag);
+        }
+        data.res->unlock();
+    }
+    return data.iterations * data.styleIds.size();
+}
+
+static size_t benchApplyStyle(const DataSet& data) {
+    for (size_t r = 0; r < data.iterations; r++) {
+        ResTable::Theme theme(*data.res);
+        for (size_t i = 0; i < data.styleIds.size(); i++) {
+            theme.applyStyle(data.styleIds[i], true);
+        }
+    }
+    return data.iterations * data.styleIds.size();
+}
+
+static size_t benchGetAttribute(const DataSet& data) {
+    // A theme defining most attributes, as the styles override each other
+    ResTable::Theme theme(*data.res);
+    for (size_t i = 0; i < data.styleIds.size(); i++) {
+        theme.applyStyle(data.styleIds[i], true);
+    }
+
+    Res_value value;
+    for (size_t r = 0; r < data.iterations; r++) {
+        for (size_t i = 0; i < data.attrIds.size(); i++) {
+            theme.getAttribute(data.attrIds[i], &value);
+        }
+    }
+    return data.iterations * data.attrIds.size();
+}
+
+static size_t benchStringAt(const DataSet& data) {
+    const ResStringPool* pool = data.res->getTableStringBlock(0);
+    size_t len;
+    for (size_t r = 0; r < data.iterations; r++) {
+        for (size_t i = 0; i < pool->size(); i++) {
+            pool->stringAt(i, &len);
+        }
+    }
+    return data.iterations * pool->size();
+}
+
+static size_t benchString8At(const DataSet& data) {
+    const ResStringPool* pool = data.res->getTableStringBlock(0);
+    size_t len;
+    for (size_t r = 0; r < data.iterations; r++) {
+        for (size_t i = 0; i < pool->size(); i++) {
+            pool->string8At(i, &len);
+        }
+    }
+    return data.iterations * pool->size();
+}
+
+static size_t benchXmlParser(const DataSet& data) {
+    size_t count = 0;
+    for (size_t r = 0; r < data.iterations; r++) {
+        for (size_t i = 0; i < data.xmlFiles.size(); i++) {
+            ResXMLParser parser(*data.xmlFiles[i]);
+            parser.restart();
+            ResXMLParser::event_code_t code;
+            while ((code = parser.next()) != ResXMLParser::END_DOCUMENT &&
+                    code != ResXMLParser::BAD_DOCUMENT) {
+                // What the inflater reads from each tag
+                if (code == ResXMLParser::START_TAG) {
+                    for (size_t a = 0; a < parser.getAttributeCount(); a++) {
+                        parser.getAttributeNameResID(a);
+                        parser.getAttributeDataType(a);
+                        parser.getAttributeData(a);
+                    }
+                }
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+static size_t benchFindEntryByName(const DataSet& data) {
+    for (size_t r = 0; r < data.iterations; r++) {
+        for (size_t i = 0; i < data.entryNames.size(); i++) {
+            ZipEntryRO entry = data.zip->findEntryByName(data.entryNames[i].string());
+            data.zip->releaseEntry(entry);
+        }
+    }
+    return data.iterations * data.entryNames.size();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Runner
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Releases the threads of a run at the same time, so that they contend.
+ */
+struct Run {
+    Run(const DataSet& data, BenchmarkFunction function):
+            data(data), function(function), started(false) {
+    }
+
+    const DataSet& data;
+    const BenchmarkFunction function;
+
+    Mutex lock;
+    Condition condition;
+    bool started;
+};
+
+struct RunThread {
+    Run* run;
+    pthread_t thread;
+    size_t operations;
+    nsecs_t time;
+};
+
+static void* runThread(void* arg) {
+    RunThread* runThread = (RunThread*) arg;
+    Run* run = runThread->run;
+    {
+        Mutex::Autolock _l(run->lock);
+        while (!run->started) {
+            run->condition.wait(run->lock);
+        }
+    }
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    runThread->operations = run->function(run->data);
+    runThread->time = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    return NULL;
+}
+
+static void runBenchmark(const DataSet& data, const char* name, BenchmarkFunction function,
+        size_t threadCount) {
+    // Warms up the caches of the table, the first lookups are not measured
+    function(data);
+
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    size_t operations = function(data);
+    nsecs_t time = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    if (operations == 0) {
+        printf("%-20s  nothing to measure in this package\n", name);
+        return;
+    }
+    printf("%-20s  1 thread    %10.1f ns/op  %8.2f Mop/s\n", name,
+            double(time) / operations, operations * 1000.0 / time);
+
+    if (threadCount <= 1) {
+        return;
+    }
+
+    Run run(data, function);
+    Vector<RunThread> threads;
+    threads.insertAt(0, threadCount);
+    for (size_t i = 0; i < threadCount; i++) {
+        RunThread& thread = threads.editItemAt(i);
+        thread.run = &run;
+        thread.operations = 0;
+        thread.time = 0;
+        pthread_create(&thread.thread, NULL, runThread, &thread);
+    }
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    {
+        Mutex::Autolock _l(run.lock);
+        run.started = true;
+        run.condition.broadcast();
+    }
+
+    operations = 0;
+    time = 0;
+    for (size_t i = 0; i < threadCount; i++) {
+        pthread_join(threads[i].thread, NULL);
+        operations += threads[i].operations;
+        time += threads[i].time;
+    }
+    nsecs_t wallTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    printf("%-20s  %zu threads   %10.1f ns/op  %8.2f Mop/s\n", "", threadCount,
+            double(time) / operations, operations * 1000.0 / wallTime);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Main
+///////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <apk> [thread count] [iteration count]\n", argv[0]);
+        return 1;
+    }
+
+    const size_t threadCount = argc > 2 ? atoi(argv[2]) : DEFAULT_THREAD_COUNT;
+
+    DataSet data;
+    data.iterations = argc > 3 ? atoi(argv[3]) : DEFAULT_ITERATION_COUNT;
+    if (data.iterations == 0) {
+        data.iterations = 1;
+    }
+
+    if (!data.assets.addAssetPath(String8(argv[1]), NULL)) {
+        fprintf(stderr, "Unable to add %s\n", argv[1]);
+        return 1;
+    }
+    data.res = &data.assets.getResources(true);
+    if (data.res->getError() != NO_ERROR) {
+        fprintf(stderr, "Unable to load the resources of %s\n", argv[1]);
+        return 1;
+    }
+
+    collectResources(&data);
+    if (!collectEntries(&data, argv[1])) {
+        return 1;
+    }
+
+    const ResStringPool* pool = data.res->getTableStringBlock(0);
+    printf("%zu resources, %zu styles, %zu attributes, %zu strings (%s), "
+            "%zu zip entries, %zu XML files\n",
+            data.resIds.size(), data.styleIds.size(), data.attrIds.size(), pool->size(),
+            pool->isUTF8() ? "UTF-8" : "UTF-16", data.entryNames.size(), data.xmlFiles.size());
+
+    runBenchmark(data, "getResource", benchGetResource, threadCount);
+    runBenchmark(data, "getBagLocked", benchGetBagLocked, threadCount);
+    runBenchmark(data, "Theme::applyStyle", benchApplyStyle, threadCount);
+    runBenchmark(data, "Theme::getAttribute", benchGetAttribute, threadCount);
+    // The UTF-16 strings of UTF-8 pools are decoded once and cached
+    runBenchmark(data, "stringAt", benchStringAt, threadCount);
+    if (pool->isUTF8()) {
+        runBenchmark(data, "string8At", benchString8At, threadCount);
+    }
+    runBenchmark(data, "ResXMLParser::next", benchXmlParser, threadCount);
+    runBenchmark(data, "findEntryByName", benchFindEntryByName, threadCount);
+    return 0;
+}
@@ -6,27 +6,36 @@ include $(CLEAR_VARS)
 ifeq ($(USE_OPENGL_RENDERER),true)
 	LOCAL_SRC_FILES:= \
 		utils/Blur.cpp \
+		utils/PooledLinearAllocator.cpp \
 		utils/SortedListImpl.cpp \
 		thread/TaskManager.cpp \
 		font/CacheTexture.cpp \
+		font/DistanceField.cpp \
 		font/Font.cpp \
 		AssetAtlas.cpp \
+		BatchingStatistics.cpp \
 		FontRenderer.cpp \
 		GammaFontRenderer.cpp \
+		GLStateStatistics.cpp \
 		Caches.cpp \
 		DisplayList.cpp \
 		DeferredDisplayList.cpp \
+		DisplayListAnimator.cpp \
+		DisplayListCapture.cpp \
 		DisplayListLogBuffer.cpp \
 		DisplayListRenderer.cpp \
 		Dither.cpp \
 		Extensions.cpp \
 		FboCache.cpp \
+		GpuProfiler.cpp \
 		GradientCache.cpp \
 		Image.cpp \
 		Layer.cpp \
 		LayerCache.cpp \
+		LayerDeferrer.cpp \
 		LayerRenderer.cpp \
 		Matrix.cpp \
+		MemoryBudget.cpp \
 		OpenGLRenderer.cpp \
 		Patch.cpp \
 		PatchCache.cpp \
@@ -34,14 +43,18 @@ ifeq ($(USE_OPENGL_RENDERER),true)
 		PathTessellator.cpp \
 		PixelBuffer.cpp \
 		Program.cpp \
+		ProgramBinaryCache.cpp \
 		ProgramCache.cpp \
 		RenderBufferCache.cpp \
+		RenderThread.cpp \
 		ResourceCache.cpp \
 		SkiaColorFilter.cpp \
 		SkiaShader.cpp \
 		Snapshot.cpp \
 		Stencil.cpp \
+		TessellationCache.cpp \
 		Texture.cpp \
+		TextureAtlas.cpp \
 		TextureCache.cpp \
 		TextDropShadowCache.cpp
 
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include "BatchingStatistics.h"
+
+namespace android {
+namespace uirenderer {
+
+static const char* gBarrierNames[BatchingStatistics::kBarrier_Count] = {
+        "state op",
+        "restore to count",
+        "empty bounds",
+        "overdraw",
+        "cached list"
+};
+
+void BatchingStatistics::dump(String8& log) const {
+    const Counters& c = mLastFrame;
+
+    log.appendFormat("Draw batching (last frame):\n");
+    log.appendFormat("  Ops deferred         %8d\n", c.opsDeferred);
+    log.appendFormat("  Ops rejected         %8d\n", c.opsRejected);
+    log.appendFormat("  Batches created      %8d (%d merging)\n",
+            c.batchesCreated, c.mergingBatchesCreated);
+    log.appendFormat("  Ops merged           %8d\n", c.opsMerged);
+    log.appendFormat("  Ops joined           %8d\n", c.opsJoined);
+    log.appendFormat("  Merges rejected      %8d\n", c.mergesRejected);
+    log.appendFormat("  Ops blocked          %8d\n", c.opsBlocked);
+    log.appendFormat("  Cached lists reused  %8d\n", c.cachedListsReused);
+    log.appendFormat("  Ops hoisted          %8d\n", c.opsHoisted);
+    log.appendFormat("  Ops occluded         %8d\n", c.opsOccluded);
+    log.appendFormat("  Batches replayed     %8d\n", c.batchesReplayed);
+    log.appendFormat("  Merged draws         %8d (%d ops, %.2f avg, %d max)\n",
+            c.mergedDraws, c.mergedOps,
+            c.mergedDraws ? c.mergedOps / (float) c.mergedDraws : 0.0f,
+            c.maxOpsPerMergedDraw);
+    log.appendFormat("  Barriers:\n");
+    for (int i = 0; i < kBarrier_Count; i++) {
+        log.appendFormat("    %-18s %8d\n", gBarrierNames[i], c.barriers[i]);
+    }
+}
+
+}; // namespace uirenderer
+}; // namespace android
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_BATCHING_STATISTICS_H
+#define ANDROID_HWUI_BATCHING_STATISTICS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <utils/String8.h>
+
+namespace android {
+namespace uirenderer {
+
+/**
+ * Counts how draw operations are deferred, batched and merged by
+ * DeferredDisplayList. The counters are cheap enough to always be
+ * enabled: they are updated from the rendering thread only and are
+ * kept for the current and for the last completed frame. Lists that
+ * may be deferred on worker threads count into their own instance,
+ * which the rendering thread then adds to the frame's.
+ */
+class BatchingStatistics {
+public:
+    /**
+     * Reasons for which the batching state of a DeferredDisplayList
+     * is reset. Operations can never be reordered across a barrier.
+     */
+    enum BarrierReason {
+        // save layer, complex clip and the saves recorded within a complex clip
+        kBarrier_StateOp = 0,
+        // restore of a layer or of a complex clip save
+        kBarrier_RestoreToCount,
+        // operation with unknown bounds
+        kBarrier_EmptyBounds,
+        // opaque operation covering every previous operation
+        kBarrier_Overdraw,
+        // deferred operations kept from a previous frame
+        kBarrier_CachedList,
+
+        kBarrier_Count // Add other barrier reasons before this
+    };
+
+    struct Counters {
+        Counters() {
+            reset();
+        }
+
+        void reset() {
+            memset(this, 0, sizeof(Counters));
+        }
+
+        // Defer time
+        uint32_t opsDeferred;
+        uint32_t opsRejected;
+        uint32_t batchesCreated;
+        uint32_t mergingBatchesCreated;
+        // ops added to an existing merging batch
+        uint32_t opsMerged;
+        // ops added to an existing non-merging batch
+        uint32_t opsJoined;
+        // ops that found a batch but were incompatible with it
+        uint32_t mergesRejected;
+        // ops that found a batch but overlapped a batch drawn after it
+        uint32_t opsBlocked;
+        // display lists whose deferred operations were kept from a previous frame
+        uint32_t cachedListsReused;
+        uint32_t barriers[kBarrier_Count];
+
+        // Flush time
+        uint32_t opsHoisted;
+        // ops hidden by opaque ops drawn after them
+        uint32_t opsOccluded;
+        uint32_t batchesReplayed;
+        uint32_t mergedDraws;
+        uint32_t mergedOps;
+        uint32_t maxOpsPerMergedDraw;
+    };
+
+    BatchingStatistics() { }
+    ~BatchingStatistics() { }
+
+    /**
+     * Counters of the frame currently being drawn.
+     */
+    Counters& current() {
+        return mCurrent;
+    }
+
+    /**
+     * Counters of the last completed frame.
+     */
+    const Counters& lastFrame() const {
+        return mLastFrame;
+    }
+
+    void addBarrier(BarrierReason reason) {
+        mCurrent.barriers[reason]++;
+    }
+
+    void addMergedDraw(uint32_t opCount) {
+        mCurrent.mergedDraws++;
+        mCurrent.mergedOps += opCount;
+        if (opCount > mCurrent.maxOpsPerMergedDraw) {
+            mCurrent.maxOpsPerMergedDraw = opCount;
+        }
+    }
+
+    /**
+     * Adds the specified counters to the ones of the current frame.
+     */
+    void add(const Counters& counters) {
+        // Every counter is a sum, but for the maximum
+        const uint32_t maxOps = mCurrent.maxOpsPerMergedDraw;
+        uint32_t* dst = (uint32_t*) &mCurrent;
+        const uint32_t* src = (const uint32_t*) &counters;
+        for (size_t i = 0; i < sizeof(Counters) / sizeof(uint32_t); i++) {
+            dst[i] += src[i];
+        }
+        mCurrent.maxOpsPerMergedDraw = counters.maxOpsPerMergedDraw > maxOps ?
+                counters.maxOpsPerMergedDraw : maxOps;
+    }
+
+    /**
+     * Must be invoked at the end of each frame.
+     */
+    void endFrame() {
+        mLastFrame = mCurrent;
+        mCurrent.reset();
+    }
+
+    /**
+     * Outputs the counters of the last completed frame.
+     */
+    void dump(String8& log) const;
+
+private:
+    Counters mCurrent;
+    Counters mLastFrame;
+}; // class BatchingStatistics
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_BATCHING_STATISTICS_H
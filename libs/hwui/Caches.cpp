@@ -55,6 +55,7 @@ Caches::Caches(): Singleton<Caches>(),
     initProperties();
     initStaticProperties();
     initExtensions();
+    initMemoryBudget();
 
     mDebugLevel = readDebugLevel();
     ALOGD("Enabling debug mode %d", mDebugLevel);
@@ -153,6 +154,17 @@ void Caches::initStaticProperties() {
     }
 }
 
+void Caches::initMemoryBudget() {
+    // The patch cache and the font renderers allocate fixed size
+    // buffers and textures and cannot shrink, they are not included
+    memoryBudget.addClient(&textureCache, "TextureCache");
+    memoryBudget.addClient(&layerCache, "LayerCache");
+    memoryBudget.addClient(&gradientCache, "GradientCache");
+    memoryBudget.addClient(&pathCache, "PathCache");
+    memoryBudget.addClient(&tessellationCache, "TessellationCache");
+    memoryBudget.addClient(&dropShadowCache, "TextDropShadowCache");
+}
+
 bool Caches::initProperties() {
     bool prevDebugLayersUpdates = debugLayersUpdates;
     bool prevDebugOverdraw = debugOverdraw;
@@ -206,6 +218,28 @@ bool Caches::initProperties() {
         INIT_LOGD("  Draw reorder enabled");
     }
 
+    if (property_get(PROPERTY_ENABLE_DEFER_CACHE, property, "false")) {
+        deferCacheEnabled = !strcasecmp(property, "true");
+        INIT_LOGD("  Defer cache %s", deferCacheEnabled ? "enabled" : "disabled");
+    } else {
+        INIT_LOGD("  Defer cache disabled");
+    }
+
+    if (property_get(PROPERTY_CAPTURE_FRAME, property, NULL) > 0) {
+        if (mCaptureFrameProperty != property) {
+            INIT_LOGD("  Capturing next frame to %s", property);
+            mCaptureFrameProperty.setTo(property);
+            captureFramePath.setTo(property);
+        }
+    } else {
+        mCaptureFrameProperty.clear();
+    }
+
+    if (property_get(PROPERTY_PROFILE_GPU, property, "false")) {
+        gpuProfiler.setEnabled(!strcasecmp(property, "true"));
+        INIT_LOGD("  GPU profiling %s", gpuProfiler.isEnabled() ? "enabled" : "disabled");
+    }
+
     return (prevDebugLayersUpdates != debugLayersUpdates) ||
             (prevDebugOverdraw != debugOverdraw) ||
             (prevDebugStencilClip != debugStencilClip);
@@ -231,6 +265,9 @@ void Caches::terminate() {
 
     patchCache.clear();
 
+    // Releases the queries
+    gpuProfiler.setEnabled(false);
+
     clearGarbage();
 
     mInitialized = false;
@@ -260,6 +297,8 @@ void Caches::dumpMemoryUsage(String8 &log) {
     log.appendFormat("Current memory usage / total memory usage (bytes):\n");
     log.appendFormat("  TextureCache         %8d / %8d\n",
             textureCache.getSize(), textureCache.getMaxSize());
+    log.appendFormat("  TextureAtlas         %8d / %8d\n",
+            textureCache.getAtlasSize(), textureCache.getAtlasSize());
     log.appendFormat("  LayerCache           %8d / %8d\n",
             layerCache.getSize(), layerCache.getMaxSize());
     log.appendFormat("  RenderBufferCache    %8d / %8d\n",
@@ -268,6 +307,8 @@ void Caches::dumpMemoryUsage(String8 &log) {
             gradientCache.getSize(), gradientCache.getMaxSize());
     log.appendFormat("  PathCache            %8d / %8d\n",
             pathCache.getSize(), pathCache.getMaxSize());
+    log.appendFormat("  TessellationCache    %8d / %8d\n",
+            tessellationCache.getSize(), tessellationCache.getMaxSize());
     log.appendFormat("  TextDropShadowCache  %8d / %8d\n", dropShadowCache.getSize(),
             dropShadowCache.getMaxSize());
     log.appendFormat("  PatchCache           %8d / %8d\n",
@@ -280,16 +321,19 @@ void Caches::dumpMemoryUsage(String8 &log) {
         log.appendFormat("  FontRenderer %d total %8d / %8d\n", i, sizeA8 + sizeRGBA,
                 sizeA8 + sizeRGBA);
     }
+    memoryBudget.dump(log);
     log.appendFormat("Other:\n");
     log.appendFormat("  FboCache             %8d / %8d\n",
             fboCache.getSize(), fboCache.getMaxSize());
 
     uint32_t total = 0;
     total += textureCache.getSize();
+    total += textureCache.getAtlasSize();
     total += layerCache.getSize();
     total += renderBufferCache.getSize();
     total += gradientCache.getSize();
     total += pathCache.getSize();
+    total += tessellationCache.getSize();
     total += dropShadowCache.getSize();
     total += patchCache.getSize();
     for (uint32_t i = 0; i < fontRenderer->getFontRendererCount(); i++) {
@@ -301,6 +345,18 @@ void Caches::dumpMemoryUsage(String8 &log) {
     log.appendFormat("  %d bytes, %.2f MB\n", total, total / 1024.0f / 1024.0f);
 }
 
+void Caches::dumpBatchingStatistics(String8& log) {
+    batchingStatistics.dump(log);
+}
+
+void Caches::dumpGLStateStatistics(String8& log) {
+    glStateStatistics.dump(log);
+}
+
+void Caches::dumpGpuProfile(String8& log) {
+    gpuProfiler.dump(log);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Memory management
 ///////////////////////////////////////////////////////////////////////////////
@@ -362,11 +418,14 @@ void Caches::flush(FlushMode mode) {
             fontRenderer->clear();
             fboCache.clear();
             dither.clear();
+            PooledLinearAllocator::trimPool();
+            Snapshot::trimPool();
             // fall through
         case kFlushMode_Moderate:
             fontRenderer->flush();
             textureCache.flush();
             pathCache.clear();
+            tessellationCache.clear();
             // fall through
         case kFlushMode_Layers:
             layerCache.clear();
@@ -374,6 +433,16 @@ void Caches::flush(FlushMode mode) {
             break;
     }
 
+    if (mode > kFlushMode_Layers) {
+        // Leave room for the other applications until the caches are
+        // needed again
+        memoryBudget.resetLimits();
+    } else {
+        memoryBudget.trimIdleClients();
+    }
+
+    programCache.flush();
+
     clearGarbage();
 }
 
@@ -389,8 +458,10 @@ bool Caches::bindMeshBuffer(const GLuint buffer) {
     if (mCurrentBuffer != buffer) {
         glBindBuffer(GL_ARRAY_BUFFER, buffer);
         mCurrentBuffer = buffer;
+        glStateStatistics.count(GLStateStatistics::kCall_BindBuffer, true);
         return true;
     }
+    glStateStatistics.count(GLStateStatistics::kCall_BindBuffer, false);
     return false;
 }
 
@@ -407,8 +478,10 @@ bool Caches::bindIndicesBuffer(const GLuint buffer) {
     if (mCurrentIndicesBuffer != buffer) {
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
         mCurrentIndicesBuffer = buffer;
+        glStateStatistics.count(GLStateStatistics::kCall_BindBuffer, true);
         return true;
     }
+    glStateStatistics.count(GLStateStatistics::kCall_BindBuffer, false);
     return false;
 }
 
@@ -479,6 +552,9 @@ void Caches::bindPositionVertexPointer(bool force, GLvoid* vertices, GLsizei str
         glVertexAttribPointer(slot, 2, GL_FLOAT, GL_FALSE, stride, vertices);
         mCurrentPositionPointer = vertices;
         mCurrentPositionStride = stride;
+        glStateStatistics.count(GLStateStatistics::kCall_VertexAttribPointer, true);
+    } else {
+        glStateStatistics.count(GLStateStatistics::kCall_VertexAttribPointer, false);
     }
 }
 
@@ -488,6 +564,9 @@ void Caches::bindTexCoordsVertexPointer(bool force, GLvoid* vertices, GLsizei st
         glVertexAttribPointer(slot, 2, GL_FLOAT, GL_FALSE, stride, vertices);
         mCurrentTexCoordsPointer = vertices;
         mCurrentTexCoordsStride = stride;
+        glStateStatistics.count(GLStateStatistics::kCall_VertexAttribPointer, true);
+    } else {
+        glStateStatistics.count(GLStateStatistics::kCall_VertexAttribPointer, false);
     }
 }
 
@@ -516,10 +595,12 @@ void Caches::disableTexCoordsVertexArray() {
 }
 
 void Caches::activeTexture(GLuint textureUnit) {
-    if (mTextureUnit != textureUnit) {
+    bool issued = mTextureUnit != textureUnit;
+    if (issued) {
         glActiveTexture(gTextureUnits[textureUnit]);
         mTextureUnit = textureUnit;
     }
+    glStateStatistics.count(GLStateStatistics::kCall_ActiveTexture, issued);
 }
 
 void Caches::resetActiveTexture() {
@@ -527,17 +608,21 @@ void Caches::resetActiveTexture() {
 }
 
 void Caches::bindTexture(GLuint texture) {
-    if (mBoundTextures[mTextureUnit] != texture) {
+    bool issued = mBoundTextures[mTextureUnit] != texture;
+    if (issued) {
         glBindTexture(GL_TEXTURE_2D, texture);
         mBoundTextures[mTextureUnit] = texture;
     }
+    glStateStatistics.count(GLStateStatistics::kCall_BindTexture, issued);
 }
 
 void Caches::bindTexture(GLenum target, GLuint texture) {
-    if (mBoundTextures[mTextureUnit] != texture) {
+    bool issued = mBoundTextures[mTextureUnit] != texture;
+    if (issued) {
         glBindTexture(target, texture);
         mBoundTextures[mTextureUnit] = texture;
     }
+    glStateStatistics.count(GLStateStatistics::kCall_BindTexture, issued);
 }
 
 void Caches::deleteTexture(GLuint texture) {
@@ -595,8 +680,10 @@ bool Caches::setScissor(GLint x, GLint y, GLint width, GLint height) {
         mScissorWidth = width;
         mScissorHeight = height;
 
+        glStateStatistics.count(GLStateStatistics::kCall_Scissor, true);
         return true;
     }
+    glStateStatistics.count(GLStateStatistics::kCall_Scissor, false);
     return false;
 }
 
@@ -605,8 +692,10 @@ bool Caches::enableScissor() {
         glEnable(GL_SCISSOR_TEST);
         scissorEnabled = true;
         resetScissor();
+        glStateStatistics.count(GLStateStatistics::kCall_Scissor, true);
         return true;
     }
+    glStateStatistics.count(GLStateStatistics::kCall_Scissor, false);
     return false;
 }
 
@@ -614,8 +703,10 @@ bool Caches::disableScissor() {
     if (scissorEnabled) {
         glDisable(GL_SCISSOR_TEST);
         scissorEnabled = false;
+        glStateStatistics.count(GLStateStatistics::kCall_Scissor, true);
         return true;
     }
+    glStateStatistics.count(GLStateStatistics::kCall_Scissor, false);
     return false;
 }
 
@@ -638,12 +729,15 @@ void Caches::resetScissor() {
 void Caches::startTiling(GLuint x, GLuint y, GLuint width, GLuint height, bool discard) {
     if (mExtensions.hasTiledRendering() && !debugOverdraw) {
         glStartTilingQCOM(x, y, width, height, (discard ? GL_NONE : GL_COLOR_BUFFER_BIT0_QCOM));
+        // Only the color buffer is preserved
+        stencil.invalidateClips();
     }
 }
 
 void Caches::endTiling() {
     if (mExtensions.hasTiledRendering() && !debugOverdraw) {
         glEndTilingQCOM(GL_COLOR_BUFFER_BIT0_QCOM);
+        stencil.invalidateClips();
     }
 }
 
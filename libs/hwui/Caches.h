@@ -25,6 +25,7 @@
 
 #include <utils/KeyedVector.h>
 #include <utils/Singleton.h>
+#include <utils/String8.h>
 #include <utils/Vector.h>
 
 #include <cutils/compiler.h>
@@ -33,8 +34,12 @@
 #include "thread/TaskManager.h"
 
 #include "AssetAtlas.h"
+#include "BatchingStatistics.h"
+#include "GLStateStatistics.h"
 #include "FontRenderer.h"
 #include "GammaFontRenderer.h"
+#include "GpuProfiler.h"
+#include "MemoryBudget.h"
 #include "TextureCache.h"
 #include "LayerCache.h"
 #include "RenderBufferCache.h"
@@ -42,6 +47,7 @@
 #include "PatchCache.h"
 #include "ProgramCache.h"
 #include "PathCache.h"
+#include "TessellationCache.h"
 #include "TextDropShadowCache.h"
 #include "FboCache.h"
 #include "ResourceCache.h"
@@ -293,6 +299,21 @@ public:
     void dumpMemoryUsage();
     void dumpMemoryUsage(String8& log);
 
+    /**
+     * Displays how draw operations were batched in the last frame.
+     */
+    void dumpBatchingStatistics(String8& log);
+
+    /**
+     * Displays how many GL state changes were issued and skipped in the last frame.
+     */
+    void dumpGLStateStatistics(String8& log);
+
+    /**
+     * Displays the GPU timings of the last frame, if GPU profiling is enabled.
+     */
+    void dumpGpuProfile(String8& log);
+
     bool hasRegisteredFunctors();
     void registerFunctors(uint32_t functorCount);
     void unregisterFunctors(uint32_t functorCount);
@@ -305,6 +326,10 @@ public:
 
     bool drawDeferDisabled;
     bool drawReorderDisabled;
+    bool deferCacheEnabled;
+
+    // Path of the file the next frame is captured to, empty if no capture is pending
+    String8 captureFramePath;
 
     // VBO to draw with
     GLuint meshBuffer;
@@ -323,12 +348,15 @@ public:
     };
     StencilClipDebug debugStencilClip;
 
+    MemoryBudget memoryBudget;
+
     TextureCache textureCache;
     LayerCache layerCache;
     RenderBufferCache renderBufferCache;
     GradientCache gradientCache;
     ProgramCache programCache;
     PathCache pathCache;
+    TessellationCache tessellationCache;
     PatchCache patchCache;
     TextDropShadowCache dropShadowCache;
     FboCache fboCache;
@@ -343,6 +371,10 @@ public:
 
     AssetAtlas assetAtlas;
 
+    BatchingStatistics batchingStatistics;
+    GLStateStatistics glStateStatistics;
+    GpuProfiler gpuProfiler;
+
     bool gpuPixelBuffersEnabled;
 
     // Debug methods
@@ -363,6 +395,7 @@ private:
     void initExtensions();
     void initConstraints();
     void initStaticProperties();
+    void initMemoryBudget();
 
     static void eventMarkNull(GLsizei length, const GLchar* marker) { }
     static void startMarkNull(GLsizei length, const GLchar* marker) { }
@@ -413,6 +446,9 @@ private:
     GLuint mBoundTextures[REQUIRED_TEXTURE_UNITS_COUNT];
 
     OverdrawColorSet mOverdrawDebugColorSet;
+
+    // Last value of PROPERTY_CAPTURE_FRAME, a frame is captured when it changes
+    String8 mCaptureFrameProperty;
 }; // class Caches
 
 }; // namespace uirenderer
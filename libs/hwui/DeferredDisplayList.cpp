@@ -27,6 +27,7 @@
 #include "Debug.h"
 #include "DeferredDisplayList.h"
 #include "DisplayListOp.h"
+#include "LayerDeferrer.h"
 #include "OpenGLRenderer.h"
 
 #if DEBUG_DEFER
@@ -41,6 +42,9 @@ namespace uirenderer {
 // Depth of the save stack at the beginning of batch playback at flush time
 #define FLUSH_SAVE_STACK_DEPTH 2
 
+// Maximum number of batches a batch can be hoisted across at flush time
+#define MAX_REORDER_DISTANCE 32
+
 #define DEBUG_COLOR_BARRIER          0x1f000000
 #define DEBUG_COLOR_MERGEDBATCH      0x5f7f7fff
 #define DEBUG_COLOR_MERGEDBATCH_SOLO 0x5f7fff7f
@@ -57,9 +61,22 @@ public:
     virtual bool coversBounds(const Rect& bounds) { return false; }
 };
 
+/*
+ * Returns true if the specified bounds are entirely covered by the opaque region. The bounds are
+ * rounded outwards, since any pixel they touch may be drawn.
+ */
+static bool isOccluded(const Rect& bounds, const Region& opaqueRegion, const Rect& opaqueBounds) {
+    if (!opaqueBounds.contains(bounds)) return false;
+
+    Region uncovered(android::Rect(floorf(bounds.left), floorf(bounds.top),
+            ceilf(bounds.right), ceilf(bounds.bottom)));
+    uncovered.subtractSelf(opaqueRegion);
+    return uncovered.isEmpty();
+}
+
 class DrawBatch : public Batch {
 public:
-    DrawBatch(const DeferInfo& deferInfo) : mAllOpsOpaque(true),
+    DrawBatch(const DeferInfo& deferInfo) : mAllOpsOpaque(true), mHasUnboundedOps(false),
             mBatchId(deferInfo.batchId), mMergeId(deferInfo.mergeId) {
         mOps.clear();
     }
@@ -70,9 +87,25 @@ public:
         // NOTE: ignore empty bounds special case, since we don't merge across those ops
         mBounds.unionWith(state->mBounds);
         mAllOpsOpaque &= opaqueOverBounds;
+        mHasUnboundedOps |= state->mBounds.isEmpty();
         mOps.add(OpStatePair(op, state));
     }
 
+    /*
+     * Moves ops from the beginning of the specified batch to the end of this batch, for as long as
+     * they are compatible with this batch. The caller must guarantee that the moved ops can be
+     * drawn before any batch between the two batches. Returns the number of moved ops.
+     */
+    virtual unsigned int absorb(DrawBatch* batch) {
+        // non-merging batches draw their ops one by one, and accept any op of their batch id
+        unsigned int count = batch->mOps.size();
+        for (unsigned int i = 0; i < count; i++) {
+            add(batch->mOps[i].op, batch->mOps[i].state, false);
+        }
+        batch->removeOps(count);
+        return count;
+    }
+
     bool intersects(const Rect& rect) {
         if (!rect.intersects(mBounds)) return false;
 
@@ -90,6 +123,16 @@ public:
         return false;
     }
 
+    // returns true if any op of the specified batch intersects with an op of this batch
+    bool intersects(const DrawBatch* batch) {
+        if (!batch->mBounds.intersects(mBounds)) return false;
+
+        for (unsigned int i = 0; i < batch->mOps.size(); i++) {
+            if (intersects(batch->mOps[i].state->mBounds)) return true;
+        }
+        return false;
+    }
+
     virtual status_t replay(OpenGLRenderer& renderer, Rect& dirty, int index) {
         DEFER_LOGD("%d  replaying DrawBatch %p, with %d ops (batch id %x, merge id %p)",
                 index, this, mOps.size(), getBatchId(), getMergeId());
@@ -133,15 +176,79 @@ public:
         return uncovered.isEmpty();
     }
 
+    /*
+     * Removes the ops entirely covered by the specified opaque region, drawn after this batch.
+     * Returns the number of removed ops.
+     */
+    unsigned int removeOccludedOps(const Region& opaqueRegion, const Rect& opaqueBounds) {
+        if (!opaqueBounds.intersects(mBounds)) return 0;
+
+        unsigned int kept = 0;
+        for (unsigned int i = 0; i < mOps.size(); i++) {
+            if (isOccluded(mOps[i].state->mBounds, opaqueRegion, opaqueBounds)) continue;
+            if (kept != i) mOps.editItemAt(kept) = mOps[i];
+            kept++;
+        }
+
+        const unsigned int removed = mOps.size() - kept;
+        if (removed > 0) {
+            mOps.removeItemsAt(kept, removed);
+            updateBounds();
+        }
+        return removed;
+    }
+
+    /*
+     * Adds the area covered by the ops of this batch to the opaque region, if the ops are opaque.
+     * The bounds of the ops are rounded inwards, since pixels they partially cover may still show
+     * what is drawn underneath.
+     */
+    void addOpaqueArea(Region& opaqueRegion, Rect& opaqueBounds) const {
+        if (!mAllOpsOpaque || mHasUnboundedOps) return;
+
+        for (unsigned int i = 0; i < mOps.size(); i++) {
+            const DeferredDisplayState* state = mOps[i].state;
+            if (state->mClipSideFlags == kClipSide_ConservativeFull) continue;
+
+            Rect inner(ceilf(state->mBounds.left), ceilf(state->mBounds.top),
+                    floorf(state->mBounds.right), floorf(state->mBounds.bottom));
+            if (inner.isEmpty()) continue;
+
+            opaqueRegion.orSelf(android::Rect(inner.left, inner.top, inner.right, inner.bottom));
+            opaqueBounds.unionWith(inner);
+        }
+    }
+
+    virtual bool isMergingBatch() const { return false; }
+
+    // ops with unknown bounds can't be reordered, so batches containing them act as barriers
+    inline bool hasUnboundedOps() const { return mHasUnboundedOps; }
+
     inline int getBatchId() const { return mBatchId; }
     inline mergeid_t getMergeId() const { return mMergeId; }
     inline int count() const { return mOps.size(); }
+    // name of the first op of the batch, all the ops of a batch share its batch id
+    inline const char* name() const { return mOps.isEmpty() ? "DrawBatch" : mOps[0].op->name(); }
 
 protected:
+    // removes the specified number of ops from the beginning of the batch
+    void removeOps(unsigned int count) {
+        mOps.removeItemsAt(0, count);
+        updateBounds();
+    }
+
+    void updateBounds() {
+        mBounds.setEmpty();
+        for (unsigned int i = 0; i < mOps.size(); i++) {
+            mBounds.unionWith(mOps[i].state->mBounds);
+        }
+    }
+
     Vector<OpStatePair> mOps;
     Rect mBounds; // union of bounds of contained ops
 private:
     bool mAllOpsOpaque;
+    bool mHasUnboundedOps;
     int mBatchId;
     mergeid_t mMergeId;
 };
@@ -249,6 +356,26 @@ public:
         return true;
     }
 
+    /*
+     * Only moves the longest prefix of the batch's ops that this batch can merge with. Ops within a
+     * merging batch are drawn in order, so the moved ops have to be the first ones.
+     */
+    virtual unsigned int absorb(DrawBatch* batch) {
+        MergingDrawBatch* mergingBatch = (MergingDrawBatch*) batch;
+
+        unsigned int count = 0;
+        while (count < mergingBatch->mOps.size()) {
+            const OpStatePair& pair = mergingBatch->mOps[count];
+            if (!canMergeWith(pair.op, pair.state)) break;
+            add(pair.op, pair.state, false);
+            count++;
+        }
+        mergingBatch->removeOps(count);
+        return count;
+    }
+
+    virtual bool isMergingBatch() const { return true; }
+
     virtual void add(DrawOp* op, const DeferredDisplayState* state, bool opaqueOverBounds) {
         DrawBatch::add(op, state, opaqueOverBounds);
 
@@ -271,6 +398,8 @@ public:
         // clipping in the merged case is done ahead of time since all ops share the clip (if any)
         renderer.setupMergedMultiDraw(mClipSideFlags ? &mClipRect : NULL);
 
+        renderer.getCaches().batchingStatistics.addMergedDraw(mOps.size());
+
         DrawOp* op = mOps[0].op;
         DisplayListLogBuffer& buffer = DisplayListLogBuffer::getInstance();
         buffer.writeCommand(0, "multiDraw");
@@ -348,6 +477,20 @@ private:
     const int mRestoreCount;
 };
 
+class CachedListBatch : public Batch {
+public:
+    CachedListBatch(const sp<CachedDeferredList>& cachedList) : mCachedList(cachedList) {}
+
+    virtual status_t replay(OpenGLRenderer& renderer, Rect& dirty, int index) {
+        DEFER_LOGD("batch %p replaying cached list %p", this, mCachedList.get());
+        return mCachedList->replay(renderer, dirty);
+    }
+
+private:
+    // keeps the cached list alive until this batch is flushed
+    sp<CachedDeferredList> mCachedList;
+};
+
 #if DEBUG_MERGE_BEHAVIOR
 class BarrierDebugBatch : public Batch {
     virtual status_t replay(OpenGLRenderer& renderer, Rect& dirty, int index) {
@@ -489,12 +632,15 @@ void DeferredDisplayList::addRestoreToCount(OpenGLRenderer& renderer, StateOp* o
 }
 
 void DeferredDisplayList::addDrawOp(OpenGLRenderer& renderer, DrawOp* op) {
+    BatchingStatistics& stats = mStatistics;
+
     /* 1: op calculates local bounds */
     DeferredDisplayState* const state = createState();
     if (op->getLocalBounds(renderer.getDrawModifiers(), state->mBounds)) {
         if (state->mBounds.isEmpty()) {
             // valid empty bounds, don't bother deferring
             tryRecycleState(state);
+            stats.current().opsRejected++;
             return;
         }
     } else {
@@ -504,12 +650,18 @@ void DeferredDisplayList::addDrawOp(OpenGLRenderer& renderer, DrawOp* op) {
     /* 2: renderer calculates global bounds + stores state */
     if (renderer.storeDisplayState(*state, getDrawOpDeferFlags())) {
         tryRecycleState(state);
+        stats.current().opsRejected++;
         return; // quick rejected
     }
+    stats.current().opsDeferred++;
 
     /* 3: ask op for defer info, given renderer state */
     DeferInfo deferInfo;
-    op->onDefer(renderer, deferInfo, *state);
+    if (CC_UNLIKELY(mDeferrer != NULL) && op->onDeferUsesCaches()) {
+        mDeferrer->onDefer(renderer, op, deferInfo, *state);
+    } else {
+        op->onDefer(renderer, deferInfo, *state);
+    }
 
     // complex clip has a complex set of expectations on the renderer state - for now, avoid taking
     // the merge path in those cases
@@ -522,6 +674,7 @@ void DeferredDisplayList::addDrawOp(OpenGLRenderer& renderer, DrawOp* op) {
         // avoid overdraw by resetting drawing state + discarding drawing ops
         discardDrawingBatches(mBatches.size() - 1);
         resetBatchingState();
+        stats.addBarrier(BatchingStatistics::kBarrier_Overdraw);
     }
 
     if (CC_UNLIKELY(renderer.getCaches().drawReorderDisabled)) {
@@ -529,6 +682,7 @@ void DeferredDisplayList::addDrawOp(OpenGLRenderer& renderer, DrawOp* op) {
         DrawBatch* b = new DrawBatch(deferInfo);
         b->add(op, state, deferInfo.opaqueOverBounds);
         mBatches.add(b);
+        stats.current().batchesCreated++;
         return;
     }
 
@@ -545,6 +699,8 @@ void DeferredDisplayList::addDrawOp(OpenGLRenderer& renderer, DrawOp* op) {
             b->add(op, state, deferInfo.opaqueOverBounds);
             mBatches.add(b);
             resetBatchingState();
+            stats.current().batchesCreated++;
+            stats.addBarrier(BatchingStatistics::kBarrier_EmptyBounds);
 #if DEBUG_DEFER
             DEFER_LOGD("Warning: Encountered op with empty bounds, resetting batches");
             op->output(2);
@@ -557,6 +713,7 @@ void DeferredDisplayList::addDrawOp(OpenGLRenderer& renderer, DrawOp* op) {
             if (mMergingBatches[deferInfo.batchId].get(deferInfo.mergeId, targetBatch)) {
                 if (!((MergingDrawBatch*) targetBatch)->canMergeWith(op, state)) {
                     targetBatch = NULL;
+                    stats.current().mergesRejected++;
                 }
             }
         } else {
@@ -582,6 +739,7 @@ void DeferredDisplayList::addDrawOp(OpenGLRenderer& renderer, DrawOp* op) {
                     // NOTE: it may be possible to optimize for special cases where two operations
                     // of the same batch/paint could swap order, such as with a non-mergeable
                     // (clipped) and a mergeable text operation
+                    if (targetBatch) stats.current().opsBlocked++;
                     targetBatch = NULL;
 #if DEBUG_DEFER
                     DEFER_LOGD("op couldn't join batch %p, was intersected by batch %d",
@@ -608,6 +766,13 @@ void DeferredDisplayList::addDrawOp(OpenGLRenderer& renderer, DrawOp* op) {
                 deferInfo.mergeable ? "Merg" : "Draw",
                 targetBatch, deferInfo.batchId, insertBatchIndex);
         mBatches.insertAt(targetBatch, insertBatchIndex);
+
+        stats.current().batchesCreated++;
+        if (deferInfo.mergeable) stats.current().mergingBatchesCreated++;
+    } else if (deferInfo.mergeable) {
+        stats.current().opsMerged++;
+    } else {
+        stats.current().opsJoined++;
     }
 
     targetBatch->add(op, state, deferInfo.opaqueOverBounds);
@@ -620,6 +785,7 @@ void DeferredDisplayList::storeStateOpBarrier(OpenGLRenderer& renderer, StateOp*
     renderer.storeDisplayState(*state, getStateOpDeferFlags());
     mBatches.add(new StateOpBatch(op, state));
     resetBatchingState();
+    mStatistics.addBarrier(BatchingStatistics::kBarrier_StateOp);
 }
 
 void DeferredDisplayList::storeRestoreToCountBarrier(OpenGLRenderer& renderer, StateOp* op,
@@ -633,6 +799,74 @@ void DeferredDisplayList::storeRestoreToCountBarrier(OpenGLRenderer& renderer, S
     renderer.storeDisplayState(*state, getStateOpDeferFlags());
     mBatches.add(new RestoreToCountBatch(op, state, newSaveCount));
     resetBatchingState();
+    mStatistics.addBarrier(BatchingStatistics::kBarrier_RestoreToCount);
+}
+
+void DeferredDisplayList::addCachedList(OpenGLRenderer& renderer,
+        const sp<CachedDeferredList>& cachedList) {
+    DEFER_LOGD("%p adding cached list %p, pos %d", this, cachedList.get(), mBatches.size());
+
+    // the cached operations may overlap anything deferred before or after them
+    resetBatchingState();
+    mBatches.add(new CachedListBatch(cachedList));
+    resetBatchingState();
+
+    mStatistics.current().cachedListsReused++;
+    mStatistics.addBarrier(BatchingStatistics::kBarrier_CachedList);
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+// Reordering
+/////////////////////////////////////////////////////////////////////////////////
+
+static inline bool isReorderableBatch(Batch* batch) {
+    return batch->purelyDrawBatch() && !((DrawBatch*) batch)->hasUnboundedOps();
+}
+
+static inline bool canAbsorb(DrawBatch* target, DrawBatch* batch) {
+    if (target->getBatchId() != batch->getBatchId()) return false;
+    if (target->isMergingBatch() != batch->isMergingBatch()) return false;
+
+    // non-merging batches are joined by batch id only, like at defer time
+    return !batch->isMergingBatch() || target->getMergeId() == batch->getMergeId();
+}
+
+/**
+ * At defer time, an op can only join the most recent batch of its kind, and any batch it overlaps
+ * in between prevents it from doing so. This pass looks further back: each drawing batch is
+ * hoisted across all the earlier batches that neither of its ops overlaps, and its ops are merged
+ * into the first compatible batch found on the way. State op batches, and batches containing ops
+ * with unknown bounds, are barriers that are never crossed.
+ */
+void DeferredDisplayList::reorderBatches(BatchingStatistics& stats) {
+    for (unsigned int j = 1; j < mBatches.size(); j++) {
+        if (!mBatches[j] || !isReorderableBatch(mBatches[j])) continue;
+
+        DrawBatch* batch = (DrawBatch*) mBatches[j];
+        if (batch->getBatchId() == kOpBatch_None) continue;
+
+        int minIndex = j > MAX_REORDER_DISTANCE ? j - MAX_REORDER_DISTANCE : 0;
+        for (int i = j - 1; i >= minIndex; i--) {
+            if (!mBatches[i]) continue; // discarded to avoid overdraw
+            if (!isReorderableBatch(mBatches[i])) break;
+
+            DrawBatch* target = (DrawBatch*) mBatches[i];
+            unsigned int hoisted = 0;
+            if (canAbsorb(target, batch) && (hoisted = target->absorb(batch)) > 0) {
+                DEFER_LOGD("hoisted %d ops of batch %d into batch %d, %d ops left",
+                        hoisted, j, i, batch->count());
+                stats.current().opsHoisted += hoisted;
+                if (batch->count() == 0) {
+                    delete batch;
+                    mBatches.replaceAt(NULL, j);
+                    break;
+                }
+            }
+
+            // the remaining ops can't be drawn before a batch they overlap
+            if (target->intersects(batch)) break;
+        }
+    }
 }
 
 /////////////////////////////////////////////////////////////////////////////////
@@ -642,10 +876,22 @@ void DeferredDisplayList::storeRestoreToCountBarrier(OpenGLRenderer& renderer, S
 static status_t replayBatchList(const Vector<Batch*>& batchList,
         OpenGLRenderer& renderer, Rect& dirty) {
     status_t status = DrawGlInfo::kStatusDone;
+    BatchingStatistics& stats = renderer.getCaches().batchingStatistics;
+    GpuProfiler& profiler = renderer.getCaches().gpuProfiler;
 
     for (unsigned int i = 0; i < batchList.size(); i++) {
-        if (batchList[i]) {
-            status |= batchList[i]->replay(renderer, dirty, i);
+        Batch* batch = batchList[i];
+        if (batch) {
+            int sample = -1;
+            if (CC_UNLIKELY(profiler.isEnabled()) && batch->purelyDrawBatch()) {
+                DrawBatch* drawBatch = (DrawBatch*) batch;
+                sample = profiler.startSample(drawBatch->name(), drawBatch->count());
+            }
+
+            status |= batch->replay(renderer, dirty, i);
+            stats.current().batchesReplayed++;
+
+            profiler.endSample(sample);
         }
     }
     DEFER_LOGD("--flushed, drew %d batches", batchList.size());
@@ -658,6 +904,11 @@ status_t DeferredDisplayList::flush(OpenGLRenderer& renderer, Rect& dirty) {
 
     status_t status = DrawGlInfo::kStatusDone;
 
+    // The list may have been deferred on a worker thread, its counters are
+    // only added to the frame's here, on the rendering thread
+    renderer.getCaches().batchingStatistics.add(mStatistics.current());
+    mStatistics.current().reset();
+
     if (isEmpty()) return status; // nothing to flush
     renderer.restoreToCount(1);
 
@@ -668,13 +919,8 @@ status_t DeferredDisplayList::flush(OpenGLRenderer& renderer, Rect& dirty) {
     DrawModifiers restoreDrawModifiers = renderer.getDrawModifiers();
     renderer.save(SkCanvas::kMatrix_SaveFlag | SkCanvas::kClip_SaveFlag);
 
-    if (CC_LIKELY(mAvoidOverdraw)) {
-        for (unsigned int i = 1; i < mBatches.size(); i++) {
-            if (mBatches[i] && mBatches[i]->coversBounds(mBounds)) {
-                discardDrawingBatches(i - 1);
-            }
-        }
-    }
+    optimizeBatches(renderer);
+
     // NOTE: depth of the save stack at this point, before playback, should be reflected in
     // FLUSH_SAVE_STACK_DEPTH, so that save/restores match up correctly
     status |= replayBatchList(mBatches, renderer, dirty);
@@ -687,6 +933,56 @@ status_t DeferredDisplayList::flush(OpenGLRenderer& renderer, Rect& dirty) {
     return status;
 }
 
+void DeferredDisplayList::optimizeBatches(OpenGLRenderer& renderer) {
+    if (CC_LIKELY(mAvoidOverdraw)) {
+        for (unsigned int i = 1; i < mBatches.size(); i++) {
+            if (mBatches[i] && mBatches[i]->coversBounds(mBounds)) {
+                discardDrawingBatches(i - 1);
+            }
+        }
+        cullOccludedOps(renderer.getCaches().batchingStatistics);
+    }
+    if (CC_LIKELY(!renderer.getCaches().drawReorderDisabled)) {
+        reorderBatches(renderer.getCaches().batchingStatistics);
+    }
+}
+
+/**
+ * Walks the batches from front to back, accumulating the area covered by opaque ops, and removes
+ * the ops hidden by opaque ops drawn after them. Batches that are not pure drawing batches (saves,
+ * layers, restores and cached lists) reset the opaque area, ops are never culled across them.
+ */
+void DeferredDisplayList::cullOccludedOps(BatchingStatistics& stats) {
+    Region opaqueRegion;
+    Rect opaqueBounds;
+
+    for (int i = mBatches.size() - 1; i >= 0; i--) {
+        if (!mBatches[i]) continue;
+
+        if (!mBatches[i]->purelyDrawBatch()) {
+            opaqueRegion.clear();
+            opaqueBounds.setEmpty();
+            continue;
+        }
+
+        DrawBatch* batch = (DrawBatch*) mBatches[i];
+        if (!opaqueBounds.isEmpty()) {
+            unsigned int culled = batch->removeOccludedOps(opaqueRegion, opaqueBounds);
+            if (culled > 0) {
+                DEFER_LOGD("culled %d occluded ops of batch %d, %d ops left",
+                        culled, i, batch->count());
+                stats.current().opsOccluded += culled;
+                if (batch->count() == 0) {
+                    delete batch;
+                    mBatches.replaceAt(NULL, i);
+                    continue;
+                }
+            }
+        }
+        batch->addOpaqueArea(opaqueRegion, opaqueBounds);
+    }
+}
+
 void DeferredDisplayList::discardDrawingBatches(const unsigned int maxIndex) {
     for (unsigned int i = mEarliestUnclearedIndex; i <= maxIndex; i++) {
         // leave deferred state ops alone for simplicity (empty save restore pairs may now exist)
@@ -699,5 +995,76 @@ void DeferredDisplayList::discardDrawingBatches(const unsigned int maxIndex) {
     mEarliestUnclearedIndex = maxIndex + 1;
 }
 
+/////////////////////////////////////////////////////////////////////////////////
+// CachedDeferredList
+/////////////////////////////////////////////////////////////////////////////////
+
+static bool drawModifiersEqual(const DrawModifiers& a, const DrawModifiers& b) {
+    return a.mShader == b.mShader && a.mColorFilter == b.mColorFilter &&
+            a.mOverrideLayerAlpha == b.mOverrideLayerAlpha &&
+            a.mHasShadow == b.mHasShadow && a.mShadowRadius == b.mShadowRadius &&
+            a.mShadowDx == b.mShadowDx && a.mShadowDy == b.mShadowDy &&
+            a.mShadowColor == b.mShadowColor &&
+            a.mHasDrawFilter == b.mHasDrawFilter &&
+            a.mPaintFilterClearBits == b.mPaintFilterClearBits &&
+            a.mPaintFilterSetBits == b.mPaintFilterSetBits;
+}
+
+CachedDeferredList::CachedDeferredList(OpenGLRenderer& renderer,
+        const DeferredDisplayList& parentList, int replayFlags) :
+        mList(parentList.getBounds(), parentList.avoidsOverdraw()), mDeferred(false),
+        mViewportWidth(renderer.getViewportWidth()),
+        mViewportHeight(renderer.getViewportHeight()), mReplayFlags(replayFlags) {
+    mList.mCached = true;
+
+    renderer.storeDisplayState(mState, kStateDeferFlag_Clip);
+    mAtlasGenerationId = renderer.getCaches().textureCache.getAtlasGenerationId();
+    mAssetAtlasGenerationId = renderer.getCaches().assetAtlas.getGenerationId();
+}
+
+bool CachedDeferredList::matchesState(OpenGLRenderer& renderer,
+        const DeferredDisplayList& parentList, int replayFlags) const {
+    Caches& caches = renderer.getCaches();
+    // operations store the location of their bitmap in the atlases when deferred
+    if (mAtlasGenerationId != caches.textureCache.getAtlasGenerationId() ||
+            mAssetAtlasGenerationId != caches.assetAtlas.getGenerationId()) {
+        return false;
+    }
+
+    if (mReplayFlags != replayFlags ||
+            mViewportWidth != renderer.getViewportWidth() ||
+            mViewportHeight != renderer.getViewportHeight() ||
+            mList.getBounds() != parentList.getBounds() ||
+            mList.avoidsOverdraw() != parentList.avoidsOverdraw()) {
+        return false;
+    }
+
+    DeferredDisplayState state;
+    renderer.storeDisplayState(state, kStateDeferFlag_Clip);
+    return state.mClip == mState.mClip && state.mMatrix == mState.mMatrix &&
+            state.mAlpha == mState.mAlpha &&
+            drawModifiersEqual(state.mDrawModifiers, mState.mDrawModifiers);
+}
+
+void CachedDeferredList::finishDeferral(OpenGLRenderer& renderer) {
+    mList.optimizeBatches(renderer);
+
+    // deferring may have packed bitmaps in the atlas
+    mAtlasGenerationId = renderer.getCaches().textureCache.getAtlasGenerationId();
+    mDeferred = true;
+}
+
+status_t CachedDeferredList::replay(OpenGLRenderer& renderer, Rect& dirty) {
+    // restore the state of the renderer so that the following batches are not affected
+    const int saveCount = renderer.getSaveCount();
+    DrawModifiers restoreDrawModifiers = renderer.getDrawModifiers();
+
+    status_t status = replayBatchList(mList.mBatches, renderer, dirty);
+
+    renderer.restoreToCount(saveCount);
+    renderer.setDrawModifiers(restoreDrawModifiers);
+    return status;
+}
+
 }; // namespace uirenderer
 }; // namespace android
@@ -19,9 +19,11 @@
 
 #include <utils/Errors.h>
 #include <utils/LinearAllocator.h>
+#include <utils/RefBase.h>
 #include <utils/Vector.h>
 #include <utils/TinyHashMap.h>
 
+#include "BatchingStatistics.h"
 #include "Matrix.h"
 #include "OpenGLRenderer.h"
 #include "Rect.h"
@@ -44,6 +46,9 @@ class Batch;
 class DrawBatch;
 class MergingDrawBatch;
 
+class CachedDeferredList;
+class LayerDeferrer;
+
 typedef const void* mergeid_t;
 
 class DeferredDisplayState {
@@ -81,7 +86,7 @@ public:
 class DeferredDisplayList {
 public:
     DeferredDisplayList(const Rect& bounds, bool avoidOverdraw = true) :
-            mBounds(bounds), mAvoidOverdraw(avoidOverdraw) {
+            mBounds(bounds), mAvoidOverdraw(avoidOverdraw), mCached(false), mDeferrer(NULL) {
         clear();
     }
     ~DeferredDisplayList() { clear(); }
@@ -119,6 +124,30 @@ public:
      */
     void addDrawOp(OpenGLRenderer& renderer, DrawOp* op);
 
+    /**
+     * Returns true if a CachedDeferredList can be added at this point. The save stack must be
+     * empty for the save counts of the cached list to match at flush time, and cached lists
+     * never contain other cached lists.
+     */
+    bool canAddCachedList() const {
+        return !mCached && mSaveStack.isEmpty() && !recordingComplexClip();
+    }
+
+    /**
+     * Adds the operations of a cached list, which are replayed in place at flush time. The
+     * cached list is a barrier, operations are never reordered across it.
+     */
+    void addCachedList(OpenGLRenderer& renderer, const sp<CachedDeferredList>& cachedList);
+
+    const Rect& getBounds() const { return mBounds; }
+    bool avoidsOverdraw() const { return mAvoidOverdraw; }
+
+    /**
+     * Set while the list is deferred off the GL thread. The onDefer() step of
+     * operations that access the caches is then run by the deferrer.
+     */
+    void setDeferrer(LayerDeferrer* deferrer) { mDeferrer = deferrer; }
+
 private:
     DeferredDisplayState* createState() {
         return new (mAllocator) DeferredDisplayState();
@@ -146,10 +175,37 @@ private:
 
     void discardDrawingBatches(const unsigned int maxIndex);
 
+    /**
+     * Discards the batches hidden by opaque batches and reorders the remaining batches.
+     * Called at flush time, or once per cached list.
+     */
+    void optimizeBatches(OpenGLRenderer& renderer);
+
+    /**
+     * Removes the drawing ops entirely covered by opaque ops drawn after them.
+     */
+    void cullOccludedOps(BatchingStatistics& stats);
+
+    /**
+     * Hoists drawing batches across the earlier batches they don't overlap, merging their ops
+     * into compatible batches. Called at flush time, once all ops have been deferred.
+     */
+    void reorderBatches(BatchingStatistics& stats);
+
     // layer space bounds of rendering
     Rect mBounds;
     const bool mAvoidOverdraw;
 
+    // set if the list belongs to a CachedDeferredList
+    bool mCached;
+
+    LayerDeferrer* mDeferrer;
+
+    // Defer time counters. Layers are deferred on worker threads at the same
+    // time, each list counts into its own and flush() adds them to the
+    // frame's counters in Caches, on the rendering thread.
+    BatchingStatistics mStatistics;
+
     /**
      * At defer time, stores the *defer time* savecount of save/saveLayer ops that were deferred, so
      * that when an associated restoreToCount is deferred, it can be recorded as a
@@ -177,8 +233,74 @@ private:
     TinyHashMap<mergeid_t, DrawBatch*> mMergingBatches[kOpBatch_Count];
 
     LinearAllocator mAllocator;
+
+    friend class CachedDeferredList;
 };
 
+/**
+ * Operations of a display list subtree deferred in their own DeferredDisplayList, kept across
+ * frames. Since deferred operations depend on the state of the renderer, and on the content of
+ * the atlases, a cached list can only be reused if they match the state captured when the list
+ * was created.
+ *
+ * Cached lists are reference counted: a list replaced during a frame stays valid until the
+ * DeferredDisplayList it was added to is flushed.
+ */
+class CachedDeferredList : public LightRefBase<CachedDeferredList> {
+public:
+    CachedDeferredList(OpenGLRenderer& renderer, const DeferredDisplayList& parentList,
+            int replayFlags);
+
+    /**
+     * Returns true if the operations deferred in this list are valid for the current state of
+     * the renderer, and can be added to the specified list.
+     */
+    bool matchesState(OpenGLRenderer& renderer, const DeferredDisplayList& parentList,
+            int replayFlags) const;
+
+    /**
+     * List the operations of the display list subtree are deferred into.
+     */
+    DeferredDisplayList& getList() {
+        return mList;
+    }
+
+    /**
+     * Must be invoked once all the operations have been deferred in the list.
+     */
+    void finishDeferral(OpenGLRenderer& renderer);
+
+    /**
+     * Returns true if finishDeferral() was invoked.
+     */
+    bool isDeferred() const {
+        return mDeferred;
+    }
+
+    /**
+     * Replays the deferred operations, without clearing them. The renderer must be at
+     * the flush time save count of an empty save stack.
+     */
+    status_t replay(OpenGLRenderer& renderer, Rect& dirty);
+
+    /**
+     * Describes the display list subtree whose operations are cached, see DisplayList.
+     */
+    Vector<uint32_t> signature;
+
+private:
+    DeferredDisplayList mList;
+    bool mDeferred;
+
+    // State the deferred operations depend on
+    DeferredDisplayState mState;
+    int mViewportWidth;
+    int mViewportHeight;
+    int mReplayFlags;
+    uint32_t mAtlasGenerationId;
+    uint32_t mAssetAtlasGenerationId;
+}; // class CachedDeferredList
+
 /**
  * Struct containing information that instructs the defer
  */
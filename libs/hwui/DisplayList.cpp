@@ -16,6 +16,8 @@
 
 #include <SkCanvas.h>
 
+#include <cutils/atomic.h>
+
 #include "Debug.h"
 #include "DisplayList.h"
 #include "DisplayListOp.h"
@@ -24,6 +26,10 @@
 namespace android {
 namespace uirenderer {
 
+// Minimum number of operations a subtree must record for its deferred operations to be
+// cached: caching a subtree prevents its operations from being batched with the others
+#define DEFER_CACHE_MIN_OP_COUNT 32
+
 void DisplayList::outputLogBuffer(int fd) {
     DisplayListLogBuffer& logBuffer = DisplayListLogBuffer::getInstance();
     if (logBuffer.isEmpty()) {
@@ -40,6 +46,20 @@ void DisplayList::outputLogBuffer(int fd) {
     fprintf(file, "\nCaches:\n%s", cachesLog.string());
     fprintf(file, "\n");
 
+    String8 batchingLog;
+    Caches::getInstance().dumpBatchingStatistics(batchingLog);
+    fprintf(file, "%s\n", batchingLog.string());
+
+    String8 stateLog;
+    Caches::getInstance().dumpGLStateStatistics(stateLog);
+    fprintf(file, "%s\n", stateLog.string());
+
+    String8 gpuLog;
+    Caches::getInstance().dumpGpuProfile(gpuLog);
+    if (!gpuLog.isEmpty()) {
+        fprintf(file, "%s\n", gpuLog.string());
+    }
+
     fflush(file);
 }
 
@@ -64,6 +84,8 @@ void DisplayList::destroyDisplayListDeferred(DisplayList* displayList) {
 
 void DisplayList::clearResources() {
     mDisplayListData = NULL;
+    mDeferCache.clear();
+    mChildren.clear();
 
     mClipRectOp = NULL;
     mSaveLayerOp = NULL;
@@ -153,7 +175,83 @@ void DisplayList::reset() {
     init();
 }
 
+uint32_t DisplayList::nextContentId() {
+    static volatile int32_t sContentId = 0;
+    int32_t id;
+    do {
+        id = android_atomic_inc(&sContentId) + 1;
+    } while (id == 0);
+    return (uint32_t) id;
+}
+
+/**
+ * Compares two recordings of a display list, operation by operation, and computes the area
+ * whose rendering differs. Returns false if that area cannot be bounded, for instance when
+ * operations were added or removed.
+ */
+static bool computeContentDamage(const Vector<DisplayListOp*>& previousOps,
+        const Vector<DisplayListOp*>& ops, Rect& damage) {
+    if (previousOps.size() != ops.size()) {
+        return false;
+    }
+
+    OpDiffState state;
+    damage.setEmpty();
+
+    for (size_t i = 0; i < ops.size(); i++) {
+        DisplayListOp* previousOp = previousOps.itemAt(i);
+        DisplayListOp* op = ops.itemAt(i);
+
+        if (!op->isEquivalent(previousOp)) {
+            Rect bounds;
+            if (!op->getDamageBounds(state, bounds)) return false;
+            damage.unionWith(bounds);
+
+            if (!previousOp->getDamageBounds(state, bounds)) return false;
+            damage.unionWith(bounds);
+        }
+
+        op->updateDiffState(state);
+    }
+
+    if (!damage.isEmpty()) {
+        damage.snapGeometryToPixelBoundaries(true);
+    }
+    return true;
+}
+
+bool DisplayList::getContentDamage(uint32_t contentId, Rect& damage) const {
+    if (contentId == 0 || mHasExternalContent) {
+        return false;
+    }
+
+    // The view properties are applied to the content when it is rendered
+    if (mLeft != 0 || mTop != 0 || mStaticMatrix || mAnimationMatrix ||
+            mMatrixFlags != 0 || mAlpha < 1.0f) {
+        return false;
+    }
+
+    if (contentId == mContentId) {
+        damage.setEmpty();
+        return true;
+    }
+    if (contentId == mPreviousContentId) {
+        damage.set(mContentDamage);
+        return true;
+    }
+    return false;
+}
+
 void DisplayList::initFromDisplayListRenderer(const DisplayListRenderer& recorder, bool reusing) {
+    // The previous recording is compared with the new one before its resources are released
+    uint32_t previousContentId = 0;
+    Rect damage;
+    if (reusing && mDisplayListData != NULL && !mHasExternalContent &&
+            computeContentDamage(mDisplayListData->displayListOps,
+                    recorder.getDisplayListData()->displayListOps, damage)) {
+        previousContentId = mContentId;
+    }
+
     if (reusing) {
         // re-using display list - clear out previous allocations
         clearResources();
@@ -161,6 +259,9 @@ void DisplayList::initFromDisplayListRenderer(const DisplayListRenderer& recorde
 
     init();
 
+    mPreviousContentId = previousContentId;
+    mContentDamage.set(damage);
+
     mDisplayListData = recorder.getDisplayListData();
     mSize = mDisplayListData->allocator.usedSize();
 
@@ -169,7 +270,7 @@ void DisplayList::initFromDisplayListRenderer(const DisplayListRenderer& recorde
     }
 
     // allocate reusable ops for state-deferral
-    LinearAllocator& alloc = mDisplayListData->allocator;
+    PooledLinearAllocator& alloc = mDisplayListData->allocator;
     mClipRectOp = new (alloc) ClipRectOp();
     mSaveLayerOp = new (alloc) SaveLayerOp();
     mSaveOp = new (alloc) SaveOp();
@@ -180,6 +281,9 @@ void DisplayList::initFromDisplayListRenderer(const DisplayListRenderer& recorde
     }
 
     mFunctorCount = recorder.getFunctorCount();
+    mHasExternalContent = mFunctorCount > 0 || recorder.hasChildren() ||
+            recorder.getLayers().size() > 0;
+    mChildren.appendVector(recorder.getChildren());
 
     Caches& caches = Caches::getInstance();
     caches.registerFunctors(mFunctorCount);
@@ -244,6 +348,10 @@ void DisplayList::init() {
     mSize = 0;
     mIsRenderable = true;
     mFunctorCount = 0;
+    mContentId = nextContentId();
+    mPreviousContentId = 0;
+    mContentDamage.setEmpty();
+    mHasExternalContent = false;
     mLeft = 0;
     mTop = 0;
     mRight = 0;
@@ -304,6 +412,18 @@ float DisplayList::getPivotY() {
     return mPivotY;
 }
 
+/**
+ * Fading a view with overlapping rendering requires a layer for the
+ * duration of the animation, see setViewProperties(). Allocating it ahead
+ * of the first frame avoids a stall in the middle of that frame.
+ */
+void DisplayList::prewarmAlphaLayer() {
+    if (!mCaching && mHasOverlappingRendering && mWidth > 0 && mHeight > 0 &&
+            Caches::hasInstance()) {
+        Caches::getInstance().layerCache.prewarm(mWidth, mHeight);
+    }
+}
+
 void DisplayList::updateMatrix() {
     if (mMatrixDirty) {
         if (!mTransformMatrix) {
@@ -460,10 +580,168 @@ private:
 };
 
 void DisplayList::defer(DeferStateStruct& deferStruct, const int level) {
+    if (CC_UNLIKELY(deferStruct.mRenderer.getCaches().deferCacheEnabled) &&
+            deferFromCache(deferStruct, level)) {
+        return;
+    }
+
     DeferOperationHandler handler(deferStruct, level);
     iterate<DeferOperationHandler>(deferStruct.mRenderer, handler, level);
 }
 
+/**
+ * Builds the signature of a display list subtree, made of the content id and of the view
+ * properties of each display list of the subtree, or compares the subtree against a signature
+ * built previously.
+ */
+class DeferSignature {
+public:
+    DeferSignature(Vector<uint32_t>& signature, bool compare)
+        : mSignature(signature), mCompare(compare), mIndex(0), mMatches(true), mOpCount(0) {}
+
+    void add(uint32_t value) {
+        if (!mCompare) {
+            mSignature.add(value);
+        } else if (mMatches) {
+            mMatches = mIndex < mSignature.size() && mSignature[mIndex] == value;
+            mIndex++;
+        }
+    }
+
+    void addFloat(float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(uint32_t));
+        add(bits);
+    }
+
+    void addMatrix(const SkMatrix* matrix) {
+        for (int i = 0; i < 9; i++) {
+            addFloat(matrix->get(i));
+        }
+    }
+
+    void addOps(size_t count) {
+        mOpCount += count;
+    }
+
+    /**
+     * Returns true if the subtree matches the signature it was compared against.
+     */
+    bool matches() const {
+        return mMatches && mIndex == mSignature.size();
+    }
+
+    size_t getOpCount() const {
+        return mOpCount;
+    }
+
+private:
+    Vector<uint32_t>& mSignature;
+    const bool mCompare;
+    size_t mIndex;
+    bool mMatches;
+    size_t mOpCount;
+};
+
+/**
+ * Appends the content id and the view properties of this display list, and of its children,
+ * to the signature. Returns false if the subtree draws functors or layers, whose rendering can
+ * change without the signature changing.
+ */
+bool DisplayList::appendDeferSignature(DeferSignature& signature) {
+    if (mFunctorCount > 0 || !mLayers.isEmpty()) {
+        return false;
+    }
+
+    updateMatrix();
+    signature.add(mContentId);
+    signature.add(mIsRenderable | (mClipToBounds << 1) | (mCaching << 2) |
+            (mHasOverlappingRendering << 3));
+    signature.add(mLeft);
+    signature.add(mTop);
+    signature.add(mRight);
+    signature.add(mBottom);
+    signature.addFloat(mAlpha);
+
+    signature.add(mStaticMatrix ? 1 : (mAnimationMatrix ? 2 : 0));
+    if (mStaticMatrix) {
+        signature.addMatrix(mStaticMatrix);
+    } else if (mAnimationMatrix) {
+        signature.addMatrix(mAnimationMatrix);
+    }
+    signature.add(mMatrixFlags);
+    if (mMatrixFlags == TRANSLATION) {
+        signature.addFloat(mTranslationX);
+        signature.addFloat(mTranslationY);
+    } else if (mMatrixFlags != 0) {
+        signature.addMatrix(mTransformMatrix);
+    }
+
+    if (mDisplayListData != NULL) {
+        signature.addOps(mDisplayListData->displayListOps.size());
+    }
+
+    signature.add(mChildren.size());
+    for (size_t i = 0; i < mChildren.size(); i++) {
+        DisplayList* child = mChildren.itemAt(i);
+        if (child && !child->appendDeferSignature(signature)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Keeps the deferred operations of static subtrees across frames. Each time the display list is
+ * deferred, the content and properties of its subtree, as well as the state of the renderer,
+ * are compared with the previous frame. If nothing changed, the subtree is deferred one last time
+ * in a CachedDeferredList, which is then added as is to the deferred display lists of the
+ * following frames, for as long as nothing changes.
+ *
+ * Returns true if the operations of the subtree were added to the deferred display list.
+ */
+bool DisplayList::deferFromCache(DeferStateStruct& deferStruct, const int level) {
+    OpenGLRenderer& renderer = deferStruct.mRenderer;
+    DeferredDisplayList& deferredList = deferStruct.mDeferredList;
+
+    if (!deferredList.canAddCachedList()) {
+        mDeferCache.clear();
+        return false;
+    }
+
+    if (mDeferCache != NULL &&
+            mDeferCache->matchesState(renderer, deferredList, deferStruct.mReplayFlags)) {
+        DeferSignature signature(mDeferCache->signature, true);
+        if (appendDeferSignature(signature) && signature.matches()) {
+            if (!mDeferCache->isDeferred()) {
+                DeferStateStruct cacheStruct(mDeferCache->getList(), renderer,
+                        deferStruct.mReplayFlags);
+                DeferOperationHandler handler(cacheStruct, level);
+                iterate<DeferOperationHandler>(renderer, handler, level);
+                mDeferCache->finishDeferral(renderer);
+            } else if (mSize != 0 && mAlpha > 0) {
+                // iterate() is skipped, leave the renderer in the same state
+                renderer.setOverrideLayerAlpha(1.0f);
+            }
+
+            deferredList.addCachedList(renderer, mDeferCache);
+            return true;
+        }
+    }
+
+    // Something changed since the previous frame, the operations are cached
+    // if nothing changes until the next frame
+    mDeferCache.clear();
+
+    Vector<uint32_t> signatureData;
+    DeferSignature signature(signatureData, false);
+    if (appendDeferSignature(signature) && signature.getOpCount() >= DEFER_CACHE_MIN_OP_COUNT) {
+        mDeferCache = new CachedDeferredList(renderer, deferredList, deferStruct.mReplayFlags);
+        mDeferCache->signature = signatureData;
+    }
+    return false;
+}
+
 class ReplayOperationHandler {
 public:
     ReplayOperationHandler(ReplayStateStruct& replayStruct, int level)
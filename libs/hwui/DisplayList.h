@@ -26,7 +26,6 @@
 
 #include <private/hwui/DrawGlInfo.h>
 
-#include <utils/LinearAllocator.h>
 #include <utils/RefBase.h>
 #include <utils/SortedVector.h>
 #include <utils/String8.h>
@@ -37,6 +36,8 @@
 #include <androidfw/ResourceTypes.h>
 
 #include "Debug.h"
+#include "Rect.h"
+#include "utils/PooledLinearAllocator.h"
 
 #define TRANSLATION 0x0001
 #define ROTATION    0x0002
@@ -52,7 +53,9 @@ class SkRegion;
 namespace android {
 namespace uirenderer {
 
+class CachedDeferredList;
 class DeferredDisplayList;
+class DeferSignature;
 class DisplayListOp;
 class DisplayListRenderer;
 class OpenGLRenderer;
@@ -89,7 +92,7 @@ struct ReplayStateStruct {
  */
 class DisplayListData : public LightRefBase<DisplayListData> {
 public:
-    LinearAllocator allocator;
+    PooledLinearAllocator allocator;
     Vector<DisplayListOp*> displayListOps;
 };
 
@@ -169,6 +172,7 @@ public:
     void setAlpha(float alpha) {
         alpha = fminf(1.0f, fmaxf(0.0f, alpha));
         if (alpha != mAlpha) {
+            if (mAlpha >= 1.0f && alpha < 1.0f) prewarmAlphaLayer();
             mAlpha = alpha;
         }
     }
@@ -453,7 +457,25 @@ public:
         return mHeight;
     }
 
+    /**
+     * Identifies the content recorded in this display list. Content ids are unique
+     * across display lists and change every time a display list is recorded or reset.
+     */
+    uint32_t getContentId() const {
+        return mContentId;
+    }
+
+    /**
+     * Returns true if the area of the display list whose rendering changed since
+     * the content identified by contentId can be bounded. If so, damage is set to
+     * that area, in the display list's coordinate space. The damage is empty if the
+     * content has not changed.
+     */
+    bool getContentDamage(uint32_t contentId, Rect& damage) const;
+
 private:
+    friend class DisplayListCapture; // give the capture access to the ops and properties
+
     void outputViewProperties(const int level);
 
     template <class T>
@@ -468,6 +490,14 @@ private:
 
     void updateMatrix();
 
+    void prewarmAlphaLayer();
+
+    static uint32_t nextContentId();
+
+    bool deferFromCache(DeferStateStruct& deferStruct, const int level);
+
+    bool appendDeferSignature(DeferSignature& signature);
+
     class TextContainer {
     public:
         size_t length() const {
@@ -502,6 +532,20 @@ private:
     bool mIsRenderable;
     uint32_t mFunctorCount;
 
+    // See getContentDamage()
+    uint32_t mContentId;
+    uint32_t mPreviousContentId;
+    Rect mContentDamage;
+    // Set when the display list draws children, layers or functors, whose
+    // rendering can change without this display list being recorded again
+    bool mHasExternalContent;
+
+    // Display lists drawn by this display list, in drawing order
+    Vector<DisplayList*> mChildren;
+
+    // See deferFromCache()
+    sp<CachedDeferredList> mDeferCache;
+
     String8 mName;
     bool mDestroyed; // used for debugging crash, TODO: remove once invalid state crash fixed
 
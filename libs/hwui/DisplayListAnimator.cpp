@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <math.h>
+
+#include "DisplayList.h"
+#include "DisplayListAnimator.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Property animation
+///////////////////////////////////////////////////////////////////////////////
+
+PropertyAnimation::PropertyAnimation(DisplayList* target, Property property):
+        mTarget(target), mProperty(property),
+        mInterpolator(kInterpolatorAccelerateDecelerate), mFactor(1.0f),
+        mStartTime(0), mDuration(0), mRepeatCount(0), mRepeatMode(kRepeatRestart) {
+}
+
+void PropertyAnimation::setKeyframes(const float* fractions, const float* values, size_t count) {
+    mKeyframes.clear();
+    mKeyframes.setCapacity(count);
+    for (size_t i = 0; i < count; i++) {
+        Keyframe keyframe = { fractions[i], values[i] };
+        mKeyframes.add(keyframe);
+    }
+}
+
+void PropertyAnimation::setInterpolator(Interpolator interpolator, float factor) {
+    mInterpolator = interpolator;
+    mFactor = factor;
+}
+
+void PropertyAnimation::setInterpolatorTable(const float* values, size_t count) {
+    mInterpolator = kInterpolatorTable;
+    mTable.clear();
+    mTable.appendArray(values, count);
+}
+
+void PropertyAnimation::setTiming(nsecs_t startTime, nsecs_t duration,
+        int32_t repeatCount, RepeatMode repeatMode) {
+    mStartTime = startTime;
+    mDuration = duration;
+    mRepeatCount = repeatCount;
+    mRepeatMode = repeatMode;
+}
+
+/**
+ * Same formulas as the interpolators of android.view.animation.
+ */
+float PropertyAnimation::interpolate(float t) const {
+    switch (mInterpolator) {
+        case kInterpolatorLinear:
+            return t;
+        case kInterpolatorAccelerate:
+            return mFactor == 1.0f ? t * t : powf(t, 2.0f * mFactor);
+        case kInterpolatorDecelerate:
+            return mFactor == 1.0f ? 1.0f - (1.0f - t) * (1.0f - t) :
+                    1.0f - powf(1.0f - t, 2.0f * mFactor);
+        case kInterpolatorAccelerateDecelerate:
+            return cosf((t + 1.0f) * M_PI) / 2.0f + 0.5f;
+        case kInterpolatorAnticipate:
+            return t * t * ((mFactor + 1.0f) * t - mFactor);
+        case kInterpolatorOvershoot:
+            t -= 1.0f;
+            return t * t * ((mFactor + 1.0f) * t + mFactor) + 1.0f;
+        case kInterpolatorTable: {
+            const size_t count = mTable.size();
+            if (count == 0) return t;
+            if (count == 1 || t <= 0.0f) return mTable[0];
+            if (t >= 1.0f) return mTable[count - 1];
+            float position = t * (count - 1);
+            size_t index = (size_t) position;
+            float delta = position - index;
+            return mTable[index] + delta * (mTable[index + 1] - mTable[index]);
+        }
+    }
+    return t;
+}
+
+/**
+ * Same as KeyframeSet.getValue(): fractions outside of [0..1], produced by
+ * anticipate and overshoot interpolators, extrapolate the first or last
+ * interval.
+ */
+float PropertyAnimation::evaluate(float fraction) const {
+    const size_t count = mKeyframes.size();
+    if (count == 0) return 0.0f;
+    if (count == 1) return mKeyframes[0].value;
+
+    size_t next = 1;
+    if (fraction >= 1.0f) {
+        next = count - 1;
+    } else if (fraction > 0.0f) {
+        while (next < count - 1 && fraction >= mKeyframes[next].fraction) {
+            next++;
+        }
+    }
+
+    const Keyframe& a = mKeyframes[next - 1];
+    const Keyframe& b = mKeyframes[next];
+    float interval = b.fraction - a.fraction;
+    float intervalFraction = interval > 0.0f ? (fraction - a.fraction) / interval : 1.0f;
+    return a.value + intervalFraction * (b.value - a.value);
+}
+
+void PropertyAnimation::apply(float value) {
+    switch (mProperty) {
+        case kPropertyAlpha:
+            mTarget->setAlpha(value);
+            break;
+        case kPropertyTranslationX:
+            mTarget->setTranslationX(value);
+            break;
+        case kPropertyTranslationY:
+            mTarget->setTranslationY(value);
+            break;
+        case kPropertyRotation:
+            mTarget->setRotation(value);
+            break;
+        case kPropertyRotationX:
+            mTarget->setRotationX(value);
+            break;
+        case kPropertyRotationY:
+            mTarget->setRotationY(value);
+            break;
+        case kPropertyScaleX:
+            mTarget->setScaleX(value);
+            break;
+        case kPropertyScaleY:
+            mTarget->setScaleY(value);
+            break;
+        case kPropertyPivotX:
+            mTarget->setPivotX(value);
+            break;
+        case kPropertyPivotY:
+            mTarget->setPivotY(value);
+            break;
+        case kPropertyCameraDistance:
+            mTarget->setCameraDistance(value);
+            break;
+        // IntKeyframeSet truncates the evaluated value
+        case kPropertyLeft:
+            mTarget->setLeft((int) value);
+            break;
+        case kPropertyTop:
+            mTarget->setTop((int) value);
+            break;
+        case kPropertyRight:
+            mTarget->setRight((int) value);
+            break;
+        case kPropertyBottom:
+            mTarget->setBottom((int) value);
+            break;
+    }
+}
+
+bool PropertyAnimation::animate(nsecs_t frameTime) {
+    // Same as ValueAnimator.animationFrame()
+    float fraction = mDuration > 0 ? float(frameTime - mStartTime) / mDuration : 1.0f;
+    if (fraction < 0.0f) fraction = 0.0f;
+
+    bool running = true;
+    int32_t iteration = 0;
+    if (fraction >= 1.0f) {
+        iteration = (int32_t) fraction;
+        if (mRepeatCount == kRepeatInfinite || iteration <= mRepeatCount) {
+            fraction = fmodf(fraction, 1.0f);
+        } else {
+            iteration = mRepeatCount;
+            fraction = 1.0f;
+            running = false;
+        }
+    }
+    if (mRepeatMode == kRepeatReverse && (iteration & 1)) {
+        fraction = 1.0f - fraction;
+    }
+
+    apply(evaluate(interpolate(fraction)));
+    return running;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Animator
+///////////////////////////////////////////////////////////////////////////////
+
+DisplayListAnimator::DisplayListAnimator(): mNextId(1) {
+}
+
+DisplayListAnimator::~DisplayListAnimator() {
+    for (size_t i = 0; i < mAnimations.size(); i++) {
+        delete mAnimations[i].animation;
+    }
+}
+
+int32_t DisplayListAnimator::start(PropertyAnimation* animation) {
+    Entry entry = { mNextId, animation };
+    mAnimations.add(entry);
+
+    // Ids are reported back to the caller, 0 is never used
+    if (++mNextId <= 0) mNextId = 1;
+    return entry.id;
+}
+
+void DisplayListAnimator::removeAt(size_t index) {
+    delete mAnimations[index].animation;
+    mAnimations.removeAt(index);
+}
+
+void DisplayListAnimator::cancel(int32_t id) {
+    for (size_t i = 0; i < mAnimations.size(); i++) {
+        if (mAnimations[i].id == id) {
+            removeAt(i);
+            return;
+        }
+    }
+}
+
+void DisplayListAnimator::cancel(DisplayList* target) {
+    for (size_t i = 0; i < mAnimations.size(); ) {
+        if (mAnimations[i].animation->getTarget() == target) {
+            removeAt(i);
+        } else {
+            i++;
+        }
+    }
+}
+
+size_t DisplayListAnimator::animate(nsecs_t frameTime) {
+    for (size_t i = 0; i < mAnimations.size(); ) {
+        if (!mAnimations[i].animation->animate(frameTime)) {
+            mEnded.add(mAnimations[i].id);
+            removeAt(i);
+        } else {
+            i++;
+        }
+    }
+    return mAnimations.size();
+}
+
+size_t DisplayListAnimator::getEndedAnimations(int32_t* ids, size_t count) {
+    if (count > mEnded.size()) count = mEnded.size();
+    for (size_t i = 0; i < count; i++) {
+        ids[i] = mEnded[i];
+    }
+    mEnded.removeItemsAt(0, count);
+    return count;
+}
+
+}; // namespace uirenderer
+}; // namespace android
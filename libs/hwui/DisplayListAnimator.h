@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_DISPLAY_LIST_ANIMATOR_H
+#define ANDROID_HWUI_DISPLAY_LIST_ANIMATOR_H
+
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include <cutils/compiler.h>
+
+namespace android {
+namespace uirenderer {
+
+class DisplayList;
+
+/**
+ * Animates a single property of a display list. Mirrors what a
+ * PropertyValuesHolder driven by a ValueAnimator computes every frame:
+ * the elapsed time gives a fraction, which goes through the interpolator
+ * and then through the keyframes.
+ */
+class PropertyAnimation {
+public:
+    enum Property {
+        kPropertyAlpha = 0,
+        kPropertyTranslationX,
+        kPropertyTranslationY,
+        kPropertyRotation,
+        kPropertyRotationX,
+        kPropertyRotationY,
+        kPropertyScaleX,
+        kPropertyScaleY,
+        kPropertyPivotX,
+        kPropertyPivotY,
+        kPropertyCameraDistance,
+        // Integer properties
+        kPropertyLeft,
+        kPropertyTop,
+        kPropertyRight,
+        kPropertyBottom
+    };
+
+    /**
+     * Interpolators of android.view.animation evaluated natively. Any other
+     * interpolator is sampled by the caller and evaluated from a table.
+     */
+    enum Interpolator {
+        kInterpolatorLinear = 0,
+        kInterpolatorAccelerate,
+        kInterpolatorDecelerate,
+        kInterpolatorAccelerateDecelerate,
+        kInterpolatorAnticipate,
+        kInterpolatorOvershoot,
+        kInterpolatorTable
+    };
+
+    // Same values as ValueAnimator.RESTART, REVERSE and INFINITE
+    enum RepeatMode {
+        kRepeatRestart = 1,
+        kRepeatReverse = 2
+    };
+    static const int32_t kRepeatInfinite = -1;
+
+    ANDROID_API PropertyAnimation(DisplayList* target, Property property);
+
+    /**
+     * Sets the keyframes, at least two. Fractions must be increasing, the
+     * first one is 0 and the last one 1.
+     */
+    ANDROID_API void setKeyframes(const float* fractions, const float* values, size_t count);
+
+    /**
+     * Sets the interpolator. The factor is the factor of the accelerate and
+     * decelerate interpolators, or the tension of the anticipate and
+     * overshoot interpolators.
+     */
+    ANDROID_API void setInterpolator(Interpolator interpolator, float factor);
+
+    /**
+     * Interpolates with a table of values sampled at evenly spaced fractions
+     * from 0 to 1, both included.
+     */
+    ANDROID_API void setInterpolatorTable(const float* values, size_t count);
+
+    ANDROID_API void setTiming(nsecs_t startTime, nsecs_t duration,
+            int32_t repeatCount, RepeatMode repeatMode);
+
+    DisplayList* getTarget() const {
+        return mTarget;
+    }
+
+    /**
+     * Writes the value of the property at the specified time into the target.
+     * Returns false once the animation has ended; the end value is then
+     * written.
+     */
+    bool animate(nsecs_t frameTime);
+
+private:
+    struct Keyframe {
+        float fraction;
+        float value;
+    };
+
+    float interpolate(float fraction) const;
+    float evaluate(float fraction) const;
+    void apply(float value);
+
+    DisplayList* mTarget;
+    Property mProperty;
+
+    Vector<Keyframe> mKeyframes;
+
+    Interpolator mInterpolator;
+    float mFactor;
+    Vector<float> mTable;
+
+    nsecs_t mStartTime;
+    nsecs_t mDuration;
+    int32_t mRepeatCount;
+    RepeatMode mRepeatMode;
+}; // class PropertyAnimation
+
+/**
+ * Runs property animations of display lists, so that the values of every
+ * running animation are computed and set in a single call per frame instead
+ * of one reflective call per property from the UI toolkit.
+ *
+ * Must only be used from the thread that sets display list properties.
+ * Animations must be cancelled before their display list is destroyed.
+ */
+class DisplayListAnimator {
+public:
+    ANDROID_API DisplayListAnimator();
+    ANDROID_API ~DisplayListAnimator();
+
+    /**
+     * Takes ownership of the animation and returns its id, which is never 0.
+     */
+    ANDROID_API int32_t start(PropertyAnimation* animation);
+
+    /**
+     * Stops an animation, leaving its property at the last computed value.
+     */
+    ANDROID_API void cancel(int32_t id);
+
+    /**
+     * Stops all the animations of the specified display list.
+     */
+    ANDROID_API void cancel(DisplayList* target);
+
+    /**
+     * Computes and sets the values of every running animation. Returns the
+     * number of animations still running.
+     */
+    ANDROID_API size_t animate(nsecs_t frameTime);
+
+    /**
+     * Copies the ids of up to count animations that ended since the last
+     * call and returns how many were copied. Cancelled animations are not
+     * reported.
+     */
+    ANDROID_API size_t getEndedAnimations(int32_t* ids, size_t count);
+
+private:
+    struct Entry {
+        int32_t id;
+        PropertyAnimation* animation;
+    };
+
+    void removeAt(size_t index);
+
+    Vector<Entry> mAnimations;
+    Vector<int32_t> mEnded;
+    int32_t mNextId;
+}; // class DisplayListAnimator
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_DISPLAY_LIST_ANIMATOR_H
@@ -0,0 +1,1546 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+
+#include <SkRegion.h>
+#include <SkTypeface.h>
+#include <SkXfermode.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/Log.h>
+
+#include "Caches.h"
+#include "DisplayList.h"
+#include "DisplayListCapture.h"
+#include "DisplayListOp.h"
+#include "DisplayListRenderer.h"
+#include "OpenGLRenderer.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// File format
+///////////////////////////////////////////////////////////////////////////////
+
+/*
+ * All values are stored as 32 bits words in the native byte order. Byte arrays
+ * (text and pixels) are padded to a multiple of 4 bytes. A file contains:
+ *
+ *   header         magic, version, dropped ops count
+ *   bitmaps        count, then config, width, height, row bytes, opaque, pixels
+ *   nine-patches   count, then the divs, paddings and colors of each patch
+ *   paths          count, then fill type and verbs/points, ended by kDone_Verb
+ *   paints         count, then the attributes of each paint
+ *   display lists  count, then name, view properties and ops, ended by kOp_End
+ *
+ * Ops refer to the resources by their index in the tables above, -1 stands for
+ * NULL. Display lists refer to their children by index as well.
+ */
+enum CaptureOp {
+    kOp_End = 0,
+    kOp_Save,
+    kOp_Restore,
+    kOp_RestoreToCount,
+    kOp_SaveLayer,
+    kOp_Translate,
+    kOp_Rotate,
+    kOp_Scale,
+    kOp_Skew,
+    kOp_SetMatrix,
+    kOp_ConcatMatrix,
+    kOp_ClipRect,
+    kOp_ClipPath,
+    kOp_ClipRegion,
+    kOp_ResetShader,
+    kOp_ResetColorFilter,
+    kOp_ResetShadow,
+    kOp_SetupShadow,
+    kOp_ResetPaintFilter,
+    kOp_SetupPaintFilter,
+    kOp_DrawDisplayList,
+    kOp_DrawBitmap,
+    kOp_DrawBitmapMatrix,
+    kOp_DrawBitmapRect,
+    kOp_DrawBitmapData,
+    kOp_DrawBitmapMesh,
+    kOp_DrawPatch,
+    kOp_DrawColor,
+    kOp_DrawRect,
+    kOp_DrawRoundRect,
+    kOp_DrawCircle,
+    kOp_DrawOval,
+    kOp_DrawArc,
+    kOp_DrawPath,
+    kOp_DrawLines,
+    kOp_DrawPoints,
+    kOp_DrawTextOnPath,
+    kOp_DrawPosText,
+    kOp_DrawText,
+    kOp_DrawRects
+};
+
+#define CAPTURE_ALIGN(x) (((x) + 3) & ~3)
+
+///////////////////////////////////////////////////////////////////////////////
+// Streams
+///////////////////////////////////////////////////////////////////////////////
+
+class CaptureStream {
+public:
+    void writeInt(int32_t value) {
+        mData.appendArray((const uint8_t*) &value, sizeof(int32_t));
+    }
+
+    void writeFloat(float value) {
+        mData.appendArray((const uint8_t*) &value, sizeof(float));
+    }
+
+    void writeFloats(const float* values, int count) {
+        mData.appendArray((const uint8_t*) values, count * sizeof(float));
+    }
+
+    void writeBytes(const void* data, size_t size) {
+        writeInt(size);
+        if (size > 0) {
+            mData.appendArray((const uint8_t*) data, size);
+            const size_t padding = CAPTURE_ALIGN(size) - size;
+            if (padding > 0) mData.insertAt(0, mData.size(), padding);
+        }
+    }
+
+    void writeString(const char* string) {
+        writeBytes(string, strlen(string));
+    }
+
+    void writeRect(float left, float top, float right, float bottom) {
+        writeFloat(left);
+        writeFloat(top);
+        writeFloat(right);
+        writeFloat(bottom);
+    }
+
+    void writeMatrix(const SkMatrix* matrix) {
+        writeInt(matrix != NULL);
+        if (matrix) {
+            for (int i = 0; i < 9; i++) {
+                writeFloat(matrix->get(i));
+            }
+        }
+    }
+
+    size_t size() const {
+        return mData.size();
+    }
+
+    const uint8_t* data() const {
+        return mData.array();
+    }
+
+    void append(const CaptureStream& stream) {
+        mData.appendVector(stream.mData);
+    }
+
+private:
+    Vector<uint8_t> mData;
+}; // class CaptureStream
+
+class CaptureReader {
+public:
+    CaptureReader(const uint8_t* data, size_t size):
+            mData(data), mSize(size), mPosition(0), mError(false) {
+    }
+
+    bool hasError() const {
+        return mError;
+    }
+
+    void setError() {
+        mError = true;
+    }
+
+    int32_t readInt() {
+        int32_t value = 0;
+        const void* data = read(sizeof(int32_t));
+        if (data) memcpy(&value, data, sizeof(int32_t));
+        return value;
+    }
+
+    float readFloat() {
+        float value = 0.0f;
+        const void* data = read(sizeof(float));
+        if (data) memcpy(&value, data, sizeof(float));
+        return value;
+    }
+
+    const float* readFloats(int count) {
+        if (count < 0) {
+            mError = true;
+            return NULL;
+        }
+        return (const float*) read(count * sizeof(float));
+    }
+
+    const void* readBytes(size_t* size) {
+        int32_t length = readInt();
+        if (length < 0) {
+            mError = true;
+            length = 0;
+        }
+        *size = length;
+        if (length == 0) return NULL;
+        return read(CAPTURE_ALIGN(length));
+    }
+
+    bool readMatrix(SkMatrix* matrix) {
+        if (!readInt()) return false;
+
+        const float* values = readFloats(9);
+        if (!values) return false;
+
+        matrix->set9(values);
+        return true;
+    }
+
+    /**
+     * Reads an index in a table of the specified size, -1 is accepted as NULL.
+     */
+    int readIndex(size_t tableSize) {
+        int32_t index = readInt();
+        if (index < -1 || index >= int32_t(tableSize)) {
+            mError = true;
+            return -1;
+        }
+        return index;
+    }
+
+private:
+    const void* read(size_t size) {
+        if (mError || size > mSize - mPosition) {
+            mError = true;
+            return NULL;
+        }
+        const void* data = mData + mPosition;
+        mPosition += size;
+        return data;
+    }
+
+    const uint8_t* mData;
+    size_t mSize;
+    size_t mPosition;
+    bool mError;
+}; // class CaptureReader
+
+///////////////////////////////////////////////////////////////////////////////
+// Capture
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Renderer the ops of the captured display lists are replayed to. Instead of
+ * drawing, each call is written to the stream of the display list being captured.
+ */
+class CaptureRenderer: public OpenGLRenderer {
+public:
+    CaptureRenderer(): mStream(NULL), mDroppedOpsCount(0) {
+    }
+
+    virtual ~CaptureRenderer() {
+        for (size_t i = 0; i < mDisplayLists.size(); i++) {
+            delete mDisplayLists.itemAt(i);
+        }
+    }
+
+    /**
+     * Captures the specified display list and its children, returns the index
+     * of the display list.
+     */
+    int captureDisplayList(DisplayList* displayList) {
+        ssize_t index = mDisplayListIndices.indexOfKey(displayList);
+        if (index >= 0) return mDisplayListIndices.valueAt(index);
+
+        CaptureStream* previousStream = mStream;
+        CaptureStream* stream = new CaptureStream();
+        mStream = stream;
+
+        stream->writeString(displayList->getName());
+        writeViewProperties(displayList);
+
+        Rect dirty;
+        ReplayStateStruct replayStruct(*this, dirty, 0);
+
+        const Vector<DisplayListOp*>& ops = DisplayListCapture::getOps(displayList);
+        for (size_t i = 0; i < ops.size(); i++) {
+            DisplayListOp* op = ops.itemAt(i);
+            const char* name = op->name();
+
+            if (!strcmp(name, "DrawDisplayList")) {
+                int flags;
+                DisplayList* child = DisplayListCapture::getChild(op, &flags);
+                if (child && child->isRenderable()) {
+                    const int childIndex = captureDisplayList(child);
+                    mStream->writeInt(kOp_DrawDisplayList);
+                    mStream->writeInt(childIndex);
+                    mStream->writeInt(flags);
+                }
+            } else if (!strcmp(name, "DrawPatch")) {
+                Res_png_9patch* patch;
+                Rect bounds;
+                SkPaint* paint;
+                SkBitmap* bitmap = DisplayListCapture::getPatch(op, &patch, &bounds, &paint);
+                mStream->writeInt(kOp_DrawPatch);
+                mStream->writeInt(getBitmapIndex(bitmap));
+                mStream->writeInt(getPatchIndex(patch));
+                mStream->writeRect(bounds.left, bounds.top, bounds.right, bounds.bottom);
+                mStream->writeInt(getPaintIndex(paint));
+            } else {
+                // Property and state ops are replayed without any save count offset,
+                // the recorded save counts are captured as is
+                op->replay(replayStruct, 0, 0, false);
+            }
+        }
+        stream->writeInt(kOp_End);
+
+        mStream = previousStream;
+
+        index = mDisplayLists.size();
+        mDisplayLists.add(stream);
+        mDisplayListIndices.add(displayList, index);
+        return index;
+    }
+
+    bool write(const char* path) {
+        FILE* file = fopen(path, "wb");
+        if (!file) {
+            ALOGE("Could not open %s to write the display list capture", path);
+            return false;
+        }
+
+        CaptureStream header;
+        header.writeInt(DISPLAY_LIST_CAPTURE_MAGIC);
+        header.writeInt(DISPLAY_LIST_CAPTURE_VERSION);
+        header.writeInt(mDroppedOpsCount);
+
+        header.writeInt(mBitmapIndices.size());
+        header.append(mBitmaps);
+        header.writeInt(mPatchIndices.size());
+        header.append(mPatches);
+        header.writeInt(mPathIndices.size());
+        header.append(mPaths);
+        header.writeInt(mPaintIndices.size());
+        header.append(mPaints);
+
+        header.writeInt(mDisplayLists.size());
+        bool success = fwrite(header.data(), 1, header.size(), file) == header.size();
+        for (size_t i = 0; success && i < mDisplayLists.size(); i++) {
+            const CaptureStream* stream = mDisplayLists.itemAt(i);
+            success = fwrite(stream->data(), 1, stream->size(), file) == stream->size();
+        }
+
+        if (fclose(file) || !success) {
+            ALOGE("Could not write the display list capture to %s", path);
+            return false;
+        }
+
+        ALOGD("Captured %d display lists to %s, %d ops dropped",
+                mDisplayLists.size(), path, mDroppedOpsCount);
+        return true;
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // State
+    ///////////////////////////////////////////////////////////////////////////
+
+    virtual int save(int flags) {
+        mStream->writeInt(kOp_Save);
+        mStream->writeInt(flags);
+        return 0;
+    }
+
+    virtual void restore() {
+        mStream->writeInt(kOp_Restore);
+    }
+
+    virtual void restoreToCount(int saveCount) {
+        mStream->writeInt(kOp_RestoreToCount);
+        mStream->writeInt(saveCount);
+    }
+
+    virtual int saveLayer(float left, float top, float right, float bottom,
+            int alpha, SkXfermode::Mode mode, int flags) {
+        mStream->writeInt(kOp_SaveLayer);
+        mStream->writeRect(left, top, right, bottom);
+        mStream->writeInt(alpha);
+        mStream->writeInt(mode);
+        mStream->writeInt(flags);
+        return 0;
+    }
+
+    virtual void translate(float dx, float dy) {
+        mStream->writeInt(kOp_Translate);
+        mStream->writeFloat(dx);
+        mStream->writeFloat(dy);
+    }
+
+    virtual void rotate(float degrees) {
+        mStream->writeInt(kOp_Rotate);
+        mStream->writeFloat(degrees);
+    }
+
+    virtual void scale(float sx, float sy) {
+        mStream->writeInt(kOp_Scale);
+        mStream->writeFloat(sx);
+        mStream->writeFloat(sy);
+    }
+
+    virtual void skew(float sx, float sy) {
+        mStream->writeInt(kOp_Skew);
+        mStream->writeFloat(sx);
+        mStream->writeFloat(sy);
+    }
+
+    virtual void setMatrix(SkMatrix* matrix) {
+        mStream->writeInt(kOp_SetMatrix);
+        mStream->writeMatrix(matrix);
+    }
+
+    virtual void concatMatrix(SkMatrix* matrix) {
+        mStream->writeInt(kOp_ConcatMatrix);
+        mStream->writeMatrix(matrix);
+    }
+
+    virtual bool clipRect(float left, float top, float right, float bottom, SkRegion::Op op) {
+        mStream->writeInt(kOp_ClipRect);
+        mStream->writeRect(left, top, right, bottom);
+        mStream->writeInt(op);
+        return true;
+    }
+
+    virtual bool clipPath(SkPath* path, SkRegion::Op op) {
+        mStream->writeInt(kOp_ClipPath);
+        mStream->writeInt(getPathIndex(path));
+        mStream->writeInt(op);
+        return true;
+    }
+
+    virtual bool clipRegion(SkRegion* region, SkRegion::Op op) {
+        int count = 0;
+        for (SkRegion::Iterator it(*region); !it.done(); it.next()) {
+            count++;
+        }
+
+        mStream->writeInt(kOp_ClipRegion);
+        mStream->writeInt(count);
+        for (SkRegion::Iterator it(*region); !it.done(); it.next()) {
+            const SkIRect& r = it.rect();
+            mStream->writeInt(r.fLeft);
+            mStream->writeInt(r.fTop);
+            mStream->writeInt(r.fRight);
+            mStream->writeInt(r.fBottom);
+        }
+        mStream->writeInt(op);
+        return true;
+    }
+
+    virtual void resetShader() {
+        mStream->writeInt(kOp_ResetShader);
+    }
+
+    virtual void setupShader(SkiaShader* shader) {
+        mDroppedOpsCount++;
+    }
+
+    virtual void resetColorFilter() {
+        mStream->writeInt(kOp_ResetColorFilter);
+    }
+
+    virtual void setupColorFilter(SkiaColorFilter* filter) {
+        mDroppedOpsCount++;
+    }
+
+    virtual void resetShadow() {
+        mStream->writeInt(kOp_ResetShadow);
+    }
+
+    virtual void setupShadow(float radius, float dx, float dy, int color) {
+        mStream->writeInt(kOp_SetupShadow);
+        mStream->writeFloat(radius);
+        mStream->writeFloat(dx);
+        mStream->writeFloat(dy);
+        mStream->writeInt(color);
+    }
+
+    virtual void resetPaintFilter() {
+        mStream->writeInt(kOp_ResetPaintFilter);
+    }
+
+    virtual void setupPaintFilter(int clearBits, int setBits) {
+        mStream->writeInt(kOp_SetupPaintFilter);
+        mStream->writeInt(clearBits);
+        mStream->writeInt(setBits);
+    }
+
+    ///////////////////////////////////////////////////////////////////////////
+    // Drawing
+    ///////////////////////////////////////////////////////////////////////////
+
+    virtual status_t callDrawGLFunction(Functor* functor, Rect& dirty) {
+        mDroppedOpsCount++;
+        return DrawGlInfo::kStatusDone;
+    }
+
+    virtual status_t drawLayer(Layer* layer, float x, float y) {
+        mDroppedOpsCount++;
+        return DrawGlInfo::kStatusDone;
+    }
+
+    virtual status_t drawBitmap(SkBitmap* bitmap, float left, float top, SkPaint* paint) {
+        mStream->writeInt(kOp_DrawBitmap);
+        mStream->writeInt(getBitmapIndex(bitmap));
+        mStream->writeFloat(left);
+        mStream->writeFloat(top);
+        mStream->writeInt(getPaintIndex(paint));
+        return DrawGlInfo::kStatusDone;
+    }
+
+    virtual status_t drawBitmap(SkBitmap* bitmap, SkMatrix* matrix, SkPaint* paint) {
+        mStream->writeInt(kOp_DrawBitmapMatrix);
+        mStream->writeInt(getBitmapIndex(bitmap));
+        mStream->writeMatrix(matrix);
+        mStream->writeInt(getPaintIndex(paint));
+        return DrawGlInfo::kStatusDone;
+    }
+
+    virtual status_t drawBitmap(SkBitmap* bitmap, float srcLeft, float srcTop,
+            float srcRight, float srcBottom, float dstLeft, float dstTop,
+            float dstRight, float dstBottom, SkPaint* paint) {
+        mStream->writeInt(kOp_DrawBitmapRect);
+        mStream->writeInt(getBitmapIndex(bitmap));
+        mStream->writeRect(srcLeft, srcTop, srcRight, srcBottom);
+        mStream->writeRect(dstLeft, dstTop, dstRight, dstBottom);
+        mStream->writeInt(getPaintIndex(paint));
+        return DrawGlInfo::kStatusDone;
+    }
+
+    virtual status_t drawBitmapData(SkBitmap* bitmap, float left, float top, SkPaint* paint) {
+        mStream->writeInt(kOp_DrawBitmapData);
+        mStream->writeInt(getBitmapIndex(bitmap));
+        mStream->writeFloat(left);
+        mStream->writeFloat(top);
+        mStream->writeInt(getPaintIndex(paint));
+        return DrawGlInfo::kStatusDone;
+    }
+
+    virtual status_t drawBitmapMesh(SkBitmap* bitmap, int meshWidth, int meshHeight,
+            float* vertices, int* colors, SkPaint* paint) {
+        const int count = (meshWidth + 1) * (meshHeight + 1);
+
+        mStream->writeInt(kOp_DrawBitmapMesh);
+        mStream->writeInt(getBitmapIndex(bitmap));
+        mStream->writeInt(meshWidth);
+        mStream->writeInt(meshHeight);
+        mStream->writeFloats(vertices, count * 2);
+        mStream->writeInt(colors != NULL);
+        if (colors) {
+            for (int i = 0; i < count; i++) {
+                mStream->writeInt(colors[i]);
+            }
+        }
+        mStream->writeInt(getPaintIndex(paint));
+        return DrawGlInfo::kStatusDone;
+    }
+
+    virtual status_t drawColor(int color, SkXfermode::Mode mode) {
+        mStream->writeInt(kOp_DrawColor);
+        mStream->writeInt(color);
+        mStream->writeInt(mode);
+        return DrawGlInfo::kStatusDone;
+    }
+
+    virtual status_t drawRect(float left, float top, float right, float bottom, SkPaint* paint) {
+        mStream->writeInt(kOp_DrawRect);
+        mStream->writeRect(left, top, right, bottom);
+        mStream->writeInt(getPaintIndex(paint));
+        return DrawGlInfo::kStatusDone;
+    }
+
+    virtual status_t drawRoundRect(float left, float top, float right, float bottom,
+            float rx, float ry, SkPaint* paint) {
+        mStream->writeInt(kOp_DrawRoundRect);
+        mStream->writeRect(left, top, right, bottom);
+        mStream->writeFloat(rx);
+        mStream->writeFloat(ry);
+        mStream->writeInt(getPaintIndex(paint));
+        return DrawGlInfo::kStatusDone;
+    }
+
+    virtual status_t drawCircle(float x, float y, float radius, SkPaint* paint) {
+        mStream->writeInt(kOp_DrawCircle);
+        mStream->writeFloat(x);
+        mStream->writeFloat(y);
+        mStream->writeFloat(radius);
+        mStream->writeInt(getPaintIndex(paint));
+        return DrawGlInfo::kStatusDone;
+    }
+
+    virtual status_t drawOval(float left, float top, float right, float bottom, SkPaint* paint) {
+        mStream->writeInt(kOp_DrawOval);
+        mStream->writeRect(left, top, right, bottom);
+        mStream->writeInt(getPaintIndex(paint));
+        return DrawGlInfo::kStatusDone;
+    }
+
+    virtual status_t drawArc(float left, float top, float right, float bottom,
+            float startAngle, float sweepAngle, bool useCenter, SkPaint* paint) {
+        mStream->writeInt(kOp_DrawArc);
+        mStream->writeRect(left, top, right, bottom);
+        mStream->writeFloat(startAngle);
+        mStream->writeFloat(sweepAngle);
+        mStream->writeInt(useCenter);
+        mStream->writeInt(getPaintIndex(paint));
+        return DrawGlInfo::kStatusDone;
+    }
+
+    virtual status_t drawPath(SkPath* path, SkPaint* paint) {
+        mStream->writeInt(kOp_DrawPath);
+        mStream->writeInt(getPathIndex(path));
+        mStream->writeInt(getPaintIndex(paint));
+        return DrawGlInfo::kStatusDone;
+    }
+
+    virtual status_t drawLines(float* points, int count, SkPaint* paint) {
+        mStream->writeInt(kOp_DrawLines);
+        mStream->writeInt(count);
+        mStream->writeFloats(points, count);
+        mStream->writeInt(getPaintIndex(paint));
+        return DrawGlInfo::kStatusDone;
+    }
+
+    virtual status_t drawPoints(float* points, int count, SkPaint* paint) {
+        mStream->writeInt(kOp_DrawPoints);
+        mStream->writeInt(count);
+        mStream->writeFloats(points, count);
+        mStream->writeInt(getPaintIndex(paint));
+        return DrawGlInfo::kStatusDone;
+    }
+
+    virtual status_t drawTextOnPath(const char* text, int bytesCount, int count, SkPath* path,
+            float hOffset, float vOffset, SkPaint* paint) {
+        mStream->writeInt(kOp_DrawTextOnPath);
+        mStream->writeBytes(text, bytesCount);
+        mStream->writeInt(count);
+        mStream->writeInt(getPathIndex(path));
+        mStream->writeFloat(hOffset);
+        mStream->writeFloat(vOffset);
+        mStream->writeInt(getPaintIndex(paint));
+        return DrawGlInfo::kStatusDone;
+    }
+
+    virtual status_t drawPosText(const char* text, int bytesCount, int count,
+            const float* positions, SkPaint* paint) {
+        mStream->writeInt(kOp_DrawPosText);
+        mStream->writeBytes(text, bytesCount);
+        mStream->writeInt(count);
+        mStream->writeFloats(positions, count * 2);
+        mStream->writeInt(getPaintIndex(paint));
+        return DrawGlInfo::kStatusDone;
+    }
+
+    virtual status_t drawText(const char* text, int bytesCount, int count, float x, float y,
+            const float* positions, SkPaint* paint, float totalAdvance, const Rect& bounds,
+            DrawOpMode drawOpMode) {
+        mStream->writeInt(kOp_DrawText);
+        mStream->writeBytes(text, bytesCount);
+        mStream->writeInt(count);
+        mStream->writeFloat(x);
+        mStream->writeFloat(y);
+        mStream->writeInt(positions != NULL);
+        if (positions) mStream->writeFloats(positions, count * 2);
+        mStream->writeFloat(totalAdvance);
+        mStream->writeRect(bounds.left, bounds.top, bounds.right, bounds.bottom);
+        mStream->writeInt(getPaintIndex(paint));
+        return DrawGlInfo::kStatusDone;
+    }
+
+    virtual status_t drawRects(const float* rects, int count, SkPaint* paint) {
+        mStream->writeInt(kOp_DrawRects);
+        mStream->writeInt(count);
+        mStream->writeFloats(rects, count);
+        mStream->writeInt(getPaintIndex(paint));
+        return DrawGlInfo::kStatusDone;
+    }
+
+private:
+    void writeViewProperties(DisplayList* displayList) {
+        mStream->writeInt(displayList->getLeft());
+        mStream->writeInt(displayList->getTop());
+        mStream->writeInt(displayList->getRight());
+        mStream->writeInt(displayList->getBottom());
+        mStream->writeInt(DisplayListCapture::getClipToBounds(displayList));
+        mStream->writeFloat(displayList->getAlpha());
+        mStream->writeInt(displayList->hasOverlappingRendering());
+        mStream->writeFloat(displayList->getTranslationX());
+        mStream->writeFloat(displayList->getTranslationY());
+        mStream->writeFloat(displayList->getRotation());
+        mStream->writeFloat(displayList->getRotationX());
+        mStream->writeFloat(displayList->getRotationY());
+        mStream->writeFloat(displayList->getScaleX());
+        mStream->writeFloat(displayList->getScaleY());
+        mStream->writeFloat(displayList->getPivotX());
+        mStream->writeFloat(displayList->getPivotY());
+        mStream->writeFloat(displayList->getCameraDistance());
+        mStream->writeMatrix(displayList->getStaticMatrix());
+        mStream->writeMatrix(DisplayListCapture::getAnimationMatrix(displayList));
+    }
+
+    int getBitmapIndex(SkBitmap* bitmap) {
+        if (!bitmap) return -1;
+
+        ssize_t index = mBitmapIndices.indexOfKey(bitmap);
+        if (index >= 0) return mBitmapIndices.valueAt(index);
+
+        // Bitmaps with a color table are stored like 32 bits bitmaps
+        SkBitmap copy;
+        const SkBitmap* source = bitmap;
+        switch (bitmap->config()) {
+            case SkBitmap::kA8_Config:
+            case SkBitmap::kRGB_565_Config:
+            case SkBitmap::kARGB_4444_Config:
+            case SkBitmap::kARGB_8888_Config:
+                break;
+            default:
+                bitmap->copyTo(&copy, SkBitmap::kARGB_8888_Config);
+                source = &copy;
+                break;
+        }
+
+        SkAutoLockPixels alp(*source);
+        mBitmaps.writeInt(source->config());
+        mBitmaps.writeInt(source->width());
+        mBitmaps.writeInt(source->height());
+        mBitmaps.writeInt(source->rowBytes());
+        mBitmaps.writeInt(source->isOpaque());
+        if (source->getPixels()) {
+            mBitmaps.writeBytes(source->getPixels(), source->getSize());
+        } else {
+            mBitmaps.writeBytes(NULL, 0);
+        }
+
+        index = mBitmapIndices.size();
+        mBitmapIndices.add(bitmap, index);
+        return index;
+    }
+
+    int getPatchIndex(Res_png_9patch* patch) {
+        if (!patch) return -1;
+
+        ssize_t index = mPatchIndices.indexOfKey(patch);
+        if (index >= 0) return mPatchIndices.valueAt(index);
+
+        mPatches.writeInt(patch->numXDivs);
+        mPatches.writeInt(patch->numYDivs);
+        mPatches.writeInt(patch->numColors);
+        mPatches.writeInt(patch->paddingLeft);
+        mPatches.writeInt(patch->paddingRight);
+        mPatches.writeInt(patch->paddingTop);
+        mPatches.writeInt(patch->paddingBottom);
+        for (int i = 0; i < patch->numXDivs; i++) {
+            mPatches.writeInt(patch->xDivs[i]);
+        }
+        for (int i = 0; i < patch->numYDivs; i++) {
+            mPatches.writeInt(patch->yDivs[i]);
+        }
+        for (int i = 0; i < patch->numColors; i++) {
+            mPatches.writeInt(patch->colors[i]);
+        }
+
+        index = mPatchIndices.size();
+        mPatchIndices.add(patch, index);
+        return index;
+    }
+
+    int getPathIndex(SkPath* path) {
+        if (!path) return -1;
+
+        ssize_t index = mPathIndices.indexOfKey(path);
+        if (index >= 0) return mPathIndices.valueAt(index);
+
+        mPaths.writeInt(path->getFillType());
+
+        SkPath::RawIter iter(*path);
+        SkPoint pts[4];
+        SkPath::Verb verb;
+        while ((verb = iter.next(pts)) != SkPath::kDone_Verb) {
+            int first = 1;
+            int count = 0;
+            switch (verb) {
+                case SkPath::kMove_Verb:
+                    first = 0;
+                    count = 1;
+                    break;
+                case SkPath::kLine_Verb:
+                    count = 1;
+                    break;
+                case SkPath::kQuad_Verb:
+                    count = 2;
+                    break;
+                case SkPath::kCubic_Verb:
+                    count = 3;
+                    break;
+                case SkPath::kClose_Verb:
+                    break;
+                default:
+                    // Unknown verbs are dropped
+                    continue;
+            }
+
+            mPaths.writeInt(verb);
+            for (int i = first; i < first + count; i++) {
+                mPaths.writeFloat(pts[i].fX);
+                mPaths.writeFloat(pts[i].fY);
+            }
+        }
+        mPaths.writeInt(SkPath::kDone_Verb);
+
+        index = mPathIndices.size();
+        mPathIndices.add(path, index);
+        return index;
+    }
+
+    int getPaintIndex(SkPaint* paint) {
+        if (!paint) return -1;
+
+        ssize_t index = mPaintIndices.indexOfKey(paint);
+        if (index >= 0) return mPaintIndices.valueAt(index);
+
+        SkXfermode::Mode mode = SkXfermode::kSrcOver_Mode;
+        SkXfermode::AsMode(paint->getXfermode(), &mode);
+        SkTypeface* typeface = paint->getTypeface();
+
+        mPaints.writeInt(paint->getColor());
+        mPaints.writeInt(paint->getFlags());
+        mPaints.writeInt(paint->getStyle());
+        mPaints.writeFloat(paint->getStrokeWidth());
+        mPaints.writeFloat(paint->getStrokeMiter());
+        mPaints.writeInt(paint->getStrokeCap());
+        mPaints.writeInt(paint->getStrokeJoin());
+        mPaints.writeInt(paint->getHinting());
+        mPaints.writeInt(mode);
+        mPaints.writeFloat(paint->getTextSize());
+        mPaints.writeFloat(paint->getTextScaleX());
+        mPaints.writeFloat(paint->getTextSkewX());
+        mPaints.writeInt(paint->getTextAlign());
+        mPaints.writeInt(paint->getTextEncoding());
+        mPaints.writeInt(typeface ? typeface->style() : SkTypeface::kNormal);
+
+        index = mPaintIndices.size();
+        mPaintIndices.add(paint, index);
+        return index;
+    }
+
+    CaptureStream* mStream;
+    uint32_t mDroppedOpsCount;
+
+    Vector<CaptureStream*> mDisplayLists;
+    KeyedVector<DisplayList*, int> mDisplayListIndices;
+
+    CaptureStream mBitmaps;
+    KeyedVector<SkBitmap*, int> mBitmapIndices;
+    CaptureStream mPatches;
+    KeyedVector<Res_png_9patch*, int> mPatchIndices;
+    CaptureStream mPaths;
+    KeyedVector<SkPath*, int> mPathIndices;
+    CaptureStream mPaints;
+    KeyedVector<SkPaint*, int> mPaintIndices;
+}; // class CaptureRenderer
+
+bool DisplayListCapture::write(DisplayList* displayList, const char* path) {
+    if (!displayList || !displayList->isRenderable()) return false;
+
+    CaptureRenderer renderer;
+    renderer.captureDisplayList(displayList);
+    return renderer.write(path);
+}
+
+const Vector<DisplayListOp*>& DisplayListCapture::getOps(DisplayList* displayList) {
+    return displayList->mDisplayListData->displayListOps;
+}
+
+bool DisplayListCapture::getClipToBounds(DisplayList* displayList) {
+    return displayList->mClipToBounds;
+}
+
+SkMatrix* DisplayListCapture::getAnimationMatrix(DisplayList* displayList) {
+    return displayList->mAnimationMatrix;
+}
+
+DisplayList* DisplayListCapture::getChild(DisplayListOp* op, int* flags) {
+    DrawDisplayListOp* drawOp = (DrawDisplayListOp*) op;
+    *flags = drawOp->mFlags;
+    return drawOp->mDisplayList;
+}
+
+SkBitmap* DisplayListCapture::getPatch(DisplayListOp* op, Res_png_9patch** patch, Rect* bounds,
+        SkPaint** paint) {
+    DrawPatchOp* drawOp = (DrawPatchOp*) op;
+    *patch = drawOp->mPatch;
+    *bounds = drawOp->mLocalBounds;
+    *paint = drawOp->mPaint;
+    return drawOp->mBitmap;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Playback
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Reads the resources and display lists of a capture into a CapturedDisplayList.
+ */
+class CaptureLoader {
+public:
+    CaptureLoader(CapturedDisplayList& list, CaptureReader& reader):
+            mList(list), mReader(reader) {
+    }
+
+    bool load() {
+        if (mReader.readInt() != DISPLAY_LIST_CAPTURE_MAGIC) {
+            ALOGE("Not a display list capture");
+            return false;
+        }
+        int version = mReader.readInt();
+        if (version != DISPLAY_LIST_CAPTURE_VERSION) {
+            ALOGE("Unsupported display list capture version %d", version);
+            return false;
+        }
+        mList.mDroppedOpsCount = mReader.readInt();
+
+        int count = readCount();
+        for (int i = 0; i < count && !mReader.hasError(); i++) {
+            mList.mBitmaps.add(readBitmap());
+        }
+        count = readCount();
+        for (int i = 0; i < count && !mReader.hasError(); i++) {
+            mList.mPatches.add(readPatch());
+        }
+        count = readCount();
+        for (int i = 0; i < count && !mReader.hasError(); i++) {
+            mList.mPaths.add(readPath());
+        }
+        count = readCount();
+        for (int i = 0; i < count && !mReader.hasError(); i++) {
+            mList.mPaints.add(readPaint());
+        }
+        count = readCount();
+        for (int i = 0; i < count && !mReader.hasError(); i++) {
+            DisplayList* displayList = readDisplayList();
+            if (!displayList) break;
+            mList.mDisplayLists.add(displayList);
+        }
+
+        if (mReader.hasError() || mList.mDisplayLists.isEmpty()) {
+            ALOGE("Invalid display list capture");
+            return false;
+        }
+        return true;
+    }
+
+private:
+    int readCount() {
+        int count = mReader.readInt();
+        if (count < 0) {
+            count = 0;
+            mReader.setError();
+        }
+        return count;
+    }
+
+    SkBitmap* readBitmap() {
+        SkBitmap::Config config = (SkBitmap::Config) mReader.readInt();
+        int width = mReader.readInt();
+        int height = mReader.readInt();
+        int rowBytes = mReader.readInt();
+        bool opaque = mReader.readInt();
+
+        size_t size;
+        const void* pixels = mReader.readBytes(&size);
+
+        SkBitmap* bitmap = new SkBitmap();
+        bitmap->setConfig(config, width, height, rowBytes);
+        if (pixels && size == bitmap->getSize() && bitmap->allocPixels()) {
+            memcpy(bitmap->getPixels(), pixels, size);
+            bitmap->notifyPixelsChanged();
+        }
+        bitmap->setIsOpaque(opaque);
+        return bitmap;
+    }
+
+    Res_png_9patch* readPatch() {
+        int numXDivs = mReader.readInt();
+        int numYDivs = mReader.readInt();
+        int numColors = mReader.readInt();
+        if (numXDivs < 0 || numXDivs > 127 || numYDivs < 0 || numYDivs > 127 ||
+                numColors < 0 || numColors > 127) {
+            mReader.setError();
+            return NULL;
+        }
+
+        // Laid out like a deserialized patch, freed as an array by the resource cache
+        const size_t size = sizeof(Res_png_9patch) +
+                (numXDivs + numYDivs + numColors) * sizeof(int32_t);
+        int8_t* data = new int8_t[size];
+        Res_png_9patch* patch = new (data) Res_png_9patch();
+
+        patch->wasDeserialized = true;
+        patch->numXDivs = numXDivs;
+        patch->numYDivs = numYDivs;
+        patch->numColors = numColors;
+        patch->paddingLeft = mReader.readInt();
+        patch->paddingRight = mReader.readInt();
+        patch->paddingTop = mReader.readInt();
+        patch->paddingBottom = mReader.readInt();
+
+        patch->xDivs = (int32_t*) (data + sizeof(Res_png_9patch));
+        patch->yDivs = patch->xDivs + numXDivs;
+        patch->colors = (uint32_t*) (patch->yDivs + numYDivs);
+        for (int i = 0; i < numXDivs; i++) {
+            patch->xDivs[i] = mReader.readInt();
+        }
+        for (int i = 0; i < numYDivs; i++) {
+            patch->yDivs[i] = mReader.readInt();
+        }
+        for (int i = 0; i < numColors; i++) {
+            patch->colors[i] = mReader.readInt();
+        }
+        return patch;
+    }
+
+    SkPath* readPath() {
+        SkPath* path = new SkPath();
+        path->setFillType((SkPath::FillType) mReader.readInt());
+
+        while (!mReader.hasError()) {
+            const SkPath::Verb verb = (SkPath::Verb) mReader.readInt();
+            if (verb == SkPath::kDone_Verb) break;
+
+            const float* pts;
+            switch (verb) {
+                case SkPath::kMove_Verb:
+                    pts = mReader.readFloats(2);
+                    if (pts) path->moveTo(pts[0], pts[1]);
+                    break;
+                case SkPath::kLine_Verb:
+                    pts = mReader.readFloats(2);
+                    if (pts) path->lineTo(pts[0], pts[1]);
+                    break;
+                case SkPath::kQuad_Verb:
+                    pts = mReader.readFloats(4);
+                    if (pts) path->quadTo(pts[0], pts[1], pts[2], pts[3]);
+                    break;
+                case SkPath::kCubic_Verb:
+                    pts = mReader.readFloats(6);
+                    if (pts) path->cubicTo(pts[0], pts[1], pts[2], pts[3], pts[4], pts[5]);
+                    break;
+                case SkPath::kClose_Verb:
+                    path->close();
+                    break;
+                default:
+                    mReader.setError();
+                    break;
+            }
+        }
+        return path;
+    }
+
+    SkPaint* readPaint() {
+        SkPaint* paint = new SkPaint();
+        paint->setColor(mReader.readInt());
+        paint->setFlags(mReader.readInt());
+        paint->setStyle((SkPaint::Style) mReader.readInt());
+        paint->setStrokeWidth(mReader.readFloat());
+        paint->setStrokeMiter(mReader.readFloat());
+        paint->setStrokeCap((SkPaint::Cap) mReader.readInt());
+        paint->setStrokeJoin((SkPaint::Join) mReader.readInt());
+        paint->setHinting((SkPaint::Hinting) mReader.readInt());
+        paint->setXfermodeMode((SkXfermode::Mode) mReader.readInt());
+        paint->setTextSize(mReader.readFloat());
+        paint->setTextScaleX(mReader.readFloat());
+        paint->setTextSkewX(mReader.readFloat());
+        paint->setTextAlign((SkPaint::Align) mReader.readInt());
+        paint->setTextEncoding((SkPaint::TextEncoding) mReader.readInt());
+
+        SkTypeface::Style style = (SkTypeface::Style) mReader.readInt();
+        if (style != SkTypeface::kNormal) {
+            SkTypeface* typeface = SkTypeface::CreateFromName(NULL, style);
+            paint->setTypeface(typeface);
+            SkSafeUnref(typeface);
+        }
+        return paint;
+    }
+
+    SkBitmap* bitmapAt(int index) {
+        return index < 0 ? NULL : mList.mBitmaps.itemAt(index);
+    }
+
+    SkPath* pathAt(int index) {
+        return index < 0 ? NULL : mList.mPaths.itemAt(index);
+    }
+
+    SkPaint* paintAt(int index) {
+        return index < 0 ? NULL : mList.mPaints.itemAt(index);
+    }
+
+    SkBitmap* readBitmapIndex() {
+        SkBitmap* bitmap = bitmapAt(mReader.readIndex(mList.mBitmaps.size()));
+        if (!bitmap) mReader.setError(); // bitmaps are mandatory
+        return bitmap;
+    }
+
+    SkPath* readPathIndex() {
+        SkPath* path = pathAt(mReader.readIndex(mList.mPaths.size()));
+        if (!path) mReader.setError(); // paths are mandatory
+        return path;
+    }
+
+    SkPaint* readPaintIndex() {
+        return paintAt(mReader.readIndex(mList.mPaints.size()));
+    }
+
+    Rect readRect() {
+        const float* values = mReader.readFloats(4);
+        if (!values) return Rect();
+        return Rect(values[0], values[1], values[2], values[3]);
+    }
+
+    DisplayList* readDisplayList() {
+        size_t nameLength;
+        const char* name = (const char*) mReader.readBytes(&nameLength);
+        String8 displayListName(name ? name : "", nameLength);
+
+        const int left = mReader.readInt();
+        const int top = mReader.readInt();
+        const int right = mReader.readInt();
+        const int bottom = mReader.readInt();
+        const bool clipToBounds = mReader.readInt();
+        const float alpha = mReader.readFloat();
+        const bool hasOverlappingRendering = mReader.readInt();
+        const float translationX = mReader.readFloat();
+        const float translationY = mReader.readFloat();
+        const float rotation = mReader.readFloat();
+        const float rotationX = mReader.readFloat();
+        const float rotationY = mReader.readFloat();
+        const float scaleX = mReader.readFloat();
+        const float scaleY = mReader.readFloat();
+        const float pivotX = mReader.readFloat();
+        const float pivotY = mReader.readFloat();
+        const float cameraDistance = mReader.readFloat();
+        SkMatrix staticMatrix;
+        const bool hasStaticMatrix = mReader.readMatrix(&staticMatrix);
+        SkMatrix animationMatrix;
+        const bool hasAnimationMatrix = mReader.readMatrix(&animationMatrix);
+
+        DisplayListRenderer renderer;
+        renderer.setViewport(right - left, bottom - top);
+        renderer.prepare(false);
+        if (!readOps(renderer)) return NULL;
+        renderer.finish();
+
+        DisplayList* displayList = renderer.getDisplayList(NULL);
+        displayList->setName(displayListName.string());
+        displayList->setLeftTopRightBottom(left, top, right, bottom);
+        displayList->setClipToBounds(clipToBounds);
+        displayList->setAlpha(alpha);
+        displayList->setHasOverlappingRendering(hasOverlappingRendering);
+        displayList->setTranslationX(translationX);
+        displayList->setTranslationY(translationY);
+        displayList->setRotation(rotation);
+        displayList->setRotationX(rotationX);
+        displayList->setRotationY(rotationY);
+        displayList->setScaleX(scaleX);
+        displayList->setScaleY(scaleY);
+        displayList->setPivotX(pivotX);
+        displayList->setPivotY(pivotY);
+        displayList->setCameraDistance(cameraDistance);
+        if (hasStaticMatrix) displayList->setStaticMatrix(&staticMatrix);
+        if (hasAnimationMatrix) displayList->setAnimationMatrix(&animationMatrix);
+        return displayList;
+    }
+
+    bool readOps(DisplayListRenderer& renderer) {
+        Rect dirty;
+        while (!mReader.hasError()) {
+            const int op = mReader.readInt();
+            switch (op) {
+                case kOp_End:
+                    return true;
+                case kOp_Save:
+                    renderer.save(mReader.readInt());
+                    break;
+                case kOp_Restore:
+                    renderer.restore();
+                    break;
+                case kOp_RestoreToCount:
+                    renderer.restoreToCount(mReader.readInt());
+                    break;
+                case kOp_SaveLayer: {
+                    Rect area = readRect();
+                    const int alpha = mReader.readInt();
+                    const SkXfermode::Mode mode = (SkXfermode::Mode) mReader.readInt();
+                    const int flags = mReader.readInt();
+                    renderer.saveLayer(area.left, area.top, area.right, area.bottom,
+                            alpha, mode, flags);
+                    break;
+                }
+                case kOp_Translate: {
+                    const float dx = mReader.readFloat();
+                    renderer.translate(dx, mReader.readFloat());
+                    break;
+                }
+                case kOp_Rotate:
+                    renderer.rotate(mReader.readFloat());
+                    break;
+                case kOp_Scale: {
+                    const float sx = mReader.readFloat();
+                    renderer.scale(sx, mReader.readFloat());
+                    break;
+                }
+                case kOp_Skew: {
+                    const float sx = mReader.readFloat();
+                    renderer.skew(sx, mReader.readFloat());
+                    break;
+                }
+                case kOp_SetMatrix: {
+                    SkMatrix matrix;
+                    renderer.setMatrix(mReader.readMatrix(&matrix) ? &matrix : NULL);
+                    break;
+                }
+                case kOp_ConcatMatrix: {
+                    SkMatrix matrix;
+                    if (mReader.readMatrix(&matrix)) renderer.concatMatrix(&matrix);
+                    break;
+                }
+                case kOp_ClipRect: {
+                    Rect r = readRect();
+                    renderer.clipRect(r.left, r.top, r.right, r.bottom,
+                            (SkRegion::Op) mReader.readInt());
+                    break;
+                }
+                case kOp_ClipPath: {
+                    SkPath* path = readPathIndex();
+                    const SkRegion::Op regionOp = (SkRegion::Op) mReader.readInt();
+                    if (path) renderer.clipPath(path, regionOp);
+                    break;
+                }
+                case kOp_ClipRegion: {
+                    SkRegion region;
+                    const int count = mReader.readInt();
+                    for (int i = 0; i < count && !mReader.hasError(); i++) {
+                        const int l = mReader.readInt();
+                        const int t = mReader.readInt();
+                        const int r = mReader.readInt();
+                        const int b = mReader.readInt();
+                        region.op(SkIRect::MakeLTRB(l, t, r, b), SkRegion::kUnion_Op);
+                    }
+                    renderer.clipRegion(&region, (SkRegion::Op) mReader.readInt());
+                    break;
+                }
+                case kOp_ResetShader:
+                    renderer.resetShader();
+                    break;
+                case kOp_ResetColorFilter:
+                    renderer.resetColorFilter();
+                    break;
+                case kOp_ResetShadow:
+                    renderer.resetShadow();
+                    break;
+                case kOp_SetupShadow: {
+                    const float radius = mReader.readFloat();
+                    const float dx = mReader.readFloat();
+                    const float dy = mReader.readFloat();
+                    renderer.setupShadow(radius, dx, dy, mReader.readInt());
+                    break;
+                }
+                case kOp_ResetPaintFilter:
+                    renderer.resetPaintFilter();
+                    break;
+                case kOp_SetupPaintFilter: {
+                    const int clearBits = mReader.readInt();
+                    renderer.setupPaintFilter(clearBits, mReader.readInt());
+                    break;
+                }
+                case kOp_DrawDisplayList: {
+                    // Children are always stored before their parents
+                    const int index = mReader.readIndex(mList.mDisplayLists.size());
+                    const int flags = mReader.readInt();
+                    if (index < 0) return false;
+                    renderer.drawDisplayList(mList.mDisplayLists.itemAt(index), dirty, flags);
+                    break;
+                }
+                case kOp_DrawBitmap:
+                case kOp_DrawBitmapData: {
+                    SkBitmap* bitmap = readBitmapIndex();
+                    const float left = mReader.readFloat();
+                    const float top = mReader.readFloat();
+                    SkPaint* paint = readPaintIndex();
+                    if (!bitmap) break;
+                    if (op == kOp_DrawBitmap) {
+                        renderer.drawBitmap(bitmap, left, top, paint);
+                    } else {
+                        // The display list owns, and destroys, the bitmaps drawn as data
+                        renderer.drawBitmapData(new SkBitmap(*bitmap), left, top, paint);
+                    }
+                    break;
+                }
+                case kOp_DrawBitmapMatrix: {
+                    SkBitmap* bitmap = readBitmapIndex();
+                    SkMatrix matrix;
+                    const bool hasMatrix = mReader.readMatrix(&matrix);
+                    SkPaint* paint = readPaintIndex();
+                    if (bitmap) renderer.drawBitmap(bitmap, hasMatrix ? &matrix : NULL, paint);
+                    break;
+                }
+                case kOp_DrawBitmapRect: {
+                    SkBitmap* bitmap = readBitmapIndex();
+                    Rect src = readRect();
+                    Rect dst = readRect();
+                    SkPaint* paint = readPaintIndex();
+                    if (!bitmap) break;
+                    renderer.drawBitmap(bitmap, src.left, src.top, src.right, src.bottom,
+                            dst.left, dst.top, dst.right, dst.bottom, paint);
+                    break;
+                }
+                case kOp_DrawBitmapMesh: {
+                    SkBitmap* bitmap = readBitmapIndex();
+                    const int meshWidth = mReader.readInt();
+                    const int meshHeight = mReader.readInt();
+                    const int count = (meshWidth + 1) * (meshHeight + 1);
+                    const float* vertices = mReader.readFloats(count * 2);
+                    Vector<int> colors;
+                    if (mReader.readInt()) {
+                        for (int i = 0; i < count && !mReader.hasError(); i++) {
+                            colors.add(mReader.readInt());
+                        }
+                    }
+                    SkPaint* paint = readPaintIndex();
+                    if (!bitmap || !vertices) break;
+                    renderer.drawBitmapMesh(bitmap, meshWidth, meshHeight,
+                            const_cast<float*>(vertices),
+                            colors.isEmpty() ? NULL : colors.editArray(), paint);
+                    break;
+                }
+                case kOp_DrawPatch: {
+                    SkBitmap* bitmap = readBitmapIndex();
+                    const int index = mReader.readIndex(mList.mPatches.size());
+                    Rect bounds = readRect();
+                    SkPaint* paint = readPaintIndex();
+                    if (!bitmap || index < 0) break;
+                    renderer.drawPatch(bitmap, mList.mPatches.itemAt(index),
+                            bounds.left, bounds.top, bounds.right, bounds.bottom, paint);
+                    break;
+                }
+                case kOp_DrawColor: {
+                    const int color = mReader.readInt();
+                    renderer.drawColor(color, (SkXfermode::Mode) mReader.readInt());
+                    break;
+                }
+                case kOp_DrawRect:
+                case kOp_DrawOval: {
+                    Rect r = readRect();
+                    SkPaint* paint = readPaintIndex();
+                    if (op == kOp_DrawRect) {
+                        renderer.drawRect(r.left, r.top, r.right, r.bottom, paint);
+                    } else {
+                        renderer.drawOval(r.left, r.top, r.right, r.bottom, paint);
+                    }
+                    break;
+                }
+                case kOp_DrawRoundRect: {
+                    Rect r = readRect();
+                    const float rx = mReader.readFloat();
+                    const float ry = mReader.readFloat();
+                    renderer.drawRoundRect(r.left, r.top, r.right, r.bottom, rx, ry,
+                            readPaintIndex());
+                    break;
+                }
+                case kOp_DrawCircle: {
+                    const float x = mReader.readFloat();
+                    const float y = mReader.readFloat();
+                    const float radius = mReader.readFloat();
+                    renderer.drawCircle(x, y, radius, readPaintIndex());
+                    break;
+                }
+                case kOp_DrawArc: {
+                    Rect r = readRect();
+                    const float startAngle = mReader.readFloat();
+                    const float sweepAngle = mReader.readFloat();
+                    const bool useCenter = mReader.readInt();
+                    renderer.drawArc(r.left, r.top, r.right, r.bottom,
+                            startAngle, sweepAngle, useCenter, readPaintIndex());
+                    break;
+                }
+                case kOp_DrawPath: {
+                    SkPath* path = readPathIndex();
+                    SkPaint* paint = readPaintIndex();
+                    if (path) renderer.drawPath(path, paint);
+                    break;
+                }
+                case kOp_DrawLines:
+                case kOp_DrawPoints:
+                case kOp_DrawRects: {
+                    const int count = mReader.readInt();
+                    const float* values = mReader.readFloats(count);
+                    SkPaint* paint = readPaintIndex();
+                    if (!values) break;
+                    if (op == kOp_DrawLines) {
+                        renderer.drawLines(const_cast<float*>(values), count, paint);
+                    } else if (op == kOp_DrawPoints) {
+                        renderer.drawPoints(const_cast<float*>(values), count, paint);
+                    } else {
+                        renderer.drawRects(values, count, paint);
+                    }
+                    break;
+                }
+                case kOp_DrawTextOnPath: {
+                    size_t bytesCount;
+                    const char* text = (const char*) mReader.readBytes(&bytesCount);
+                    const int count = mReader.readInt();
+                    SkPath* path = readPathIndex();
+                    const float hOffset = mReader.readFloat();
+                    const float vOffset = mReader.readFloat();
+                    SkPaint* paint = readPaintIndex();
+                    if (!text || !path) break;
+                    renderer.drawTextOnPath(text, bytesCount, count, path,
+                            hOffset, vOffset, paint);
+                    break;
+                }
+                case kOp_DrawPosText: {
+                    size_t bytesCount;
+                    const char* text = (const char*) mReader.readBytes(&bytesCount);
+                    const int count = mReader.readInt();
+                    const float* positions = mReader.readFloats(count * 2);
+                    SkPaint* paint = readPaintIndex();
+                    if (!text || !positions) break;
+                    renderer.drawPosText(text, bytesCount, count, positions, paint);
+                    break;
+                }
+                case kOp_DrawText: {
+                    size_t bytesCount;
+                    const char* text = (const char*) mReader.readBytes(&bytesCount);
+                    const int count = mReader.readInt();
+                    const float x = mReader.readFloat();
+                    const float y = mReader.readFloat();
+                    const float* positions = NULL;
+                    if (mReader.readInt()) positions = mReader.readFloats(count * 2);
+                    const float totalAdvance = mReader.readFloat();
+                    Rect bounds = readRect();
+                    SkPaint* paint = readPaintIndex();
+                    if (!text) break;
+                    renderer.drawText(text, bytesCount, count, x, y, positions, paint,
+                            totalAdvance, bounds, kDrawOpMode_Immediate);
+                    break;
+                }
+                default:
+                    ALOGE("Unknown display list capture op %d", op);
+                    return false;
+            }
+        }
+        return false;
+    }
+
+    CapturedDisplayList& mList;
+    CaptureReader& mReader;
+}; // class CaptureLoader
+
+CapturedDisplayList::CapturedDisplayList(): mDroppedOpsCount(0) {
+}
+
+CapturedDisplayList::~CapturedDisplayList() {
+    clear();
+}
+
+void CapturedDisplayList::clear() {
+    // Parents are destroyed before their children
+    for (size_t i = mDisplayLists.size(); i > 0; i--) {
+        delete mDisplayLists.itemAt(i - 1);
+    }
+    mDisplayLists.clear();
+
+    Caches& caches = Caches::getInstance();
+    for (size_t i = 0; i < mBitmaps.size(); i++) {
+        caches.textureCache.remove(mBitmaps.itemAt(i));
+        delete mBitmaps.itemAt(i);
+    }
+    mBitmaps.clear();
+
+    for (size_t i = 0; i < mPatches.size(); i++) {
+        delete[] (int8_t*) mPatches.itemAt(i);
+    }
+    mPatches.clear();
+
+    for (size_t i = 0; i < mPaths.size(); i++) {
+        delete mPaths.itemAt(i);
+    }
+    mPaths.clear();
+
+    for (size_t i = 0; i < mPaints.size(); i++) {
+        delete mPaints.itemAt(i);
+    }
+    mPaints.clear();
+
+    mDroppedOpsCount = 0;
+}
+
+bool CapturedDisplayList::read(const char* path) {
+    clear();
+
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        ALOGE("Could not open display list capture %s", path);
+        return false;
+    }
+
+    Vector<uint8_t> data;
+    uint8_t buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.appendArray(buffer, count);
+    }
+    fclose(file);
+
+    CaptureReader reader(data.array(), data.size());
+    CaptureLoader loader(*this, reader);
+    if (!loader.load()) {
+        clear();
+        return false;
+    }
+    return true;
+}
+
+int CapturedDisplayList::getWidth() const {
+    DisplayList* displayList = getDisplayList();
+    return displayList ? displayList->getWidth() : 0;
+}
+
+int CapturedDisplayList::getHeight() const {
+    DisplayList* displayList = getDisplayList();
+    return displayList ? displayList->getHeight() : 0;
+}
+
+}; // namespace uirenderer
+}; // namespace android
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_DISPLAY_LIST_CAPTURE_H
+#define ANDROID_HWUI_DISPLAY_LIST_CAPTURE_H
+
+#include <SkBitmap.h>
+#include <SkPaint.h>
+#include <SkPath.h>
+
+#include <cutils/compiler.h>
+#include <utils/Vector.h>
+
+#include <androidfw/ResourceTypes.h>
+
+#include "Rect.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// "HWDL", stored in little endian
+#define DISPLAY_LIST_CAPTURE_MAGIC 0x4c445748
+#define DISPLAY_LIST_CAPTURE_VERSION 1
+
+///////////////////////////////////////////////////////////////////////////////
+// Capture
+///////////////////////////////////////////////////////////////////////////////
+
+class DisplayList;
+class DisplayListOp;
+
+/**
+ * Writes a display list tree to a binary file, along with the bitmaps, nine-patches,
+ * paths and paints its operations reference. The file can be read back with a
+ * CapturedDisplayList to replay the frame outside of the application.
+ *
+ * Each display list of the tree is stored once, as the list of canvas calls that
+ * recreate its operations, followed by its view properties. The children are
+ * stored before their parents, the root display list is stored last.
+ *
+ * Layers, functors, shaders and color filters cannot be captured: the operations
+ * that use them are dropped. Only the paint attributes hwui reads are stored, the
+ * path effects, mask filters and loopers of the paints are dropped as well.
+ */
+class DisplayListCapture {
+public:
+    /**
+     * Writes the specified display list and its children to the specified file.
+     * Returns false if the file could not be written.
+     */
+    ANDROID_API static bool write(DisplayList* displayList, const char* path);
+
+private:
+    // Accessors to the internals of display lists and operations
+    static const Vector<DisplayListOp*>& getOps(DisplayList* displayList);
+    static bool getClipToBounds(DisplayList* displayList);
+    static SkMatrix* getAnimationMatrix(DisplayList* displayList);
+    static DisplayList* getChild(DisplayListOp* op, int* flags);
+    static SkBitmap* getPatch(DisplayListOp* op, Res_png_9patch** patch, Rect* bounds,
+            SkPaint** paint);
+
+    friend class CaptureRenderer;
+}; // class DisplayListCapture
+
+/**
+ * Display list tree read from a file written by DisplayListCapture. The display
+ * lists are recreated with a DisplayListRenderer and can be drawn by any
+ * OpenGLRenderer. Reading a tree requires a current GL context.
+ */
+class CapturedDisplayList {
+public:
+    ANDROID_API CapturedDisplayList();
+    ANDROID_API ~CapturedDisplayList();
+
+    /**
+     * Reads the display list tree stored in the specified file. Returns false if
+     * the file cannot be read or is not a valid capture.
+     */
+    ANDROID_API bool read(const char* path);
+
+    /**
+     * Returns the root of the display list tree, or NULL if no tree was read.
+     */
+    DisplayList* getDisplayList() const {
+        return mDisplayLists.isEmpty() ? NULL : mDisplayLists.top();
+    }
+
+    /**
+     * Returns the size of the root display list.
+     */
+    ANDROID_API int getWidth() const;
+    ANDROID_API int getHeight() const;
+
+    /**
+     * Returns the number of operations that could not be captured and were dropped.
+     */
+    uint32_t getDroppedOpsCount() const {
+        return mDroppedOpsCount;
+    }
+
+private:
+    void clear();
+
+    Vector<DisplayList*> mDisplayLists;
+    Vector<SkBitmap*> mBitmaps;
+    Vector<Res_png_9patch*> mPatches;
+    Vector<SkPath*> mPaths;
+    Vector<SkPaint*> mPaints;
+    uint32_t mDroppedOpsCount;
+
+    friend class CaptureLoader;
+}; // class CapturedDisplayList
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_DISPLAY_LIST_CAPTURE_H
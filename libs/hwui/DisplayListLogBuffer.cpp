@@ -72,6 +72,7 @@ DisplayListLogBuffer::~DisplayListLogBuffer() {
  */
 void DisplayListLogBuffer::outputCommands(FILE *file)
 {
+    Mutex::Autolock _l(mLock);
     OpLog* tmpBufferPtr = mStart;
     while (true) {
         if (tmpBufferPtr == mEnd) {
@@ -92,6 +93,7 @@ void DisplayListLogBuffer::outputCommands(FILE *file)
  * and mStart values as appropriate. Label should point to static memory.
  */
 void DisplayListLogBuffer::writeCommand(int level, const char* label) {
+    Mutex::Autolock _l(mLock);
     mEnd->level = level;
     mEnd->label = label;
 
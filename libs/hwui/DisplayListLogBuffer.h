@@ -17,6 +17,7 @@
 #ifndef ANDROID_HWUI_DISPLAY_LIST_LOG_BUFFER_H
 #define ANDROID_HWUI_DISPLAY_LIST_LOG_BUFFER_H
 
+#include <utils/Mutex.h>
 #include <utils/Singleton.h>
 
 #include <stdio.h>
@@ -35,6 +36,7 @@ public:
     void outputCommands(FILE *file);
 
     bool isEmpty() {
+        Mutex::Autolock _l(mLock);
         return (mStart == mEnd);
     }
 
@@ -44,6 +46,9 @@ public:
     };
 
 private:
+    // Layers may be deferred on several threads at once
+    Mutex mLock;
+
     OpLog* mBufferFirst; // where the memory starts
     OpLog* mStart;       // where the current command stream starts
     OpLog* mEnd;         // where the current commands end
@@ -30,7 +30,7 @@
 #include "DeferredDisplayList.h"
 #include "DisplayListRenderer.h"
 #include "UvMapper.h"
-#include "utils/LinearAllocator.h"
+#include "utils/PooledLinearAllocator.h"
 
 #define CRASH() do { \
     *(int *)(uintptr_t) 0xbbadbeef = 0; \
@@ -44,25 +44,72 @@
 namespace android {
 namespace uirenderer {
 
+/**
+ * Tracks the transform and the drop shadow applied to the operations of a display list while two
+ * recordings of that display list are compared, see DisplayList::initFromDisplayListRenderer().
+ * It mirrors the effect state operations have on the renderer, without applying any clip.
+ */
+class OpDiffState {
+public:
+    OpDiffState() {
+        mTransforms.add(mat4());
+    }
+
+    void save() {
+        const mat4 transform(currentTransform());
+        mTransforms.add(transform);
+    }
+
+    void restoreToCount(int saveCount) {
+        if (saveCount < 1) saveCount = 1;
+        while (int(mTransforms.size()) > saveCount) {
+            mTransforms.removeAt(mTransforms.size() - 1);
+        }
+    }
+
+    mat4& currentTransform() {
+        return mTransforms.editItemAt(mTransforms.size() - 1);
+    }
+
+    /**
+     * Maps the specified local bounds to the coordinate space of the display list, outset to
+     * account for anti-aliasing.
+     */
+    void mapBounds(const Rect& localBounds, Rect& bounds) const {
+        bounds.set(localBounds);
+        mTransforms.itemAt(mTransforms.size() - 1).mapRect(bounds);
+        bounds.outset(1.0f);
+    }
+
+    DrawModifiers& drawModifiers() {
+        return mDrawModifiers;
+    }
+
+private:
+    Vector<mat4> mTransforms;
+    DrawModifiers mDrawModifiers;
+}; // class OpDiffState
+
 /**
  * Structure for storing canvas operations when they are recorded into a DisplayList, so that they
  * may be replayed to an OpenGLRenderer.
  *
  * To avoid individual memory allocations, DisplayListOps may only be allocated into a
- * LinearAllocator's managed memory buffers.  Each pointer held by a DisplayListOp is either a
- * pointer into memory also allocated in the LinearAllocator (mostly for text and float buffers) or
+ * PooledLinearAllocator's managed memory buffers.  Each pointer held by a DisplayListOp is either a
+ * pointer into memory also allocated in the allocator (mostly for text and float buffers) or
  * references a externally refcounted object (Sk... and Skia... objects). ~DisplayListOp() is
- * never called as LinearAllocators are simply discarded, so no memory management should be done in
- * this class.
+ * never called as allocators are simply discarded (their pages go back to a shared pool), so no
+ * memory management should be done in this class.
  */
 class DisplayListOp {
 public:
-    // These objects should always be allocated with a LinearAllocator, and never destroyed/deleted.
+    // These objects should always be allocated with a PooledLinearAllocator, and never
+    // destroyed/deleted.
     // standard new() intentionally not implemented, and delete/deconstructor should never be used.
     virtual ~DisplayListOp() { CRASH(); }
     static void operator delete(void* ptr) { CRASH(); }
     /** static void* operator new(size_t size); PURPOSELY OMITTED **/
-    static void* operator new(size_t size, LinearAllocator& allocator) {
+    static void* operator new(size_t size, PooledLinearAllocator& allocator) {
         return allocator.alloc(size);
     }
 
@@ -82,6 +129,37 @@ public:
     // NOTE: it would be nice to declare constants and overriding the implementation in each op to
     // point at the constants, but that seems to require a .cpp file
     virtual const char* name() = 0;
+
+    /**
+     * Returns true if this operation renders exactly like the specified operation, recorded in
+     * a previous recording of the same display list. Returning false is always safe, it only
+     * causes more of the display list to be considered modified.
+     */
+    virtual bool isEquivalent(DisplayListOp* op) {
+        return false;
+    }
+
+    /**
+     * Computes the area of the display list affected by this operation, when it does not match
+     * the operation at the same position in the previous recording. Returns false if that area
+     * cannot be bounded, in which case the whole display list is considered modified.
+     */
+    virtual bool getDamageBounds(OpDiffState& state, Rect& bounds) {
+        return false;
+    }
+
+    /**
+     * Applies the effect of the operation on the transform and draw modifiers to the specified
+     * diff state.
+     */
+    virtual void updateDiffState(OpDiffState& state) const {
+    }
+
+protected:
+    // Only operations of the same type can be equivalent
+    bool isSameType(DisplayListOp* op) {
+        return !strcmp(name(), op->name());
+    }
 };
 
 class StateOp : public DisplayListOp {
@@ -164,6 +242,12 @@ public:
     virtual void onDefer(OpenGLRenderer& renderer, DeferInfo& deferInfo,
             const DeferredDisplayState& state) {}
 
+    /**
+     * Returns true if onDefer() reads or fills the caches. Such operations must run
+     * onDefer() on the GL thread when their display list is deferred by a worker.
+     */
+    virtual bool onDeferUsesCaches() const { return false; }
+
     /**
      * Query the conservative, local bounds (unmapped) bounds of the op.
      *
@@ -187,7 +271,50 @@ public:
         return width * 0.5f;
     }
 
+    virtual bool getDamageBounds(OpDiffState& state, Rect& bounds) {
+        // Mask filters and loopers draw outside of the local bounds
+        if (mPaint && (mPaint->getMaskFilter() || mPaint->getLooper())) return false;
+
+        Rect localBounds;
+        if (!getLocalBounds(state.drawModifiers(), localBounds)) return false;
+        state.mapBounds(localBounds, bounds);
+        return true;
+    }
+
 protected:
+    /**
+     * Returns true if the paint of this operation renders like the paint of the specified
+     * operation. Both paints are copies owned by their display list.
+     */
+    bool isPaintEquivalent(const DrawOp* op) const {
+        const SkPaint* a = mPaint;
+        const SkPaint* b = op->mPaint;
+        if (a == b) return true;
+        if (!a || !b) return false;
+
+        return a->getColor() == b->getColor() &&
+                a->getFlags() == b->getFlags() &&
+                a->getStyle() == b->getStyle() &&
+                a->getStrokeWidth() == b->getStrokeWidth() &&
+                a->getStrokeMiter() == b->getStrokeMiter() &&
+                a->getStrokeCap() == b->getStrokeCap() &&
+                a->getStrokeJoin() == b->getStrokeJoin() &&
+                a->getHinting() == b->getHinting() &&
+                a->getXfermode() == b->getXfermode() &&
+                a->getShader() == b->getShader() &&
+                a->getColorFilter() == b->getColorFilter() &&
+                a->getPathEffect() == b->getPathEffect() &&
+                a->getMaskFilter() == b->getMaskFilter() &&
+                a->getLooper() == b->getLooper() &&
+                a->getRasterizer() == b->getRasterizer() &&
+                a->getTypeface() == b->getTypeface() &&
+                a->getTextSize() == b->getTextSize() &&
+                a->getTextScaleX() == b->getTextScaleX() &&
+                a->getTextSkewX() == b->getTextSkewX() &&
+                a->getTextAlign() == b->getTextAlign() &&
+                a->getTextEncoding() == b->getTextEncoding();
+    }
+
     SkPaint* getPaint(OpenGLRenderer& renderer) {
         return renderer.filterPaint(mPaint);
     }
@@ -280,6 +407,14 @@ public:
 
     virtual const char* name() { return "Save"; }
 
+    virtual bool isEquivalent(DisplayListOp* op) {
+        return isSameType(op) && mFlags == static_cast<SaveOp*>(op)->mFlags;
+    }
+
+    virtual void updateDiffState(OpDiffState& state) const {
+        state.save();
+    }
+
     int getFlags() const { return mFlags; }
 private:
     SaveOp() {}
@@ -314,6 +449,14 @@ public:
 
     virtual const char* name() { return "RestoreToCount"; }
 
+    virtual bool isEquivalent(DisplayListOp* op) {
+        return isSameType(op) && mCount == static_cast<RestoreToCountOp*>(op)->mCount;
+    }
+
+    virtual void updateDiffState(OpDiffState& state) const {
+        state.restoreToCount(mCount);
+    }
+
 private:
     RestoreToCountOp() {}
     DisplayListOp* reinit(int count) {
@@ -354,6 +497,17 @@ public:
 
     virtual const char* name() { return isSaveLayerAlpha() ? "SaveLayerAlpha" : "SaveLayer"; }
 
+    virtual bool isEquivalent(DisplayListOp* op) {
+        if (!isSameType(op)) return false;
+        const SaveLayerOp* other = static_cast<SaveLayerOp*>(op);
+        return mArea == other->mArea && mAlpha == other->mAlpha &&
+                mMode == other->mMode && mFlags == other->mFlags;
+    }
+
+    virtual void updateDiffState(OpDiffState& state) const {
+        state.save();
+    }
+
     int getFlags() { return mFlags; }
 
 private:
@@ -390,6 +544,16 @@ public:
 
     virtual const char* name() { return "Translate"; }
 
+    virtual bool isEquivalent(DisplayListOp* op) {
+        if (!isSameType(op)) return false;
+        const TranslateOp* other = static_cast<TranslateOp*>(op);
+        return mDx == other->mDx && mDy == other->mDy;
+    }
+
+    virtual void updateDiffState(OpDiffState& state) const {
+        state.currentTransform().translate(mDx, mDy);
+    }
+
 private:
     float mDx;
     float mDy;
@@ -410,6 +574,14 @@ public:
 
     virtual const char* name() { return "Rotate"; }
 
+    virtual bool isEquivalent(DisplayListOp* op) {
+        return isSameType(op) && mDegrees == static_cast<RotateOp*>(op)->mDegrees;
+    }
+
+    virtual void updateDiffState(OpDiffState& state) const {
+        state.currentTransform().rotate(mDegrees, 0.0f, 0.0f, 1.0f);
+    }
+
 private:
     float mDegrees;
 };
@@ -429,6 +601,16 @@ public:
 
     virtual const char* name() { return "Scale"; }
 
+    virtual bool isEquivalent(DisplayListOp* op) {
+        if (!isSameType(op)) return false;
+        const ScaleOp* other = static_cast<ScaleOp*>(op);
+        return mSx == other->mSx && mSy == other->mSy;
+    }
+
+    virtual void updateDiffState(OpDiffState& state) const {
+        state.currentTransform().scale(mSx, mSy, 1.0f);
+    }
+
 private:
     float mSx;
     float mSy;
@@ -449,6 +631,16 @@ public:
 
     virtual const char* name() { return "Skew"; }
 
+    virtual bool isEquivalent(DisplayListOp* op) {
+        if (!isSameType(op)) return false;
+        const SkewOp* other = static_cast<SkewOp*>(op);
+        return mSx == other->mSx && mSy == other->mSy;
+    }
+
+    virtual void updateDiffState(OpDiffState& state) const {
+        state.currentTransform().skew(mSx, mSy);
+    }
+
 private:
     float mSx;
     float mSy;
@@ -473,6 +665,21 @@ public:
 
     virtual const char* name() { return "SetMatrix"; }
 
+    virtual bool isEquivalent(DisplayListOp* op) {
+        if (!isSameType(op)) return false;
+        const SkMatrix* matrix = static_cast<SetMatrixOp*>(op)->mMatrix;
+        if (!mMatrix || !matrix) return mMatrix == matrix;
+        return *mMatrix == *matrix;
+    }
+
+    virtual void updateDiffState(OpDiffState& state) const {
+        if (mMatrix) {
+            state.currentTransform().load(*mMatrix);
+        } else {
+            state.currentTransform().loadIdentity();
+        }
+    }
+
 private:
     SkMatrix* mMatrix;
 };
@@ -492,6 +699,15 @@ public:
 
     virtual const char* name() { return "ConcatMatrix"; }
 
+    virtual bool isEquivalent(DisplayListOp* op) {
+        return isSameType(op) && *mMatrix == *static_cast<ConcatMatrixOp*>(op)->mMatrix;
+    }
+
+    virtual void updateDiffState(OpDiffState& state) const {
+        const mat4 transform(*mMatrix);
+        state.currentTransform().multiply(transform);
+    }
+
 private:
     SkMatrix* mMatrix;
 };
@@ -536,6 +752,22 @@ public:
 
     virtual const char* name() { return "ClipRect"; }
 
+    virtual bool isEquivalent(DisplayListOp* op) {
+        if (!isSameType(op)) return false;
+        const ClipRectOp* other = static_cast<ClipRectOp*>(op);
+        return mOp == other->mOp && mArea == other->mArea;
+    }
+
+    /**
+     * The operations drawn after a modified clip are only affected within the
+     * old and new clip rects, as long as the clip keeps them inside the rect.
+     */
+    virtual bool getDamageBounds(OpDiffState& state, Rect& bounds) {
+        if (mOp != SkRegion::kIntersect_Op && mOp != SkRegion::kReplace_Op) return false;
+        state.mapBounds(mArea, bounds);
+        return true;
+    }
+
 protected:
     virtual bool isRect() { return true; }
 
@@ -603,6 +835,10 @@ public:
     }
 
     virtual const char* name() { return "ResetShader"; }
+
+    virtual bool isEquivalent(DisplayListOp* op) {
+        return isSameType(op);
+    }
 };
 
 class SetupShaderOp : public StateOp {
@@ -634,6 +870,10 @@ public:
     }
 
     virtual const char* name() { return "ResetColorFilter"; }
+
+    virtual bool isEquivalent(DisplayListOp* op) {
+        return isSameType(op);
+    }
 };
 
 class SetupColorFilterOp : public StateOp {
@@ -666,6 +906,14 @@ public:
     }
 
     virtual const char* name() { return "ResetShadow"; }
+
+    virtual bool isEquivalent(DisplayListOp* op) {
+        return isSameType(op);
+    }
+
+    virtual void updateDiffState(OpDiffState& state) const {
+        state.drawModifiers().mHasShadow = false;
+    }
 };
 
 class SetupShadowOp : public StateOp {
@@ -683,6 +931,22 @@ public:
 
     virtual const char* name() { return "SetupShadow"; }
 
+    virtual bool isEquivalent(DisplayListOp* op) {
+        if (!isSameType(op)) return false;
+        const SetupShadowOp* other = static_cast<SetupShadowOp*>(op);
+        return mRadius == other->mRadius && mDx == other->mDx && mDy == other->mDy &&
+                mColor == other->mColor;
+    }
+
+    virtual void updateDiffState(OpDiffState& state) const {
+        DrawModifiers& drawModifiers = state.drawModifiers();
+        drawModifiers.mHasShadow = true;
+        drawModifiers.mShadowRadius = mRadius;
+        drawModifiers.mShadowDx = mDx;
+        drawModifiers.mShadowDy = mDy;
+        drawModifiers.mShadowColor = mColor;
+    }
+
 private:
     float mRadius;
     float mDx;
@@ -701,6 +965,10 @@ public:
     }
 
     virtual const char* name() { return "ResetPaintFilter"; }
+
+    virtual bool isEquivalent(DisplayListOp* op) {
+        return isSameType(op);
+    }
 };
 
 class SetupPaintFilterOp : public StateOp {
@@ -718,6 +986,12 @@ public:
 
     virtual const char* name() { return "SetupPaintFilter"; }
 
+    virtual bool isEquivalent(DisplayListOp* op) {
+        if (!isSameType(op)) return false;
+        const SetupPaintFilterOp* other = static_cast<SetupPaintFilterOp*>(op);
+        return mClearBits == other->mClearBits && mSetBits == other->mSetBits;
+    }
+
 private:
     int mClearBits;
     int mSetBits;
@@ -731,7 +1005,8 @@ class DrawBitmapOp : public DrawBoundedOp {
 public:
     DrawBitmapOp(SkBitmap* bitmap, float left, float top, SkPaint* paint)
             : DrawBoundedOp(left, top, left + bitmap->width(), top + bitmap->height(), paint),
-            mBitmap(bitmap), mAtlas(Caches::getInstance().assetAtlas) {
+            mBitmap(bitmap), mBitmapGenerationId(bitmap->getGenerationID()),
+            mAtlas(Caches::getInstance().assetAtlas) {
         mEntry = mAtlas.getEntry(bitmap);
         if (mEntry) {
             mEntryGenerationId = mAtlas.getGenerationId();
@@ -810,11 +1085,35 @@ public:
 
     virtual const char* name() { return "DrawBitmap"; }
 
+    virtual bool isEquivalent(DisplayListOp* op) {
+        if (!isSameType(op)) return false;
+        const DrawBitmapOp* other = static_cast<DrawBitmapOp*>(op);
+        return mBitmap == other->mBitmap &&
+                mBitmap->getGenerationID() == other->mBitmapGenerationId &&
+                mLocalBounds == other->mLocalBounds && isPaintEquivalent(other);
+    }
+
+    virtual bool onDeferUsesCaches() const { return true; }
+
     virtual void onDefer(OpenGLRenderer& renderer, DeferInfo& deferInfo,
             const DeferredDisplayState& state) {
         deferInfo.batchId = DeferredDisplayList::kOpBatch_Bitmap;
-        deferInfo.mergeId = getAtlasEntry() ?
-                (mergeid_t) mEntry->getMergeId() : (mergeid_t) mBitmap;
+        if (getAtlasEntry()) {
+            deferInfo.mergeId = (mergeid_t) mEntry->getMergeId();
+        } else {
+            // Small immutable bitmaps are packed in the runtime atlas so
+            // that they can be merged with each other. The entry is only
+            // valid for the current frame, so it is not kept around
+            TextureAtlas::Entry* entry =
+                    Caches::getInstance().textureCache.getAtlasEntry(mBitmap);
+            if (entry) {
+                mUvMapper = entry->uvMapper;
+                deferInfo.mergeId = (mergeid_t) entry->getMergeId();
+            } else {
+                mUvMapper = UvMapper();
+                deferInfo.mergeId = (mergeid_t) mBitmap;
+            }
+        }
 
         // Don't merge non-simply transformed or neg scale ops, SET_TEXTURE doesn't handle rotation
         // Don't merge A8 bitmaps - the paint's color isn't compared by mergeId, or in
@@ -829,6 +1128,7 @@ public:
     const SkBitmap* bitmap() { return mBitmap; }
 protected:
     SkBitmap* mBitmap;
+    uint32_t mBitmapGenerationId;
     const AssetAtlas& mAtlas;
     uint32_t mEntryGenerationId;
     AssetAtlas::Entry* mEntry;
@@ -869,7 +1169,8 @@ public:
     DrawBitmapRectOp(SkBitmap* bitmap, float srcLeft, float srcTop, float srcRight, float srcBottom,
             float dstLeft, float dstTop, float dstRight, float dstBottom, SkPaint* paint)
             : DrawBoundedOp(dstLeft, dstTop, dstRight, dstBottom, paint),
-            mBitmap(bitmap), mSrc(srcLeft, srcTop, srcRight, srcBottom) {}
+            mBitmap(bitmap), mBitmapGenerationId(bitmap->getGenerationID()),
+            mSrc(srcLeft, srcTop, srcRight, srcBottom) {}
 
     virtual status_t applyDraw(OpenGLRenderer& renderer, Rect& dirty) {
         return renderer.drawBitmap(mBitmap, mSrc.left, mSrc.top, mSrc.right, mSrc.bottom,
@@ -884,6 +1185,15 @@ public:
 
     virtual const char* name() { return "DrawBitmapRect"; }
 
+    virtual bool isEquivalent(DisplayListOp* op) {
+        if (!isSameType(op)) return false;
+        const DrawBitmapRectOp* other = static_cast<DrawBitmapRectOp*>(op);
+        return mBitmap == other->mBitmap &&
+                mBitmap->getGenerationID() == other->mBitmapGenerationId &&
+                mSrc == other->mSrc && mLocalBounds == other->mLocalBounds &&
+                isPaintEquivalent(other);
+    }
+
     virtual void onDefer(OpenGLRenderer& renderer, DeferInfo& deferInfo,
             const DeferredDisplayState& state) {
         deferInfo.batchId = DeferredDisplayList::kOpBatch_Bitmap;
@@ -891,6 +1201,7 @@ public:
 
 private:
     SkBitmap* mBitmap;
+    uint32_t mBitmapGenerationId;
     Rect mSrc;
 };
 
@@ -949,11 +1260,13 @@ private:
 };
 
 class DrawPatchOp : public DrawBoundedOp {
+    friend class DisplayListCapture; // give the capture access to the patch
 public:
     DrawPatchOp(SkBitmap* bitmap, Res_png_9patch* patch,
             float left, float top, float right, float bottom, SkPaint* paint)
             : DrawBoundedOp(left, top, right, bottom, paint),
-            mBitmap(bitmap), mPatch(patch), mGenerationId(0), mMesh(NULL),
+            mBitmap(bitmap), mBitmapGenerationId(bitmap->getGenerationID()),
+            mPatch(patch), mGenerationId(0), mMesh(NULL),
             mAtlas(Caches::getInstance().assetAtlas) {
         mEntry = mAtlas.getEntry(bitmap);
         if (mEntry) {
@@ -970,12 +1283,35 @@ public:
         return mEntry;
     }
 
+    /**
+     * Returns the entry of the bitmap in the runtime atlas, if the bitmap is not
+     * part of the asset atlas. Packing 9-patch bitmaps in the runtime atlas lets
+     * 9-patches drawn with different bitmaps merge with each other.
+     */
+    TextureAtlas::Entry* getRuntimeAtlasEntry(OpenGLRenderer& renderer) {
+        if (getAtlasEntry()) return NULL;
+        return renderer.getCaches().textureCache.getAtlasEntry(mBitmap);
+    }
+
     const Patch* getMesh(OpenGLRenderer& renderer) {
-        if (!mMesh || renderer.getCaches().patchCache.getGenerationId() != mGenerationId) {
-            PatchCache& cache = renderer.getCaches().patchCache;
-            mMesh = cache.get(getAtlasEntry(), mBitmap->width(), mBitmap->height(),
+        UvMapper mapper;
+        if (getAtlasEntry()) {
+            mapper = mEntry->uvMapper;
+        } else {
+            TextureAtlas::Entry* entry = getRuntimeAtlasEntry(renderer);
+            if (entry) mapper = entry->uvMapper;
+        }
+
+        // The runtime atlas can be reset between frames, moving the bitmap
+        Rect texCoords(0.0f, 0.0f, 1.0f, 1.0f);
+        mapper.map(texCoords);
+
+        PatchCache& cache = renderer.getCaches().patchCache;
+        if (!mMesh || cache.getGenerationId() != mGenerationId || texCoords != mTexCoords) {
+            mMesh = cache.get(mapper, mBitmap->width(), mBitmap->height(),
                     mLocalBounds.getWidth(), mLocalBounds.getHeight(), mPatch);
             mGenerationId = cache.getGenerationId();
+            mTexCoords = texCoords;
         }
         return mMesh;
     }
@@ -1073,10 +1409,26 @@ public:
 
     virtual const char* name() { return "DrawPatch"; }
 
+    virtual bool isEquivalent(DisplayListOp* op) {
+        if (!isSameType(op)) return false;
+        const DrawPatchOp* other = static_cast<DrawPatchOp*>(op);
+        return mBitmap == other->mBitmap &&
+                mBitmap->getGenerationID() == other->mBitmapGenerationId &&
+                mPatch == other->mPatch && mLocalBounds == other->mLocalBounds &&
+                isPaintEquivalent(other);
+    }
+
+    virtual bool onDeferUsesCaches() const { return true; }
+
     virtual void onDefer(OpenGLRenderer& renderer, DeferInfo& deferInfo,
             const DeferredDisplayState& state) {
         deferInfo.batchId = DeferredDisplayList::kOpBatch_Patch;
-        deferInfo.mergeId = getAtlasEntry() ? (mergeid_t) mEntry->getMergeId() : (mergeid_t) mBitmap;
+        if (getAtlasEntry()) {
+            deferInfo.mergeId = (mergeid_t) mEntry->getMergeId();
+        } else {
+            TextureAtlas::Entry* entry = getRuntimeAtlasEntry(renderer);
+            deferInfo.mergeId = entry ? (mergeid_t) entry->getMergeId() : (mergeid_t) mBitmap;
+        }
         deferInfo.mergeable = state.mMatrix.isPureTranslate() &&
                 OpenGLRenderer::getXfermodeDirect(mPaint) == SkXfermode::kSrcOver_Mode;
         deferInfo.opaqueOverBounds = isOpaqueOverBounds(state) && mBitmap->isOpaque();
@@ -1084,10 +1436,13 @@ public:
 
 private:
     SkBitmap* mBitmap;
+    uint32_t mBitmapGenerationId;
     Res_png_9patch* mPatch;
 
     uint32_t mGenerationId;
     const Patch* mMesh;
+    // Location of the bitmap in its atlas when the mesh was generated
+    Rect mTexCoords;
 
     const AssetAtlas& mAtlas;
     uint32_t mEntryGenerationId;
@@ -1109,6 +1464,12 @@ public:
 
     virtual const char* name() { return "DrawColor"; }
 
+    virtual bool isEquivalent(DisplayListOp* op) {
+        if (!isSameType(op)) return false;
+        const DrawColorOp* other = static_cast<DrawColorOp*>(op);
+        return mColor == other->mColor && mMode == other->mMode;
+    }
+
 private:
     int mColor;
     SkXfermode::Mode mMode;
@@ -1127,6 +1488,9 @@ public:
         return true;
     }
 
+    // Subclasses precache their tessellation in onDefer()
+    virtual bool onDeferUsesCaches() const { return true; }
+
     virtual void onDefer(OpenGLRenderer& renderer, DeferInfo& deferInfo,
             const DeferredDisplayState& state) {
         if (mPaint->getPathEffect()) {
@@ -1137,6 +1501,15 @@ public:
                     DeferredDisplayList::kOpBatch_Vertices;
         }
     }
+
+protected:
+    /**
+     * Starts tessellating the shape on a worker thread. The renderer
+     * picks up the result from the tessellation cache at replay time.
+     */
+    void precacheShape(OpenGLRenderer& renderer, const TessellationDescription& description) {
+        renderer.getCaches().tessellationCache.precache(description);
+    }
 };
 
 class DrawRectOp : public DrawStrokableOp {
@@ -1158,9 +1531,26 @@ public:
         DrawStrokableOp::onDefer(renderer, deferInfo, state);
         deferInfo.opaqueOverBounds = isOpaqueOverBounds(state) &&
                 mPaint->getStyle() == SkPaint::kFill_Style;
+
+        // Only non-rectilinear AA fills and simple strokes are tessellated
+        SkPaint* paint = getPaint(renderer);
+        const bool tessellate = paint->getStyle() == SkPaint::kFill_Style ?
+                paint->isAntiAlias() && !state.mMatrix.isSimple() :
+                !paint->getPathEffect() && paint->getStrokeJoin() == SkPaint::kMiter_Join;
+        if (tessellate) {
+            TessellationDescription description(kShapeRect, state.mMatrix, paint);
+            description.shape.rect.mWidth = mLocalBounds.getWidth();
+            description.shape.rect.mHeight = mLocalBounds.getHeight();
+            precacheShape(renderer, description);
+        }
     }
 
     virtual const char* name() { return "DrawRect"; }
+
+    virtual bool isEquivalent(DisplayListOp* op) {
+        return isSameType(op) && mLocalBounds == static_cast<DrawRectOp*>(op)->mLocalBounds &&
+                isPaintEquivalent(static_cast<DrawOp*>(op));
+    }
 };
 
 class DrawRectsOp : public DrawBoundedOp {
@@ -1204,8 +1594,30 @@ public:
         OP_LOG("Draw RoundRect "RECT_STRING", rx %f, ry %f", RECT_ARGS(mLocalBounds), mRx, mRy);
     }
 
+    virtual void onDefer(OpenGLRenderer& renderer, DeferInfo& deferInfo,
+            const DeferredDisplayState& state) {
+        DrawStrokableOp::onDefer(renderer, deferInfo, state);
+
+        SkPaint* paint = getPaint(renderer);
+        if (!paint->getPathEffect()) {
+            TessellationDescription description(kShapeRoundRect, state.mMatrix, paint);
+            description.shape.roundRect.mWidth = mLocalBounds.getWidth();
+            description.shape.roundRect.mHeight = mLocalBounds.getHeight();
+            description.shape.roundRect.mRx = mRx;
+            description.shape.roundRect.mRy = mRy;
+            precacheShape(renderer, description);
+        }
+    }
+
     virtual const char* name() { return "DrawRoundRect"; }
 
+    virtual bool isEquivalent(DisplayListOp* op) {
+        if (!isSameType(op)) return false;
+        const DrawRoundRectOp* other = static_cast<DrawRoundRectOp*>(op);
+        return mLocalBounds == other->mLocalBounds && mRx == other->mRx && mRy == other->mRy &&
+                isPaintEquivalent(other);
+    }
+
 private:
     float mRx;
     float mRy;
@@ -1225,8 +1637,27 @@ public:
         OP_LOG("Draw Circle x %f, y %f, r %f", mX, mY, mRadius);
     }
 
+    virtual void onDefer(OpenGLRenderer& renderer, DeferInfo& deferInfo,
+            const DeferredDisplayState& state) {
+        DrawStrokableOp::onDefer(renderer, deferInfo, state);
+
+        SkPaint* paint = getPaint(renderer);
+        if (!paint->getPathEffect()) {
+            TessellationDescription description(kShapeCircle, state.mMatrix, paint);
+            description.shape.circle.mRadius = mRadius;
+            precacheShape(renderer, description);
+        }
+    }
+
     virtual const char* name() { return "DrawCircle"; }
 
+    virtual bool isEquivalent(DisplayListOp* op) {
+        if (!isSameType(op)) return false;
+        const DrawCircleOp* other = static_cast<DrawCircleOp*>(op);
+        return mX == other->mX && mY == other->mY && mRadius == other->mRadius &&
+                isPaintEquivalent(other);
+    }
+
 private:
     float mX;
     float mY;
@@ -1247,6 +1678,19 @@ public:
         OP_LOG("Draw Oval "RECT_STRING, RECT_ARGS(mLocalBounds));
     }
 
+    virtual void onDefer(OpenGLRenderer& renderer, DeferInfo& deferInfo,
+            const DeferredDisplayState& state) {
+        DrawStrokableOp::onDefer(renderer, deferInfo, state);
+
+        SkPaint* paint = getPaint(renderer);
+        if (!paint->getPathEffect()) {
+            TessellationDescription description(kShapeOval, state.mMatrix, paint);
+            description.shape.oval.mWidth = mLocalBounds.getWidth();
+            description.shape.oval.mHeight = mLocalBounds.getHeight();
+            precacheShape(renderer, description);
+        }
+    }
+
     virtual const char* name() { return "DrawOval"; }
 };
 
@@ -1268,6 +1712,24 @@ public:
                 RECT_ARGS(mLocalBounds), mStartAngle, mSweepAngle, mUseCenter);
     }
 
+    virtual void onDefer(OpenGLRenderer& renderer, DeferInfo& deferInfo,
+            const DeferredDisplayState& state) {
+        DrawStrokableOp::onDefer(renderer, deferInfo, state);
+
+        // Only strokes are tessellated, see OpenGLRenderer::drawArc()
+        SkPaint* paint = getPaint(renderer);
+        if (fabs(mSweepAngle) < 360.0f && paint->getStyle() == SkPaint::kStroke_Style &&
+                !paint->getPathEffect() && !mUseCenter) {
+            TessellationDescription description(kShapeArc, state.mMatrix, paint);
+            description.shape.arc.mWidth = mLocalBounds.getWidth();
+            description.shape.arc.mHeight = mLocalBounds.getHeight();
+            description.shape.arc.mStartAngle = mStartAngle;
+            description.shape.arc.mSweepAngle = mSweepAngle;
+            description.shape.arc.mUseCenter = mUseCenter;
+            precacheShape(renderer, description);
+        }
+    }
+
     virtual const char* name() { return "DrawArc"; }
 
 private:
@@ -1292,6 +1754,8 @@ public:
         return renderer.drawPath(mPath, getPaint(renderer));
     }
 
+    virtual bool onDeferUsesCaches() const { return true; }
+
     virtual void onDefer(OpenGLRenderer& renderer, DeferInfo& deferInfo,
             const DeferredDisplayState& state) {
         SkPaint* paint = getPaint(renderer);
@@ -1365,6 +1829,8 @@ public:
         OP_LOG("Draw some text, %d bytes", mBytesCount);
     }
 
+    virtual bool onDeferUsesCaches() const { return true; }
+
     virtual void onDefer(OpenGLRenderer& renderer, DeferInfo& deferInfo,
             const DeferredDisplayState& state) {
         SkPaint* paint = getPaint(renderer);
@@ -1427,18 +1893,25 @@ public:
     DrawTextOp(const char* text, int bytesCount, int count, float x, float y,
             const float* positions, SkPaint* paint, float totalAdvance, const Rect& bounds)
             : DrawBoundedOp(bounds, paint), mText(text), mBytesCount(bytesCount), mCount(count),
-            mX(x), mY(y), mPositions(positions), mTotalAdvance(totalAdvance) {
+            mX(x), mY(y), mPositions(positions), mTotalAdvance(totalAdvance),
+            mPrecacheDistanceField(false) {
         memset(&mPrecacheTransform.data[0], 0xff, 16 * sizeof(float));
     }
 
+    virtual bool onDeferUsesCaches() const { return true; }
+
     virtual void onDefer(OpenGLRenderer& renderer, DeferInfo& deferInfo,
             const DeferredDisplayState& state) {
         SkPaint* paint = getPaint(renderer);
         FontRenderer& fontRenderer = renderer.getCaches().fontRenderer->getFontRenderer(paint);
-        const mat4& transform = renderer.findBestFontTransform(state.mMatrix);
-        if (mPrecacheTransform != transform) {
-            fontRenderer.precache(paint, mText, mCount, transform);
+        // Distance field glyphs do not depend on the transform
+        const bool distanceField = renderer.useDistanceFieldText(paint, state.mMatrix);
+        const mat4& transform = distanceField ?
+                mat4::identity() : renderer.findBestFontTransform(state.mMatrix);
+        if (mPrecacheTransform != transform || mPrecacheDistanceField != distanceField) {
+            fontRenderer.precache(paint, mText, mCount, transform, distanceField);
             mPrecacheTransform = transform;
+            mPrecacheDistanceField = distanceField;
         }
         deferInfo.batchId = mPaint->getColor() == 0xff000000 ?
                 DeferredDisplayList::kOpBatch_Text :
@@ -1449,7 +1922,10 @@ public:
         // don't merge decorated text - the decorations won't draw in order
         bool noDecorations = !(mPaint->getFlags() & (SkPaint::kUnderlineText_Flag |
                         SkPaint::kStrikeThruText_Flag));
+        // merged ops share the program of the last op, which must not
+        // mix distance field and regular glyphs
         deferInfo.mergeable = state.mMatrix.isPureTranslate() && noDecorations &&
+                !distanceField &&
                 OpenGLRenderer::getXfermodeDirect(mPaint) == SkXfermode::kSrcOver_Mode;
     }
 
@@ -1484,6 +1960,19 @@ public:
 
     virtual const char* name() { return "DrawText"; }
 
+    virtual bool isEquivalent(DisplayListOp* op) {
+        if (!isSameType(op)) return false;
+        const DrawTextOp* other = static_cast<DrawTextOp*>(op);
+        if (mBytesCount != other->mBytesCount || mCount != other->mCount ||
+                mX != other->mX || mY != other->mY || mTotalAdvance != other->mTotalAdvance ||
+                !isPaintEquivalent(other)) {
+            return false;
+        }
+        if (memcmp(mText, other->mText, mBytesCount)) return false;
+        if (!mPositions || !other->mPositions) return mPositions == other->mPositions;
+        return !memcmp(mPositions, other->mPositions, mCount * 2 * sizeof(float));
+    }
+
 private:
     const char* mText;
     int mBytesCount;
@@ -1493,6 +1982,7 @@ private:
     const float* mPositions;
     float mTotalAdvance;
     mat4 mPrecacheTransform;
+    bool mPrecacheDistanceField;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1522,6 +2012,7 @@ private:
 };
 
 class DrawDisplayListOp : public DrawBoundedOp {
+    friend class DisplayListCapture; // give the capture access to the child display list
 public:
     DrawDisplayListOp(DisplayList* displayList, int flags)
             : DrawBoundedOp(0, 0, displayList->getWidth(), displayList->getHeight(), 0),
@@ -1554,6 +2045,11 @@ public:
 
     virtual const char* name() { return "DrawDisplayList"; }
 
+    // The child display list applies its own properties, it may draw outside of its bounds
+    virtual bool getDamageBounds(OpDiffState& state, Rect& bounds) {
+        return false;
+    }
+
 private:
     DisplayList* mDisplayList;
     int mFlags;
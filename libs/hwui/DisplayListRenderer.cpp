@@ -98,6 +98,7 @@ void DisplayListRenderer::reset() {
     mLayers.clear();
 
     mHasDrawOps = false;
+    mChildren.clear();
     mFunctorCount = 0;
 }
 
@@ -249,6 +250,7 @@ status_t DisplayListRenderer::drawDisplayList(DisplayList* displayList,
     //       do the right thing for now
 
     addDrawOp(new (alloc()) DrawDisplayListOp(displayList, flags));
+    mChildren.add(displayList);
     return DrawGlInfo::kStatusDone;
 }
 
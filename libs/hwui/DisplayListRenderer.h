@@ -192,11 +192,19 @@ public:
         return mFunctorCount;
     }
 
+    bool hasChildren() const {
+        return !mChildren.isEmpty();
+    }
+
+    const Vector<DisplayList*>& getChildren() const {
+        return mChildren;
+    }
+
 private:
     void insertRestoreToCount();
     void insertTranslate();
 
-    LinearAllocator& alloc() { return mDisplayListData->allocator; }
+    PooledLinearAllocator& alloc() { return mDisplayListData->allocator; }
     void addStateOp(StateOp* op);
     void addDrawOp(DrawOp* op);
     void addOpInternal(DisplayListOp* op) {
@@ -361,6 +369,9 @@ private:
     bool mHasTranslate;
     bool mHasDrawOps;
 
+    // Display lists drawn by this display list, in drawing order
+    Vector<DisplayList*> mChildren;
+
     uint32_t mFunctorCount;
 
     friend class DisplayList;
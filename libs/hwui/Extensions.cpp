@@ -61,9 +61,11 @@ Extensions::Extensions(): Singleton<Extensions>() {
     mHasTiledRendering = hasGlExtension("GL_QCOM_tiled_rendering");
     mHas1BitStencil = hasGlExtension("GL_OES_stencil1");
     mHas4BitStencil = hasGlExtension("GL_OES_stencil4");
+    mHasProgramBinary = hasGlExtension("GL_OES_get_program_binary");
 
     // Query EGL extensions
     findExtensions(eglQueryString(eglGetCurrentDisplay(), EGL_EXTENSIONS), mEglExtensionList);
+    mHasBufferAge = hasEglExtension("EGL_EXT_buffer_age");
 
     char property[PROPERTY_VALUE_MAX];
     if (property_get(PROPERTY_DEBUG_NV_PROFILING, property, NULL) > 0) {
@@ -41,6 +41,8 @@ public:
     inline bool has1BitStencil() const { return mHas1BitStencil; }
     inline bool has4BitStencil() const { return mHas4BitStencil; }
     inline bool hasNvSystemTime() const { return mHasNvSystemTime; }
+    inline bool hasBufferAge() const { return mHasBufferAge; }
+    inline bool hasProgramBinary() const { return mHasProgramBinary; }
     inline bool hasUnpackRowLength() const { return mVersionMajor >= 3; }
     inline bool hasPixelBufferObjects() const { return mVersionMajor >= 3; }
     inline bool hasOcclusionQueries() const { return mVersionMajor >= 3; }
@@ -74,6 +76,8 @@ private:
     bool mHas1BitStencil;
     bool mHas4BitStencil;
     bool mHasNvSystemTime;
+    bool mHasBufferAge;
+    bool mHasProgramBinary;
 
     int mVersionMajor;
     int mVersionMinor;
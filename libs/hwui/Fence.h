@@ -75,6 +75,16 @@ public:
         return waitStatus == EGL_CONDITION_SATISFIED_KHR;
     }
 
+    /**
+     * Returns true if this fence has been signaled. This method never
+     * blocks. A fence that could not be created is always signaled.
+     */
+    bool isSignaled() {
+        if (mFence == EGL_NO_SYNC_KHR) return true;
+        return eglClientWaitSyncKHR(mDisplay, mFence, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, 0) ==
+                EGL_CONDITION_SATISFIED_KHR;
+    }
+
 private:
     EGLDisplay mDisplay;
     EGLSyncKHR mFence;
@@ -15,6 +15,7 @@
  */
 
 #define LOG_TAG "OpenGLRenderer"
+#define ATRACE_TAG ATRACE_TAG_VIEW
 
 #include <SkGlyph.h>
 #include <SkUtils.h>
@@ -22,6 +23,7 @@
 #include <cutils/properties.h>
 
 #include <utils/Log.h>
+#include <utils/Trace.h>
 
 #ifdef ANDROID_ENABLE_RENDERSCRIPT
 #include <RenderScript.h>
@@ -44,6 +46,10 @@ namespace uirenderer {
 // blur inputs smaller than this constant will bypass renderscript
 #define RS_MIN_INPUT_CUTOFF 10000
 
+// blur radii larger than this constant will use a box blur approximation
+// when renderscript is not used
+#define BOX_BLUR_MIN_RADIUS 16
+
 ///////////////////////////////////////////////////////////////////////////////
 // TextSetupFunctor
 ///////////////////////////////////////////////////////////////////////////////
@@ -57,6 +63,9 @@ status_t TextSetupFunctor::operator ()(int what, void* data) {
     renderer->setupDrawWithTexture(glyphFormat == GL_ALPHA);
     switch (glyphFormat) {
         case GL_ALPHA: {
+            if (distanceFieldSmoothing > 0.0f) {
+                renderer->setupDrawDistanceField();
+            }
             renderer->setupDrawAlpha8Color(paint->getColor(), alpha);
             break;
         }
@@ -86,6 +95,7 @@ status_t TextSetupFunctor::operator ()(int what, void* data) {
     renderer->setupDrawColorFilterUniforms();
     renderer->setupDrawShaderUniforms(pureTranslate);
     renderer->setupDrawTextGammaUniforms();
+    renderer->setupDrawDistanceFieldUniforms(distanceFieldSmoothing);
 
     return NO_ERROR;
 }
@@ -107,8 +117,10 @@ FontRenderer::FontRenderer() :
     mInitialized = false;
 
     mCurrentCacheTexture = NULL;
+    mGeneration = 0;
 
     mLinearFiltering = false;
+    mDistanceFieldEnabled = true;
 
     mSmallCacheWidth = DEFAULT_TEXT_SMALL_CACHE_WIDTH;
     mSmallCacheHeight = DEFAULT_TEXT_SMALL_CACHE_HEIGHT;
@@ -132,6 +144,10 @@ FontRenderer::FontRenderer() :
         mLargeCacheHeight = atoi(property);
     }
 
+    if (property_get(PROPERTY_TEXT_DISTANCE_FIELD, property, "true") > 0) {
+        mDistanceFieldEnabled = !strcmp(property, "true");
+    }
+
     uint32_t maxTextureSize = (uint32_t) Caches::getInstance().maxTextureSize;
     mSmallCacheWidth = mSmallCacheWidth > maxTextureSize ? maxTextureSize : mSmallCacheWidth;
     mSmallCacheHeight = mSmallCacheHeight > maxTextureSize ? maxTextureSize : mSmallCacheHeight;
@@ -157,6 +173,8 @@ void clearCacheTextures(Vector<CacheTexture*>& cacheTextures) {
 }
 
 FontRenderer::~FontRenderer() {
+    cancelPrecaching();
+
     clearCacheTextures(mACacheTextures);
     clearCacheTextures(mRGBACacheTextures);
 
@@ -184,6 +202,135 @@ void FontRenderer::flushAllAndInvalidate() {
     }
 }
 
+static int compareGlyphGeneration(CachedGlyphInfo* const* lhs, CachedGlyphInfo* const* rhs) {
+    // Most recently used glyphs first
+    if ((*lhs)->mGeneration > (*rhs)->mGeneration) return -1;
+    if ((*lhs)->mGeneration < (*rhs)->mGeneration) return 1;
+    return 0;
+}
+
+/**
+ * Repacks the glyphs stored in the specified cache textures. The most recently
+ * used glyphs are moved, without being rasterized again, until they cover
+ * CACHE_COMPACTION_KEEP_RATIO of the area of the textures; the other glyphs are
+ * invalidated. This frees space for new glyphs without dropping the glyphs that
+ * are still drawn, and removes the fragmentation left by invalidated glyphs.
+ */
+void FontRenderer::compactCacheTextures(Vector<CacheTexture*>& cacheTextures) {
+    // Glyphs are about to move, the pending quads must be drawn first
+    issueDrawCommand();
+
+    // Save the content of the cache textures, glyphs are copied from there
+    KeyedVector<CacheTexture*, uint8_t*> snapshots;
+    uint32_t area = 0;
+    for (uint32_t i = 0; i < cacheTextures.size(); i++) {
+        CacheTexture* cacheTexture = cacheTextures[i];
+        PixelBuffer* pixelBuffer = cacheTexture->getPixelBuffer();
+        if (pixelBuffer && cacheTexture->getGlyphCount() > 0) {
+            uint8_t* snapshot = new uint8_t[pixelBuffer->getSize()];
+            memcpy(snapshot, pixelBuffer->map(), pixelBuffer->getSize());
+            snapshots.add(cacheTexture, snapshot);
+            area += cacheTexture->getWidth() * cacheTexture->getHeight();
+        }
+    }
+
+    Vector<CachedGlyphInfo*> glyphs;
+    LruCache<Font::FontDescription, Font*>::Iterator it(mActiveFonts);
+    while (it.next()) {
+        const DefaultKeyedVector<glyph_t, CachedGlyphInfo*>& cachedGlyphs =
+                it.value()->mCachedGlyphs;
+        for (uint32_t i = 0; i < cachedGlyphs.size(); i++) {
+            CachedGlyphInfo* cachedGlyph = cachedGlyphs.valueAt(i);
+            if (cachedGlyph->mIsValid && cachedGlyph->mCacheTexture &&
+                    snapshots.indexOfKey(cachedGlyph->mCacheTexture) >= 0) {
+                glyphs.add(cachedGlyph);
+            }
+        }
+    }
+    glyphs.sort(compareGlyphGeneration);
+
+    for (uint32_t i = 0; i < cacheTextures.size(); i++) {
+        cacheTextures[i]->init();
+    }
+
+    const uint32_t maxKeptArea = uint32_t(area * CACHE_COMPACTION_KEEP_RATIO);
+    uint32_t keptArea = 0;
+
+    for (uint32_t i = 0; i < glyphs.size(); i++) {
+        CachedGlyphInfo* cachedGlyph = glyphs[i];
+        const uint32_t width = cachedGlyph->mBitmapWidth;
+        const uint32_t height = cachedGlyph->mBitmapHeight;
+        const uint32_t glyphArea = (width + TEXTURE_BORDER_SIZE * 2) *
+                (height + TEXTURE_BORDER_SIZE * 2);
+
+        uint32_t startX = 0;
+        uint32_t startY = 0;
+        CacheTexture* cacheTexture = NULL;
+        if (keptArea + glyphArea <= maxKeptArea) {
+            for (uint32_t j = 0; j < cacheTextures.size(); j++) {
+                if (cacheTextures[j]->fitBitmap(width, height, &startX, &startY)) {
+                    cacheTexture = cacheTextures[j];
+                    break;
+                }
+            }
+        }
+
+        if (!cacheTexture) {
+            cachedGlyph->mIsValid = false;
+            continue;
+        }
+
+        if (!cacheTexture->getPixelBuffer()) {
+            Caches::getInstance().activeTexture(0);
+            cacheTexture->allocateTexture();
+        }
+        if (!cacheTexture->mesh()) {
+            cacheTexture->allocateMesh();
+        }
+
+        // Copy the glyph along with its border
+        CacheTexture* oldTexture = cachedGlyph->mCacheTexture;
+        const uint8_t* src = snapshots.valueFor(oldTexture) + oldTexture->getOffset(
+                cachedGlyph->mStartX - TEXTURE_BORDER_SIZE,
+                cachedGlyph->mStartY - TEXTURE_BORDER_SIZE);
+        uint8_t* dst = cacheTexture->getPixelBuffer()->map() + cacheTexture->getOffset(
+                startX - TEXTURE_BORDER_SIZE, startY - TEXTURE_BORDER_SIZE);
+
+        const uint32_t formatSize = PixelBuffer::formatSize(cacheTexture->getFormat());
+        const uint32_t rowSize = (width + TEXTURE_BORDER_SIZE * 2) * formatSize;
+        const uint32_t srcStride = oldTexture->getWidth() * formatSize;
+        const uint32_t dstStride = cacheTexture->getWidth() * formatSize;
+        for (uint32_t y = 0; y < height + TEXTURE_BORDER_SIZE * 2; y++) {
+            memcpy(dst, src, rowSize);
+            src += srcStride;
+            dst += dstStride;
+        }
+
+        const float cacheWidth = cacheTexture->getWidth();
+        const float cacheHeight = cacheTexture->getHeight();
+
+        cachedGlyph->mCacheTexture = cacheTexture;
+        cachedGlyph->mStartX = startX;
+        cachedGlyph->mStartY = startY;
+        cachedGlyph->mBitmapMinU = startX / cacheWidth;
+        cachedGlyph->mBitmapMinV = startY / cacheHeight;
+        cachedGlyph->mBitmapMaxU = (startX + width) / cacheWidth;
+        cachedGlyph->mBitmapMaxV = (startY + height) / cacheHeight;
+
+        keptArea += glyphArea;
+    }
+
+    for (uint32_t i = 0; i < snapshots.size(); i++) {
+        delete[] snapshots.valueAt(i);
+    }
+
+    setTextureDirty();
+
+#if DEBUG_FONT_RENDERER
+    ALOGD("compactCacheTextures: kept %d of %d pixels", keptArea, area);
+#endif
+}
+
 void FontRenderer::flushLargeCaches(Vector<CacheTexture*>& cacheTextures) {
     // Start from 1; don't deallocate smallest/default texture
     for (uint32_t i = 1; i < cacheTextures.size(); i++) {
@@ -200,6 +347,9 @@ void FontRenderer::flushLargeCaches(Vector<CacheTexture*>& cacheTextures) {
 }
 
 void FontRenderer::flushLargeCaches() {
+    // Worker threads may have been stopped
+    cancelPrecaching();
+
     flushLargeCaches(mACacheTextures);
     flushLargeCaches(mRGBACacheTextures);
 }
@@ -216,7 +366,7 @@ CacheTexture* FontRenderer::cacheBitmapInTexture(Vector<CacheTexture*>& cacheTex
 }
 
 void FontRenderer::cacheBitmap(const SkGlyph& glyph, CachedGlyphInfo* cachedGlyph,
-        uint32_t* retOriginX, uint32_t* retOriginY, bool precaching) {
+        uint32_t* retOriginX, uint32_t* retOriginY, bool precaching, bool applyGamma) {
     checkInit();
 
     // If the glyph bitmap is empty let's assum the glyph is valid
@@ -264,9 +414,15 @@ void FontRenderer::cacheBitmap(const SkGlyph& glyph, CachedGlyphInfo* cachedGlyp
     if (!cacheTexture) {
         if (!precaching) {
             // If the new glyph didn't fit and we are not just trying to precache it,
-            // clear out the cache and try again
-            flushAllAndInvalidate();
+            // evict the least recently used glyphs and try again
+            compactCacheTextures(*cacheTextures);
             cacheTexture = cacheBitmapInTexture(*cacheTextures, glyph, &startX, &startY);
+
+            if (!cacheTexture) {
+                // Clear out the cache as a last resort
+                flushAllAndInvalidate();
+                cacheTexture = cacheBitmapInTexture(*cacheTextures, glyph, &startX, &startY);
+            }
         }
 
         if (!cacheTexture) {
@@ -307,7 +463,7 @@ void FontRenderer::cacheBitmap(const SkGlyph& glyph, CachedGlyphInfo* cachedGlyp
             // write leading border line
             memset(&cacheBuffer[row], 0, glyph.fWidth + 2 * TEXTURE_BORDER_SIZE);
             // write glyph data
-            if (mGammaTable) {
+            if (mGammaTable && applyGamma) {
                 for (cacheY = startY, bY = 0; cacheY < endY; cacheY++, bY += srcStride) {
                     row = cacheY * cacheWidth;
                     cacheBuffer[row + startX - TEXTURE_BORDER_SIZE] = 0;
@@ -586,8 +742,39 @@ void FontRenderer::appendRotatedMeshQuad(float x1, float y1, float u1, float v1,
     }
 }
 
-void FontRenderer::setFont(SkPaint* paint, const mat4& matrix) {
-    mCurrentFont = Font::create(this, paint, matrix);
+void FontRenderer::setFont(SkPaint* paint, const mat4& matrix, bool distanceField) {
+    mCurrentFont = Font::create(this, paint, matrix, distanceField);
+}
+
+bool FontRenderer::canUseDistanceField(const SkPaint* paint, const mat4& transform) const {
+    // Strokes and perspective are better served by glyphs
+    // rasterized with the actual paint and transform
+    if (!mDistanceFieldEnabled || paint->getStyle() != SkPaint::kFill_Style ||
+            transform.isPerspective()) {
+        return false;
+    }
+
+    float sx, sy;
+    transform.decomposeScale(sx, sy);
+    const float screenTextSize = paint->getTextSize() * fmaxf(sx, sy);
+
+    if (screenTextSize >= DISTANCE_FIELD_MIN_LARGE_TEXT_SIZE) {
+        return true;
+    }
+    return !transform.isPureTranslate() &&
+            screenTextSize >= DISTANCE_FIELD_MIN_TRANSFORMED_TEXT_SIZE;
+}
+
+float FontRenderer::getDistanceFieldSmoothing(const SkPaint* paint, const mat4& transform) {
+    float sx, sy;
+    transform.decomposeScale(sx, sy);
+
+    // Number of screen pixels covered by one pixel of the distance field
+    const float scale = paint->getTextSize() * (sx + sy) * 0.5f / DISTANCE_FIELD_TEXT_SIZE;
+    if (scale <= 0.0f) return 0.5f;
+
+    // One screen pixel spans 1 / (scale * 2 * spread) units of the field
+    return fminf(0.5f, 0.25f / (scale * DISTANCE_FIELD_SPREAD));
 }
 
 FontRenderer::DropShadow FontRenderer::renderDropShadow(SkPaint* paint, const char *text,
@@ -661,6 +848,7 @@ FontRenderer::DropShadow FontRenderer::renderDropShadow(SkPaint* paint, const ch
 
 void FontRenderer::initRender(const Rect* clip, Rect* bounds, Functor* functor) {
     checkInit();
+    mGeneration++;
 
     mDrawn = false;
     mBounds = bounds;
@@ -675,15 +863,101 @@ void FontRenderer::finishRender() {
     issueDrawCommand();
 }
 
-void FontRenderer::precache(SkPaint* paint, const char* text, int numGlyphs, const mat4& matrix) {
-    Font* font = Font::create(this, paint, matrix);
-    font->precache(paint, text, numGlyphs);
+///////////////////////////////////////////////////////////////////////////////
+// Precaching
+///////////////////////////////////////////////////////////////////////////////
+
+FontRenderer::PrecacheTask::~PrecacheTask() {
+    for (size_t i = 0; i < rasterizedGlyphs.size(); i++) {
+        delete[] (uint8_t*) rasterizedGlyphs[i].skiaGlyph.fImage;
+    }
+}
+
+FontRenderer::PrecacheProcessor::PrecacheProcessor(Caches& caches):
+        TaskProcessor<bool>(&caches.tasks) {
+}
+
+void FontRenderer::PrecacheProcessor::onProcess(const sp<Task<bool> >& task) {
+    sp<PrecacheTask> t = static_cast<PrecacheTask*>(task.get());
+    ATRACE_NAME("precacheGlyphs");
+
+    const SkMatrix& lookupTransform = t->font->getDescription().mLookupTransform;
+    const bool distanceField = t->font->isDistanceField();
+
+    for (size_t i = 0; i < t->glyphs.size(); i++) {
+        if (t->isCanceled()) break;
+
+        PrecacheTask::RasterizedGlyph rasterizedGlyph;
+        rasterizedGlyph.glyph = t->glyphs[i];
+        if (Font::rasterize(&t->paint, rasterizedGlyph.glyph, lookupTransform, distanceField,
+                &rasterizedGlyph.skiaGlyph)) {
+            t->rasterizedGlyphs.add(rasterizedGlyph);
+        }
+    }
+
+    t->setResult(!t->isCanceled());
+}
+
+void FontRenderer::precache(SkPaint* paint, const char* text, int numGlyphs, const mat4& matrix,
+        bool distanceField) {
+    mGeneration++;
+    Font* font = Font::create(this, paint, matrix, distanceField);
+
+    SkPaint fieldPaint;
+    if (distanceField) {
+        Font::getDistanceFieldPaint(paint, &fieldPaint);
+        paint = &fieldPaint;
+    }
+
+    Caches& caches = Caches::getInstance();
+    if (!caches.tasks.canRunTasks()) {
+        font->precache(paint, text, numGlyphs);
+        return;
+    }
+
+    // Skia rasterizes the glyphs on the worker threads, only copying
+    // the images into the cache textures happens in endPrecaching()
+    sp<PrecacheTask> task = new PrecacheTask(font, paint);
+    font->findUncachedGlyphs(text, numGlyphs, task->glyphs);
+    if (task->glyphs.isEmpty()) return;
+
+    if (mPrecacheProcessor == NULL) {
+        mPrecacheProcessor = new PrecacheProcessor(caches);
+    }
+
+    if (mPrecacheProcessor->add(task)) {
+        mPrecacheTasks.push(task);
+    } else {
+        font->precache(paint, text, numGlyphs);
+    }
 }
 
 void FontRenderer::endPrecaching() {
+    for (size_t i = 0; i < mPrecacheTasks.size(); i++) {
+        const sp<PrecacheTask>& task = mPrecacheTasks.itemAt(i);
+        if (!task->getResult()) continue;
+
+        for (size_t j = 0; j < task->rasterizedGlyphs.size(); j++) {
+            const PrecacheTask::RasterizedGlyph& rasterizedGlyph = task->rasterizedGlyphs[j];
+            task->font->cacheRasterizedGlyph(&task->paint,
+                    rasterizedGlyph.glyph, rasterizedGlyph.skiaGlyph);
+        }
+    }
+    mPrecacheTasks.clear();
+
     checkTextureUpdate();
 }
 
+void FontRenderer::cancelPrecaching() {
+    for (size_t i = 0; i < mPrecacheTasks.size(); i++) {
+        const sp<PrecacheTask>& task = mPrecacheTasks.itemAt(i);
+        task->cancel();
+        // Wait for a running task to let go of its font
+        task->getResult();
+    }
+    mPrecacheTasks.clear();
+}
+
 bool FontRenderer::renderPosText(SkPaint* paint, const Rect* clip, const char *text,
         uint32_t startIndex, uint32_t len, int numGlyphs, int x, int y,
         const float* positions, Rect* bounds, Functor* functor, bool forceFinish) {
@@ -693,7 +967,13 @@ bool FontRenderer::renderPosText(SkPaint* paint, const Rect* clip, const char *t
     }
 
     initRender(clip, bounds, functor);
-    mCurrentFont->render(paint, text, startIndex, len, numGlyphs, x, y, positions);
+    if (mCurrentFont->isDistanceField()) {
+        SkPaint fieldPaint;
+        Font::getDistanceFieldPaint(paint, &fieldPaint);
+        mCurrentFont->render(&fieldPaint, text, startIndex, len, numGlyphs, x, y, positions);
+    } else {
+        mCurrentFont->render(paint, text, startIndex, len, numGlyphs, x, y, positions);
+    }
 
     if (forceFinish) {
         finishRender();
@@ -762,14 +1042,20 @@ void FontRenderer::blurImage(uint8_t** image, int32_t width, int32_t height, int
     }
 #endif
 
-    float *gaussian = new float[2 * radius + 1];
-    Blur::generateGaussianWeights(gaussian, radius);
-
     uint8_t* scratch = new uint8_t[width * height];
-    Blur::horizontal(gaussian, radius, *image, scratch, width, height);
-    Blur::vertical(gaussian, radius, scratch, *image, width, height);
 
-    delete[] gaussian;
+    if (radius > BOX_BLUR_MIN_RADIUS) {
+        Blur::approximateGaussian(radius, *image, scratch, width, height);
+    } else {
+        float *gaussian = new float[2 * radius + 1];
+        Blur::generateGaussianWeights(gaussian, radius);
+
+        Blur::horizontal(gaussian, radius, *image, scratch, width, height);
+        Blur::vertical(gaussian, radius, scratch, *image, width, height);
+
+        delete[] gaussian;
+    }
+
     delete[] scratch;
 }
 
@@ -30,6 +30,8 @@
 #include "font/CacheTexture.h"
 #include "font/CachedGlyphInfo.h"
 #include "font/Font.h"
+#include "thread/Task.h"
+#include "thread/TaskProcessor.h"
 #include "utils/SortedList.h"
 #include "Matrix.h"
 #include "Properties.h"
@@ -49,6 +51,7 @@ class Functor;
 namespace android {
 namespace uirenderer {
 
+class Caches;
 class OpenGLRenderer;
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -64,9 +67,11 @@ public:
     };
 
     TextSetupFunctor(OpenGLRenderer* renderer, float x, float y, bool pureTranslate,
-            int alpha, SkXfermode::Mode mode, SkPaint* paint): Functor(),
+            int alpha, SkXfermode::Mode mode, SkPaint* paint,
+            float distanceFieldSmoothing = 0.0f): Functor(),
             renderer(renderer), x(x), y(y), pureTranslate(pureTranslate),
-            alpha(alpha), mode(mode), paint(paint) {
+            alpha(alpha), mode(mode), paint(paint),
+            distanceFieldSmoothing(distanceFieldSmoothing) {
     }
     ~TextSetupFunctor() { }
 
@@ -79,6 +84,9 @@ public:
     int alpha;
     SkXfermode::Mode mode;
     SkPaint* paint;
+    // Half width of the anti-aliasing ramp of distance field glyphs, in
+    // distance field units. 0 if the glyphs are not distance fields
+    float distanceFieldSmoothing;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -97,11 +105,28 @@ public:
         mGammaTable = gammaTable;
     }
 
-    void setFont(SkPaint* paint, const mat4& matrix);
+    void setFont(SkPaint* paint, const mat4& matrix, bool distanceField = false);
 
-    void precache(SkPaint* paint, const char* text, int numGlyphs, const mat4& matrix);
+    void precache(SkPaint* paint, const char* text, int numGlyphs, const mat4& matrix,
+            bool distanceField = false);
     void endPrecaching();
 
+    /**
+     * Returns true if text drawn with the specified paint and transform
+     * should be rendered from signed distance fields: large text, or text
+     * drawn with a scale or a rotation. Distance fields let these draws
+     * share a single rasterization of each glyph and remain sharp when
+     * the transform changes every frame.
+     */
+    bool canUseDistanceField(const SkPaint* paint, const mat4& transform) const;
+
+    /**
+     * Returns the half width of the anti-aliasing ramp, in distance field
+     * units, of text drawn from distance fields with the specified paint
+     * and transform. The ramp spans about one pixel on screen.
+     */
+    static float getDistanceFieldSmoothing(const SkPaint* paint, const mat4& transform);
+
     // bounds is an out parameter
     bool renderPosText(SkPaint* paint, const Rect* clip, const char *text, uint32_t startIndex,
             uint32_t len, int numGlyphs, int x, int y, const float* positions, Rect* bounds,
@@ -142,6 +167,42 @@ public:
 private:
     friend class Font;
 
+    /**
+     * Rasterizes the glyphs of a font on a worker thread. The resulting
+     * images are stored in the cache textures by endPrecaching().
+     */
+    class PrecacheTask: public Task<bool> {
+    public:
+        PrecacheTask(Font* font, const SkPaint* paint): Task<bool>(kPriorityFrame),
+                font(font), paint(*paint) {
+        }
+
+        ~PrecacheTask();
+
+        Font* font;
+        SkPaint paint;
+        SortedVector<glyph_t> glyphs;
+
+        struct RasterizedGlyph {
+            glyph_t glyph;
+            // fImage points to a copy of the glyph's image, see Font::rasterize()
+            SkGlyph skiaGlyph;
+        };
+
+        // Set by the worker thread
+        Vector<RasterizedGlyph> rasterizedGlyphs;
+    };
+
+    class PrecacheProcessor: public TaskProcessor<bool> {
+    public:
+        PrecacheProcessor(Caches& caches);
+        ~PrecacheProcessor() { }
+
+        virtual void onProcess(const sp<Task<bool> >& task);
+    };
+
+    void cancelPrecaching();
+
     const uint8_t* mGammaTable;
 
     void allocateTextureMemory(CacheTexture* cacheTexture);
@@ -149,10 +210,11 @@ private:
     void initTextTexture();
     CacheTexture* createCacheTexture(int width, int height, GLenum format, bool allocate);
     void cacheBitmap(const SkGlyph& glyph, CachedGlyphInfo* cachedGlyph,
-            uint32_t *retOriginX, uint32_t *retOriginY, bool precaching);
+            uint32_t *retOriginX, uint32_t *retOriginY, bool precaching, bool applyGamma = true);
     CacheTexture* cacheBitmapInTexture(Vector<CacheTexture*>& cacheTextures, const SkGlyph& glyph,
             uint32_t* startX, uint32_t* startY);
 
+    void compactCacheTextures(Vector<CacheTexture*>& cacheTextures);
     void flushAllAndInvalidate();
 
     void checkInit();
@@ -193,6 +255,14 @@ private:
     Font* mCurrentFont;
     LruCache<Font::FontDescription, Font*> mActiveFonts;
 
+    // Incremented for every text draw or precache operation, see
+    // CachedGlyphInfo::mGeneration
+    uint32_t mGeneration;
+
+    // Glyphs rasterized by worker threads since the last call to endPrecaching()
+    Vector<sp<PrecacheTask> > mPrecacheTasks;
+    sp<PrecacheProcessor> mPrecacheProcessor;
+
     CacheTexture* mCurrentCacheTexture;
 
     bool mUploadTexture;
@@ -206,6 +276,8 @@ private:
 
     bool mLinearFiltering;
 
+    bool mDistanceFieldEnabled;
+
 #ifdef ANDROID_ENABLE_RENDERSCRIPT
     // RS constructs
     RSC::sp<RSC::RS> mRs;
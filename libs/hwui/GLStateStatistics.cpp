@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include "GLStateStatistics.h"
+
+namespace android {
+namespace uirenderer {
+
+static const char* gCallNames[GLStateStatistics::kCall_Count] = {
+        "use program",
+        "uniform",
+        "attrib pointer",
+        "active texture",
+        "bind texture",
+        "bind buffer",
+        "scissor",
+        "blend"
+};
+
+void GLStateStatistics::dump(String8& log) const {
+    const Counters& c = mLastFrame;
+    uint32_t totalIssued = 0;
+    uint32_t totalSkipped = 0;
+
+    log.appendFormat("GL state changes (last frame):\n");
+    log.appendFormat("    %-18s %8s %8s\n", "", "issued", "skipped");
+    for (int i = 0; i < kCall_Count; i++) {
+        log.appendFormat("    %-18s %8d %8d\n", gCallNames[i], c.issued[i], c.skipped[i]);
+        totalIssued += c.issued[i];
+        totalSkipped += c.skipped[i];
+    }
+    log.appendFormat("    %-18s %8d %8d\n", "total", totalIssued, totalSkipped);
+}
+
+}; // namespace uirenderer
+}; // namespace android
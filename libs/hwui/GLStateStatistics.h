@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_GL_STATE_STATISTICS_H
+#define ANDROID_HWUI_GL_STATE_STATISTICS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <utils/String8.h>
+
+namespace android {
+namespace uirenderer {
+
+/**
+ * Counts, for each kind of GL state change, the calls that were issued and
+ * the calls that were skipped because the shadow state kept by Caches and
+ * Program showed they would not change anything. Like BatchingStatistics,
+ * the counters are always enabled and are only updated from the GL thread.
+ */
+class GLStateStatistics {
+public:
+    enum CallType {
+        kCall_UseProgram = 0,
+        kCall_Uniform,
+        kCall_VertexAttribPointer,
+        kCall_ActiveTexture,
+        kCall_BindTexture,
+        kCall_BindBuffer,
+        kCall_Scissor,
+        kCall_Blend,
+
+        kCall_Count // Add other call types before this
+    };
+
+    struct Counters {
+        Counters() {
+            reset();
+        }
+
+        void reset() {
+            memset(this, 0, sizeof(Counters));
+        }
+
+        uint32_t issued[kCall_Count];
+        uint32_t skipped[kCall_Count];
+    };
+
+    GLStateStatistics() { }
+    ~GLStateStatistics() { }
+
+    /**
+     * Records a state change of the specified type, which was either sent
+     * to the driver or found redundant.
+     */
+    void count(CallType type, bool issued) {
+        if (issued) {
+            mCurrent.issued[type]++;
+        } else {
+            mCurrent.skipped[type]++;
+        }
+    }
+
+    void count(CallType type, uint32_t issued, uint32_t skipped) {
+        mCurrent.issued[type] += issued;
+        mCurrent.skipped[type] += skipped;
+    }
+
+    /**
+     * Counters of the last completed frame.
+     */
+    const Counters& lastFrame() const {
+        return mLastFrame;
+    }
+
+    /**
+     * Must be invoked at the end of each frame.
+     */
+    void endFrame() {
+        mLastFrame = mCurrent;
+        mCurrent.reset();
+    }
+
+    /**
+     * Outputs the counters of the last completed frame.
+     */
+    void dump(String8& log) const;
+
+private:
+    Counters mCurrent;
+    Counters mLastFrame;
+}; // class GLStateStatistics
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_GL_STATE_STATISTICS_H
@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <stdlib.h>
+
+#include <EGL/egl.h>
+
+#include <utils/Log.h>
+
+#include "Extensions.h"
+#include "GpuProfiler.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Maximum number of samples recorded per frame, each sample uses two queries
+#define MAX_SAMPLES_PER_FRAME 512
+// Maximum number of frames waiting for their results. When the GPU falls
+// further behind, the oldest frame is discarded
+#define MAX_PENDING_FRAMES 3
+// Number of samples printed by dump(), the longest samples are printed first
+#define MAX_DUMPED_SAMPLES 24
+
+// GL_EXT_disjoint_timer_query, the entry points are loaded at runtime
+// since not every driver exports them
+#ifndef GL_TIMESTAMP_EXT
+    #define GL_TIMESTAMP_EXT 0x8E28
+#endif
+#ifndef GL_GPU_DISJOINT_EXT
+    #define GL_GPU_DISJOINT_EXT 0x8FBB
+#endif
+#ifndef GL_QUERY_RESULT_EXT
+    #define GL_QUERY_RESULT_EXT 0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE_EXT
+    #define GL_QUERY_RESULT_AVAILABLE_EXT 0x8867
+#endif
+
+typedef void (GL_APIENTRYP GenQueriesProc) (GLsizei n, GLuint* ids);
+typedef void (GL_APIENTRYP DeleteQueriesProc) (GLsizei n, const GLuint* ids);
+typedef void (GL_APIENTRYP QueryCounterProc) (GLuint id, GLenum target);
+typedef void (GL_APIENTRYP GetQueryObjectuivProc) (GLuint id, GLenum pname, GLuint* params);
+typedef void (GL_APIENTRYP GetQueryObjectui64vProc) (GLuint id, GLenum pname, GLuint64* params);
+
+static GenQueriesProc sGenQueries = NULL;
+static DeleteQueriesProc sDeleteQueries = NULL;
+static QueryCounterProc sQueryCounter = NULL;
+static GetQueryObjectuivProc sGetQueryObjectuiv = NULL;
+static GetQueryObjectui64vProc sGetQueryObjectui64v = NULL;
+
+static bool loadTimerQueries() {
+    if (sQueryCounter) return true;
+    if (!Extensions::getInstance().hasGlExtension("GL_EXT_disjoint_timer_query")) return false;
+
+    sGenQueries = (GenQueriesProc) eglGetProcAddress("glGenQueriesEXT");
+    sDeleteQueries = (DeleteQueriesProc) eglGetProcAddress("glDeleteQueriesEXT");
+    sGetQueryObjectuiv = (GetQueryObjectuivProc) eglGetProcAddress("glGetQueryObjectuivEXT");
+    sGetQueryObjectui64v = (GetQueryObjectui64vProc)
+            eglGetProcAddress("glGetQueryObjectui64vEXT");
+    QueryCounterProc queryCounter = (QueryCounterProc) eglGetProcAddress("glQueryCounterEXT");
+
+    if (!sGenQueries || !sDeleteQueries || !sGetQueryObjectuiv || !sGetQueryObjectui64v ||
+            !queryCounter) {
+        ALOGW("GL_EXT_disjoint_timer_query is advertised but its entry points are missing");
+        return false;
+    }
+
+    sQueryCounter = queryCounter;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors/destructor
+///////////////////////////////////////////////////////////////////////////////
+
+GpuProfiler::GpuProfiler(): mEnabled(false), mCurrent(NULL),
+        mResultsDroppedSamples(0), mDisjointFrames(0) {
+}
+
+GpuProfiler::~GpuProfiler() {
+    clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Samples
+///////////////////////////////////////////////////////////////////////////////
+
+void GpuProfiler::setEnabled(bool enabled) {
+    enabled = enabled && loadTimerQueries();
+    if (enabled == mEnabled) return;
+
+    if (!enabled) clear();
+    mEnabled = enabled;
+}
+
+GLuint GpuProfiler::obtainQuery() {
+    if (!mQueryPool.isEmpty()) {
+        GLuint query = mQueryPool.top();
+        mQueryPool.pop();
+        return query;
+    }
+
+    GLuint query;
+    sGenQueries(1, &query);
+    return query;
+}
+
+int GpuProfiler::startSample(const char* label, uint32_t opCount) {
+    if (!mEnabled) return -1;
+
+    if (!mCurrent) {
+        mCurrent = new Frame();
+        mCurrent->droppedSamples = 0;
+        mCurrent->lastQuery = 0;
+    }
+
+    if (mCurrent->samples.size() >= MAX_SAMPLES_PER_FRAME) {
+        mCurrent->droppedSamples++;
+        return -1;
+    }
+
+    Sample sample;
+    sample.label = label;
+    sample.opCount = opCount;
+    sample.start = obtainQuery();
+    sample.end = 0;
+    sQueryCounter(sample.start, GL_TIMESTAMP_EXT);
+
+    return mCurrent->samples.add(sample);
+}
+
+void GpuProfiler::endSample(int sample) {
+    if (sample < 0 || !mCurrent) return;
+
+    Sample& s = mCurrent->samples.editItemAt(sample);
+    s.end = obtainQuery();
+    sQueryCounter(s.end, GL_TIMESTAMP_EXT);
+    mCurrent->lastQuery = s.end;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Results
+///////////////////////////////////////////////////////////////////////////////
+
+void GpuProfiler::endFrame() {
+    if (!mEnabled) return;
+
+    if (mCurrent) {
+        mPending.add(mCurrent);
+        mCurrent = NULL;
+    }
+
+    // The disjoint flag is reset when read and covers every query issued
+    // since it was last read, including those of the frames still pending
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    if (disjoint) {
+        mDisjointFrames += mPending.size();
+        for (size_t i = 0; i < mPending.size(); i++) {
+            releaseFrame(mPending[i]);
+        }
+        mPending.clear();
+        return;
+    }
+
+    // Timestamps are written in order, the frames complete in order as well
+    while (!mPending.isEmpty()) {
+        Frame* frame = mPending[0];
+        if (!readFrame(frame) && mPending.size() <= MAX_PENDING_FRAMES) break;
+
+        releaseFrame(frame);
+        mPending.removeAt(0);
+    }
+}
+
+bool GpuProfiler::readFrame(const Frame* frame) {
+    const Vector<Sample>& samples = frame->samples;
+
+    // Queries complete in the order they were issued
+    if (frame->lastQuery) {
+        GLuint available = GL_FALSE;
+        sGetQueryObjectuiv(frame->lastQuery, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+        if (!available) return false;
+    }
+
+    mResults.clear();
+    mResultsDroppedSamples = frame->droppedSamples;
+    for (size_t i = 0; i < samples.size(); i++) {
+        const Sample& sample = samples[i];
+        // Samples left open have no end
+        if (!sample.end) {
+            mResultsDroppedSamples++;
+            continue;
+        }
+
+        GLuint64 start = 0;
+        GLuint64 end = 0;
+        sGetQueryObjectui64v(sample.start, GL_QUERY_RESULT_EXT, &start);
+        sGetQueryObjectui64v(sample.end, GL_QUERY_RESULT_EXT, &end);
+
+        Result result;
+        result.label = sample.label;
+        result.opCount = sample.opCount;
+        result.duration = end > start ? nsecs_t(end - start) : 0;
+        mResults.add(result);
+    }
+
+    return true;
+}
+
+void GpuProfiler::releaseFrame(Frame* frame) {
+    const Vector<Sample>& samples = frame->samples;
+    for (size_t i = 0; i < samples.size(); i++) {
+        mQueryPool.add(samples[i].start);
+        if (samples[i].end) mQueryPool.add(samples[i].end);
+    }
+    delete frame;
+}
+
+void GpuProfiler::clear() {
+    if (mCurrent) {
+        releaseFrame(mCurrent);
+        mCurrent = NULL;
+    }
+    for (size_t i = 0; i < mPending.size(); i++) {
+        releaseFrame(mPending[i]);
+    }
+    mPending.clear();
+
+    if (!mQueryPool.isEmpty()) {
+        sDeleteQueries(mQueryPool.size(), mQueryPool.array());
+        mQueryPool.clear();
+    }
+
+    mResults.clear();
+    mResultsDroppedSamples = 0;
+    mDisjointFrames = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Debug
+///////////////////////////////////////////////////////////////////////////////
+
+int GpuProfiler::compareResults(const void* lhs, const void* rhs) {
+    nsecs_t l = ((const Result*) lhs)->duration;
+    nsecs_t r = ((const Result*) rhs)->duration;
+    return l > r ? -1 : (l < r ? 1 : 0);
+}
+
+void GpuProfiler::dump(String8& log) const {
+    if (!mEnabled) return;
+
+    nsecs_t total = 0;
+    for (size_t i = 0; i < mResults.size(); i++) {
+        total += mResults[i].duration;
+    }
+
+    log.appendFormat("GPU timings of the last completed frame:\n");
+    log.appendFormat("  Samples              %8d\n", mResults.size());
+    log.appendFormat("  Samples dropped      %8d\n", mResultsDroppedSamples);
+    log.appendFormat("  Disjoint frames      %8d\n", mDisjointFrames);
+    // Layers are composed by batches, their time is counted twice
+    log.appendFormat("  Sum of samples       %8.3f ms\n", total / 1000000.0);
+
+    Vector<Result> results(mResults);
+    qsort(results.editArray(), results.size(), sizeof(Result), compareResults);
+
+    const size_t count = results.size() < MAX_DUMPED_SAMPLES ?
+            results.size() : MAX_DUMPED_SAMPLES;
+    for (size_t i = 0; i < count; i++) {
+        const Result& result = results[i];
+        log.appendFormat("  %-24s %4d ops %8.3f ms\n", result.label, result.opCount,
+                result.duration / 1000000.0);
+    }
+}
+
+}; // namespace uirenderer
+}; // namespace android
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_GPU_PROFILER_H
+#define ANDROID_HWUI_GPU_PROFILER_H
+
+#include <GLES3/gl3.h>
+
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+namespace android {
+namespace uirenderer {
+
+/**
+ * Measures the GPU time spent drawing each batch of deferred operations and
+ * composing each layer, using the timestamp queries of GL_EXT_disjoint_timer_query.
+ *
+ * Every sample is delimited by two timestamps written in the command stream.
+ * Timestamps, unlike time elapsed queries, can be nested: the time spent
+ * composing a layer is also accounted to the batch that draws it.
+ *
+ * The results are read back a few frames later, without stalling the pipeline,
+ * and kept for the last frame whose results are available. Frames during
+ * which the GPU reported a disjoint operation (frequency change, context
+ * loss, etc.) are discarded.
+ */
+class GpuProfiler {
+public:
+    GpuProfiler();
+    ~GpuProfiler();
+
+    /**
+     * Enables or disables the profiler. Has no effect if the device does
+     * not support GL_EXT_disjoint_timer_query. Disabling the profiler
+     * releases all its queries.
+     */
+    void setEnabled(bool enabled);
+
+    bool isEnabled() const {
+        return mEnabled;
+    }
+
+    /**
+     * Starts a sample with the specified label, which must be a static string.
+     * Returns the identifier to pass to endSample(), or -1 if the sample is
+     * not recorded.
+     */
+    int startSample(const char* label, uint32_t opCount);
+    void endSample(int sample);
+
+    /**
+     * Must be invoked at the end of each frame.
+     */
+    void endFrame();
+
+    /**
+     * Outputs the samples of the last frame whose results are available.
+     */
+    void dump(String8& log) const;
+
+private:
+    struct Sample {
+        const char* label;
+        uint32_t opCount;
+        GLuint start;
+        GLuint end;
+    };
+
+    struct Result {
+        const char* label;
+        uint32_t opCount;
+        nsecs_t duration;
+    };
+
+    struct Frame {
+        Vector<Sample> samples;
+        uint32_t droppedSamples;
+        // Most recently issued end of sample
+        GLuint lastQuery;
+    };
+
+    static int compareResults(const void* lhs, const void* rhs);
+
+    GLuint obtainQuery();
+    void releaseFrame(Frame* frame);
+    bool readFrame(const Frame* frame);
+    void clear();
+
+    bool mEnabled;
+
+    Vector<GLuint> mQueryPool;
+
+    Frame* mCurrent;
+    // Frames whose results are not available yet, oldest first
+    Vector<Frame*> mPending;
+
+    Vector<Result> mResults;
+    uint32_t mResultsDroppedSamples;
+    uint32_t mDisjointFrames;
+}; // class GpuProfiler
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_GPU_PROFILER_H
@@ -63,7 +63,7 @@ int GradientCacheEntry::compare(const GradientCacheEntry& lhs, const GradientCac
 ///////////////////////////////////////////////////////////////////////////////
 
 GradientCache::GradientCache():
-        mCache(LruCache<GradientCacheEntry, Texture*>::kUnlimitedCapacity),
+        mCache(ClockCache<GradientCacheEntry, Texture*>::kUnlimitedCapacity),
         mSize(0), mMaxSize(MB(DEFAULT_GRADIENT_CACHE_SIZE)) {
     char property[PROPERTY_VALUE_MAX];
     if (property_get(PROPERTY_GRADIENT_CACHE_SIZE, property, NULL) > 0) {
@@ -83,7 +83,7 @@ GradientCache::GradientCache():
 }
 
 GradientCache::GradientCache(uint32_t maxByteSize):
-        mCache(LruCache<GradientCacheEntry, Texture*>::kUnlimitedCapacity),
+        mCache(ClockCache<GradientCacheEntry, Texture*>::kUnlimitedCapacity),
         mSize(0), mMaxSize(maxByteSize) {
     mCache.setOnEntryRemovedListener(this);
 }
@@ -130,6 +130,8 @@ void GradientCache::operator()(GradientCacheEntry& shader, Texture*& texture) {
 ///////////////////////////////////////////////////////////////////////////////
 
 Texture* GradientCache::get(uint32_t* colors, float* positions, int count) {
+    markUsed();
+
     GradientCacheEntry gradient(colors, positions, count);
     Texture* texture = mCache.get(gradient);
 
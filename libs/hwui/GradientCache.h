@@ -21,11 +21,12 @@
 
 #include <SkShader.h>
 
-#include <utils/LruCache.h>
 #include <utils/Mutex.h>
 #include <utils/Vector.h>
 
+#include "MemoryBudget.h"
 #include "Texture.h"
+#include "utils/ClockCache.h"
 
 namespace android {
 namespace uirenderer {
@@ -108,7 +109,8 @@ inline hash_t hash_type(const GradientCacheEntry& entry) {
  * Any texture added to the cache causing the cache to grow beyond the maximum
  * allowed size will also cause the oldest texture to be kicked out.
  */
-class GradientCache: public OnEntryRemoved<GradientCacheEntry, Texture*> {
+class GradientCache: public OnEntryRemoved<GradientCacheEntry, Texture*>,
+        public MemoryBudget::Client {
 public:
     GradientCache();
     GradientCache(uint32_t maxByteSize);
@@ -181,7 +183,7 @@ private:
     void mixBytes(GradientColor& start, GradientColor& end, float amount, uint8_t*& dst) const;
     void mixFloats(GradientColor& start, GradientColor& end, float amount, uint8_t*& dst) const;
 
-    LruCache<GradientCacheEntry, Texture*> mCache;
+    ClockCache<GradientCacheEntry, Texture*> mCache;
 
     uint32_t mSize;
     uint32_t mMaxSize;
@@ -32,9 +32,13 @@ Layer::Layer(const uint32_t layerWidth, const uint32_t layerHeight):
         caches(Caches::getInstance()), texture(caches) {
     mesh = NULL;
     meshElementCount = 0;
+    meshWidth = 0;
+    meshHeight = 0;
     cacheable = true;
     dirty = false;
     textureLayer = false;
+    directComposition = false;
+    overlayComposited = false;
     renderTarget = GL_TEXTURE_2D;
     texture.width = layerWidth;
     texture.height = layerHeight;
@@ -46,6 +50,9 @@ Layer::Layer(const uint32_t layerWidth, const uint32_t layerHeight):
     stencil = NULL;
     debugDrawUpdate = false;
     hasDrawnSinceUpdate = false;
+    renderedContentId = 0;
+    renderedWidth = 0;
+    renderedHeight = 0;
     deferredList = NULL;
     caches.resourceCache.incrementRefcount(this);
 }
@@ -68,6 +75,8 @@ uint32_t Layer::computeIdealHeight(uint32_t layerHeight) {
 }
 
 bool Layer::resize(const uint32_t width, const uint32_t height) {
+    renderedContentId = 0;
+
     uint32_t desiredWidth = computeIdealWidth(width);
     uint32_t desiredHeight = computeIdealWidth(height);
 
@@ -101,6 +110,7 @@ bool Layer::resize(const uint32_t width, const uint32_t height) {
     if (stencil) {
         stencil->bind();
         stencil->resize(desiredWidth, desiredHeight);
+        caches.stencil.invalidateClip(stencil);
 
         if (glGetError() != GL_NO_ERROR) {
             setSize(oldWidth, oldHeight);
@@ -119,6 +129,7 @@ void Layer::removeFbo(bool flush) {
         glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, 0);
         if (fbo != previousFbo) glBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
 
+        caches.stencil.invalidateClip(stencil);
         caches.renderBufferCache.put(stencil);
         stencil = NULL;
     }
@@ -186,6 +197,11 @@ void Layer::allocateTexture() {
 }
 
 void Layer::defer() {
+    prepareDefer();
+    deferDisplayList();
+}
+
+void Layer::prepareDefer() {
     const float width = layer.getWidth();
     const float height = layer.getHeight();
 
@@ -199,19 +215,56 @@ void Layer::defer() {
     } else {
         deferredList = new DeferredDisplayList(dirtyRect);
     }
-    DeferStateStruct deferredState(*deferredList, *renderer,
-            DisplayList::kReplayFlag_ClipChildren);
 
     renderer->initViewport(width, height);
     renderer->setupFrameState(dirtyRect.left, dirtyRect.top,
             dirtyRect.right, dirtyRect.bottom, !isBlend());
+}
 
+void Layer::deferDisplayList(LayerDeferrer* deferrer) {
+    DeferStateStruct deferredState(*deferredList, *renderer,
+            DisplayList::kReplayFlag_ClipChildren);
+
+    deferredList->setDeferrer(deferrer);
     displayList->defer(deferredState, 0);
+    deferredList->setDeferrer(NULL);
 
     deferredUpdateScheduled = false;
 }
 
+bool Layer::clipDirtyRectToContentDamage() {
+    Rect damage;
+    const bool hasDamage = !isDirty() && renderedContentId != 0 &&
+            displayList->getWidth() == renderedWidth &&
+            displayList->getHeight() == renderedHeight &&
+            displayList->getContentDamage(renderedContentId, damage);
+
+    renderedContentId = displayList->getContentId();
+    renderedWidth = displayList->getWidth();
+    renderedHeight = displayList->getHeight();
+
+    if (!hasDamage) {
+        return true;
+    }
+
+    if (dirtyRect.isEmpty()) {
+        dirtyRect.set(0, 0, layer.getWidth(), layer.getHeight());
+    }
+
+    if (!dirtyRect.intersect(damage)) {
+        // None of the operations drawn in the dirty rect changed
+        renderer = NULL;
+        displayList = NULL;
+        dirtyRect.setEmpty();
+        deferredUpdateScheduled = false;
+        return false;
+    }
+
+    return true;
+}
+
 void Layer::cancelDefer() {
+    renderedContentId = 0;
     renderer = NULL;
     displayList = NULL;
     deferredUpdateScheduled = false;
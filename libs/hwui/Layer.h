@@ -17,6 +17,7 @@
 #ifndef ANDROID_HWUI_LAYER_H
 #define ANDROID_HWUI_LAYER_H
 
+#include <string.h>
 #include <sys/types.h>
 
 #include <GLES2/gl2.h>
@@ -45,6 +46,7 @@ class OpenGLRenderer;
 class DisplayList;
 class DeferredDisplayList;
 class DeferStateStruct;
+class LayerDeferrer;
 
 /**
  * A layer has dimensions and is backed by an OpenGL texture or FBO.
@@ -91,6 +93,13 @@ struct Layer {
         deferredUpdateScheduled = true;
     }
 
+    /**
+     * Restricts the dirty rect of the scheduled update to the area of the
+     * display list that changed since the last update of this layer. Returns
+     * false if the layer is already up to date, the update is then dropped.
+     */
+    bool clipDirtyRectToContentDamage();
+
     inline uint32_t getWidth() const {
         return texture.width;
     }
@@ -216,6 +225,63 @@ struct Layer {
         this->textureLayer = textureLayer;
     }
 
+    /**
+     * A texture layer in direct composition mode is not sampled: its content
+     * is posted to an overlay surface composited by SurfaceFlinger below the
+     * window, and the renderer only clears the area the layer covers.
+     */
+    inline bool isDirectComposition() const {
+        return directComposition;
+    }
+
+    inline void setDirectComposition(bool directComposition) {
+        this->directComposition = directComposition;
+        overlayComposited = false;
+    }
+
+    /**
+     * Indicates whether the overlay was used by the last draw of this layer.
+     * When false, the transform, alpha or clip of the layer could not be
+     * applied by SurfaceFlinger and nothing was drawn.
+     */
+    inline bool isOverlayComposited() const {
+        return overlayComposited;
+    }
+
+    /**
+     * Records how the overlay must be placed on screen to match the last
+     * draw of this layer: position and 2x2 matrix of the overlay, and the
+     * visible area in window coordinates.
+     */
+    inline void setOverlayGeometry(float x, float y, const mat4& transform, const Rect& clip) {
+        overlayX = x;
+        overlayY = y;
+        overlayMatrix[0] = transform[mat4::kScaleX];
+        overlayMatrix[1] = transform[mat4::kSkewY];
+        overlayMatrix[2] = transform[mat4::kSkewX];
+        overlayMatrix[3] = transform[mat4::kScaleY];
+        overlayClip.set(clip);
+        overlayComposited = true;
+    }
+
+    inline void rejectOverlay() {
+        overlayComposited = false;
+    }
+
+    /**
+     * Outputs x, y, dsdx, dtdx, dsdy, dtdy and the clip's left, top, right
+     * and bottom.
+     */
+    inline void getOverlayGeometry(float* geometry) const {
+        geometry[0] = overlayX;
+        geometry[1] = overlayY;
+        memcpy(&geometry[2], overlayMatrix, sizeof(overlayMatrix));
+        geometry[6] = overlayClip.left;
+        geometry[7] = overlayClip.top;
+        geometry[8] = overlayClip.right;
+        geometry[9] = overlayClip.bottom;
+    }
+
     inline SkiaColorFilter* getColorFilter() const {
         return colorFilter;
     }
@@ -245,6 +311,13 @@ struct Layer {
     }
 
     void defer();
+    /**
+     * defer() is made of these two steps. Only the second one, which walks
+     * the display list, may run off the GL thread, in which case the
+     * specified deferrer runs the steps that access the caches.
+     */
+    void prepareDefer();
+    void deferDisplayList(LayerDeferrer* deferrer = NULL);
     void cancelDefer();
     void flush();
     void render();
@@ -278,6 +351,14 @@ struct Layer {
      */
     TextureVertex* mesh;
     GLsizei meshElementCount;
+    /**
+     * Region, layer bounds and texture size the mesh was generated from.
+     * The mesh is only regenerated when one of them changes.
+     */
+    Region meshRegion;
+    Rect meshLayer;
+    uint32_t meshWidth;
+    uint32_t meshHeight;
 
     /**
      * Used for deferred updates.
@@ -289,6 +370,14 @@ struct Layer {
     bool debugDrawUpdate;
     bool hasDrawnSinceUpdate;
 
+    /**
+     * Content of the display list last rendered in this layer, used to
+     * only redraw what changed since, see clipDirtyRectToContentDamage().
+     */
+    uint32_t renderedContentId;
+    int renderedWidth;
+    int renderedHeight;
+
 private:
     Caches& caches;
 
@@ -324,6 +413,16 @@ private:
      */
     bool textureLayer;
 
+    /**
+     * Direct composition state of texture layers, see isDirectComposition().
+     */
+    bool directComposition;
+    bool overlayComposited;
+    float overlayX;
+    float overlayY;
+    float overlayMatrix[4];
+    Rect overlayClip;
+
     /**
      * When set to true, this layer is dirty and should be cleared
      * before any rendering occurs.
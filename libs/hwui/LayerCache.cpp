@@ -58,8 +58,10 @@ uint32_t LayerCache::getMaxSize() {
 }
 
 void LayerCache::setMaxSize(uint32_t maxSize) {
-    clear();
     mMaxSize = maxSize;
+    while (mSize > mMaxSize) {
+        deleteVictim();
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -83,6 +85,20 @@ void LayerCache::deleteLayer(Layer* layer) {
     }
 }
 
+void LayerCache::deleteVictim() {
+    // TODO: Use an LRU
+    size_t position = 0;
+#if LAYER_REMOVE_BIGGEST_FIRST
+    position = mCache.size() - 1;
+#endif
+    Layer* victim = mCache.itemAt(position).mLayer;
+    deleteLayer(victim);
+    mCache.removeAt(position);
+
+    LAYER_LOGD("  Deleting layer %.2fx%.2f", victim->layer.getWidth(),
+            victim->layer.getHeight());
+}
+
 void LayerCache::clear() {
     size_t count = mCache.size();
     for (size_t i = 0; i < count; i++) {
@@ -91,11 +107,56 @@ void LayerCache::clear() {
     mCache.clear();
 }
 
+ssize_t LayerCache::findLayer(const LayerEntry& entry) const {
+    // Look for the smallest layer that can hold the requested size. The list
+    // is sorted by width first so the search can stop at the first layer that
+    // is too wide to be reused
+    const float maxArea = entry.mWidth * entry.mHeight * LAYER_REUSE_MAX_AREA_RATIO;
+
+    ssize_t bestIndex = -1;
+    uint32_t bestArea = 0;
+
+    const size_t count = mCache.size();
+    for (size_t i = 0; i < count; i++) {
+        const LayerEntry& candidate = mCache.itemAt(i);
+        if (candidate.mWidth < entry.mWidth || candidate.mHeight < entry.mHeight) continue;
+        if (candidate.mWidth * entry.mHeight > maxArea) break;
+
+        const uint32_t area = candidate.mWidth * candidate.mHeight;
+        if (area <= maxArea && (bestIndex < 0 || area < bestArea)) {
+            bestIndex = i;
+            bestArea = area;
+            // Exact match
+            if (candidate.mWidth == entry.mWidth && candidate.mHeight == entry.mHeight) break;
+        }
+    }
+
+    return bestIndex;
+}
+
+Layer* LayerCache::createLayer(const LayerEntry& entry) {
+    LAYER_LOGD("Creating new layer %dx%d", entry.mWidth, entry.mHeight);
+
+    Layer* layer = new Layer(entry.mWidth, entry.mHeight);
+    layer->setBlend(true);
+    layer->setEmpty(true);
+    layer->setFbo(0);
+
+    layer->generateTexture();
+    layer->bindTexture();
+    layer->setFilter(GL_NEAREST);
+    layer->setWrap(GL_CLAMP_TO_EDGE, false);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    return layer;
+}
+
 Layer* LayerCache::get(const uint32_t width, const uint32_t height) {
+    markUsed();
     Layer* layer = NULL;
 
     LayerEntry entry(width, height);
-    ssize_t index = mCache.indexOf(entry);
+    ssize_t index = findLayer(entry);
 
     if (index >= 0) {
         entry = mCache.itemAt(index);
@@ -104,20 +165,10 @@ Layer* LayerCache::get(const uint32_t width, const uint32_t height) {
         layer = entry.mLayer;
         mSize -= layer->getWidth() * layer->getHeight() * 4;
 
-        LAYER_LOGD("Reusing layer %dx%d", layer->getWidth(), layer->getHeight());
+        LAYER_LOGD("Reusing layer %dx%d for %dx%d", layer->getWidth(), layer->getHeight(),
+                width, height);
     } else {
-        LAYER_LOGD("Creating new layer %dx%d", entry.mWidth, entry.mHeight);
-
-        layer = new Layer(entry.mWidth, entry.mHeight);
-        layer->setBlend(true);
-        layer->setEmpty(true);
-        layer->setFbo(0);
-
-        layer->generateTexture();
-        layer->bindTexture();
-        layer->setFilter(GL_NEAREST);
-        layer->setWrap(GL_CLAMP_TO_EDGE, false);
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        layer = createLayer(entry);
 
 #if DEBUG_LAYERS
         dump();
@@ -127,6 +178,54 @@ Layer* LayerCache::get(const uint32_t width, const uint32_t height) {
     return layer;
 }
 
+void LayerCache::prewarm(const uint32_t width, const uint32_t height) {
+    if (width == 0 || height == 0) return;
+
+    Mutex::Autolock _l(mLock);
+    mPrewarmed.push(LayerEntry(width, height));
+}
+
+void LayerCache::allocatePrewarmedLayers() {
+    Vector<LayerEntry> prewarmed;
+
+    { // scope for the mutex
+        Mutex::Autolock _l(mLock);
+        if (mPrewarmed.isEmpty()) return;
+        prewarmed = mPrewarmed;
+        mPrewarmed.clear();
+    }
+
+    const uint32_t maxTextureSize = Caches::getInstance().maxTextureSize;
+
+    for (size_t i = 0; i < prewarmed.size(); i++) {
+        const LayerEntry& entry = prewarmed.itemAt(i);
+        if (entry.mWidth > maxTextureSize || entry.mHeight > maxTextureSize) continue;
+        if (findLayer(entry) >= 0) continue;
+
+        // Don't evict other layers to make room for a layer that may not be used
+        const uint32_t size = entry.mWidth * entry.mHeight * 4;
+        if (mSize + size > mMaxSize) continue;
+
+        Caches::getInstance().activeTexture(0);
+        Layer* layer = createLayer(entry);
+
+        // Allocating the storage is what stalls the driver, do it now
+        layer->allocateTexture();
+        if (glGetError() != GL_NO_ERROR) {
+            ALOGW("Could not prewarm layer %dx%d", entry.mWidth, entry.mHeight);
+            Caches::getInstance().resourceCache.decrementRefcount(layer);
+            continue;
+        }
+        layer->setEmpty(false);
+
+        LAYER_LOGD("Prewarmed layer %dx%d", entry.mWidth, entry.mHeight);
+
+        if (!put(layer)) {
+            Caches::getInstance().resourceCache.decrementRefcount(layer);
+        }
+    }
+}
+
 void LayerCache::dump() {
     size_t size = mCache.size();
     for (size_t i = 0; i < size; i++) {
@@ -141,18 +240,8 @@ bool LayerCache::put(Layer* layer) {
     const uint32_t size = layer->getWidth() * layer->getHeight() * 4;
     // Don't even try to cache a layer that's bigger than the cache
     if (size < mMaxSize) {
-        // TODO: Use an LRU
         while (mSize + size > mMaxSize) {
-            size_t position = 0;
-#if LAYER_REMOVE_BIGGEST_FIRST
-            position = mCache.size() - 1;
-#endif
-            Layer* victim = mCache.itemAt(position).mLayer;
-            deleteLayer(victim);
-            mCache.removeAt(position);
-
-            LAYER_LOGD("  Deleting layer %.2fx%.2f", victim->layer.getWidth(),
-                    victim->layer.getHeight());
+            deleteVictim();
         }
 
         layer->cancelDefer();
@@ -17,8 +17,12 @@
 #ifndef ANDROID_HWUI_LAYER_CACHE_H
 #define ANDROID_HWUI_LAYER_CACHE_H
 
+#include <utils/Mutex.h>
+#include <utils/Vector.h>
+
 #include "Debug.h"
 #include "Layer.h"
+#include "MemoryBudget.h"
 #include "utils/SortedList.h"
 
 namespace android {
@@ -39,7 +43,7 @@ namespace uirenderer {
 // Cache
 ///////////////////////////////////////////////////////////////////////////////
 
-class LayerCache {
+class LayerCache: public MemoryBudget::Client {
 public:
     LayerCache();
     ~LayerCache();
@@ -49,6 +53,11 @@ public:
      * layer can be found, a new one is created and returned. If creating a new
      * layer fails, NULL is returned.
      *
+     * Layers are allocated in size classes, multiples of LAYER_SIZE. A cached
+     * layer from a larger size class can be returned as long as it does not
+     * waste too much memory, see LAYER_REUSE_MAX_AREA_RATIO. Callers must use
+     * the requested dimensions for the viewport and texture coordinates.
+     *
      * When a layer is obtained from the cache, it is removed and the total
      * size of the cache goes down.
      *
@@ -57,6 +66,24 @@ public:
      */
     Layer* get(const uint32_t width, const uint32_t height);
 
+    /**
+     * Requests a layer of the specified dimensions to be allocated ahead of
+     * time, for instance when an animation is about to require a layer. This
+     * method can be invoked from any thread, the layer is created and added
+     * to the cache when allocatePrewarmedLayers() is invoked.
+     *
+     * @param width The expected width of the layer
+     * @param height The expected height of the layer
+     */
+    void prewarm(const uint32_t width, const uint32_t height);
+
+    /**
+     * Allocates the layers requested with prewarm() that cannot be served
+     * by the layers already in the cache. Must be invoked on the thread
+     * that owns the GL context, before drawing a frame.
+     */
+    void allocatePrewarmedLayers();
+
     /**
      * Adds the layer to the cache. The layer will not be added if there is
      * not enough space available. Adding a layer can cause other layers to
@@ -73,7 +100,8 @@ public:
     void clear();
 
     /**
-     * Sets the maximum size of the cache in bytes.
+     * Sets the maximum size of the cache in bytes. Layers are deleted
+     * until the cache is under that size.
      */
     void setMaxSize(uint32_t maxSize);
     /**
@@ -129,11 +157,18 @@ private:
     }; // struct LayerEntry
 
     void deleteLayer(Layer* layer);
+    void deleteVictim();
+    ssize_t findLayer(const LayerEntry& entry) const;
+    Layer* createLayer(const LayerEntry& entry);
 
     SortedList<LayerEntry> mCache;
 
     uint32_t mSize;
     uint32_t mMaxSize;
+
+    // Layers requested with prewarm()
+    Vector<LayerEntry> mPrewarmed;
+    mutable Mutex mLock;
 }; // class LayerCache
 
 }; // namespace uirenderer
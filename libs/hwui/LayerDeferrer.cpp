@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+#define ATRACE_TAG ATRACE_TAG_VIEW
+
+#include <utils/Trace.h>
+
+#include "Caches.h"
+#include "DeferredDisplayList.h"
+#include "DisplayListOp.h"
+#include "Layer.h"
+#include "LayerDeferrer.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Processor
+///////////////////////////////////////////////////////////////////////////////
+
+LayerDeferrer::DeferProcessor::DeferProcessor(Caches& caches, LayerDeferrer* deferrer,
+        const sp<Sync>& sync): TaskProcessor<bool>(&caches.tasks),
+        mDeferrer(deferrer), mSync(sync) {
+}
+
+void LayerDeferrer::DeferProcessor::onProcess(const sp<Task<bool> >& task) {
+    DeferTask* t = static_cast<DeferTask*>(task.get());
+    ATRACE_NAME("deferLayer");
+
+    t->layer->deferDisplayList(mDeferrer);
+    t->setResult(true);
+
+    // The deferrer may be destroyed as soon as the last layer is deferred,
+    // it must not be used past this point
+    sp<Sync> sync(mSync);
+    sync->onLayerDeferred();
+}
+
+void LayerDeferrer::Sync::onLayerDeferred() {
+    Mutex::Autolock _l(lock);
+    pendingLayers--;
+    condition.broadcast();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Deferrer
+///////////////////////////////////////////////////////////////////////////////
+
+LayerDeferrer::LayerDeferrer(Caches& caches): mCaches(caches), mSync(new Sync()) {
+}
+
+LayerDeferrer::~LayerDeferrer() {
+    finish();
+}
+
+bool LayerDeferrer::canDeferInParallel(Caches& caches) {
+    return caches.tasks.canRunTasks() && !caches.deferCacheEnabled;
+}
+
+void LayerDeferrer::add(Layer* layer) {
+    mLayers.add(layer);
+}
+
+void LayerDeferrer::finish() {
+    if (mLayers.isEmpty()) return;
+
+    ATRACE_CALL();
+
+    // A single layer gains nothing from a round trip to a worker
+    if (mLayers.size() == 1) {
+        mLayers[0]->deferDisplayList();
+        mLayers.clear();
+        return;
+    }
+
+    if (mProcessor == NULL) {
+        mProcessor = new DeferProcessor(mCaches, this, mSync);
+    }
+
+    Sync& sync = *mSync;
+    {
+        Mutex::Autolock _l(sync.lock);
+        sync.pendingLayers = mLayers.size();
+    }
+
+    for (size_t i = 0; i < mLayers.size(); i++) {
+        sp<DeferTask> task = new DeferTask(mLayers[i]);
+        if (!mProcessor->add(task)) {
+            // The layer is deferred here, its operations don't need a round trip
+            mLayers[i]->deferDisplayList();
+            sync.onLayerDeferred();
+        }
+    }
+    mLayers.clear();
+
+    Mutex::Autolock _l(sync.lock);
+    while (sync.pendingLayers > 0 || !sync.requests.isEmpty()) {
+        if (sync.requests.isEmpty()) {
+            sync.condition.wait(sync.lock);
+            continue;
+        }
+
+        Request* request = sync.requests[0];
+        sync.requests.removeAt(0);
+
+        sync.lock.unlock();
+        request->op->onDefer(*request->renderer, *request->deferInfo, *request->state);
+        sync.lock.lock();
+
+        request->done = true;
+        sync.condition.broadcast();
+    }
+}
+
+void LayerDeferrer::onDefer(OpenGLRenderer& renderer, DrawOp* op, DeferInfo& deferInfo,
+        const DeferredDisplayState& state) {
+    Request request;
+    request.renderer = &renderer;
+    request.op = op;
+    request.deferInfo = &deferInfo;
+    request.state = &state;
+    request.done = false;
+
+    Sync& sync = *mSync;
+    Mutex::Autolock _l(sync.lock);
+    sync.requests.add(&request);
+    sync.condition.broadcast();
+    while (!request.done) {
+        sync.condition.wait(sync.lock);
+    }
+}
+
+}; // namespace uirenderer
+}; // namespace android
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_LAYER_DEFERRER_H
+#define ANDROID_HWUI_LAYER_DEFERRER_H
+
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+#include <utils/Vector.h>
+
+#include "thread/Task.h"
+#include "thread/TaskProcessor.h"
+
+namespace android {
+namespace uirenderer {
+
+class Caches;
+class DeferredDisplayState;
+class DrawOp;
+class Layer;
+class OpenGLRenderer;
+struct DeferInfo;
+
+/**
+ * Defers the display lists of several layers in parallel on the workers
+ * of the task manager, before the layers are flushed.
+ *
+ * Walking a display list and batching its operations only touches the
+ * layer's own renderer and deferred list, but the onDefer() step of some
+ * operations reads or fills the shared caches, which may issue GL calls.
+ * These calls are sent back to the GL thread, which executes them one at
+ * a time while it waits for the workers in finish().
+ */
+class LayerDeferrer {
+public:
+    LayerDeferrer(Caches& caches);
+    ~LayerDeferrer();
+
+    /**
+     * Returns true if layers can be deferred off the GL thread. This is not
+     * the case on single core devices, or when display lists keep their
+     * deferred operations across frames, as cached lists are deferred
+     * without going through this class.
+     */
+    static bool canDeferInParallel(Caches& caches);
+
+    /**
+     * Queues a layer whose update was prepared with Layer::prepareDefer().
+     */
+    void add(Layer* layer);
+
+    /**
+     * Defers every queued layer and returns once they are all deferred.
+     * Must be called on the GL thread.
+     */
+    void finish();
+
+    /**
+     * Runs the onDefer() step of the specified operation on the GL thread.
+     * Called by the deferred display lists of the layers being deferred.
+     */
+    void onDefer(OpenGLRenderer& renderer, DrawOp* op, DeferInfo& deferInfo,
+            const DeferredDisplayState& state);
+
+private:
+    class DeferTask: public Task<bool> {
+    public:
+        DeferTask(Layer* layer): Task<bool>(kPriorityFrame), layer(layer) { }
+
+        Layer* layer;
+    };
+
+    struct Request {
+        OpenGLRenderer* renderer;
+        DrawOp* op;
+        DeferInfo* deferInfo;
+        const DeferredDisplayState* state;
+        bool done;
+    };
+
+    /**
+     * State shared with the workers. The deferrer may be destroyed as soon
+     * as the last layer is deferred, the worker that signals it keeps this
+     * alive until it has released the lock.
+     */
+    struct Sync: public LightRefBase<Sync> {
+        Sync(): pendingLayers(0) { }
+
+        void onLayerDeferred();
+
+        Mutex lock;
+        Condition condition;
+        Vector<Request*> requests;
+        size_t pendingLayers;
+    };
+
+    class DeferProcessor: public TaskProcessor<bool> {
+    public:
+        DeferProcessor(Caches& caches, LayerDeferrer* deferrer, const sp<Sync>& sync);
+        ~DeferProcessor() { }
+
+        virtual void onProcess(const sp<Task<bool> >& task);
+
+    private:
+        LayerDeferrer* mDeferrer;
+        sp<Sync> mSync;
+    };
+
+    Caches& mCaches;
+    sp<DeferProcessor> mProcessor;
+    Vector<Layer*> mLayers;
+    sp<Sync> mSync;
+}; // class LayerDeferrer
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_LAYER_DEFERRER_H
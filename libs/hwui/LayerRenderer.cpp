@@ -112,6 +112,10 @@ void LayerRenderer::ensureStencilBuffer() {
     attachStencilBufferToLayer(mLayer);
 }
 
+const RenderBuffer* LayerRenderer::getStencilBuffer() const {
+    return mLayer->getStencilRenderBuffer();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Dirty region tracking
 ///////////////////////////////////////////////////////////////////////////////
@@ -123,6 +127,16 @@ Region* LayerRenderer::getRegion() const {
     return &mLayer->region;
 }
 
+static bool regionsEqual(const Region& lhs, const Region& rhs) {
+    size_t lhsCount;
+    size_t rhsCount;
+    const android::Rect* lhsRects = lhs.getArray(&lhsCount);
+    const android::Rect* rhsRects = rhs.getArray(&rhsCount);
+
+    if (lhsCount != rhsCount) return false;
+    return lhsRects == rhsRects || !memcmp(lhsRects, rhsRects, lhsCount * sizeof(android::Rect));
+}
+
 // TODO: This implementation uses a very simple approach to fixing T-junctions which keeps the
 //       results as rectangles, and is thus not necessarily efficient in the geometry
 //       produced. Eventually, it may be better to develop triangle-based mechanism.
@@ -132,12 +146,21 @@ void LayerRenderer::generateMesh() {
             delete[] mLayer->mesh;
             mLayer->mesh = NULL;
             mLayer->meshElementCount = 0;
+            mLayer->meshRegion.clear();
         }
 
         mLayer->setRegionAsRect();
         return;
     }
 
+    // Layers are often updated without their region changing, in which case
+    // the mesh generated by the previous update can be reused as is
+    if (mLayer->mesh && mLayer->meshWidth == mLayer->getWidth() &&
+            mLayer->meshHeight == mLayer->getHeight() && mLayer->meshLayer == mLayer->layer &&
+            regionsEqual(mLayer->meshRegion, mLayer->region)) {
+        return;
+    }
+
     // avoid T-junctions as they cause artifacts in between the resultant
     // geometry when complex transforms occur.
     // TODO: generate the safeRegion only if necessary based on drawing transform (see
@@ -158,6 +181,10 @@ void LayerRenderer::generateMesh() {
         mLayer->mesh = new TextureVertex[count * 4];
     }
     mLayer->meshElementCount = elementCount;
+    mLayer->meshRegion = mLayer->region;
+    mLayer->meshLayer = mLayer->layer;
+    mLayer->meshWidth = mLayer->getWidth();
+    mLayer->meshHeight = mLayer->getHeight();
 
     const float texX = 1.0f / float(mLayer->getWidth());
     const float texY = 1.0f / float(mLayer->getHeight());
@@ -310,6 +337,24 @@ void LayerRenderer::updateTextureLayer(Layer* layer, uint32_t width, uint32_t he
     }
 }
 
+/**
+ * In direct composition mode the producer of a texture layer posts to an
+ * overlay surface instead of the layer's SurfaceTexture, updateTextureLayer()
+ * is then never called and the size of the layer must be set here.
+ */
+void LayerRenderer::setDirectComposition(Layer* layer, bool enabled,
+        uint32_t width, uint32_t height) {
+    if (layer) {
+        layer->setDirectComposition(enabled);
+        if (enabled) {
+            layer->setSize(width, height);
+            layer->layer.set(0.0f, 0.0f, width, height);
+            layer->region.set(width, height);
+            layer->regionRect.set(0.0f, 0.0f, width, height);
+        }
+    }
+}
+
 void LayerRenderer::destroyLayer(Layer* layer) {
     if (layer) {
         LAYER_RENDERER_LOGD("Recycling layer, %dx%d fbo = %d",
@@ -57,6 +57,8 @@ public:
     ANDROID_API static bool resizeLayer(Layer* layer, uint32_t width, uint32_t height);
     ANDROID_API static void updateTextureLayer(Layer* layer, uint32_t width, uint32_t height,
             bool isOpaque, GLenum renderTarget, float* transform);
+    ANDROID_API static void setDirectComposition(Layer* layer, bool enabled,
+            uint32_t width, uint32_t height);
     ANDROID_API static void destroyLayer(Layer* layer);
     ANDROID_API static void destroyLayerDeferred(Layer* layer);
     ANDROID_API static bool copyLayer(Layer* layer, SkBitmap* bitmap);
@@ -65,6 +67,7 @@ public:
 
 protected:
     virtual void ensureStencilBuffer();
+    virtual const RenderBuffer* getStencilBuffer() const;
     virtual bool hasLayer() const;
     virtual Region* getRegion() const;
     virtual GLint getTargetFbo() const;
@@ -26,6 +26,14 @@
 
 #include "Matrix.h"
 
+#if defined(__ARM_HAVE_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define MATRIX_USE_NEON 1
+#elif defined(__SSE__)
+    #include <xmmintrin.h>
+    #define MATRIX_USE_SSE 1
+#endif
+
 namespace android {
 namespace uirenderer {
 
@@ -200,6 +208,28 @@ void Matrix4::copyTo(SkMatrix& v) const {
 }
 
 void Matrix4::loadInverse(const Matrix4& v) {
+    if (v.isSimple()) {
+        // No skew nor perspective, the inverse of a scale is the reciprocal scale
+        const float sx = 1.0f / v.data[kScaleX];
+        const float sy = 1.0f / v.data[kScaleY];
+
+        data[kScaleX] = sx;
+        data[kSkewX] = 0.0f;
+        data[kTranslateX] = -v.data[kTranslateX] * sx;
+
+        data[kSkewY] = 0.0f;
+        data[kScaleY] = sy;
+        data[kTranslateY] = -v.data[kTranslateY] * sy;
+
+        data[kPerspective0] = 0.0f;
+        data[kPerspective1] = 0.0f;
+        data[kPerspective2] = 1.0f;
+
+        // Inverting keeps the same entries non-zero and non-one
+        mType = v.getType();
+        return;
+    }
+
     double scale = 1.0 /
             (v.data[kScaleX] * ((double) v.data[kScaleY]  * v.data[kPerspective2] -
                     (double) v.data[kTranslateY] * v.data[kPerspective1]) +
@@ -251,6 +281,22 @@ void Matrix4::multiply(float v) {
     mType = kTypeUnknown;
 }
 
+void Matrix4::scale(float sx, float sy, float sz) {
+    // Post-multiplying by a scale matrix scales the first three columns
+    for (int i = 0; i < 4; i++) {
+        data[i] *= sx;
+        data[4 + i] *= sy;
+        data[8 + i] *= sz;
+    }
+    mType = kTypeUnknown;
+}
+
+void Matrix4::translateColumns(float x, float y) {
+    for (int i = 0; i < 4; i++) {
+        data[12 + i] = data[i] * x + data[4 + i] * y + data[12 + i];
+    }
+}
+
 void Matrix4::loadTranslate(float x, float y, float z) {
     loadIdentity();
 
@@ -346,6 +392,37 @@ void Matrix4::loadRotate(float angle, float x, float y, float z) {
 }
 
 void Matrix4::loadMultiply(const Matrix4& u, const Matrix4& v) {
+    // Each column of the result is a linear combination of the columns of u,
+    // weighted by the corresponding column of v
+#if MATRIX_USE_NEON
+    const float32x4_t u0 = vld1q_f32(&u.data[0]);
+    const float32x4_t u1 = vld1q_f32(&u.data[4]);
+    const float32x4_t u2 = vld1q_f32(&u.data[8]);
+    const float32x4_t u3 = vld1q_f32(&u.data[12]);
+
+    for (int i = 0 ; i < 4 ; i++) {
+        const float* e = &v.data[i * 4];
+        float32x4_t r = vmulq_n_f32(u0, e[0]);
+        r = vmlaq_n_f32(r, u1, e[1]);
+        r = vmlaq_n_f32(r, u2, e[2]);
+        r = vmlaq_n_f32(r, u3, e[3]);
+        vst1q_f32(&data[i * 4], r);
+    }
+#elif MATRIX_USE_SSE
+    const __m128 u0 = _mm_loadu_ps(&u.data[0]);
+    const __m128 u1 = _mm_loadu_ps(&u.data[4]);
+    const __m128 u2 = _mm_loadu_ps(&u.data[8]);
+    const __m128 u3 = _mm_loadu_ps(&u.data[12]);
+
+    for (int i = 0 ; i < 4 ; i++) {
+        const float* e = &v.data[i * 4];
+        __m128 r = _mm_mul_ps(u0, _mm_set1_ps(e[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(u1, _mm_set1_ps(e[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(u2, _mm_set1_ps(e[2])));
+        r = _mm_add_ps(r, _mm_mul_ps(u3, _mm_set1_ps(e[3])));
+        _mm_storeu_ps(&data[i * 4], r);
+    }
+#else
     for (int i = 0 ; i < 4 ; i++) {
         float x = 0;
         float y = 0;
@@ -365,6 +442,7 @@ void Matrix4::loadMultiply(const Matrix4& u, const Matrix4& v) {
         set(i, 2, z);
         set(i, 3, w);
     }
+#endif
 
     mType = kTypeUnknown;
 }
@@ -385,7 +463,14 @@ void Matrix4::loadOrtho(float left, float right, float bottom, float top, float
 #define MUL_ADD_STORE(a, b, c) a = (a) * (b) + (c)
 
 void Matrix4::mapPoint(float& x, float& y) const {
-    if (isSimple()) {
+    const uint8_t type = getGeometryType();
+    if (type <= kTypeTranslate) {
+        x += data[kTranslateX];
+        y += data[kTranslateY];
+        return;
+    }
+
+    if (type <= (kTypeScale | kTypeTranslate)) {
         MUL_ADD_STORE(x, data[kScaleX], data[kTranslateX]);
         MUL_ADD_STORE(y, data[kScaleY], data[kTranslateY]);
         return;
@@ -401,11 +486,16 @@ void Matrix4::mapPoint(float& x, float& y) const {
 }
 
 void Matrix4::mapRect(Rect& r) const {
-    if (isSimple()) {
-        MUL_ADD_STORE(r.left, data[kScaleX], data[kTranslateX]);
-        MUL_ADD_STORE(r.right, data[kScaleX], data[kTranslateX]);
-        MUL_ADD_STORE(r.top, data[kScaleY], data[kTranslateY]);
-        MUL_ADD_STORE(r.bottom, data[kScaleY], data[kTranslateY]);
+    const uint8_t type = getGeometryType();
+    if (type <= (kTypeScale | kTypeTranslate)) {
+        if (type <= kTypeTranslate) {
+            r.translate(data[kTranslateX], data[kTranslateY]);
+        } else {
+            MUL_ADD_STORE(r.left, data[kScaleX], data[kTranslateX]);
+            MUL_ADD_STORE(r.right, data[kScaleX], data[kTranslateX]);
+            MUL_ADD_STORE(r.top, data[kScaleY], data[kTranslateY]);
+            MUL_ADD_STORE(r.bottom, data[kScaleY], data[kTranslateY]);
+        }
 
         if (r.left > r.right) {
             float x = r.left;
@@ -422,6 +512,60 @@ void Matrix4::mapRect(Rect& r) const {
         return;
     }
 
+#if MATRIX_USE_NEON || MATRIX_USE_SSE
+    if (!(type & kTypePerspective)) {
+        // Maps the 4 corners at once, the corners are stored in the order
+        // (left, top), (right, top), (right, bottom), (left, bottom)
+        const float xs[] = { r.left, r.right, r.right, r.left };
+        const float ys[] = { r.top, r.top, r.bottom, r.bottom };
+#if MATRIX_USE_NEON
+        const float32x4_t px = vld1q_f32(xs);
+        const float32x4_t py = vld1q_f32(ys);
+
+        float32x4_t x = vmlaq_n_f32(vmulq_n_f32(px, data[kScaleX]), py, data[kSkewX]);
+        x = vaddq_f32(x, vdupq_n_f32(data[kTranslateX]));
+        float32x4_t y = vmlaq_n_f32(vmulq_n_f32(px, data[kSkewY]), py, data[kScaleY]);
+        y = vaddq_f32(y, vdupq_n_f32(data[kTranslateY]));
+
+        float32x2_t minX = vpmin_f32(vget_low_f32(x), vget_high_f32(x));
+        float32x2_t maxX = vpmax_f32(vget_low_f32(x), vget_high_f32(x));
+        float32x2_t minY = vpmin_f32(vget_low_f32(y), vget_high_f32(y));
+        float32x2_t maxY = vpmax_f32(vget_low_f32(y), vget_high_f32(y));
+
+        r.left = vget_lane_f32(vpmin_f32(minX, minX), 0);
+        r.right = vget_lane_f32(vpmax_f32(maxX, maxX), 0);
+        r.top = vget_lane_f32(vpmin_f32(minY, minY), 0);
+        r.bottom = vget_lane_f32(vpmax_f32(maxY, maxY), 0);
+#else
+        const __m128 px = _mm_loadu_ps(xs);
+        const __m128 py = _mm_loadu_ps(ys);
+
+        __m128 x = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(data[kScaleX])),
+                _mm_mul_ps(py, _mm_set1_ps(data[kSkewX])));
+        x = _mm_add_ps(x, _mm_set1_ps(data[kTranslateX]));
+        __m128 y = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(data[kSkewY])),
+                _mm_mul_ps(py, _mm_set1_ps(data[kScaleY])));
+        y = _mm_add_ps(y, _mm_set1_ps(data[kTranslateY]));
+
+        // Reduce each vector: swap the halves, then the neighbors
+        __m128 minX = _mm_min_ps(x, _mm_movehl_ps(x, x));
+        __m128 maxX = _mm_max_ps(x, _mm_movehl_ps(x, x));
+        __m128 minY = _mm_min_ps(y, _mm_movehl_ps(y, y));
+        __m128 maxY = _mm_max_ps(y, _mm_movehl_ps(y, y));
+        minX = _mm_min_ss(minX, _mm_shuffle_ps(minX, minX, _MM_SHUFFLE(1, 1, 1, 1)));
+        maxX = _mm_max_ss(maxX, _mm_shuffle_ps(maxX, maxX, _MM_SHUFFLE(1, 1, 1, 1)));
+        minY = _mm_min_ss(minY, _mm_shuffle_ps(minY, minY, _MM_SHUFFLE(1, 1, 1, 1)));
+        maxY = _mm_max_ss(maxY, _mm_shuffle_ps(maxY, maxY, _MM_SHUFFLE(1, 1, 1, 1)));
+
+        _mm_store_ss(&r.left, minX);
+        _mm_store_ss(&r.right, maxX);
+        _mm_store_ss(&r.top, minY);
+        _mm_store_ss(&r.bottom, maxY);
+#endif
+        return;
+    }
+#endif
+
     float vertices[] = {
         r.left, r.top,
         r.right, r.top,
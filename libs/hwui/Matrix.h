@@ -143,9 +143,8 @@ public:
             // Save the type
             uint8_t type = mType;
 
-            Matrix4 u;
-            u.loadTranslate(x, y, 0.0f);
-            multiply(u);
+            // Post-multiplying by a translation only changes the last column
+            translateColumns(x, y);
 
             // Restore the type and fix the translate bit
             mType = type;
@@ -157,11 +156,7 @@ public:
         }
     }
 
-    void scale(float sx, float sy, float sz) {
-        Matrix4 u;
-        u.loadScale(sx, sy, sz);
-        multiply(u);
-    }
+    void scale(float sx, float sy, float sz);
 
     void skew(float sx, float sy) {
         Matrix4 u;
@@ -215,6 +210,8 @@ private:
 
     uint8_t getGeometryType() const;
 
+    void translateColumns(float x, float y);
+
 }; // class Matrix4
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <stdlib.h>
+
+#include <cutils/properties.h>
+
+#include "Debug.h"
+#include "MemoryBudget.h"
+#include "Properties.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors
+///////////////////////////////////////////////////////////////////////////////
+
+MemoryBudget::MemoryBudget(): mMaxSize(0), mHasFixedMaxSize(false), mFrame(0) {
+    char property[PROPERTY_VALUE_MAX];
+    if (property_get(PROPERTY_MEMORY_BUDGET, property, NULL) > 0) {
+        INIT_LOGD("  Setting memory budget to %sMB", property);
+        mMaxSize = MB(atof(property));
+        mHasFixedMaxSize = true;
+    } else {
+        INIT_LOGD("  Using the sum of the cache sizes as the memory budget");
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Clients
+///////////////////////////////////////////////////////////////////////////////
+
+void MemoryBudget::addClient(Client* client, const char* name) {
+    client->mBudget = this;
+    client->mName = name;
+    client->mLastUseFrame = mFrame;
+    client->mNominalSize = client->getMaxSize();
+    client->mLimit = client->mNominalSize;
+    mClients.push(client);
+
+    updateShares();
+}
+
+void MemoryBudget::updateShares() {
+    uint64_t nominalSize = 0;
+    for (size_t i = 0; i < mClients.size(); i++) {
+        nominalSize += mClients[i]->mNominalSize;
+    }
+
+    if (!mHasFixedMaxSize) {
+        mMaxSize = uint32_t(nominalSize);
+    }
+
+    // The shares add up to the budget
+    for (size_t i = 0; i < mClients.size(); i++) {
+        Client* client = mClients[i];
+        client->mShare = nominalSize > 0 ?
+                uint32_t(uint64_t(client->mNominalSize) * mMaxSize / nominalSize) : 0;
+    }
+}
+
+uint32_t MemoryBudget::getSize() const {
+    uint32_t size = 0;
+    for (size_t i = 0; i < mClients.size(); i++) {
+        size += mClients[i]->getSize();
+    }
+    return size;
+}
+
+bool MemoryBudget::isIdle(const Client* client) const {
+    return mFrame - client->mLastUseFrame > MEMORY_BUDGET_IDLE_FRAMES;
+}
+
+void MemoryBudget::setLimit(Client* client, uint32_t limit) {
+    if (client->mLimit != limit) {
+        client->setMaxSize(limit);
+        client->mLimit = limit;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Arbitration
+///////////////////////////////////////////////////////////////////////////////
+
+int MemoryBudget::compareVictims(Client* const* lhs, Client* const* rhs) {
+    const Client* l = *lhs;
+    const Client* r = *rhs;
+
+    // Least recently used first
+    if (l->mLastUseFrame != r->mLastUseFrame) {
+        return l->mLastUseFrame < r->mLastUseFrame ? -1 : 1;
+    }
+
+    // Then the clients exceeding their share by the largest amount
+    const int64_t lhsExcess = int64_t(l->mSize) - l->mShare;
+    const int64_t rhsExcess = int64_t(r->mSize) - r->mShare;
+    if (lhsExcess != rhsExcess) {
+        return lhsExcess > rhsExcess ? -1 : 1;
+    }
+
+    return 0;
+}
+
+void MemoryBudget::reclaim(uint32_t size) {
+    Vector<Client*> victims;
+    victims.appendVector(mClients);
+    victims.sort(compareVictims);
+
+    for (size_t i = 0; i < victims.size() && size > 0; i++) {
+        Client* client = victims[i];
+
+        // Idle clients give up their share as well
+        const uint32_t floor = isIdle(client) ? 0 : client->mShare;
+        if (client->mSize <= floor) continue;
+
+        const uint32_t release = client->mSize - floor < size ? client->mSize - floor : size;
+        setLimit(client, client->mSize - release);
+
+        const uint32_t newSize = client->getSize();
+        const uint32_t released = client->mSize > newSize ? client->mSize - newSize : 0;
+        client->mSize = newSize;
+
+        size -= released < size ? released : size;
+    }
+}
+
+void MemoryBudget::endFrame() {
+    uint32_t size = 0;
+    for (size_t i = 0; i < mClients.size(); i++) {
+        Client* client = mClients[i];
+        client->mSize = client->getSize();
+        size += client->mSize;
+    }
+
+    if (size > mMaxSize) {
+        reclaim(size - mMaxSize);
+
+        size = 0;
+        for (size_t i = 0; i < mClients.size(); i++) {
+            size += mClients[i]->mSize;
+        }
+    }
+
+    // Every client can grow into the memory left unused by the others, and
+    // always up to its share. The budget can be exceeded during a frame if
+    // several clients grow at once, which the next call to endFrame() fixes
+    const uint32_t available = size < mMaxSize ? mMaxSize - size : 0;
+    for (size_t i = 0; i < mClients.size(); i++) {
+        Client* client = mClients[i];
+        const uint32_t limit = client->mSize + available;
+        setLimit(client, limit > client->mShare ? limit : client->mShare);
+    }
+
+    mFrame++;
+}
+
+void MemoryBudget::trimIdleClients() {
+    for (size_t i = 0; i < mClients.size(); i++) {
+        Client* client = mClients[i];
+        if (isIdle(client)) {
+            setLimit(client, 0);
+            setLimit(client, client->mShare);
+        }
+    }
+}
+
+void MemoryBudget::resetLimits() {
+    for (size_t i = 0; i < mClients.size(); i++) {
+        Client* client = mClients[i];
+        setLimit(client, client->mShare);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Debug
+///////////////////////////////////////////////////////////////////////////////
+
+void MemoryBudget::dump(String8& log) const {
+    log.appendFormat("Memory budget (bytes): %d / %d\n", getSize(), mMaxSize);
+    for (size_t i = 0; i < mClients.size(); i++) {
+        const Client* client = mClients[i];
+        log.appendFormat("  %-20s share %8d, limit %8d%s\n", client->mName,
+                client->mShare, client->mLimit, isIdle(client) ? ", idle" : "");
+    }
+}
+
+}; // namespace uirenderer
+}; // namespace android
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_MEMORY_BUDGET_H
+#define ANDROID_HWUI_MEMORY_BUDGET_H
+
+#include <stdint.h>
+
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Number of frames after which a cache that has not been used gives
+// up its share of the budget to the other caches
+#define MEMORY_BUDGET_IDLE_FRAMES 120
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Arbitrates a single memory budget between several caches. Each cache is
+ * guaranteed a share of the budget proportional to its own maximum size, as
+ * defined by its properties, and can grow into the memory left unused by the
+ * other caches.
+ *
+ * The limits of the caches are updated at the end of every frame. When the
+ * caches use more than the budget, memory is reclaimed from the caches that
+ * were used the least recently first, down to their share, and from idle
+ * caches entirely. Among caches used equally recently, the caches exceeding
+ * their share by the largest amount are trimmed first. Each cache evicts its
+ * own entries in LRU order.
+ */
+class MemoryBudget {
+public:
+    /**
+     * A cache whose memory is managed by a MemoryBudget.
+     */
+    class Client {
+    public:
+        Client(): mBudget(NULL), mName(NULL), mLastUseFrame(0), mSize(0),
+                mNominalSize(0), mShare(0), mLimit(0) {
+        }
+
+        virtual ~Client() {
+        }
+
+        /**
+         * Returns the current size of the cache in bytes.
+         */
+        virtual uint32_t getSize() = 0;
+
+        /**
+         * Returns the maximum size of the cache in bytes.
+         */
+        virtual uint32_t getMaxSize() = 0;
+
+        /**
+         * Sets the maximum size of the cache in bytes. The cache must evict
+         * entries until it is under that size.
+         */
+        virtual void setMaxSize(uint32_t maxSize) = 0;
+
+    protected:
+        /**
+         * Must be invoked whenever the cache is queried.
+         */
+        void markUsed() {
+            if (mBudget) mLastUseFrame = mBudget->mFrame;
+        }
+
+    private:
+        MemoryBudget* mBudget;
+        const char* mName;
+
+        uint32_t mLastUseFrame;
+        // Size of the cache when the limits were last updated
+        uint32_t mSize;
+        // Maximum size of the cache when it was added to the budget
+        uint32_t mNominalSize;
+        // Size guaranteed to the cache
+        uint32_t mShare;
+        // Last limit set with setMaxSize()
+        uint32_t mLimit;
+
+        friend class MemoryBudget;
+    }; // class Client
+
+    MemoryBudget();
+
+    /**
+     * Adds a cache to the budget. The current maximum size of the cache
+     * defines the share of the budget it is guaranteed. Unless a size is
+     * set through properties, the budget is the sum of the maximum sizes
+     * of its clients.
+     */
+    void addClient(Client* client, const char* name);
+
+    /**
+     * Must be invoked at the end of each frame. Reclaims memory if the
+     * caches use more than the budget and updates their limits.
+     */
+    void endFrame();
+
+    /**
+     * Releases the memory held by the caches that have not been used
+     * recently.
+     */
+    void trimIdleClients();
+
+    /**
+     * Restricts every cache to its share of the budget, to invoke after
+     * the caches were flushed. The caches can grow again at the end of
+     * the next frame.
+     */
+    void resetLimits();
+
+    /**
+     * Returns the size of the budget in bytes.
+     */
+    uint32_t getMaxSize() const {
+        return mMaxSize;
+    }
+
+    /**
+     * Returns the memory used by all the clients in bytes.
+     */
+    uint32_t getSize() const;
+
+    /**
+     * Prints the share and limit of every client.
+     */
+    void dump(String8& log) const;
+
+private:
+    void updateShares();
+    void reclaim(uint32_t size);
+    void setLimit(Client* client, uint32_t limit);
+    bool isIdle(const Client* client) const;
+
+    static int compareVictims(Client* const* lhs, Client* const* rhs);
+
+    Vector<Client*> mClients;
+
+    uint32_t mMaxSize;
+    bool mHasFixedMaxSize;
+
+    uint32_t mFrame;
+}; // class MemoryBudget
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_MEMORY_BUDGET_H
@@ -32,8 +32,10 @@
 
 #include "OpenGLRenderer.h"
 #include "DeferredDisplayList.h"
+#include "DisplayListCapture.h"
 #include "DisplayListRenderer.h"
 #include "Fence.h"
+#include "LayerDeferrer.h"
 #include "PathTessellator.h"
 #include "Properties.h"
 #include "Vector.h"
@@ -131,6 +133,10 @@ OpenGLRenderer::OpenGLRenderer():
     mFrameStarted = false;
     mCountOverdraw = false;
 
+    mBufferAge = -1;
+    mDamageHistoryHead = 0;
+    mDamageHistoryCount = 0;
+
     mScissorOptimizationDisabled = false;
 }
 
@@ -173,6 +179,9 @@ bool OpenGLRenderer::isDeferred() {
 void OpenGLRenderer::setViewport(int width, int height) {
     initViewport(width, height);
 
+    // The buffers are reallocated, the damage of previous frames is meaningless
+    mDamageHistoryCount = 0;
+
     glDisable(GL_DITHER);
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 
@@ -192,6 +201,7 @@ void OpenGLRenderer::initViewport(int width, int height) {
 void OpenGLRenderer::setupFrameState(float left, float top,
         float right, float bottom, bool opaque) {
     mCaches.clearGarbage();
+    mCaches.layerCache.allocatePrewarmedLayers();
 
     mOpaque = opaque;
     mSnapshot = new Snapshot(mFirstSnapshot,
@@ -209,6 +219,12 @@ status_t OpenGLRenderer::startFrame() {
 
     mDirtyClip = true;
 
+    // The content of the stencil buffer of the framebuffer is
+    // undefined after a swap
+    if (getTargetFbo() == 0) {
+        mCaches.stencil.invalidateClip(NULL);
+    }
+
     discardFramebuffer(mTilingClip.left, mTilingClip.top, mTilingClip.right, mTilingClip.bottom);
 
     glViewport(0, 0, mWidth, mHeight);
@@ -233,6 +249,20 @@ status_t OpenGLRenderer::prepare(bool opaque) {
 status_t OpenGLRenderer::prepareDirty(float left, float top,
         float right, float bottom, bool opaque) {
 
+    // The damage of every frame drawn to the framebuffer is recorded, even
+    // when its buffer age is unknown, so that a later frame that knows its
+    // age doesn't miss it
+    if (getTargetFbo() == 0) {
+        Rect dirty(left, top, right, bottom);
+        accumulateDamage(dirty, mBufferAge);
+        mBufferAge = -1;
+
+        left = dirty.left;
+        top = dirty.top;
+        right = dirty.right;
+        bottom = dirty.bottom;
+    }
+
     setupFrameState(left, top, right, bottom, opaque);
 
     // Layer renderers will start the frame immediately
@@ -249,6 +279,28 @@ status_t OpenGLRenderer::prepareDirty(float left, float top,
     return DrawGlInfo::kStatusDone;
 }
 
+void OpenGLRenderer::accumulateDamage(Rect& dirty, int bufferAge) {
+    const Rect damage(dirty);
+
+    // A buffer of age N last received the frame drawn N frames ago, it
+    // misses the damage of the N - 1 frames drawn since
+    if (bufferAge < 0) {
+        // Unknown age, the dirty rectangle is drawn as-is
+    } else if (bufferAge == 0 || bufferAge - 1 > mDamageHistoryCount) {
+        dirty.set(0.0f, 0.0f, mWidth, mHeight);
+    } else {
+        for (int i = 0; i < bufferAge - 1; i++) {
+            int index = (mDamageHistoryHead - i + kMaxBufferAge - 1) % (kMaxBufferAge - 1);
+            dirty.unionWith(mDamageHistory[index]);
+        }
+    }
+
+    // Stores what this frame changes, not what it redraws
+    mDamageHistoryHead = (mDamageHistoryHead + 1) % (kMaxBufferAge - 1);
+    mDamageHistory[mDamageHistoryHead] = damage;
+    if (mDamageHistoryCount < kMaxBufferAge - 1) mDamageHistoryCount++;
+}
+
 void OpenGLRenderer::discardFramebuffer(float left, float top, float right, float bottom) {
     // If we know that we are going to redraw the entire framebuffer,
     // perform a discard to let the driver know we don't need to preserve
@@ -260,6 +312,7 @@ void OpenGLRenderer::discardFramebuffer(float left, float top, float right, floa
                 isFbo ? (const GLenum) GL_COLOR_EXT : (const GLenum) GL_COLOR_ATTACHMENT0,
                 isFbo ? (const GLenum) GL_STENCIL_EXT : (const GLenum) GL_STENCIL_ATTACHMENT };
         glDiscardFramebufferEXT(GL_FRAMEBUFFER, 1, attachments);
+        mCaches.stencil.invalidateClip(getStencilBuffer());
     }
 }
 
@@ -313,6 +366,12 @@ void OpenGLRenderer::finish() {
     // of the current frame
     if (getTargetFbo() == 0) {
         mCaches.pathCache.trim();
+        mCaches.tessellationCache.trim();
+        mCaches.textureCache.endFrame();
+        mCaches.memoryBudget.endFrame();
+        mCaches.batchingStatistics.endFrame();
+        mCaches.glStateStatistics.endFrame();
+        mCaches.gpuProfiler.endFrame();
     }
 
     if (!suppressErrorChecks()) {
@@ -574,11 +633,15 @@ void OpenGLRenderer::countOverdraw() {
 // Layers
 ///////////////////////////////////////////////////////////////////////////////
 
-bool OpenGLRenderer::updateLayer(Layer* layer, bool inFrame) {
+bool OpenGLRenderer::updateLayer(Layer* layer, bool inFrame, LayerDeferrer* deferrer) {
     if (layer->deferredUpdateScheduled && layer->renderer &&
             layer->displayList && layer->displayList->isRenderable()) {
         ATRACE_CALL();
 
+        if (!layer->clipDirtyRectToContentDamage()) {
+            return false;
+        }
+
         Rect& dirty = layer->dirtyRect;
 
         if (inFrame) {
@@ -588,6 +651,9 @@ bool OpenGLRenderer::updateLayer(Layer* layer, bool inFrame) {
 
         if (CC_UNLIKELY(inFrame || mCaches.drawDeferDisabled)) {
             layer->render();
+        } else if (deferrer) {
+            layer->prepareDefer();
+            deferrer->add(layer);
         } else {
             layer->defer();
         }
@@ -618,14 +684,22 @@ void OpenGLRenderer::updateLayers() {
             startMark("Defer Layer Updates");
         }
 
+        // Layers are deferred into their own lists, independently of each
+        // other, so their display lists can be walked in parallel. They are
+        // still flushed in order by flushLayers()
+        LayerDeferrer deferrer(mCaches);
+        const bool parallel = count > 1 && !mCaches.drawDeferDisabled &&
+                LayerDeferrer::canDeferInParallel(mCaches);
+
         // Note: it is very important to update the layers in order
         for (int i = 0; i < count; i++) {
             Layer* layer = mLayerUpdates.itemAt(i);
-            updateLayer(layer, false);
+            updateLayer(layer, false, parallel ? &deferrer : NULL);
             if (CC_UNLIKELY(mCaches.drawDeferDisabled)) {
                 mCaches.resourceCache.decrementRefcount(layer);
             }
         }
+        deferrer.finish();
 
         if (CC_UNLIKELY(mCaches.drawDeferDisabled)) {
             mLayerUpdates.clear();
@@ -1033,6 +1107,8 @@ void OpenGLRenderer::composeLayer(sp<Snapshot> current, sp<Snapshot> previous) {
     const Rect& rect = layer->layer;
     const bool fboLayer = current->flags & Snapshot::kFlagIsFboLayer;
 
+    const int sample = mCaches.gpuProfiler.startSample("composeLayer", 1);
+
     bool clipRequired = false;
     quickRejectNoScissor(rect, &clipRequired); // safely ignore return, should never be rejected
     mCaches.setScissorEnabled(mScissorOptimizationDisabled || clipRequired);
@@ -1087,6 +1163,8 @@ void OpenGLRenderer::composeLayer(sp<Snapshot> current, sp<Snapshot> previous) {
 
     dirtyClip();
 
+    mCaches.gpuProfiler.endSample(sample);
+
     // Failing to add the layer to the cache should happen only if the layer is too large
     if (!mCaches.layerCache.put(layer)) {
         LAYER_LOGD("Deleting layer");
@@ -1094,7 +1172,37 @@ void OpenGLRenderer::composeLayer(sp<Snapshot> current, sp<Snapshot> previous) {
     }
 }
 
+void OpenGLRenderer::drawTextureLayerOverlay(Layer* layer, const Rect& rect) {
+    const mat4& transform = currentTransform();
+
+    // SurfaceFlinger composites the overlay opaque, below the window and
+    // with an axis aligned transform; anything else cannot be matched
+    if (getTargetFbo() != 0 || !transform.rectToRect() || getLayerAlpha(layer) < 1.0f ||
+            layer->getColorFilter() || layer->getMode() != SkXfermode::kSrcOver_Mode ||
+            !mSnapshot->clipRegion->isEmpty()) {
+        layer->rejectOverlay();
+        return;
+    }
+
+    float x = rect.left;
+    float y = rect.top;
+    transform.mapPoint(x, y);
+
+    mat4 overlayTransform(transform);
+    overlayTransform.scale(rect.getWidth() / layer->getWidth(),
+            rect.getHeight() / layer->getHeight(), 1.0f);
+    layer->setOverlayGeometry(x, y, overlayTransform, *mSnapshot->clipRect);
+
+    // Punch a hole through the window down to the overlay
+    drawColorRect(rect.left, rect.top, rect.right, rect.bottom, 0, SkXfermode::kSrc_Mode);
+}
+
 void OpenGLRenderer::drawTextureLayer(Layer* layer, const Rect& rect) {
+    if (layer->isDirectComposition()) {
+        drawTextureLayerOverlay(layer, rect);
+        return;
+    }
+
     float alpha = getLayerAlpha(layer);
 
     setupDraw();
@@ -1574,12 +1682,17 @@ void OpenGLRenderer::attachStencilBufferToLayer(Layer* layer) {
 
         RenderBuffer* buffer = mCaches.renderBufferCache.get(
                 Stencil::getSmallestStencilFormat(), layer->getWidth(), layer->getHeight());
+        mCaches.stencil.invalidateClip(buffer);
         layer->setStencilRenderBuffer(buffer);
 
         startTiling(layer->clipRect, layer->layer.getHeight());
     }
 }
 
+const RenderBuffer* OpenGLRenderer::getStencilBuffer() const {
+    return hasLayer() && mSnapshot->layer ? mSnapshot->layer->getStencilRenderBuffer() : NULL;
+}
+
 void OpenGLRenderer::setStencilFromClip() {
     if (!mCaches.debugOverdraw) {
         if (!mSnapshot->clipRegion->isEmpty()) {
@@ -1589,25 +1702,33 @@ void OpenGLRenderer::setStencilFromClip() {
 
             ensureStencilBuffer();
 
-            mCaches.stencil.enableWrite();
+            // Restoring a clip, or drawing the same clipped content in
+            // consecutive frames, often leads to the same region: reuse
+            // the stencil buffer as is when it already contains it
+            const RenderBuffer* buffer = getStencilBuffer();
+            if (!mCaches.stencil.hasClip(buffer, *mSnapshot->clipRegion)) {
+                mCaches.stencil.enableWrite();
+
+                // Clear the stencil but first make sure we restrict drawing
+                // to the region's bounds
+                bool resetScissor = mCaches.enableScissor();
+                if (resetScissor) {
+                    // The scissor was not set so we now need to update it
+                    setScissorFromClip();
+                }
+                mCaches.stencil.clear();
+                if (resetScissor) mCaches.disableScissor();
 
-            // Clear the stencil but first make sure we restrict drawing
-            // to the region's bounds
-            bool resetScissor = mCaches.enableScissor();
-            if (resetScissor) {
-                // The scissor was not set so we now need to update it
-                setScissorFromClip();
-            }
-            mCaches.stencil.clear();
-            if (resetScissor) mCaches.disableScissor();
+                // NOTE: We could use the region contour path to generate a smaller mesh
+                //       Since we are using the stencil we could use the red book path
+                //       drawing technique. It might increase bandwidth usage though.
 
-            // NOTE: We could use the region contour path to generate a smaller mesh
-            //       Since we are using the stencil we could use the red book path
-            //       drawing technique. It might increase bandwidth usage though.
+                // The last parameter is important: we are not drawing in the color buffer
+                // so we don't want to dirty the current layer, if any
+                drawRegionRects(*mSnapshot->clipRegion, 0xff000000, SkXfermode::kSrc_Mode, false);
 
-            // The last parameter is important: we are not drawing in the color buffer
-            // so we don't want to dirty the current layer, if any
-            drawRegionRects(*mSnapshot->clipRegion, 0xff000000, SkXfermode::kSrc_Mode, false);
+                mCaches.stencil.setClip(buffer, *mSnapshot->clipRegion);
+            }
 
             mCaches.stencil.enableTest();
 
@@ -1814,6 +1935,12 @@ void OpenGLRenderer::setupDrawTextGamma(const SkPaint* paint) {
     mCaches.fontRenderer->describe(mDescription, paint);
 }
 
+void OpenGLRenderer::setupDrawDistanceField() {
+    mDescription.hasDistanceField = true;
+    // Distance fields are not coverage values
+    mDescription.hasGammaCorrection = false;
+}
+
 void OpenGLRenderer::setupDrawColor(float r, float g, float b, float a) {
     mColorA = a;
     mColorR = r;
@@ -1874,18 +2001,14 @@ void OpenGLRenderer::setupDrawModelViewTranslate(float left, float top, float ri
         bool ignoreTransform) {
     mModelView.loadTranslate(left, top, 0.0f);
     if (!ignoreTransform) {
-        mCaches.currentProgram->set(mOrthoMatrix, mModelView, currentTransform());
+        setupDrawTransform(currentTransform());
         if (mTrackDirtyRegions) dirtyLayer(left, top, right, bottom, currentTransform());
     } else {
-        mCaches.currentProgram->set(mOrthoMatrix, mModelView, mat4::identity());
+        setupDrawTransform(mat4::identity());
         if (mTrackDirtyRegions) dirtyLayer(left, top, right, bottom);
     }
 }
 
-void OpenGLRenderer::setupDrawModelViewIdentity(bool offset) {
-    mCaches.currentProgram->set(mOrthoMatrix, mat4::identity(), currentTransform(), offset);
-}
-
 void OpenGLRenderer::setupDrawModelView(float left, float top, float right, float bottom,
         bool ignoreTransform, bool ignoreModelView) {
     if (!ignoreModelView) {
@@ -1896,25 +2019,32 @@ void OpenGLRenderer::setupDrawModelView(float left, float top, float right, floa
     }
     bool dirty = right - left > 0.0f && bottom - top > 0.0f;
     if (!ignoreTransform) {
-        mCaches.currentProgram->set(mOrthoMatrix, mModelView, currentTransform());
+        setupDrawTransform(currentTransform());
         if (mTrackDirtyRegions && dirty) {
             dirtyLayer(left, top, right, bottom, currentTransform());
         }
     } else {
-        mCaches.currentProgram->set(mOrthoMatrix, mModelView, mat4::identity());
+        setupDrawTransform(mat4::identity());
         if (mTrackDirtyRegions && dirty) dirtyLayer(left, top, right, bottom);
     }
 }
 
+void OpenGLRenderer::setupDrawTransform(const mat4& transform, bool offset) {
+    uint32_t uploaded = mCaches.currentProgram->set(mOrthoMatrix, mModelView, transform, offset);
+    mCaches.glStateStatistics.count(GLStateStatistics::kCall_Uniform, uploaded, 2 - uploaded);
+}
+
 void OpenGLRenderer::setupDrawColorUniforms() {
     if ((mColorSet && !mDrawModifiers.mShader) || (mDrawModifiers.mShader && mSetShaderColor)) {
-        mCaches.currentProgram->setColor(mColorR, mColorG, mColorB, mColorA);
+        mCaches.glStateStatistics.count(GLStateStatistics::kCall_Uniform,
+                mCaches.currentProgram->setColor(mColorR, mColorG, mColorB, mColorA));
     }
 }
 
 void OpenGLRenderer::setupDrawPureColorUniforms() {
     if (mSetShaderColor) {
-        mCaches.currentProgram->setColor(mColorR, mColorG, mColorB, mColorA);
+        mCaches.glStateStatistics.count(GLStateStatistics::kCall_Uniform,
+                mCaches.currentProgram->setColor(mColorR, mColorG, mColorB, mColorA));
     }
 }
 
@@ -1928,13 +2058,6 @@ void OpenGLRenderer::setupDrawShaderUniforms(bool ignoreTransform) {
     }
 }
 
-void OpenGLRenderer::setupDrawShaderIdentityUniforms() {
-    if (mDrawModifiers.mShader) {
-        mDrawModifiers.mShader->setupProgram(mCaches.currentProgram,
-                mat4::identity(), *mSnapshot, &mTextureUnit);
-    }
-}
-
 void OpenGLRenderer::setupDrawColorFilterUniforms() {
     if (mDrawModifiers.mColorFilter) {
         mDrawModifiers.mColorFilter->setupProgram(mCaches.currentProgram);
@@ -1945,6 +2068,12 @@ void OpenGLRenderer::setupDrawTextGammaUniforms() {
     mCaches.fontRenderer->setupProgram(mDescription, mCaches.currentProgram);
 }
 
+void OpenGLRenderer::setupDrawDistanceFieldUniforms(float smoothing) {
+    if (mDescription.hasDistanceField) {
+        glUniform1f(mCaches.currentProgram->getUniform("distanceFieldSmoothing"), smoothing);
+    }
+}
+
 void OpenGLRenderer::setupDrawSimpleMesh() {
     bool force = mCaches.bindMeshBuffer();
     mCaches.bindPositionVertexPointer(force, 0);
@@ -2039,11 +2168,16 @@ status_t OpenGLRenderer::drawDisplayList(DisplayList* displayList, Rect& dirty,
     // All the usual checks and setup operations (quickReject, setupDraw, etc.)
     // will be performed by the display list itself
     if (displayList && displayList->isRenderable()) {
+        if (CC_UNLIKELY(!mCaches.captureFramePath.isEmpty()) && getTargetFbo() == 0) {
+            DisplayListCapture::write(displayList, mCaches.captureFramePath.string());
+            mCaches.captureFramePath.clear();
+        }
+
         if (CC_UNLIKELY(mCaches.drawDeferDisabled)) {
             status = startFrame();
             ReplayStateStruct replayStruct(*this, dirty, replayFlags);
             displayList->replay(replayStruct, 0);
-            return status | replayStruct.mDrawGlStatus;
+            return status | replayStruct.mDrawGlStatus | getPendingUploadsStatus();
         }
 
         bool avoidOverdraw = !mCaches.debugOverdraw && !mCountOverdraw; // shh, don't tell devs!
@@ -2054,12 +2188,43 @@ status_t OpenGLRenderer::drawDisplayList(DisplayList* displayList, Rect& dirty,
         flushLayers();
         status = startFrame();
 
-        return status | deferredList.flush(*this, dirty);
+        return status | deferredList.flush(*this, dirty) | getPendingUploadsStatus();
     }
 
     return DrawGlInfo::kStatusDone;
 }
 
+DeferredDisplayList* OpenGLRenderer::deferDisplayList(DisplayList* displayList,
+        int32_t replayFlags) {
+    if (!displayList || !displayList->isRenderable()) {
+        return NULL;
+    }
+
+    bool avoidOverdraw = !mCaches.debugOverdraw && !mCountOverdraw;
+    DeferredDisplayList* deferredList = new DeferredDisplayList(*(mSnapshot->clipRect),
+            avoidOverdraw);
+    DeferStateStruct deferStruct(*deferredList, *this, replayFlags);
+    displayList->defer(deferStruct, 0);
+    return deferredList;
+}
+
+status_t OpenGLRenderer::flushDeferredDisplayList(DeferredDisplayList* deferredList,
+        Rect& dirty) {
+    flushLayers();
+    status_t status = startFrame();
+
+    status |= deferredList->flush(*this, dirty) | getPendingUploadsStatus();
+    delete deferredList;
+    return status;
+}
+
+status_t OpenGLRenderer::getPendingUploadsStatus() const {
+    // Bitmaps whose textures are still being uploaded were not drawn
+    // or were drawn with stale content, ask for another frame
+    return mCaches.textureCache.hasPendingUploads() ?
+            DrawGlInfo::kStatusDraw : DrawGlInfo::kStatusDone;
+}
+
 void OpenGLRenderer::outputDisplayList(DisplayList* displayList) {
     if (displayList) {
         displayList->output(1);
@@ -2104,7 +2269,7 @@ void OpenGLRenderer::drawAlphaBitmap(Texture* texture, float left, float top, Sk
 status_t OpenGLRenderer::drawBitmaps(SkBitmap* bitmap, AssetAtlas::Entry* entry, int bitmapCount,
         TextureVertex* vertices, bool pureTranslate, const Rect& bounds, SkPaint* paint) {
     mCaches.activeTexture(0);
-    Texture* texture = entry ? entry->texture : mCaches.textureCache.get(bitmap);
+    Texture* texture = entry ? entry->texture : getTexture(bitmap);
     if (!texture) return DrawGlInfo::kStatusDone;
 
     const AutoTexture autoCleanup(texture);
@@ -2422,7 +2587,15 @@ status_t OpenGLRenderer::drawPatch(SkBitmap* bitmap, Res_png_9patch* patch,
     }
 
     AssetAtlas::Entry* entry = mCaches.assetAtlas.getEntry(bitmap);
-    const Patch* mesh = mCaches.patchCache.get(entry, bitmap->width(), bitmap->height(),
+    UvMapper mapper;
+    if (entry) {
+        mapper = entry->uvMapper;
+    } else {
+        TextureAtlas::Entry* atlasEntry = mCaches.textureCache.getAtlasEntry(bitmap);
+        if (atlasEntry) mapper = atlasEntry->uvMapper;
+    }
+
+    const Patch* mesh = mCaches.patchCache.get(mapper, bitmap->width(), bitmap->height(),
             right - left, bottom - top, patch);
 
     return drawPatch(bitmap, mesh, entry, left, top, right, bottom, paint);
@@ -2436,7 +2609,7 @@ status_t OpenGLRenderer::drawPatch(SkBitmap* bitmap, const Patch* mesh, AssetAtl
 
     if (CC_LIKELY(mesh && mesh->verticesCount > 0)) {
         mCaches.activeTexture(0);
-        Texture* texture = entry ? entry->texture : mCaches.textureCache.get(bitmap);
+        Texture* texture = getPatchTexture(bitmap, entry);
         if (!texture) return DrawGlInfo::kStatusDone;
         const AutoTexture autoCleanup(texture);
 
@@ -2487,6 +2660,14 @@ status_t OpenGLRenderer::drawPatch(SkBitmap* bitmap, const Patch* mesh, AssetAtl
     return DrawGlInfo::kStatusDrew;
 }
 
+Texture* OpenGLRenderer::getPatchTexture(SkBitmap* bitmap, AssetAtlas::Entry* entry) {
+    if (entry) return entry->texture;
+    // The mesh was mapped into the runtime atlas if the bitmap was packed
+    // when the mesh was requested, see DrawPatchOp::getMesh()
+    Texture* texture = mCaches.textureCache.getAtlasTexture(bitmap);
+    return texture ? texture : mCaches.textureCache.get(bitmap);
+}
+
 /**
  * Important note: this method is intended to draw batches of 9-patch objects and
  * will not set the scissor enable or dirty the current layer, if any.
@@ -2495,7 +2676,7 @@ status_t OpenGLRenderer::drawPatch(SkBitmap* bitmap, const Patch* mesh, AssetAtl
 status_t OpenGLRenderer::drawPatches(SkBitmap* bitmap, AssetAtlas::Entry* entry,
         TextureVertex* vertices, uint32_t indexCount, SkPaint* paint) {
     mCaches.activeTexture(0);
-    Texture* texture = entry ? entry->texture : mCaches.textureCache.get(bitmap);
+    Texture* texture = getPatchTexture(bitmap, entry);
     if (!texture) return DrawGlInfo::kStatusDone;
     const AutoTexture autoCleanup(texture);
 
@@ -2513,8 +2694,8 @@ status_t OpenGLRenderer::drawPatches(SkBitmap* bitmap, AssetAtlas::Entry* entry,
     return DrawGlInfo::kStatusDrew;
 }
 
-status_t OpenGLRenderer::drawVertexBuffer(const VertexBuffer& vertexBuffer, SkPaint* paint,
-        bool useOffset) {
+status_t OpenGLRenderer::drawVertexBuffer(float translateX, float translateY,
+        const VertexBuffer& vertexBuffer, SkPaint* paint, bool useOffset) {
     if (!vertexBuffer.getVertexCount()) {
         // no vertices to draw
         return DrawGlInfo::kStatusDone;
@@ -2532,10 +2713,11 @@ status_t OpenGLRenderer::drawVertexBuffer(const VertexBuffer& vertexBuffer, SkPa
     setupDrawShader();
     setupDrawBlending(isAA, mode);
     setupDrawProgram();
-    setupDrawModelViewIdentity(useOffset);
+    mModelView.loadTranslate(translateX, translateY, 0.0f);
+    setupDrawTransform(currentTransform(), useOffset);
     setupDrawColorUniforms();
     setupDrawColorFilterUniforms();
-    setupDrawShaderIdentityUniforms();
+    setupDrawShaderUniforms();
 
     void* vertices = vertexBuffer.getBuffer();
     bool force = mCaches.unbindMeshBuffer();
@@ -2563,26 +2745,33 @@ status_t OpenGLRenderer::drawVertexBuffer(const VertexBuffer& vertexBuffer, SkPa
 }
 
 /**
- * Renders a convex path via tessellation. For AA paths, this function uses a similar approach to
+ * Renders a convex shape via tessellation. For AA shapes, this function uses a similar approach to
  * that of AA lines in the drawLines() function.  We expand the convex path by a half pixel in
  * screen space in all directions. However, instead of using a fragment shader to compute the
  * translucency of the color from its position, we simply use a varying parameter to define how far
- * a given pixel is from the edge. For non-AA paths, the expansion and alpha varying are not used.
+ * a given pixel is from the edge. For non-AA shapes, the expansion and alpha varying are not used.
+ *
+ * The shape is tessellated at the origin, possibly ahead of time by a worker thread (see
+ * TessellationCache), and translated to its position.
  *
  * Doesn't yet support joins, caps, or path effects.
  */
-status_t OpenGLRenderer::drawConvexPath(const SkPath& path, SkPaint* paint) {
-    VertexBuffer vertexBuffer;
+status_t OpenGLRenderer::drawConvexShape(float left, float top, float right, float bottom,
+        const TessellationDescription& description, SkPaint* paint) {
     // TODO: try clipping large paths to viewport
-    PathTessellator::tessellatePath(path, paint, mSnapshot->transform, vertexBuffer);
+    const VertexBuffer* vertexBuffer = mCaches.tessellationCache.get(description);
+    if (!vertexBuffer) return DrawGlInfo::kStatusDone;
 
     if (hasLayer()) {
-        SkRect bounds = path.getBounds();
+        SkRect bounds = SkRect::MakeLTRB(left, top, right, bottom);
+        if (paint->getStyle() == SkPaint::kStrokeAndFill_Style) {
+            bounds.outset(paint->getStrokeWidth() / 2, paint->getStrokeWidth() / 2);
+        }
         PathTessellator::expandBoundsForStroke(bounds, paint, false);
         dirtyLayer(bounds.fLeft, bounds.fTop, bounds.fRight, bounds.fBottom, currentTransform());
     }
 
-    return drawVertexBuffer(vertexBuffer, paint);
+    return drawVertexBuffer(left, top, *vertexBuffer, paint);
 }
 
 /**
@@ -2673,16 +2862,12 @@ status_t OpenGLRenderer::drawRoundRect(float left, float top, float right, float
         return drawShape(left, top, texture, p);
     }
 
-    SkPath path;
-    SkRect rect = SkRect::MakeLTRB(left, top, right, bottom);
-    if (p->getStyle() == SkPaint::kStrokeAndFill_Style) {
-        float outset = p->getStrokeWidth() / 2;
-        rect.outset(outset, outset);
-        rx += outset;
-        ry += outset;
-    }
-    path.addRoundRect(rect, rx, ry);
-    return drawConvexPath(path, p);
+    TessellationDescription description(kShapeRoundRect, currentTransform(), p);
+    description.shape.roundRect.mWidth = right - left;
+    description.shape.roundRect.mHeight = bottom - top;
+    description.shape.roundRect.mRx = rx;
+    description.shape.roundRect.mRy = ry;
+    return drawConvexShape(left, top, right, bottom, description, p);
 }
 
 status_t OpenGLRenderer::drawCircle(float x, float y, float radius, SkPaint* p) {
@@ -2697,13 +2882,9 @@ status_t OpenGLRenderer::drawCircle(float x, float y, float radius, SkPaint* p)
         return drawShape(x - radius, y - radius, texture, p);
     }
 
-    SkPath path;
-    if (p->getStyle() == SkPaint::kStrokeAndFill_Style) {
-        path.addCircle(x, y, radius + p->getStrokeWidth() / 2);
-    } else {
-        path.addCircle(x, y, radius);
-    }
-    return drawConvexPath(path, p);
+    TessellationDescription description(kShapeCircle, currentTransform(), p);
+    description.shape.circle.mRadius = radius;
+    return drawConvexShape(x - radius, y - radius, x + radius, y + radius, description, p);
 }
 
 status_t OpenGLRenderer::drawOval(float left, float top, float right, float bottom,
@@ -2719,13 +2900,10 @@ status_t OpenGLRenderer::drawOval(float left, float top, float right, float bott
         return drawShape(left, top, texture, p);
     }
 
-    SkPath path;
-    SkRect rect = SkRect::MakeLTRB(left, top, right, bottom);
-    if (p->getStyle() == SkPaint::kStrokeAndFill_Style) {
-        rect.outset(p->getStrokeWidth() / 2, p->getStrokeWidth() / 2);
-    }
-    path.addOval(rect);
-    return drawConvexPath(path, p);
+    TessellationDescription description(kShapeOval, currentTransform(), p);
+    description.shape.oval.mWidth = right - left;
+    description.shape.oval.mHeight = bottom - top;
+    return drawConvexShape(left, top, right, bottom, description, p);
 }
 
 status_t OpenGLRenderer::drawArc(float left, float top, float right, float bottom,
@@ -2747,20 +2925,13 @@ status_t OpenGLRenderer::drawArc(float left, float top, float right, float botto
         return drawShape(left, top, texture, p);
     }
 
-    SkRect rect = SkRect::MakeLTRB(left, top, right, bottom);
-    if (p->getStyle() == SkPaint::kStrokeAndFill_Style) {
-        rect.outset(p->getStrokeWidth() / 2, p->getStrokeWidth() / 2);
-    }
-
-    SkPath path;
-    if (useCenter) {
-        path.moveTo(rect.centerX(), rect.centerY());
-    }
-    path.arcTo(rect, startAngle, sweepAngle, !useCenter);
-    if (useCenter) {
-        path.close();
-    }
-    return drawConvexPath(path, p);
+    TessellationDescription description(kShapeArc, currentTransform(), p);
+    description.shape.arc.mWidth = right - left;
+    description.shape.arc.mHeight = bottom - top;
+    description.shape.arc.mStartAngle = startAngle;
+    description.shape.arc.mSweepAngle = sweepAngle;
+    description.shape.arc.mUseCenter = useCenter;
+    return drawConvexShape(left, top, right, bottom, description, p);
 }
 
 // See SkPaintDefaults.h
@@ -2773,7 +2944,7 @@ status_t OpenGLRenderer::drawRect(float left, float top, float right, float bott
     }
 
     if (p->getStyle() != SkPaint::kFill_Style) {
-        // only fill style is supported by drawConvexPath, since others have to handle joins
+        // only fill style is supported by drawConvexShape, since others have to handle joins
         if (p->getPathEffect() != 0 || p->getStrokeJoin() != SkPaint::kMiter_Join ||
                 p->getStrokeMiter() != SkPaintDefaults_MiterLimit) {
             mCaches.activeTexture(0);
@@ -2782,19 +2953,17 @@ status_t OpenGLRenderer::drawRect(float left, float top, float right, float bott
             return drawShape(left, top, texture, p);
         }
 
-        SkPath path;
-        SkRect rect = SkRect::MakeLTRB(left, top, right, bottom);
-        if (p->getStyle() == SkPaint::kStrokeAndFill_Style) {
-            rect.outset(p->getStrokeWidth() / 2, p->getStrokeWidth() / 2);
-        }
-        path.addRect(rect);
-        return drawConvexPath(path, p);
+        TessellationDescription description(kShapeRect, currentTransform(), p);
+        description.shape.rect.mWidth = right - left;
+        description.shape.rect.mHeight = bottom - top;
+        return drawConvexShape(left, top, right, bottom, description, p);
     }
 
     if (p->isAntiAlias() && !currentTransform().isSimple()) {
-        SkPath path;
-        path.addRect(left, top, right, bottom);
-        return drawConvexPath(path, p);
+        TessellationDescription description(kShapeRect, currentTransform(), p);
+        description.shape.rect.mWidth = right - left;
+        description.shape.rect.mHeight = bottom - top;
+        return drawConvexShape(left, top, right, bottom, description, p);
     } else {
         drawColorRect(left, top, right, bottom, p->getColor(), getXfermode(p->getXfermode()));
         return DrawGlInfo::kStatusDrew;
@@ -2922,6 +3091,12 @@ mat4 OpenGLRenderer::findBestFontTransform(const mat4& transform) const {
     return fontTransform;
 }
 
+bool OpenGLRenderer::useDistanceFieldText(const SkPaint* paint, const mat4& transform) const {
+    // The distance field programs do not support shaders
+    return !mDrawModifiers.mShader &&
+            mCaches.fontRenderer->getFontRenderer(paint).canUseDistanceField(paint, transform);
+}
+
 status_t OpenGLRenderer::drawText(const char* text, int bytesCount, int count, float x, float y,
         const float* positions, SkPaint* paint, float totalAdvance, const Rect& bounds,
         DrawOpMode drawOpMode) {
@@ -2971,11 +3146,22 @@ status_t OpenGLRenderer::drawText(const char* text, int bytesCount, int count, f
     // Applying the full matrix in the shader is the easiest way to handle
     // rotation and perspective and allows us to always generated quads in the
     // font renderer which greatly simplifies the code, clipping in particular.
-    mat4 fontTransform = findBestFontTransform(transform);
-    fontRenderer.setFont(paint, fontTransform);
+    // Large and transformed text can instead be rendered from distance
+    // fields, which are rasterized once at a fixed size with an identity
+    // transform. The glyphs are scaled when the mesh is generated.
+    const bool distanceField = useDistanceFieldText(paint, transform);
+    float distanceFieldSmoothing = 0.0f;
+    if (distanceField) {
+        fontRenderer.setFont(paint, mat4::identity(), true);
+        distanceFieldSmoothing = FontRenderer::getDistanceFieldSmoothing(paint, transform);
+    } else {
+        mat4 fontTransform = findBestFontTransform(transform);
+        fontRenderer.setFont(paint, fontTransform);
+    }
 
-    // Pick the appropriate texture filtering
-    bool linearFilter = !pureTranslate || fabs(y - (int) y) > 0.0f || fabs(x - (int) x) > 0.0f;
+    // Pick the appropriate texture filtering, distance fields must be interpolated
+    bool linearFilter = distanceField || !pureTranslate ||
+            fabs(y - (int) y) > 0.0f || fabs(x - (int) x) > 0.0f;
     fontRenderer.setTextureFiltering(linearFilter);
 
     // TODO: Implement better clipping for scaled/rotated text
@@ -2983,7 +3169,8 @@ status_t OpenGLRenderer::drawText(const char* text, int bytesCount, int count, f
     Rect layerBounds(FLT_MAX / 2.0f, FLT_MAX / 2.0f, FLT_MIN / 2.0f, FLT_MIN / 2.0f);
 
     bool status;
-    TextSetupFunctor functor(this, x, y, pureTranslate, alpha, mode, paint);
+    TextSetupFunctor functor(this, x, y, pureTranslate, alpha, mode, paint,
+            distanceFieldSmoothing);
 
     // don't call issuedrawcommand, do it at end of batch
     bool forceFinish = (drawOpMode != kDrawOpMode_Defer);
@@ -3087,6 +3274,9 @@ status_t OpenGLRenderer::drawLayer(Layer* layer, float x, float y) {
 
     updateLayer(layer, true);
 
+    // Only the composition is measured, the update of the layer is not
+    const int sample = mCaches.gpuProfiler.startSample("drawLayer", 1);
+
     mCaches.setScissorEnabled(mScissorOptimizationDisabled || clipRequired);
     mCaches.activeTexture(0);
 
@@ -3152,6 +3342,8 @@ status_t OpenGLRenderer::drawLayer(Layer* layer, float x, float y) {
     }
     layer->hasDrawnSinceUpdate = true;
 
+    mCaches.gpuProfiler.endSample(sample);
+
     if (transform && !transform->isIdentity()) {
         restore();
     }
@@ -3241,7 +3433,12 @@ SkPaint* OpenGLRenderer::filterPaint(SkPaint* paint) {
 Texture* OpenGLRenderer::getTexture(SkBitmap* bitmap) {
     Texture* texture = mCaches.assetAtlas.getEntryTexture(bitmap);
     if (!texture) {
-        return mCaches.textureCache.get(bitmap);
+        // Bitmaps are packed in the runtime atlas when deferred,
+        // see DrawBitmapOp::onDefer()
+        texture = mCaches.textureCache.getAtlasTexture(bitmap);
+        if (!texture) {
+            return mCaches.textureCache.getAsync(bitmap);
+        }
     }
     return texture;
 }
@@ -3545,6 +3742,8 @@ void OpenGLRenderer::drawAlpha8TextureMesh(float left, float top, float right, f
 
 void OpenGLRenderer::chooseBlending(bool blend, SkXfermode::Mode mode,
         ProgramDescription& description, bool swapSrcDst) {
+    GLStateStatistics& stats = mCaches.glStateStatistics;
+
     if (mCountOverdraw) {
         if (!mCaches.blend) glEnable(GL_BLEND);
         if (mCaches.lastSrcMode != GL_ONE || mCaches.lastDstMode != GL_ONE) {
@@ -3571,6 +3770,7 @@ void OpenGLRenderer::chooseBlending(bool blend, SkXfermode::Mode mode,
                 description.framebufferMode = mode;
                 description.swapSrcDst = swapSrcDst;
 
+                stats.count(GLStateStatistics::kCall_Blend, mCaches.blend);
                 if (mCaches.blend) {
                     glDisable(GL_BLEND);
                     mCaches.blend = false;
@@ -3582,6 +3782,7 @@ void OpenGLRenderer::chooseBlending(bool blend, SkXfermode::Mode mode,
             }
         }
 
+        stats.count(GLStateStatistics::kCall_Blend, !mCaches.blend);
         if (!mCaches.blend) {
             glEnable(GL_BLEND);
         }
@@ -3589,13 +3790,18 @@ void OpenGLRenderer::chooseBlending(bool blend, SkXfermode::Mode mode,
         GLenum sourceMode = swapSrcDst ? gBlendsSwap[mode].src : gBlends[mode].src;
         GLenum destMode = swapSrcDst ? gBlendsSwap[mode].dst : gBlends[mode].dst;
 
-        if (sourceMode != mCaches.lastSrcMode || destMode != mCaches.lastDstMode) {
+        bool funcChanged = sourceMode != mCaches.lastSrcMode || destMode != mCaches.lastDstMode;
+        stats.count(GLStateStatistics::kCall_Blend, funcChanged);
+        if (funcChanged) {
             glBlendFunc(sourceMode, destMode);
             mCaches.lastSrcMode = sourceMode;
             mCaches.lastDstMode = destMode;
         }
-    } else if (mCaches.blend) {
-        glDisable(GL_BLEND);
+    } else {
+        stats.count(GLStateStatistics::kCall_Blend, mCaches.blend);
+        if (mCaches.blend) {
+            glDisable(GL_BLEND);
+        }
     }
     mCaches.blend = blend;
 }
@@ -3605,8 +3811,10 @@ bool OpenGLRenderer::useProgram(Program* program) {
         if (mCaches.currentProgram != NULL) mCaches.currentProgram->remove();
         program->use();
         mCaches.currentProgram = program;
+        mCaches.glStateStatistics.count(GLStateStatistics::kCall_UseProgram, true);
         return false;
     }
+    mCaches.glStateStatistics.count(GLStateStatistics::kCall_UseProgram, false);
     return true;
 }
 
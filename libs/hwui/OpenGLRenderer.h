@@ -102,8 +102,10 @@ enum ClipSideFlags {
 // Renderer
 ///////////////////////////////////////////////////////////////////////////////
 
+class DeferredDisplayList;
 class DeferredDisplayState;
 class DisplayList;
+class LayerDeferrer;
 class TextSetupFunctor;
 class VertexBuffer;
 
@@ -178,6 +180,24 @@ public:
      */
     virtual status_t prepareDirty(float left, float top, float right, float bottom, bool opaque);
 
+    /**
+     * Sets the age of the buffer the next frame will be drawn into, as reported
+     * by EGL_EXT_buffer_age: the number of frames since the content of the buffer
+     * was drawn, or 0 if its content is undefined. The age applies to the next
+     * call to prepareDirty() only.
+     *
+     * When the age is set, prepareDirty() grows the dirty rectangle to also cover
+     * the rectangles drawn by the frames the buffer missed, so that only the
+     * union of these rectangles is redrawn even though the back buffer is not
+     * preserved. The whole surface is redrawn when the age is 0 or older than
+     * the damage history.
+     *
+     * @param age The age of the buffer, or -1 to draw the dirty rectangle as-is
+     */
+    ANDROID_API void setBufferAge(int age) {
+        mBufferAge = age;
+    }
+
     /**
      * Indicates the end of a frame. This method must be invoked whenever
      * the caller is done rendering a frame.
@@ -281,6 +301,18 @@ public:
     virtual Rect* getClipRect();
 
     virtual status_t drawDisplayList(DisplayList* displayList, Rect& dirty, int32_t replayFlags);
+
+    /**
+     * Splits drawDisplayList() in two for callers that replay a frame from
+     * another thread. deferDisplayList() walks the tree and copies out the
+     * state the frame needs; the display lists must not be modified again
+     * until flushDeferredDisplayList() has issued the GL commands, which also
+     * deletes the deferred list. Returns NULL if there is nothing to draw.
+     */
+    ANDROID_API DeferredDisplayList* deferDisplayList(DisplayList* displayList,
+            int32_t replayFlags);
+    ANDROID_API status_t flushDeferredDisplayList(DeferredDisplayList* deferredList, Rect& dirty);
+
     virtual void outputDisplayList(DisplayList* displayList);
     virtual status_t drawLayer(Layer* layer, float x, float y);
     virtual status_t drawBitmap(SkBitmap* bitmap, float left, float top, SkPaint* paint);
@@ -421,6 +453,12 @@ public:
      */
     mat4 findBestFontTransform(const mat4& transform) const;
 
+    /**
+     * Returns true if text drawn with the specified paint and transform
+     * should be rendered from signed distance fields.
+     */
+    bool useDistanceFieldText(const SkPaint* paint, const mat4& transform) const;
+
 #if DEBUG_MERGE_BEHAVIOR
     void drawScreenSpaceColorRect(float left, float top, float right, float bottom, int color) {
         mCaches.setScissorEnabled(false);
@@ -471,6 +509,12 @@ protected:
      */
     virtual void ensureStencilBuffer();
 
+    /**
+     * Returns the stencil buffer attached by ensureStencilBuffer(), or NULL
+     * when drawing in the framebuffer.
+     */
+    virtual const RenderBuffer* getStencilBuffer() const;
+
     /**
      * Obtains a stencil render buffer (allocating it if necessary) and
      * attaches it to the specified layer.
@@ -529,6 +573,13 @@ protected:
      */
     void drawTextureLayer(Layer* layer, const Rect& rect);
 
+    /**
+     * Draws a texture layer in direct composition mode: clears the area
+     * covered by the layer so that its overlay shows through, and records
+     * where the overlay must be placed.
+     */
+    void drawTextureLayerOverlay(Layer* layer, const Rect& rect);
+
     /**
      * Gets the alpha and xfermode out of a paint object. If the paint is null
      * alpha will be 255 and the xfermode will be SRC_OVER. Accounts for both
@@ -567,6 +618,14 @@ protected:
     }
 
 private:
+    /**
+     * Grows the specified dirty rectangle of the frame about to be drawn to
+     * the framebuffer by the damage the current buffer missed, based on its
+     * age, and records the original dirty rectangle in the damage history.
+     * The rectangle is left as-is when the age is unknown (negative).
+     */
+    void accumulateDamage(Rect& dirty, int bufferAge);
+
     /**
      * Discards the content of the framebuffer if supported by the driver.
      * This method should be called at the beginning of a frame to optimize
@@ -767,20 +826,34 @@ private:
     /**
      * Renders a strip of polygons with the specified paint, used for tessellated geometry.
      *
+     * @param translateX The horizontal translation applied to the vertices
+     * @param translateY The vertical translation applied to the vertices
      * @param vertexBuffer The VertexBuffer to be drawn
      * @param paint The paint to render with
      * @param useOffset Offset the vertexBuffer (used in drawing non-AA lines)
      */
+    status_t drawVertexBuffer(float translateX, float translateY,
+            const VertexBuffer& vertexBuffer, SkPaint* paint, bool useOffset = false);
+
     status_t drawVertexBuffer(const VertexBuffer& vertexBuffer, SkPaint* paint,
-            bool useOffset = false);
+            bool useOffset = false) {
+        return drawVertexBuffer(0.0f, 0.0f, vertexBuffer, paint, useOffset);
+    }
 
     /**
-     * Renders the convex hull defined by the specified path as a strip of polygons.
+     * Renders the convex shape defined by the specified description as a strip
+     * of polygons. The tessellation is obtained from the tessellation cache and
+     * translated to the specified position.
      *
-     * @param path The hull of the path to draw
+     * @param left The left coordinate of the shape's bounding box
+     * @param top The top coordinate of the shape's bounding box
+     * @param right The right coordinate of the shape's bounding box
+     * @param bottom The bottom coordinate of the shape's bounding box
+     * @param description The description of the shape to draw
      * @param paint The paint to render with
      */
-    status_t drawConvexPath(const SkPath& path, SkPaint* paint);
+    status_t drawConvexShape(float left, float top, float right, float bottom,
+            const TessellationDescription& description, SkPaint* paint);
 
     /**
      * Draws a textured rectangle with the specified texture. The specified coordinates
@@ -970,6 +1043,7 @@ private:
     void setupDrawColor(float r, float g, float b, float a);
     void setupDrawAlpha8Color(int color, int alpha);
     void setupDrawTextGamma(const SkPaint* paint);
+    void setupDrawDistanceField();
     void setupDrawShader();
     void setupDrawColorFilter();
     void setupDrawBlending(SkXfermode::Mode mode = SkXfermode::kSrcOver_Mode,
@@ -978,14 +1052,17 @@ private:
             bool swapSrcDst = false);
     void setupDrawProgram();
     void setupDrawDirtyRegionsDisabled();
-    void setupDrawModelViewIdentity(bool offset = false);
+    /**
+     * Sets the transform uniforms of the current program, counting the uploads
+     * that were skipped.
+     */
+    void setupDrawTransform(const mat4& transform, bool offset = false);
     void setupDrawModelView(float left, float top, float right, float bottom,
             bool ignoreTransform = false, bool ignoreModelView = false);
     void setupDrawModelViewTranslate(float left, float top, float right, float bottom,
             bool ignoreTransform = false);
     void setupDrawColorUniforms();
     void setupDrawPureColorUniforms();
-    void setupDrawShaderIdentityUniforms();
     void setupDrawShaderUniforms(bool ignoreTransform = false);
     void setupDrawColorFilterUniforms();
     void setupDrawSimpleMesh();
@@ -994,13 +1071,14 @@ private:
     void setupDrawTextureTransform();
     void setupDrawTextureTransformUniforms(mat4& transform);
     void setupDrawTextGammaUniforms();
+    void setupDrawDistanceFieldUniforms(float smoothing);
     void setupDrawMesh(GLvoid* vertices, GLvoid* texCoords = NULL, GLuint vbo = 0);
     void setupDrawMesh(GLvoid* vertices, GLvoid* texCoords, GLvoid* colors);
     void setupDrawMeshIndices(GLvoid* vertices, GLvoid* texCoords, GLuint vbo = 0);
     void setupDrawIndexedVertices(GLvoid* vertices);
     void accountForClear(SkXfermode::Mode mode);
 
-    bool updateLayer(Layer* layer, bool inFrame);
+    bool updateLayer(Layer* layer, bool inFrame, LayerDeferrer* deferrer = NULL);
     void updateLayers();
     void flushLayers();
 
@@ -1045,10 +1123,24 @@ private:
     /**
      * Returns a texture object for the specified bitmap. The texture can
      * come from the texture cache or an atlas. If this method returns
-     * NULL, the texture could not be found and/or allocated.
+     * NULL, the texture could not be found and/or allocated, or is still
+     * being uploaded.
      */
     Texture* getTexture(SkBitmap* bitmap);
 
+    /**
+     * Returns the texture a 9-patch mesh was generated for: the asset
+     * atlas if the specified entry is not NULL, the runtime atlas if the
+     * bitmap is packed in it or the texture cache otherwise.
+     */
+    Texture* getPatchTexture(SkBitmap* bitmap, AssetAtlas::Entry* entry);
+
+    /**
+     * Returns DrawGlInfo::kStatusDraw if textures are still being uploaded
+     * asynchronously, DrawGlInfo::kStatusDone otherwise.
+     */
+    status_t getPendingUploadsStatus() const;
+
     // Dimensions of the drawing surface
     int mWidth, mHeight;
 
@@ -1071,6 +1163,17 @@ private:
     // Is a frame currently being rendered
     bool mFrameStarted;
 
+    // Maximum buffer age for which the damage of the missed frames is known,
+    // enough for quad buffering
+    static const int kMaxBufferAge = 4;
+    // Age of the buffer the next frame is drawn into, -1 if unknown
+    int mBufferAge;
+    // Dirty rectangles of the previous frames drawn to the framebuffer,
+    // mDamageHistory[mDamageHistoryHead] is the most recent one
+    Rect mDamageHistory[kMaxBufferAge - 1];
+    int mDamageHistoryHead;
+    int mDamageHistoryCount;
+
     // Used to draw textured quads
     TextureVertex mMeshVertices[4];
 
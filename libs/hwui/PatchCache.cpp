@@ -72,6 +72,10 @@ hash_t PatchCache::PatchDescription::hash() const {
     hash = JenkinsHashMix(hash, mBitmapHeight);
     hash = JenkinsHashMix(hash, mPixelWidth);
     hash = JenkinsHashMix(hash, mPixelHeight);
+    hash = JenkinsHashMix(hash, android::hash_type(mMinU));
+    hash = JenkinsHashMix(hash, android::hash_type(mMinV));
+    hash = JenkinsHashMix(hash, android::hash_type(mMaxU));
+    hash = JenkinsHashMix(hash, android::hash_type(mMaxV));
     return JenkinsHashWhiten(hash);
 }
 
@@ -221,25 +225,18 @@ void PatchCache::setupMesh(Patch* newMesh, TextureVertex* vertices) {
     mSize += size;
 }
 
-const Patch* PatchCache::get(const AssetAtlas::Entry* entry,
+const Patch* PatchCache::get(const UvMapper& mapper,
         const uint32_t bitmapWidth, const uint32_t bitmapHeight,
         const float pixelWidth, const float pixelHeight, const Res_png_9patch* patch) {
 
-    const PatchDescription description(bitmapWidth, bitmapHeight, pixelWidth, pixelHeight, patch);
+    const PatchDescription description(bitmapWidth, bitmapHeight, pixelWidth, pixelHeight,
+            mapper, patch);
     const Patch* mesh = mCache.get(description);
 
     if (!mesh) {
         Patch* newMesh = new Patch();
-        TextureVertex* vertices;
-
-        if (entry) {
-            // An atlas entry has a UV mapper
-            vertices = newMesh->createMesh(bitmapWidth, bitmapHeight,
-                    pixelWidth, pixelHeight, entry->uvMapper, patch);
-        } else {
-            vertices = newMesh->createMesh(bitmapWidth, bitmapHeight,
-                    pixelWidth, pixelHeight, patch);
-        }
+        TextureVertex* vertices = newMesh->createMesh(bitmapWidth, bitmapHeight,
+                pixelWidth, pixelHeight, mapper, patch);
 
         if (vertices) {
             setupMesh(newMesh, vertices);
@@ -26,6 +26,7 @@
 #include "AssetAtlas.h"
 #include "Debug.h"
 #include "Patch.h"
+#include "UvMapper.h"
 #include "utils/Pair.h"
 
 namespace android {
@@ -54,7 +55,12 @@ public:
     ~PatchCache();
     void init(Caches& caches);
 
-    const Patch* get(const AssetAtlas::Entry* entry,
+    /**
+     * Returns the mesh of the specified 9-patch. The texture coordinates of
+     * the mesh are transformed by the specified mapper when the bitmap is
+     * stored in an atlas.
+     */
+    const Patch* get(const UvMapper& mapper,
             const uint32_t bitmapWidth, const uint32_t bitmapHeight,
             const float pixelWidth, const float pixelHeight, const Res_png_9patch* patch);
     void clear();
@@ -91,13 +97,22 @@ public:
 private:
     struct PatchDescription {
         PatchDescription(): mPatch(NULL), mBitmapWidth(0), mBitmapHeight(0),
-                mPixelWidth(0), mPixelHeight(0) {
+                mPixelWidth(0), mPixelHeight(0), mMinU(0), mMinV(0), mMaxU(1), mMaxV(1) {
         }
 
         PatchDescription(const uint32_t bitmapWidth, const uint32_t bitmapHeight,
-                const float pixelWidth, const float pixelHeight, const Res_png_9patch* patch):
+                const float pixelWidth, const float pixelHeight, const UvMapper& mapper,
+                const Res_png_9patch* patch):
                 mPatch(patch), mBitmapWidth(bitmapWidth), mBitmapHeight(bitmapHeight),
                 mPixelWidth(pixelWidth), mPixelHeight(pixelHeight) {
+            // The same bitmap can be packed at different locations of the
+            // runtime atlas over time, each location requires its own mesh
+            Rect texCoords(0.0f, 0.0f, 1.0f, 1.0f);
+            mapper.map(texCoords);
+            mMinU = texCoords.left;
+            mMinV = texCoords.top;
+            mMaxU = texCoords.right;
+            mMaxV = texCoords.bottom;
         }
 
         hash_t hash() const;
@@ -134,6 +149,10 @@ private:
         uint32_t mBitmapHeight;
         float mPixelWidth;
         float mPixelHeight;
+        float mMinU;
+        float mMinV;
+        float mMaxU;
+        float mMaxV;
 
     }; // struct PatchDescription
 
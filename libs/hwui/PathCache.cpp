@@ -154,7 +154,7 @@ static PathTexture* createTexture(float left, float top, float offset,
 ///////////////////////////////////////////////////////////////////////////////
 
 PathCache::PathCache():
-        mCache(LruCache<PathDescription, PathTexture*>::kUnlimitedCapacity),
+        mCache(ClockCache<PathDescription, PathTexture*>::kUnlimitedCapacity),
         mSize(0), mMaxSize(MB(DEFAULT_PATH_CACHE_SIZE)) {
     char property[PROPERTY_VALUE_MAX];
     if (property_get(PROPERTY_PATH_CACHE_SIZE, property, NULL) > 0) {
@@ -216,9 +216,12 @@ void PathCache::removeTexture(PathTexture* texture) {
         const uint32_t size = texture->width * texture->height;
 
         // If there is a pending task we must wait for it to return
-        // before attempting our cleanup
+        // before attempting our cleanup. Nobody will use its result
+        // so cancel it first: the worker threads will either skip it
+        // or stop rasterizing the path early
         const sp<Task<SkBitmap*> >& task = texture->task();
         if (task != NULL) {
+            task->cancel();
             SkBitmap* bitmap = task->getResult();
             texture->clearTask();
         } else {
@@ -355,7 +358,9 @@ void PathCache::PathProcessor::onProcess(const sp<Task<SkBitmap*> >& task) {
     texture->width = width;
     texture->height = height;
 
-    if (width <= mMaxTextureSize && height <= mMaxTextureSize) {
+    if (t->isCanceled()) {
+        t->setResult(NULL);
+    } else if (width <= mMaxTextureSize && height <= mMaxTextureSize) {
         SkBitmap* bitmap = new SkBitmap();
         drawPath(t->path, t->paint, *bitmap, left, top, offset, width, height);
         t->setResult(bitmap);
@@ -371,7 +376,7 @@ void PathCache::PathProcessor::onProcess(const sp<Task<SkBitmap*> >& task) {
 ///////////////////////////////////////////////////////////////////////////////
 
 void PathCache::remove(Vector<PathDescription>& pathsToRemove, const path_pair_t& pair) {
-    LruCache<PathDescription, PathTexture*>::Iterator i(mCache);
+    ClockCache<PathDescription, PathTexture*>::Iterator i(mCache);
 
     while (i.next()) {
         const PathDescription& key = i.key();
@@ -427,6 +432,7 @@ PathTexture* PathCache::get(SkPath* path, SkPaint* paint) {
     PathDescription entry(kShapePath, paint);
     entry.shape.path.mPath = path;
 
+    markUsed();
     PathTexture* texture = mCache.get(entry);
 
     if (!texture) {
@@ -19,13 +19,14 @@
 
 #include <GLES2/gl2.h>
 
-#include <utils/LruCache.h>
 #include <utils/Mutex.h>
 #include <utils/Vector.h>
 
 #include "Debug.h"
+#include "MemoryBudget.h"
 #include "Properties.h"
 #include "Texture.h"
+#include "utils/ClockCache.h"
 #include "utils/Pair.h"
 
 class SkBitmap;
@@ -178,7 +179,8 @@ struct PathDescription {
  * Any texture added to the cache causing the cache to grow beyond the maximum
  * allowed size will also cause the oldest texture to be kicked out.
  */
-class PathCache: public OnEntryRemoved<PathDescription, PathTexture*> {
+class PathCache: public OnEntryRemoved<PathDescription, PathTexture*>,
+        public MemoryBudget::Client {
 public:
     PathCache();
     ~PathCache();
@@ -262,6 +264,7 @@ private:
             bool addToCache = true);
 
     PathTexture* get(const PathDescription& entry) {
+        markUsed();
         return mCache.get(entry);
     }
 
@@ -293,7 +296,7 @@ private:
     class PathTask: public Task<SkBitmap*> {
     public:
         PathTask(SkPath* path, SkPaint* paint, PathTexture* texture):
-            path(path), paint(paint), texture(texture) {
+            Task<SkBitmap*>(kPriorityPrecache), path(path), paint(paint), texture(texture) {
         }
 
         ~PathTask() {
@@ -316,7 +319,7 @@ private:
         uint32_t mMaxTextureSize;
     };
 
-    LruCache<PathDescription, PathTexture*> mCache;
+    ClockCache<PathDescription, PathTexture*> mCache;
     uint32_t mSize;
     uint32_t mMaxSize;
     GLuint mMaxTextureSize;
@@ -31,6 +31,7 @@ public:
     VertexBuffer():
         mBuffer(0),
         mVertexCount(0),
+        mVertexSize(0),
         mCleanupMethod(NULL)
     {}
 
@@ -56,6 +57,7 @@ public:
             return reallocBuffer;
         }
         mVertexCount = vertexCount;
+        mVertexSize = sizeof(TYPE);
         mReallocBuffer = mBuffer = (void*)new TYPE[vertexCount];
         mCleanupMethod = &(cleanup<TYPE>);
 
@@ -76,6 +78,7 @@ public:
 
     void* getBuffer() const { return mBuffer; } // shouldn't be const, since not a const ptr?
     unsigned int getVertexCount() const { return mVertexCount; }
+    unsigned int getSize() const { return mVertexCount * mVertexSize; }
 
     template <class TYPE>
     void createDegenerateSeparators(int allocSize) {
@@ -94,6 +97,7 @@ private:
 
     void* mBuffer;
     unsigned int mVertexCount;
+    unsigned int mVertexSize;
 
     void* mReallocBuffer; // used for multi-allocation
 
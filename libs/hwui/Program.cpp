@@ -34,6 +34,8 @@ Program::Program(const ProgramDescription& description, const char* vertex, cons
     mHasColorUniform = false;
     mHasSampler = false;
     mUse = false;
+    mHasProjection = false;
+    mHasTransform = false;
 
     // No need to cache compiled shaders, rely instead on Android's
     // persistent shaders cache
@@ -46,12 +48,7 @@ Program::Program(const ProgramDescription& description, const char* vertex, cons
             glAttachShader(mProgramId, mVertexShader);
             glAttachShader(mProgramId, mFragmentShader);
 
-            position = bindAttrib("position", kBindingPosition);
-            if (description.hasTexture || description.hasExternalTexture) {
-                texCoords = bindAttrib("texCoords", kBindingTexCoords);
-            } else {
-                texCoords = -1;
-            }
+            bindAttribs(description);
 
             ATRACE_BEGIN("linkProgram");
             glLinkProgram(mProgramId);
@@ -90,21 +87,86 @@ Program::Program(const ProgramDescription& description, const char* vertex, cons
     }
 }
 
+Program::Program(const ProgramDescription& description, GLenum binaryFormat,
+        const void* binary, GLsizei length) {
+    mInitialized = false;
+    mHasColorUniform = false;
+    mHasSampler = false;
+    mUse = false;
+    mHasProjection = false;
+    mHasTransform = false;
+
+    // Programs loaded from a binary do not own any shader
+    mVertexShader = 0;
+    mFragmentShader = 0;
+
+    mProgramId = glCreateProgram();
+    bindAttribs(description);
+
+    ATRACE_BEGIN("loadProgramBinary");
+    glProgramBinaryOES(mProgramId, binaryFormat, binary, length);
+    ATRACE_END();
+
+    GLint status;
+    glGetProgramiv(mProgramId, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        PROGRAM_LOGD("Program binary rejected by the driver");
+        glDeleteProgram(mProgramId);
+    } else {
+        mInitialized = true;
+    }
+
+    if (mInitialized) {
+        transform = addUniform("transform");
+        projection = addUniform("projection");
+    }
+}
+
 Program::~Program() {
     if (mInitialized) {
-        // This would ideally happen after linking the program
-        // but Tegra drivers, especially when perfhud is enabled,
-        // sometimes crash if we do so
-        glDetachShader(mProgramId, mVertexShader);
-        glDetachShader(mProgramId, mFragmentShader);
+        if (mVertexShader) {
+            // This would ideally happen after linking the program
+            // but Tegra drivers, especially when perfhud is enabled,
+            // sometimes crash if we do so
+            glDetachShader(mProgramId, mVertexShader);
+            glDetachShader(mProgramId, mFragmentShader);
 
-        glDeleteShader(mVertexShader);
-        glDeleteShader(mFragmentShader);
+            glDeleteShader(mVertexShader);
+            glDeleteShader(mFragmentShader);
+        }
 
         glDeleteProgram(mProgramId);
     }
 }
 
+uint8_t* Program::getBinary(GLenum* format, GLsizei* length) const {
+    if (!mInitialized) return NULL;
+
+    GLint size = 0;
+    glGetProgramiv(mProgramId, GL_PROGRAM_BINARY_LENGTH_OES, &size);
+    if (size <= 0) return NULL;
+
+    // Left untouched if the call fails
+    *length = 0;
+    uint8_t* binary = new uint8_t[size];
+    glGetProgramBinaryOES(mProgramId, size, length, format, binary);
+    if (*length <= 0) {
+        delete[] binary;
+        return NULL;
+    }
+
+    return binary;
+}
+
+void Program::bindAttribs(const ProgramDescription& description) {
+    position = bindAttrib("position", kBindingPosition);
+    if (description.hasTexture || description.hasExternalTexture) {
+        texCoords = bindAttrib("texCoords", kBindingTexCoords);
+    } else {
+        texCoords = -1;
+    }
+}
+
 int Program::addAttrib(const char* name) {
     int slot = glGetAttribLocation(mProgramId, name);
     mAttributes.add(name, slot);
@@ -161,9 +223,11 @@ GLuint Program::buildShader(const char* source, GLenum type) {
     return shader;
 }
 
-void Program::set(const mat4& projectionMatrix, const mat4& modelViewMatrix,
+uint32_t Program::set(const mat4& projectionMatrix, const mat4& modelViewMatrix,
         const mat4& transformMatrix, bool offset) {
-    if (projectionMatrix != mProjection) {
+    uint32_t uploaded = 0;
+
+    if (!mHasProjection || projectionMatrix != mProjection || offset != mProjectionOffset) {
         if (CC_LIKELY(!offset)) {
             glUniformMatrix4fv(projection, 1, GL_FALSE, &projectionMatrix.data[0]);
         } else {
@@ -177,19 +241,36 @@ void Program::set(const mat4& projectionMatrix, const mat4& modelViewMatrix,
             glUniformMatrix4fv(projection, 1, GL_FALSE, &p.data[0]);
         }
         mProjection = projectionMatrix;
+        mProjectionOffset = offset;
+        mHasProjection = true;
+        uploaded++;
     }
 
     mat4 t(transformMatrix);
     t.multiply(modelViewMatrix);
-    glUniformMatrix4fv(transform, 1, GL_FALSE, &t.data[0]);
+    if (!mHasTransform || t != mTransform) {
+        glUniformMatrix4fv(transform, 1, GL_FALSE, &t.data[0]);
+        mTransform = t;
+        mHasTransform = true;
+        uploaded++;
+    }
+
+    return uploaded;
 }
 
-void Program::setColor(const float r, const float g, const float b, const float a) {
+bool Program::setColor(const float r, const float g, const float b, const float a) {
     if (!mHasColorUniform) {
         mColorUniform = getUniform("color");
         mHasColorUniform = true;
+    } else if (r == mColor[0] && g == mColor[1] && b == mColor[2] && a == mColor[3]) {
+        return false;
     }
     glUniform4f(mColorUniform, r, g, b, a);
+    mColor[0] = r;
+    mColor[1] = g;
+    mColor[2] = b;
+    mColor[3] = a;
+    return true;
 }
 
 void Program::use() {
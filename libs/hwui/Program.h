@@ -85,6 +85,10 @@ namespace uirenderer {
 #define PROGRAM_HAS_DEBUG_HIGHLIGHT 42
 #define PROGRAM_EMULATE_STENCIL 43
 
+#define PROGRAM_HAS_DISTANCE_FIELD 44
+
+#define PROGRAM_HAS_GRADIENT_MID_STOP 45
+
 ///////////////////////////////////////////////////////////////////////////////
 // Types
 ///////////////////////////////////////////////////////////////////////////////
@@ -138,7 +142,10 @@ struct ProgramDescription {
 
     bool hasGradient;
     Gradient gradientType;
+    // Simple gradients are evaluated from uniforms instead of a texture
     bool isSimpleGradient;
+    // Simple gradient with 3 color stops
+    bool hasGradientMidStop;
 
     SkXfermode::Mode shadersMode;
 
@@ -161,6 +168,10 @@ struct ProgramDescription {
     bool hasDebugHighlight;
     bool emulateStencil;
 
+    // The alpha8 texture holds a signed distance field,
+    // requires hasAlpha8Texture
+    bool hasDistanceField;
+
     /**
      * Resets this description. All fields are reset back to the default
      * values they hold after building a new instance.
@@ -183,6 +194,7 @@ struct ProgramDescription {
         hasGradient = false;
         gradientType = kGradientLinear;
         isSimpleGradient = false;
+        hasGradientMidStop = false;
 
         shadersMode = SkXfermode::kClear_Mode;
 
@@ -200,6 +212,8 @@ struct ProgramDescription {
         gamma = 2.2f;
 
         hasDebugHighlight = false;
+
+        hasDistanceField = false;
     }
 
     /**
@@ -269,6 +283,8 @@ struct ProgramDescription {
         if (hasColors) key |= programid(0x1) << PROGRAM_HAS_COLORS;
         if (hasDebugHighlight) key |= programid(0x1) << PROGRAM_HAS_DEBUG_HIGHLIGHT;
         if (emulateStencil) key |= programid(0x1) << PROGRAM_EMULATE_STENCIL;
+        if (hasDistanceField) key |= programid(0x1) << PROGRAM_HAS_DISTANCE_FIELD;
+        if (hasGradientMidStop) key |= programid(0x1) << PROGRAM_HAS_GRADIENT_MID_STOP;
         return key;
     }
 
@@ -314,8 +330,25 @@ public:
      * shaders sources.
      */
     Program(const ProgramDescription& description, const char* vertex, const char* fragment);
+
+    /**
+     * Creates a new program from a binary previously returned by
+     * getBinary(). The program is not initialized if the driver
+     * rejects the binary.
+     */
+    Program(const ProgramDescription& description, GLenum binaryFormat,
+            const void* binary, GLsizei length);
+
     virtual ~Program();
 
+    /**
+     * Returns the binary representation of this linked program, as
+     * returned by glGetProgramBinaryOES. The caller is responsible
+     * for deleting the returned array. Returns NULL if the binary
+     * cannot be retrieved.
+     */
+    uint8_t* getBinary(GLenum* format, GLsizei* length) const;
+
     /**
      * Binds this program to the GL context.
      */
@@ -354,15 +387,18 @@ public:
 
     /**
      * Binds the program with the specified projection, modelView and
-     * transform matrices.
+     * transform matrices. Uniforms keep their values while the program
+     * is not in use, matrices equal to the last ones are not uploaded
+     * again. Returns the number of matrices uploaded, out of two.
      */
-    void set(const mat4& projectionMatrix, const mat4& modelViewMatrix,
+    uint32_t set(const mat4& projectionMatrix, const mat4& modelViewMatrix,
              const mat4& transformMatrix, bool offset = false);
 
     /**
-     * Sets the color associated with this shader.
+     * Sets the color associated with this shader. Returns false if the
+     * color was already set.
      */
-    void setColor(const float r, const float g, const float b, const float a);
+    bool setColor(const float r, const float g, const float b, const float a);
 
     /**
      * Name of the position attribute.
@@ -405,6 +441,11 @@ protected:
     int addUniform(const char* name);
 
 private:
+    /**
+     * Binds the attributes required by the specified description.
+     */
+    void bindAttribs(const ProgramDescription& description);
+
     /**
      * Compiles the specified shader of the specified type.
      *
@@ -430,7 +471,13 @@ private:
 
     bool mHasSampler;
 
+    // Last values of the uniforms, to skip redundant uploads
+    bool mHasProjection;
+    bool mProjectionOffset;
     mat4 mProjection;
+    bool mHasTransform;
+    mat4 mTransform;
+    float mColor[4];
 }; // class Program
 
 }; // namespace uirenderer
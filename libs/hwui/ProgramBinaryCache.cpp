@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <utils/JenkinsHash.h>
+#include <utils/Log.h>
+
+#include "Extensions.h"
+#include "ProgramBinaryCache.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+#define PROGRAM_BINARY_CACHE_MAGIC ('h' << 24 | 'w' << 16 | 'p' << 8 | 'b')
+#define PROGRAM_BINARY_CACHE_VERSION 1
+
+struct ProgramBinaryCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t fingerprint;
+    uint32_t count;
+};
+
+struct ProgramBinaryEntryHeader {
+    programid key;
+    uint32_t sourceHash;
+    uint32_t format;
+    uint32_t size;
+};
+
+String8 ProgramBinaryCache::sFilename;
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors/destructor
+///////////////////////////////////////////////////////////////////////////////
+
+ProgramBinaryCache::ProgramBinaryCache(): mSize(0), mFingerprint(0),
+        mInitialized(false), mEnabled(false), mDirty(false) {
+}
+
+ProgramBinaryCache::~ProgramBinaryCache() {
+    clear();
+}
+
+void ProgramBinaryCache::setFilename(const char* filename) {
+    sFilename.setTo(filename);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Initialization
+///////////////////////////////////////////////////////////////////////////////
+
+void ProgramBinaryCache::init() {
+    if (mInitialized) return;
+    mInitialized = true;
+
+    if (sFilename.isEmpty() || !Extensions::getInstance().hasProgramBinary()) {
+        return;
+    }
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formats);
+    if (formats <= 0) {
+        return;
+    }
+
+    mEnabled = true;
+    mFingerprint = computeFingerprint();
+    load();
+}
+
+uint32_t ProgramBinaryCache::computeFingerprint() const {
+    const GLenum names[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+
+    uint32_t hash = 0;
+    for (size_t i = 0; i < sizeof(names) / sizeof(GLenum); i++) {
+        const char* value = (const char*) glGetString(names[i]);
+        if (value) {
+            hash = JenkinsHashMixBytes(hash, (const uint8_t*) value, strlen(value));
+        }
+    }
+    return JenkinsHashWhiten(hash);
+}
+
+void ProgramBinaryCache::load() {
+    FILE* file = fopen(sFilename.string(), "rb");
+    if (!file) return;
+
+    ProgramBinaryCacheHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+            header.magic != PROGRAM_BINARY_CACHE_MAGIC ||
+            header.version != PROGRAM_BINARY_CACHE_VERSION ||
+            header.fingerprint != mFingerprint) {
+        // The binaries were produced by another driver or are corrupted,
+        // they will be replaced on the next flush
+        PROGRAM_LOGD("Discarding program binary cache %s", sFilename.string());
+        fclose(file);
+        mDirty = true;
+        return;
+    }
+
+    for (uint32_t i = 0; i < header.count; i++) {
+        ProgramBinaryEntryHeader entry;
+        if (fread(&entry, sizeof(entry), 1, file) != 1) break;
+
+        // A key stored twice keeps its last binary, as in put()
+        ssize_t index = mEntries.indexOfKey(entry.key);
+        if (index >= 0) {
+            Entry* previous = mEntries.valueAt(index);
+            mSize -= previous->size;
+            delete previous;
+            mEntries.removeItemsAt(index);
+        }
+
+        // mSize never exceeds the maximum, comparing against what is left
+        // can't overflow like mSize + entry.size can
+        if (entry.size > PROGRAM_BINARY_CACHE_MAX_SIZE - mSize) break;
+
+        uint8_t* data = new uint8_t[entry.size];
+        if (fread(data, entry.size, 1, file) != 1) {
+            delete[] data;
+            break;
+        }
+
+        mEntries.add(entry.key, new Entry(entry.sourceHash, entry.format, data, entry.size));
+        mSize += entry.size;
+    }
+
+    PROGRAM_LOGD("Loaded %d program binaries (%d bytes)", mEntries.size(), mSize);
+
+    fclose(file);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Cache management
+///////////////////////////////////////////////////////////////////////////////
+
+Program* ProgramBinaryCache::get(const ProgramDescription& description, programid key,
+        uint32_t sourceHash) {
+    init();
+    if (!mEnabled) return NULL;
+
+    ssize_t index = mEntries.indexOfKey(key);
+    if (index < 0) return NULL;
+
+    Entry* entry = mEntries.valueAt(index);
+    if (entry->sourceHash != sourceHash) return NULL;
+
+    Program* program = new Program(description, entry->format, entry->data, entry->size);
+    if (!program->isInitialized()) {
+        // The driver rejected the binary, it will be replaced
+        // after the program is compiled from its sources
+        delete program;
+        return NULL;
+    }
+
+    return program;
+}
+
+void ProgramBinaryCache::put(Program* program, programid key, uint32_t sourceHash) {
+    init();
+    if (!mEnabled || !program->isInitialized()) return;
+
+    GLenum format;
+    GLsizei size;
+    uint8_t* data = program->getBinary(&format, &size);
+    if (!data) return;
+
+    ssize_t index = mEntries.indexOfKey(key);
+    if (index >= 0) {
+        Entry* entry = mEntries.valueAt(index);
+        mSize -= entry->size;
+        delete entry;
+        mEntries.removeItemsAt(index);
+    }
+
+    if (uint32_t(size) > PROGRAM_BINARY_CACHE_MAX_SIZE - mSize) {
+        delete[] data;
+        return;
+    }
+
+    mEntries.add(key, new Entry(sourceHash, format, data, size));
+    mSize += size;
+    mDirty = true;
+}
+
+void ProgramBinaryCache::flush() {
+    if (!mEnabled || !mDirty) return;
+
+    // Write to a temporary file first to never leave a partially
+    // written cache behind
+    String8 tempFilename(sFilename);
+    tempFilename.append(".tmp");
+
+    FILE* file = fopen(tempFilename.string(), "wb");
+    if (!file) {
+        ALOGW("Could not open program binary cache %s", tempFilename.string());
+        return;
+    }
+
+    ProgramBinaryCacheHeader header;
+    header.magic = PROGRAM_BINARY_CACHE_MAGIC;
+    header.version = PROGRAM_BINARY_CACHE_VERSION;
+    header.fingerprint = mFingerprint;
+    header.count = mEntries.size();
+
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (size_t i = 0; success && i < mEntries.size(); i++) {
+        const Entry* entry = mEntries.valueAt(i);
+
+        ProgramBinaryEntryHeader entryHeader;
+        entryHeader.key = mEntries.keyAt(i);
+        entryHeader.sourceHash = entry->sourceHash;
+        entryHeader.format = entry->format;
+        entryHeader.size = entry->size;
+
+        success = fwrite(&entryHeader, sizeof(entryHeader), 1, file) == 1 &&
+                fwrite(entry->data, entry->size, 1, file) == 1;
+    }
+
+    success = (fclose(file) == 0) && success;
+    if (!success || rename(tempFilename.string(), sFilename.string()) != 0) {
+        ALOGW("Could not write program binary cache %s", sFilename.string());
+        unlink(tempFilename.string());
+        return;
+    }
+
+    mDirty = false;
+}
+
+void ProgramBinaryCache::clear() {
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        delete mEntries.valueAt(i);
+    }
+    mEntries.clear();
+    mSize = 0;
+
+    // The cache will be reloaded with the next GL context
+    mInitialized = false;
+    mEnabled = false;
+    mDirty = false;
+}
+
+}; // namespace uirenderer
+}; // namespace android
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_PROGRAM_BINARY_CACHE_H
+#define ANDROID_HWUI_PROGRAM_BINARY_CACHE_H
+
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+
+#include <GLES2/gl2.h>
+
+#include "Program.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Maximum size, in bytes, of the binaries stored on disk
+#define PROGRAM_BINARY_CACHE_MAX_SIZE (2 * 1024 * 1024)
+
+///////////////////////////////////////////////////////////////////////////////
+// Cache
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Persists linked program binaries, as returned by glGetProgramBinaryOES,
+ * across processes and GL contexts. Binaries are keyed by program
+ * description and by a hash of the shaders sources. The whole cache is
+ * discarded when the GPU driver fingerprint (vendor, renderer and version
+ * strings) changes.
+ */
+class ProgramBinaryCache {
+public:
+    ProgramBinaryCache();
+    ~ProgramBinaryCache();
+
+    /**
+     * Sets the path of the file used to persist the cache. This method
+     * must be called before the first GL context is initialized, the
+     * cache is disabled otherwise.
+     */
+    static void setFilename(const char* filename);
+
+    /**
+     * Creates a program from a cached binary. Returns NULL if no binary
+     * is cached for the specified key and sources or if the binary was
+     * rejected by the driver.
+     */
+    Program* get(const ProgramDescription& description, programid key, uint32_t sourceHash);
+
+    /**
+     * Stores the binary of the specified program. The binary is written
+     * to disk on the next call to flush().
+     */
+    void put(Program* program, programid key, uint32_t sourceHash);
+
+    /**
+     * Writes the cache to disk if it was modified.
+     */
+    void flush();
+
+    /**
+     * Releases the binaries held in memory.
+     */
+    void clear();
+
+private:
+    struct Entry {
+        Entry(uint32_t sourceHash, GLenum format, uint8_t* data, uint32_t size):
+                sourceHash(sourceHash), format(format), data(data), size(size) {
+        }
+
+        ~Entry() {
+            delete[] data;
+        }
+
+        uint32_t sourceHash;
+        GLenum format;
+        uint8_t* data;
+        uint32_t size;
+    };
+
+    /**
+     * Reads the cache file if needed. Must be called with a GL context.
+     */
+    void init();
+
+    void load();
+    uint32_t computeFingerprint() const;
+
+    KeyedVector<programid, Entry*> mEntries;
+    uint32_t mSize;
+
+    uint32_t mFingerprint;
+    bool mInitialized;
+    bool mEnabled;
+    bool mDirty;
+
+    static String8 sFilename;
+}; // class ProgramBinaryCache
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_PROGRAM_BINARY_CACHE_H
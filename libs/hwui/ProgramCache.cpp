@@ -16,6 +16,7 @@
 
 #define LOG_TAG "OpenGLRenderer"
 
+#include <utils/JenkinsHash.h>
 #include <utils/String8.h>
 
 #include "Caches.h"
@@ -139,12 +140,30 @@ const char* gFS_Uniforms_ExternalTextureSampler =
         "uniform samplerExternalOES baseSampler;\n";
 const char* gFS_Uniforms_Dither =
         "uniform sampler2D ditherSampler;";
-const char* gFS_Uniforms_GradientSampler[2] = {
+const char* gFS_Uniforms_GradientSampler[3] = {
         "%s\n"
         "uniform sampler2D gradientSampler;\n",
+        // The stops hold the position of a color and the inverse of the
+        // distance to the next color, for each pair of consecutive colors
         "%s\n"
         "uniform vec4 startColor;\n"
         "uniform vec4 endColor;\n"
+        "uniform highp vec4 gradientStops;\n"
+        "\nvec4 gradient(highp float t) {\n"
+        "    return mix(startColor, endColor,\n"
+        "            clamp((t - gradientStops.x) * gradientStops.y, 0.0, 1.0));\n"
+        "}\n",
+        "%s\n"
+        "uniform vec4 startColor;\n"
+        "uniform vec4 midColor;\n"
+        "uniform vec4 endColor;\n"
+        "uniform highp vec4 gradientStops;\n"
+        "\nvec4 gradient(highp float t) {\n"
+        "    vec4 color = mix(startColor, midColor,\n"
+        "            clamp((t - gradientStops.x) * gradientStops.y, 0.0, 1.0));\n"
+        "    return mix(color, endColor,\n"
+        "            clamp((t - gradientStops.z) * gradientStops.w, 0.0, 1.0));\n"
+        "}\n"
 };
 const char* gFS_Uniforms_BitmapSampler =
         "uniform sampler2D bitmapSampler;\n";
@@ -162,6 +181,8 @@ const char* gFS_Uniforms_ColorOp[4] = {
 };
 const char* gFS_Uniforms_Gamma =
         "uniform float gamma;\n";
+const char* gFS_Uniforms_DistanceField =
+        "uniform float distanceFieldSmoothing;\n";
 
 const char* gFS_Main =
         "\nvoid main(void) {\n"
@@ -205,12 +226,22 @@ const char* gFS_Fast_SingleModulateA8Texture_ApplyGamma =
         "\nvoid main(void) {\n"
         "    gl_FragColor = color * pow(texture2D(baseSampler, outTexCoords).a, gamma);\n"
         "}\n\n";
+const char* gFS_Fast_SingleA8Texture_DistanceField =
+        "\nvoid main(void) {\n"
+        "    gl_FragColor = vec4(0.0, 0.0, 0.0, smoothstep(0.5 - distanceFieldSmoothing,\n"
+        "            0.5 + distanceFieldSmoothing, texture2D(baseSampler, outTexCoords).a));\n"
+        "}\n\n";
+const char* gFS_Fast_SingleModulateA8Texture_DistanceField =
+        "\nvoid main(void) {\n"
+        "    gl_FragColor = color * smoothstep(0.5 - distanceFieldSmoothing,\n"
+        "            0.5 + distanceFieldSmoothing, texture2D(baseSampler, outTexCoords).a);\n"
+        "}\n\n";
 const char* gFS_Fast_SingleGradient[2] = {
         "\nvoid main(void) {\n"
         "    gl_FragColor = %s + texture2D(gradientSampler, linear);\n"
         "}\n\n",
         "\nvoid main(void) {\n"
-        "    gl_FragColor = %s + mix(startColor, endColor, clamp(linear, 0.0, 1.0));\n"
+        "    gl_FragColor = %s + gradient(linear);\n"
         "}\n\n",
 };
 const char* gFS_Fast_SingleModulateGradient[2] = {
@@ -218,7 +249,7 @@ const char* gFS_Fast_SingleModulateGradient[2] = {
         "    gl_FragColor = %s + color.a * texture2D(gradientSampler, linear);\n"
         "}\n\n",
         "\nvoid main(void) {\n"
-        "    gl_FragColor = %s + color.a * mix(startColor, endColor, clamp(linear, 0.0, 1.0));\n"
+        "    gl_FragColor = %s + color.a * gradient(linear);\n"
         "}\n\n"
 };
 
@@ -244,23 +275,31 @@ const char* gFS_Main_FetchA8Texture[4] = {
         "    fragColor = color * texture2D(baseSampler, outTexCoords).a;\n",
         "    fragColor = color * pow(texture2D(baseSampler, outTexCoords).a, gamma);\n"
 };
+const char* gFS_Main_FetchA8Texture_DistanceField[2] = {
+        // Don't modulate
+        "    fragColor = vec4(0.0, 0.0, 0.0, smoothstep(0.5 - distanceFieldSmoothing,\n"
+        "            0.5 + distanceFieldSmoothing, texture2D(baseSampler, outTexCoords).a));\n",
+        // Modulate
+        "    fragColor = color * smoothstep(0.5 - distanceFieldSmoothing,\n"
+        "            0.5 + distanceFieldSmoothing, texture2D(baseSampler, outTexCoords).a);\n"
+};
 const char* gFS_Main_FetchGradient[6] = {
         // Linear
         "    vec4 gradientColor = texture2D(gradientSampler, linear);\n",
 
-        "    vec4 gradientColor = mix(startColor, endColor, clamp(linear, 0.0, 1.0));\n",
+        "    vec4 gradientColor = gradient(linear);\n",
 
         // Circular
         "    vec4 gradientColor = texture2D(gradientSampler, vec2(length(circular), 0.5));\n",
 
-        "    vec4 gradientColor = mix(startColor, endColor, clamp(length(circular), 0.0, 1.0));\n",
+        "    vec4 gradientColor = gradient(length(circular));\n",
 
         // Sweep
         "    highp float index = atan(sweep.y, sweep.x) * 0.15915494309; // inv(2 * PI)\n"
         "    vec4 gradientColor = texture2D(gradientSampler, vec2(index - floor(index), 0.5));\n",
 
         "    highp float index = atan(sweep.y, sweep.x) * 0.15915494309; // inv(2 * PI)\n"
-        "    vec4 gradientColor = mix(startColor, endColor, clamp(index - floor(index), 0.0, 1.0));\n"
+        "    vec4 gradientColor = gradient(index - floor(index));\n"
 };
 const char* gFS_Main_FetchBitmap =
         "    vec4 bitmapColor = texture2D(bitmapSampler, outBitmapTexCoords);\n";
@@ -409,6 +448,13 @@ void ProgramCache::clear() {
         delete mCache.valueAt(i);
     }
     mCache.clear();
+
+    mBinaryCache.flush();
+    mBinaryCache.clear();
+}
+
+void ProgramCache::flush() {
+    mBinaryCache.flush();
 }
 
 Program* ProgramCache::get(const ProgramDescription& description) {
@@ -439,7 +485,21 @@ Program* ProgramCache::generateProgram(const ProgramDescription& description, pr
     String8 vertexShader = generateVertexShader(description);
     String8 fragmentShader = generateFragmentShader(description);
 
-    return new Program(description, vertexShader.string(), fragmentShader.string());
+    // The sources are part of the key of the binary cache since they
+    // can change with the system while the GPU driver stays the same
+    uint32_t sourceHash = JenkinsHashMixBytes(0,
+            (const uint8_t*) vertexShader.string(), vertexShader.length());
+    sourceHash = JenkinsHashMixBytes(sourceHash,
+            (const uint8_t*) fragmentShader.string(), fragmentShader.length());
+    sourceHash = JenkinsHashWhiten(sourceHash);
+
+    Program* program = mBinaryCache.get(description, key, sourceHash);
+    if (!program) {
+        program = new Program(description, vertexShader.string(), fragmentShader.string());
+        mBinaryCache.put(program, key, sourceHash);
+    }
+
+    return program;
 }
 
 static inline size_t gradientIndex(const ProgramDescription& description) {
@@ -569,12 +629,16 @@ String8 ProgramCache::generateFragmentShader(const ProgramDescription& descripti
         shader.append(gFS_Uniforms_ExternalTextureSampler);
     }
     if (description.hasGradient) {
-        shader.appendFormat(gFS_Uniforms_GradientSampler[description.isSimpleGradient],
-                gFS_Uniforms_Dither);
+        const int index = description.isSimpleGradient ?
+                1 + description.hasGradientMidStop : 0;
+        shader.appendFormat(gFS_Uniforms_GradientSampler[index], gFS_Uniforms_Dither);
     }
     if (description.hasGammaCorrection) {
         shader.append(gFS_Uniforms_Gamma);
     }
+    if (description.hasDistanceField) {
+        shader.append(gFS_Uniforms_DistanceField);
+    }
 
     // Optimization for common cases
     if (!description.isAA && !blendFramebuffer && !description.hasColors &&
@@ -602,7 +666,13 @@ String8 ProgramCache::generateFragmentShader(const ProgramDescription& descripti
             }
             fast = true;
         } else if (singleA8Texture) {
-            if (!description.modulate) {
+            if (description.hasDistanceField) {
+                if (!description.modulate) {
+                    shader.append(gFS_Fast_SingleA8Texture_DistanceField);
+                } else {
+                    shader.append(gFS_Fast_SingleModulateA8Texture_DistanceField);
+                }
+            } else if (!description.modulate) {
                 if (description.hasGammaCorrection) {
                     shader.append(gFS_Fast_SingleA8Texture_ApplyGamma);
                 } else {
@@ -666,8 +736,12 @@ String8 ProgramCache::generateFragmentShader(const ProgramDescription& descripti
         if (description.hasTexture || description.hasExternalTexture) {
             if (description.hasAlpha8Texture) {
                 if (!description.hasGradient && !description.hasBitmap) {
-                    shader.append(gFS_Main_FetchA8Texture[modulateOp * 2 +
-                                                          description.hasGammaCorrection]);
+                    if (description.hasDistanceField) {
+                        shader.append(gFS_Main_FetchA8Texture_DistanceField[modulateOp]);
+                    } else {
+                        shader.append(gFS_Main_FetchA8Texture[modulateOp * 2 +
+                                                              description.hasGammaCorrection]);
+                    }
                 }
             } else {
                 shader.append(gFS_Main_FetchTexture[modulateOp]);
@@ -25,6 +25,7 @@
 
 #include "Debug.h"
 #include "Program.h"
+#include "ProgramBinaryCache.h"
 #include "Properties.h"
 
 namespace android {
@@ -47,6 +48,12 @@ public:
 
     void clear();
 
+    /**
+     * Writes the binaries of the programs generated since the
+     * last flush to disk.
+     */
+    void flush();
+
 private:
     Program* generateProgram(const ProgramDescription& description, programid key);
     String8 generateVertexShader(const ProgramDescription& description);
@@ -57,6 +64,7 @@ private:
     void printLongString(const String8& shader) const;
 
     KeyedVector<programid, Program*> mCache;
+    ProgramBinaryCache mBinaryCache;
 
     const bool mHasES3;
 }; // class ProgramCache
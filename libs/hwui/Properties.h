@@ -38,6 +38,10 @@
 // Textures used by layers must have dimensions multiples of this number
 #define LAYER_SIZE 64
 
+// A cached layer can be reused for a smaller request as long as its area
+// is no larger than the area of the request multiplied by this factor
+#define LAYER_REUSE_MAX_AREA_RATIO 2.0f
+
 // Defines the size in bits of the stencil buffer for the framebuffer
 // Note: Only 1 bit is required for clipping but more bits are required
 // to properly implement overdraw debugging
@@ -115,6 +119,30 @@ enum DebugLevel {
  */
 #define PROPERTY_DISABLE_DRAW_REORDER "debug.hwui.disable_draw_reorder"
 
+/**
+ * Used to keep the deferred draw operations of display lists whose content,
+ * properties and drawing state do not change from one frame to the next,
+ * instead of deferring them again every frame. The accepted values are
+ * "true" and "false". The default value is "false".
+ * Has no effect if PROPERTY_DISABLE_DRAW_DEFER is set to "true"
+ */
+#define PROPERTY_ENABLE_DEFER_CACHE "debug.hwui.enable_defer_cache"
+
+/**
+ * Path of a file to write the next frame's display list tree to, see
+ * DisplayListCapture. A frame is captured every time the property is
+ * set to a new path and the properties are reloaded.
+ */
+#define PROPERTY_CAPTURE_FRAME "debug.hwui.capture_frame"
+
+/**
+ * Used to measure the GPU time spent drawing each batch of operations and
+ * composing each layer, see GpuProfiler. The timings of the last frame are
+ * output by dumpsys gfxinfo. Requires GL_EXT_disjoint_timer_query. The
+ * accepted values are "true" and "false". The default value is "false".
+ */
+#define PROPERTY_PROFILE_GPU "debug.hwui.profile_gpu"
+
 ///////////////////////////////////////////////////////////////////////////////
 // Runtime configuration properties
 ///////////////////////////////////////////////////////////////////////////////
@@ -146,9 +174,13 @@ enum DebugLevel {
 #define PROPERTY_RENDER_BUFFER_CACHE_SIZE "ro.hwui.r_buffer_cache_size"
 #define PROPERTY_GRADIENT_CACHE_SIZE "ro.hwui.gradient_cache_size"
 #define PROPERTY_PATH_CACHE_SIZE "ro.hwui.path_cache_size"
+#define PROPERTY_TESSELLATION_CACHE_SIZE "ro.hwui.tessellation_cache_size"
 #define PROPERTY_PATCH_CACHE_SIZE "ro.hwui.patch_cache_size"
 #define PROPERTY_DROP_SHADOW_CACHE_SIZE "ro.hwui.drop_shadow_cache_size"
 #define PROPERTY_FBO_CACHE_SIZE "ro.hwui.fbo_cache_size"
+// Memory shared by the texture, layer, gradient, path, tessellation and
+// drop shadow caches, in MB. Defaults to the sum of their sizes
+#define PROPERTY_MEMORY_BUDGET "ro.hwui.memory_budget"
 
 // These properties are defined in percentage (range 0..1)
 #define PROPERTY_TEXTURE_CACHE_FLUSH_RATE "ro.hwui.texture_cache_flushrate"
@@ -158,6 +190,12 @@ enum DebugLevel {
 #define PROPERTY_TEXT_SMALL_CACHE_HEIGHT "ro.hwui.text_small_cache_height"
 #define PROPERTY_TEXT_LARGE_CACHE_WIDTH "ro.hwui.text_large_cache_width"
 #define PROPERTY_TEXT_LARGE_CACHE_HEIGHT "ro.hwui.text_large_cache_height"
+// Width and height of the runtime texture atlas, 0 disables the atlas
+#define PROPERTY_TEXTURE_ATLAS_SIZE "ro.hwui.texture_atlas_size"
+
+// Indicates whether large, scaled or rotated text can be rendered using
+// signed distance fields. Accepted values are "true" and "false"
+#define PROPERTY_TEXT_DISTANCE_FIELD "ro.hwui.text_distance_field"
 
 // Indicates whether gamma correction should be applied in the shaders
 // or in lookup tables. Accepted values:
@@ -192,10 +230,12 @@ enum DebugLevel {
 #define DEFAULT_LAYER_CACHE_SIZE 16.0f
 #define DEFAULT_RENDER_BUFFER_CACHE_SIZE 2.0f
 #define DEFAULT_PATH_CACHE_SIZE 10.0f
+#define DEFAULT_TESSELLATION_CACHE_SIZE 1.0f
 #define DEFAULT_PATCH_CACHE_SIZE 128 // in kB
 #define DEFAULT_GRADIENT_CACHE_SIZE 0.5f
 #define DEFAULT_DROP_SHADOW_CACHE_SIZE 2.0f
 #define DEFAULT_FBO_CACHE_SIZE 16
+#define DEFAULT_TEXTURE_ATLAS_SIZE 512 // in pixels
 
 #define DEFAULT_TEXTURE_CACHE_FLUSH_RATE 0.6f
 
@@ -0,0 +1,357 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <EGL/eglext.h>
+
+#include <utils/Log.h>
+
+#include <private/hwui/DrawGlInfo.h>
+
+#include "Caches.h"
+#include "DisplayList.h"
+#include "OpenGLRenderer.h"
+#include "RenderThread.h"
+#include "Stencil.h"
+
+#ifndef EGL_BUFFER_AGE_EXT
+    #define EGL_BUFFER_AGE_EXT 0x313D
+#endif
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Shared context
+///////////////////////////////////////////////////////////////////////////////
+
+// The Caches singleton holds GL names and state of a single context, every
+// render thread of the process uses the same one. A thread holds sEglLock
+// while the context is current, frames of different windows are therefore
+// rendered one at a time
+static Mutex sEglLock;
+static EGLContext sEglContext = EGL_NO_CONTEXT;
+static EGLConfig sEglConfig;
+static int sEglContextRefs = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors/destructor
+///////////////////////////////////////////////////////////////////////////////
+
+RenderThread::RenderThread(): Thread(false),
+        mRequest(kRequestNone), mInitialized(false), mTerminated(false),
+        mSynced(true), mFlushed(true),
+        mSyncStatus(DrawGlInfo::kStatusDone), mFlushStatus(DrawGlInfo::kStatusDone),
+        mDisplayList(NULL), mOpaque(false),
+        mEglDisplay(EGL_NO_DISPLAY), mEglContext(EGL_NO_CONTEXT), mEglSurface(EGL_NO_SURFACE),
+        mBufferPreserved(false), mWidth(0), mHeight(0), mRenderer(NULL) {
+}
+
+RenderThread::~RenderThread() {
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// UI thread
+///////////////////////////////////////////////////////////////////////////////
+
+bool RenderThread::initialize(const sp<ANativeWindow>& window) {
+    Mutex::Autolock _l(mLock);
+    if (mInitialized || mTerminated) return mInitialized;
+
+    if (run("hwuiRenderThread", PRIORITY_URGENT_DISPLAY) != NO_ERROR) {
+        return false;
+    }
+
+    mWindow = window;
+    mRequest = kRequestInitialize;
+    mCondition.broadcast();
+    while (mRequest != kRequestNone) {
+        mCondition.wait(mLock);
+    }
+    return mInitialized;
+}
+
+status_t RenderThread::drawFrame(DisplayList* displayList, const Rect& dirty, bool opaque) {
+    Mutex::Autolock _l(mLock);
+    // Only one frame may be in flight: the previous one must be flushed
+    // and picked up before its parameters are overwritten
+    while (mRequest != kRequestNone || !mFlushed) {
+        mCondition.wait(mLock);
+    }
+    if (!mInitialized) return DrawGlInfo::kStatusDone;
+
+    mDisplayList = displayList;
+    mDirty.set(dirty);
+    mOpaque = opaque;
+    mSynced = false;
+    mFlushed = false;
+    mRequest = kRequestFrame;
+    mCondition.broadcast();
+
+    while (!mSynced) {
+        mCondition.wait(mLock);
+    }
+    return mSyncStatus;
+}
+
+status_t RenderThread::waitForFlush() {
+    Mutex::Autolock _l(mLock);
+    while (!mFlushed) {
+        mCondition.wait(mLock);
+    }
+    return mFlushStatus;
+}
+
+void RenderThread::terminate() {
+    Mutex::Autolock _l(mLock);
+    if (!mInitialized) return;
+
+    while (mRequest != kRequestNone || !mFlushed) {
+        mCondition.wait(mLock);
+    }
+    mRequest = kRequestTerminate;
+    mCondition.broadcast();
+    while (!mTerminated) {
+        mCondition.wait(mLock);
+    }
+    mInitialized = false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Render thread
+///////////////////////////////////////////////////////////////////////////////
+
+bool RenderThread::threadLoop() {
+    Request request;
+    {
+        Mutex::Autolock _l(mLock);
+        while (mRequest == kRequestNone) {
+            mCondition.wait(mLock);
+        }
+        request = mRequest;
+    }
+
+    switch (request) {
+        case kRequestInitialize: {
+            bool initialized = initializeEgl();
+            if (!initialized) {
+                terminateEgl();
+            }
+
+            Mutex::Autolock _l(mLock);
+            mInitialized = initialized;
+            mTerminated = !initialized;
+            mRequest = kRequestNone;
+            mCondition.broadcast();
+            return initialized;
+        }
+        case kRequestFrame:
+            renderFrame();
+            return true;
+        case kRequestTerminate: {
+            terminateEgl();
+
+            Mutex::Autolock _l(mLock);
+            mTerminated = true;
+            mRequest = kRequestNone;
+            mCondition.broadcast();
+            return false;
+        }
+        default:
+            return true;
+    }
+}
+
+bool RenderThread::initializeEgl() {
+    mEglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (mEglDisplay == EGL_NO_DISPLAY || !eglInitialize(mEglDisplay, NULL, NULL)) {
+        ALOGE("RenderThread: could not initialize EGL (%#x)", eglGetError());
+        return false;
+    }
+
+    Mutex::Autolock _l(sEglLock);
+    if (sEglContext == EGL_NO_CONTEXT && !createSharedContext(mEglDisplay)) {
+        return false;
+    }
+    mEglContext = sEglContext;
+    sEglContextRefs++;
+
+    mEglSurface = eglCreateWindowSurface(mEglDisplay, sEglConfig, mWindow.get(), NULL);
+    if (mEglSurface == EGL_NO_SURFACE) {
+        ALOGE("RenderThread: could not create window surface (%#x)", eglGetError());
+        return false;
+    }
+
+    if (!eglMakeCurrent(mEglDisplay, mEglSurface, mEglSurface, mEglContext)) {
+        ALOGE("RenderThread: could not make context current (%#x)", eglGetError());
+        return false;
+    }
+
+    // Without buffer age, partial updates need the back buffer to be preserved
+    if (!Extensions::getInstance().hasBufferAge()) {
+        mBufferPreserved = eglSurfaceAttrib(mEglDisplay, mEglSurface,
+                EGL_SWAP_BEHAVIOR, EGL_BUFFER_PRESERVED);
+    }
+
+    // The Caches singleton is initialized by the first thread only
+    Caches::getInstance().init();
+
+    mRenderer = new OpenGLRenderer();
+    mRenderer->initProperties();
+    mWidth = mHeight = 0;
+
+    eglMakeCurrent(mEglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    return true;
+}
+
+bool RenderThread::createSharedContext(EGLDisplay display) {
+    EGLint configAttribs[] = {
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+            EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+            EGL_RED_SIZE, 8,
+            EGL_GREEN_SIZE, 8,
+            EGL_BLUE_SIZE, 8,
+            EGL_ALPHA_SIZE, 8,
+            EGL_DEPTH_SIZE, 0,
+            EGL_STENCIL_SIZE, (EGLint) Stencil::getStencilSize(),
+            EGL_NONE
+    };
+    EGLint configCount = 0;
+    if (!eglChooseConfig(display, configAttribs, &sEglConfig, 1, &configCount)
+            || configCount != 1) {
+        ALOGE("RenderThread: no suitable EGL config (%#x)", eglGetError());
+        return false;
+    }
+
+    EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+    sEglContext = eglCreateContext(display, sEglConfig, EGL_NO_CONTEXT, contextAttribs);
+    if (sEglContext == EGL_NO_CONTEXT) {
+        ALOGE("RenderThread: could not create EGL context (%#x)", eglGetError());
+        return false;
+    }
+    return true;
+}
+
+void RenderThread::terminateEgl() {
+    if (mEglDisplay != EGL_NO_DISPLAY) {
+        Mutex::Autolock _l(sEglLock);
+        if (mEglContext != EGL_NO_CONTEXT) {
+            // The window surface may not exist if initialization failed
+            const bool current = eglMakeCurrent(mEglDisplay, mEglSurface, mEglSurface,
+                    mEglContext);
+            if (current && mRenderer) {
+                delete mRenderer;
+            }
+            if (--sEglContextRefs == 0) {
+                if (current) {
+                    Caches::getInstance().terminate();
+                }
+                eglMakeCurrent(mEglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+                eglDestroyContext(mEglDisplay, sEglContext);
+                sEglContext = EGL_NO_CONTEXT;
+            }
+            mEglContext = EGL_NO_CONTEXT;
+        }
+        mRenderer = NULL;
+
+        eglMakeCurrent(mEglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (mEglSurface != EGL_NO_SURFACE) {
+            eglDestroySurface(mEglDisplay, mEglSurface);
+            mEglSurface = EGL_NO_SURFACE;
+        }
+        eglReleaseThread();
+    }
+    mWindow.clear();
+}
+
+void RenderThread::renderFrame() {
+    Mutex::Autolock _egl(sEglLock);
+    if (!eglMakeCurrent(mEglDisplay, mEglSurface, mEglSurface, mEglContext)) {
+        ALOGE("RenderThread: could not make context current (%#x)", eglGetError());
+    }
+
+    DisplayList* displayList;
+    Rect dirty;
+    bool opaque;
+    {
+        Mutex::Autolock _l(mLock);
+        displayList = mDisplayList;
+        dirty.set(mDirty);
+        opaque = mOpaque;
+    }
+
+    EGLint width, height;
+    eglQuerySurface(mEglDisplay, mEglSurface, EGL_WIDTH, &width);
+    eglQuerySurface(mEglDisplay, mEglSurface, EGL_HEIGHT, &height);
+    if (width != mWidth || height != mHeight) {
+        mWidth = width;
+        mHeight = height;
+        mRenderer->setViewport(width, height);
+        dirty.set(0.0f, 0.0f, width, height);
+    }
+
+    if (Extensions::getInstance().hasBufferAge()) {
+        EGLint age = 0;
+        eglQuerySurface(mEglDisplay, mEglSurface, EGL_BUFFER_AGE_EXT, &age);
+        mRenderer->setBufferAge(age);
+    } else if (!mBufferPreserved) {
+        dirty.set(0.0f, 0.0f, mWidth, mHeight);
+    }
+
+    status_t status = mRenderer->prepareDirty(dirty.left, dirty.top, dirty.right, dirty.bottom,
+            opaque);
+
+    // Sync phase: the UI thread is blocked until the tree has been deferred
+    DeferredDisplayList* deferredList = NULL;
+    Rect drawDirty;
+    if (CC_UNLIKELY(Caches::getInstance().drawDeferDisabled)) {
+        status |= mRenderer->drawDisplayList(displayList, drawDirty, 0);
+    } else {
+        deferredList = mRenderer->deferDisplayList(displayList, 0);
+    }
+
+    {
+        Mutex::Autolock _l(mLock);
+        mSyncStatus = status;
+        mSynced = true;
+        mRequest = kRequestNone;
+        mCondition.broadcast();
+    }
+
+    status_t flushStatus = DrawGlInfo::kStatusDone;
+    if (deferredList) {
+        flushStatus = mRenderer->flushDeferredDisplayList(deferredList, drawDirty);
+    }
+
+    {
+        Mutex::Autolock _l(mLock);
+        mFlushStatus = flushStatus;
+        mFlushed = true;
+        mCondition.broadcast();
+    }
+
+    mRenderer->finish();
+    if (!eglSwapBuffers(mEglDisplay, mEglSurface)) {
+        ALOGW("RenderThread: eglSwapBuffers failed (%#x)", eglGetError());
+    }
+
+    // Let the render threads of other windows use the context
+    eglMakeCurrent(mEglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+}; // namespace uirenderer
+}; // namespace android
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_RENDER_THREAD_H
+#define ANDROID_HWUI_RENDER_THREAD_H
+
+#include <EGL/egl.h>
+
+#include <system/window.h>
+
+#include <utils/Thread.h>
+
+#include <cutils/compiler.h>
+
+#include "Rect.h"
+
+namespace android {
+namespace uirenderer {
+
+class DisplayList;
+class OpenGLRenderer;
+
+/**
+ * Replays display lists on a dedicated thread that owns the EGL context,
+ * so that the UI thread can record the next frame while the GPU commands
+ * of the current one are issued and the buffer is swapped.
+ *
+ * A frame is handed over in two phases. drawFrame() blocks the UI thread
+ * while the render thread defers the display list tree, which copies out
+ * everything the frame needs; the UI thread then resumes while the render
+ * thread flushes the deferred list, calls finish() and swaps. Display lists
+ * are not modified during the flush only as long as the UI thread calls
+ * waitForFlush() before it records again.
+ *
+ * The render threads of a process share one EGL context, to which the
+ * Caches singleton is bound, and render one frame at a time. The first
+ * initialize() must return before any display list is recorded in the
+ * process.
+ */
+class RenderThread: public Thread {
+public:
+    ANDROID_API RenderThread();
+    ANDROID_API virtual ~RenderThread();
+
+    /**
+     * Starts the thread and creates the EGL context, the window surface
+     * and the renderer. Blocks until done; returns false on failure.
+     */
+    ANDROID_API bool initialize(const sp<ANativeWindow>& window);
+
+    /**
+     * Hands the specified display list to the render thread and returns
+     * once it has been deferred, with the status of that phase.
+     */
+    ANDROID_API status_t drawFrame(DisplayList* displayList, const Rect& dirty, bool opaque);
+
+    /**
+     * Blocks until the last frame's GL commands have been issued. Returns
+     * the status of the flush, which has kStatusDraw set when another frame
+     * is needed.
+     */
+    ANDROID_API status_t waitForFlush();
+
+    /**
+     * Destroys the renderer and the EGL objects, then stops the thread.
+     */
+    ANDROID_API void terminate();
+
+private:
+    enum Request {
+        kRequestNone,
+        kRequestInitialize,
+        kRequestFrame,
+        kRequestTerminate
+    };
+
+    virtual bool threadLoop();
+
+    bool initializeEgl();
+    void terminateEgl();
+    static bool createSharedContext(EGLDisplay display);
+    void renderFrame();
+
+    Mutex mLock;
+    Condition mCondition;
+
+    Request mRequest;
+    bool mInitialized;
+    bool mTerminated;
+    bool mSynced;
+    bool mFlushed;
+    status_t mSyncStatus;
+    status_t mFlushStatus;
+
+    DisplayList* mDisplayList;
+    Rect mDirty;
+    bool mOpaque;
+
+    // Only accessed from the render thread once initialized
+    sp<ANativeWindow> mWindow;
+    EGLDisplay mEglDisplay;
+    EGLContext mEglContext;     // the shared context, once referenced
+    EGLSurface mEglSurface;
+    bool mBufferPreserved;
+    int mWidth;
+    int mHeight;
+    OpenGLRenderer* mRenderer;
+}; // class RenderThread
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_RENDER_THREAD_H
@@ -16,6 +16,8 @@
 
 #define LOG_TAG "OpenGLRenderer"
 
+#include <string.h>
+
 #include <SkPixelRef.h>
 #include "ResourceCache.h"
 #include "Caches.h"
@@ -29,23 +31,36 @@ namespace uirenderer {
 
 void ResourceCache::logCache() {
     ALOGD("ResourceCache: cacheReport:");
-    for (size_t i = 0; i < mCache->size(); ++i) {
-        ResourceReference* ref = mCache->valueAt(i);
+    if (!mTable) return;
+    for (size_t i = 0; i < mTable->capacity; ++i) {
+        ResourceReference* ref = mTable->slots[i].ref;
+        if (!ref) continue;
         ALOGD("  ResourceCache: mCache(%d): resource, ref = 0x%p, 0x%p",
-                i, mCache->keyAt(i), mCache->valueAt(i));
+                i, mTable->slots[i].key, ref);
         ALOGD("  ResourceCache: mCache(%d): refCount, recycled, destroyed, type = %d, %d, %d, %d",
                 i, ref->refCount, ref->recycled, ref->destroyed, ref->resourceType);
     }
 }
 
-ResourceCache::ResourceCache() {
-    Mutex::Autolock _l(mLock);
-    mCache = new KeyedVector<void*, ResourceReference*>();
+ResourceCache::ResourceCache(): mTable(NULL), mUsedSlots(0), mLiveReferences(0) {
 }
 
 ResourceCache::~ResourceCache() {
     Mutex::Autolock _l(mLock);
-    delete mCache;
+    if (mTable) {
+        for (size_t i = 0; i < mTable->capacity; i++) {
+            delete mTable->slots[i].ref;
+        }
+        mRetiredTables.add(mTable);
+        mTable = NULL;
+    }
+    for (size_t i = 0; i < mRetiredTables.size(); i++) {
+        delete[] mRetiredTables[i]->slots;
+        delete mRetiredTables[i];
+    }
+    for (size_t i = 0; i < mFreeReferences.size(); i++) {
+        delete mFreeReferences[i];
+    }
 }
 
 void ResourceCache::lock() {
@@ -56,7 +71,208 @@ void ResourceCache::unlock() {
     mLock.unlock();
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Lock-free references
+///////////////////////////////////////////////////////////////////////////////
+
+static inline size_t hashResource(void* resource) {
+    uint32_t h = (uint32_t) (uintptr_t) resource;
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return h;
+}
+
+/**
+ * Returns the reference tracking the specified resource, or NULL. Can be
+ * called without holding the lock, in which case the result is only a hint:
+ * a concurrent update of the table may hide a reference, or the returned
+ * reference may have been released or reused for another resource since.
+ */
+ResourceReference* ResourceCache::findReference(void* resource) const {
+    Table* table = __atomic_load_n(&mTable, __ATOMIC_ACQUIRE);
+    if (!table) return NULL;
+
+    const size_t mask = table->capacity - 1;
+    size_t index = hashResource(resource) & mask;
+    for (size_t i = 0; i < table->capacity; i++) {
+        Slot& slot = table->slots[index];
+        void* key = __atomic_load_n(&slot.key, __ATOMIC_ACQUIRE);
+        if (key == resource) {
+            return __atomic_load_n(&slot.ref, __ATOMIC_ACQUIRE);
+        }
+        if (key == NULL) break;
+        index = (index + 1) & mask;
+    }
+    return NULL;
+}
+
+/**
+ * Takes a reference on a resource that is already tracked, without the lock.
+ * Returns false if the lock must be taken instead.
+ */
+bool ResourceCache::tryIncrementRefcount(void* resource) {
+    ResourceReference* ref = findReference(resource);
+    if (!ref) return false;
+
+    // A count of 0 means the reference is being created or was released
+    int32_t count = __atomic_load_n(&ref->refCount, __ATOMIC_RELAXED);
+    do {
+        if (count <= 0) return false;
+    } while (!__atomic_compare_exchange_n(&ref->refCount, &count, count + 1, true,
+            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    // The reference may have been released and reused for another resource
+    // between the lookup and the increment, in which case the count we took
+    // belongs to that resource and must be given back
+    if (CC_UNLIKELY(__atomic_load_n(&ref->resource, __ATOMIC_ACQUIRE) != resource)) {
+        Mutex::Autolock _l(mLock);
+        decrementReferenceLocked(ref);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Drops a reference without the lock, unless it is the last one, which may
+ * require the resource to be deleted. Returns false if the lock must be taken.
+ */
+bool ResourceCache::tryDecrementRefcount(void* resource) {
+    ResourceReference* ref = findReference(resource);
+    // The caller holds a reference: if this is the reference tracking the
+    // resource, it cannot be released or reused concurrently
+    if (!ref || __atomic_load_n(&ref->resource, __ATOMIC_ACQUIRE) != resource) return false;
+
+    int32_t count = __atomic_load_n(&ref->refCount, __ATOMIC_RELAXED);
+    while (count > 1) {
+        if (__atomic_compare_exchange_n(&ref->refCount, &count, count - 1, true,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ResourceCache::decrementReferenceLocked(ResourceReference* ref) {
+    if (__atomic_sub_fetch(&ref->refCount, 1, __ATOMIC_ACQ_REL) == 0) {
+        deleteResourceReferenceLocked(ref->resource, ref);
+    }
+}
+
+void ResourceCache::insertReferenceLocked(void* resource, ResourceReference* ref) {
+    if (!mTable || (mUsedSlots + 1) * 4 > mTable->capacity * 3) {
+        rehashLocked();
+    }
+
+    const size_t mask = mTable->capacity - 1;
+    size_t index = hashResource(resource) & mask;
+    Slot* released = NULL;
+    while (mTable->slots[index].key != NULL) {
+        Slot& slot = mTable->slots[index];
+        if (slot.key == resource) {
+            __atomic_store_n(&slot.ref, ref, __ATOMIC_RELEASE);
+            mLiveReferences++;
+            return;
+        }
+        if (!released && slot.ref == NULL) {
+            released = &slot;
+        }
+        index = (index + 1) & mask;
+    }
+
+    if (released) {
+        // A reader may briefly pair the old key with the new reference,
+        // which tryIncrementRefcount() and tryDecrementRefcount() detect
+        __atomic_store_n(&released->key, resource, __ATOMIC_RELEASE);
+        __atomic_store_n(&released->ref, ref, __ATOMIC_RELEASE);
+    } else {
+        Slot& slot = mTable->slots[index];
+        __atomic_store_n(&slot.ref, ref, __ATOMIC_RELAXED);
+        __atomic_store_n(&slot.key, resource, __ATOMIC_RELEASE);
+        mUsedSlots++;
+    }
+    mLiveReferences++;
+}
+
+void ResourceCache::removeReferenceLocked(void* resource) {
+    const size_t mask = mTable->capacity - 1;
+    size_t index = hashResource(resource) & mask;
+    while (mTable->slots[index].key != NULL) {
+        Slot& slot = mTable->slots[index];
+        if (slot.key == resource) {
+            __atomic_store_n(&slot.ref, (ResourceReference*) NULL, __ATOMIC_RELEASE);
+            mLiveReferences--;
+            return;
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+/**
+ * Drops the keys of released references. The table is rebuilt in place,
+ * readers that miss an entry in the meantime fall back to the lock, unless it
+ * must grow: the old table is then kept until the cache is destroyed as it
+ * may still be read. Since tables only grow, they at most double the memory
+ * used by the largest one.
+ */
+void ResourceCache::rehashLocked() {
+    size_t capacity = kMinCapacity;
+    while (capacity < (mLiveReferences + 1) * 2) {
+        capacity *= 2;
+    }
+
+    Vector<Slot> live;
+    if (mTable) {
+        live.setCapacity(mLiveReferences);
+        for (size_t i = 0; i < mTable->capacity; i++) {
+            if (mTable->slots[i].ref) live.add(mTable->slots[i]);
+        }
+    }
+
+    Table* table = mTable;
+    if (!table || capacity > table->capacity) {
+        table = new Table;
+        table->capacity = capacity;
+        table->slots = new Slot[capacity];
+        memset(table->slots, 0, capacity * sizeof(Slot));
+    } else {
+        for (size_t i = 0; i < table->capacity; i++) {
+            __atomic_store_n(&table->slots[i].key, (void*) NULL, __ATOMIC_RELEASE);
+        }
+    }
+
+    const size_t mask = table->capacity - 1;
+    for (size_t i = 0; i < live.size(); i++) {
+        size_t index = hashResource(live[i].key) & mask;
+        while (table->slots[index].key != NULL) {
+            index = (index + 1) & mask;
+        }
+        __atomic_store_n(&table->slots[index].ref, live[i].ref, __ATOMIC_RELAXED);
+        __atomic_store_n(&table->slots[index].key, live[i].key, __ATOMIC_RELEASE);
+    }
+
+    if (table != mTable) {
+        if (mTable) mRetiredTables.add(mTable);
+        __atomic_store_n(&mTable, table, __ATOMIC_RELEASE);
+    } else {
+        // Slots that were not refilled still hold a released reference
+        for (size_t i = 0; i < table->capacity; i++) {
+            if (table->slots[i].key == NULL) {
+                __atomic_store_n(&table->slots[i].ref, (ResourceReference*) NULL,
+                        __ATOMIC_RELAXED);
+            }
+        }
+    }
+    mUsedSlots = live.size();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Reference counting
+///////////////////////////////////////////////////////////////////////////////
+
 void ResourceCache::incrementRefcount(void* resource, ResourceType resourceType) {
+    if (tryIncrementRefcount(resource)) return;
+
     Mutex::Autolock _l(mLock);
     incrementRefcountLocked(resource, resourceType);
 }
@@ -90,13 +306,22 @@ void ResourceCache::incrementRefcount(Layer* layerResource) {
 }
 
 void ResourceCache::incrementRefcountLocked(void* resource, ResourceType resourceType) {
-    ssize_t index = mCache->indexOfKey(resource);
-    ResourceReference* ref = index >= 0 ? mCache->valueAt(index) : NULL;
-    if (ref == NULL || mCache->size() == 0) {
-        ref = new ResourceReference(resourceType);
-        mCache->add(resource, ref);
+    ResourceReference* ref = findReference(resource);
+    if (ref == NULL) {
+        if (mFreeReferences.isEmpty()) {
+            ref = new ResourceReference(resourceType);
+        } else {
+            ref = mFreeReferences.top();
+            mFreeReferences.pop();
+            ref->recycled = false;
+            ref->destroyed = false;
+            ref->resourceType = resourceType;
+        }
+        __atomic_store_n(&ref->resource, resource, __ATOMIC_RELAXED);
+        insertReferenceLocked(resource, ref);
     }
-    ref->refCount++;
+    // Publishes the reference's resource to tryIncrementRefcount()
+    __atomic_add_fetch(&ref->refCount, 1, __ATOMIC_RELEASE);
 }
 
 void ResourceCache::incrementRefcountLocked(SkBitmap* bitmapResource) {
@@ -128,6 +353,8 @@ void ResourceCache::incrementRefcountLocked(Layer* layerResource) {
 }
 
 void ResourceCache::decrementRefcount(void* resource) {
+    if (tryDecrementRefcount(resource)) return;
+
     Mutex::Autolock _l(mLock);
     decrementRefcountLocked(resource);
 }
@@ -161,16 +388,12 @@ void ResourceCache::decrementRefcount(Layer* layerResource) {
 }
 
 void ResourceCache::decrementRefcountLocked(void* resource) {
-    ssize_t index = mCache->indexOfKey(resource);
-    ResourceReference* ref = index >= 0 ? mCache->valueAt(index) : NULL;
+    ResourceReference* ref = findReference(resource);
     if (ref == NULL) {
         // Should not get here - shouldn't get a call to decrement if we're not yet tracking it
         return;
     }
-    ref->refCount--;
-    if (ref->refCount == 0) {
-        deleteResourceReferenceLocked(resource, ref);
-    }
+    decrementReferenceLocked(ref);
 }
 
 void ResourceCache::decrementRefcountLocked(SkBitmap* bitmapResource) {
@@ -207,8 +430,7 @@ void ResourceCache::destructor(SkPath* resource) {
 }
 
 void ResourceCache::destructorLocked(SkPath* resource) {
-    ssize_t index = mCache->indexOfKey(resource);
-    ResourceReference* ref = index >= 0 ? mCache->valueAt(index) : NULL;
+    ResourceReference* ref = findReference(resource);
     if (ref == NULL) {
         // If we're not tracking this resource, just delete it
         if (Caches::hasInstance()) {
@@ -218,7 +440,7 @@ void ResourceCache::destructorLocked(SkPath* resource) {
         return;
     }
     ref->destroyed = true;
-    if (ref->refCount == 0) {
+    if (__atomic_load_n(&ref->refCount, __ATOMIC_ACQUIRE) == 0) {
         deleteResourceReferenceLocked(resource, ref);
     }
 }
@@ -229,8 +451,7 @@ void ResourceCache::destructor(SkBitmap* resource) {
 }
 
 void ResourceCache::destructorLocked(SkBitmap* resource) {
-    ssize_t index = mCache->indexOfKey(resource);
-    ResourceReference* ref = index >= 0 ? mCache->valueAt(index) : NULL;
+    ResourceReference* ref = findReference(resource);
     if (ref == NULL) {
         // If we're not tracking this resource, just delete it
         if (Caches::hasInstance()) {
@@ -240,7 +461,7 @@ void ResourceCache::destructorLocked(SkBitmap* resource) {
         return;
     }
     ref->destroyed = true;
-    if (ref->refCount == 0) {
+    if (__atomic_load_n(&ref->refCount, __ATOMIC_ACQUIRE) == 0) {
         deleteResourceReferenceLocked(resource, ref);
     }
 }
@@ -251,15 +472,14 @@ void ResourceCache::destructor(SkiaShader* resource) {
 }
 
 void ResourceCache::destructorLocked(SkiaShader* resource) {
-    ssize_t index = mCache->indexOfKey(resource);
-    ResourceReference* ref = index >= 0 ? mCache->valueAt(index) : NULL;
+    ResourceReference* ref = findReference(resource);
     if (ref == NULL) {
         // If we're not tracking this resource, just delete it
         delete resource;
         return;
     }
     ref->destroyed = true;
-    if (ref->refCount == 0) {
+    if (__atomic_load_n(&ref->refCount, __ATOMIC_ACQUIRE) == 0) {
         deleteResourceReferenceLocked(resource, ref);
     }
 }
@@ -270,15 +490,14 @@ void ResourceCache::destructor(SkiaColorFilter* resource) {
 }
 
 void ResourceCache::destructorLocked(SkiaColorFilter* resource) {
-    ssize_t index = mCache->indexOfKey(resource);
-    ResourceReference* ref = index >= 0 ? mCache->valueAt(index) : NULL;
+    ResourceReference* ref = findReference(resource);
     if (ref == NULL) {
         // If we're not tracking this resource, just delete it
         delete resource;
         return;
     }
     ref->destroyed = true;
-    if (ref->refCount == 0) {
+    if (__atomic_load_n(&ref->refCount, __ATOMIC_ACQUIRE) == 0) {
         deleteResourceReferenceLocked(resource, ref);
     }
 }
@@ -289,8 +508,7 @@ void ResourceCache::destructor(Res_png_9patch* resource) {
 }
 
 void ResourceCache::destructorLocked(Res_png_9patch* resource) {
-    ssize_t index = mCache->indexOfKey(resource);
-    ResourceReference* ref = index >= 0 ? mCache->valueAt(index) : NULL;
+    ResourceReference* ref = findReference(resource);
     if (ref == NULL) {
         if (Caches::hasInstance()) {
             Caches::getInstance().patchCache.removeDeferred(resource);
@@ -302,7 +520,7 @@ void ResourceCache::destructorLocked(Res_png_9patch* resource) {
         return;
     }
     ref->destroyed = true;
-    if (ref->refCount == 0) {
+    if (__atomic_load_n(&ref->refCount, __ATOMIC_ACQUIRE) == 0) {
         deleteResourceReferenceLocked(resource, ref);
     }
 }
@@ -321,19 +539,14 @@ bool ResourceCache::recycle(SkBitmap* resource) {
  * reaches 0.
  */
 bool ResourceCache::recycleLocked(SkBitmap* resource) {
-    ssize_t index = mCache->indexOfKey(resource);
-    if (index < 0) {
+    ResourceReference* ref = findReference(resource);
+    if (ref == NULL) {
         // not tracking this resource; just recycle the pixel data
         resource->setPixels(NULL, NULL);
         return true;
     }
-    ResourceReference* ref = mCache->valueAt(index);
-    if (ref == NULL) {
-        // Should not get here - shouldn't get a call to recycle if we're not yet tracking it
-        return true;
-    }
     ref->recycled = true;
-    if (ref->refCount == 0) {
+    if (__atomic_load_n(&ref->refCount, __ATOMIC_ACQUIRE) == 0) {
         deleteResourceReferenceLocked(resource, ref);
         return true;
     }
@@ -394,8 +607,10 @@ void ResourceCache::deleteResourceReferenceLocked(void* resource, ResourceRefere
             break;
         }
     }
-    mCache->removeItem(resource);
-    delete ref;
+    removeReferenceLocked(resource);
+    // A lock-free reader may still hold a pointer to the reference
+    __atomic_store_n(&ref->resource, (void*) NULL, __ATOMIC_RELAXED);
+    mFreeReferences.push(ref);
 }
 
 }; // namespace uirenderer
@@ -23,7 +23,8 @@
 #include <SkiaColorFilter.h>
 #include <SkiaShader.h>
 
-#include <utils/KeyedVector.h>
+#include <utils/Mutex.h>
+#include <utils/Vector.h>
 
 #include <androidfw/ResourceTypes.h>
 
@@ -47,17 +48,29 @@ enum ResourceType {
 class ResourceReference {
 public:
 
-    ResourceReference() { refCount = 0; recycled = false; destroyed = false;}
+    ResourceReference() { refCount = 0; recycled = false; destroyed = false; resource = NULL; }
     ResourceReference(ResourceType type) {
-        refCount = 0; recycled = false; destroyed = false; resourceType = type;
+        refCount = 0; recycled = false; destroyed = false; resourceType = type; resource = NULL;
     }
 
-    int refCount;
+    // Only ever modified atomically, the cache updates it without holding its lock
+    volatile int32_t refCount;
     bool recycled;
     bool destroyed;
     ResourceType resourceType;
+    // Resource tracked by this reference; references are reused once released
+    void* resource;
 };
 
+/**
+ * Reference counts the resources used by display lists.
+ *
+ * Taking or dropping a reference on a resource that is already tracked, as
+ * long as it is not the last one, is lock-free: the reference is found in an
+ * open addressing table that can be read while it is modified, and its count
+ * is updated with a compare-and-swap. The lock is only taken to start or stop
+ * tracking a resource, and to destroy or recycle it.
+ */
 class ANDROID_API ResourceCache {
 public:
     ResourceCache();
@@ -114,8 +127,32 @@ public:
     bool recycleLocked(SkBitmap* resource);
 
 private:
+    struct Slot {
+        // Never reset to NULL outside of a rehash: a slot whose reference was
+        // released keeps its key, so that probe sequences are not cut short
+        void* key;
+        ResourceReference* ref;
+    };
+
+    struct Table {
+        size_t capacity;
+        Slot* slots;
+    };
+
+    // Capacity of the table is a power of two
+    static const size_t kMinCapacity = 64;
+
     void deleteResourceReferenceLocked(void* resource, ResourceReference* ref);
 
+    bool tryIncrementRefcount(void* resource);
+    bool tryDecrementRefcount(void* resource);
+    void decrementReferenceLocked(ResourceReference* ref);
+
+    ResourceReference* findReference(void* resource) const;
+    void insertReferenceLocked(void* resource, ResourceReference* ref);
+    void removeReferenceLocked(void* resource);
+    void rehashLocked();
+
     void incrementRefcount(void* resource, ResourceType resourceType);
     void incrementRefcountLocked(void* resource, ResourceType resourceType);
 
@@ -127,11 +164,22 @@ private:
     /**
      * Used to increment, decrement, and destroy. Incrementing is generally accessed on the UI
      * thread, but destroying resources may be called from the GC thread, the finalizer thread,
-     * or a reference queue finalization thread.
+     * or a reference queue finalization thread. Only required to start or stop tracking a
+     * resource, see tryIncrementRefcount() and tryDecrementRefcount().
      */
     mutable Mutex mLock;
 
-    KeyedVector<void*, ResourceReference*>* mCache;
+    // Read without the lock, only replaced when the table grows
+    Table* mTable;
+    // Tables replaced by a larger one, lock-free readers may still be using them
+    Vector<Table*> mRetiredTables;
+    // Slots with a key, whether their reference is live or released
+    size_t mUsedSlots;
+    size_t mLiveReferences;
+
+    // Released references are reused rather than freed, a lock-free reader
+    // may still be looking at them
+    Vector<ResourceReference*> mFreeReferences;
 };
 
 }; // namespace uirenderer
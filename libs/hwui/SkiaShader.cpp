@@ -54,6 +54,41 @@ static inline void bindUniformColor(int slot, uint32_t color) {
             a);
 }
 
+/**
+ * Returns true if the specified gradient can be evaluated in the fragment
+ * shader from uniforms instead of being rendered into a texture by the
+ * gradient cache. Hard stops, where two colors share the same position,
+ * always use a texture.
+ */
+static bool isSimpleGradient(const float* positions, int count, SkShader::TileMode tileMode) {
+    if (tileMode != SkShader::kClamp_TileMode) return false;
+    if (count != 2 && count != 3) return false;
+
+    for (int i = 1; i < count; i++) {
+        if (positions[i] <= positions[i - 1]) return false;
+    }
+    return true;
+}
+
+/**
+ * Binds the colors and positions of a simple gradient, see isSimpleGradient().
+ */
+static void bindUniformGradient(Program* program, const uint32_t* colors,
+        const float* positions, int count) {
+    bindUniformColor(program->getUniform("startColor"), colors[0]);
+    bindUniformColor(program->getUniform("endColor"), colors[count - 1]);
+
+    if (count == 3) {
+        bindUniformColor(program->getUniform("midColor"), colors[1]);
+        glUniform4f(program->getUniform("gradientStops"),
+                positions[0], 1.0f / (positions[1] - positions[0]),
+                positions[1], 1.0f / (positions[2] - positions[1]));
+    } else {
+        glUniform4f(program->getUniform("gradientStops"),
+                positions[0], 1.0f / (positions[1] - positions[0]), 0.0f, 0.0f);
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Base shader
 ///////////////////////////////////////////////////////////////////////////////
@@ -197,7 +232,7 @@ SkiaLinearGradientShader::SkiaLinearGradientShader(float* bounds, uint32_t* colo
 
     updateLocalMatrix(matrix);
 
-    mIsSimple = count == 2 && tileMode == SkShader::kClamp_TileMode;
+    mIsSimple = isSimpleGradient(positions, count, tileMode);
 }
 
 SkiaLinearGradientShader::~SkiaLinearGradientShader() {
@@ -225,6 +260,7 @@ void SkiaLinearGradientShader::describe(ProgramDescription& description,
     description.hasGradient = true;
     description.gradientType = ProgramDescription::kGradientLinear;
     description.isSimpleGradient = mIsSimple;
+    description.hasGradientMidStop = mIsSimple && mCount == 3;
 }
 
 void SkiaLinearGradientShader::setupProgram(Program* program, const mat4& modelView,
@@ -239,8 +275,7 @@ void SkiaLinearGradientShader::setupProgram(Program* program, const mat4& modelV
         bindTexture(texture, gTileModes[mTileX], gTileModes[mTileY]);
         glUniform1i(program->getUniform("gradientSampler"), textureSlot);
     } else {
-        bindUniformColor(program->getUniform("startColor"), mColors[0]);
-        bindUniformColor(program->getUniform("endColor"), mColors[1]);
+        bindUniformGradient(program, mColors, mPositions, mCount);
     }
 
     Caches::getInstance().dither.setupProgram(program, textureUnit);
@@ -290,6 +325,7 @@ void SkiaCircularGradientShader::describe(ProgramDescription& description,
     description.hasGradient = true;
     description.gradientType = ProgramDescription::kGradientCircular;
     description.isSimpleGradient = mIsSimple;
+    description.hasGradientMidStop = mIsSimple && mCount == 3;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -311,7 +347,7 @@ SkiaSweepGradientShader::SkiaSweepGradientShader(float x, float y, uint32_t* col
 
     updateLocalMatrix(matrix);
 
-    mIsSimple = count == 2;
+    mIsSimple = isSimpleGradient(positions, count, SkShader::kClamp_TileMode);
 }
 
 SkiaSweepGradientShader::SkiaSweepGradientShader(Type type, float x, float y, uint32_t* colors,
@@ -320,7 +356,7 @@ SkiaSweepGradientShader::SkiaSweepGradientShader(Type type, float x, float y, ui
         SkiaShader(type, key, tileMode, tileMode, matrix, blend),
         mColors(colors), mPositions(positions), mCount(count) {
 
-    mIsSimple = count == 2 && tileMode == SkShader::kClamp_TileMode;
+    mIsSimple = isSimpleGradient(positions, count, tileMode);
 }
 
 SkiaSweepGradientShader::~SkiaSweepGradientShader() {
@@ -345,6 +381,7 @@ void SkiaSweepGradientShader::describe(ProgramDescription& description,
     description.hasGradient = true;
     description.gradientType = ProgramDescription::kGradientSweep;
     description.isSimpleGradient = mIsSimple;
+    description.hasGradientMidStop = mIsSimple && mCount == 3;
 }
 
 void SkiaSweepGradientShader::setupProgram(Program* program, const mat4& modelView,
@@ -359,8 +396,7 @@ void SkiaSweepGradientShader::setupProgram(Program* program, const mat4& modelVi
         bindTexture(texture, gTileModes[mTileX], gTileModes[mTileY]);
         glUniform1i(program->getUniform("gradientSampler"), textureSlot);
     } else {
-       bindUniformColor(program->getUniform("startColor"), mColors[0]);
-       bindUniformColor(program->getUniform("endColor"), mColors[1]);
+        bindUniformGradient(program, mColors, mPositions, mCount);
     }
 
     mCaches->dither.setupProgram(program, textureUnit);
@@ -16,6 +16,12 @@
 
 #define LOG_TAG "OpenGLRenderer"
 
+#include <stdlib.h>
+
+#include <utils/Log.h>
+#include <utils/Mutex.h>
+#include <utils/Singleton.h>
+
 #include "Snapshot.h"
 
 #include <SkCanvas.h>
@@ -23,12 +29,111 @@
 namespace android {
 namespace uirenderer {
 
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Maximum number of released snapshots kept in the pool, deep enough
+// for the save stacks of a few renderers
+#define SNAPSHOT_POOL_MAX_COUNT 64
+
+///////////////////////////////////////////////////////////////////////////////
+// Pool
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Process-wide free list of snapshot allocations. The memory of a released
+ * snapshot holds the link to the next free allocation.
+ */
+class SnapshotPool: public Singleton<SnapshotPool> {
+    SnapshotPool(): mFreeList(NULL), mCount(0) {
+    }
+
+    friend class Singleton<SnapshotPool>;
+
+    struct FreeSnapshot {
+        FreeSnapshot* next;
+    };
+
+public:
+    void* obtain(size_t size) {
+        {
+            Mutex::Autolock _l(mLock);
+            FreeSnapshot* snapshot = mFreeList;
+            if (snapshot) {
+                mFreeList = snapshot->next;
+                mCount--;
+                return snapshot;
+            }
+        }
+
+        void* ptr = malloc(size);
+        if (!ptr) {
+            LOG_ALWAYS_FATAL("Could not allocate a snapshot of %d bytes", (int) size);
+        }
+        return ptr;
+    }
+
+    void recycle(void* ptr) {
+        {
+            Mutex::Autolock _l(mLock);
+            if (mCount < SNAPSHOT_POOL_MAX_COUNT) {
+                FreeSnapshot* snapshot = (FreeSnapshot*) ptr;
+                snapshot->next = mFreeList;
+                mFreeList = snapshot;
+                mCount++;
+                return;
+            }
+        }
+        free(ptr);
+    }
+
+    void trim() {
+        Mutex::Autolock _l(mLock);
+        while (mFreeList) {
+            FreeSnapshot* next = mFreeList->next;
+            free(mFreeList);
+            mFreeList = next;
+        }
+        mCount = 0;
+    }
+
+private:
+    FreeSnapshot* mFreeList;
+    uint32_t mCount;
+
+    Mutex mLock;
+}; // class SnapshotPool
+
+}; // namespace uirenderer
+
+using namespace uirenderer;
+ANDROID_SINGLETON_STATIC_INSTANCE(SnapshotPool);
+
+namespace uirenderer {
+
+void* Snapshot::operator new(size_t size) {
+    // Every allocation of the pool has the size of a snapshot
+    LOG_ALWAYS_FATAL_IF(size != sizeof(Snapshot), "Invalid snapshot size %d", (int) size);
+    return SnapshotPool::getInstance().obtain(size);
+}
+
+void Snapshot::operator delete(void* ptr) {
+    if (ptr) {
+        SnapshotPool::getInstance().recycle(ptr);
+    }
+}
+
+void Snapshot::trimPool() {
+    SnapshotPool::getInstance().trim();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Constructors
 ///////////////////////////////////////////////////////////////////////////////
 
 Snapshot::Snapshot(): flags(0), previous(NULL), layer(NULL), fbo(0),
-        invisible(false), empty(false), alpha(1.0f) {
+        invisible(false), empty(false), alpha(1.0f), mRefCount(0) {
 
     transform = &mTransformRoot;
     clipRect = &mClipRectRoot;
@@ -43,7 +148,7 @@ Snapshot::Snapshot(): flags(0), previous(NULL), layer(NULL), fbo(0),
 Snapshot::Snapshot(const sp<Snapshot>& s, int saveFlags):
         flags(0), previous(s), layer(s->layer), fbo(s->fbo),
         invisible(s->invisible), empty(false),
-        viewport(s->viewport), height(s->height), alpha(s->alpha) {
+        viewport(s->viewport), height(s->height), alpha(s->alpha), mRefCount(0) {
 
     if (saveFlags & SkCanvas::kMatrix_SaveFlag) {
         mTransformRoot.load(*s->transform);
@@ -41,12 +41,38 @@ namespace uirenderer {
  * Each snapshot has a link to a previous snapshot, indicating the previous
  * state of the renderer.
  */
-class Snapshot: public LightRefBase<Snapshot> {
+class Snapshot {
 public:
 
     Snapshot();
     Snapshot(const sp<Snapshot>& s, int saveFlags);
 
+    /**
+     * Snapshots are allocated from, and released to, a pool to avoid going
+     * through malloc() and free() on every save and restore.
+     */
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr);
+
+    /**
+     * Releases the memory held by the pool of snapshots.
+     */
+    static void trimPool();
+
+    /**
+     * A snapshot is only ever used by the renderer that created it, on the
+     * renderer's thread, so its reference count does not need atomic operations.
+     */
+    void incStrong(const void* id) const {
+        mRefCount++;
+    }
+
+    void decStrong(const void* id) const {
+        if (--mRefCount == 0) {
+            delete this;
+        }
+    }
+
     /**
      * Various flags set on ::flags.
      */
@@ -242,6 +268,8 @@ private:
 
     SkRegion mClipRegionRoot;
 
+    mutable int32_t mRefCount;
+
 }; // class Snapshot
 
 }; // namespace uirenderer
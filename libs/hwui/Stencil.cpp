@@ -87,6 +87,8 @@ void Stencil::enableDebugTest(GLint value, bool greater) {
 }
 
 void Stencil::enableDebugWrite() {
+    // Overdraw debugging counts fragments in the stencil buffer
+    invalidateClips();
     if (mState != kWrite) {
         enable();
         glStencilFunc(GL_ALWAYS, 0x1, 0xffffffff);
@@ -110,5 +112,22 @@ void Stencil::disable() {
     }
 }
 
+bool Stencil::hasClip(const RenderBuffer* buffer, const SkRegion& region) const {
+    ssize_t index = mClips.indexOfKey(buffer);
+    return index >= 0 && mClips.valueAt(index) == region;
+}
+
+void Stencil::setClip(const RenderBuffer* buffer, const SkRegion& region) {
+    mClips.replaceValueFor(buffer, region);
+}
+
+void Stencil::invalidateClip(const RenderBuffer* buffer) {
+    mClips.removeItem(buffer);
+}
+
+void Stencil::invalidateClips() {
+    mClips.clear();
+}
+
 }; // namespace uirenderer
 }; // namespace android
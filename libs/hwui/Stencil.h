@@ -23,11 +23,16 @@
 
 #include <GLES2/gl2.h>
 
+#include <SkRegion.h>
+
 #include <cutils/compiler.h>
+#include <utils/KeyedVector.h>
 
 namespace android {
 namespace uirenderer {
 
+struct RenderBuffer;
+
 ///////////////////////////////////////////////////////////////////////////////
 // Stencil buffer management
 ///////////////////////////////////////////////////////////////////////////////
@@ -94,6 +99,31 @@ public:
         return mState == kTest;
     }
 
+    /**
+     * Indicates whether the specified stencil buffer already contains the
+     * specified clip region, in which case the region does not need to be
+     * drawn again. A NULL buffer designates the stencil buffer of the
+     * framebuffer.
+     */
+    bool hasClip(const RenderBuffer* buffer, const SkRegion& region) const;
+
+    /**
+     * Records the clip region drawn in the specified stencil buffer.
+     */
+    void setClip(const RenderBuffer* buffer, const SkRegion& region);
+
+    /**
+     * Forgets the clip region drawn in the specified stencil buffer. Must be
+     * invoked when the content of the buffer becomes undefined, for instance
+     * when the buffer is discarded, resized or recycled.
+     */
+    void invalidateClip(const RenderBuffer* buffer);
+
+    /**
+     * Forgets the clip regions drawn in all the stencil buffers.
+     */
+    void invalidateClips();
+
 private:
     void enable();
 
@@ -105,6 +135,9 @@ private:
 
     StencilState mState;
 
+    // Clip region last drawn in each stencil buffer
+    KeyedVector<const RenderBuffer*, SkRegion> mClips;
+
 }; // class Stencil
 
 }; // namespace uirenderer
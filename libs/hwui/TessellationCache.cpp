@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+#define ATRACE_TAG ATRACE_TAG_VIEW
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SkPath.h>
+#include <SkRect.h>
+
+#include <utils/JenkinsHash.h>
+#include <utils/Trace.h>
+
+#include "Caches.h"
+#include "Properties.h"
+#include "TessellationCache.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Cache entries
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Rounds the scale to the nearest of TESSELLATION_SCALE_STEPS values
+ * within its power of two. The relative error is kept under 1/32 which
+ * is not noticeable on the anti-aliasing ramp or on curve subdivision.
+ */
+static float quantizeScale(float scale) {
+    if (scale == 0.0f) return 0.0f;
+
+    int exponent;
+    // The mantissa is in the [0.5..1) range
+    const float mantissa = frexpf(scale, &exponent);
+    const float steps = TESSELLATION_SCALE_STEPS * 2.0f;
+    return ldexpf(roundf(mantissa * steps) / steps, exponent);
+}
+
+TessellationDescription::TessellationDescription() {
+    memset(this, 0, sizeof(TessellationDescription));
+}
+
+TessellationDescription::TessellationDescription(ShapeType shapeType, const mat4& transform,
+        const SkPaint* paint) {
+    // Clear the padding as well, descriptions are compared with memcmp()
+    memset(this, 0, sizeof(TessellationDescription));
+
+    type = shapeType;
+    style = paint->getStyle();
+    // Caps and joins do not affect fills
+    if (style != SkPaint::kFill_Style) {
+        cap = paint->getStrokeCap();
+        join = paint->getStrokeJoin();
+    }
+    isAA = paint->isAntiAlias();
+    strokeWidth = paint->getStrokeWidth();
+
+    // Same decomposition as the one performed by the PathTessellator
+    scaleX = 1.0f;
+    scaleY = 1.0f;
+    if (!transform.isPureTranslate()) {
+        const float m00 = transform.data[Matrix4::kScaleX];
+        const float m01 = transform.data[Matrix4::kSkewY];
+        const float m10 = transform.data[Matrix4::kSkewX];
+        const float m11 = transform.data[Matrix4::kScaleY];
+        scaleX = quantizeScale(sqrtf(m00 * m00 + m01 * m01));
+        scaleY = quantizeScale(sqrtf(m10 * m10 + m11 * m11));
+    }
+}
+
+hash_t TessellationDescription::hash() const {
+    uint32_t hash = JenkinsHashMix(0, type);
+    hash = JenkinsHashMix(hash, style);
+    hash = JenkinsHashMix(hash, cap);
+    hash = JenkinsHashMix(hash, join);
+    hash = JenkinsHashMix(hash, isAA);
+    hash = JenkinsHashMix(hash, android::hash_type(strokeWidth));
+    hash = JenkinsHashMix(hash, android::hash_type(scaleX));
+    hash = JenkinsHashMix(hash, android::hash_type(scaleY));
+    hash = JenkinsHashMixBytes(hash, (uint8_t*) &shape, sizeof(Shape));
+    return JenkinsHashWhiten(hash);
+}
+
+int TessellationDescription::compare(const TessellationDescription& rhs) const {
+    return memcmp(this, &rhs, sizeof(TessellationDescription));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Tessellation
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Builds the path of the shape at the origin. This must match the paths
+ * OpenGLRenderer used to build for each shape: kStrokeAndFill_Style is
+ * handled by outsetting the shape since the tessellator treats it as a fill.
+ */
+static void buildPath(const TessellationDescription& description, SkPath& path) {
+    const float outset = description.style == SkPaint::kStrokeAndFill_Style ?
+            description.strokeWidth / 2 : 0.0f;
+
+    switch (description.type) {
+        case kShapeRoundRect: {
+            const TessellationDescription::Shape::RoundRect& roundRect =
+                    description.shape.roundRect;
+            SkRect rect = SkRect::MakeWH(roundRect.mWidth, roundRect.mHeight);
+            rect.outset(outset, outset);
+            path.addRoundRect(rect, roundRect.mRx + outset, roundRect.mRy + outset);
+            break;
+        }
+        case kShapeCircle: {
+            const float radius = description.shape.circle.mRadius;
+            path.addCircle(radius, radius, radius + outset);
+            break;
+        }
+        case kShapeOval: {
+            SkRect rect = SkRect::MakeWH(description.shape.oval.mWidth,
+                    description.shape.oval.mHeight);
+            rect.outset(outset, outset);
+            path.addOval(rect);
+            break;
+        }
+        case kShapeRect: {
+            SkRect rect = SkRect::MakeWH(description.shape.rect.mWidth,
+                    description.shape.rect.mHeight);
+            rect.outset(outset, outset);
+            path.addRect(rect);
+            break;
+        }
+        case kShapeArc: {
+            const TessellationDescription::Shape::Arc& arc = description.shape.arc;
+            SkRect rect = SkRect::MakeWH(arc.mWidth, arc.mHeight);
+            rect.outset(outset, outset);
+            if (arc.mUseCenter) {
+                path.moveTo(rect.centerX(), rect.centerY());
+            }
+            path.arcTo(rect, arc.mStartAngle, arc.mSweepAngle, !arc.mUseCenter);
+            if (arc.mUseCenter) {
+                path.close();
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void TessellationCache::tessellate(const TessellationDescription& description,
+        VertexBuffer& vertexBuffer) {
+    SkPath path;
+    buildPath(description, path);
+
+    // The tessellator only looks at the stroke parameters and the scale
+    SkPaint paint;
+    paint.setStyle(description.style);
+    paint.setStrokeCap(description.cap);
+    paint.setStrokeJoin(description.join);
+    paint.setStrokeWidth(description.strokeWidth);
+    paint.setAntiAlias(description.isAA);
+
+    mat4 transform;
+    transform.loadScale(description.scaleX, description.scaleY, 1.0f);
+
+    PathTessellator::tessellatePath(path, &paint, &transform, vertexBuffer);
+}
+
+TessellationCache::TessellationProcessor::TessellationProcessor(Caches& caches):
+        TaskProcessor<VertexBuffer*>(&caches.tasks) {
+}
+
+void TessellationCache::TessellationProcessor::onProcess(
+        const sp<Task<VertexBuffer*> >& task) {
+    sp<TessellationTask> t = static_cast<TessellationTask*>(task.get());
+    ATRACE_NAME("shapeTessellation");
+
+    if (t->isCanceled()) {
+        t->setResult(NULL);
+        return;
+    }
+
+    VertexBuffer* buffer = new VertexBuffer();
+    tessellate(t->description, *buffer);
+    t->setResult(buffer);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors/destructor
+///////////////////////////////////////////////////////////////////////////////
+
+TessellationCache::TessellationCache():
+        mCache(LruCache<TessellationDescription, sp<TessellationTask> >::kUnlimitedCapacity),
+        mSize(0), mMaxSize(MB(DEFAULT_TESSELLATION_CACHE_SIZE)) {
+    char property[PROPERTY_VALUE_MAX];
+    if (property_get(PROPERTY_TESSELLATION_CACHE_SIZE, property, NULL) > 0) {
+        INIT_LOGD("  Setting tessellation cache size to %sMB", property);
+        mMaxSize = MB(atof(property));
+    } else {
+        INIT_LOGD("  Using default tessellation cache size of %.2fMB",
+                DEFAULT_TESSELLATION_CACHE_SIZE);
+    }
+
+    mCache.setOnEntryRemovedListener(this);
+}
+
+TessellationCache::~TessellationCache() {
+    clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Size management
+///////////////////////////////////////////////////////////////////////////////
+
+void TessellationCache::setMaxSize(uint32_t maxSize) {
+    mMaxSize = maxSize;
+    while (mSize > mMaxSize) {
+        mCache.removeOldest();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Callbacks
+///////////////////////////////////////////////////////////////////////////////
+
+void TessellationCache::operator()(TessellationDescription& description,
+        sp<TessellationTask>& task) {
+    if (task != NULL) {
+        // Nobody will use the result of a pending task. The buffer
+        // is released with the task, once the workers let go of it
+        task->cancel();
+        mSize -= task->size;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Caching
+///////////////////////////////////////////////////////////////////////////////
+
+void TessellationCache::precache(const TessellationDescription& description) {
+    if (!Caches::getInstance().tasks.canRunTasks()) {
+        return;
+    }
+
+    if (mCache.get(description) != NULL) {
+        return;
+    }
+
+    sp<TessellationTask> task = new TessellationTask(description);
+
+    if (mProcessor == NULL) {
+        mProcessor = new TessellationProcessor(Caches::getInstance());
+    }
+
+    if (mProcessor->add(task)) {
+        mCache.put(description, task);
+        mPrecached.push(task);
+    }
+}
+
+const VertexBuffer* TessellationCache::get(const TessellationDescription& description) {
+    markUsed();
+    sp<TessellationTask> task = mCache.get(description);
+
+    if (task == NULL) {
+        task = new TessellationTask(description);
+
+        VertexBuffer* buffer = new VertexBuffer();
+        tessellate(description, *buffer);
+        task->setResult(buffer);
+
+        mCache.put(description, task);
+    }
+
+    VertexBuffer* buffer = task->getResult();
+    if (buffer && !task->size) {
+        task->size = buffer->getSize();
+        mSize += task->size;
+    }
+
+    return buffer;
+}
+
+void TessellationCache::trim() {
+    // Shapes precached during this frame but never drawn were most
+    // likely rejected, drop them before they get accounted for
+    for (size_t i = 0; i < mPrecached.size(); i++) {
+        const sp<TessellationTask>& task = mPrecached.itemAt(i);
+        if (!task->size) {
+            mCache.remove(task->description);
+        }
+    }
+    mPrecached.clear();
+
+    while (mSize > mMaxSize) {
+        mCache.removeOldest();
+    }
+}
+
+void TessellationCache::clear() {
+    mPrecached.clear();
+    mCache.clear();
+}
+
+}; // namespace uirenderer
+}; // namespace android
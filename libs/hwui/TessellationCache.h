@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_TESSELLATION_CACHE_H
+#define ANDROID_HWUI_TESSELLATION_CACHE_H
+
+#include <SkPaint.h>
+
+#include <utils/LruCache.h>
+#include <utils/Vector.h>
+
+#include "Debug.h"
+#include "Matrix.h"
+#include "MemoryBudget.h"
+#include "PathCache.h"
+#include "PathTessellator.h"
+#include "thread/Task.h"
+#include "thread/TaskProcessor.h"
+
+namespace android {
+namespace uirenderer {
+
+class Caches;
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Number of distinct scale factors per power of two. The scale of the
+// transform is rounded to one of these steps to let shapes drawn under
+// slightly different transforms share the same tessellation
+#define TESSELLATION_SCALE_STEPS 16
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Describes a convex shape to tessellate. Shapes are tessellated with
+ * their top-left corner at the origin and translated when drawn. Only
+ * the scale of the transform affects the tessellation: it defines the
+ * width of the anti-aliasing ramp and how finely curves are subdivided.
+ * The scale is quantized, see TESSELLATION_SCALE_STEPS.
+ */
+struct TessellationDescription {
+    ShapeType type;
+    SkPaint::Style style;
+    SkPaint::Cap cap;
+    SkPaint::Join join;
+    bool isAA;
+    float strokeWidth;
+    float scaleX;
+    float scaleY;
+    union Shape {
+        struct RoundRect {
+            float mWidth;
+            float mHeight;
+            float mRx;
+            float mRy;
+        } roundRect;
+        struct Circle {
+            float mRadius;
+        } circle;
+        struct Oval {
+            float mWidth;
+            float mHeight;
+        } oval;
+        struct Rect {
+            float mWidth;
+            float mHeight;
+        } rect;
+        struct Arc {
+            float mWidth;
+            float mHeight;
+            float mStartAngle;
+            float mSweepAngle;
+            bool mUseCenter;
+        } arc;
+    } shape;
+
+    TessellationDescription();
+    TessellationDescription(ShapeType shapeType, const mat4& transform, const SkPaint* paint);
+
+    hash_t hash() const;
+
+    int compare(const TessellationDescription& rhs) const;
+
+    bool operator==(const TessellationDescription& other) const {
+        return compare(other) == 0;
+    }
+
+    bool operator!=(const TessellationDescription& other) const {
+        return compare(other) != 0;
+    }
+
+    friend inline int strictly_order_type(
+            const TessellationDescription& lhs, const TessellationDescription& rhs) {
+        return lhs.compare(rhs) < 0;
+    }
+
+    friend inline int compare_type(
+            const TessellationDescription& lhs, const TessellationDescription& rhs) {
+        return lhs.compare(rhs);
+    }
+
+    friend inline hash_t hash_type(const TessellationDescription& entry) {
+        return entry.hash();
+    }
+};
+
+/**
+ * Tessellation of a shape, possibly performed by a worker thread.
+ */
+class TessellationTask: public Task<VertexBuffer*> {
+public:
+    TessellationTask(const TessellationDescription& description):
+        Task<VertexBuffer*>(kPriorityFrame), description(description), size(0) {
+    }
+
+    ~TessellationTask() {
+        delete future()->get();
+    }
+
+    const TessellationDescription description;
+
+    /**
+     * Size in bytes of the resulting vertex buffer. Set by the cache
+     * the first time the result is retrieved.
+     */
+    uint32_t size;
+};
+
+/**
+ * Caches the tessellations of convex shapes. Shapes can be precached while
+ * display lists are deferred, in which case they are tessellated by worker
+ * threads and the renderer only waits for the result when the shape is
+ * actually drawn.
+ */
+class TessellationCache: public OnEntryRemoved<TessellationDescription, sp<TessellationTask> >,
+        public MemoryBudget::Client {
+public:
+    TessellationCache();
+    ~TessellationCache();
+
+    /**
+     * Used as a callback when an entry is removed from the cache.
+     * Do not invoke directly.
+     */
+    void operator()(TessellationDescription& description, sp<TessellationTask>& task);
+
+    /**
+     * Sets the maximum size of the cache in bytes.
+     */
+    void setMaxSize(uint32_t maxSize);
+
+    /**
+     * Returns the maximum size of the cache in bytes.
+     */
+    uint32_t getMaxSize() {
+        return mMaxSize;
+    }
+
+    /**
+     * Returns the current size of the cache in bytes.
+     */
+    uint32_t getSize() {
+        return mSize;
+    }
+
+    /**
+     * Starts tessellating the specified shape using background threads.
+     */
+    void precache(const TessellationDescription& description);
+
+    /**
+     * Returns the tessellation of the specified shape. If the shape was
+     * precached this method waits for the background tessellation to
+     * complete, otherwise the shape is tessellated immediately. The
+     * returned buffer remains valid until the next call to trim() or
+     * clear().
+     */
+    const VertexBuffer* get(const TessellationDescription& description);
+
+    /**
+     * Trims the contents of the cache, removing items until it's under
+     * its specified limit. Shapes precached during the frame but never
+     * drawn are discarded. Must be invoked at the end of each frame.
+     */
+    void trim();
+
+    /**
+     * Releases all the tessellations.
+     */
+    void clear();
+
+    /**
+     * Tessellates the specified shape into the vertex buffer.
+     */
+    static void tessellate(const TessellationDescription& description,
+            VertexBuffer& vertexBuffer);
+
+private:
+    class TessellationProcessor: public TaskProcessor<VertexBuffer*> {
+    public:
+        TessellationProcessor(Caches& caches);
+        ~TessellationProcessor() { }
+
+        virtual void onProcess(const sp<Task<VertexBuffer*> >& task);
+    };
+
+    LruCache<TessellationDescription, sp<TessellationTask> > mCache;
+    uint32_t mSize;
+    uint32_t mMaxSize;
+
+    // Tasks sent to the background threads during the current frame
+    Vector<sp<TessellationTask> > mPrecached;
+
+    sp<TessellationProcessor> mProcessor;
+}; // class TessellationCache
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_TESSELLATION_CACHE_H
@@ -170,6 +170,8 @@ void TextDropShadowCache::clear() {
 
 ShadowTexture* TextDropShadowCache::get(SkPaint* paint, const char* text, uint32_t len,
         int numGlyphs, float radius, const float* positions) {
+    markUsed();
+
     ShadowText entry(paint, radius, len, text, positions);
     ShadowTexture* texture = mCache.get(entry);
 
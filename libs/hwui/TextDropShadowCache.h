@@ -25,6 +25,7 @@
 #include <utils/String16.h>
 
 #include "FontRenderer.h"
+#include "MemoryBudget.h"
 #include "Texture.h"
 
 namespace android {
@@ -123,7 +124,8 @@ struct ShadowTexture: public Texture {
     float top;
 }; // struct ShadowTexture
 
-class TextDropShadowCache: public OnEntryRemoved<ShadowText, ShadowTexture*> {
+class TextDropShadowCache: public OnEntryRemoved<ShadowText, ShadowTexture*>,
+        public MemoryBudget::Client {
 public:
     TextDropShadowCache();
     TextDropShadowCache(uint32_t maxByteSize);
@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <stdlib.h>
+
+#include "Caches.h"
+#include "Properties.h"
+#include "TextureAtlas.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors/destructor
+///////////////////////////////////////////////////////////////////////////////
+
+TextureAtlas::TextureAtlas(): mTexture(NULL), mDimension(DEFAULT_TEXTURE_ATLAS_SIZE),
+        mNextShelfY(0), mFull(false), mUsedArea(0), mGenerationId(0), mBlendKey(true), mOpaqueKey(false) {
+    char property[PROPERTY_VALUE_MAX];
+    if (property_get(PROPERTY_TEXTURE_ATLAS_SIZE, property, NULL) > 0) {
+        INIT_LOGD("  Setting texture atlas size to %s pixels", property);
+        mDimension = uint32_t(atoi(property));
+    } else {
+        INIT_LOGD("  Using default texture atlas size of %d pixels", DEFAULT_TEXTURE_ATLAS_SIZE);
+    }
+
+    GLint maxTextureSize;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    if (mDimension > uint32_t(maxTextureSize)) {
+        mDimension = maxTextureSize;
+    }
+
+    mMaxEntryDimension = mDimension / 4;
+}
+
+TextureAtlas::~TextureAtlas() {
+    clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Entries
+///////////////////////////////////////////////////////////////////////////////
+
+TextureAtlas::Entry* TextureAtlas::get(SkBitmap* bitmap) {
+    ssize_t index = mEntries.indexOfKey(bitmap);
+    if (index >= 0) {
+        Entry* entry = mEntries.valueAt(index);
+        if (entry->generation == bitmap->getGenerationID()) {
+            markUsed(entry);
+            return entry;
+        }
+        // The pixels were replaced, the old entry is stale
+        remove(bitmap);
+    }
+
+    if (!canPack(bitmap)) return NULL;
+    if (!mTexture && !createTexture()) return NULL;
+
+    const uint32_t width = bitmap->width();
+    const uint32_t height = bitmap->height();
+
+    int x, y;
+    if (!allocate(width + TEXTURE_ATLAS_ENTRY_PADDING,
+            height + TEXTURE_ATLAS_ENTRY_PADDING, x, y)) {
+        mFull = true;
+        return NULL;
+    }
+
+    SkAutoLockPixels alp(*bitmap);
+    if (!bitmap->readyToDraw()) {
+        ALOGE("Cannot pack bitmap in texture atlas");
+        return NULL;
+    }
+    upload(bitmap, x, y);
+
+    const float dimension = float(mDimension);
+    const UvMapper mapper(
+            x / dimension, (x + width) / dimension,
+            y / dimension, (y + height) / dimension);
+
+    Caches& caches = Caches::getInstance();
+    Texture* texture = new DelegateTexture(caches, mTexture);
+    texture->id = mTexture->id;
+    // Do this after calling getPixels() to make sure Skia's deferred
+    // decoding happened
+    texture->blend = !bitmap->isOpaque();
+    texture->width = width;
+    texture->height = height;
+
+    Entry* entry = new Entry(bitmap, x, y, texture, mapper, *this);
+    texture->uvMapper = &entry->uvMapper;
+
+    mEntries.add(bitmap, entry);
+    markUsed(entry);
+    mGenerationId++;
+
+    TEXTURE_LOGD("TextureAtlas::get: packed bitmap %p (%dx%d) at %d, %d",
+            bitmap, width, height, x, y);
+
+    return entry;
+}
+
+Texture* TextureAtlas::getEntryTexture(SkBitmap* bitmap) const {
+    ssize_t index = mEntries.indexOfKey(bitmap);
+    return index >= 0 ? mEntries.valueAt(index)->texture : NULL;
+}
+
+void TextureAtlas::remove(SkBitmap* bitmap) {
+    ssize_t index = mEntries.indexOfKey(bitmap);
+    if (index >= 0) {
+        delete mEntries.valueAt(index);
+        mEntries.removeItemsAt(index);
+        mGenerationId++;
+    }
+}
+
+bool TextureAtlas::canPack(SkBitmap* bitmap) const {
+    // Mutable bitmaps would force us to re-upload parts of the atlas,
+    // and mipmaps cannot be generated for a single entry
+    return mDimension > 0 && bitmap->isImmutable() &&
+            bitmap->getConfig() == SkBitmap::kARGB_8888_Config &&
+            !bitmap->hasHardwareMipMap() &&
+            bitmap->width() > 0 && uint32_t(bitmap->width()) <= mMaxEntryDimension &&
+            bitmap->height() > 0 && uint32_t(bitmap->height()) <= mMaxEntryDimension;
+}
+
+void TextureAtlas::markUsed(Entry* entry) {
+    if (!entry->used) {
+        entry->used = true;
+        mUsedArea += (entry->texture->width + TEXTURE_ATLAS_ENTRY_PADDING) *
+                (entry->texture->height + TEXTURE_ATLAS_ENTRY_PADDING);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Allocation
+///////////////////////////////////////////////////////////////////////////////
+
+bool TextureAtlas::allocate(uint32_t width, uint32_t height, int& x, int& y) {
+    // Find the shortest shelf that can hold the entry without wasting
+    // more than half of its height
+    Shelf* bestShelf = NULL;
+    for (size_t i = 0; i < mShelves.size(); i++) {
+        Shelf& shelf = mShelves.editItemAt(i);
+        if (height <= shelf.height && height * 2 > shelf.height &&
+                shelf.x + width <= mDimension) {
+            if (!bestShelf || shelf.height < bestShelf->height) {
+                bestShelf = &shelf;
+            }
+        }
+    }
+
+    if (!bestShelf) {
+        uint32_t shelfHeight = (height + TEXTURE_ATLAS_SHELF_ROUNDING - 1) &
+                ~(TEXTURE_ATLAS_SHELF_ROUNDING - 1);
+
+        if (mNextShelfY + height > mDimension) return false;
+        if (mNextShelfY + shelfHeight > mDimension) {
+            shelfHeight = mDimension - mNextShelfY;
+        }
+
+        mShelves.push(Shelf(mNextShelfY, shelfHeight));
+        mNextShelfY += shelfHeight;
+
+        bestShelf = &mShelves.editTop();
+    }
+
+    x = bestShelf->x;
+    y = bestShelf->y;
+    bestShelf->x += width;
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Texture
+///////////////////////////////////////////////////////////////////////////////
+
+bool TextureAtlas::createTexture() {
+    Caches& caches = Caches::getInstance();
+
+    mTexture = new Texture(caches);
+    mTexture->width = mDimension;
+    mTexture->height = mDimension;
+    mTexture->blend = true;
+
+    glGenTextures(1, &mTexture->id);
+    caches.bindTexture(mTexture->id);
+
+    mTexture->setFilter(GL_NEAREST);
+    mTexture->setWrap(GL_CLAMP_TO_EDGE);
+
+    if (!clearTexture()) {
+        ALOGW("Could not allocate %dx%d texture atlas, disabling", mDimension, mDimension);
+
+        mTexture->deleteTexture();
+        delete mTexture;
+        mTexture = NULL;
+
+        mDimension = 0;
+        return false;
+    }
+
+    return true;
+}
+
+bool TextureAtlas::clearTexture() {
+    // The padding around entries must be transparent
+    void* pixels = calloc(mDimension * mDimension, 4);
+    if (!pixels) return false;
+
+    // Flush pending errors
+    while (glGetError() != GL_NO_ERROR) { }
+
+    Caches::getInstance().bindTexture(mTexture->id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, mDimension, mDimension, 0,
+            GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+    free(pixels);
+
+    return glGetError() == GL_NO_ERROR;
+}
+
+void TextureAtlas::upload(SkBitmap* bitmap, int x, int y) {
+    const GLsizei width = bitmap->width();
+    const GLsizei height = bitmap->height();
+    const GLsizei stride = bitmap->rowBytesAsPixels();
+
+    Caches::getInstance().bindTexture(mTexture->id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, bitmap->bytesPerPixel());
+
+    if (stride == width) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height,
+                GL_RGBA, GL_UNSIGNED_BYTE, bitmap->getPixels());
+    } else if (Extensions::getInstance().hasUnpackRowLength()) {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height,
+                GL_RGBA, GL_UNSIGNED_BYTE, bitmap->getPixels());
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    } else {
+        // Entries are small, uploading one row at a time is cheaper
+        // than copying the bitmap in a temporary buffer
+        for (GLsizei i = 0; i < height; i++) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, x, y + i, width, 1,
+                    GL_RGBA, GL_UNSIGNED_BYTE, bitmap->getAddr32(0, i));
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Lifecycle
+///////////////////////////////////////////////////////////////////////////////
+
+void TextureAtlas::endFrame() {
+    if (mFull) {
+        // The atlas could not hold every eligible bitmap drawn during this
+        // frame. If it is mostly filled with bitmaps that were not drawn,
+        // start over to let the current set of bitmaps be packed. Otherwise
+        // keep it as is to avoid re-uploading the same bitmaps every frame
+        const float usedFraction = mUsedArea / float(mDimension * mDimension);
+        if (usedFraction < TEXTURE_ATLAS_RESET_THRESHOLD) {
+            TEXTURE_LOGD("TextureAtlas::endFrame: resetting atlas, %.2f%% in use",
+                    usedFraction * 100.0f);
+            reset();
+        }
+        mFull = false;
+    }
+
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        mEntries.valueAt(i)->used = false;
+    }
+    mUsedArea = 0;
+}
+
+void TextureAtlas::removeEntries() {
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        delete mEntries.valueAt(i);
+    }
+    mEntries.clear();
+    mGenerationId++;
+
+    mShelves.clear();
+    mNextShelfY = 0;
+    mUsedArea = 0;
+}
+
+void TextureAtlas::reset() {
+    removeEntries();
+    if (mTexture && !clearTexture()) {
+        ALOGW("Could not clear texture atlas");
+        clear();
+    }
+}
+
+void TextureAtlas::clear() {
+    removeEntries();
+    if (mTexture) {
+        mTexture->deleteTexture();
+        delete mTexture;
+        mTexture = NULL;
+    }
+    mFull = false;
+}
+
+}; // namespace uirenderer
+}; // namespace android
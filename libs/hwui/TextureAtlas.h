@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_TEXTURE_ATLAS_H
+#define ANDROID_HWUI_TEXTURE_ATLAS_H
+
+#include <GLES2/gl2.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/Vector.h>
+
+#include <SkBitmap.h>
+
+#include "Texture.h"
+#include "UvMapper.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Space left around each entry, in pixels, to avoid sampling
+// neighboring entries when filtering
+#define TEXTURE_ATLAS_ENTRY_PADDING 1
+
+// Shelf heights are rounded up to a multiple of this value,
+// in pixels, to let bitmaps of slightly different sizes share
+// the same shelf
+#define TEXTURE_ATLAS_SHELF_ROUNDING 8
+
+// If the atlas ran out of space during a frame and less than this
+// fraction of its area was drawn during that frame, it is reset
+#define TEXTURE_ATLAS_RESET_THRESHOLD 0.5f
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * A texture atlas packs small, immutable bitmaps into a single OpenGL
+ * texture at runtime. Unlike the AssetAtlas, which is generated by the
+ * framework at boot time, this atlas holds application bitmaps and is
+ * filled as bitmaps are drawn. Bitmaps stored in the same atlas can be
+ * merged into a single draw call.
+ *
+ * Entries are allocated on shelves: horizontal strips of the atlas whose
+ * height is the height of the first entry they hold. Space is never
+ * reclaimed for individual entries; instead the entire atlas is reset
+ * when it runs out of space and most of its entries were not drawn
+ * during the last frame.
+ *
+ * Entries remain valid until the end of the frame during which they
+ * were returned by get().
+ */
+class TextureAtlas {
+public:
+    /**
+     * Entry representing the position of a bitmap inside the atlas.
+     */
+    struct Entry {
+        /**
+         * The bitmap that generated this atlas entry.
+         */
+        SkBitmap* bitmap;
+
+        /**
+         * Generation of the bitmap when it was packed.
+         */
+        uint32_t generation;
+
+        /**
+         * Location of the bitmap inside the atlas, in pixels.
+         */
+        int x;
+        int y;
+
+        /*
+         * A "virtual texture" object that represents the texture
+         * this entry belongs to. This texture should never be
+         * modified.
+         */
+        Texture* texture;
+
+        /**
+         * Maps texture coordinates in the [0..1] range into the
+         * correct range to sample this entry from the atlas.
+         */
+        const UvMapper uvMapper;
+
+        /**
+         * Atlas this entry belongs to.
+         */
+        const TextureAtlas& atlas;
+
+        /**
+         * Unique identifier used to merge bitmaps stored in the atlas.
+         */
+        const void* getMergeId() const {
+            return texture->blend ? &atlas.mBlendKey : &atlas.mOpaqueKey;
+        }
+
+    private:
+        Entry(SkBitmap* bitmap, int x, int y, Texture* texture,
+                const UvMapper& mapper, const TextureAtlas& atlas):
+                bitmap(bitmap), generation(bitmap->getGenerationID()), x(x), y(y),
+                texture(texture), uvMapper(mapper), atlas(atlas), used(false) {
+        }
+
+        ~Entry() {
+            delete texture;
+        }
+
+        /**
+         * Set when the entry is returned by get() during the current frame.
+         */
+        bool used;
+
+        friend class TextureAtlas;
+    };
+
+    TextureAtlas();
+    ~TextureAtlas();
+
+    /**
+     * Returns the entry associated with the specified bitmap. If the
+     * bitmap is not in the atlas yet, this method attempts to pack it.
+     * Returns NULL if the bitmap cannot be stored in the atlas.
+     */
+    Entry* get(SkBitmap* bitmap);
+
+    /**
+     * Returns the texture of the entry associated with the specified
+     * bitmap. Unlike get(), this method never packs the bitmap.
+     * Returns NULL if the bitmap is not in the atlas.
+     */
+    Texture* getEntryTexture(SkBitmap* bitmap) const;
+
+    /**
+     * Removes the entry associated with the specified bitmap, if any.
+     * The space used by the entry is reclaimed on the next reset.
+     */
+    void remove(SkBitmap* bitmap);
+
+    /**
+     * Must be invoked at the end of a frame. Resets the atlas if it
+     * ran out of space during the frame and is mostly filled with
+     * bitmaps that were not drawn.
+     */
+    void endFrame();
+
+    /**
+     * Removes all the entries and destroys the atlas texture.
+     */
+    void clear();
+
+    /**
+     * Returns the size of the atlas texture in bytes, or 0 if
+     * the texture has not been created yet.
+     */
+    uint32_t getSize() const {
+        return mTexture ? mTexture->width * mTexture->height * 4 : 0;
+    }
+
+    /**
+     * Returns the current generation id of the atlas. The generation
+     * changes every time an entry is added or removed.
+     */
+    uint32_t getGenerationId() const {
+        return mGenerationId;
+    }
+
+private:
+    /**
+     * Horizontal strip of the atlas. Entries are packed from
+     * left to right.
+     */
+    struct Shelf {
+        Shelf(): y(0), height(0), x(0) { }
+        Shelf(uint32_t y, uint32_t height): y(y), height(height), x(0) { }
+
+        uint32_t y;
+        uint32_t height;
+        uint32_t x;
+    };
+
+    bool canPack(SkBitmap* bitmap) const;
+    bool allocate(uint32_t width, uint32_t height, int& x, int& y);
+    bool createTexture();
+    bool clearTexture();
+    void upload(SkBitmap* bitmap, int x, int y);
+    void markUsed(Entry* entry);
+    void removeEntries();
+    void reset();
+
+    Texture* mTexture;
+
+    uint32_t mDimension;
+    uint32_t mMaxEntryDimension;
+
+    Vector<Shelf> mShelves;
+    uint32_t mNextShelfY;
+
+    bool mFull;
+    uint32_t mUsedArea;
+
+    uint32_t mGenerationId;
+
+    const bool mBlendKey;
+    const bool mOpaqueKey;
+
+    KeyedVector<SkBitmap*, Entry*> mEntries;
+}; // class TextureAtlas
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_TEXTURE_ATLAS_H
@@ -16,6 +16,8 @@
 
 #define LOG_TAG "OpenGLRenderer"
 
+#include <string.h>
+
 #include <GLES2/gl2.h>
 
 #include <SkCanvas.h>
@@ -29,14 +31,23 @@
 namespace android {
 namespace uirenderer {
 
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Bitmaps at least this large are uploaded asynchronously by getAsync()
+#define ASYNC_UPLOAD_MIN_SIZE KB(256)
+// Maximum amount of memory held by pixel buffers of pending uploads
+#define ASYNC_UPLOAD_MAX_SIZE MB(8)
+
 ///////////////////////////////////////////////////////////////////////////////
 // Constructors/destructor
 ///////////////////////////////////////////////////////////////////////////////
 
 TextureCache::TextureCache():
-        mCache(LruCache<SkBitmap*, Texture*>::kUnlimitedCapacity),
+        mCache(ClockCache<SkBitmap*, Texture*>::kUnlimitedCapacity),
         mSize(0), mMaxSize(MB(DEFAULT_TEXTURE_CACHE_SIZE)),
-        mFlushRate(DEFAULT_TEXTURE_CACHE_FLUSH_RATE) {
+        mFlushRate(DEFAULT_TEXTURE_CACHE_FLUSH_RATE), mUploadsSize(0) {
     char property[PROPERTY_VALUE_MAX];
     if (property_get(PROPERTY_TEXTURE_CACHE_SIZE, property, NULL) > 0) {
         INIT_LOGD("  Setting texture cache size to %sMB", property);
@@ -58,13 +69,14 @@ TextureCache::TextureCache():
 }
 
 TextureCache::TextureCache(uint32_t maxByteSize):
-        mCache(LruCache<SkBitmap*, Texture*>::kUnlimitedCapacity),
-        mSize(0), mMaxSize(maxByteSize) {
+        mCache(ClockCache<SkBitmap*, Texture*>::kUnlimitedCapacity),
+        mSize(0), mMaxSize(maxByteSize), mUploadsSize(0) {
     init();
 }
 
 TextureCache::~TextureCache() {
     mCache.clear();
+    mAtlas.clear();
 }
 
 void TextureCache::init() {
@@ -88,6 +100,14 @@ uint32_t TextureCache::getMaxSize() {
     return mMaxSize;
 }
 
+uint32_t TextureCache::getAtlasSize() const {
+    return mAtlas.getSize();
+}
+
+uint32_t TextureCache::getAtlasGenerationId() const {
+    return mAtlas.getGenerationId();
+}
+
 void TextureCache::setMaxSize(uint32_t maxSize) {
     mMaxSize = maxSize;
     while (mSize > mMaxSize) {
@@ -112,6 +132,7 @@ void TextureCache::operator()(SkBitmap*& bitmap, Texture*& texture) {
         if (mDebugEnabled) {
             ALOGD("Texture deleted, size = %d", texture->bitmapSize);
         }
+        cancelUpload(texture);
         texture->deleteTexture();
         delete texture;
     }
@@ -122,6 +143,15 @@ void TextureCache::operator()(SkBitmap*& bitmap, Texture*& texture) {
 ///////////////////////////////////////////////////////////////////////////////
 
 Texture* TextureCache::get(SkBitmap* bitmap) {
+    return get(bitmap, false);
+}
+
+Texture* TextureCache::getAsync(SkBitmap* bitmap) {
+    return get(bitmap, true);
+}
+
+Texture* TextureCache::get(SkBitmap* bitmap, bool allowAsync) {
+    markUsed();
     Texture* texture = mCache.get(bitmap);
 
     if (!texture) {
@@ -141,7 +171,11 @@ Texture* TextureCache::get(SkBitmap* bitmap) {
 
         texture = new Texture();
         texture->bitmapSize = size;
-        generateTexture(bitmap, texture, false);
+        // Textures that are not kept in the cache are destroyed right after
+        // being drawn, they must be uploaded synchronously
+        if (!allowAsync || size >= mMaxSize || !uploadAsync(bitmap, texture)) {
+            generateTexture(bitmap, texture, false);
+        }
 
         if (size < mMaxSize) {
             mSize += size;
@@ -155,10 +189,23 @@ Texture* TextureCache::get(SkBitmap* bitmap) {
             texture->cleanup = true;
         }
     } else if (bitmap->getGenerationID() != texture->generation) {
-        generateTexture(bitmap, texture, true);
+        // A pending upload holds stale pixels
+        cancelUpload(texture);
+        if (!allowAsync || !uploadAsync(bitmap, texture)) {
+            generateTexture(bitmap, texture, texture->id != 0);
+        }
     }
 
-    return texture;
+    ssize_t index = mUploads.indexOfKey(texture);
+    if (index >= 0) {
+        // The texture can be used before the fence is signaled, at the
+        // cost of a stall in the driver
+        if (!allowAsync || mUploads.valueAt(index).fence->isSignaled()) {
+            finishUpload(index);
+        }
+    }
+
+    return texture->id ? texture : NULL;
 }
 
 Texture* TextureCache::getTransient(SkBitmap* bitmap) {
@@ -171,8 +218,17 @@ Texture* TextureCache::getTransient(SkBitmap* bitmap) {
     return texture;
 }
 
+TextureAtlas::Entry* TextureCache::getAtlasEntry(SkBitmap* bitmap) {
+    return mAtlas.get(bitmap);
+}
+
+Texture* TextureCache::getAtlasTexture(SkBitmap* bitmap) const {
+    return mAtlas.getEntryTexture(bitmap);
+}
+
 void TextureCache::remove(SkBitmap* bitmap) {
     mCache.remove(bitmap);
+    mAtlas.remove(bitmap);
 }
 
 void TextureCache::removeDeferred(SkBitmap* bitmap) {
@@ -184,13 +240,16 @@ void TextureCache::clearGarbage() {
     Mutex::Autolock _l(mLock);
     size_t count = mGarbage.size();
     for (size_t i = 0; i < count; i++) {
-        mCache.remove(mGarbage.itemAt(i));
+        SkBitmap* bitmap = mGarbage.itemAt(i);
+        mCache.remove(bitmap);
+        mAtlas.remove(bitmap);
     }
     mGarbage.clear();
 }
 
 void TextureCache::clear() {
     mCache.clear();
+    mAtlas.clear();
     TEXTURE_LOGD("TextureCache:clear(), mSize = %d", mSize);
 }
 
@@ -209,6 +268,149 @@ void TextureCache::flush() {
     }
 }
 
+void TextureCache::endFrame() {
+    processUploads();
+    mAtlas.endFrame();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Asynchronous uploads
+///////////////////////////////////////////////////////////////////////////////
+
+bool TextureCache::uploadAsync(SkBitmap* bitmap, Texture* texture) {
+    Caches& caches = Caches::getInstance();
+    if (!caches.gpuPixelBuffersEnabled) return false;
+
+    GLenum format;
+    switch (bitmap->getConfig()) {
+        case SkBitmap::kA8_Config:
+            format = GL_ALPHA;
+            break;
+        case SkBitmap::kARGB_8888_Config:
+            format = GL_RGBA;
+            break;
+        default:
+            // Other configs require a conversion, which is as expensive as
+            // the upload itself
+            return false;
+    }
+
+    const uint32_t size = bitmap->rowBytes() * bitmap->height();
+    if (size < ASYNC_UPLOAD_MIN_SIZE || mUploadsSize + size > ASYNC_UPLOAD_MAX_SIZE) {
+        return false;
+    }
+
+    // Mipmaps must be generated after the upload, which would wait for it
+    if (bitmap->hasHardwareMipMap()) return false;
+
+    // The previous texture is drawn until the upload completes, which
+    // only makes sense if it has the same dimensions
+    if (texture->id && (bitmap->width() != int(texture->width) ||
+            bitmap->height() != int(texture->height))) {
+        return false;
+    }
+
+    SkAutoLockPixels alp(*bitmap);
+    if (!bitmap->readyToDraw()) return false;
+
+    const uint32_t width = bitmap->width();
+    const uint32_t height = bitmap->height();
+
+    PixelBuffer* buffer = PixelBuffer::create(format, width, height);
+    uint8_t* dst = buffer->map(PixelBuffer::kAccessMode_Write);
+    if (!dst) {
+        delete buffer;
+        caches.unbindPixelBuffer();
+        return false;
+    }
+
+    const uint8_t* src = (const uint8_t*) bitmap->getPixels();
+    const size_t rowSize = width * PixelBuffer::formatSize(format);
+    for (uint32_t y = 0; y < height; y++) {
+        memcpy(dst, src, rowSize);
+        dst += rowSize;
+        src += bitmap->rowBytes();
+    }
+
+    AsyncUpload upload;
+    upload.width = width;
+    upload.height = height;
+    // Do this after calling getPixels() to make sure Skia's deferred
+    // decoding happened
+    upload.blend = format == GL_ALPHA || !bitmap->isOpaque();
+    upload.buffer = buffer;
+
+    glGenTextures(1, &upload.id);
+    caches.bindTexture(upload.id);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, bitmap->bytesPerPixel());
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, NULL);
+    buffer->upload(0, 0, width, height);
+    caches.unbindPixelBuffer();
+
+    upload.fence = new Fence();
+
+    texture->generation = bitmap->getGenerationID();
+
+    mUploads.add(texture, upload);
+    mUploadsSize += buffer->getSize();
+
+    TEXTURE_LOGD("TextureCache::uploadAsync: started upload of %p (%dx%d), pending = %d",
+            bitmap, width, height, mUploads.size());
+
+    return true;
+}
+
+void TextureCache::finishUpload(size_t index) {
+    Texture* texture = mUploads.keyAt(index);
+    const AsyncUpload& upload = mUploads.valueAt(index);
+
+    // Replace the previous texture, if any
+    if (texture->id) {
+        texture->deleteTexture();
+    }
+
+    texture->id = upload.id;
+    texture->width = upload.width;
+    texture->height = upload.height;
+    texture->blend = upload.blend;
+    texture->mipMap = false;
+
+    // The new OpenGL texture uses the default parameters
+    Caches::getInstance().bindTexture(texture->id);
+    texture->setFilter(GL_NEAREST, false, true);
+    texture->setWrap(GL_CLAMP_TO_EDGE, false, true);
+
+    TEXTURE_LOGD("TextureCache::finishUpload: name = %d", texture->id);
+
+    releaseUpload(upload);
+    mUploads.removeItemsAt(index);
+}
+
+void TextureCache::cancelUpload(Texture* texture) {
+    ssize_t index = mUploads.indexOfKey(texture);
+    if (index >= 0) {
+        const AsyncUpload& upload = mUploads.valueAt(index);
+        Caches::getInstance().deleteTexture(upload.id);
+        releaseUpload(upload);
+        mUploads.removeItemsAt(index);
+    }
+}
+
+void TextureCache::releaseUpload(const AsyncUpload& upload) {
+    mUploadsSize -= upload.buffer->getSize();
+    delete upload.fence;
+    delete upload.buffer;
+}
+
+void TextureCache::processUploads() {
+    for (size_t i = mUploads.size(); i > 0; i--) {
+        if (mUploads.valueAt(i - 1).fence->isSignaled()) {
+            finishUpload(i - 1);
+        }
+    }
+}
+
 void TextureCache::generateTexture(SkBitmap* bitmap, Texture* texture, bool regenerate) {
     SkAutoLockPixels alp(*bitmap);
 
@@ -19,12 +19,17 @@
 
 #include <SkBitmap.h>
 
-#include <utils/LruCache.h>
+#include <utils/KeyedVector.h>
 #include <utils/Mutex.h>
 #include <utils/Vector.h>
 
 #include "Debug.h"
+#include "Fence.h"
+#include "MemoryBudget.h"
+#include "PixelBuffer.h"
 #include "Texture.h"
+#include "TextureAtlas.h"
+#include "utils/ClockCache.h"
 
 namespace android {
 namespace uirenderer {
@@ -49,7 +54,7 @@ namespace uirenderer {
  * Any texture added to the cache causing the cache to grow beyond the maximum
  * allowed size will also cause the oldest texture to be kicked out.
  */
-class TextureCache: public OnEntryRemoved<SkBitmap*, Texture*> {
+class TextureCache: public OnEntryRemoved<SkBitmap*, Texture*>, public MemoryBudget::Client {
 public:
     TextureCache();
     TextureCache(uint32_t maxByteSize);
@@ -66,11 +71,31 @@ public:
      * cannot be found in the cache, a new texture is generated.
      */
     Texture* get(SkBitmap* bitmap);
+    /**
+     * Returns the texture associated with the specified bitmap. Large
+     * bitmaps are uploaded asynchronously through a pixel buffer: until
+     * the upload completes this method returns the texture previously
+     * generated for the bitmap, or NULL if there is none.
+     */
+    Texture* getAsync(SkBitmap* bitmap);
     /**
      * Returns the texture associated with the specified bitmap. The generated
      * texture is not kept in the cache. The caller must destroy the texture.
      */
     Texture* getTransient(SkBitmap* bitmap);
+    /**
+     * Returns the runtime atlas entry associated with the specified bitmap,
+     * packing the bitmap in the atlas if needed. Returns NULL if the bitmap
+     * cannot be stored in the atlas. The returned entry remains valid until
+     * the end of the current frame.
+     */
+    TextureAtlas::Entry* getAtlasEntry(SkBitmap* bitmap);
+    /**
+     * Returns the runtime atlas texture associated with the specified
+     * bitmap, or NULL if the bitmap is not in the atlas. This method
+     * never packs the bitmap.
+     */
+    Texture* getAtlasTexture(SkBitmap* bitmap) const;
     /**
      * Removes the texture associated with the specified bitmap.
      * Upon remove the texture is freed.
@@ -103,6 +128,15 @@ public:
      * Returns the current size of the cache in bytes.
      */
     uint32_t getSize();
+    /**
+     * Returns the size of the runtime atlas in bytes.
+     */
+    uint32_t getAtlasSize() const;
+    /**
+     * Returns the generation id of the runtime atlas, which changes
+     * every time a bitmap is packed in, or removed from, the atlas.
+     */
+    uint32_t getAtlasGenerationId() const;
 
     /**
      * Partially flushes the cache. The amount of memory freed by a flush
@@ -115,7 +149,49 @@ public:
      */
     void setFlushRate(float flushRate);
 
+    /**
+     * Must be invoked at the end of each frame to let the
+     * runtime atlas recycle its space.
+     */
+    void endFrame();
+
+    /**
+     * Returns true if at least one asynchronous upload has not completed
+     * yet. Another frame should be drawn to display the texture once the
+     * upload completes.
+     */
+    bool hasPendingUploads() const {
+        return mUploads.size() > 0;
+    }
+
 private:
+    /**
+     * Describes a texture upload performed through a pixel buffer. The
+     * texture can be used without stalling once the fence is signaled.
+     */
+    struct AsyncUpload {
+        AsyncUpload(): id(0), width(0), height(0), blend(false), buffer(NULL), fence(NULL) { }
+
+        GLuint id;
+        uint32_t width;
+        uint32_t height;
+        bool blend;
+        PixelBuffer* buffer;
+        Fence* fence;
+    };
+
+    Texture* get(SkBitmap* bitmap, bool allowAsync);
+
+    /**
+     * Starts uploading the bitmap into a new OpenGL texture using a pixel
+     * buffer. Returns false if the bitmap cannot be uploaded asynchronously.
+     */
+    bool uploadAsync(SkBitmap* bitmap, Texture* texture);
+    void finishUpload(size_t index);
+    void cancelUpload(Texture* texture);
+    void releaseUpload(const AsyncUpload& upload);
+    void processUploads();
+
     /**
      * Generates the texture from a bitmap into the specified texture structure.
      *
@@ -130,7 +206,8 @@ private:
 
     void init();
 
-    LruCache<SkBitmap*, Texture*> mCache;
+    ClockCache<SkBitmap*, Texture*> mCache;
+    TextureAtlas mAtlas;
 
     uint32_t mSize;
     uint32_t mMaxSize;
@@ -140,6 +217,9 @@ private:
 
     bool mDebugEnabled;
 
+    KeyedVector<Texture*, AsyncUpload> mUploads;
+    uint32_t mUploadsSize;
+
     Vector<SkBitmap*> mGarbage;
     mutable Mutex mLock;
 }; // class TextureCache
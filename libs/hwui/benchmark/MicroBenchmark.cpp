@@ -0,0 +1,472 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures the caches and the tessellation of the renderer on synthetic
+ * inputs, in an offscreen context, and reports the time per operation:
+ *
+ *   hwuimicrobench [sample count] [name prefix]
+ *
+ * Each benchmark runs a fixed number of operations per sample. The median,
+ * minimum and maximum time per operation over the samples are printed, one
+ * benchmark per line, so that the output can be compared across builds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include <SkBitmap.h>
+#include <SkPaint.h>
+#include <SkPath.h>
+
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include <Caches.h>
+#include <DisplayList.h>
+#include <DisplayListRenderer.h>
+#include <FontRenderer.h>
+#include <Matrix.h>
+#include <OpenGLRenderer.h>
+#include <PathTessellator.h>
+#include <TextureCache.h>
+#include <utils/Blur.h>
+
+#include "OffscreenContext.h"
+
+using namespace android;
+using namespace android::uirenderer;
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+#define DEFAULT_SAMPLE_COUNT 10
+
+#define SURFACE_WIDTH 1080
+#define SURFACE_HEIGHT 1920
+
+// Results the compiler must not optimize away are written here
+static volatile float gSink;
+
+///////////////////////////////////////////////////////////////////////////////
+// Benchmarks
+///////////////////////////////////////////////////////////////////////////////
+
+class Benchmark {
+public:
+    Benchmark(const char* name, size_t operations): mName(name), mOperations(operations) {
+    }
+
+    virtual ~Benchmark() {
+    }
+
+    const char* getName() const {
+        return mName;
+    }
+
+    size_t getOperations() const {
+        return mOperations;
+    }
+
+    /**
+     * Runs the operations of one sample.
+     */
+    virtual void run(size_t operations) = 0;
+
+private:
+    const char* mName;
+    size_t mOperations;
+}; // class Benchmark
+
+class TessellationBenchmark: public Benchmark {
+public:
+    TessellationBenchmark(const char* name, const SkPath& path, SkPaint::Style style,
+            float strokeWidth): Benchmark(name, 1000), mPath(path) {
+        mPaint.setAntiAlias(true);
+        mPaint.setStyle(style);
+        mPaint.setStrokeWidth(strokeWidth);
+    }
+
+    virtual void run(size_t operations) {
+        for (size_t i = 0; i < operations; i++) {
+            VertexBuffer vertexBuffer;
+            PathTessellator::tessellatePath(mPath, &mPaint, &mat4::identity(), vertexBuffer);
+            gSink = vertexBuffer.getVertexCount();
+        }
+    }
+
+private:
+    SkPath mPath;
+    SkPaint mPaint;
+}; // class TessellationBenchmark
+
+class FontBenchmark: public Benchmark {
+public:
+    FontBenchmark(const char* name, bool warm): Benchmark(name, warm ? 1000 : 20),
+            mWarm(warm), mRenderer(NULL) {
+        for (int i = 0; i < 256; i++) {
+            mGammaTable[i] = i;
+        }
+
+        mPaint.setAntiAlias(true);
+        mPaint.setTextSize(18.0f);
+        const char* text = "The quick brown fox jumps over the lazy dog 0123456789,.;!?";
+        mGlyphs.insertAt(0, strlen(text));
+        mPaint.textToGlyphs(text, strlen(text), mGlyphs.editArray());
+        mPaint.setTextEncoding(SkPaint::kGlyphID_TextEncoding);
+
+        if (mWarm) {
+            mRenderer = createRenderer();
+            precache(mRenderer);
+        }
+    }
+
+    virtual ~FontBenchmark() {
+        delete mRenderer;
+    }
+
+    virtual void run(size_t operations) {
+        for (size_t i = 0; i < operations; i++) {
+            if (mWarm) {
+                precache(mRenderer);
+            } else {
+                // Every glyph is rasterized and uploaded to new cache textures
+                FontRenderer* renderer = createRenderer();
+                precache(renderer);
+                delete renderer;
+            }
+        }
+    }
+
+private:
+    FontRenderer* createRenderer() {
+        FontRenderer* renderer = new FontRenderer();
+        renderer->setGammaTable(mGammaTable);
+        return renderer;
+    }
+
+    void precache(FontRenderer* renderer) {
+        renderer->precache(&mPaint, (const char*) mGlyphs.array(), mGlyphs.size(),
+                mat4::identity());
+        renderer->endPrecaching();
+    }
+
+    const bool mWarm;
+    FontRenderer* mRenderer;
+    SkPaint mPaint;
+    Vector<uint16_t> mGlyphs;
+    uint8_t mGammaTable[256];
+}; // class FontBenchmark
+
+class BlurBenchmark: public Benchmark {
+public:
+    BlurBenchmark(const char* name, int32_t radius, bool approximate):
+            Benchmark(name, approximate ? 100 : 20), mRadius(radius), mApproximate(approximate) {
+        mImage = new uint8_t[kSize * kSize];
+        mScratch = new uint8_t[kSize * kSize];
+        for (int32_t i = 0; i < kSize * kSize; i++) {
+            mImage[i] = (i * 31) & 0xff;
+        }
+        mWeights = new float[2 * radius + 1];
+    }
+
+    virtual ~BlurBenchmark() {
+        delete[] mImage;
+        delete[] mScratch;
+        delete[] mWeights;
+    }
+
+    virtual void run(size_t operations) {
+        for (size_t i = 0; i < operations; i++) {
+            if (mApproximate) {
+                Blur::approximateGaussian(mRadius, mImage, mScratch, kSize, kSize);
+            } else {
+                Blur::generateGaussianWeights(mWeights, mRadius);
+                Blur::horizontal(mWeights, mRadius, mImage, mScratch, kSize, kSize);
+                Blur::vertical(mWeights, mRadius, mScratch, mImage, kSize, kSize);
+            }
+        }
+    }
+
+private:
+    static const int32_t kSize = 256;
+
+    const int32_t mRadius;
+    const bool mApproximate;
+    uint8_t* mImage;
+    uint8_t* mScratch;
+    float* mWeights;
+}; // class BlurBenchmark
+
+class TextureUploadBenchmark: public Benchmark {
+public:
+    TextureUploadBenchmark(const char* name, int width, int height): Benchmark(name, 50) {
+        mBitmap.setConfig(SkBitmap::kARGB_8888_Config, width, height);
+        mBitmap.allocPixels();
+        mBitmap.eraseARGB(0xff, 0x33, 0x66, 0x99);
+    }
+
+    virtual ~TextureUploadBenchmark() {
+        Caches::getInstance().textureCache.remove(&mBitmap);
+    }
+
+    virtual void run(size_t operations) {
+        TextureCache& cache = Caches::getInstance().textureCache;
+        for (size_t i = 0; i < operations; i++) {
+            cache.remove(&mBitmap);
+            cache.get(&mBitmap);
+        }
+        // The uploads are only complete once the GPU is done with them
+        glFinish();
+    }
+
+private:
+    SkBitmap mBitmap;
+}; // class TextureUploadBenchmark
+
+/**
+ * Defers and flushes a synthetic frame: rects, round rects, bitmaps and text
+ * in saved and clipped groups, as drawn by a list of views.
+ */
+class DisplayListBenchmark: public Benchmark {
+public:
+    DisplayListBenchmark(const char* name, int groupCount): Benchmark(name, 50) {
+        mBitmaps[0].setConfig(SkBitmap::kARGB_8888_Config, 48, 48);
+        mBitmaps[1].setConfig(SkBitmap::kARGB_8888_Config, 96, 96);
+        for (int i = 0; i < 2; i++) {
+            mBitmaps[i].allocPixels();
+            mBitmaps[i].eraseARGB(0xff, 0x20 * i, 0x80, 0xc0);
+        }
+
+        SkPaint textPaint;
+        textPaint.setAntiAlias(true);
+        textPaint.setTextSize(16.0f);
+        const char* text = "Item title";
+        const size_t glyphCount = strlen(text);
+        uint16_t glyphs[glyphCount];
+        float positions[glyphCount * 2];
+        textPaint.textToGlyphs(text, glyphCount, glyphs);
+        textPaint.setTextEncoding(SkPaint::kGlyphID_TextEncoding);
+        for (size_t i = 0; i < glyphCount; i++) {
+            positions[i * 2] = 80.0f + i * 9.0f;
+            positions[i * 2 + 1] = 30.0f;
+        }
+
+        DisplayListRenderer* recorder = new DisplayListRenderer();
+        recorder->setViewport(SURFACE_WIDTH, SURFACE_HEIGHT);
+        recorder->prepare(false);
+
+        SkPaint paint;
+        for (int i = 0; i < groupCount; i++) {
+            const float top = (i * 60) % SURFACE_HEIGHT;
+            recorder->save(SkCanvas::kMatrix_SaveFlag | SkCanvas::kClip_SaveFlag);
+            recorder->translate(0.0f, top);
+            recorder->clipRect(0.0f, 0.0f, SURFACE_WIDTH, 60.0f, SkRegion::kIntersect_Op);
+
+            paint.setColor(i & 1 ? 0xfff0f0f0 : 0xffffffff);
+            recorder->drawRect(0.0f, 0.0f, SURFACE_WIDTH, 60.0f, &paint);
+            paint.setColor(0xff3366cc);
+            paint.setAntiAlias(true);
+            recorder->drawRoundRect(SURFACE_WIDTH - 120.0f, 10.0f, SURFACE_WIDTH - 20.0f, 50.0f,
+                    8.0f, 8.0f, &paint);
+            paint.setAntiAlias(false);
+            recorder->drawBitmap(&mBitmaps[i % 2], 10.0f, 6.0f, NULL);
+            recorder->drawPosText((const char*) glyphs, glyphCount * 2, glyphCount,
+                    positions, &textPaint);
+
+            recorder->restore();
+        }
+        recorder->finish();
+
+        mDisplayList = recorder->getDisplayList(NULL);
+        delete recorder;
+
+        mRenderer = new OpenGLRenderer();
+        mRenderer->initProperties();
+        mRenderer->setViewport(SURFACE_WIDTH, SURFACE_HEIGHT);
+    }
+
+    virtual ~DisplayListBenchmark() {
+        delete mRenderer;
+        DisplayList::destroyDisplayListDeferred(mDisplayList);
+    }
+
+    virtual void run(size_t operations) {
+        for (size_t i = 0; i < operations; i++) {
+            Rect dirty;
+            mRenderer->prepare(false);
+            mRenderer->drawDisplayList(mDisplayList, dirty, DisplayList::kReplayFlag_ClipChildren);
+            mRenderer->finish();
+        }
+        glFinish();
+    }
+
+private:
+    SkBitmap mBitmaps[2];
+    DisplayList* mDisplayList;
+    OpenGLRenderer* mRenderer;
+}; // class DisplayListBenchmark
+
+class MatrixBenchmark: public Benchmark {
+public:
+    enum Operation {
+        kMultiply,
+        kInverse,
+        kMapRect
+    };
+
+    MatrixBenchmark(const char* name, Operation operation):
+            Benchmark(name, 100000), mOperation(operation) {
+        mMatrix.loadRotate(30.0f);
+        mMatrix.scale(1.5f, 0.75f, 1.0f);
+        mMatrix.translate(12.0f, 34.0f);
+    }
+
+    virtual void run(size_t operations) {
+        mat4 result;
+        Rect rect;
+        for (size_t i = 0; i < operations; i++) {
+            switch (mOperation) {
+                case kMultiply:
+                    result.loadMultiply(mMatrix, mMatrix);
+                    gSink = result[0];
+                    break;
+                case kInverse:
+                    result.loadInverse(mMatrix);
+                    gSink = result[0];
+                    break;
+                case kMapRect:
+                    rect.set(0.0f, 0.0f, i & 0xff, 100.0f);
+                    mMatrix.mapRect(rect);
+                    gSink = rect.left;
+                    break;
+            }
+        }
+    }
+
+private:
+    const Operation mOperation;
+    mat4 mMatrix;
+}; // class MatrixBenchmark
+
+///////////////////////////////////////////////////////////////////////////////
+// Timings
+///////////////////////////////////////////////////////////////////////////////
+
+static int compareTimes(const double* lhs, const double* rhs) {
+    return *lhs < *rhs ? -1 : (*lhs > *rhs ? 1 : 0);
+}
+
+static void runBenchmark(Benchmark* benchmark, int sampleCount) {
+    const size_t operations = benchmark->getOperations();
+
+    // The first run fills the caches the benchmark does not measure
+    benchmark->run(operations);
+
+    Vector<double> times;
+    for (int i = 0; i < sampleCount; i++) {
+        const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        benchmark->run(operations);
+        const nsecs_t time = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        times.add(double(time) / operations);
+    }
+    times.sort(compareTimes);
+
+    printf("%-28s %12.1f %12.1f %12.1f\n", benchmark->getName(),
+            times[times.size() / 2], times[0], times.top());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Main
+///////////////////////////////////////////////////////////////////////////////
+
+static void addTessellationBenchmarks(Vector<Benchmark*>& benchmarks) {
+    SkPath rect;
+    rect.addRect(10.0f, 10.0f, 310.0f, 210.0f);
+    benchmarks.add(new TessellationBenchmark("tessellate_rect_fill", rect,
+            SkPaint::kFill_Style, 0.0f));
+
+    SkPath roundRect;
+    roundRect.addRoundRect(SkRect::MakeLTRB(10.0f, 10.0f, 310.0f, 210.0f), 16.0f, 16.0f);
+    benchmarks.add(new TessellationBenchmark("tessellate_roundrect_fill", roundRect,
+            SkPaint::kFill_Style, 0.0f));
+
+    SkPath circle;
+    circle.addCircle(200.0f, 200.0f, 150.0f);
+    benchmarks.add(new TessellationBenchmark("tessellate_circle_stroke", circle,
+            SkPaint::kStroke_Style, 6.0f));
+    benchmarks.add(new TessellationBenchmark("tessellate_circle_hairline", circle,
+            SkPaint::kStroke_Style, 0.0f));
+
+    // A wavy closed shape made of cubics
+    SkPath curves;
+    curves.moveTo(0.0f, 200.0f);
+    for (int i = 0; i < 32; i++) {
+        const float x = i * 20.0f;
+        curves.cubicTo(x + 5.0f, (i & 1) ? 100.0f : 300.0f,
+                x + 15.0f, (i & 1) ? 300.0f : 100.0f, x + 20.0f, 200.0f);
+    }
+    curves.lineTo(640.0f, 400.0f);
+    curves.lineTo(0.0f, 400.0f);
+    curves.close();
+    benchmarks.add(new TessellationBenchmark("tessellate_curves_fill", curves,
+            SkPaint::kFill_Style, 0.0f));
+    benchmarks.add(new TessellationBenchmark("tessellate_curves_stroke", curves,
+            SkPaint::kStroke_Style, 3.0f));
+}
+
+int main(int argc, char** argv) {
+    const int sampleCount = argc > 1 ? atoi(argv[1]) : DEFAULT_SAMPLE_COUNT;
+    const char* prefix = argc > 2 ? argv[2] : "";
+    if (sampleCount <= 0) {
+        fprintf(stderr, "Usage: %s [sample count] [name prefix]\n", argv[0]);
+        return 1;
+    }
+
+    OffscreenContext context;
+    if (!context.init(SURFACE_WIDTH, SURFACE_HEIGHT)) return 1;
+    Caches::getInstance();
+
+    Vector<Benchmark*> benchmarks;
+    addTessellationBenchmarks(benchmarks);
+    benchmarks.add(new FontBenchmark("font_precache_cold", false));
+    benchmarks.add(new FontBenchmark("font_precache_warm", true));
+    benchmarks.add(new BlurBenchmark("blur_gaussian_r8", 8, false));
+    benchmarks.add(new BlurBenchmark("blur_approximate_r25", 25, true));
+    benchmarks.add(new TextureUploadBenchmark("texture_upload_256", 256, 256));
+    benchmarks.add(new TextureUploadBenchmark("texture_upload_1024", 1024, 1024));
+    benchmarks.add(new DisplayListBenchmark("displaylist_defer_flush_64", 64));
+    benchmarks.add(new DisplayListBenchmark("displaylist_defer_flush_512", 512));
+    benchmarks.add(new MatrixBenchmark("matrix_multiply", MatrixBenchmark::kMultiply));
+    benchmarks.add(new MatrixBenchmark("matrix_inverse", MatrixBenchmark::kInverse));
+    benchmarks.add(new MatrixBenchmark("matrix_map_rect", MatrixBenchmark::kMapRect));
+
+    printf("%d samples, times in ns per operation\n", sampleCount);
+    printf("%-28s %12s %12s %12s\n", "benchmark", "median", "min", "max");
+    for (size_t i = 0; i < benchmarks.size(); i++) {
+        Benchmark* benchmark = benchmarks[i];
+        if (!strncmp(benchmark->getName(), prefix, strlen(prefix))) {
+            runBenchmark(benchmark, sampleCount);
+        }
+        delete benchmark;
+    }
+    return 0;
+}
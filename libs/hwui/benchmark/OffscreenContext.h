@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_BENCHMARK_OFFSCREEN_CONTEXT_H
+#define ANDROID_HWUI_BENCHMARK_OFFSCREEN_CONTEXT_H
+
+#include <stdio.h>
+
+#include <EGL/egl.h>
+
+/**
+ * A GLES 2.0 context current on a pbuffer surface, for the benchmarks.
+ */
+class OffscreenContext {
+public:
+    OffscreenContext(): mDisplay(EGL_NO_DISPLAY), mConfig(NULL), mContext(EGL_NO_CONTEXT),
+            mSurface(EGL_NO_SURFACE) {
+    }
+
+    ~OffscreenContext() {
+        if (mDisplay == EGL_NO_DISPLAY) return;
+
+        eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (mSurface != EGL_NO_SURFACE) eglDestroySurface(mDisplay, mSurface);
+        if (mContext != EGL_NO_CONTEXT) eglDestroyContext(mDisplay, mContext);
+        eglTerminate(mDisplay);
+    }
+
+    bool init(int width, int height) {
+        mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (mDisplay == EGL_NO_DISPLAY || !eglInitialize(mDisplay, NULL, NULL)) {
+            fprintf(stderr, "Could not initialize EGL\n");
+            return false;
+        }
+
+        const EGLint configAttribs[] = {
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+                EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                EGL_RED_SIZE, 8,
+                EGL_GREEN_SIZE, 8,
+                EGL_BLUE_SIZE, 8,
+                EGL_ALPHA_SIZE, 8,
+                EGL_STENCIL_SIZE, 8,
+                EGL_NONE
+        };
+        EGLConfig config;
+        EGLint configCount;
+        if (!eglChooseConfig(mDisplay, configAttribs, &config, 1, &configCount) ||
+                configCount != 1) {
+            fprintf(stderr, "Could not find an EGL config\n");
+            return false;
+        }
+
+        mConfig = config;
+
+        const EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+        mContext = eglCreateContext(mDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+        if (mContext == EGL_NO_CONTEXT) {
+            fprintf(stderr, "Could not create an EGL context\n");
+            return false;
+        }
+
+        return resize(width, height);
+    }
+
+    /**
+     * Replaces the surface with a surface of the specified size. The context,
+     * and the GL objects it holds, are kept.
+     */
+    bool resize(int width, int height) {
+        const EGLint surfaceAttribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+        EGLSurface surface = eglCreatePbufferSurface(mDisplay, mConfig, surfaceAttribs);
+        if (surface == EGL_NO_SURFACE || !eglMakeCurrent(mDisplay, surface, surface, mContext)) {
+            fprintf(stderr, "Could not create a %dx%d offscreen surface\n", width, height);
+            return false;
+        }
+
+        if (mSurface != EGL_NO_SURFACE) eglDestroySurface(mDisplay, mSurface);
+        mSurface = surface;
+        return true;
+    }
+
+private:
+    EGLDisplay mDisplay;
+    EGLConfig mConfig;
+    EGLContext mContext;
+    EGLSurface mSurface;
+}; // class OffscreenContext
+
+#endif // ANDROID_HWUI_BENCHMARK_OFFSCREEN_CONTEXT_H
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays a frame captured with DisplayListCapture (see the property
+ * debug.hwui.capture_frame) into an offscreen surface, and reports the
+ * time spent in each stage of the frame:
+ *
+ *   hwuireplay <capture file> [frame count]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include <DisplayList.h>
+#include <DisplayListCapture.h>
+#include <OpenGLRenderer.h>
+
+#include "OffscreenContext.h"
+
+using namespace android;
+using namespace android::uirenderer;
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+#define DEFAULT_FRAME_COUNT 100
+
+///////////////////////////////////////////////////////////////////////////////
+// Timings
+///////////////////////////////////////////////////////////////////////////////
+
+class Stage {
+public:
+    Stage(const char* name): mName(name) {
+    }
+
+    void add(nsecs_t time) {
+        mTimes.add(time);
+    }
+
+    void print() {
+        if (mTimes.isEmpty()) return;
+
+        mTimes.sort(compare);
+        nsecs_t total = 0;
+        for (size_t i = 0; i < mTimes.size(); i++) {
+            total += mTimes[i];
+        }
+
+        printf("  %-10s %8.3f %8.3f %8.3f %8.3f\n", mName,
+                toMs(mTimes[0]), toMs(mTimes[mTimes.size() / 2]),
+                toMs(total / mTimes.size()), toMs(mTimes.top()));
+    }
+
+private:
+    static int compare(const nsecs_t* lhs, const nsecs_t* rhs) {
+        return *lhs < *rhs ? -1 : (*lhs > *rhs ? 1 : 0);
+    }
+
+    static double toMs(nsecs_t time) {
+        return time / 1000000.0;
+    }
+
+    const char* mName;
+    Vector<nsecs_t> mTimes;
+}; // class Stage
+
+static nsecs_t now() {
+    return systemTime(SYSTEM_TIME_MONOTONIC);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Main
+///////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <capture file> [frame count]\n", argv[0]);
+        return 1;
+    }
+    const int frameCount = argc > 2 ? atoi(argv[2]) : DEFAULT_FRAME_COUNT;
+
+    // The size of the surface is only known once the capture is read, which
+    // already requires a context: start with a minimal surface
+    OffscreenContext context;
+    if (!context.init(1, 1)) return 1;
+
+    nsecs_t start = now();
+    CapturedDisplayList* capture = new CapturedDisplayList();
+    if (!capture->read(argv[1])) {
+        fprintf(stderr, "Could not read %s\n", argv[1]);
+        return 1;
+    }
+    const nsecs_t readTime = now() - start;
+
+    const int width = capture->getWidth();
+    const int height = capture->getHeight();
+    if (width <= 0 || height <= 0 || !context.resize(width, height)) {
+        fprintf(stderr, "Invalid capture size %dx%d\n", width, height);
+        return 1;
+    }
+
+    printf("%s: %dx%d, read in %.3f ms, %u ops dropped at capture\n", argv[1],
+            width, height, readTime / 1000000.0, capture->getDroppedOpsCount());
+
+    OpenGLRenderer* renderer = new OpenGLRenderer();
+    renderer->initProperties();
+    renderer->setViewport(width, height);
+
+    Stage prepare("prepare");
+    Stage draw("draw");
+    Stage finish("finish");
+    Stage gpu("gpu");
+    Stage frame("frame");
+
+    DisplayList* displayList = capture->getDisplayList();
+    for (int i = 0; i < frameCount; i++) {
+        uirenderer::Rect dirty;
+
+        const nsecs_t frameStart = now();
+        start = frameStart;
+        renderer->prepare(false);
+        nsecs_t end = now();
+        prepare.add(end - start);
+
+        start = end;
+        renderer->drawDisplayList(displayList, dirty, DisplayList::kReplayFlag_ClipChildren);
+        end = now();
+        draw.add(end - start);
+
+        start = end;
+        renderer->finish();
+        end = now();
+        finish.add(end - start);
+
+        start = end;
+        glFinish();
+        end = now();
+        gpu.add(end - start);
+
+        frame.add(end - frameStart);
+    }
+
+    printf("%d frames, times in ms\n", frameCount);
+    printf("  %-10s %8s %8s %8s %8s\n", "stage", "min", "median", "mean", "max");
+    prepare.print();
+    draw.print();
+    finish.print();
+    gpu.print();
+    frame.print();
+
+    delete renderer;
+    delete capture;
+    return 0;
+}
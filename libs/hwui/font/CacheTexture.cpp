@@ -257,12 +257,17 @@ bool CacheTexture::fitBitmap(const SkGlyph& glyph, uint32_t* retOriginX, uint32_
             return false;
     }
 
-    if (glyph.fHeight + TEXTURE_BORDER_SIZE * 2 > mHeight) {
+    return fitBitmap(glyph.fWidth, glyph.fHeight, retOriginX, retOriginY);
+}
+
+bool CacheTexture::fitBitmap(uint32_t width, uint32_t height,
+        uint32_t* retOriginX, uint32_t* retOriginY) {
+    if (height + TEXTURE_BORDER_SIZE * 2 > mHeight) {
         return false;
     }
 
-    uint16_t glyphW = glyph.fWidth + TEXTURE_BORDER_SIZE;
-    uint16_t glyphH = glyph.fHeight + TEXTURE_BORDER_SIZE;
+    uint16_t glyphW = width + TEXTURE_BORDER_SIZE;
+    uint16_t glyphH = height + TEXTURE_BORDER_SIZE;
 
     // roundedUpW equals glyphW to the next multiple of CACHE_BLOCK_ROUNDING_SIZE.
     // This columns for glyphs that are close but not necessarily exactly the same size. It trades
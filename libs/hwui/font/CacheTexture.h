@@ -92,6 +92,13 @@ public:
 
     bool fitBitmap(const SkGlyph& glyph, uint32_t* retOriginX, uint32_t* retOriginY);
 
+    /**
+     * Finds room for a bitmap of the specified dimensions, in pixels, without
+     * checking its format. Used to move glyphs already stored in a cache texture
+     * of the same format.
+     */
+    bool fitBitmap(uint32_t width, uint32_t height, uint32_t* retOriginX, uint32_t* retOriginY);
+
     inline uint16_t getWidth() const {
         return mWidth;
     }
@@ -50,6 +50,10 @@ struct CachedGlyphInfo {
     SkFixed mLsbDelta;
     SkFixed mRsbDelta;
     CacheTexture* mCacheTexture;
+    // Generation of the font renderer when the glyph was last
+    // used, least recently used glyphs are evicted first when
+    // cache textures are compacted
+    uint32_t mGeneration;
 };
 
 }; // namespace uirenderer
@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+
+#include "DistanceField.h"
+
+namespace android {
+namespace uirenderer {
+
+// Offset of the pixels that have no seed yet, far enough to never be
+// the nearest seed but small enough to not overflow squaredLength()
+#define DISTANCE_FIELD_FAR 4096
+
+///////////////////////////////////////////////////////////////////////////////
+// Euclidean distance transform
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Replaces the offset of the pixel at x, y with the offset of one of its
+ * neighbors if that neighbor leads to a closer seed.
+ */
+inline void DistanceField::compare(Offset* grid, int32_t gridWidth, Offset& offset,
+        int32_t x, int32_t y, int32_t offsetX, int32_t offsetY) {
+    Offset other = grid[(y + offsetY) * gridWidth + x + offsetX];
+    other.dx += offsetX;
+    other.dy += offsetY;
+
+    if (other.squaredLength() < offset.squaredLength()) {
+        offset = other;
+    }
+}
+
+/**
+ * 8-point sequential signed Euclidean distance transform (8SSEDT). The grid
+ * has a one pixel border which is never written to, avoiding bounds checks.
+ * Each pixel ends up with the offset to its nearest seed after two passes.
+ */
+void DistanceField::propagate(Offset* grid, int32_t width, int32_t height) {
+    const int32_t gridWidth = width + 2;
+
+    // Top to bottom
+    for (int32_t y = 1; y <= height; y++) {
+        for (int32_t x = 1; x <= width; x++) {
+            Offset& offset = grid[y * gridWidth + x];
+            compare(grid, gridWidth, offset, x, y, -1,  0);
+            compare(grid, gridWidth, offset, x, y,  0, -1);
+            compare(grid, gridWidth, offset, x, y, -1, -1);
+            compare(grid, gridWidth, offset, x, y,  1, -1);
+        }
+        for (int32_t x = width; x >= 1; x--) {
+            compare(grid, gridWidth, grid[y * gridWidth + x], x, y, 1, 0);
+        }
+    }
+
+    // Bottom to top
+    for (int32_t y = height; y >= 1; y--) {
+        for (int32_t x = width; x >= 1; x--) {
+            Offset& offset = grid[y * gridWidth + x];
+            compare(grid, gridWidth, offset, x, y,  1,  0);
+            compare(grid, gridWidth, offset, x, y,  0,  1);
+            compare(grid, gridWidth, offset, x, y, -1,  1);
+            compare(grid, gridWidth, offset, x, y,  1,  1);
+        }
+        for (int32_t x = 1; x <= width; x++) {
+            compare(grid, gridWidth, grid[y * gridWidth + x], x, y, -1, 0);
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Distance field
+///////////////////////////////////////////////////////////////////////////////
+
+void DistanceField::generate(const uint8_t* mask, uint32_t width, uint32_t height,
+        uint32_t stride, uint8_t* field, uint32_t fieldStride, uint32_t spread) {
+    const int32_t border = spread;
+    const int32_t fieldWidth = width + 2 * border;
+    const int32_t fieldHeight = height + 2 * border;
+    const int32_t gridWidth = fieldWidth + 2;
+    const int32_t gridSize = gridWidth * (fieldHeight + 2);
+
+    // Distances to the nearest pixel inside and outside of the shape
+    Offset* inside = new Offset[gridSize];
+    Offset* outside = new Offset[gridSize];
+
+    const Offset far = { DISTANCE_FIELD_FAR, DISTANCE_FIELD_FAR };
+    const Offset seed = { 0, 0 };
+
+    for (int32_t i = 0; i < gridSize; i++) {
+        inside[i] = far;
+        outside[i] = far;
+    }
+
+    for (int32_t y = 0; y < fieldHeight; y++) {
+        const int32_t maskY = y - border;
+        for (int32_t x = 0; x < fieldWidth; x++) {
+            const int32_t maskX = x - border;
+            const bool covered = maskX >= 0 && maskX < int32_t(width) &&
+                    maskY >= 0 && maskY < int32_t(height) &&
+                    mask[maskY * stride + maskX] >= 128;
+
+            const int32_t index = (y + 1) * gridWidth + x + 1;
+            if (covered) {
+                inside[index] = seed;
+            } else {
+                outside[index] = seed;
+            }
+        }
+    }
+
+    propagate(inside, fieldWidth, fieldHeight);
+    propagate(outside, fieldWidth, fieldHeight);
+
+    const float scale = 0.5f / border;
+    for (int32_t y = 0; y < fieldHeight; y++) {
+        const int32_t maskY = y - border;
+        uint8_t* dst = field + y * fieldStride;
+
+        for (int32_t x = 0; x < fieldWidth; x++) {
+            const int32_t maskX = x - border;
+            const int32_t index = (y + 1) * gridWidth + x + 1;
+
+            // The edge lies half way between an inside and an outside pixel
+            float distance;
+            if (inside[index].squaredLength() == 0) {
+                distance = sqrtf(outside[index].squaredLength()) - 0.5f;
+            } else {
+                distance = 0.5f - sqrtf(inside[index].squaredLength());
+            }
+
+            // Anti-aliased edge pixels place the edge more precisely
+            if (maskX >= 0 && maskX < int32_t(width) && maskY >= 0 && maskY < int32_t(height)) {
+                const uint8_t coverage = mask[maskY * stride + maskX];
+                if (coverage > 0 && coverage < 255) {
+                    distance = coverage / 255.0f - 0.5f;
+                }
+            }
+
+            float value = 0.5f + distance * scale;
+            if (value < 0.0f) value = 0.0f;
+            if (value > 1.0f) value = 1.0f;
+            dst[x] = uint8_t(value * 255.0f + 0.5f);
+        }
+    }
+
+    delete[] inside;
+    delete[] outside;
+}
+
+}; // namespace uirenderer
+}; // namespace android
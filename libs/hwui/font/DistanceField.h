@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_DISTANCE_FIELD_H
+#define ANDROID_HWUI_DISTANCE_FIELD_H
+
+#include <stdint.h>
+
+namespace android {
+namespace uirenderer {
+
+class DistanceField {
+public:
+    /**
+     * Generates the signed distance field of an 8-bit coverage mask. Pixels
+     * whose coverage is at least 50% are inside the shape.
+     *
+     * The field is (width + 2 * spread) x (height + 2 * spread) pixels: the
+     * mask is centered in the field, leaving room for the distances outside
+     * of the shape. Each value encodes the signed distance, in pixels, to the
+     * edge of the shape: 128 is on the edge, 255 is spread pixels or more
+     * inside the shape and 0 is spread pixels or more outside the shape.
+     */
+    static void generate(const uint8_t* mask, uint32_t width, uint32_t height, uint32_t stride,
+        uint8_t* field, uint32_t fieldStride, uint32_t spread);
+
+private:
+    /**
+     * Offset from a pixel to the nearest seed pixel.
+     */
+    struct Offset {
+        int32_t dx;
+        int32_t dy;
+
+        int32_t squaredLength() const {
+            return dx * dx + dy * dy;
+        }
+    };
+
+    static void compare(Offset* grid, int32_t gridWidth, Offset& offset,
+        int32_t x, int32_t y, int32_t offsetX, int32_t offsetY);
+    static void propagate(Offset* grid, int32_t width, int32_t height);
+};
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_DISTANCE_FIELD_H
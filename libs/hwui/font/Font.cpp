@@ -25,6 +25,7 @@
 #include <SkGlyph.h>
 #include <SkUtils.h>
 
+#include "DistanceField.h"
 #include "FontUtil.h"
 #include "Font.h"
 #include "../Debug.h"
@@ -40,7 +41,7 @@ namespace uirenderer {
 ///////////////////////////////////////////////////////////////////////////////
 
 Font::Font(FontRenderer* state, const Font::FontDescription& desc) :
-        mState(state), mDescription(desc) {
+        mState(state), mDescription(desc), mDistanceFieldScale(1.0f) {
 }
 
 Font::FontDescription::FontDescription(const SkPaint* paint, const mat4& matrix) {
@@ -206,6 +207,30 @@ void Font::drawCachedGlyphTransformed(CachedGlyphInfo* glyph, int x, int y,
             p[3].x(), p[3].y(), u1, v1, glyph->mCacheTexture);
 }
 
+void Font::drawCachedGlyphDistanceField(CachedGlyphInfo* glyph, int x, int y,
+        uint8_t* bitmap, uint32_t bitmapW, uint32_t bitmapH, Rect* bounds, const float* pos) {
+    // Glyphs are rasterized at DISTANCE_FIELD_TEXT_SIZE, the quad is scaled
+    // to the size of the text and the rest of the transform is applied by
+    // the vertex shader
+    const float scale = mDistanceFieldScale;
+
+    float nPenX = x + glyph->mBitmapLeft * scale;
+    float nPenY = y + (glyph->mBitmapTop + (int) glyph->mBitmapHeight) * scale;
+
+    float width = glyph->mBitmapWidth * scale;
+    float height = glyph->mBitmapHeight * scale;
+
+    float u1 = glyph->mBitmapMinU;
+    float u2 = glyph->mBitmapMaxU;
+    float v1 = glyph->mBitmapMinV;
+    float v2 = glyph->mBitmapMaxV;
+
+    mState->appendMeshQuad(nPenX, nPenY, u1, v2,
+            nPenX + width, nPenY, u2, v2,
+            nPenX + width, nPenY - height, u2, v1,
+            nPenX, nPenY - height, u1, v1, glyph->mCacheTexture);
+}
+
 void Font::drawCachedGlyphBitmap(CachedGlyphInfo* glyph, int x, int y, uint8_t* bitmap,
         uint32_t bitmapWidth, uint32_t bitmapHeight, Rect* bounds, const float* pos) {
     int dstX = x + glyph->mBitmapLeft;
@@ -278,6 +303,7 @@ CachedGlyphInfo* Font::getCachedGlyph(SkPaint* paint, glyph_t textUnit, bool pre
     } else {
         cachedGlyph = cacheGlyph(paint, textUnit, precaching);
     }
+    cachedGlyph->mGeneration = mState->mGeneration;
 
     return cachedGlyph;
 }
@@ -369,6 +395,124 @@ void Font::precache(SkPaint* paint, const char* text, int numGlyphs) {
     }
 }
 
+void Font::findUncachedGlyphs(const char* text, int numGlyphs, SortedVector<glyph_t>& glyphs) {
+    if (numGlyphs == 0 || text == NULL) {
+        return;
+    }
+
+    int glyphsCount = 0;
+    while (glyphsCount < numGlyphs) {
+        glyph_t glyph = GET_GLYPH(text);
+
+        // Reached the end of the string
+        if (IS_END_OF_STRING(glyph)) {
+            break;
+        }
+
+        CachedGlyphInfo* cachedGlyph = mCachedGlyphs.valueFor(glyph);
+        if (cachedGlyph && cachedGlyph->mIsValid) {
+            cachedGlyph->mGeneration = mState->mGeneration;
+        } else {
+            glyphs.add(glyph);
+        }
+        glyphsCount++;
+    }
+}
+
+bool Font::rasterize(SkPaint* paint, glyph_t glyph, const SkMatrix& lookupTransform,
+        bool distanceField, SkGlyph* rasterizedGlyph) {
+    const SkGlyph& skiaGlyph = GET_METRICS(paint, glyph, &lookupTransform);
+    if (skiaGlyph.fWidth == 0 || skiaGlyph.fHeight == 0) {
+        return false;
+    }
+
+    if (!skiaGlyph.fImage) {
+        paint->findImage(skiaGlyph, &lookupTransform);
+        if (!skiaGlyph.fImage) return false;
+    }
+
+    // The distance field is a copy of the image as well
+    if (distanceField && generateDistanceField(skiaGlyph, rasterizedGlyph)) {
+        return true;
+    }
+
+    // The glyph belongs to Skia's glyph cache, which may purge
+    // it at any time: keep a copy of its image
+    const size_t size = skiaGlyph.computeImageSize();
+    uint8_t* image = new uint8_t[size];
+    memcpy(image, skiaGlyph.fImage, size);
+
+    *rasterizedGlyph = skiaGlyph;
+    rasterizedGlyph->fImage = image;
+
+    return true;
+}
+
+bool Font::generateDistanceField(const SkGlyph& skiaGlyph, SkGlyph* fieldGlyph) {
+    const SkMask::Format format = static_cast<SkMask::Format>(skiaGlyph.fMaskFormat);
+    if (!skiaGlyph.fImage || skiaGlyph.fWidth == 0 || skiaGlyph.fHeight == 0 ||
+            (format != SkMask::kA8_Format && format != SkMask::kBW_Format)) {
+        return false;
+    }
+
+    const uint32_t width = skiaGlyph.fWidth;
+    const uint32_t height = skiaGlyph.fHeight;
+
+    const uint8_t* mask = (const uint8_t*) skiaGlyph.fImage;
+    uint32_t stride = skiaGlyph.rowBytes();
+
+    // Expand 1-bit masks to 8-bit coverage
+    uint8_t* expandedMask = NULL;
+    if (format == SkMask::kBW_Format) {
+        expandedMask = new uint8_t[width * height];
+        for (uint32_t y = 0; y < height; y++) {
+            const uint8_t* src = &mask[y * stride];
+            uint8_t* dst = &expandedMask[y * width];
+            for (uint32_t x = 0; x < width; x++) {
+                dst[x] = (src[x >> 3] & (0x80 >> (x & 0x7))) ? 0xFF : 0x00;
+            }
+        }
+        mask = expandedMask;
+        stride = width;
+    }
+
+    *fieldGlyph = skiaGlyph;
+    fieldGlyph->fWidth = width + 2 * DISTANCE_FIELD_SPREAD;
+    fieldGlyph->fHeight = height + 2 * DISTANCE_FIELD_SPREAD;
+    fieldGlyph->fLeft -= DISTANCE_FIELD_SPREAD;
+    fieldGlyph->fTop -= DISTANCE_FIELD_SPREAD;
+    fieldGlyph->fMaskFormat = SkMask::kA8_Format;
+
+    const uint32_t fieldStride = fieldGlyph->rowBytes();
+    uint8_t* field = new uint8_t[fieldStride * fieldGlyph->fHeight];
+    DistanceField::generate(mask, width, height, stride, field, fieldStride,
+            DISTANCE_FIELD_SPREAD);
+    fieldGlyph->fImage = field;
+
+    delete[] expandedMask;
+
+    return true;
+}
+
+void Font::getDistanceFieldPaint(const SkPaint* paint, SkPaint* fieldPaint) {
+    *fieldPaint = *paint;
+    fieldPaint->setTextSize(DISTANCE_FIELD_TEXT_SIZE);
+    // Hinting is meant for a specific pixel grid, the glyphs are scaled
+    fieldPaint->setHinting(SkPaint::kNo_Hinting);
+}
+
+void Font::cacheRasterizedGlyph(SkPaint* paint, glyph_t glyph, const SkGlyph& skiaGlyph) {
+    // The image was already converted to a distance field if needed
+    CachedGlyphInfo* cachedGlyph = mCachedGlyphs.valueFor(glyph);
+    if (!cachedGlyph) {
+        cachedGlyph = createCachedGlyph(glyph, skiaGlyph);
+        storeGlyph(skiaGlyph, cachedGlyph, true);
+    } else if (!cachedGlyph->mIsValid) {
+        storeGlyph(skiaGlyph, cachedGlyph, true);
+    }
+    cachedGlyph->mGeneration = mState->mGeneration;
+}
+
 void Font::render(SkPaint* paint, const char* text, uint32_t start, uint32_t len,
         int numGlyphs, int x, int y, RenderMode mode, uint8_t *bitmap,
         uint32_t bitmapW, uint32_t bitmapH, Rect* bounds, const float* positions) {
@@ -385,6 +529,9 @@ void Font::render(SkPaint* paint, const char* text, uint32_t start, uint32_t len
             &android::uirenderer::Font::measureCachedGlyph
     };
     RenderGlyph render = gRenderGlyph[(mode << 1) + !mIdentityTransform];
+    if (mode == FRAMEBUFFER && isDistanceField()) {
+        render = &android::uirenderer::Font::drawCachedGlyphDistanceField;
+    }
 
     text += start;
     int glyphsCount = 0;
@@ -417,6 +564,22 @@ void Font::render(SkPaint* paint, const char* text, uint32_t start, uint32_t len
 
 void Font::updateGlyphCache(SkPaint* paint, const SkGlyph& skiaGlyph, CachedGlyphInfo* glyph,
         bool precaching) {
+    // Get the bitmap for the glyph
+    if (!skiaGlyph.fImage) {
+        paint->findImage(skiaGlyph, &mDescription.mLookupTransform);
+    }
+
+    SkGlyph fieldGlyph;
+    if (isDistanceField() && generateDistanceField(skiaGlyph, &fieldGlyph)) {
+        storeGlyph(fieldGlyph, glyph, precaching);
+        delete[] (uint8_t*) fieldGlyph.fImage;
+        return;
+    }
+
+    storeGlyph(skiaGlyph, glyph, precaching);
+}
+
+void Font::storeGlyph(const SkGlyph& skiaGlyph, CachedGlyphInfo* glyph, bool precaching) {
     glyph->mAdvanceX = skiaGlyph.fAdvanceX;
     glyph->mAdvanceY = skiaGlyph.fAdvanceY;
     glyph->mBitmapLeft = skiaGlyph.fLeft;
@@ -427,11 +590,8 @@ void Font::updateGlyphCache(SkPaint* paint, const SkGlyph& skiaGlyph, CachedGlyp
     uint32_t startX = 0;
     uint32_t startY = 0;
 
-    // Get the bitmap for the glyph
-    if (!skiaGlyph.fImage) {
-        paint->findImage(skiaGlyph, &mDescription.mLookupTransform);
-    }
-    mState->cacheBitmap(skiaGlyph, glyph, &startX, &startY, precaching);
+    // Distance fields are linear, gamma correction would shift the edges
+    mState->cacheBitmap(skiaGlyph, glyph, &startX, &startY, precaching, !isDistanceField());
 
     if (!glyph->mIsValid) {
         return;
@@ -460,21 +620,49 @@ void Font::updateGlyphCache(SkPaint* paint, const SkGlyph& skiaGlyph, CachedGlyp
 }
 
 CachedGlyphInfo* Font::cacheGlyph(SkPaint* paint, glyph_t glyph, bool precaching) {
+    const SkGlyph& skiaGlyph = GET_METRICS(paint, glyph, &mDescription.mLookupTransform);
+    CachedGlyphInfo* newGlyph = createCachedGlyph(glyph, skiaGlyph);
+
+    updateGlyphCache(paint, skiaGlyph, newGlyph, precaching);
+
+    return newGlyph;
+}
+
+CachedGlyphInfo* Font::createCachedGlyph(glyph_t glyph, const SkGlyph& skiaGlyph) {
     CachedGlyphInfo* newGlyph = new CachedGlyphInfo();
     mCachedGlyphs.add(glyph, newGlyph);
 
-    const SkGlyph& skiaGlyph = GET_METRICS(paint, glyph, &mDescription.mLookupTransform);
     newGlyph->mIsValid = false;
     newGlyph->mGlyphIndex = skiaGlyph.fID;
 
-    updateGlyphCache(paint, skiaGlyph, newGlyph, precaching);
-
     return newGlyph;
 }
 
-Font* Font::create(FontRenderer* state, const SkPaint* paint, const mat4& matrix) {
+Font* Font::create(FontRenderer* state, const SkPaint* paint, const mat4& matrix,
+        bool distanceField) {
+    Font* font;
+
+    if (distanceField) {
+        // All the sizes and transforms share the same glyphs
+        SkPaint fieldPaint;
+        getDistanceFieldPaint(paint, &fieldPaint);
+
+        FontDescription description(&fieldPaint, mat4::identity());
+        description.mFlags |= kDistanceField;
+
+        font = state->mActiveFonts.get(description);
+        if (!font) {
+            font = new Font(state, description);
+            state->mActiveFonts.put(description, font);
+        }
+        font->mIdentityTransform = true;
+        font->mDistanceFieldScale = paint->getTextSize() / DISTANCE_FIELD_TEXT_SIZE;
+
+        return font;
+    }
+
     FontDescription description(paint, matrix);
-    Font* font = state->mActiveFonts.get(description);
+    font = state->mActiveFonts.get(description);
 
     if (!font) {
         font = new Font(state, description);
@@ -18,6 +18,7 @@
 #define ANDROID_HWUI_FONT_H
 
 #include <utils/KeyedVector.h>
+#include <utils/SortedVector.h>
 
 #include <SkScalerContext.h>
 #include <SkPaint.h>
@@ -43,7 +44,8 @@ class FontRenderer;
 class Font {
 public:
     enum Style {
-        kFakeBold = 1
+        kFakeBold = 1,
+        kDistanceField = 2
     };
 
     struct FontDescription {
@@ -87,9 +89,28 @@ public:
     }
 
     /**
-     * Creates a new font associated with the specified font state.
+     * Returns true if the glyphs of this font are stored as signed distance
+     * fields. Such fonts are rasterized at DISTANCE_FIELD_TEXT_SIZE with an
+     * identity transform and their glyphs are scaled when drawn.
      */
-    static Font* create(FontRenderer* state, const SkPaint* paint, const mat4& matrix);
+    bool isDistanceField() const {
+        return mDescription.mFlags & kDistanceField;
+    }
+
+    /**
+     * Copies the paint into fieldPaint and changes the copy to rasterize
+     * the glyphs of distance field fonts. The paint passed to render() and
+     * precache() for a distance field font must be modified this way.
+     */
+    static void getDistanceFieldPaint(const SkPaint* paint, SkPaint* fieldPaint);
+
+    /**
+     * Creates a new font associated with the specified font state. When
+     * distanceField is true, the matrix is ignored and the font renders
+     * its glyphs from signed distance fields.
+     */
+    static Font* create(FontRenderer* state, const SkPaint* paint, const mat4& matrix,
+            bool distanceField = false);
 
 private:
     friend class FontRenderer;
@@ -107,6 +128,38 @@ private:
 
     void precache(SkPaint* paint, const char* text, int numGlyphs);
 
+    /**
+     * Adds to the specified list the glyphs of the text that are not
+     * in the cache textures. Can be used to rasterize glyphs ahead of
+     * time through rasterize() and cacheRasterizedGlyph().
+     */
+    void findUncachedGlyphs(const char* text, int numGlyphs, SortedVector<glyph_t>& glyphs);
+
+    /**
+     * Retrieves the metrics and the image of the specified glyph. The image
+     * is copied in a buffer allocated with new[] and owned by the caller; the
+     * fImage field of the returned glyph points to that buffer. Returns false
+     * if the glyph is empty or could not be rasterized. When distanceField is
+     * true the image is converted to a distance field, see
+     * generateDistanceField(). This method can be invoked from any thread.
+     */
+    static bool rasterize(SkPaint* paint, glyph_t glyph, const SkMatrix& lookupTransform,
+            bool distanceField, SkGlyph* rasterizedGlyph);
+
+    /**
+     * Generates the signed distance field of the image of the specified
+     * glyph. The field is allocated with new[] and owned by the caller; the
+     * fImage field of fieldGlyph points to it and the bounds of fieldGlyph
+     * are outset by DISTANCE_FIELD_SPREAD. Returns false if the glyph has
+     * no image or is not an alpha mask.
+     */
+    static bool generateDistanceField(const SkGlyph& skiaGlyph, SkGlyph* fieldGlyph);
+
+    /**
+     * Stores a glyph returned by rasterize() in the cache textures.
+     */
+    void cacheRasterizedGlyph(SkPaint* paint, glyph_t glyph, const SkGlyph& skiaGlyph);
+
     void render(SkPaint* paint, const char *text, uint32_t start, uint32_t len,
             int numGlyphs, int x, int y, RenderMode mode, uint8_t *bitmap,
             uint32_t bitmapW, uint32_t bitmapH, Rect *bounds, const float* positions);
@@ -117,8 +170,10 @@ private:
     void invalidateTextureCache(CacheTexture* cacheTexture = NULL);
 
     CachedGlyphInfo* cacheGlyph(SkPaint* paint, glyph_t glyph, bool precaching);
+    CachedGlyphInfo* createCachedGlyph(glyph_t glyph, const SkGlyph& skiaGlyph);
     void updateGlyphCache(SkPaint* paint, const SkGlyph& skiaGlyph, CachedGlyphInfo* glyph,
             bool precaching);
+    void storeGlyph(const SkGlyph& skiaGlyph, CachedGlyphInfo* glyph, bool precaching);
 
     void measureCachedGlyph(CachedGlyphInfo* glyph, int x, int y,
             uint8_t *bitmap, uint32_t bitmapW, uint32_t bitmapH,
@@ -129,6 +184,9 @@ private:
     void drawCachedGlyphTransformed(CachedGlyphInfo* glyph, int x, int y,
             uint8_t *bitmap, uint32_t bitmapW, uint32_t bitmapH,
             Rect* bounds, const float* pos);
+    void drawCachedGlyphDistanceField(CachedGlyphInfo* glyph, int x, int y,
+            uint8_t *bitmap, uint32_t bitmapW, uint32_t bitmapH,
+            Rect* bounds, const float* pos);
     void drawCachedGlyphBitmap(CachedGlyphInfo* glyph, int x, int y,
             uint8_t *bitmap, uint32_t bitmapW, uint32_t bitmapH,
             Rect* bounds, const float* pos);
@@ -144,6 +202,10 @@ private:
     DefaultKeyedVector<glyph_t, CachedGlyphInfo*> mCachedGlyphs;
 
     bool mIdentityTransform;
+
+    // Ratio between the size of the text being drawn and the size the
+    // glyphs of a distance field font are rasterized at
+    float mDistanceFieldScale;
 };
 
 inline int strictly_order_type(const Font::FontDescription& lhs,
@@ -37,6 +37,24 @@
 
 #define CACHE_BLOCK_ROUNDING_SIZE 4
 
+// Fraction of the area of the cache textures of a given format kept
+// when the textures are compacted. The most recently used glyphs are
+// kept, the others are evicted and rasterized again when needed
+#define CACHE_COMPACTION_KEEP_RATIO 0.5f
+
+// Glyphs of distance field fonts are rasterized at this size and scaled
+// when drawn, whatever the size and transform of the text
+#define DISTANCE_FIELD_TEXT_SIZE 48.0f
+// Distance, in pixels of the rasterized glyph, covered by the distance field
+// on each side of the edges of the glyph. The field is larger than the glyph
+// by this amount on all sides
+#define DISTANCE_FIELD_SPREAD 6
+// Screen space text size from which text is rendered with distance fields
+#define DISTANCE_FIELD_MIN_LARGE_TEXT_SIZE 64.0f
+// Screen space text size from which text drawn with a scale or rotation
+// is rendered with distance fields
+#define DISTANCE_FIELD_MIN_TRANSFORMED_TEXT_SIZE 16.0f
+
 #if RENDER_TEXT_AS_GLYPHS
     typedef uint16_t glyph_t;
     #define TO_GLYPH(g) g
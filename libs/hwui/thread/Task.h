@@ -19,6 +19,8 @@
 
 #define ATRACE_TAG ATRACE_TAG_VIEW
 
+#include <cutils/atomic.h>
+
 #include <utils/RefBase.h>
 #include <utils/Trace.h>
 
@@ -29,14 +31,66 @@ namespace uirenderer {
 
 class TaskBase: public RefBase {
 public:
-    TaskBase() { }
+    enum Priority {
+        // The result of the task is needed to draw the current frame
+        kPriorityFrame = 0,
+        // The result of the task might be used by a future frame
+        kPriorityPrecache = 1
+    };
+
+    TaskBase(Priority priority = kPriorityFrame):
+            mPriority(priority), mState(kStatePending), mCanceled(0) { }
     virtual ~TaskBase() { }
+
+    Priority getPriority() const {
+        return mPriority;
+    }
+
+    /**
+     * Returns true if the cancellation of this task was requested.
+     * Long running tasks should check this value periodically and
+     * bail out early when it returns true.
+     */
+    bool isCanceled() const {
+        return android_atomic_acquire_load(&mCanceled) != 0;
+    }
+
+protected:
+    /**
+     * Marks this task as canceled. Returns true if the task had not
+     * started yet, in which case it will never run.
+     */
+    bool markCanceled() {
+        android_atomic_release_store(1, &mCanceled);
+        return android_atomic_cmpxchg(kStatePending, kStateCanceled, &mState) == 0;
+    }
+
+private:
+    friend class TaskManager;
+
+    enum State {
+        kStatePending = 0,
+        kStateRunning = 1,
+        kStateCanceled = 2
+    };
+
+    /**
+     * Invoked by the task manager before running this task. Returns
+     * false if the task was canceled and must be skipped.
+     */
+    bool start() {
+        return android_atomic_cmpxchg(kStatePending, kStateRunning, &mState) == 0;
+    }
+
+    const Priority mPriority;
+    volatile int32_t mState;
+    volatile int32_t mCanceled;
 };
 
 template<typename T>
 class Task: public TaskBase {
 public:
-    Task(): mFuture(new Future<T>()) { }
+    Task(Priority priority = kPriorityFrame): TaskBase(priority), mFuture(new Future<T>()) { }
     virtual ~Task() { }
 
     T getResult() const {
@@ -48,6 +102,23 @@ public:
         mFuture->produce(result);
     }
 
+    /**
+     * Cancels this task. If the task has not started yet it will never
+     * run and its result is set to T(). If the task is already running,
+     * it can observe the cancellation through isCanceled() and produce
+     * its result early. Either way, getResult() must still be called
+     * before releasing the resources used by the task.
+     *
+     * Returns true if the task was prevented from running.
+     */
+    bool cancel() {
+        if (markCanceled()) {
+            mFuture->produce(T());
+            return true;
+        }
+        return false;
+    }
+
 protected:
     const sp<Future<T> >& future() const {
         return mFuture;
@@ -34,7 +34,7 @@ TaskManager::TaskManager() {
     for (int i = 0; i < cpuCount / 2; i++) {
         String8 name;
         name.appendFormat("hwuiTask%d", i + 1);
-        mThreads.add(new WorkerThread(name));
+        mThreads.add(new WorkerThread(this, i, name));
     }
 }
 
@@ -68,7 +68,30 @@ bool TaskManager::addTaskBase(const sp<TaskBase>& task, const sp<TaskProcessorBa
             }
         }
 
-        return thread->addTask(wrapper);
+        if (!thread->addTask(wrapper)) {
+            return false;
+        }
+
+        // Let idle workers know there is work they can steal
+        for (size_t i = 0; i < mThreads.size(); i++) {
+            if (mThreads[i] != thread) {
+                mThreads[i]->wake();
+            }
+        }
+
+        return true;
+    }
+    return false;
+}
+
+bool TaskManager::stealTask(const WorkerThread* thief, TaskWrapper* task) {
+    const size_t count = mThreads.size();
+    // Start with the thief's neighbour to spread contention across workers
+    for (size_t i = 1; i < count; i++) {
+        const sp<WorkerThread>& victim = mThreads[(thief->getIndex() + i) % count];
+        if (victim->stealTask(task)) {
+            return true;
+        }
     }
     return false;
 }
@@ -78,29 +101,74 @@ bool TaskManager::addTaskBase(const sp<TaskBase>& task, const sp<TaskProcessorBa
 ///////////////////////////////////////////////////////////////////////////////
 
 bool TaskManager::WorkerThread::threadLoop() {
-    mSignal.wait();
-    Vector<TaskWrapper> tasks;
-    {
-        Mutex::Autolock l(mLock);
-        tasks = mTasks;
-        mTasks.clear();
+    TaskWrapper task;
+    if (!popTask(&task) && !mManager->stealTask(this, &task)) {
+        // Sleep until a task is queued on this thread or a
+        // sibling receives a task that can be stolen
+        mSignal.wait();
+        return true;
     }
 
-    for (size_t i = 0; i < tasks.size(); i++) {
-        const TaskWrapper& task = tasks.itemAt(i);
+    // Tasks canceled before they started already have a result
+    if (task.mTask->start()) {
         task.mProcessor->process(task.mTask);
     }
 
     return true;
 }
 
+bool TaskManager::WorkerThread::popTask(TaskWrapper* task) {
+    Mutex::Autolock l(mLock);
+    if (mTasks.isEmpty()) {
+        return false;
+    }
+    *task = mTasks.itemAt(0);
+    mTasks.removeAt(0);
+    return true;
+}
+
+bool TaskManager::WorkerThread::stealTask(TaskWrapper* task) {
+    Mutex::Autolock l(mLock);
+    if (mTasks.isEmpty()) {
+        return false;
+    }
+
+    // Steal the most recent task needed by the current frame, if any,
+    // otherwise the most recent speculative task
+    size_t index = mTasks.size() - 1;
+    size_t frameTasks = getFrameTaskCount();
+    if (frameTasks > 0) {
+        index = frameTasks - 1;
+    }
+
+    *task = mTasks.itemAt(index);
+    mTasks.removeAt(index);
+    return true;
+}
+
+size_t TaskManager::WorkerThread::getFrameTaskCount() const {
+    // Tasks needed by the current frame are always queued before precache tasks
+    size_t count = 0;
+    while (count < mTasks.size() &&
+            mTasks.itemAt(count).mTask->getPriority() == TaskBase::kPriorityFrame) {
+        count++;
+    }
+    return count;
+}
+
 bool TaskManager::WorkerThread::addTask(TaskWrapper task) {
     if (!isRunning()) {
         run(mName.string(), PRIORITY_DEFAULT);
     }
 
     Mutex::Autolock l(mLock);
-    ssize_t index = mTasks.add(task);
+    ssize_t index;
+    if (task.mTask->getPriority() == TaskBase::kPriorityFrame) {
+        // Run ahead of the speculative tasks, after previous frame tasks
+        index = mTasks.insertAt(task, getFrameTaskCount());
+    } else {
+        index = mTasks.add(task);
+    }
     mSignal.signal();
 
     return index >= 0;
@@ -111,6 +179,12 @@ size_t TaskManager::WorkerThread::getTaskCount() const {
     return mTasks.size();
 }
 
+void TaskManager::WorkerThread::wake() {
+    if (isRunning()) {
+        mSignal.signal();
+    }
+}
+
 void TaskManager::WorkerThread::exit() {
     {
         Mutex::Autolock l(mLock);
@@ -64,6 +64,15 @@ private:
 
     bool addTaskBase(const sp<TaskBase>& task, const sp<TaskProcessorBase>& processor);
 
+    struct TaskWrapper;
+    class WorkerThread;
+
+    /**
+     * Attempts to take a task queued on any worker other than the
+     * specified thief. Returns true if a task was stolen.
+     */
+    bool stealTask(const WorkerThread* thief, TaskWrapper* task);
+
     struct TaskWrapper {
         TaskWrapper(): mTask(), mProcessor() { }
 
@@ -75,18 +84,50 @@ private:
         sp<TaskProcessorBase> mProcessor;
     };
 
+    /**
+     * Each worker owns a deque of tasks. The worker runs its own tasks
+     * in the order they were queued (from the front of the deque) and,
+     * when it runs out of work, steals the most recently queued tasks
+     * (from the back of the deque) of its siblings. This prevents a
+     * single slow task from holding up every task queued after it.
+     *
+     * Tasks with TaskBase::kPriorityFrame are queued ahead of
+     * speculative TaskBase::kPriorityPrecache tasks.
+     */
     class WorkerThread: public Thread {
     public:
-        WorkerThread(const String8 name): mSignal(Condition::WAKE_UP_ONE), mName(name) { }
+        WorkerThread(TaskManager* manager, size_t index, const String8 name):
+                mManager(manager), mIndex(index), mSignal(Condition::WAKE_UP_ONE), mName(name) { }
 
         bool addTask(TaskWrapper task);
         size_t getTaskCount() const;
+        size_t getIndex() const { return mIndex; }
         void exit();
 
+        /**
+         * Wakes up this thread, if it is running, so it can look
+         * for tasks to steal from its siblings.
+         */
+        void wake();
+
+        /**
+         * Removes the most recently queued task from this thread's
+         * deque. Returns false if the deque is empty.
+         */
+        bool stealTask(TaskWrapper* task);
+
     private:
         virtual bool threadLoop();
 
-        // Lock for the list of tasks
+        bool popTask(TaskWrapper* task);
+
+        // Must be called with mLock held
+        size_t getFrameTaskCount() const;
+
+        TaskManager* mManager;
+        const size_t mIndex;
+
+        // Lock for the deque of tasks
         mutable Mutex mLock;
         Vector<TaskWrapper> mTasks;
 
@@ -17,12 +17,81 @@
 #define LOG_TAG "OpenGLRenderer"
 
 #include <math.h>
+#include <string.h>
 
 #include "Blur.h"
 
+#if defined(__ARM_HAVE_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define BLUR_USE_NEON 1
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+    #define BLUR_USE_SSE2 1
+#endif
+
+#if defined(BLUR_USE_NEON) || defined(BLUR_USE_SSE2)
+    #define BLUR_USE_SIMD 1
+#endif
+
 namespace android {
 namespace uirenderer {
 
+///////////////////////////////////////////////////////////////////////////////
+// Vectorized kernels
+///////////////////////////////////////////////////////////////////////////////
+
+#if BLUR_USE_SIMD
+
+/**
+ * Computes 4 consecutive blurred pixels. source points to the first tap
+ * of the kernel of the first output pixel and stride is the distance in
+ * bytes between two taps of the kernel. The 4 output pixels read their
+ * taps from 4 consecutive bytes.
+ */
+static inline void blur4(const float* weights, int32_t taps, const uint8_t* source,
+        int32_t stride, uint8_t* dest) {
+    uint32_t pixels;
+    uint32_t result;
+
+#if BLUR_USE_NEON
+    float32x4_t sum = vdupq_n_f32(0.0f);
+    for (int32_t r = 0; r < taps; r++) {
+        memcpy(&pixels, source, sizeof(uint32_t));
+        uint8x8_t p8 = vreinterpret_u8_u32(vdup_n_u32(pixels));
+        uint32x4_t p32 = vmovl_u16(vget_low_u16(vmovl_u8(p8)));
+        sum = vmlaq_n_f32(sum, vcvtq_f32_u32(p32), weights[r]);
+        source += stride;
+    }
+    // Conversion to integers truncates, like the scalar code
+    uint16x4_t s16 = vqmovn_u32(vcvtq_u32_f32(sum));
+    uint8x8_t s8 = vqmovn_u16(vcombine_u16(s16, s16));
+    result = vget_lane_u32(vreinterpret_u32_u8(s8), 0);
+#elif BLUR_USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128 sum = _mm_setzero_ps();
+    for (int32_t r = 0; r < taps; r++) {
+        memcpy(&pixels, source, sizeof(uint32_t));
+        __m128i p = _mm_cvtsi32_si128(pixels);
+        p = _mm_unpacklo_epi16(_mm_unpacklo_epi8(p, zero), zero);
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_cvtepi32_ps(p), _mm_set1_ps(weights[r])));
+        source += stride;
+    }
+    // Conversion to integers truncates, like the scalar code
+    __m128i s = _mm_cvttps_epi32(sum);
+    s = _mm_packs_epi32(s, s);
+    s = _mm_packus_epi16(s, s);
+    result = _mm_cvtsi128_si32(s);
+#endif
+
+    memcpy(dest, &result, sizeof(uint32_t));
+}
+
+#endif // BLUR_USE_SIMD
+
+///////////////////////////////////////////////////////////////////////////////
+// Gaussian blur
+///////////////////////////////////////////////////////////////////////////////
+
 void Blur::generateGaussianWeights(float* weights, int32_t radius) {
     // Compute gaussian weights for the blur
     // e is the euler's number
@@ -71,6 +140,15 @@ void Blur::horizontal(float* weights, int32_t radius,
         uint8_t* output = dest + y * width;
 
         for (int32_t x = 0; x < width; x ++) {
+#if BLUR_USE_SIMD
+            // Blur 4 non-border pixels at once
+            if (x > radius && x + 3 < (width - radius)) {
+                blur4(weights, 2 * radius + 1, input + (x - radius), 1, output);
+                output += 4;
+                x += 3;
+                continue;
+            }
+#endif
             blurredPixel = 0.0f;
             const float* gPtr = weights;
             // Optimization for non-border pixels
@@ -113,6 +191,16 @@ void Blur::vertical(float* weights, int32_t radius,
         uint8_t* output = dest + y * width;
 
         for (int32_t x = 0; x < width; x ++) {
+#if BLUR_USE_SIMD
+            // Blur 4 columns of non-border pixels at once
+            if (y > radius && y < (height - radius) && x + 3 < width) {
+                blur4(weights, 2 * radius + 1, source + x + ((y - radius) * width),
+                        width, output);
+                output += 4;
+                x += 3;
+                continue;
+            }
+#endif
             blurredPixel = 0.0f;
             const float* gPtr = weights;
             const uint8_t* input = source + x;
@@ -148,5 +236,101 @@ void Blur::vertical(float* weights, int32_t radius,
     }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Box blur approximation
+///////////////////////////////////////////////////////////////////////////////
+
+// Number of box blurs used to approximate a gaussian blur
+#define BOX_BLUR_PASSES 3
+
+static inline int32_t clampIndex(int32_t index, int32_t count) {
+    if (index < 0) return 0;
+    if (index > count - 1) return count - 1;
+    return index;
+}
+
+/**
+ * Averages, with rounding, a sum of boxSize pixels. The scale is a
+ * 16.16 fixed point reciprocal of the box size.
+ */
+static inline uint8_t boxAverage(uint32_t sum, uint32_t scale) {
+    return (uint8_t) ((sum * scale + (1 << 15)) >> 16);
+}
+
+void Blur::boxHorizontal(int32_t boxRadius, const uint8_t* source, uint8_t* dest,
+        int32_t width, int32_t height) {
+    const uint32_t scale = (1 << 16) / (2 * boxRadius + 1);
+
+    for (int32_t y = 0; y < height; y++) {
+        const uint8_t* input = source + y * width;
+        uint8_t* output = dest + y * width;
+
+        uint32_t sum = 0;
+        for (int32_t r = -boxRadius; r <= boxRadius; r++) {
+            sum += input[clampIndex(r, width)];
+        }
+
+        // Slide the box along the row, the edges are clamped
+        for (int32_t x = 0; x < width; x++) {
+            output[x] = boxAverage(sum, scale);
+            sum += input[clampIndex(x + boxRadius + 1, width)];
+            sum -= input[clampIndex(x - boxRadius, width)];
+        }
+    }
+}
+
+void Blur::boxVertical(int32_t boxRadius, const uint8_t* source, uint8_t* dest,
+        int32_t width, int32_t height) {
+    const uint32_t scale = (1 << 16) / (2 * boxRadius + 1);
+
+    // Slide the boxes of all the columns at once to walk the
+    // source one row at a time
+    uint32_t* sums = new uint32_t[width];
+    memset(sums, 0, width * sizeof(uint32_t));
+
+    for (int32_t r = -boxRadius; r <= boxRadius; r++) {
+        const uint8_t* input = source + clampIndex(r, height) * width;
+        for (int32_t x = 0; x < width; x++) {
+            sums[x] += input[x];
+        }
+    }
+
+    for (int32_t y = 0; y < height; y++) {
+        uint8_t* output = dest + y * width;
+        const uint8_t* next = source + clampIndex(y + boxRadius + 1, height) * width;
+        const uint8_t* previous = source + clampIndex(y - boxRadius, height) * width;
+
+        for (int32_t x = 0; x < width; x++) {
+            output[x] = boxAverage(sums[x], scale);
+            sums[x] += next[x];
+            sums[x] -= previous[x];
+        }
+    }
+
+    delete[] sums;
+}
+
+void Blur::approximateGaussian(int32_t radius, uint8_t* image, uint8_t* scratch,
+        int32_t width, int32_t height) {
+    // Use the same sigma as generateGaussianWeights()
+    float sigma = 0.3f * (float) radius + 0.6f;
+
+    // Compute the sizes of the boxes whose successive application
+    // produces a blur with a standard deviation of sigma
+    const int32_t n = BOX_BLUR_PASSES;
+    int32_t lower = (int32_t) floorf(sqrtf(12.0f * sigma * sigma / n + 1.0f));
+    if (lower % 2 == 0) lower--;
+    const int32_t upper = lower + 2;
+    const float idealCount = (12.0f * sigma * sigma - n * lower * lower - 4 * n * lower - 3 * n) /
+            (-4.0f * lower - 4.0f);
+    const int32_t lowerCount = (int32_t) floorf(idealCount + 0.5f);
+
+    for (int32_t i = 0; i < n; i++) {
+        int32_t boxRadius = ((i < lowerCount ? lower : upper) - 1) / 2;
+        boxHorizontal(boxRadius, image, scratch, width, height);
+        boxVertical(boxRadius, scratch, image, width, height);
+    }
+}
+
 }; // namespace uirenderer
 }; // namespace android
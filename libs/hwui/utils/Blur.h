@@ -29,6 +29,24 @@ public:
         uint8_t* dest, int32_t width, int32_t height);
     static void vertical(float* weights, int32_t radius, const uint8_t* source,
         uint8_t* dest, int32_t width, int32_t height);
+
+    /**
+     * Approximates a gaussian blur of the specified radius using three
+     * successive box blurs in each direction. The cost of a box blur does
+     * not depend on its radius which makes this method much faster than
+     * horizontal() and vertical() for large radii.
+     *
+     * The result is written back into image. The scratch buffer must be
+     * at least as large as image.
+     */
+    static void approximateGaussian(int32_t radius, uint8_t* image, uint8_t* scratch,
+        int32_t width, int32_t height);
+
+private:
+    static void boxHorizontal(int32_t boxRadius, const uint8_t* source, uint8_t* dest,
+        int32_t width, int32_t height);
+    static void boxVertical(int32_t boxRadius, const uint8_t* source, uint8_t* dest,
+        int32_t width, int32_t height);
 };
 
 }; // namespace uirenderer
@@ -0,0 +1,330 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_CLOCK_CACHE_H
+#define ANDROID_HWUI_CLOCK_CACHE_H
+
+#include <new>
+#include <stdlib.h>
+
+#include <utils/LruCache.h>
+#include <utils/TypeHelpers.h>
+
+namespace android {
+namespace uirenderer {
+
+/**
+ * Drop-in replacement for LruCache, as used by the renderer caches.
+ *
+ * Entries are stored inline in a single open addressing table with linear
+ * probing, instead of one heap node per entry linked in both a hash chain
+ * and a recency list. A hit only sets the entry's reference bit; the "oldest"
+ * entry is picked by a clock hand that sweeps the table, clearing reference
+ * bits until it finds an entry that was not used since the last sweep. This
+ * approximates LRU order without touching any other entry on a hit.
+ *
+ * The table only grows, so once it has reached its working size insertions
+ * never allocate. Removals shift the following entries back instead of
+ * leaving tombstones, which keeps probe sequences short.
+ */
+template <typename TKey, typename TValue>
+class ClockCache {
+public:
+    enum Capacity {
+        kUnlimitedCapacity,
+    };
+
+    explicit ClockCache(uint32_t maxCapacity);
+    ~ClockCache();
+
+    void setOnEntryRemovedListener(OnEntryRemoved<TKey, TValue>* listener) {
+        mListener = listener;
+    }
+
+    size_t size() const {
+        return mSize;
+    }
+
+    /**
+     * Returns the value of the specified key, or TValue() if there is
+     * none. Marks the entry as recently used.
+     */
+    const TValue& get(const TKey& key);
+
+    /**
+     * Adds an entry. Returns false, leaving the cache unchanged, if the key
+     * is already present.
+     */
+    bool put(const TKey& key, const TValue& value);
+
+    bool remove(const TKey& key);
+    bool removeOldest();
+    void clear();
+
+    class Iterator {
+    public:
+        Iterator(const ClockCache<TKey, TValue>& cache): mCache(cache), mIndex(-1) {
+        }
+
+        bool next() {
+            while (++mIndex < (ssize_t) mCache.mCapacity) {
+                if (mCache.mSlots[mIndex].state != kSlotEmpty) return true;
+            }
+            return false;
+        }
+
+        const TKey& key() const {
+            return mCache.entryAt(mIndex).key;
+        }
+
+        const TValue& value() const {
+            return mCache.entryAt(mIndex).value;
+        }
+
+    private:
+        const ClockCache<TKey, TValue>& mCache;
+        ssize_t mIndex;
+    };
+
+private:
+    typedef key_value_pair_t<TKey, TValue> Entry;
+
+    enum SlotState {
+        kSlotEmpty = 0,
+        kSlotUsed,
+        kSlotReferenced
+    };
+
+    struct Slot {
+        hash_t hash;
+        uint32_t state;
+    };
+
+    // Capacity is a power of two, grown when 3/4 full
+    static const size_t kMinCapacity = 16;
+
+    ClockCache(const ClockCache& that);  // disallow copy constructor
+
+    inline Entry& entryAt(size_t index) const {
+        return reinterpret_cast<Entry*>(mEntries)[index];
+    }
+
+    inline size_t indexOf(hash_t hash) const {
+        // The hash functions of the cache keys are not always well mixed
+        uint32_t h = (uint32_t) hash;
+        h ^= h >> 16;
+        h *= 0x45d9f3b;
+        h ^= h >> 16;
+        return h & (mCapacity - 1);
+    }
+
+    ssize_t find(const TKey& key, hash_t hash) const;
+    void removeAt(size_t index);
+    void grow();
+
+    Slot* mSlots;
+    // Raw storage, an entry is only constructed in a used slot
+    void* mEntries;
+    size_t mCapacity;
+    size_t mSize;
+    size_t mHand;
+
+    uint32_t mMaxCapacity;
+    OnEntryRemoved<TKey, TValue>* mListener;
+    TValue mNullValue;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Implementation
+///////////////////////////////////////////////////////////////////////////////
+
+template <typename TKey, typename TValue>
+ClockCache<TKey, TValue>::ClockCache(uint32_t maxCapacity):
+        mSlots(NULL), mEntries(NULL), mCapacity(0), mSize(0), mHand(0),
+        mMaxCapacity(maxCapacity), mListener(NULL), mNullValue(NULL) {
+}
+
+template <typename TKey, typename TValue>
+ClockCache<TKey, TValue>::~ClockCache() {
+    for (size_t i = 0; i < mCapacity; i++) {
+        if (mSlots[i].state != kSlotEmpty) {
+            entryAt(i).~Entry();
+        }
+    }
+    free(mSlots);
+    free(mEntries);
+}
+
+template <typename TKey, typename TValue>
+ssize_t ClockCache<TKey, TValue>::find(const TKey& key, hash_t hash) const {
+    if (mSize == 0) return -1;
+
+    size_t index = indexOf(hash);
+    while (mSlots[index].state != kSlotEmpty) {
+        if (mSlots[index].hash == hash && entryAt(index).key == key) {
+            return index;
+        }
+        index = (index + 1) & (mCapacity - 1);
+    }
+    return -1;
+}
+
+template <typename TKey, typename TValue>
+const TValue& ClockCache<TKey, TValue>::get(const TKey& key) {
+    ssize_t index = find(key, hash_type(key));
+    if (index < 0) {
+        return mNullValue;
+    }
+    mSlots[index].state = kSlotReferenced;
+    return entryAt(index).value;
+}
+
+template <typename TKey, typename TValue>
+bool ClockCache<TKey, TValue>::put(const TKey& key, const TValue& value) {
+    if (mMaxCapacity != kUnlimitedCapacity && mSize >= mMaxCapacity) {
+        removeOldest();
+    }
+
+    hash_t hash = hash_type(key);
+    if (find(key, hash) >= 0) {
+        return false;
+    }
+
+    if ((mSize + 1) * 4 > mCapacity * 3) {
+        grow();
+    }
+
+    size_t index = indexOf(hash);
+    while (mSlots[index].state != kSlotEmpty) {
+        index = (index + 1) & (mCapacity - 1);
+    }
+    new (&entryAt(index)) Entry(key, value);
+    mSlots[index].hash = hash;
+    mSlots[index].state = kSlotReferenced;
+    mSize++;
+    return true;
+}
+
+template <typename TKey, typename TValue>
+bool ClockCache<TKey, TValue>::remove(const TKey& key) {
+    ssize_t index = find(key, hash_type(key));
+    if (index < 0) {
+        return false;
+    }
+    if (mListener) {
+        (*mListener)(entryAt(index).key, entryAt(index).value);
+    }
+    removeAt(index);
+    return true;
+}
+
+template <typename TKey, typename TValue>
+bool ClockCache<TKey, TValue>::removeOldest() {
+    if (mSize == 0) {
+        return false;
+    }
+
+    // Every reference bit is cleared after one full sweep, so this terminates
+    // in at most two sweeps
+    while (true) {
+        mHand = (mHand + 1) & (mCapacity - 1);
+        Slot& slot = mSlots[mHand];
+        if (slot.state == kSlotReferenced) {
+            slot.state = kSlotUsed;
+        } else if (slot.state == kSlotUsed) {
+            if (mListener) {
+                (*mListener)(entryAt(mHand).key, entryAt(mHand).value);
+            }
+            removeAt(mHand);
+            // An entry may have been shifted into the hand's slot
+            mHand = (mHand - 1) & (mCapacity - 1);
+            return true;
+        }
+    }
+}
+
+template <typename TKey, typename TValue>
+void ClockCache<TKey, TValue>::clear() {
+    for (size_t i = 0; i < mCapacity; i++) {
+        if (mSlots[i].state != kSlotEmpty) {
+            if (mListener) {
+                (*mListener)(entryAt(i).key, entryAt(i).value);
+            }
+            entryAt(i).~Entry();
+            mSlots[i].state = kSlotEmpty;
+        }
+    }
+    mSize = 0;
+    mHand = 0;
+}
+
+template <typename TKey, typename TValue>
+void ClockCache<TKey, TValue>::removeAt(size_t index) {
+    entryAt(index).~Entry();
+    mSlots[index].state = kSlotEmpty;
+    mSize--;
+
+    // Shift back the entries whose probe sequence goes through the hole
+    const size_t mask = mCapacity - 1;
+    size_t hole = index;
+    size_t next = (index + 1) & mask;
+    while (mSlots[next].state != kSlotEmpty) {
+        size_t home = indexOf(mSlots[next].hash);
+        bool movable = hole <= next ?
+                (home <= hole || home > next) : (home <= hole && home > next);
+        if (movable) {
+            new (&entryAt(hole)) Entry(entryAt(next));
+            entryAt(next).~Entry();
+            mSlots[hole] = mSlots[next];
+            mSlots[next].state = kSlotEmpty;
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+}
+
+template <typename TKey, typename TValue>
+void ClockCache<TKey, TValue>::grow() {
+    Slot* oldSlots = mSlots;
+    void* oldEntries = mEntries;
+    size_t oldCapacity = mCapacity;
+
+    mCapacity = oldCapacity ? oldCapacity * 2 : kMinCapacity;
+    mSlots = (Slot*) calloc(mCapacity, sizeof(Slot));
+    mEntries = malloc(mCapacity * sizeof(Entry));
+    mHand = 0;
+
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (oldSlots[i].state == kSlotEmpty) continue;
+
+        Entry& entry = reinterpret_cast<Entry*>(oldEntries)[i];
+        size_t index = indexOf(oldSlots[i].hash);
+        while (mSlots[index].state != kSlotEmpty) {
+            index = (index + 1) & (mCapacity - 1);
+        }
+        new (&entryAt(index)) Entry(entry);
+        mSlots[index] = oldSlots[i];
+        entry.~Entry();
+    }
+
+    free(oldSlots);
+    free(oldEntries);
+}
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_CLOCK_CACHE_H
@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <stdlib.h>
+
+#include <utils/Log.h>
+#include <utils/Mutex.h>
+#include <utils/Singleton.h>
+
+#include "PooledLinearAllocator.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+#define ALIGN_SIZE ((size_t) 8)
+#define ALIGN(x) (((x) + ALIGN_SIZE - 1) & ~(ALIGN_SIZE - 1))
+
+// One size class per power of two between the initial and the max page size
+#define POOLED_ALLOCATOR_SIZE_CLASS_COUNT 6
+
+///////////////////////////////////////////////////////////////////////////////
+// Pages
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Header of a page. The memory handed out by the allocator directly
+ * follows the header.
+ */
+struct PooledPage {
+    PooledPage* next;
+    // Size of the page in bytes, including the header
+    size_t size;
+
+    void* start() {
+        return ((char*) this) + ALIGN(sizeof(PooledPage));
+    }
+
+    void* end() {
+        return ((char*) this) + size;
+    }
+
+    static size_t headerSize() {
+        return ALIGN(sizeof(PooledPage));
+    }
+};
+
+/**
+ * Process-wide pool of pages. The pool is accessed by the threads that
+ * record display lists and by the threads that destroy them.
+ */
+class PagePool: public Singleton<PagePool> {
+    PagePool(): mSize(0) {
+        for (int i = 0; i < POOLED_ALLOCATOR_SIZE_CLASS_COUNT; i++) {
+            mFreePages[i] = NULL;
+        }
+    }
+
+    friend class Singleton<PagePool>;
+
+public:
+    /**
+     * Returns the size class of a page of the specified size, or -1
+     * if pages of that size are not pooled.
+     */
+    static int getSizeClass(size_t size) {
+        size_t classSize = POOLED_ALLOCATOR_INITIAL_PAGE_SIZE;
+        for (int i = 0; i < POOLED_ALLOCATOR_SIZE_CLASS_COUNT; i++) {
+            if (size == classSize) return i;
+            classSize *= 2;
+        }
+        return -1;
+    }
+
+    /**
+     * Returns the smallest pooled size able to hold the specified size,
+     * or the specified size if it is larger than the largest size class.
+     */
+    static size_t roundToSizeClass(size_t size) {
+        size_t classSize = POOLED_ALLOCATOR_INITIAL_PAGE_SIZE;
+        for (int i = 0; i < POOLED_ALLOCATOR_SIZE_CLASS_COUNT; i++) {
+            if (size <= classSize) return classSize;
+            classSize *= 2;
+        }
+        return size;
+    }
+
+    PooledPage* obtain(size_t size) {
+        const int sizeClass = getSizeClass(size);
+        if (sizeClass >= 0) {
+            Mutex::Autolock _l(mLock);
+            PooledPage* page = mFreePages[sizeClass];
+            if (page) {
+                mFreePages[sizeClass] = page->next;
+                mSize -= page->size;
+                page->next = NULL;
+                return page;
+            }
+        }
+
+        PooledPage* page = (PooledPage*) malloc(size);
+        if (!page) {
+            LOG_ALWAYS_FATAL("Could not allocate a page of %d bytes", (int) size);
+        }
+        page->next = NULL;
+        page->size = size;
+        return page;
+    }
+
+    /**
+     * Returns a linked list of pages to the pool. The pages that do not fit
+     * in the pool are freed.
+     */
+    void recycle(PooledPage* pages) {
+        Mutex::Autolock _l(mLock);
+        while (pages) {
+            PooledPage* next = pages->next;
+
+            const int sizeClass = getSizeClass(pages->size);
+            if (sizeClass >= 0 && mSize + pages->size <= POOLED_ALLOCATOR_MAX_POOL_SIZE) {
+                pages->next = mFreePages[sizeClass];
+                mFreePages[sizeClass] = pages;
+                mSize += pages->size;
+            } else {
+                free(pages);
+            }
+
+            pages = next;
+        }
+    }
+
+    void trim() {
+        Mutex::Autolock _l(mLock);
+        for (int i = 0; i < POOLED_ALLOCATOR_SIZE_CLASS_COUNT; i++) {
+            PooledPage* page = mFreePages[i];
+            while (page) {
+                PooledPage* next = page->next;
+                free(page);
+                page = next;
+            }
+            mFreePages[i] = NULL;
+        }
+        mSize = 0;
+    }
+
+    size_t getSize() {
+        Mutex::Autolock _l(mLock);
+        return mSize;
+    }
+
+private:
+    PooledPage* mFreePages[POOLED_ALLOCATOR_SIZE_CLASS_COUNT];
+    size_t mSize;
+
+    Mutex mLock;
+}; // class PagePool
+
+}; // namespace uirenderer
+
+using namespace uirenderer;
+ANDROID_SINGLETON_STATIC_INSTANCE(PagePool);
+
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors/destructor
+///////////////////////////////////////////////////////////////////////////////
+
+PooledLinearAllocator::PooledLinearAllocator():
+        mPageSize(POOLED_ALLOCATOR_INITIAL_PAGE_SIZE),
+        mMaxAllocSize(POOLED_ALLOCATOR_MAX_WASTE_SIZE),
+        mNext(NULL), mCurrentPage(NULL), mPages(NULL),
+        mTotalAllocated(0), mWastedSpace(0) {
+}
+
+PooledLinearAllocator::~PooledLinearAllocator() {
+    if (mPages) {
+        PagePool::getInstance().recycle(mPages);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Pool
+///////////////////////////////////////////////////////////////////////////////
+
+void PooledLinearAllocator::trimPool() {
+    PagePool::getInstance().trim();
+}
+
+size_t PooledLinearAllocator::getPoolSize() {
+    return PagePool::getInstance().getSize();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Allocation
+///////////////////////////////////////////////////////////////////////////////
+
+PooledPage* PooledLinearAllocator::newPage(size_t size) {
+    PooledPage* page = PagePool::getInstance().obtain(size);
+    mTotalAllocated += page->size - PooledPage::headerSize();
+    return page;
+}
+
+bool PooledLinearAllocator::fitsInCurrentPage(size_t size) const {
+    return mNext && ((char*) mNext) + size <= mCurrentPage->end();
+}
+
+void PooledLinearAllocator::ensureNext(size_t size) {
+    if (fitsInCurrentPage(size)) return;
+
+    if (mCurrentPage && mPageSize < POOLED_ALLOCATOR_MAX_PAGE_SIZE) {
+        mPageSize *= 2;
+    }
+
+    PooledPage* page = newPage(mPageSize);
+    mWastedSpace += mPageSize - PooledPage::headerSize();
+
+    page->next = mPages;
+    mPages = page;
+    mCurrentPage = page;
+    mNext = page->start();
+}
+
+void* PooledLinearAllocator::alloc(size_t size) {
+    size = ALIGN(size);
+
+    if (size > mMaxAllocSize && !fitsInCurrentPage(size)) {
+        // The allocation is too large, give it a dedicated page. The
+        // rounding to the size class is accounted as wasted space
+        const size_t pageSize = PagePool::roundToSizeClass(size + PooledPage::headerSize());
+        PooledPage* page = newPage(pageSize);
+        mWastedSpace += pageSize - PooledPage::headerSize() - size;
+
+        // The dedicated page does not become the current page, the
+        // following allocations keep using the current page
+        page->next = mPages;
+        mPages = page;
+
+        return page->start();
+    }
+
+    ensureNext(size);
+    void* ptr = mNext;
+    mNext = ((char*) mNext) + size;
+    mWastedSpace -= size;
+    return ptr;
+}
+
+void PooledLinearAllocator::rewindIfLastAlloc(void* ptr, size_t allocSize) {
+    allocSize = ALIGN(allocSize);
+    if (mCurrentPage && ptr >= mCurrentPage->start() &&
+            ((char*) mNext) - allocSize == ptr) {
+        mNext = ptr;
+        mWastedSpace += allocSize;
+    }
+}
+
+}; // namespace uirenderer
+}; // namespace android
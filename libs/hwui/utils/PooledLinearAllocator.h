@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_POOLED_LINEAR_ALLOCATOR_H
+#define ANDROID_HWUI_POOLED_LINEAR_ALLOCATOR_H
+
+#include <stddef.h>
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Size of the first page of an allocator, the following pages double in
+// size up to the maximum page size
+#define POOLED_ALLOCATOR_INITIAL_PAGE_SIZE ((size_t) 4096)
+#define POOLED_ALLOCATOR_MAX_PAGE_SIZE ((size_t) 131072)
+
+// Allocations larger than this size get their own page when they do not
+// fit in the current page, to avoid wasting the end of the current page
+#define POOLED_ALLOCATOR_MAX_WASTE_SIZE ((size_t) 1024)
+
+// Maximum amount of memory kept in the page pool, in bytes
+#define POOLED_ALLOCATOR_MAX_POOL_SIZE ((size_t) 1024 * 1024)
+
+///////////////////////////////////////////////////////////////////////////////
+// Allocator
+///////////////////////////////////////////////////////////////////////////////
+
+struct PooledPage;
+
+/**
+ * Linear allocator with the same allocation semantics as LinearAllocator,
+ * whose pages are taken from, and returned to, a process-wide pool. Pages
+ * come in a few size classes (powers of two between the initial and the
+ * maximum page size) so that a page released by an allocator is a good fit
+ * for the next allocator. This avoids going through malloc() and free()
+ * every time a display list is re-recorded.
+ *
+ * Like LinearAllocator, the objects allocated with this allocator are never
+ * destroyed: the memory is released all at once when the allocator is.
+ */
+class PooledLinearAllocator {
+public:
+    PooledLinearAllocator();
+    ~PooledLinearAllocator();
+
+    /**
+     * Reserves and returns a region of memory of at least the specified size,
+     * aligned on 8 bytes.
+     */
+    void* alloc(size_t size);
+
+    /**
+     * Releases the memory of the last allocation if it is the specified
+     * pointer. This is useful to cancel an allocation that is no longer
+     * needed.
+     */
+    void rewindIfLastAlloc(void* ptr, size_t allocSize);
+
+    /**
+     * Returns the amount of allocated memory, in bytes.
+     */
+    size_t usedSize() const {
+        return mTotalAllocated - mWastedSpace;
+    }
+
+    /**
+     * Releases the pages held by the process-wide pool.
+     */
+    static void trimPool();
+
+    /**
+     * Returns the amount of memory held by the process-wide pool, in bytes.
+     */
+    static size_t getPoolSize();
+
+private:
+    // Allocators can't be copied
+    PooledLinearAllocator(const PooledLinearAllocator&);
+    PooledLinearAllocator& operator=(const PooledLinearAllocator&);
+
+    bool fitsInCurrentPage(size_t size) const;
+    void ensureNext(size_t size);
+    PooledPage* newPage(size_t size);
+
+    size_t mPageSize;
+    size_t mMaxAllocSize;
+
+    void* mNext;
+    PooledPage* mCurrentPage;
+    PooledPage* mPages;
+
+    size_t mTotalAllocated;
+    size_t mWastedSpace;
+}; // class PooledLinearAllocator
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_POOLED_LINEAR_ALLOCATOR_H
@@ -17,51 +17,120 @@
 #ifndef ANDROID_HWUI_TINYHASHMAP_H
 #define ANDROID_HWUI_TINYHASHMAP_H
 
-#include <utils/BasicHashtable.h>
+#include <stdlib.h>
+
+#include <utils/TypeHelpers.h>
 
 namespace android {
 namespace uirenderer {
 
 /**
  * A very simple hash map that doesn't allow duplicate keys, overwriting the older entry.
+ *
+ * Entries are stored inline in an open addressing table. The map is meant to be filled
+ * and cleared over and over (once per frame): clear() only bumps a generation counter and
+ * keeps the table, so a map that reached its working size never allocates again.
+ * Keys and values must be cheap to copy and default constructible.
  */
 template <typename TKey, typename TValue>
 class TinyHashMap {
 public:
-    typedef key_value_pair_t<TKey, TValue> TEntry;
+    TinyHashMap(): mSlots(NULL), mCapacity(0), mSize(0), mGeneration(1) {
+    }
+
+    ~TinyHashMap() {
+        delete[] mSlots;
+    }
 
     /**
      * Puts an entry in the hash, removing any existing entry with the same key
      */
     void put(TKey key, TValue value) {
-        hash_t hash = android::hash_type(key);
-
-        ssize_t index = mTable.find(-1, hash, key);
-        if (index != -1) {
-            mTable.removeAt(index);
+        if ((mSize + 1) * 2 > mCapacity) {
+            grow();
         }
 
-        TEntry initEntry(key, value);
-        mTable.add(hash, initEntry);
+        Slot* slot = findSlot(key, android::hash_type(key));
+        if (slot->generation != mGeneration) {
+            slot->generation = mGeneration;
+            slot->key = key;
+            mSize++;
+        }
+        slot->value = value;
     }
 
     /**
      * Return true if key is in the map, in which case stores the value in the output ref
      */
     bool get(TKey key, TValue& outValue) {
-        hash_t hash = android::hash_type(key);
-        ssize_t index = mTable.find(-1, hash, key);
-        if (index == -1) {
+        if (mSize == 0) return false;
+
+        Slot* slot = findSlot(key, android::hash_type(key));
+        if (slot->generation != mGeneration) {
             return false;
         }
-        outValue = mTable.entryAt(index).value;
+        outValue = slot->value;
         return true;
     }
 
-    void clear() { mTable.clear(); }
+    void clear() {
+        mSize = 0;
+        if (++mGeneration == 0) {
+            // The counter wrapped around, stale slots could look current
+            for (size_t i = 0; i < mCapacity; i++) {
+                mSlots[i].generation = 0;
+            }
+            mGeneration = 1;
+        }
+    }
 
 private:
-    BasicHashtable<TKey, TEntry> mTable;
+    struct Slot {
+        Slot(): generation(0) { }
+
+        TKey key;
+        TValue value;
+        // The slot is in use if this matches the generation of the map
+        uint32_t generation;
+    };
+
+    static const size_t kMinCapacity = 8;
+
+    TinyHashMap(const TinyHashMap& that);  // disallow copy constructor
+
+    /**
+     * Returns the slot holding the specified key, or the empty slot where it would be inserted.
+     */
+    Slot* findSlot(const TKey& key, hash_t hash) const {
+        const size_t mask = mCapacity - 1;
+        uint32_t h = (uint32_t) hash;
+        size_t index = (h ^ (h >> 16)) & mask;
+        while (mSlots[index].generation == mGeneration && !(mSlots[index].key == key)) {
+            index = (index + 1) & mask;
+        }
+        return &mSlots[index];
+    }
+
+    void grow() {
+        Slot* oldSlots = mSlots;
+        size_t oldCapacity = mCapacity;
+
+        mCapacity = oldCapacity ? oldCapacity * 2 : kMinCapacity;
+        mSlots = new Slot[mCapacity];
+
+        for (size_t i = 0; i < oldCapacity; i++) {
+            if (oldSlots[i].generation == mGeneration) {
+                Slot* slot = findSlot(oldSlots[i].key, android::hash_type(oldSlots[i].key));
+                *slot = oldSlots[i];
+            }
+        }
+        delete[] oldSlots;
+    }
+
+    Slot* mSlots;
+    size_t mCapacity;
+    size_t mSize;
+    uint32_t mGeneration;
 };
 
 }; // namespace uirenderer
@@ -19,7 +19,9 @@
 #include <utils/Log.h>
 #include <utils/misc.h>
 #include <utils/List.h>
+#include <utils/Mutex.h>
 #include <utils/String8.h>
+#include <utils/Vector.h>
 
 #include <cstdio>
 
@@ -68,8 +70,20 @@ static struct {
     jmethodID ctor;
 } gSurfacePlaneClassInfo;
 
+static struct {
+    jmethodID clear;
+} gBufferClassInfo;
+
 // ----------------------------------------------------------------------------
 
+class JNIImageReaderContext;
+
+// A LockedBuffer that knows which reader it belongs to, so that Image methods,
+// which only see the buffer, can reach the reader's plane buffer cache.
+struct JNILockedBuffer : public CpuConsumer::LockedBuffer {
+    JNIImageReaderContext* ctx;
+};
+
 class JNIImageReaderContext : public CpuConsumer::FrameAvailableListener
 {
 public:
@@ -98,10 +112,28 @@ public:
     void setBufferHeight(int height) { mHeight = height; }
     int getBufferHeight() { return mHeight; }
 
+    // Returns a local reference to a direct ByteBuffer over [base, base + size),
+    // reusing the one created when the same buffer slot was last locked.
+    jobject getPlaneByteBuffer(JNIEnv* env, uint8_t* base, uint32_t size);
+
 private:
     static JNIEnv* getJNIEnv(bool* needsDetach);
     static void detachJNI();
 
+    struct PlaneBuffer {
+        uint8_t* base;
+        uint32_t size;
+        jobject byteBuffer;  // global ref
+    };
+
+    // Enough for every plane of every slot a BufferQueue can have
+    static const size_t kMaxPlaneBuffers =
+            BufferQueue::NUM_BUFFER_SLOTS * IMAGE_READER_MAX_NUM_PLANES;
+
+    Mutex mPlaneBufferLock;
+    // Most recently used last
+    Vector<PlaneBuffer> mPlaneBuffers;
+
     List<CpuConsumer::LockedBuffer*> mBuffers;
     sp<CpuConsumer> mConsumer;
     sp<BufferQueue> mBufferQueue;
@@ -117,7 +149,8 @@ JNIImageReaderContext::JNIImageReaderContext(JNIEnv* env,
     mWeakThiz(env->NewGlobalRef(weakThiz)),
     mClazz((jclass)env->NewGlobalRef(clazz)) {
     for (int i = 0; i < maxImages; i++) {
-        CpuConsumer::LockedBuffer *buffer = new CpuConsumer::LockedBuffer;
+        JNILockedBuffer *buffer = new JNILockedBuffer;
+        buffer->ctx = this;
         mBuffers.push_back(buffer);
     }
 }
@@ -162,12 +195,47 @@ void JNIImageReaderContext::returnLockedBuffer(CpuConsumer::LockedBuffer* buffer
     mBuffers.push_back(buffer);
 }
 
+jobject JNIImageReaderContext::getPlaneByteBuffer(JNIEnv* env, uint8_t* base, uint32_t size) {
+    Mutex::Autolock _l(mPlaneBufferLock);
+
+    for (size_t i = 0; i < mPlaneBuffers.size(); i++) {
+        PlaneBuffer entry = mPlaneBuffers[i];
+        if (entry.base == base && entry.size == size) {
+            mPlaneBuffers.removeAt(i);
+            mPlaneBuffers.push(entry);
+            // The previous user may have moved position and limit
+            jobject byteBuffer = env->NewLocalRef(entry.byteBuffer);
+            env->CallObjectMethod(byteBuffer, gBufferClassInfo.clear);
+            return byteBuffer;
+        }
+    }
+
+    jobject byteBuffer = env->NewDirectByteBuffer(base, size);
+    if (byteBuffer == NULL) {
+        return NULL;
+    }
+
+    if (mPlaneBuffers.size() >= kMaxPlaneBuffers) {
+        env->DeleteGlobalRef(mPlaneBuffers[0].byteBuffer);
+        mPlaneBuffers.removeAt(0);
+    }
+    PlaneBuffer entry;
+    entry.base = base;
+    entry.size = size;
+    entry.byteBuffer = env->NewGlobalRef(byteBuffer);
+    mPlaneBuffers.push(entry);
+    return byteBuffer;
+}
+
 JNIImageReaderContext::~JNIImageReaderContext() {
     bool needsDetach = false;
     JNIEnv* env = getJNIEnv(&needsDetach);
     if (env != NULL) {
         env->DeleteGlobalRef(mWeakThiz);
         env->DeleteGlobalRef(mClazz);
+        for (size_t i = 0; i < mPlaneBuffers.size(); i++) {
+            env->DeleteGlobalRef(mPlaneBuffers[i].byteBuffer);
+        }
     } else {
         ALOGW("leaking JNI object references");
     }
@@ -178,7 +246,7 @@ JNIImageReaderContext::~JNIImageReaderContext() {
     // Delete LockedBuffers
     for (List<CpuConsumer::LockedBuffer *>::iterator it = mBuffers.begin();
             it != mBuffers.end(); it++) {
-        delete *it;
+        delete static_cast<JNILockedBuffer*>(*it);
     }
     mBuffers.clear();
     mConsumer.clear();
@@ -600,6 +668,11 @@ static void ImageReader_classInit(JNIEnv* env, jclass clazz)
             "(Landroid/media/ImageReader$SurfaceImage;III)V");
     LOG_ALWAYS_FATAL_IF(gSurfacePlaneClassInfo.ctor == NULL,
             "Can not find SurfacePlane constructor");
+
+    jclass bufferClazz = env->FindClass("java/nio/Buffer");
+    LOG_ALWAYS_FATAL_IF(bufferClazz == NULL, "Can not find java/nio/Buffer");
+    gBufferClassInfo.clear = env->GetMethodID(bufferClazz, "clear", "()Ljava/nio/Buffer;");
+    LOG_ALWAYS_FATAL_IF(gBufferClassInfo.clear == NULL, "Can not find Buffer.clear");
 }
 
 static void ImageReader_init(JNIEnv* env, jobject thiz, jobject weakThiz,
@@ -688,21 +761,16 @@ static void ImageReader_imageRelease(JNIEnv* env, jobject thiz, jobject image)
     ctx->returnLockedBuffer(buffer);
 }
 
-static jint ImageReader_imageSetup(JNIEnv* env, jobject thiz,
-                                             jobject image)
+// Locks the next buffer into a spare LockedBuffer. Returns ACQUIRE_SUCCESS,
+// ACQUIRE_NO_BUFFERS or ACQUIRE_MAX_IMAGES, or -1 with an exception pending.
+static jint ImageReader_lockNextBuffer(JNIEnv* env, JNIImageReaderContext* ctx,
+        CpuConsumer::LockedBuffer** lockedBuffer, bool warnIfMaxImages)
 {
-    ALOGV("%s:", __FUNCTION__);
-    JNIImageReaderContext* ctx = ImageReader_getContext(env, thiz);
-    if (ctx == NULL) {
-        jniThrowRuntimeException(env, "ImageReaderContext is not initialized");
-        return -1;
-    }
-
     CpuConsumer* consumer = ctx->getCpuConsumer();
     CpuConsumer::LockedBuffer* buffer = ctx->getLockedBuffer();
     if (buffer == NULL) {
-        ALOGW("Unable to acquire a lockedBuffer, very likely client tries to lock more than"
-            " maxImages buffers");
+        ALOGW_IF(warnIfMaxImages, "Unable to acquire a lockedBuffer, very likely client tries"
+            " to lock more than maxImages buffers");
         return ACQUIRE_MAX_IMAGES;
     }
     status_t res = consumer->lockNextBuffer(buffer);
@@ -717,10 +785,21 @@ static jint ImageReader_imageSetup(JNIEnv* env, jobject thiz,
                 jniThrowExceptionFmt(env, "java/lang/AssertionError",
                           "Unknown error (%d) when we tried to lock buffer.",
                           res);
+                return -1;
             }
         }
         return ACQUIRE_NO_BUFFERS;
     }
+    *lockedBuffer = buffer;
+    return ACQUIRE_SUCCESS;
+}
+
+// Checks a locked buffer against the reader configuration and hands it to the
+// image. Returns ACQUIRE_SUCCESS, or -1 with an exception pending.
+static jint ImageReader_attachBuffer(JNIEnv* env, JNIImageReaderContext* ctx,
+        CpuConsumer::LockedBuffer* buffer, jobject image)
+{
+    CpuConsumer* consumer = ctx->getCpuConsumer();
 
     if (buffer->format == HAL_PIXEL_FORMAT_YCrCb_420_SP) {
         jniThrowException(env, "java/lang/UnsupportedOperationException",
@@ -790,6 +869,65 @@ static jint ImageReader_imageSetup(JNIEnv* env, jobject thiz,
     return ACQUIRE_SUCCESS;
 }
 
+static jint ImageReader_imageSetup(JNIEnv* env, jobject thiz,
+                                             jobject image)
+{
+    ALOGV("%s:", __FUNCTION__);
+    JNIImageReaderContext* ctx = ImageReader_getContext(env, thiz);
+    if (ctx == NULL) {
+        jniThrowRuntimeException(env, "ImageReaderContext is not initialized");
+        return -1;
+    }
+
+    CpuConsumer::LockedBuffer* buffer = NULL;
+    jint res = ImageReader_lockNextBuffer(env, ctx, &buffer, true);
+    if (res != ACQUIRE_SUCCESS) {
+        return res;
+    }
+    return ImageReader_attachBuffer(env, ctx, buffer, image);
+}
+
+// Like ImageReader_imageSetup, but drains the queue natively and hands only
+// the newest buffer to the image; older ones go straight back to the producer.
+static jint ImageReader_imageSetupLatest(JNIEnv* env, jobject thiz,
+                                             jobject image)
+{
+    ALOGV("%s:", __FUNCTION__);
+    JNIImageReaderContext* ctx = ImageReader_getContext(env, thiz);
+    if (ctx == NULL) {
+        jniThrowRuntimeException(env, "ImageReaderContext is not initialized");
+        return -1;
+    }
+
+    CpuConsumer* consumer = ctx->getCpuConsumer();
+    CpuConsumer::LockedBuffer* buffer = NULL;
+    jint res = ImageReader_lockNextBuffer(env, ctx, &buffer, true);
+    if (res != ACQUIRE_SUCCESS) {
+        return res;
+    }
+
+    int dropped = 0;
+    for (;;) {
+        CpuConsumer::LockedBuffer* next = NULL;
+        res = ImageReader_lockNextBuffer(env, ctx, &next, false);
+        if (res == -1) {
+            consumer->unlockBuffer(*buffer);
+            ctx->returnLockedBuffer(buffer);
+            return -1;
+        } else if (res != ACQUIRE_SUCCESS) {
+            // Queue drained, or every spare buffer is held by the client
+            break;
+        }
+        consumer->unlockBuffer(*buffer);
+        ctx->returnLockedBuffer(buffer);
+        buffer = next;
+        dropped++;
+    }
+    ALOGV("%s: dropped %d stale buffers", __FUNCTION__, dropped);
+
+    return ImageReader_attachBuffer(env, ctx, buffer, image);
+}
+
 static jobject ImageReader_getSurface(JNIEnv* env, jobject thiz)
 {
     ALOGV("%s: ", __FUNCTION__);
@@ -838,9 +976,10 @@ static jobject Image_getByteBuffer(JNIEnv* env, jobject thiz, int idx)
         jniThrowException(env, "java/lang/IllegalStateException", "Image was released");
     }
 
-    // Create byteBuffer from native buffer
+    // Create byteBuffer from native buffer, or reuse the one made for this slot
     Image_getLockedBufferInfo(env, buffer, idx, &base, &size);
-    byteBuffer = env->NewDirectByteBuffer(base, size);
+    byteBuffer = static_cast<JNILockedBuffer*>(buffer)->ctx->getPlaneByteBuffer(
+            env, base, size);
     // TODO: throw dvm exOutOfMemoryError?
     if ((byteBuffer == NULL) && (env->ExceptionCheck() == false)) {
         jniThrowException(env, "java/lang/IllegalStateException", "Failed to allocate ByteBuffer");
@@ -859,6 +998,7 @@ static JNINativeMethod gImageReaderMethods[] = {
     {"nativeClose",            "()V",                        (void*)ImageReader_close },
     {"nativeReleaseImage",     "(Landroid/media/Image;)V",   (void*)ImageReader_imageRelease },
     {"nativeImageSetup",       "(Landroid/media/Image;)I",    (void*)ImageReader_imageSetup },
+    {"nativeImageSetupLatest", "(Landroid/media/Image;)I",    (void*)ImageReader_imageSetupLatest },
     {"nativeGetSurface",       "()Landroid/view/Surface;",   (void*)ImageReader_getSurface },
 };
 
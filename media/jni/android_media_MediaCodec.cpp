@@ -23,6 +23,7 @@
 #include "android_media_MediaCrypto.h"
 #include "android_media_Utils.h"
 #include "android_runtime/AndroidRuntime.h"
+#include "android_runtime/Log.h"
 #include "android_runtime/android_view_Surface.h"
 #include "jni.h"
 #include "JNIHelp.h"
@@ -33,6 +34,7 @@
 #include <media/stagefright/MediaCodec.h>
 #include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AHandler.h>
 #include <media/stagefright/foundation/ALooper.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/foundation/AString.h>
@@ -51,6 +53,14 @@ enum {
     DEQUEUE_INFO_OUTPUT_BUFFERS_CHANGED     = -3,
 };
 
+enum {
+    EVENT_CALLBACK_INPUT_AVAILABLE          = 1,
+    EVENT_CALLBACK_OUTPUT_AVAILABLE         = 2,
+    EVENT_CALLBACK_ERROR                    = 3,
+    EVENT_CALLBACK_OUTPUT_FORMAT_CHANGED    = 4,
+    EVENT_CALLBACK_OUTPUT_BUFFERS_CHANGED   = 5,
+};
+
 struct CryptoErrorCodes {
     jint cryptoErrorNoKey;
     jint cryptoErrorKeyExpired;
@@ -65,6 +75,7 @@ struct fields_t {
     jfieldID cryptoInfoKeyID;
     jfieldID cryptoInfoIVID;
     jfieldID cryptoInfoModeID;
+    jmethodID postEventFromNativeID;
 };
 
 static fields_t gFields;
@@ -75,7 +86,8 @@ JMediaCodec::JMediaCodec(
         JNIEnv *env, jobject thiz,
         const char *name, bool nameIsType, bool encoder)
     : mClass(NULL),
-      mObject(NULL) {
+      mObject(NULL),
+      mCallbackEnabled(false) {
     jclass clazz = env->GetObjectClass(thiz);
     CHECK(clazz != NULL);
 
@@ -102,6 +114,10 @@ status_t JMediaCodec::initCheck() const {
 }
 
 JMediaCodec::~JMediaCodec() {
+    if (mCallbackLooper != NULL) {
+        mCallbackLooper->unregisterHandler(mCallbackHandler->id());
+    }
+
     if (mCodec != NULL) {
         mCodec->release();
         mCodec.clear();
@@ -136,7 +152,11 @@ status_t JMediaCodec::createInputSurface(
 }
 
 status_t JMediaCodec::start() {
-    return mCodec->start();
+    status_t err = mCodec->start();
+    if (err == OK && mCallbackEnabled) {
+        requestActivityNotification();
+    }
+    return err;
 }
 
 status_t JMediaCodec::stop() {
@@ -320,6 +340,133 @@ void JMediaCodec::setVideoScalingMode(int mode) {
     }
 }
 
+
+struct CodecCallbackHandler : public AHandler {
+    enum {
+        kWhatActivity = 'actv',
+    };
+
+    CodecCallbackHandler(const wp<JMediaCodec> &codec)
+        : mCodec(codec) {
+    }
+
+protected:
+    virtual void onMessageReceived(const sp<AMessage> &msg) {
+        sp<JMediaCodec> codec = mCodec.promote();
+        if (codec != NULL && msg->what() == kWhatActivity) {
+            codec->onActivity();
+        }
+    }
+
+private:
+    wp<JMediaCodec> mCodec;
+
+    DISALLOW_EVIL_CONSTRUCTORS(CodecCallbackHandler);
+};
+
+status_t JMediaCodec::setCallbackEnabled(bool enable) {
+    if (enable && mCallbackLooper == NULL) {
+        mCallbackLooper = new ALooper;
+        mCallbackLooper->setName("MediaCodec_callback");
+        status_t err = mCallbackLooper->start(
+                false,      // runOnCallingThread
+                true,       // canCallJava
+                PRIORITY_FOREGROUND);
+        if (err != OK) {
+            mCallbackLooper.clear();
+            return err;
+        }
+
+        mCallbackHandler = new CodecCallbackHandler(this);
+        mCallbackLooper->registerHandler(mCallbackHandler);
+    }
+
+    mCallbackEnabled = enable;
+    if (enable) {
+        requestActivityNotification();
+    }
+    return OK;
+}
+
+void JMediaCodec::requestActivityNotification() {
+    mCodec->requestActivityNotification(
+            new AMessage(CodecCallbackHandler::kWhatActivity, mCallbackHandler->id()));
+}
+
+// Posts a callback event to Java. Returns false if it threw, the exception is
+// then logged and cleared as no further JNI call may be made while it is
+// pending.
+static bool postCallbackEvent(JNIEnv *env, jobject thiz, int what,
+        jint arg1, jint arg2, jint arg3, jlong arg4, jint arg5) {
+    env->CallVoidMethod(thiz, gFields.postEventFromNativeID,
+            what, arg1, arg2, arg3, arg4, arg5);
+    if (env->ExceptionCheck()) {
+        ALOGW("An exception occurred while notifying a MediaCodec callback.");
+        LOGW_EX(env);
+        env->ExceptionClear();
+        return false;
+    }
+    return true;
+}
+
+void JMediaCodec::onActivity() {
+    if (!mCallbackEnabled) {
+        return;
+    }
+
+    JNIEnv *env = AndroidRuntime::getJNIEnv();
+    ScopedLocalRef<jobject> thiz(env, env->NewLocalRef(mObject));
+    if (thiz.get() == NULL) {
+        return;
+    }
+
+    size_t index, offset, size;
+    int64_t timeUs;
+    uint32_t flags;
+    status_t err;
+
+    // The buffers left after an exception are notified again once re-armed,
+    // but an error is sticky and would be notified over and over: the next
+    // notification is only requested again by start()
+    bool posted = true;
+    bool failed = false;
+    while (posted && (err = mCodec->dequeueInputBuffer(&index, 0)) == OK) {
+        posted = postCallbackEvent(env, thiz.get(),
+                EVENT_CALLBACK_INPUT_AVAILABLE, (jint) index, 0, 0, 0ll, 0);
+    }
+    if (posted && err != -EAGAIN) {
+        postCallbackEvent(env, thiz.get(), EVENT_CALLBACK_ERROR, (jint) err, 0, 0, 0ll, 0);
+        failed = true;
+    }
+
+    while (posted && !failed) {
+        err = mCodec->dequeueOutputBuffer(&index, &offset, &size, &timeUs, &flags, 0);
+        if (err == OK) {
+            posted = postCallbackEvent(env, thiz.get(),
+                    EVENT_CALLBACK_OUTPUT_AVAILABLE, (jint) index,
+                    (jint) offset, (jint) size, (jlong) timeUs, (jint) flags);
+        } else if (err == INFO_FORMAT_CHANGED) {
+            posted = postCallbackEvent(env, thiz.get(),
+                    EVENT_CALLBACK_OUTPUT_FORMAT_CHANGED, 0, 0, 0, 0ll, 0);
+        } else if (err == INFO_OUTPUT_BUFFERS_CHANGED) {
+            posted = postCallbackEvent(env, thiz.get(),
+                    EVENT_CALLBACK_OUTPUT_BUFFERS_CHANGED, 0, 0, 0, 0ll, 0);
+        } else {
+            if (err != -EAGAIN) {
+                postCallbackEvent(env, thiz.get(),
+                        EVENT_CALLBACK_ERROR, (jint) err, 0, 0, 0ll, 0);
+                failed = true;
+            }
+            break;
+        }
+    }
+
+    // Activity notifications are one-shot
+    if (mCallbackEnabled && !failed) {
+        requestActivityNotification();
+    }
+}
+
 }  // namespace android
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -880,6 +1027,22 @@ static void android_media_MediaCodec_setVideoScalingMode(
     codec->setVideoScalingMode(mode);
 }
 
+static void android_media_MediaCodec_native_setCallback(
+        JNIEnv *env, jobject thiz, jboolean enable) {
+    ALOGV("android_media_MediaCodec_native_setCallback");
+
+    sp<JMediaCodec> codec = getMediaCodec(env, thiz);
+
+    if (codec == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+
+    status_t err = codec->setCallbackEnabled(enable);
+
+    throwExceptionAsNecessary(env, err);
+}
+
 static void android_media_MediaCodec_native_init(JNIEnv *env) {
     ScopedLocalRef<jclass> clazz(
             env, env->FindClass("android/media/MediaCodec"));
@@ -888,6 +1051,10 @@ static void android_media_MediaCodec_native_init(JNIEnv *env) {
     gFields.context = env->GetFieldID(clazz.get(), "mNativeContext", "J");
     CHECK(gFields.context != NULL);
 
+    gFields.postEventFromNativeID =
+        env->GetMethodID(clazz.get(), "postEventFromNative", "(IIIIJI)V");
+    CHECK(gFields.postEventFromNativeID != NULL);
+
     clazz.reset(env->FindClass("android/media/MediaCodec$CryptoInfo"));
     CHECK(clazz.get() != NULL);
 
@@ -1017,6 +1184,9 @@ static JNINativeMethod gMethods[] = {
     { "setVideoScalingMode", "(I)V",
       (void *)android_media_MediaCodec_setVideoScalingMode },
 
+    { "native_setCallback", "(Z)V",
+      (void *)android_media_MediaCodec_native_setCallback },
+
     { "native_init", "()V", (void *)android_media_MediaCodec_native_init },
 
     { "native_setup", "(Ljava/lang/String;ZZ)V",
@@ -26,6 +26,7 @@
 
 namespace android {
 
+struct AHandler;
 struct ALooper;
 struct AMessage;
 struct AString;
@@ -91,6 +92,17 @@ struct JMediaCodec : public RefBase {
 
     void setVideoScalingMode(int mode);
 
+    // Switches between the polling dequeue calls and callback mode, in which
+    // buffer events are posted to Java from a native callback thread as soon
+    // as the codec signals activity. dequeue* must not be called in callback
+    // mode.
+    status_t setCallbackEnabled(bool enable);
+
+    // Drains every available input and output buffer into Java callbacks.
+    // Runs on the callback thread. After an error is reported, no further
+    // callback is made until the codec is started again.
+    void onActivity();
+
 protected:
     virtual ~JMediaCodec();
 
@@ -102,6 +114,12 @@ private:
     sp<ALooper> mLooper;
     sp<MediaCodec> mCodec;
 
+    sp<ALooper> mCallbackLooper;
+    sp<AHandler> mCallbackHandler;
+    volatile bool mCallbackEnabled;
+
+    void requestActivityNotification();
+
     DISALLOW_EVIL_CONSTRUCTORS(JMediaCodec);
 };
 
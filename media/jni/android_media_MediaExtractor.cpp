@@ -282,6 +282,51 @@ status_t JMediaExtractor::getSampleFlags(uint32_t *sampleFlags) {
     return OK;
 }
 
+status_t JMediaExtractor::readSamples(
+        void *dst, size_t dstSize, int64_t *meta, size_t maxSamples,
+        size_t *sampleCount) {
+    size_t count = 0;
+    size_t used = 0;
+    status_t err = OK;
+
+    while (count < maxSamples) {
+        size_t trackIndex;
+        int64_t timeUs;
+        uint32_t flags;
+        if ((err = getSampleTrackIndex(&trackIndex)) != OK
+                || (err = getSampleTime(&timeUs)) != OK
+                || (err = getSampleFlags(&flags)) != OK) {
+            break;
+        }
+        if (flags & NuMediaExtractor::SAMPLE_FLAG_ENCRYPTED) {
+            break;
+        }
+
+        sp<ABuffer> buffer = new ABuffer((char *)dst + used, dstSize - used);
+        if ((err = mImpl->readSampleData(buffer)) != OK) {
+            break;
+        }
+
+        int64_t *sampleMeta = meta + 4 * count;
+        sampleMeta[0] = timeUs;
+        sampleMeta[1] = flags;
+        sampleMeta[2] = trackIndex;
+        sampleMeta[3] = buffer->size();
+        used += buffer->size();
+        count++;
+
+        if ((err = mImpl->advance()) != OK) {
+            break;
+        }
+    }
+
+    *sampleCount = count;
+
+    // Running out of room or into an encrypted sample after reading some
+    // samples is not an error; the caller picks up from there.
+    return count > 0 ? OK : err;
+}
+
 status_t JMediaExtractor::getSampleMeta(sp<MetaData> *sampleMeta) {
     return mImpl->getSampleMeta(sampleMeta);
 }
@@ -467,6 +512,46 @@ static jint android_media_MediaExtractor_readSampleData(
     return (jint) sampleSize;
 }
 
+static jint android_media_MediaExtractor_readSamples(
+        JNIEnv *env, jobject thiz, jobject byteBuf, jint offset,
+        jlongArray metaArray, jint maxSamples) {
+    sp<JMediaExtractor> extractor = getMediaExtractor(env, thiz);
+
+    if (extractor == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return -1;
+    }
+
+    void *dst = env->GetDirectBufferAddress(byteBuf);
+    jlong capacity = env->GetDirectBufferCapacity(byteBuf);
+    if (dst == NULL || capacity < 0 || metaArray == NULL || offset < 0
+            || offset > capacity || maxSamples < 0
+            || env->GetArrayLength(metaArray) / 4 < maxSamples) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return -1;
+    }
+
+    jlong *meta = env->GetLongArrayElements(metaArray, NULL);
+    if (meta == NULL) {
+        return -1;
+    }
+
+    size_t sampleCount;
+    status_t err = extractor->readSamples(
+            (char *)dst + offset, capacity - offset, meta, maxSamples, &sampleCount);
+
+    env->ReleaseLongArrayElements(metaArray, meta, 0);
+
+    if (err == ERROR_END_OF_STREAM) {
+        return -1;
+    } else if (err != OK) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return -1;
+    }
+
+    return (jint) sampleCount;
+}
+
 static jint android_media_MediaExtractor_getSampleTrackIndex(
         JNIEnv *env, jobject thiz) {
     sp<JMediaExtractor> extractor = getMediaExtractor(env, thiz);
@@ -819,6 +904,9 @@ static JNINativeMethod gMethods[] = {
     { "readSampleData", "(Ljava/nio/ByteBuffer;I)I",
         (void *)android_media_MediaExtractor_readSampleData },
 
+    { "readSamples", "(Ljava/nio/ByteBuffer;I[JI)I",
+        (void *)android_media_MediaExtractor_readSamples },
+
     { "getSampleTrackIndex", "()I",
         (void *)android_media_MediaExtractor_getSampleTrackIndex },
 
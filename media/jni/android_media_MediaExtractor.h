@@ -59,6 +59,15 @@ struct JMediaExtractor : public RefBase {
     status_t getSampleFlags(uint32_t *sampleFlags);
     status_t getSampleMeta(sp<MetaData> *sampleMeta);
 
+    // Reads up to maxSamples consecutive samples into dst and advances past
+    // them. For sample i, meta[4 * i] to meta[4 * i + 3] receive its time,
+    // flags, track index and size; the samples are packed back to back.
+    // Stops early at an encrypted sample, which needs its crypto info read
+    // before advancing, and when the next sample does not fit.
+    status_t readSamples(
+            void *dst, size_t dstSize, int64_t *meta, size_t maxSamples,
+            size_t *sampleCount);
+
     bool getCachedDuration(int64_t *durationUs, bool *eos) const;
 
 protected:
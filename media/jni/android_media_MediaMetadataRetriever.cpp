@@ -19,7 +19,11 @@
 #define LOG_TAG "MediaMetadataRetrieverJNI"
 
 #include <assert.h>
+#include <sys/stat.h>
+#include <utils/JenkinsHash.h>
 #include <utils/Log.h>
+#include <utils/LruCache.h>
+#include <utils/String8.h>
 #include <utils/threads.h>
 #include <core/SkBitmap.h>
 #include <media/mediametadataretriever.h>
@@ -31,8 +35,145 @@
 #include "android_media_Utils.h"
 
 
+namespace android {
+
+// Identifies a decoded frame: where it came from and how it was requested.
+// width and height are 0 for frames at their native size.
+struct FrameCacheKey {
+    String8 source;
+    int64_t timeUs;
+    int option;
+    int width;
+    int height;
+
+    FrameCacheKey(): timeUs(0), option(0), width(0), height(0) {
+    }
+
+    bool operator==(const FrameCacheKey& other) const {
+        return timeUs == other.timeUs && option == other.option
+                && width == other.width && height == other.height
+                && source == other.source;
+    }
+
+    bool operator!=(const FrameCacheKey& other) const {
+        return !(*this == other);
+    }
+};
+
+inline hash_t hash_type(const FrameCacheKey& key) {
+    uint32_t hash = JenkinsHashMixBytes(0, (const uint8_t*) key.source.string(),
+            key.source.length());
+    hash = JenkinsHashMix(hash, android::hash_type(key.timeUs));
+    hash = JenkinsHashMix(hash, key.option);
+    hash = JenkinsHashMix(hash, key.width);
+    hash = JenkinsHashMix(hash, key.height);
+    return JenkinsHashWhiten(hash);
+}
+
+// RGB565 pixels, already rotated and scaled to their final size
+struct FrameCacheEntry {
+    size_t width;
+    size_t height;
+    // Size the bitmap should be shown at, for frames at their native size
+    size_t displayWidth;
+    size_t displayHeight;
+    uint16_t* pixels;
+
+    FrameCacheEntry(size_t w, size_t h)
+        : width(w), height(h), displayWidth(w), displayHeight(h) {
+        pixels = new uint16_t[w * h];
+    }
+
+    ~FrameCacheEntry() {
+        delete[] pixels;
+    }
+
+    size_t byteSize() const {
+        return width * height * sizeof(uint16_t);
+    }
+};
+
+/**
+ * A process wide LRU cache of decoded frames, shared by every retriever so
+ * that scrubbing UIs which recreate retrievers still hit it. The cache is
+ * bounded in bytes and is disabled until a size is set.
+ */
+class FrameCache: public OnEntryRemoved<FrameCacheKey, FrameCacheEntry*> {
+public:
+    FrameCache()
+        : mCache(LruCache<FrameCacheKey, FrameCacheEntry*>::kUnlimitedCapacity),
+          mSize(0), mMaxSize(0) {
+        mCache.setOnEntryRemovedListener(this);
+    }
+
+    void operator()(FrameCacheKey& key, FrameCacheEntry*& entry) {
+        mSize -= entry->byteSize();
+        delete entry;
+    }
+
+    void setMaxSize(size_t maxSize) {
+        Mutex::Autolock _l(mLock);
+        mMaxSize = maxSize;
+        trim_l();
+    }
+
+    // Copies the cached frame into a new entry owned by the caller
+    FrameCacheEntry* get(const FrameCacheKey& key) {
+        Mutex::Autolock _l(mLock);
+        if (key.source.isEmpty()) {
+            return NULL;
+        }
+        FrameCacheEntry* cached = mCache.get(key);
+        if (cached == NULL) {
+            return NULL;
+        }
+        FrameCacheEntry* entry = new FrameCacheEntry(cached->width, cached->height);
+        entry->displayWidth = cached->displayWidth;
+        entry->displayHeight = cached->displayHeight;
+        memcpy(entry->pixels, cached->pixels, cached->byteSize());
+        return entry;
+    }
+
+    void put(const FrameCacheKey& key, const FrameCacheEntry& frame) {
+        Mutex::Autolock _l(mLock);
+        if (key.source.isEmpty() || frame.byteSize() > mMaxSize) {
+            return;
+        }
+        mCache.remove(key);
+
+        FrameCacheEntry* entry = new FrameCacheEntry(frame.width, frame.height);
+        entry->displayWidth = frame.displayWidth;
+        entry->displayHeight = frame.displayHeight;
+        memcpy(entry->pixels, frame.pixels, frame.byteSize());
+        mSize += entry->byteSize();
+        mCache.put(key, entry);
+        trim_l();
+    }
+
+private:
+    void trim_l() {
+        while (mSize > mMaxSize && mCache.size() > 0) {
+            mCache.removeOldest();
+        }
+    }
+
+    Mutex mLock;
+    LruCache<FrameCacheKey, FrameCacheEntry*> mCache;
+    size_t mSize;
+    size_t mMaxSize;
+};
+
+}; // namespace android
+
 using namespace android;
 
+struct RetrieverContext {
+    MediaMetadataRetriever* retriever;
+    // Identifies the current data source in the frame cache; empty when the
+    // source can't be identified reliably, which disables caching
+    String8 sourceKey;
+};
+
 struct fields_t {
     jfieldID context;
     jclass bitmapClazz;  // Must be a global ref
@@ -45,6 +186,7 @@ struct fields_t {
 
 static fields_t fields;
 static Mutex sLock;
+static FrameCache sFrameCache;
 static const char* const kClassPathName = "android/media/MediaMetadataRetriever";
 
 static void process_media_retriever_call(JNIEnv *env, status_t opStatus, const char* exception, const char *message)
@@ -64,18 +206,30 @@ static void process_media_retriever_call(JNIEnv *env, status_t opStatus, const c
     }
 }
 
-static MediaMetadataRetriever* getRetriever(JNIEnv* env, jobject thiz)
+static RetrieverContext* getContext(JNIEnv* env, jobject thiz)
 {
     // No lock is needed, since it is called internally by other methods that are protected
-    MediaMetadataRetriever* retriever = (MediaMetadataRetriever*) env->GetLongField(thiz, fields.context);
-    return retriever;
+    return (RetrieverContext*) env->GetLongField(thiz, fields.context);
 }
 
-static void setRetriever(JNIEnv* env, jobject thiz, MediaMetadataRetriever* retriever)
+static MediaMetadataRetriever* getRetriever(JNIEnv* env, jobject thiz)
+{
+    RetrieverContext* context = getContext(env, thiz);
+    return context != NULL ? context->retriever : NULL;
+}
+
+static void setContext(JNIEnv* env, jobject thiz, RetrieverContext* context)
 {
     // No lock is needed, since it is called internally by other methods that are protected
-    MediaMetadataRetriever *old = (MediaMetadataRetriever*) env->GetLongField(thiz, fields.context);
-    env->SetLongField(thiz, fields.context, (jlong) retriever);
+    env->SetLongField(thiz, fields.context, (jlong) context);
+}
+
+static void setSourceKey(JNIEnv* env, jobject thiz, status_t opStatus, const String8& key)
+{
+    RetrieverContext* context = getContext(env, thiz);
+    if (context != NULL) {
+        context->sourceKey = opStatus == OK ? key : String8();
+    }
 }
 
 static void
@@ -122,11 +276,26 @@ android_media_MediaMetadataRetriever_setDataSourceAndHeaders(
             env, keys, values, &headersVector)) {
         return;
     }
+    status_t opStatus = retriever->setDataSource(
+            pathStr.string(), headersVector.size() > 0 ? &headersVector : NULL);
+
+    // Remote sources are keyed by URL alone; local files also by their
+    // modification time and size so that rewritten files miss the cache
+    String8 sourceKey;
+    struct stat st;
+    if (headersVector.size() > 0) {
+        // Headers may select different content for the same URL
+    } else if (stat(pathStr.string(), &st) == 0) {
+        sourceKey = String8::format("file:%s:%lld:%lld", pathStr.string(),
+                (long long) st.st_mtime, (long long) st.st_size);
+    } else if (strstr(pathStr.string(), "://") != NULL) {
+        sourceKey = String8::format("url:%s", pathStr.string());
+    }
+    setSourceKey(env, thiz, opStatus, sourceKey);
+
     process_media_retriever_call(
             env,
-            retriever->setDataSource(
-                pathStr.string(), headersVector.size() > 0 ? &headersVector : NULL),
-
+            opStatus,
             "java/lang/RuntimeException",
             "setDataSource failed");
 }
@@ -157,7 +326,19 @@ static void android_media_MediaMetadataRetriever_setDataSourceFD(JNIEnv *env, jo
         jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
         return;
     }
-    process_media_retriever_call(env, retriever->setDataSource(fd, offset, length), "java/lang/RuntimeException", "setDataSource failed");
+    status_t opStatus = retriever->setDataSource(fd, offset, length);
+
+    String8 sourceKey;
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        sourceKey = String8::format("fd:%llu:%llu:%lld:%lld:%lld:%lld",
+                (unsigned long long) st.st_dev, (unsigned long long) st.st_ino,
+                (long long) st.st_mtime, (long long) st.st_size,
+                (long long) offset, (long long) length);
+    }
+    setSourceKey(env, thiz, opStatus, sourceKey);
+
+    process_media_retriever_call(env, opStatus, "java/lang/RuntimeException", "setDataSource failed");
 }
 
 template<typename T>
@@ -215,15 +396,86 @@ static void rotate(T *dst, const T *src, size_t width, size_t height, int angle)
     }
 }
 
-static jobject android_media_MediaMetadataRetriever_getFrameAtTime(JNIEnv *env, jobject thiz, jlong timeUs, jint option)
+// Bilinear sample of an RGB565 image at 16.16 fixed point coordinates
+static inline uint16_t sample565(const uint16_t* src, size_t width, size_t height,
+        int32_t x, int32_t y)
 {
-    ALOGV("getFrameAtTime: %lld us option: %d", timeUs, option);
-    MediaMetadataRetriever* retriever = getRetriever(env, thiz);
-    if (retriever == 0) {
-        jniThrowException(env, "java/lang/IllegalStateException", "No retriever available");
-        return NULL;
+    size_t x0 = x >> 16;
+    size_t y0 = y >> 16;
+    size_t x1 = x0 + 1 < width ? x0 + 1 : x0;
+    size_t y1 = y0 + 1 < height ? y0 + 1 : y0;
+    uint32_t fx = (x >> 8) & 0xff;
+    uint32_t fy = (y >> 8) & 0xff;
+
+    uint32_t p[4] = {
+        src[y0 * width + x0], src[y0 * width + x1],
+        src[y1 * width + x0], src[y1 * width + x1],
+    };
+    uint32_t w[4] = {
+        (256 - fx) * (256 - fy), fx * (256 - fy),
+        (256 - fx) * fy, fx * fy,
+    };
+
+    uint32_t r = 0, g = 0, b = 0;
+    for (int i = 0; i < 4; i++) {
+        r += ((p[i] >> 11) & 0x1f) * w[i];
+        g += ((p[i] >> 5) & 0x3f) * w[i];
+        b += (p[i] & 0x1f) * w[i];
+    }
+    return ((r >> 16) << 11) | ((g >> 16) << 5) | (b >> 16);
+}
+
+// Rotates and scales in a single pass; dst is dstWidth x dstHeight in the
+// rotated orientation
+static void rotateAndScale(uint16_t* dst, size_t dstWidth, size_t dstHeight,
+        const uint16_t* src, size_t width, size_t height, int angle)
+{
+    bool swap = angle == 90 || angle == 270;
+    size_t rotatedWidth = swap ? height : width;
+    size_t rotatedHeight = swap ? width : height;
+    int32_t maxU = (int32_t) (rotatedWidth - 1) << 16;
+    int32_t maxV = (int32_t) (rotatedHeight - 1) << 16;
+
+    for (size_t dy = 0; dy < dstHeight; ++dy) {
+        // Sample at pixel centers
+        int32_t v = (int32_t) (((2 * dy + 1) * ((int64_t) rotatedHeight << 16))
+                / (2 * dstHeight)) - 0x8000;
+        v = v < 0 ? 0 : (v > maxV ? maxV : v);
+        for (size_t dx = 0; dx < dstWidth; ++dx) {
+            int32_t u = (int32_t) (((2 * dx + 1) * ((int64_t) rotatedWidth << 16))
+                    / (2 * dstWidth)) - 0x8000;
+            u = u < 0 ? 0 : (u > maxU ? maxU : u);
+
+            // Inverse of the mappings in rotate90/180/270 above
+            int32_t x, y;
+            switch (angle) {
+                case 90:
+                    x = v;
+                    y = maxU - u;
+                    break;
+                case 180:
+                    x = maxU - u;
+                    y = maxV - v;
+                    break;
+                case 270:
+                    x = maxV - v;
+                    y = u;
+                    break;
+                default:
+                    x = u;
+                    y = v;
+                    break;
+            }
+            dst[dy * dstWidth + dx] = sample565(src, width, height, x, y);
+        }
     }
+}
 
+// Decodes a frame through the retriever; dstWidth and dstHeight are 0 to keep
+// the decoded size. Returns NULL if no frame could be retrieved.
+static FrameCacheEntry* decodeFrame(MediaMetadataRetriever* retriever,
+        int64_t timeUs, int option, size_t dstWidth, size_t dstHeight)
+{
     // Call native method to retrieve a video frame
     VideoFrame *videoFrame = NULL;
     sp<IMemory> frameMemory = retriever->getFrameAtTime(timeUs, option);
@@ -240,62 +492,209 @@ static jobject android_media_MediaMetadataRetriever_getFrameAtTime(JNIEnv *env,
             videoFrame->mDisplayHeight,
             videoFrame->mSize);
 
-    jobject config = env->CallStaticObjectMethod(
-                        fields.configClazz,
-                        fields.createConfigMethod,
-                        SkBitmap::kRGB_565_Config);
-
     size_t width, height;
-    bool swapWidthAndHeight = false;
+    size_t displayWidth = videoFrame->mDisplayWidth;
+    size_t displayHeight = videoFrame->mDisplayHeight;
     if (videoFrame->mRotationAngle == 90 || videoFrame->mRotationAngle == 270) {
         width = videoFrame->mHeight;
         height = videoFrame->mWidth;
-        swapWidthAndHeight = true;
+        displayWidth = videoFrame->mDisplayHeight;
+        displayHeight = videoFrame->mDisplayWidth;
     } else {
         width = videoFrame->mWidth;
         height = videoFrame->mHeight;
     }
 
+    const uint16_t* src = (uint16_t*)((char*)videoFrame + sizeof(VideoFrame));
+    FrameCacheEntry* entry;
+    if (dstWidth == 0 || dstHeight == 0 || (dstWidth == width && dstHeight == height)) {
+        entry = new FrameCacheEntry(width, height);
+        entry->displayWidth = displayWidth;
+        entry->displayHeight = displayHeight;
+        rotate(entry->pixels, src,
+               videoFrame->mWidth,
+               videoFrame->mHeight,
+               videoFrame->mRotationAngle);
+    } else {
+        entry = new FrameCacheEntry(dstWidth, dstHeight);
+        rotateAndScale(entry->pixels, dstWidth, dstHeight, src,
+               videoFrame->mWidth,
+               videoFrame->mHeight,
+               videoFrame->mRotationAngle);
+    }
+    return entry;
+}
+
+static jobject createBitmap(JNIEnv *env, const FrameCacheEntry& frame)
+{
+    jobject config = env->CallStaticObjectMethod(
+                        fields.configClazz,
+                        fields.createConfigMethod,
+                        SkBitmap::kRGB_565_Config);
+
     jobject jBitmap = env->CallStaticObjectMethod(
                             fields.bitmapClazz,
                             fields.createBitmapMethod,
-                            width,
-                            height,
+                            (jint) frame.width,
+                            (jint) frame.height,
                             config);
+    env->DeleteLocalRef(config);
+    if (jBitmap == NULL) {  // OutOfMemoryError exception has already been thrown.
+        return NULL;
+    }
 
     SkBitmap *bitmap =
             (SkBitmap *) env->GetLongField(jBitmap, fields.nativeBitmap);
 
     bitmap->lockPixels();
-    rotate((uint16_t*)bitmap->getPixels(),
-           (uint16_t*)((char*)videoFrame + sizeof(VideoFrame)),
-           videoFrame->mWidth,
-           videoFrame->mHeight,
-           videoFrame->mRotationAngle);
+    memcpy(bitmap->getPixels(), frame.pixels, frame.byteSize());
     bitmap->unlockPixels();
 
-    if (videoFrame->mDisplayWidth  != videoFrame->mWidth ||
-        videoFrame->mDisplayHeight != videoFrame->mHeight) {
-        size_t displayWidth = videoFrame->mDisplayWidth;
-        size_t displayHeight = videoFrame->mDisplayHeight;
-        if (swapWidthAndHeight) {
-            displayWidth = videoFrame->mDisplayHeight;
-            displayHeight = videoFrame->mDisplayWidth;
-        }
+    if (frame.displayWidth != frame.width || frame.displayHeight != frame.height) {
         ALOGV("Bitmap dimension is scaled from %dx%d to %dx%d",
-                width, height, displayWidth, displayHeight);
+                frame.width, frame.height, frame.displayWidth, frame.displayHeight);
         jobject scaledBitmap = env->CallStaticObjectMethod(fields.bitmapClazz,
                                     fields.createScaledBitmapMethod,
                                     jBitmap,
-                                    displayWidth,
-                                    displayHeight,
+                                    (jint) frame.displayWidth,
+                                    (jint) frame.displayHeight,
                                     true);
+        env->DeleteLocalRef(jBitmap);
         return scaledBitmap;
     }
 
     return jBitmap;
 }
 
+static FrameCacheEntry* getFrame(RetrieverContext* context,
+        int64_t timeUs, int option, int dstWidth, int dstHeight)
+{
+    FrameCacheKey key;
+    key.source = context->sourceKey;
+    key.timeUs = timeUs;
+    key.option = option;
+    key.width = dstWidth;
+    key.height = dstHeight;
+
+    FrameCacheEntry* frame = sFrameCache.get(key);
+    if (frame == NULL) {
+        frame = decodeFrame(context->retriever, timeUs, option, dstWidth, dstHeight);
+        if (frame != NULL) {
+            sFrameCache.put(key, *frame);
+        }
+    }
+    return frame;
+}
+
+static jobject android_media_MediaMetadataRetriever_getScaledFrameAtTime(JNIEnv *env,
+        jobject thiz, jlong timeUs, jint option, jint dstWidth, jint dstHeight)
+{
+    ALOGV("getFrameAtTime: %lld us option: %d size: %dx%d", timeUs, option, dstWidth, dstHeight);
+    RetrieverContext* context = getContext(env, thiz);
+    if (context == NULL || context->retriever == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", "No retriever available");
+        return NULL;
+    }
+    if (dstWidth < 0 || dstHeight < 0) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return NULL;
+    }
+
+    FrameCacheEntry* frame = getFrame(context, timeUs, option, dstWidth, dstHeight);
+    if (frame == NULL) {
+        return NULL;
+    }
+    jobject jBitmap = createBitmap(env, *frame);
+    delete frame;
+    return jBitmap;
+}
+
+static jobject android_media_MediaMetadataRetriever_getFrameAtTime(JNIEnv *env, jobject thiz, jlong timeUs, jint option)
+{
+    return android_media_MediaMetadataRetriever_getScaledFrameAtTime(
+            env, thiz, timeUs, option, 0, 0);
+}
+
+static int compareTimeIndex(const void* lhs, const void* rhs)
+{
+    int64_t a = ((const int64_t*) lhs)[0];
+    int64_t b = ((const int64_t*) rhs)[0];
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+/*
+ * Retrieves a frame for each of timesUs, in the order given. Frames are
+ * decoded in ascending time order, so the retriever only seeks forward, and
+ * repeated times are decoded once.
+ */
+static jobjectArray android_media_MediaMetadataRetriever_getFramesAtTimes(JNIEnv *env,
+        jobject thiz, jlongArray timesUs, jint option, jint dstWidth, jint dstHeight)
+{
+    ALOGV("getFramesAtTimes");
+    RetrieverContext* context = getContext(env, thiz);
+    if (context == NULL || context->retriever == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", "No retriever available");
+        return NULL;
+    }
+    if (timesUs == NULL || dstWidth < 0 || dstHeight < 0) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return NULL;
+    }
+
+    jsize count = env->GetArrayLength(timesUs);
+    jobjectArray result = env->NewObjectArray(count, fields.bitmapClazz, NULL);
+    if (result == NULL || count == 0) {
+        return result;
+    }
+
+    // (time, index) pairs sorted by time
+    int64_t* order = new int64_t[count * 2];
+    jlong* times = env->GetLongArrayElements(timesUs, NULL);
+    if (times == NULL) {
+        delete[] order;
+        return NULL;
+    }
+    for (jsize i = 0; i < count; i++) {
+        order[i * 2] = times[i];
+        order[i * 2 + 1] = i;
+    }
+    env->ReleaseLongArrayElements(timesUs, times, JNI_ABORT);
+    qsort(order, count, sizeof(int64_t) * 2, compareTimeIndex);
+
+    jobject previous = NULL;
+    for (jsize i = 0; i < count; i++) {
+        jobject jBitmap;
+        if (i > 0 && order[i * 2] == order[(i - 1) * 2]) {
+            jBitmap = previous != NULL ? env->NewLocalRef(previous) : NULL;
+        } else {
+            FrameCacheEntry* frame = getFrame(context, order[i * 2], option,
+                    dstWidth, dstHeight);
+            jBitmap = frame != NULL ? createBitmap(env, *frame) : NULL;
+            delete frame;
+            if (env->ExceptionCheck()) {
+                break;
+            }
+        }
+        env->SetObjectArrayElement(result, (jsize) order[i * 2 + 1], jBitmap);
+        if (previous != NULL) {
+            env->DeleteLocalRef(previous);
+        }
+        previous = jBitmap;
+    }
+    if (previous != NULL) {
+        env->DeleteLocalRef(previous);
+    }
+    delete[] order;
+    return env->ExceptionCheck() ? NULL : result;
+}
+
+static void android_media_MediaMetadataRetriever_setFrameCacheSize(JNIEnv *env, jclass clazz,
+        jint maxBytes)
+{
+    ALOGV("setFrameCacheSize: %d", maxBytes);
+    sFrameCache.setMaxSize(maxBytes > 0 ? maxBytes : 0);
+}
+
 static jbyteArray android_media_MediaMetadataRetriever_getEmbeddedPicture(
         JNIEnv *env, jobject thiz, jint pictureType)
 {
@@ -357,9 +756,12 @@ static void android_media_MediaMetadataRetriever_release(JNIEnv *env, jobject th
 {
     ALOGV("release");
     Mutex::Autolock lock(sLock);
-    MediaMetadataRetriever* retriever = getRetriever(env, thiz);
-    delete retriever;
-    setRetriever(env, thiz, (MediaMetadataRetriever*) 0);
+    RetrieverContext* context = getContext(env, thiz);
+    if (context != NULL) {
+        delete context->retriever;
+        delete context;
+    }
+    setContext(env, thiz, (RetrieverContext*) 0);
 }
 
 static void android_media_MediaMetadataRetriever_native_finalize(JNIEnv *env, jobject thiz)
@@ -435,7 +837,9 @@ static void android_media_MediaMetadataRetriever_native_setup(JNIEnv *env, jobje
         jniThrowException(env, "java/lang/RuntimeException", "Out of memory");
         return;
     }
-    setRetriever(env, thiz, retriever);
+    RetrieverContext* context = new RetrieverContext;
+    context->retriever = retriever;
+    setContext(env, thiz, context);
 }
 
 // JNI mapping between Java methods and native methods
@@ -448,6 +852,9 @@ static JNINativeMethod nativeMethods[] = {
 
         {"setDataSource",   "(Ljava/io/FileDescriptor;JJ)V", (void *)android_media_MediaMetadataRetriever_setDataSourceFD},
         {"_getFrameAtTime", "(JI)Landroid/graphics/Bitmap;", (void *)android_media_MediaMetadataRetriever_getFrameAtTime},
+        {"_getScaledFrameAtTime", "(JIII)Landroid/graphics/Bitmap;", (void *)android_media_MediaMetadataRetriever_getScaledFrameAtTime},
+        {"_getFramesAtTimes", "([JIII)[Landroid/graphics/Bitmap;", (void *)android_media_MediaMetadataRetriever_getFramesAtTimes},
+        {"native_setFrameCacheSize", "(I)V", (void *)android_media_MediaMetadataRetriever_setFrameCacheSize},
         {"extractMetadata", "(I)Ljava/lang/String;", (void *)android_media_MediaMetadataRetriever_extractMetadata},
         {"getEmbeddedPicture", "(I)[B", (void *)android_media_MediaMetadataRetriever_getEmbeddedPicture},
         {"release",         "()V", (void *)android_media_MediaMetadataRetriever_release},
@@ -18,7 +18,9 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "MediaScannerJNI"
 #include <utils/Log.h>
+#include <utils/String8.h>
 #include <utils/threads.h>
+#include <utils/Vector.h>
 #include <media/mediascanner.h>
 #include <media/stagefright/StagefrightMediaScanner.h>
 
@@ -223,15 +225,386 @@ private:
     jmethodID mSetMimeTypeMethodID;
 };
 
+struct ScanEntry {
+    String8 path;
+    long long lastModified;
+    long long fileSize;
+    bool isDirectory;
+    bool noMedia;
+};
+
+static int compareScanEntries(const ScanEntry* lhs, const ScanEntry* rhs)
+{
+    return strcmp(lhs->path.string(), rhs->path.string());
+}
+
+// (path, lastModified, size) of every entry found by the previous scan,
+// sorted by path so that lookups during the walk are a binary search.
+class ScanSnapshot
+{
+public:
+    status_t init(JNIEnv *env, jobjectArray paths, jlongArray lastModified,
+            jlongArray sizes)
+    {
+        if (paths == NULL) {
+            return OK;
+        }
+        jsize count = env->GetArrayLength(paths);
+        if (lastModified == NULL || sizes == NULL
+                || env->GetArrayLength(lastModified) != count
+                || env->GetArrayLength(sizes) != count) {
+            return BAD_VALUE;
+        }
+
+        jlong *modifiedArray = env->GetLongArrayElements(lastModified, NULL);
+        jlong *sizeArray = env->GetLongArrayElements(sizes, NULL);
+        if (modifiedArray == NULL || sizeArray == NULL) {
+            if (modifiedArray != NULL) {
+                env->ReleaseLongArrayElements(lastModified, modifiedArray, JNI_ABORT);
+            }
+            return NO_MEMORY;
+        }
+
+        status_t err = OK;
+        mEntries.setCapacity(count);
+        for (jsize i = 0; i < count && err == OK; i++) {
+            jstring path = (jstring) env->GetObjectArrayElement(paths, i);
+            if (path == NULL) {
+                err = BAD_VALUE;
+                break;
+            }
+            const char *pathStr = env->GetStringUTFChars(path, NULL);
+            if (pathStr == NULL) {
+                err = NO_MEMORY;
+            } else {
+                ScanEntry entry;
+                entry.path.setTo(pathStr);
+                entry.lastModified = modifiedArray[i];
+                entry.fileSize = sizeArray[i];
+                entry.isDirectory = false;
+                entry.noMedia = false;
+                mEntries.add(entry);
+                env->ReleaseStringUTFChars(path, pathStr);
+            }
+            env->DeleteLocalRef(path);
+        }
+
+        env->ReleaseLongArrayElements(lastModified, modifiedArray, JNI_ABORT);
+        env->ReleaseLongArrayElements(sizes, sizeArray, JNI_ABORT);
+        mEntries.sort(compareScanEntries);
+        return err;
+    }
+
+    bool isUnchanged(const char *path, long long lastModified, long long fileSize) const
+    {
+        ssize_t lo = 0;
+        ssize_t hi = mEntries.size() - 1;
+        while (lo <= hi) {
+            ssize_t mid = (lo + hi) / 2;
+            const ScanEntry& entry = mEntries[mid];
+            int cmp = strcmp(path, entry.path.string());
+            if (cmp == 0) {
+                return entry.lastModified == lastModified && entry.fileSize == fileSize;
+            } else if (cmp < 0) {
+                hi = mid - 1;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        return false;
+    }
+
+private:
+    Vector<ScanEntry> mEntries;
+};
+
+// Receives the directory walk natively, dropping entries that match the
+// snapshot, so the walk can finish before any Java callback is made.
+class CollectingScannerClient : public MediaScannerClient
+{
+public:
+    CollectingScannerClient(const ScanSnapshot& snapshot, Vector<ScanEntry>& entries)
+        :   mSnapshot(snapshot),
+            mEntries(entries)
+    {
+    }
+
+    virtual status_t scanFile(const char* path, long long lastModified,
+            long long fileSize, bool isDirectory, bool noMedia)
+    {
+        if (mSnapshot.isUnchanged(path, lastModified, fileSize)) {
+            return OK;
+        }
+        ScanEntry entry;
+        entry.path.setTo(path);
+        entry.lastModified = lastModified;
+        entry.fileSize = fileSize;
+        entry.isDirectory = isDirectory;
+        entry.noMedia = noMedia;
+        mEntries.add(entry);
+        return OK;
+    }
+
+    virtual status_t handleStringTag(const char* name, const char* value)
+    {
+        return OK;
+    }
+
+    virtual status_t setMimeType(const char* mimeType)
+    {
+        return OK;
+    }
+
+private:
+    const ScanSnapshot& mSnapshot;
+    Vector<ScanEntry>& mEntries;
+};
+
+struct ScanTag {
+    bool isMimeType;
+    String8 name;
+    String8 value;
+};
+
+// Records what the extractor reports for one file so that it can be
+// replayed to the Java client later, on the thread that owns the JNIEnv.
+class RecordingScannerClient : public MediaScannerClient
+{
+public:
+    RecordingScannerClient(Vector<ScanTag>& tags)
+        :   mTags(tags)
+    {
+    }
+
+    virtual status_t scanFile(const char* path, long long lastModified,
+            long long fileSize, bool isDirectory, bool noMedia)
+    {
+        return OK;
+    }
+
+    virtual status_t handleStringTag(const char* name, const char* value)
+    {
+        ScanTag tag;
+        tag.isMimeType = false;
+        tag.name.setTo(name);
+        tag.value.setTo(value);
+        mTags.add(tag);
+        return OK;
+    }
+
+    virtual status_t setMimeType(const char* mimeType)
+    {
+        ScanTag tag;
+        tag.isMimeType = true;
+        tag.value.setTo(mimeType);
+        mTags.add(tag);
+        return OK;
+    }
+
+private:
+    Vector<ScanTag>& mTags;
+};
+
+/*
+ * Extracts metadata for the entries of a directory walk on a pool of worker
+ * threads, a bounded window ahead of the entry the Java client is currently
+ * looking at. When the client calls back into processFile for that entry,
+ * the prefetched result is replayed instead of extracting it again.
+ */
+class ScanPrefetcher
+{
+public:
+    ScanPrefetcher(const Vector<ScanEntry>& entries, const String8& locale)
+        :   mEntries(entries),
+            mLocale(locale),
+            mCurrent(0),
+            mNextFetch(0),
+            mExiting(false)
+    {
+        for (size_t i = 0; i < kWindow; i++) {
+            mSlots[i].index = -1;
+            mSlots[i].done = false;
+            mSlots[i].result = MEDIA_SCAN_RESULT_SKIPPED;
+        }
+    }
+
+    ~ScanPrefetcher()
+    {
+        {
+            Mutex::Autolock _l(mLock);
+            mExiting = true;
+            mCondition.broadcast();
+        }
+        for (size_t i = 0; i < mWorkers.size(); i++) {
+            mWorkers[i]->requestExitAndWait();
+        }
+    }
+
+    void start(size_t numThreads)
+    {
+        for (size_t i = 0; i < numThreads; i++) {
+            sp<Worker> worker = new Worker(this);
+            if (worker->run("MediaScanWorker", PRIORITY_BACKGROUND) == OK) {
+                mWorkers.add(worker);
+            }
+        }
+    }
+
+    // Called before the Java client is handed entry |index|.
+    void setCurrent(size_t index)
+    {
+        Mutex::Autolock _l(mLock);
+        mCurrent = index;
+        mCondition.broadcast();
+    }
+
+    // Returns false if |path| is not the current entry or nothing was prefetched.
+    bool replay(const char* path, MediaScannerClient& client, MediaScanResult* result)
+    {
+        Vector<ScanTag> tags;
+        {
+            Mutex::Autolock _l(mLock);
+            if (mWorkers.isEmpty() || mCurrent >= mEntries.size()
+                    || mEntries[mCurrent].isDirectory
+                    || strcmp(mEntries[mCurrent].path.string(), path)) {
+                return false;
+            }
+            Slot& slot = mSlots[mCurrent % kWindow];
+            while (slot.index != (ssize_t) mCurrent || !slot.done) {
+                mCondition.wait(mLock);
+            }
+            tags = slot.tags;
+            slot.tags.clear();
+            *result = slot.result;
+        }
+
+        for (size_t i = 0; i < tags.size(); i++) {
+            const ScanTag& tag = tags[i];
+            status_t err = tag.isMimeType
+                    ? client.setMimeType(tag.value.string())
+                    : client.handleStringTag(tag.name.string(), tag.value.string());
+            if (err != OK) {
+                *result = MEDIA_SCAN_RESULT_ERROR;
+                break;
+            }
+        }
+        return true;
+    }
+
+private:
+    // Entries are fetched at most this far ahead of the Java client
+    static const size_t kWindow = 32;
+
+    struct Slot {
+        ssize_t index;
+        bool done;
+        MediaScanResult result;
+        Vector<ScanTag> tags;
+    };
+
+    class Worker : public Thread
+    {
+    public:
+        Worker(ScanPrefetcher* owner)
+            :   Thread(false),
+                mOwner(owner)
+        {
+            mScanner = new StagefrightMediaScanner;
+            if (!owner->mLocale.isEmpty()) {
+                mScanner->setLocale(owner->mLocale.string());
+            }
+        }
+
+        virtual ~Worker()
+        {
+            delete mScanner;
+        }
+
+    private:
+        virtual bool threadLoop()
+        {
+            return mOwner->fetchNext(mScanner);
+        }
+
+        ScanPrefetcher* mOwner;
+        MediaScanner* mScanner;
+    };
+
+    bool fetchNext(MediaScanner* scanner)
+    {
+        size_t index;
+        {
+            Mutex::Autolock _l(mLock);
+            while (!mExiting && mNextFetch < mEntries.size()
+                    && mNextFetch >= mCurrent + kWindow) {
+                mCondition.wait(mLock);
+            }
+            if (mExiting || mNextFetch >= mEntries.size()) {
+                return false;
+            }
+            index = mNextFetch++;
+            if (index < mCurrent) {
+                // The client has already moved past this entry
+                return true;
+            }
+            Slot& slot = mSlots[index % kWindow];
+            slot.index = index;
+            slot.done = false;
+            slot.tags.clear();
+        }
+
+        const ScanEntry& entry = mEntries[index];
+        Vector<ScanTag> tags;
+        MediaScanResult result = MEDIA_SCAN_RESULT_SKIPPED;
+        if (!entry.isDirectory) {
+            RecordingScannerClient recorder(tags);
+            result = scanner->processFile(entry.path.string(), NULL, recorder);
+        }
+
+        Mutex::Autolock _l(mLock);
+        Slot& slot = mSlots[index % kWindow];
+        if (slot.index == (ssize_t) index) {
+            slot.tags = tags;
+            slot.result = result;
+            slot.done = true;
+            mCondition.broadcast();
+        }
+        return true;
+    }
+
+    const Vector<ScanEntry>& mEntries;
+    const String8 mLocale;
+    Mutex mLock;
+    Condition mCondition;
+    size_t mCurrent;
+    size_t mNextFetch;
+    bool mExiting;
+    Slot mSlots[kWindow];
+    Vector<sp<Worker> > mWorkers;
+};
+
+// What mNativeContext points at
+struct ScannerContext {
+    MediaScanner *scanner;
+    String8 locale;
+    // Set only while processDirectoryIncremental runs with worker threads
+    ScanPrefetcher *prefetcher;
+};
+
+static ScannerContext *getScannerContext_l(JNIEnv* env, jobject thiz)
+{
+    return (ScannerContext *) env->GetLongField(thiz, fields.context);
+}
 
 static MediaScanner *getNativeScanner_l(JNIEnv* env, jobject thiz)
 {
-    return (MediaScanner *) env->GetLongField(thiz, fields.context);
+    ScannerContext *context = getScannerContext_l(env, thiz);
+    return context != NULL ? context->scanner : NULL;
 }
 
-static void setNativeScanner_l(JNIEnv* env, jobject thiz, MediaScanner *s)
+static void setScannerContext_l(JNIEnv* env, jobject thiz, ScannerContext *context)
 {
-    env->SetLongField(thiz, fields.context, (jlong)s);
+    env->SetLongField(thiz, fields.context, (jlong)context);
 }
 
 static void
@@ -263,6 +636,72 @@ android_media_MediaScanner_processDirectory(
     env->ReleaseStringUTFChars(path, pathStr);
 }
 
+static void
+android_media_MediaScanner_processDirectoryIncremental(
+        JNIEnv *env, jobject thiz, jstring path, jobject client,
+        jobjectArray snapshotPaths, jlongArray snapshotLastModified,
+        jlongArray snapshotSizes, jint numThreads)
+{
+    ALOGV("processDirectoryIncremental");
+    ScannerContext *context = getScannerContext_l(env, thiz);
+    if (context == NULL) {
+        jniThrowException(env, kRunTimeException, "No scanner available");
+        return;
+    }
+
+    if (path == NULL) {
+        jniThrowException(env, kIllegalArgumentException, NULL);
+        return;
+    }
+
+    ScanSnapshot snapshot;
+    status_t err = snapshot.init(env, snapshotPaths, snapshotLastModified, snapshotSizes);
+    if (err == BAD_VALUE) {
+        jniThrowException(env, kIllegalArgumentException, "Malformed snapshot");
+        return;
+    } else if (err != OK) {  // Out of memory
+        return;
+    }
+
+    const char *pathStr = env->GetStringUTFChars(path, NULL);
+    if (pathStr == NULL) {  // Out of memory
+        return;
+    }
+
+    // Walk the whole tree first; only changed entries reach Java
+    Vector<ScanEntry> entries;
+    CollectingScannerClient collector(snapshot, entries);
+    MediaScanResult result = context->scanner->processDirectory(pathStr, collector);
+    if (result == MEDIA_SCAN_RESULT_ERROR) {
+        ALOGE("An error occurred while scanning directory '%s'.", pathStr);
+    }
+    ALOGV("%d changed entries under '%s'", (int) entries.size(), pathStr);
+    env->ReleaseStringUTFChars(path, pathStr);
+
+    ScanPrefetcher *prefetcher = NULL;
+    if (numThreads > 1 && !entries.isEmpty()) {
+        prefetcher = new ScanPrefetcher(entries, context->locale);
+        prefetcher->start(numThreads);
+        context->prefetcher = prefetcher;
+    }
+
+    MyMediaScannerClient myClient(env, client);
+    for (size_t i = 0; i < entries.size(); i++) {
+        const ScanEntry& entry = entries[i];
+        if (prefetcher != NULL) {
+            prefetcher->setCurrent(i);
+        }
+        if (myClient.scanFile(entry.path.string(), entry.lastModified, entry.fileSize,
+                entry.isDirectory, entry.noMedia) != OK) {
+            ALOGE("An error occurred while scanning file '%s'.", entry.path.string());
+            break;
+        }
+    }
+
+    context->prefetcher = NULL;
+    delete prefetcher;
+}
+
 static void
 android_media_MediaScanner_processFile(
         JNIEnv *env, jobject thiz, jstring path,
@@ -271,7 +710,8 @@ android_media_MediaScanner_processFile(
     ALOGV("processFile");
 
     // Lock already hold by processDirectory
-    MediaScanner *mp = getNativeScanner_l(env, thiz);
+    ScannerContext *context = getScannerContext_l(env, thiz);
+    MediaScanner *mp = context != NULL ? context->scanner : NULL;
     if (mp == NULL) {
         jniThrowException(env, kRunTimeException, "No scanner available");
         return;
@@ -296,7 +736,11 @@ android_media_MediaScanner_processFile(
     }
 
     MyMediaScannerClient myClient(env, client);
-    MediaScanResult result = mp->processFile(pathStr, mimeTypeStr, myClient);
+    MediaScanResult result;
+    if (context->prefetcher == NULL
+            || !context->prefetcher->replay(pathStr, myClient, &result)) {
+        result = mp->processFile(pathStr, mimeTypeStr, myClient);
+    }
     if (result == MEDIA_SCAN_RESULT_ERROR) {
         ALOGE("An error occurred while scanning file '%s'.", pathStr);
     }
@@ -311,8 +755,8 @@ android_media_MediaScanner_setLocale(
         JNIEnv *env, jobject thiz, jstring locale)
 {
     ALOGV("setLocale");
-    MediaScanner *mp = getNativeScanner_l(env, thiz);
-    if (mp == NULL) {
+    ScannerContext *context = getScannerContext_l(env, thiz);
+    if (context == NULL) {
         jniThrowException(env, kRunTimeException, "No scanner available");
         return;
     }
@@ -325,7 +769,8 @@ android_media_MediaScanner_setLocale(
     if (localeStr == NULL) {  // Out of memory
         return;
     }
-    mp->setLocale(localeStr);
+    context->scanner->setLocale(localeStr);
+    context->locale.setTo(localeStr);
 
     env->ReleaseStringUTFChars(locale, localeStr);
 }
@@ -391,26 +836,30 @@ static void
 android_media_MediaScanner_native_setup(JNIEnv *env, jobject thiz)
 {
     ALOGV("native_setup");
-    MediaScanner *mp = new StagefrightMediaScanner;
+    ScannerContext *context = new ScannerContext;
+    context->scanner = new StagefrightMediaScanner;
+    context->prefetcher = NULL;
 
-    if (mp == NULL) {
+    if (context->scanner == NULL) {
+        delete context;
         jniThrowException(env, kRunTimeException, "Out of memory");
         return;
     }
 
-    env->SetLongField(thiz, fields.context, (jlong)mp);
+    setScannerContext_l(env, thiz, context);
 }
 
 static void
 android_media_MediaScanner_native_finalize(JNIEnv *env, jobject thiz)
 {
     ALOGV("native_finalize");
-    MediaScanner *mp = getNativeScanner_l(env, thiz);
-    if (mp == 0) {
+    ScannerContext *context = getScannerContext_l(env, thiz);
+    if (context == 0) {
         return;
     }
-    delete mp;
-    setNativeScanner_l(env, thiz, 0);
+    delete context->scanner;
+    delete context;
+    setScannerContext_l(env, thiz, 0);
 }
 
 static JNINativeMethod gMethods[] = {
@@ -420,6 +869,12 @@ static JNINativeMethod gMethods[] = {
         (void *)android_media_MediaScanner_processDirectory
     },
 
+    {
+        "processDirectoryIncremental",
+        "(Ljava/lang/String;Landroid/media/MediaScannerClient;[Ljava/lang/String;[J[JI)V",
+        (void *)android_media_MediaScanner_processDirectoryIncremental
+    },
+
     {
         "processFile",
         "(Ljava/lang/String;Ljava/lang/String;Landroid/media/MediaScannerClient;)V",
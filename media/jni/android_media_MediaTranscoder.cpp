@@ -0,0 +1,739 @@
+/*
+ * Copyright 2014, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "MediaTranscoder-JNI"
+#include <utils/Log.h>
+
+#include "android_media_Utils.h"
+#include "android_runtime/AndroidRuntime.h"
+#include "jni.h"
+#include "JNIHelp.h"
+
+#include <gui/Surface.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/AString.h>
+#include <media/stagefright/MediaCodec.h>
+#include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MediaMuxer.h>
+#include <media/stagefright/MetaData.h>
+#include <media/stagefright/NuMediaExtractor.h>
+
+#include <utils/List.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+// Keep these in sync with their equivalents in MediaTranscoder.java !!!
+enum {
+    EVENT_PROGRESS      = 1,
+    EVENT_COMPLETED     = 2,
+    EVENT_ERROR         = 3,
+};
+
+struct fields_t {
+    jclass clazz;
+    jmethodID postEventFromNativeID;
+};
+
+static fields_t gFields;
+
+/*
+ * Runs extractor -> decoder -> encoder -> muxer for a whole file on a native
+ * thread, so that no sample passes through Java. Tracks added without an
+ * encoder format are copied to the output unchanged. Video is handed from
+ * decoder to encoder through the encoder's input surface; audio is copied
+ * from the decoder output buffers into the encoder input buffers.
+ *
+ * Only progress, completion and errors are posted to Java.
+ */
+struct JMediaTranscoder : public Thread {
+    JMediaTranscoder(
+            int srcFd, off64_t offset, off64_t length,
+            int dstFd, MediaMuxer::OutputFormat format);
+
+    status_t initCheck() const;
+
+    // Selects extractor track index; encoderFormat is NULL to copy the track.
+    status_t addTrack(size_t index, const sp<AMessage> &encoderFormat);
+
+    status_t startTranscode(JNIEnv *env, jobject weakThis);
+    void cancel();
+
+protected:
+    virtual ~JMediaTranscoder();
+
+private:
+    // Posting progress more often than this, in media time, is pointless
+    static const int64_t kProgressIntervalUs = 1000000ll;
+    static const useconds_t kIdleSleepUs = 2000;
+
+    struct Track {
+        size_t extractorIndex;
+        ssize_t muxerIndex;
+        sp<AMessage> format;
+
+        // NULL for tracks that are copied
+        sp<MediaCodec> decoder;
+        sp<MediaCodec> encoder;
+        bool isVideo;
+        Vector<sp<ABuffer> > decoderInputBuffers;
+        Vector<sp<ABuffer> > decoderOutputBuffers;
+        Vector<sp<ABuffer> > encoderInputBuffers;
+        Vector<sp<ABuffer> > encoderOutputBuffers;
+
+        // Samples of a track copied as is are read here first
+        sp<ABuffer> sampleBuffer;
+
+        // Decoded audio waiting for an encoder input buffer
+        bool hasPendingOutput;
+        size_t pendingIndex, pendingOffset, pendingSize;
+        int64_t pendingTimeUs;
+        uint32_t pendingFlags;
+
+        bool extractorDone;
+        bool decoderDone;
+        bool encoderDone;
+    };
+
+    // A sample produced before every track was added to the muxer
+    struct PendingSample {
+        size_t muxerTrack;
+        sp<ABuffer> buffer;
+        int64_t timeUs;
+        uint32_t flags;
+    };
+
+    status_t mInitCheck;
+    sp<ALooper> mLooper;
+    sp<NuMediaExtractor> mExtractor;
+    sp<MediaMuxer> mMuxer;
+    Vector<Track> mTracks;
+    List<PendingSample> mPendingSamples;
+    bool mMuxerStarted;
+    int64_t mLastProgressUs;
+
+    jclass mClass;
+    jobject mObject;
+
+    virtual bool threadLoop();
+
+    Track *findTrack(size_t extractorIndex);
+    status_t startCodecs();
+    status_t feedExtractor(bool *progress);
+    status_t drainDecoder(Track *track, bool *progress);
+    status_t drainEncoder(Track *track, bool *progress);
+    status_t writeSample(const Track &track, const sp<ABuffer> &buffer,
+            int64_t timeUs, uint32_t flags);
+    status_t maybeStartMuxer();
+    void postEvent(int what, int arg1, int64_t arg2);
+
+    DISALLOW_EVIL_CONSTRUCTORS(JMediaTranscoder);
+};
+
+JMediaTranscoder::JMediaTranscoder(
+        int srcFd, off64_t offset, off64_t length,
+        int dstFd, MediaMuxer::OutputFormat format)
+    : Thread(true /*canCallJava*/),
+      mInitCheck(NO_INIT),
+      mMuxerStarted(false),
+      mLastProgressUs(-1),
+      mClass(NULL),
+      mObject(NULL) {
+    mLooper = new ALooper;
+    mLooper->setName("MediaTranscoder_looper");
+    mLooper->start(
+            false,      // runOnCallingThread
+            false,      // canCallJava
+            PRIORITY_FOREGROUND);
+
+    mExtractor = new NuMediaExtractor;
+    mInitCheck = mExtractor->setDataSource(srcFd, offset, length);
+    if (mInitCheck == OK) {
+        mMuxer = new MediaMuxer(dstFd, format);
+    }
+}
+
+JMediaTranscoder::~JMediaTranscoder() {
+    for (size_t i = 0; i < mTracks.size(); i++) {
+        const Track &track = mTracks[i];
+        if (track.decoder != NULL) {
+            track.decoder->release();
+        }
+        if (track.encoder != NULL) {
+            track.encoder->release();
+        }
+    }
+
+    if (mClass != NULL) {
+        JNIEnv *env = AndroidRuntime::getJNIEnv();
+        env->DeleteGlobalRef(mObject);
+        env->DeleteGlobalRef(mClass);
+    }
+}
+
+status_t JMediaTranscoder::initCheck() const {
+    return mInitCheck;
+}
+
+// A codec must be released before it is destroyed, whatever state it is in
+static void releaseCodecs(sp<MediaCodec> *decoder, sp<MediaCodec> *encoder) {
+    if (*decoder != NULL) {
+        (*decoder)->release();
+        decoder->clear();
+    }
+    if (*encoder != NULL) {
+        (*encoder)->release();
+        encoder->clear();
+    }
+}
+
+status_t JMediaTranscoder::addTrack(size_t index, const sp<AMessage> &encoderFormat) {
+    if (index >= mExtractor->countTracks() || findTrack(index) != NULL) {
+        return BAD_VALUE;
+    }
+
+    Track track;
+    track.extractorIndex = index;
+    track.muxerIndex = -1;
+    track.isVideo = false;
+    track.hasPendingOutput = false;
+    track.extractorDone = false;
+    track.decoderDone = false;
+    track.encoderDone = false;
+
+    status_t err = mExtractor->getTrackFormat(index, &track.format);
+    if (err != OK) {
+        return err;
+    }
+
+    if (encoderFormat != NULL) {
+        AString mime, encoderMime;
+        if (!track.format->findString("mime", &mime)
+                || !encoderFormat->findString("mime", &encoderMime)) {
+            return BAD_VALUE;
+        }
+        track.isVideo = !strncasecmp(mime.c_str(), "video/", 6);
+
+        track.decoder = MediaCodec::CreateByType(mLooper, mime.c_str(), false /*encoder*/);
+        track.encoder = MediaCodec::CreateByType(mLooper, encoderMime.c_str(), true /*encoder*/);
+        if (track.decoder == NULL || track.encoder == NULL) {
+            releaseCodecs(&track.decoder, &track.encoder);
+            return NAME_NOT_FOUND;
+        }
+
+        err = track.encoder->configure(
+                encoderFormat, NULL, NULL, MediaCodec::CONFIGURE_FLAG_ENCODE);
+
+        sp<Surface> surface;
+        if (err == OK && track.isVideo) {
+            sp<IGraphicBufferProducer> bufferProducer;
+            err = track.encoder->createInputSurface(&bufferProducer);
+            if (err == OK) {
+                surface = new Surface(bufferProducer);
+            }
+        }
+
+        if (err == OK) {
+            err = track.decoder->configure(track.format, surface, NULL, 0);
+        }
+        if (err != OK) {
+            releaseCodecs(&track.decoder, &track.encoder);
+            return err;
+        }
+    }
+
+    err = mExtractor->selectTrack(index);
+    if (err != OK) {
+        releaseCodecs(&track.decoder, &track.encoder);
+        return err;
+    }
+
+    mTracks.push(track);
+    return OK;
+}
+
+status_t JMediaTranscoder::startTranscode(JNIEnv *env, jobject weakThis) {
+    if (mTracks.isEmpty()) {
+        return INVALID_OPERATION;
+    }
+
+    status_t err = startCodecs();
+    if (err != OK) {
+        return err;
+    }
+
+    // Copied tracks are known up front; transcoded ones are added to the
+    // muxer once their encoder reports its output format
+    for (size_t i = 0; i < mTracks.size(); i++) {
+        Track &track = mTracks.editItemAt(i);
+        if (track.encoder == NULL) {
+            track.muxerIndex = mMuxer->addTrack(track.format);
+            if (track.muxerIndex < 0) {
+                return track.muxerIndex;
+            }
+        }
+    }
+
+    mClass = (jclass)env->NewGlobalRef(gFields.clazz);
+    mObject = env->NewGlobalRef(weakThis);
+
+    return run("MediaTranscoder", PRIORITY_BACKGROUND);
+}
+
+void JMediaTranscoder::cancel() {
+    requestExitAndWait();
+}
+
+JMediaTranscoder::Track *JMediaTranscoder::findTrack(size_t extractorIndex) {
+    for (size_t i = 0; i < mTracks.size(); i++) {
+        if (mTracks[i].extractorIndex == extractorIndex) {
+            return &mTracks.editItemAt(i);
+        }
+    }
+    return NULL;
+}
+
+status_t JMediaTranscoder::startCodecs() {
+    for (size_t i = 0; i < mTracks.size(); i++) {
+        Track &track = mTracks.editItemAt(i);
+        if (track.encoder == NULL) {
+            continue;
+        }
+
+        status_t err;
+        if ((err = track.encoder->start()) != OK
+                || (err = track.decoder->start()) != OK
+                || (err = track.decoder->getInputBuffers(&track.decoderInputBuffers)) != OK
+                || (err = track.decoder->getOutputBuffers(&track.decoderOutputBuffers)) != OK
+                || (err = track.encoder->getOutputBuffers(&track.encoderOutputBuffers)) != OK) {
+            return err;
+        }
+        if (!track.isVideo
+                && (err = track.encoder->getInputBuffers(&track.encoderInputBuffers)) != OK) {
+            return err;
+        }
+    }
+    return OK;
+}
+
+bool JMediaTranscoder::threadLoop() {
+    bool progress = false;
+
+    status_t err = feedExtractor(&progress);
+    bool done = true;
+    for (size_t i = 0; err == OK && i < mTracks.size(); i++) {
+        Track *track = &mTracks.editItemAt(i);
+        if (track->encoder == NULL) {
+            done = done && track->extractorDone;
+            continue;
+        }
+        if ((err = drainDecoder(track, &progress)) == OK) {
+            err = drainEncoder(track, &progress);
+        }
+        done = done && track->encoderDone;
+    }
+
+    if (err == OK && done) {
+        err = mMuxer->stop();
+        if (err == OK) {
+            postEvent(EVENT_COMPLETED, 0, 0);
+            return false;
+        }
+    }
+    if (err != OK) {
+        ALOGE("transcoding failed: %d", err);
+        postEvent(EVENT_ERROR, err, 0);
+        return false;
+    }
+
+    if (!progress) {
+        usleep(kIdleSleepUs);
+    }
+    return true;
+}
+
+status_t JMediaTranscoder::feedExtractor(bool *progress) {
+    size_t trackIndex;
+    if (mExtractor->getSampleTrackIndex(&trackIndex) != OK) {
+        // End of stream: every track still reading gets its EOS
+        for (size_t i = 0; i < mTracks.size(); i++) {
+            Track &track = mTracks.editItemAt(i);
+            if (track.extractorDone) {
+                continue;
+            }
+            if (track.decoder != NULL) {
+                size_t index;
+                if (track.decoder->dequeueInputBuffer(&index, 0) != OK) {
+                    continue;
+                }
+                status_t err = track.decoder->queueInputBuffer(
+                        index, 0, 0, 0, MediaCodec::BUFFER_FLAG_EOS);
+                if (err != OK) {
+                    return err;
+                }
+            }
+            track.extractorDone = true;
+            *progress = true;
+        }
+        return OK;
+    }
+
+    Track *track = findTrack(trackIndex);
+    CHECK(track != NULL);
+
+    int64_t timeUs;
+    sp<MetaData> meta;
+    status_t err;
+    if ((err = mExtractor->getSampleTime(&timeUs)) != OK
+            || (err = mExtractor->getSampleMeta(&meta)) != OK) {
+        return err;
+    }
+
+    if (track->decoder != NULL) {
+        size_t index;
+        if (track->decoder->dequeueInputBuffer(&index, 0) != OK) {
+            // The decoder is full; draining it below makes room
+            return OK;
+        }
+
+        const sp<ABuffer> &buffer = track->decoderInputBuffers[index];
+        buffer->setRange(0, buffer->capacity());
+        if ((err = mExtractor->readSampleData(buffer)) != OK) {
+            return err;
+        }
+        err = track->decoder->queueInputBuffer(index, 0, buffer->size(), timeUs, 0);
+    } else {
+        int32_t isSync;
+        uint32_t flags = 0;
+        if (meta->findInt32(kKeyIsSyncFrame, &isSync) && isSync) {
+            flags |= MediaCodec::BUFFER_FLAG_SYNCFRAME;
+        }
+
+        if (track->sampleBuffer == NULL) {
+            int32_t maxSize;
+            if (!track->format->findInt32("max-input-size", &maxSize) || maxSize <= 0) {
+                maxSize = 1024 * 1024;
+            }
+            track->sampleBuffer = new ABuffer(maxSize);
+        }
+        const sp<ABuffer> &sample = track->sampleBuffer;
+        sample->setRange(0, sample->capacity());
+        if ((err = mExtractor->readSampleData(sample)) != OK) {
+            return err;
+        }
+
+        // The muxer keeps the buffer until it is written out
+        sp<ABuffer> buffer = new ABuffer(sample->size());
+        memcpy(buffer->data(), sample->data(), sample->size());
+        err = writeSample(*track, buffer, timeUs, flags);
+    }
+
+    if (err == OK) {
+        mExtractor->advance();
+        *progress = true;
+    }
+    return err;
+}
+
+status_t JMediaTranscoder::drainDecoder(Track *track, bool *progress) {
+    while (!track->decoderDone) {
+        if (!track->hasPendingOutput) {
+            status_t err = track->decoder->dequeueOutputBuffer(
+                    &track->pendingIndex, &track->pendingOffset, &track->pendingSize,
+                    &track->pendingTimeUs, &track->pendingFlags, 0);
+            if (err == INFO_OUTPUT_BUFFERS_CHANGED) {
+                track->decoder->getOutputBuffers(&track->decoderOutputBuffers);
+                continue;
+            } else if (err == INFO_FORMAT_CHANGED) {
+                continue;
+            } else if (err == -EAGAIN) {
+                return OK;
+            } else if (err != OK) {
+                return err;
+            }
+            track->hasPendingOutput = true;
+            *progress = true;
+        }
+
+        const bool eos = (track->pendingFlags & MediaCodec::BUFFER_FLAG_EOS) != 0;
+
+        if (track->isVideo) {
+            // Rendering queues the frame to the encoder's input surface
+            status_t err = track->pendingSize > 0
+                    ? track->decoder->renderOutputBufferAndRelease(track->pendingIndex)
+                    : track->decoder->releaseOutputBuffer(track->pendingIndex);
+            track->hasPendingOutput = false;
+            if (err != OK) {
+                return err;
+            }
+            if (eos) {
+                track->decoderDone = true;
+                return track->encoder->signalEndOfInputStream();
+            }
+            continue;
+        }
+
+        size_t index;
+        if (track->encoder->dequeueInputBuffer(&index, 0) != OK) {
+            // Keep the decoded buffer until the encoder has room
+            return OK;
+        }
+
+        const sp<ABuffer> &src = track->decoderOutputBuffers[track->pendingIndex];
+        const sp<ABuffer> &dst = track->encoderInputBuffers[index];
+        const size_t size = track->pendingSize < dst->capacity()
+                ? track->pendingSize : dst->capacity();
+        memcpy(dst->data(), src->base() + track->pendingOffset, size);
+        track->pendingOffset += size;
+        track->pendingSize -= size;
+
+        const bool last = track->pendingSize == 0;
+        status_t err = track->encoder->queueInputBuffer(
+                index, 0, size, track->pendingTimeUs,
+                last && eos ? MediaCodec::BUFFER_FLAG_EOS : 0);
+        if (err != OK) {
+            return err;
+        }
+        if (last) {
+            track->decoder->releaseOutputBuffer(track->pendingIndex);
+            track->hasPendingOutput = false;
+            track->decoderDone = eos;
+        }
+        *progress = true;
+    }
+    return OK;
+}
+
+status_t JMediaTranscoder::drainEncoder(Track *track, bool *progress) {
+    while (!track->encoderDone) {
+        size_t index, offset, size;
+        int64_t timeUs;
+        uint32_t flags;
+        status_t err = track->encoder->dequeueOutputBuffer(
+                &index, &offset, &size, &timeUs, &flags, 0);
+        if (err == INFO_OUTPUT_BUFFERS_CHANGED) {
+            track->encoder->getOutputBuffers(&track->encoderOutputBuffers);
+            continue;
+        } else if (err == INFO_FORMAT_CHANGED) {
+            sp<AMessage> format;
+            if ((err = track->encoder->getOutputFormat(&format)) != OK) {
+                return err;
+            }
+            track->muxerIndex = mMuxer->addTrack(format);
+            if (track->muxerIndex < 0) {
+                return track->muxerIndex;
+            }
+            if ((err = maybeStartMuxer()) != OK) {
+                return err;
+            }
+            continue;
+        } else if (err == -EAGAIN) {
+            return OK;
+        } else if (err != OK) {
+            return err;
+        }
+        *progress = true;
+
+        // Codec config data reaches the muxer through the output format
+        if (size > 0 && !(flags & MediaCodec::BUFFER_FLAG_CODECCONFIG)) {
+            const sp<ABuffer> &src = track->encoderOutputBuffers[index];
+            sp<ABuffer> buffer = new ABuffer(size);
+            memcpy(buffer->data(), src->base() + offset, size);
+            err = writeSample(*track, buffer, timeUs,
+                    flags & MediaCodec::BUFFER_FLAG_SYNCFRAME);
+        }
+        track->encoder->releaseOutputBuffer(index);
+        if (err != OK) {
+            return err;
+        }
+        if (flags & MediaCodec::BUFFER_FLAG_EOS) {
+            track->encoderDone = true;
+        }
+    }
+    return OK;
+}
+
+status_t JMediaTranscoder::writeSample(const Track &track, const sp<ABuffer> &buffer,
+        int64_t timeUs, uint32_t flags) {
+    if (!mMuxerStarted) {
+        PendingSample sample;
+        sample.muxerTrack = track.muxerIndex;
+        sample.buffer = buffer;
+        sample.timeUs = timeUs;
+        sample.flags = flags;
+        mPendingSamples.push_back(sample);
+        return OK;
+    }
+
+    status_t err = mMuxer->writeSampleData(buffer, track.muxerIndex, timeUs, flags);
+    if (err == OK && timeUs >= mLastProgressUs + kProgressIntervalUs) {
+        mLastProgressUs = timeUs;
+        postEvent(EVENT_PROGRESS, 0, timeUs);
+    }
+    return err;
+}
+
+status_t JMediaTranscoder::maybeStartMuxer() {
+    for (size_t i = 0; i < mTracks.size(); i++) {
+        if (mTracks[i].muxerIndex < 0) {
+            return OK;
+        }
+    }
+
+    status_t err = mMuxer->start();
+    if (err != OK) {
+        return err;
+    }
+    mMuxerStarted = true;
+
+    for (List<PendingSample>::iterator it = mPendingSamples.begin();
+            it != mPendingSamples.end(); ++it) {
+        err = mMuxer->writeSampleData(it->buffer, it->muxerTrack, it->timeUs, it->flags);
+        if (err != OK) {
+            break;
+        }
+    }
+    mPendingSamples.clear();
+    return err;
+}
+
+void JMediaTranscoder::postEvent(int what, int arg1, int64_t arg2) {
+    JNIEnv *env = AndroidRuntime::getJNIEnv();
+    env->CallStaticVoidMethod(mClass, gFields.postEventFromNativeID,
+            mObject, what, arg1, (jlong) arg2);
+    if (env->ExceptionCheck()) {
+        ALOGW("An exception occurred while notifying an event.");
+        env->ExceptionClear();
+    }
+}
+
+}  // namespace android
+
+////////////////////////////////////////////////////////////////////////////////
+
+using namespace android;
+
+static jlong android_media_MediaTranscoder_native_setup(
+        JNIEnv *env, jclass clazz, jobject srcFileDescriptor, jlong offset, jlong length,
+        jobject dstFileDescriptor, jint format) {
+    int srcFd = jniGetFDFromFileDescriptor(env, srcFileDescriptor);
+    int dstFd = jniGetFDFromFileDescriptor(env, dstFileDescriptor);
+    if (srcFd < 0 || dstFd < 0) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return 0;
+    }
+
+    sp<JMediaTranscoder> transcoder = new JMediaTranscoder(
+            srcFd, offset, length, dstFd, static_cast<MediaMuxer::OutputFormat>(format));
+    if (transcoder->initCheck() != OK) {
+        jniThrowException(env, "java/io/IOException", "Failed to open the source");
+        return 0;
+    }
+
+    transcoder->incStrong(clazz);
+    return reinterpret_cast<jlong>(transcoder.get());
+}
+
+static void android_media_MediaTranscoder_addTrack(
+        JNIEnv *env, jclass clazz, jlong nativeObject, jint trackIndex,
+        jobjectArray keys, jobjectArray values) {
+    sp<JMediaTranscoder> transcoder(reinterpret_cast<JMediaTranscoder *>(nativeObject));
+    if (transcoder == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+
+    sp<AMessage> encoderFormat;
+    if (keys != NULL) {
+        status_t err = ConvertKeyValueArraysToMessage(env, keys, values, &encoderFormat);
+        if (err != OK) {
+            jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+            return;
+        }
+    }
+
+    status_t err = transcoder->addTrack(trackIndex, encoderFormat);
+    if (err == BAD_VALUE) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+    } else if (err != OK) {
+        jniThrowException(env, "java/lang/IllegalStateException",
+                "Failed to set up the track");
+    }
+}
+
+static void android_media_MediaTranscoder_start(
+        JNIEnv *env, jclass clazz, jlong nativeObject, jobject weakThis) {
+    sp<JMediaTranscoder> transcoder(reinterpret_cast<JMediaTranscoder *>(nativeObject));
+    if (transcoder == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+
+    status_t err = transcoder->startTranscode(env, weakThis);
+    if (err != OK) {
+        jniThrowException(env, "java/lang/IllegalStateException",
+                "Failed to start transcoding");
+    }
+}
+
+static void android_media_MediaTranscoder_native_release(
+        JNIEnv *env, jclass clazz, jlong nativeObject) {
+    sp<JMediaTranscoder> transcoder(reinterpret_cast<JMediaTranscoder *>(nativeObject));
+    if (transcoder != NULL) {
+        transcoder->cancel();
+        transcoder->decStrong(clazz);
+    }
+}
+
+static JNINativeMethod gMethods[] = {
+
+    { "nativeSetup", "(Ljava/io/FileDescriptor;JJLjava/io/FileDescriptor;I)J",
+        (void *)android_media_MediaTranscoder_native_setup },
+
+    { "nativeAddTrack", "(JI[Ljava/lang/String;[Ljava/lang/Object;)V",
+        (void *)android_media_MediaTranscoder_addTrack },
+
+    { "nativeStart", "(JLjava/lang/Object;)V",
+        (void *)android_media_MediaTranscoder_start },
+
+    { "nativeRelease", "(J)V",
+        (void *)android_media_MediaTranscoder_native_release },
+
+};
+
+// This function only registers the native methods, and is called from
+// JNI_OnLoad in android_media_MediaPlayer.cpp
+int register_android_media_MediaTranscoder(JNIEnv *env) {
+    int err = AndroidRuntime::registerNativeMethods(env,
+                "android/media/MediaTranscoder", gMethods, NELEM(gMethods));
+
+    jclass clazz = env->FindClass("android/media/MediaTranscoder");
+    CHECK(clazz != NULL);
+    gFields.clazz = (jclass)env->NewGlobalRef(clazz);
+
+    gFields.postEventFromNativeID = env->GetStaticMethodID(
+            clazz, "postEventFromNative", "(Ljava/lang/Object;IIJ)V");
+    CHECK(gFields.postEventFromNativeID != NULL);
+
+    return err;
+}
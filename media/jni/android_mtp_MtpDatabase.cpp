@@ -28,6 +28,10 @@
 #include "android_runtime/AndroidRuntime.h"
 #include "android_runtime/Log.h"
 
+#include <utils/KeyedVector.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
 #include "MtpDatabase.h"
 #include "MtpDataPacket.h"
 #include "MtpObjectInfo.h"
@@ -84,11 +88,66 @@ MtpDatabase* getMtpDatabase(JNIEnv *env, jobject database) {
 
 class MyMtpDatabase : public MtpDatabase {
 private:
+    // One value of a property list, as returned by MtpDatabase.getObjectPropertyList
+    struct PropertyEntry {
+        MtpObjectHandle     handle;
+        MtpObjectProperty   property;
+        int                 type;
+        int64_t             longValue;
+        MtpString           stringValue;
+        bool                hasString;
+    };
+
+    // All properties of one object
+    struct CachedProperties {
+        nsecs_t                 time;
+        Vector<PropertyEntry>   entries;
+    };
+
+    struct CachedObjectInfo {
+        nsecs_t             time;
+        MtpStorageID        storageID;
+        MtpObjectFormat     format;
+        MtpObjectHandle     parent;
+        uint32_t            compressedSize;
+        time_t              dateCreated;
+        time_t              dateModified;
+        MtpString           name;
+        uint32_t            thumbCompressedSize;
+        MtpObjectFormat     thumbFormat;
+        uint32_t            imagePixWidth;
+        uint32_t            imagePixHeight;
+    };
+
     jobject         mDatabase;
     jintArray       mIntBuffer;
     jlongArray      mLongBuffer;
     jcharArray      mStringBuffer;
 
+    // Hosts browsing a folder ask for the info and properties of every object
+    // in it, often more than once, and each of these is a MediaProvider query
+    // on the Java side.  Both are cached for the session, and property lists
+    // are fetched for all children of a parent at once.  Changes made on the
+    // device outside of MTP are picked up when the entries expire.
+    KeyedVector<MtpObjectHandle, CachedProperties>  mPropertyCache;
+    KeyedVector<MtpObjectHandle, CachedObjectInfo>  mObjectInfoCache;
+    // Parent of every handle handed out by getObjectList or getObjectInfo
+    KeyedVector<MtpObjectHandle, MtpObjectHandle>   mParents;
+    // When the children of a parent were last prefetched
+    KeyedVector<MtpObjectHandle, nsecs_t>           mPrefetchTimes;
+
+    MtpResponseCode                 queryObjectPropertyList(MtpObjectHandle handle,
+                                            uint32_t format, uint32_t property,
+                                            int groupCode, int depth,
+                                            Vector<PropertyEntry>& entries);
+    static void                     writePropertyEntry(MtpDataPacket& packet,
+                                            const PropertyEntry& entry);
+    const CachedProperties*         getCachedProperties(MtpObjectHandle handle);
+    void                            cacheProperties(const Vector<PropertyEntry>& entries);
+    void                            prefetchChildren(MtpObjectHandle parent);
+    void                            invalidateObject(MtpObjectHandle handle);
+    void                            invalidateCache();
+
 public:
                                     MyMtpDatabase(JNIEnv *env, jobject client);
     virtual                         ~MyMtpDatabase();
@@ -181,6 +240,15 @@ static void checkAndClearExceptionFromCallback(JNIEnv* env, const char* methodNa
     }
 }
 
+// cached object info and properties are dropped after this long
+static const nsecs_t kCacheTimeout = s2ns(30);
+// bound on the number of objects in each cache
+static const size_t kMaxCachedObjects = 32768;
+
+static bool isObjectHandle(MtpObjectHandle handle) {
+    return handle != 0 && handle != 0xFFFFFFFF;
+}
+
 // ----------------------------------------------------------------------------
 
 MyMtpDatabase::MyMtpDatabase(JNIEnv *env, jobject client)
@@ -238,6 +306,8 @@ MtpObjectHandle MyMtpDatabase::beginSendObject(const char* path,
 
 void MyMtpDatabase::endSendObject(const char* path, MtpObjectHandle handle,
                                 MtpObjectFormat format, bool succeeded) {
+    invalidateObject(handle);
+
     JNIEnv* env = AndroidRuntime::getJNIEnv();
     jstring pathStr = env->NewStringUTF(path);
     env->CallVoidMethod(mDatabase, method_endSendObject, pathStr,
@@ -259,8 +329,11 @@ MtpObjectHandleList* MyMtpDatabase::getObjectList(MtpStorageID storageID,
     MtpObjectHandleList* list = new MtpObjectHandleList();
     jint* handles = env->GetIntArrayElements(array, 0);
     jsize length = env->GetArrayLength(array);
-    for (int i = 0; i < length; i++)
+    for (int i = 0; i < length; i++) {
         list->push(handles[i]);
+        if (isObjectHandle(parent))
+            mParents.replaceValueFor(handles[i], parent);
+    }
     env->ReleaseIntArrayElements(array, handles, 0);
     env->DeleteLocalRef(array);
 
@@ -513,6 +586,7 @@ MtpResponseCode MyMtpDatabase::setObjectPropertyValue(MtpObjectHandle handle,
             return MTP_RESPONSE_INVALID_OBJECT_PROP_FORMAT;
     }
 
+    invalidateObject(handle);
     jint result = env->CallIntMethod(mDatabase, method_setObjectProperty,
                 (jint)handle, (jint)property, longValue, stringValue);
     if (stringValue)
@@ -649,10 +723,10 @@ MtpResponseCode MyMtpDatabase::resetDeviceProperty(MtpDeviceProperty property) {
     return -1;
 }
 
-MtpResponseCode MyMtpDatabase::getObjectPropertyList(MtpObjectHandle handle,
+MtpResponseCode MyMtpDatabase::queryObjectPropertyList(MtpObjectHandle handle,
                                             uint32_t format, uint32_t property,
                                             int groupCode, int depth,
-                                            MtpDataPacket& packet) {
+                                            Vector<PropertyEntry>& entries) {
     JNIEnv* env = AndroidRuntime::getJNIEnv();
     jobject list = env->CallObjectMethod(mDatabase, method_getObjectPropertyList,
                 (jlong)handle, (jint)format, (jlong)property, (jint)groupCode, (jint)depth);
@@ -662,7 +736,6 @@ MtpResponseCode MyMtpDatabase::getObjectPropertyList(MtpObjectHandle handle,
     int count = env->GetIntField(list, field_mCount);
     MtpResponseCode result = env->GetIntField(list, field_mResult);
 
-    packet.putUInt32(count);
     if (count > 0) {
         jintArray objectHandlesArray = (jintArray)env->GetObjectField(list, field_mObjectHandles);
         jintArray propertyCodesArray = (jintArray)env->GetObjectField(list, field_mPropertyCodes);
@@ -675,59 +748,25 @@ MtpResponseCode MyMtpDatabase::getObjectPropertyList(MtpObjectHandle handle,
         jint* dataTypes = env->GetIntArrayElements(dataTypesArray, 0);
         jlong* longValues = (longValuesArray ? env->GetLongArrayElements(longValuesArray, 0) : NULL);
 
+        entries.setCapacity(count);
         for (int i = 0; i < count; i++) {
-            packet.putUInt32(objectHandles[i]);
-            packet.putUInt16(propertyCodes[i]);
-            int type = dataTypes[i];
-            packet.putUInt16(type);
-
-            switch (type) {
-                case MTP_TYPE_INT8:
-                    packet.putInt8(longValues[i]);
-                    break;
-                case MTP_TYPE_UINT8:
-                    packet.putUInt8(longValues[i]);
-                    break;
-                case MTP_TYPE_INT16:
-                    packet.putInt16(longValues[i]);
-                    break;
-                case MTP_TYPE_UINT16:
-                    packet.putUInt16(longValues[i]);
-                    break;
-                case MTP_TYPE_INT32:
-                    packet.putInt32(longValues[i]);
-                    break;
-                case MTP_TYPE_UINT32:
-                    packet.putUInt32(longValues[i]);
-                    break;
-                case MTP_TYPE_INT64:
-                    packet.putInt64(longValues[i]);
-                    break;
-                case MTP_TYPE_UINT64:
-                    packet.putUInt64(longValues[i]);
-                    break;
-                case MTP_TYPE_INT128:
-                    packet.putInt128(longValues[i]);
-                    break;
-                case MTP_TYPE_UINT128:
-                    packet.putUInt128(longValues[i]);
-                    break;
-                case MTP_TYPE_STR: {
-                    jstring value = (jstring)env->GetObjectArrayElement(stringValuesArray, i);
-                    const char *valueStr = (value ? env->GetStringUTFChars(value, NULL) : NULL);
-                    if (valueStr) {
-                        packet.putString(valueStr);
-                        env->ReleaseStringUTFChars(value, valueStr);
-                    } else {
-                        packet.putEmptyString();
-                    }
-                    env->DeleteLocalRef(value);
-                    break;
+            PropertyEntry entry;
+            entry.handle = objectHandles[i];
+            entry.property = propertyCodes[i];
+            entry.type = dataTypes[i];
+            entry.longValue = (longValues ? longValues[i] : 0);
+            entry.hasString = false;
+            if (entry.type == MTP_TYPE_STR) {
+                jstring value = (jstring)env->GetObjectArrayElement(stringValuesArray, i);
+                const char *valueStr = (value ? env->GetStringUTFChars(value, NULL) : NULL);
+                if (valueStr) {
+                    entry.stringValue.setTo(valueStr);
+                    entry.hasString = true;
+                    env->ReleaseStringUTFChars(value, valueStr);
                 }
-                default:
-                    ALOGE("bad or unsupported data type in MyMtpDatabase::getObjectPropertyList");
-                    break;
+                env->DeleteLocalRef(value);
             }
+            entries.add(entry);
         }
 
         env->ReleaseIntArrayElements(objectHandlesArray, objectHandles, 0);
@@ -750,13 +789,180 @@ MtpResponseCode MyMtpDatabase::getObjectPropertyList(MtpObjectHandle handle,
     return result;
 }
 
+void MyMtpDatabase::writePropertyEntry(MtpDataPacket& packet, const PropertyEntry& entry) {
+    packet.putUInt32(entry.handle);
+    packet.putUInt16(entry.property);
+    packet.putUInt16(entry.type);
+
+    switch (entry.type) {
+        case MTP_TYPE_INT8:
+            packet.putInt8(entry.longValue);
+            break;
+        case MTP_TYPE_UINT8:
+            packet.putUInt8(entry.longValue);
+            break;
+        case MTP_TYPE_INT16:
+            packet.putInt16(entry.longValue);
+            break;
+        case MTP_TYPE_UINT16:
+            packet.putUInt16(entry.longValue);
+            break;
+        case MTP_TYPE_INT32:
+            packet.putInt32(entry.longValue);
+            break;
+        case MTP_TYPE_UINT32:
+            packet.putUInt32(entry.longValue);
+            break;
+        case MTP_TYPE_INT64:
+            packet.putInt64(entry.longValue);
+            break;
+        case MTP_TYPE_UINT64:
+            packet.putUInt64(entry.longValue);
+            break;
+        case MTP_TYPE_INT128:
+            packet.putInt128(entry.longValue);
+            break;
+        case MTP_TYPE_UINT128:
+            packet.putUInt128(entry.longValue);
+            break;
+        case MTP_TYPE_STR:
+            if (entry.hasString)
+                packet.putString((const char *)entry.stringValue);
+            else
+                packet.putEmptyString();
+            break;
+        default:
+            ALOGE("bad or unsupported data type in MyMtpDatabase::getObjectPropertyList");
+            break;
+    }
+}
+
+const MyMtpDatabase::CachedProperties* MyMtpDatabase::getCachedProperties(
+                                            MtpObjectHandle handle) {
+    ssize_t index = mPropertyCache.indexOfKey(handle);
+    if (index >= 0 && systemTime() - mPropertyCache.valueAt(index).time > kCacheTimeout) {
+        mPropertyCache.removeItemsAt(index);
+        index = -1;
+    }
+    if (index < 0) {
+        // fetch the whole folder, the host is likely to ask for the siblings next
+        ssize_t parentIndex = mParents.indexOfKey(handle);
+        if (parentIndex < 0)
+            return NULL;
+        prefetchChildren(mParents.valueAt(parentIndex));
+        index = mPropertyCache.indexOfKey(handle);
+        if (index < 0)
+            return NULL;
+    }
+    return &mPropertyCache.valueAt(index);
+}
+
+void MyMtpDatabase::cacheProperties(const Vector<PropertyEntry>& entries) {
+    nsecs_t now = systemTime();
+    size_t i = 0;
+    while (i < entries.size()) {
+        MtpObjectHandle handle = entries[i].handle;
+        CachedProperties cached;
+        cached.time = now;
+        // entries for one object are contiguous
+        while (i < entries.size() && entries[i].handle == handle)
+            cached.entries.add(entries[i++]);
+
+        if (mPropertyCache.size() >= kMaxCachedObjects)
+            mPropertyCache.clear();
+        mPropertyCache.replaceValueFor(handle, cached);
+    }
+}
+
+void MyMtpDatabase::prefetchChildren(MtpObjectHandle parent) {
+    nsecs_t now = systemTime();
+    ssize_t index = mPrefetchTimes.indexOfKey(parent);
+    if (index >= 0 && now - mPrefetchTimes.valueAt(index) < kCacheTimeout)
+        return;
+    mPrefetchTimes.replaceValueFor(parent, now);
+
+    Vector<PropertyEntry> entries;
+    if (queryObjectPropertyList(parent, 0, 0xFFFFFFFF, 0, 1, entries) == MTP_RESPONSE_OK) {
+        ALOGV("prefetched %d properties of the children of %08X", (int)entries.size(), parent);
+        cacheProperties(entries);
+    }
+}
+
+void MyMtpDatabase::invalidateObject(MtpObjectHandle handle) {
+    mPropertyCache.removeItem(handle);
+    mObjectInfoCache.removeItem(handle);
+}
+
+void MyMtpDatabase::invalidateCache() {
+    mPropertyCache.clear();
+    mObjectInfoCache.clear();
+    mParents.clear();
+    mPrefetchTimes.clear();
+}
+
+MtpResponseCode MyMtpDatabase::getObjectPropertyList(MtpObjectHandle handle,
+                                            uint32_t format, uint32_t property,
+                                            int groupCode, int depth,
+                                            MtpDataPacket& packet) {
+    const bool allProperties = (property == 0xFFFFFFFF && groupCode == 0);
+
+    if (format == 0 && groupCode == 0 && depth == 0 && isObjectHandle(handle)) {
+        const CachedProperties* cached = getCachedProperties(handle);
+        if (cached) {
+            const Vector<PropertyEntry>& entries = cached->entries;
+            if (allProperties) {
+                packet.putUInt32(entries.size());
+                for (size_t i = 0; i < entries.size(); i++)
+                    writePropertyEntry(packet, entries[i]);
+                return MTP_RESPONSE_OK;
+            }
+            for (size_t i = 0; i < entries.size(); i++) {
+                if (entries[i].property == property) {
+                    packet.putUInt32(1);
+                    writePropertyEntry(packet, entries[i]);
+                    return MTP_RESPONSE_OK;
+                }
+            }
+            // not among the supported properties, let the Java side decide
+        }
+    }
+
+    Vector<PropertyEntry> entries;
+    MtpResponseCode result = queryObjectPropertyList(handle, format, property,
+            groupCode, depth, entries);
+    packet.putUInt32(entries.size());
+    for (size_t i = 0; i < entries.size(); i++)
+        writePropertyEntry(packet, entries[i]);
+
+    if (result == MTP_RESPONSE_OK && allProperties && format == 0 && depth <= 1)
+        cacheProperties(entries);
+    return result;
+}
+
 MtpResponseCode MyMtpDatabase::getObjectInfo(MtpObjectHandle handle,
                                             MtpObjectInfo& info) {
-    char            date[20];
     MtpString       path;
     int64_t         length;
     MtpObjectFormat format;
 
+    ssize_t index = mObjectInfoCache.indexOfKey(handle);
+    if (index >= 0 && systemTime() - mObjectInfoCache.valueAt(index).time <= kCacheTimeout) {
+        const CachedObjectInfo& cached = mObjectInfoCache.valueAt(index);
+        info.mCompressedSize = cached.compressedSize;
+        info.mStorageID = cached.storageID;
+        info.mFormat = cached.format;
+        info.mParent = cached.parent;
+        info.mDateCreated = cached.dateCreated;
+        info.mDateModified = cached.dateModified;
+        info.mAssociationType = MTP_ASSOCIATION_TYPE_UNDEFINED;
+        info.mName = strdup((const char *)cached.name);
+        info.mThumbCompressedSize = cached.thumbCompressedSize;
+        info.mThumbFormat = cached.thumbFormat;
+        info.mImagePixWidth = cached.imagePixWidth;
+        info.mImagePixHeight = cached.imagePixHeight;
+        return MTP_RESPONSE_OK;
+    }
+
     MtpResponseCode result = getObjectFilePath(handle, path, length, format);
     if (result != MTP_RESPONSE_OK) {
         return result;
@@ -811,6 +1017,25 @@ MtpResponseCode MyMtpDatabase::getObjectInfo(MtpObjectHandle handle,
         DiscardData();
     }
 
+    CachedObjectInfo cached;
+    cached.time = systemTime();
+    cached.compressedSize = info.mCompressedSize;
+    cached.storageID = info.mStorageID;
+    cached.format = info.mFormat;
+    cached.parent = info.mParent;
+    cached.dateCreated = info.mDateCreated;
+    cached.dateModified = info.mDateModified;
+    cached.name.setTo(info.mName);
+    cached.thumbCompressedSize = info.mThumbCompressedSize;
+    cached.thumbFormat = info.mThumbFormat;
+    cached.imagePixWidth = info.mImagePixWidth;
+    cached.imagePixHeight = info.mImagePixHeight;
+    if (mObjectInfoCache.size() >= kMaxCachedObjects)
+        mObjectInfoCache.clear();
+    mObjectInfoCache.replaceValueFor(handle, cached);
+    if (isObjectHandle(info.mParent))
+        mParents.replaceValueFor(handle, info.mParent);
+
     checkAndClearExceptionFromCallback(env, __FUNCTION__);
     return MTP_RESPONSE_OK;
 }
@@ -872,6 +1097,9 @@ MtpResponseCode MyMtpDatabase::getObjectFilePath(MtpObjectHandle handle,
 }
 
 MtpResponseCode MyMtpDatabase::deleteFile(MtpObjectHandle handle) {
+    // may take a whole subtree with it
+    invalidateCache();
+
     JNIEnv* env = AndroidRuntime::getJNIEnv();
     MtpResponseCode result = env->CallIntMethod(mDatabase, method_deleteFile, (jint)handle);
 
@@ -1058,12 +1286,14 @@ MtpProperty* MyMtpDatabase::getDevicePropertyDesc(MtpDeviceProperty property) {
 }
 
 void MyMtpDatabase::sessionStarted() {
+    invalidateCache();
     JNIEnv* env = AndroidRuntime::getJNIEnv();
     env->CallVoidMethod(mDatabase, method_sessionStarted);
     checkAndClearExceptionFromCallback(env, __FUNCTION__);
 }
 
 void MyMtpDatabase::sessionEnded() {
+    invalidateCache();
     JNIEnv* env = AndroidRuntime::getJNIEnv();
     env->CallVoidMethod(mDatabase, method_sessionEnded);
     checkAndClearExceptionFromCallback(env, __FUNCTION__);
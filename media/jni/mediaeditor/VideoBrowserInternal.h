@@ -98,6 +98,13 @@ typedef struct
     M4_StreamHandler*                   m_pStreamHandler ;
     M4_AccessUnit                       m_accessUnit ;
 
+    /*--- Second reader of the file, only used to look up sync frames
+          without moving the position of the decoder's reader ---*/
+    M4OSA_Char*                         m_pURL ;
+    M4OSA_Context                       m_pRapReaderCtx ;
+    M4_StreamHandler*                   m_pRapStreamHandler ;
+    M4OSA_Bool                          m_bRapReaderFailed ;
+
     /*--- Decoder parameters ---*/
     M4DECODER_VideoInterface*           m_pDecoder ;
     M4OSA_Context                       m_pDecoderCtx ;
@@ -16,6 +16,7 @@
 #include "VideoEditorVideoDecoder.h"
 #include "VideoEditor3gpReader.h"
 
+#include <string.h>
 #include <utils/Log.h>
 #include "VideoBrowserInternal.h"
 #include "LVOSA_FileReader_optim.h"
@@ -165,6 +166,13 @@ M4OSA_ERR videoBrowserCreate(
     pContext->m_state = VideoBrowser_kVBCreating ;
     pContext->m_frameColorType = clrType;
 
+    /*--- Keep the URL to open the sync frame reader ---*/
+    pContext->m_pURL = (M4OSA_Char*)M4OSA_32bitAlignedMalloc(
+            strlen((const char*)pURL) + 1,
+            VIDEOBROWSER, (M4OSA_Char*)"Video browser URL");
+    CHECK_PTR(videoBrowserCreate, pContext->m_pURL, err, M4ERR_ALLOC);
+    memcpy((void *)pContext->m_pURL, (void *)pURL, strlen((const char*)pURL) + 1);
+
     /*--- Copy the file reader functions ---*/
     memcpy((void *)&pContext->m_fileReadPtr,
                  (void *)ptrF,
@@ -376,6 +384,7 @@ videoBrowserCreate_cleanUp:
         SAFE_FREE(pContext->m_pDecoder);
         SAFE_FREE(pContext->m_3gpReader);
         SAFE_FREE(pContext->m_3gpData);
+        SAFE_FREE(pContext->m_pURL);
         SAFE_FREE(pContext);
     }
 
@@ -413,9 +422,17 @@ M4OSA_ERR videoBrowserCleanUp(M4OSA_Context pContext)
         pC->m_pReaderCtx = M4OSA_NULL;
     }
 
+    if (M4OSA_NULL != pC->m_pRapReaderCtx)
+    {
+        pC->m_3gpReader->m_pFctClose(pC->m_pRapReaderCtx) ;
+        pC->m_3gpReader->m_pFctDestroy(pC->m_pRapReaderCtx);
+        pC->m_pRapReaderCtx = M4OSA_NULL;
+    }
+
     SAFE_FREE(pC->m_pDecoder);
     SAFE_FREE(pC->m_3gpReader);
     SAFE_FREE(pC->m_3gpData);
+    SAFE_FREE(pC->m_pURL);
 
     if (pC->m_frameColorType != VideoBrowser_kYUV420) {
         SAFE_FREE(pC->m_outputPlane[0].pac_data);
@@ -430,19 +447,116 @@ videoBrowserCleanUp_cleanUp:
     M4OSA_TRACE2_1("videoBrowserCleanUp returned 0x%x", err);
     return err;
 }
+
 /******************************************************************************
-* M4OSA_ERR     videoBrowserPrepareFrame(
-*       M4OSA_Context pContext, M4OSA_UInt32* pTime);
-* @brief        This function prepares the frame.
-* @param        pContext     (IN) : Video browser context
-* @param        pTime        (IN/OUT) : Pointer on the time to reach. Updated
-*                                       by this function with the reached time
-* @param        tolerance    (IN) :  We may decode an earlier frame within the tolerance.
-*                                    The time difference is specified in milliseconds.
-* @return       M4NO_ERROR / M4ERR_PARAMETER / M4ERR_STATE / M4ERR_ALLOC
+* @brief        Opens the second reader of the file, used to look up sync frames.
+*               Asking the decoder's reader would move its position.
+* @param        pC           (IN) : Video browser context
+* @return       M4NO_ERROR / M4ERR_ALLOC / reader errors
 ******************************************************************************/
-M4OSA_ERR videoBrowserPrepareFrame(M4OSA_Context pContext, M4OSA_UInt32* pTime,
-    M4OSA_UInt32 tolerance)
+static M4OSA_ERR videoBrowserOpenRapReader(VideoBrowserContext* pC)
+{
+    M4READER_MediaFamily mediaFamily = M4READER_kMediaFamilyUnknown;
+    M4_StreamHandler* pStreamHandler = M4OSA_NULL;
+    M4OSA_Context pReaderCtx = M4OSA_NULL;
+    M4OSA_ERR err = M4NO_ERROR;
+
+    err = pC->m_3gpReader->m_pFctCreate(&pReaderCtx);
+    CHECK_ERR(videoBrowserOpenRapReader, err);
+    CHECK_PTR(videoBrowserOpenRapReader, pReaderCtx, err, M4ERR_ALLOC);
+
+    err = pC->m_3gpReader->m_pFctSetOption(pReaderCtx,
+            M4READER_kOptionID_SetOsaFileReaderFctsPtr,
+            (M4OSA_DataOption)(&pC->m_fileReadPtr));
+    CHECK_ERR(videoBrowserOpenRapReader, err);
+
+    err = pC->m_3gpReader->m_pFctOpen(pReaderCtx, pC->m_pURL);
+    CHECK_ERR(videoBrowserOpenRapReader, err);
+
+    while (err == M4NO_ERROR)
+    {
+        err = pC->m_3gpReader->m_pFctGetNextStream(
+                pReaderCtx, &mediaFamily, &pStreamHandler);
+
+        if ((err == (M4OSA_UInt32)M4ERR_READER_UNKNOWN_STREAM_TYPE) ||
+            (err == (M4OSA_UInt32)M4WAR_TOO_MUCH_STREAMS) ||
+            ((err == M4NO_ERROR) && (M4READER_kMediaFamilyVideo != mediaFamily)))
+        {
+            err = M4NO_ERROR;
+            continue;
+        }
+        if (err != M4NO_ERROR)
+        {
+            // M4WAR_NO_MORE_STREAM or a reader error
+            goto videoBrowserOpenRapReader_cleanUp;
+        }
+
+        err = pC->m_3gpReader->m_pFctReset(pReaderCtx, pStreamHandler);
+        CHECK_ERR(videoBrowserOpenRapReader, err);
+
+        pC->m_pRapReaderCtx = pReaderCtx;
+        pC->m_pRapStreamHandler = pStreamHandler;
+        return M4NO_ERROR;
+    }
+
+videoBrowserOpenRapReader_cleanUp:
+
+    if (M4OSA_NULL != pReaderCtx)
+    {
+        pC->m_3gpReader->m_pFctClose(pReaderCtx);
+        pC->m_3gpReader->m_pFctDestroy(pReaderCtx);
+    }
+    M4OSA_TRACE1_1("videoBrowserOpenRapReader returned 0x%x", err);
+    return err;
+}
+
+/******************************************************************************
+* @brief        Decides whether the decoder has to jump to reach a time.
+* @param        pC           (IN) : Video browser context
+* @param        targetTime   (IN) : Time to reach
+* @param        bInOrder     (IN) : The caller asks for increasing times
+* @return       M4OSA_TRUE if the decoder must jump
+******************************************************************************/
+static M4OSA_Bool videoBrowserIsJumpNeeded(VideoBrowserContext* pC,
+    M4OSA_UInt32 targetTime, M4OSA_Bool bInOrder)
+{
+    M4OSA_Int32 rapTime = (M4OSA_Int32)targetTime;
+
+    if (pC->m_currentCTS == 0 || targetTime < pC->m_currentCTS)
+    {
+        return M4OSA_TRUE;
+    }
+
+    // Decoding on is cheaper than jumping unless a sync frame lies between
+    // the current position and the target. It is looked up with the second
+    // reader, the decoder's one would be moved to that sync frame.
+    if (bInOrder && (M4OSA_NULL == pC->m_pRapReaderCtx) &&
+        (M4OSA_FALSE == pC->m_bRapReaderFailed))
+    {
+        pC->m_bRapReaderFailed = (videoBrowserOpenRapReader(pC) != M4NO_ERROR)
+            ? M4OSA_TRUE : M4OSA_FALSE;
+    }
+    if (bInOrder && (M4OSA_NULL != pC->m_pRapReaderCtx) &&
+        pC->m_3gpReader->m_pFctGetPrevRapTime(pC->m_pRapReaderCtx,
+            pC->m_pRapStreamHandler, &rapTime) == M4NO_ERROR)
+    {
+        return (rapTime > (M4OSA_Int32)pC->m_currentCTS) ? M4OSA_TRUE : M4OSA_FALSE;
+    }
+
+    // If we jump forward to a time greater than current position by
+    // 85ms (~ 2 frames), we want to jump.
+    return (targetTime > (pC->m_currentCTS + 85)) ? M4OSA_TRUE : M4OSA_FALSE;
+}
+
+/******************************************************************************
+* M4OSA_ERR     videoBrowserPrepare(
+*       M4OSA_Context pContext, M4OSA_UInt32* pTime, M4OSA_UInt32 tolerance,
+*       M4OSA_Bool bInOrder);
+* @brief        Common part of videoBrowserPrepareFrame and
+*               videoBrowserPrepareNextFrame.
+******************************************************************************/
+static M4OSA_ERR videoBrowserPrepare(M4OSA_Context pContext, M4OSA_UInt32* pTime,
+    M4OSA_UInt32 tolerance, M4OSA_Bool bInOrder)
 {
     VideoBrowserContext* pC = (VideoBrowserContext*)pContext;
     M4OSA_ERR err = M4NO_ERROR;
@@ -451,8 +565,8 @@ M4OSA_ERR videoBrowserPrepareFrame(M4OSA_Context pContext, M4OSA_UInt32* pTime,
     M4OSA_Bool bJumpNeeded = M4OSA_FALSE;
 
     /*--- Sanity checks ---*/
-    CHECK_PTR(videoBrowserPrepareFrame, pContext, err, M4ERR_PARAMETER);
-    CHECK_PTR(videoBrowserPrepareFrame, pTime,  err, M4ERR_PARAMETER);
+    CHECK_PTR(videoBrowserPrepare, pContext, err, M4ERR_PARAMETER);
+    CHECK_PTR(videoBrowserPrepare, pTime,  err, M4ERR_PARAMETER);
 
     targetTime = *pTime ;
 
@@ -465,17 +579,10 @@ M4OSA_ERR videoBrowserPrepareFrame(M4OSA_Context pContext, M4OSA_UInt32* pTime,
     else if (VideoBrowser_kVBBrowsing != pC->m_state)
     {
         err = M4ERR_STATE ;
-        goto videoBrowserPrepareFrame_cleanUp;
+        goto videoBrowserPrepare_cleanUp;
     }
 
-    // If we jump backward or forward to a time greater than current position by
-    // 85ms (~ 2 frames), we want to jump.
-    if (pC->m_currentCTS == 0 ||
-        targetTime < pC->m_currentCTS ||
-        targetTime > (pC->m_currentCTS + 85))
-    {
-        bJumpNeeded = M4OSA_TRUE;
-    }
+    bJumpNeeded = videoBrowserIsJumpNeeded(pC, targetTime, bInOrder);
 
     timeMS = (M4_MediaTime)targetTime;
     err = pC->m_pDecoder->m_pFctDecode(
@@ -493,7 +600,7 @@ M4OSA_ERR videoBrowserPrepareFrame(M4OSA_Context pContext, M4OSA_UInt32* pTime,
     {
         return err;
     }
-    CHECK_ERR(videoBrowserPrepareFrame, err) ;
+    CHECK_ERR(videoBrowserPrepare, err) ;
 
     pC->m_currentCTS = (M4OSA_UInt32)timeMS;
 
@@ -501,7 +608,7 @@ M4OSA_ERR videoBrowserPrepareFrame(M4OSA_Context pContext, M4OSA_UInt32* pTime,
 
     return M4NO_ERROR;
 
-videoBrowserPrepareFrame_cleanUp:
+videoBrowserPrepare_cleanUp:
 
     if ((M4WAR_INVALID_TIME == err) || (M4WAR_NO_MORE_AU == err))
     {
@@ -512,10 +619,47 @@ videoBrowserPrepareFrame_cleanUp:
         pC->m_currentCTS = 0;
     }
 
-    M4OSA_TRACE2_1("videoBrowserPrepareFrame returned 0x%x", err);
+    M4OSA_TRACE2_1("videoBrowserPrepare returned 0x%x", err);
     return err;
 }
 
+/******************************************************************************
+* M4OSA_ERR     videoBrowserPrepareFrame(
+*       M4OSA_Context pContext, M4OSA_UInt32* pTime);
+* @brief        This function prepares the frame.
+* @param        pContext     (IN) : Video browser context
+* @param        pTime        (IN/OUT) : Pointer on the time to reach. Updated
+*                                       by this function with the reached time
+* @param        tolerance    (IN) :  We may decode an earlier frame within the tolerance.
+*                                    The time difference is specified in milliseconds.
+* @return       M4NO_ERROR / M4ERR_PARAMETER / M4ERR_STATE / M4ERR_ALLOC
+******************************************************************************/
+M4OSA_ERR videoBrowserPrepareFrame(M4OSA_Context pContext, M4OSA_UInt32* pTime,
+    M4OSA_UInt32 tolerance)
+{
+    return videoBrowserPrepare(pContext, pTime, tolerance, M4OSA_FALSE);
+}
+
+/******************************************************************************
+* M4OSA_ERR     videoBrowserPrepareNextFrame(
+*       M4OSA_Context pContext, M4OSA_UInt32* pTime, M4OSA_UInt32 tolerance);
+* @brief        This function prepares the frame, for callers that browse
+*               forward. Rather than jumping to the sync frame before every
+*               time, the decoder carries on from the current position unless
+*               a sync frame lies in between.
+* @param        pContext     (IN) : Video browser context
+* @param        pTime        (IN/OUT) : Pointer on the time to reach. Updated
+*                                       by this function with the reached time
+* @param        tolerance    (IN) :  We may decode an earlier frame within the tolerance.
+*                                    The time difference is specified in milliseconds.
+* @return       M4NO_ERROR / M4ERR_PARAMETER / M4ERR_STATE / M4ERR_ALLOC
+******************************************************************************/
+M4OSA_ERR videoBrowserPrepareNextFrame(M4OSA_Context pContext, M4OSA_UInt32* pTime,
+    M4OSA_UInt32 tolerance)
+{
+    return videoBrowserPrepare(pContext, pTime, tolerance, M4OSA_TRUE);
+}
+
 /******************************************************************************
 * M4OSA_ERR     videoBrowserDisplayCurrentFrame(M4OSA_Context pContext);
 * @brief        This function displays the current frame.
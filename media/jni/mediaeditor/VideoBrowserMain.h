@@ -136,6 +136,18 @@ M4OSA_ERR videoBrowserCleanUp(M4OSA_Context pContext) ;
 M4OSA_ERR videoBrowserPrepareFrame(M4OSA_Context pContext, M4OSA_UInt32* pTime,
         M4OSA_UInt32 tolerance);
 
+/******************************************************************************
+* @brief        Same as videoBrowserPrepareFrame, for increasing times. The
+*               decoder only jumps when a sync frame lies between the current
+*               position and the time to reach.
+* @param        pContext  (IN)      : Video browser context
+* @param        pTime     (IN/OUT)  : Pointer on the time to reach. Updated by
+*                                     this function with the reached time
+* @return       M4NO_ERROR / M4ERR_PARAMETER / M4ERR_STATE / M4ERR_ALLOC
+******************************************************************************/
+M4OSA_ERR videoBrowserPrepareNextFrame(M4OSA_Context pContext, M4OSA_UInt32* pTime,
+        M4OSA_UInt32 tolerance);
+
 /******************************************************************************
 * @brief        This function sets the size and the position of the display.
 * @param        pContext     (IN) : Video Browser context
@@ -18,8 +18,10 @@
 #include <dlfcn.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <utils/List.h>
 #include <utils/Log.h>
 #include <utils/threads.h>
+#include <utils/Vector.h>
 #include <VideoEditorClasses.h>
 #include <VideoEditorJava.h>
 #include <VideoEditorOsal.h>
@@ -2237,6 +2239,124 @@ static jint videoEditor_getPixels(
     return (jint)timeMS;
 }
 
+/*
+ * Extracts a list of thumbnails on its own thread, a few frames ahead of the
+ * caller, so decoding the next frame overlaps with the Java callback that
+ * consumes the current one.  Requests are decoded, and come out, in time
+ * order so that the decoder only seeks when it has to.
+ */
+class ThumbnailPipeline : public Thread {
+public:
+    struct Frame {
+        int             index;
+        M4OSA_UInt32    timeMs;
+        M4OSA_ERR       err;
+        M4OSA_Int32*    pixels;
+    };
+
+    ThumbnailPipeline(M4OSA_Context context, M4OSA_UInt32 width, M4OSA_UInt32 height,
+            M4OSA_UInt32 tolerance)
+        : Thread(false), mContext(context), mWidth(width), mHeight(height),
+          mTolerance(tolerance), mNext(0) {
+    }
+
+    virtual ~ThumbnailPipeline() {
+        for (size_t i = 0; i < mBuffers.size(); i++) {
+            free(mBuffers[i]);
+        }
+    }
+
+    void addRequest(int index, M4OSA_UInt32 timeMs) {
+        Frame frame;
+        frame.index = index;
+        frame.timeMs = timeMs;
+        frame.err = M4NO_ERROR;
+        frame.pixels = NULL;
+        size_t i = mRequests.size();
+        while (i > 0 && mRequests[i - 1].timeMs > timeMs) {
+            i--;
+        }
+        mRequests.insertAt(frame, i);
+    }
+
+    status_t start() {
+        for (int i = 0; i < kDepth; i++) {
+            M4OSA_Int32* buffer = (M4OSA_Int32*)malloc(mWidth * mHeight * sizeof(M4OSA_Int32));
+            if (buffer == NULL) {
+                return NO_MEMORY;
+            }
+            mBuffers.add(buffer);
+            mFree.add(buffer);
+        }
+        return run("VideoEditorThumbnails", PRIORITY_BACKGROUND);
+    }
+
+    // Waits for the next frame; its pixels must be handed back with release()
+    void dequeue(Frame* frame) {
+        Mutex::Autolock _l(mLock);
+        while (mReady.empty()) {
+            mCondition.wait(mLock);
+        }
+        *frame = *mReady.begin();
+        mReady.erase(mReady.begin());
+    }
+
+    void release(M4OSA_Int32* pixels) {
+        Mutex::Autolock _l(mLock);
+        mFree.add(pixels);
+        mCondition.broadcast();
+    }
+
+    void stop() {
+        {
+            Mutex::Autolock _l(mLock);
+            requestExit();
+            mCondition.broadcast();
+        }
+        requestExitAndWait();
+    }
+
+private:
+    // Frames decoded ahead of the consumer
+    static const int kDepth = 3;
+
+    virtual bool threadLoop() {
+        Frame frame;
+        {
+            Mutex::Autolock _l(mLock);
+            while (mFree.empty() && !exitPending()) {
+                mCondition.wait(mLock);
+            }
+            if (exitPending()) {
+                return false;
+            }
+            frame = mRequests[mNext++];
+            frame.pixels = mFree[mFree.size() - 1];
+            mFree.removeAt(mFree.size() - 1);
+        }
+
+        frame.err = ThumbnailGetNextPixels32(mContext, frame.pixels, mWidth, mHeight,
+                &frame.timeMs, mTolerance);
+
+        Mutex::Autolock _l(mLock);
+        mReady.push_back(frame);
+        mCondition.broadcast();
+        return frame.err == M4NO_ERROR && mNext < mRequests.size();
+    }
+
+    M4OSA_Context           mContext;
+    M4OSA_UInt32            mWidth;
+    M4OSA_UInt32            mHeight;
+    M4OSA_UInt32            mTolerance;
+    Vector<Frame>           mRequests;
+    size_t                  mNext;
+    Vector<M4OSA_Int32*>    mBuffers;
+    Vector<M4OSA_Int32*>    mFree;
+    List<Frame>             mReady;
+    Mutex                   mLock;
+    Condition               mCondition;
+};
+
 static jint videoEditor_getPixelsList(
                 JNIEnv*                 env,
                 jobject                 thiz,
@@ -2278,21 +2398,37 @@ static jint videoEditor_getPixelsList(
     jclass cls = env->GetObjectClass(callback);
     jmethodID mid = env->GetMethodID(cls, "onThumbnail", "(I)V");
 
+    sp<ThumbnailPipeline> pipeline = new ThumbnailPipeline(mContext, width, height, tolerance);
     for (int i = 0; i < len; i++) {
         int k = indices[i];
         M4OSA_UInt32 timeMS = startTime;
         timeMS += (2 * k + 1) * duration / (2 * noOfThumbnails);
-        err = ThumbnailGetPixels32(mContext, ((M4OSA_Int32 *)m_dst32),
-            width, height, &timeMS, tolerance);
+        pipeline->addRequest(k, timeMS);
+    }
+
+    if (len > 0 && pipeline->start() != NO_ERROR) {
+        err = M4ERR_ALLOC;
+        len = 0;
+    }
+    for (int i = 0; i < len; i++) {
+        ThumbnailPipeline::Frame frame;
+        pipeline->dequeue(&frame);
+        err = frame.err;
+        if (err == M4NO_ERROR) {
+            memcpy(m_dst32, frame.pixels, width * height * sizeof(jint));
+        }
+        pipeline->release(frame.pixels);
         if (err != M4NO_ERROR) {
             break;
         }
-        env->CallVoidMethod(callback, mid, (jint)k);
+        env->CallVoidMethod(callback, mid, (jint)frame.index);
         if (env->ExceptionCheck()) {
             err = M4ERR_ALLOC;
             break;
         }
     }
+    // the pipeline uses the thumbnail context until it has stopped
+    pipeline->stop();
 
     env->ReleaseIntArrayElements(pixelArray, m_dst32, 0);
     env->ReleaseIntArrayElements(indexArray, indices, 0);
@@ -18,6 +18,11 @@
 #include <jni.h>
 #include <JNIHelp.h>
 #include <utils/Log.h>
+
+#if defined(__ARM_HAVE_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define THUMBNAIL_USE_NEON 1
+#endif
 #include "VideoBrowserMain.h"
 #include "VideoBrowserInternal.h"
 
@@ -40,6 +45,29 @@
 //                                RED                 GREEN               BLUE            ALPHA
 #define RGB565toSKCOLOR(c) ( (((c)&0xF800)>>8) | (((c)&0x7E0)<<5) | (((c)&0x1F)<<19) | 0xFF000000)
 
+/*
+ * Converts the leading pixels of a row with RGB565toSKCOLOR, 8 at a time, and
+ * returns how many it did.  The caller converts the rest one by one.
+ */
+static M4OSA_UInt32 RGB565toSKCOLOR_Row(M4OSA_Int32* dst, const M4OSA_UInt16* src,
+        M4OSA_UInt32 width)
+{
+    M4OSA_UInt32 i = 0;
+#if THUMBNAIL_USE_NEON
+    const uint8x8_t alpha = vdup_n_u8(0xFF);
+    for (; i + 8 <= width; i += 8) {
+        uint16x8_t c = vld1q_u16(src + i);
+        uint8x8x4_t rgba;
+        rgba.val[0] = vand_u8(vshrn_n_u16(c, 8), vdup_n_u8(0xF8));
+        rgba.val[1] = vand_u8(vshrn_n_u16(c, 3), vdup_n_u8(0xFC));
+        rgba.val[2] = vmovn_u16(vshlq_n_u16(c, 3));
+        rgba.val[3] = alpha;
+        vst4_u8((uint8_t*)(dst + i), rgba);
+    }
+#endif
+    return i;
+}
+
 #define GetIntField(env, obj, name) env->GetIntField(obj,\
 env->GetFieldID(env->GetObjectClass(obj), name, "I"))
 
@@ -69,12 +97,14 @@ typedef struct
  * @param    width      (IN)    Width of thumbnail
  * @param    height     (IN)    Height of thumbnail
  * @param    pTimeMS    (IN/OUT)Time stamp at which thumbnail is retrieved.
+ * @param    bInOrder   (IN)    true if the caller browses forward
  ************************************************************************
 */
 M4OSA_ERR ThumbnailGetPixels(const M4OSA_Context pContext,
                              M4OSA_Int32* pixelArray,
                              M4OSA_UInt32 width, M4OSA_UInt32 height,
-                             M4OSA_UInt32* pTimeMS, M4OSA_UInt32 tolerance);
+                             M4OSA_UInt32* pTimeMS, M4OSA_UInt32 tolerance,
+                             M4OSA_Bool bInOrder);
 
 
 /**
@@ -116,7 +146,7 @@ M4OSA_Void VBcallback(  M4OSA_Context  pInstance,
 
         for (j = 0; j < pPlane->u_height; j++)
         {
-            for (i = 0; i < pPlane->u_width; i++)
+            for (i = RGB565toSKCOLOR_Row(dst, src, pPlane->u_width); i < pPlane->u_width; i++)
             {
                 dst[i] = RGB565toSKCOLOR(src[i]);
             }
@@ -219,7 +249,8 @@ ThumbnailOpen_cleanUp:
 M4OSA_ERR ThumbnailGetPixels(const M4OSA_Context pContext,
                              M4OSA_Int32* pixelArray,
                              M4OSA_UInt32 width, M4OSA_UInt32 height,
-                             M4OSA_UInt32* pTimeMS, M4OSA_UInt32 tolerance)
+                             M4OSA_UInt32* pTimeMS, M4OSA_UInt32 tolerance,
+                             M4OSA_Bool bInOrder)
 {
     M4OSA_ERR err;
 
@@ -249,7 +280,11 @@ M4OSA_ERR ThumbnailGetPixels(const M4OSA_Context pContext,
         pC->m_previousTime = *pTimeMS;
     }
 
-    err = videoBrowserPrepareFrame(pC->m_pVideoBrowser, pTimeMS, tolerance);
+    if (bInOrder == M4OSA_TRUE) {
+        err = videoBrowserPrepareNextFrame(pC->m_pVideoBrowser, pTimeMS, tolerance);
+    } else {
+        err = videoBrowserPrepareFrame(pC->m_pVideoBrowser, pTimeMS, tolerance);
+    }
     CHECK_ERR(ThumbnailGetPixels, err);
 
     if (pC->m_bRender != M4OSA_TRUE) {
@@ -278,7 +313,8 @@ M4OSA_ERR ThumbnailGetPixels32(const M4OSA_Context pContext,
     pC->m_dst16 = NULL;
     pC->m_dst32 = pixelArray;
 
-    err = ThumbnailGetPixels(pContext, pixelArray, width, height, timeMS, tolerance);
+    err = ThumbnailGetPixels(pContext, pixelArray, width, height, timeMS, tolerance,
+            M4OSA_FALSE);
 
 ThumbnailGetPixels32_cleanUp:
 
@@ -301,13 +337,36 @@ M4OSA_ERR ThumbnailGetPixels16(const M4OSA_Context pContext,
     pC->m_dst32 = NULL;
 
     err = ThumbnailGetPixels(pContext, (M4OSA_Int32*)pixelArray, width, height,
-            timeMS, tolerance);
+            timeMS, tolerance, M4OSA_FALSE);
 
 ThumbnailGetPixels16_cleanUp:
 
     return err;
 }
 
+M4OSA_ERR ThumbnailGetNextPixels32(const M4OSA_Context pContext,
+                         M4OSA_Int32* pixelArray, M4OSA_UInt32 width,
+                         M4OSA_UInt32 height, M4OSA_UInt32* timeMS,
+                         M4OSA_UInt32 tolerance)
+{
+    M4OSA_ERR err = M4NO_ERROR;
+
+    ThumbnailContext* pC = (ThumbnailContext*)pContext;
+
+    CHECK_PTR(ThumbnailGetNextPixels32, pC->m_pVideoBrowser, err, M4ERR_ALLOC);
+    CHECK_PTR(ThumbnailGetNextPixels32, pixelArray, err, M4ERR_ALLOC);
+
+    pC->m_dst16 = NULL;
+    pC->m_dst32 = pixelArray;
+
+    err = ThumbnailGetPixels(pContext, pixelArray, width, height, timeMS, tolerance,
+            M4OSA_TRUE);
+
+ThumbnailGetNextPixels32_cleanUp:
+
+    return err;
+}
+
 
 void ThumbnailClose(const M4OSA_Context pContext)
 {
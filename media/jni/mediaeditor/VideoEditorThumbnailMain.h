@@ -52,6 +52,24 @@ M4OSA_ERR ThumbnailGetPixels32(const M4OSA_Context pContext,
                              M4OSA_UInt32 height, M4OSA_UInt32 *timeMS,
                              M4OSA_UInt32 tolerance);
 
+/**
+ ************************************************************************
+ * @brief    Same as ThumbnailGetPixels32, for callers asking for increasing
+ *           times.  The decoder only seeks when a sync frame lies between
+ *           the previous frame and the time asked for, and otherwise decodes
+ *           on from the previous frame.
+ * @param    pContext    (IN)    Thumbnail Context.
+ * @param    pixelArray  (OUT)   Pointer to array in which pixels data to return
+ * @param    width       (IN)    Width of thumbnail
+ * @param    height      (IN)    Height of thumbnail
+ * @param    timeMS      (IN/OUT)Time stamp at which thumbnail is retrieved.
+ ************************************************************************
+*/
+M4OSA_ERR ThumbnailGetNextPixels32(const M4OSA_Context pContext,
+                             M4OSA_Int32* pixelArray, M4OSA_UInt32 width,
+                             M4OSA_UInt32 height, M4OSA_UInt32 *timeMS,
+                             M4OSA_UInt32 tolerance);
+
 /**
  ************************************************************************
  * @brief    Interface to retrieve a RGB565 format thumbnail pixels
@@ -2,7 +2,8 @@ LOCAL_PATH:= $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES:= \
-	android_media_SoundPool_SoundPoolImpl.cpp
+	android_media_SoundPool_SoundPoolImpl.cpp \
+	SampleCache.cpp
 
 LOCAL_SHARED_LIBRARIES := \
 	liblog \
@@ -10,7 +11,9 @@ LOCAL_SHARED_LIBRARIES := \
 	libutils \
 	libandroid_runtime \
 	libnativehelper \
-	libmedia
+	libmedia \
+	libstagefright \
+	libstagefright_foundation
 
 LOCAL_MODULE:= libsoundpool
 
@@ -0,0 +1,373 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SoundPool-SampleCache"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cutils/ashmem.h>
+#include <utils/Log.h>
+#include <utils/Vector.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/AString.h>
+#include <media/stagefright/MediaCodec.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/NuMediaExtractor.h>
+
+#include "SampleCache.h"
+
+namespace android {
+
+// Codec calls poll with this timeout so a stalled decode can't wedge the thread
+static const int64_t kCodecTimeoutUs = 10000ll;
+static const int kMaxCodecRetries = 500;
+static const size_t kWavHeaderSize = 44;
+static const size_t kDefaultMaxSize = 16 * 1024 * 1024;
+
+static Mutex gInstanceLock;
+static sp<SampleCache> gInstance;
+
+sp<SampleCache> SampleCache::getInstance() {
+    Mutex::Autolock _l(gInstanceLock);
+    if (gInstance == NULL) {
+        gInstance = new SampleCache();
+    }
+    return gInstance;
+}
+
+SampleCache::SampleCache()
+    : Thread(false),
+      mSize(0),
+      mMaxSize(kDefaultMaxSize),
+      mStarted(false) {
+}
+
+SampleCache::~SampleCache() {
+    for (List<Entry>::iterator it = mEntries.begin(); it != mEntries.end(); ++it) {
+        close(it->fd);
+    }
+    for (List<Request>::iterator it = mRequests.begin(); it != mRequests.end(); ++it) {
+        close(it->fd);
+    }
+}
+
+bool SampleCache::makeKey(int fd, int64_t offset, int64_t length, String8* key) {
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    key->setTo(String8::format("%llu:%llu:%lld:%lld:%lld:%lld",
+            (unsigned long long) st.st_dev, (unsigned long long) st.st_ino,
+            (long long) st.st_mtime, (long long) st.st_size,
+            (long long) offset, (long long) length));
+    return true;
+}
+
+bool SampleCache::makeKey(const char* path, String8* key) {
+    struct stat st;
+    if (path == NULL || stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    key->setTo(String8::format("%llu:%llu:%lld:%lld:0:%lld",
+            (unsigned long long) st.st_dev, (unsigned long long) st.st_ino,
+            (long long) st.st_mtime, (long long) st.st_size,
+            (long long) st.st_size));
+    return true;
+}
+
+int SampleCache::acquire(const String8& key, int fd, int64_t offset, int64_t length,
+        int64_t* size) {
+    Mutex::Autolock _l(mLock);
+
+    for (List<Entry>::iterator it = mEntries.begin(); it != mEntries.end(); ++it) {
+        if (it->key == key) {
+            Entry entry = *it;
+            mEntries.erase(it);
+            mEntries.push_front(entry);
+            *size = entry.size;
+            ALOGV("hit %s", key.string());
+            return dup(entry.fd);
+        }
+    }
+
+    if (mMaxSize == 0 || isQueued_l(key)) {
+        return -1;
+    }
+
+    Request request;
+    request.key = key;
+    request.fd = dup(fd);
+    request.offset = offset;
+    request.length = length;
+    if (request.fd < 0) {
+        return -1;
+    }
+    mRequests.push_back(request);
+
+    if (!mStarted) {
+        mStarted = run("SoundPoolSampleCache", PRIORITY_BACKGROUND) == OK;
+    }
+    mCondition.signal();
+    return -1;
+}
+
+void SampleCache::setMaxSize(size_t maxSize) {
+    Mutex::Autolock _l(mLock);
+    mMaxSize = maxSize;
+    trim_l();
+}
+
+bool SampleCache::isQueued_l(const String8& key) const {
+    if (mDecoding == key) {
+        return true;
+    }
+    for (List<Request>::const_iterator it = mRequests.begin(); it != mRequests.end(); ++it) {
+        if (it->key == key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SampleCache::trim_l() {
+    while (mSize > mMaxSize && !mEntries.empty()) {
+        List<Entry>::iterator last = --mEntries.end();
+        // Pools that loaded from it hold their own dup
+        close(last->fd);
+        mSize -= last->size;
+        mEntries.erase(last);
+    }
+}
+
+bool SampleCache::threadLoop() {
+    Request request;
+    {
+        Mutex::Autolock _l(mLock);
+        while (mRequests.empty()) {
+            mCondition.wait(mLock);
+        }
+        request = *mRequests.begin();
+        mRequests.erase(mRequests.begin());
+        mDecoding = request.key;
+    }
+
+    size_t size = 0;
+    int fd = decode(request, &size);
+    close(request.fd);
+
+    Mutex::Autolock _l(mLock);
+    mDecoding.clear();
+    if (fd >= 0) {
+        if (size > mMaxSize) {
+            close(fd);
+        } else {
+            Entry entry;
+            entry.key = request.key;
+            entry.fd = fd;
+            entry.size = size;
+            mEntries.push_front(entry);
+            mSize += size;
+            trim_l();
+        }
+    }
+    return true;
+}
+
+static void writeLE16(uint8_t* p, uint16_t value) {
+    p[0] = value & 0xff;
+    p[1] = value >> 8;
+}
+
+static void writeLE32(uint8_t* p, uint32_t value) {
+    writeLE16(p, value & 0xffff);
+    writeLE16(p + 2, value >> 16);
+}
+
+static void writeWavHeader(uint8_t* p, size_t dataSize, int32_t sampleRate,
+        int32_t channelCount) {
+    memcpy(p, "RIFF", 4);
+    writeLE32(p + 4, 36 + dataSize);
+    memcpy(p + 8, "WAVEfmt ", 8);
+    writeLE32(p + 16, 16);
+    writeLE16(p + 20, 1);   // PCM
+    writeLE16(p + 22, channelCount);
+    writeLE32(p + 24, sampleRate);
+    writeLE32(p + 28, sampleRate * channelCount * 2);
+    writeLE16(p + 32, channelCount * 2);
+    writeLE16(p + 34, 16);
+    memcpy(p + 36, "data", 4);
+    writeLE32(p + 40, dataSize);
+}
+
+int SampleCache::decode(const Request& request, size_t* size) {
+    sp<NuMediaExtractor> extractor = new NuMediaExtractor;
+    if (extractor->setDataSource(request.fd, request.offset, request.length) != OK) {
+        return -1;
+    }
+
+    sp<AMessage> format;
+    AString mime;
+    size_t track;
+    for (track = 0; track < extractor->countTracks(); track++) {
+        if (extractor->getTrackFormat(track, &format) == OK
+                && format->findString("mime", &mime)
+                && !strncasecmp(mime.c_str(), "audio/", 6)) {
+            break;
+        }
+    }
+    if (track == extractor->countTracks() || extractor->selectTrack(track) != OK) {
+        return -1;
+    }
+
+    sp<ALooper> looper = new ALooper;
+    looper->setName("SampleCache_looper");
+    looper->start();
+
+    sp<MediaCodec> codec = MediaCodec::CreateByType(looper, mime.c_str(), false);
+    if (codec == NULL) {
+        return -1;
+    }
+
+    // Room for the header up front; PCM is appended after it
+    uint8_t* data = (uint8_t*) malloc(kWavHeaderSize);
+    if (data == NULL) {
+        codec->release();
+        return -1;
+    }
+    size_t dataSize = 0;
+    size_t capacity = kWavHeaderSize;
+    int32_t sampleRate = 0;
+    int32_t channelCount = 0;
+    format->findInt32("sample-rate", &sampleRate);
+    format->findInt32("channel-count", &channelCount);
+
+    Vector<sp<ABuffer> > inputBuffers, outputBuffers;
+    status_t err;
+    if ((err = codec->configure(format, NULL, NULL, 0)) != OK
+            || (err = codec->start()) != OK
+            || (err = codec->getInputBuffers(&inputBuffers)) != OK
+            || (err = codec->getOutputBuffers(&outputBuffers)) != OK) {
+        codec->release();
+        free(data);
+        return -1;
+    }
+
+    bool inputDone = false;
+    bool outputDone = false;
+    int idle = 0;
+    while (err == OK && !outputDone && idle < kMaxCodecRetries) {
+        bool progress = false;
+        size_t index;
+        if (!inputDone && codec->dequeueInputBuffer(&index, kCodecTimeoutUs) == OK) {
+            const sp<ABuffer>& buffer = inputBuffers[index];
+            int64_t timeUs = 0;
+            buffer->setRange(0, buffer->capacity());
+            if (extractor->readSampleData(buffer) != OK
+                    || extractor->getSampleTime(&timeUs) != OK) {
+                err = codec->queueInputBuffer(index, 0, 0, 0, MediaCodec::BUFFER_FLAG_EOS);
+                inputDone = true;
+            } else {
+                err = codec->queueInputBuffer(index, 0, buffer->size(), timeUs, 0);
+                extractor->advance();
+            }
+            progress = true;
+        }
+
+        size_t offset, outSize;
+        int64_t timeUs;
+        uint32_t flags;
+        status_t res = codec->dequeueOutputBuffer(&index, &offset, &outSize, &timeUs, &flags,
+                kCodecTimeoutUs);
+        if (res == OK) {
+            if (kWavHeaderSize + dataSize + outSize > kMaxEntrySize) {
+                codec->releaseOutputBuffer(index);
+                err = ERROR_BUFFER_TOO_SMALL;
+                break;
+            }
+            if (kWavHeaderSize + dataSize + outSize > capacity) {
+                size_t newCapacity = (kWavHeaderSize + dataSize + outSize) * 2;
+                // data is left untouched on failure and freed below
+                uint8_t* newData = (uint8_t*) realloc(data, newCapacity);
+                if (newData == NULL) {
+                    codec->releaseOutputBuffer(index);
+                    err = NO_MEMORY;
+                    break;
+                }
+                data = newData;
+                capacity = newCapacity;
+            }
+            memcpy(data + kWavHeaderSize + dataSize, outputBuffers[index]->base() + offset,
+                    outSize);
+            dataSize += outSize;
+            codec->releaseOutputBuffer(index);
+            outputDone = (flags & MediaCodec::BUFFER_FLAG_EOS) != 0;
+            progress = true;
+        } else if (res == INFO_OUTPUT_BUFFERS_CHANGED) {
+            codec->getOutputBuffers(&outputBuffers);
+            progress = true;
+        } else if (res == INFO_FORMAT_CHANGED) {
+            sp<AMessage> outputFormat;
+            if (codec->getOutputFormat(&outputFormat) == OK) {
+                outputFormat->findInt32("sample-rate", &sampleRate);
+                outputFormat->findInt32("channel-count", &channelCount);
+            }
+            progress = true;
+        } else if (res != -EAGAIN) {
+            err = res;
+        }
+        idle = progress ? 0 : idle + 1;
+    }
+    codec->release();
+    looper->stop();
+
+    if (err != OK || !outputDone || dataSize == 0 || sampleRate <= 0
+            || channelCount <= 0 || channelCount > 2) {
+        ALOGV("decoding %s failed: %d", request.key.string(), err);
+        free(data);
+        return -1;
+    }
+
+    *size = kWavHeaderSize + dataSize;
+    int fd = ashmem_create_region("SoundPoolSample", *size);
+    if (fd < 0) {
+        free(data);
+        return -1;
+    }
+    void* region = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (region == MAP_FAILED) {
+        close(fd);
+        free(data);
+        return -1;
+    }
+    writeWavHeader(data, dataSize, sampleRate, channelCount);
+    memcpy(region, data, *size);
+    munmap(region, *size);
+    free(data);
+
+    // Readers only ever get a read-only view
+    ashmem_set_prot_region(fd, PROT_READ);
+    ALOGV("cached %s: %d bytes", request.key.string(), (int) *size);
+    return fd;
+}
+
+}; // namespace android
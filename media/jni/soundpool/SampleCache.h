@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SOUNDPOOL_SAMPLE_CACHE_H
+#define ANDROID_SOUNDPOOL_SAMPLE_CACHE_H
+
+#include <utils/List.h>
+#include <utils/StrongPointer.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
+
+namespace android {
+
+/*
+ * Process wide cache of decoded samples, shared by every SoundPool.
+ *
+ * Each entry is an ashmem region holding the decoded PCM wrapped in a WAV
+ * header, so that SoundPool::load() can read it back from a file descriptor
+ * without running a decoder again. Entries outlive the pools that loaded
+ * them and, being ashmem, the descriptors can be handed to other processes.
+ *
+ * A miss never blocks the caller: the sample is loaded from its original
+ * source as before and decoded into the cache on a background thread, so
+ * only later loads of the same source benefit.
+ */
+class SampleCache : public Thread {
+public:
+    static sp<SampleCache> getInstance();
+
+    // Identifies a source by file identity, so renamed or reopened files
+    // still hit. Returns false if the source can't be identified.
+    static bool makeKey(int fd, int64_t offset, int64_t length, String8* key);
+    static bool makeKey(const char* path, String8* key);
+
+    // Returns a dup of the cached region's fd and its size, or -1 on a miss.
+    // On a miss the source is queued for decoding; fd is duplicated so the
+    // caller may close it.
+    int acquire(const String8& key, int fd, int64_t offset, int64_t length,
+            int64_t* size);
+
+    void setMaxSize(size_t maxSize);
+
+private:
+    struct Entry {
+        String8 key;
+        int fd;
+        size_t size;
+    };
+
+    struct Request {
+        String8 key;
+        int fd;
+        int64_t offset;
+        int64_t length;
+    };
+
+    // Decoded samples larger than this are not worth keeping around
+    static const size_t kMaxEntrySize = 4 * 1024 * 1024;
+
+    SampleCache();
+    virtual ~SampleCache();
+
+    virtual bool threadLoop();
+
+    // Decodes the request into a new ashmem region; returns its fd or -1
+    static int decode(const Request& request, size_t* size);
+
+    bool isQueued_l(const String8& key) const;
+    void trim_l();
+
+    Mutex mLock;
+    Condition mCondition;
+    // Most recently used first
+    List<Entry> mEntries;
+    List<Request> mRequests;
+    String8 mDecoding;
+    size_t mSize;
+    size_t mMaxSize;
+    bool mStarted;
+};
+
+}; // namespace android
+
+#endif // ANDROID_SOUNDPOOL_SAMPLE_CACHE_H
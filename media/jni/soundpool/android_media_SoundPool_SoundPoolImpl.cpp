@@ -14,7 +14,10 @@
  * limitations under the License.
  */
 
+#include <fcntl.h>
 #include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 //#define LOG_NDEBUG 0
 #define LOG_TAG "SoundPool-JNI"
@@ -25,6 +28,8 @@
 #include <android_runtime/AndroidRuntime.h>
 #include <media/SoundPool.h>
 
+#include "SampleCache.h"
+
 using namespace android;
 
 static struct fields_t {
@@ -48,11 +53,48 @@ android_media_SoundPool_SoundPoolImpl_load_URL(JNIEnv *env, jobject thiz, jstrin
         return 0;
     }
     const char* s = env->GetStringUTFChars(path, NULL);
-    int id = ap->load(s, priority);
+    int id;
+
+    // Local files go through the decoded sample cache, keyed like fd loads
+    String8 key;
+    int cachedFd = -1;
+    int64_t cachedSize;
+    if (SampleCache::makeKey(s, &key)) {
+        int fd = open(s, O_RDONLY);
+        if (fd >= 0) {
+            struct stat st;
+            int64_t length = fstat(fd, &st) == 0 ? st.st_size : 0;
+            cachedFd = SampleCache::getInstance()->acquire(key, fd, 0, length, &cachedSize);
+            close(fd);
+        }
+    }
+    if (cachedFd >= 0) {
+        id = ap->load(cachedFd, 0, cachedSize, priority);
+        close(cachedFd);
+    } else {
+        id = ap->load(s, priority);
+    }
     env->ReleaseStringUTFChars(path, s);
     return (jint) id;
 }
 
+static int loadFromFd(SoundPool *ap, int fd, int64_t offset, int64_t length, int priority)
+{
+    String8 key;
+    int64_t cachedSize;
+    int cachedFd = -1;
+    if (SampleCache::makeKey(fd, offset, length, &key)) {
+        cachedFd = SampleCache::getInstance()->acquire(key, fd, offset, length, &cachedSize);
+    }
+    if (cachedFd < 0) {
+        return ap->load(fd, offset, length, priority);
+    }
+    // SoundPool keeps its own dup of the descriptor
+    int id = ap->load(cachedFd, 0, cachedSize, priority);
+    close(cachedFd);
+    return id;
+}
+
 static jint
 android_media_SoundPool_SoundPoolImpl_load_FD(JNIEnv *env, jobject thiz, jobject fileDescriptor,
         jlong offset, jlong length, jint priority)
@@ -60,10 +102,64 @@ android_media_SoundPool_SoundPoolImpl_load_FD(JNIEnv *env, jobject thiz, jobject
     ALOGV("android_media_SoundPool_SoundPoolImpl_load_FD");
     SoundPool *ap = MusterSoundPool(env, thiz);
     if (ap == NULL) return 0;
-    return (jint) ap->load(jniGetFDFromFileDescriptor(env, fileDescriptor),
+    return (jint) loadFromFd(ap, jniGetFDFromFileDescriptor(env, fileDescriptor),
             int64_t(offset), int64_t(length), int(priority));
 }
 
+static jintArray
+android_media_SoundPool_SoundPoolImpl_loadAll(JNIEnv *env, jobject thiz,
+        jobjectArray fileDescriptors, jlongArray offsets, jlongArray lengths, jint priority)
+{
+    ALOGV("android_media_SoundPool_SoundPoolImpl_loadAll");
+    SoundPool *ap = MusterSoundPool(env, thiz);
+    if (ap == NULL) return NULL;
+    if (fileDescriptors == NULL || offsets == NULL || lengths == NULL) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return NULL;
+    }
+    jsize count = env->GetArrayLength(fileDescriptors);
+    if (env->GetArrayLength(offsets) != count || env->GetArrayLength(lengths) != count) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return NULL;
+    }
+
+    jintArray ids = env->NewIntArray(count);
+    if (ids == NULL) {
+        return NULL;
+    }
+    jlong *offsetArray = env->GetLongArrayElements(offsets, NULL);
+    jlong *lengthArray = env->GetLongArrayElements(lengths, NULL);
+    jint *idArray = env->GetIntArrayElements(ids, NULL);
+    if (offsetArray != NULL && lengthArray != NULL && idArray != NULL) {
+        for (jsize i = 0; i < count; i++) {
+            jobject fileDescriptor = env->GetObjectArrayElement(fileDescriptors, i);
+            int fd = fileDescriptor != NULL
+                    ? jniGetFDFromFileDescriptor(env, fileDescriptor) : -1;
+            idArray[i] = fd >= 0
+                    ? loadFromFd(ap, fd, offsetArray[i], lengthArray[i], priority) : 0;
+            env->DeleteLocalRef(fileDescriptor);
+        }
+    }
+    if (idArray != NULL) {
+        env->ReleaseIntArrayElements(ids, idArray, 0);
+    }
+    if (lengthArray != NULL) {
+        env->ReleaseLongArrayElements(lengths, lengthArray, JNI_ABORT);
+    }
+    if (offsetArray != NULL) {
+        env->ReleaseLongArrayElements(offsets, offsetArray, JNI_ABORT);
+    }
+    return ids;
+}
+
+static void
+android_media_SoundPool_SoundPoolImpl_setSampleCacheSize(JNIEnv *env, jclass clazz,
+        jint maxBytes)
+{
+    ALOGV("android_media_SoundPool_SoundPoolImpl_setSampleCacheSize");
+    SampleCache::getInstance()->setMaxSize(maxBytes > 0 ? maxBytes : 0);
+}
+
 static jboolean
 android_media_SoundPool_SoundPoolImpl_unload(JNIEnv *env, jobject thiz, jint sampleID) {
     ALOGV("android_media_SoundPool_SoundPoolImpl_unload\n");
@@ -225,6 +321,14 @@ static JNINativeMethod gMethods[] = {
         "(Ljava/io/FileDescriptor;JJI)I",
         (void *)android_media_SoundPool_SoundPoolImpl_load_FD
     },
+    {   "_loadAll",
+        "([Ljava/io/FileDescriptor;[J[JI)[I",
+        (void *)android_media_SoundPool_SoundPoolImpl_loadAll
+    },
+    {   "native_setSampleCacheSize",
+        "(I)V",
+        (void *)android_media_SoundPool_SoundPoolImpl_setSampleCacheSize
+    },
     {   "unload",
         "(I)Z",
         (void *)android_media_SoundPool_SoundPoolImpl_unload
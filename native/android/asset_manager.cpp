@@ -22,6 +22,9 @@
 #include <androidfw/AssetDir.h>
 #include <androidfw/AssetManager.h>
 #include <utils/threads.h>
+#include <utils/Vector.h>
+
+#include <stdlib.h>
 
 #include "jni.h"
 #include "JNIHelp.h"
@@ -47,9 +50,16 @@ struct AAssetDir {
 // -----
 struct AAsset {
     Asset* mAsset;
+    // Ranges that had to be inflated for AAsset_mapRange()
+    Vector<void*> mRanges;
 
     AAsset(Asset* asset) : mAsset(asset) { }
-    ~AAsset() { delete mAsset; }
+    ~AAsset() {
+        for (size_t i = 0; i < mRanges.size(); i++) {
+            free(mRanges[i]);
+        }
+        delete mAsset;
+    }
 };
 
 // -------------------- Public native C API --------------------
@@ -234,3 +244,60 @@ int AAsset_isAllocated(AAsset* asset)
 {
     return asset->mAsset->isAllocated() ? 1 : 0;
 }
+
+const void* AAsset_mapRange(AAsset* asset, off64_t offset, size_t length)
+{
+    Asset* a = asset->mAsset;
+    if (offset < 0 || offset > a->getLength() || (off64_t) length > a->getLength() - offset) {
+        return NULL;
+    }
+
+    // Stored entries and already inflated ones are handed out in place
+    const void* data = a->getRange(offset, length);
+    if (data != NULL) {
+        return data;
+    }
+
+    // Otherwise inflate just this range rather than the whole asset
+    void* buf = malloc(length > 0 ? length : 1);
+    if (buf == NULL) {
+        return NULL;
+    }
+    off64_t position = a->seek(0, SEEK_CUR);
+    size_t done = 0;
+    if (a->seek(offset, SEEK_SET) == offset) {
+        while (done < length) {
+            ssize_t actual = a->read((char*) buf + done, length - done);
+            if (actual <= 0) {
+                break;
+            }
+            done += actual;
+        }
+    }
+    a->seek(position, SEEK_SET);
+    if (done < length) {
+        ALOGW("failed to read %u bytes at %lld from asset", (unsigned) length,
+                (long long) offset);
+        free(buf);
+        return NULL;
+    }
+    asset->mRanges.add(buf);
+    return buf;
+}
+
+void AAsset_unmapRange(AAsset* asset, const void* data)
+{
+    // Mapped ranges belong to the asset and go away with it
+    for (size_t i = 0; i < asset->mRanges.size(); i++) {
+        if (asset->mRanges[i] == data) {
+            free(asset->mRanges[i]);
+            asset->mRanges.removeAt(i);
+            return;
+        }
+    }
+}
+
+void AAsset_prefetch(AAsset* asset, off64_t offset, size_t length)
+{
+    asset->mAsset->prefetch(offset, length);
+}
@@ -35,6 +35,18 @@ AObbInfo* AObbScanner_getObbInfo(const char* filename) {
     return static_cast<AObbInfo*>(obbFile);
 }
 
+size_t AObbScanner_getObbInfos(const char* const* filenames, size_t count,
+        AObbInfo** obbInfos) {
+    size_t found = 0;
+    for (size_t i = 0; i < count; i++) {
+        obbInfos[i] = AObbScanner_getObbInfo(filenames[i]);
+        if (obbInfos[i] != NULL) {
+            found++;
+        }
+    }
+    return found;
+}
+
 void AObbInfo_delete(AObbInfo* obbInfo) {
     if (obbInfo != NULL) {
         obbInfo->decStrong((void*)AObbScanner_getObbInfo);
@@ -20,6 +20,8 @@
 #include <android/looper.h>
 #include <android/sensor.h>
 
+#include <cutils/atomic.h>
+
 #include <utils/RefBase.h>
 #include <utils/Looper.h>
 #include <utils/Timers.h>
@@ -102,6 +104,20 @@ int ASensorEventQueue_setEventRate(ASensorEventQueue* queue, ASensor const* sens
             static_cast<Sensor const*>(sensor), us2ns(usec));
 }
 
+int ASensorEventQueue_registerSensor(ASensorEventQueue* queue, ASensor const* sensor,
+        int32_t samplingPeriodUs, int64_t maxBatchReportLatencyUs)
+{
+    if (samplingPeriodUs < 0 || maxBatchReportLatencyUs < 0
+            || maxBatchReportLatencyUs > INT32_MAX) {
+        return -EINVAL;
+    }
+    // A non-zero latency lets the HAL hold events in its FIFO and deliver
+    // them in one go, so the caller wakes up once per batch
+    return static_cast<SensorEventQueue*>(queue)->enableSensor(
+            static_cast<Sensor const*>(sensor)->getHandle(), samplingPeriodUs,
+            int(maxBatchReportLatencyUs), 0);
+}
+
 int ASensorEventQueue_hasEvents(ASensorEventQueue* queue)
 {
     struct pollfd pfd;
@@ -126,6 +142,56 @@ ssize_t ASensorEventQueue_getEvents(ASensorEventQueue* queue,
     return static_cast<SensorEventQueue*>(queue)->read(events, count);
 }
 
+/*
+ * Drains the queue into a single producer, single consumer ring owned by the
+ * caller. writeIndex and readIndex are free running event counts that wrap
+ * around at 2^32, so capacity must be a power of two for slot i of the ring,
+ * i & (capacity - 1), to stay in step across the wrap. The new writeIndex is published with release
+ * semantics after the events are in place, so another thread can consume
+ * from the ring without a lock. Returns the number of events added, or a
+ * negative error.
+ */
+ssize_t ASensorEventQueue_getEventsIntoRing(ASensorEventQueue* inQueue,
+        ASensorEvent* ring, size_t capacity,
+        volatile int32_t* writeIndex, volatile int32_t* readIndex)
+{
+    if (ring == NULL || capacity == 0 || capacity > INT32_MAX
+            || (capacity & (capacity - 1)) != 0
+            || writeIndex == NULL || readIndex == NULL) {
+        return -EINVAL;
+    }
+    SensorEventQueue* queue = static_cast<SensorEventQueue*>(inQueue);
+
+    uint32_t write = uint32_t(*writeIndex);
+    ssize_t total = 0;
+    for (;;) {
+        uint32_t read = uint32_t(android_atomic_acquire_load(readIndex));
+        size_t space = capacity - size_t(write - read);
+        if (space == 0) {
+            break;
+        }
+        // Up to the end of the ring; the next pass wraps around
+        size_t slot = write & (capacity - 1);
+        size_t count = capacity - slot < space ? capacity - slot : space;
+
+        ssize_t n = queue->read(ring + slot, count);
+        if (n <= 0) {
+            if (n < 0 && n != -EAGAIN && total == 0) {
+                return n;
+            }
+            break;
+        }
+        write += uint32_t(n);
+        total += n;
+        android_atomic_release_store(int32_t(write), writeIndex);
+        if (size_t(n) < count) {
+            // The queue is drained
+            break;
+        }
+    }
+    return total;
+}
+
 
 /*****************************************************************************/
 
@@ -197,6 +197,18 @@ int AStorageManager_isObbMounted(AStorageManager* mgr, const char* filename) {
     return mgr->isObbMounted(filename) != 0;
 }
 
+size_t AStorageManager_areObbsMounted(AStorageManager* mgr, const char* const* filenames,
+        size_t count, int* mounted) {
+    size_t found = 0;
+    for (size_t i = 0; i < count; i++) {
+        mounted[i] = mgr->isObbMounted(filenames[i]) != 0;
+        if (mounted[i]) {
+            found++;
+        }
+    }
+    return found;
+}
+
 const char* AStorageManager_getMountedObbPath(AStorageManager* mgr, const char* filename) {
     return mgr->getMountedObbPath(filename);
 }
@@ -16,8 +16,12 @@
 
 #define LOG_TAG "PacProcessor"
 
+#include <utils/Condition.h>
+#include <utils/KeyedVector.h>
 #include <utils/Log.h>
 #include <utils/Mutex.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
 #include "android_runtime/AndroidRuntime.h"
 
 #include "jni.h"
@@ -42,9 +46,136 @@ public:
     }
 };
 
-net::ProxyResolverV8* proxyResolver = NULL;
-ProxyErrorLogger* logger = NULL;
-bool pacSet = false;
+// Each resolver runs in its own V8 context, so up to this many requests can
+// be evaluated at once; the JS bindings drop the V8 lock around DNS lookups,
+// which is where PAC evaluation spends its time.
+static const size_t kMaxResolvers = 4;
+// Results depend on network state (myIpAddress, dnsResolve), so keep them
+// only briefly.
+static const nsecs_t kResultTimeout = s2ns(30);
+static const size_t kMaxCachedResults = 256;
+
+struct Resolver {
+    net::ProxyResolverV8* resolver;
+    ProxyErrorLogger* logger;
+    uint32_t scriptHash;    // hash of the script loaded into this context
+    String16 script;
+};
+
+struct CachedResult {
+    String16 proxy;
+    nsecs_t time;
+};
+
+static Mutex gLock;
+static Condition gResolverAvailable;
+static Vector<Resolver*> gFreeResolvers;
+static size_t gResolverCount = 0;
+static bool gStarted = false;
+
+static bool pacSet = false;
+static String16 gScript;
+static uint32_t gScriptHash = 0;
+// Keyed by url and host; cleared whenever the script changes.
+static KeyedVector<String16, CachedResult> gResults;
+
+static uint32_t hashScript(const String16& script) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    const char16_t* str = script.string();
+    for (size_t i = 0; i < script.size(); i++) {
+        hash = (hash ^ str[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static Resolver* createResolver() {
+    Resolver* r = new Resolver();
+    r->logger = new ProxyErrorLogger();
+    r->resolver = new net::ProxyResolverV8(net::ProxyResolverJSBindings::CreateDefault(),
+            r->logger);
+    r->scriptHash = 0;
+    return r;
+}
+
+static void destroyResolver(Resolver* r) {
+    delete r->resolver;
+    delete r->logger;
+    delete r;
+}
+
+// Blocks until a resolver is free or another one may be created. Returns
+// NULL if the parser is shut down.
+static Resolver* acquireResolver() {
+    Mutex::Autolock _l(gLock);
+    while (gStarted && gFreeResolvers.isEmpty() && gResolverCount >= kMaxResolvers) {
+        gResolverAvailable.wait(gLock);
+    }
+    if (!gStarted) {
+        return NULL;
+    }
+    if (!gFreeResolvers.isEmpty()) {
+        Resolver* r = gFreeResolvers.top();
+        gFreeResolvers.pop();
+        return r;
+    }
+    gResolverCount++;
+    return createResolver();
+}
+
+static void releaseResolver(Resolver* r) {
+    Mutex::Autolock _l(gLock);
+    if (gStarted) {
+        gFreeResolvers.push(r);
+    } else {
+        destroyResolver(r);
+        gResolverCount--;
+    }
+    gResolverAvailable.signal();
+}
+
+// Loads script into the resolver unless it already holds an identical one,
+// in which case the compiled context is reused as is.
+static bool loadScript(Resolver* r, const String16& script, uint32_t hash) {
+    if (r->scriptHash == hash && r->script == script) {
+        return true;
+    }
+    r->scriptHash = 0;
+    r->script = String16();
+    if (r->resolver->SetPacScript(script) != OK) {
+        return false;
+    }
+    r->scriptHash = hash;
+    r->script = script;
+    return true;
+}
+
+static String16 makeResultKey(const String16& url, const String16& host) {
+    String16 key(url);
+    key.append(String16("\n"));
+    key.append(host);
+    return key;
+}
+
+static void cacheResult_l(const String16& key, const String16& proxy, nsecs_t now) {
+    if (gResults.size() >= kMaxCachedResults) {
+        size_t oldest = 0;
+        for (size_t i = gResults.size(); i > 0; i--) {
+            if (now - gResults.valueAt(i - 1).time > kResultTimeout) {
+                gResults.removeItemsAt(i - 1);
+            } else if (gResults.valueAt(i - 1).time < gResults.valueAt(oldest).time) {
+                oldest = i - 1;
+            }
+        }
+        if (gResults.size() >= kMaxCachedResults) {
+            gResults.removeItemsAt(oldest);
+        }
+    }
+    CachedResult result;
+    result.proxy = proxy;
+    result.time = now;
+    gResults.add(key, result);
+}
 
 String16 jstringToString16(JNIEnv* env, jstring jstr) {
     const jchar* str = env->GetStringCritical(jstr, 0);
@@ -62,11 +193,15 @@ jstring string16ToJstring(JNIEnv* env, String16 string) {
 
 static jboolean com_android_pacprocessor_PacNative_createV8ParserNativeLocked(JNIEnv* env, 
         jobject) {
-    if (proxyResolver == NULL) {
-        logger = new ProxyErrorLogger();
-        proxyResolver = new net::ProxyResolverV8(net::ProxyResolverJSBindings::CreateDefault(),
-                logger);
+    Mutex::Autolock _l(gLock);
+    if (!gStarted) {
+        gStarted = true;
+        gFreeResolvers.push(createResolver());
+        gResolverCount++;
         pacSet = false;
+        gScript = String16();
+        gScriptHash = 0;
+        gResults.clear();
         return JNI_FALSE;
     }
     return JNI_TRUE;
@@ -74,11 +209,17 @@ static jboolean com_android_pacprocessor_PacNative_createV8ParserNativeLocked(JN
 
 static jboolean com_android_pacprocessor_PacNative_destroyV8ParserNativeLocked(JNIEnv* env, 
         jobject) {
-    if (proxyResolver != NULL) {
-        delete logger;
-        delete proxyResolver;
-        logger = NULL;
-        proxyResolver = NULL;
+    Mutex::Autolock _l(gLock);
+    if (gStarted) {
+        // Resolvers still evaluating are destroyed when they are released
+        gStarted = false;
+        while (!gFreeResolvers.isEmpty()) {
+            destroyResolver(gFreeResolvers.top());
+            gFreeResolvers.pop();
+            gResolverCount--;
+        }
+        gResults.clear();
+        gResolverAvailable.broadcast();
         return JNI_FALSE;
     }
     return JNI_TRUE;
@@ -87,43 +228,104 @@ static jboolean com_android_pacprocessor_PacNative_destroyV8ParserNativeLocked(J
 static jboolean com_android_pacprocessor_PacNative_setProxyScriptNativeLocked(JNIEnv* env, jobject,
         jstring script) {
     String16 script16 = jstringToString16(env, script);
+    uint32_t hash = hashScript(script16);
+
+    {
+        Mutex::Autolock _l(gLock);
+        if (!gStarted) {
+            ALOGE("V8 Parser not started when setting PAC script");
+            return JNI_TRUE;
+        }
+        if (pacSet && gScriptHash == hash && gScript == script16) {
+            ALOGV("PAC script unchanged");
+            return JNI_FALSE;
+        }
+    }
 
-    if (proxyResolver == NULL) {
+    // Compile once up front so a bad script is reported here; the other
+    // resolvers pick it up the next time they are used.
+    Resolver* r = acquireResolver();
+    if (r == NULL) {
         ALOGE("V8 Parser not started when setting PAC script");
         return JNI_TRUE;
     }
-
-    if (proxyResolver->SetPacScript(script16) != OK) {
+    bool loaded = loadScript(r, script16, hash);
+    releaseResolver(r);
+    if (!loaded) {
         ALOGE("Unable to set PAC script");
         return JNI_TRUE;
     }
+
+    Mutex::Autolock _l(gLock);
+    gScript = script16;
+    gScriptHash = hash;
+    gResults.clear();
     pacSet = true;
 
     return JNI_FALSE;
 }
 
+/*
+ * Safe to call concurrently; makeProxyRequestNative is the same entry point
+ * without the Java-side lock.
+ */
 static jstring com_android_pacprocessor_PacNative_makeProxyRequestNativeLocked(JNIEnv* env, jobject,
         jstring url, jstring host) {
     String16 url16 = jstringToString16(env, url);
     String16 host16 = jstringToString16(env, host);
+    String16 key = makeResultKey(url16, host16);
+    String16 script;
+    uint32_t hash;
     String16 ret;
 
-    if (proxyResolver == NULL) {
+    {
+        Mutex::Autolock _l(gLock);
+        if (!gStarted) {
+            ALOGE("V8 Parser not initialized when running PAC script");
+            return NULL;
+        }
+        if (!pacSet) {
+            ALOGW("Attempting to run PAC with no script set");
+            return NULL;
+        }
+        ssize_t index = gResults.indexOfKey(key);
+        if (index >= 0) {
+            const CachedResult& cached = gResults.valueAt(index);
+            if (systemTime(SYSTEM_TIME_MONOTONIC) - cached.time <= kResultTimeout) {
+                return string16ToJstring(env, cached.proxy);
+            }
+            gResults.removeItemsAt(index);
+        }
+        script = gScript;
+        hash = gScriptHash;
+    }
+
+    Resolver* r = acquireResolver();
+    if (r == NULL) {
         ALOGE("V8 Parser not initialized when running PAC script");
         return NULL;
     }
-
-    if (!pacSet) {
-        ALOGW("Attempting to run PAC with no script set");
+    if (!loadScript(r, script, hash)) {
+        releaseResolver(r);
+        ALOGE("Unable to set PAC script");
         return NULL;
     }
+    status_t err = r->resolver->GetProxyForURL(url16, host16, &ret);
+    releaseResolver(r);
 
-    if (proxyResolver->GetProxyForURL(url16, host16, &ret) != OK) {
+    if (err != OK) {
         String8 ret8(ret);
         ALOGE("Error Running PAC: %s", ret8.string());
         return NULL;
     }
 
+    {
+        Mutex::Autolock _l(gLock);
+        if (gStarted && gScriptHash == hash) {
+            cacheResult_l(key, ret, systemTime(SYSTEM_TIME_MONOTONIC));
+        }
+    }
+
     jstring jret = string16ToJstring(env, ret);
 
     return jret;
@@ -138,6 +340,8 @@ static JNINativeMethod gMethods[] = {
         (void*)com_android_pacprocessor_PacNative_setProxyScriptNativeLocked},
     { "makeProxyRequestNativeLocked", "(Ljava/lang/String;Ljava/lang/String;)Ljava/lang/String;",
         (void*)com_android_pacprocessor_PacNative_makeProxyRequestNativeLocked},
+    { "makeProxyRequestNative", "(Ljava/lang/String;Ljava/lang/String;)Ljava/lang/String;",
+        (void*)com_android_pacprocessor_PacNative_makeProxyRequestNativeLocked},
 };
 
 int register_com_android_pacprocessor_PacNative(JNIEnv* env) {
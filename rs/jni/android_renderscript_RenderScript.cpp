@@ -21,7 +21,10 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <math.h>
+#include <utils/KeyedVector.h>
+#include <utils/List.h>
 #include <utils/misc.h>
+#include <utils/threads.h>
 
 #include <core/SkBitmap.h>
 #include <core/SkPixelRef.h>
@@ -164,6 +167,8 @@ private:
 
 // ---------------------------------------------------------------------------
 
+static void cancelAsyncCopier(JNIEnv *_env, jobject _this, RsContext con);
+
 static jfieldID gContextId = 0;
 static jfieldID gNativeBitmapID = 0;
 static jfieldID gTypeNativeCache = 0;
@@ -296,6 +301,7 @@ static void
 nContextDestroy(JNIEnv *_env, jobject _this, jlong con)
 {
     LOG_API("nContextDestroy, con(%p)", (RsContext)con);
+    cancelAsyncCopier(_env, _this, (RsContext)con);
     rsContextDestroy((RsContext)con);
 }
 
@@ -778,6 +784,352 @@ nAllocationRead2D(JNIEnv *_env, jobject _this, jlong con, jlong _alloc, jint xof
     PER_ARRAY_TYPE(0, rsAllocation2DRead, (RsContext)con, alloc, xoff, yoff, lod, face, w, h, ptr, sizeBytes, 0);
 }
 
+// ---------------------------------------------------------------------------
+
+/*
+ * Copies between allocations and direct ByteBuffers. The buffer memory is
+ * handed to RS as is, with no array pinning, and a copy may be queued on a
+ * per-context worker instead of run inline. Queued copies complete in
+ * order and are identified by a fence; the allocation must not be used by
+ * a script until its fence has been waited on.
+ */
+struct AllocationCopy {
+    enum Op {
+        DATA_1D,
+        DATA_2D,
+        DATA_3D,
+        READ_1D,
+        READ_2D
+    };
+
+    Op op;
+    RsAllocation alloc;
+    jint xoff, yoff, zoff;
+    jint lod, face;
+    jint w, h, d;
+    void *ptr;
+    size_t sizeBytes;
+    jobject buffer;     // global ref while queued
+    int64_t fence;
+};
+
+static void runAllocationCopy(RsContext con, const AllocationCopy& c)
+{
+    RsAllocationCubemapFace face = (RsAllocationCubemapFace)c.face;
+    switch (c.op) {
+    case AllocationCopy::DATA_1D:
+        rsAllocation1DData(con, c.alloc, c.xoff, c.lod, c.w, c.ptr, c.sizeBytes);
+        break;
+    case AllocationCopy::DATA_2D:
+        rsAllocation2DData(con, c.alloc, c.xoff, c.yoff, c.lod, face, c.w, c.h,
+                           c.ptr, c.sizeBytes, 0);
+        break;
+    case AllocationCopy::DATA_3D:
+        rsAllocation3DData(con, c.alloc, c.xoff, c.yoff, c.zoff, c.lod, c.w, c.h, c.d,
+                           c.ptr, c.sizeBytes, 0);
+        break;
+    case AllocationCopy::READ_1D:
+        rsAllocation1DRead(con, c.alloc, c.xoff, c.lod, c.w, c.ptr, c.sizeBytes);
+        break;
+    case AllocationCopy::READ_2D:
+        rsAllocation2DRead(con, c.alloc, c.xoff, c.yoff, c.lod, face, c.w, c.h,
+                           c.ptr, c.sizeBytes, 0);
+        break;
+    }
+}
+
+/*
+ * Runs queued copies for one context. A context's command stream has a
+ * single writer, which the Java side guarantees by making every native call
+ * under the RenderScript object's monitor; the worker takes the same
+ * monitor around each copy.
+ */
+class AsyncCopier : public Thread {
+public:
+    AsyncCopier(JNIEnv *env, jobject rs, RsContext con)
+        : Thread(true), mLockObject(env->NewGlobalRef(rs)), mContext(con),
+          mNextFence(1), mCompleted(0), mCancelled(false) {
+    }
+
+    int64_t enqueue(const AllocationCopy& copy) {
+        Mutex::Autolock _l(mLock);
+        AllocationCopy queued = copy;
+        queued.fence = mNextFence++;
+        mPending.push_back(queued);
+        mCondition.signal();
+        return queued.fence;
+    }
+
+    // rs is the caller's reference to the RenderScript object. Holding its
+    // monitor keeps the worker out, so copies still queued up to the fence
+    // are run here instead of waited for.
+    void wait(JNIEnv *env, jobject rs, int64_t fence) {
+        env->MonitorEnter(rs);
+        while (runNext(env, fence)) {
+        }
+        env->MonitorExit(rs);
+    }
+
+    bool isDone(int64_t fence) {
+        Mutex::Autolock _l(mLock);
+        return fence <= mCompleted;
+    }
+
+    // Drops whatever is still queued; the context is about to go away.
+    void cancel(JNIEnv *env, jobject rs) {
+        env->MonitorEnter(rs);
+        {
+            Mutex::Autolock _l(mLock);
+            mCancelled = true;
+            for (List<AllocationCopy>::iterator it = mPending.begin();
+                    it != mPending.end(); ++it) {
+                env->DeleteGlobalRef(it->buffer);
+            }
+            mPending.clear();
+            mCondition.signal();
+        }
+        env->MonitorExit(rs);
+    }
+
+private:
+    virtual bool threadLoop() {
+        JNIEnv *env = AndroidRuntime::getJNIEnv();
+        {
+            Mutex::Autolock _l(mLock);
+            while (mPending.empty() && !mCancelled) {
+                mCondition.wait(mLock);
+            }
+        }
+        env->MonitorEnter(mLockObject);
+        runNext(env, -1);
+        env->MonitorExit(mLockObject);
+
+        Mutex::Autolock _l(mLock);
+        if (mCancelled) {
+            env->DeleteGlobalRef(mLockObject);
+            return false;
+        }
+        return true;
+    }
+
+    // Runs the oldest queued copy if its fence is within reach; a negative
+    // fence takes any copy. The caller holds the RenderScript monitor.
+    bool runNext(JNIEnv *env, int64_t fence) {
+        AllocationCopy copy;
+        {
+            Mutex::Autolock _l(mLock);
+            if (mCancelled || mPending.empty()
+                    || (fence >= 0 && mPending.begin()->fence > fence)) {
+                return false;
+            }
+            copy = *mPending.begin();
+            mPending.erase(mPending.begin());
+        }
+        runAllocationCopy(mContext, copy);
+        env->DeleteGlobalRef(copy.buffer);
+
+        Mutex::Autolock _l(mLock);
+        mCompleted = copy.fence;
+        return true;
+    }
+
+    jobject mLockObject;
+    RsContext mContext;
+    Mutex mLock;
+    Condition mCondition;
+    List<AllocationCopy> mPending;
+    int64_t mNextFence;
+    int64_t mCompleted;
+    bool mCancelled;
+};
+
+static Mutex gCopiersLock;
+static KeyedVector<RsContext, sp<AsyncCopier> > gCopiers;
+
+static sp<AsyncCopier> getAsyncCopier(JNIEnv *_env, jobject _this, RsContext con, bool create)
+{
+    Mutex::Autolock _l(gCopiersLock);
+    ssize_t index = gCopiers.indexOfKey(con);
+    if (index >= 0) {
+        return gCopiers.valueAt(index);
+    }
+    if (!create) {
+        return NULL;
+    }
+    sp<AsyncCopier> copier = new AsyncCopier(_env, _this, con);
+    if (copier->run("RSAsyncCopy", PRIORITY_DISPLAY) != NO_ERROR) {
+        return NULL;
+    }
+    gCopiers.add(con, copier);
+    return copier;
+}
+
+static void cancelAsyncCopier(JNIEnv *_env, jobject _this, RsContext con)
+{
+    sp<AsyncCopier> copier;
+    {
+        Mutex::Autolock _l(gCopiersLock);
+        ssize_t index = gCopiers.indexOfKey(con);
+        if (index < 0) {
+            return;
+        }
+        copier = gCopiers.valueAt(index);
+        gCopiers.removeItemsAt(index);
+    }
+    copier->cancel(_env, _this);
+}
+
+static bool
+initAllocationCopy(JNIEnv *_env, AllocationCopy *copy, AllocationCopy::Op op, jlong alloc,
+                   jobject data, jint sizeBytes)
+{
+    void *ptr = data != NULL ? _env->GetDirectBufferAddress(data) : NULL;
+    if (ptr == NULL) {
+        jniThrowException(_env, "java/lang/IllegalArgumentException",
+                          "Must use a direct ByteBuffer");
+        return false;
+    }
+    if (sizeBytes < 0 || _env->GetDirectBufferCapacity(data) < sizeBytes) {
+        jniThrowException(_env, "java/lang/IllegalArgumentException",
+                          "Buffer is too small");
+        return false;
+    }
+    memset(copy, 0, sizeof(*copy));
+    copy->op = op;
+    copy->alloc = (RsAllocation)alloc;
+    copy->ptr = ptr;
+    copy->sizeBytes = sizeBytes;
+    return true;
+}
+
+// Returns the fence of a queued copy, or 0 once an inline copy is done.
+static jlong
+submitAllocationCopy(JNIEnv *_env, jobject _this, RsContext con, AllocationCopy& copy,
+                     jboolean async, jobject data)
+{
+    if (!async) {
+        runAllocationCopy(con, copy);
+        return 0;
+    }
+    sp<AsyncCopier> copier = getAsyncCopier(_env, _this, con, true);
+    if (copier == NULL) {
+        runAllocationCopy(con, copy);
+        return 0;
+    }
+    copy.buffer = _env->NewGlobalRef(data);
+    return copier->enqueue(copy);
+}
+
+static jlong
+nAllocationData1DDirect(JNIEnv *_env, jobject _this, jlong con, jlong alloc, jint offset, jint lod,
+                        jint count, jobject data, jint sizeBytes, jboolean async)
+{
+    LOG_API("nAllocationData1DDirect, con(%p), alloc(%p), offset(%i), count(%i), sizeBytes(%i), async(%i)",
+            (RsContext)con, (RsAllocation)alloc, offset, count, sizeBytes, async);
+    AllocationCopy copy;
+    if (!initAllocationCopy(_env, &copy, AllocationCopy::DATA_1D, alloc, data, sizeBytes)) {
+        return 0;
+    }
+    copy.xoff = offset;
+    copy.lod = lod;
+    copy.w = count;
+    return submitAllocationCopy(_env, _this, (RsContext)con, copy, async, data);
+}
+
+static jlong
+nAllocationData2DDirect(JNIEnv *_env, jobject _this, jlong con, jlong alloc, jint xoff, jint yoff,
+                        jint lod, jint face, jint w, jint h, jobject data, jint sizeBytes,
+                        jboolean async)
+{
+    LOG_API("nAllocationData2DDirect, con(%p), alloc(%p), xoff(%i), yoff(%i), w(%i), h(%i), sizeBytes(%i), async(%i)",
+            (RsContext)con, (RsAllocation)alloc, xoff, yoff, w, h, sizeBytes, async);
+    AllocationCopy copy;
+    if (!initAllocationCopy(_env, &copy, AllocationCopy::DATA_2D, alloc, data, sizeBytes)) {
+        return 0;
+    }
+    copy.xoff = xoff;
+    copy.yoff = yoff;
+    copy.lod = lod;
+    copy.face = face;
+    copy.w = w;
+    copy.h = h;
+    return submitAllocationCopy(_env, _this, (RsContext)con, copy, async, data);
+}
+
+static jlong
+nAllocationData3DDirect(JNIEnv *_env, jobject _this, jlong con, jlong alloc, jint xoff, jint yoff,
+                        jint zoff, jint lod, jint w, jint h, jint d, jobject data, jint sizeBytes,
+                        jboolean async)
+{
+    LOG_API("nAllocationData3DDirect, con(%p), alloc(%p), xoff(%i), yoff(%i), zoff(%i), w(%i), h(%i), d(%i), sizeBytes(%i), async(%i)",
+            (RsContext)con, (RsAllocation)alloc, xoff, yoff, zoff, w, h, d, sizeBytes, async);
+    AllocationCopy copy;
+    if (!initAllocationCopy(_env, &copy, AllocationCopy::DATA_3D, alloc, data, sizeBytes)) {
+        return 0;
+    }
+    copy.xoff = xoff;
+    copy.yoff = yoff;
+    copy.zoff = zoff;
+    copy.lod = lod;
+    copy.w = w;
+    copy.h = h;
+    copy.d = d;
+    return submitAllocationCopy(_env, _this, (RsContext)con, copy, async, data);
+}
+
+static jlong
+nAllocationRead1DDirect(JNIEnv *_env, jobject _this, jlong con, jlong alloc, jint offset, jint lod,
+                        jint count, jobject data, jint sizeBytes, jboolean async)
+{
+    LOG_API("nAllocationRead1DDirect, con(%p), alloc(%p), offset(%i), count(%i), sizeBytes(%i), async(%i)",
+            (RsContext)con, (RsAllocation)alloc, offset, count, sizeBytes, async);
+    AllocationCopy copy;
+    if (!initAllocationCopy(_env, &copy, AllocationCopy::READ_1D, alloc, data, sizeBytes)) {
+        return 0;
+    }
+    copy.xoff = offset;
+    copy.lod = lod;
+    copy.w = count;
+    return submitAllocationCopy(_env, _this, (RsContext)con, copy, async, data);
+}
+
+static jlong
+nAllocationRead2DDirect(JNIEnv *_env, jobject _this, jlong con, jlong alloc, jint xoff, jint yoff,
+                        jint lod, jint face, jint w, jint h, jobject data, jint sizeBytes,
+                        jboolean async)
+{
+    LOG_API("nAllocationRead2DDirect, con(%p), alloc(%p), xoff(%i), yoff(%i), w(%i), h(%i), sizeBytes(%i), async(%i)",
+            (RsContext)con, (RsAllocation)alloc, xoff, yoff, w, h, sizeBytes, async);
+    AllocationCopy copy;
+    if (!initAllocationCopy(_env, &copy, AllocationCopy::READ_2D, alloc, data, sizeBytes)) {
+        return 0;
+    }
+    copy.xoff = xoff;
+    copy.yoff = yoff;
+    copy.lod = lod;
+    copy.face = face;
+    copy.w = w;
+    copy.h = h;
+    return submitAllocationCopy(_env, _this, (RsContext)con, copy, async, data);
+}
+
+static void
+nAllocationCopyWait(JNIEnv *_env, jobject _this, jlong con, jlong fence)
+{
+    LOG_API("nAllocationCopyWait, con(%p), fence(%lli)", (RsContext)con, fence);
+    sp<AsyncCopier> copier = getAsyncCopier(_env, _this, (RsContext)con, false);
+    if (copier != NULL) {
+        copier->wait(_env, _this, fence);
+    }
+}
+
+static jboolean
+nAllocationCopyIsDone(JNIEnv *_env, jobject _this, jlong con, jlong fence)
+{
+    sp<AsyncCopier> copier = getAsyncCopier(_env, _this, (RsContext)con, false);
+    return copier == NULL || copier->isDone(fence);
+}
+
 static jlong
 nAllocationGetType(JNIEnv *_env, jobject _this, jlong con, jlong a)
 {
@@ -1565,6 +1917,13 @@ static JNINativeMethod methods[] = {
 {"rsnAllocationRead",                "(JJLjava/lang/Object;I)V",              (void*)nAllocationRead },
 {"rsnAllocationRead1D",              "(JJIIILjava/lang/Object;II)V",          (void*)nAllocationRead1D },
 {"rsnAllocationRead2D",              "(JJIIIIIILjava/lang/Object;II)V",       (void*)nAllocationRead2D },
+{"rsnAllocationData1DDirect",        "(JJIIILjava/nio/ByteBuffer;IZ)J",       (void*)nAllocationData1DDirect },
+{"rsnAllocationData2DDirect",        "(JJIIIIIILjava/nio/ByteBuffer;IZ)J",    (void*)nAllocationData2DDirect },
+{"rsnAllocationData3DDirect",        "(JJIIIIIIILjava/nio/ByteBuffer;IZ)J",   (void*)nAllocationData3DDirect },
+{"rsnAllocationRead1DDirect",        "(JJIIILjava/nio/ByteBuffer;IZ)J",       (void*)nAllocationRead1DDirect },
+{"rsnAllocationRead2DDirect",        "(JJIIIIIILjava/nio/ByteBuffer;IZ)J",    (void*)nAllocationRead2DDirect },
+{"rsnAllocationCopyWait",            "(JJ)V",                                 (void*)nAllocationCopyWait },
+{"rsnAllocationCopyIsDone",          "(JJ)Z",                                 (void*)nAllocationCopyIsDone },
 {"rsnAllocationGetType",             "(JJ)J",                                 (void*)nAllocationGetType},
 {"rsnAllocationResize1D",            "(JJI)V",                                (void*)nAllocationResize1D },
 {"rsnAllocationGenerateMipmaps",     "(JJ)V",                                 (void*)nAllocationGenerateMipmaps },
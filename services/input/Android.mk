@@ -18,6 +18,7 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES:= \
     EventHub.cpp \
+    EventLog.cpp \
     InputApplication.cpp \
     InputDispatcher.cpp \
     InputListener.cpp \
@@ -25,6 +26,7 @@ LOCAL_SRC_FILES:= \
     InputReader.cpp \
     InputWindow.cpp \
     PointerController.cpp \
+    ReplayEventHub.cpp \
     SpriteController.cpp
 
 LOCAL_SHARED_LIBRARIES := \
@@ -19,9 +19,11 @@
 // #define LOG_NDEBUG 0
 
 #include "EventHub.h"
+#include "EventLog.h"
 
 #include <hardware_legacy/power.h>
 
+#include <cutils/atomic.h>
 #include <cutils/properties.h>
 #include <utils/Log.h>
 #include <utils/Timers.h>
@@ -49,6 +51,8 @@
 #include <sys/ioctl.h>
 #include <sys/limits.h>
 #include <sys/sha1.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
 
 /* this macro is used to tell if "bit" is set in "array"
  * it selects a byte from the array, and does a boolean AND
@@ -60,6 +64,11 @@
 /* this macro computes the number of bytes needed to represent a bit array of the specified size */
 #define sizeof_bit_array(bits)  ((bits + 7) / 8)
 
+/* older headers do not define the epoll flag of Linux 3.5 to hold a wake source */
+#ifndef EPOLLWAKEUP
+#define EPOLLWAKEUP (1u << 29)
+#endif
+
 #define INDENT "  "
 #define INDENT2 "    "
 #define INDENT3 "      "
@@ -187,12 +196,72 @@ void EventHub::Device::close() {
 }
 
 
+// --- EventHub::CachedFile ---
+
+void EventHub::CachedFile::setTo(const String8& path) {
+    this->path = path;
+
+    struct stat st;
+    if (!path.isEmpty() && !stat(path.string(), &st)) {
+        modificationTime = st.st_mtime;
+        size = st.st_size;
+    } else {
+        modificationTime = 0;
+        size = -1;
+    }
+}
+
+
+// --- EventHub::DeviceProbeQueue ---
+
+EventHub::DeviceProbeQueue::DeviceProbeQueue(EventHub* eventHub,
+        const Vector<String8>& devicePaths, const Vector<String8>& excludedDevices) :
+        mEventHub(eventHub), mDevicePaths(devicePaths), mExcludedDevices(excludedDevices),
+        mNextIndex(0) {
+    DeviceProbe probe;
+    probe.device = NULL;
+    probe.builtInKeyboardEligible = false;
+    probe.usingSuspendBlockIoctl = false;
+    probe.usingClockIoctl = false;
+    mProbes.insertAt(probe, 0, devicePaths.size());
+}
+
+void EventHub::DeviceProbeQueue::probeDevices() {
+    for (;;) {
+        size_t index = size_t(android_atomic_inc(&mNextIndex));
+        if (index >= mDevicePaths.size()) {
+            break;
+        }
+
+        // Each probe is only written by the thread that claimed its index.
+        DeviceProbe& probe = mProbes.editItemAt(index);
+        if (mEventHub->probeDevice(mDevicePaths[index].string(), mExcludedDevices, &probe)) {
+            probe.device = NULL;
+        }
+    }
+}
+
+
+// --- EventHub::DeviceProbeThread ---
+
+EventHub::DeviceProbeThread::DeviceProbeThread(DeviceProbeQueue* queue) :
+        Thread(/*canCallJava*/ false), mQueue(queue) {
+}
+
+bool EventHub::DeviceProbeThread::threadLoop() {
+    mQueue->probeDevices();
+    return false;
+}
+
+
 // --- EventHub ---
 
 const uint32_t EventHub::EPOLL_ID_INOTIFY;
 const uint32_t EventHub::EPOLL_ID_WAKE;
 const int EventHub::EPOLL_SIZE_HINT;
 const int EventHub::EPOLL_MAX_EVENTS;
+const size_t EventHub::MAX_DEVICE_PROBE_THREADS;
+const size_t EventHub::MAX_CACHED_FILES;
 
 EventHub::EventHub(void) :
         mBuiltInKeyboardId(NO_BUILT_IN_KEYBOARD), mNextDeviceId(1), mControllerNumbers(),
@@ -202,6 +271,12 @@ EventHub::EventHub(void) :
         mPendingEventCount(0), mPendingEventIndex(0), mPendingINotify(false) {
     acquire_wake_lock(PARTIAL_WAKE_LOCK, WAKE_LOCK_ID);
 
+    // EPOLLWAKEUP is supported as of Linux 3.5.
+    int major, minor;
+    struct utsname info;
+    mUsingEpollWakeup = !uname(&info) && sscanf(info.release, "%d.%d", &major, &minor) == 2
+            && (major > 3 || (major == 3 && minor >= 5));
+
     mEpollFd = epoll_create(EPOLL_SIZE_HINT);
     LOG_ALWAYS_FATAL_IF(mEpollFd < 0, "Could not create epoll instance.  errno=%d", errno);
 
@@ -236,6 +311,20 @@ EventHub::EventHub(void) :
     result = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeReadPipeFd, &eventItem);
     LOG_ALWAYS_FATAL_IF(result != 0, "Could not add wake read pipe to epoll instance.  errno=%d",
             errno);
+
+    mCaptureLog = NULL;
+    char capturePath[PROPERTY_VALUE_MAX];
+    if (property_get("debug.input.capture", capturePath, NULL) > 0) {
+        mCaptureLog = new EventLogWriter();
+        status_t status = mCaptureLog->open(capturePath);
+        if (!status) {
+            ALOGI("Capturing input events to %s.", capturePath);
+        } else {
+            ALOGW("Could not open %s to capture input events.  status=%d", capturePath, status);
+            delete mCaptureLog;
+            mCaptureLog = NULL;
+        }
+    }
 }
 
 EventHub::~EventHub(void) {
@@ -252,6 +341,12 @@ EventHub::~EventHub(void) {
     ::close(mWakeReadPipeFd);
     ::close(mWakeWritePipeFd);
 
+    delete mCaptureLog;
+
+    for (size_t i = 0; i < mConfigurationCache.size(); i++) {
+        delete mConfigurationCache.valueAt(i).configuration;
+    }
+
     release_wake_lock(WAKE_LOCK_ID);
 }
 
@@ -699,6 +794,9 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
             event->when = now;
             event->deviceId = device->id == mBuiltInKeyboardId ? 0 : device->id;
             event->type = DEVICE_ADDED;
+            if (mCaptureLog) {
+                captureDeviceLocked(device, event->deviceId);
+            }
             event += 1;
             mNeedToSendFinishedDeviceScan = true;
             if (--capacity == 0) {
@@ -914,10 +1012,20 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
         // service the timeout.
         mPendingEventIndex = 0;
 
+        // Leave room for every device as well as the inotify FD and the wake pipe.
+        size_t maxEvents = mDevices.size() + 2;
+        if (maxEvents < size_t(EPOLL_MAX_EVENTS)) {
+            maxEvents = EPOLL_MAX_EVENTS;
+        }
+        if (mPendingEventItems.size() < maxEvents) {
+            mPendingEventItems.resize(maxEvents);
+        }
+
         mLock.unlock(); // release lock before poll, must be before release_wake_lock
         release_wake_lock(WAKE_LOCK_ID);
 
-        int pollResult = epoll_wait(mEpollFd, mPendingEventItems, EPOLL_MAX_EVENTS, timeoutMillis);
+        int pollResult = epoll_wait(mEpollFd, mPendingEventItems.editArray(),
+                mPendingEventItems.size(), timeoutMillis);
 
         acquire_wake_lock(PARTIAL_WAKE_LOCK, WAKE_LOCK_ID);
         mLock.lock(); // reacquire lock after poll, must be after acquire_wake_lock
@@ -944,10 +1052,46 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
         }
     }
 
+    if (mCaptureLog) {
+        mCaptureLog->writeEvents(buffer, event - buffer);
+    }
+
     // All done, return the number of events we read.
     return event - buffer;
 }
 
+void EventHub::captureDeviceLocked(const Device* device, int32_t deviceId) {
+    EventLogDevice info;
+    info.id = deviceId;
+    info.classes = device->classes;
+    info.identifier = device->identifier;
+
+    if (!device->isVirtual()) {
+        for (int axis = 0; axis <= ABS_MAX; axis++) {
+            struct input_absinfo absInfo;
+            if (test_bit(axis, device->absBitmask)
+                    && !ioctl(device->fd, EVIOCGABS(axis), &absInfo)
+                    && absInfo.minimum != absInfo.maximum) {
+                RawAbsoluteAxisInfo axisInfo;
+                axisInfo.valid = true;
+                axisInfo.minValue = absInfo.minimum;
+                axisInfo.maxValue = absInfo.maximum;
+                axisInfo.flat = absInfo.flat;
+                axisInfo.fuzz = absInfo.fuzz;
+                axisInfo.resolution = absInfo.resolution;
+                info.absoluteAxes.add(axis, axisInfo);
+            }
+        }
+    }
+
+    memcpy(info.keyBitmask, device->keyBitmask, sizeof(info.keyBitmask));
+    memcpy(info.relBitmask, device->relBitmask, sizeof(info.relBitmask));
+    memcpy(info.swBitmask, device->swBitmask, sizeof(info.swBitmask));
+    memcpy(info.ledBitmask, device->ledBitmask, sizeof(info.ledBitmask));
+    memcpy(info.propBitmask, device->propBitmask, sizeof(info.propBitmask));
+    mCaptureLog->writeDevice(info);
+}
+
 void EventHub::wake() {
     ALOGV("wake() called");
 
@@ -998,6 +1142,16 @@ static const int32_t GAMEPAD_KEYCODES[] = {
 };
 
 status_t EventHub::openDeviceLocked(const char *devicePath) {
+    DeviceProbe probe;
+    status_t status = probeDevice(devicePath, mExcludedDevices, &probe);
+    if (status) {
+        return status;
+    }
+    return registerDeviceLocked(probe);
+}
+
+status_t EventHub::probeDevice(const char *devicePath, const Vector<String8>& excludedDevices,
+        DeviceProbe* outProbe) {
     char buffer[80];
 
     ALOGV("Opening device: %s", devicePath);
@@ -1019,8 +1173,8 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
     }
 
     // Check to see if the device is on our excluded list
-    for (size_t i = 0; i < mExcludedDevices.size(); i++) {
-        const String8& item = mExcludedDevices.itemAt(i);
+    for (size_t i = 0; i < excludedDevices.size(); i++) {
+        const String8& item = excludedDevices.itemAt(i);
         if (identifier.name == item) {
             ALOGI("ignoring event id %s driver %s\n", devicePath, item.string());
             close(fd);
@@ -1075,10 +1229,10 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
     }
 
     // Allocate device.  (The device object takes ownership of the fd at this point.)
-    int32_t deviceId = mNextDeviceId++;
-    Device* device = new Device(fd, deviceId, String8(devicePath), identifier);
+    // The id is assigned when the device is registered.
+    Device* device = new Device(fd, -1, String8(devicePath), identifier);
 
-    ALOGV("add device %d: %s\n", deviceId, devicePath);
+    ALOGV("probe device: %s\n", devicePath);
     ALOGV("  bus:        %04x\n"
          "  vendor      %04x\n"
          "  product     %04x\n"
@@ -1186,14 +1340,12 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
     }
 
     // Configure the keyboard, gamepad or virtual keyboard.
+    bool builtInKeyboardEligible = false;
     if (device->classes & INPUT_DEVICE_CLASS_KEYBOARD) {
-        // Register the keyboard as a built-in keyboard if it is eligible.
-        if (!keyMapStatus
-                && mBuiltInKeyboardId == NO_BUILT_IN_KEYBOARD
+        // The keyboard is registered as a built-in keyboard if it is eligible.
+        builtInKeyboardEligible = !keyMapStatus
                 && isEligibleBuiltInKeyboard(device->identifier,
-                        device->configuration, &device->keyMap)) {
-            mBuiltInKeyboardId = device->id;
-        }
+                        device->configuration, &device->keyMap);
 
         // 'Q' key support = cheap test of whether this is an alpha-capable kbd
         if (hasKeycodeLocked(device, AKEYCODE_Q)) {
@@ -1226,8 +1378,8 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
 
     // If the device isn't recognized as something we handle, don't monitor it.
     if (device->classes == 0) {
-        ALOGV("Dropping device: id=%d, path='%s', name='%s'",
-                deviceId, devicePath, device->identifier.name.string());
+        ALOGV("Dropping device: path='%s', name='%s'",
+                devicePath, device->identifier.name.string());
         delete device;
         return -1;
     }
@@ -1237,22 +1389,7 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
         device->classes |= INPUT_DEVICE_CLASS_EXTERNAL;
     }
 
-    if (device->classes & (INPUT_DEVICE_CLASS_JOYSTICK | INPUT_DEVICE_CLASS_GAMEPAD)) {
-        device->controllerNumber = getNextControllerNumberLocked(device);
-    }
-
-    // Register with epoll.
-    struct epoll_event eventItem;
-    memset(&eventItem, 0, sizeof(eventItem));
-    eventItem.events = EPOLLIN;
-    eventItem.data.u32 = deviceId;
-    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &eventItem)) {
-        ALOGE("Could not add device fd to epoll instance.  errno=%d", errno);
-        delete device;
-        return -1;
-    }
-
-    // Enable wake-lock behavior on kernels that support it.
+    // Enable wake-lock behavior on kernels that support it, unless EPOLLWAKEUP already does.
     // TODO: Only need this for devices that can really wake the system.
 #ifndef EVIOCSSUSPENDBLOCK
     // uapi headers don't include EVIOCSSUSPENDBLOCK, and future kernels
@@ -1260,7 +1397,8 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
     // this feature, we need to be prepared to define the ioctl ourselves.
 #define EVIOCSSUSPENDBLOCK _IOW('E', 0x91, int)
 #endif
-    bool usingSuspendBlockIoctl = !ioctl(fd, EVIOCSSUSPENDBLOCK, 1);
+    // The suspend blocker is not needed once epoll holds a wake source for the device.
+    bool usingSuspendBlockIoctl = !mUsingEpollWakeup && !ioctl(fd, EVIOCSSUSPENDBLOCK, 1);
 
     // Tell the kernel that we want to use the monotonic clock for reporting timestamps
     // associated with input events.  This is important because the input system
@@ -1280,21 +1418,57 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
     int clockId = CLOCK_MONOTONIC;
     bool usingClockIoctl = !ioctl(fd, EVIOCSCLOCKID, &clockId);
 
+    outProbe->device = device;
+    outProbe->builtInKeyboardEligible = builtInKeyboardEligible;
+    outProbe->usingSuspendBlockIoctl = usingSuspendBlockIoctl;
+    outProbe->usingClockIoctl = usingClockIoctl;
+    return 0;
+}
+
+status_t EventHub::registerDeviceLocked(const DeviceProbe& probe) {
+    Device* device = probe.device;
+    int32_t deviceId = mNextDeviceId++;
+    device->id = deviceId;
+
+    if (probe.builtInKeyboardEligible && mBuiltInKeyboardId == NO_BUILT_IN_KEYBOARD) {
+        mBuiltInKeyboardId = deviceId;
+    }
+
+    if (device->classes & (INPUT_DEVICE_CLASS_JOYSTICK | INPUT_DEVICE_CLASS_GAMEPAD)) {
+        device->controllerNumber = getNextControllerNumberLocked(device);
+    }
+
+    // Register with epoll.
+    struct epoll_event eventItem;
+    memset(&eventItem, 0, sizeof(eventItem));
+    eventItem.events = mUsingEpollWakeup ? EPOLLIN | EPOLLWAKEUP : EPOLLIN;
+    eventItem.data.u32 = deviceId;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, device->fd, &eventItem)) {
+        ALOGE("Could not add device fd to epoll instance.  errno=%d", errno);
+        if (mBuiltInKeyboardId == deviceId) {
+            mBuiltInKeyboardId = NO_BUILT_IN_KEYBOARD;
+        }
+        releaseControllerNumberLocked(device);
+        delete device;
+        return -1;
+    }
+
     ALOGI("New device: id=%d, fd=%d, path='%s', name='%s', classes=0x%x, "
             "configuration='%s', keyLayout='%s', keyCharacterMap='%s', builtinKeyboard=%s, "
             "usingSuspendBlockIoctl=%s, usingClockIoctl=%s",
-         deviceId, fd, devicePath, device->identifier.name.string(),
+         deviceId, device->fd, device->path.string(), device->identifier.name.string(),
          device->classes,
          device->configurationFile.string(),
          device->keyMap.keyLayoutFile.string(),
          device->keyMap.keyCharacterMapFile.string(),
          toString(mBuiltInKeyboardId == deviceId),
-         toString(usingSuspendBlockIoctl), toString(usingClockIoctl));
+         toString(probe.usingSuspendBlockIoctl), toString(probe.usingClockIoctl));
 
     addDeviceLocked(device);
     return 0;
 }
 
+
 void EventHub::createVirtualKeyboardLocked() {
     InputDeviceIdentifier identifier;
     identifier.name = "Virtual";
@@ -1323,12 +1497,21 @@ void EventHub::loadConfigurationLocked(Device* device) {
         ALOGD("No input device configuration file found for device '%s'.",
                 device->identifier.name.string());
     } else {
+        CachedFile file;
+        file.setTo(device->configurationFile);
+        device->configuration = getCachedConfiguration(file);
+        if (device->configuration) {
+            return;
+        }
+
         status_t status = PropertyMap::load(device->configurationFile,
                 &device->configuration);
         if (status) {
             ALOGE("Error loading input device configuration file for device '%s'.  "
                     "Using default configuration.",
                     device->identifier.name.string());
+        } else {
+            putCachedConfiguration(file, device->configuration);
         }
     }
 }
@@ -1345,7 +1528,94 @@ status_t EventHub::loadVirtualKeyMapLocked(Device* device) {
 }
 
 status_t EventHub::loadKeyMapLocked(Device* device) {
-    return device->keyMap.load(device->identifier, device->configuration);
+    // The configuration file may select the key layout and key character map.
+    CachedFile configurationFile;
+    configurationFile.setTo(device->configurationFile);
+    if (getCachedKeyMap(device->identifier.descriptor, configurationFile, &device->keyMap)) {
+        return OK;
+    }
+
+    status_t status = device->keyMap.load(device->identifier, device->configuration);
+    if (!status) {
+        putCachedKeyMap(device->identifier.descriptor, configurationFile, device->keyMap);
+    }
+    return status;
+}
+
+PropertyMap* EventHub::getCachedConfiguration(const CachedFile& file) {
+    AutoMutex _l(mCacheLock);
+
+    ssize_t index = mConfigurationCache.indexOfKey(file.path);
+    if (index < 0) {
+        return NULL;
+    }
+    const CachedConfiguration& entry = mConfigurationCache.valueAt(index);
+    if (entry.file != file) {
+        return NULL;
+    }
+    return new PropertyMap(*entry.configuration);
+}
+
+void EventHub::putCachedConfiguration(const CachedFile& file,
+        const PropertyMap* configuration) {
+    AutoMutex _l(mCacheLock);
+
+    ssize_t index = mConfigurationCache.indexOfKey(file.path);
+    if (index >= 0) {
+        delete mConfigurationCache.valueAt(index).configuration;
+        mConfigurationCache.removeItemsAt(index);
+    } else if (mConfigurationCache.size() >= MAX_CACHED_FILES) {
+        delete mConfigurationCache.valueAt(0).configuration;
+        mConfigurationCache.removeItemsAt(0);
+    }
+
+    CachedConfiguration entry;
+    entry.file = file;
+    entry.configuration = new PropertyMap(*configuration);
+    mConfigurationCache.add(file.path, entry);
+}
+
+bool EventHub::getCachedKeyMap(const String8& descriptor, const CachedFile& configurationFile,
+        KeyMap* outKeyMap) {
+    AutoMutex _l(mCacheLock);
+
+    ssize_t index = mKeyMapCache.indexOfKey(descriptor);
+    if (index < 0) {
+        return false;
+    }
+
+    // The key layout and key character map are immutable once loaded, the devices share them.
+    const CachedKeyMap& entry = mKeyMapCache.valueAt(index);
+    CachedFile keyLayoutFile;
+    keyLayoutFile.setTo(entry.keyMap.keyLayoutFile);
+    CachedFile keyCharacterMapFile;
+    keyCharacterMapFile.setTo(entry.keyMap.keyCharacterMapFile);
+    if (entry.configurationFile != configurationFile
+            || entry.keyLayoutFile != keyLayoutFile
+            || entry.keyCharacterMapFile != keyCharacterMapFile) {
+        return false;
+    }
+    *outKeyMap = entry.keyMap;
+    return true;
+}
+
+void EventHub::putCachedKeyMap(const String8& descriptor, const CachedFile& configurationFile,
+        const KeyMap& keyMap) {
+    AutoMutex _l(mCacheLock);
+
+    ssize_t index = mKeyMapCache.indexOfKey(descriptor);
+    if (index >= 0) {
+        mKeyMapCache.removeItemsAt(index);
+    } else if (mKeyMapCache.size() >= MAX_CACHED_FILES) {
+        mKeyMapCache.removeItemsAt(0);
+    }
+
+    CachedKeyMap entry;
+    entry.configurationFile = configurationFile;
+    entry.keyLayoutFile.setTo(keyMap.keyLayoutFile);
+    entry.keyCharacterMapFile.setTo(keyMap.keyCharacterMapFile);
+    entry.keyMap = keyMap;
+    mKeyMapCache.add(descriptor, entry);
 }
 
 bool EventHub::isExternalDeviceLocked(Device* device) {
@@ -1519,15 +1789,52 @@ status_t EventHub::scanDirLocked(const char *dirname)
     strcpy(devname, dirname);
     filename = devname + strlen(devname);
     *filename++ = '/';
+    Vector<String8> devicePaths;
     while((de = readdir(dir))) {
         if(de->d_name[0] == '.' &&
            (de->d_name[1] == '\0' ||
             (de->d_name[1] == '.' && de->d_name[2] == '\0')))
             continue;
         strcpy(filename, de->d_name);
-        openDeviceLocked(devname);
+        devicePaths.add(String8(devname));
     }
     closedir(dir);
+
+    if (devicePaths.size() <= 1) {
+        for (size_t i = 0; i < devicePaths.size(); i++) {
+            openDeviceLocked(devicePaths[i].string());
+        }
+        return 0;
+    }
+
+    // Probing a device takes many ioctls and loads its configuration files, which is
+    // done in parallel and without holding the lock.  The devices are then registered
+    // in the order of the directory, as they were when opened one by one.
+    DeviceProbeQueue queue(this, devicePaths, mExcludedDevices);
+    size_t threadCount = devicePaths.size() < MAX_DEVICE_PROBE_THREADS
+            ? devicePaths.size() : MAX_DEVICE_PROBE_THREADS;
+
+    mLock.unlock();
+    Vector<sp<DeviceProbeThread> > threads;
+    for (size_t i = 1; i < threadCount; i++) {
+        sp<DeviceProbeThread> thread = new DeviceProbeThread(&queue);
+        if (thread->run("DeviceProbe", PRIORITY_URGENT_DISPLAY)) {
+            break;
+        }
+        threads.add(thread);
+    }
+    queue.probeDevices(); // this thread probes devices too
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i]->join();
+    }
+    mLock.lock();
+
+    for (size_t i = 0; i < devicePaths.size(); i++) {
+        const DeviceProbe& probe = queue.getProbe(i);
+        if (probe.device) {
+            registerDeviceLocked(probe);
+        }
+    }
     return 0;
 }
 
@@ -1545,6 +1852,13 @@ void EventHub::dump(String8& dump) {
         AutoMutex _l(mLock);
 
         dump.appendFormat(INDENT "BuiltInKeyboardId: %d\n", mBuiltInKeyboardId);
+        dump.appendFormat(INDENT "UsingEpollWakeup: %s\n", toString(mUsingEpollWakeup));
+
+        { // acquire cache lock
+            AutoMutex _cl(mCacheLock);
+            dump.appendFormat(INDENT "CachedConfigurations: %d\n", mConfigurationCache.size());
+            dump.appendFormat(INDENT "CachedKeyMaps: %d\n", mKeyMapCache.size());
+        } // release cache lock
 
         dump.append(INDENT "Devices:\n");
 
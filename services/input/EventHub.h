@@ -59,6 +59,8 @@
 
 namespace android {
 
+class EventLogWriter;
+
 enum {
     // Device id of a special "virtual" keyboard that is always present.
     VIRTUAL_KEYBOARD_ID = -1,
@@ -323,7 +325,7 @@ private:
         Device* next;
 
         int fd; // may be -1 if device is virtual
-        const int32_t id;
+        int32_t id; // assigned when the device is registered
         const String8 path;
         const InputDeviceIdentifier identifier;
 
@@ -368,7 +370,77 @@ private:
         }
     };
 
+    // Identifies the contents of a configuration file, assuming that a file
+    // which changes also changes its modification time or its size.
+    struct CachedFile {
+        String8 path; // empty if there is no file
+        time_t modificationTime;
+        off_t size;
+
+        void setTo(const String8& path);
+
+        inline bool operator==(const CachedFile& other) const {
+            return path == other.path && modificationTime == other.modificationTime
+                    && size == other.size;
+        }
+        inline bool operator!=(const CachedFile& other) const { return !(*this == other); }
+    };
+
+    struct CachedConfiguration {
+        CachedFile file;
+        PropertyMap* configuration;
+    };
+
+    struct CachedKeyMap {
+        CachedFile configurationFile;
+        CachedFile keyLayoutFile;
+        CachedFile keyCharacterMapFile;
+        KeyMap keyMap;
+    };
+
+    // Result of probing a device node, before the device is registered.
+    struct DeviceProbe {
+        Device* device;
+        bool builtInKeyboardEligible;
+        bool usingSuspendBlockIoctl;
+        bool usingClockIoctl;
+    };
+
+    // Probes the devices of a directory scan, shared by the threads that probe them.
+    class DeviceProbeQueue {
+    public:
+        DeviceProbeQueue(EventHub* eventHub, const Vector<String8>& devicePaths,
+                const Vector<String8>& excludedDevices);
+
+        // Probes devices until every device of the queue has been claimed by a thread.
+        void probeDevices();
+
+        inline const DeviceProbe& getProbe(size_t index) const { return mProbes[index]; }
+
+    private:
+        EventHub* mEventHub;
+        const Vector<String8>& mDevicePaths;
+        const Vector<String8> mExcludedDevices;
+        Vector<DeviceProbe> mProbes;
+        volatile int32_t mNextIndex;
+    };
+
+    class DeviceProbeThread : public Thread {
+    public:
+        explicit DeviceProbeThread(DeviceProbeQueue* queue);
+
+    private:
+        DeviceProbeQueue* mQueue;
+
+        virtual bool threadLoop();
+    };
+
     status_t openDeviceLocked(const char *devicePath);
+    // Opens and identifies a device and loads its configuration.  Only reads the state
+    // of the device itself, so it may be called without holding the lock.
+    status_t probeDevice(const char *devicePath, const Vector<String8>& excludedDevices,
+            DeviceProbe* outProbe);
+    status_t registerDeviceLocked(const DeviceProbe& probe);
     void createVirtualKeyboardLocked();
     void addDeviceLocked(Device* device);
 
@@ -391,6 +463,15 @@ private:
 
     bool isExternalDeviceLocked(Device* device);
 
+    PropertyMap* getCachedConfiguration(const CachedFile& file);
+    void putCachedConfiguration(const CachedFile& file, const PropertyMap* configuration);
+    bool getCachedKeyMap(const String8& descriptor, const CachedFile& configurationFile,
+            KeyMap* outKeyMap);
+    void putCachedKeyMap(const String8& descriptor, const CachedFile& configurationFile,
+            const KeyMap& keyMap);
+
+    void captureDeviceLocked(const Device* device, int32_t deviceId);
+
     int32_t getNextControllerNumberLocked(Device* device);
     void releaseControllerNumberLocked(Device* device);
 
@@ -429,17 +510,43 @@ private:
     static const uint32_t EPOLL_ID_INOTIFY = 0x80000001;
     static const uint32_t EPOLL_ID_WAKE = 0x80000002;
 
+    // Maximum number of threads probing devices during a directory scan.
+    static const size_t MAX_DEVICE_PROBE_THREADS = 4;
+
     // Epoll FD list size hint.
     static const int EPOLL_SIZE_HINT = 8;
 
-    // Maximum number of signalled FDs to handle at a time.
+    // Minimum number of signalled FDs to handle at a time.  The batch grows with the
+    // number of open devices so that every signalled FD is handled in a single poll.
     static const int EPOLL_MAX_EVENTS = 16;
 
+    // True if the kernel holds a wake source for the signalled device FDs until
+    // they are read again, instead of each device holding a suspend blocker.
+    bool mUsingEpollWakeup;
+
     // The array of pending epoll events and the index of the next event to be handled.
-    struct epoll_event mPendingEventItems[EPOLL_MAX_EVENTS];
+    Vector<struct epoll_event> mPendingEventItems;
     size_t mPendingEventCount;
     size_t mPendingEventIndex;
     bool mPendingINotify;
+
+    // Guards the caches of parsed configuration files, which are used while devices
+    // are probed without holding mLock.  The caches are kept across reconnects.
+    Mutex mCacheLock;
+
+    // Maximum number of entries of each cache.
+    static const size_t MAX_CACHED_FILES = 32;
+
+    // Parsed input device configuration files, keyed by path.
+    KeyedVector<String8, CachedConfiguration> mConfigurationCache;
+
+    // Key maps, keyed by device descriptor.
+    KeyedVector<String8, CachedKeyMap> mKeyMapCache;
+
+    // Log of the devices and events reported by getEvents(), or NULL when the
+    // debug.input.capture property does not name a file when the hub is created.
+    // The log can be replayed by a ReplayEventHub.
+    EventLogWriter* mCaptureLog;
 };
 
 }; // namespace android
@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "EventLog"
+
+//#define LOG_NDEBUG 0
+
+#include "EventLog.h"
+
+#include <cutils/log.h>
+
+#include <errno.h>
+#include <string.h>
+
+namespace android {
+
+// Identifies an event log and the version of its format.
+static const int32_t EVENT_LOG_MAGIC = 0x4c564945; // "EIVL"
+static const int32_t EVENT_LOG_VERSION = 1;
+
+// Record tags.
+static const int32_t TAG_DEVICE = 1;
+static const int32_t TAG_EVENTS = 2;
+
+// Upper bounds of the values read from a log, to reject malformed records
+// without attempting huge allocations.
+static const int32_t MAX_STRING_LENGTH = 4096;
+static const int32_t MAX_AXES = ABS_MAX + 1;
+static const int32_t MAX_EVENTS_PER_RECORD = 65536;
+
+
+// --- EventLogDevice ---
+
+EventLogDevice::EventLogDevice() :
+        id(0), classes(0) {
+    memset(keyBitmask, 0, sizeof(keyBitmask));
+    memset(relBitmask, 0, sizeof(relBitmask));
+    memset(swBitmask, 0, sizeof(swBitmask));
+    memset(ledBitmask, 0, sizeof(ledBitmask));
+    memset(propBitmask, 0, sizeof(propBitmask));
+}
+
+
+// --- EventLogWriter ---
+
+EventLogWriter::EventLogWriter() :
+        mFile(NULL) {
+}
+
+EventLogWriter::~EventLogWriter() {
+    close();
+}
+
+status_t EventLogWriter::open(const char* path) {
+    close();
+
+    mFile = fopen(path, "wb");
+    if (!mFile) {
+        return -errno;
+    }
+
+    writeInt32(EVENT_LOG_MAGIC);
+    writeInt32(EVENT_LOG_VERSION);
+    return OK;
+}
+
+void EventLogWriter::close() {
+    if (mFile) {
+        fclose(mFile);
+        mFile = NULL;
+    }
+}
+
+void EventLogWriter::writeDevice(const EventLogDevice& device) {
+    writeInt32(TAG_DEVICE);
+    writeInt32(device.id);
+    writeInt32(int32_t(device.classes));
+
+    const InputDeviceIdentifier& identifier = device.identifier;
+    writeString(identifier.name);
+    writeString(identifier.location);
+    writeString(identifier.uniqueId);
+    writeString(identifier.descriptor);
+    writeInt32(identifier.bus);
+    writeInt32(identifier.vendor);
+    writeInt32(identifier.product);
+    writeInt32(identifier.version);
+
+    writeInt32(int32_t(device.absoluteAxes.size()));
+    for (size_t i = 0; i < device.absoluteAxes.size(); i++) {
+        const RawAbsoluteAxisInfo& info = device.absoluteAxes.valueAt(i);
+        writeInt32(device.absoluteAxes.keyAt(i));
+        writeInt32(info.minValue);
+        writeInt32(info.maxValue);
+        writeInt32(info.flat);
+        writeInt32(info.fuzz);
+        writeInt32(info.resolution);
+    }
+
+    fwrite(device.keyBitmask, sizeof(device.keyBitmask), 1, mFile);
+    fwrite(device.relBitmask, sizeof(device.relBitmask), 1, mFile);
+    fwrite(device.swBitmask, sizeof(device.swBitmask), 1, mFile);
+    fwrite(device.ledBitmask, sizeof(device.ledBitmask), 1, mFile);
+    fwrite(device.propBitmask, sizeof(device.propBitmask), 1, mFile);
+}
+
+void EventLogWriter::writeEvents(const RawEvent* events, size_t count) {
+    if (!count) {
+        return;
+    }
+
+    writeInt32(TAG_EVENTS);
+    writeInt32(int32_t(count));
+    fwrite(events, sizeof(RawEvent), count, mFile);
+    fflush(mFile);
+}
+
+void EventLogWriter::writeInt32(int32_t value) {
+    fwrite(&value, sizeof(value), 1, mFile);
+}
+
+void EventLogWriter::writeString(const String8& value) {
+    writeInt32(int32_t(value.length()));
+    fwrite(value.string(), 1, value.length(), mFile);
+}
+
+
+// --- EventLogReader ---
+
+EventLogReader::EventLogReader() :
+        mFile(NULL) {
+}
+
+EventLogReader::~EventLogReader() {
+    close();
+}
+
+status_t EventLogReader::open(const char* path) {
+    close();
+
+    mFile = fopen(path, "rb");
+    if (!mFile) {
+        return -errno;
+    }
+
+    int32_t magic, version;
+    if (!readInt32(&magic) || !readInt32(&version)
+            || magic != EVENT_LOG_MAGIC || version != EVENT_LOG_VERSION) {
+        ALOGE("%s is not an input event log of version %d.", path, EVENT_LOG_VERSION);
+        close();
+        return BAD_VALUE;
+    }
+    return OK;
+}
+
+void EventLogReader::close() {
+    if (mFile) {
+        fclose(mFile);
+        mFile = NULL;
+    }
+}
+
+EventLogReader::RecordType EventLogReader::readRecord(EventLogDevice* outDevice,
+        Vector<RawEvent>* outEvents) {
+    int32_t tag;
+    if (!mFile || !readInt32(&tag)) {
+        return RECORD_NONE;
+    }
+
+    switch (tag) {
+    case TAG_DEVICE: {
+        int32_t classes, bus, vendor, product, version, axisCount;
+        InputDeviceIdentifier& identifier = outDevice->identifier;
+        if (!readInt32(&outDevice->id) || !readInt32(&classes)
+                || !readString(&identifier.name)
+                || !readString(&identifier.location)
+                || !readString(&identifier.uniqueId)
+                || !readString(&identifier.descriptor)
+                || !readInt32(&bus) || !readInt32(&vendor)
+                || !readInt32(&product) || !readInt32(&version)
+                || !readInt32(&axisCount)
+                || axisCount < 0 || axisCount > MAX_AXES) {
+            break;
+        }
+        outDevice->classes = uint32_t(classes);
+        identifier.bus = bus;
+        identifier.vendor = vendor;
+        identifier.product = product;
+        identifier.version = version;
+
+        outDevice->absoluteAxes.clear();
+        bool valid = true;
+        for (int32_t i = 0; valid && i < axisCount; i++) {
+            int32_t axis;
+            RawAbsoluteAxisInfo info;
+            info.valid = true;
+            valid = readInt32(&axis) && readInt32(&info.minValue) && readInt32(&info.maxValue)
+                    && readInt32(&info.flat) && readInt32(&info.fuzz)
+                    && readInt32(&info.resolution);
+            if (valid) {
+                outDevice->absoluteAxes.add(axis, info);
+            }
+        }
+        if (!valid
+                || !readBytes(outDevice->keyBitmask, sizeof(outDevice->keyBitmask))
+                || !readBytes(outDevice->relBitmask, sizeof(outDevice->relBitmask))
+                || !readBytes(outDevice->swBitmask, sizeof(outDevice->swBitmask))
+                || !readBytes(outDevice->ledBitmask, sizeof(outDevice->ledBitmask))
+                || !readBytes(outDevice->propBitmask, sizeof(outDevice->propBitmask))) {
+            break;
+        }
+        return RECORD_DEVICE;
+    }
+
+    case TAG_EVENTS: {
+        int32_t count;
+        if (!readInt32(&count) || count <= 0 || count > MAX_EVENTS_PER_RECORD) {
+            break;
+        }
+
+        size_t start = outEvents->size();
+        outEvents->insertAt(start, size_t(count));
+        if (!readBytes(outEvents->editArray() + start, sizeof(RawEvent) * count)) {
+            outEvents->removeItemsAt(start, size_t(count));
+            break;
+        }
+        return RECORD_EVENTS;
+    }
+
+    default:
+        break;
+    }
+
+    ALOGW("Ignoring the end of a truncated or malformed input event log.");
+    return RECORD_NONE;
+}
+
+bool EventLogReader::readInt32(int32_t* outValue) {
+    return readBytes(outValue, sizeof(*outValue));
+}
+
+bool EventLogReader::readString(String8* outValue) {
+    int32_t length;
+    if (!readInt32(&length) || length < 0 || length > MAX_STRING_LENGTH) {
+        return false;
+    }
+
+    char buffer[MAX_STRING_LENGTH + 1];
+    if (!readBytes(buffer, size_t(length))) {
+        return false;
+    }
+    outValue->setTo(buffer, size_t(length));
+    return true;
+}
+
+bool EventLogReader::readBytes(void* outData, size_t size) {
+    return !size || fread(outData, size, 1, mFile) == 1;
+}
+
+}; // namespace android
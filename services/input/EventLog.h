@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UI_INPUT_EVENT_LOG_H
+#define _UI_INPUT_EVENT_LOG_H
+
+#include "EventHub.h"
+
+#include <utils/Errors.h>
+#include <utils/KeyedVector.h>
+#include <utils/Vector.h>
+
+#include <stdio.h>
+
+namespace android {
+
+/*
+ * Describes a device of an event log, as it was reported by the EventHub when
+ * the device was added.
+ */
+struct EventLogDevice {
+    int32_t id;
+    uint32_t classes;
+    InputDeviceIdentifier identifier;
+
+    // Valid absolute axes only.
+    KeyedVector<int32_t, RawAbsoluteAxisInfo> absoluteAxes;
+
+    uint8_t keyBitmask[(KEY_MAX + 1) / 8];
+    uint8_t relBitmask[(REL_MAX + 1) / 8];
+    uint8_t swBitmask[(SW_MAX + 1) / 8];
+    uint8_t ledBitmask[(LED_MAX + 1) / 8];
+    uint8_t propBitmask[(INPUT_PROP_MAX + 1) / 8];
+
+    EventLogDevice();
+};
+
+/*
+ * Writes the devices and raw events reported by the EventHub to a binary log.
+ *
+ * The log starts with a header followed by a sequence of records, each record
+ * starting with its tag. A device record is written when the device is added,
+ * before the events record that holds its DEVICE_ADDED notification. Values are
+ * stored in the native byte order, the log is meant to be replayed on a device
+ * of the same architecture.
+ */
+class EventLogWriter {
+public:
+    EventLogWriter();
+    ~EventLogWriter();
+
+    status_t open(const char* path);
+    void close();
+
+    bool isOpen() const { return mFile != NULL; }
+
+    void writeDevice(const EventLogDevice& device);
+
+    /* Writes a batch of events and flushes the log. */
+    void writeEvents(const RawEvent* events, size_t count);
+
+private:
+    void writeInt32(int32_t value);
+    void writeString(const String8& value);
+
+    FILE* mFile;
+};
+
+/*
+ * Reads the records of a log written by EventLogWriter.
+ */
+class EventLogReader {
+public:
+    enum RecordType {
+        // The end of the log, or a truncated or malformed record.
+        RECORD_NONE,
+        RECORD_DEVICE,
+        RECORD_EVENTS,
+    };
+
+    EventLogReader();
+    ~EventLogReader();
+
+    status_t open(const char* path);
+    void close();
+
+    /*
+     * Reads the next record. A device record is stored in outDevice, the events of an
+     * events record are appended to outEvents.
+     */
+    RecordType readRecord(EventLogDevice* outDevice, Vector<RawEvent>* outEvents);
+
+private:
+    bool readInt32(int32_t* outValue);
+    bool readString(String8* outValue);
+    bool readBytes(void* outData, size_t size);
+
+    FILE* mFile;
+};
+
+}; // namespace android
+
+#endif // _UI_INPUT_EVENT_LOG_H
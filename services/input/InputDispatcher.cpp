@@ -50,6 +50,7 @@
 #include <androidfw/PowerManager.h>
 
 #include <stddef.h>
+#include <string.h>
 #include <unistd.h>
 #include <errno.h>
 #include <limits.h>
@@ -87,6 +88,25 @@ const nsecs_t SLOW_EVENT_PROCESSING_WARNING_TIMEOUT = 2000 * 1000000LL; // 2sec
 // Number of recent events to keep for debugging purposes.
 const size_t RECENT_QUEUE_MAX_SIZE = 10;
 
+// Number of rows and of columns of the grid of cells used to find the windows under a point.
+const int32_t WINDOW_INDEX_GRID_SIZE = 8;
+
+// Number of released entries of each type kept for reuse.
+const size_t MAX_FREE_KEY_ENTRIES = 16;
+const size_t MAX_FREE_MOTION_ENTRIES = 32;
+const size_t MAX_FREE_DISPATCH_ENTRIES = 64;
+const size_t MAX_FREE_COMMAND_ENTRIES = 16;
+
+template<typename T>
+inline static T min(const T& a, const T& b) {
+    return a < b ? a : b;
+}
+
+template<typename T>
+inline static T max(const T& a, const T& b) {
+    return a > b ? a : b;
+}
+
 static inline nsecs_t now() {
     return systemTime(SYSTEM_TIME_MONOTONIC);
 }
@@ -190,6 +210,38 @@ static void dumpRegion(String8& dump, const SkRegion& region) {
     }
 }
 
+// Lists of window indexes sorted front to back, as used by the window index.
+static void insertInZOrder(Vector<size_t>& windows, size_t window) {
+    size_t i = windows.size();
+    while (i > 0 && windows.itemAt(i - 1) > window) {
+        i--;
+    }
+    windows.insertAt(window, i);
+}
+
+static void removeFromZOrder(Vector<size_t>& windows, size_t window, bool shift) {
+    for (size_t i = 0; i < windows.size(); ) {
+        size_t other = windows.itemAt(i);
+        if (other == window) {
+            windows.removeAt(i);
+            continue;
+        }
+        if (shift && other > window) {
+            windows.editItemAt(i) = other - 1;
+        }
+        i++;
+    }
+}
+
+static void shiftZOrder(Vector<size_t>& windows, size_t window) {
+    for (size_t i = 0; i < windows.size(); i++) {
+        size_t other = windows.itemAt(i);
+        if (other >= window) {
+            windows.editItemAt(i) = other + 1;
+        }
+    }
+}
+
 
 // --- InputDispatcher ---
 
@@ -255,6 +307,8 @@ void InputDispatcher::dispatchOnceInnerLocked(nsecs_t* nextWakeupTime) {
         resetKeyRepeatLocked();
     }
 
+    transferIncomingEventsLocked();
+
     // If dispatching is frozen, do not process timeouts or try to deliver any new events.
     if (mDispatchFrozen) {
 #if DEBUG_FOCUS
@@ -300,6 +354,7 @@ void InputDispatcher::dispatchOnceInnerLocked(nsecs_t* nextWakeupTime) {
         } else {
             // Inbound queue has at least one entry.
             mPendingEvent = mInboundQueue.dequeueAtHead();
+            mPendingEvent->dequeueTime = currentTime;
             traceInboundQueueLengthLocked();
         }
 
@@ -457,6 +512,30 @@ bool InputDispatcher::enqueueInboundEventLocked(EventEntry* entry) {
     return needWake;
 }
 
+bool InputDispatcher::enqueueIncomingEvent(EventEntry* entry) {
+    // The dispatcher thread takes every incoming event at once, it only needs
+    // to be woken up for the first one.
+    bool needWake = mIncomingQueue.isEmpty();
+    entry->queueTime = now();
+    mIncomingQueue.enqueueAtTail(entry);
+    return needWake;
+}
+
+void InputDispatcher::transferIncomingEventsLocked() {
+    Queue<EventEntry> incomingQueue;
+    { // acquire lock
+        AutoMutex _l(mIncomingLock);
+        incomingQueue = mIncomingQueue;
+        mIncomingQueue.head = NULL;
+        mIncomingQueue.tail = NULL;
+    } // release lock
+
+    // Dispatch is already under way, enqueueInboundEventLocked does not need to wake it.
+    while (!incomingQueue.isEmpty()) {
+        enqueueInboundEventLocked(incomingQueue.dequeueAtHead());
+    }
+}
+
 void InputDispatcher::addRecentEventLocked(EventEntry* entry) {
     entry->refCount += 1;
     mRecentQueue.enqueueAtTail(entry);
@@ -468,9 +547,10 @@ void InputDispatcher::addRecentEventLocked(EventEntry* entry) {
 sp<InputWindowHandle> InputDispatcher::findTouchedWindowAtLocked(int32_t displayId,
         int32_t x, int32_t y) {
     // Traverse windows from front to back to find touched window.
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
-        sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
+    const Vector<size_t>& candidates = mWindowIndex.getTouchCandidates(displayId, x, y);
+    size_t numCandidates = candidates.size();
+    for (size_t i = 0; i < numCandidates; i++) {
+        sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(candidates[i]);
         const InputWindowInfo* windowInfo = windowHandle->getInfo();
         if (windowInfo->displayId == displayId) {
             int32_t flags = windowInfo->layoutParamsFlags;
@@ -609,6 +689,7 @@ InputDispatcher::CommandEntry* InputDispatcher::postCommandLocked(Command comman
 }
 
 void InputDispatcher::drainInboundQueueLocked() {
+    transferIncomingEventsLocked();
     while (! mInboundQueue.isEmpty()) {
         EventEntry* entry = mInboundQueue.dequeueAtHead();
         releaseInboundEventLocked(entry);
@@ -1208,9 +1289,10 @@ int32_t InputDispatcher::findTouchedWindowTargetsLocked(nsecs_t currentTime,
         bool isTouchModal = false;
 
         // Traverse windows from front to back to find touched window and outside targets.
-        size_t numWindows = mWindowHandles.size();
-        for (size_t i = 0; i < numWindows; i++) {
-            sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
+        const Vector<size_t>& candidates = mWindowIndex.getTouchCandidates(displayId, x, y);
+        size_t numCandidates = candidates.size();
+        for (size_t i = 0; i < numCandidates; i++) {
+            sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(candidates[i]);
             const InputWindowInfo* windowInfo = windowHandle->getInfo();
             if (windowInfo->displayId != displayId) {
                 continue; // wrong display
@@ -1643,13 +1725,17 @@ bool InputDispatcher::checkInjectionPermission(const sp<InputWindowHandle>& wind
 bool InputDispatcher::isWindowObscuredAtPointLocked(
         const sp<InputWindowHandle>& windowHandle, int32_t x, int32_t y) const {
     int32_t displayId = windowHandle->getInfo()->displayId;
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
-        sp<InputWindowHandle> otherHandle = mWindowHandles.itemAt(i);
-        if (otherHandle == windowHandle) {
+    // Only the windows in front of this one can obscure it
+    ssize_t zOrder = mWindowIndex.getZOrder(windowHandle);
+    const Vector<size_t>& candidates = mWindowIndex.getObscuringCandidates(displayId, x, y);
+    size_t numCandidates = candidates.size();
+    for (size_t i = 0; i < numCandidates; i++) {
+        if (zOrder >= 0 && candidates[i] >= size_t(zOrder)) {
             break;
         }
 
+        sp<InputWindowHandle> otherHandle = mWindowHandles.itemAt(candidates[i]);
+
         const InputWindowInfo* otherInfo = otherHandle->getInfo();
         if (otherInfo->displayId == displayId
                 && otherInfo->visible && !otherInfo->isTrustedOverlay()
@@ -1915,6 +2001,12 @@ void InputDispatcher::enqueueDispatchEntryLocked(
     }
     }
 
+    // Drop the previous move if it is still waiting to be published, the new sample
+    // supersedes it.
+    if (dispatchEntry->resolvedAction == AMOTION_EVENT_ACTION_MOVE) {
+        coalesceOutboundMotionLocked(connection, dispatchEntry);
+    }
+
     // Remember that we are waiting for this dispatch to complete.
     if (dispatchEntry->hasForegroundTarget()) {
         incrementPendingForegroundDispatchesLocked(eventEntry);
@@ -1925,6 +2017,48 @@ void InputDispatcher::enqueueDispatchEntryLocked(
     traceOutboundQueueLengthLocked(connection);
 }
 
+void InputDispatcher::coalesceOutboundMotionLocked(const sp<Connection>& connection,
+        const DispatchEntry* dispatchEntry) {
+    DispatchEntry* tailEntry = connection->outboundQueue.tail;
+    if (!tailEntry
+            || tailEntry->eventEntry->type != EventEntry::TYPE_MOTION
+            || tailEntry->resolvedAction != dispatchEntry->resolvedAction
+            || tailEntry->resolvedFlags != dispatchEntry->resolvedFlags
+            || tailEntry->targetFlags != dispatchEntry->targetFlags
+            || tailEntry->xOffset != dispatchEntry->xOffset
+            || tailEntry->yOffset != dispatchEntry->yOffset
+            || tailEntry->scaleFactor != dispatchEntry->scaleFactor) {
+        return;
+    }
+
+    const MotionEntry* tailMotionEntry = static_cast<const MotionEntry*>(
+            tailEntry->eventEntry);
+    const MotionEntry* motionEntry = static_cast<const MotionEntry*>(
+            dispatchEntry->eventEntry);
+    if (tailMotionEntry->deviceId != motionEntry->deviceId
+            || tailMotionEntry->source != motionEntry->source
+            || tailMotionEntry->displayId != motionEntry->displayId
+            || tailMotionEntry->metaState != motionEntry->metaState
+            || tailMotionEntry->buttonState != motionEntry->buttonState
+            || tailMotionEntry->pointerCount != motionEntry->pointerCount) {
+        return;
+    }
+    for (uint32_t i = 0; i < motionEntry->pointerCount; i++) {
+        if (tailMotionEntry->pointerProperties[i].id != motionEntry->pointerProperties[i].id
+                || tailMotionEntry->pointerProperties[i].toolType
+                        != motionEntry->pointerProperties[i].toolType) {
+            return;
+        }
+    }
+
+#if DEBUG_DISPATCH_CYCLE
+    ALOGD("channel '%s' ~ coalesceOutboundMotion: dropping move superseded by a newer sample",
+            connection->getInputChannelName());
+#endif
+    connection->outboundQueue.dequeue(tailEntry);
+    releaseDispatchEntryLocked(tailEntry);
+}
+
 void InputDispatcher::startDispatchCycleLocked(nsecs_t currentTime,
         const sp<Connection>& connection) {
 #if DEBUG_DISPATCH_CYCLE
@@ -2322,6 +2456,8 @@ InputDispatcher::splitMotionEvent(const MotionEntry* originalMotionEntry, BitSet
         splitMotionEntry->injectionState = originalMotionEntry->injectionState;
         splitMotionEntry->injectionState->refCount += 1;
     }
+    splitMotionEntry->queueTime = originalMotionEntry->queueTime;
+    splitMotionEntry->dequeueTime = originalMotionEntry->dequeueTime;
 
     return splitMotionEntry;
 }
@@ -2333,10 +2469,10 @@ void InputDispatcher::notifyConfigurationChanged(const NotifyConfigurationChange
 
     bool needWake;
     { // acquire lock
-        AutoMutex _l(mLock);
+        AutoMutex _l(mIncomingLock);
 
         ConfigurationChangedEntry* newEntry = new ConfigurationChangedEntry(args->eventTime);
-        needWake = enqueueInboundEventLocked(newEntry);
+        needWake = enqueueIncomingEvent(newEntry);
     } // release lock
 
     if (needWake) {
@@ -2394,17 +2530,17 @@ void InputDispatcher::notifyKey(const NotifyKeyArgs* args) {
 
     bool needWake;
     { // acquire lock
-        mLock.lock();
+        mIncomingLock.lock();
 
         if (shouldSendKeyToInputFilterLocked(args)) {
-            mLock.unlock();
+            mIncomingLock.unlock();
 
             policyFlags |= POLICY_FLAG_FILTERED;
             if (!mPolicy->filterInputEvent(&event, policyFlags)) {
                 return; // event was consumed by the filter
             }
 
-            mLock.lock();
+            mIncomingLock.lock();
         }
 
         int32_t repeatCount = 0;
@@ -2413,8 +2549,8 @@ void InputDispatcher::notifyKey(const NotifyKeyArgs* args) {
                 args->action, flags, args->keyCode, args->scanCode,
                 metaState, repeatCount, args->downTime);
 
-        needWake = enqueueInboundEventLocked(newEntry);
-        mLock.unlock();
+        needWake = enqueueIncomingEvent(newEntry);
+        mIncomingLock.unlock();
     } // release lock
 
     if (needWake) {
@@ -2462,10 +2598,10 @@ void InputDispatcher::notifyMotion(const NotifyMotionArgs* args) {
 
     bool needWake;
     { // acquire lock
-        mLock.lock();
+        mIncomingLock.lock();
 
         if (shouldSendMotionToInputFilterLocked(args)) {
-            mLock.unlock();
+            mIncomingLock.unlock();
 
             MotionEvent event;
             event.initialize(args->deviceId, args->source, args->action, args->flags,
@@ -2479,7 +2615,7 @@ void InputDispatcher::notifyMotion(const NotifyMotionArgs* args) {
                 return; // event was consumed by the filter
             }
 
-            mLock.lock();
+            mIncomingLock.lock();
         }
 
         // Just enqueue a new motion event.
@@ -2490,8 +2626,8 @@ void InputDispatcher::notifyMotion(const NotifyMotionArgs* args) {
                 args->displayId,
                 args->pointerCount, args->pointerProperties, args->pointerCoords);
 
-        needWake = enqueueInboundEventLocked(newEntry);
-        mLock.unlock();
+        needWake = enqueueIncomingEvent(newEntry);
+        mIncomingLock.unlock();
     } // release lock
 
     if (needWake) {
@@ -2525,10 +2661,10 @@ void InputDispatcher::notifyDeviceReset(const NotifyDeviceResetArgs* args) {
 
     bool needWake;
     { // acquire lock
-        AutoMutex _l(mLock);
+        AutoMutex _l(mIncomingLock);
 
         DeviceResetEntry* newEntry = new DeviceResetEntry(args->eventTime, args->deviceId);
-        needWake = enqueueInboundEventLocked(newEntry);
+        needWake = enqueueIncomingEvent(newEntry);
     } // release lock
 
     if (needWake) {
@@ -2785,13 +2921,79 @@ sp<InputWindowHandle> InputDispatcher::getWindowHandleLocked(
 
 bool InputDispatcher::hasWindowHandleLocked(
         const sp<InputWindowHandle>& windowHandle) const {
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
-        if (mWindowHandles.itemAt(i) == windowHandle) {
-            return true;
+    return mWindowIndex.getZOrder(windowHandle) >= 0;
+}
+
+void InputDispatcher::insertWindowHandleLocked(const sp<InputWindowHandle>& windowHandle) {
+    // Windows are ordered front to back.
+    int32_t layer = windowHandle->getInfo()->layer;
+    size_t index = 0;
+    while (index < mWindowHandles.size()
+            && mWindowHandles.itemAt(index)->getInfo()->layer >= layer) {
+        index++;
+    }
+    mWindowHandles.insertAt(windowHandle, index);
+    mWindowIndex.insertWindow(mWindowHandles, index);
+}
+
+void InputDispatcher::removeWindowHandleLocked(size_t index) {
+    sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(index);
+    mWindowHandles.removeAt(index);
+    mWindowIndex.removeWindow(windowHandle.get(), index);
+}
+
+void InputDispatcher::updateFocusedWindowLocked() {
+    sp<InputWindowHandle> newFocusedWindowHandle;
+    for (size_t i = 0; i < mWindowHandles.size(); i++) {
+        const sp<InputWindowHandle>& windowHandle = mWindowHandles.itemAt(i);
+        if (windowHandle->getInfo()->hasFocus) {
+            newFocusedWindowHandle = windowHandle;
+        }
+    }
+
+    if (mFocusedWindowHandle != newFocusedWindowHandle) {
+        if (mFocusedWindowHandle != NULL) {
+#if DEBUG_FOCUS
+            ALOGD("Focus left window: %s",
+                    mFocusedWindowHandle->getName().string());
+#endif
+            sp<InputChannel> focusedInputChannel = mFocusedWindowHandle->getInputChannel();
+            if (focusedInputChannel != NULL) {
+                CancelationOptions options(CancelationOptions::CANCEL_NON_POINTER_EVENTS,
+                        "focus left window");
+                synthesizeCancelationEventsForInputChannelLocked(
+                        focusedInputChannel, options);
+            }
+        }
+        if (newFocusedWindowHandle != NULL) {
+#if DEBUG_FOCUS
+            ALOGD("Focus entered window: %s",
+                    newFocusedWindowHandle->getName().string());
+#endif
+        }
+        mFocusedWindowHandle = newFocusedWindowHandle;
+    }
+}
+
+void InputDispatcher::cancelRemovedTouchedWindowsLocked() {
+    for (size_t i = 0; i < mTouchState.windows.size(); i++) {
+        TouchedWindow& touchedWindow = mTouchState.windows.editItemAt(i);
+        if (!hasWindowHandleLocked(touchedWindow.windowHandle)) {
+#if DEBUG_FOCUS
+            ALOGD("Touched window was removed: %s",
+                    touchedWindow.windowHandle->getName().string());
+#endif
+            sp<InputChannel> touchedInputChannel =
+                    touchedWindow.windowHandle->getInputChannel();
+            if (touchedInputChannel != NULL) {
+                CancelationOptions options(CancelationOptions::CANCEL_POINTER_EVENTS,
+                        "touched window was removed");
+                synthesizeCancelationEventsForInputChannelLocked(
+                        touchedInputChannel, options);
+            }
+            mTouchState.windows.removeAt(i--);
         }
     }
-    return false;
 }
 
 void InputDispatcher::setInputWindows(const Vector<sp<InputWindowHandle> >& inputWindowHandles) {
@@ -2804,7 +3006,6 @@ void InputDispatcher::setInputWindows(const Vector<sp<InputWindowHandle> >& inpu
         Vector<sp<InputWindowHandle> > oldWindowHandles = mWindowHandles;
         mWindowHandles = inputWindowHandles;
 
-        sp<InputWindowHandle> newFocusedWindowHandle;
         bool foundHoveredWindow = false;
         for (size_t i = 0; i < mWindowHandles.size(); i++) {
             const sp<InputWindowHandle>& windowHandle = mWindowHandles.itemAt(i);
@@ -2812,9 +3013,6 @@ void InputDispatcher::setInputWindows(const Vector<sp<InputWindowHandle> >& inpu
                 mWindowHandles.removeAt(i--);
                 continue;
             }
-            if (windowHandle->getInfo()->hasFocus) {
-                newFocusedWindowHandle = windowHandle;
-            }
             if (windowHandle == mLastHoverWindowHandle) {
                 foundHoveredWindow = true;
             }
@@ -2824,59 +3022,102 @@ void InputDispatcher::setInputWindows(const Vector<sp<InputWindowHandle> >& inpu
             mLastHoverWindowHandle = NULL;
         }
 
-        if (mFocusedWindowHandle != newFocusedWindowHandle) {
-            if (mFocusedWindowHandle != NULL) {
+        mWindowIndex.rebuild(mWindowHandles);
+
+        updateFocusedWindowLocked();
+        cancelRemovedTouchedWindowsLocked();
+
+        // Release information for windows that are no longer present.
+        // This ensures that unused input channels are released promptly.
+        // Otherwise, they might stick around until the window handle is destroyed
+        // which might not happen until the next GC.
+        for (size_t i = 0; i < oldWindowHandles.size(); i++) {
+            const sp<InputWindowHandle>& oldWindowHandle = oldWindowHandles.itemAt(i);
+            if (!hasWindowHandleLocked(oldWindowHandle)) {
 #if DEBUG_FOCUS
-                ALOGD("Focus left window: %s",
-                        mFocusedWindowHandle->getName().string());
+                ALOGD("Window went away: %s", oldWindowHandle->getName().string());
 #endif
-                sp<InputChannel> focusedInputChannel = mFocusedWindowHandle->getInputChannel();
-                if (focusedInputChannel != NULL) {
-                    CancelationOptions options(CancelationOptions::CANCEL_NON_POINTER_EVENTS,
-                            "focus left window");
-                    synthesizeCancelationEventsForInputChannelLocked(
-                            focusedInputChannel, options);
-                }
+                oldWindowHandle->releaseInfo();
             }
-            if (newFocusedWindowHandle != NULL) {
+        }
+    } // release lock
+
+    // Wake up poll loop since it may need to make new input dispatching choices.
+    mLooper->wake();
+}
+
+void InputDispatcher::updateInputWindows(
+        const Vector<sp<InputWindowHandle> >& updatedWindowHandles,
+        const Vector<sp<InputWindowHandle> >& removedWindowHandles) {
 #if DEBUG_FOCUS
-                ALOGD("Focus entered window: %s",
-                        newFocusedWindowHandle->getName().string());
+    ALOGD("updateInputWindows: %d updated, %d removed",
+            updatedWindowHandles.size(), removedWindowHandles.size());
 #endif
+    { // acquire lock
+        AutoMutex _l(mLock);
+
+        // Only the windows that changed are updated, the focus and the touch state are
+        // only checked again when one of them may be affected.
+        Vector<sp<InputWindowHandle> > goneWindowHandles;
+        bool focusMayChange = false;
+
+        for (size_t i = 0; i < removedWindowHandles.size(); i++) {
+            const sp<InputWindowHandle>& windowHandle = removedWindowHandles.itemAt(i);
+            ssize_t index = mWindowIndex.getZOrder(windowHandle);
+            if (index >= 0) {
+                removeWindowHandleLocked(index);
+                goneWindowHandles.push(windowHandle);
+                focusMayChange |= windowHandle == mFocusedWindowHandle;
             }
-            mFocusedWindowHandle = newFocusedWindowHandle;
         }
 
-        for (size_t i = 0; i < mTouchState.windows.size(); i++) {
-            TouchedWindow& touchedWindow = mTouchState.windows.editItemAt(i);
-            if (!hasWindowHandleLocked(touchedWindow.windowHandle)) {
-#if DEBUG_FOCUS
-                ALOGD("Touched window was removed: %s",
-                        touchedWindow.windowHandle->getName().string());
-#endif
-                sp<InputChannel> touchedInputChannel =
-                        touchedWindow.windowHandle->getInputChannel();
-                if (touchedInputChannel != NULL) {
-                    CancelationOptions options(CancelationOptions::CANCEL_POINTER_EVENTS,
-                            "touched window was removed");
-                    synthesizeCancelationEventsForInputChannelLocked(
-                            touchedInputChannel, options);
+        for (size_t i = 0; i < updatedWindowHandles.size(); i++) {
+            const sp<InputWindowHandle>& windowHandle = updatedWindowHandles.itemAt(i);
+            ssize_t index = mWindowIndex.getZOrder(windowHandle);
+            int32_t oldLayer = index >= 0 ? windowHandle->getInfo()->layer : 0;
+            if (!windowHandle->updateInfo() || windowHandle->getInputChannel() == NULL) {
+                if (index >= 0) {
+                    removeWindowHandleLocked(index);
+                    goneWindowHandles.push(windowHandle);
+                    focusMayChange |= windowHandle == mFocusedWindowHandle;
                 }
-                mTouchState.windows.removeAt(i--);
+                continue;
+            }
+
+            focusMayChange |= windowHandle->getInfo()->hasFocus
+                    || windowHandle == mFocusedWindowHandle;
+            if (index < 0) {
+                insertWindowHandleLocked(windowHandle);
+            } else if (windowHandle->getInfo()->layer != oldLayer) {
+                removeWindowHandleLocked(index);
+                insertWindowHandleLocked(windowHandle);
+            } else {
+                mWindowIndex.updateWindow(mWindowHandles, index);
             }
         }
 
-        // Release information for windows that are no longer present.
-        // This ensures that unused input channels are released promptly.
-        // Otherwise, they might stick around until the window handle is destroyed
-        // which might not happen until the next GC.
-        for (size_t i = 0; i < oldWindowHandles.size(); i++) {
-            const sp<InputWindowHandle>& oldWindowHandle = oldWindowHandles.itemAt(i);
-            if (!hasWindowHandleLocked(oldWindowHandle)) {
+        mWindowIndex.rebuildIfStale(mWindowHandles);
+
+        if (focusMayChange) {
+            updateFocusedWindowLocked();
+        }
+
+        if (!goneWindowHandles.isEmpty()) {
+            if (mLastHoverWindowHandle != NULL
+                    && !hasWindowHandleLocked(mLastHoverWindowHandle)) {
+                mLastHoverWindowHandle = NULL;
+            }
+
+            cancelRemovedTouchedWindowsLocked();
+
+            for (size_t i = 0; i < goneWindowHandles.size(); i++) {
+                const sp<InputWindowHandle>& windowHandle = goneWindowHandles.itemAt(i);
+                if (!hasWindowHandleLocked(windowHandle)) {
 #if DEBUG_FOCUS
-                ALOGD("Window went away: %s", oldWindowHandle->getName().string());
+                    ALOGD("Window went away: %s", windowHandle->getName().string());
 #endif
-                oldWindowHandle->releaseInfo();
+                    windowHandle->releaseInfo();
+                }
             }
         }
     } // release lock
@@ -2964,7 +3205,10 @@ void InputDispatcher::setInputFilterEnabled(bool enabled) {
             return;
         }
 
-        mInputFilterEnabled = enabled;
+        { // acquire lock
+            AutoMutex _il(mIncomingLock);
+            mInputFilterEnabled = enabled;
+        } // release lock
         resetAndDropEverythingLocked("input filter is being enabled or disabled");
     } // release lock
 
@@ -3238,6 +3482,9 @@ void InputDispatcher::dumpDispatchStateLocked(String8& dump) {
             } else {
                 dump.append(INDENT3 "WaitQueue: <empty>\n");
             }
+
+            connection->keyLatency.dump(dump, "KeyLatency");
+            connection->motionLatency.dump(dump, "MotionLatency");
         }
     } else {
         dump.append(INDENT "Connections: <none>\n");
@@ -3482,6 +3729,12 @@ void InputDispatcher::doDispatchCycleFinishedLockedInterruptible(
     // Handle post-event policy actions.
     DispatchEntry* dispatchEntry = connection->findWaitQueueEntry(seq);
     if (dispatchEntry) {
+        if (dispatchEntry->eventEntry->type == EventEntry::TYPE_KEY) {
+            connection->keyLatency.add(dispatchEntry, finishTime);
+        } else if (dispatchEntry->eventEntry->type == EventEntry::TYPE_MOTION) {
+            connection->motionLatency.add(dispatchEntry, finishTime);
+        }
+
         nsecs_t eventDuration = finishTime - dispatchEntry->deliveryTime;
         if (eventDuration > SLOW_EVENT_PROCESSING_WARNING_TIMEOUT) {
             String8 msg;
@@ -3775,6 +4028,47 @@ uint32_t InputDispatcher::Queue<T>::count() const {
 }
 
 
+// --- InputDispatcher::EntryPool ---
+
+InputDispatcher::EntryPool::EntryPool(size_t blockSize, size_t maxFreeBlocks) :
+        mBlockSize(blockSize), mMaxFreeBlocks(maxFreeBlocks),
+        mFreeBlockCount(0), mFreeBlocks(NULL) {
+}
+
+void* InputDispatcher::EntryPool::allocate(size_t size) {
+    if (size <= mBlockSize) {
+        AutoMutex _l(mLock);
+        if (mFreeBlocks) {
+            FreeBlock* block = mFreeBlocks;
+            mFreeBlocks = block->next;
+            mFreeBlockCount -= 1;
+            return block;
+        }
+        size = mBlockSize;
+    }
+    return ::operator new(size);
+}
+
+void InputDispatcher::EntryPool::release(void* block) {
+    if (!block) {
+        return;
+    }
+
+    { // acquire lock
+        AutoMutex _l(mLock);
+        // Blocks are never smaller than mBlockSize, so any of them can be reused
+        if (mFreeBlockCount < mMaxFreeBlocks) {
+            FreeBlock* freeBlock = static_cast<FreeBlock*>(block);
+            freeBlock->next = mFreeBlocks;
+            mFreeBlocks = freeBlock;
+            mFreeBlockCount += 1;
+            return;
+        }
+    } // release lock
+    ::operator delete(block);
+}
+
+
 // --- InputDispatcher::InjectionState ---
 
 InputDispatcher::InjectionState::InjectionState(int32_t injectorPid, int32_t injectorUid) :
@@ -3801,7 +4095,7 @@ void InputDispatcher::InjectionState::release() {
 
 InputDispatcher::EventEntry::EventEntry(int32_t type, nsecs_t eventTime, uint32_t policyFlags) :
         refCount(1), type(type), eventTime(eventTime), policyFlags(policyFlags),
-        injectionState(NULL), dispatchInProgress(false) {
+        injectionState(NULL), queueTime(0), dequeueTime(0), dispatchInProgress(false) {
 }
 
 InputDispatcher::EventEntry::~EventEntry() {
@@ -3873,6 +4167,16 @@ InputDispatcher::KeyEntry::KeyEntry(nsecs_t eventTime,
 InputDispatcher::KeyEntry::~KeyEntry() {
 }
 
+InputDispatcher::EntryPool InputDispatcher::KeyEntry::sPool(sizeof(KeyEntry), MAX_FREE_KEY_ENTRIES);
+
+void* InputDispatcher::KeyEntry::operator new(size_t size) {
+    return sPool.allocate(size);
+}
+
+void InputDispatcher::KeyEntry::operator delete(void* ptr) {
+    sPool.release(ptr);
+}
+
 void InputDispatcher::KeyEntry::appendDescription(String8& msg) const {
     msg.appendFormat("KeyEvent(deviceId=%d, source=0x%08x, action=%d, "
             "flags=0x%08x, keyCode=%d, scanCode=%d, metaState=0x%08x, "
@@ -3914,6 +4218,16 @@ InputDispatcher::MotionEntry::MotionEntry(nsecs_t eventTime,
 InputDispatcher::MotionEntry::~MotionEntry() {
 }
 
+InputDispatcher::EntryPool InputDispatcher::MotionEntry::sPool(sizeof(MotionEntry), MAX_FREE_MOTION_ENTRIES);
+
+void* InputDispatcher::MotionEntry::operator new(size_t size) {
+    return sPool.allocate(size);
+}
+
+void InputDispatcher::MotionEntry::operator delete(void* ptr) {
+    sPool.release(ptr);
+}
+
 void InputDispatcher::MotionEntry::appendDescription(String8& msg) const {
     msg.appendFormat("MotionEvent(deviceId=%d, source=0x%08x, action=%d, "
             "flags=0x%08x, metaState=0x%08x, buttonState=0x%08x, edgeFlags=0x%08x, "
@@ -3948,6 +4262,16 @@ InputDispatcher::DispatchEntry::~DispatchEntry() {
     eventEntry->release();
 }
 
+InputDispatcher::EntryPool InputDispatcher::DispatchEntry::sPool(sizeof(DispatchEntry), MAX_FREE_DISPATCH_ENTRIES);
+
+void* InputDispatcher::DispatchEntry::operator new(size_t size) {
+    return sPool.allocate(size);
+}
+
+void InputDispatcher::DispatchEntry::operator delete(void* ptr) {
+    sPool.release(ptr);
+}
+
 uint32_t InputDispatcher::DispatchEntry::nextSeq() {
     // Sequence number 0 is reserved and will never be returned.
     uint32_t seq;
@@ -4290,6 +4614,99 @@ bool InputDispatcher::InputState::shouldCancelMotion(const MotionMemento& mement
 }
 
 
+// --- InputDispatcher::LatencyHistogram ---
+
+InputDispatcher::LatencyHistogram::LatencyHistogram() :
+        mCount(0) {
+    memset(mBuckets, 0, sizeof(mBuckets));
+}
+
+void InputDispatcher::LatencyHistogram::add(nsecs_t latency) {
+    mBuckets[getBucket(latency)] += 1;
+    mCount += 1;
+}
+
+nsecs_t InputDispatcher::LatencyHistogram::getPercentile(uint32_t percentile) const {
+    if (!mCount) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t(mCount) * percentile + 99) / 100;
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t count = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        count += mBuckets[i];
+        if (count >= rank) {
+            return getBucketUpperBound(i);
+        }
+    }
+    return getBucketUpperBound(BUCKET_COUNT - 1);
+}
+
+size_t InputDispatcher::LatencyHistogram::getBucket(nsecs_t latency) {
+    if (latency < 4000) {
+        return latency > 0 ? size_t(latency / 1000) : 0;
+    }
+
+    // The two bits after the most significant bit of the latency in microseconds
+    // select one of the four buckets of its power of two.
+    uint32_t us = uint32_t(min<nsecs_t>(latency / 1000, 0xffffffffLL));
+    int32_t exponent = 31 - __builtin_clz(us);
+    size_t bucket = size_t(exponent * 4 + ((us >> (exponent - 2)) & 3) - 4);
+    return min<size_t>(bucket, BUCKET_COUNT - 1);
+}
+
+nsecs_t InputDispatcher::LatencyHistogram::getBucketUpperBound(size_t bucket) {
+    if (bucket < 4) {
+        return nsecs_t(bucket + 1) * 1000;
+    }
+
+    int32_t exponent = int32_t(bucket + 4) / 4;
+    int64_t fraction = int64_t(bucket + 4) % 4;
+    return ((5 + fraction) << (exponent - 2)) * 1000;
+}
+
+
+// --- InputDispatcher::LatencyStatistics ---
+
+void InputDispatcher::LatencyStatistics::add(const DispatchEntry* dispatchEntry,
+        nsecs_t finishTime) {
+    // Only the events that went through every stage are recorded, which excludes
+    // injected and synthesized events.
+    const EventEntry* eventEntry = dispatchEntry->eventEntry;
+    if (!eventEntry->queueTime || !eventEntry->dequeueTime) {
+        return;
+    }
+
+    stages[STAGE_READER].add(eventEntry->queueTime - eventEntry->eventTime);
+    stages[STAGE_INBOUND].add(eventEntry->dequeueTime - eventEntry->queueTime);
+    stages[STAGE_PUBLISH].add(dispatchEntry->deliveryTime - eventEntry->dequeueTime);
+    stages[STAGE_FINISH].add(finishTime - dispatchEntry->deliveryTime);
+    stages[STAGE_TOTAL].add(finishTime - eventEntry->eventTime);
+}
+
+void InputDispatcher::LatencyStatistics::dump(String8& dump, const char* label) const {
+    uint32_t count = stages[STAGE_TOTAL].getCount();
+    if (!count) {
+        dump.appendFormat(INDENT3 "%s: <none>\n", label);
+        return;
+    }
+
+    static const char* const STAGE_LABELS[STAGE_COUNT] = {
+        "reader", "inbound", "publish", "finish", "total",
+    };
+    dump.appendFormat(INDENT3 "%s: count=%u, p50/p99 in ms:", label, count);
+    for (size_t i = 0; i < STAGE_COUNT; i++) {
+        dump.appendFormat(" %s=%0.2f/%0.2f", STAGE_LABELS[i],
+                stages[i].getPercentile(50) * 0.000001f,
+                stages[i].getPercentile(99) * 0.000001f);
+    }
+    dump.append("\n");
+}
+
+
 // --- InputDispatcher::Connection ---
 
 InputDispatcher::Connection::Connection(const sp<InputChannel>& inputChannel,
@@ -4348,6 +4765,284 @@ InputDispatcher::CommandEntry::CommandEntry(Command command) :
 InputDispatcher::CommandEntry::~CommandEntry() {
 }
 
+InputDispatcher::EntryPool InputDispatcher::CommandEntry::sPool(sizeof(CommandEntry), MAX_FREE_COMMAND_ENTRIES);
+
+void* InputDispatcher::CommandEntry::operator new(size_t size) {
+    return sPool.allocate(size);
+}
+
+void InputDispatcher::CommandEntry::operator delete(void* ptr) {
+    sPool.release(ptr);
+}
+
+
+// --- InputDispatcher::WindowIndex ---
+
+InputDispatcher::WindowIndex::WindowIndex() :
+        stale(false) {
+}
+
+void InputDispatcher::WindowIndex::rebuild(const Vector<sp<InputWindowHandle> >& windowHandles) {
+    grids.clear();
+    zOrders.clear();
+    stale = false;
+
+    size_t numWindows = windowHandles.size();
+    for (size_t i = 0; i < numWindows; i++) {
+        zOrders.add(windowHandles.itemAt(i).get(), i);
+    }
+
+    // Bounds of each display, as the union of the frames and touchable regions of its windows
+    for (size_t i = 0; i < numWindows; i++) {
+        const InputWindowInfo* info = windowHandles.itemAt(i)->getInfo();
+        int32_t left, top, right, bottom;
+        getWindowBounds(info, &left, &top, &right, &bottom);
+
+        Grid* grid = NULL;
+        for (size_t j = 0; j < grids.size(); j++) {
+            if (grids[j].displayId == info->displayId) {
+                grid = &grids.editItemAt(j);
+                break;
+            }
+        }
+        if (!grid) {
+            Grid newGrid;
+            newGrid.displayId = info->displayId;
+            newGrid.left = left;
+            newGrid.top = top;
+            newGrid.right = right;
+            newGrid.bottom = bottom;
+            grid = &grids.editItemAt(grids.add(newGrid));
+        } else {
+            grid->left = min(grid->left, left);
+            grid->top = min(grid->top, top);
+            grid->right = max(grid->right, right);
+            grid->bottom = max(grid->bottom, bottom);
+        }
+    }
+
+    for (size_t i = 0; i < grids.size(); i++) {
+        Grid& grid = grids.editItemAt(i);
+        grid.right = max(grid.right, grid.left + 1);
+        grid.bottom = max(grid.bottom, grid.top + 1);
+        grid.cellWidth = (grid.right - grid.left + WINDOW_INDEX_GRID_SIZE - 1)
+                / WINDOW_INDEX_GRID_SIZE;
+        grid.cellHeight = (grid.bottom - grid.top + WINDOW_INDEX_GRID_SIZE - 1)
+                / WINDOW_INDEX_GRID_SIZE;
+        grid.touchCells.insertAt(Vector<size_t>(), 0,
+                WINDOW_INDEX_GRID_SIZE * WINDOW_INDEX_GRID_SIZE);
+        grid.obscuringCells.insertAt(Vector<size_t>(), 0,
+                WINDOW_INDEX_GRID_SIZE * WINDOW_INDEX_GRID_SIZE);
+    }
+
+    // Windows are added front to back, so each list is in z order.
+    for (size_t i = 0; i < numWindows; i++) {
+        addWindow(windowHandles.itemAt(i)->getInfo(), i, false);
+    }
+}
+
+void InputDispatcher::WindowIndex::rebuildIfStale(
+        const Vector<sp<InputWindowHandle> >& windowHandles) {
+    if (stale) {
+        rebuild(windowHandles);
+    }
+}
+
+void InputDispatcher::WindowIndex::insertWindow(
+        const Vector<sp<InputWindowHandle> >& windowHandles, size_t window) {
+    for (size_t i = 0; i < zOrders.size(); i++) {
+        size_t& zOrder = zOrders.editValueAt(i);
+        if (zOrder >= window) {
+            zOrder += 1;
+        }
+    }
+    zOrders.add(windowHandles.itemAt(window).get(), window);
+
+    if (!stale) {
+        shiftCells(window);
+        stale = !addWindow(windowHandles.itemAt(window)->getInfo(), window, true);
+    }
+}
+
+void InputDispatcher::WindowIndex::removeWindow(const InputWindowHandle* windowHandle,
+        size_t window) {
+    zOrders.removeItem(windowHandle);
+    for (size_t i = 0; i < zOrders.size(); i++) {
+        size_t& zOrder = zOrders.editValueAt(i);
+        if (zOrder > window) {
+            zOrder -= 1;
+        }
+    }
+
+    if (!stale) {
+        removeFromCells(window, true);
+    }
+}
+
+void InputDispatcher::WindowIndex::updateWindow(
+        const Vector<sp<InputWindowHandle> >& windowHandles, size_t window) {
+    if (!stale) {
+        removeFromCells(window, false);
+        stale = !addWindow(windowHandles.itemAt(window)->getInfo(), window, true);
+    }
+}
+
+void InputDispatcher::WindowIndex::getWindowBounds(const InputWindowInfo* info,
+        int32_t* outLeft, int32_t* outTop, int32_t* outRight, int32_t* outBottom) {
+    *outLeft = info->frameLeft;
+    *outTop = info->frameTop;
+    *outRight = info->frameRight + 1;
+    *outBottom = info->frameBottom + 1;
+    if (!info->touchableRegion.isEmpty()) {
+        const SkIRect& touchableBounds = info->touchableRegion.getBounds();
+        *outLeft = min(*outLeft, touchableBounds.fLeft);
+        *outTop = min(*outTop, touchableBounds.fTop);
+        *outRight = max(*outRight, touchableBounds.fRight);
+        *outBottom = max(*outBottom, touchableBounds.fBottom);
+    }
+}
+
+bool InputDispatcher::WindowIndex::addWindow(const InputWindowInfo* info, size_t window,
+        bool mustFit) {
+    Grid* grid = const_cast<Grid*>(getGrid(info->displayId));
+    if (mustFit) {
+        // The cells of a grid cannot grow, a window outside of them needs a rebuild.
+        if (!grid) {
+            return false;
+        }
+        int32_t left, top, right, bottom;
+        getWindowBounds(info, &left, &top, &right, &bottom);
+        if (left < grid->left || top < grid->top
+                || right > grid->right || bottom > grid->bottom) {
+            return false;
+        }
+    }
+    int32_t flags = info->layoutParamsFlags;
+
+    // Same conditions as findTouchedWindowTargetsLocked, which must also see the
+    // error windows and the windows watching outside touches wherever the touch is.
+    bool anywhere = info->layoutParamsPrivateFlags
+            & InputWindowInfo::PRIVATE_FLAG_SYSTEM_ERROR;
+    if (info->visible) {
+        if (flags & InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH) {
+            anywhere = true;
+        }
+        if (!(flags & InputWindowInfo::FLAG_NOT_TOUCHABLE)) {
+            bool isTouchModal = (flags & (InputWindowInfo::FLAG_NOT_FOCUSABLE
+                    | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0;
+            if (isTouchModal) {
+                anywhere = true;
+            } else if (!anywhere && !info->touchableRegion.isEmpty()) {
+                const SkIRect& bounds = info->touchableRegion.getBounds();
+                addToCells(*grid, grid->touchCells, window,
+                        bounds.fLeft, bounds.fTop, bounds.fRight, bounds.fBottom);
+            }
+        }
+
+        if (!info->isTrustedOverlay()) {
+            addToCells(*grid, grid->obscuringCells, window, info->frameLeft, info->frameTop,
+                    info->frameRight + 1, info->frameBottom + 1);
+        }
+    }
+
+    if (anywhere) {
+        addToCells(*grid, grid->touchCells, window,
+                grid->left, grid->top, grid->right, grid->bottom);
+        insertInZOrder(grid->outsideTouch, window);
+    }
+    return true;
+}
+
+void InputDispatcher::WindowIndex::removeFromCells(size_t window, bool shift) {
+    for (size_t i = 0; i < grids.size(); i++) {
+        Grid& grid = grids.editItemAt(i);
+        for (size_t j = 0; j < grid.touchCells.size(); j++) {
+            removeFromZOrder(grid.touchCells.editItemAt(j), window, shift);
+        }
+        for (size_t j = 0; j < grid.obscuringCells.size(); j++) {
+            removeFromZOrder(grid.obscuringCells.editItemAt(j), window, shift);
+        }
+        removeFromZOrder(grid.outsideTouch, window, shift);
+    }
+}
+
+void InputDispatcher::WindowIndex::shiftCells(size_t window) {
+    for (size_t i = 0; i < grids.size(); i++) {
+        Grid& grid = grids.editItemAt(i);
+        for (size_t j = 0; j < grid.touchCells.size(); j++) {
+            shiftZOrder(grid.touchCells.editItemAt(j), window);
+        }
+        for (size_t j = 0; j < grid.obscuringCells.size(); j++) {
+            shiftZOrder(grid.obscuringCells.editItemAt(j), window);
+        }
+        shiftZOrder(grid.outsideTouch, window);
+    }
+}
+
+void InputDispatcher::WindowIndex::addToCells(Grid& grid, Vector<Vector<size_t> >& cells,
+        size_t window, int32_t left, int32_t top, int32_t right, int32_t bottom) {
+    left = max(left, grid.left);
+    top = max(top, grid.top);
+    right = min(right, grid.right);
+    bottom = min(bottom, grid.bottom);
+    if (left >= right || top >= bottom) {
+        return;
+    }
+
+    int32_t firstColumn = (left - grid.left) / grid.cellWidth;
+    int32_t lastColumn = (right - 1 - grid.left) / grid.cellWidth;
+    int32_t firstRow = (top - grid.top) / grid.cellHeight;
+    int32_t lastRow = (bottom - 1 - grid.top) / grid.cellHeight;
+    for (int32_t row = firstRow; row <= lastRow; row++) {
+        for (int32_t column = firstColumn; column <= lastColumn; column++) {
+            insertInZOrder(cells.editItemAt(row * WINDOW_INDEX_GRID_SIZE + column), window);
+        }
+    }
+}
+
+ssize_t InputDispatcher::WindowIndex::Grid::getCell(int32_t x, int32_t y) const {
+    if (x < left || x >= right || y < top || y >= bottom) {
+        return -1;
+    }
+    return ((y - top) / cellHeight) * WINDOW_INDEX_GRID_SIZE + (x - left) / cellWidth;
+}
+
+const InputDispatcher::WindowIndex::Grid* InputDispatcher::WindowIndex::getGrid(
+        int32_t displayId) const {
+    for (size_t i = 0; i < grids.size(); i++) {
+        if (grids[i].displayId == displayId) {
+            return &grids[i];
+        }
+    }
+    return NULL;
+}
+
+const Vector<size_t>& InputDispatcher::WindowIndex::getTouchCandidates(int32_t displayId,
+        int32_t x, int32_t y) const {
+    const Grid* grid = getGrid(displayId);
+    if (!grid) {
+        return empty;
+    }
+    ssize_t cell = grid->getCell(x, y);
+    return cell >= 0 ? grid->touchCells[cell] : grid->outsideTouch;
+}
+
+const Vector<size_t>& InputDispatcher::WindowIndex::getObscuringCandidates(int32_t displayId,
+        int32_t x, int32_t y) const {
+    const Grid* grid = getGrid(displayId);
+    if (!grid) {
+        return empty;
+    }
+    ssize_t cell = grid->getCell(x, y);
+    return cell >= 0 ? grid->obscuringCells[cell] : empty;
+}
+
+ssize_t InputDispatcher::WindowIndex::getZOrder(
+        const sp<InputWindowHandle>& windowHandle) const {
+    ssize_t index = zOrders.indexOfKey(windowHandle.get());
+    return index >= 0 ? ssize_t(zOrders.valueAt(index)) : -1;
+}
+
 
 // --- InputDispatcher::TouchState ---
 
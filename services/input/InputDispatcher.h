@@ -307,6 +307,16 @@ public:
      */
     virtual void setInputWindows(const Vector<sp<InputWindowHandle> >& inputWindowHandles) = 0;
 
+    /* Updates some of the input windows without resending the whole list.
+     * Windows are identified by their handle.  A window of updatedWindowHandles that is
+     * already present is updated in place, or moved if its layer changed.  Otherwise it is
+     * inserted behind the windows of higher or equal layers.
+     *
+     * This method may be called on any thread (usually by the input manager).
+     */
+    virtual void updateInputWindows(const Vector<sp<InputWindowHandle> >& updatedWindowHandles,
+            const Vector<sp<InputWindowHandle> >& removedWindowHandles) = 0;
+
     /* Sets the focused application.
      *
      * This method may be called on any thread (usually by the input manager).
@@ -386,6 +396,8 @@ public:
             uint32_t policyFlags);
 
     virtual void setInputWindows(const Vector<sp<InputWindowHandle> >& inputWindowHandles);
+    virtual void updateInputWindows(const Vector<sp<InputWindowHandle> >& updatedWindowHandles,
+            const Vector<sp<InputWindowHandle> >& removedWindowHandles);
     virtual void setFocusedApplication(const sp<InputApplicationHandle>& inputApplicationHandle);
     virtual void setInputDispatchMode(bool enabled, bool frozen);
     virtual void setInputFilterEnabled(bool enabled);
@@ -398,6 +410,28 @@ public:
     virtual status_t unregisterInputChannel(const sp<InputChannel>& inputChannel);
 
 private:
+    // A thread safe pool of fixed size blocks, which keeps up to maxFreeBlocks released
+    // blocks for reuse.  The entries allocated for each event and each target use one
+    // pool per type instead of the heap.
+    class EntryPool {
+    public:
+        EntryPool(size_t blockSize, size_t maxFreeBlocks);
+
+        void* allocate(size_t size);
+        void release(void* block);
+
+    private:
+        struct FreeBlock {
+            FreeBlock* next;
+        };
+
+        Mutex mLock;
+        const size_t mBlockSize;
+        const size_t mMaxFreeBlocks;
+        size_t mFreeBlockCount;
+        FreeBlock* mFreeBlocks;
+    };
+
     template <typename T>
     struct Link {
         T* next;
@@ -437,6 +471,9 @@ private:
         uint32_t policyFlags;
         InjectionState* injectionState;
 
+        nsecs_t queueTime; // time when the reader queued the event, 0 if it did not
+        nsecs_t dequeueTime; // time when the event left the inbound queue, 0 if it did not
+
         bool dispatchInProgress; // initially false, set to true while dispatching
 
         inline bool isInjected() const { return injectionState != NULL; }
@@ -498,8 +535,14 @@ private:
         virtual void appendDescription(String8& msg) const;
         void recycle();
 
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr);
+
     protected:
         virtual ~KeyEntry();
+
+    private:
+        static EntryPool sPool;
     };
 
     struct MotionEntry : EventEntry {
@@ -528,8 +571,14 @@ private:
                 const PointerProperties* pointerProperties, const PointerCoords* pointerCoords);
         virtual void appendDescription(String8& msg) const;
 
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr);
+
     protected:
         virtual ~MotionEntry();
+
+    private:
+        static EntryPool sPool;
     };
 
     // Tracks the progress of dispatching a particular event to a particular connection.
@@ -551,6 +600,9 @@ private:
                 int32_t targetFlags, float xOffset, float yOffset, float scaleFactor);
         ~DispatchEntry();
 
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr);
+
         inline bool hasForegroundTarget() const {
             return targetFlags & InputTarget::FLAG_FOREGROUND;
         }
@@ -560,6 +612,7 @@ private:
         }
 
     private:
+        static EntryPool sPool;
         static volatile int32_t sNextSeqAtomic;
 
         static uint32_t nextSeq();
@@ -589,6 +642,9 @@ private:
         CommandEntry(Command command);
         ~CommandEntry();
 
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr);
+
         Command command;
 
         // parameters for the command (usage varies by command)
@@ -601,6 +657,9 @@ private:
         int32_t userActivityEventType;
         uint32_t seq;
         bool handled;
+
+    private:
+        static EntryPool sPool;
     };
 
     // Generic queue implementation.
@@ -784,6 +843,52 @@ private:
                 const CancelationOptions& options);
     };
 
+    /* Histogram of latencies, with four buckets per power of two microseconds so that
+     * the reported percentiles are within 25% of the actual values. */
+    class LatencyHistogram {
+    public:
+        LatencyHistogram();
+
+        void add(nsecs_t latency);
+
+        inline uint32_t getCount() const { return mCount; }
+
+        // Returns the upper bound of the bucket that holds the given percentile.
+        nsecs_t getPercentile(uint32_t percentile) const;
+
+    private:
+        enum { BUCKET_COUNT = 96 };
+
+        uint32_t mCount;
+        uint32_t mBuckets[BUCKET_COUNT];
+
+        static size_t getBucket(nsecs_t latency);
+        static nsecs_t getBucketUpperBound(size_t bucket);
+    };
+
+    /* Latencies of the events delivered to a connection, for each stage of their delivery. */
+    struct LatencyStatistics {
+        enum {
+            // From the kernel timestamp of the event until the reader queued it.
+            STAGE_READER,
+            // Time spent in the inbound queue of the dispatcher.
+            STAGE_INBOUND,
+            // From the inbound queue until the event was published to the connection.
+            STAGE_PUBLISH,
+            // From the publication until the application finished handling the event.
+            STAGE_FINISH,
+            // From the kernel timestamp until the application finished handling the event.
+            STAGE_TOTAL,
+
+            STAGE_COUNT
+        };
+
+        LatencyHistogram stages[STAGE_COUNT];
+
+        void add(const DispatchEntry* dispatchEntry, nsecs_t finishTime);
+        void dump(String8& dump, const char* label) const;
+    };
+
     /* Manages the dispatch state associated with a single input channel. */
     class Connection : public RefBase {
     protected:
@@ -817,6 +922,10 @@ private:
         // yet received a "finished" response from the application.
         Queue<DispatchEntry> waitQueue;
 
+        // Latencies of the key and motion events the application finished handling.
+        LatencyStatistics keyLatency;
+        LatencyStatistics motionLatency;
+
         explicit Connection(const sp<InputChannel>& inputChannel,
                 const sp<InputWindowHandle>& inputWindowHandle, bool monitor);
 
@@ -842,6 +951,14 @@ private:
 
     Mutex mLock;
 
+    // Guards mIncomingQueue, and mInputFilterEnabled which is written with both locks held.
+    // The input reader only takes this lock, for as long as it takes to append an event,
+    // so that it does not wait for the dispatch cycle.  Acquired after mLock.
+    Mutex mIncomingLock;
+
+    // Events notified by the input reader, moved to mInboundQueue by the dispatcher thread.
+    Queue<EventEntry> mIncomingQueue;
+
     Condition mDispatcherIsAliveCondition;
 
     sp<Looper> mLooper;
@@ -856,6 +973,13 @@ private:
     // Enqueues an inbound event.  Returns true if mLooper->wake() should be called.
     bool enqueueInboundEventLocked(EventEntry* entry);
 
+    // Enqueues an event notified by the input reader.  Must be called with mIncomingLock
+    // held.  Returns true if mLooper->wake() should be called.
+    bool enqueueIncomingEvent(EventEntry* entry);
+
+    // Moves the events notified by the input reader to the inbound queue.
+    void transferIncomingEventsLocked();
+
     // Cleans up input state when dropping an inbound event.
     void dropInboundEventLocked(EventEntry* entry, DropReason dropReason);
 
@@ -927,8 +1051,70 @@ private:
 
     Vector<sp<InputWindowHandle> > mWindowHandles;
 
+    // Spatial index of the windows, rebuilt by setInputWindows and maintained by
+    // updateInputWindows.
+    // The bounds of the windows of each display are split into a grid of cells.  Each cell
+    // lists, front to back, the indexes in mWindowHandles of the windows that may be touched
+    // at a point of the cell, and of the windows that may obscure another window there.
+    // Windows that do not depend on the location of the touch, such as touch modal windows,
+    // are in every list.
+    struct WindowIndex {
+        struct Grid {
+            int32_t displayId;
+            // Covered bounds, right and bottom are exclusive
+            int32_t left, top, right, bottom;
+            int32_t cellWidth, cellHeight;
+            Vector<Vector<size_t> > touchCells;
+            Vector<Vector<size_t> > obscuringCells;
+            // Touch candidates outside of the covered bounds
+            Vector<size_t> outsideTouch;
+
+            ssize_t getCell(int32_t x, int32_t y) const;
+        };
+
+        Vector<Grid> grids;
+        KeyedVector<const InputWindowHandle*, size_t> zOrders;
+        Vector<size_t> empty;
+        // True when a window did not fit in the grid of its display, the grids must be
+        // rebuilt before they are used.  The z orders are always up to date.
+        bool stale;
+
+        WindowIndex();
+
+        void rebuild(const Vector<sp<InputWindowHandle> >& windowHandles);
+        void rebuildIfStale(const Vector<sp<InputWindowHandle> >& windowHandles);
+
+        // Incremental updates, invoked after the window was inserted in, removed from or
+        // updated in place in windowHandles.
+        void insertWindow(const Vector<sp<InputWindowHandle> >& windowHandles, size_t window);
+        void removeWindow(const InputWindowHandle* windowHandle, size_t window);
+        void updateWindow(const Vector<sp<InputWindowHandle> >& windowHandles, size_t window);
+
+        const Vector<size_t>& getTouchCandidates(int32_t displayId, int32_t x, int32_t y) const;
+        const Vector<size_t>& getObscuringCandidates(int32_t displayId,
+                int32_t x, int32_t y) const;
+        // Returns the index of the window in mWindowHandles, or -1 if it is not there.
+        ssize_t getZOrder(const sp<InputWindowHandle>& windowHandle) const;
+
+    private:
+        const Grid* getGrid(int32_t displayId) const;
+        bool addWindow(const InputWindowInfo* info, size_t window, bool mustFit);
+        void removeFromCells(size_t window, bool shift);
+        void shiftCells(size_t window);
+        static void addToCells(Grid& grid, Vector<Vector<size_t> >& cells, size_t window,
+                int32_t left, int32_t top, int32_t right, int32_t bottom);
+        static void getWindowBounds(const InputWindowInfo* info,
+                int32_t* outLeft, int32_t* outTop, int32_t* outRight, int32_t* outBottom);
+    };
+
+    WindowIndex mWindowIndex;
+
     sp<InputWindowHandle> getWindowHandleLocked(const sp<InputChannel>& inputChannel) const;
     bool hasWindowHandleLocked(const sp<InputWindowHandle>& windowHandle) const;
+    void insertWindowHandleLocked(const sp<InputWindowHandle>& windowHandle);
+    void removeWindowHandleLocked(size_t index);
+    void updateFocusedWindowLocked();
+    void cancelRemovedTouchedWindowsLocked();
 
     // Focus tracking for keys, trackball, etc.
     sp<InputWindowHandle> mFocusedWindowHandle;
@@ -1041,6 +1227,8 @@ private:
             EventEntry* eventEntry, const InputTarget* inputTarget);
     void enqueueDispatchEntryLocked(const sp<Connection>& connection,
             EventEntry* eventEntry, const InputTarget* inputTarget, int32_t dispatchMode);
+    void coalesceOutboundMotionLocked(const sp<Connection>& connection,
+            const DispatchEntry* dispatchEntry);
     void startDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection);
     void finishDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection,
             uint32_t seq, bool handled);
@@ -22,6 +22,9 @@
 
 #include <cutils/log.h>
 
+#include <new>
+#include <stdlib.h>
+
 namespace android {
 
 // --- NotifyConfigurationChangedArgs ---
@@ -136,47 +139,173 @@ void NotifyDeviceResetArgs::notify(const sp<InputListenerInterface>& listener) c
 
 // --- QueuedInputListener ---
 
+// Default size of a chunk of queued arguments.
+// A chunk holds about a hundred motion events with a single pointer.
+static const size_t ARGS_CHUNK_SIZE = 16 * 1024;
+
+// Alignment of the queued arguments within a chunk.
+static const size_t ARGS_ALIGNMENT = 8;
+
+static inline size_t alignArgsSize(size_t size) {
+    return (size + ARGS_ALIGNMENT - 1) & ~(ARGS_ALIGNMENT - 1);
+}
+
 QueuedInputListener::QueuedInputListener(const sp<InputListenerInterface>& innerListener) :
-        mInnerListener(innerListener) {
+        mInnerListener(innerListener), mCurrentChunk(0) {
 }
 
 QueuedInputListener::~QueuedInputListener() {
-    size_t count = mArgsQueue.size();
-    for (size_t i = 0; i < count; i++) {
-        delete mArgsQueue[i];
+    for (size_t i = 0; i < mChunks.size(); i++) {
+        const Chunk& chunk = mChunks.itemAt(i);
+        for (size_t offset = 0; offset < chunk.used; ) {
+            Record* record = reinterpret_cast<Record*>(chunk.data + offset);
+            offset += record->size;
+            destroyRecord(record);
+        }
+        free(chunk.data);
+    }
+}
+
+void* QueuedInputListener::appendRecord(uint32_t type, size_t payloadSize) {
+    size_t size = alignArgsSize(sizeof(Record)) + alignArgsSize(payloadSize);
+
+    // Chunks past the current one are empty, left over from a previous flush.
+    while (mCurrentChunk < mChunks.size()) {
+        const Chunk& chunk = mChunks.itemAt(mCurrentChunk);
+        if (chunk.capacity - chunk.used >= size) {
+            break;
+        }
+        mCurrentChunk += 1;
     }
+
+    if (mCurrentChunk == mChunks.size()) {
+        Chunk chunk;
+        chunk.capacity = size > ARGS_CHUNK_SIZE ? size : ARGS_CHUNK_SIZE;
+        chunk.data = static_cast<uint8_t*>(malloc(chunk.capacity));
+        chunk.used = 0;
+        mChunks.push(chunk);
+    }
+
+    Chunk& chunk = mChunks.editItemAt(mCurrentChunk);
+    Record* record = reinterpret_cast<Record*>(chunk.data + chunk.used);
+    record->type = type;
+    record->size = size;
+    chunk.used += size;
+    return reinterpret_cast<uint8_t*>(record) + alignArgsSize(sizeof(Record));
 }
 
 void QueuedInputListener::notifyConfigurationChanged(
         const NotifyConfigurationChangedArgs* args) {
-    mArgsQueue.push(new NotifyConfigurationChangedArgs(*args));
+    new (appendRecord(TYPE_CONFIGURATION_CHANGED, sizeof(NotifyConfigurationChangedArgs)))
+            NotifyConfigurationChangedArgs(*args);
 }
 
 void QueuedInputListener::notifyKey(const NotifyKeyArgs* args) {
-    mArgsQueue.push(new NotifyKeyArgs(*args));
+    new (appendRecord(TYPE_KEY, sizeof(NotifyKeyArgs))) NotifyKeyArgs(*args);
 }
 
 void QueuedInputListener::notifyMotion(const NotifyMotionArgs* args) {
-    mArgsQueue.push(new NotifyMotionArgs(*args));
+    uint32_t pointerCount = args->pointerCount;
+    size_t propertiesOffset = alignArgsSize(sizeof(CompactMotionArgs));
+    size_t coordsOffset = alignArgsSize(propertiesOffset
+            + pointerCount * sizeof(PointerProperties));
+    uint8_t* payload = static_cast<uint8_t*>(appendRecord(TYPE_MOTION,
+            coordsOffset + pointerCount * sizeof(PointerCoords)));
+
+    CompactMotionArgs* compact = reinterpret_cast<CompactMotionArgs*>(payload);
+    compact->eventTime = args->eventTime;
+    compact->downTime = args->downTime;
+    compact->deviceId = args->deviceId;
+    compact->source = args->source;
+    compact->policyFlags = args->policyFlags;
+    compact->action = args->action;
+    compact->flags = args->flags;
+    compact->metaState = args->metaState;
+    compact->buttonState = args->buttonState;
+    compact->edgeFlags = args->edgeFlags;
+    compact->displayId = args->displayId;
+    compact->pointerCount = pointerCount;
+    compact->xPrecision = args->xPrecision;
+    compact->yPrecision = args->yPrecision;
+
+    PointerProperties* pointerProperties =
+            reinterpret_cast<PointerProperties*>(payload + propertiesOffset);
+    PointerCoords* pointerCoords = reinterpret_cast<PointerCoords*>(payload + coordsOffset);
+    for (uint32_t i = 0; i < pointerCount; i++) {
+        pointerProperties[i].copyFrom(args->pointerProperties[i]);
+        pointerCoords[i].copyFrom(args->pointerCoords[i]);
+    }
 }
 
 void QueuedInputListener::notifySwitch(const NotifySwitchArgs* args) {
-    mArgsQueue.push(new NotifySwitchArgs(*args));
+    new (appendRecord(TYPE_SWITCH, sizeof(NotifySwitchArgs))) NotifySwitchArgs(*args);
 }
 
 void QueuedInputListener::notifyDeviceReset(const NotifyDeviceResetArgs* args) {
-    mArgsQueue.push(new NotifyDeviceResetArgs(*args));
+    new (appendRecord(TYPE_DEVICE_RESET, sizeof(NotifyDeviceResetArgs)))
+            NotifyDeviceResetArgs(*args);
 }
 
-void QueuedInputListener::flush() {
-    size_t count = mArgsQueue.size();
-    for (size_t i = 0; i < count; i++) {
-        NotifyArgs* args = mArgsQueue[i];
-        args->notify(mInnerListener);
-        delete args;
+void QueuedInputListener::flushRecord(Record* record) {
+    uint8_t* payload = reinterpret_cast<uint8_t*>(record) + alignArgsSize(sizeof(Record));
+    if (record->type != TYPE_MOTION) {
+        reinterpret_cast<NotifyArgs*>(payload)->notify(mInnerListener);
+        return;
+    }
+
+    const CompactMotionArgs* compact = reinterpret_cast<const CompactMotionArgs*>(payload);
+    uint32_t pointerCount = compact->pointerCount;
+    size_t propertiesOffset = alignArgsSize(sizeof(CompactMotionArgs));
+    size_t coordsOffset = alignArgsSize(propertiesOffset
+            + pointerCount * sizeof(PointerProperties));
+    const PointerProperties* pointerProperties =
+            reinterpret_cast<const PointerProperties*>(payload + propertiesOffset);
+    const PointerCoords* pointerCoords =
+            reinterpret_cast<const PointerCoords*>(payload + coordsOffset);
+
+    NotifyMotionArgs& args = mFlushedMotionArgs;
+    args.eventTime = compact->eventTime;
+    args.deviceId = compact->deviceId;
+    args.source = compact->source;
+    args.policyFlags = compact->policyFlags;
+    args.action = compact->action;
+    args.flags = compact->flags;
+    args.metaState = compact->metaState;
+    args.buttonState = compact->buttonState;
+    args.edgeFlags = compact->edgeFlags;
+    args.displayId = compact->displayId;
+    args.pointerCount = pointerCount;
+    for (uint32_t i = 0; i < pointerCount; i++) {
+        args.pointerProperties[i].copyFrom(pointerProperties[i]);
+        args.pointerCoords[i].copyFrom(pointerCoords[i]);
     }
-    mArgsQueue.clear();
+    args.xPrecision = compact->xPrecision;
+    args.yPrecision = compact->yPrecision;
+    args.downTime = compact->downTime;
+    mInnerListener->notifyMotion(&args);
 }
 
+void QueuedInputListener::destroyRecord(Record* record) {
+    // Motion records are plain data, the other records hold an args object.
+    if (record->type != TYPE_MOTION) {
+        uint8_t* payload = reinterpret_cast<uint8_t*>(record) + alignArgsSize(sizeof(Record));
+        reinterpret_cast<NotifyArgs*>(payload)->~NotifyArgs();
+    }
+}
+
+void QueuedInputListener::flush() {
+    size_t chunkCount = mCurrentChunk < mChunks.size() ? mCurrentChunk + 1 : 0;
+    for (size_t i = 0; i < chunkCount; i++) {
+        Chunk& chunk = mChunks.editItemAt(i);
+        for (size_t offset = 0; offset < chunk.used; ) {
+            Record* record = reinterpret_cast<Record*>(chunk.data + offset);
+            offset += record->size;
+            flushRecord(record);
+            destroyRecord(record);
+        }
+        chunk.used = 0;
+    }
+    mCurrentChunk = 0;
+}
 
 } // namespace android
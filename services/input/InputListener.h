@@ -170,6 +170,10 @@ public:
 /*
  * An implementation of the listener interface that queues up and defers dispatch
  * of decoded events until flushed.
+ *
+ * The queued arguments are copied into chunks of memory that are kept from one flush
+ * to the next so that queueing does not allocate once the chunks are warmed up.
+ * Motion arguments are compacted to their actual pointer count.
  */
 class QueuedInputListener : public InputListenerInterface {
 protected:
@@ -187,8 +191,55 @@ public:
     void flush();
 
 private:
+    enum {
+        TYPE_CONFIGURATION_CHANGED,
+        TYPE_KEY,
+        TYPE_MOTION,
+        TYPE_SWITCH,
+        TYPE_DEVICE_RESET,
+    };
+
+    // Precedes each queued argument in a chunk, the size includes the header.
+    struct Record {
+        uint32_t type;
+        uint32_t size;
+    };
+
+    // Queued motion arguments, followed by pointerCount pointer properties
+    // and then by pointerCount pointer coordinates.
+    struct CompactMotionArgs {
+        nsecs_t eventTime;
+        nsecs_t downTime;
+        int32_t deviceId;
+        uint32_t source;
+        uint32_t policyFlags;
+        int32_t action;
+        int32_t flags;
+        int32_t metaState;
+        int32_t buttonState;
+        int32_t edgeFlags;
+        int32_t displayId;
+        uint32_t pointerCount;
+        float xPrecision;
+        float yPrecision;
+    };
+
+    struct Chunk {
+        uint8_t* data;
+        size_t capacity;
+        size_t used;
+    };
+
     sp<InputListenerInterface> mInnerListener;
-    Vector<NotifyArgs*> mArgsQueue;
+    Vector<Chunk> mChunks;
+    size_t mCurrentChunk;
+
+    // Rebuilt from the compact motion arguments when flushing.
+    NotifyMotionArgs mFlushedMotionArgs;
+
+    void* appendRecord(uint32_t type, size_t payloadSize);
+    void flushRecord(Record* record);
+    void destroyRecord(Record* record);
 };
 
 } // namespace android
@@ -267,12 +267,27 @@ void InputReader::loopOnce() {
 
     size_t count = mEventHub->getEvents(timeoutMillis, mEventBuffer, EVENT_BUFFER_SIZE);
 
+    // Process the events of the latency critical devices first, and flush them out to
+    // the listener before processing the events of the other devices.
+    size_t latencyCriticalCount = 0;
+    if (count) {
+        AutoMutex _l(mLock);
+        latencyCriticalCount = partitionLatencyCriticalEventsLocked(mEventBuffer, count);
+        if (latencyCriticalCount) {
+            processEventsLocked(mEventBuffer, latencyCriticalCount);
+        }
+    } // release lock
+    if (latencyCriticalCount) {
+        mQueuedListener->flush();
+    }
+
     { // acquire lock
         AutoMutex _l(mLock);
         mReaderIsAliveCondition.broadcast();
 
-        if (count) {
-            processEventsLocked(mEventBuffer, count);
+        if (count > latencyCriticalCount) {
+            processEventsLocked(mEventBuffer + latencyCriticalCount,
+                    count - latencyCriticalCount);
         }
 
         if (mNextTimeout != LLONG_MAX) {
@@ -345,6 +360,65 @@ void InputReader::processEventsLocked(const RawEvent* rawEvents, size_t count) {
     }
 }
 
+size_t InputReader::partitionLatencyCriticalEventsLocked(RawEvent* rawEvents, size_t count) {
+    if (!mConfig.prioritizeLatencyCriticalDevices) {
+        return 0;
+    }
+
+    // Devices may be added or removed in between the events, in which case the events
+    // are processed in order.
+    size_t latencyCriticalCount = 0;
+    int32_t lastDeviceId = -1;
+    bool lastDeviceIsLatencyCritical = false;
+    for (size_t i = 0; i < count; i++) {
+        const RawEvent& rawEvent = rawEvents[i];
+        if (rawEvent.type >= EventHubInterface::FIRST_SYNTHETIC_EVENT) {
+            return 0;
+        }
+        if (rawEvent.deviceId != lastDeviceId) {
+            lastDeviceId = rawEvent.deviceId;
+            lastDeviceIsLatencyCritical = isLatencyCriticalDeviceLocked(lastDeviceId);
+        }
+        if (lastDeviceIsLatencyCritical) {
+            latencyCriticalCount += 1;
+        }
+    }
+    if (latencyCriticalCount == 0 || latencyCriticalCount == count) {
+        return 0; // nothing to reorder
+    }
+
+    // Move the events of the latency critical devices first, keeping the events
+    // of each device in order.
+    size_t latencyCriticalIndex = 0;
+    size_t otherIndex = latencyCriticalCount;
+    lastDeviceId = -1;
+    for (size_t i = 0; i < count; i++) {
+        const RawEvent& rawEvent = rawEvents[i];
+        if (rawEvent.deviceId != lastDeviceId) {
+            lastDeviceId = rawEvent.deviceId;
+            lastDeviceIsLatencyCritical = isLatencyCriticalDeviceLocked(lastDeviceId);
+        }
+        if (lastDeviceIsLatencyCritical) {
+            mPartitionBuffer[latencyCriticalIndex++] = rawEvent;
+        } else {
+            mPartitionBuffer[otherIndex++] = rawEvent;
+        }
+    }
+    memcpy(rawEvents, mPartitionBuffer, count * sizeof(RawEvent));
+    return latencyCriticalCount;
+}
+
+bool InputReader::isLatencyCriticalDeviceLocked(int32_t deviceId) const {
+    ssize_t deviceIndex = mDevices.indexOfKey(deviceId);
+    if (deviceIndex < 0) {
+        return false;
+    }
+
+    uint32_t sources = mDevices.valueAt(deviceIndex)->getSources();
+    return (sources & AINPUT_SOURCE_TOUCHSCREEN) == AINPUT_SOURCE_TOUCHSCREEN
+            || (sources & AINPUT_SOURCE_STYLUS) == AINPUT_SOURCE_STYLUS;
+}
+
 void InputReader::addDeviceLocked(nsecs_t when, int32_t deviceId) {
     ssize_t deviceIndex = mDevices.indexOfKey(deviceId);
     if (deviceIndex >= 0) {
@@ -2632,6 +2706,14 @@ void TouchInputMapper::populateDeviceInfo(InputDeviceInfo* info) {
             info->addMotionRange(AMOTION_EVENT_AXIS_GENERIC_4, mSource, y.min, y.max, y.flat,
                     y.fuzz, y.resolution);
         }
+        if (isPredictionEnabled()) {
+            const InputDeviceInfo::MotionRange& x = mOrientedRanges.x;
+            const InputDeviceInfo::MotionRange& y = mOrientedRanges.y;
+            info->addMotionRange(AMOTION_EVENT_AXIS_GENERIC_5, mSource, x.min, x.max, x.flat,
+                    x.fuzz, x.resolution);
+            info->addMotionRange(AMOTION_EVENT_AXIS_GENERIC_6, mSource, y.min, y.max, y.flat,
+                    y.fuzz, y.resolution);
+        }
         info->setButtonUnderPad(mParameters.hasButtonUnderPad);
     }
 }
@@ -3258,6 +3340,51 @@ void TouchInputMapper::configureSurface(nsecs_t when, bool* outResetNeeded) {
             break;
         }
 
+        // Resolve the mapping of raw coordinates for the surface orientation once,
+        // instead of for each pointer of each sync.
+        switch (mSurfaceOrientation) {
+        case DISPLAY_ORIENTATION_90:
+            mOrientedAxesSwapped = true;
+            mOrientedXOrigin = mRawPointerAxes.y.minValue;
+            mOrientedXScale = mYScale;
+            mOrientedXTranslate = mYTranslate;
+            mOrientedYOrigin = mRawPointerAxes.x.maxValue;
+            mOrientedYScale = -mXScale;
+            mOrientedYTranslate = mXTranslate;
+            mOrientedOrientationOffset = -M_PI_2;
+            break;
+        case DISPLAY_ORIENTATION_180:
+            mOrientedAxesSwapped = false;
+            mOrientedXOrigin = mRawPointerAxes.x.maxValue;
+            mOrientedXScale = -mXScale;
+            mOrientedXTranslate = mXTranslate;
+            mOrientedYOrigin = mRawPointerAxes.y.maxValue;
+            mOrientedYScale = -mYScale;
+            mOrientedYTranslate = mYTranslate;
+            mOrientedOrientationOffset = -M_PI;
+            break;
+        case DISPLAY_ORIENTATION_270:
+            mOrientedAxesSwapped = true;
+            mOrientedXOrigin = mRawPointerAxes.y.maxValue;
+            mOrientedXScale = -mYScale;
+            mOrientedXTranslate = mYTranslate;
+            mOrientedYOrigin = mRawPointerAxes.x.minValue;
+            mOrientedYScale = mXScale;
+            mOrientedYTranslate = mXTranslate;
+            mOrientedOrientationOffset = M_PI_2;
+            break;
+        default:
+            mOrientedAxesSwapped = false;
+            mOrientedXOrigin = mRawPointerAxes.x.minValue;
+            mOrientedXScale = mXScale;
+            mOrientedXTranslate = mXTranslate;
+            mOrientedYOrigin = mRawPointerAxes.y.minValue;
+            mOrientedYScale = mYScale;
+            mOrientedYTranslate = mYTranslate;
+            mOrientedOrientationOffset = 0;
+            break;
+        }
+
         if (mDeviceMode == DEVICE_MODE_POINTER) {
             // Compute pointer gesture detection parameters.
             float rawDiagonal = hypotf(rawWidth, rawHeight);
@@ -3476,6 +3603,10 @@ void TouchInputMapper::parseCalibration() {
                     coverageCalibrationString.string());
         }
     }
+
+    // Prediction
+    out.havePredictionHorizon = in.tryGetProperty(String8("touch.prediction.horizon"),
+            out.predictionHorizon);
 }
 
 void TouchInputMapper::resolveCalibration() {
@@ -3519,6 +3650,13 @@ void TouchInputMapper::resolveCalibration() {
     if (mCalibration.coverageCalibration == Calibration::COVERAGE_CALIBRATION_DEFAULT) {
         mCalibration.coverageCalibration = Calibration::COVERAGE_CALIBRATION_NONE;
     }
+
+    // Prediction
+    if (mCalibration.havePredictionHorizon && mCalibration.predictionHorizon <= 0) {
+        ALOGW("Invalid value for touch.prediction.horizon: %0.3f",
+                mCalibration.predictionHorizon);
+        mCalibration.havePredictionHorizon = false;
+    }
 }
 
 void TouchInputMapper::dumpCalibration(String8& dump) {
@@ -3622,6 +3760,11 @@ void TouchInputMapper::dumpCalibration(String8& dump) {
     default:
         ALOG_ASSERT(false);
     }
+
+    if (mCalibration.havePredictionHorizon) {
+        dump.appendFormat(INDENT4 "touch.prediction.horizon: %0.3f\n",
+                mCalibration.predictionHorizon);
+    }
 }
 
 void TouchInputMapper::reset(nsecs_t when) {
@@ -3632,6 +3775,7 @@ void TouchInputMapper::reset(nsecs_t when) {
     mPointerVelocityControl.reset();
     mWheelXVelocityControl.reset();
     mWheelYVelocityControl.reset();
+    mPredictionVelocityTracker.clear();
 
     mCurrentRawPointerData.clear();
     mLastRawPointerData.clear();
@@ -3756,6 +3900,7 @@ void TouchInputMapper::sync(nsecs_t when) {
         // with cooked pointer data that has the same ids and indices as the raw data.
         // The following code can use either the raw or cooked data, as needed.
         cookPointerData();
+        predictPointerCoords(when);
 
         // Dispatch the touches either directly or by translation through a pointer on screen.
         if (mDeviceMode == DEVICE_MODE_POINTER) {
@@ -4089,6 +4234,15 @@ void TouchInputMapper::cookPointerData() {
     mCurrentCookedPointerData.hoveringIdBits = mCurrentRawPointerData.hoveringIdBits;
     mCurrentCookedPointerData.touchingIdBits = mCurrentRawPointerData.touchingIdBits;
 
+    // Summed sizes are shared evenly between the touching pointers.
+    uint32_t sizeDivisor = 1;
+    if (mCalibration.haveSizeIsSummed && mCalibration.sizeIsSummed) {
+        uint32_t touchingCount = mCurrentRawPointerData.touchingIdBits.count();
+        if (touchingCount > 1) {
+            sizeDivisor = touchingCount;
+        }
+    }
+
     // Walk through the the active pointers and map device coordinates onto
     // surface coordinates and adjust for display orientation.
     for (uint32_t i = 0; i < currentPointerCount; i++) {
@@ -4130,15 +4284,12 @@ void TouchInputMapper::cookPointerData() {
                 size = 0;
             }
 
-            if (mCalibration.haveSizeIsSummed && mCalibration.sizeIsSummed) {
-                uint32_t touchingCount = mCurrentRawPointerData.touchingIdBits.count();
-                if (touchingCount > 1) {
-                    touchMajor /= touchingCount;
-                    touchMinor /= touchingCount;
-                    toolMajor /= touchingCount;
-                    toolMinor /= touchingCount;
-                    size /= touchingCount;
-                }
+            if (sizeDivisor > 1) {
+                touchMajor /= sizeDivisor;
+                touchMinor /= sizeDivisor;
+                toolMajor /= sizeDivisor;
+                toolMinor /= sizeDivisor;
+                size /= sizeDivisor;
             }
 
             if (mCalibration.sizeCalibration == Calibration::SIZE_CALIBRATION_GEOMETRIC) {
@@ -4243,57 +4394,25 @@ void TouchInputMapper::cookPointerData() {
             break;
         }
 
-        // X, Y, and the bounding box for coverage information
-        // Adjust coords for surface orientation.
-        float x, y, left, top, right, bottom;
-        switch (mSurfaceOrientation) {
-        case DISPLAY_ORIENTATION_90:
-            x = float(in.y - mRawPointerAxes.y.minValue) * mYScale + mYTranslate;
-            y = float(mRawPointerAxes.x.maxValue - in.x) * mXScale + mXTranslate;
-            left = float(rawTop - mRawPointerAxes.y.minValue) * mYScale + mYTranslate;
-            right = float(rawBottom- mRawPointerAxes.y.minValue) * mYScale + mYTranslate;
-            bottom = float(mRawPointerAxes.x.maxValue - rawLeft) * mXScale + mXTranslate;
-            top = float(mRawPointerAxes.x.maxValue - rawRight) * mXScale + mXTranslate;
-            orientation -= M_PI_2;
+        // X and Y, adjusted for surface orientation.
+        int32_t rawX = mOrientedAxesSwapped ? in.y : in.x;
+        int32_t rawY = mOrientedAxesSwapped ? in.x : in.y;
+        float x = float(rawX - mOrientedXOrigin) * mOrientedXScale + mOrientedXTranslate;
+        float y = float(rawY - mOrientedYOrigin) * mOrientedYScale + mOrientedYTranslate;
+        if (mOrientedOrientationOffset < 0) {
+            orientation += mOrientedOrientationOffset;
             if (orientation < mOrientedRanges.orientation.min) {
                 orientation += (mOrientedRanges.orientation.max - mOrientedRanges.orientation.min);
             }
-            break;
-        case DISPLAY_ORIENTATION_180:
-            x = float(mRawPointerAxes.x.maxValue - in.x) * mXScale + mXTranslate;
-            y = float(mRawPointerAxes.y.maxValue - in.y) * mYScale + mYTranslate;
-            left = float(mRawPointerAxes.x.maxValue - rawRight) * mXScale + mXTranslate;
-            right = float(mRawPointerAxes.x.maxValue - rawLeft) * mXScale + mXTranslate;
-            bottom = float(mRawPointerAxes.y.maxValue - rawTop) * mYScale + mYTranslate;
-            top = float(mRawPointerAxes.y.maxValue - rawBottom) * mYScale + mYTranslate;
-            orientation -= M_PI;
-            if (orientation < mOrientedRanges.orientation.min) {
-                orientation += (mOrientedRanges.orientation.max - mOrientedRanges.orientation.min);
-            }
-            break;
-        case DISPLAY_ORIENTATION_270:
-            x = float(mRawPointerAxes.y.maxValue - in.y) * mYScale + mYTranslate;
-            y = float(in.x - mRawPointerAxes.x.minValue) * mXScale + mXTranslate;
-            left = float(mRawPointerAxes.y.maxValue - rawBottom) * mYScale + mYTranslate;
-            right = float(mRawPointerAxes.y.maxValue - rawTop) * mYScale + mYTranslate;
-            bottom = float(rawRight - mRawPointerAxes.x.minValue) * mXScale + mXTranslate;
-            top = float(rawLeft - mRawPointerAxes.x.minValue) * mXScale + mXTranslate;
-            orientation += M_PI_2;
+        } else if (mOrientedOrientationOffset > 0) {
+            orientation += mOrientedOrientationOffset;
             if (orientation > mOrientedRanges.orientation.max) {
                 orientation -= (mOrientedRanges.orientation.max - mOrientedRanges.orientation.min);
             }
-            break;
-        default:
-            x = float(in.x - mRawPointerAxes.x.minValue) * mXScale + mXTranslate;
-            y = float(in.y - mRawPointerAxes.y.minValue) * mYScale + mYTranslate;
-            left = float(rawLeft - mRawPointerAxes.x.minValue) * mXScale + mXTranslate;
-            right = float(rawRight - mRawPointerAxes.x.minValue) * mXScale + mXTranslate;
-            bottom = float(rawBottom - mRawPointerAxes.y.minValue) * mYScale + mYTranslate;
-            top = float(rawTop - mRawPointerAxes.y.minValue) * mYScale + mYTranslate;
-            break;
         }
 
         // Write output coords.
+        // Axes are written in increasing order, so that each value is appended.
         PointerCoords& out = mCurrentCookedPointerData.pointerCoords[i];
         out.clear();
         out.setAxisValue(AMOTION_EVENT_AXIS_X, x);
@@ -4302,17 +4421,37 @@ void TouchInputMapper::cookPointerData() {
         out.setAxisValue(AMOTION_EVENT_AXIS_SIZE, size);
         out.setAxisValue(AMOTION_EVENT_AXIS_TOUCH_MAJOR, touchMajor);
         out.setAxisValue(AMOTION_EVENT_AXIS_TOUCH_MINOR, touchMinor);
+        if (mCalibration.coverageCalibration != Calibration::COVERAGE_CALIBRATION_BOX) {
+            out.setAxisValue(AMOTION_EVENT_AXIS_TOOL_MAJOR, toolMajor);
+            out.setAxisValue(AMOTION_EVENT_AXIS_TOOL_MINOR, toolMinor);
+        }
         out.setAxisValue(AMOTION_EVENT_AXIS_ORIENTATION, orientation);
-        out.setAxisValue(AMOTION_EVENT_AXIS_TILT, tilt);
         out.setAxisValue(AMOTION_EVENT_AXIS_DISTANCE, distance);
+        out.setAxisValue(AMOTION_EVENT_AXIS_TILT, tilt);
         if (mCalibration.coverageCalibration == Calibration::COVERAGE_CALIBRATION_BOX) {
+            // The bounding box, adjusted for surface orientation.
+            int32_t rawXMin = mOrientedAxesSwapped ? rawTop : rawLeft;
+            int32_t rawXMax = mOrientedAxesSwapped ? rawBottom : rawRight;
+            int32_t rawYMin = mOrientedAxesSwapped ? rawLeft : rawTop;
+            int32_t rawYMax = mOrientedAxesSwapped ? rawRight : rawBottom;
+            if (mOrientedXScale < 0) {
+                swap(rawXMin, rawXMax);
+            }
+            if (mOrientedYScale < 0) {
+                swap(rawYMin, rawYMax);
+            }
+            float left = float(rawXMin - mOrientedXOrigin) * mOrientedXScale
+                    + mOrientedXTranslate;
+            float right = float(rawXMax - mOrientedXOrigin) * mOrientedXScale
+                    + mOrientedXTranslate;
+            float top = float(rawYMin - mOrientedYOrigin) * mOrientedYScale
+                    + mOrientedYTranslate;
+            float bottom = float(rawYMax - mOrientedYOrigin) * mOrientedYScale
+                    + mOrientedYTranslate;
             out.setAxisValue(AMOTION_EVENT_AXIS_GENERIC_1, left);
             out.setAxisValue(AMOTION_EVENT_AXIS_GENERIC_2, top);
             out.setAxisValue(AMOTION_EVENT_AXIS_GENERIC_3, right);
             out.setAxisValue(AMOTION_EVENT_AXIS_GENERIC_4, bottom);
-        } else {
-            out.setAxisValue(AMOTION_EVENT_AXIS_TOOL_MAJOR, toolMajor);
-            out.setAxisValue(AMOTION_EVENT_AXIS_TOOL_MINOR, toolMinor);
         }
 
         // Write output properties.
@@ -4327,6 +4466,51 @@ void TouchInputMapper::cookPointerData() {
     }
 }
 
+void TouchInputMapper::predictPointerCoords(nsecs_t when) {
+    if (!isPredictionEnabled()) {
+        return;
+    }
+
+    // Forget the pointers that went up, their ids may be reused by new pointers.
+    BitSet32 idBits(mCurrentCookedPointerData.touchingIdBits.value
+            | mCurrentCookedPointerData.hoveringIdBits.value);
+    BitSet32 lastIdBits(mLastCookedPointerData.touchingIdBits.value
+            | mLastCookedPointerData.hoveringIdBits.value);
+    BitSet32 removedIdBits(lastIdBits.value & ~idBits.value);
+    if (!removedIdBits.isEmpty()) {
+        mPredictionVelocityTracker.clearPointers(removedIdBits);
+    }
+    if (idBits.isEmpty()) {
+        return;
+    }
+
+    VelocityTracker::Position positions[MAX_POINTERS];
+    uint32_t count = 0;
+    for (BitSet32 remainingIdBits(idBits); !remainingIdBits.isEmpty(); count++) {
+        uint32_t id = remainingIdBits.clearFirstMarkedBit();
+        const PointerCoords& coords = mCurrentCookedPointerData.pointerCoordsForId(id);
+        positions[count].x = coords.getX();
+        positions[count].y = coords.getY();
+    }
+    mPredictionVelocityTracker.addMovement(when, idBits, positions);
+
+    // Extrapolate the positions linearly, the velocity is in pixels per second.
+    float horizon = mCalibration.predictionHorizon * 0.001f;
+    count = 0;
+    for (BitSet32 remainingIdBits(idBits); !remainingIdBits.isEmpty(); count++) {
+        uint32_t id = remainingIdBits.clearFirstMarkedBit();
+        float vx, vy;
+        if (!mPredictionVelocityTracker.getVelocity(id, &vx, &vy)) {
+            vx = 0;
+            vy = 0;
+        }
+        PointerCoords& coords = mCurrentCookedPointerData.pointerCoords[
+                mCurrentCookedPointerData.idToIndex[id]];
+        coords.setAxisValue(AMOTION_EVENT_AXIS_GENERIC_5, positions[count].x + vx * horizon);
+        coords.setAxisValue(AMOTION_EVENT_AXIS_GENERIC_6, positions[count].y + vy * horizon);
+    }
+}
+
 void TouchInputMapper::dispatchPointerUsage(nsecs_t when, uint32_t policyFlags,
         PointerUsage pointerUsage) {
     if (pointerUsage != mPointerUsage) {
@@ -5662,6 +5846,11 @@ bool TouchInputMapper::isPointInsideSurface(int32_t x, int32_t y) {
             && y >= mRawPointerAxes.y.minValue && y <= mRawPointerAxes.y.maxValue;
 }
 
+bool TouchInputMapper::isPredictionEnabled() const {
+    // Predicted positions are only meaningful when they are on the display.
+    return mCalibration.havePredictionHorizon && mDeviceMode == DEVICE_MODE_DIRECT;
+}
+
 const TouchInputMapper::VirtualKey* TouchInputMapper::findVirtualKeyHit(
         int32_t x, int32_t y) {
     size_t numVirtualKeys = mVirtualKeys.size();
@@ -5718,6 +5907,11 @@ void TouchInputMapper::assignPointerIds() {
         return;
     }
 
+    if (currentPointerCount == lastPointerCount && assignPointerIdsFromNearestPointers()) {
+        // Every pointer moved less than the distance to its neighbors.
+        return;
+    }
+
     // General case.
     // We build a heap of squared euclidean distances between current and last pointers
     // associated with the current and last pointer indices.  Then, we find the best
@@ -5872,6 +6066,76 @@ void TouchInputMapper::assignPointerIds() {
     }
 }
 
+bool TouchInputMapper::assignPointerIdsFromNearestPointers() {
+    // When each current pointer and its nearest last pointer are also the nearest
+    // current pointer of each other, matching pairs by increasing distance picks
+    // exactly these pairs, so the distance heap is not needed.
+    // This is the common case of pointers that move less between two samples than
+    // their distance to other pointers.
+    const uint64_t NO_DISTANCE = ~uint64_t(0);
+    uint32_t pointerCount = mCurrentRawPointerData.pointerCount;
+    uint32_t nearestLastIndex[MAX_POINTERS];
+    uint32_t nearestCurrentIndex[MAX_POINTERS];
+    uint64_t nearestLastDistance[MAX_POINTERS];
+    uint64_t nearestCurrentDistance[MAX_POINTERS];
+    for (uint32_t i = 0; i < pointerCount; i++) {
+        nearestLastDistance[i] = NO_DISTANCE;
+        nearestCurrentDistance[i] = NO_DISTANCE;
+    }
+
+    for (uint32_t currentPointerIndex = 0; currentPointerIndex < pointerCount;
+            currentPointerIndex++) {
+        const RawPointerData::Pointer& currentPointer =
+                mCurrentRawPointerData.pointers[currentPointerIndex];
+        for (uint32_t lastPointerIndex = 0; lastPointerIndex < pointerCount;
+                lastPointerIndex++) {
+            const RawPointerData::Pointer& lastPointer =
+                    mLastRawPointerData.pointers[lastPointerIndex];
+            if (currentPointer.toolType != lastPointer.toolType) {
+                continue;
+            }
+
+            int64_t deltaX = currentPointer.x - lastPointer.x;
+            int64_t deltaY = currentPointer.y - lastPointer.y;
+            uint64_t distance = uint64_t(deltaX * deltaX + deltaY * deltaY);
+            if (distance < nearestLastDistance[currentPointerIndex]) {
+                nearestLastDistance[currentPointerIndex] = distance;
+                nearestLastIndex[currentPointerIndex] = lastPointerIndex;
+            }
+            if (distance < nearestCurrentDistance[lastPointerIndex]) {
+                nearestCurrentDistance[lastPointerIndex] = distance;
+                nearestCurrentIndex[lastPointerIndex] = currentPointerIndex;
+            }
+        }
+    }
+
+    for (uint32_t currentPointerIndex = 0; currentPointerIndex < pointerCount;
+            currentPointerIndex++) {
+        if (nearestLastDistance[currentPointerIndex] == NO_DISTANCE
+                || nearestCurrentIndex[nearestLastIndex[currentPointerIndex]]
+                        != currentPointerIndex) {
+            return false;
+        }
+    }
+
+    for (uint32_t currentPointerIndex = 0; currentPointerIndex < pointerCount;
+            currentPointerIndex++) {
+        uint32_t lastPointerIndex = nearestLastIndex[currentPointerIndex];
+        uint32_t id = mLastRawPointerData.pointers[lastPointerIndex].id;
+        mCurrentRawPointerData.pointers[currentPointerIndex].id = id;
+        mCurrentRawPointerData.idToIndex[id] = currentPointerIndex;
+        mCurrentRawPointerData.markIdBit(id,
+                mCurrentRawPointerData.isHovering(currentPointerIndex));
+
+#if DEBUG_POINTER_ASSIGNMENT
+        ALOGD("assignPointerIds - matched nearest: cur=%d, last=%d, id=%d, distance=%lld",
+                currentPointerIndex, lastPointerIndex, id,
+                nearestLastDistance[currentPointerIndex]);
+#endif
+    }
+    return true;
+}
+
 int32_t TouchInputMapper::getKeyCodeState(uint32_t sourceMask, int32_t keyCode) {
     if (mCurrentVirtualKey.down && mCurrentVirtualKey.keyCode == keyCode) {
         return AKEY_STATE_VIRTUAL;
@@ -6070,6 +6334,7 @@ void MultiTouchInputMapper::syncTouch(nsecs_t when, bool* outHavePointerIds) {
                     uint32_t n = idBits.clearFirstMarkedBit();
                     if (mPointerTrackingIdMap[n] == trackingId) {
                         id = n;
+                        break;
                     }
                 }
 
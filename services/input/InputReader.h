@@ -224,6 +224,10 @@ struct InputReaderConfiguration {
     // True to show the location of touches on the touch screen as spots.
     bool showTouches;
 
+    // True to process the events of touch screens and styluses, and to send them to the
+    // listener, before the events of the other devices read at the same time.
+    bool prioritizeLatencyCriticalDevices;
+
     InputReaderConfiguration() :
             virtualKeyQuietTime(0),
             pointerVelocityControlParameters(1.0f, 500.0f, 3000.0f, 3.0f),
@@ -240,7 +244,8 @@ struct InputReaderConfiguration {
             pointerGestureSwipeMaxWidthRatio(0.25f),
             pointerGestureMovementSpeedRatio(0.8f),
             pointerGestureZoomSpeedRatio(0.3f),
-            showTouches(false) { }
+            showTouches(false),
+            prioritizeLatencyCriticalDevices(true) { }
 
     bool getDisplayInfo(bool external, DisplayViewport* outViewport) const;
     void setDisplayInfo(bool external, const DisplayViewport& viewport);
@@ -447,11 +452,14 @@ private:
     // The event queue.
     static const int EVENT_BUFFER_SIZE = 256;
     RawEvent mEventBuffer[EVENT_BUFFER_SIZE];
+    RawEvent mPartitionBuffer[EVENT_BUFFER_SIZE];
 
     KeyedVector<int32_t, InputDevice*> mDevices;
 
     // low-level input event decoding and device management
     void processEventsLocked(const RawEvent* rawEvents, size_t count);
+    size_t partitionLatencyCriticalEventsLocked(RawEvent* rawEvents, size_t count);
+    bool isLatencyCriticalDeviceLocked(int32_t deviceId) const;
 
     void addDeviceLocked(nsecs_t when, int32_t deviceId);
     void removeDeviceLocked(nsecs_t when, int32_t deviceId);
@@ -1278,6 +1286,10 @@ protected:
 
         CoverageCalibration coverageCalibration;
 
+        // Prediction horizon in milliseconds, enables the predicted position axes
+        bool havePredictionHorizon;
+        float predictionHorizon;
+
         inline void applySizeScaleAndBias(float* outSize) const {
             if (haveSizeScale) {
                 *outSize *= sizeScale;
@@ -1302,6 +1314,9 @@ protected:
     CookedPointerData mCurrentCookedPointerData;
     CookedPointerData mLastCookedPointerData;
 
+    // Velocity of the cooked pointers, used to predict their positions.
+    VelocityTracker mPredictionVelocityTracker;
+
     // Button state.
     int32_t mCurrentButtonState;
     int32_t mLastButtonState;
@@ -1432,6 +1447,21 @@ private:
     float mOrientedXPrecision;
     float mOrientedYPrecision;
 
+    // Mapping of raw coordinates onto oriented surface coordinates, resolved for the
+    // surface orientation by configureSurface: an oriented coordinate is
+    // (raw - origin) * scale + translate, where the raw coordinate is read from the other
+    // axis when the axes are swapped and the scale is negative when the axis is reversed.
+    bool mOrientedAxesSwapped;
+    int32_t mOrientedXOrigin;
+    float mOrientedXScale;
+    float mOrientedXTranslate;
+    int32_t mOrientedYOrigin;
+    float mOrientedYScale;
+    float mOrientedYTranslate;
+
+    // Rotation added to the orientation of the pointers for the surface orientation.
+    float mOrientedOrientationOffset;
+
     struct CurrentVirtualKeyState {
         bool down;
         bool ignored;
@@ -1640,6 +1670,7 @@ private:
     void dispatchHoverExit(nsecs_t when, uint32_t policyFlags);
     void dispatchHoverEnterAndMove(nsecs_t when, uint32_t policyFlags);
     void cookPointerData();
+    void predictPointerCoords(nsecs_t when);
 
     void dispatchPointerUsage(nsecs_t when, uint32_t policyFlags, PointerUsage pointerUsage);
     void abortPointerUsage(nsecs_t when, uint32_t policyFlags);
@@ -1679,9 +1710,11 @@ private:
             const uint32_t* outIdToIndex, BitSet32 idBits) const;
 
     bool isPointInsideSurface(int32_t x, int32_t y);
+    bool isPredictionEnabled() const;
     const VirtualKey* findVirtualKeyHit(int32_t x, int32_t y);
 
     void assignPointerIds();
+    bool assignPointerIdsFromNearestPointers();
 };
 
 
@@ -0,0 +1,610 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ReplayEventHub"
+
+//#define LOG_NDEBUG 0
+
+#include "ReplayEventHub.h"
+
+#include <cutils/log.h>
+#include <utils/Timers.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#define test_bit(bit, array)    (array[bit/8] & (1<<(bit%8)))
+
+#define INDENT "  "
+#define INDENT2 "    "
+
+namespace android {
+
+static inline const char* toString(bool value) {
+    return value ? "true" : "false";
+}
+
+static inline void setBit(uint8_t* array, int32_t bit, bool value) {
+    if (value) {
+        array[bit / 8] |= 1 << (bit % 8);
+    } else {
+        array[bit / 8] &= ~(1 << (bit % 8));
+    }
+}
+
+
+// --- ReplayEventHub::Device ---
+
+ReplayEventHub::Device::Device() :
+        configuration(NULL), virtualKeyMap(NULL) {
+    resetState();
+}
+
+ReplayEventHub::Device::~Device() {
+    delete configuration;
+    delete virtualKeyMap;
+}
+
+void ReplayEventHub::Device::resetState() {
+    memset(keyState, 0, sizeof(keyState));
+    memset(swState, 0, sizeof(swState));
+    absoluteAxisValues.clear();
+}
+
+
+// --- ReplayEventHub ---
+
+ReplayEventHub::ReplayEventHub(bool realTime) :
+        mRealTime(realTime), mWakeRequested(false),
+        mNextEvent(0), mFirstInputEvent(0), mRepeatCount(1),
+        mStarted(false), mTimeOffset(0) {
+}
+
+ReplayEventHub::~ReplayEventHub() {
+    for (size_t i = 0; i < mLoggedDevices.size(); i++) {
+        delete mLoggedDevices.itemAt(i);
+    }
+}
+
+status_t ReplayEventHub::load(const char* path) {
+    EventLogReader reader;
+    status_t status = reader.open(path);
+    if (status) {
+        return status;
+    }
+
+    AutoMutex _l(mLock);
+
+    // Index of the most recently logged device of each id.
+    KeyedVector<int32_t, size_t> loggedDevicesById;
+
+    EventLogDevice info;
+    Vector<RawEvent> events;
+    for (;;) {
+        events.clear();
+        EventLogReader::RecordType type = reader.readRecord(&info, &events);
+        if (type == EventLogReader::RECORD_NONE) {
+            break;
+        }
+
+        if (type == EventLogReader::RECORD_DEVICE) {
+            Device* device = new Device();
+            device->info = info;
+            loadDeviceFilesLocked(device);
+            loggedDevicesById.replaceValueFor(info.id, mLoggedDevices.add(device));
+            continue;
+        }
+
+        for (size_t i = 0; i < events.size(); i++) {
+            const RawEvent& event = events.itemAt(i);
+            if (event.type == DEVICE_ADDED) {
+                ssize_t index = loggedDevicesById.indexOfKey(event.deviceId);
+                if (index < 0) {
+                    ALOGW("Ignoring the addition of device %d, which is not described by "
+                            "the log.", event.deviceId);
+                    continue;
+                }
+                mAddedDevices.add(mEvents.size(), loggedDevicesById.valueAt(index));
+            }
+            mEvents.push(event);
+        }
+    }
+
+    mFirstInputEvent = 0;
+    while (mFirstInputEvent < mEvents.size()
+            && mEvents.itemAt(mFirstInputEvent).type >= FIRST_SYNTHETIC_EVENT) {
+        mFirstInputEvent++;
+    }
+
+    ALOGI("Loaded %d devices and %d events from %s.", mLoggedDevices.size(),
+            mEvents.size(), path);
+    return OK;
+}
+
+void ReplayEventHub::loadDeviceFilesLocked(Device* device) {
+    const InputDeviceIdentifier& identifier = device->info.identifier;
+    const uint32_t classes = device->info.classes;
+
+    String8 configurationFile = getInputDeviceConfigurationFilePathByDeviceIdentifier(
+            identifier, INPUT_DEVICE_CONFIGURATION_FILE_TYPE_CONFIGURATION);
+    if (!configurationFile.isEmpty()
+            && PropertyMap::load(configurationFile, &device->configuration)) {
+        ALOGE("Error loading input device configuration file for device '%s'.  "
+                "Using default configuration.", identifier.name.string());
+    }
+
+    if (classes & INPUT_DEVICE_CLASS_TOUCH) {
+        // The virtual key map is supplied by the kernel as a system board property file.
+        String8 path;
+        path.append("/sys/board_properties/virtualkeys.");
+        path.append(identifier.name);
+        if (!access(path.string(), R_OK)) {
+            VirtualKeyMap::load(path, &device->virtualKeyMap);
+        }
+    }
+
+    if (classes & (INPUT_DEVICE_CLASS_KEYBOARD | INPUT_DEVICE_CLASS_JOYSTICK)) {
+        device->keyMap.load(identifier, device->configuration);
+    }
+}
+
+void ReplayEventHub::setRepeatCount(int repeatCount) {
+    AutoMutex _l(mLock);
+    mRepeatCount = repeatCount;
+}
+
+bool ReplayEventHub::isDone() const {
+    AutoMutex _l(mLock);
+    return mNextEvent >= mEvents.size()
+            && (mRepeatCount <= 1 || mFirstInputEvent == mEvents.size());
+}
+
+int32_t ReplayEventHub::peekDeviceId() const {
+    AutoMutex _l(mLock);
+    size_t next = mNextEvent;
+    if (next >= mEvents.size() && mRepeatCount > 1) {
+        next = mFirstInputEvent;
+    }
+    if (next >= mEvents.size() || mEvents.itemAt(next).type >= FIRST_SYNTHETIC_EVENT) {
+        return -1;
+    }
+    return mEvents.itemAt(next).deviceId;
+}
+
+size_t ReplayEventHub::getLoggedDeviceCount() const {
+    AutoMutex _l(mLock);
+    return mLoggedDevices.size();
+}
+
+size_t ReplayEventHub::getLoggedInputEventCount() const {
+    AutoMutex _l(mLock);
+    return mEvents.size() - mFirstInputEvent;
+}
+
+ReplayEventHub::Device* ReplayEventHub::getDeviceLocked(int32_t deviceId) const {
+    ssize_t index = mDevices.indexOfKey(deviceId);
+    return index >= 0 ? mDevices.valueAt(index) : NULL;
+}
+
+uint32_t ReplayEventHub::getDeviceClasses(int32_t deviceId) const {
+    AutoMutex _l(mLock);
+    Device* device = getDeviceLocked(deviceId);
+    return device ? device->info.classes : 0;
+}
+
+InputDeviceIdentifier ReplayEventHub::getDeviceIdentifier(int32_t deviceId) const {
+    AutoMutex _l(mLock);
+    Device* device = getDeviceLocked(deviceId);
+    return device ? device->info.identifier : InputDeviceIdentifier();
+}
+
+int32_t ReplayEventHub::getDeviceControllerNumber(int32_t deviceId) const {
+    // Controller numbers are not logged.
+    return 0;
+}
+
+void ReplayEventHub::getConfiguration(int32_t deviceId, PropertyMap* outConfiguration) const {
+    AutoMutex _l(mLock);
+    Device* device = getDeviceLocked(deviceId);
+    if (device && device->configuration) {
+        *outConfiguration = *device->configuration;
+    } else {
+        outConfiguration->clear();
+    }
+}
+
+status_t ReplayEventHub::getAbsoluteAxisInfo(int32_t deviceId, int axis,
+        RawAbsoluteAxisInfo* outAxisInfo) const {
+    outAxisInfo->clear();
+
+    AutoMutex _l(mLock);
+    Device* device = getDeviceLocked(deviceId);
+    if (device) {
+        ssize_t index = device->info.absoluteAxes.indexOfKey(axis);
+        if (index >= 0) {
+            *outAxisInfo = device->info.absoluteAxes.valueAt(index);
+            return OK;
+        }
+    }
+    return -1;
+}
+
+bool ReplayEventHub::hasRelativeAxis(int32_t deviceId, int axis) const {
+    if (axis >= 0 && axis <= REL_MAX) {
+        AutoMutex _l(mLock);
+        Device* device = getDeviceLocked(deviceId);
+        if (device) {
+            return test_bit(axis, device->info.relBitmask);
+        }
+    }
+    return false;
+}
+
+bool ReplayEventHub::hasInputProperty(int32_t deviceId, int property) const {
+    if (property >= 0 && property <= INPUT_PROP_MAX) {
+        AutoMutex _l(mLock);
+        Device* device = getDeviceLocked(deviceId);
+        if (device) {
+            return test_bit(property, device->info.propBitmask);
+        }
+    }
+    return false;
+}
+
+status_t ReplayEventHub::mapKey(int32_t deviceId, int32_t scanCode, int32_t usageCode,
+        int32_t* outKeycode, uint32_t* outFlags) const {
+    AutoMutex _l(mLock);
+    Device* device = getDeviceLocked(deviceId);
+
+    if (device) {
+        // Check the key character map first.
+        sp<KeyCharacterMap> kcm = device->getKeyCharacterMap();
+        if (kcm != NULL) {
+            if (!kcm->mapKey(scanCode, usageCode, outKeycode)) {
+                *outFlags = 0;
+                return NO_ERROR;
+            }
+        }
+
+        // Check the key layout next.
+        if (device->keyMap.haveKeyLayout()) {
+            if (!device->keyMap.keyLayoutMap->mapKey(
+                    scanCode, usageCode, outKeycode, outFlags)) {
+                return NO_ERROR;
+            }
+        }
+    }
+
+    *outKeycode = 0;
+    *outFlags = 0;
+    return NAME_NOT_FOUND;
+}
+
+status_t ReplayEventHub::mapAxis(int32_t deviceId, int32_t scanCode,
+        AxisInfo* outAxisInfo) const {
+    AutoMutex _l(mLock);
+    Device* device = getDeviceLocked(deviceId);
+
+    if (device && device->keyMap.haveKeyLayout()) {
+        if (!device->keyMap.keyLayoutMap->mapAxis(scanCode, outAxisInfo)) {
+            return NO_ERROR;
+        }
+    }
+    return NAME_NOT_FOUND;
+}
+
+void ReplayEventHub::setExcludedDevices(const Vector<String8>& devices) {
+    // The log only holds the devices the EventHub opened.
+}
+
+int32_t ReplayEventHub::getScanCodeState(int32_t deviceId, int32_t scanCode) const {
+    if (scanCode >= 0 && scanCode <= KEY_MAX) {
+        AutoMutex _l(mLock);
+        Device* device = getDeviceLocked(deviceId);
+        if (device && test_bit(scanCode, device->info.keyBitmask)) {
+            return test_bit(scanCode, device->keyState) ? AKEY_STATE_DOWN : AKEY_STATE_UP;
+        }
+    }
+    return AKEY_STATE_UNKNOWN;
+}
+
+int32_t ReplayEventHub::getKeyCodeState(int32_t deviceId, int32_t keyCode) const {
+    AutoMutex _l(mLock);
+    Device* device = getDeviceLocked(deviceId);
+    if (device && device->keyMap.haveKeyLayout()) {
+        Vector<int32_t> scanCodes;
+        device->keyMap.keyLayoutMap->findScanCodesForKey(keyCode, &scanCodes);
+        if (scanCodes.size() != 0) {
+            for (size_t i = 0; i < scanCodes.size(); i++) {
+                int32_t sc = scanCodes.itemAt(i);
+                if (sc >= 0 && sc <= KEY_MAX && test_bit(sc, device->keyState)) {
+                    return AKEY_STATE_DOWN;
+                }
+            }
+            return AKEY_STATE_UP;
+        }
+    }
+    return AKEY_STATE_UNKNOWN;
+}
+
+int32_t ReplayEventHub::getSwitchState(int32_t deviceId, int32_t sw) const {
+    if (sw >= 0 && sw <= SW_MAX) {
+        AutoMutex _l(mLock);
+        Device* device = getDeviceLocked(deviceId);
+        if (device && test_bit(sw, device->info.swBitmask)) {
+            return test_bit(sw, device->swState) ? AKEY_STATE_DOWN : AKEY_STATE_UP;
+        }
+    }
+    return AKEY_STATE_UNKNOWN;
+}
+
+status_t ReplayEventHub::getAbsoluteAxisValue(int32_t deviceId, int32_t axis,
+        int32_t* outValue) const {
+    *outValue = 0;
+
+    AutoMutex _l(mLock);
+    Device* device = getDeviceLocked(deviceId);
+    if (device && device->info.absoluteAxes.indexOfKey(axis) >= 0) {
+        ssize_t index = device->absoluteAxisValues.indexOfKey(axis);
+        if (index >= 0) {
+            *outValue = device->absoluteAxisValues.valueAt(index);
+        }
+        return OK;
+    }
+    return -1;
+}
+
+bool ReplayEventHub::markSupportedKeyCodes(int32_t deviceId, size_t numCodes,
+        const int32_t* keyCodes, uint8_t* outFlags) const {
+    AutoMutex _l(mLock);
+    Device* device = getDeviceLocked(deviceId);
+    if (device && device->keyMap.haveKeyLayout()) {
+        Vector<int32_t> scanCodes;
+        for (size_t codeIndex = 0; codeIndex < numCodes; codeIndex++) {
+            scanCodes.clear();
+
+            status_t err = device->keyMap.keyLayoutMap->findScanCodesForKey(
+                    keyCodes[codeIndex], &scanCodes);
+            if (! err) {
+                for (size_t sc = 0; sc < scanCodes.size(); sc++) {
+                    if (test_bit(scanCodes[sc], device->info.keyBitmask)) {
+                        outFlags[codeIndex] = 1;
+                        break;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+size_t ReplayEventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSize) {
+    AutoMutex _l(mLock);
+
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    const nsecs_t timeoutTime = timeoutMillis < 0 ? -1
+            : now + milliseconds_to_nanoseconds(timeoutMillis);
+
+    rewindIfNeededLocked();
+    if (mNextEvent >= mEvents.size()) {
+        // The log is over, behave like an event hub whose devices are idle.
+        if (mRealTime && !mWakeRequested) {
+            if (timeoutTime < 0) {
+                mWakeCondition.wait(mLock);
+            } else {
+                mWakeCondition.waitRelative(mLock, timeoutTime - now);
+            }
+        }
+        mWakeRequested = false;
+        return 0;
+    }
+
+    if (!mStarted) {
+        mStarted = true;
+        mTimeOffset = now - mEvents.itemAt(mNextEvent).when;
+    }
+
+    if (mRealTime) {
+        for (;;) {
+            if (mWakeRequested) {
+                mWakeRequested = false;
+                return 0;
+            }
+
+            const nsecs_t dueTime = mEvents.itemAt(mNextEvent).when + mTimeOffset;
+            if (dueTime <= now) {
+                break;
+            }
+            if (timeoutTime >= 0 && timeoutTime <= now) {
+                return 0;
+            }
+
+            const nsecs_t wakeTime = timeoutTime >= 0 && timeoutTime < dueTime
+                    ? timeoutTime : dueTime;
+            mWakeCondition.waitRelative(mLock, wakeTime - now);
+            now = systemTime(SYSTEM_TIME_MONOTONIC);
+        }
+    }
+
+    size_t count = 0;
+    while (count < bufferSize && mNextEvent < mEvents.size()) {
+        const size_t index = mNextEvent++;
+        RawEvent& event = buffer[count++];
+        event = mEvents.itemAt(index);
+        event.when += mTimeOffset;
+
+        if (event.type == DEVICE_ADDED) {
+            Device* device = mLoggedDevices.itemAt(mAddedDevices.valueFor(index));
+            device->resetState();
+            mDevices.replaceValueFor(event.deviceId, device);
+        } else if (event.type == DEVICE_REMOVED) {
+            mDevices.removeItem(event.deviceId);
+        } else if (event.type < FIRST_SYNTHETIC_EVENT) {
+            applyEventLocked(event);
+        }
+
+        if (event.type >= FIRST_SYNTHETIC_EVENT
+                || (event.type == EV_SYN && event.code == SYN_REPORT)) {
+            break;
+        }
+        if (mNextEvent < mEvents.size()
+                && mEvents.itemAt(mNextEvent).deviceId != event.deviceId) {
+            break;
+        }
+    }
+    return count;
+}
+
+void ReplayEventHub::applyEventLocked(const RawEvent& event) {
+    Device* device = getDeviceLocked(event.deviceId);
+    if (!device) {
+        return;
+    }
+
+    switch (event.type) {
+    case EV_KEY:
+        if (event.code >= 0 && event.code <= KEY_MAX) {
+            setBit(device->keyState, event.code, event.value != 0);
+        }
+        break;
+    case EV_SW:
+        if (event.code >= 0 && event.code <= SW_MAX) {
+            setBit(device->swState, event.code, event.value != 0);
+        }
+        break;
+    case EV_ABS:
+        device->absoluteAxisValues.replaceValueFor(event.code, event.value);
+        break;
+    }
+}
+
+void ReplayEventHub::rewindIfNeededLocked() {
+    if (mNextEvent < mEvents.size() || mRepeatCount <= 1
+            || mFirstInputEvent == mEvents.size()) {
+        return;
+    }
+
+    // Shifts the next pass in time so that the timestamps keep increasing.
+    mRepeatCount--;
+    mTimeOffset += mEvents.top().when - mEvents.itemAt(mFirstInputEvent).when
+            + seconds_to_nanoseconds(1);
+    mNextEvent = mFirstInputEvent;
+}
+
+bool ReplayEventHub::hasScanCode(int32_t deviceId, int32_t scanCode) const {
+    AutoMutex _l(mLock);
+    Device* device = getDeviceLocked(deviceId);
+    if (device && scanCode >= 0 && scanCode <= KEY_MAX) {
+        return test_bit(scanCode, device->info.keyBitmask);
+    }
+    return false;
+}
+
+bool ReplayEventHub::hasLed(int32_t deviceId, int32_t led) const {
+    AutoMutex _l(mLock);
+    Device* device = getDeviceLocked(deviceId);
+    if (device && led >= 0 && led <= LED_MAX) {
+        return test_bit(led, device->info.ledBitmask);
+    }
+    return false;
+}
+
+void ReplayEventHub::setLedState(int32_t deviceId, int32_t led, bool on) {
+}
+
+void ReplayEventHub::getVirtualKeyDefinitions(int32_t deviceId,
+        Vector<VirtualKeyDefinition>& outVirtualKeys) const {
+    outVirtualKeys.clear();
+
+    AutoMutex _l(mLock);
+    Device* device = getDeviceLocked(deviceId);
+    if (device && device->virtualKeyMap) {
+        outVirtualKeys.appendVector(device->virtualKeyMap->getVirtualKeys());
+    }
+}
+
+sp<KeyCharacterMap> ReplayEventHub::getKeyCharacterMap(int32_t deviceId) const {
+    AutoMutex _l(mLock);
+    Device* device = getDeviceLocked(deviceId);
+    if (device) {
+        return device->getKeyCharacterMap();
+    }
+    return NULL;
+}
+
+bool ReplayEventHub::setKeyboardLayoutOverlay(int32_t deviceId,
+        const sp<KeyCharacterMap>& map) {
+    AutoMutex _l(mLock);
+    Device* device = getDeviceLocked(deviceId);
+    if (device) {
+        if (map != device->overlayKeyMap) {
+            device->overlayKeyMap = map;
+            device->combinedKeyMap = KeyCharacterMap::combine(
+                    device->keyMap.keyCharacterMap, map);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ReplayEventHub::vibrate(int32_t deviceId, nsecs_t duration) {
+}
+
+void ReplayEventHub::cancelVibrate(int32_t deviceId) {
+}
+
+void ReplayEventHub::requestReopenDevices() {
+    // The devices of the log cannot be reopened.
+}
+
+void ReplayEventHub::wake() {
+    AutoMutex _l(mLock);
+    mWakeRequested = true;
+    mWakeCondition.signal();
+}
+
+void ReplayEventHub::dump(String8& dump) {
+    dump.append("Event Hub State:\n");
+
+    {
+        AutoMutex _l(mLock);
+
+        dump.appendFormat(INDENT "Replaying: %s\n", mRealTime ? "real time" : "fast");
+        dump.appendFormat(INDENT "Events: %d / %d\n", mNextEvent, mEvents.size());
+        dump.appendFormat(INDENT "RepeatCount: %d\n", mRepeatCount);
+
+        dump.append(INDENT "Devices:\n");
+        for (size_t i = 0; i < mDevices.size(); i++) {
+            const Device* device = mDevices.valueAt(i);
+            dump.appendFormat(INDENT2 "%d: %s\n", mDevices.keyAt(i),
+                    device->info.identifier.name.string());
+            dump.appendFormat(INDENT2 "  Classes: 0x%08x\n", device->info.classes);
+            dump.appendFormat(INDENT2 "  Descriptor: %s\n",
+                    device->info.identifier.descriptor.string());
+            dump.appendFormat(INDENT2 "  HaveKeyboardLayoutOverlay: %s\n",
+                    toString(device->overlayKeyMap != NULL));
+        }
+    } // release lock
+}
+
+void ReplayEventHub::monitor() {
+    // Acquire and release the lock to ensure that the event hub has not deadlocked.
+    mLock.lock();
+    mLock.unlock();
+}
+
+}; // namespace android
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UI_INPUT_REPLAY_EVENT_HUB_H
+#define _UI_INPUT_REPLAY_EVENT_HUB_H
+
+#include "EventHub.h"
+#include "EventLog.h"
+
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+
+namespace android {
+
+/*
+ * An event hub that replays an event log recorded by the EventHub (see the
+ * debug.input.capture property) instead of reading the input devices.
+ *
+ * The devices of the log are added and removed when their notifications are
+ * replayed. Their configuration, key maps and virtual keys are loaded from the
+ * files of the system that replays the log, the same way the EventHub loads them.
+ *
+ * The timestamps of the events are shifted so that the first event is stamped
+ * with the time the replay starts. In real time mode, getEvents() waits until
+ * the next event is due, so that the load of the recording is reproduced
+ * exactly. Otherwise the events are returned as fast as they are read.
+ *
+ * Each call to getEvents() returns the events of a single device up to its next
+ * SYN_REPORT, so that the cost of each batch can be attributed to a device.
+ */
+class ReplayEventHub : public EventHubInterface {
+public:
+    ReplayEventHub(bool realTime);
+
+    status_t load(const char* path);
+
+    /* Replays the input events of the log the specified number of times. Device
+     * notifications that precede the first input event are only replayed once. */
+    void setRepeatCount(int repeatCount);
+
+    /* Returns true once every event has been returned. */
+    bool isDone() const;
+
+    /* Returns the device of the events returned by the next call to getEvents(),
+     * or -1 if the next event is a device notification. */
+    int32_t peekDeviceId() const;
+
+    size_t getLoggedDeviceCount() const;
+    size_t getLoggedInputEventCount() const;
+
+    virtual uint32_t getDeviceClasses(int32_t deviceId) const;
+
+    virtual InputDeviceIdentifier getDeviceIdentifier(int32_t deviceId) const;
+
+    virtual int32_t getDeviceControllerNumber(int32_t deviceId) const;
+
+    virtual void getConfiguration(int32_t deviceId, PropertyMap* outConfiguration) const;
+
+    virtual status_t getAbsoluteAxisInfo(int32_t deviceId, int axis,
+            RawAbsoluteAxisInfo* outAxisInfo) const;
+
+    virtual bool hasRelativeAxis(int32_t deviceId, int axis) const;
+
+    virtual bool hasInputProperty(int32_t deviceId, int property) const;
+
+    virtual status_t mapKey(int32_t deviceId, int32_t scanCode, int32_t usageCode,
+            int32_t* outKeycode, uint32_t* outFlags) const;
+
+    virtual status_t mapAxis(int32_t deviceId, int32_t scanCode,
+            AxisInfo* outAxisInfo) const;
+
+    virtual void setExcludedDevices(const Vector<String8>& devices);
+
+    virtual int32_t getScanCodeState(int32_t deviceId, int32_t scanCode) const;
+    virtual int32_t getKeyCodeState(int32_t deviceId, int32_t keyCode) const;
+    virtual int32_t getSwitchState(int32_t deviceId, int32_t sw) const;
+    virtual status_t getAbsoluteAxisValue(int32_t deviceId, int32_t axis, int32_t* outValue) const;
+
+    virtual bool markSupportedKeyCodes(int32_t deviceId, size_t numCodes,
+            const int32_t* keyCodes, uint8_t* outFlags) const;
+
+    virtual size_t getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSize);
+
+    virtual bool hasScanCode(int32_t deviceId, int32_t scanCode) const;
+    virtual bool hasLed(int32_t deviceId, int32_t led) const;
+    virtual void setLedState(int32_t deviceId, int32_t led, bool on);
+
+    virtual void getVirtualKeyDefinitions(int32_t deviceId,
+            Vector<VirtualKeyDefinition>& outVirtualKeys) const;
+
+    virtual sp<KeyCharacterMap> getKeyCharacterMap(int32_t deviceId) const;
+    virtual bool setKeyboardLayoutOverlay(int32_t deviceId, const sp<KeyCharacterMap>& map);
+
+    virtual void vibrate(int32_t deviceId, nsecs_t duration);
+    virtual void cancelVibrate(int32_t deviceId);
+
+    virtual void requestReopenDevices();
+
+    virtual void wake();
+
+    virtual void dump(String8& dump);
+    virtual void monitor();
+
+protected:
+    virtual ~ReplayEventHub();
+
+private:
+    struct Device {
+        EventLogDevice info;
+
+        PropertyMap* configuration;
+        VirtualKeyMap* virtualKeyMap;
+        KeyMap keyMap;
+
+        sp<KeyCharacterMap> overlayKeyMap;
+        sp<KeyCharacterMap> combinedKeyMap;
+
+        // State of the device as of the last event returned by getEvents().
+        uint8_t keyState[(KEY_MAX + 1) / 8];
+        uint8_t swState[(SW_MAX + 1) / 8];
+        KeyedVector<int32_t, int32_t> absoluteAxisValues;
+
+        Device();
+        ~Device();
+
+        void resetState();
+
+        const sp<KeyCharacterMap>& getKeyCharacterMap() const {
+            if (combinedKeyMap != NULL) {
+                return combinedKeyMap;
+            }
+            return keyMap.keyCharacterMap;
+        }
+    };
+
+    Device* getDeviceLocked(int32_t deviceId) const;
+
+    void loadDeviceFilesLocked(Device* device);
+    void rewindIfNeededLocked();
+    void applyEventLocked(const RawEvent& event);
+
+    bool mRealTime;
+
+    mutable Mutex mLock;
+    Condition mWakeCondition;
+    bool mWakeRequested;
+
+    // Every device of the log, in the order of the log.
+    Vector<Device*> mLoggedDevices;
+
+    // Devices that are currently added, by id.
+    KeyedVector<int32_t, Device*> mDevices;
+
+    // Events of the log and, for each DEVICE_ADDED notification, the index of the
+    // logged device it adds.
+    Vector<RawEvent> mEvents;
+    KeyedVector<size_t, size_t> mAddedDevices;
+
+    size_t mNextEvent;
+    // Index of the first event that is not a device notification.
+    size_t mFirstInputEvent;
+    int mRepeatCount;
+
+    // Added to the logged timestamps, computed when the first event is returned.
+    bool mStarted;
+    nsecs_t mTimeOffset;
+};
+
+}; // namespace android
+
+#endif // _UI_INPUT_REPLAY_EVENT_HUB_H
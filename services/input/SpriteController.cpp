@@ -22,6 +22,7 @@
 
 #include <cutils/log.h>
 #include <utils/String8.h>
+#include <utils/Timers.h>
 #include <gui/Surface.h>
 
 #include <SkBitmap.h>
@@ -33,6 +34,10 @@
 
 namespace android {
 
+// Minimum interval between two updates that only move sprites, such as the
+// pointer following a mouse that reports faster than the display refreshes.
+static const nsecs_t POSITION_UPDATE_INTERVAL = 1000000000LL / 60;
+
 // --- SpriteController ---
 
 SpriteController::SpriteController(const sp<Looper>& looper, int32_t overlayLayer) :
@@ -41,6 +46,10 @@ SpriteController::SpriteController(const sp<Looper>& looper, int32_t overlayLaye
 
     mLocked.transactionNestingCount = 0;
     mLocked.deferredSpriteUpdate = false;
+    mLocked.deferredSpriteUpdateUrgent = false;
+    mLocked.updateScheduled = false;
+    mLocked.updateDelayed = false;
+    mLocked.lastUpdateTime = 0;
 }
 
 SpriteController::~SpriteController() {
@@ -71,20 +80,44 @@ void SpriteController::closeTransaction() {
     mLocked.transactionNestingCount -= 1;
     if (mLocked.transactionNestingCount == 0 && mLocked.deferredSpriteUpdate) {
         mLocked.deferredSpriteUpdate = false;
-        mLooper->sendMessage(mHandler, Message(MSG_UPDATE_SPRITES));
+        scheduleUpdateLocked(mLocked.deferredSpriteUpdateUrgent);
+        mLocked.deferredSpriteUpdateUrgent = false;
     }
 }
 
-void SpriteController::invalidateSpriteLocked(const sp<SpriteImpl>& sprite) {
-    bool wasEmpty = mLocked.invalidatedSprites.isEmpty();
-    mLocked.invalidatedSprites.push(sprite);
-    if (wasEmpty) {
-        if (mLocked.transactionNestingCount != 0) {
-            mLocked.deferredSpriteUpdate = true;
-        } else {
-            mLooper->sendMessage(mHandler, Message(MSG_UPDATE_SPRITES));
+void SpriteController::invalidateSpriteLocked(const sp<SpriteImpl>& sprite,
+        bool wasDirty, uint32_t dirty) {
+    if (!wasDirty) {
+        mLocked.invalidatedSprites.push(sprite);
+    }
+
+    // Anything but a move changes what is on screen and is not delayed.
+    bool urgent = dirty & ~DIRTY_POSITION;
+    if (mLocked.transactionNestingCount != 0) {
+        mLocked.deferredSpriteUpdate = true;
+        mLocked.deferredSpriteUpdateUrgent |= urgent;
+    } else {
+        scheduleUpdateLocked(urgent);
+    }
+}
+
+void SpriteController::scheduleUpdateLocked(bool urgent) {
+    if (mLocked.updateScheduled) {
+        if (!urgent || !mLocked.updateDelayed) {
+            return;
         }
+        mLooper->removeMessages(mHandler, MSG_UPDATE_SPRITES);
+    }
+
+    nsecs_t nextUpdateTime = mLocked.lastUpdateTime + POSITION_UPDATE_INTERVAL;
+    if (!urgent && systemTime(SYSTEM_TIME_MONOTONIC) < nextUpdateTime) {
+        mLooper->sendMessageAtTime(nextUpdateTime, mHandler, Message(MSG_UPDATE_SPRITES));
+        mLocked.updateDelayed = true;
+    } else {
+        mLooper->sendMessage(mHandler, Message(MSG_UPDATE_SPRITES));
+        mLocked.updateDelayed = false;
     }
+    mLocked.updateScheduled = true;
 }
 
 void SpriteController::disposeSurfaceLocked(const sp<SurfaceControl>& surfaceControl) {
@@ -117,6 +150,10 @@ void SpriteController::doUpdateSprites() {
     { // acquire lock
         AutoMutex _l(mLock);
 
+        mLocked.updateScheduled = false;
+        mLocked.updateDelayed = false;
+        mLocked.lastUpdateTime = systemTime(SYSTEM_TIME_MONOTONIC);
+
         numSprites = mLocked.invalidatedSprites.size();
         for (size_t i = 0; i < numSprites; i++) {
             const sp<SpriteImpl>& sprite = mLocked.invalidatedSprites.itemAt(i);
@@ -384,6 +421,7 @@ sp<SurfaceControl> SpriteController::obtainSurface(int32_t width, int32_t height
 
 SpriteController::SpriteImpl::SpriteImpl(const sp<SpriteController> controller) :
         mController(controller) {
+    mLocked.iconGenerationId = 0;
 }
 
 SpriteController::SpriteImpl::~SpriteImpl() {
@@ -402,7 +440,18 @@ void SpriteController::SpriteImpl::setIcon(const SpriteIcon& icon) {
 
     uint32_t dirty;
     if (icon.isValid()) {
+        // Sprites usually switch between a few icons loaded once, so the icon being set
+        // is often the one the surface already shows: skip copying and redrawing it.
+        uint32_t generationId = icon.bitmap.getGenerationID();
+        if (generationId != 0 && generationId == mLocked.iconGenerationId
+                && mLocked.state.icon.isValid()
+                && mLocked.state.icon.hotSpotX == icon.hotSpotX
+                && mLocked.state.icon.hotSpotY == icon.hotSpotY) {
+            return;
+        }
+
         icon.bitmap.copyTo(&mLocked.state.icon.bitmap, SkBitmap::kARGB_8888_Config);
+        mLocked.iconGenerationId = generationId;
 
         if (!mLocked.state.icon.isValid()
                 || mLocked.state.icon.hotSpotX != icon.hotSpotX
@@ -415,6 +464,7 @@ void SpriteController::SpriteImpl::setIcon(const SpriteIcon& icon) {
         }
     } else if (mLocked.state.icon.isValid()) {
         mLocked.state.icon.bitmap.reset();
+        mLocked.iconGenerationId = 0;
         dirty = DIRTY_BITMAP | DIRTY_HOTSPOT;
     } else {
         return; // setting to invalid icon and already invalid so nothing to do
@@ -474,9 +524,7 @@ void SpriteController::SpriteImpl::invalidateLocked(uint32_t dirty) {
     bool wasDirty = mLocked.state.dirty;
     mLocked.state.dirty |= dirty;
 
-    if (!wasDirty) {
-        mController->invalidateSpriteLocked(this);
-    }
+    mController->invalidateSpriteLocked(this, wasDirty, dirty);
 }
 
 } // namespace android
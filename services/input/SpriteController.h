@@ -132,6 +132,7 @@ public:
  * by other components.
  *
  * All sprite position updates and rendering is performed asynchronously.
+ * Updates that only move sprites are coalesced to at most one per frame.
  *
  * Clients are responsible for animating sprites by periodically updating their properties.
  */
@@ -245,6 +246,9 @@ private:
 
         struct Locked {
             SpriteState state;
+
+            // Generation id of the bitmap the icon was copied from, or 0 if unknown.
+            uint32_t iconGenerationId;
         } mLocked; // guarded by mController->mLock
 
         void invalidateLocked(uint32_t dirty);
@@ -275,9 +279,16 @@ private:
         Vector<sp<SurfaceControl> > disposedSurfaces;
         uint32_t transactionNestingCount;
         bool deferredSpriteUpdate;
+        bool deferredSpriteUpdateUrgent;
+
+        // An update message is queued, and is delayed to the next frame.
+        bool updateScheduled;
+        bool updateDelayed;
+        nsecs_t lastUpdateTime;
     } mLocked; // guarded by mLock
 
-    void invalidateSpriteLocked(const sp<SpriteImpl>& sprite);
+    void invalidateSpriteLocked(const sp<SpriteImpl>& sprite, bool wasDirty, uint32_t dirty);
+    void scheduleUpdateLocked(bool urgent);
     void disposeSurfaceLocked(const sp<SurfaceControl>& surfaceControl);
 
     void handleMessage(const Message& message);
@@ -0,0 +1,22 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    ReplayBenchmark.cpp
+
+LOCAL_C_INCLUDES += \
+    external/skia/include/core
+
+LOCAL_SHARED_LIBRARIES := \
+    libcutils \
+    liblog \
+    libutils \
+    libui \
+    libskia \
+    libinput \
+    libinputservice
+
+LOCAL_MODULE:= inputreplay
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
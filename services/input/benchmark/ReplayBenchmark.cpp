@@ -0,0 +1,501 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays an event log recorded by the EventHub (see the property debug.input.capture)
+ * through the InputReader and the InputDispatcher, as fast as possible, and reports
+ * the CPU time and the allocations spent on the events of each device:
+ *
+ *   inputreplay <event log> [repeat count] [display width] [display height]
+ *
+ * The events are delivered to a full screen window whose input channel is drained
+ * as soon as the dispatcher publishes to it, so that the dispatcher never waits.
+ * The display is 1080x1920 by default.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <input/InputTransport.h>
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include "../InputDispatcher.h"
+#include "../InputReader.h"
+#include "../ReplayEventHub.h"
+
+using namespace android;
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+#define DEFAULT_DISPLAY_WIDTH 1080
+#define DEFAULT_DISPLAY_HEIGHT 1920
+
+// Dispatcher iterations run after the last event, to process the last finished signals
+#define DRAIN_ITERATIONS 16
+
+///////////////////////////////////////////////////////////////////////////////
+// Allocations
+///////////////////////////////////////////////////////////////////////////////
+
+// The benchmark runs the reader and the dispatcher on a single thread, every
+// allocation through operator new is counted. Allocations made with malloc(),
+// such as the storage of the utils containers, are not.
+static size_t gAllocationCount = 0;
+
+void* operator new(size_t size) {
+    gAllocationCount++;
+    void* p = malloc(size ? size : 1);
+    if (!p) abort();
+    return p;
+}
+
+void* operator new[](size_t size) {
+    gAllocationCount++;
+    void* p = malloc(size ? size : 1);
+    if (!p) abort();
+    return p;
+}
+
+void operator delete(void* p) {
+    free(p);
+}
+
+void operator delete[](void* p) {
+    free(p);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Policies
+///////////////////////////////////////////////////////////////////////////////
+
+class ReplayPointerController : public PointerControllerInterface {
+public:
+    ReplayPointerController(float maxX, float maxY): mMaxX(maxX), mMaxY(maxY),
+            mX(0), mY(0), mButtonState(0) {
+    }
+
+    virtual bool getBounds(float* outMinX, float* outMinY,
+            float* outMaxX, float* outMaxY) const {
+        *outMinX = 0;
+        *outMinY = 0;
+        *outMaxX = mMaxX;
+        *outMaxY = mMaxY;
+        return true;
+    }
+
+    virtual void move(float deltaX, float deltaY) {
+        setPosition(mX + deltaX, mY + deltaY);
+    }
+
+    virtual void setButtonState(int32_t buttonState) {
+        mButtonState = buttonState;
+    }
+
+    virtual int32_t getButtonState() const {
+        return mButtonState;
+    }
+
+    virtual void setPosition(float x, float y) {
+        mX = x < 0 ? 0 : (x > mMaxX ? mMaxX : x);
+        mY = y < 0 ? 0 : (y > mMaxY ? mMaxY : y);
+    }
+
+    virtual void getPosition(float* outX, float* outY) const {
+        *outX = mX;
+        *outY = mY;
+    }
+
+    virtual void fade(Transition transition) {
+    }
+
+    virtual void unfade(Transition transition) {
+    }
+
+    virtual void setPresentation(Presentation presentation) {
+    }
+
+    virtual void setSpots(const PointerCoords* spotCoords, const uint32_t* spotIdToIndex,
+            BitSet32 spotIdBits) {
+    }
+
+    virtual void clearSpots() {
+    }
+
+private:
+    float mMaxX;
+    float mMaxY;
+    float mX;
+    float mY;
+    int32_t mButtonState;
+}; // class ReplayPointerController
+
+class ReplayReaderPolicy : public InputReaderPolicyInterface {
+public:
+    ReplayReaderPolicy(int32_t width, int32_t height) {
+        DisplayViewport viewport;
+        viewport.displayId = 0;
+        viewport.orientation = DISPLAY_ORIENTATION_0;
+        viewport.logicalLeft = 0;
+        viewport.logicalTop = 0;
+        viewport.logicalRight = width;
+        viewport.logicalBottom = height;
+        viewport.physicalLeft = 0;
+        viewport.physicalTop = 0;
+        viewport.physicalRight = width;
+        viewport.physicalBottom = height;
+        viewport.deviceWidth = width;
+        viewport.deviceHeight = height;
+        mConfig.setDisplayInfo(false /*external*/, viewport);
+
+        mPointerController = new ReplayPointerController(width - 1, height - 1);
+    }
+
+    virtual void getReaderConfiguration(InputReaderConfiguration* outConfig) {
+        *outConfig = mConfig;
+    }
+
+    virtual sp<PointerControllerInterface> obtainPointerController(int32_t deviceId) {
+        return mPointerController;
+    }
+
+    virtual void notifyInputDevicesChanged(const Vector<InputDeviceInfo>& inputDevices) {
+    }
+
+    virtual sp<KeyCharacterMap> getKeyboardLayoutOverlay(const String8& inputDeviceDescriptor) {
+        return NULL;
+    }
+
+    virtual String8 getDeviceAlias(const InputDeviceIdentifier& identifier) {
+        return String8::empty();
+    }
+
+private:
+    InputReaderConfiguration mConfig;
+    sp<PointerControllerInterface> mPointerController;
+}; // class ReplayReaderPolicy
+
+class ReplayDispatcherPolicy : public InputDispatcherPolicyInterface {
+public:
+    virtual void notifyConfigurationChanged(nsecs_t when) {
+    }
+
+    virtual nsecs_t notifyANR(const sp<InputApplicationHandle>& inputApplicationHandle,
+            const sp<InputWindowHandle>& inputWindowHandle, const String8& reason) {
+        fprintf(stderr, "Unexpected ANR: %s\n", reason.string());
+        return 0;
+    }
+
+    virtual void notifyInputChannelBroken(const sp<InputWindowHandle>& inputWindowHandle) {
+    }
+
+    virtual void getDispatcherConfiguration(InputDispatcherConfiguration* outConfig) {
+        *outConfig = mConfig;
+    }
+
+    // Key repeats depend on the time the replay takes, not on the log
+    virtual bool isKeyRepeatEnabled() {
+        return false;
+    }
+
+    virtual bool filterInputEvent(const InputEvent* inputEvent, uint32_t policyFlags) {
+        return true;
+    }
+
+    virtual void interceptKeyBeforeQueueing(const KeyEvent* keyEvent, uint32_t& policyFlags) {
+        policyFlags |= POLICY_FLAG_PASS_TO_USER;
+    }
+
+    virtual void interceptMotionBeforeQueueing(nsecs_t when, uint32_t& policyFlags) {
+        policyFlags |= POLICY_FLAG_PASS_TO_USER;
+    }
+
+    virtual nsecs_t interceptKeyBeforeDispatching(const sp<InputWindowHandle>& inputWindowHandle,
+            const KeyEvent* keyEvent, uint32_t policyFlags) {
+        return 0;
+    }
+
+    virtual bool dispatchUnhandledKey(const sp<InputWindowHandle>& inputWindowHandle,
+            const KeyEvent* keyEvent, uint32_t policyFlags, KeyEvent* outFallbackKeyEvent) {
+        return false;
+    }
+
+    virtual void notifySwitch(nsecs_t when,
+            uint32_t switchValues, uint32_t switchMask, uint32_t policyFlags) {
+    }
+
+    virtual void pokeUserActivity(nsecs_t eventTime, int32_t eventType) {
+    }
+
+    virtual bool checkInjectEventsPermissionNonReentrant(
+            int32_t injectorPid, int32_t injectorUid) {
+        return false;
+    }
+
+private:
+    InputDispatcherConfiguration mConfig;
+}; // class ReplayDispatcherPolicy
+
+///////////////////////////////////////////////////////////////////////////////
+// Window
+///////////////////////////////////////////////////////////////////////////////
+
+class ReplayApplicationHandle : public InputApplicationHandle {
+public:
+    virtual bool updateInfo() {
+        if (!mInfo) {
+            mInfo = new InputApplicationInfo();
+            mInfo->name.setTo("inputreplay");
+            mInfo->dispatchingTimeout = seconds_to_nanoseconds(5);
+        }
+        return true;
+    }
+}; // class ReplayApplicationHandle
+
+/**
+ * A focused, full screen and touchable window.
+ */
+class ReplayWindowHandle : public InputWindowHandle {
+public:
+    ReplayWindowHandle(const sp<InputApplicationHandle>& application,
+            const sp<InputChannel>& channel, int32_t width, int32_t height):
+            InputWindowHandle(application), mChannel(channel), mWidth(width), mHeight(height) {
+    }
+
+    virtual bool updateInfo() {
+        if (!mInfo) {
+            mInfo = new InputWindowInfo();
+            mInfo->inputChannel = mChannel;
+            mInfo->name.setTo("inputreplay");
+            mInfo->layoutParamsFlags = InputWindowInfo::FLAG_SPLIT_TOUCH;
+            mInfo->layoutParamsPrivateFlags = 0;
+            mInfo->layoutParamsType = InputWindowInfo::TYPE_APPLICATION;
+            mInfo->dispatchingTimeout = seconds_to_nanoseconds(5);
+            mInfo->frameLeft = 0;
+            mInfo->frameTop = 0;
+            mInfo->frameRight = mWidth;
+            mInfo->frameBottom = mHeight;
+            mInfo->scaleFactor = 1.0f;
+            mInfo->touchableRegion.setRect(0, 0, mWidth, mHeight);
+            mInfo->visible = true;
+            mInfo->canReceiveKeys = true;
+            mInfo->hasFocus = true;
+            mInfo->hasWallpaper = false;
+            mInfo->paused = false;
+            mInfo->layer = 1;
+            mInfo->ownerPid = 0;
+            mInfo->ownerUid = 0;
+            mInfo->inputFeatures = 0;
+            mInfo->displayId = 0;
+        }
+        return true;
+    }
+
+private:
+    sp<InputChannel> mChannel;
+    int32_t mWidth;
+    int32_t mHeight;
+}; // class ReplayWindowHandle
+
+///////////////////////////////////////////////////////////////////////////////
+// Timings
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Forwards the notifications of the reader to the dispatcher and counts them,
+ * each notification takes at least one dispatcher iteration.
+ */
+class CountingListener : public InputListenerInterface {
+public:
+    CountingListener(const sp<InputListenerInterface>& listener): mListener(listener),
+            mCount(0) {
+    }
+
+    size_t getCount() const {
+        return mCount;
+    }
+
+    virtual void notifyConfigurationChanged(const NotifyConfigurationChangedArgs* args) {
+        mCount++;
+        mListener->notifyConfigurationChanged(args);
+    }
+
+    virtual void notifyKey(const NotifyKeyArgs* args) {
+        mCount++;
+        mListener->notifyKey(args);
+    }
+
+    virtual void notifyMotion(const NotifyMotionArgs* args) {
+        mCount++;
+        mListener->notifyMotion(args);
+    }
+
+    virtual void notifySwitch(const NotifySwitchArgs* args) {
+        mCount++;
+        mListener->notifySwitch(args);
+    }
+
+    virtual void notifyDeviceReset(const NotifyDeviceResetArgs* args) {
+        mCount++;
+        mListener->notifyDeviceReset(args);
+    }
+
+private:
+    sp<InputListenerInterface> mListener;
+    size_t mCount;
+}; // class CountingListener
+
+struct DeviceStats {
+    DeviceStats(): batches(0), notifications(0), readerTime(0), dispatchTime(0),
+            allocations(0) {
+    }
+
+    size_t batches;
+    size_t notifications;
+    nsecs_t readerTime;
+    nsecs_t dispatchTime;
+    size_t allocations;
+};
+
+static nsecs_t cpuTime() {
+    return systemTime(SYSTEM_TIME_THREAD);
+}
+
+static double toUs(nsecs_t time, size_t count) {
+    return count ? time / 1000.0 / count : 0.0;
+}
+
+/**
+ * Runs the dispatcher for the specified number of iterations, then acknowledges
+ * every event published to the window.
+ */
+static void dispatch(const sp<InputDispatcher>& dispatcher,
+        const sp<InputApplicationHandle>& application, InputConsumer& consumer,
+        PreallocatedInputEventFactory& factory, size_t iterations) {
+    for (size_t i = 0; i < iterations; i++) {
+        // Wakes the dispatcher up so that it never blocks once it is idle
+        dispatcher->setFocusedApplication(application);
+        dispatcher->dispatchOnce();
+
+        uint32_t seq;
+        InputEvent* event;
+        while (consumer.consume(&factory, true, -1, &seq, &event) == OK) {
+            consumer.sendFinishedSignal(seq, true);
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Main
+///////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <event log> [repeat count] [display width] "
+                "[display height]\n", argv[0]);
+        return 1;
+    }
+
+    sp<ReplayEventHub> eventHub = new ReplayEventHub(false /*realTime*/);
+    if (eventHub->load(argv[1])) {
+        fprintf(stderr, "Could not read %s\n", argv[1]);
+        return 1;
+    }
+    eventHub->setRepeatCount(argc > 2 ? atoi(argv[2]) : 1);
+
+    const int32_t width = argc > 3 ? atoi(argv[3]) : DEFAULT_DISPLAY_WIDTH;
+    const int32_t height = argc > 4 ? atoi(argv[4]) : DEFAULT_DISPLAY_HEIGHT;
+
+    sp<InputChannel> serverChannel, clientChannel;
+    if (InputChannel::openInputChannelPair(String8("inputreplay"),
+            serverChannel, clientChannel)) {
+        fprintf(stderr, "Could not open an input channel pair\n");
+        return 1;
+    }
+    InputConsumer consumer(clientChannel);
+    PreallocatedInputEventFactory factory;
+
+    sp<InputApplicationHandle> application = new ReplayApplicationHandle();
+    sp<InputWindowHandle> window = new ReplayWindowHandle(application, serverChannel,
+            width, height);
+    Vector<sp<InputWindowHandle> > windows;
+    windows.push(window);
+
+    sp<InputDispatcher> dispatcher = new InputDispatcher(new ReplayDispatcherPolicy());
+    dispatcher->registerInputChannel(serverChannel, window, false);
+    dispatcher->setInputWindows(windows);
+    dispatcher->setFocusedApplication(application);
+    dispatcher->setInputDispatchMode(true, false);
+
+    sp<CountingListener> listener = new CountingListener(dispatcher);
+    sp<InputReader> reader = new InputReader(eventHub, new ReplayReaderPolicy(width, height),
+            listener);
+
+    KeyedVector<int32_t, DeviceStats> stats;
+    while (!eventHub->isDone()) {
+        const int32_t deviceId = eventHub->peekDeviceId();
+        const size_t notifications = listener->getCount();
+        const size_t allocations = gAllocationCount;
+
+        nsecs_t start = cpuTime();
+        reader->loopOnce();
+        nsecs_t end = cpuTime();
+        const nsecs_t readerTime = end - start;
+
+        const size_t count = listener->getCount() - notifications;
+        start = end;
+        dispatch(dispatcher, application, consumer, factory, count + 1);
+        const nsecs_t dispatchTime = cpuTime() - start;
+
+        ssize_t index = stats.indexOfKey(deviceId);
+        if (index < 0) {
+            index = stats.add(deviceId, DeviceStats());
+        }
+        DeviceStats& deviceStats = stats.editValueAt(index);
+        deviceStats.batches++;
+        deviceStats.notifications += count;
+        deviceStats.readerTime += readerTime;
+        deviceStats.dispatchTime += dispatchTime;
+        deviceStats.allocations += gAllocationCount - allocations;
+    }
+    dispatch(dispatcher, application, consumer, factory, DRAIN_ITERATIONS);
+
+    printf("%s: %d devices, %d input events, display %dx%d\n", argv[1],
+            eventHub->getLoggedDeviceCount(), eventHub->getLoggedInputEventCount(),
+            width, height);
+    printf("CPU times in us per batch, a batch holds the events of a device up to a sync\n");
+    printf("  %-32s %10s %8s %8s %8s %8s %8s\n", "device", "classes", "batches",
+            "notified", "reader", "dispatch", "allocs");
+    for (size_t i = 0; i < stats.size(); i++) {
+        const int32_t deviceId = stats.keyAt(i);
+        const DeviceStats& s = stats.valueAt(i);
+        // Device notifications, such as the initial device scan
+        if (deviceId < 0) continue;
+
+        InputDeviceIdentifier identifier = eventHub->getDeviceIdentifier(deviceId);
+        printf("  %-32.32s 0x%08x %8d %8d %8.3f %8.3f %8.2f\n", identifier.name.string(),
+                eventHub->getDeviceClasses(deviceId), s.batches, s.notifications,
+                toUs(s.readerTime, s.batches), toUs(s.dispatchTime, s.batches),
+                s.batches ? double(s.allocations) / s.batches : 0.0);
+    }
+
+    dispatcher->unregisterInputChannel(serverChannel);
+    return 0;
+}
@@ -4639,6 +4639,44 @@ TEST_F(MultiTouchInputMapperTest, Process_PressureAxis_AmplitudeCalibration) {
             x, y, pressure, 0, 0, 0, 0, 0, 0, 0));
 }
 
+TEST_F(MultiTouchInputMapperTest, Process_PredictedPosition_ExtrapolatesVelocity) {
+    MultiTouchInputMapper* mapper = new MultiTouchInputMapper(mDevice);
+    addConfigurationProperty("touch.deviceType", "touchScreen");
+    prepareDisplay(DISPLAY_ORIENTATION_0);
+    prepareAxes(POSITION);
+    addConfigurationProperty("touch.prediction.horizon", "16");
+    addMapperAndConfigure(mapper);
+
+    InputDeviceInfo info;
+    mapper->populateDeviceInfo(&info);
+    ASSERT_TRUE(info.getMotionRange(AMOTION_EVENT_AXIS_GENERIC_5,
+            AINPUT_SOURCE_TOUCHSCREEN) != NULL);
+    ASSERT_TRUE(info.getMotionRange(AMOTION_EVENT_AXIS_GENERIC_6,
+            AINPUT_SOURCE_TOUCHSCREEN) != NULL);
+
+    // The pointer moves right at a constant speed, one sample every 10ms.
+    const nsecs_t interval = 10 * 1000000LL;
+    int32_t rawY = 200;
+    NotifyMotionArgs args;
+    for (int32_t i = 0; i < 3; i++) {
+        nsecs_t when = ARBITRARY_TIME + i * interval;
+        process(mapper, when, DEVICE_ID, EV_ABS, ABS_MT_POSITION_X, 100 + i * 10);
+        process(mapper, when, DEVICE_ID, EV_ABS, ABS_MT_POSITION_Y, rawY);
+        process(mapper, when, DEVICE_ID, EV_SYN, SYN_MT_REPORT, 0);
+        process(mapper, when, DEVICE_ID, EV_SYN, SYN_REPORT, 0);
+        ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyMotionWasCalled(&args));
+    }
+
+    // Velocity in pixels per second, extrapolated over 16ms.
+    float x = toDisplayX(120);
+    float velocity = (toDisplayX(120) - toDisplayX(100)) / 0.02f;
+    ASSERT_NEAR(x, args.pointerCoords[0].getX(), EPSILON);
+    ASSERT_NEAR(x + velocity * 0.016f,
+            args.pointerCoords[0].getAxisValue(AMOTION_EVENT_AXIS_GENERIC_5), 0.1f);
+    ASSERT_NEAR(toDisplayY(rawY),
+            args.pointerCoords[0].getAxisValue(AMOTION_EVENT_AXIS_GENERIC_6), 0.1f);
+}
+
 TEST_F(MultiTouchInputMapperTest, Process_ShouldHandleAllButtons) {
     MultiTouchInputMapper* mapper = new MultiTouchInputMapper(mDevice);
     addConfigurationProperty("touch.deviceType", "touchScreen");
@@ -21,6 +21,7 @@
 #include "jni.h"
 #include <utils/Log.h>
 #include <utils/misc.h>
+#include <utils/threads.h>
 
 #include <fcntl.h>
 #include <stdio.h>
@@ -60,9 +61,21 @@ public:
     virtual int set(int type, struct timespec *ts) = 0;
     virtual int waitForAlarm() = 0;
 
+    int arm(int type, struct timespec *ts, bool *changed = NULL);
+    void expired(int result);
+
 protected:
     int *fds;
     size_t n_fds;
+
+private:
+    /* arm() runs on the threads setting alarms and expired() on the one
+       waiting for them */
+    Mutex armedLock;
+    /* last deadline programmed for each type, so an unchanged one
+       isn't handed to the kernel again */
+    struct timespec armed[ANDROID_ALARM_TYPE_COUNT];
+    bool armedValid[ANDROID_ALARM_TYPE_COUNT];
 };
 
 class AlarmImplAlarmDriver : public AlarmImpl
@@ -92,6 +105,7 @@ AlarmImpl::AlarmImpl(int *fds_, size_t n_fds) : fds(new int[n_fds]),
         n_fds(n_fds)
 {
     memcpy(fds, fds_, n_fds * sizeof(fds[0]));
+    memset(armedValid, 0, sizeof(armedValid));
 }
 
 AlarmImpl::~AlarmImpl()
@@ -102,6 +116,40 @@ AlarmImpl::~AlarmImpl()
     delete [] fds;
 }
 
+int AlarmImpl::arm(int type, struct timespec *ts, bool *changed)
+{
+    /* held across set() so that a deadline is recorded in the order it
+       was programmed */
+    Mutex::Autolock _l(armedLock);
+    bool unchanged = type >= 0 && type < ANDROID_ALARM_TYPE_COUNT && armedValid[type] &&
+            armed[type].tv_sec == ts->tv_sec && armed[type].tv_nsec == ts->tv_nsec;
+    if (changed != NULL) {
+        *changed = !unchanged;
+    }
+    if (unchanged) {
+        return 0;
+    }
+
+    int result = set(type, ts);
+    if (type >= 0 && type < ANDROID_ALARM_TYPE_COUNT) {
+        armed[type] = *ts;
+        armedValid[type] = result >= 0;
+    }
+    return result;
+}
+
+void AlarmImpl::expired(int result)
+{
+    /* a fired or clock-shifted timer is no longer armed, even if the next
+       deadline happens to match the old one */
+    Mutex::Autolock _l(armedLock);
+    for (int type = 0; type < ANDROID_ALARM_TYPE_COUNT; type++) {
+        if ((result & ANDROID_ALARM_TIME_CHANGE_MASK) || (result & (1 << type))) {
+            armedValid[type] = false;
+        }
+    }
+}
+
 int AlarmImplAlarmDriver::set(int type, struct timespec *ts)
 {
     return ioctl(fds[0], ANDROID_ALARM_SET(type), ts);
@@ -277,13 +325,88 @@ static void android_server_AlarmManagerService_set(JNIEnv*, jobject, jlong nativ
     ts.tv_sec = seconds;
     ts.tv_nsec = nanoseconds;
 
-    int result = impl->set(type, &ts);
+    int result = impl->arm(type, &ts);
     if (result < 0)
     {
         ALOGE("Unable to set alarm to %lld.%09lld: %s\n", seconds, nanoseconds, strerror(errno));
     }
 }
 
+/*
+ * Programs one deadline per alarm type from a list of delivery windows,
+ * given as parallel arrays of type and window start/end in nanoseconds of
+ * that type's clock. Each type is armed for the earliest window end, the
+ * latest wakeup that still lands inside every one of its windows, so all
+ * alarms whose windows have opened by then are delivered in one batch.
+ * Types with no windows are left as they are. Returns the mask of types
+ * that had to be reprogrammed.
+ */
+static jint android_server_AlarmManagerService_setBatch(JNIEnv* env, jobject, jlong nativeData,
+        jintArray typesArray, jlongArray startsArray, jlongArray endsArray)
+{
+    AlarmImpl *impl = reinterpret_cast<AlarmImpl *>(nativeData);
+    jsize count = env->GetArrayLength(typesArray);
+    if (env->GetArrayLength(startsArray) != count || env->GetArrayLength(endsArray) != count) {
+        jniThrowException(env, "java/lang/IllegalArgumentException",
+                "window arrays differ in length");
+        return 0;
+    }
+
+    jlong deadlines[ANDROID_ALARM_TYPE_COUNT];
+    bool present[ANDROID_ALARM_TYPE_COUNT];
+    memset(present, 0, sizeof(present));
+
+    /* on failure an OutOfMemoryError is pending */
+    jint *types = env->GetIntArrayElements(typesArray, NULL);
+    if (types == NULL) {
+        return 0;
+    }
+    jlong *starts = env->GetLongArrayElements(startsArray, NULL);
+    if (starts == NULL) {
+        env->ReleaseIntArrayElements(typesArray, types, JNI_ABORT);
+        return 0;
+    }
+    jlong *ends = env->GetLongArrayElements(endsArray, NULL);
+    if (ends == NULL) {
+        env->ReleaseLongArrayElements(startsArray, starts, JNI_ABORT);
+        env->ReleaseIntArrayElements(typesArray, types, JNI_ABORT);
+        return 0;
+    }
+    for (jsize i = 0; i < count; i++) {
+        jint type = types[i];
+        if (type < 0 || type >= ANDROID_ALARM_TYPE_COUNT) {
+            continue;
+        }
+        jlong end = ends[i] > starts[i] ? ends[i] : starts[i];
+        if (!present[type] || end < deadlines[type]) {
+            deadlines[type] = end;
+            present[type] = true;
+        }
+    }
+    env->ReleaseLongArrayElements(endsArray, ends, JNI_ABORT);
+    env->ReleaseLongArrayElements(startsArray, starts, JNI_ABORT);
+    env->ReleaseIntArrayElements(typesArray, types, JNI_ABORT);
+
+    jint reprogrammed = 0;
+    for (int type = 0; type < ANDROID_ALARM_TYPE_COUNT; type++) {
+        if (!present[type]) {
+            continue;
+        }
+        struct timespec ts;
+        ts.tv_sec = deadlines[type] / 1000000000LL;
+        ts.tv_nsec = deadlines[type] % 1000000000LL;
+        bool changed;
+        int result = impl->arm(type, &ts, &changed);
+        if (result < 0) {
+            ALOGE("Unable to set alarm %d to %lld.%09ld: %s\n", type,
+                    (long long) ts.tv_sec, ts.tv_nsec, strerror(errno));
+        } else if (changed) {
+            reprogrammed |= 1 << type;
+        }
+    }
+    return reprogrammed;
+}
+
 static jint android_server_AlarmManagerService_waitForAlarm(JNIEnv*, jobject, jlong nativeData)
 {
     AlarmImpl *impl = reinterpret_cast<AlarmImpl *>(nativeData);
@@ -300,6 +423,7 @@ static jint android_server_AlarmManagerService_waitForAlarm(JNIEnv*, jobject, jl
         return 0;
     }
 
+    impl->expired(result);
     return result;
 }
 
@@ -308,6 +432,7 @@ static JNINativeMethod sMethods[] = {
     {"init", "()J", (void*)android_server_AlarmManagerService_init},
     {"close", "(J)V", (void*)android_server_AlarmManagerService_close},
     {"set", "(JIJJ)V", (void*)android_server_AlarmManagerService_set},
+    {"setBatch", "(J[I[J[J)I", (void*)android_server_AlarmManagerService_setBatch},
     {"waitForAlarm", "(J)I", (void*)android_server_AlarmManagerService_waitForAlarm},
     {"setKernelTimezone", "(JI)I", (void*)android_server_AlarmManagerService_setKernelTimezone},
 };
@@ -31,12 +31,14 @@
 #include <android_runtime/AndroidRuntime.h>
 #include <android_runtime/Log.h>
 
+#include <cutils/properties.h>
 #include <utils/Log.h>
 #include <utils/Looper.h>
 #include <utils/threads.h>
 
 #include <input/InputManager.h>
 #include <input/PointerController.h>
+#include <input/ReplayEventHub.h>
 #include <input/SpriteController.h>
 
 #include <android_os_MessageQueue.h>
@@ -278,7 +280,22 @@ NativeInputManager::NativeInputManager(jobject contextObj,
         mLocked.showTouches = false;
     }
 
-    sp<EventHub> eventHub = new EventHub();
+    // Replays an event log, recorded with debug.input.capture, in real time instead of
+    // reading the input devices, to reproduce the input load of another device.
+    sp<EventHubInterface> eventHub;
+    char replayPath[PROPERTY_VALUE_MAX];
+    if (property_get("debug.input.replay", replayPath, NULL) > 0) {
+        sp<ReplayEventHub> replayEventHub = new ReplayEventHub(true /*realTime*/);
+        if (!replayEventHub->load(replayPath)) {
+            ALOGI("Replaying the input events of %s.", replayPath);
+            eventHub = replayEventHub;
+        } else {
+            ALOGE("Could not load the input event log %s.", replayPath);
+        }
+    }
+    if (eventHub == NULL) {
+        eventHub = new EventHub();
+    }
     mInputManager = new InputManager(eventHub, this, this);
 }
 
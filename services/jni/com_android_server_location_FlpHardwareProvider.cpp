@@ -32,6 +32,7 @@ static JNIEnv *sCallbackEnv = NULL;
 static hw_device_t* sHardwareDevice = NULL;
 
 static jmethodID sOnLocationReport = NULL;
+static jmethodID sOnLocationReportPacked = NULL;
 static jmethodID sOnDataReport = NULL;
 static jmethodID sOnGeofenceTransition = NULL;
 static jmethodID sOnGeofenceMonitorStatus = NULL;
@@ -40,6 +41,33 @@ static jmethodID sOnGeofenceRemove = NULL;
 static jmethodID sOnGeofencePause = NULL;
 static jmethodID sOnGeofenceResume = NULL;
 
+// android.location.Location and the setters used to fill it in
+static jclass sLocationClass = NULL;
+static jmethodID sLocationCtor = NULL;
+static jmethodID sSetLatitude = NULL;
+static jmethodID sSetLongitude = NULL;
+static jmethodID sSetTime = NULL;
+static jmethodID sSetAltitude = NULL;
+static jmethodID sSetSpeed = NULL;
+static jmethodID sSetBearing = NULL;
+static jmethodID sSetAccuracy = NULL;
+
+// Layout of one location in the packed array handed to
+// onLocationReportPacked. The timestamp is in milliseconds, which a double
+// holds exactly.
+enum {
+  PACKED_FLAGS,
+  PACKED_LATITUDE,
+  PACKED_LONGITUDE,
+  PACKED_ALTITUDE,
+  PACKED_SPEED,
+  PACKED_BEARING,
+  PACKED_ACCURACY,
+  PACKED_TIMESTAMP,
+  PACKED_SOURCES_USED,
+  PACKED_STRIDE
+};
+
 static const FlpLocationInterface* sFlpInterface = NULL;
 static const FlpDiagnosticInterface* sFlpDiagnosticInterface = NULL;
 static const FlpGeofencingInterface* sFlpGeofencingInterface = NULL;
@@ -163,6 +191,24 @@ static void ClassInit(JNIEnv* env, jclass clazz) {
   sOnGeofenceRemove = env->GetMethodID(clazz, "onGeofenceRemove", "(II)V");
   sOnGeofencePause = env->GetMethodID(clazz, "onGeofencePause", "(II)V");
   sOnGeofenceResume = env->GetMethodID(clazz, "onGeofenceResume", "(II)V");
+
+  // optional; when present, batches skip building Location objects here
+  sOnLocationReportPacked = env->GetMethodID(clazz, "onLocationReportPacked", "(I[D)V");
+  if (sOnLocationReportPacked == NULL) {
+    env->ExceptionClear();
+  }
+
+  jclass locationClass = env->FindClass(LOCATION_CLASS_NAME);
+  sLocationClass = reinterpret_cast<jclass>(env->NewGlobalRef(locationClass));
+  env->DeleteLocalRef(locationClass);
+  sLocationCtor = env->GetMethodID(sLocationClass, "<init>", "(Ljava/lang/String;)V");
+  sSetLatitude = env->GetMethodID(sLocationClass, "setLatitude", "(D)V");
+  sSetLongitude = env->GetMethodID(sLocationClass, "setLongitude", "(D)V");
+  sSetTime = env->GetMethodID(sLocationClass, "setTime", "(J)V");
+  sSetAltitude = env->GetMethodID(sLocationClass, "setAltitude", "(D)V");
+  sSetSpeed = env->GetMethodID(sLocationClass, "setSpeed", "(F)V");
+  sSetBearing = env->GetMethodID(sLocationClass, "setBearing", "(F)V");
+  sSetAccuracy = env->GetMethodID(sLocationClass, "setAccuracy", "(F)V");
 }
 
 /*
@@ -339,84 +385,66 @@ static void TranslateGeofenceFromGeofenceHardwareRequestParcelable(
  * Helper function to transform FlpLocation into a java object.
  */
 static void TranslateToObject(const FlpLocation* location, jobject& locationObject) {
-  jclass locationClass = sCallbackEnv->FindClass(LOCATION_CLASS_NAME);
-  jmethodID locationCtor = sCallbackEnv->GetMethodID(
-      locationClass,
-      "<init>",
-      "(Ljava/lang/String;)V"
-      );
-
   // the provider is set in the upper JVM layer
-  locationObject = sCallbackEnv->NewObject(locationClass, locationCtor, NULL);
+  locationObject = sCallbackEnv->NewObject(sLocationClass, sLocationCtor, NULL);
   jint flags = location->flags;
 
   // set the valid information in the object
   if (flags & FLP_LOCATION_HAS_LAT_LONG) {
-    jmethodID setLatitude = sCallbackEnv->GetMethodID(
-        locationClass,
-        "setLatitude",
-        "(D)V"
-        );
-    sCallbackEnv->CallVoidMethod(locationObject, setLatitude, location->latitude);
-
-    jmethodID setLongitude = sCallbackEnv->GetMethodID(
-        locationClass,
-        "setLongitude",
-        "(D)V"
-        );
-    sCallbackEnv->CallVoidMethod(
-        locationObject,
-        setLongitude,
-        location->longitude
-        );
-
-    jmethodID setTime = sCallbackEnv->GetMethodID(
-        locationClass,
-        "setTime",
-        "(J)V"
-        );
-    sCallbackEnv->CallVoidMethod(locationObject, setTime, location->timestamp);
+    sCallbackEnv->CallVoidMethod(locationObject, sSetLatitude, location->latitude);
+    sCallbackEnv->CallVoidMethod(locationObject, sSetLongitude, location->longitude);
+    sCallbackEnv->CallVoidMethod(locationObject, sSetTime, location->timestamp);
   }
 
   if (flags & FLP_LOCATION_HAS_ALTITUDE) {
-    jmethodID setAltitude = sCallbackEnv->GetMethodID(
-        locationClass,
-        "setAltitude",
-        "(D)V"
-        );
-    sCallbackEnv->CallVoidMethod(locationObject, setAltitude, location->altitude);
+    sCallbackEnv->CallVoidMethod(locationObject, sSetAltitude, location->altitude);
   }
 
   if (flags & FLP_LOCATION_HAS_SPEED) {
-    jmethodID setSpeed = sCallbackEnv->GetMethodID(
-        locationClass,
-        "setSpeed",
-        "(F)V"
-        );
-    sCallbackEnv->CallVoidMethod(locationObject, setSpeed, location->speed);
+    sCallbackEnv->CallVoidMethod(locationObject, sSetSpeed, location->speed);
   }
 
   if (flags & FLP_LOCATION_HAS_BEARING) {
-    jmethodID setBearing = sCallbackEnv->GetMethodID(
-        locationClass,
-        "setBearing",
-        "(F)V"
-        );
-    sCallbackEnv->CallVoidMethod(locationObject, setBearing, location->bearing);
+    sCallbackEnv->CallVoidMethod(locationObject, sSetBearing, location->bearing);
   }
 
   if (flags & FLP_LOCATION_HAS_ACCURACY) {
-    jmethodID setAccuracy = sCallbackEnv->GetMethodID(
-        locationClass,
-        "setAccuracy",
-        "(F)V"
-        );
-    sCallbackEnv->CallVoidMethod(locationObject, setAccuracy, location->accuracy);
+    sCallbackEnv->CallVoidMethod(locationObject, sSetAccuracy, location->accuracy);
   }
 
   // TODO: wire FlpLocation::sources_used when needed
+}
 
-  sCallbackEnv->DeleteLocalRef(locationClass);
+/*
+ * Helper function to pack FlpLocation structures into a single array of
+ * PACKED_STRIDE doubles each.
+ */
+static jdoubleArray TranslateToPackedArray(int32_t locationsCount, FlpLocation** locations) {
+  jdoubleArray packedArray = sCallbackEnv->NewDoubleArray(locationsCount * PACKED_STRIDE);
+  if (packedArray == NULL) {
+    return NULL;
+  }
+
+  jdouble* packed = sCallbackEnv->GetDoubleArrayElements(packedArray, NULL);
+  if (packed == NULL) {
+    sCallbackEnv->DeleteLocalRef(packedArray);
+    return NULL;
+  }
+  for (int i = 0; i < locationsCount; ++i) {
+    const FlpLocation* location = locations[i];
+    jdouble* out = packed + i * PACKED_STRIDE;
+    out[PACKED_FLAGS] = location->flags;
+    out[PACKED_LATITUDE] = location->latitude;
+    out[PACKED_LONGITUDE] = location->longitude;
+    out[PACKED_ALTITUDE] = location->altitude;
+    out[PACKED_SPEED] = location->speed;
+    out[PACKED_BEARING] = location->bearing;
+    out[PACKED_ACCURACY] = location->accuracy;
+    out[PACKED_TIMESTAMP] = location->timestamp;
+    out[PACKED_SOURCES_USED] = location->sources_used;
+  }
+  sCallbackEnv->ReleaseDoubleArrayElements(packedArray, packed, 0);
+  return packedArray;
 }
 
 /*
@@ -426,10 +454,9 @@ static void TranslateToObjectArray(
     int32_t locationsCount,
     FlpLocation** locations,
     jobjectArray& locationsArray) {
-  jclass locationClass = sCallbackEnv->FindClass(LOCATION_CLASS_NAME);
   locationsArray = sCallbackEnv->NewObjectArray(
       locationsCount,
-      locationClass,
+      sLocationClass,
       /* initialElement */ NULL
       );
 
@@ -439,8 +466,6 @@ static void TranslateToObjectArray(
     sCallbackEnv->SetObjectArrayElement(locationsArray, i, locationObject);
     sCallbackEnv->DeleteLocalRef(locationObject);
   }
-
-  sCallbackEnv->DeleteLocalRef(locationClass);
 }
 
 static void LocationCallback(int32_t locationsCount, FlpLocation** locations) {
@@ -457,6 +482,22 @@ static void LocationCallback(int32_t locationsCount, FlpLocation** locations) {
     return;
   }
 
+  if (sOnLocationReportPacked != NULL) {
+    jdoubleArray packedArray = TranslateToPackedArray(locationsCount, locations);
+    if (packedArray != NULL) {
+      sCallbackEnv->CallVoidMethod(
+          sCallbacksObj,
+          sOnLocationReportPacked,
+          locationsCount,
+          packedArray
+          );
+      CheckExceptions(sCallbackEnv, __FUNCTION__);
+      sCallbackEnv->DeleteLocalRef(packedArray);
+      return;
+    }
+    CheckExceptions(sCallbackEnv, __FUNCTION__);
+  }
+
   jobjectArray locationsArray = NULL;
   TranslateToObjectArray(locationsCount, locations, locationsArray);
 
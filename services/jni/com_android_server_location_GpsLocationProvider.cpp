@@ -36,6 +36,7 @@ static jobject mCallbacksObj = NULL;
 static jmethodID method_reportLocation;
 static jmethodID method_reportStatus;
 static jmethodID method_reportSvStatus;
+static jmethodID method_reportSvStatusPacked;
 static jmethodID method_reportAGpsStatus;
 static jmethodID method_reportNmea;
 static jmethodID method_setEngineCapabilities;
@@ -61,6 +62,13 @@ static const GpsGeofencingInterface* sGpsGeofencingInterface = NULL;
 
 // temporary storage for GPS callbacks
 static GpsSvStatus  sGpsSvStatus;
+// Reused for every packed SV report; Java copies out before returning.
+// Ints are the prns followed by the ephemeris, almanac and used-in-fix
+// masks; floats are snr, elevation and azimuth for each SV in turn.
+static jintArray sSvInts = NULL;
+static jfloatArray sSvFloats = NULL;
+static const int SV_INTS_LENGTH = GPS_MAX_SVS + 3;
+static const int SV_FLOATS_LENGTH = GPS_MAX_SVS * 3;
 static const char* sNmeaString;
 static int sNmeaStringLength;
 
@@ -94,11 +102,56 @@ static void status_callback(GpsStatus* status)
     checkAndClearExceptionFromCallback(env, __FUNCTION__);
 }
 
+static bool report_sv_status_packed(JNIEnv* env, const GpsSvStatus* sv_status)
+{
+    if (method_reportSvStatusPacked == NULL) {
+        return false;
+    }
+    if (sSvInts == NULL) {
+        jintArray ints = env->NewIntArray(SV_INTS_LENGTH);
+        jfloatArray floats = env->NewFloatArray(SV_FLOATS_LENGTH);
+        if (ints == NULL || floats == NULL) {
+            env->ExceptionClear();
+            return false;
+        }
+        sSvInts = (jintArray)env->NewGlobalRef(ints);
+        sSvFloats = (jfloatArray)env->NewGlobalRef(floats);
+        env->DeleteLocalRef(ints);
+        env->DeleteLocalRef(floats);
+    }
+
+    int num_svs = sv_status->num_svs;
+    if (num_svs < 0 || num_svs > GPS_MAX_SVS) {
+        num_svs = 0;
+    }
+    jint ints[SV_INTS_LENGTH];
+    jfloat floats[SV_FLOATS_LENGTH];
+    for (int i = 0; i < num_svs; i++) {
+        const GpsSvInfo& sv = sv_status->sv_list[i];
+        ints[i] = sv.prn;
+        floats[i * 3] = sv.snr;
+        floats[i * 3 + 1] = sv.elevation;
+        floats[i * 3 + 2] = sv.azimuth;
+    }
+    ints[num_svs] = sv_status->ephemeris_mask;
+    ints[num_svs + 1] = sv_status->almanac_mask;
+    ints[num_svs + 2] = sv_status->used_in_fix_mask;
+
+    env->SetIntArrayRegion(sSvInts, 0, num_svs + 3, ints);
+    env->SetFloatArrayRegion(sSvFloats, 0, num_svs * 3, floats);
+    env->CallVoidMethod(mCallbacksObj, method_reportSvStatusPacked, num_svs, sSvInts, sSvFloats);
+    return true;
+}
+
 static void sv_status_callback(GpsSvStatus* sv_status)
 {
     JNIEnv* env = AndroidRuntime::getJNIEnv();
     memcpy(&sGpsSvStatus, sv_status, sizeof(sGpsSvStatus));
-    env->CallVoidMethod(mCallbacksObj, method_reportSvStatus);
+    // One upcall with the whole report instead of a second trip through
+    // native_read_sv_status and five pinned arrays
+    if (!report_sv_status_packed(env, &sGpsSvStatus)) {
+        env->CallVoidMethod(mCallbacksObj, method_reportSvStatus);
+    }
     checkAndClearExceptionFromCallback(env, __FUNCTION__);
 }
 
@@ -339,6 +392,11 @@ static void android_location_GpsLocationProvider_class_init_native(JNIEnv* env,
     method_reportLocation = env->GetMethodID(clazz, "reportLocation", "(IDDDFFFJ)V");
     method_reportStatus = env->GetMethodID(clazz, "reportStatus", "(I)V");
     method_reportSvStatus = env->GetMethodID(clazz, "reportSvStatus", "()V");
+    method_reportSvStatusPacked = env->GetMethodID(clazz, "reportSvStatusPacked", "(I[I[F)V");
+    if (method_reportSvStatusPacked == NULL) {
+        // optional; older providers read the status back through native_read_sv_status
+        env->ExceptionClear();
+    }
     method_reportAGpsStatus = env->GetMethodID(clazz, "reportAGpsStatus", "(III)V");
     method_reportNmea = env->GetMethodID(clazz, "reportNmea", "(J)V");
     method_setEngineCapabilities = env->GetMethodID(clazz, "setEngineCapabilities", "(I)V");
@@ -479,11 +537,11 @@ static jint android_location_GpsLocationProvider_read_sv_status(JNIEnv* env, job
 {
     // this should only be called from within a call to reportSvStatus
 
-    jint* prns = env->GetIntArrayElements(prnArray, 0);
-    jfloat* snrs = env->GetFloatArrayElements(snrArray, 0);
-    jfloat* elev = env->GetFloatArrayElements(elevArray, 0);
-    jfloat* azim = env->GetFloatArrayElements(azumArray, 0);
-    jint* mask = env->GetIntArrayElements(maskArray, 0);
+    jint prns[GPS_MAX_SVS];
+    jfloat snrs[GPS_MAX_SVS];
+    jfloat elev[GPS_MAX_SVS];
+    jfloat azim[GPS_MAX_SVS];
+    jint mask[3];
 
     int num_svs = sGpsSvStatus.num_svs;
     for (int i = 0; i < num_svs; i++) {
@@ -496,11 +554,12 @@ static jint android_location_GpsLocationProvider_read_sv_status(JNIEnv* env, job
     mask[1] = sGpsSvStatus.almanac_mask;
     mask[2] = sGpsSvStatus.used_in_fix_mask;
 
-    env->ReleaseIntArrayElements(prnArray, prns, 0);
-    env->ReleaseFloatArrayElements(snrArray, snrs, 0);
-    env->ReleaseFloatArrayElements(elevArray, elev, 0);
-    env->ReleaseFloatArrayElements(azumArray, azim, 0);
-    env->ReleaseIntArrayElements(maskArray, mask, 0);
+    // Region copies only touch the used prefix of each array
+    env->SetIntArrayRegion(prnArray, 0, num_svs, prns);
+    env->SetFloatArrayRegion(snrArray, 0, num_svs, snrs);
+    env->SetFloatArrayRegion(elevArray, 0, num_svs, elev);
+    env->SetFloatArrayRegion(azumArray, 0, num_svs, azim);
+    env->SetIntArrayRegion(maskArray, 0, 3, mask);
     return (jint) num_svs;
 }
 
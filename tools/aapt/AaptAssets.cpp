@@ -5,6 +5,7 @@
 #include "AaptAssets.h"
 #include "ResourceFilter.h"
 #include "Main.h"
+#include "DirectoryListing.h"
 
 #include <utils/misc.h>
 #include <utils/SortedVector.h>
@@ -62,7 +63,7 @@ const char * const gDefaultIgnoreAssets =
 // The ignore pattern that can be passed via --ignore-assets in Main.cpp
 const char * gUserIgnoreAssets = NULL;
 
-static bool isHidden(const char *root, const char *path)
+static bool isHidden(const char *path, FileType type)
 {
     // Patterns syntax:
     // - Delimiter is :
@@ -95,10 +96,6 @@ static bool isHidden(const char *root, const char *path)
     bool chatty = true;
     char *matchedPattern = NULL;
 
-    String8 fullPath(root);
-    fullPath.appendPath(path);
-    FileType type = getFileType(fullPath);
-
     int plen = strlen(path);
 
     // Note: we don't have strtok_r under mingw.
@@ -1756,38 +1753,19 @@ ssize_t AaptDir::slurpFullTree(Bundle* bundle, const String8& srcDir,
                             const AaptGroupEntry& kind, const String8& resType,
                             sp<FilePathStore>& fullResPaths)
 {
-    Vector<String8> fileNames;
-    {
-        DIR* dir = NULL;
-
-        dir = opendir(srcDir.string());
-        if (dir == NULL) {
-            fprintf(stderr, "ERROR: opendir(%s): %s\n", srcDir.string(), strerror(errno));
-            return UNKNOWN_ERROR;
-        }
-
-        /*
-         * Slurp the filenames out of the directory.
-         */
-        while (1) {
-            struct dirent* entry;
-
-            entry = readdir(dir);
-            if (entry == NULL)
-                break;
-
-            if (isHidden(srcDir.string(), entry->d_name))
-                continue;
+    sp<DirectoryListing> listing = DirectoryListing::scan(srcDir, bundle->getScanThreads());
+    return slurpListing(bundle, srcDir, listing, kind, resType, fullResPaths);
+}
 
-            String8 name(entry->d_name);
-            fileNames.add(name);
-            // Add fully qualified path for dependency purposes
-            // if we're collecting them
-            if (fullResPaths != NULL) {
-                fullResPaths->add(srcDir.appendPathCopy(name));
-            }
-        }
-        closedir(dir);
+ssize_t AaptDir::slurpListing(Bundle* bundle, const String8& srcDir,
+                            const sp<DirectoryListing>& listing,
+                            const AaptGroupEntry& kind, const String8& resType,
+                            sp<FilePathStore>& fullResPaths)
+{
+    if (listing->getError() != NO_ERROR) {
+        fprintf(stderr, "ERROR: opendir(%s): %s\n", srcDir.string(),
+                strerror(-listing->getError()));
+        return UNKNOWN_ERROR;
     }
 
     ssize_t count = 0;
@@ -1795,35 +1773,48 @@ ssize_t AaptDir::slurpFullTree(Bundle* bundle, const String8& srcDir,
     /*
      * Stash away the files and recursively descend into subdirectories.
      */
-    const size_t N = fileNames.size();
+    const Vector<DirectoryListing::Entry>& entries = listing->getEntries();
+    Vector<size_t> visible;
+    for (size_t ei = 0; ei < entries.size(); ei++) {
+        const DirectoryListing::Entry& entry = entries[ei];
+        if (isHidden(entry.name.string(), entry.type))
+            continue;
+
+        visible.add(ei);
+        // Add fully qualified path for dependency purposes
+        // if we're collecting them
+        if (fullResPaths != NULL) {
+            fullResPaths->add(srcDir.appendPathCopy(entry.name));
+        }
+    }
+
+    const size_t N = visible.size();
     size_t i;
     for (i = 0; i < N; i++) {
+        const DirectoryListing::Entry& entry = entries[visible[i]];
         String8 pathName(srcDir);
-        FileType type;
-
-        pathName.appendPath(fileNames[i].string());
-        type = getFileType(pathName.string());
-        if (type == kFileTypeDirectory) {
+        pathName.appendPath(entry.name.string());
+        if (entry.type == kFileTypeDirectory) {
             sp<AaptDir> subdir;
             bool notAdded = false;
-            if (mDirs.indexOfKey(fileNames[i]) >= 0) {
-                subdir = mDirs.valueFor(fileNames[i]);
+            if (mDirs.indexOfKey(entry.name) >= 0) {
+                subdir = mDirs.valueFor(entry.name);
             } else {
-                subdir = new AaptDir(fileNames[i], mPath.appendPathCopy(fileNames[i]));
+                subdir = new AaptDir(entry.name, mPath.appendPathCopy(entry.name));
                 notAdded = true;
             }
-            ssize_t res = subdir->slurpFullTree(bundle, pathName, kind,
-                                                resType, fullResPaths);
+            ssize_t res = subdir->slurpListing(bundle, pathName, entry.subdir, kind,
+                                               resType, fullResPaths);
             if (res < NO_ERROR) {
                 return res;
             }
             if (res > 0 && notAdded) {
-                mDirs.add(fileNames[i], subdir);
+                mDirs.add(entry.name, subdir);
             }
             count += res;
-        } else if (type == kFileTypeRegular) {
+        } else if (entry.type == kFileTypeRegular) {
             sp<AaptFile> file = new AaptFile(pathName, kind, resType);
-            status_t err = addLeafFile(fileNames[i], file);
+            status_t err = addLeafFile(entry.name, file);
             if (err != NO_ERROR) {
                 return err;
             }
@@ -2226,9 +2217,11 @@ ssize_t AaptAssets::slurpResourceTree(Bundle* bundle, const String8& srcDir)
 {
     ssize_t err = 0;
 
-    DIR* dir = opendir(srcDir.string());
-    if (dir == NULL) {
-        fprintf(stderr, "ERROR: opendir(%s): %s\n", srcDir.string(), strerror(errno));
+    // The whole resource tree is listed at once, on several threads.
+    sp<DirectoryListing> listing = DirectoryListing::scan(srcDir, bundle->getScanThreads());
+    if (listing->getError() != NO_ERROR) {
+        fprintf(stderr, "ERROR: opendir(%s): %s\n", srcDir.string(),
+                strerror(-listing->getError()));
         return UNKNOWN_ERROR;
     }
 
@@ -2238,25 +2231,22 @@ ssize_t AaptAssets::slurpResourceTree(Bundle* bundle, const String8& srcDir)
      * Run through the directory, looking for dirs that match the
      * expected pattern.
      */
-    while (1) {
-        struct dirent* entry = readdir(dir);
-        if (entry == NULL) {
-            break;
-        }
-
-        if (isHidden(srcDir.string(), entry->d_name)) {
+    const Vector<DirectoryListing::Entry>& entries = listing->getEntries();
+    for (size_t i = 0; i < entries.size(); i++) {
+        const DirectoryListing::Entry& entry = entries[i];
+        if (isHidden(entry.name.string(), entry.type)) {
             continue;
         }
 
         String8 subdirName(srcDir);
-        subdirName.appendPath(entry->d_name);
+        subdirName.appendPath(entry.name);
 
         AaptGroupEntry group;
         String8 resType;
-        bool b = group.initFromDirName(entry->d_name, &resType);
+        bool b = group.initFromDirName(entry.name.string(), &resType);
         if (!b) {
             fprintf(stderr, "invalid resource directory name: %s/%s\n", srcDir.string(),
-                    entry->d_name);
+                    entry.name.string());
             err = -1;
             continue;
         }
@@ -2266,20 +2256,18 @@ ssize_t AaptAssets::slurpResourceTree(Bundle* bundle, const String8& srcDir)
             const char *verString = group.getVersionString().string();
             int dirVersionInt = atoi(verString + 1); // skip 'v' in version name
             if (dirVersionInt > maxResInt) {
-              fprintf(stderr, "max res %d, skipping %s\n", maxResInt, entry->d_name);
+              fprintf(stderr, "max res %d, skipping %s\n", maxResInt, entry.name.string());
               continue;
             }
         }
 
-        FileType type = getFileType(subdirName.string());
-
-        if (type == kFileTypeDirectory) {
+        if (entry.type == kFileTypeDirectory) {
             sp<AaptDir> dir = makeDir(resType);
-            ssize_t res = dir->slurpFullTree(bundle, subdirName, group,
-                                                resType, mFullResPaths);
+            ssize_t res = dir->slurpListing(bundle, subdirName, entry.subdir, group,
+                                            resType, mFullResPaths);
             if (res < 0) {
                 count = res;
-                goto bail;
+                break;
             }
             if (res > 0) {
                 mGroupEntries.add(group);
@@ -2300,10 +2288,6 @@ ssize_t AaptAssets::slurpResourceTree(Bundle* bundle, const String8& srcDir)
         }
     }
 
-bail:
-    closedir(dir);
-    dir = NULL;
-
     if (err != 0) {
         return err;
     }
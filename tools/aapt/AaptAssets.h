@@ -29,6 +29,7 @@ extern const char * gUserIgnoreAssets;
 bool valid_symbol_name(const String8& str);
 
 class AaptAssets;
+class DirectoryListing;
 
 enum {
     AXIS_NONE = 0,
@@ -307,6 +308,12 @@ private:
                                   const AaptGroupEntry& kind,
                                   const String8& resType,
                                   sp<FilePathStore>& fullResPaths);
+    ssize_t slurpListing(Bundle* bundle,
+                         const String8& srcDir,
+                         const sp<DirectoryListing>& listing,
+                         const AaptGroupEntry& kind,
+                         const String8& resType,
+                         sp<FilePathStore>& fullResPaths);
 
     String8 mLeaf;
     String8 mPath;
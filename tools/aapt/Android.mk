@@ -10,8 +10,12 @@ ifeq ($(TARGET_BUILD_APPS),)
 
 aapt_src_files := \
 	AaptAssets.cpp \
+	BuildProfile.cpp \
 	Command.cpp \
 	CrunchCache.cpp \
+	CrunchContentCache.cpp \
+	Daemon.cpp \
+	DirectoryListing.cpp \
 	FileFinder.cpp \
 	Main.cpp \
 	Package.cpp \
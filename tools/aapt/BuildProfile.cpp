@@ -0,0 +1,207 @@
+//
+// Copyright 2013 The Android Open Source Project
+//
+// Implementation file for BuildProfile
+// This file defines functions laid out and documented in
+// BuildProfile.h
+
+#include "BuildProfile.h"
+
+#include <utils/KeyedVector.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+#include <errno.h>
+#include <stdio.h>
+
+#ifndef HAVE_MS_C_RUNTIME
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+struct Event {
+    const char* name;
+    String8 file;
+    int thread;
+    nsecs_t start;
+    nsecs_t end;
+    // Peak memory when a phase ends, 0 for the work on a file.
+    size_t peakMemoryKb;
+};
+
+}
+
+bool BuildProfile::sEnabled = false;
+
+static Mutex gLock;
+static nsecs_t gStartTime;
+static Vector<Event> gEvents;
+// Track of each thread that recorded work, the thread of start() being 0.
+static KeyedVector<android_thread_id_t, int> gThreads;
+
+static void writeJsonString(FILE* fp, const char* str)
+{
+    fputc('"', fp);
+    for (const unsigned char* p = (const unsigned char*)str; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(fp, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(fp, "\\u%04x", *p);
+        } else {
+            fputc(*p, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+// Trace timestamps are in microseconds since start().
+static double toTraceTime(nsecs_t time)
+{
+    return (time - gStartTime) / 1000.0;
+}
+
+BuildProfile::Scope::Scope(const char* name)
+    : mName(name), mStart(0)
+{
+    if (sEnabled) {
+        mStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+}
+
+BuildProfile::Scope::Scope(const char* name, const String8& file)
+    : mName(name), mStart(0)
+{
+    if (sEnabled) {
+        mFile = file;
+        mStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+}
+
+BuildProfile::Scope::~Scope()
+{
+    end();
+}
+
+void BuildProfile::Scope::next(const char* name)
+{
+    end();
+    mName = name;
+    if (sEnabled) {
+        mStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+}
+
+void BuildProfile::Scope::end()
+{
+    if (sEnabled && mStart != 0) {
+        record(mName, mFile, mStart, systemTime(SYSTEM_TIME_MONOTONIC));
+    }
+    mStart = 0;
+}
+
+void BuildProfile::start()
+{
+    AutoMutex _l(gLock);
+    gEvents.clear();
+    gThreads.clear();
+    gThreads.add(androidGetThreadId(), 0);
+    gStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    sEnabled = true;
+}
+
+void BuildProfile::record(const char* name, const String8& file,
+        nsecs_t start, nsecs_t end)
+{
+    // Sampling the memory is a system call, only phases pay for it.
+    size_t peakMemoryKb = file.length() == 0 ? getPeakMemoryKb() : 0;
+
+    AutoMutex _l(gLock);
+    android_thread_id_t id = androidGetThreadId();
+    ssize_t index = gThreads.indexOfKey(id);
+    if (index < 0) {
+        index = gThreads.add(id, gThreads.size());
+    }
+
+    Event event;
+    event.name = name;
+    event.file = file;
+    event.thread = gThreads.valueAt(index);
+    event.start = start;
+    event.end = end;
+    event.peakMemoryKb = peakMemoryKb;
+    gEvents.add(event);
+}
+
+size_t BuildProfile::getPeakMemoryKb()
+{
+#ifndef HAVE_MS_C_RUNTIME
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        // Darwin reports bytes.
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+#endif
+    return 0;
+}
+
+status_t BuildProfile::write(const char* path)
+{
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    size_t peakMemoryKb = getPeakMemoryKb();
+
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) {
+        return -errno;
+    }
+
+    AutoMutex _l(gLock);
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for (size_t i = 0; i < gThreads.size(); i++) {
+        int thread = gThreads.valueAt(i);
+        fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                "\"args\":{\"name\":", thread);
+        if (thread == 0) {
+            fprintf(fp, "\"aapt\"");
+        } else {
+            fprintf(fp, "\"worker %d\"", thread);
+        }
+        fprintf(fp, "}},\n");
+    }
+    for (size_t i = 0; i < gEvents.size(); i++) {
+        const Event& event = gEvents[i];
+        fprintf(fp, "{\"name\":");
+        writeJsonString(fp, event.name);
+        fprintf(fp, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                "\"ts\":%.3f,\"dur\":%.3f",
+                event.file.length() > 0 ? "file" : "phase", event.thread,
+                toTraceTime(event.start), (event.end - event.start) / 1000.0);
+        if (event.file.length() > 0) {
+            fprintf(fp, ",\"args\":{\"file\":");
+            writeJsonString(fp, event.file.string());
+            fprintf(fp, "}");
+        }
+        fprintf(fp, "},\n");
+        if (event.peakMemoryKb > 0) {
+            fprintf(fp, "{\"name\":\"peak memory\",\"ph\":\"C\",\"pid\":1,\"tid\":0,"
+                    "\"ts\":%.3f,\"args\":{\"KB\":%lu}},\n",
+                    toTraceTime(event.end), (unsigned long)event.peakMemoryKb);
+        }
+    }
+    // The whole command, which also closes the list without a trailing comma.
+    fprintf(fp, "{\"name\":\"aapt\",\"cat\":\"phase\",\"ph\":\"X\",\"pid\":1,\"tid\":0,"
+            "\"ts\":0,\"dur\":%.3f}\n],\n", toTraceTime(now));
+    fprintf(fp, "\"displayTimeUnit\":\"ms\",\n");
+    fprintf(fp, "\"otherData\":{\"peakMemoryKb\":\"%lu\"}}\n",
+            (unsigned long)peakMemoryKb);
+
+    bool failed = ferror(fp);
+    if (fclose(fp) != 0) {
+        failed = true;
+    }
+    return failed ? UNKNOWN_ERROR : NO_ERROR;
+}
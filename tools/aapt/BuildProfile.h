@@ -0,0 +1,75 @@
+//
+// Copyright 2013 The Android Open Source Project
+//
+// Timing trace of the phases of a command, written by --profile.
+//
+
+#ifndef BUILD_PROFILE_H
+#define BUILD_PROFILE_H
+
+#include <utils/Errors.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+/** BuildProfile
+ *  Records how long the phases of a command and the work on each file take,
+ *  and writes them in the Chrome trace event format, so that the trace can
+ *  be loaded in chrome://tracing.  Each thread that records work gets its own
+ *  track, and the peak memory of the process is sampled as each phase ends.
+ *
+ *  Nothing is recorded until start() is called; until then a Scope only
+ *  tests a flag.
+ *
+ *  Usage:
+ *      BuildProfile::Scope phase("parse");
+ *      ...
+ *      phase.next("compile");
+ *      ...
+ *      The last phase ends when the scope is destroyed, which also covers
+ *      the early returns.
+ */
+class BuildProfile {
+public:
+    class Scope {
+    public:
+        /** Times a phase of the command. */
+        explicit Scope(const char* name);
+        /** Times the work done on a file. */
+        Scope(const char* name, const String8& file);
+        ~Scope();
+
+        /** next ends the current phase and starts the named one. */
+        void next(const char* name);
+
+    private:
+        void end();
+
+        const char* mName;
+        String8 mFile;
+        nsecs_t mStart;
+    };
+
+    /** start enables recording, and drops what a previous command of the
+     *  process recorded. */
+    static void start();
+
+    static bool isEnabled() { return sEnabled; }
+
+    /** write saves what was recorded since start() to the file at path, and
+     *  returns NO_ERROR or the -errno value of the failure. */
+    static status_t write(const char* path);
+
+    /** getPeakMemoryKb returns the peak resident memory of the process so
+     *  far, or 0 if the platform doesn't report it. */
+    static size_t getPeakMemoryKb();
+
+private:
+    static void record(const char* name, const String8& file,
+            nsecs_t start, nsecs_t end);
+
+    static bool sEnabled;
+};
+
+#endif // BUILD_PROFILE_H
@@ -39,6 +39,7 @@ typedef enum Command {
     kCommandPackage,
     kCommandCrunch,
     kCommandSingleCrunch,
+    kCommandDaemon,
 } Command;
 
 /*
@@ -64,6 +65,10 @@ public:
           mMaxResVersion(NULL), mDebugMode(false), mNonConstantId(false), mProduct(NULL),
           mUseCrunchCache(false), mErrorOnFailedInsert(false), mOutputTextSymbols(NULL),
           mSingleCrunchInputFile(NULL), mSingleCrunchOutputFile(NULL),
+          mZipThreads(1), mCompressionLevel(-1), mIncremental(false),
+          mCrunchCacheDir(NULL), mCrunchThreads(4), mPngFilterSearch(false),
+          mXmlThreads(4), mResourceIdCacheFile(NULL), mTableProfile(NULL),
+          mDaemonSocket(NULL), mScanThreads(4), mProfileFile(NULL),
           mArgc(0), mArgv(NULL)
         {}
     ~Bundle(void) {}
@@ -101,6 +106,13 @@ public:
     void setValues(bool val) { mValues = val; }
     int getCompressionMethod(void) const { return mCompressionMethod; }
     void setCompressionMethod(int val) { mCompressionMethod = val; }
+    int getZipThreads(void) const { return mZipThreads; }
+    void setZipThreads(int val) { mZipThreads = val; }
+    /* zlib level used for deflated entries; -1 for the ZipFile default */
+    int getCompressionLevel(void) const { return mCompressionLevel; }
+    void setCompressionLevel(int val) { mCompressionLevel = val; }
+    bool getIncremental(void) const { return mIncremental; }
+    void setIncremental(bool val) { mIncremental = val; }
     bool getJunkPath(void) const { return mJunkPath; }
     void setJunkPath(bool val) { mJunkPath = val; }
     const char* getOutputAPKFile() const { return mOutputAPKFile; }
@@ -182,6 +194,24 @@ public:
     void setSingleCrunchInputFile(const char* val) { mSingleCrunchInputFile = val; }
     const char* getSingleCrunchOutputFile() const { return mSingleCrunchOutputFile; }
     void setSingleCrunchOutputFile(const char* val) { mSingleCrunchOutputFile = val; }
+    const char* getCrunchCacheDir() const { return mCrunchCacheDir; }
+    void setCrunchCacheDir(const char* val) { mCrunchCacheDir = val; }
+    int getCrunchThreads() const { return mCrunchThreads; }
+    void setCrunchThreads(int val) { mCrunchThreads = val; }
+    bool getPngFilterSearch() const { return mPngFilterSearch; }
+    void setPngFilterSearch(bool val) { mPngFilterSearch = val; }
+    int getXmlThreads() const { return mXmlThreads; }
+    void setXmlThreads(int val) { mXmlThreads = val; }
+    const char* getResourceIdCacheFile() const { return mResourceIdCacheFile; }
+    void setResourceIdCacheFile(const char* val) { mResourceIdCacheFile = val; }
+    const char* getTableProfile() const { return mTableProfile; }
+    void setTableProfile(const char* val) { mTableProfile = val; }
+    const char* getDaemonSocket() const { return mDaemonSocket; }
+    void setDaemonSocket(const char* val) { mDaemonSocket = val; }
+    int getScanThreads() const { return mScanThreads; }
+    void setScanThreads(int val) { mScanThreads = val; }
+    const char* getProfileFile() const { return mProfileFile; }
+    void setProfileFile(const char* val) { mProfileFile = val; }
 
     /*
      * Set and get the file specification.
@@ -291,6 +321,18 @@ private:
     const char* mOutputTextSymbols;
     const char* mSingleCrunchInputFile;
     const char* mSingleCrunchOutputFile;
+    int         mZipThreads;
+    int         mCompressionLevel;
+    bool        mIncremental;
+    const char* mCrunchCacheDir;
+    int         mCrunchThreads;
+    bool        mPngFilterSearch;
+    int         mXmlThreads;
+    const char* mResourceIdCacheFile;
+    const char* mTableProfile;
+    const char* mDaemonSocket;
+    int         mScanThreads;
+    const char* mProfileFile;
 
     /* file specification */
     int         mArgc;
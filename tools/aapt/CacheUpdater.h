@@ -12,6 +12,7 @@
 #include <sys/stat.h>
 #include <stdio.h>
 #include "Images.h"
+#include "CrunchContentCache.h"
 
 using namespace android;
 
@@ -27,6 +28,8 @@ using namespace android;
  */
 class CacheUpdater {
 public:
+    virtual ~CacheUpdater() { };
+
     // Make sure all the directories along this path exist
     virtual void ensureDirectoriesExist(String8 path) = 0;
 
@@ -47,7 +50,16 @@ class SystemCacheUpdater : public CacheUpdater {
 public:
     // Constructor to set bundle to pass to preProcessImage
     SystemCacheUpdater (Bundle* b)
-        : bundle(b) { };
+        : bundle(b), contentCache(NULL)
+    {
+        if (b->getCrunchCacheDir() != NULL)
+            contentCache = new CrunchContentCache(b, String8(b->getCrunchCacheDir()));
+    };
+
+    ~SystemCacheUpdater()
+    {
+        delete contentCache;
+    };
 
     // Make sure all the directories along this path exist
     virtual void ensureDirectoriesExist(String8 path)
@@ -98,10 +110,14 @@ public:
         // Make sure we're trying to write to a directory that is extant
         ensureDirectoriesExist(dest.getPathDir());
 
-        preProcessImageToCache(bundle, source, dest);
+        if (contentCache != NULL)
+            contentCache->crunch(source, dest);
+        else
+            preProcessImageToCache(bundle, source, dest);
     };
 private:
     Bundle* bundle;
+    CrunchContentCache* contentCache;
 };
 
 #endif // CACHE_UPDATER_H
\ No newline at end of file
@@ -8,7 +8,9 @@
 #include "ResourceFilter.h"
 #include "ResourceTable.h"
 #include "Images.h"
+#include "CrunchContentCache.h"
 #include "XMLNode.h"
+#include "BuildProfile.h"
 
 #include <utils/Log.h>
 #include <utils/threads.h>
@@ -1883,6 +1885,7 @@ int doPackage(Bundle* bundle)
     int N;
     FILE* fp;
     String8 dependencyFile;
+    BuildProfile::Scope phase("parse options");
 
     // -c zz_ZZ means do pseudolocalization
     ResourceFilter filter;
@@ -1929,6 +1932,7 @@ int doPackage(Bundle* bundle)
         assets->setFullAssetPaths(assetPathStore);
     }
 
+    phase.next("slurpFromArgs");
     err = assets->slurpFromArgs(bundle);
     if (err < 0) {
         goto bail;
@@ -1940,6 +1944,7 @@ int doPackage(Bundle* bundle)
 
     // If they asked for any fileAs that need to be compiled, do so.
     if (bundle->getResourceSourceDirs().size() || bundle->getAndroidManifestFile()) {
+        phase.next("buildResources");
         err = buildResources(bundle, assets);
         if (err != 0) {
             goto bail;
@@ -1953,6 +1958,7 @@ int doPackage(Bundle* bundle)
     }
 
     // Update symbols with information about which ones are needed as Java symbols.
+    phase.next("writeResourceSymbols");
     assets->applyJavaSymbols();
     if (SourcePos::hasErrors()) {
         goto bail;
@@ -2020,6 +2026,7 @@ int doPackage(Bundle* bundle)
     }
 
     // Write out the ProGuard file
+    phase.next("writeProguardFile");
     err = writeProguardFile(bundle, assets);
     if (err < 0) {
         goto bail;
@@ -2027,6 +2034,7 @@ int doPackage(Bundle* bundle)
 
     // Write the apk
     if (outputAPKFile) {
+        phase.next("writeAPK");
         err = writeAPK(bundle, assets, String8(outputAPKFile));
         if (err != NO_ERROR) {
             fprintf(stderr, "ERROR: packaging of '%s' failed\n", outputAPKFile);
@@ -2041,6 +2049,7 @@ int doPackage(Bundle* bundle)
     if (bundle->getGenDependencies()) {
         // Now that writeResourceSymbols or writeAPK has taken care of writing
         // the targets to our dependency file, we'll write the prereqs
+        phase.next("writeDependencyPreReqs");
         fp = fopen(dependencyFile, "a+");
         fprintf(fp, " : ");
         bool includeRaw = (outputAPKFile != NULL);
@@ -2094,7 +2103,14 @@ int doSingleCrunch(Bundle* bundle)
     String8 input(bundle->getSingleCrunchInputFile());
     String8 output(bundle->getSingleCrunchOutputFile());
 
-    if (preProcessImageToCache(bundle, input, output) != NO_ERROR) {
+    status_t err;
+    if (bundle->getCrunchCacheDir() != NULL) {
+        CrunchContentCache cache(bundle, String8(bundle->getCrunchCacheDir()));
+        err = cache.crunch(input, output);
+    } else {
+        err = preProcessImageToCache(bundle, input, output);
+    }
+    if (err != NO_ERROR) {
         // we can't return the status_t as it gets truncate to the lower 8 bits.
         return 42;
     }
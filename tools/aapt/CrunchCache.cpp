@@ -12,9 +12,26 @@
 #include "FileFinder.h"
 #include "CacheUpdater.h"
 #include "CrunchCache.h"
+#include "WorkQueue.h"
 
 using namespace android;
 
+class ProcessImageWorkUnit : public WorkQueue::WorkUnit {
+public:
+    ProcessImageWorkUnit(CacheUpdater* cu, const String8& source, const String8& dest)
+        : mCacheUpdater(cu), mSource(source), mDest(dest) { }
+
+    virtual bool run() {
+        mCacheUpdater->processImage(mSource, mDest);
+        return true;
+    }
+
+private:
+    CacheUpdater* mCacheUpdater;
+    String8 mSource;
+    String8 mDest;
+};
+
 CrunchCache::CrunchCache(String8 sourcePath, String8 destPath, FileFinder* ff)
     : mSourcePath(sourcePath), mDestPath(destPath), mSourceFiles(0), mDestFiles(0), mFileFinder(ff)
 {
@@ -28,10 +45,13 @@ CrunchCache::CrunchCache(String8 sourcePath, String8 destPath, FileFinder* ff)
     loadFiles();
 }
 
-size_t CrunchCache::crunch(CacheUpdater* cu, bool forceOverwrite)
+size_t CrunchCache::crunch(CacheUpdater* cu, bool forceOverwrite, size_t maxThreads)
 {
     size_t numFilesUpdated = 0;
 
+    // Images are crunched on the work queue if there is one, in place otherwise.
+    WorkQueue* wq = maxThreads > 1 ? new WorkQueue(maxThreads, false) : NULL;
+
     // Iterate through the source files and compare to cache.
     // After processing a file, remove it from the source files and
     // from the dest files.
@@ -51,8 +71,19 @@ size_t CrunchCache::crunch(CacheUpdater* cu, bool forceOverwrite)
         relativePath = String8(rPathPtr + offset);
 
         if (forceOverwrite || needsUpdating(relativePath)) {
-            cu->processImage(mSourcePath.appendPathCopy(relativePath),
-                             mDestPath.appendPathCopy(relativePath));
+            String8 source(mSourcePath.appendPathCopy(relativePath));
+            String8 dest(mDestPath.appendPathCopy(relativePath));
+            ProcessImageWorkUnit* w = NULL;
+            if (wq != NULL) {
+                w = new ProcessImageWorkUnit(cu, source, dest);
+                if (wq->schedule(w) != NO_ERROR) {
+                    delete w;
+                    w = NULL;
+                }
+            }
+            if (w == NULL) {
+                cu->processImage(source, dest);
+            }
             numFilesUpdated++;
             // crunchFile(relativePath);
         }
@@ -62,6 +93,11 @@ size_t CrunchCache::crunch(CacheUpdater* cu, bool forceOverwrite)
         mDestFiles.removeItem(mDestPath.appendPathCopy(relativePath));
     }
 
+    if (wq != NULL) {
+        wq->finish();
+        delete wq;
+    }
+
     // Iterate through what's left of destFiles and delete leftovers
     while (mDestFiles.size() > 0) {
         cu->deleteFile(mDestFiles.keyAt(0));
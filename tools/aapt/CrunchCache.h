@@ -45,6 +45,11 @@ public:
      * we delete any leftover files in the cache that are no longer present
      * in source.
      *
+     * If maxThreads is greater than one, the source files are processed on
+     * that many threads, so the CacheUpdater must then be thread safe.
+     * Deletions always happen on the calling thread, once every source
+     * file has been processed.
+     *
      * PRECONDITIONS:
      *      No setup besides construction is needed
      * POSTCONDITIONS:
@@ -52,7 +57,7 @@ public:
      *      The function then returns the number of files changed in cache
      *      (counting deletions).
      */
-    size_t crunch(CacheUpdater* cu, bool forceOverwrite=false);
+    size_t crunch(CacheUpdater* cu, bool forceOverwrite=false, size_t maxThreads=1);
 
 private:
     /** loadFiles is a wrapper to the FileFinder that places matching
@@ -0,0 +1,176 @@
+//
+// Copyright 2013 The Android Open Source Project
+//
+// Implementation file for CrunchContentCache
+// This file defines functions laid out and documented in
+// CrunchContentCache.h
+
+#include "CrunchContentCache.h"
+#include "Images.h"
+
+#include <cutils/atomic.h>
+#include <zlib.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace android;
+
+// Part of every key. Bump it whenever a change to the crunching code alters
+// its output, so that entries written by older versions are not reused.
+static const uint32_t kCrunchFormatVersion = 1;
+
+// Distinguishes the temporary files of the threads of this process.
+static volatile int32_t sTmpFileCount = 0;
+
+static const uint64_t kFnvOffsetBasis = 0xcbf29ce484222325ULL;
+static const uint64_t kFnvPrime = 0x100000001b3ULL;
+
+static uint64_t fnv1a(uint64_t hash, const unsigned char* data, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= kFnvPrime;
+    }
+    return hash;
+}
+
+static void makeDirectory(const String8& path)
+{
+#ifdef HAVE_MS_C_RUNTIME
+    _mkdir(path.string());
+#else
+    mkdir(path.string(), S_IRWXU|S_IRGRP|S_IXGRP|S_IROTH|S_IXOTH);
+#endif
+}
+
+static status_t copyFile(const String8& source, const String8& dest)
+{
+    FILE* in = fopen(source.string(), "rb");
+    if (in == NULL) {
+        return -errno;
+    }
+    FILE* out = fopen(dest.string(), "wb");
+    if (out == NULL) {
+        status_t err = -errno;
+        fclose(in);
+        return err;
+    }
+
+    status_t err = NO_ERROR;
+    unsigned char buf[32768];
+    size_t count;
+    while ((count = fread(buf, 1, sizeof(buf), in)) > 0) {
+        if (fwrite(buf, 1, count, out) != count) {
+            err = UNKNOWN_ERROR;
+            break;
+        }
+    }
+    if (ferror(in)) {
+        err = UNKNOWN_ERROR;
+    }
+    fclose(in);
+    if (fclose(out) != 0) {
+        err = UNKNOWN_ERROR;
+    }
+    if (err != NO_ERROR) {
+        unlink(dest.string());
+    }
+    return err;
+}
+
+CrunchContentCache::CrunchContentCache(const Bundle* bundle, const String8& cacheDir)
+    : mBundle(bundle), mCacheDir(cacheDir)
+{
+}
+
+status_t CrunchContentCache::crunch(const String8& source, const String8& dest)
+{
+    String8 key;
+    if (!computeKey(source, &key)) {
+        // Let the crunch report the error.
+        return preProcessImageToCache(mBundle, source, dest);
+    }
+
+    if (copyFile(getCachePath(key), dest) == NO_ERROR) {
+        if (mBundle->getVerbose()) {
+            printf("Reusing cached image: %s => %s\n", source.string(), dest.string());
+        }
+        return NO_ERROR;
+    }
+
+    status_t err = preProcessImageToCache(mBundle, source, dest);
+    if (err == NO_ERROR) {
+        store(dest, key);
+    }
+    return err;
+}
+
+bool CrunchContentCache::computeKey(const String8& source, String8* outKey) const
+{
+    FILE* fp = fopen(source.string(), "rb");
+    if (fp == NULL) {
+        return false;
+    }
+
+    // Two independent hashes of the contents, so that an accidental collision
+    // must happen in both to alias two files.
+    uint32_t options[3];
+    options[0] = kCrunchFormatVersion;
+    options[1] = uint32_t(mBundle->getGrayscaleTolerance());
+    options[2] = mBundle->getPngFilterSearch() ? 1 : 0;
+    uint64_t fnv = fnv1a(kFnvOffsetBasis, (const unsigned char*) options, sizeof(options));
+    unsigned long crc = crc32(0L, Z_NULL, 0);
+    uint64_t size = 0;
+
+    unsigned char buf[32768];
+    size_t count;
+    while ((count = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        fnv = fnv1a(fnv, buf, count);
+        crc = crc32(crc, buf, count);
+        size += count;
+    }
+    bool failed = ferror(fp);
+    fclose(fp);
+    if (failed) {
+        return false;
+    }
+
+    outKey->setTo(String8::format("%08x%08x%08x%08x%02x",
+            uint32_t(fnv >> 32), uint32_t(fnv), uint32_t(crc), uint32_t(size),
+            uint32_t(size >> 32) & 0xff));
+    return true;
+}
+
+String8 CrunchContentCache::getCachePath(const String8& key) const
+{
+    // Spread the entries over 256 directories to keep them small.
+    String8 path(mCacheDir);
+    path.appendPath(String8(key.string(), 2));
+    path.appendPath(key);
+    path.append(".png");
+    return path;
+}
+
+void CrunchContentCache::store(const String8& dest, const String8& key)
+{
+    String8 path(getCachePath(key));
+    makeDirectory(mCacheDir);
+    makeDirectory(path.getPathDir());
+
+    // Write under a name of our own, then move the entry into place in one
+    // step so that concurrent builds never see a partial file.
+    String8 tmpPath(path);
+    tmpPath.appendFormat(".%d-%d.tmp", int(getpid()), int(android_atomic_inc(&sTmpFileCount)));
+    if (copyFile(dest, tmpPath) != NO_ERROR) {
+        fprintf(stderr, "warning: unable to add '%s' to crunch cache\n", dest.string());
+        return;
+    }
+    if (rename(tmpPath.string(), path.string()) != 0) {
+        // Another build may have added the same entry first.
+        unlink(tmpPath.string());
+    }
+}
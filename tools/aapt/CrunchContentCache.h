@@ -0,0 +1,59 @@
+//
+// Copyright 2013 The Android Open Source Project
+//
+// Content-addressed store of crunched PNG files, shared between source
+// trees and machines.
+//
+
+#ifndef CRUNCH_CONTENT_CACHE_H
+#define CRUNCH_CONTENT_CACHE_H
+
+#include <utils/Errors.h>
+#include <utils/String8.h>
+
+#include "Bundle.h"
+
+using namespace android;
+
+/** CrunchContentCache
+ *  Crunches PNG files through a directory of previously crunched outputs.
+ *  Its methods may be called from several threads at once.
+ *  Each output is stored under a key computed from the bytes of its source
+ *  and from the options that affect crunching, so a file whose contents are
+ *  unchanged is never crunched twice, whatever its path or modification time.
+ *
+ *  The directory may be shared by several trees, builds or machines: entries
+ *  are written to a temporary file and renamed into place, and an entry is
+ *  never modified once present.
+ *
+ *  Usage:
+ *      Create an instance with the bundle whose options are used to crunch
+ *      and the root of the cache, then call crunch for each file.
+ */
+class CrunchContentCache {
+public:
+    CrunchContentCache(const Bundle* bundle, const String8& cacheDir);
+
+    /** crunch writes the crunched version of source to dest, copying it from
+     *  the cache when present and adding it to the cache otherwise. Failing
+     *  to read or write the cache is not an error, the file is then crunched
+     *  as if there was no cache.
+     */
+    status_t crunch(const String8& source, const String8& dest);
+
+private:
+    /** computeKey hashes the contents of source along with the crunch
+     *  options. Returns false if source can't be read.
+     */
+    bool computeKey(const String8& source, String8* outKey) const;
+
+    String8 getCachePath(const String8& key) const;
+
+    // Copies the crunched file at dest into the cache under key.
+    void store(const String8& dest, const String8& key);
+
+    const Bundle* mBundle;
+    String8 mCacheDir;
+};
+
+#endif // CRUNCH_CONTENT_CACHE_H
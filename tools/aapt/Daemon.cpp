@@ -0,0 +1,422 @@
+//
+// Copyright 2013 The Android Open Source Project
+//
+// A long-lived aapt process that runs the commands of its clients, so that
+// they don't pay for starting aapt and parsing the included packages.
+//
+// Each command runs in a child forked from the daemon: it starts with the
+// resource tables of the included packages already parsed, and whatever it
+// changes in the global state of aapt is gone when it exits.
+//
+// A client connects to the daemon's socket and sends, along with its standard
+// output and error descriptors, the length of the request followed by the
+// request: its working directory and the arguments of the command, each
+// terminated by a NUL.  The daemon answers with the exit status of the
+// command, as an int32_t.
+//
+// The commands read and write files as the user running the daemon: its
+// socket is only accessible to that user, and connections from other users
+// are refused.
+//
+#include "Main.h"
+#include "Bundle.h"
+
+#include <androidfw/AssetManager.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef HAVE_MS_C_RUNTIME
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#endif
+
+using namespace android;
+
+#ifndef HAVE_MS_C_RUNTIME
+
+// Upper bound of the length of a request, to reject garbage.
+static const uint32_t kMaxRequestSize = 1024 * 1024;
+
+static bool readFully(int fd, void* data, size_t size)
+{
+    uint8_t* pos = (uint8_t*)data;
+    while (size > 0) {
+        ssize_t amt = read(fd, pos, size);
+        if (amt < 0 && errno == EINTR) {
+            continue;
+        }
+        if (amt <= 0) {
+            return false;
+        }
+        pos += amt;
+        size -= amt;
+    }
+    return true;
+}
+
+static bool writeFully(int fd, const void* data, size_t size)
+{
+    const uint8_t* pos = (const uint8_t*)data;
+    while (size > 0) {
+        ssize_t amt = write(fd, pos, size);
+        if (amt < 0 && errno == EINTR) {
+            continue;
+        }
+        if (amt <= 0) {
+            return false;
+        }
+        pos += amt;
+        size -= amt;
+    }
+    return true;
+}
+
+static int makeSocketAddress(const char* path, struct sockaddr_un* addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "ERROR: Socket path '%s' is too long\n", path);
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/*
+ * The included packages, kept open so that the children share their parsed
+ * resource tables: AssetManager shares the table of the first package of an
+ * asset manager between the asset managers opening the same, unmodified file.
+ */
+class PreloadedPackages {
+public:
+    PreloadedPackages(const Vector<const char*>& paths)
+        : mPaths(paths), mAssets(NULL) { }
+    ~PreloadedPackages() { delete mAssets; }
+
+    // Reloads the packages if one of them was modified since they were loaded.
+    void update(bool verbose)
+    {
+        Vector<time_t> modWhen;
+        for (size_t i = 0; i < mPaths.size(); i++) {
+            struct stat st;
+            modWhen.add(stat(mPaths[i], &st) == 0 ? st.st_mtime : 0);
+        }
+        bool modified = mAssets == NULL;
+        for (size_t i = 0; !modified && i < modWhen.size(); i++) {
+            modified = modWhen[i] != mModWhen[i];
+        }
+        if (!modified) {
+            return;
+        }
+
+        delete mAssets;
+        mAssets = new AssetManager();
+        for (size_t i = 0; i < mPaths.size(); i++) {
+            if (verbose) {
+                printf("Preloading resources from package: %s\n", mPaths[i]);
+            }
+            if (!mAssets->addAssetPath(String8(mPaths[i]), NULL)) {
+                fprintf(stderr, "WARNING: Asset package include '%s' not found.\n",
+                        mPaths[i]);
+            }
+        }
+        mAssets->getResources(true);
+        mModWhen = modWhen;
+    }
+
+private:
+    const Vector<const char*> mPaths;
+    AssetManager* mAssets;
+    Vector<time_t> mModWhen;
+};
+
+// Returns true if the peer of the connection runs as the same user as the
+// daemon.
+static bool isPeerTrusted(int client)
+{
+    uid_t uid;
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(client, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+        return false;
+    }
+    uid = cred.uid;
+#else
+    gid_t gid;
+    if (getpeereid(client, &uid, &gid) != 0) {
+        return false;
+    }
+#endif
+    return uid == getuid();
+}
+
+// The connection of the request being run, until its status is sent.
+static int gClient = -1;
+
+// A command that calls exit() still reports a failure to its client.
+static void reportExit()
+{
+    if (gClient >= 0) {
+        int32_t result = 1;
+        fflush(stdout);
+        fflush(stderr);
+        writeFully(gClient, &result, sizeof(result));
+        gClient = -1;
+    }
+}
+
+/*
+ * Runs the request of a client in the current process, a child of the
+ * daemon, and sends the exit status of the command back.
+ */
+static void handleRequest(int client)
+{
+    uint32_t size = 0;
+    int fds[2] = { -1, -1 };
+
+    struct iovec iov;
+    iov.iov_base = &size;
+    iov.iov_len = sizeof(size);
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t amt;
+    do {
+        amt = recvmsg(client, &msg, 0);
+    } while (amt < 0 && errno == EINTR);
+    if (amt <= 0) {
+        return;
+    }
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+            cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+                && cmsg->cmsg_len == CMSG_LEN(sizeof(fds))) {
+            memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+        }
+    }
+    if ((size_t)amt < sizeof(size)
+            && !readFully(client, ((uint8_t*)&size) + amt, sizeof(size) - amt)) {
+        return;
+    }
+    if (fds[0] < 0 || fds[1] < 0) {
+        return;
+    }
+    dup2(fds[0], STDOUT_FILENO);
+    dup2(fds[1], STDERR_FILENO);
+    if (size == 0 || size > kMaxRequestSize) {
+        fprintf(stderr, "ERROR: Malformed aapt daemon request\n");
+        return;
+    }
+
+    char* request = (char*)malloc(size + 1);
+    if (request == NULL || !readFully(client, request, size)) {
+        free(request);
+        return;
+    }
+    request[size] = '\0';
+
+    // The working directory, then the arguments.
+    Vector<char*> args;
+    for (size_t pos = 0; pos < size; pos += strlen(request + pos) + 1) {
+        args.add(request + pos);
+    }
+
+    int32_t result = 1;
+    if (args.size() < 2 || strcmp(args[1], "daemon") == 0) {
+        fprintf(stderr, "ERROR: Invalid aapt daemon command\n");
+    } else if (chdir(args[0]) != 0) {
+        fprintf(stderr, "ERROR: Unable to change to directory '%s': %s\n",
+                args[0], strerror(errno));
+    } else {
+        // The arguments replace the working directory by the program name.
+        args.editItemAt(0) = (char*)"aapt";
+        args.add(NULL);
+        gClient = client;
+        atexit(reportExit);
+        result = aaptMain(args.size() - 1, args.array());
+        gClient = -1;
+    }
+    fflush(stdout);
+    fflush(stderr);
+
+    writeFully(client, &result, sizeof(result));
+    free(request);
+}
+
+int doDaemon(Bundle* bundle)
+{
+    const char* socketPath = bundle->getDaemonSocket();
+    if (socketPath == NULL) {
+        fprintf(stderr, "ERROR: daemon requires the --socket option\n");
+        return 1;
+    }
+
+    struct sockaddr_un addr;
+    if (makeSocketAddress(socketPath, &addr) != 0) {
+        return 1;
+    }
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) {
+        fprintf(stderr, "ERROR: Unable to create socket: %s\n", strerror(errno));
+        return 1;
+    }
+    unlink(socketPath);
+    // The socket is created accessible to the user only, whatever the umask
+    mode_t oldMask = umask(077);
+    int bound = bind(server, (struct sockaddr*)&addr, sizeof(addr));
+    umask(oldMask);
+    if (bound != 0 || chmod(socketPath, 0600) != 0 || listen(server, 16) != 0) {
+        fprintf(stderr, "ERROR: Unable to listen on '%s': %s\n",
+                socketPath, strerror(errno));
+        close(server);
+        return 1;
+    }
+
+    // The children are reaped automatically.
+    signal(SIGCHLD, SIG_IGN);
+
+    PreloadedPackages preloaded(bundle->getPackageIncludes());
+    preloaded.update(bundle->getVerbose());
+    if (bundle->getVerbose()) {
+        printf("Listening on %s\n", socketPath);
+    }
+
+    while (true) {
+        int client = accept(server, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            fprintf(stderr, "ERROR: Unable to accept connection: %s\n", strerror(errno));
+            break;
+        }
+        if (!isPeerTrusted(client)) {
+            fprintf(stderr, "WARNING: Refused a connection from another user\n");
+            close(client);
+            continue;
+        }
+
+        preloaded.update(bundle->getVerbose());
+        fflush(stdout);
+        fflush(stderr);
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(server);
+            signal(SIGCHLD, SIG_DFL);
+            handleRequest(client);
+            _exit(0);
+        }
+        if (pid < 0) {
+            fprintf(stderr, "ERROR: Unable to fork: %s\n", strerror(errno));
+        }
+        close(client);
+    }
+
+    close(server);
+    unlink(socketPath);
+    return 1;
+}
+
+int doDaemonClient(const char* socketPath, int argc, char* const argv[])
+{
+    struct sockaddr_un addr;
+    if (makeSocketAddress(socketPath, &addr) != 0) {
+        return 1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        // No daemon, run the command here.
+        if (fd >= 0) {
+            close(fd);
+        }
+        Vector<char*> args;
+        args.add((char*)"aapt");
+        for (int i = 0; i < argc; i++) {
+            args.add(argv[i]);
+        }
+        args.add(NULL);
+        return aaptMain(args.size() - 1, args.array());
+    }
+
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        fprintf(stderr, "ERROR: Unable to get the working directory: %s\n", strerror(errno));
+        close(fd);
+        return 1;
+    }
+    Vector<char> request;
+    request.appendArray(cwd, strlen(cwd) + 1);
+    for (int i = 0; i < argc; i++) {
+        request.appendArray(argv[i], strlen(argv[i]) + 1);
+    }
+    uint32_t size = request.size();
+
+    int fds[2] = { STDOUT_FILENO, STDERR_FILENO };
+    struct iovec iov;
+    iov.iov_base = &size;
+    iov.iov_len = sizeof(size);
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    fflush(stdout);
+    fflush(stderr);
+    int32_t result = 1;
+    if (sendmsg(fd, &msg, 0) != (ssize_t)sizeof(size)
+            || !writeFully(fd, request.array(), request.size())
+            || !readFully(fd, &result, sizeof(result))) {
+        fprintf(stderr, "ERROR: Lost the connection to the aapt daemon at '%s'\n", socketPath);
+        result = 1;
+    }
+    close(fd);
+    return result;
+}
+
+#else
+
+int doDaemon(Bundle* bundle)
+{
+    fprintf(stderr, "ERROR: daemon is not supported on this platform\n");
+    return 1;
+}
+
+int doDaemonClient(const char* socketPath, int argc, char* const argv[])
+{
+    Vector<char*> args;
+    args.add((char*)"aapt");
+    for (int i = 0; i < argc; i++) {
+        args.add(argv[i]);
+    }
+    args.add(NULL);
+    return aaptMain(args.size() - 1, args.array());
+}
+
+#endif // HAVE_MS_C_RUNTIME
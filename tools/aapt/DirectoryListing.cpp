@@ -0,0 +1,163 @@
+//
+// Copyright 2013 The Android Open Source Project
+//
+// Implementation file for DirectoryListing
+// This file defines functions laid out and documented in
+// DirectoryListing.h
+
+#include "DirectoryListing.h"
+#include "WorkQueue.h"
+
+#include <utils/threads.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+static FileType getEntryType(const String8& path, const struct dirent* entry)
+{
+#ifdef DT_DIR
+    // Links and filesystems that don't report types are resolved by stat().
+    if (entry->d_type == DT_DIR) {
+        return kFileTypeDirectory;
+    }
+    if (entry->d_type == DT_REG) {
+        return kFileTypeRegular;
+    }
+#endif
+    struct stat st;
+    if (stat(path.appendPathCopy(entry->d_name).string(), &st) != 0) {
+        return kFileTypeNonexistent;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        return kFileTypeDirectory;
+    }
+    if (S_ISREG(st.st_mode)) {
+        return kFileTypeRegular;
+    }
+    return kFileTypeUnknown;
+}
+
+void DirectoryListing::list(const String8& path)
+{
+    DIR* dir = opendir(path.string());
+    if (dir == NULL) {
+        mError = -errno;
+        return;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        Entry e;
+        e.name = entry->d_name;
+        e.type = getEntryType(path, entry);
+        if (e.type == kFileTypeDirectory) {
+            e.subdir = new DirectoryListing();
+        }
+        mEntries.add(e);
+    }
+    closedir(dir);
+}
+
+void DirectoryListing::listTree(const String8& path)
+{
+    list(path);
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        if (mEntries[i].subdir != NULL) {
+            mEntries[i].subdir->listTree(path.appendPathCopy(mEntries[i].name));
+        }
+    }
+}
+
+// Counts the directories left to list, the scan is over when it drops to 0.
+class DirectoryListing::ScanState {
+public:
+    ScanState(size_t maxThreads) : mQueue(maxThreads, false), mPending(0) { }
+
+    void schedule(const sp<DirectoryListing>& listing, const String8& path);
+
+    void finished()
+    {
+        AutoMutex _l(mLock);
+        if (--mPending == 0) {
+            mDone.broadcast();
+        }
+    }
+
+    void wait()
+    {
+        {
+            AutoMutex _l(mLock);
+            while (mPending != 0) {
+                mDone.wait(mLock);
+            }
+        }
+        mQueue.finish();
+    }
+
+private:
+    WorkQueue mQueue;
+    Mutex mLock;
+    Condition mDone;
+    size_t mPending;
+};
+
+class DirectoryListing::ListWorkUnit : public WorkQueue::WorkUnit {
+public:
+    ListWorkUnit(ScanState* state, const sp<DirectoryListing>& listing, const String8& path)
+        : mState(state), mListing(listing), mPath(path) { }
+
+    virtual bool run()
+    {
+        mListing->list(mPath);
+        const Vector<Entry>& entries = mListing->getEntries();
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (entries[i].subdir != NULL) {
+                mState->schedule(entries[i].subdir, mPath.appendPathCopy(entries[i].name));
+            }
+        }
+        mState->finished();
+        return true;
+    }
+
+private:
+    ScanState* const mState;
+    const sp<DirectoryListing> mListing;
+    const String8 mPath;
+};
+
+void DirectoryListing::ScanState::schedule(const sp<DirectoryListing>& listing,
+                                           const String8& path)
+{
+    {
+        AutoMutex _l(mLock);
+        mPending++;
+    }
+    // Not throttled: the work units schedule their subdirectories, and
+    // blocking a worker on the queue it drains could deadlock.
+    ListWorkUnit* unit = new ListWorkUnit(this, listing, path);
+    if (mQueue.schedule(unit, 0) != OK) {
+        delete unit;
+        listing->listTree(path);
+        finished();
+    }
+}
+
+sp<DirectoryListing> DirectoryListing::scan(const String8& path, size_t maxThreads)
+{
+    sp<DirectoryListing> root = new DirectoryListing();
+    if (maxThreads <= 1) {
+        root->listTree(path);
+        return root;
+    }
+
+    ScanState state(maxThreads);
+    state.schedule(root, path);
+    state.wait();
+    return root;
+}
@@ -0,0 +1,70 @@
+//
+// Copyright 2013 The Android Open Source Project
+//
+// Listings of directory trees, read on several threads.
+//
+
+#ifndef DIRECTORY_LISTING_H
+#define DIRECTORY_LISTING_H
+
+#include <utils/Errors.h>
+#include <utils/misc.h>
+#include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+using namespace android;
+
+/** DirectoryListing
+ *  The entries of a directory and, recursively, of its subdirectories, as
+ *  they were when the tree was scanned.
+ *
+ *  The directories of the tree are read in parallel, but each listing keeps
+ *  the entries in the order readdir() returned them, so walking a listing
+ *  visits the files in the same order as walking the directories themselves.
+ *  The type of an entry comes from readdir() when the filesystem reports it,
+ *  sparing a stat() per file, and from stat() otherwise, following links.
+ *
+ *  Usage:
+ *      Scan the root of the tree, then read the entries of each listing on
+ *      any thread.  Every directory is listed, the caller skips the ones it
+ *      ignores.
+ */
+class DirectoryListing : public RefBase {
+public:
+    struct Entry {
+        String8 name;
+        FileType type;
+        // The listing of the entry if it is a directory.
+        sp<DirectoryListing> subdir;
+    };
+
+    /** scan lists the directory at path and its subdirectories on up to
+     *  maxThreads threads, and returns once every directory is listed. */
+    static sp<DirectoryListing> scan(const String8& path, size_t maxThreads);
+
+    /** getError returns NO_ERROR, or the -errno value of opendir() when the
+     *  directory couldn't be listed. */
+    status_t getError() const { return mError; }
+
+    /** getEntries returns the entries of the directory, except "." and "..". */
+    const Vector<Entry>& getEntries() const { return mEntries; }
+
+private:
+    class ScanState;
+    class ListWorkUnit;
+
+    DirectoryListing() : mError(NO_ERROR) { }
+
+    // Reads the entries of the directory at path, and creates an empty
+    // listing for each subdirectory.
+    void list(const String8& path);
+
+    // Lists the subdirectories, recursively, on the current thread.
+    void listTree(const String8& path);
+
+    status_t mError;
+    Vector<Entry> mEntries;
+};
+
+#endif // DIRECTORY_LISTING_H
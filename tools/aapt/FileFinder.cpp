@@ -58,15 +58,29 @@ bool SystemFileFinder::findFiles(String8 basePath, Vector<String8>& extensions,
             continue;
 
         String8 fullPath = basePath.appendPathCopy(entryName);
+        // The walker has already read the type of the entry, avoid
+        // another stat per file to check it.
+        bool directory, file;
+#ifdef DT_DIR
+        if (entry->d_type == DT_DIR || entry->d_type == DT_REG) {
+            directory = entry->d_type == DT_DIR;
+            file = entry->d_type == DT_REG;
+        } else
+#endif
+        {
+            directory = isDirectory(fullPath.string());
+            file = isFile(fullPath.string());
+        }
+
         // If this entry is a directory we'll recurse into it
-        if (isDirectory(fullPath.string()) ) {
+        if (directory) {
             DirectoryWalker* copy = dw->clone();
             findFiles(fullPath, extensions, fileStore,copy);
             delete copy;
         }
 
         // If this entry is a file, we'll pass it over to checkAndAddFile
-        if (isFile(fullPath.string()) ) {
+        if (file) {
             checkAndAddFile(fullPath,dw->entryStats(),extensions,fileStore);
         }
     }
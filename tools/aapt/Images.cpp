@@ -801,6 +801,11 @@ static void dump_image(int w, int h, png_bytepp rows, int color_type)
 #define MAX(a,b) ((a)>(b)?(a):(b))
 #define ABS(a)   ((a)<0?-(a):(a))
 
+// Size of the hash table used to build palettes, at least twice the 256 colors
+// of a palette.
+#define PALETTE_HASH_BITS 9
+#define PALETTE_HASH_SIZE (1 << PALETTE_HASH_BITS)
+
 static void analyze_image(const char *imageName, image_info &imageInfo, int grayscaleTolerance,
                           png_colorp rgbPalette, png_bytep alphaPalette,
                           int *paletteEntries, bool *hasTransparency, int *colorType,
@@ -812,13 +817,20 @@ static void analyze_image(const char *imageName, image_info &imageInfo, int gray
     uint32_t colors[256], col;
     int num_colors = 0;
     int maxGrayDeviation = 0;
+    int alphaMask = 0xff;
 
-    bool isOpaque = true;
     bool isPalette = true;
-    bool isGrayscale = true;
 
-    // Scan the entire image and determine if:
-    // 1. Every pixel has R == G == B (grayscale)
+    // Open addressed hash table of the colors found so far.  Each slot holds
+    // the index of its color in "colors" plus one, or zero if it is free.  It
+    // never holds more than 256 colors, so there is always a free slot.
+    uint16_t colorSlots[PALETTE_HASH_SIZE];
+    memset(colorSlots, 0, sizeof(colorSlots));
+    uint32_t lastColor = 0;
+    int lastIdx = -1;
+
+    // Scan the entire image once and determine if:
+    // 1. Every pixel has R == G == B (grayscale), i.e. the max gray deviation is 0
     // 2. Every pixel has A == 255 (opaque)
     // 3. There are no more than 256 distinct RGBA colors
 
@@ -828,66 +840,80 @@ static void analyze_image(const char *imageName, image_info &imageInfo, int gray
     for (j = 0; j < h; j++) {
         png_bytep row = imageInfo.rows[j];
         png_bytep out = outRows[j];
+
+        if (!isPalette) {
+            // Only the deviation and alpha are left to compute.  Keep this loop
+            // free of branches so that the compiler can vectorize it.
+            for (i = 0; i < w; i++, row += 4) {
+                rr = row[0];
+                gg = row[1];
+                bb = row[2];
+                int dev = MAX(MAX(ABS(rr - gg), ABS(gg - bb)), ABS(bb - rr));
+                maxGrayDeviation = MAX(dev, maxGrayDeviation);
+                alphaMask &= row[3];
+            }
+            continue;
+        }
+
         for (i = 0; i < w; i++) {
             rr = *row++;
             gg = *row++;
             bb = *row++;
             aa = *row++;
 
-            int odev = maxGrayDeviation;
-            maxGrayDeviation = MAX(ABS(rr - gg), maxGrayDeviation);
-            maxGrayDeviation = MAX(ABS(gg - bb), maxGrayDeviation);
-            maxGrayDeviation = MAX(ABS(bb - rr), maxGrayDeviation);
-            if (maxGrayDeviation > odev) {
+            int dev = MAX(MAX(ABS(rr - gg), ABS(gg - bb)), ABS(bb - rr));
+            if (dev > maxGrayDeviation) {
                 NOISY(printf("New max dev. = %d at pixel (%d, %d) = (%d %d %d %d)\n",
-                             maxGrayDeviation, i, j, rr, gg, bb, aa));
+                             dev, i, j, rr, gg, bb, aa));
+                maxGrayDeviation = dev;
             }
-
-            // Check if image is really grayscale
-            if (isGrayscale) {
-                if (rr != gg || rr != bb) {
-                     NOISY(printf("Found a non-gray pixel at %d, %d = (%d %d %d %d)\n",
-                                  i, j, rr, gg, bb, aa));
-                    isGrayscale = false;
+            alphaMask &= aa;
+
+            // Check if image is really <= 256 colors.  Neighboring pixels often
+            // share their color, so check the previous one before hashing.
+            col = (uint32_t) ((rr << 24) | (gg << 16) | (bb << 8) | aa);
+            if (lastIdx < 0 || col != lastColor) {
+                uint32_t slot = (col * 2654435761u) >> (32 - PALETTE_HASH_BITS);
+                while (colorSlots[slot] != 0 && colors[colorSlots[slot] - 1] != col) {
+                    slot = (slot + 1) & (PALETTE_HASH_SIZE - 1);
                 }
-            }
-
-            // Check if image is really opaque
-            if (isOpaque) {
-                if (aa != 0xff) {
-                    NOISY(printf("Found a non-opaque pixel at %d, %d = (%d %d %d %d)\n",
-                                 i, j, rr, gg, bb, aa));
-                    isOpaque = false;
+                if (colorSlots[slot] != 0) {
+                    idx = colorSlots[slot] - 1;
+                } else if (num_colors == 256) {
+                    NOISY(printf("Found 257th color at %d, %d\n", i, j));
+                    isPalette = false;
+                    break;
+                } else {
+                    idx = num_colors;
+                    colors[num_colors++] = col;
+                    colorSlots[slot] = num_colors;
                 }
+                lastColor = col;
+                lastIdx = idx;
             }
 
-            // Check if image is really <= 256 colors
-            if (isPalette) {
-                col = (uint32_t) ((rr << 24) | (gg << 16) | (bb << 8) | aa);
-                bool match = false;
-                for (idx = 0; idx < num_colors; idx++) {
-                    if (colors[idx] == col) {
-                        match = true;
-                        break;
-                    }
-                }
+            // Write the palette index for the pixel to outRows optimistically
+            // We might overwrite it later if we decide to encode as gray or
+            // gray + alpha
+            *out++ = lastIdx;
+        }
 
-                // Write the palette index for the pixel to outRows optimistically
-                // We might overwrite it later if we decide to encode as gray or
-                // gray + alpha
-                *out++ = idx;
-                if (!match) {
-                    if (num_colors == 256) {
-                        NOISY(printf("Found 257th color at %d, %d\n", i, j));
-                        isPalette = false;
-                    } else {
-                        colors[num_colors++] = col;
-                    }
-                }
+        if (!isPalette) {
+            // Finish the row without the palette.
+            for (i++; i < w; i++, row += 4) {
+                rr = row[0];
+                gg = row[1];
+                bb = row[2];
+                int dev = MAX(MAX(ABS(rr - gg), ABS(gg - bb)), ABS(bb - rr));
+                maxGrayDeviation = MAX(dev, maxGrayDeviation);
+                alphaMask &= row[3];
             }
         }
     }
 
+    bool isGrayscale = maxGrayDeviation == 0;
+    bool isOpaque = alphaMask == 0xff;
+
     *paletteEntries = 0;
     *hasTransparency = !isOpaque;
     int bpp = isOpaque ? 3 : 4;
@@ -971,9 +997,101 @@ static void analyze_image(const char *imageName, image_info &imageInfo, int gray
 }
 
 
-static void write_png(const char* imageName,
+static void count_png_bytes(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+    *(size_t*) png_get_io_ptr(png_ptr) += length;
+}
+
+static void flush_nothing(png_structp png_ptr)
+{
+}
+
+// Returns the size of the PNG stream of an image encoded with the given row
+// filters, leaving out the chunks that don't depend on them, or (size_t) -1
+// on error.
+static size_t measure_png(const image_info& imageInfo, png_bytepp rows, int color_type,
+                          png_colorp rgbPalette, png_bytep alphaPalette, int paletteEntries,
+                          bool hasTransparency, int filters)
+{
+    png_structp write_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!write_ptr) {
+        return (size_t) -1;
+    }
+    png_infop write_info = png_create_info_struct(write_ptr);
+    if (!write_info) {
+        png_destroy_write_struct(&write_ptr, NULL);
+        return (size_t) -1;
+    }
+
+    // On the heap so that the count isn't cached in a register across longjmp().
+    size_t* size = (size_t*) calloc(1, sizeof(size_t));
+    if (setjmp(png_jmpbuf(write_ptr))) {
+        png_destroy_write_struct(&write_ptr, &write_info);
+        free(size);
+        return (size_t) -1;
+    }
+
+    png_set_write_fn(write_ptr, size, count_png_bytes, flush_nothing);
+    png_set_compression_level(write_ptr, Z_BEST_COMPRESSION);
+    png_set_IHDR(write_ptr, write_info, imageInfo.width, imageInfo.height,
+                 8, color_type, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    if (color_type == PNG_COLOR_TYPE_PALETTE) {
+        png_set_PLTE(write_ptr, write_info, rgbPalette, paletteEntries);
+        if (hasTransparency) {
+            png_set_tRNS(write_ptr, write_info, alphaPalette, paletteEntries, (png_color_16p) 0);
+        }
+    }
+    png_set_filter(write_ptr, 0, filters);
+
+    png_write_info(write_ptr, write_info);
+    if (color_type == PNG_COLOR_TYPE_RGB) {
+        png_set_filler(write_ptr, 0, PNG_FILLER_AFTER);
+    }
+    png_write_image(write_ptr, rows);
+    png_write_end(write_ptr, write_info);
+
+    size_t result = *size;
+    png_destroy_write_struct(&write_ptr, &write_info);
+    free(size);
+    return result;
+}
+
+// Encodes the image with each filter strategy and returns the one that gives
+// the smallest file, preferring "defaultFilters" on ties.
+static int choose_png_filters(const char* imageName, const image_info& imageInfo,
+                              png_bytepp rows, int color_type, png_colorp rgbPalette,
+                              png_bytep alphaPalette, int paletteEntries,
+                              bool hasTransparency, int defaultFilters)
+{
+    static const int kFilters[] = {
+        PNG_ALL_FILTERS, PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP,
+        PNG_FILTER_AVG, PNG_FILTER_PAETH
+    };
+
+    int bestFilters = defaultFilters;
+    size_t bestSize = measure_png(imageInfo, rows, color_type, rgbPalette, alphaPalette,
+                                  paletteEntries, hasTransparency, defaultFilters);
+    for (size_t i = 0; i < sizeof(kFilters) / sizeof(kFilters[0]); i++) {
+        if (kFilters[i] == defaultFilters) {
+            continue;
+        }
+        size_t size = measure_png(imageInfo, rows, color_type, rgbPalette, alphaPalette,
+                                  paletteEntries, hasTransparency, kFilters[i]);
+        if (size < bestSize) {
+            bestSize = size;
+            bestFilters = kFilters[i];
+        }
+    }
+
+    NOISY(printf("Image %s: best filters = 0x%x (%d bytes)\n", imageName, bestFilters,
+                 (int) bestSize));
+    return bestFilters;
+}
+
+static status_t write_png(const char* imageName,
                       png_structp write_ptr, png_infop write_info,
-                      image_info& imageInfo, int grayscaleTolerance)
+                      image_info& imageInfo, int grayscaleTolerance, bool searchFilters)
 {
     bool optimize = true;
     png_uint_32 width, height;
@@ -987,14 +1105,18 @@ static void write_png(const char* imageName,
 
     png_bytepp outRows = (png_bytepp) malloc((int) imageInfo.height * sizeof(png_bytep));
     if (outRows == (png_bytepp) 0) {
-        printf("Can't allocate output buffer!\n");
-        exit(1);
+        fprintf(stderr, "ERROR: Can't allocate output buffer for %s\n", imageName);
+        return NO_MEMORY;
     }
     for (i = 0; i < (int) imageInfo.height; i++) {
         outRows[i] = (png_bytep) malloc(2 * (int) imageInfo.width);
         if (outRows[i] == (png_bytep) 0) {
-            printf("Can't allocate output buffer!\n");
-            exit(1);
+            fprintf(stderr, "ERROR: Can't allocate output buffer for %s\n", imageName);
+            while (i > 0) {
+                free(outRows[--i]);
+            }
+            free(outRows);
+            return NO_MEMORY;
         }
     }
 
@@ -1042,15 +1164,26 @@ static void write_png(const char* imageName,
                  8, color_type, PNG_INTERLACE_NONE,
                  PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
+    png_bytepp rows;
+    if (color_type == PNG_COLOR_TYPE_RGB || color_type == PNG_COLOR_TYPE_RGB_ALPHA) {
+        rows = imageInfo.rows;
+    } else {
+        rows = outRows;
+    }
+
+    int filters = color_type == PNG_COLOR_TYPE_PALETTE ? PNG_NO_FILTERS : PNG_ALL_FILTERS;
+    if (searchFilters) {
+        filters = choose_png_filters(imageName, imageInfo, rows, color_type, rgbPalette,
+                                     alphaPalette, paletteEntries, hasTransparency, filters);
+    }
+
     if (color_type == PNG_COLOR_TYPE_PALETTE) {
         png_set_PLTE(write_ptr, write_info, rgbPalette, paletteEntries);
         if (hasTransparency) {
             png_set_tRNS(write_ptr, write_info, alphaPalette, paletteEntries, (png_color_16p) 0);
         }
-       png_set_filter(write_ptr, 0, PNG_NO_FILTERS);
-    } else {
-       png_set_filter(write_ptr, 0, PNG_ALL_FILTERS);
     }
+    png_set_filter(write_ptr, 0, filters);
 
     if (imageInfo.is9Patch) {
         int chunk_count = 1 + (imageInfo.haveLayoutBounds ? 1 : 0);
@@ -1092,14 +1225,8 @@ static void write_png(const char* imageName,
 
     png_write_info(write_ptr, write_info);
 
-    png_bytepp rows;
-    if (color_type == PNG_COLOR_TYPE_RGB || color_type == PNG_COLOR_TYPE_RGB_ALPHA) {
-        if (color_type == PNG_COLOR_TYPE_RGB) {
-            png_set_filler(write_ptr, 0, PNG_FILLER_AFTER);
-        }
-        rows = imageInfo.rows;
-    } else {
-        rows = outRows;
+    if (color_type == PNG_COLOR_TYPE_RGB) {
+        png_set_filler(write_ptr, 0, PNG_FILLER_AFTER);
     }
     png_write_image(write_ptr, rows);
 
@@ -1122,6 +1249,7 @@ static void write_png(const char* imageName,
     NOISY(printf("Image written: w=%d, h=%d, d=%d, colors=%d, inter=%d, comp=%d\n",
                  (int)width, (int)height, bit_depth, color_type, interlace_type,
                  compression_type));
+    return NO_ERROR;
 }
 
 status_t preProcessImage(const Bundle* bundle, const sp<AaptAssets>& assets,
@@ -1212,10 +1340,11 @@ status_t preProcessImage(const Bundle* bundle, const sp<AaptAssets>& assets,
         goto bail;
     }
 
-    write_png(printableName.string(), write_ptr, write_info, imageInfo,
-              bundle->getGrayscaleTolerance());
-
-    error = NO_ERROR;
+    error = write_png(printableName.string(), write_ptr, write_info, imageInfo,
+              bundle->getGrayscaleTolerance(), bundle->getPngFilterSearch());
+    if (error != NO_ERROR) {
+        goto bail;
+    }
 
     if (bundle->getVerbose()) {
         fseek(fp, 0, SEEK_END);
@@ -1348,8 +1477,13 @@ status_t preProcessImageToCache(const Bundle* bundle, const String8& source, con
     }
 
     // Actually write out to the new png
-    write_png(dest.string(), write_ptr, write_info, imageInfo,
-              bundle->getGrayscaleTolerance());
+    error = write_png(dest.string(), write_ptr, write_info, imageInfo,
+              bundle->getGrayscaleTolerance(), bundle->getPngFilterSearch());
+    if (error != NO_ERROR) {
+        fclose(fp);
+        png_destroy_write_struct(&write_ptr, &write_info);
+        return error;
+    }
 
     if (bundle->getVerbose()) {
         // Find the size of our new file
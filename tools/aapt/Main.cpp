@@ -5,6 +5,7 @@
 //
 #include "Main.h"
 #include "Bundle.h"
+#include "BuildProfile.h"
 
 #include <utils/Log.h>
 #include <utils/threads.h>
@@ -64,6 +65,10 @@ void usage(void)
         "        [--rename-instrumentation-target-package PACKAGE] \\\n"
         "        [--utf16] [--auto-add-overlay] \\\n"
         "        [--max-res-version VAL] \\\n"
+        "        [--zip-threads N] [--compression-level N] [--incremental] \\\n"
+        "        [--crunch-threads N] [--png-filter-search] [--xml-threads N] \\\n"
+        "        [--resource-id-cache FILE] [--table-profile FILE] [--scan-threads N] \\\n"
+        "        [--profile FILE] \\\n"
         "        [-I base-package [-I base-package ...]] \\\n"
         "        [-A asset-source-dir]  [-G class-list-file] [-P public-definitions-file] \\\n"
         "        [-S resource-sources [-S resource-sources ...]] \\\n"
@@ -85,12 +90,22 @@ void usage(void)
         " %s a[dd] [-v] file.{zip,jar,apk} file1 [file2 ...]\n"
         "   Add specified files to Zip-compatible archive.\n\n", gProgName);
     fprintf(stderr,
-        " %s c[runch] [-v] -S resource-sources ... -C output-folder ...\n"
+        " %s c[runch] [-v] -S resource-sources ... -C output-folder ... \\\n"
+        "        [--crunch-cache-dir DIR] [--crunch-threads N]\n"
         "   Do PNG preprocessing on one or several resource folders\n"
         "   and store the results in the output folder.\n\n", gProgName);
     fprintf(stderr,
-        " %s s[ingleCrunch] [-v] -i input-file -o outputfile\n"
+        " %s s[ingleCrunch] [-v] -i input-file -o outputfile [--crunch-cache-dir DIR]\n"
         "   Do PNG preprocessing on a single file.\n\n", gProgName);
+    fprintf(stderr,
+        " %s daemon [-v] --socket socket-path [-I base-package [-I base-package ...]]\n"
+        "   Run the commands sent to the given Unix domain socket, each in a process\n"
+        "   forked from this one.  The resources of the -I packages are parsed once,\n"
+        "   and again only when the packages are modified.\n\n", gProgName);
+    fprintf(stderr,
+        " %s client socket-path command [args...]\n"
+        "   Run an aapt command through the daemon listening on the given socket,\n"
+        "   or in this process if there is none.\n\n", gProgName);
     fprintf(stderr,
         " %s v[ersion]\n"
         "   Print program version.\n\n", gProgName);
@@ -191,6 +206,49 @@ void usage(void)
         "   --output-text-symbols\n"
         "       Generates a text file containing the resource symbols of the R class in the\n"
         "       specified folder.\n"
+        "   --zip-threads\n"
+        "       Deflates the files added to the APK on N threads.  The files are\n"
+        "       still written in the same order, so the APK is the same as the one\n"
+        "       written by a single thread.  Ignored with -u.\n"
+        "   --compression-level\n"
+        "       zlib compression level (0-9) of the files added to the APK.  The\n"
+        "       default is 9; lower levels package faster, e.g. for debug builds.\n"
+        "   --incremental\n"
+        "       Rewrites an existing APK, copying the entries of unchanged files from\n"
+        "       it without compressing them again.  Unlike -u, the entries of files\n"
+        "       that no longer exist are dropped.\n"
+        "   --crunch-cache-dir\n"
+        "       Directory of crunched PNG files keyed by the contents of their sources,\n"
+        "       used by crunch and singleCrunch to skip files crunched before.  It can\n"
+        "       be shared between source trees and machines.\n"
+        "   --crunch-threads\n"
+        "       Number of threads that crunch PNG files, for package and crunch.\n"
+        "       The default is 4.\n"
+        "   --png-filter-search\n"
+        "       Encodes each crunched PNG file with every row filter strategy and keeps\n"
+        "       the smallest result.  Crunching is several times slower.\n"
+        "   --xml-threads\n"
+        "       Number of threads that parse and flatten XML resource files.  The\n"
+        "       resources they reference are always resolved on one thread, so the\n"
+        "       output does not depend on it.  The default is 4.\n"
+        "   --resource-id-cache\n"
+        "       File the resource identifiers looked up while compiling are saved to,\n"
+        "       and loaded from by the next build if its resources and included\n"
+        "       packages have the same identifiers.  With --incremental, defaults to\n"
+        "       the APK path followed by .ids.\n"
+        "   --table-profile\n"
+        "       Lists resource types with their access counts, one \"type count\" pair\n"
+        "       per line.  The types listed are written first in resources.arsc, from\n"
+        "       the most accessed, and page-aligned so that looking them up touches\n"
+        "       fewer pages of the mapped table.\n"
+        "   --scan-threads\n"
+        "       Number of threads that list the asset and resource directories.  The\n"
+        "       files are still added in the order of the directories, so the output\n"
+        "       does not depend on it.  The default is 4.\n"
+        "   --profile\n"
+        "       Writes how long each phase of the command and the work on each file\n"
+        "       took, and the peak memory, to FILE as a trace that chrome://tracing\n"
+        "       can load.\n"
         "   --ignore-assets\n"
         "       Assets to be ignored. Default pattern is:\n"
         "       %s\n",
@@ -216,6 +274,7 @@ int handleCommand(Bundle* bundle)
     case kCommandPackage:      return doPackage(bundle);
     case kCommandCrunch:       return doCrunch(bundle);
     case kCommandSingleCrunch: return doSingleCrunch(bundle);
+    case kCommandDaemon:       return doDaemon(bundle);
     default:
         fprintf(stderr, "%s: requested command not yet supported\n", gProgName);
         return 1;
@@ -225,7 +284,7 @@ int handleCommand(Bundle* bundle)
 /*
  * Parse args.
  */
-int main(int argc, char* const argv[])
+int aaptMain(int argc, char* const argv[])
 {
     char *prog = argv[0];
     Bundle bundle;
@@ -241,7 +300,18 @@ int main(int argc, char* const argv[])
         goto bail;
     }
 
-    if (argv[1][0] == 'v')
+    // The commands whose first letter is taken by another.
+    if (strcmp(argv[1], "client") == 0) {
+        if (argc < 4) {
+            wantUsage = true;
+            goto bail;
+        }
+        return doDaemonClient(argv[2], argc - 3, argv + 3);
+    }
+
+    if (strcmp(argv[1], "daemon") == 0)
+        bundle.setCommand(kCommandDaemon);
+    else if (argv[1][0] == 'v')
         bundle.setCommand(kCommandVersion);
     else if (argv[1][0] == 'd')
         bundle.setCommand(kCommandDump);
@@ -605,6 +675,125 @@ int main(int argc, char* const argv[])
                     bundle.setNonConstantId(true);
                 } else if (strcmp(cp, "-no-crunch") == 0) {
                     bundle.setUseCrunchCache(true);
+                } else if (strcmp(cp, "-zip-threads") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--zip-threads' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle.setZipThreads(atoi(argv[0]));
+                    if (bundle.getZipThreads() < 1) {
+                        fprintf(stderr, "ERROR: Invalid '--zip-threads' value '%s'\n", argv[0]);
+                        wantUsage = true;
+                        goto bail;
+                    }
+                } else if (strcmp(cp, "-compression-level") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--compression-level' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle.setCompressionLevel(atoi(argv[0]));
+                    if (bundle.getCompressionLevel() < 0 || bundle.getCompressionLevel() > 9) {
+                        fprintf(stderr, "ERROR: Invalid '--compression-level' value '%s'\n", argv[0]);
+                        wantUsage = true;
+                        goto bail;
+                    }
+                } else if (strcmp(cp, "-incremental") == 0) {
+                    bundle.setIncremental(true);
+                } else if (strcmp(cp, "-crunch-cache-dir") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--crunch-cache-dir' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle.setCrunchCacheDir(argv[0]);
+                } else if (strcmp(cp, "-crunch-threads") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--crunch-threads' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle.setCrunchThreads(atoi(argv[0]));
+                    if (bundle.getCrunchThreads() < 1) {
+                        fprintf(stderr, "ERROR: Invalid '--crunch-threads' value '%s'\n", argv[0]);
+                        wantUsage = true;
+                        goto bail;
+                    }
+                } else if (strcmp(cp, "-png-filter-search") == 0) {
+                    bundle.setPngFilterSearch(true);
+                } else if (strcmp(cp, "-xml-threads") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--xml-threads' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle.setXmlThreads(atoi(argv[0]));
+                    if (bundle.getXmlThreads() < 1) {
+                        fprintf(stderr, "ERROR: Invalid '--xml-threads' value '%s'\n", argv[0]);
+                        wantUsage = true;
+                        goto bail;
+                    }
+                } else if (strcmp(cp, "-scan-threads") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--scan-threads' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle.setScanThreads(atoi(argv[0]));
+                    if (bundle.getScanThreads() < 1) {
+                        fprintf(stderr, "ERROR: Invalid '--scan-threads' value '%s'\n", argv[0]);
+                        wantUsage = true;
+                        goto bail;
+                    }
+                } else if (strcmp(cp, "-resource-id-cache") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--resource-id-cache' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle.setResourceIdCacheFile(argv[0]);
+                } else if (strcmp(cp, "-socket") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--socket' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle.setDaemonSocket(argv[0]);
+                } else if (strcmp(cp, "-table-profile") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--table-profile' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle.setTableProfile(argv[0]);
+                } else if (strcmp(cp, "-profile") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--profile' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle.setProfileFile(argv[0]);
                 } else if (strcmp(cp, "-ignore-assets") == 0) {
                     argc--;
                     argv++;
@@ -638,8 +827,22 @@ int main(int argc, char* const argv[])
      */
     bundle.setFileSpec(argv, argc);
 
+    if (bundle.getProfileFile() != NULL) {
+        BuildProfile::start();
+    }
+
     result = handleCommand(&bundle);
 
+    if (bundle.getProfileFile() != NULL) {
+        status_t err = BuildProfile::write(bundle.getProfileFile());
+        if (err != NO_ERROR) {
+            fprintf(stderr, "WARNING: Unable to write profile '%s'\n", bundle.getProfileFile());
+        } else if (bundle.getVerbose()) {
+            printf("Wrote profile %s, peak memory %lu KB\n", bundle.getProfileFile(),
+                    (unsigned long)BuildProfile::getPeakMemoryKb());
+        }
+    }
+
 bail:
     if (wantUsage) {
         usage();
@@ -649,3 +852,8 @@ bail:
     //printf("--> returning %d\n", result);
     return result;
 }
+
+int main(int argc, char* const argv[])
+{
+    return aaptMain(argc, argv);
+}
@@ -30,6 +30,11 @@ extern int doRemove(Bundle* bundle);
 extern int doPackage(Bundle* bundle);
 extern int doCrunch(Bundle* bundle);
 extern int doSingleCrunch(Bundle* bundle);
+extern int doDaemon(Bundle* bundle);
+extern int doDaemonClient(const char* socketPath, int argc, char* const argv[]);
+
+/* Parses the arguments of a command and runs it, as the aapt program does. */
+extern int aaptMain(int argc, char* const argv[]);
 
 extern int calcPercent(long uncompressedLen, long compressedLen);
 
@@ -7,6 +7,8 @@
 #include "AaptAssets.h"
 #include "ResourceTable.h"
 #include "ResourceFilter.h"
+#include "WorkQueue.h"
+#include "BuildProfile.h"
 
 #include <androidfw/misc.h>
 
@@ -17,9 +19,11 @@
 #include <utils/misc.h>
 
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <dirent.h>
 #include <ctype.h>
 #include <errno.h>
+#include <zlib.h>
 
 using namespace android;
 
@@ -35,11 +39,81 @@ static const char* kNoCompressExt[] = {
     ".amr", ".awb", ".wma", ".wmv"
 };
 
+/*
+ * Files queued by processFile() are written in batches of at most this many
+ * files or bytes when they are deflated on several threads, which bounds the
+ * memory used to hold their compressed data.
+ */
+static const size_t kMaxQueuedFiles = 512;
+static const size_t kMaxQueuedBytes = 64 * 1024 * 1024;
+
+/*
+ * Adds files to the archive in the order they are queued.
+ *
+ * With a single zip thread every file is added as soon as it is queued.
+ * Otherwise the files that need deflating are compressed on a WorkQueue a
+ * batch at a time, and the batch is then written in queue order, so the
+ * archive is the same as the one a single thread writes.
+ *
+ * If a previous version of the archive is supplied, files whose contents
+ * match one of its entries are copied from it without being compressed.
+ */
+class ZipWriteQueue {
+public:
+    ZipWriteQueue(Bundle* bundle, ZipFile* zip, ZipFile* previousZip);
+    ~ZipWriteQueue();
+
+    bool add(const sp<AaptFile>& file, const String8& storageName,
+             bool fromGzip, int compressionMethod);
+
+    /* Write every queued file.  Returns false if any of them failed. */
+    bool flush();
+
+private:
+    struct Item {
+        sp<AaptFile> file;
+        String8 storageName;
+        bool fromGzip;
+        int compressionMethod;
+        bool precompressed;
+        ZipFile::Precompressed data;
+        ZipEntry* previousEntry;
+    };
+
+    class PrecompressWorkUnit : public WorkQueue::WorkUnit {
+    public:
+        PrecompressWorkUnit(Item* item, int level) :
+                mItem(item), mLevel(level) {
+        }
+
+        virtual bool run();
+
+    private:
+        Item* mItem;
+        int mLevel;
+    };
+
+    ZipEntry* findUnchangedEntry(const sp<AaptFile>& file, const String8& storageName,
+            bool fromGzip, int compressionMethod) const;
+    bool write(const Item& item);
+
+    Bundle* mBundle;
+    ZipFile* mZip;
+    ZipFile* mPreviousZip;
+    // Entries of the previous archive, by name.
+    KeyedVector<String8, ZipEntry*> mPreviousEntries;
+    size_t mThreads;
+    Vector<Item*> mItems;
+    size_t mQueuedBytes;
+};
+
 /* fwd decls, so I can write this downward */
-ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<AaptAssets>& assets);
-ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<AaptDir>& dir,
-                        const AaptGroupEntry& ge, const ResourceFilter* filter);
-bool processFile(Bundle* bundle, ZipFile* zip,
+ssize_t processAssets(Bundle* bundle, ZipFile* zip, ZipFile* previousZip,
+                        const sp<AaptAssets>& assets);
+ssize_t processAssets(Bundle* bundle, ZipWriteQueue* queue, ZipFile* zip,
+                        const sp<AaptDir>& dir, const AaptGroupEntry& ge,
+                        const ResourceFilter* filter);
+bool processFile(Bundle* bundle, ZipWriteQueue* queue, ZipFile* zip,
                         const sp<AaptGroup>& group, const sp<AaptFile>& file);
 bool okayToCompress(Bundle* bundle, const String8& pathName);
 ssize_t processJarFiles(Bundle* bundle, ZipFile* zip);
@@ -61,15 +135,21 @@ status_t writeAPK(Bundle* bundle, const sp<AaptAssets>& assets,
 
     status_t result = NO_ERROR;
     ZipFile* zip = NULL;
+    ZipFile* previousZip = NULL;
+    String8 zipFileName(outputFile);
     int count;
+    BuildProfile::Scope phase("openZip");
 
     //bundle->setPackageCount(0);
 
     /*
      * Prep the Zip archive.
      *
-     * If the file already exists, fail unless "update" or "force" is set.
+     * If the file already exists, fail unless "update", "incremental" or
+     * "force" is set.
      * If "update" is set, update the contents of the existing archive.
+     * Else, if "incremental" is set, write a new archive next to the
+     * existing one, copying unchanged entries from it, and replace it.
      * Else, if "force" is set, remove the existing archive.
      */
     FileType fileType = getFileType(outputFile.string());
@@ -78,6 +158,16 @@ status_t writeAPK(Bundle* bundle, const sp<AaptAssets>& assets,
     } else if (fileType == kFileTypeRegular) {
         if (bundle->getUpdate()) {
             // okay, open it below
+        } else if (bundle->getIncremental()) {
+            previousZip = new ZipFile;
+            if (previousZip->open(outputFile.string(), ZipFile::kOpenReadOnly) != NO_ERROR) {
+                fprintf(stderr, "warning: '%s' is not a Zip file, rewriting it\n",
+                        outputFile.string());
+                delete previousZip;
+                previousZip = NULL;
+            }
+            zipFileName.append(".new");
+            unlink(zipFileName.string());
         } else if (bundle->getForce()) {
             if (unlink(outputFile.string()) != 0) {
                 fprintf(stderr, "ERROR: unable to remove '%s': %s\n", outputFile.string(),
@@ -101,18 +191,23 @@ status_t writeAPK(Bundle* bundle, const sp<AaptAssets>& assets,
 
     status_t status;
     zip = new ZipFile;
-    status = zip->open(outputFile.string(), ZipFile::kOpenReadWrite | ZipFile::kOpenCreate);
+    status = zip->open(zipFileName.string(), ZipFile::kOpenReadWrite | ZipFile::kOpenCreate);
     if (status != NO_ERROR) {
         fprintf(stderr, "ERROR: unable to open '%s' as Zip file for writing\n",
-                outputFile.string());
+                zipFileName.string());
         goto bail;
     }
 
+    if (bundle->getCompressionLevel() >= 0) {
+        zip->setCompressionLevel(bundle->getCompressionLevel());
+    }
+
     if (bundle->getVerbose()) {
         printf("Writing all files...\n");
     }
 
-    count = processAssets(bundle, zip, assets);
+    phase.next("processAssets");
+    count = processAssets(bundle, zip, previousZip, assets);
     if (count < 0) {
         fprintf(stderr, "ERROR: unable to process assets while packaging '%s'\n",
                 outputFile.string());
@@ -124,6 +219,7 @@ status_t writeAPK(Bundle* bundle, const sp<AaptAssets>& assets,
         printf("Generated %d file%s\n", count, (count==1) ? "" : "s");
     }
     
+    phase.next("processJarFiles");
     count = processJarFiles(bundle, zip);
     if (count < 0) {
         fprintf(stderr, "ERROR: unable to process jar files while packaging '%s'\n",
@@ -163,6 +259,7 @@ status_t writeAPK(Bundle* bundle, const sp<AaptAssets>& assets,
     }
 
     /* tell Zip lib to process deletions and other pending changes */
+    phase.next("flushZip");
     result = zip->flush();
     if (result != NO_ERROR) {
         fprintf(stderr, "ERROR: Zip flush failed, archive may be hosed\n");
@@ -176,9 +273,26 @@ status_t writeAPK(Bundle* bundle, const sp<AaptAssets>& assets,
         }
         delete zip;        // close the file so we can remove it in Win32
         zip = NULL;
+        delete previousZip;
+        previousZip = NULL;
         if (unlink(outputFile.string()) != 0) {
             fprintf(stderr, "warning: could not unlink '%s'\n", outputFile.string());
         }
+        if (zipFileName != outputFile) {
+            unlink(zipFileName.string());
+        }
+    } else if (zipFileName != outputFile) {
+        /* replace the previous archive, closing both files first for Win32 */
+        delete previousZip;
+        previousZip = NULL;
+        delete zip;
+        zip = NULL;
+        if (rename(zipFileName.string(), outputFile.string()) != 0) {
+            fprintf(stderr, "ERROR: unable to rename '%s' to '%s': %s\n",
+                    zipFileName.string(), outputFile.string(), strerror(errno));
+            result = UNKNOWN_ERROR;
+            goto bail;
+        }
     }
 
     // If we've been asked to generate a dependency file for the .ap_ package,
@@ -200,6 +314,7 @@ status_t writeAPK(Bundle* bundle, const sp<AaptAssets>& assets,
 
 bail:
     delete zip;        // must close before remove in Win32
+    delete previousZip;
     if (result != NO_ERROR) {
         if (bundle->getVerbose()) {
             printf("Removing %s due to earlier failures\n", outputFile.string());
@@ -207,6 +322,9 @@ bail:
         if (unlink(outputFile.string()) != 0) {
             fprintf(stderr, "warning: could not unlink '%s'\n", outputFile.string());
         }
+        if (zipFileName != outputFile) {
+            unlink(zipFileName.string());
+        }
     }
 
     if (result == NO_ERROR && bundle->getVerbose())
@@ -218,7 +336,7 @@ bail:
     return result;
 }
 
-ssize_t processAssets(Bundle* bundle, ZipFile* zip,
+ssize_t processAssets(Bundle* bundle, ZipFile* zip, ZipFile* previousZip,
                       const sp<AaptAssets>& assets)
 {
     ResourceFilter filter;
@@ -227,13 +345,14 @@ ssize_t processAssets(Bundle* bundle, ZipFile* zip,
         return -1;
     }
 
+    ZipWriteQueue queue(bundle, zip, previousZip);
     ssize_t count = 0;
 
     const size_t N = assets->getGroupEntries().size();
     for (size_t i=0; i<N; i++) {
         const AaptGroupEntry& ge = assets->getGroupEntries()[i];
 
-        ssize_t res = processAssets(bundle, zip, assets, ge, &filter);
+        ssize_t res = processAssets(bundle, &queue, zip, assets, ge, &filter);
         if (res < 0) {
             return res;
         }
@@ -241,11 +360,15 @@ ssize_t processAssets(Bundle* bundle, ZipFile* zip,
         count += res;
     }
 
+    if (!queue.flush()) {
+        return UNKNOWN_ERROR;
+    }
+
     return count;
 }
 
-ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<AaptDir>& dir,
-        const AaptGroupEntry& ge, const ResourceFilter* filter)
+ssize_t processAssets(Bundle* bundle, ZipWriteQueue* queue, ZipFile* zip,
+        const sp<AaptDir>& dir, const AaptGroupEntry& ge, const ResourceFilter* filter)
 {
     ssize_t count = 0;
 
@@ -260,7 +383,8 @@ ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<AaptDir>& dir,
             continue;
         }
 
-        ssize_t res = processAssets(bundle, zip, subDir, ge, filterable ? filter : NULL);
+        ssize_t res = processAssets(bundle, queue, zip, subDir, ge,
+                filterable ? filter : NULL);
         if (res < 0) {
             return res;
         }
@@ -277,7 +401,7 @@ ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<AaptDir>& dir,
         ssize_t fi = gp->getFiles().indexOfKey(ge);
         if (fi >= 0) {
             sp<AaptFile> fl = gp->getFiles().valueAt(fi);
-            if (!processFile(bundle, zip, gp, fl)) {
+            if (!processFile(bundle, queue, zip, gp, fl)) {
                 return UNKNOWN_ERROR;
             }
             count++;
@@ -293,7 +417,7 @@ ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<AaptDir>& dir,
  * If we're in "update" mode, and the file already exists in the archive,
  * delete the existing entry before adding the new one.
  */
-bool processFile(Bundle* bundle, ZipFile* zip,
+bool processFile(Bundle* bundle, ZipWriteQueue* queue, ZipFile* zip,
                  const sp<AaptGroup>& group, const sp<AaptFile>& file)
 {
     const bool hasData = file->hasData();
@@ -302,7 +426,6 @@ bool processFile(Bundle* bundle, ZipFile* zip,
     storageName.convertToResPath();
     ZipEntry* entry;
     bool fromGzip = false;
-    status_t result;
 
     /*
      * See if the filename ends in ".EXCLUDE".  We can't use
@@ -373,24 +496,212 @@ bool processFile(Bundle* bundle, ZipFile* zip,
 
     //android_setMinPriority(NULL, ANDROID_LOG_VERBOSE);
 
+    int compressionMethod;
     if (fromGzip) {
-        result = zip->addGzip(file->getSourceFile().string(), storageName.string(), &entry);
+        compressionMethod = ZipEntry::kCompressDeflated;
     } else if (!hasData) {
         /* don't compress certain files, e.g. PNGs */
-        int compressionMethod = bundle->getCompressionMethod();
+        compressionMethod = bundle->getCompressionMethod();
         if (!okayToCompress(bundle, storageName)) {
             compressionMethod = ZipEntry::kCompressStored;
         }
-        result = zip->add(file->getSourceFile().string(), storageName.string(), compressionMethod,
-                            &entry);
     } else {
-        result = zip->add(file->getData(), file->getSize(), storageName.string(),
-                           file->getCompressionMethod(), &entry);
+        compressionMethod = file->getCompressionMethod();
+    }
+
+    return queue->add(file, storageName, fromGzip, compressionMethod);
+}
+
+// --- ZipWriteQueue ---
+
+ZipWriteQueue::ZipWriteQueue(Bundle* bundle, ZipFile* zip, ZipFile* previousZip) :
+        mBundle(bundle), mZip(zip), mPreviousZip(previousZip), mThreads(1), mQueuedBytes(0) {
+    // Update mode checks the entries already written while it queues files,
+    // so it always writes them as they come.
+    if (!bundle->getUpdate() && bundle->getZipThreads() > 1) {
+        mThreads = bundle->getZipThreads();
+    }
+
+    if (previousZip != NULL) {
+        const int N = previousZip->getNumEntries();
+        for (int i = 0; i < N; i++) {
+            ZipEntry* entry = previousZip->getEntryByIndex(i);
+            mPreviousEntries.add(String8(entry->getFileName()), entry);
+        }
+    }
+}
+
+ZipWriteQueue::~ZipWriteQueue() {
+    for (size_t i = 0; i < mItems.size(); i++) {
+        delete mItems[i];
+    }
+}
+
+bool ZipWriteQueue::add(const sp<AaptFile>& file, const String8& storageName,
+        bool fromGzip, int compressionMethod) {
+    Item* item = new Item;
+    item->file = file;
+    item->storageName = storageName;
+    item->fromGzip = fromGzip;
+    item->compressionMethod = compressionMethod;
+    item->precompressed = false;
+    item->previousEntry = findUnchangedEntry(file, storageName, fromGzip, compressionMethod);
+
+    if (mThreads <= 1) {
+        bool result = write(*item);
+        delete item;
+        return result;
+    }
+
+    mItems.add(item);
+    if (file->hasData()) {
+        mQueuedBytes += file->getSize();
+    } else {
+        struct stat sb;
+        if (stat(file->getSourceFile().string(), &sb) == 0) {
+            mQueuedBytes += sb.st_size;
+        }
+    }
+    if (mItems.size() >= kMaxQueuedFiles || mQueuedBytes >= kMaxQueuedBytes) {
+        return flush();
+    }
+    return true;
+}
+
+bool ZipWriteQueue::flush() {
+    bool result = true;
+
+    if (mItems.size() > 1) {
+        // A WorkQueue can't be reused once it has finished, so each batch gets its own.
+        WorkQueue wq(mThreads, false);
+        for (size_t i = 0; i < mItems.size(); i++) {
+            Item* item = mItems[i];
+            if (item->fromGzip || item->previousEntry != NULL
+                    || item->compressionMethod != ZipEntry::kCompressDeflated) {
+                continue;
+            }
+            PrecompressWorkUnit* w = new PrecompressWorkUnit(item, mZip->getCompressionLevel());
+            status_t status = wq.schedule(w);
+            if (status) {
+                // The remaining files are compressed as they are written.
+                fprintf(stderr, "warning: unable to schedule compression: %d\n", status);
+                delete w;
+                break;
+            }
+        }
+        wq.finish();
+    }
+
+    for (size_t i = 0; i < mItems.size(); i++) {
+        if (result && !write(*mItems[i])) {
+            result = false;
+        }
+        delete mItems[i];
+    }
+    mItems.clear();
+    mQueuedBytes = 0;
+    return result;
+}
+
+bool ZipWriteQueue::PrecompressWorkUnit::run() {
+    BuildProfile::Scope scope("precompress", mItem->storageName);
+    const sp<AaptFile>& file = mItem->file;
+    status_t status;
+    if (file->hasData()) {
+        status = ZipFile::precompress(NULL, file->getData(), file->getSize(), mLevel,
+                &mItem->data);
+    } else {
+        status = ZipFile::precompress(file->getSourceFile().string(), NULL, 0, mLevel,
+                &mItem->data);
+    }
+    // On failure the file is compressed again when it is written, which
+    // reports the error.
+    mItem->precompressed = status == NO_ERROR;
+    return true;
+}
+
+/*
+ * Returns the entry of the previous archive that holds exactly the contents
+ * of "file", or NULL if the file is new or changed.  A source file is taken
+ * to be unchanged when its size and modification time match the entry;
+ * otherwise, and for generated data, the CRCs are compared.
+ */
+ZipEntry* ZipWriteQueue::findUnchangedEntry(const sp<AaptFile>& file,
+        const String8& storageName, bool fromGzip, int compressionMethod) const {
+    ssize_t index = mPreviousEntries.indexOfKey(storageName);
+    if (index < 0 || fromGzip) {
+        return NULL;
+    }
+
+    ZipEntry* entry = mPreviousEntries.valueAt(index);
+    if (compressionMethod == ZipEntry::kCompressStored && entry->isCompressed()) {
+        return NULL;
+    }
+
+    unsigned long crc = crc32(0L, Z_NULL, 0);
+    if (file->hasData()) {
+        if (entry->getUncompressedLen() != (off_t) file->getSize()) {
+            return NULL;
+        }
+        crc = crc32(crc, (const unsigned char*) file->getData(), file->getSize());
+    } else {
+        const char* sourceFile = file->getSourceFile().string();
+        struct stat sb;
+        if (stat(sourceFile, &sb) != 0 || entry->getUncompressedLen() != sb.st_size) {
+            return NULL;
+        }
+
+        // ZipEntry rounds times up to an even number of seconds.
+        time_t even = (time_t)(((unsigned long)(sb.st_mtime) + 1) & (~1));
+        if (entry->getModWhen() == even) {
+            return entry;
+        }
+
+        FILE* fp = fopen(sourceFile, "rb");
+        if (fp == NULL) {
+            return NULL;
+        }
+        unsigned char buf[32768];
+        size_t count;
+        while ((count = fread(buf, 1, sizeof(buf), fp)) > 0) {
+            crc = crc32(crc, buf, count);
+        }
+        bool failed = ferror(fp);
+        fclose(fp);
+        if (failed) {
+            return NULL;
+        }
+    }
+    return crc == entry->getCRC32() ? entry : NULL;
+}
+
+bool ZipWriteQueue::write(const Item& item) {
+    BuildProfile::Scope scope("addToZip", item.storageName);
+    const sp<AaptFile>& file = item.file;
+    const char* storageName = item.storageName.string();
+    const char* sourceFile = file->hasData() ? NULL : file->getSourceFile().string();
+    ZipEntry* entry;
+    status_t result;
+
+    if (item.previousEntry != NULL) {
+        result = mZip->add(mPreviousZip, item.previousEntry, 0, &entry);
+    } else if (item.fromGzip) {
+        result = mZip->addGzip(file->getSourceFile().string(), storageName, &entry);
+    } else if (item.precompressed) {
+        result = mZip->addPrecompressed(sourceFile, file->getData(), file->getSize(),
+                storageName, item.data, &entry);
+    } else if (!file->hasData()) {
+        result = mZip->add(sourceFile, storageName, item.compressionMethod, &entry);
+    } else {
+        result = mZip->add(file->getData(), file->getSize(), storageName,
+                item.compressionMethod, &entry);
     }
     if (result == NO_ERROR) {
-        if (bundle->getVerbose()) {
-            printf("      '%s'%s", storageName.string(), fromGzip ? " (from .gz)" : "");
-            if (entry->getCompressionMethod() == ZipEntry::kCompressStored) {
+        if (mBundle->getVerbose()) {
+            printf("      '%s'%s", storageName, item.fromGzip ? " (from .gz)" : "");
+            if (item.previousEntry != NULL) {
+                printf(" (unchanged)\n");
+            } else if (entry->getCompressionMethod() == ZipEntry::kCompressStored) {
                 printf(" (not compressed)\n");
             } else {
                 printf(" (compressed %d%%)\n", calcPercent(entry->getUncompressedLen(),
@@ -462,16 +773,16 @@ ssize_t processJarFile(ZipFile* jar, ZipFile* out)
         ZipEntry* entry = jar->getEntryByIndex(i);
         const char* storageName = entry->getFileName();
         if (endsWith(storageName, ".class")) {
-            int compressionMethod = entry->getCompressionMethod();
-            size_t size = entry->getUncompressedLen();
-            const void* data = jar->uncompress(entry);
-            if (data == NULL) {
-                fprintf(stderr, "ERROR: unable to uncompress entry '%s'\n",
-                    storageName);
-                return -1;
+            // Copy the compressed bytes as they are, with the CRC, sizes and
+            // method of the jar entry; the first copy of a name wins.
+            if (out->getEntryByName(storageName) == NULL) {
+                err = out->add(jar, entry, 0, NULL);
+                if (err != NO_ERROR) {
+                    fprintf(stderr, "ERROR: unable to copy entry '%s'\n",
+                        storageName);
+                    return -1;
+                }
             }
-            out->add(data, size, storageName, compressionMethod, NULL);
-            free((void*)data);
         }
         count++;
     }
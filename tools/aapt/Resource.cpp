@@ -15,6 +15,8 @@
 #include "CacheUpdater.h"
 
 #include "WorkQueue.h"
+#include "ResourceIdCache.h"
+#include "BuildProfile.h"
 
 #if HAVE_PRINTF_ZD
 #  define ZD "%zd"
@@ -26,9 +28,6 @@
 
 #define NOISY(x) // x
 
-// Number of threads to use for preprocessing images.
-static const size_t MAX_THREADS = 4;
-
 // ==========================================================================
 // ==========================================================================
 // ==========================================================================
@@ -316,6 +315,7 @@ public:
     }
 
     virtual bool run() {
+        BuildProfile::Scope scope("preProcessImage", mFile->getSourceFile());
         status_t status = preProcessImage(mBundle, mAssets, mFile, NULL);
         if (status) {
             *mHasErrors = true;
@@ -336,7 +336,7 @@ static status_t preProcessImages(const Bundle* bundle, const sp<AaptAssets>& ass
     volatile bool hasErrors = false;
     ssize_t res = NO_ERROR;
     if (bundle->getUseCrunchCache() == false) {
-        WorkQueue wq(MAX_THREADS, false);
+        WorkQueue wq(bundle->getCrunchThreads(), false);
         ResourceDirIterator it(set, String8(type));
         while ((res=it.next()) == NO_ERROR) {
             PreProcessImageWorkUnit* w = new PreProcessImageWorkUnit(
@@ -866,7 +866,7 @@ status_t updatePreProcessedCache(Bundle* bundle)
     CrunchCache cc(source,dest,ff);
 
     CacheUpdater* cu = new SystemCacheUpdater(bundle);
-    size_t numFiles = cc.crunch(cu);
+    size_t numFiles = cc.crunch(cu, false, bundle->getCrunchThreads());
 
     if (bundle->getVerbose())
         fprintf(stdout, "Crunched %d PNG files to update cache\n", (int)numFiles);
@@ -881,8 +881,146 @@ status_t updatePreProcessedCache(Bundle* bundle)
     return 0;
 }
 
+/*
+ * An XML file compiled by compileXmlFiles().
+ */
+struct XmlCompileJob {
+    XmlCompileJob(const sp<AaptFile>& _file, bool _checkIds)
+        : file(_file), checkIds(_checkIds), err(NO_ERROR) { }
+
+    sp<AaptFile> file;
+    // Whether to warn about ids defined by the compiled file.
+    bool checkIds;
+
+    sp<XMLNode> root;
+    status_t err;
+};
+
+static void addXmlCompileJobs(Vector<XmlCompileJob*>* jobs,
+        const sp<ResourceTypeSet>& set, const char* resType, bool checkIds)
+{
+    if (set == NULL) {
+        return;
+    }
+    ResourceDirIterator it(set, String8(resType));
+    while (it.next() == NO_ERROR) {
+        jobs->add(new XmlCompileJob(it.getFile(), checkIds));
+    }
+}
+
+class XmlCompileWorkUnit : public WorkQueue::WorkUnit {
+public:
+    enum Step {
+        STEP_PARSE,
+        STEP_FLATTEN,
+    };
+
+    XmlCompileWorkUnit(XmlCompileJob* job, Step step, int options) :
+            mJob(job), mStep(step), mOptions(options) {
+    }
+
+    virtual bool run() {
+        BuildProfile::Scope scope(mStep == STEP_PARSE ? "parseXml" : "flattenXml",
+                mJob->file->getSourceFile());
+        if (mStep == STEP_PARSE) {
+            mJob->root = XMLNode::parse(mJob->file);
+            if (mJob->root == NULL) {
+                mJob->err = UNKNOWN_ERROR;
+            } else {
+                prepareXmlTree(mJob->root, mOptions);
+            }
+        } else if (mJob->err == NO_ERROR) {
+            mJob->err = flattenXmlTree(mJob->root, mJob->file, mOptions);
+        }
+        return true; // continue even if there are errors
+    }
+
+private:
+    XmlCompileJob* mJob;
+    Step mStep;
+    int mOptions;
+};
+
+// Runs a step of the given jobs, on a WorkQueue when several threads are allowed.
+static void runXmlCompileStep(const Bundle* bundle, const Vector<XmlCompileJob*>& jobs,
+        XmlCompileWorkUnit::Step step, int options)
+{
+    const size_t N = jobs.size();
+    if (bundle->getXmlThreads() <= 1 || N <= 1) {
+        for (size_t i = 0; i < N; i++) {
+            XmlCompileWorkUnit(jobs[i], step, options).run();
+        }
+        return;
+    }
+
+    WorkQueue wq(bundle->getXmlThreads(), false);
+    for (size_t i = 0; i < N; i++) {
+        XmlCompileWorkUnit* w = new XmlCompileWorkUnit(jobs[i], step, options);
+        if (wq.schedule(w) != NO_ERROR) {
+            delete w;
+            XmlCompileWorkUnit(jobs[i], step, options).run();
+        }
+    }
+    wq.finish();
+}
+
+/*
+ * Compiles XML files that may reference resources, the same way
+ * compileXmlFile() would one after the other, and deletes the jobs.  The
+ * files are parsed and flattened in parallel; the resources they reference
+ * are resolved on this thread, in order, since that may add entries to the
+ * table.
+ */
+static status_t compileXmlFiles(const Bundle* bundle, const sp<AaptAssets>& assets,
+        ResourceTable* table, const Vector<XmlCompileJob*>& jobs, int options)
+{
+    runXmlCompileStep(bundle, jobs, XmlCompileWorkUnit::STEP_PARSE, options);
+
+    const size_t N = jobs.size();
+    for (size_t i = 0; i < N; i++) {
+        XmlCompileJob* job = jobs[i];
+        if (job->err == NO_ERROR) {
+            BuildProfile::Scope scope("resolveXml", job->file->getSourceFile());
+            job->err = resolveXmlTree(assets, job->root, table, options);
+        }
+    }
+
+    runXmlCompileStep(bundle, jobs, XmlCompileWorkUnit::STEP_FLATTEN, options);
+
+    bool hasErrors = false;
+    for (size_t i = 0; i < N; i++) {
+        XmlCompileJob* job = jobs[i];
+        if (job->err != NO_ERROR) {
+            hasErrors = true;
+        } else if (job->checkIds) {
+            ResXMLTree block;
+            block.setTo(job->file->getData(), job->file->getSize(), true);
+            checkForIds(job->file->getPrintableSource(), block);
+        }
+        delete job;
+    }
+    return hasErrors ? UNKNOWN_ERROR : NO_ERROR;
+}
+
+/*
+ * Returns the file the resource ID cache is saved to, or an empty string if it
+ * isn't saved.  Incremental builds of an APK keep it next to the APK.
+ */
+static String8 getResourceIdCachePath(const Bundle* bundle)
+{
+    if (bundle->getResourceIdCacheFile() != NULL) {
+        return String8(bundle->getResourceIdCacheFile());
+    }
+    if (bundle->getIncremental() && bundle->getOutputAPKFile() != NULL) {
+        return String8(bundle->getOutputAPKFile()) + String8(".ids");
+    }
+    return String8();
+}
+
 status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
 {
+    BuildProfile::Scope phase("parsePackage");
+
     // First, look for a package file to parse.  This is required to
     // be able to generate the resource information.
     sp<AaptGroup> androidManifestFile =
@@ -900,6 +1038,7 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
     NOISY(printf("Creating resources for package %s\n",
                  assets->getPackage().string()));
 
+    phase.next("addIncludedResources");
     ResourceTable table(bundle, String16(assets->getPackage()));
     err = table.addIncludedResources(bundle, assets);
     if (err != NO_ERROR) {
@@ -908,6 +1047,9 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
 
     NOISY(printf("Found %d included resource packages\n", (int)table.size()));
 
+    String8 idCachePath;
+    uint32_t idCacheSignature = 0;
+
     // Standard flags for compiled XML and optional UTF-8 encoding
     int xmlFlags = XML_COMPILE_STANDARD_RESOURCE;
 
@@ -923,6 +1065,7 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
     // First, gather all resource information.
     // --------------------------------------------------------------
 
+    phase.next("collectFiles");
     // resType -> leafName -> group
     KeyedVector<String8, sp<ResourceTypeSet> > *resources =
             new KeyedVector<String8, sp<ResourceTypeSet> >;
@@ -981,9 +1124,11 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
 
     if (drawables != NULL) {
         if (bundle->getOutputAPKFile() != NULL) {
+            phase.next("preProcessImages");
             err = preProcessImages(bundle, assets, drawables, "drawable");
         }
         if (err == NO_ERROR) {
+            phase.next("makeFileResources");
             err = makeFileResources(bundle, assets, &table, drawables, "drawable");
             if (err != NO_ERROR) {
                 hasErrors = true;
@@ -995,9 +1140,11 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
 
     if (mipmaps != NULL) {
         if (bundle->getOutputAPKFile() != NULL) {
+            phase.next("preProcessImages");
             err = preProcessImages(bundle, assets, mipmaps, "mipmap");
         }
         if (err == NO_ERROR) {
+            phase.next("makeFileResources");
             err = makeFileResources(bundle, assets, &table, mipmaps, "mipmap");
             if (err != NO_ERROR) {
                 hasErrors = true;
@@ -1007,6 +1154,7 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
         }
     }
 
+    phase.next("makeFileResources");
     if (layouts != NULL) {
         err = makeFileResources(bundle, assets, &table, layouts, "layout");
         if (err != NO_ERROR) {
@@ -1057,6 +1205,7 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
     }
 
     // compile resources
+    phase.next("compileResourceFiles");
     current = assets;
     while(current.get()) {
         KeyedVector<String8, sp<ResourceTypeSet> > *resources =
@@ -1068,6 +1217,7 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
             ssize_t res;
             while ((res=it.next()) == NO_ERROR) {
                 sp<AaptFile> file = it.getFile();
+                BuildProfile::Scope scope("compileResourceFile", file->getSourceFile());
                 res = compileResourceFile(bundle, assets, file, it.getParams(),
                                           (current!=assets), &table);
                 if (res != NO_ERROR) {
@@ -1078,6 +1228,7 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
         current = current->getOverlay();
     }
 
+    phase.next("makeFileResources");
     if (colors != NULL) {
         err = makeFileResources(bundle, assets, &table, colors, "color");
         if (err != NO_ERROR) {
@@ -1103,10 +1254,22 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
             return UNKNOWN_ERROR;
         }
 
+        phase.next("assignResourceIds");
         err = table.assignResourceIds();
         if (err < NO_ERROR) {
             return err;
         }
+
+        // The IDs looked up by the previous build are still valid if it
+        // assigned the same ones.
+        idCachePath = getResourceIdCachePath(bundle);
+        if (idCachePath.length() > 0) {
+            idCacheSignature = table.getIdSignature();
+            if (ResourceIdCache::load(idCachePath.string(), idCacheSignature) == NO_ERROR
+                    && bundle->getVerbose()) {
+                printf("Loaded resource ID cache %s\n", idCachePath.string());
+            }
+        }
     }
 
     // --------------------------------------------------------------
@@ -1114,142 +1277,39 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
     // resources.
     // --------------------------------------------------------------
 
-    if (layouts != NULL) {
-        ResourceDirIterator it(layouts, String8("layout"));
-        while ((err=it.next()) == NO_ERROR) {
-            String8 src = it.getFile()->getPrintableSource();
-            err = compileXmlFile(assets, it.getFile(), &table, xmlFlags);
-            if (err == NO_ERROR) {
-                ResXMLTree block;
-                block.setTo(it.getFile()->getData(), it.getFile()->getSize(), true);
-                checkForIds(src, block);
-            } else {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
-            hasErrors = true;
-        }
-        err = NO_ERROR;
-    }
-
-    if (anims != NULL) {
-        ResourceDirIterator it(anims, String8("anim"));
-        while ((err=it.next()) == NO_ERROR) {
-            err = compileXmlFile(assets, it.getFile(), &table, xmlFlags);
-            if (err != NO_ERROR) {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
-            hasErrors = true;
-        }
-        err = NO_ERROR;
-    }
-
-    if (animators != NULL) {
-        ResourceDirIterator it(animators, String8("animator"));
-        while ((err=it.next()) == NO_ERROR) {
-            err = compileXmlFile(assets, it.getFile(), &table, xmlFlags);
-            if (err != NO_ERROR) {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
-            hasErrors = true;
-        }
-        err = NO_ERROR;
-    }
-
-    if (interpolators != NULL) {
-        ResourceDirIterator it(interpolators, String8("interpolator"));
-        while ((err=it.next()) == NO_ERROR) {
-            err = compileXmlFile(assets, it.getFile(), &table, xmlFlags);
-            if (err != NO_ERROR) {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
-            hasErrors = true;
-        }
-        err = NO_ERROR;
-    }
-
-    if (transitions != NULL) {
-        ResourceDirIterator it(transitions, String8("transition"));
-        while ((err=it.next()) == NO_ERROR) {
-            err = compileXmlFile(assets, it.getFile(), &table, xmlFlags);
-            if (err != NO_ERROR) {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
-            hasErrors = true;
-        }
-        err = NO_ERROR;
-    }
-
-    if (xmls != NULL) {
-        ResourceDirIterator it(xmls, String8("xml"));
-        while ((err=it.next()) == NO_ERROR) {
-            err = compileXmlFile(assets, it.getFile(), &table, xmlFlags);
-            if (err != NO_ERROR) {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
+    phase.next("compileXmlFiles");
+    {
+        Vector<XmlCompileJob*> jobs;
+        addXmlCompileJobs(&jobs, layouts, "layout", true);
+        addXmlCompileJobs(&jobs, anims, "anim", false);
+        addXmlCompileJobs(&jobs, animators, "animator", false);
+        addXmlCompileJobs(&jobs, interpolators, "interpolator", false);
+        addXmlCompileJobs(&jobs, transitions, "transition", false);
+        addXmlCompileJobs(&jobs, xmls, "xml", false);
+        if (compileXmlFiles(bundle, assets, &table, jobs, xmlFlags) != NO_ERROR) {
             hasErrors = true;
         }
-        err = NO_ERROR;
     }
 
     if (drawables != NULL) {
+        phase.next("postProcessImages");
         err = postProcessImages(assets, &table, drawables);
         if (err != NO_ERROR) {
             hasErrors = true;
         }
     }
 
-    if (colors != NULL) {
-        ResourceDirIterator it(colors, String8("color"));
-        while ((err=it.next()) == NO_ERROR) {
-          err = compileXmlFile(assets, it.getFile(), &table, xmlFlags);
-            if (err != NO_ERROR) {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
-            hasErrors = true;
-        }
-        err = NO_ERROR;
-    }
-
-    if (menus != NULL) {
-        ResourceDirIterator it(menus, String8("menu"));
-        while ((err=it.next()) == NO_ERROR) {
-            String8 src = it.getFile()->getPrintableSource();
-            err = compileXmlFile(assets, it.getFile(), &table, xmlFlags);
-            if (err != NO_ERROR) {
-                hasErrors = true;
-            }
-            ResXMLTree block;
-            block.setTo(it.getFile()->getData(), it.getFile()->getSize(), true);
-            checkForIds(src, block);
-        }
-
-        if (err < NO_ERROR) {
+    phase.next("compileXmlFiles");
+    {
+        Vector<XmlCompileJob*> jobs;
+        addXmlCompileJobs(&jobs, colors, "color", false);
+        addXmlCompileJobs(&jobs, menus, "menu", true);
+        if (compileXmlFiles(bundle, assets, &table, jobs, xmlFlags) != NO_ERROR) {
             hasErrors = true;
         }
-        err = NO_ERROR;
     }
 
+    phase.next("validateLocalizations");
     if (table.validateLocalizations()) {
         hasErrors = true;
     }
@@ -1262,6 +1322,7 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
     String8 manifestPath(manifestFile->getPrintableSource());
 
     // Generate final compiled manifest file.
+    phase.next("compileManifest");
     manifestFile->clearData();
     sp<XMLNode> manifestTree = XMLNode::parse(manifestFile);
     if (manifestTree == NULL) {
@@ -1287,6 +1348,7 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
     ResTable finalResTable;
     sp<AaptFile> resFile;
 
+    phase.next("flatten");
     if (table.hasResources()) {
         sp<AaptSymbols> symbols = assets->getSymbolsFor(String8("R"));
         err = table.addSymbols(symbols);
@@ -1329,6 +1391,7 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
 #endif
     }
 
+    phase.next("validateManifest");
     // Perform a basic validation of the manifest file.  This time we
     // parse it with the comments intact, so that we can use them to
     // generate java docs...  so we are not going to write this one
@@ -1582,6 +1645,11 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
         }
     }
 
+    if (idCachePath.length() > 0
+            && ResourceIdCache::save(idCachePath.string(), idCacheSignature) != NO_ERROR) {
+        fprintf(stderr, "WARNING: Unable to write resource ID cache %s\n", idCachePath.string());
+    }
+
     return err;
 }
 
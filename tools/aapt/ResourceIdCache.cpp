@@ -6,9 +6,12 @@
 #define LOG_TAG "ResourceIdCache"
 
 #include <utils/String16.h>
+#include <utils/String8.h>
 #include <utils/Log.h>
 #include "ResourceIdCache.h"
 #include <map>
+#include <stdio.h>
+#include <unistd.h>
 using namespace std;
 
 
@@ -31,6 +34,13 @@ struct CacheEntry {
 
 static map< uint32_t, CacheEntry > mIdMap;
 
+// Header of a saved cache: magic, version, signature and number of entries.
+// Each entry is then stored as its hash, ID, name length and name, in the
+// native byte order.
+static const uint32_t CACHE_FILE_MAGIC = 0x43444952; // "RIDC"
+static const uint32_t CACHE_FILE_VERSION = 1;
+static const uint32_t MAX_HASHED_NAME_LENGTH = 4096;
+
 
 // djb2; reasonable choice for strings when collisions aren't particularly important
 static inline uint32_t hashround(uint32_t hash, int c) {
@@ -96,6 +106,84 @@ uint32_t ResourceIdCache::store(const android::String16& package,
     return resId;
 }
 
+static bool readUint32(FILE* fp, uint32_t* outValue) {
+    return fread(outValue, sizeof(*outValue), 1, fp) == 1;
+}
+
+static bool writeUint32(FILE* fp, uint32_t value) {
+    return fwrite(&value, sizeof(value), 1, fp) == 1;
+}
+
+status_t ResourceIdCache::load(const char* path, uint32_t signature) {
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return NAME_NOT_FOUND;
+    }
+
+    uint32_t magic, version, savedSignature, count;
+    if (!readUint32(fp, &magic) || !readUint32(fp, &version)
+            || !readUint32(fp, &savedSignature) || !readUint32(fp, &count)
+            || magic != CACHE_FILE_MAGIC || version != CACHE_FILE_VERSION
+            || count > MAX_CACHE_ENTRIES) {
+        fclose(fp);
+        return BAD_VALUE;
+    }
+    if (savedSignature != signature) {
+        // The resources have changed since the cache was saved.
+        fclose(fp);
+        return NAME_NOT_FOUND;
+    }
+
+    status_t err = NO_ERROR;
+    char16_t buffer[MAX_HASHED_NAME_LENGTH];
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t hashcode, id, length;
+        if (!readUint32(fp, &hashcode) || !readUint32(fp, &id) || !readUint32(fp, &length)
+                || length > MAX_HASHED_NAME_LENGTH
+                || fread(buffer, sizeof(char16_t), length, fp) != length) {
+            err = BAD_VALUE;
+            break;
+        }
+        String16 hashedName(buffer, length);
+        if (hash(hashedName) != hashcode) {
+            err = BAD_VALUE;
+            break;
+        }
+        if (mIdMap.size() < MAX_CACHE_ENTRIES && mIdMap.find(hashcode) == mIdMap.end()) {
+            mIdMap[hashcode] = CacheEntry(hashedName, id);
+        }
+    }
+    fclose(fp);
+    return err;
+}
+
+status_t ResourceIdCache::save(const char* path, uint32_t signature) {
+    // Written to a temporary file first, so that an interrupted build doesn't
+    // leave a truncated cache behind.
+    String8 tmpPath(path);
+    tmpPath.appendFormat(".%d.tmp", (int) getpid());
+    FILE* fp = fopen(tmpPath.string(), "wb");
+    if (fp == NULL) {
+        return UNKNOWN_ERROR;
+    }
+
+    bool ok = writeUint32(fp, CACHE_FILE_MAGIC) && writeUint32(fp, CACHE_FILE_VERSION)
+            && writeUint32(fp, signature) && writeUint32(fp, (uint32_t) mIdMap.size());
+    for (map<uint32_t, CacheEntry>::const_iterator item = mIdMap.begin();
+            ok && item != mIdMap.end(); ++item) {
+        const String16& hashedName = (*item).second.hashedName;
+        ok = writeUint32(fp, (*item).first) && writeUint32(fp, (*item).second.id)
+                && writeUint32(fp, (uint32_t) hashedName.size())
+                && fwrite(hashedName.string(), sizeof(char16_t), hashedName.size(), fp)
+                        == hashedName.size();
+    }
+    if (fclose(fp) != 0 || !ok || rename(tmpPath.string(), path) != 0) {
+        unlink(tmpPath.string());
+        return UNKNOWN_ERROR;
+    }
+    return NO_ERROR;
+}
+
 void ResourceIdCache::dump() {
     printf("ResourceIdCache dump:\n");
     printf("Size: %ld\n", mIdMap.size());
@@ -6,6 +6,8 @@
 #ifndef RESOURCE_ID_CACHE_H
 #define RESOURCE_ID_CACHE_H
 
+#include <utils/Errors.h>
+
 namespace android {
 class android::String16;
 
@@ -22,6 +24,16 @@ public:
             bool onlyPublic,
             uint32_t resId);
 
+    /*
+     * Adds the entries saved in a cache file to the cache.  The entries are only
+     * loaded if the file was saved with the same signature, which must identify
+     * every input that the resource IDs depend on.  Entries already in the cache
+     * are kept.
+     */
+    static status_t load(const char* path, uint32_t signature);
+
+    static status_t save(const char* path, uint32_t signature);
+
     static void dump(void);
 };
 
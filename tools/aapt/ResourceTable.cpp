@@ -12,7 +12,10 @@
 
 #include <androidfw/ResourceTypes.h>
 #include <utils/ByteOrder.h>
+#include <utils/JenkinsHash.h>
+#include <ctype.h>
 #include <stdarg.h>
+#include <sys/stat.h>
 
 #define NOISY(x) //x
 
@@ -48,6 +51,18 @@ status_t compileXmlFile(const sp<AaptAssets>& assets,
                         const sp<AaptFile>& target,
                         ResourceTable* table,
                         int options)
+{
+    prepareXmlTree(root, options);
+
+    status_t err = resolveXmlTree(assets, root, table, options);
+    if (err != NO_ERROR) {
+        return err;
+    }
+
+    return flattenXmlTree(root, target, options);
+}
+
+void prepareXmlTree(const sp<XMLNode>& root, int options)
 {
     if ((options&XML_COMPILE_STRIP_WHITESPACE) != 0) {
         root->removeWhitespace(true, NULL);
@@ -58,7 +73,13 @@ status_t compileXmlFile(const sp<AaptAssets>& assets,
     if ((options&XML_COMPILE_UTF8) != 0) {
         root->setUTF8(true);
     }
+}
 
+status_t resolveXmlTree(const sp<AaptAssets>& assets,
+                        const sp<XMLNode>& root,
+                        ResourceTable* table,
+                        int options)
+{
     bool hasErrors = false;
     
     if ((options&XML_COMPILE_ASSIGN_ATTRIBUTE_IDS) != 0) {
@@ -73,13 +94,16 @@ status_t compileXmlFile(const sp<AaptAssets>& assets,
         hasErrors = true;
     }
 
-    if (hasErrors) {
-        return UNKNOWN_ERROR;
-    }
-    
+    return hasErrors ? UNKNOWN_ERROR : NO_ERROR;
+}
+
+status_t flattenXmlTree(const sp<XMLNode>& root,
+                        const sp<AaptFile>& target,
+                        int options)
+{
     NOISY(printf("Input XML Resource:\n"));
     NOISY(root->print());
-    err = root->flatten(target,
+    status_t err = root->flatten(target,
             (options&XML_COMPILE_STRIP_COMMENTS) != 0,
             (options&XML_COMPILE_STRIP_RAW_VALUES) != 0);
     if (err != NO_ERROR) {
@@ -2106,6 +2130,61 @@ uint32_t ResourceTable::getResId(const String16& package,
             getResId(p, t, ei));
 }
 
+static inline uint32_t hashString16(uint32_t hash, const String16& value)
+{
+    hash = JenkinsHashMix(hash, value.size());
+    return JenkinsHashMixShorts(hash, value.string(), value.size());
+}
+
+uint32_t ResourceTable::getIdSignature() const
+{
+    uint32_t hash = 0;
+
+    const Vector<const char*>& includes = mBundle->getPackageIncludes();
+    for (size_t i = 0; i < includes.size(); i++) {
+        // The included packages are identified by their path, size and
+        // modification time rather than hashed, they can be large.
+        hash = hashString16(hash, String16(includes[i]));
+        struct stat st;
+        if (stat(includes[i], &st) == 0) {
+            hash = JenkinsHashMix(hash, (uint32_t) st.st_size);
+            hash = JenkinsHashMix(hash, (uint32_t) st.st_mtime);
+        }
+    }
+
+    const size_t N = mOrderedPackages.size();
+    for (size_t pi = 0; pi < N; pi++) {
+        sp<Package> p = mOrderedPackages.itemAt(pi);
+        if (p == NULL) {
+            continue;
+        }
+        hash = hashString16(hash, p->getName());
+        hash = JenkinsHashMix(hash, (uint32_t) p->getAssignedId());
+
+        const Vector<sp<Type> >& types = p->getOrderedTypes();
+        for (size_t ti = 0; ti < types.size(); ti++) {
+            sp<Type> t = types.itemAt(ti);
+            if (t == NULL) {
+                continue;
+            }
+            hash = hashString16(hash, t->getName());
+            hash = JenkinsHashMix(hash, (uint32_t) t->getIndex());
+
+            const Vector<sp<ConfigList> >& configs = t->getOrderedConfigs();
+            for (size_t ci = 0; ci < configs.size(); ci++) {
+                sp<ConfigList> c = configs.itemAt(ci);
+                if (c == NULL) {
+                    continue;
+                }
+                hash = hashString16(hash, c->getName());
+                hash = JenkinsHashMix(hash, (uint32_t) c->getEntryIndex());
+            }
+        }
+    }
+
+    return JenkinsHashWhiten(hash);
+}
+
 uint32_t ResourceTable::getResId(const String16& ref,
                                  const String16* defType,
                                  const String16* defPackage,
@@ -2653,6 +2732,105 @@ ResourceTable::validateLocalizations(void)
     return err;
 }
 
+// Alignment of the hot types of a table ordered by a type profile.
+static const size_t kTablePageSize = 4096;
+
+/*
+ * Reads a type profile: one "type count" pair per line, where count is the
+ * number of accesses to the type, e.g. from the lookups counted on a device.
+ * Blank lines and lines starting with '#' are ignored.
+ */
+static status_t loadTypeProfile(const char* path, DefaultKeyedVector<String16, uint32_t>* outCounts)
+{
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "ERROR: Unable to open type profile '%s'\n", path);
+        return UNKNOWN_ERROR;
+    }
+
+    char line[512];
+    int lineNo = 0;
+    status_t err = NO_ERROR;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineNo++;
+        char name[256];
+        unsigned long count;
+        const char* cp = line;
+        while (isspace((unsigned char) *cp)) {
+            cp++;
+        }
+        if (*cp == '\0' || *cp == '#') {
+            continue;
+        }
+        if (sscanf(cp, "%255s %lu", name, &count) != 2) {
+            fprintf(stderr, "%s:%d: ERROR: Expected a type name and an access count\n",
+                    path, lineNo);
+            err = UNKNOWN_ERROR;
+            break;
+        }
+        outCounts->add(String16(name), (uint32_t) count);
+    }
+    fclose(fp);
+    return err;
+}
+
+/*
+ * Writes a package chunk to the table, inserting padding chunks so that each
+ * of the given offsets of the package starts on a page of the table.
+ */
+static status_t writeAlignedPackage(const sp<AaptFile>& dest, size_t tableStart,
+                                    const sp<AaptFile>& package,
+                                    const Vector<size_t>& alignedOffsets)
+{
+    const size_t packageStart = dest->getSize();
+    const uint8_t* const data = (const uint8_t*)package->getData();
+    size_t pos = 0;
+    for (size_t i = 0; i <= alignedOffsets.size(); i++) {
+        const size_t next = i < alignedOffsets.size() ? alignedOffsets[i] : package->getSize();
+        status_t err = dest->writeData(data + pos, next - pos);
+        if (err != NO_ERROR) {
+            return err;
+        }
+        pos = next;
+        if (i == alignedOffsets.size()) {
+            break;
+        }
+
+        size_t padding = (kTablePageSize - (dest->getSize() - tableStart) % kTablePageSize)
+                % kTablePageSize;
+        if (padding == 0) {
+            continue;
+        }
+        if (padding < sizeof(ResChunk_header)) {
+            padding += kTablePageSize;
+        }
+        // Readers skip chunks they don't know.
+        const size_t paddingStart = dest->getSize();
+        ResChunk_header* chunk = (ResChunk_header*)
+            (((uint8_t*)dest->editData(paddingStart+padding)) + paddingStart);
+        if (chunk == NULL) {
+            return NO_MEMORY;
+        }
+        memset(chunk, 0, padding);
+        chunk->type = htods(RES_NULL_TYPE);
+        chunk->headerSize = htods(sizeof(*chunk));
+        chunk->size = htodl(padding);
+    }
+
+    ResTable_package* header = (ResTable_package*)
+        (((uint8_t*)dest->editData()) + packageStart);
+    header->header.size = htodl(dest->getSize() - packageStart);
+    return NO_ERROR;
+}
+
+// Orders the entries of a config index by language only: they are added in
+// the order of their configs.
+static int compareConfigIndexEntries(const ResTable_configIndexEntry& lhs,
+                                     const ResTable_configIndexEntry& rhs)
+{
+    return memcmp(lhs.language, rhs.language, sizeof(lhs.language));
+}
+
 status_t ResourceTable::flatten(Bundle* bundle, const sp<AaptFile>& dest)
 {
     ResourceFilter filter;
@@ -2663,6 +2841,14 @@ status_t ResourceTable::flatten(Bundle* bundle, const sp<AaptFile>& dest)
 
     const ConfigDescription nullConfig;
 
+    DefaultKeyedVector<String16, uint32_t> typeProfile(0);
+    if (bundle->getTableProfile() != NULL) {
+        err = loadTypeProfile(bundle->getTableProfile(), &typeProfile);
+        if (err != NO_ERROR) {
+            return err;
+        }
+    }
+
     const size_t N = mOrderedPackages.size();
     size_t pi;
 
@@ -2764,6 +2950,8 @@ status_t ResourceTable::flatten(Bundle* bundle, const sp<AaptFile>& dest)
     
     // Now build the array of package chunks.
     Vector<sp<AaptFile> > flatPackages;
+    // For each package, the offsets of its chunks to page-align.
+    Vector<Vector<size_t> > flatPackageAlignments;
     for (pi=0; pi<N; pi++) {
         sp<Package> p = mOrderedPackages.itemAt(pi);
         if (p->getTypes().size() == 0) {
@@ -2810,9 +2998,42 @@ status_t ResourceTable::flatten(Bundle* bundle, const sp<AaptFile>& dest)
             return amt;
         }
 
-        // Build the type chunks inside of this package.
+        // The types are written in the same order as the type string block,
+        // unless a type profile is given: the types it lists are then written
+        // first, from the most to the least accessed, so that they share as
+        // few pages as possible.  Readers find the types by their ID.
+        Vector<size_t> typeOrder;
+        size_t hotTypes = 0;
         for (size_t ti=0; ti<N; ti++) {
-            // Retrieve them in the same order as the type string block.
+            size_t len;
+            const uint32_t count = typeProfile.valueFor(
+                    String16(p->getTypeStrings().stringAt(ti, &len)));
+            if (count == 0) {
+                typeOrder.add(ti);
+                continue;
+            }
+            size_t pos = 0;
+            while (pos < hotTypes && typeProfile.valueFor(String16(
+                    p->getTypeStrings().stringAt(typeOrder[pos], &len))) >= count) {
+                pos++;
+            }
+            typeOrder.insertAt(ti, pos);
+            hotTypes++;
+        }
+
+        Vector<size_t> alignments;
+        if (hotTypes > 0) {
+            alignments.add(data->getSize());
+        }
+
+        // Build the type chunks inside of this package.
+        for (size_t oi=0; oi<N; oi++) {
+            const size_t ti = typeOrder[oi];
+            if (oi == hotTypes && hotTypes > 0) {
+                // The first cold type starts on a page of its own.
+                alignments.add(data->getSize());
+            }
+
             size_t len;
             String16 typeName(p->getTypeStrings().stringAt(ti, &len));
             sp<Type> t = p->getTypes().valueFor(typeName);
@@ -2879,6 +3100,10 @@ status_t ResourceTable::flatten(Bundle* bundle, const sp<AaptFile>& dest)
             const size_t NC = t->getUniqueConfigs().size();
             
             const size_t typeSize = sizeof(ResTable_type) + sizeof(uint32_t)*N;
+
+            // The configs written, sorted by language for the config index.
+            Vector<ResTable_configIndexEntry> configIndex;
+            size_t configLanguages = 0;
             
             for (size_t ci=0; ci<NC; ci++) {
                 ConfigDescription config = t->getUniqueConfigs().itemAt(ci);
@@ -2909,6 +3134,24 @@ status_t ResourceTable::flatten(Bundle* bundle, const sp<AaptFile>& dest)
                 if (filterable && !filter.match(config)) {
                     continue;
                 }
+
+                ResTable_configIndexEntry indexEntry;
+                memset(&indexEntry, 0, sizeof(indexEntry));
+                if (config.language[0] != 0) {
+                    indexEntry.language[0] = config.language[0];
+                    indexEntry.language[1] = config.language[1];
+                }
+                indexEntry.config = htods(configIndex.size());
+                size_t indexPos = configIndex.size();
+                while (indexPos > 0 && compareConfigIndexEntries(
+                        configIndex[indexPos-1], indexEntry) > 0) {
+                    indexPos--;
+                }
+                if (indexPos == 0 || compareConfigIndexEntries(
+                        configIndex[indexPos-1], indexEntry) != 0) {
+                    configLanguages++;
+                }
+                configIndex.insertAt(indexEntry, indexPos);
                 
                 const size_t typeStart = data->getSize();
 
@@ -2979,6 +3222,27 @@ status_t ResourceTable::flatten(Bundle* bundle, const sp<AaptFile>& dest)
                 tHeader->header.size = htodl(data->getSize()-typeStart);
             }
 
+            // The index only helps getEntry() if it can rule out configs.
+            if (configLanguages > 1 && configIndex.size() <= 0xffff) {
+                const size_t indexSize = sizeof(ResTable_configIndex)
+                        + sizeof(ResTable_configIndexEntry)*configIndex.size();
+                const size_t indexStart = data->getSize();
+                ResTable_configIndex* ciHeader = (ResTable_configIndex*)
+                    (((uint8_t*)data->editData(indexStart+indexSize)) + indexStart);
+                if (ciHeader == NULL) {
+                    fprintf(stderr, "ERROR: out of memory creating ResTable_configIndex\n");
+                    return NO_MEMORY;
+                }
+                memset(ciHeader, 0, sizeof(*ciHeader));
+                ciHeader->header.type = htods(RES_TABLE_CONFIG_INDEX_TYPE);
+                ciHeader->header.headerSize = htods(sizeof(*ciHeader));
+                ciHeader->header.size = htodl(indexSize);
+                ciHeader->id = ti+1;
+                ciHeader->configCount = htodl(configIndex.size());
+                memcpy(ciHeader+1, configIndex.array(),
+                        sizeof(ResTable_configIndexEntry)*configIndex.size());
+            }
+
             for (size_t i = 0; i < N; ++i) {
                 if (!validResources[i]) {
                     sp<ConfigList> c = t->getOrderedConfigs().itemAt(i);
@@ -2997,6 +3261,7 @@ status_t ResourceTable::flatten(Bundle* bundle, const sp<AaptFile>& dest)
         header->lastPublicKey = htodl(p->getKeyStrings().size());
 
         flatPackages.add(data);
+        flatPackageAlignments.add(alignments);
     }
 
     // And now write out the final chunks.
@@ -3030,8 +3295,8 @@ status_t ResourceTable::flatten(Bundle* bundle, const sp<AaptFile>& dest)
     #endif
     
     for (pi=0; pi<flatPackages.size(); pi++) {
-        err = dest->writeData(flatPackages[pi]->getData(),
-                              flatPackages[pi]->getSize());
+        err = writeAlignedPackage(dest, dataStart, flatPackages[pi],
+                                  flatPackageAlignments[pi]);
         if (err != NO_ERROR) {
             fprintf(stderr, "ERROR: out of memory creating package chunk for ResTable_header\n");
             return err;
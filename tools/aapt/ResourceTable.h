@@ -48,6 +48,22 @@ status_t compileXmlFile(const sp<AaptAssets>& assets,
                         ResourceTable* table,
                         int options = XML_COMPILE_STANDARD_RESOURCE);
 
+/*
+ * The steps of compileXmlFile(), for callers that compile many files at once.
+ * prepareXmlTree() and flattenXmlTree() only touch the tree and the target
+ * file, so different files can go through them on different threads.
+ * resolveXmlTree() looks up and may add resources in the table, so it must
+ * run on one thread, in the order the files would have been compiled.
+ */
+void prepareXmlTree(const sp<XMLNode>& xmlTree, int options);
+status_t resolveXmlTree(const sp<AaptAssets>& assets,
+                        const sp<XMLNode>& xmlTree,
+                        ResourceTable* table,
+                        int options);
+status_t flattenXmlTree(const sp<XMLNode>& xmlTree,
+                        const sp<AaptFile>& target,
+                        int options);
+
 status_t compileResourceFile(Bundle* bundle,
                              const sp<AaptAssets>& assets,
                              const sp<AaptFile>& in,
@@ -219,6 +235,13 @@ public:
                        const ConfigDescription* config = NULL);
 
     status_t assignResourceIds();
+
+    /*
+     * Returns a hash of everything the resource IDs depend on: the packages,
+     * types and entries of the table with their assigned IDs, and the packages
+     * included with -I.  Identifies the resource ID caches that can be reused.
+     */
+    uint32_t getIdSignature() const;
     status_t addSymbols(const sp<AaptSymbols>& outSymbols = NULL);
     void addLocalization(const String16& name, const String8& locale);
     status_t validateLocalizations(void);
@@ -1,5 +1,7 @@
 #include "SourcePos.h"
 
+#include <utils/threads.h>
+
 #include <stdarg.h>
 #include <vector>
 
@@ -26,6 +28,8 @@ struct ErrorPos
     void print(FILE* to) const;
 };
 
+// Errors may be reported from several WorkQueue threads.
+static Mutex g_errorsLock;
 static vector<ErrorPos> g_errors;
 
 ErrorPos::ErrorPos()
@@ -130,6 +134,7 @@ SourcePos::error(const char* fmt, ...) const
         *p = '\0';
         p--;
     }
+    Mutex::Autolock _l(g_errorsLock);
     g_errors.push_back(ErrorPos(this->file, this->line, String8(buf), true));
     return retval;
 }
@@ -155,12 +160,14 @@ SourcePos::warning(const char* fmt, ...) const
 bool
 SourcePos::hasErrors()
 {
+    Mutex::Autolock _l(g_errorsLock);
     return g_errors.size() > 0;
 }
 
 void
 SourcePos::printErrors(FILE* to)
 {
+    Mutex::Autolock _l(g_errorsLock);
     vector<ErrorPos>::const_iterator it;
     for (it=g_errors.begin(); it!=g_errors.end(); it++) {
         it->print(to);
@@ -8,6 +8,7 @@
 #include "ResourceTable.h"
 
 #include <utils/ByteOrder.h>
+#include <utils/JenkinsHash.h>
 #include <utils/SortedVector.h>
 #include "qsort_r_compat.h"
 
@@ -102,10 +103,21 @@ int StringPool::entry::compare(const entry& o) const {
 }
 
 StringPool::StringPool(bool utf8) :
-        mUTF8(utf8), mValues(-1)
+        mUTF8(utf8)
 {
 }
 
+hash_t StringPool::hashValue(const String16& value)
+{
+    return JenkinsHashWhiten(JenkinsHashMixShorts(0, value.string(), value.size()));
+}
+
+ssize_t StringPool::findValue(const String16& value) const
+{
+    ssize_t index = mValues.find(-1, hashValue(value), value);
+    return index >= 0 ? mValues.entryAt(index).pos : -1;
+}
+
 ssize_t StringPool::add(const String16& value, const Vector<entry_style_span>& spans,
         const String8* configTypeName, const ResTable_config* config)
 {
@@ -119,8 +131,7 @@ ssize_t StringPool::add(const String16& value, const Vector<entry_style_span>& s
 ssize_t StringPool::add(const String16& value,
         bool mergeDuplicates, const String8* configTypeName, const ResTable_config* config)
 {
-    ssize_t vidx = mValues.indexOfKey(value);
-    ssize_t pos = vidx >= 0 ? mValues.valueAt(vidx) : -1;
+    ssize_t pos = findValue(value);
     ssize_t eidx = pos >= 0 ? mEntryArray.itemAt(pos) : -1;
     if (eidx < 0) {
         eidx = mEntries.add(entry(value));
@@ -161,20 +172,20 @@ ssize_t StringPool::add(const String16& value,
         }
     }
 
-    const bool first = vidx < 0;
+    const bool first = pos < 0;
     const bool styled = (pos >= 0 && (size_t)pos < mEntryStyleArray.size()) ?
         mEntryStyleArray[pos].spans.size() : 0;
     if (first || styled || !mergeDuplicates) {
         pos = mEntryArray.add(eidx);
         if (first) {
-            vidx = mValues.add(value, pos);
+            mValues.add(hashValue(value), value_entry(value, pos));
         }
         entry& ent = mEntries.editItemAt(eidx);
         ent.indices.add(pos);
     }
 
-    NOISY(printf("Adding string %s to pool: pos=%d eidx=%d vidx=%d\n",
-            String8(value).string(), pos, eidx, vidx));
+    NOISY(printf("Adding string %s to pool: pos=%d eidx=%d\n",
+            String8(value).string(), pos, eidx));
     
     return pos;
 }
@@ -329,7 +340,7 @@ void StringPool::sortByConfig()
     mValues.clear();
     for (size_t i=0; i<mEntries.size(); i++) {
         const entry& ent = mEntries[i];
-        mValues.add(ent.value, ent.indices[0]);
+        mValues.add(hashValue(ent.value), value_entry(ent.value, ent.indices[0]));
     }
 
 #if 0
@@ -566,7 +577,7 @@ ssize_t StringPool::offsetForString(const String16& val) const
 
 const Vector<size_t>* StringPool::offsetsForString(const String16& val) const
 {
-    ssize_t pos = mValues.valueFor(val);
+    ssize_t pos = findValue(val);
     if (pos < 0) {
         return NULL;
     }
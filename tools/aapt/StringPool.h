@@ -11,6 +11,7 @@
 #include "AaptAssets.h"
 
 #include <androidfw/ResourceTypes.h>
+#include <utils/BasicHashtable.h>
 #include <utils/String16.h>
 #include <utils/TypeHelpers.h>
 
@@ -140,6 +141,21 @@ public:
 private:
     static int config_sort(void* state, const void* lhs, const void* rhs);
 
+    // An entry of mValues.
+    struct value_entry {
+        value_entry(const String16& _value, ssize_t _pos) : value(_value), pos(_pos) { }
+
+        const String16& getKey() const { return value; }
+
+        String16 value;
+        ssize_t pos;
+    };
+
+    static hash_t hashValue(const String16& value);
+
+    // Returns the first index of mEntryArray where value was added, or -1.
+    ssize_t findValue(const String16& value) const;
+
     const bool                              mUTF8;
 
     // The following data structures represent the actual structures
@@ -165,7 +181,8 @@ private:
 
     // Unique set of all the strings added to the pool, mapped to
     // the first index of mEntryArray where the value was added.
-    DefaultKeyedVector<String16, ssize_t>   mValues;
+    // Hashed, since it is queried for every string that is added.
+    BasicHashtable<String16, value_entry>   mValues;
     // This array maps from the original position a string was placed at
     // in mEntryArray to its new position after being sorted with sortByConfig().
     Vector<size_t>                          mOriginalPosToNewPos;
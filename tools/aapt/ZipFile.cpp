@@ -33,6 +33,12 @@
 #include <errno.h>
 #include <assert.h>
 
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 using namespace android;
 
 /*
@@ -414,7 +420,8 @@ status_t ZipFile::addCommon(const char* fileName, const void* data, size_t size,
     if (sourceType == ZipEntry::kCompressStored) {
         if (compressionMethod == ZipEntry::kCompressDeflated) {
             bool failed = false;
-            result = compressFpToFp(mZipFp, inputFp, data, size, &crc);
+            result = compressFpToFp(mZipFp, NULL, inputFp, data, size,
+                        mCompressionLevel, &crc);
             if (result != NO_ERROR) {
                 ALOGD("compression failed, storing\n");
                 failed = true;
@@ -529,6 +536,132 @@ bail:
     return result;
 }
 
+/*
+ * Deflate a file or a buffer into memory, so that the expensive part of
+ * adding it can happen away from the archive.  The data is marked as
+ * stored when it doesn't compress by at least 10%, like addCommon() does.
+ */
+/*static*/ status_t ZipFile::precompress(const char* fileName,
+    const void* data, size_t size, int level, Precompressed* pOut)
+{
+    FILE* inputFp = NULL;
+    status_t result;
+
+    pOut->method = ZipEntry::kCompressStored;
+    pOut->data.clear();
+
+    if (!data) {
+        inputFp = fopen(fileName, FILE_OPEN_RO);
+        if (inputFp == NULL)
+            return errnoToStatus(errno);
+    }
+
+    result = compressFpToFp(NULL, &pOut->data, inputFp, data, size, level,
+                &pOut->crc);
+    pOut->uncompressedLen = inputFp ? ftell(inputFp) : size;
+    if (inputFp != NULL)
+        fclose(inputFp);
+    if (result != NO_ERROR) {
+        pOut->data.clear();
+        return result;
+    }
+
+    long src = pOut->uncompressedLen;
+    long dst = pOut->data.size();
+    if (dst + (dst / 10) > src) {
+        ALOGD("insufficient compression (src=%ld dst=%ld), storing\n",
+            src, dst);
+        pOut->data.clear();
+    } else {
+        pOut->method = ZipEntry::kCompressDeflated;
+    }
+    return NO_ERROR;
+}
+
+/*
+ * Add a file that was deflated by precompress().  This writes the same
+ * bytes addCommon() would have written if it had compressed the file
+ * itself at the same level.
+ */
+status_t ZipFile::addPrecompressed(const char* fileName, const void* data,
+    size_t size, const char* storageName,
+    const Precompressed& precompressed, ZipEntry** ppEntry)
+{
+    ZipEntry* pEntry = NULL;
+    status_t result = NO_ERROR;
+    long lfhPosn, startPosn, endPosn;
+    time_t modWhen;
+
+    if (precompressed.method != ZipEntry::kCompressDeflated) {
+        return addCommon(fileName, data, size, storageName,
+                         ZipEntry::kCompressStored,
+                         ZipEntry::kCompressStored, ppEntry);
+    }
+
+    if (mReadOnly)
+        return INVALID_OPERATION;
+
+    /* make sure we're in a reasonable state */
+    assert(mZipFp != NULL);
+    assert(mEntries.size() == mEOCD.mTotalNumEntries);
+
+    /* make sure it doesn't already exist */
+    if (getEntryByName(storageName) != NULL)
+        return ALREADY_EXISTS;
+
+    if (fseek(mZipFp, mEOCD.mCentralDirOffset, SEEK_SET) != 0)
+        return UNKNOWN_ERROR;
+
+    pEntry = new ZipEntry;
+    pEntry->initNew(storageName, NULL);
+
+    mNeedCDRewrite = true;
+
+    /* write the place-holder LFH, then the compressed data */
+    lfhPosn = ftell(mZipFp);
+    pEntry->mLFH.write(mZipFp);
+    startPosn = ftell(mZipFp);
+
+    if (fwrite(precompressed.data.array(), 1, precompressed.data.size(),
+            mZipFp) != precompressed.data.size()) {
+        ALOGD("failed copying compressed data in\n");
+        result = UNKNOWN_ERROR;
+        goto bail;
+    }
+    endPosn = ftell(mZipFp);
+
+    pEntry->setDataInfo(precompressed.uncompressedLen, endPosn - startPosn,
+        precompressed.crc, ZipEntry::kCompressDeflated);
+    if (fileName != NULL) {
+        struct stat sb;
+        modWhen = stat(fileName, &sb) == 0 ? sb.st_mtime : (time_t) -1;
+    } else {
+        modWhen = getModTime(fileno(mZipFp));
+    }
+    pEntry->setModWhen(modWhen);
+    pEntry->setLFHOffset(lfhPosn);
+    mEOCD.mNumEntries++;
+    mEOCD.mTotalNumEntries++;
+    mEOCD.mCentralDirSize = 0;      // mark invalid; set by flush()
+    mEOCD.mCentralDirOffset = endPosn;
+
+    /* go back and write the LFH */
+    if (fseek(mZipFp, lfhPosn, SEEK_SET) != 0) {
+        result = UNKNOWN_ERROR;
+        goto bail;
+    }
+    pEntry->mLFH.write(mZipFp);
+
+    mEntries.add(pEntry);
+    if (ppEntry != NULL)
+        *ppEntry = pEntry;
+    pEntry = NULL;
+
+bail:
+    delete pEntry;
+    return result;
+}
+
 /*
  * Add an entry by copying it from another zip file.  If "padding" is
  * nonzero, the specified number of bytes will be added to the "extra"
@@ -690,10 +823,69 @@ status_t ZipFile::copyDataToFp(FILE* dstFp,
     return NO_ERROR;
 }
 
+/*
+ * Copy up to "length" bytes from "srcFp" to "dstFp" inside the kernel,
+ * without reading them into our buffers.  Returns the number of bytes
+ * copied, which falls short of "length" when the kernel can't copy between
+ * the two files.
+ *
+ * On exit, both streams are seeked immediately past the bytes copied.
+ */
+static long copyFileRange(FILE* dstFp, FILE* srcFp, long length)
+{
+#ifdef __linux__
+    if (fflush(dstFp) != 0)
+        return 0;
+    off_t srcPosn = ftello(srcFp);
+    off_t dstPosn = ftello(dstFp);
+    if (srcPosn < 0 || dstPosn < 0)
+        return 0;
+    int srcFd = fileno(srcFp);
+    int dstFd = fileno(dstFp);
+
+    long copied = 0;
+#ifdef __NR_copy_file_range
+    while (copied < length) {
+        loff_t srcOff = srcPosn + copied;
+        loff_t dstOff = dstPosn + copied;
+        long amt = syscall(__NR_copy_file_range, srcFd, &srcOff, dstFd, &dstOff,
+                (size_t) (length - copied), 0);
+        if (amt < 0 && errno == EINTR)
+            continue;
+        if (amt <= 0)
+            break;
+        copied += amt;
+    }
+#endif
+    // sendfile() writes at the file offset of the destination.
+    if (copied < length && lseek(dstFd, dstPosn + copied, SEEK_SET) == dstPosn + copied) {
+        while (copied < length) {
+            off_t srcOff = srcPosn + copied;
+            ssize_t amt = sendfile(dstFd, srcFd, &srcOff, (size_t) (length - copied));
+            if (amt < 0 && errno == EINTR)
+                continue;
+            if (amt <= 0)
+                break;
+            copied += amt;
+        }
+    }
+
+    // The kernel moved the data behind stdio's back; resync the streams.
+    if (fseeko(srcFp, srcPosn + copied, SEEK_SET) != 0
+            || fseeko(dstFp, dstPosn + copied, SEEK_SET) != 0) {
+        return -1;
+    }
+    return copied;
+#else
+    return 0;
+#endif
+}
+
 /*
  * Copy some of the bytes in "src" to "dst".
  *
- * If "pCRC32" is NULL, the CRC will not be computed.
+ * If "pCRC32" is NULL, the CRC will not be computed, and the bytes are
+ * copied by the kernel where possible.
  *
  * On exit, "srcFp" will be seeked to the end of the file, and "dstFp"
  * will be seeked immediately past the data just written.
@@ -706,6 +898,14 @@ status_t ZipFile::copyPartialFpToFp(FILE* dstFp, FILE* srcFp, long length,
 
     if (pCRC32 != NULL)
         *pCRC32 = crc32(0L, Z_NULL, 0);
+    else if (length > 0) {
+        long copied = copyFileRange(dstFp, srcFp, length);
+        if (copied < 0) {
+            ALOGD("seek after copying %ld bytes failed\n", length);
+            return UNKNOWN_ERROR;
+        }
+        length -= copied;
+    }
 
     while (length) {
         long readSize;
@@ -735,13 +935,16 @@ status_t ZipFile::copyPartialFpToFp(FILE* dstFp, FILE* srcFp, long length,
 }
 
 /*
- * Compress all of the data in "srcFp" and write it to "dstFp".
+ * Compress all of the data in "srcFp" and write it to "dstFp".  If "data"
+ * is non-NULL it is compressed instead of "srcFp", and if "dstFp" is NULL
+ * the compressed data is appended to "dstBuf".
  *
  * On exit, "srcFp" will be seeked to the end of the file, and "dstFp"
  * will be seeked immediately past the compressed data.
  */
-status_t ZipFile::compressFpToFp(FILE* dstFp, FILE* srcFp,
-    const void* data, size_t size, unsigned long* pCRC32)
+status_t ZipFile::compressFpToFp(FILE* dstFp, Vector<unsigned char>* dstBuf,
+    FILE* srcFp, const void* data, size_t size, int level,
+    unsigned long* pCRC32)
 {
     status_t result = NO_ERROR;
     const size_t kBufSize = 32768;
@@ -775,7 +978,7 @@ status_t ZipFile::compressFpToFp(FILE* dstFp, FILE* srcFp,
     zstream.avail_out = kBufSize;
     zstream.data_type = Z_UNKNOWN;
 
-    zerr = deflateInit2(&zstream, Z_BEST_COMPRESSION,
+    zerr = deflateInit2(&zstream, level,
         Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY);
     if (zerr != Z_OK) {
         result = UNKNOWN_ERROR;
@@ -841,7 +1044,9 @@ status_t ZipFile::compressFpToFp(FILE* dstFp, FILE* srcFp,
             (zerr == Z_STREAM_END && zstream.avail_out != (uInt) kBufSize))
         {
             ALOGV("+++ writing %d bytes\n", (int) (zstream.next_out - outBuf));
-            if (fwrite(outBuf, 1, zstream.next_out - outBuf, dstFp) !=
+            if (dstFp == NULL) {
+                dstBuf->appendArray(outBuf, zstream.next_out - outBuf);
+            } else if (fwrite(outBuf, 1, zstream.next_out - outBuf, dstFp) !=
                 (size_t)(zstream.next_out - outBuf))
             {
                 ALOGD("write %d failed in deflate\n",
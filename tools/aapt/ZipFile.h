@@ -44,7 +44,8 @@ namespace android {
 class ZipFile {
 public:
     ZipFile(void)
-      : mZipFp(NULL), mReadOnly(false), mNeedCDRewrite(false)
+      : mZipFp(NULL), mReadOnly(false), mNeedCDRewrite(false),
+        mCompressionLevel(kDefaultCompressionLevel)
       {}
     ~ZipFile(void) {
         if (!mReadOnly)
@@ -116,6 +117,48 @@ public:
                          compressionMethod, ppEntry);
     }
 
+    /*
+     * The result of deflating a file ahead of time with precompress().  If
+     * the data didn't compress well enough, "method" is kCompressStored and
+     * the file will be stored instead.
+     */
+    struct Precompressed {
+        Precompressed(void)
+          : method(ZipEntry::kCompressStored), uncompressedLen(0), crc(0)
+          {}
+        int             method;
+        long            uncompressedLen;
+        unsigned long   crc;
+        Vector<unsigned char> data;
+    };
+
+    /*
+     * Deflate a file, or an in-memory buffer if "data" is non-NULL, at
+     * compression level "level".  This doesn't touch any archive, so it can
+     * run on a worker thread while other files are added.
+     */
+    static status_t precompress(const char* fileName, const void* data,
+        size_t size, int level, Precompressed* pOut);
+
+    /*
+     * Add a file, or an in-memory buffer if "data" is non-NULL, that was
+     * deflated with precompress().  The source is only read again if it
+     * has to be stored.
+     *
+     * If "ppEntry" is non-NULL, a pointer to the new entry will be returned.
+     */
+    status_t addPrecompressed(const char* fileName, const void* data,
+        size_t size, const char* storageName,
+        const Precompressed& precompressed, ZipEntry** ppEntry);
+
+    /*
+     * Set the zlib compression level (0-9) used for deflated entries.  The
+     * default is the best compression.
+     */
+    enum { kDefaultCompressionLevel = 9 };
+    void setCompressionLevel(int level) { mCompressionLevel = level; }
+    int getCompressionLevel(void) const { return mCompressionLevel; }
+
     /*
      * Add an entry by copying it from another zip file.  If "padding" is
      * nonzero, the specified number of bytes will be added to the "extra"
@@ -235,9 +278,11 @@ private:
         unsigned long* pCRC32);
     /* like memmove(), but on parts of a single file */
     status_t filemove(FILE* fp, off_t dest, off_t src, size_t n);
-    /* compress all of "srcFp" into "dstFp", using Deflate */
-    status_t compressFpToFp(FILE* dstFp, FILE* srcFp,
-        const void* data, size_t size, unsigned long* pCRC32);
+    /* compress all of "srcFp" (or "data") into "dstFp" (or "dstBuf"),
+     * using Deflate */
+    static status_t compressFpToFp(FILE* dstFp, Vector<unsigned char>* dstBuf,
+        FILE* srcFp, const void* data, size_t size, int level,
+        unsigned long* pCRC32);
 
     /* get modification date from a file descriptor */
     time_t getModTime(int fd);
@@ -257,6 +302,9 @@ private:
     /* set this when we trash the central dir */
     bool            mNeedCDRewrite;
 
+    /* zlib level for deflated entries */
+    int             mCompressionLevel;
+
     /*
      * One ZipEntry per entry in the zip file.  I'm using pointers instead
      * of objects because it's easier than making operator= work for the
@@ -32,7 +32,7 @@ static int wantVersion = 0;
 
 #define SALT_LEN 8
 
-#define ADD_OPTS "n:v:os:"
+#define ADD_OPTS "n:v:os:k:r:"
 static const struct option longopts[] = {
     {"help",       no_argument, &wantUsage,   1},
     {"version",    no_argument, &wantVersion, 1},
@@ -42,6 +42,8 @@ static const struct option longopts[] = {
     {"version",    required_argument, NULL, 'v'},
     {"overlay",    optional_argument, NULL, 'o'},
     {"salt",       required_argument, NULL, 's'},
+    {"kdf",        required_argument, NULL, 'k'},
+    {"rounds",     required_argument, NULL, 'r'},
 
     {NULL, 0, NULL, '\0'}
 };
@@ -53,6 +55,8 @@ public:
             , packageVersion(-1)
             , overlay(false)
             , salted(false)
+            , kdfDigest(OBB_KDF_SHA1)
+            , kdfRounds(OBB_KDF_DEFAULT_ROUNDS)
     {
         memset(&salt, 0, sizeof(salt));
     }
@@ -62,6 +66,8 @@ public:
     bool overlay;
     bool salted;
     unsigned char salt[SALT_LEN];
+    int kdfDigest;
+    int kdfRounds;
 };
 
 /*
@@ -80,7 +86,9 @@ void usage(void)
         "     -v <OBB version>       sets the OBB version (required)\n"
         "     -o                     sets the OBB overlay flag\n"
         "     -s <8 byte hex salt>   sets the crypto key salt (if encrypted)\n"
-        "\n");
+        "     -k sha1|sha256         sets the PBKDF2 digest of the key (default sha1)\n"
+        "     -r <rounds>            sets the PBKDF2 rounds of the key (default %d)\n"
+        "\n", OBB_KDF_DEFAULT_ROUNDS);
     fprintf(stderr,
         " %s r[emove] FILENAME\n"
         "   Removes the OBB signature from the file.\n\n", gProgName);
@@ -102,6 +110,7 @@ void doAdd(const char* filename, struct PackageInfo* info) {
     if (info->salted) {
         obb->setSalt(info->salt, SALT_LEN);
     }
+    obb->setKdf(info->kdfDigest, info->kdfRounds);
 
     if (!obb->writeTo(filename)) {
         fprintf(stderr, "ERROR: %s: couldn't write OBB signature: %s\n",
@@ -151,6 +160,8 @@ void doInfo(const char* filename) {
     } else {
         printf("<empty>\n");
     }
+    printf("         KDF: PBKDF2-%s, %d rounds\n",
+            obb->getKdfDigest() == OBB_KDF_SHA256 ? "SHA256" : "SHA1", obb->getKdfRounds());
 }
 
 bool fromHex(char h, unsigned char *b) {
@@ -234,6 +245,27 @@ int main(int argc, char* const argv[])
                 package_info.salt[i] = b;
             }
             break;
+        case 'k':
+            if (strcmp(optarg, "sha1") == 0) {
+                package_info.kdfDigest = OBB_KDF_SHA1;
+            } else if (strcmp(optarg, "sha256") == 0) {
+                package_info.kdfDigest = OBB_KDF_SHA256;
+            } else {
+                fprintf(stderr, "ERROR: KDF digest must be sha1 or sha256\n\n");
+                wantUsage = 1;
+                goto bail;
+            }
+            break;
+        case 'r': {
+            char* end;
+            package_info.kdfRounds = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || package_info.kdfRounds <= 0) {
+                fprintf(stderr, "ERROR: invalid rounds; should be a positive integer!\n\n");
+                wantUsage = 1;
+                goto bail;
+            }
+            break;
+        }
         case '?':
             wantUsage = 1;
             goto bail;
@@ -261,6 +261,8 @@ echo "Successfully created \`${filename}'"
 if [ ${use_crypto} -eq 1 ]; then \
     echo "salt for use with obbtool is:"
     echo "${salt}"
+    echo "PBKDF2 digest and rounds for use with obbtool are:"
+    echo "-k ${kdf} -r ${rounds}"
 fi
 
 #
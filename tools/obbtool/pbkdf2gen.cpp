@@ -19,26 +19,147 @@
 #include <sys/types.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 /**
  * Simple program to generate a key based on PBKDF2 with preset inputs.
  *
- * Will print out the salt and key in hex.
+ * Will print out the salt and key in hex, along with the digest and the
+ * number of rounds, as shell assignments.  The rounds can be given, or
+ * calibrated so that deriving the key takes a target time on this machine;
+ * the -b option only prints how long each round count takes.
  */
 
 #define SALT_LEN 8
 #define ROUNDS 1024
 #define KEY_BITS 128
 
+/* Rounds are calibrated by timing at least this long a run. */
+#define CALIBRATE_MIN_MS 100
+
+static void usage(const char* progName)
+{
+    fprintf(stderr,
+        "Usage: %s [ OPTIONS ] <password>\n"
+        "   Options:\n"
+        "     -d sha1|sha256   sets the PBKDF2 digest (default sha1)\n"
+        "     -r <rounds>      sets the number of rounds (default %d)\n"
+        "     -t <ms>          picks the rounds that take this long on this machine\n"
+        "     -b               prints how long a range of round counts takes\n",
+        progName, ROUNDS);
+}
+
+static bool derive(const char* password, const unsigned char* salt, int rounds,
+        const EVP_MD* digest, unsigned char* rawKey)
+{
+    return PKCS5_PBKDF2_HMAC(password, strlen(password), salt, SALT_LEN,
+            rounds, digest, KEY_BITS / 8, rawKey) == 1;
+}
+
+static double nowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/*
+ * Returns how many milliseconds deriving a key with the given rounds takes,
+ * or a negative number on failure.
+ */
+static double timeRounds(const char* password, const unsigned char* salt, int rounds,
+        const EVP_MD* digest)
+{
+    unsigned char rawKey[KEY_BITS / 8];
+    double start = nowMs();
+    if (!derive(password, salt, rounds, digest, rawKey)) {
+        return -1;
+    }
+    return nowMs() - start;
+}
+
+/*
+ * Returns the number of rounds that take about targetMs to derive, never
+ * fewer than the default.  The rounds are doubled until a run is long
+ * enough to time, then scaled to the target.
+ */
+static int calibrateRounds(const char* password, const unsigned char* salt, int targetMs,
+        const EVP_MD* digest)
+{
+    int rounds = ROUNDS;
+    double elapsed;
+    while ((elapsed = timeRounds(password, salt, rounds, digest)) < CALIBRATE_MIN_MS
+            && elapsed >= 0 && rounds < (1 << 29)) {
+        rounds *= 2;
+    }
+    if (elapsed <= 0) {
+        return -1;
+    }
+
+    double scaled = rounds * (targetMs / elapsed);
+    if (scaled < ROUNDS) {
+        return ROUNDS;
+    } else if (scaled > (1 << 30)) {
+        return 1 << 30;
+    }
+    return (int) scaled;
+}
+
 int main(int argc, char* argv[])
 {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <password>\n", argv[0]);
+    const EVP_MD* digest = EVP_sha1();
+    const char* digestName = "sha1";
+    int rounds = ROUNDS;
+    int targetMs = 0;
+    bool benchmark = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:r:t:b")) != -1) {
+        switch (opt) {
+        case 'd':
+            if (strcmp(optarg, "sha1") == 0) {
+                digest = EVP_sha1();
+            } else if (strcmp(optarg, "sha256") == 0) {
+                digest = EVP_sha256();
+            } else {
+                fprintf(stderr, "Unknown digest '%s'; should be sha1 or sha256\n", optarg);
+                exit(1);
+            }
+            digestName = optarg;
+            break;
+        case 'r':
+            rounds = atoi(optarg);
+            if (rounds <= 0) {
+                fprintf(stderr, "Invalid number of rounds '%s'\n", optarg);
+                exit(1);
+            }
+            break;
+        case 't':
+            targetMs = atoi(optarg);
+            if (targetMs <= 0) {
+                fprintf(stderr, "Invalid target time '%s'\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'b':
+            benchmark = true;
+            break;
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
         exit(1);
     }
+    const char* password = argv[optind];
 
     int fd = open("/dev/urandom", O_RDONLY);
     if (fd < 0) {
@@ -56,10 +177,29 @@ int main(int argc, char* argv[])
     }
     close(fd);
 
-    unsigned char rawKey[KEY_BITS];
+    if (benchmark) {
+        for (int r = ROUNDS; r <= ROUNDS * 256; r *= 2) {
+            double elapsed = timeRounds(password, salt, r, digest);
+            if (elapsed < 0) {
+                fprintf(stderr, "Could not generate PBKDF2 output\n");
+                exit(1);
+            }
+            printf("%s %9d rounds: %10.2f ms\n", digestName, r, elapsed);
+        }
+        return 0;
+    }
+
+    if (targetMs > 0) {
+        rounds = calibrateRounds(password, salt, targetMs, digest);
+        if (rounds < 0) {
+            fprintf(stderr, "Could not generate PBKDF2 output\n");
+            exit(1);
+        }
+    }
+
+    unsigned char rawKey[KEY_BITS / 8];
 
-    if (PKCS5_PBKDF2_HMAC_SHA1(argv[1], strlen(argv[1]), salt, SALT_LEN,
-            ROUNDS, KEY_BITS, rawKey) != 1) {
+    if (!derive(password, salt, rounds, digest, rawKey)) {
         fprintf(stderr, "Could not generate PBKDF2 output: %s\n", strerror(errno));
         exit(1);
     }
@@ -75,4 +215,7 @@ int main(int argc, char* argv[])
         printf("%02x", rawKey[i]);
     }
     printf("\n");
+
+    printf("kdf=%s\n", digestName);
+    printf("rounds=%d\n", rounds);
 }